@@ -178,6 +178,26 @@ static void mem_avoid_init(unsigned long input, unsigned long input_size,
 	mem_avoid[4].size = BOOT_STACK_SIZE;
 }
 
+/* Does this memory vector overlap memory preserved across kexec? */
+static bool mem_avoid_preserved(struct mem_vector *img,
+				struct setup_data *ptr)
+{
+	struct e820entry *entry = (struct e820entry *)ptr->data;
+	int i, nr = ptr->len / sizeof(*entry);
+
+	for (i = 0; i < nr; i++) {
+		struct mem_vector avoid;
+
+		avoid.start = entry[i].addr;
+		avoid.size = entry[i].size;
+
+		if (mem_overlaps(img, &avoid))
+			return true;
+	}
+
+	return false;
+}
+
 /* Does this memory vector overlap a known avoided area? */
 static bool mem_avoid_overlap(struct mem_vector *img)
 {
@@ -200,6 +220,10 @@ static bool mem_avoid_overlap(struct mem_vector *img)
 		if (mem_overlaps(img, &avoid))
 			return true;
 
+		if (ptr->type == SETUP_KEXEC_PRESERVE &&
+		    mem_avoid_preserved(img, ptr))
+			return true;
+
 		ptr = (struct setup_data *)(unsigned long)ptr->next;
 	}
 
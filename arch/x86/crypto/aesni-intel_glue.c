@@ -98,8 +98,11 @@ asmlinkage void aesni_cbc_dec(struct crypto_aes_ctx *ctx, u8 *out,
 int crypto_fpu_init(void);
 void crypto_fpu_exit(void);
 
-#define AVX_GEN2_OPTSIZE 640
-#define AVX_GEN4_OPTSIZE 4096
+/*
+ * Below this size the SSE implementation keeps up with the AVX one, which
+ * sets up eight counter blocks even for a short message.
+ */
+#define AVX_GEN2_OPTSIZE 256
 
 #ifdef CONFIG_X86_64
 
@@ -188,7 +191,6 @@ static void aesni_gcm_enc_avx(void *ctx, u8 *out,
 		aesni_gcm_enc(ctx, out, in, plaintext_len, iv, hash_subkey, aad,
 				aad_len, auth_tag, auth_tag_len);
 	} else {
-		aesni_gcm_precomp_avx_gen2(ctx, hash_subkey);
 		aesni_gcm_enc_avx_gen2(ctx, out, in, plaintext_len, iv, aad,
 					aad_len, auth_tag, auth_tag_len);
 	}
@@ -204,7 +206,6 @@ static void aesni_gcm_dec_avx(void *ctx, u8 *out,
 		aesni_gcm_dec(ctx, out, in, ciphertext_len, iv, hash_subkey, aad,
 				aad_len, auth_tag, auth_tag_len);
 	} else {
-		aesni_gcm_precomp_avx_gen2(ctx, hash_subkey);
 		aesni_gcm_dec_avx_gen2(ctx, out, in, ciphertext_len, iv, aad,
 					aad_len, auth_tag, auth_tag_len);
 	}
@@ -235,15 +236,10 @@ static void aesni_gcm_enc_avx2(void *ctx, u8 *out,
 			u8 *auth_tag, unsigned long auth_tag_len)
 {
        struct crypto_aes_ctx *aes_ctx = (struct crypto_aes_ctx*)ctx;
-	if ((plaintext_len < AVX_GEN2_OPTSIZE) || (aes_ctx-> key_length != AES_KEYSIZE_128)) {
+	if (aes_ctx->key_length != AES_KEYSIZE_128) {
 		aesni_gcm_enc(ctx, out, in, plaintext_len, iv, hash_subkey, aad,
 				aad_len, auth_tag, auth_tag_len);
-	} else if (plaintext_len < AVX_GEN4_OPTSIZE) {
-		aesni_gcm_precomp_avx_gen2(ctx, hash_subkey);
-		aesni_gcm_enc_avx_gen2(ctx, out, in, plaintext_len, iv, aad,
-					aad_len, auth_tag, auth_tag_len);
 	} else {
-		aesni_gcm_precomp_avx_gen4(ctx, hash_subkey);
 		aesni_gcm_enc_avx_gen4(ctx, out, in, plaintext_len, iv, aad,
 					aad_len, auth_tag, auth_tag_len);
 	}
@@ -255,15 +251,10 @@ static void aesni_gcm_dec_avx2(void *ctx, u8 *out,
 			u8 *auth_tag, unsigned long auth_tag_len)
 {
        struct crypto_aes_ctx *aes_ctx = (struct crypto_aes_ctx*)ctx;
-	if ((ciphertext_len < AVX_GEN2_OPTSIZE) || (aes_ctx-> key_length != AES_KEYSIZE_128)) {
+	if (aes_ctx->key_length != AES_KEYSIZE_128) {
 		aesni_gcm_dec(ctx, out, in, ciphertext_len, iv, hash_subkey,
 				aad, aad_len, auth_tag, auth_tag_len);
-	} else if (ciphertext_len < AVX_GEN4_OPTSIZE) {
-		aesni_gcm_precomp_avx_gen2(ctx, hash_subkey);
-		aesni_gcm_dec_avx_gen2(ctx, out, in, ciphertext_len, iv, aad,
-					aad_len, auth_tag, auth_tag_len);
 	} else {
-		aesni_gcm_precomp_avx_gen4(ctx, hash_subkey);
 		aesni_gcm_dec_avx_gen4(ctx, out, in, ciphertext_len, iv, aad,
 					aad_len, auth_tag, auth_tag_len);
 	}
@@ -882,6 +873,26 @@ out_free_ablkcipher:
 	return ret;
 }
 
+/*
+ * The AVX implementations keep the powers HashKey^1..8 in the context
+ * right behind the AES-128 key schedule.  Derive them once per key rather
+ * than once per request; both generations use the same table, the gen2
+ * precompute additionally stores the Karatsuba halves it needs.
+ */
+static int rfc4106_set_hash_table(struct aesni_rfc4106_gcm_ctx *ctx)
+{
+#ifdef CONFIG_AS_AVX
+	if (boot_cpu_has(X86_FEATURE_AVX) &&
+	    ctx->aes_key_expanded.key_length == AES_KEYSIZE_128) {
+		kernel_fpu_begin();
+		aesni_gcm_precomp_avx_gen2(&ctx->aes_key_expanded,
+					   ctx->hash_subkey);
+		kernel_fpu_end();
+	}
+#endif
+	return 0;
+}
+
 static int common_rfc4106_set_key(struct crypto_aead *aead, const u8 *key,
 				  unsigned int key_len)
 {
@@ -898,7 +909,8 @@ static int common_rfc4106_set_key(struct crypto_aead *aead, const u8 *key,
 
 	return aes_set_key_common(crypto_aead_tfm(aead),
 				  &ctx->aes_key_expanded, key, key_len) ?:
-	       rfc4106_set_hash_subkey(ctx->hash_subkey, key, key_len);
+	       rfc4106_set_hash_subkey(ctx->hash_subkey, key, key_len) ?:
+	       rfc4106_set_hash_table(ctx);
 }
 
 static int rfc4106_set_key(struct crypto_aead *parent, const u8 *key,
@@ -936,6 +948,18 @@ static int rfc4106_set_authsize(struct crypto_aead *parent,
 	return crypto_aead_setauthsize(&cryptd_tfm->base, authsize);
 }
 
+/*
+ * A request can be processed in place if its scatterlist is a single entry
+ * that maps as a whole: either it does not cross a page or the pages are
+ * in the linear mapping, which is the common case for an ESP packet.
+ */
+static inline bool rfc4106_sg_is_linear(struct scatterlist *sg)
+{
+	return sg_is_last(sg) &&
+	       (!PageHighMem(sg_page(sg)) ||
+		sg->offset + sg->length <= PAGE_SIZE);
+}
+
 static int helper_rfc4106_encrypt(struct aead_request *req)
 {
 	u8 one_entry_in_sg = 0;
@@ -963,10 +987,8 @@ static int helper_rfc4106_encrypt(struct aead_request *req)
 		*(iv+4+i) = req->iv[i];
 	*((__be32 *)(iv+12)) = counter;
 
-	if (sg_is_last(req->src) &&
-	    req->src->offset + req->src->length <= PAGE_SIZE &&
-	    sg_is_last(req->dst) &&
-	    req->dst->offset + req->dst->length <= PAGE_SIZE) {
+	if (rfc4106_sg_is_linear(req->src) &&
+	    rfc4106_sg_is_linear(req->dst)) {
 		one_entry_in_sg = 1;
 		scatterwalk_start(&src_sg_walk, req->src);
 		assoc = scatterwalk_map(&src_sg_walk);
@@ -1045,10 +1067,8 @@ static int helper_rfc4106_decrypt(struct aead_request *req)
 		*(iv+4+i) = req->iv[i];
 	*((__be32 *)(iv+12)) = counter;
 
-	if (sg_is_last(req->src) &&
-	    req->src->offset + req->src->length <= PAGE_SIZE &&
-	    sg_is_last(req->dst) &&
-	    req->dst->offset + req->dst->length <= PAGE_SIZE) {
+	if (rfc4106_sg_is_linear(req->src) &&
+	    rfc4106_sg_is_linear(req->dst)) {
 		one_entry_in_sg = 1;
 		scatterwalk_start(&src_sg_walk, req->src);
 		assoc = scatterwalk_map(&src_sg_walk);
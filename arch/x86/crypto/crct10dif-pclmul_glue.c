@@ -104,6 +104,27 @@ static int chksum_digest(struct shash_desc *desc, const u8 *data,
 	return __chksum_finup(&ctx->crc, data, length, out);
 }
 
+/*
+ * One FPU section for the whole batch.  The callers hand in at most a
+ * page worth of blocks, which bounds the time spent non-preemptible.
+ */
+static void crc_t10dif_pcl_blocks(const unsigned char *data,
+				  unsigned int interval, unsigned int count,
+				  __u16 *crcs)
+{
+	unsigned int i;
+
+	if (irq_fpu_usable()) {
+		kernel_fpu_begin();
+		for (i = 0; i < count; i++, data += interval)
+			crcs[i] = crc_t10dif_pcl(0, data, interval);
+		kernel_fpu_end();
+	} else {
+		for (i = 0; i < count; i++, data += interval)
+			crcs[i] = crc_t10dif_generic(0, data, interval);
+	}
+}
+
 static struct shash_alg alg = {
 	.digestsize		=	CRC_T10DIF_DIGEST_SIZE,
 	.init		=	chksum_init,
@@ -129,14 +150,20 @@ MODULE_DEVICE_TABLE(x86cpu, crct10dif_cpu_id);
 
 static int __init crct10dif_intel_mod_init(void)
 {
+	int ret;
+
 	if (!x86_match_cpu(crct10dif_cpu_id))
 		return -ENODEV;
 
-	return crypto_register_shash(&alg);
+	ret = crypto_register_shash(&alg);
+	if (!ret)
+		crc_t10dif_register_blocks(crc_t10dif_pcl_blocks);
+	return ret;
 }
 
 static void __exit crct10dif_intel_mod_fini(void)
 {
+	crc_t10dif_unregister_blocks(crc_t10dif_pcl_blocks);
 	crypto_unregister_shash(&alg);
 }
 
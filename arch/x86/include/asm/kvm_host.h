@@ -41,8 +41,18 @@
 
 #define KVM_PIO_PAGE_OFFSET 1
 #define KVM_COALESCED_MMIO_PAGE_OFFSET 2
+
+/*
+ * Dirty ring entries kept free for what a vcpu may still push after its
+ * ring went soft-full and before it gets out to userspace, including a
+ * full PML buffer (512 entries).
+ */
+#define KVM_DIRTY_RING_RSVD_ENTRIES (64 + 512)
 #define KVM_HALT_POLL_NS_DEFAULT 400000
 
+/* kvm->mmu_lock is a rwlock, see arch/x86/kvm/mmu.c */
+#define __KVM_HAVE_ARCH_MMU_RWLOCK
+
 #define KVM_IRQCHIP_NUM_PINS  KVM_IOAPIC_NUM_PINS
 
 #define CR0_RESERVED_BITS                                               \
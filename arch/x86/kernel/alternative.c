@@ -642,6 +642,11 @@ void __init alternative_instructions(void)
 				(unsigned long)__smp_locks_end);
 #endif
 
+#ifdef CONFIG_NUMA_AWARE_SPINLOCKS
+	/* Must be done before the pv_lock_ops call sites get patched. */
+	cna_configure_spin_lock_slowpath();
+#endif
+
 	apply_paravirt(__parainstructions, __parainstructions_end);
 
 	restart_nmi();
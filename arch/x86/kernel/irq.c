@@ -465,6 +465,11 @@ void fixup_irqs(void)
 		irq_force_complete_move(desc);
 
 		if (cpumask_any_and(affinity, cpu_online_mask) >= nr_cpu_ids) {
+			/* Managed irqs wait for their cpus to come back */
+			if (irq_affinity_offline_managed(desc)) {
+				raw_spin_unlock(&desc->lock);
+				continue;
+			}
 			break_affinity = 1;
 			affinity = cpu_online_mask;
 		}
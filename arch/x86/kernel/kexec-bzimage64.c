@@ -29,6 +29,9 @@
 #include <asm/kexec-bzimage64.h>
 
 #define MAX_ELFCOREHDR_STR_LEN	30	/* elfcorehdr=0x<64bit-value> */
+#define MAX_HANDOVER_STR_LEN	34	/* kexec_handover=0x<64bit-value> */
+#define MAX_CMDLINE_PREFIX_LEN	\
+	max(MAX_ELFCOREHDR_STR_LEN, MAX_HANDOVER_STR_LEN)
 
 /*
  * Defines lowest physical address for various segments. Not sure where
@@ -78,6 +81,9 @@ static int setup_cmdline(struct kimage *image, struct boot_params *params,
 	if (image->type == KEXEC_TYPE_CRASH) {
 		len = sprintf(cmdline_ptr,
 			"elfcorehdr=0x%lx ", image->arch.elf_load_addr);
+	} else if (kexec_handover_paddr()) {
+		len = sprintf(cmdline_ptr, "kexec_handover=0x%llx ",
+			(unsigned long long)kexec_handover_paddr());
 	}
 	memcpy(cmdline_ptr + len, cmdline, cmdline_len);
 	cmdline_len += len;
@@ -195,6 +201,40 @@ setup_efi_state(struct boot_params *params, unsigned long params_load_addr,
 }
 #endif /* CONFIG_EFI */
 
+static int add_preserved_entry(u64 start, u64 size, void *arg)
+{
+	struct setup_data *sd = arg;
+	struct e820entry *entry = (void *)sd->data + sd->len;
+
+	entry->addr = start;
+	entry->size = size;
+	entry->type = E820_RESERVED;
+	sd->len += sizeof(*entry);
+
+	return 0;
+}
+
+/*
+ * Tell the decompressor of the next kernel about preserved memory, so
+ * that KASLR does not pick a spot on top of it.  The kernel itself only
+ * learns about the ranges from kexec_handover=<addr>, after it has been
+ * decompressed and relocated.
+ */
+static void
+setup_kexec_preserve(struct boot_params *params,
+		     unsigned long params_load_addr,
+		     unsigned int preserve_setup_data_offset)
+{
+	struct setup_data *sd = (void *)params + preserve_setup_data_offset;
+
+	sd->type = SETUP_KEXEC_PRESERVE;
+	sd->len = 0;
+	kexec_preserved_mem_walk(sd, add_preserved_entry);
+
+	sd->next = params->hdr.setup_data;
+	params->hdr.setup_data = params_load_addr + preserve_setup_data_offset;
+}
+
 static int
 setup_boot_parameters(struct kimage *image, struct boot_params *params,
 		      unsigned long params_load_addr,
@@ -343,6 +383,7 @@ static void *bzImage64_load(struct kimage *image, char *kernel,
 	void *stack;
 	unsigned int setup_hdr_offset = offsetof(struct boot_params, hdr);
 	unsigned int efi_map_offset, efi_map_sz, efi_setup_data_offset;
+	unsigned int preserve_setup_data_offset, nr_preserved = 0;
 
 	header = (struct setup_header *)(kernel + setup_hdr_offset);
 	setup_sects = header->setup_sects;
@@ -362,10 +403,11 @@ static void *bzImage64_load(struct kimage *image, char *kernel,
 
 	/*
 	 * In case of crash dump, we will append elfcorehdr=<addr> to
-	 * command line. Make sure it does not overflow
+	 * command line, otherwise kexec_handover=<addr> for preserved
+	 * memory. Make sure it does not overflow
 	 */
-	if (cmdline_len + MAX_ELFCOREHDR_STR_LEN > header->cmdline_size) {
-		pr_debug("Appending elfcorehdr=<addr> to command line exceeds maximum allowed length\n");
+	if (cmdline_len + MAX_CMDLINE_PREFIX_LEN > header->cmdline_size) {
+		pr_debug("Appending elfcorehdr=<addr> or kexec_handover=<addr> to command line exceeds maximum allowed length\n");
 		return ERR_PTR(-EINVAL);
 	}
 
@@ -401,11 +443,17 @@ static void *bzImage64_load(struct kimage *image, char *kernel,
 	efi_map_sz = efi_get_runtime_map_size();
 	efi_map_sz = ALIGN(efi_map_sz, 16);
 	params_cmdline_sz = sizeof(struct boot_params) + cmdline_len +
-				MAX_ELFCOREHDR_STR_LEN;
+				MAX_CMDLINE_PREFIX_LEN;
 	params_cmdline_sz = ALIGN(params_cmdline_sz, 16);
 	params_misc_sz = params_cmdline_sz + efi_map_sz +
 				sizeof(struct setup_data) +
 				sizeof(struct efi_setup_data);
+	preserve_setup_data_offset = params_misc_sz;
+	if (image->type != KEXEC_TYPE_CRASH)
+		nr_preserved = kexec_preserved_nr_ranges();
+	if (nr_preserved)
+		params_misc_sz += sizeof(struct setup_data) +
+				  nr_preserved * sizeof(struct e820entry);
 
 	params = kzalloc(params_misc_sz, GFP_KERNEL);
 	if (!params)
@@ -492,6 +540,10 @@ static void *bzImage64_load(struct kimage *image, char *kernel,
 	if (ret)
 		goto out_free_params;
 
+	if (nr_preserved)
+		setup_kexec_preserve(params, bootparam_load_addr,
+				     preserve_setup_data_offset);
+
 	/* Allocate loader specific data */
 	ldata = kzalloc(sizeof(struct bzimage64_data), GFP_KERNEL);
 	if (!ldata) {
@@ -317,6 +317,51 @@ static void kvm_register_steal_time(void)
 
 static DEFINE_PER_CPU(unsigned long, kvm_apic_eoi) = KVM_PV_EOI_DISABLED;
 
+static DEFINE_PER_CPU(cpumask_var_t, __pv_tlb_mask);
+
+/*
+ * A vCPU the host has preempted would only answer the flush IPI once it
+ * runs again, with the sender spinning all that time.  Ask the host to
+ * flush its TLB before it next enters the guest instead, and only IPI
+ * the vCPUs that are running.
+ */
+static void kvm_flush_tlb_others(const struct cpumask *cpumask,
+				 struct mm_struct *mm, unsigned long start,
+				 unsigned long end)
+{
+	struct cpumask *flushmask = this_cpu_cpumask_var_ptr(__pv_tlb_mask);
+	struct kvm_steal_time *src;
+	u8 state;
+	int cpu;
+
+	if (unlikely(!flushmask)) {
+		native_flush_tlb_others(cpumask, mm, start, end);
+		return;
+	}
+
+	cpumask_copy(flushmask, cpumask);
+
+	for_each_cpu(cpu, flushmask) {
+		src = &per_cpu(steal_time, cpu);
+		state = READ_ONCE(src->preempted);
+		if (!(state & KVM_VCPU_PREEMPTED))
+			continue;
+
+		/* Fails if the vCPU was scheduled in meanwhile: IPI it */
+		if (cmpxchg(&src->preempted, state,
+			    state | KVM_VCPU_FLUSH_TLB) == state)
+			cpumask_clear_cpu(cpu, flushmask);
+	}
+
+	native_flush_tlb_others(flushmask, mm, start, end);
+}
+
+static bool kvm_pv_tlb_flush_supported(void)
+{
+	return kvm_para_has_feature(KVM_FEATURE_PV_TLB_FLUSH) &&
+	       kvm_para_has_feature(KVM_FEATURE_STEAL_TIME);
+}
+
 static void kvm_guest_apic_eoi_write(u32 reg, u32 val)
 {
 	/**
@@ -495,6 +540,9 @@ void __init kvm_guest_init(void)
 		pv_time_ops.steal_clock = kvm_steal_clock;
 	}
 
+	if (kvm_pv_tlb_flush_supported())
+		pv_mmu_ops.flush_tlb_others = kvm_flush_tlb_others;
+
 	if (kvm_para_has_feature(KVM_FEATURE_PV_EOI))
 		apic_set_eoi_write(kvm_guest_apic_eoi_write);
 
@@ -572,6 +620,25 @@ static __init int activate_jump_labels(void)
 }
 arch_initcall(activate_jump_labels);
 
+/*
+ * Before the other CPUs come up; until then there is nobody to flush.
+ * A CPU without its mask falls back to plain IPIs.
+ */
+static __init int kvm_setup_pv_tlb_flush(void)
+{
+	int cpu;
+
+	if (!kvm_para_available() || !kvm_pv_tlb_flush_supported())
+		return 0;
+
+	for_each_possible_cpu(cpu)
+		zalloc_cpumask_var_node(per_cpu_ptr(&__pv_tlb_mask, cpu),
+					GFP_KERNEL, cpu_to_node(cpu));
+
+	return 0;
+}
+early_initcall(kvm_setup_pv_tlb_flush);
+
 #ifdef CONFIG_PARAVIRT_SPINLOCKS
 
 /* Kick a cpu by its apicid. Used to wake up a halted vcpu */
@@ -548,7 +548,8 @@ static inline int __do_cpuid_ent(struct kvm_cpuid_entry2 *entry, u32 function,
 			     (1 << KVM_FEATURE_PV_UNHALT);
 
 		if (sched_info_on())
-			entry->eax |= (1 << KVM_FEATURE_STEAL_TIME);
+			entry->eax |= (1 << KVM_FEATURE_STEAL_TIME) |
+				      (1 << KVM_FEATURE_PV_TLB_FLUSH);
 
 		entry->ebx = 0;
 		entry->ecx = 0;
@@ -2005,6 +2005,32 @@ static void accumulate_steal_time(struct kvm_vcpu *vcpu)
 	vcpu->arch.st.accum_steal = delta;
 }
 
+/*
+ * Other vCPUs add KVM_VCPU_FLUSH_TLB with a cmpxchg in guest memory, so
+ * the byte has to be cleared atomically there too, not through the
+ * cached copy, or a flush request could be lost.
+ */
+static u8 kvm_steal_time_clear_preempted(struct kvm_vcpu *vcpu)
+{
+	gpa_t gpa = vcpu->arch.st.msr_val & KVM_STEAL_VALID_BITS;
+	struct kvm_steal_time *st;
+	struct page *page;
+	u8 preempted;
+
+	page = kvm_vcpu_gfn_to_page(vcpu, gpa >> PAGE_SHIFT);
+	if (is_error_page(page))
+		return 0;
+
+	st = kmap_atomic(page) + offset_in_page(gpa);
+	preempted = xchg(&st->preempted, 0);
+	kunmap_atomic(st);
+
+	kvm_release_page_dirty(page);
+	kvm_vcpu_mark_page_dirty(vcpu, gpa >> PAGE_SHIFT);
+
+	return preempted;
+}
+
 static void record_steal_time(struct kvm_vcpu *vcpu)
 {
 	accumulate_steal_time(vcpu);
@@ -2016,6 +2042,13 @@ static void record_steal_time(struct kvm_vcpu *vcpu)
 		&vcpu->arch.st.steal, sizeof(struct kvm_steal_time))))
 		return;
 
+	/* Do the TLB flushes other vCPUs queued instead of an IPI */
+	if (vcpu->arch.st.steal.preempted) {
+		if (kvm_steal_time_clear_preempted(vcpu) & KVM_VCPU_FLUSH_TLB)
+			kvm_make_request(KVM_REQ_TLB_FLUSH, vcpu);
+		vcpu->arch.st.steal.preempted = 0;
+	}
+
 	vcpu->arch.st.steal.steal += vcpu->arch.st.accum_steal;
 	vcpu->arch.st.steal.version += 2;
 	vcpu->arch.st.accum_steal = 0;
@@ -2738,8 +2771,28 @@ void kvm_arch_vcpu_load(struct kvm_vcpu *vcpu, int cpu)
 	vcpu->arch.switch_db_regs |= KVM_DEBUGREG_RELOAD;
 }
 
+static void kvm_steal_time_set_preempted(struct kvm_vcpu *vcpu)
+{
+	if (!(vcpu->arch.st.msr_val & KVM_MSR_ENABLED))
+		return;
+
+	/*
+	 * The byte is zero while the vCPU runs and nobody else writes it
+	 * then, so a plain write is enough.  This may run from the preempt
+	 * notifier: don't fault the page in, the flag is only a hint.
+	 */
+	vcpu->arch.st.steal.preempted = KVM_VCPU_PREEMPTED;
+
+	pagefault_disable();
+	kvm_write_guest_cached(vcpu->kvm, &vcpu->arch.st.stime,
+			       &vcpu->arch.st.steal,
+			       sizeof(struct kvm_steal_time));
+	pagefault_enable();
+}
+
 void kvm_arch_vcpu_put(struct kvm_vcpu *vcpu)
 {
+	kvm_steal_time_set_preempted(vcpu);
 	kvm_x86_ops->vcpu_put(vcpu);
 	kvm_put_guest_fpu(vcpu);
 	vcpu->arch.last_host_tsc = rdtsc();
@@ -3694,6 +3747,9 @@ static int kvm_vm_ioctl_enable_cap(struct kvm *kvm,
 		kvm->arch.disabled_quirks = cap->args[0];
 		r = 0;
 		break;
+	case KVM_CAP_DIRTY_LOG_RING:
+		r = kvm_vm_ioctl_enable_dirty_log_ring(kvm, cap->args[0]);
+		break;
 	case KVM_CAP_SPLIT_IRQCHIP: {
 		mutex_lock(&kvm->lock);
 		r = -EINVAL;
@@ -5148,9 +5204,9 @@ static bool reexecute_instruction(struct kvm_vcpu *vcpu, gva_t cr2,
 	if (vcpu->arch.mmu.direct_map) {
 		unsigned int indirect_shadow_pages;
 
-		spin_lock(&vcpu->kvm->mmu_lock);
+		write_lock(&vcpu->kvm->mmu_lock);
 		indirect_shadow_pages = vcpu->kvm->arch.indirect_shadow_pages;
-		spin_unlock(&vcpu->kvm->mmu_lock);
+		write_unlock(&vcpu->kvm->mmu_lock);
 
 		if (indirect_shadow_pages)
 			kvm_mmu_unprotect_page(vcpu->kvm, gpa_to_gfn(gpa));
@@ -6398,6 +6454,10 @@ static int vcpu_enter_guest(struct kvm_vcpu *vcpu)
 			r = 0;
 			goto out;
 		}
+		if (kvm_dirty_ring_check_request(vcpu)) {
+			r = 0;
+			goto out;
+		}
 		if (kvm_check_request(KVM_REQ_DEACTIVATE_FPU, vcpu)) {
 			vcpu->fpu_active = 0;
 			kvm_x86_ops->fpu_deactivate(vcpu);
@@ -1181,6 +1181,32 @@ __do_page_fault(struct pt_regs *regs, unsigned long error_code,
 	 * validate the source. If this is invalid we can skip the address
 	 * space check, thus avoiding the deadlock:
 	 */
+#ifdef CONFIG_PER_VMA_LOCK
+	/*
+	 * User faults are first tried under the vma lock alone.  These run
+	 * without FAULT_FLAG_ALLOW_RETRY since there is no mmap_sem to drop.
+	 */
+	if (!(error_code & PF_USER))
+		goto lock_mmap;
+
+	vma = lock_vma_under_rcu(mm, address);
+	if (!vma)
+		goto lock_mmap;
+
+	if (unlikely(access_error(error_code, vma))) {
+		vma_end_read(vma);
+		goto lock_mmap;
+	}
+	fault = handle_mm_fault(mm, vma, address,
+				flags & ~FAULT_FLAG_ALLOW_RETRY);
+	vma_end_read(vma);
+
+	if (!(fault & VM_FAULT_RETRY)) {
+		major |= fault & VM_FAULT_MAJOR;
+		goto done;
+	}
+lock_mmap:
+#endif
 	if (unlikely(!down_read_trylock(&mm->mmap_sem))) {
 		if ((error_code & PF_USER) == 0 &&
 		    !search_exception_tables(regs->ip)) {
@@ -1269,6 +1295,9 @@ good_area:
 	}
 
 	up_read(&mm->mmap_sem);
+#ifdef CONFIG_PER_VMA_LOCK
+done:
+#endif
 	if (unlikely(fault & VM_FAULT_ERROR)) {
 		mm_fault_error(regs, error_code, address, fault);
 		return;
@@ -0,0 +1,494 @@
+/*
+ * Latency target based I/O controller for cgroups
+ *
+ * Each cgroup can set a completion latency target per device through the
+ * "latency" file of the io controller:
+ *
+ *	MAJ:MIN target=<usecs>
+ *
+ * Completion latencies of every group are sampled into windows of
+ * IOLAT_WINDOW_NSEC.  When a window ends with a group averaging above its
+ * target, all groups with a looser target, or no target at all, get their
+ * queue depth halved.  Windows in which every group meets its target scale
+ * the throttled groups back up until they run unlimited again.
+ *
+ * Throttling happens when a request is allocated in the blk-mq submission
+ * path, legacy request_fn queues are not throttled.  Groups are handled
+ * flat, a target only protects the group it is set on.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/blkdev.h>
+#include <linux/blk-cgroup.h>
+#include <linux/percpu.h>
+#include <linux/slab.h>
+#include <linux/timer.h>
+#include <linux/wait.h>
+
+#include "blk.h"
+#include "blk-stat.h"
+
+/* Length of a sampling window, in nsecs */
+#define IOLAT_WINDOW_NSEC	(100 * NSEC_PER_MSEC)
+
+/* A window with fewer completions says nothing about a group */
+#define IOLAT_MIN_SAMPLES	4
+
+static struct blkcg_policy blkcg_policy_iolatency;
+
+/* Per queue state, hangs off q->iolat */
+struct blk_iolatency {
+	struct request_queue *queue;
+	struct timer_list window_timer;
+	u64 window_seq;				/* current stat window */
+	atomic_t nr_targets;			/* groups with a target */
+};
+
+/* Per group state */
+struct iolat_grp {
+	struct blkg_policy_data pd;
+
+	u64 min_lat_nsec;			/* latency target, 0 is none */
+	unsigned int max_depth;			/* UINT_MAX is unthrottled */
+
+	atomic_t inflight;
+	wait_queue_head_t wait;
+
+	struct blk_rq_stat __percpu *stat;	/* completion latencies */
+};
+
+static inline struct iolat_grp *pd_to_iolat(struct blkg_policy_data *pd)
+{
+	return pd ? container_of(pd, struct iolat_grp, pd) : NULL;
+}
+
+static inline struct iolat_grp *blkg_to_iolat(struct blkcg_gq *blkg)
+{
+	return pd_to_iolat(blkg_to_pd(blkg, &blkcg_policy_iolatency));
+}
+
+/*
+ * Increment 'v', if 'v' is below 'below'. Returns true if we succeeded,
+ * false if 'v' + 1 would be bigger than 'below'.
+ */
+static bool atomic_inc_below(atomic_t *v, unsigned int below)
+{
+	unsigned int cur = atomic_read(v);
+
+	for (;;) {
+		unsigned int old;
+
+		if (cur >= below)
+			return false;
+		old = atomic_cmpxchg(v, cur, cur + 1);
+		if (old == cur)
+			break;
+		cur = old;
+	}
+
+	return true;
+}
+
+static void iolat_arm_timer(struct blk_iolatency *iolat)
+{
+	unsigned long expires = nsecs_to_jiffies(IOLAT_WINDOW_NSEC);
+
+	mod_timer(&iolat->window_timer, jiffies + max(expires, 1UL));
+}
+
+/*
+ * Wait for a slot in the group of @bio.  Returns the blkg the request is
+ * accounted to with a reference held, or NULL if it isn't tracked.  The
+ * caller attaches it to the request, or drops it with __blk_iolatency_done()
+ * if no request could be allocated.
+ */
+struct blkcg_gq *blk_iolatency_throttle(struct request_queue *q,
+					struct bio *bio)
+{
+	struct blk_iolatency *iolat = q->iolat;
+	struct blkcg_gq *blkg;
+	struct iolat_grp *ig;
+	DEFINE_WAIT(wait);
+
+	if (!iolat || !atomic_read(&iolat->nr_targets))
+		return NULL;
+
+	rcu_read_lock();
+	blkg = blkg_lookup(bio_blkcg(bio), q);
+	if (!blkg)
+		blkg = q->root_blkg;
+	ig = blkg_to_iolat(blkg);
+	if (!ig) {
+		rcu_read_unlock();
+		return NULL;
+	}
+	blkg_get(blkg);
+	rcu_read_unlock();
+
+	if (!timer_pending(&iolat->window_timer))
+		iolat_arm_timer(iolat);
+
+	if (atomic_inc_below(&ig->inflight, READ_ONCE(ig->max_depth)))
+		return blkg;
+
+	do {
+		prepare_to_wait_exclusive(&ig->wait, &wait,
+					  TASK_UNINTERRUPTIBLE);
+
+		if (atomic_inc_below(&ig->inflight, READ_ONCE(ig->max_depth)))
+			break;
+
+		io_schedule();
+	} while (1);
+
+	finish_wait(&ig->wait, &wait);
+	return blkg;
+}
+
+void __blk_iolatency_done(struct blkcg_gq *blkg)
+{
+	struct iolat_grp *ig = blkg_to_iolat(blkg);
+	int inflight;
+
+	inflight = atomic_dec_return(&ig->inflight);
+	WARN_ON_ONCE(inflight < 0);
+
+	if (inflight < READ_ONCE(ig->max_depth) && waitqueue_active(&ig->wait))
+		wake_up(&ig->wait);
+
+	blkg_put(blkg);
+}
+
+void blk_iolatency_issue(struct request *rq)
+{
+	if (!rq->iolat_blkg)
+		return;
+
+	if (!rq->issue_time_ns)
+		rq->issue_time_ns = ktime_get_ns();
+}
+
+/*
+ * Called on completion (or free) of a request.  Samples its latency into
+ * the group and releases its slot.
+ */
+void blk_iolatency_done(struct request *rq)
+{
+	struct blkcg_gq *blkg = rq->iolat_blkg;
+	struct iolat_grp *ig;
+
+	if (!blkg)
+		return;
+
+	ig = blkg_to_iolat(blkg);
+	if (rq->issue_time_ns) {
+		u64 now = ktime_get_ns();
+		u64 window = READ_ONCE(rq->q->iolat->window_seq);
+		struct blk_rq_stat *stat;
+		unsigned long flags;
+
+		local_irq_save(flags);
+		stat = this_cpu_ptr(ig->stat);
+		if (stat->window != window) {
+			blk_stat_init(stat);
+			stat->window = window;
+		}
+		if (now > rq->issue_time_ns)
+			__blk_stat_add(stat, now - rq->issue_time_ns);
+		local_irq_restore(flags);
+	}
+
+	rq->iolat_blkg = NULL;
+	__blk_iolatency_done(blkg);
+}
+
+static void iolat_sum_window(struct iolat_grp *ig, u64 window,
+			     struct blk_rq_stat *stat)
+{
+	int cpu;
+
+	blk_stat_init(stat);
+	for_each_possible_cpu(cpu) {
+		struct blk_rq_stat *s = per_cpu_ptr(ig->stat, cpu);
+
+		if (READ_ONCE(s->window) == window)
+			blk_stat_sum(stat, s);
+	}
+}
+
+static void iolat_scale_down(struct iolat_grp *ig, unsigned int nr_requests)
+{
+	unsigned int depth = min(ig->max_depth, nr_requests);
+
+	WRITE_ONCE(ig->max_depth, max(depth >> 1, 1U));
+}
+
+static bool iolat_scale_up(struct iolat_grp *ig, unsigned int nr_requests)
+{
+	unsigned int depth = ig->max_depth;
+
+	if (depth == UINT_MAX)
+		return false;
+
+	depth <<= 1;
+	if (depth >= nr_requests)
+		depth = UINT_MAX;
+	WRITE_ONCE(ig->max_depth, depth);
+	wake_up_all(&ig->wait);
+	return depth != UINT_MAX;
+}
+
+/*
+ * End of a window: find the tightest target missed, then throttle every
+ * group that is looser than it.  If nobody missed, give depth back.
+ */
+static void iolat_timer_fn(unsigned long data)
+{
+	struct blk_iolatency *iolat = (struct blk_iolatency *)data;
+	struct request_queue *q = iolat->queue;
+	unsigned int nr_requests = max_t(unsigned long, q->nr_requests, 2);
+	u64 window = iolat->window_seq;
+	u64 missed_lat = 0;
+	bool busy = false;
+	struct blkcg_gq *blkg;
+	unsigned long flags;
+
+	spin_lock_irqsave(q->queue_lock, flags);
+
+	WRITE_ONCE(iolat->window_seq, window + 1);
+
+	list_for_each_entry(blkg, &q->blkg_list, q_node) {
+		struct iolat_grp *ig = blkg_to_iolat(blkg);
+		struct blk_rq_stat stat;
+
+		if (!ig)
+			continue;
+
+		iolat_sum_window(ig, window, &stat);
+		if (stat.nr_samples)
+			busy = true;
+
+		if (!ig->min_lat_nsec || stat.nr_samples < IOLAT_MIN_SAMPLES)
+			continue;
+		if (blk_stat_mean(&stat) <= ig->min_lat_nsec)
+			continue;
+		if (!missed_lat || ig->min_lat_nsec < missed_lat)
+			missed_lat = ig->min_lat_nsec;
+	}
+
+	list_for_each_entry(blkg, &q->blkg_list, q_node) {
+		struct iolat_grp *ig = blkg_to_iolat(blkg);
+
+		if (!ig)
+			continue;
+
+		if (missed_lat && (!ig->min_lat_nsec ||
+				   ig->min_lat_nsec > missed_lat)) {
+			iolat_scale_down(ig, nr_requests);
+			busy = true;
+		} else if (iolat_scale_up(ig, nr_requests)) {
+			busy = true;
+		}
+	}
+
+	/* Keep sampling while there is I/O or somebody is still held back */
+	if (busy && atomic_read(&iolat->nr_targets))
+		iolat_arm_timer(iolat);
+
+	spin_unlock_irqrestore(q->queue_lock, flags);
+}
+
+static struct blkg_policy_data *iolat_pd_alloc(gfp_t gfp, int node)
+{
+	struct iolat_grp *ig;
+
+	ig = kzalloc_node(sizeof(*ig), gfp, node);
+	if (!ig)
+		return NULL;
+
+	ig->stat = alloc_percpu_gfp(struct blk_rq_stat, gfp);
+	if (!ig->stat) {
+		kfree(ig);
+		return NULL;
+	}
+
+	return &ig->pd;
+}
+
+static void iolat_pd_init(struct blkg_policy_data *pd)
+{
+	struct iolat_grp *ig = pd_to_iolat(pd);
+
+	ig->max_depth = UINT_MAX;
+	atomic_set(&ig->inflight, 0);
+	init_waitqueue_head(&ig->wait);
+}
+
+/* Drop the target and let everybody waiting on the group go */
+static void iolat_pd_offline(struct blkg_policy_data *pd)
+{
+	struct iolat_grp *ig = pd_to_iolat(pd);
+	struct blk_iolatency *iolat = pd->blkg->q->iolat;
+
+	if (ig->min_lat_nsec) {
+		ig->min_lat_nsec = 0;
+		atomic_dec(&iolat->nr_targets);
+	}
+	WRITE_ONCE(ig->max_depth, UINT_MAX);
+	wake_up_all(&ig->wait);
+}
+
+static void iolat_pd_free(struct blkg_policy_data *pd)
+{
+	struct iolat_grp *ig = pd_to_iolat(pd);
+
+	free_percpu(ig->stat);
+	kfree(ig);
+}
+
+static u64 iolat_prfill(struct seq_file *sf, struct blkg_policy_data *pd,
+			int off)
+{
+	struct iolat_grp *ig = pd_to_iolat(pd);
+	const char *dname = blkg_dev_name(pd->blkg);
+
+	if (!dname || !ig->min_lat_nsec)
+		return 0;
+
+	seq_printf(sf, "%s target=%llu\n", dname,
+		   div_u64(ig->min_lat_nsec, NSEC_PER_USEC));
+	return 0;
+}
+
+static int iolat_print_latency(struct seq_file *sf, void *v)
+{
+	blkcg_print_blkgs(sf, css_to_blkcg(seq_css(sf)), iolat_prfill,
+			  &blkcg_policy_iolatency, seq_cft(sf)->private, false);
+	return 0;
+}
+
+static ssize_t iolat_set_latency(struct kernfs_open_file *of, char *buf,
+				 size_t nbytes, loff_t off)
+{
+	struct blkcg *blkcg = css_to_blkcg(of_css(of));
+	struct blk_iolatency *iolat;
+	struct blkg_conf_ctx ctx;
+	struct iolat_grp *ig;
+	u64 lat_nsec;
+	int ret;
+
+	ret = blkg_conf_prep(blkcg, &blkcg_policy_iolatency, buf, &ctx);
+	if (ret)
+		return ret;
+
+	ig = blkg_to_iolat(ctx.blkg);
+	iolat = ctx.blkg->q->iolat;
+	lat_nsec = ig->min_lat_nsec;
+
+	while (true) {
+		char tok[27];	/* target=18446744073709551616 */
+		char *p;
+		u64 val = 0;
+		int len;
+
+		if (sscanf(ctx.body, "%26s%n", tok, &len) != 1)
+			break;
+		if (tok[0] == '\0')
+			break;
+		ctx.body += len;
+
+		ret = -EINVAL;
+		p = tok;
+		strsep(&p, "=");
+		if (!p || (sscanf(p, "%llu", &val) != 1 && strcmp(p, "max")))
+			goto out_finish;
+		if (strcmp(tok, "target"))
+			goto out_finish;
+
+		/* "max" and 0 remove the target */
+		ret = -ERANGE;
+		if (val > div_u64(U64_MAX, NSEC_PER_USEC))
+			goto out_finish;
+		lat_nsec = val * NSEC_PER_USEC;
+	}
+
+	if (lat_nsec && !ig->min_lat_nsec)
+		atomic_inc(&iolat->nr_targets);
+	else if (!lat_nsec && ig->min_lat_nsec)
+		atomic_dec(&iolat->nr_targets);
+	ig->min_lat_nsec = lat_nsec;
+
+	/* A new target starts out with a clean slate */
+	WRITE_ONCE(ig->max_depth, UINT_MAX);
+	wake_up_all(&ig->wait);
+	ret = 0;
+out_finish:
+	blkg_conf_finish(&ctx);
+	return ret ?: nbytes;
+}
+
+static struct cftype iolat_files[] = {
+	{
+		.name = "latency",
+		.flags = CFTYPE_NOT_ON_ROOT,
+		.seq_show = iolat_print_latency,
+		.write = iolat_set_latency,
+	},
+	{ }	/* terminate */
+};
+
+static struct blkcg_policy blkcg_policy_iolatency = {
+	.dfl_cftypes		= iolat_files,
+	.legacy_cftypes		= iolat_files,
+
+	.pd_alloc_fn		= iolat_pd_alloc,
+	.pd_init_fn		= iolat_pd_init,
+	.pd_offline_fn		= iolat_pd_offline,
+	.pd_free_fn		= iolat_pd_free,
+};
+
+int blk_iolatency_init(struct request_queue *q)
+{
+	struct blk_iolatency *iolat;
+	int ret;
+
+	iolat = kzalloc_node(sizeof(*iolat), GFP_KERNEL, q->node);
+	if (!iolat)
+		return -ENOMEM;
+
+	setup_timer(&iolat->window_timer, iolat_timer_fn,
+		    (unsigned long) iolat);
+	iolat->window_seq = 1;
+	atomic_set(&iolat->nr_targets, 0);
+	iolat->queue = q;
+
+	q->iolat = iolat;
+
+	ret = blkcg_activate_policy(q, &blkcg_policy_iolatency);
+	if (ret) {
+		q->iolat = NULL;
+		kfree(iolat);
+	}
+	return ret;
+}
+
+void blk_iolatency_exit(struct request_queue *q)
+{
+	struct blk_iolatency *iolat = q->iolat;
+
+	del_timer_sync(&iolat->window_timer);
+	blkcg_deactivate_policy(q, &blkcg_policy_iolatency);
+	q->iolat = NULL;
+	kfree(iolat);
+}
+
+static int __init iolatency_init(void)
+{
+	return blkcg_policy_register(&blkcg_policy_iolatency);
+}
+
+module_init(iolatency_init);
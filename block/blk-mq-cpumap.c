@@ -86,6 +86,19 @@ int blk_mq_update_queue_map(unsigned int *map, unsigned int nr_queues,
 	return 0;
 }
 
+/*
+ * Let the driver map the queues if it knows better, e.g. from the affinity
+ * of its interrupt vectors, otherwise spread the online cpus.
+ */
+int blk_mq_map_queues(struct blk_mq_tag_set *set, unsigned int *map,
+		      const struct cpumask *online_mask)
+{
+	if (set->ops->map_queues && !set->ops->map_queues(set, map))
+		return 0;
+
+	return blk_mq_update_queue_map(map, set->nr_hw_queues, online_mask);
+}
+
 unsigned int *blk_mq_make_queue_map(struct blk_mq_tag_set *set)
 {
 	unsigned int *map;
@@ -96,7 +109,7 @@ unsigned int *blk_mq_make_queue_map(struct blk_mq_tag_set *set)
 	if (!map)
 		return NULL;
 
-	if (!blk_mq_update_queue_map(map, set->nr_hw_queues, cpu_online_mask))
+	if (!blk_mq_map_queues(set, map, cpu_online_mask))
 		return map;
 
 	kfree(map);
@@ -0,0 +1,162 @@
+/*
+ * blk-mq scheduling framework
+ *
+ * Attaches elevator_types that set ->uses_mq to a blk-mq queue.  The
+ * scheduler keeps its state per hardware queue, requests are inserted into
+ * it instead of the software queues and the hardware queue run pulls them
+ * out one at a time for as long as the driver accepts them.
+ */
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/blkdev.h>
+#include <linux/blk-mq.h>
+#include <linux/elevator.h>
+#include <linux/blktrace_api.h>
+
+#include "blk.h"
+#include "blk-mq.h"
+#include "blk-mq-sched.h"
+
+/*
+ * Make sure nothing runs a hardware queue while q->elevator changes. The
+ * queue is frozen already, so no request can be inserted and all
+ * scheduled requests have been dispatched and completed.
+ */
+static void blk_mq_sched_quiesce(struct request_queue *q)
+{
+	struct blk_mq_hw_ctx *hctx;
+	unsigned int i;
+
+	blk_mq_stop_hw_queues(q);
+
+	/* direct runs happen with preemption disabled */
+	synchronize_sched();
+
+	queue_for_each_hw_ctx(q, hctx, i) {
+		cancel_delayed_work_sync(&hctx->run_work);
+		cancel_delayed_work_sync(&hctx->delay_work);
+	}
+}
+
+static void blk_mq_sched_exit_hctxs(struct request_queue *q,
+				    struct elevator_queue *e,
+				    unsigned int nr)
+{
+	struct blk_mq_hw_ctx *hctx;
+	unsigned int i;
+
+	queue_for_each_hw_ctx(q, hctx, i) {
+		if (i == nr)
+			break;
+		if (e->type->mq_ops.exit_hctx && hctx->sched_data)
+			e->type->mq_ops.exit_hctx(hctx, i);
+		hctx->sched_data = NULL;
+	}
+}
+
+static void blk_mq_sched_exit(struct request_queue *q,
+			      struct elevator_queue *e)
+{
+	blk_mq_sched_exit_hctxs(q, e, q->nr_hw_queues);
+
+	mutex_lock(&e->sysfs_lock);
+	if (e->type->mq_ops.exit_sched)
+		e->type->mq_ops.exit_sched(e);
+	mutex_unlock(&e->sysfs_lock);
+
+	kobject_put(&e->kobj);
+}
+
+/*
+ * Consumes the reference to @e, also on failure.
+ */
+static int blk_mq_sched_init(struct request_queue *q, struct elevator_type *e)
+{
+	struct blk_mq_hw_ctx *hctx;
+	unsigned int i;
+	int ret;
+
+	/* ->init_sched() sets q->elevator */
+	ret = e->mq_ops.init_sched(q, e);
+	if (ret) {
+		module_put(e->elevator_owner);
+		return ret;
+	}
+
+	queue_for_each_hw_ctx(q, hctx, i) {
+		if (!e->mq_ops.init_hctx)
+			continue;
+
+		ret = e->mq_ops.init_hctx(hctx, i);
+		if (ret) {
+			blk_mq_sched_exit(q, q->elevator);
+			q->elevator = NULL;
+			return ret;
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * blk_mq_sched_switch - attach a scheduler to, or detach it from, a queue
+ * @q:	the blk-mq request queue
+ * @e:	the new scheduler, or %NULL for none.  A reference to @e is
+ *	consumed, also on failure.
+ *
+ * Called with q->sysfs_lock held.
+ */
+int blk_mq_sched_switch(struct request_queue *q, struct elevator_type *e)
+{
+	struct elevator_queue *old = q->elevator;
+	bool registered = old && old->registered;
+	int ret = 0;
+
+	lockdep_assert_held(&q->sysfs_lock);
+
+	blk_mq_freeze_queue(q);
+	blk_mq_sched_quiesce(q);
+
+	if (old) {
+		if (registered)
+			elv_unregister_queue(q);
+		blk_mq_sched_exit(q, old);
+		q->elevator = NULL;
+	}
+
+	if (e) {
+		ret = blk_mq_sched_init(q, e);
+		if (ret)
+			goto out;
+
+		if (q->mq_sysfs_init_done) {
+			ret = elv_register_queue(q);
+			if (ret) {
+				blk_mq_sched_exit(q, q->elevator);
+				q->elevator = NULL;
+				goto out;
+			}
+		}
+		blk_add_trace_msg(q, "elv switch: %s", e->elevator_name);
+	} else
+		blk_add_trace_msg(q, "elv switch: none");
+
+out:
+	blk_mq_start_stopped_hw_queues(q, true);
+	blk_mq_unfreeze_queue(q);
+	return ret;
+}
+
+/*
+ * Called on queue teardown, the queue is dead and all requests are gone.
+ */
+void blk_mq_sched_teardown(struct request_queue *q)
+{
+	struct elevator_queue *e = q->elevator;
+
+	if (!e)
+		return;
+
+	blk_mq_sched_exit(q, e);
+	q->elevator = NULL;
+}
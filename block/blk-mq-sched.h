@@ -0,0 +1,59 @@
+#ifndef BLK_MQ_SCHED_H
+#define BLK_MQ_SCHED_H
+
+#include <linux/elevator.h>
+
+#include "blk-mq.h"
+
+int blk_mq_sched_switch(struct request_queue *q, struct elevator_type *e);
+void blk_mq_sched_teardown(struct request_queue *q);
+
+/*
+ * Flush sequences, passthrough commands and head insertions (requeues of
+ * requests that were already issued) go straight to the software queues.
+ */
+static inline bool blk_mq_sched_bypass_insert(struct request *rq,
+					      bool at_head)
+{
+	if (at_head || rq->cmd_type != REQ_TYPE_FS)
+		return true;
+	if (rq->cmd_flags & (REQ_FLUSH | REQ_FUA | REQ_FLUSH_SEQ))
+		return true;
+	return false;
+}
+
+static inline bool blk_mq_sched_insert_request(struct blk_mq_hw_ctx *hctx,
+					       struct request *rq,
+					       bool at_head)
+{
+	struct elevator_queue *e = hctx->queue->elevator;
+
+	if (!e || blk_mq_sched_bypass_insert(rq, at_head))
+		return false;
+
+	e->type->mq_ops.insert_request(hctx, rq);
+	return true;
+}
+
+static inline struct request *
+blk_mq_sched_dispatch_request(struct blk_mq_hw_ctx *hctx)
+{
+	struct elevator_queue *e = hctx->queue->elevator;
+
+	if (!e)
+		return NULL;
+
+	return e->type->mq_ops.dispatch_request(hctx);
+}
+
+static inline bool blk_mq_sched_has_work(struct blk_mq_hw_ctx *hctx)
+{
+	struct elevator_queue *e = hctx->queue->elevator;
+
+	if (!e)
+		return false;
+
+	return e->type->mq_ops.has_work(hctx);
+}
+
+#endif
@@ -179,6 +179,30 @@ static ssize_t blk_mq_hw_sysfs_poll_show(struct blk_mq_hw_ctx *hctx, char *page)
 	return sprintf(page, "invoked=%lu, success=%lu\n", hctx->poll_invoked, hctx->poll_success);
 }
 
+static ssize_t blk_mq_hw_sysfs_poll_stat_show(struct blk_mq_hw_ctx *hctx,
+					      char *page)
+{
+	char *start_page = page;
+	int i;
+
+	for (i = 0; i < BLK_MQ_POLL_STATS_BKTS; i++) {
+		struct blk_rq_stat stat;
+
+		blk_hctx_stat_get(hctx, i, &stat);
+		if (!stat.nr_samples)
+			continue;
+
+		page += sprintf(page, "%s %u: samples=%u, mean=%llu, min=%llu, max=%llu\n",
+				i & 1 ? "write" : "read", 512U << (i / 2),
+				stat.nr_samples,
+				(unsigned long long) blk_stat_mean(&stat),
+				(unsigned long long) stat.min,
+				(unsigned long long) stat.max);
+	}
+
+	return page - start_page;
+}
+
 static ssize_t blk_mq_hw_sysfs_queued_show(struct blk_mq_hw_ctx *hctx,
 					   char *page)
 {
@@ -304,6 +328,10 @@ static struct blk_mq_hw_ctx_sysfs_entry blk_mq_hw_sysfs_poll = {
 	.attr = {.name = "io_poll", .mode = S_IRUGO },
 	.show = blk_mq_hw_sysfs_poll_show,
 };
+static struct blk_mq_hw_ctx_sysfs_entry blk_mq_hw_sysfs_poll_stat = {
+	.attr = {.name = "poll_stat", .mode = S_IRUGO },
+	.show = blk_mq_hw_sysfs_poll_stat_show,
+};
 
 static struct attribute *default_hw_ctx_attrs[] = {
 	&blk_mq_hw_sysfs_queued.attr,
@@ -314,6 +342,7 @@ static struct attribute *default_hw_ctx_attrs[] = {
 	&blk_mq_hw_sysfs_cpus.attr,
 	&blk_mq_hw_sysfs_active.attr,
 	&blk_mq_hw_sysfs_poll.attr,
+	&blk_mq_hw_sysfs_poll_stat.attr,
 	NULL,
 };
 
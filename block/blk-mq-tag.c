@@ -377,31 +377,39 @@ static struct bt_wait_state *bt_wake_ptr(struct blk_mq_bitmap_tags *bt)
 	return NULL;
 }
 
-static void bt_clear_tag(struct blk_mq_bitmap_tags *bt, unsigned int tag)
+/* Account @nr freed tags against the waiters, waking them in batches */
+static void bt_tags_freed(struct blk_mq_bitmap_tags *bt, int nr)
 {
-	const int index = TAG_TO_INDEX(bt, tag);
 	struct bt_wait_state *bs;
 	int wait_cnt;
 
-	clear_bit(TAG_TO_BIT(bt, tag), &bt->map[index].word);
-
 	/* Ensure that the wait list checks occur after clear_bit(). */
 	smp_mb();
 
-	bs = bt_wake_ptr(bt);
-	if (!bs)
-		return;
-
-	wait_cnt = atomic_dec_return(&bs->wait_cnt);
-	if (unlikely(wait_cnt < 0))
-		wait_cnt = atomic_inc_return(&bs->wait_cnt);
-	if (wait_cnt == 0) {
-		atomic_add(bt->wake_cnt, &bs->wait_cnt);
-		bt_index_atomic_inc(&bt->wake_index);
-		wake_up(&bs->wait);
+	while (nr--) {
+		bs = bt_wake_ptr(bt);
+		if (!bs)
+			return;
+
+		wait_cnt = atomic_dec_return(&bs->wait_cnt);
+		if (unlikely(wait_cnt < 0))
+			wait_cnt = atomic_inc_return(&bs->wait_cnt);
+		if (wait_cnt == 0) {
+			atomic_add(bt->wake_cnt, &bs->wait_cnt);
+			bt_index_atomic_inc(&bt->wake_index);
+			wake_up(&bs->wait);
+		}
 	}
 }
 
+static void bt_clear_tag(struct blk_mq_bitmap_tags *bt, unsigned int tag)
+{
+	const int index = TAG_TO_INDEX(bt, tag);
+
+	clear_bit(TAG_TO_BIT(bt, tag), &bt->map[index].word);
+	bt_tags_freed(bt, 1);
+}
+
 void blk_mq_put_tag(struct blk_mq_hw_ctx *hctx, unsigned int tag,
 		    unsigned int *last_tag)
 {
@@ -420,6 +428,39 @@ void blk_mq_put_tag(struct blk_mq_hw_ctx *hctx, unsigned int tag,
 	}
 }
 
+/*
+ * Free @nr tags of @hctx at once: clear all their bits first, then check for
+ * waiters a single time for the normal tags.
+ */
+void blk_mq_put_tags(struct blk_mq_hw_ctx *hctx, const unsigned int *tag_array,
+		     int nr, unsigned int *last_tag)
+{
+	struct blk_mq_tags *tags = hctx->tags;
+	struct blk_mq_bitmap_tags *bt = &tags->bitmap_tags;
+	int i, nr_normal = 0;
+
+	for (i = 0; i < nr; i++) {
+		const unsigned int tag = tag_array[i];
+		int real_tag;
+
+		if (tag < tags->nr_reserved_tags) {
+			bt_clear_tag(&tags->breserved_tags, tag);
+			continue;
+		}
+
+		real_tag = tag - tags->nr_reserved_tags;
+		BUG_ON(real_tag >= tags->nr_tags);
+		clear_bit(TAG_TO_BIT(bt, real_tag),
+			  &bt->map[TAG_TO_INDEX(bt, real_tag)].word);
+		if (likely(tags->alloc_policy == BLK_TAG_ALLOC_FIFO))
+			*last_tag = real_tag;
+		nr_normal++;
+	}
+
+	if (nr_normal)
+		bt_tags_freed(bt, nr_normal);
+}
+
 static void bt_for_each(struct blk_mq_hw_ctx *hctx,
 		struct blk_mq_bitmap_tags *bt, unsigned int off,
 		busy_iter_fn *fn, void *data, bool reserved)
@@ -475,6 +516,18 @@ void blk_mq_all_tag_busy_iter(struct blk_mq_tags *tags, busy_tag_iter_fn *fn,
 }
 EXPORT_SYMBOL(blk_mq_all_tag_busy_iter);
 
+void blk_mq_tagset_busy_iter(struct blk_mq_tag_set *tagset,
+		busy_tag_iter_fn *fn, void *priv)
+{
+	int i;
+
+	for (i = 0; i < tagset->nr_hw_queues; i++) {
+		if (tagset->tags && tagset->tags[i])
+			blk_mq_all_tag_busy_iter(tagset->tags[i], fn, priv);
+	}
+}
+EXPORT_SYMBOL(blk_mq_tagset_busy_iter);
+
 void blk_mq_queue_tag_busy_iter(struct request_queue *q, busy_iter_fn *fn,
 		void *priv)
 {
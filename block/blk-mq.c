@@ -29,6 +29,8 @@
 #include "blk.h"
 #include "blk-mq.h"
 #include "blk-mq-tag.h"
+#include "blk-mq-sched.h"
+#include "blk-wbt.h"
 
 static DEFINE_MUTEX(all_q_mutex);
 static LIST_HEAD(all_q_list);
@@ -46,7 +48,7 @@ static bool blk_mq_hctx_has_pending(struct blk_mq_hw_ctx *hctx)
 		if (hctx->ctx_map.map[i].word)
 			return true;
 
-	return false;
+	return blk_mq_sched_has_work(hctx);
 }
 
 static inline struct blk_align_bitmap *get_bm(struct blk_mq_hw_ctx *hctx,
@@ -176,10 +178,14 @@ static void blk_mq_rq_ctx_init(struct request_queue *q, struct blk_mq_ctx *ctx,
 	rq->rq_disk = NULL;
 	rq->part = NULL;
 	rq->start_time = jiffies;
+	rq->wbt_flags = 0;
 #ifdef CONFIG_BLK_CGROUP
 	rq->rl = NULL;
 	set_start_time_ns(rq);
 	rq->io_start_time_ns = 0;
+#endif
+#ifdef CONFIG_BLK_CGROUP_IOLATENCY
+	rq->iolat_blkg = NULL;
 #endif
 	rq->nr_phys_segments = 0;
 #if defined(CONFIG_BLK_DEV_INTEGRITY)
@@ -268,17 +274,77 @@ struct request *blk_mq_alloc_request(struct request_queue *q, int rw, gfp_t gfp,
 }
 EXPORT_SYMBOL(blk_mq_alloc_request);
 
-static void __blk_mq_free_request(struct blk_mq_hw_ctx *hctx,
-				  struct blk_mq_ctx *ctx, struct request *rq)
+/*
+ * Allocate a request for hardware queue @hctx_idx rather than the one the
+ * current CPU maps to.  For drivers that need to issue a command on a
+ * particular hardware queue, e.g. to connect it, so this never waits for
+ * a tag.
+ */
+struct request *blk_mq_alloc_request_hctx(struct request_queue *q, int rw,
+		bool reserved, unsigned int hctx_idx)
+{
+	struct blk_mq_hw_ctx *hctx;
+	struct blk_mq_ctx *ctx;
+	struct request *rq;
+	struct blk_mq_alloc_data alloc_data;
+	int ret;
+
+	if (hctx_idx >= q->nr_hw_queues)
+		return ERR_PTR(-EIO);
+
+	ret = blk_queue_enter(q, GFP_NOWAIT);
+	if (ret)
+		return ERR_PTR(ret);
+
+	/*
+	 * Check if the hardware context is actually mapped to anything.
+	 * If not tell the caller that it should skip this queue.
+	 */
+	hctx = q->queue_hw_ctx[hctx_idx];
+	if (!blk_mq_hw_queue_mapped(hctx)) {
+		ret = -EXDEV;
+		goto out_queue_exit;
+	}
+	ctx = __blk_mq_get_ctx(q, cpumask_first(hctx->cpumask));
+
+	blk_mq_set_alloc_data(&alloc_data, q, GFP_NOWAIT, reserved, ctx, hctx);
+	rq = __blk_mq_alloc_request(&alloc_data, rw);
+	if (!rq) {
+		ret = -EWOULDBLOCK;
+		goto out_queue_exit;
+	}
+
+	return rq;
+
+out_queue_exit:
+	blk_queue_exit(q);
+	return ERR_PTR(ret);
+}
+EXPORT_SYMBOL_GPL(blk_mq_alloc_request_hctx);
+
+/* Everything freeing a request does short of releasing its tag */
+static void blk_mq_release_request(struct blk_mq_hw_ctx *hctx,
+				   struct request *rq)
 {
-	const int tag = rq->tag;
 	struct request_queue *q = rq->q;
 
+	wbt_done(q->rq_wb, rq);
+	blk_iolatency_done(rq);
+
 	if (rq->cmd_flags & REQ_MQ_INFLIGHT)
 		atomic_dec(&hctx->nr_active);
 	rq->cmd_flags = 0;
 
 	clear_bit(REQ_ATOM_STARTED, &rq->atomic_flags);
+}
+
+static void __blk_mq_free_request(struct blk_mq_hw_ctx *hctx,
+				  struct blk_mq_ctx *ctx, struct request *rq)
+{
+	const int tag = rq->tag;
+	struct request_queue *q = rq->q;
+
+	blk_mq_release_request(hctx, rq);
 	blk_mq_put_tag(hctx, tag, &ctx->last_tag);
 	blk_queue_exit(q);
 }
@@ -384,11 +450,114 @@ void blk_mq_complete_request(struct request *rq, int error)
 		return;
 	if (!blk_mark_rq_complete(rq)) {
 		rq->errors = error;
+		if (test_bit(QUEUE_FLAG_POLL_STATS, &q->queue_flags))
+			blk_mq_stat_add(rq);
 		__blk_mq_complete_request(rq);
 	}
 }
 EXPORT_SYMBOL(blk_mq_complete_request);
 
+/**
+ * blk_mq_add_to_batch - collect a completed request in a completion batch
+ * @rq:		the request being processed
+ * @batch:	the batch of the current completion queue pass, or %NULL
+ * @error:	the completion status of @rq
+ *
+ * Description:
+ *	Lets a driver that reaps many completions in one pass defer them to
+ *	blk_mq_end_request_batch().  Only successful requests that blk-mq
+ *	ends itself can be batched: not those with an ->end_io callback or a
+ *	driver ->complete handler.  Returns %false if @rq was not taken, in
+ *	which case the driver must use blk_mq_complete_request() for it.
+ **/
+bool blk_mq_add_to_batch(struct request *rq, struct blk_mq_comp_batch *batch,
+			 int error)
+{
+	struct request_queue *q = rq->q;
+
+	if (!batch || error || rq->end_io || blk_bidi_rq(rq) ||
+	    q->softirq_done_fn)
+		return false;
+
+	if (unlikely(blk_should_fake_timeout(q)))
+		return true;
+	if (!blk_mark_rq_complete(rq)) {
+		rq->errors = 0;
+		list_add_tail(&rq->queuelist, &batch->list);
+		batch->nr++;
+	}
+	return true;
+}
+EXPORT_SYMBOL_GPL(blk_mq_add_to_batch);
+
+/* Tags released with one blk_mq_put_tags() call */
+#define BLK_MQ_BATCH_TAGS	32
+
+static void blk_mq_put_batch_tags(struct blk_mq_hw_ctx *hctx,
+				  struct blk_mq_ctx *ctx,
+				  const unsigned int *tags, int nr)
+{
+	blk_mq_put_tags(hctx, tags, nr, &ctx->last_tag);
+	percpu_ref_put_many(&hctx->queue->q_usage_counter, nr);
+}
+
+/**
+ * blk_mq_end_request_batch - end I/O on a batch of completed requests
+ * @batch:	the requests collected by blk_mq_add_to_batch()
+ *
+ * Description:
+ *	Ends every request of @batch like blk_mq_end_request() would, but
+ *	reads the clock once for the whole batch and releases the tags of
+ *	requests of the same hardware queue together, with a single check
+ *	for tag waiters.  Must be called from the same context as the
+ *	completion queue pass that filled @batch, once it is finished and
+ *	any driver lock is dropped.  @batch is empty on return.
+ **/
+void blk_mq_end_request_batch(struct blk_mq_comp_batch *batch)
+{
+	struct blk_mq_hw_ctx *hctx = NULL;
+	struct blk_mq_ctx *ctx = NULL;
+	unsigned int tags[BLK_MQ_BATCH_TAGS];
+	struct request *rq, *next;
+	int nr_tags = 0;
+	u64 now = 0;
+
+	list_for_each_entry_safe(rq, next, &batch->list, queuelist) {
+		struct request_queue *q = rq->q;
+		struct blk_mq_hw_ctx *this_hctx;
+
+		if (test_bit(QUEUE_FLAG_POLL_STATS, &q->queue_flags) &&
+		    rq->issue_time_ns) {
+			if (!now)
+				now = ktime_get_ns();
+			__blk_mq_stat_add(rq, now);
+		}
+
+		if (blk_update_request(rq, 0, blk_rq_bytes(rq)))
+			BUG();
+		blk_account_io_done(rq);
+
+		this_hctx = q->mq_ops->map_queue(q, rq->mq_ctx->cpu);
+		if (this_hctx != hctx || nr_tags == BLK_MQ_BATCH_TAGS) {
+			if (nr_tags)
+				blk_mq_put_batch_tags(hctx, ctx, tags, nr_tags);
+			hctx = this_hctx;
+			nr_tags = 0;
+		}
+
+		ctx = rq->mq_ctx;
+		ctx->rq_completed[rq_is_sync(rq)]++;
+		blk_mq_release_request(hctx, rq);
+		tags[nr_tags++] = rq->tag;
+	}
+
+	if (nr_tags)
+		blk_mq_put_batch_tags(hctx, ctx, tags, nr_tags);
+
+	blk_mq_init_comp_batch(batch);
+}
+EXPORT_SYMBOL_GPL(blk_mq_end_request_batch);
+
 int blk_mq_request_started(struct request *rq)
 {
 	return test_bit(REQ_ATOM_STARTED, &rq->atomic_flags);
@@ -401,6 +570,14 @@ void blk_mq_start_request(struct request *rq)
 
 	trace_block_rq_issue(q, rq);
 
+	if (test_bit(QUEUE_FLAG_POLL_STATS, &q->queue_flags))
+		rq->issue_time_ns = ktime_get_ns();
+	else
+		rq->issue_time_ns = 0;
+
+	wbt_issue(q->rq_wb, rq);
+	blk_iolatency_issue(rq);
+
 	rq->resid_len = blk_rq_bytes(rq);
 	if (unlikely(blk_bidi_rq(rq)))
 		rq->next_rq->resid_len = blk_rq_bytes(rq->next_rq);
@@ -423,6 +600,8 @@ void blk_mq_start_request(struct request *rq)
 		set_bit(REQ_ATOM_STARTED, &rq->atomic_flags);
 	if (test_bit(REQ_ATOM_COMPLETE, &rq->atomic_flags))
 		clear_bit(REQ_ATOM_COMPLETE, &rq->atomic_flags);
+	if (test_bit(REQ_ATOM_POLL_SLEPT, &rq->atomic_flags))
+		clear_bit(REQ_ATOM_POLL_SLEPT, &rq->atomic_flags);
 
 	if (q->dma_drain_size && blk_rq_bytes(rq)) {
 		/*
@@ -550,6 +729,103 @@ struct request *blk_mq_tag_to_rq(struct blk_mq_tags *tags, unsigned int tag)
 }
 EXPORT_SYMBOL(blk_mq_tag_to_rq);
 
+static unsigned long blk_mq_poll_nsecs(struct request_queue *q,
+				       struct blk_mq_hw_ctx *hctx,
+				       struct request *rq)
+{
+	struct blk_rq_stat stat;
+	int bucket;
+
+	/*
+	 * If stats collection isn't on, don't sleep but turn it on for
+	 * future users
+	 */
+	if (!test_bit(QUEUE_FLAG_POLL_STATS, &q->queue_flags)) {
+		set_bit(QUEUE_FLAG_POLL_STATS, &q->queue_flags);
+		return 0;
+	}
+
+	bucket = blk_mq_poll_stats_bkt(rq);
+	if (bucket < 0)
+		return 0;
+
+	/*
+	 * As an optimistic guess, use half of the mean service time
+	 * for this type of request. We can (and should) make this smarter.
+	 * For instance, if the completion latencies are tight, we can
+	 * get closer than just half the mean. This is especially
+	 * important on devices where the completion latencies are longer
+	 * than ~10 usec.
+	 */
+	blk_hctx_stat_get(hctx, bucket, &stat);
+	if (!stat.nr_samples)
+		return 0;
+
+	return (blk_stat_mean(&stat) + 1) / 2;
+}
+
+/*
+ * Sleep for a part of the expected completion time of the request behind
+ * @cookie, so that the polling loop only has to spin for the tail end of
+ * it.  Returns true if we slept, the caller should then recheck for
+ * completion before it calls back in here to start spinning.
+ */
+bool blk_mq_poll_hybrid_sleep(struct request_queue *q,
+			      struct blk_mq_hw_ctx *hctx, blk_qc_t cookie)
+{
+	struct hrtimer_sleeper hs;
+	enum hrtimer_mode mode;
+	unsigned long nsecs;
+	struct request *rq;
+	ktime_t kt;
+
+	if (q->poll_nsec == -1)
+		return false;
+
+	rq = blk_mq_tag_to_rq(hctx->tags, blk_qc_t_to_tag(cookie));
+	if (!rq || test_bit(REQ_ATOM_POLL_SLEPT, &rq->atomic_flags))
+		return false;
+
+	/*
+	 * poll_nsec can be:
+	 *
+	 * -1:	don't ever hybrid sleep
+	 *  0:	use half of prev avg
+	 * >0:	use this specific value
+	 */
+	if (q->poll_nsec > 0)
+		nsecs = q->poll_nsec;
+	else
+		nsecs = blk_mq_poll_nsecs(q, hctx, rq);
+
+	if (!nsecs)
+		return false;
+
+	set_bit(REQ_ATOM_POLL_SLEPT, &rq->atomic_flags);
+
+	kt = ktime_set(0, nsecs);
+
+	mode = HRTIMER_MODE_REL;
+	hrtimer_init_on_stack(&hs.timer, CLOCK_MONOTONIC, mode);
+	hrtimer_set_expires(&hs.timer, kt);
+
+	hrtimer_init_sleeper(&hs, current);
+	do {
+		if (test_bit(REQ_ATOM_COMPLETE, &rq->atomic_flags))
+			break;
+		set_current_state(TASK_UNINTERRUPTIBLE);
+		hrtimer_start_expires(&hs.timer, mode);
+		if (hs.task)
+			io_schedule();
+		hrtimer_cancel(&hs.timer);
+		mode = HRTIMER_MODE_ABS;
+	} while (hs.task && !signal_pending(current));
+
+	__set_current_state(TASK_RUNNING);
+	destroy_hrtimer_on_stack(&hs.timer);
+	return true;
+}
+
 struct blk_mq_timeout_data {
 	unsigned long next;
 	unsigned int next_set;
@@ -760,19 +1036,41 @@ static void __blk_mq_run_hw_queue(struct blk_mq_hw_ctx *hctx)
 	dptr = NULL;
 
 	/*
-	 * Now process all the entries, sending them to the driver.
+	 * Now process all the entries, sending them to the driver. Once the
+	 * list has been drained, requests are pulled from the IO scheduler
+	 * (if any) for as long as the driver accepts them.
 	 */
 	queued = 0;
-	while (!list_empty(&rq_list)) {
+	while (1) {
 		struct blk_mq_queue_data bd;
 		int ret;
 
-		rq = list_first_entry(&rq_list, struct request, queuelist);
-		list_del_init(&rq->queuelist);
+		/*
+		 * Reserve driver budget before taking a request off the list
+		 * or out of the scheduler, so that requests the device can't
+		 * take right now stay where they can still be merged.
+		 */
+		if (!list_empty(&rq_list)) {
+			if (!blk_mq_get_dispatch_budget(hctx))
+				break;
+			rq = list_first_entry(&rq_list, struct request,
+						queuelist);
+			list_del_init(&rq->queuelist);
+		} else {
+			if (!blk_mq_sched_has_work(hctx))
+				break;
+			if (!blk_mq_get_dispatch_budget(hctx))
+				break;
+			rq = blk_mq_sched_dispatch_request(hctx);
+			if (!rq) {
+				blk_mq_put_dispatch_budget(hctx);
+				break;
+			}
+		}
 
 		bd.rq = rq;
 		bd.list = dptr;
-		bd.last = list_empty(&rq_list);
+		bd.last = list_empty(&rq_list) && !blk_mq_sched_has_work(hctx);
 
 		ret = q->mq_ops->queue_rq(hctx, &bd);
 		switch (ret) {
@@ -990,6 +1288,11 @@ static void __blk_mq_insert_request(struct blk_mq_hw_ctx *hctx,
 {
 	struct blk_mq_ctx *ctx = rq->mq_ctx;
 
+	if (blk_mq_sched_insert_request(hctx, rq, at_head)) {
+		trace_block_rq_insert(hctx->queue, rq);
+		return;
+	}
+
 	__blk_mq_insert_req_list(hctx, ctx, rq, at_head);
 	blk_mq_hctx_mark_pending(hctx, ctx);
 }
@@ -1046,9 +1349,8 @@ static void blk_mq_insert_requests(struct request_queue *q,
 		rq = list_first_entry(list, struct request, queuelist);
 		list_del_init(&rq->queuelist);
 		rq->mq_ctx = ctx;
-		__blk_mq_insert_req_list(hctx, ctx, rq, false);
+		__blk_mq_insert_request(hctx, rq, false);
 	}
-	blk_mq_hctx_mark_pending(hctx, ctx);
 	spin_unlock(&ctx->lock);
 
 	blk_mq_run_hw_queue(hctx, from_schedule);
@@ -1211,6 +1513,9 @@ static int blk_mq_direct_issue_request(struct request *rq, blk_qc_t *cookie)
 	};
 	blk_qc_t new_cookie = blk_tag_to_qc_t(rq->tag, hctx->queue_num);
 
+	if (!blk_mq_get_dispatch_budget(hctx))
+		return -1;
+
 	/*
 	 * For OK queue, we are done. For error, kill it. Any other
 	 * error (busy), just add it to our list as we previously
@@ -1248,6 +1553,8 @@ static blk_qc_t blk_mq_make_request(struct request_queue *q, struct bio *bio)
 	unsigned int request_count = 0;
 	struct blk_plug *plug;
 	struct request *same_queue_rq = NULL;
+	struct blkcg_gq *iolat_blkg;
+	unsigned int wb_acct;
 	blk_qc_t cookie;
 
 	blk_queue_bounce(q, &bio);
@@ -1266,9 +1573,19 @@ static blk_qc_t blk_mq_make_request(struct request_queue *q, struct bio *bio)
 	} else
 		request_count = blk_plug_queued_count(q);
 
+	iolat_blkg = blk_iolatency_throttle(q, bio);
+	wb_acct = wbt_wait(q->rq_wb, bio, NULL);
+
 	rq = blk_mq_map_request(q, bio, &data);
-	if (unlikely(!rq))
+	if (unlikely(!rq)) {
+		__wbt_done(q->rq_wb, wb_acct);
+		if (iolat_blkg)
+			__blk_iolatency_done(iolat_blkg);
 		return BLK_QC_T_NONE;
+	}
+
+	wbt_track(rq, wb_acct);
+	blk_iolatency_track(rq, iolat_blkg);
 
 	cookie = blk_tag_to_qc_t(rq->tag, data.hctx->queue_num);
 
@@ -1285,7 +1602,7 @@ static blk_qc_t blk_mq_make_request(struct request_queue *q, struct bio *bio)
 	 * CPU this way.
 	 */
 	if (((plug && !blk_queue_nomerges(q)) || is_sync) &&
-	    !(data.hctx->flags & BLK_MQ_F_DEFER_ISSUE)) {
+	    !(data.hctx->flags & BLK_MQ_F_DEFER_ISSUE) && !q->elevator) {
 		struct request *old_rq = NULL;
 
 		blk_mq_bio_to_request(rq, bio);
@@ -1344,6 +1661,8 @@ static blk_qc_t blk_sq_make_request(struct request_queue *q, struct bio *bio)
 	unsigned int request_count = 0;
 	struct blk_map_ctx data;
 	struct request *rq;
+	struct blkcg_gq *iolat_blkg;
+	unsigned int wb_acct;
 	blk_qc_t cookie;
 
 	blk_queue_bounce(q, &bio);
@@ -1359,9 +1678,19 @@ static blk_qc_t blk_sq_make_request(struct request_queue *q, struct bio *bio)
 	    blk_attempt_plug_merge(q, bio, &request_count, NULL))
 		return BLK_QC_T_NONE;
 
+	iolat_blkg = blk_iolatency_throttle(q, bio);
+	wb_acct = wbt_wait(q->rq_wb, bio, NULL);
+
 	rq = blk_mq_map_request(q, bio, &data);
-	if (unlikely(!rq))
+	if (unlikely(!rq)) {
+		__wbt_done(q->rq_wb, wb_acct);
+		if (iolat_blkg)
+			__blk_iolatency_done(iolat_blkg);
 		return BLK_QC_T_NONE;
+	}
+
+	wbt_track(rq, wb_acct);
+	blk_iolatency_track(rq, iolat_blkg);
 
 	cookie = blk_tag_to_qc_t(rq->tag, data.hctx->queue_num);
 
@@ -1771,7 +2100,7 @@ static int blk_mq_init_hw_queues(struct request_queue *q,
 static void blk_mq_init_cpu_queues(struct request_queue *q,
 				   unsigned int nr_hw_queues)
 {
-	unsigned int i;
+	unsigned int i, j;
 
 	for_each_possible_cpu(i) {
 		struct blk_mq_ctx *__ctx = per_cpu_ptr(q->queue_ctx, i);
@@ -1782,6 +2111,10 @@ static void blk_mq_init_cpu_queues(struct request_queue *q,
 		spin_lock_init(&__ctx->lock);
 		INIT_LIST_HEAD(&__ctx->rq_list);
 		__ctx->queue = q;
+		for (j = 0; j < BLK_MQ_POLL_STATS_BKTS; j++) {
+			blk_stat_init(&__ctx->poll_stat[j]);
+			blk_stat_init(&__ctx->poll_stat_prev[j]);
+		}
 
 		/* If the cpu isn't online, the cpu is mapped to first hctx */
 		if (!cpu_online(i))
@@ -2050,6 +2383,7 @@ struct request_queue *blk_mq_init_allocated_queue(struct blk_mq_tag_set *set,
 	 * Do this after blk_queue_make_request() overrides it...
 	 */
 	q->nr_requests = set->queue_depth;
+	q->poll_nsec = -1;
 
 	if (set->ops->complete)
 		blk_queue_softirq_done(q, set->ops->complete);
@@ -2097,6 +2431,7 @@ void blk_mq_free_queue(struct request_queue *q)
 
 	blk_mq_del_queue_tag_set(q);
 
+	blk_mq_sched_teardown(q);
 	blk_mq_exit_hw_queues(q, set, set->nr_hw_queues);
 	blk_mq_free_hw_queues(q, set);
 }
@@ -2109,7 +2444,7 @@ static void blk_mq_queue_reinit(struct request_queue *q,
 
 	blk_mq_sysfs_unregister(q);
 
-	blk_mq_update_queue_map(q->mq_map, q->nr_hw_queues, online_mask);
+	blk_mq_map_queues(q->tag_set, q->mq_map, online_mask);
 
 	/*
 	 * redo blk_mq_init_cpu_queues and blk_mq_init_hw_queues. FIXME: maybe
@@ -0,0 +1,162 @@
+/*
+ * Block rq completion latency statistics
+ *
+ * Per software queue (blk_mq_ctx) windows of completion latencies, bucketed
+ * by data direction and request size.  The hardware queue view is the sum
+ * of its software queues, which keeps the completion side free of shared
+ * cache lines.  The numbers are updated without locking and are only
+ * approximate, which is good enough for their users (hybrid polling).
+ */
+#include <linux/kernel.h>
+#include <linux/blk-mq.h>
+#include <linux/log2.h>
+
+#include "blk-stat.h"
+#include "blk-mq.h"
+
+void blk_stat_init(struct blk_rq_stat *stat)
+{
+	stat->sum = 0;
+	stat->min = -1ULL;
+	stat->max = 0;
+	stat->nr_samples = 0;
+	stat->window = 0;
+}
+
+void __blk_stat_add(struct blk_rq_stat *stat, u64 value)
+{
+	stat->min = min(stat->min, value);
+	stat->max = max(stat->max, value);
+	stat->sum += value;
+	stat->nr_samples++;
+}
+
+/*
+ * Add @value to the window of @now in @stat.  When that starts a new window,
+ * the one that just ended is kept in @prev for readers to fall back to.
+ */
+void blk_stat_add(struct blk_rq_stat *stat, struct blk_rq_stat *prev,
+		  u64 now, u64 value)
+{
+	u64 window = blk_stat_window(now);
+
+	if (stat->window != window) {
+		if (stat->window + 1 == window)
+			*prev = *stat;
+		else
+			blk_stat_init(prev);
+		blk_stat_init(stat);
+		stat->window = window;
+	}
+
+	__blk_stat_add(stat, value);
+}
+
+void blk_stat_sum(struct blk_rq_stat *dst, const struct blk_rq_stat *src)
+{
+	if (!src->nr_samples)
+		return;
+
+	dst->min = min(dst->min, src->min);
+	dst->max = max(dst->max, src->max);
+	dst->sum += src->sum;
+	dst->nr_samples += src->nr_samples;
+}
+
+/*
+ * Sum up @window of all software queues mapped to @hctx.  A software queue
+ * still in @window has it as its current window, one that has moved on to
+ * the next window keeps it as its previous one.  Software queues that
+ * haven't seen a completion in @window are stale and are skipped.
+ */
+static void blk_hctx_stat_sum(struct blk_mq_hw_ctx *hctx, int bucket,
+			      u64 window, struct blk_rq_stat *dst)
+{
+	struct blk_mq_ctx *ctx;
+	unsigned int i;
+
+	blk_stat_init(dst);
+
+	hctx_for_each_ctx(hctx, ctx, i) {
+		struct blk_rq_stat *stat = &ctx->poll_stat[bucket];
+		struct blk_rq_stat *prev = &ctx->poll_stat_prev[bucket];
+
+		if (READ_ONCE(stat->window) == window)
+			blk_stat_sum(dst, stat);
+		else if (READ_ONCE(prev->window) == window)
+			blk_stat_sum(dst, prev);
+	}
+
+	dst->window = window;
+}
+
+/*
+ * Get the statistics of the most recent window of @hctx.  Right after the
+ * window has rolled over it holds only a few samples, too few for a mean
+ * to go by; the previous, complete window is used until it has
+ * BLK_STAT_MIN_SAMPLES, unless that one has even fewer.
+ */
+void blk_hctx_stat_get(struct blk_mq_hw_ctx *hctx, int bucket,
+		       struct blk_rq_stat *dst)
+{
+	struct blk_rq_stat prev;
+	struct blk_mq_ctx *ctx;
+	u64 newest = 0;
+	unsigned int i;
+
+	hctx_for_each_ctx(hctx, ctx, i) {
+		u64 window = READ_ONCE(ctx->poll_stat[bucket].window);
+
+		if (window > newest)
+			newest = window;
+	}
+
+	blk_hctx_stat_sum(hctx, bucket, newest, dst);
+	if (dst->nr_samples >= BLK_STAT_MIN_SAMPLES || !newest)
+		return;
+
+	blk_hctx_stat_sum(hctx, bucket, newest - 1, &prev);
+	if (prev.nr_samples > dst->nr_samples)
+		*dst = prev;
+}
+
+int blk_mq_poll_stats_bkt(const struct request *rq)
+{
+	unsigned int bytes = blk_rq_bytes(rq);
+	int bucket;
+
+	if (bytes < 512)
+		return -1;
+
+	bucket = rq_data_dir(rq) + 2 * (ilog2(bytes) - 9);
+	if (bucket >= BLK_MQ_POLL_STATS_BKTS)
+		return BLK_MQ_POLL_STATS_BKTS - 2 + rq_data_dir(rq);
+
+	return bucket;
+}
+
+/*
+ * Called at completion time, before the request byte count is consumed.
+ * @now is shared by all the requests of a completion batch.
+ */
+void __blk_mq_stat_add(struct request *rq, u64 now)
+{
+	struct blk_mq_ctx *ctx = rq->mq_ctx;
+	int bucket;
+
+	bucket = blk_mq_poll_stats_bkt(rq);
+	if (bucket < 0)
+		return;
+
+	if (now < rq->issue_time_ns)
+		return;
+
+	blk_stat_add(&ctx->poll_stat[bucket], &ctx->poll_stat_prev[bucket],
+		     now, now - rq->issue_time_ns);
+}
+
+void blk_mq_stat_add(struct request *rq)
+{
+	if (rq->issue_time_ns)
+		__blk_mq_stat_add(rq, ktime_get_ns());
+}
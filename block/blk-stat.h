@@ -0,0 +1,58 @@
+#ifndef BLK_STAT_H
+#define BLK_STAT_H
+
+#include <linux/kernel.h>
+#include <linux/ktime.h>
+
+/*
+ * Samples are collected into time windows of 2^BLK_STAT_WIN_SHIFT nsecs
+ * (~134 msec).  A window is only consulted once it has enough samples to be
+ * meaningful, readers fall back to the previous window otherwise.
+ */
+#define BLK_STAT_WIN_SHIFT	27
+
+/* Minimum number of samples for a window to be consulted */
+#define BLK_STAT_MIN_SAMPLES	16
+
+/*
+ * Completion latency buckets, split by data direction and by log2 of the
+ * request size, starting at 512 bytes.
+ */
+#define BLK_MQ_POLL_STATS_BKTS	16
+
+struct blk_rq_stat {
+	u64	sum;
+	u64	min;
+	u64	max;
+	u32	nr_samples;
+	u64	window;
+};
+
+struct blk_mq_ctx;
+struct blk_mq_hw_ctx;
+struct request;
+
+void blk_stat_init(struct blk_rq_stat *stat);
+void __blk_stat_add(struct blk_rq_stat *stat, u64 value);
+void blk_stat_add(struct blk_rq_stat *stat, struct blk_rq_stat *prev,
+		  u64 now, u64 value);
+void blk_stat_sum(struct blk_rq_stat *dst, const struct blk_rq_stat *src);
+void blk_hctx_stat_get(struct blk_mq_hw_ctx *hctx, int bucket,
+		       struct blk_rq_stat *dst);
+void __blk_mq_stat_add(struct request *rq, u64 now);
+void blk_mq_stat_add(struct request *rq);
+int blk_mq_poll_stats_bkt(const struct request *rq);
+
+static inline u64 blk_stat_mean(const struct blk_rq_stat *stat)
+{
+	if (!stat->nr_samples)
+		return 0;
+	return div_u64(stat->sum, stat->nr_samples);
+}
+
+static inline u64 blk_stat_window(u64 now)
+{
+	return now >> BLK_STAT_WIN_SHIFT;
+}
+
+#endif
@@ -0,0 +1,589 @@
+/*
+ * buffered writeback throttling. loosely based on CoDel. We can't drop
+ * packets for IO scheduling, so the logic is something like this:
+ *
+ * - Monitor latencies of sync reads in a defined window of time.
+ * - If the minimum latency in the above window exceeds some target, increment
+ *   scaling step and scale down queue depth by a factor of 2x. The monitoring
+ *   window is then shrunk to 100 / sqrt(scaling step + 1).
+ * - For any window where we don't have solid data on what the latencies
+ *   look like, retain status quo.
+ * - If latencies look good, decrement scaling step.
+ * - If we're only doing writes, allow the scaling step to go negative. This
+ *   will temporarily boost write performance, snapping back to a stable
+ *   scaling step of 0 if reads show up or the heavy writers finish.
+ *
+ * Only async writes are throttled, sync writes (O_DIRECT, fsync and
+ * WB_SYNC_ALL writeback) and reads are never held back.
+ */
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/blkdev.h>
+#include <linux/backing-dev.h>
+#include <linux/percpu.h>
+#include <linux/slab.h>
+#include <linux/swap.h>
+
+#include "blk.h"
+#include "blk-wbt.h"
+
+/* Default window size, in nsecs */
+#define RWB_WINDOW_NSEC		(100 * 1000 * 1000ULL)
+
+/* Default latency targets, in nsecs */
+#define RWB_NONROT_LAT_NSEC	(2 * 1000 * 1000ULL)
+#define RWB_ROT_LAT_NSEC	(75 * 1000 * 1000ULL)
+
+/* Depth at scale step 0, unless the queue is shallower than this */
+#define RWB_DEF_DEPTH		16
+
+/* Minimum number of read samples for a window to be considered */
+#define RWB_MIN_READ_SAMPLES	1
+
+/* Windows without samples before drifting back to the default depth */
+#define RWB_UNKNOWN_BUMP	5
+
+enum {
+	LAT_OK = 1,
+	LAT_UNKNOWN,
+	LAT_UNKNOWN_WRITES,
+	LAT_EXCEEDED,
+};
+
+static inline bool rwb_enabled(struct rq_wb *rwb)
+{
+	return rwb && rwb->min_lat_nsec != 0;
+}
+
+/*
+ * Increment 'v', if 'v' is below 'below'. Returns true if we succeeded,
+ * false if 'v' + 1 would be bigger than 'below'.
+ */
+static bool atomic_inc_below(atomic_t *v, unsigned int below)
+{
+	unsigned int cur = atomic_read(v);
+
+	for (;;) {
+		unsigned int old;
+
+		if (cur >= below)
+			return false;
+		old = atomic_cmpxchg(v, cur, cur + 1);
+		if (old == cur)
+			break;
+		cur = old;
+	}
+
+	return true;
+}
+
+/*
+ * A task was recently throttled in balance_dirty_pages(), don't hold up
+ * the writeback that will let it make progress.
+ */
+static bool wb_recent_wait(struct rq_wb *rwb)
+{
+	struct bdi_writeback *wb = &rwb->queue->backing_dev_info.wb;
+
+	return time_before(jiffies, READ_ONCE(wb->dirty_sleep) + HZ);
+}
+
+/*
+ * Sync reads were issued recently, keep writes at the background depth.
+ */
+static bool close_io(struct rq_wb *rwb)
+{
+	return time_before(jiffies, READ_ONCE(rwb->last_issue) + HZ / 10);
+}
+
+static unsigned int get_limit(struct rq_wb *rwb, unsigned int flags)
+{
+	if (!rwb_enabled(rwb))
+		return UINT_MAX;
+
+	if ((flags & WBT_KSWAPD) || wb_recent_wait(rwb))
+		return rwb->wb_max;
+	if (close_io(rwb))
+		return rwb->wb_background;
+
+	return rwb->wb_normal;
+}
+
+static void rwb_wake_all(struct rq_wb *rwb)
+{
+	if (waitqueue_active(&rwb->wait))
+		wake_up_all(&rwb->wait);
+}
+
+void __wbt_done(struct rq_wb *rwb, unsigned int flags)
+{
+	unsigned int inflight, limit;
+
+	if (!(flags & WBT_TRACKED))
+		return;
+
+	inflight = atomic_dec_return(&rwb->inflight);
+	rwb->last_comp = jiffies;
+
+	/*
+	 * wbt got disabled with IO in flight. Wake up any potential
+	 * waiters, we don't have to do more than that.
+	 */
+	if (unlikely(!rwb_enabled(rwb))) {
+		rwb_wake_all(rwb);
+		return;
+	}
+
+	/*
+	 * Don't wake anyone up if we are above the limit, and only wake up
+	 * a waiter once a decent part of the background depth is free
+	 * again, so the device sees batches rather than single writes.
+	 */
+	limit = get_limit(rwb, flags);
+	if (inflight && inflight >= limit)
+		return;
+
+	if (waitqueue_active(&rwb->wait)) {
+		unsigned int diff = limit - inflight;
+
+		if (!inflight || diff >= rwb->wb_background / 2)
+			wake_up(&rwb->wait);
+	}
+}
+
+/*
+ * Called on completion (or free) of a request. Samples the latency of
+ * sync reads and releases the slot of throttled writes.
+ */
+void wbt_done(struct rq_wb *rwb, struct request *rq)
+{
+	if (!rwb || !rq->wbt_flags)
+		return;
+
+	if ((rq->wbt_flags & WBT_READ) && rq->issue_time_ns) {
+		u64 now = ktime_get_ns();
+		u64 window = READ_ONCE(rwb->window_seq);
+		struct blk_rq_stat *stat;
+		unsigned long flags;
+
+		local_irq_save(flags);
+		stat = this_cpu_ptr(rwb->stat);
+		if (stat->window != window) {
+			blk_stat_init(stat);
+			stat->window = window;
+		}
+		if (now > rq->issue_time_ns)
+			__blk_stat_add(stat, now - rq->issue_time_ns);
+		local_irq_restore(flags);
+	}
+
+	__wbt_done(rwb, rq->wbt_flags);
+	rq->wbt_flags = 0;
+}
+
+/*
+ * Return true, if we can't increase the depth further by scaling
+ */
+static bool calc_wb_limits(struct rq_wb *rwb)
+{
+	unsigned int queue_depth = rwb->queue->nr_requests;
+	unsigned int depth = min_t(unsigned int, RWB_DEF_DEPTH, queue_depth);
+	bool ret = false;
+
+	if (!depth)
+		depth = 1;
+
+	if (rwb->scale_step > 0) {
+		/*
+		 * scale_step > 0 means we are throttling down from the
+		 * default depth
+		 */
+		depth = 1 + ((depth - 1) >> min(31, rwb->scale_step));
+	} else if (rwb->scale_step < 0) {
+		/*
+		 * scale_step < 0 means we are only seeing writes, allow up
+		 * to 3/4 of the queue to be used for them
+		 */
+		unsigned int maxd = max(1U, 3 * queue_depth / 4);
+
+		depth = 1 + ((depth - 1) << min(31, -rwb->scale_step));
+		if (depth >= maxd) {
+			depth = maxd;
+			ret = true;
+		}
+	}
+
+	/*
+	 * Set our max/normal/bg queue depths based on how far
+	 * we have scaled down (->scale_step).
+	 */
+	rwb->wb_max = depth;
+	rwb->wb_normal = (rwb->wb_max + 1) / 2;
+	rwb->wb_background = (rwb->wb_max + 3) / 4;
+
+	return ret;
+}
+
+static void scale_up(struct rq_wb *rwb)
+{
+	/*
+	 * Hit max in previous round, stop here
+	 */
+	if (rwb->scaled_max)
+		return;
+
+	rwb->scale_step--;
+	rwb->unknown_cnt = 0;
+
+	rwb->scaled_max = calc_wb_limits(rwb);
+
+	rwb_wake_all(rwb);
+}
+
+/*
+ * Scale rwb down. If 'hard_throttle' is set, do it quicker, since we
+ * had a latency violation.
+ */
+static void scale_down(struct rq_wb *rwb, bool hard_throttle)
+{
+	/*
+	 * Stop scaling down when we've hit the limit. This also prevents
+	 * ->scale_step from going to crazy values, if the device can't
+	 * keep up.
+	 */
+	if (rwb->wb_max == 1)
+		return;
+
+	if (rwb->scale_step < 0 && hard_throttle)
+		rwb->scale_step = 0;
+	else
+		rwb->scale_step++;
+
+	rwb->scaled_max = false;
+	rwb->unknown_cnt = 0;
+	calc_wb_limits(rwb);
+}
+
+static void rwb_arm_timer(struct rq_wb *rwb)
+{
+	unsigned long expires;
+
+	if (rwb->scale_step > 0) {
+		/*
+		 * We should speed this up, using some variant of a fast
+		 * integer inverse square root calculation. Since we only do
+		 * this for every window expiration, it's not a huge deal,
+		 * though.
+		 */
+		rwb->cur_win_nsec = div_u64(rwb->win_nsec << 4,
+					int_sqrt((rwb->scale_step + 1) << 8));
+	} else {
+		/*
+		 * For step < 0, we don't want to increase/decrease the
+		 * window size.
+		 */
+		rwb->cur_win_nsec = rwb->win_nsec;
+	}
+
+	expires = nsecs_to_jiffies(rwb->cur_win_nsec);
+	mod_timer(&rwb->window_timer, jiffies + max(expires, 1UL));
+}
+
+static void rwb_arm_timer_lazy(struct rq_wb *rwb)
+{
+	if (!timer_pending(&rwb->window_timer))
+		rwb_arm_timer(rwb);
+}
+
+/*
+ * Sum up the read samples of the window that just ended and start a new
+ * one. CPUs that saw no reads in this window still hold an older window
+ * and are skipped.
+ */
+static int latency_exceeded(struct rq_wb *rwb)
+{
+	u64 window = rwb->window_seq;
+	struct blk_rq_stat stat;
+	int cpu;
+
+	blk_stat_init(&stat);
+	for_each_possible_cpu(cpu) {
+		struct blk_rq_stat *s = per_cpu_ptr(rwb->stat, cpu);
+
+		if (READ_ONCE(s->window) == window)
+			blk_stat_sum(&stat, s);
+	}
+	WRITE_ONCE(rwb->window_seq, window + 1);
+
+	if (stat.nr_samples < RWB_MIN_READ_SAMPLES) {
+		/*
+		 * No reads, but writes completed in this window. Allow
+		 * the scaling step to go negative.
+		 */
+		if (time_after_eq(rwb->last_comp + nsecs_to_jiffies(
+				  rwb->cur_win_nsec), jiffies))
+			return LAT_UNKNOWN_WRITES;
+		return LAT_UNKNOWN;
+	}
+
+	/*
+	 * If the 'min' latency exceeds our target, step down.
+	 */
+	if (stat.min > rwb->min_lat_nsec)
+		return LAT_EXCEEDED;
+
+	return LAT_OK;
+}
+
+static void wb_timer_fn(unsigned long data)
+{
+	struct rq_wb *rwb = (struct rq_wb *) data;
+	unsigned int inflight = wbt_inflight(rwb);
+	int status;
+
+	if (!rwb_enabled(rwb))
+		return;
+
+	status = latency_exceeded(rwb);
+
+	switch (status) {
+	case LAT_EXCEEDED:
+		scale_down(rwb, true);
+		break;
+	case LAT_OK:
+		scale_up(rwb);
+		break;
+	case LAT_UNKNOWN_WRITES:
+		/*
+		 * We started at the center step, but don't have a valid
+		 * read sample, but we do have writes going on. Allow
+		 * step to go negative, to increase write perf.
+		 */
+		scale_up(rwb);
+		break;
+	case LAT_UNKNOWN:
+		if (++rwb->unknown_cnt < RWB_UNKNOWN_BUMP)
+			break;
+		/*
+		 * We get here when previously scaled reduced depth, and we
+		 * currently don't have a valid read/write sample. For that
+		 * case, slowly return to center state (step == 0).
+		 */
+		if (rwb->scale_step > 0)
+			scale_up(rwb);
+		else if (rwb->scale_step < 0)
+			scale_down(rwb, false);
+		break;
+	default:
+		break;
+	}
+
+	/*
+	 * Re-arm timer, if we have IO in flight
+	 */
+	if (rwb->scale_step || inflight)
+		rwb_arm_timer(rwb);
+}
+
+/*
+ * Reset the scaling state, the depth limits are recomputed from the
+ * current queue depth.
+ */
+void wbt_update_limits(struct rq_wb *rwb)
+{
+	rwb->scale_step = 0;
+	rwb->scaled_max = false;
+	rwb->unknown_cnt = 0;
+	calc_wb_limits(rwb);
+
+	rwb_wake_all(rwb);
+}
+
+/*
+ * Set the read latency target, in nsecs. 0 turns throttling off.
+ */
+void wbt_set_min_lat(struct rq_wb *rwb, u64 val)
+{
+	rwb->min_lat_nsec = val;
+	wbt_update_limits(rwb);
+}
+
+u64 wbt_default_latency_nsec(struct request_queue *q)
+{
+	/*
+	 * We default to 2msec for non-rotational storage, and 75msec
+	 * for rotational storage.
+	 */
+	if (blk_queue_nonrot(q))
+		return RWB_NONROT_LAT_NSEC;
+	else
+		return RWB_ROT_LAT_NSEC;
+}
+
+static bool wbt_should_throttle(struct bio *bio)
+{
+	const unsigned long rw = bio->bi_rw;
+
+	/*
+	 * Only async buffered writes are throttled, everything else has
+	 * someone waiting on it.
+	 */
+	if ((rw & (REQ_WRITE | REQ_SYNC)) != REQ_WRITE)
+		return false;
+	if (rw & (REQ_DISCARD | REQ_FLUSH | REQ_FUA))
+		return false;
+
+	return true;
+}
+
+static bool may_queue(struct rq_wb *rwb, unsigned int flags, bool wait)
+{
+	/*
+	 * inc it here even if disabled, since we'll dec it at completion.
+	 * this only happens if the task was sleeping in __wbt_wait(),
+	 * and someone turned it off at the same time.
+	 */
+	if (!rwb_enabled(rwb)) {
+		atomic_inc(&rwb->inflight);
+		return true;
+	}
+
+	/*
+	 * If the waitqueue is already active and we are not the next
+	 * in line to be woken up, wait for our turn.
+	 */
+	if (waitqueue_active(&rwb->wait) && !wait)
+		return false;
+
+	return atomic_inc_below(&rwb->inflight, get_limit(rwb, flags));
+}
+
+/*
+ * Block if we will exceed our limit, or if we are currently waiting for
+ * the timer to kick off queuing again.
+ */
+static void __wbt_wait(struct rq_wb *rwb, unsigned int flags, spinlock_t *lock)
+	__releases(lock)
+	__acquires(lock)
+{
+	DEFINE_WAIT(wait);
+
+	if (may_queue(rwb, flags, false))
+		return;
+
+	do {
+		prepare_to_wait_exclusive(&rwb->wait, &wait,
+					  TASK_UNINTERRUPTIBLE);
+
+		if (may_queue(rwb, flags, true))
+			break;
+
+		if (lock) {
+			spin_unlock_irq(lock);
+			io_schedule();
+			spin_lock_irq(lock);
+		} else
+			io_schedule();
+	} while (1);
+
+	finish_wait(&rwb->wait, &wait);
+}
+
+/**
+ * wbt_wait - throttle an async write before a request is allocated for it
+ * @rwb:	the queue's throttling state
+ * @bio:	the bio about to be turned into a request
+ * @lock:	if set, the queue lock, held with interrupts disabled. It is
+ *		dropped while sleeping.
+ *
+ * Returns the flags to pass to wbt_track() for the new request, or to
+ * __wbt_done() if no request ends up being allocated.
+ */
+unsigned int wbt_wait(struct rq_wb *rwb, struct bio *bio, spinlock_t *lock)
+{
+	unsigned int flags = 0;
+
+	if (!rwb_enabled(rwb))
+		return 0;
+
+	if (!wbt_should_throttle(bio)) {
+		rwb_arm_timer_lazy(rwb);
+		return 0;
+	}
+
+	if (current_is_kswapd())
+		flags |= WBT_KSWAPD;
+
+	__wbt_wait(rwb, flags, lock);
+
+	rwb_arm_timer_lazy(rwb);
+
+	return flags | WBT_TRACKED;
+}
+
+/*
+ * Called when a request is handed to the driver. Sync reads are timed
+ * from here.
+ */
+void wbt_issue(struct rq_wb *rwb, struct request *rq)
+{
+	if (!rwb_enabled(rwb))
+		return;
+
+	if (rq_data_dir(rq) != READ || rq->cmd_type != REQ_TYPE_FS)
+		return;
+
+	if (!rq->issue_time_ns)
+		rq->issue_time_ns = ktime_get_ns();
+	rq->wbt_flags |= WBT_READ;
+	rwb->last_issue = jiffies;
+}
+
+int wbt_init(struct request_queue *q)
+{
+	struct rq_wb *rwb;
+
+	if (q->rq_wb)
+		return 0;
+
+	/* bio based drivers don't see requests */
+	if (!q->request_fn && !q->mq_ops)
+		return -EINVAL;
+
+	rwb = kzalloc_node(sizeof(*rwb), GFP_KERNEL, q->node);
+	if (!rwb)
+		return -ENOMEM;
+
+	rwb->stat = alloc_percpu(struct blk_rq_stat);
+	if (!rwb->stat) {
+		kfree(rwb);
+		return -ENOMEM;
+	}
+
+	atomic_set(&rwb->inflight, 0);
+	init_waitqueue_head(&rwb->wait);
+	setup_timer(&rwb->window_timer, wb_timer_fn, (unsigned long) rwb);
+	rwb->win_nsec = RWB_WINDOW_NSEC;
+	rwb->cur_win_nsec = RWB_WINDOW_NSEC;
+	rwb->window_seq = 1;
+	rwb->last_issue = jiffies - HZ;
+	rwb->last_comp = jiffies - HZ;
+	rwb->queue = q;
+
+	wbt_set_min_lat(rwb, wbt_default_latency_nsec(q));
+
+	q->rq_wb = rwb;
+	return 0;
+}
+
+void wbt_exit(struct request_queue *q)
+{
+	struct rq_wb *rwb = q->rq_wb;
+
+	if (rwb) {
+		del_timer_sync(&rwb->window_timer);
+		q->rq_wb = NULL;
+		free_percpu(rwb->stat);
+		kfree(rwb);
+	}
+}
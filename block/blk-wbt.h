@@ -0,0 +1,117 @@
+#ifndef WB_THROTTLE_H
+#define WB_THROTTLE_H
+
+#include <linux/kernel.h>
+#include <linux/atomic.h>
+#include <linux/wait.h>
+#include <linux/timer.h>
+#include <linux/ktime.h>
+
+#include "blk-stat.h"
+
+enum wbt_flags {
+	WBT_TRACKED		= 1,	/* write, counted against the limit */
+	WBT_KSWAPD		= 2,	/* write from kswapd */
+	WBT_READ		= 4,	/* sync read, latency is sampled */
+};
+
+/*
+ * Writeback throttling state of a request queue.
+ *
+ * Async writes are limited to a depth that is scaled up and down according
+ * to the completion latency of sync reads, monitored over a window of
+ * ->cur_win_nsec.  If the minimum read latency in a window exceeds
+ * ->min_lat_nsec, the allowed depth is halved and the window shortened, CoDel
+ * style.  Windows without problems scale the depth back up.
+ */
+struct rq_wb {
+	/*
+	 * Settings that govern how we throttle
+	 */
+	unsigned int wb_background;		/* background writeback */
+	unsigned int wb_normal;			/* normal writeback */
+	unsigned int wb_max;			/* max throughput writeback */
+	int scale_step;
+	bool scaled_max;
+
+	u64 win_nsec;				/* default window size */
+	u64 cur_win_nsec;			/* current window size */
+	u64 min_lat_nsec;			/* latency target, 0 is off */
+
+	unsigned int unknown_cnt;		/* windows without samples */
+
+	unsigned long last_issue;		/* last sync read issue */
+	unsigned long last_comp;		/* last throttled write comp */
+
+	struct timer_list window_timer;
+	struct blk_rq_stat __percpu *stat;	/* sync read latencies */
+	u64 window_seq;				/* current stat window */
+
+	atomic_t inflight;
+	wait_queue_head_t wait;
+
+	struct request_queue *queue;
+};
+
+static inline unsigned int wbt_inflight(struct rq_wb *rwb)
+{
+	return atomic_read(&rwb->inflight);
+}
+
+#ifdef CONFIG_BLK_WBT
+
+static inline void wbt_track(struct request *rq, unsigned int flags)
+{
+	rq->wbt_flags |= flags;
+}
+
+unsigned int wbt_wait(struct rq_wb *, struct bio *, spinlock_t *);
+void __wbt_done(struct rq_wb *, unsigned int);
+void wbt_done(struct rq_wb *, struct request *);
+void wbt_issue(struct rq_wb *, struct request *);
+void wbt_update_limits(struct rq_wb *);
+void wbt_set_min_lat(struct rq_wb *, u64);
+u64 wbt_default_latency_nsec(struct request_queue *);
+int wbt_init(struct request_queue *);
+void wbt_exit(struct request_queue *);
+
+#else
+
+static inline void wbt_track(struct request *rq, unsigned int flags)
+{
+}
+static inline unsigned int wbt_wait(struct rq_wb *rwb, struct bio *bio,
+				    spinlock_t *lock)
+{
+	return 0;
+}
+static inline void __wbt_done(struct rq_wb *rwb, unsigned int flags)
+{
+}
+static inline void wbt_done(struct rq_wb *rwb, struct request *rq)
+{
+}
+static inline void wbt_issue(struct rq_wb *rwb, struct request *rq)
+{
+}
+static inline void wbt_update_limits(struct rq_wb *rwb)
+{
+}
+static inline void wbt_set_min_lat(struct rq_wb *rwb, u64 val)
+{
+}
+static inline u64 wbt_default_latency_nsec(struct request_queue *q)
+{
+	return 0;
+}
+static inline int wbt_init(struct request_queue *q)
+{
+	return -EINVAL;
+}
+static inline void wbt_exit(struct request_queue *q)
+{
+}
+
+#endif /* CONFIG_BLK_WBT */
+
+#endif
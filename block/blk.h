@@ -118,6 +118,7 @@ void blk_account_io_done(struct request *req);
 enum rq_atomic_flags {
 	REQ_ATOM_COMPLETE = 0,
 	REQ_ATOM_STARTED,
+	REQ_ATOM_POLL_SLEPT,
 };
 
 /*
@@ -302,4 +303,35 @@ static inline int blk_throtl_init(struct request_queue *q) { return 0; }
 static inline void blk_throtl_exit(struct request_queue *q) { }
 #endif /* CONFIG_BLK_DEV_THROTTLING */
 
+struct blkcg_gq;
+
+#ifdef CONFIG_BLK_CGROUP_IOLATENCY
+extern int blk_iolatency_init(struct request_queue *q);
+extern void blk_iolatency_exit(struct request_queue *q);
+extern struct blkcg_gq *blk_iolatency_throttle(struct request_queue *q,
+					       struct bio *bio);
+extern void __blk_iolatency_done(struct blkcg_gq *blkg);
+extern void blk_iolatency_issue(struct request *rq);
+extern void blk_iolatency_done(struct request *rq);
+
+static inline void blk_iolatency_track(struct request *rq,
+				       struct blkcg_gq *blkg)
+{
+	rq->iolat_blkg = blkg;
+}
+#else /* CONFIG_BLK_CGROUP_IOLATENCY */
+static inline int blk_iolatency_init(struct request_queue *q) { return 0; }
+static inline void blk_iolatency_exit(struct request_queue *q) { }
+static inline struct blkcg_gq *blk_iolatency_throttle(struct request_queue *q,
+						      struct bio *bio)
+{
+	return NULL;
+}
+static inline void __blk_iolatency_done(struct blkcg_gq *blkg) { }
+static inline void blk_iolatency_issue(struct request *rq) { }
+static inline void blk_iolatency_done(struct request *rq) { }
+static inline void blk_iolatency_track(struct request *rq,
+				       struct blkcg_gq *blkg) { }
+#endif /* CONFIG_BLK_CGROUP_IOLATENCY */
+
 #endif /* BLK_INTERNAL_H */
@@ -40,6 +40,7 @@
 #include <trace/events/block.h>
 
 #include "blk.h"
+#include "blk-mq-sched.h"
 
 static DEFINE_SPINLOCK(elv_list_lock);
 static LIST_HEAD(elv_list);
@@ -224,6 +225,13 @@ int elevator_init(struct request_queue *q, char *name)
 		}
 	}
 
+	if (e->uses_mq) {
+		printk(KERN_ERR "I/O scheduler %s is for blk-mq only\n",
+						e->elevator_name);
+		elevator_put(e);
+		return -EINVAL;
+	}
+
 	err = e->ops.elevator_init_fn(q, e);
 	if (err)
 		elevator_put(e);
@@ -952,21 +960,41 @@ static int __elevator_change(struct request_queue *q, const char *name)
 	char elevator_name[ELV_NAME_MAX];
 	struct elevator_type *e;
 
-	if (!q->elevator)
+	if (!q->mq_ops && !q->elevator)
 		return -ENXIO;
 
 	strlcpy(elevator_name, name, sizeof(elevator_name));
-	e = elevator_get(strstrip(elevator_name), true);
+	strstrip(elevator_name);
+
+	/* blk-mq queues may run without a scheduler */
+	if (q->mq_ops && !strcmp(elevator_name, "none")) {
+		if (!q->elevator)
+			return 0;
+		return blk_mq_sched_switch(q, NULL);
+	}
+
+	e = elevator_get(elevator_name, true);
 	if (!e) {
 		printk(KERN_ERR "elevator: type %s not found\n", elevator_name);
 		return -EINVAL;
 	}
 
-	if (!strcmp(elevator_name, q->elevator->type->elevator_name)) {
+	if (q->elevator &&
+	    !strcmp(elevator_name, q->elevator->type->elevator_name)) {
 		elevator_put(e);
 		return 0;
 	}
 
+	if (e->uses_mq != !!q->mq_ops) {
+		printk(KERN_ERR "elevator: type %s not supported on this queue\n",
+		       elevator_name);
+		elevator_put(e);
+		return -EINVAL;
+	}
+
+	if (q->mq_ops)
+		return blk_mq_sched_switch(q, e);
+
 	return elevator_switch(q, e);
 }
 
@@ -988,7 +1016,7 @@ ssize_t elv_iosched_store(struct request_queue *q, const char *name,
 {
 	int ret;
 
-	if (!q->elevator)
+	if (!q->mq_ops && !q->elevator)
 		return count;
 
 	ret = __elevator_change(q, name);
@@ -1006,6 +1034,24 @@ ssize_t elv_iosched_show(struct request_queue *q, char *name)
 	struct elevator_type *__e;
 	int len = 0;
 
+	if (q->mq_ops) {
+		elv = e ? e->type : NULL;
+
+		spin_lock(&elv_list_lock);
+		list_for_each_entry(__e, &elv_list, list) {
+			if (!__e->uses_mq)
+				continue;
+			if (elv && !strcmp(elv->elevator_name, __e->elevator_name))
+				len += sprintf(name+len, "[%s] ", elv->elevator_name);
+			else
+				len += sprintf(name+len, "%s ", __e->elevator_name);
+		}
+		spin_unlock(&elv_list_lock);
+
+		len += sprintf(name+len, elv ? "none\n" : "[none]\n");
+		return len;
+	}
+
 	if (!q->elevator || !blk_queue_stackable(q))
 		return sprintf(name, "none\n");
 
@@ -1013,6 +1059,8 @@ ssize_t elv_iosched_show(struct request_queue *q, char *name)
 
 	spin_lock(&elv_list_lock);
 	list_for_each_entry(__e, &elv_list, list) {
+		if (__e->uses_mq)
+			continue;
 		if (!strcmp(elv->elevator_name, __e->elevator_name))
 			len += sprintf(name+len, "[%s] ", elv->elevator_name);
 		else
@@ -27,6 +27,7 @@
 #include <linux/crc-t10dif.h>
 #include <linux/module.h>
 #include <linux/kernel.h>
+#include <linux/rcupdate.h>
 
 /* Table generated using the following polynomium:
  * x^16 + x^15 + x^11 + x^9 + x^8 + x^7 + x^5 + x^4 + x^2 + x + 1
@@ -78,5 +79,48 @@ __u16 crc_t10dif_generic(__u16 crc, const unsigned char *buffer, size_t len)
 }
 EXPORT_SYMBOL(crc_t10dif_generic);
 
+static crc_t10dif_blocks_fn __rcu *crc_t10dif_blocks_arch;
+
+/*
+ * Going through the crypto API once per block is expensive for 512 byte
+ * sectors, the accelerated versions save and restore the FPU state on
+ * every call.  The batched interface lets them do that once per batch.
+ */
+void crc_t10dif_blocks(const unsigned char *data, unsigned int interval,
+		       unsigned int count, __u16 *crcs)
+{
+	crc_t10dif_blocks_fn *fn;
+	unsigned int i;
+
+	rcu_read_lock();
+	fn = rcu_dereference(crc_t10dif_blocks_arch);
+	if (fn) {
+		fn(data, interval, count, crcs);
+		rcu_read_unlock();
+		return;
+	}
+	rcu_read_unlock();
+
+	for (i = 0; i < count; i++, data += interval)
+		crcs[i] = crc_t10dif_generic(0, data, interval);
+}
+EXPORT_SYMBOL(crc_t10dif_blocks);
+
+void crc_t10dif_register_blocks(crc_t10dif_blocks_fn *fn)
+{
+	rcu_assign_pointer(crc_t10dif_blocks_arch, fn);
+}
+EXPORT_SYMBOL_GPL(crc_t10dif_register_blocks);
+
+void crc_t10dif_unregister_blocks(crc_t10dif_blocks_fn *fn)
+{
+	if (rcu_access_pointer(crc_t10dif_blocks_arch) != fn)
+		return;
+
+	RCU_INIT_POINTER(crc_t10dif_blocks_arch, NULL);
+	synchronize_rcu();
+}
+EXPORT_SYMBOL_GPL(crc_t10dif_unregister_blocks);
+
 MODULE_DESCRIPTION("T10 DIF CRC calculation common code");
 MODULE_LICENSE("GPL");
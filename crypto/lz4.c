@@ -28,6 +28,11 @@ struct lz4_ctx {
 	void *lz4_comp_mem;
 };
 
+static int acceleration = LZ4_ACCELERATION_DEFAULT;
+module_param(acceleration, int, 0644);
+MODULE_PARM_DESC(acceleration,
+		 "Acceleration, higher is faster but compresses less");
+
 static int lz4_init(struct crypto_tfm *tfm)
 {
 	struct lz4_ctx *ctx = crypto_tfm_ctx(tfm);
@@ -52,7 +57,8 @@ static int lz4_compress_crypto(struct crypto_tfm *tfm, const u8 *src,
 	size_t tmp_len = *dlen;
 	int err;
 
-	err = lz4_compress(src, slen, dst, &tmp_len, ctx->lz4_comp_mem);
+	err = lz4_compress_fast(src, slen, dst, &tmp_len, ctx->lz4_comp_mem,
+				READ_ONCE(acceleration));
 
 	if (err < 0)
 		return -EINVAL;
@@ -0,0 +1,127 @@
+/*
+ * Cryptographic API.
+ *
+ * Zstandard compression, tuned for page sized buffers.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ */
+
+#include <linux/init.h>
+#include <linux/module.h>
+#include <linux/crypto.h>
+#include <linux/vmalloc.h>
+#include <linux/zstd.h>
+
+#define ZSTD_DEF_LEVEL	3
+
+struct zstd_ctx {
+	struct zstd_parameters params;
+	struct zstd_cctx *cctx;
+	struct zstd_dctx *dctx;
+	void *cwksp;
+	void *dwksp;
+};
+
+static int zstd_init(struct crypto_tfm *tfm)
+{
+	struct zstd_ctx *ctx = crypto_tfm_ctx(tfm);
+	size_t wksp_size;
+
+	ctx->params = zstd_get_params(ZSTD_DEF_LEVEL, PAGE_SIZE);
+
+	wksp_size = zstd_cctx_workspace_bound(&ctx->params.cparams);
+	ctx->cwksp = vzalloc(wksp_size);
+	if (!ctx->cwksp)
+		return -ENOMEM;
+	ctx->cctx = zstd_init_cctx(ctx->cwksp, wksp_size);
+
+	wksp_size = zstd_dctx_workspace_bound();
+	ctx->dwksp = vzalloc(wksp_size);
+	if (!ctx->dwksp) {
+		vfree(ctx->cwksp);
+		return -ENOMEM;
+	}
+	ctx->dctx = zstd_init_dctx(ctx->dwksp, wksp_size);
+
+	if (!ctx->cctx || !ctx->dctx) {
+		vfree(ctx->dwksp);
+		vfree(ctx->cwksp);
+		return -EINVAL;
+	}
+	return 0;
+}
+
+static void zstd_exit(struct crypto_tfm *tfm)
+{
+	struct zstd_ctx *ctx = crypto_tfm_ctx(tfm);
+
+	vfree(ctx->dwksp);
+	vfree(ctx->cwksp);
+}
+
+static int zstd_compress_crypto(struct crypto_tfm *tfm, const u8 *src,
+				unsigned int slen, u8 *dst, unsigned int *dlen)
+{
+	struct zstd_ctx *ctx = crypto_tfm_ctx(tfm);
+	size_t out_len;
+
+	out_len = zstd_compress_cctx(ctx->cctx, dst, *dlen, src, slen,
+				     &ctx->params);
+	if (zstd_is_error(out_len))
+		return -EINVAL;
+
+	*dlen = out_len;
+	return 0;
+}
+
+static int zstd_decompress_crypto(struct crypto_tfm *tfm, const u8 *src,
+				  unsigned int slen, u8 *dst,
+				  unsigned int *dlen)
+{
+	struct zstd_ctx *ctx = crypto_tfm_ctx(tfm);
+	size_t out_len;
+
+	out_len = zstd_decompress_dctx(ctx->dctx, dst, *dlen, src, slen);
+	if (zstd_is_error(out_len))
+		return -EINVAL;
+
+	*dlen = out_len;
+	return 0;
+}
+
+static struct crypto_alg alg_zstd = {
+	.cra_name		= "zstd",
+	.cra_flags		= CRYPTO_ALG_TYPE_COMPRESS,
+	.cra_ctxsize		= sizeof(struct zstd_ctx),
+	.cra_module		= THIS_MODULE,
+	.cra_list		= LIST_HEAD_INIT(alg_zstd.cra_list),
+	.cra_init		= zstd_init,
+	.cra_exit		= zstd_exit,
+	.cra_u			= { .compress = {
+	.coa_compress		= zstd_compress_crypto,
+	.coa_decompress		= zstd_decompress_crypto } }
+};
+
+static int __init zstd_mod_init(void)
+{
+	return crypto_register_alg(&alg_zstd);
+}
+
+static void __exit zstd_mod_fini(void)
+{
+	crypto_unregister_alg(&alg_zstd);
+}
+
+module_init(zstd_mod_init);
+module_exit(zstd_mod_fini);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("Zstd Compression Algorithm");
+MODULE_ALIAS_CRYPTO("zstd");
@@ -849,20 +849,55 @@ static void loop_config_discard(struct loop_device *lo)
 	queue_flag_set_unlocked(QUEUE_FLAG_DISCARD, q);
 }
 
+static void __loop_unprepare_queue(struct loop_device *lo, unsigned int nr)
+{
+	unsigned int i;
+
+	for (i = 0; i < nr; i++) {
+		struct loop_worker *w = &lo->workers[i];
+
+		flush_kthread_worker(&w->worker);
+		kthread_stop(w->worker_task);
+	}
+	kfree(lo->workers);
+	lo->workers = NULL;
+}
+
 static void loop_unprepare_queue(struct loop_device *lo)
 {
-	flush_kthread_worker(&lo->worker);
-	kthread_stop(lo->worker_task);
+	__loop_unprepare_queue(lo, lo->tag_set.nr_hw_queues);
 }
 
+/*
+ * Each hardware queue gets its own worker, so requests queued on
+ * different queues are handled, and with direct I/O submitted to the
+ * backing file, concurrently.
+ */
 static int loop_prepare_queue(struct loop_device *lo)
 {
-	init_kthread_worker(&lo->worker);
-	lo->worker_task = kthread_run(kthread_worker_fn,
-			&lo->worker, "loop%d", lo->lo_number);
-	if (IS_ERR(lo->worker_task))
+	unsigned int i, nr = lo->tag_set.nr_hw_queues;
+
+	lo->workers = kcalloc(nr, sizeof(*lo->workers), GFP_KERNEL);
+	if (!lo->workers)
 		return -ENOMEM;
-	set_user_nice(lo->worker_task, MIN_NICE);
+
+	for (i = 0; i < nr; i++) {
+		struct loop_worker *w = &lo->workers[i];
+
+		init_kthread_worker(&w->worker);
+		if (nr == 1)
+			w->worker_task = kthread_run(kthread_worker_fn,
+					&w->worker, "loop%d", lo->lo_number);
+		else
+			w->worker_task = kthread_run(kthread_worker_fn,
+					&w->worker, "loop%d/%u",
+					lo->lo_number, i);
+		if (IS_ERR(w->worker_task)) {
+			__loop_unprepare_queue(lo, i);
+			return -ENOMEM;
+		}
+		set_user_nice(w->worker_task, MIN_NICE);
+	}
 	return 0;
 }
 
@@ -1607,6 +1642,10 @@ module_param(max_loop, int, S_IRUGO);
 MODULE_PARM_DESC(max_loop, "Maximum number of loop devices");
 module_param(max_part, int, S_IRUGO);
 MODULE_PARM_DESC(max_part, "Maximum number of partitions per loop device");
+static unsigned int nr_hw_queues = 1;
+module_param(nr_hw_queues, uint, S_IRUGO);
+MODULE_PARM_DESC(nr_hw_queues,
+		 "Number of hardware queues per loop device, 0 means one per CPU");
 MODULE_LICENSE("GPL");
 MODULE_ALIAS_BLOCKDEV_MAJOR(LOOP_MAJOR);
 
@@ -1653,19 +1692,22 @@ static int loop_queue_rq(struct blk_mq_hw_ctx *hctx,
 {
 	struct loop_cmd *cmd = blk_mq_rq_to_pdu(bd->rq);
 	struct loop_device *lo = cmd->rq->q->queuedata;
+	struct kthread_worker *worker;
 
 	blk_mq_start_request(bd->rq);
 
 	if (lo->lo_state != Lo_bound)
 		return -EIO;
 
+	worker = &lo->workers[hctx->queue_num].worker;
+
 	if (lo->use_dio && !(cmd->rq->cmd_flags & (REQ_FLUSH |
 					REQ_DISCARD)))
 		cmd->use_aio = true;
 	else
 		cmd->use_aio = false;
 
-	queue_kthread_work(&lo->worker, &cmd->work);
+	queue_kthread_work(worker, &cmd->work);
 
 	return BLK_MQ_RQ_QUEUE_OK;
 }
@@ -1741,7 +1783,8 @@ static int loop_add(struct loop_device **l, int i)
 
 	err = -ENOMEM;
 	lo->tag_set.ops = &loop_mq_ops;
-	lo->tag_set.nr_hw_queues = 1;
+	lo->tag_set.nr_hw_queues = min_t(unsigned int, nr_cpu_ids,
+					 nr_hw_queues ? : num_online_cpus());
 	lo->tag_set.queue_depth = 128;
 	lo->tag_set.numa_node = NUMA_NO_NODE;
 	lo->tag_set.cmd_size = sizeof(struct loop_cmd);
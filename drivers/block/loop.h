@@ -56,8 +56,7 @@ struct loop_device {
 	spinlock_t		lo_lock;
 	int			lo_state;
 	struct mutex		lo_ctl_mutex;
-	struct kthread_worker	worker;
-	struct task_struct	*worker_task;
+	struct loop_worker	*workers;	/* one per hardware queue */
 	bool			use_dio;
 
 	struct request_queue	*lo_queue;
@@ -65,6 +64,11 @@ struct loop_device {
 	struct gendisk		*lo_disk;
 };
 
+struct loop_worker {
+	struct kthread_worker	worker;
+	struct task_struct	*worker_task;
+};
+
 struct loop_cmd {
 	struct kthread_work work;
 	struct request *rq;
@@ -22,6 +22,11 @@ static DEFINE_IDA(vd_index_ida);
 
 static struct workqueue_struct *virtblk_wq;
 
+static unsigned int poll_queues;
+module_param(poll_queues, uint, 0444);
+MODULE_PARM_DESC(poll_queues,
+	"number of queues dedicated to polled I/O, taken from the device's queues");
+
 struct virtio_blk_vq {
 	struct virtqueue *vq;
 	spinlock_t lock;
@@ -46,8 +51,12 @@ struct virtio_blk {
 	/* Ida index - used to track minor number allocations. */
 	int index;
 
-	/* num of vqs */
+	/*
+	 * num of vqs: one per hardware context, followed by the poll vqs,
+	 * which have callbacks disabled and only get polled I/O (REQ_HIPRI).
+	 */
 	int num_vqs;
+	int num_poll_vqs;
 	struct virtio_blk_vq *vqs;
 };
 
@@ -157,6 +166,16 @@ static void virtblk_done(struct virtqueue *vq)
 	spin_unlock_irqrestore(&vblk->vqs[qid].lock, flags);
 }
 
+/* The vq @req is issued on: polled I/O goes to a poll vq, if there are any */
+static int virtblk_req_qid(struct virtio_blk *vblk, struct blk_mq_hw_ctx *hctx,
+			   struct request *req)
+{
+	if (vblk->num_poll_vqs && (req->cmd_flags & REQ_HIPRI))
+		return vblk->num_vqs + hctx->queue_num % vblk->num_poll_vqs;
+
+	return hctx->queue_num;
+}
+
 static int virtio_queue_rq(struct blk_mq_hw_ctx *hctx,
 			   const struct blk_mq_queue_data *bd)
 {
@@ -165,7 +184,7 @@ static int virtio_queue_rq(struct blk_mq_hw_ctx *hctx,
 	struct virtblk_req *vbr = blk_mq_rq_to_pdu(req);
 	unsigned long flags;
 	unsigned int num;
-	int qid = hctx->queue_num;
+	int qid = virtblk_req_qid(vblk, hctx, req);
 	int err;
 	bool notify = false;
 
@@ -231,6 +250,33 @@ static int virtio_queue_rq(struct blk_mq_hw_ctx *hctx,
 	return BLK_MQ_RQ_QUEUE_OK;
 }
 
+static int virtblk_poll(struct blk_mq_hw_ctx *hctx, unsigned int tag)
+{
+	struct virtio_blk *vblk = hctx->queue->queuedata;
+	struct request *rq = blk_mq_tag_to_rq(hctx->tags, tag);
+	struct virtio_blk_vq *vq = &vblk->vqs[virtblk_req_qid(vblk, hctx, rq)];
+	struct virtblk_req *vbr;
+	unsigned long flags;
+	unsigned int len;
+	bool req_done = false;
+	int found = 0;
+
+	spin_lock_irqsave(&vq->lock, flags);
+	while ((vbr = virtqueue_get_buf(vq->vq, &len)) != NULL) {
+		if (vbr->req == rq)
+			found = 1;
+		blk_mq_complete_request(vbr->req, vbr->req->errors);
+		req_done = true;
+	}
+
+	/* In case queue is stopped waiting for more buffers. */
+	if (req_done)
+		blk_mq_start_stopped_hw_queues(vblk->disk->queue, true);
+	spin_unlock_irqrestore(&vq->lock, flags);
+
+	return found;
+}
+
 /* return id (s/n) string for *disk to *id_str
  */
 static int virtblk_get_id(struct gendisk *disk, char *id_str)
@@ -385,6 +431,7 @@ static int init_vq(struct virtio_blk *vblk)
 	const char **names;
 	struct virtqueue **vqs;
 	unsigned short num_vqs;
+	unsigned short num_poll_vqs;
 	struct virtio_device *vdev = vblk->vdev;
 
 	err = virtio_cread_feature(vdev, VIRTIO_BLK_F_MQ,
@@ -393,6 +440,9 @@ static int init_vq(struct virtio_blk *vblk)
 	if (err)
 		num_vqs = 1;
 
+	/* Keep at least one vq with interrupts for everything else */
+	num_poll_vqs = min_t(unsigned int, poll_queues, num_vqs - 1);
+
 	vblk->vqs = kmalloc(sizeof(*vblk->vqs) * num_vqs, GFP_KERNEL);
 	if (!vblk->vqs) {
 		err = -ENOMEM;
@@ -411,12 +461,18 @@ static int init_vq(struct virtio_blk *vblk)
 	if (!vqs)
 		goto err_vqs;
 
-	for (i = 0; i < num_vqs; i++) {
+	for (i = 0; i < num_vqs - num_poll_vqs; i++) {
 		callbacks[i] = virtblk_done;
 		snprintf(vblk->vqs[i].name, VQ_NAME_LEN, "req.%d", i);
 		names[i] = vblk->vqs[i].name;
 	}
 
+	for (; i < num_vqs; i++) {
+		callbacks[i] = NULL;
+		snprintf(vblk->vqs[i].name, VQ_NAME_LEN, "req_poll.%d", i);
+		names[i] = vblk->vqs[i].name;
+	}
+
 	/* Discover virtqueues and write information to configuration.  */
 	err = vdev->config->find_vqs(vdev, num_vqs, vqs, callbacks, names);
 	if (err)
@@ -426,7 +482,12 @@ static int init_vq(struct virtio_blk *vblk)
 		spin_lock_init(&vblk->vqs[i].lock);
 		vblk->vqs[i].vq = vqs[i];
 	}
-	vblk->num_vqs = num_vqs;
+	vblk->num_vqs = num_vqs - num_poll_vqs;
+	vblk->num_poll_vqs = num_poll_vqs;
+
+	/* Nobody waits for poll vq interrupts, suppress them */
+	for (i = vblk->num_vqs; i < num_vqs; i++)
+		virtqueue_disable_cb(vblk->vqs[i].vq);
 
  err_find_vqs:
 	kfree(vqs);
@@ -557,6 +618,7 @@ static struct blk_mq_ops virtio_mq_ops = {
 	.map_queue	= blk_mq_map_queue,
 	.complete	= virtblk_request_done,
 	.init_request	= virtblk_init_request,
+	.poll		= virtblk_poll,
 };
 
 static unsigned int virtblk_queue_depth;
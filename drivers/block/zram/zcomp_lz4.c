@@ -8,6 +8,7 @@
  */
 
 #include <linux/kernel.h>
+#include <linux/module.h>
 #include <linux/slab.h>
 #include <linux/lz4.h>
 #include <linux/vmalloc.h>
@@ -15,6 +16,11 @@
 
 #include "zcomp_lz4.h"
 
+static int lz4_acceleration = LZ4_ACCELERATION_DEFAULT;
+module_param(lz4_acceleration, int, 0644);
+MODULE_PARM_DESC(lz4_acceleration,
+		 "LZ4 acceleration, higher is faster but compresses less");
+
 static void *zcomp_lz4_create(void)
 {
 	void *ret;
@@ -46,11 +52,12 @@ static int zcomp_lz4_compress(const unsigned char *src, unsigned char *dst,
 		size_t *dst_len, void *private)
 {
 	/* return  : Success if return 0 */
-	return lz4_compress(src, PAGE_SIZE, dst, dst_len, private);
+	return lz4_compress_fast(src, PAGE_SIZE, dst, dst_len, private,
+				 READ_ONCE(lz4_acceleration));
 }
 
 static int zcomp_lz4_decompress(const unsigned char *src, size_t src_len,
-		unsigned char *dst)
+		unsigned char *dst, void *private)
 {
 	size_t dst_len = PAGE_SIZE;
 	/* return  : Success if return 0 */
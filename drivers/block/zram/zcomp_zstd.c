@@ -0,0 +1,96 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ */
+
+#include <linux/kernel.h>
+#include <linux/slab.h>
+#include <linux/zstd.h>
+#include <linux/vmalloc.h>
+#include <linux/mm.h>
+
+#include "zcomp_zstd.h"
+
+#define ZCOMP_ZSTD_LEVEL	3
+
+struct zcomp_zstd {
+	struct zstd_parameters params;
+	struct zstd_cctx *cctx;
+	struct zstd_dctx *dctx;
+};
+
+static void *zcomp_zstd_create(void)
+{
+	struct zstd_parameters params;
+	struct zcomp_zstd *zstd;
+	size_t csize, dsize, size;
+	void *ret;
+
+	params = zstd_get_params(ZCOMP_ZSTD_LEVEL, PAGE_SIZE);
+	csize = ALIGN(zstd_cctx_workspace_bound(&params.cparams), 8);
+	dsize = zstd_dctx_workspace_bound();
+	size = ALIGN(sizeof(*zstd), 8) + csize + dsize;
+
+	/* Same constraints as the other backends, see zcomp_lzo.c */
+	ret = kzalloc(size, GFP_NOIO | __GFP_NORETRY | __GFP_NOWARN);
+	if (!ret)
+		ret = __vmalloc(size,
+				GFP_NOIO | __GFP_NORETRY | __GFP_NOWARN |
+				__GFP_ZERO | __GFP_HIGHMEM,
+				PAGE_KERNEL);
+	if (!ret)
+		return NULL;
+
+	zstd = ret;
+	zstd->params = params;
+	zstd->cctx = zstd_init_cctx(ret + ALIGN(sizeof(*zstd), 8), csize);
+	zstd->dctx = zstd_init_dctx(ret + ALIGN(sizeof(*zstd), 8) + csize,
+				    dsize);
+	if (!zstd->cctx || !zstd->dctx) {
+		kvfree(ret);
+		return NULL;
+	}
+	return zstd;
+}
+
+static void zcomp_zstd_destroy(void *private)
+{
+	kvfree(private);
+}
+
+static int zcomp_zstd_compress(const unsigned char *src, unsigned char *dst,
+		size_t *dst_len, void *private)
+{
+	struct zcomp_zstd *zstd = private;
+	size_t ret;
+
+	/* dst is two pages long, see zcomp_strm_alloc() */
+	ret = zstd_compress_cctx(zstd->cctx, dst, 2 * PAGE_SIZE, src,
+				 PAGE_SIZE, &zstd->params);
+	if (zstd_is_error(ret))
+		return zstd_get_error(ret);
+	*dst_len = ret;
+	return 0;
+}
+
+static int zcomp_zstd_decompress(const unsigned char *src, size_t src_len,
+		unsigned char *dst, void *private)
+{
+	struct zcomp_zstd *zstd = private;
+	size_t ret;
+
+	ret = zstd_decompress_dctx(zstd->dctx, dst, PAGE_SIZE, src, src_len);
+	if (zstd_is_error(ret))
+		return zstd_get_error(ret);
+	return ret == PAGE_SIZE ? 0 : -EINVAL;
+}
+
+struct zcomp_backend zcomp_zstd = {
+	.compress = zcomp_zstd_compress,
+	.decompress = zcomp_zstd_decompress,
+	.create = zcomp_zstd_create,
+	.destroy = zcomp_zstd_destroy,
+	.name = "zstd",
+};
@@ -30,6 +30,7 @@
 #include <linux/err.h>
 #include <linux/idr.h>
 #include <linux/sysfs.h>
+#include <linux/workqueue.h>
 
 #include "zram_drv.h"
 
@@ -304,46 +305,20 @@ static ssize_t mem_used_max_store(struct device *dev,
 	return len;
 }
 
+/*
+ * Compression streams are per-cpu now, so there is nothing to tune.  The
+ * attribute is kept for existing tools and reports one stream per CPU.
+ */
 static ssize_t max_comp_streams_show(struct device *dev,
 		struct device_attribute *attr, char *buf)
 {
-	int val;
-	struct zram *zram = dev_to_zram(dev);
-
-	down_read(&zram->init_lock);
-	val = zram->max_comp_streams;
-	up_read(&zram->init_lock);
-
-	return scnprintf(buf, PAGE_SIZE, "%d\n", val);
+	return scnprintf(buf, PAGE_SIZE, "%d\n", num_online_cpus());
 }
 
 static ssize_t max_comp_streams_store(struct device *dev,
 		struct device_attribute *attr, const char *buf, size_t len)
 {
-	int num;
-	struct zram *zram = dev_to_zram(dev);
-	int ret;
-
-	ret = kstrtoint(buf, 0, &num);
-	if (ret < 0)
-		return ret;
-	if (num < 1)
-		return -EINVAL;
-
-	down_write(&zram->init_lock);
-	if (init_done(zram)) {
-		if (!zcomp_set_max_streams(zram->comp, num)) {
-			pr_info("Cannot change max compression streams\n");
-			ret = -EINVAL;
-			goto out;
-		}
-	}
-
-	zram->max_comp_streams = num;
-	ret = len;
-out:
-	up_write(&zram->init_lock);
-	return ret;
+	return len;
 }
 
 static ssize_t comp_algorithm_show(struct device *dev,
@@ -456,6 +431,266 @@ static ssize_t mm_stat_show(struct device *dev,
 	return ret;
 }
 
+#ifdef CONFIG_ZRAM_WRITEBACK
+static void reset_bdev(struct zram *zram)
+{
+	struct block_device *bdev;
+
+	if (!zram->backing_dev)
+		return;
+
+	bdev = zram->bdev;
+	set_blocksize(bdev, zram->old_block_size);
+	blkdev_put(bdev, FMODE_READ | FMODE_WRITE | FMODE_EXCL);
+	filp_close(zram->backing_dev, NULL);
+	zram->backing_dev = NULL;
+	zram->old_block_size = 0;
+	zram->bdev = NULL;
+
+	vfree(zram->bitmap);
+	zram->bitmap = NULL;
+}
+
+static ssize_t backing_dev_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct zram *zram = dev_to_zram(dev);
+	struct file *file;
+	char *p;
+	ssize_t ret;
+
+	down_read(&zram->init_lock);
+	file = zram->backing_dev;
+	if (!file) {
+		ret = scnprintf(buf, PAGE_SIZE, "none\n");
+		goto out;
+	}
+
+	p = file_path(file, buf, PAGE_SIZE - 1);
+	if (IS_ERR(p)) {
+		ret = PTR_ERR(p);
+		goto out;
+	}
+
+	ret = strlen(p);
+	memmove(buf, p, ret);
+	buf[ret++] = '\n';
+out:
+	up_read(&zram->init_lock);
+	return ret;
+}
+
+static ssize_t backing_dev_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t len)
+{
+	char *file_name;
+	size_t sz;
+	struct file *backing_dev = NULL;
+	struct inode *inode;
+	unsigned int old_block_size = 0;
+	unsigned long nr_pages, *bitmap = NULL;
+	struct block_device *bdev = NULL;
+	int err;
+	struct zram *zram = dev_to_zram(dev);
+
+	file_name = kmalloc(PATH_MAX, GFP_KERNEL);
+	if (!file_name)
+		return -ENOMEM;
+
+	down_write(&zram->init_lock);
+	if (init_done(zram)) {
+		pr_info("Can't setup backing device for initialized device\n");
+		err = -EBUSY;
+		goto out;
+	}
+
+	strlcpy(file_name, buf, PATH_MAX);
+	/* ignore trailing newline */
+	sz = strlen(file_name);
+	if (sz > 0 && file_name[sz - 1] == '\n')
+		file_name[sz - 1] = 0x00;
+
+	backing_dev = filp_open(file_name, O_RDWR | O_LARGEFILE, 0);
+	if (IS_ERR(backing_dev)) {
+		err = PTR_ERR(backing_dev);
+		backing_dev = NULL;
+		goto out;
+	}
+
+	inode = backing_dev->f_mapping->host;
+	/* Only block devices are supported as backing device */
+	if (!S_ISBLK(inode->i_mode)) {
+		err = -ENOTBLK;
+		goto out;
+	}
+
+	bdev = bdgrab(I_BDEV(inode));
+	err = blkdev_get(bdev, FMODE_READ | FMODE_WRITE | FMODE_EXCL, zram);
+	if (err < 0) {
+		bdev = NULL;
+		goto out;
+	}
+
+	nr_pages = i_size_read(inode) >> PAGE_SHIFT;
+	bitmap = vzalloc(BITS_TO_LONGS(nr_pages) * sizeof(long));
+	if (!bitmap) {
+		err = -ENOMEM;
+		goto out;
+	}
+
+	old_block_size = block_size(bdev);
+	err = set_blocksize(bdev, PAGE_SIZE);
+	if (err)
+		goto out;
+
+	reset_bdev(zram);
+	spin_lock_init(&zram->bitmap_lock);
+
+	zram->old_block_size = old_block_size;
+	zram->bdev = bdev;
+	zram->backing_dev = backing_dev;
+	zram->bitmap = bitmap;
+	zram->nr_pages = nr_pages;
+	up_write(&zram->init_lock);
+
+	pr_info("setup backing device %s\n", file_name);
+	kfree(file_name);
+
+	return len;
+out:
+	vfree(bitmap);
+	if (bdev)
+		blkdev_put(bdev, FMODE_READ | FMODE_WRITE | FMODE_EXCL);
+	if (backing_dev)
+		filp_close(backing_dev, NULL);
+	up_write(&zram->init_lock);
+	kfree(file_name);
+
+	return err;
+}
+
+/*
+ * Block 0 is never handed out, so that a written back page never has
+ * a zero handle.
+ */
+static unsigned long alloc_block_bdev(struct zram *zram)
+{
+	unsigned long blk_idx;
+
+	spin_lock(&zram->bitmap_lock);
+	blk_idx = find_next_zero_bit(zram->bitmap, zram->nr_pages, 1);
+	if (blk_idx >= zram->nr_pages) {
+		spin_unlock(&zram->bitmap_lock);
+		return 0;
+	}
+	set_bit(blk_idx, zram->bitmap);
+	spin_unlock(&zram->bitmap_lock);
+
+	atomic64_inc(&zram->stats.bd_count);
+	return blk_idx;
+}
+
+static void free_block_bdev(struct zram *zram, unsigned long blk_idx)
+{
+	int was_set;
+
+	was_set = test_and_clear_bit(blk_idx, zram->bitmap);
+	WARN_ON_ONCE(!was_set);
+	atomic64_dec(&zram->stats.bd_count);
+}
+
+static int zram_bdev_rw(struct zram *zram, unsigned long blk_idx,
+			struct page *page, int rw)
+{
+	struct bio *bio;
+	int ret;
+
+	bio = bio_alloc(GFP_NOIO, 1);
+	if (!bio)
+		return -ENOMEM;
+
+	bio->bi_iter.bi_sector = blk_idx << SECTORS_PER_PAGE_SHIFT;
+	bio->bi_bdev = zram->bdev;
+	if (!bio_add_page(bio, page, PAGE_SIZE, 0)) {
+		bio_put(bio);
+		return -EIO;
+	}
+
+	ret = submit_bio_wait(rw, bio);
+	bio_put(bio);
+	return ret;
+}
+
+struct zram_work {
+	struct work_struct work;
+	struct zram *zram;
+	unsigned long blk_idx;
+	struct page *page;
+	int ret;
+};
+
+static void zram_sync_read(struct work_struct *work)
+{
+	struct zram_work *zw = container_of(work, struct zram_work, work);
+
+	zw->ret = zram_bdev_rw(zw->zram, zw->blk_idx, zw->page, READ);
+}
+
+/*
+ * Reads can come from within zram_make_request(), where a bio submitted to
+ * another device is only issued once the current make_request_fn returns.
+ * Waiting for it there would deadlock, so the read is done by a worker.
+ */
+static int read_from_bdev(struct zram *zram, unsigned long blk_idx,
+			  struct page *page)
+{
+	struct zram_work work;
+
+	work.zram = zram;
+	work.blk_idx = blk_idx;
+	work.page = page;
+
+	INIT_WORK_ONSTACK(&work.work, zram_sync_read);
+	queue_work(system_unbound_wq, &work.work);
+	flush_work(&work.work);
+	destroy_work_on_stack(&work.work);
+
+	atomic64_inc(&zram->stats.bd_reads);
+	return work.ret;
+}
+
+static ssize_t bd_stat_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct zram *zram = dev_to_zram(dev);
+	ssize_t ret;
+
+	down_read(&zram->init_lock);
+	ret = scnprintf(buf, PAGE_SIZE,
+			"%8llu %8llu %8llu\n",
+			(u64)atomic64_read(&zram->stats.bd_count),
+			(u64)atomic64_read(&zram->stats.bd_reads),
+			(u64)atomic64_read(&zram->stats.bd_writes));
+	up_read(&zram->init_lock);
+
+	return ret;
+}
+#else
+static inline void reset_bdev(struct zram *zram)
+{
+}
+
+static inline void free_block_bdev(struct zram *zram, unsigned long blk_idx)
+{
+}
+
+static inline int read_from_bdev(struct zram *zram, unsigned long blk_idx,
+				 struct page *page)
+{
+	return -EIO;
+}
+#endif
+
 static DEVICE_ATTR_RO(io_stat);
 static DEVICE_ATTR_RO(mm_stat);
 ZRAM_ATTR_RO(num_reads);
@@ -488,7 +723,8 @@ static void zram_meta_free(struct zram_meta *meta, u64 disksize)
 	for (index = 0; index < num_pages; index++) {
 		unsigned long handle = meta->table[index].handle;
 
-		if (!handle)
+		/* the backing device blocks go away with its bitmap */
+		if (!handle || zram_test_flag(meta, index, ZRAM_WB))
 			continue;
 
 		zs_free(meta->mem_pool, handle);
@@ -514,7 +750,7 @@ static struct zram_meta *zram_meta_alloc(char *pool_name, u64 disksize)
 		goto out_error;
 	}
 
-	meta->mem_pool = zs_create_pool(pool_name, GFP_NOIO | __GFP_HIGHMEM);
+	meta->mem_pool = zs_create_pool(pool_name);
 	if (!meta->mem_pool) {
 		pr_err("Error creating memory pool\n");
 		goto out_error;
@@ -538,6 +774,18 @@ static void zram_free_page(struct zram *zram, size_t index)
 	struct zram_meta *meta = zram->meta;
 	unsigned long handle = meta->table[index].handle;
 
+	zram_clear_flag(meta, index, ZRAM_HUGE);
+	zram_clear_flag(meta, index, ZRAM_IDLE);
+	/* tells a writeback in progress that the page has changed */
+	zram_clear_flag(meta, index, ZRAM_UNDER_WB);
+
+	if (zram_test_flag(meta, index, ZRAM_WB)) {
+		zram_clear_flag(meta, index, ZRAM_WB);
+		free_block_bdev(zram, handle);
+		meta->table[index].handle = 0;
+		return;
+	}
+
 	if (unlikely(!handle)) {
 		/*
 		 * No memory is allocated for zero filled pages.
@@ -572,6 +820,12 @@ static int zram_decompress_page(struct zram *zram, char *mem, u32 index)
 	handle = meta->table[index].handle;
 	size = zram_get_obj_size(meta, index);
 
+	if (zram_test_flag(meta, index, ZRAM_WB)) {
+		/* written back meanwhile, see zram_read_page() */
+		bit_spin_unlock(ZRAM_ACCESS, &meta->table[index].value);
+		return -EAGAIN;
+	}
+
 	if (!handle || zram_test_flag(meta, index, ZRAM_ZERO)) {
 		bit_spin_unlock(ZRAM_ACCESS, &meta->table[index].value);
 		clear_page(mem);
@@ -579,10 +833,14 @@ static int zram_decompress_page(struct zram *zram, char *mem, u32 index)
 	}
 
 	cmem = zs_map_object(meta->mem_pool, handle, ZS_MM_RO);
-	if (size == PAGE_SIZE)
+	if (size == PAGE_SIZE) {
 		copy_page(mem, cmem);
-	else
-		ret = zcomp_decompress(zram->comp, cmem, size, mem);
+	} else {
+		struct zcomp_strm *zstrm = zcomp_strm_find(zram->comp);
+
+		ret = zcomp_decompress(zram->comp, zstrm, cmem, size, mem);
+		zcomp_strm_release(zram->comp, zstrm);
+	}
 	zs_unmap_object(meta->mem_pool, handle);
 	bit_spin_unlock(ZRAM_ACCESS, &meta->table[index].value);
 
@@ -595,16 +853,178 @@ static int zram_decompress_page(struct zram *zram, char *mem, u32 index)
 	return 0;
 }
 
+/*
+ * Read the content of slot @index into @page.  Pages that were written
+ * back are read from the backing device, so this may sleep.
+ */
+static int zram_read_page(struct zram *zram, struct page *page, u32 index)
+{
+	struct zram_meta *meta = zram->meta;
+	unsigned long blk_idx;
+	void *mem;
+	int ret;
+
+	do {
+		bit_spin_lock(ZRAM_ACCESS, &meta->table[index].value);
+		if (zram_test_flag(meta, index, ZRAM_WB)) {
+			blk_idx = meta->table[index].handle;
+			bit_spin_unlock(ZRAM_ACCESS, &meta->table[index].value);
+			return read_from_bdev(zram, blk_idx, page);
+		}
+		bit_spin_unlock(ZRAM_ACCESS, &meta->table[index].value);
+
+		mem = kmap_atomic(page);
+		ret = zram_decompress_page(zram, mem, index);
+		kunmap_atomic(mem);
+	} while (ret == -EAGAIN);
+
+	return ret;
+}
+
+#ifdef CONFIG_ZRAM_WRITEBACK
+static ssize_t idle_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t len)
+{
+	struct zram *zram = dev_to_zram(dev);
+	struct zram_meta *meta;
+	unsigned long nr_pages, index;
+
+	if (!sysfs_streq(buf, "all"))
+		return -EINVAL;
+
+	down_read(&zram->init_lock);
+	if (!init_done(zram)) {
+		up_read(&zram->init_lock);
+		return -EINVAL;
+	}
+
+	meta = zram->meta;
+	nr_pages = zram->disksize >> PAGE_SHIFT;
+	for (index = 0; index < nr_pages; index++) {
+		bit_spin_lock(ZRAM_ACCESS, &meta->table[index].value);
+		if (meta->table[index].handle &&
+		    !zram_test_flag(meta, index, ZRAM_WB) &&
+		    !zram_test_flag(meta, index, ZRAM_UNDER_WB))
+			zram_set_flag(meta, index, ZRAM_IDLE);
+		bit_spin_unlock(ZRAM_ACCESS, &meta->table[index].value);
+	}
+	up_read(&zram->init_lock);
+
+	return len;
+}
+
+/*
+ * Write the idle or the huge pages to the backing device and free their
+ * memory.  A page that is written or freed while its writeback is in
+ * flight loses ZRAM_UNDER_WB, and the backing device copy is dropped.
+ */
+static ssize_t writeback_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t len)
+{
+	struct zram *zram = dev_to_zram(dev);
+	struct zram_meta *meta;
+	unsigned long nr_pages, index, blk_idx;
+	enum zram_pageflags mode;
+	struct page *page;
+	void *mem;
+	ssize_t ret = len;
+	int err;
+
+	if (sysfs_streq(buf, "idle"))
+		mode = ZRAM_IDLE;
+	else if (sysfs_streq(buf, "huge"))
+		mode = ZRAM_HUGE;
+	else
+		return -EINVAL;
+
+	down_read(&zram->init_lock);
+	if (!init_done(zram)) {
+		ret = -EINVAL;
+		goto out_unlock;
+	}
+
+	if (!zram->backing_dev) {
+		ret = -ENODEV;
+		goto out_unlock;
+	}
+
+	page = alloc_page(GFP_KERNEL);
+	if (!page) {
+		ret = -ENOMEM;
+		goto out_unlock;
+	}
+
+	meta = zram->meta;
+	nr_pages = zram->disksize >> PAGE_SHIFT;
+	for (index = 0; index < nr_pages; index++) {
+		bit_spin_lock(ZRAM_ACCESS, &meta->table[index].value);
+		if (!meta->table[index].handle ||
+		    zram_test_flag(meta, index, ZRAM_WB) ||
+		    zram_test_flag(meta, index, ZRAM_UNDER_WB) ||
+		    !zram_test_flag(meta, index, mode)) {
+			bit_spin_unlock(ZRAM_ACCESS, &meta->table[index].value);
+			continue;
+		}
+		zram_set_flag(meta, index, ZRAM_UNDER_WB);
+		bit_spin_unlock(ZRAM_ACCESS, &meta->table[index].value);
+
+		mem = kmap_atomic(page);
+		err = zram_decompress_page(zram, mem, index);
+		kunmap_atomic(mem);
+		if (err)
+			goto next;
+
+		blk_idx = alloc_block_bdev(zram);
+		if (!blk_idx) {
+			ret = -ENOSPC;
+			goto next;
+		}
+
+		err = zram_bdev_rw(zram, blk_idx, page, WRITE);
+		if (err) {
+			free_block_bdev(zram, blk_idx);
+			ret = err;
+			goto next;
+		}
+		atomic64_inc(&zram->stats.bd_writes);
+
+		bit_spin_lock(ZRAM_ACCESS, &meta->table[index].value);
+		if (!zram_test_flag(meta, index, ZRAM_UNDER_WB)) {
+			bit_spin_unlock(ZRAM_ACCESS, &meta->table[index].value);
+			free_block_bdev(zram, blk_idx);
+			continue;
+		}
+		zram_free_page(zram, index);
+		zram_set_flag(meta, index, ZRAM_WB);
+		meta->table[index].handle = blk_idx;
+		bit_spin_unlock(ZRAM_ACCESS, &meta->table[index].value);
+		continue;
+next:
+		bit_spin_lock(ZRAM_ACCESS, &meta->table[index].value);
+		zram_clear_flag(meta, index, ZRAM_UNDER_WB);
+		bit_spin_unlock(ZRAM_ACCESS, &meta->table[index].value);
+		if (ret < 0)
+			break;
+	}
+
+	__free_page(page);
+out_unlock:
+	up_read(&zram->init_lock);
+
+	return ret;
+}
+#endif
+
 static int zram_bvec_read(struct zram *zram, struct bio_vec *bvec,
 			  u32 index, int offset)
 {
 	int ret;
 	struct page *page;
-	unsigned char *user_mem, *uncmem = NULL;
 	struct zram_meta *meta = zram->meta;
 	page = bvec->bv_page;
 
 	bit_spin_lock(ZRAM_ACCESS, &meta->table[index].value);
+	zram_clear_flag(meta, index, ZRAM_IDLE);
 	if (unlikely(!meta->table[index].handle) ||
 			zram_test_flag(meta, index, ZRAM_ZERO)) {
 		bit_spin_unlock(ZRAM_ACCESS, &meta->table[index].value);
@@ -613,35 +1033,33 @@ static int zram_bvec_read(struct zram *zram, struct bio_vec *bvec,
 	}
 	bit_spin_unlock(ZRAM_ACCESS, &meta->table[index].value);
 
-	if (is_partial_io(bvec))
-		/* Use  a temporary buffer to decompress the page */
-		uncmem = kmalloc(PAGE_SIZE, GFP_NOIO);
-
-	user_mem = kmap_atomic(page);
-	if (!is_partial_io(bvec))
-		uncmem = user_mem;
-
-	if (!uncmem) {
-		pr_err("Unable to allocate temp memory\n");
-		ret = -ENOMEM;
-		goto out_cleanup;
+	if (is_partial_io(bvec)) {
+		/* Use a temporary page to read the full page */
+		page = alloc_page(GFP_NOIO);
+		if (!page) {
+			pr_err("Unable to allocate temp memory\n");
+			return -ENOMEM;
+		}
 	}
 
-	ret = zram_decompress_page(zram, uncmem, index);
+	ret = zram_read_page(zram, page, index);
 	/* Should NEVER happen. Return bio error if it does. */
 	if (unlikely(ret))
 		goto out_cleanup;
 
-	if (is_partial_io(bvec))
-		memcpy(user_mem + bvec->bv_offset, uncmem + offset,
-				bvec->bv_len);
+	if (is_partial_io(bvec)) {
+		void *dst = kmap_atomic(bvec->bv_page);
+		void *src = kmap_atomic(page);
 
-	flush_dcache_page(page);
-	ret = 0;
+		memcpy(dst + bvec->bv_offset, src + offset, bvec->bv_len);
+		kunmap_atomic(src);
+		kunmap_atomic(dst);
+	}
+
+	flush_dcache_page(bvec->bv_page);
 out_cleanup:
-	kunmap_atomic(user_mem);
 	if (is_partial_io(bvec))
-		kfree(uncmem);
+		__free_page(page);
 	return ret;
 }
 
@@ -650,11 +1068,12 @@ static int zram_bvec_write(struct zram *zram, struct bio_vec *bvec, u32 index,
 {
 	int ret = 0;
 	size_t clen;
-	unsigned long handle;
+	unsigned long handle = 0;
 	struct page *page;
 	unsigned char *user_mem, *cmem, *src, *uncmem = NULL;
 	struct zram_meta *meta = zram->meta;
 	struct zcomp_strm *zstrm = NULL;
+	struct page *tmp_page = NULL;
 	unsigned long alloced_pages;
 
 	page = bvec->bv_page;
@@ -663,16 +1082,18 @@ static int zram_bvec_write(struct zram *zram, struct bio_vec *bvec, u32 index,
 		 * This is a partial IO. We need to read the full page
 		 * before to write the changes.
 		 */
-		uncmem = kmalloc(PAGE_SIZE, GFP_NOIO);
-		if (!uncmem) {
+		tmp_page = alloc_page(GFP_NOIO);
+		if (!tmp_page) {
 			ret = -ENOMEM;
 			goto out;
 		}
-		ret = zram_decompress_page(zram, uncmem, index);
+		ret = zram_read_page(zram, tmp_page, index);
 		if (ret)
 			goto out;
+		uncmem = page_address(tmp_page);
 	}
 
+compress_again:
 	zstrm = zcomp_strm_find(zram->comp);
 	user_mem = kmap_atomic(page);
 
@@ -717,8 +1138,24 @@ static int zram_bvec_write(struct zram *zram, struct bio_vec *bvec, u32 index,
 			src = uncmem;
 	}
 
-	handle = zs_malloc(meta->mem_pool, clen);
+	/*
+	 * The per-cpu stream keeps preemption disabled, so the handle is
+	 * first allocated without direct reclaim.  If that fails, drop the
+	 * stream, allocate with reclaim allowed, and compress again since
+	 * the stream buffer may have been reused meanwhile.
+	 */
+	if (!handle)
+		handle = zs_malloc(meta->mem_pool, clen, __GFP_KSWAPD_RECLAIM |
+				   __GFP_NOWARN | __GFP_HIGHMEM);
 	if (!handle) {
+		zcomp_strm_release(zram->comp, zstrm);
+		zstrm = NULL;
+
+		handle = zs_malloc(meta->mem_pool, clen,
+				   GFP_NOIO | __GFP_HIGHMEM);
+		if (handle)
+			goto compress_again;
+
 		pr_err("Error allocating memory for compressed page: %u, size=%zu\n",
 			index, clen);
 		ret = -ENOMEM;
@@ -729,7 +1166,6 @@ static int zram_bvec_write(struct zram *zram, struct bio_vec *bvec, u32 index,
 	update_used_max(zram, alloced_pages);
 
 	if (zram->limit_pages && alloced_pages > zram->limit_pages) {
-		zs_free(meta->mem_pool, handle);
 		ret = -ENOMEM;
 		goto out;
 	}
@@ -756,7 +1192,10 @@ static int zram_bvec_write(struct zram *zram, struct bio_vec *bvec, u32 index,
 	zram_free_page(zram, index);
 
 	meta->table[index].handle = handle;
+	handle = 0;
 	zram_set_obj_size(meta, index, clen);
+	if (clen == PAGE_SIZE)
+		zram_set_flag(meta, index, ZRAM_HUGE);
 	bit_spin_unlock(ZRAM_ACCESS, &meta->table[index].value);
 
 	/* Update stats */
@@ -765,8 +1204,11 @@ static int zram_bvec_write(struct zram *zram, struct bio_vec *bvec, u32 index,
 out:
 	if (zstrm)
 		zcomp_strm_release(zram->comp, zstrm);
-	if (is_partial_io(bvec))
-		kfree(uncmem);
+	/* a handle left over from a failed or recompressed write */
+	if (handle)
+		zs_free(meta->mem_pool, handle);
+	if (tmp_page)
+		__free_page(tmp_page);
 	return ret;
 }
 
@@ -987,6 +1429,7 @@ static void zram_reset_device(struct zram *zram)
 	zram->limit_pages = 0;
 
 	if (!init_done(zram)) {
+		reset_bdev(zram);
 		up_write(&zram->init_lock);
 		return;
 	}
@@ -1009,10 +1452,10 @@ static void zram_reset_device(struct zram *zram)
 	/* Reset stats */
 	memset(&zram->stats, 0, sizeof(zram->stats));
 	zram->disksize = 0;
-	zram->max_comp_streams = 1;
 
 	set_capacity(zram->disk, 0);
 	part_stat_set_all(&zram->disk->part0, 0);
+	reset_bdev(zram);
 
 	up_write(&zram->init_lock);
 	/* I/O operation under all of CPU are done so let's free */
@@ -1038,7 +1481,7 @@ static ssize_t disksize_store(struct device *dev,
 	if (!meta)
 		return -ENOMEM;
 
-	comp = zcomp_create(zram->compressor, zram->max_comp_streams);
+	comp = zcomp_create(zram->compressor);
 	if (IS_ERR(comp)) {
 		pr_err("Cannot initialise %s compressing backend\n",
 				zram->compressor);
@@ -1155,6 +1598,12 @@ static DEVICE_ATTR_RW(mem_limit);
 static DEVICE_ATTR_RW(mem_used_max);
 static DEVICE_ATTR_RW(max_comp_streams);
 static DEVICE_ATTR_RW(comp_algorithm);
+#ifdef CONFIG_ZRAM_WRITEBACK
+static DEVICE_ATTR_RW(backing_dev);
+static DEVICE_ATTR_WO(writeback);
+static DEVICE_ATTR_WO(idle);
+static DEVICE_ATTR_RO(bd_stat);
+#endif
 
 static struct attribute *zram_disk_attrs[] = {
 	&dev_attr_disksize.attr,
@@ -1177,6 +1626,12 @@ static struct attribute *zram_disk_attrs[] = {
 	&dev_attr_comp_algorithm.attr,
 	&dev_attr_io_stat.attr,
 	&dev_attr_mm_stat.attr,
+#ifdef CONFIG_ZRAM_WRITEBACK
+	&dev_attr_backing_dev.attr,
+	&dev_attr_writeback.attr,
+	&dev_attr_idle.attr,
+	&dev_attr_bd_stat.attr,
+#endif
 	NULL,
 };
 
@@ -1273,7 +1728,6 @@ static int zram_add(void)
 	}
 	strlcpy(zram->compressor, default_compressor, sizeof(zram->compressor));
 	zram->meta = NULL;
-	zram->max_comp_streams = 1;
 
 	pr_info("Added device: %s\n", zram->disk->disk_name);
 	return device_id;
@@ -62,6 +62,10 @@ enum zram_pageflags {
 	/* Page consists entirely of zeros */
 	ZRAM_ZERO = ZRAM_FLAG_SHIFT,
 	ZRAM_ACCESS,	/* page is now accessed */
+	ZRAM_HUGE,	/* page is stored uncompressed */
+	ZRAM_IDLE,	/* not accessed since it was last marked idle */
+	ZRAM_WB,	/* page is on the backing device, handle is its block */
+	ZRAM_UNDER_WB,	/* page is being written back */
 
 	__NR_ZRAM_PAGEFLAGS,
 };
@@ -85,6 +89,11 @@ struct zram_stats {
 	atomic64_t zero_pages;		/* no. of zero filled pages */
 	atomic64_t pages_stored;	/* no. of pages currently stored */
 	atomic_long_t max_used_pages;	/* no. of maximum pages stored */
+#ifdef CONFIG_ZRAM_WRITEBACK
+	atomic64_t bd_count;		/* no. of pages in backing device */
+	atomic64_t bd_reads;		/* no. of reads from backing device */
+	atomic64_t bd_writes;		/* no. of writes to backing device */
+#endif
 };
 
 struct zram_meta {
@@ -102,7 +111,6 @@ struct zram {
 	 * the number of pages zram can consume for storing compressed data
 	 */
 	unsigned long limit_pages;
-	int max_comp_streams;
 
 	struct zram_stats stats;
 	atomic_t refcount; /* refcount for zram_meta */
@@ -118,5 +126,15 @@ struct zram {
 	 * zram is claimed so open request will be failed
 	 */
 	bool claim; /* Protected by bdev->bd_mutex */
+#ifdef CONFIG_ZRAM_WRITEBACK
+	/* backing device for written back pages, protected by init_lock */
+	struct file *backing_dev;
+	struct block_device *bdev;
+	unsigned int old_block_size;
+	/* allocated blocks of the backing device, protected by bitmap_lock */
+	unsigned long *bitmap;
+	unsigned long nr_pages;
+	spinlock_t bitmap_lock;
+#endif
 };
 #endif
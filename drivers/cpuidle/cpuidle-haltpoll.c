@@ -0,0 +1,65 @@
+/*
+ * cpuidle driver for halt polling, for KVM guests.
+ *
+ * Halting in a guest costs a VM exit and a host wakeup, which dominates
+ * short idle periods.  The driver has two states, the generic polling
+ * state and halt, and leaves choosing between them to the haltpoll
+ * governor, which bounds the polling adaptively.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#define pr_fmt(fmt) "CPUidle haltpoll: " fmt
+
+#include <linux/init.h>
+#include <linux/cpuidle.h>
+#include <linux/module.h>
+#include <linux/sched.h>
+#include <linux/kvm_para.h>
+
+static int haltpoll_enter_idle(struct cpuidle_device *dev,
+			       struct cpuidle_driver *drv, int index)
+{
+	if (!need_resched())
+		safe_halt();
+	else
+		local_irq_enable();
+
+	return index;
+}
+
+static struct cpuidle_driver haltpoll_driver = {
+	.name = "haltpoll",
+	.owner = THIS_MODULE,
+	.governor = "haltpoll",
+	.states = {
+		{ /* entry 0 is for polling */ },
+		{
+			.enter			= haltpoll_enter_idle,
+			.exit_latency		= 1,
+			.target_residency	= 1,
+			.power_usage		= -1,
+			.name			= "haltpoll idle",
+			.desc			= "default architecture idle",
+		},
+	},
+	.safe_state_index = 0,
+	.state_count = 2,
+};
+
+static int __init haltpoll_init(void)
+{
+	int ret;
+
+	if (!kvm_para_available())
+		return -ENODEV;
+
+	ret = cpuidle_register(&haltpoll_driver, NULL);
+	if (ret)
+		pr_err("failed to register driver: %d\n", ret);
+
+	return ret;
+}
+device_initcall(haltpoll_init);
@@ -0,0 +1,148 @@
+/*
+ * haltpoll.c - haltpoll idle governor
+ *
+ * Picks between the polling state and halt, for guests where halting
+ * costs a VM exit and a host wakeup.  After a halt the CPU polls, for up
+ * to dev->poll_limit_ns, before halting again.  The limit grows when the
+ * halt ended early enough that polling would have caught the wakeup, and
+ * shrinks when the CPU stayed idle for longer than polling is allowed to
+ * last.
+ *
+ * This code is licenced under the GPL.
+ */
+
+#include <linux/kernel.h>
+#include <linux/cpuidle.h>
+#include <linux/time.h>
+#include <linux/module.h>
+#include <linux/pm_qos.h>
+
+/* upper bound of the per-cpu poll_limit_ns */
+static unsigned int guest_halt_poll_ns __read_mostly = 200000;
+module_param(guest_halt_poll_ns, uint, 0644);
+
+/* division factor to shrink per-cpu poll_limit_ns, 0 resets it */
+static unsigned int guest_halt_poll_shrink __read_mostly = 2;
+module_param(guest_halt_poll_shrink, uint, 0644);
+
+/* multiplication factor to grow per-cpu poll_limit_ns */
+static unsigned int guest_halt_poll_grow __read_mostly = 2;
+module_param(guest_halt_poll_grow, uint, 0644);
+
+/* value in ns to start growing per-cpu poll_limit_ns from */
+static unsigned int guest_halt_poll_grow_start __read_mostly = 50000;
+module_param(guest_halt_poll_grow_start, uint, 0644);
+
+/* allow shrinking per-cpu poll_limit_ns */
+static bool guest_halt_poll_allow_shrink __read_mostly = true;
+module_param(guest_halt_poll_allow_shrink, bool, 0644);
+
+static DEFINE_PER_CPU(int, haltpoll_last_state_idx);
+
+/**
+ * haltpoll_select - selects the next idle state to enter
+ * @drv: cpuidle driver containing state data
+ * @dev: the CPU
+ */
+static int haltpoll_select(struct cpuidle_driver *drv,
+			   struct cpuidle_device *dev)
+{
+	int latency_req = pm_qos_request(PM_QOS_CPU_DMA_LATENCY);
+
+	if (!drv->state_count || latency_req == 0)
+		return 0;
+
+	if (dev->poll_limit_ns == 0)
+		return 1;
+
+	/* Last state was poll?  Halt if nothing came in the poll window */
+	if (__this_cpu_read(haltpoll_last_state_idx) == 0)
+		return dev->poll_time_limit ? 1 : 0;
+
+	/* Last state was halt: poll */
+	return 0;
+}
+
+static void adjust_poll_limit(struct cpuidle_device *dev, u64 block_ns)
+{
+	u64 val;
+
+	/* Polling a bit longer would have caught this wakeup: grow */
+	if (block_ns > dev->poll_limit_ns && block_ns <= guest_halt_poll_ns) {
+		val = dev->poll_limit_ns * guest_halt_poll_grow;
+
+		if (val < guest_halt_poll_grow_start)
+			val = guest_halt_poll_grow_start;
+		if (val > guest_halt_poll_ns)
+			val = guest_halt_poll_ns;
+
+		dev->poll_limit_ns = val;
+	} else if (block_ns > guest_halt_poll_ns &&
+		   guest_halt_poll_allow_shrink) {
+		/* Polling is not going to help for idle periods this long */
+		unsigned int shrink = guest_halt_poll_shrink;
+
+		val = dev->poll_limit_ns;
+		if (shrink == 0)
+			val = 0;
+		else
+			val /= shrink;
+		dev->poll_limit_ns = val;
+	}
+}
+
+/**
+ * haltpoll_reflect - update variables and update poll time
+ * @dev: the CPU
+ * @index: the index of actual entered state
+ */
+static void haltpoll_reflect(struct cpuidle_device *dev, int index)
+{
+	__this_cpu_write(haltpoll_last_state_idx, index);
+
+	if (index != 0)
+		adjust_poll_limit(dev,
+				  (u64)dev->last_residency * NSEC_PER_USEC);
+}
+
+/**
+ * haltpoll_enable_device - scans a CPU's states and does setup
+ * @drv: cpuidle driver
+ * @dev: the CPU
+ */
+static int haltpoll_enable_device(struct cpuidle_driver *drv,
+				  struct cpuidle_device *dev)
+{
+	dev->poll_limit_ns = 0;
+	per_cpu(haltpoll_last_state_idx, dev->cpu) = 0;
+
+	return 0;
+}
+
+/**
+ * haltpoll_disable_device - lets other governors poll without a bound again
+ * @drv: cpuidle driver
+ * @dev: the CPU
+ */
+static void haltpoll_disable_device(struct cpuidle_driver *drv,
+				    struct cpuidle_device *dev)
+{
+	dev->poll_limit_ns = 0;
+}
+
+static struct cpuidle_governor haltpoll_governor = {
+	.name =			"haltpoll",
+	.rating =		9,
+	.enable =		haltpoll_enable_device,
+	.disable =		haltpoll_disable_device,
+	.select =		haltpoll_select,
+	.reflect =		haltpoll_reflect,
+	.owner =		THIS_MODULE,
+};
+
+static int __init init_haltpoll(void)
+{
+	return cpuidle_register_governor(&haltpoll_governor);
+}
+
+postcore_initcall(init_haltpoll);
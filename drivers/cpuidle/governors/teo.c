@@ -0,0 +1,329 @@
+/*
+ * teo.c - the timer events oriented (TEO) idle governor
+ *
+ * The next timer event is the primary signal: it is known exactly, and on
+ * most systems the majority of CPU wakeups are timer events.  The governor
+ * picks the idle state whose target residency fits the time until the next
+ * timer event, unless that state has recently been "missed" more often
+ * than "hit", i.e. the CPU kept waking up early, before the timer, for a
+ * reason the governor cannot see coming (interrupts, IPIs, packets).
+ *
+ * To see that, every idle state has three decaying metrics:
+ *
+ *  hits	- the state matched the sleep length and the wakeup came from
+ *		  the timer or late enough for the state to have paid off,
+ *  misses	- the state matched the sleep length, but the CPU woke up too
+ *		  early for it,
+ *  early_hits	- the state was the deepest one that fit the idle duration
+ *		  actually measured after one of those early wakeups.
+ *
+ * If misses outweigh hits for the state matching the sleep length, the
+ * shallower state with the most early hits is used instead.  Finally, if
+ * most of the recent early wakeups came even sooner than that, the
+ * average of those idle durations is used to pick a shallower state.
+ *
+ * Unlike menu, no load or iowait based heuristics are involved, and the
+ * bookkeeping after a wakeup is a single pass over the states.
+ *
+ * This code is licenced under the GPL version 2 as described
+ * in the COPYING file that acompanies the Linux Kernel.
+ */
+
+#include <linux/kernel.h>
+#include <linux/cpuidle.h>
+#include <linux/pm_qos.h>
+#include <linux/jiffies.h>
+#include <linux/ktime.h>
+#include <linux/tick.h>
+#include <linux/math64.h>
+#include <linux/sched.h>
+#include <linux/module.h>
+
+/*
+ * The metrics decay by 1/2^DECAY_SHIFT on every wakeup and grow by PULSE
+ * on every event they count, so they stay below PULSE << DECAY_SHIFT.
+ */
+#define PULSE		1024
+#define DECAY_SHIFT	3
+
+/* Number of the most recent idle durations used for pattern detection */
+#define INTERVALS	8
+
+#define TEO_TICK_US	(USEC_PER_SEC / HZ)
+
+struct teo_idle_state {
+	unsigned int early_hits;
+	unsigned int hits;
+	unsigned int misses;
+};
+
+struct teo_cpu {
+	unsigned int sleep_length_us;
+	int last_state;
+	int needs_update;
+	unsigned int interval_idx;
+	unsigned int intervals[INTERVALS];
+	struct teo_idle_state states[CPUIDLE_STATE_MAX];
+};
+
+static DEFINE_PER_CPU(struct teo_cpu, teo_cpus);
+
+/**
+ * teo_update - update the metrics after a wakeup
+ * @drv: cpuidle driver containing state data
+ * @dev: the CPU
+ */
+static void teo_update(struct cpuidle_driver *drv, struct cpuidle_device *dev)
+{
+	struct teo_cpu *cpu_data = this_cpu_ptr(&teo_cpus);
+	unsigned int sleep_length_us = cpu_data->sleep_length_us;
+	unsigned int lat = drv->states[cpu_data->last_state].exit_latency;
+	unsigned int measured_us = cpuidle_get_last_residency(dev);
+	int i, idx_hit = -1, idx_timer = -1;
+
+	/*
+	 * The measured time includes the exit latency.  A wakeup within the
+	 * exit latency of the next timer event is taken for the timer (or
+	 * as good as the timer, as the state could not have paid off more).
+	 */
+	if (measured_us + lat >= sleep_length_us)
+		measured_us = sleep_length_us;
+	else if (measured_us > lat)
+		measured_us -= lat / 2;
+
+	/*
+	 * Decay the early hits of every state and find the deepest states
+	 * matching the sleep length and the measured idle duration.
+	 */
+	for (i = 0; i < drv->state_count; i++) {
+		struct teo_idle_state *s = &cpu_data->states[i];
+
+		s->early_hits -= s->early_hits >> DECAY_SHIFT;
+
+		if (drv->states[i].target_residency <= sleep_length_us) {
+			idx_timer = i;
+			if (drv->states[i].target_residency <= measured_us)
+				idx_hit = i;
+		}
+	}
+
+	if (idx_timer >= 0) {
+		struct teo_idle_state *s = &cpu_data->states[idx_timer];
+
+		s->hits -= s->hits >> DECAY_SHIFT;
+		s->misses -= s->misses >> DECAY_SHIFT;
+
+		if (idx_timer > idx_hit) {
+			s->misses += PULSE;
+			if (idx_hit >= 0)
+				cpu_data->states[idx_hit].early_hits += PULSE;
+		} else {
+			s->hits += PULSE;
+		}
+	}
+
+	/* Keep the recent idle durations for pattern detection */
+	cpu_data->intervals[cpu_data->interval_idx++] = measured_us;
+	if (cpu_data->interval_idx >= INTERVALS)
+		cpu_data->interval_idx = 0;
+}
+
+/**
+ * teo_find_shallower_state - find the deepest state that fits @duration_us
+ * @drv: cpuidle driver containing state data
+ * @dev: the CPU
+ * @state_idx: index of the state to start from
+ * @duration_us: idle duration to fit
+ */
+static int teo_find_shallower_state(struct cpuidle_driver *drv,
+				    struct cpuidle_device *dev, int state_idx,
+				    unsigned int duration_us)
+{
+	int i;
+
+	for (i = state_idx - 1; i >= 0; i--) {
+		if (drv->states[i].disabled || dev->states_usage[i].disable)
+			continue;
+
+		state_idx = i;
+		if (drv->states[i].target_residency <= duration_us)
+			break;
+	}
+	return state_idx;
+}
+
+/**
+ * teo_select - selects the next idle state to enter
+ * @drv: cpuidle driver containing state data
+ * @dev: the CPU
+ */
+static int teo_select(struct cpuidle_driver *drv, struct cpuidle_device *dev)
+{
+	struct teo_cpu *cpu_data = this_cpu_ptr(&teo_cpus);
+	int latency_req = pm_qos_request(PM_QOS_CPU_DMA_LATENCY);
+	unsigned int duration_us, hits, misses, early_hits;
+	int max_early_idx, constraint_idx, idx, i;
+
+	if (cpu_data->needs_update) {
+		teo_update(drv, dev);
+		cpu_data->needs_update = 0;
+	}
+
+	/* Special case when user has set very strict latency requirement */
+	if (unlikely(latency_req == 0))
+		return 0;
+
+	duration_us = ktime_to_us(tick_nohz_get_sleep_length());
+	cpu_data->sleep_length_us = duration_us;
+
+	hits = 0;
+	misses = 0;
+	early_hits = 0;
+	max_early_idx = -1;
+	constraint_idx = drv->state_count;
+	idx = -1;
+
+	for (i = 0; i < drv->state_count; i++) {
+		struct cpuidle_state *s = &drv->states[i];
+		struct cpuidle_state_usage *su = &dev->states_usage[i];
+
+		if (s->disabled || su->disable) {
+			/*
+			 * The early hits of a disabled state still count, it
+			 * would be a mistake to select a deeper state that
+			 * has fewer of them.  The index cannot point to it,
+			 * however, so only raise the maximum.
+			 */
+			if (max_early_idx >= 0 &&
+			    early_hits < cpu_data->states[i].early_hits)
+				early_hits = cpu_data->states[i].early_hits;
+			continue;
+		}
+
+		if (idx < 0)
+			idx = i; /* first enabled state */
+
+		if (s->target_residency > duration_us)
+			break;
+
+		if (s->exit_latency > latency_req && constraint_idx > i)
+			constraint_idx = i;
+
+		idx = i;
+		hits = cpu_data->states[i].hits;
+		misses = cpu_data->states[i].misses;
+
+		/*
+		 * With the tick stopped, a state shallower than the tick
+		 * period could be stuck in for a long time.
+		 */
+		if (early_hits < cpu_data->states[i].early_hits &&
+		    !(tick_nohz_tick_stopped() &&
+		      s->target_residency < TEO_TICK_US)) {
+			early_hits = cpu_data->states[i].early_hits;
+			max_early_idx = i;
+		}
+	}
+
+	/*
+	 * If the state matching the sleep length was hit more often than it
+	 * was missed, use it.  Otherwise one of the shallower states is more
+	 * likely to match the idle duration seen after the wakeup, so use the
+	 * one with the most early hits.
+	 */
+	if (hits <= misses && max_early_idx >= 0) {
+		idx = max_early_idx;
+		duration_us = drv->states[idx].target_residency;
+	}
+
+	/* The latency constraint may call for a shallower state still */
+	if (constraint_idx < idx)
+		idx = constraint_idx;
+
+	if (idx < 0) {
+		idx = 0; /* No states enabled.  Must use 0. */
+	} else if (idx > 0) {
+		unsigned int count = 0;
+		u64 sum = 0;
+
+		/* Look at the recent idle durations shorter than expected */
+		for (i = 0; i < INTERVALS; i++) {
+			unsigned int val = cpu_data->intervals[i];
+
+			if (val >= duration_us)
+				continue;
+
+			count++;
+			sum += val;
+		}
+
+		/*
+		 * If most of them were shorter, go by their average, unless
+		 * that would leave a shallow state in for a whole tick.
+		 */
+		if (count > INTERVALS / 2) {
+			unsigned int avg_us = div64_u64(sum, count);
+
+			if (!(tick_nohz_tick_stopped() && avg_us < TEO_TICK_US))
+				idx = teo_find_shallower_state(drv, dev, idx,
+							       avg_us);
+		}
+	}
+
+	cpu_data->last_state = idx;
+	return idx;
+}
+
+/**
+ * teo_reflect - records that the metrics need to be updated
+ * @dev: the CPU
+ * @index: the index of actual entered state
+ *
+ * The update is deferred to the next teo_select(), so as not to add to
+ * the exit latency.
+ */
+static void teo_reflect(struct cpuidle_device *dev, int index)
+{
+	struct teo_cpu *cpu_data = this_cpu_ptr(&teo_cpus);
+
+	cpu_data->last_state = index;
+	cpu_data->needs_update = 1;
+}
+
+/**
+ * teo_enable_device - initializes the governor data of a CPU
+ * @drv: cpuidle driver
+ * @dev: the CPU
+ */
+static int teo_enable_device(struct cpuidle_driver *drv,
+			     struct cpuidle_device *dev)
+{
+	struct teo_cpu *cpu_data = &per_cpu(teo_cpus, dev->cpu);
+	int i;
+
+	memset(cpu_data, 0, sizeof(*cpu_data));
+
+	for (i = 0; i < INTERVALS; i++)
+		cpu_data->intervals[i] = UINT_MAX;
+
+	return 0;
+}
+
+static struct cpuidle_governor teo_governor = {
+	.name =		"teo",
+	.rating =	19,
+	.enable =	teo_enable_device,
+	.select =	teo_select,
+	.reflect =	teo_reflect,
+	.owner =	THIS_MODULE,
+};
+
+/**
+ * teo_governor_init - initializes the governor
+ */
+static int __init teo_governor_init(void)
+{
+	return cpuidle_register_governor(&teo_governor);
+}
+
+postcore_initcall(teo_governor_init);
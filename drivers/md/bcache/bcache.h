@@ -265,9 +265,6 @@ struct bcache_device {
 	atomic_t		*stripe_sectors_dirty;
 	unsigned long		*full_dirty_stripes;
 
-	unsigned long		sectors_dirty_last;
-	long			sectors_dirty_derivative;
-
 	struct bio_set		*bio_split;
 
 	unsigned		data_csum:1;
@@ -325,10 +322,18 @@ struct cached_dev {
 	struct delayed_work	writeback_rate_update;
 
 	/*
-	 * Internal to the writeback code, so read_dirty() can keep track of
-	 * where it's at.
+	 * Internal to the writeback code: writes to the backing device are
+	 * issued in the order read_dirty() took the keys, i.e. by offset,
+	 * even though the reads from the cache complete in any order.
+	 */
+	atomic_t		writeback_sequence_next;
+	struct closure_waitlist	writeback_ordering_wait;
+
+	/*
+	 * Counts writeback rate updates without foreground I/O in between;
+	 * writeback runs at full speed while the backing device is idle.
 	 */
-	sector_t		last_read;
+	atomic_t		backing_idle;
 
 	/* Limit number of writeback bios in flight */
 	struct semaphore	in_flight;
@@ -361,12 +366,14 @@ struct cached_dev {
 
 	uint64_t		writeback_rate_target;
 	int64_t			writeback_rate_proportional;
-	int64_t			writeback_rate_derivative;
-	int64_t			writeback_rate_change;
+	int64_t			writeback_rate_integral;
+	int64_t			writeback_rate_integral_scaled;
+	int32_t			writeback_rate_change;
 
 	unsigned		writeback_rate_update_seconds;
-	unsigned		writeback_rate_d_term;
+	unsigned		writeback_rate_i_term_inverse;
 	unsigned		writeback_rate_p_term_inverse;
+	unsigned		writeback_rate_minimum;
 };
 
 enum alloc_reserve {
@@ -18,6 +18,20 @@
 
 /* Rate limiting */
 
+/* Output of the rate controller, in sectors per second */
+static unsigned writeback_rate_pi(struct cached_dev *dc)
+{
+	return clamp_t(int64_t, dc->writeback_rate_proportional +
+		       dc->writeback_rate_integral_scaled,
+		       dc->writeback_rate_minimum, NSEC_PER_MSEC);
+}
+
+static void set_writeback_rate(struct cached_dev *dc, unsigned rate)
+{
+	dc->writeback_rate_change = rate - dc->writeback_rate.rate;
+	dc->writeback_rate.rate = rate;
+}
+
 static void __update_writeback_rate(struct cached_dev *dc)
 {
 	struct cache_set *c = dc->disk.c;
@@ -28,45 +42,65 @@ static void __update_writeback_rate(struct cached_dev *dc)
 	int64_t target = div64_u64(cache_dirty_target * bdev_sectors(dc->bdev),
 				   c->cached_dev_sectors);
 
-	/* PD controller */
-
+	/*
+	 * PI controller:
+	 * Figures out the amount that should be written per second.
+	 *
+	 * First, the error (number of sectors that are dirty beyond our
+	 * target) is calculated.  The error is accumulated (numerically
+	 * integrated).
+	 *
+	 * Then, the proportional value and integral value are scaled
+	 * based on configured values.  These are stored as inverses to
+	 * avoid fixed point math and to make configuration easy-- e.g.
+	 * the default value of 40 for writeback_rate_p_term_inverse
+	 * attempts to write at a rate that would retire all the dirty
+	 * blocks in 40 seconds.
+	 */
 	int64_t dirty = bcache_dev_sectors_dirty(&dc->disk);
-	int64_t derivative = dirty - dc->disk.sectors_dirty_last;
-	int64_t proportional = dirty - target;
-	int64_t change;
-
-	dc->disk.sectors_dirty_last = dirty;
-
-	/* Scale to sectors per second */
-
-	proportional *= dc->writeback_rate_update_seconds;
-	proportional = div_s64(proportional, dc->writeback_rate_p_term_inverse);
-
-	derivative = div_s64(derivative, dc->writeback_rate_update_seconds);
-
-	derivative = ewma_add(dc->disk.sectors_dirty_derivative, derivative,
-			      (dc->writeback_rate_d_term /
-			       dc->writeback_rate_update_seconds) ?: 1, 0);
+	int64_t error = dirty - target;
+	bool idle = atomic_inc_return(&dc->backing_idle) > 1;
 
-	derivative *= dc->writeback_rate_d_term;
-	derivative = div_s64(derivative, dc->writeback_rate_p_term_inverse);
+	dc->writeback_rate_proportional =
+		div_s64(error, dc->writeback_rate_p_term_inverse);
 
-	change = proportional + derivative;
+	/*
+	 * Only let the integral shrink while it is positive, and only let it
+	 * grow while the device is keeping up with the current rate: either
+	 * way it would wind up without having any effect.  Running flat out
+	 * on an idle backing device doesn't tell anything about the rate
+	 * foreground I/O leaves room for, so don't integrate then either.
+	 */
+	if (!idle &&
+	    ((error < 0 && dc->writeback_rate_integral > 0) ||
+	     (error > 0 &&
+	      time_before64(local_clock(),
+			    dc->writeback_rate.next + NSEC_PER_MSEC))))
+		dc->writeback_rate_integral +=
+			error * dc->writeback_rate_update_seconds;
+
+	dc->writeback_rate_integral_scaled =
+		div_s64(dc->writeback_rate_integral,
+			dc->writeback_rate_i_term_inverse);
 
-	/* Don't increase writeback rate if the device isn't keeping up */
-	if (change > 0 &&
-	    time_after64(local_clock(),
-			 dc->writeback_rate.next + NSEC_PER_MSEC))
-		change = 0;
+	dc->writeback_rate_target = target;
 
-	dc->writeback_rate.rate =
-		clamp_t(int64_t, (int64_t) dc->writeback_rate.rate + change,
-			1, NSEC_PER_MSEC);
+	/*
+	 * Nothing but writeback reached the backing device for a whole
+	 * update interval: write back at full speed, only bounded by
+	 * dc->in_flight.  The next foreground request brings the controller
+	 * back in, see bch_writeback_backing_busy().
+	 */
+	if (idle)
+		set_writeback_rate(dc, NSEC_PER_SEC);
+	else
+		set_writeback_rate(dc, writeback_rate_pi(dc));
+}
 
-	dc->writeback_rate_proportional = proportional;
-	dc->writeback_rate_derivative = derivative;
-	dc->writeback_rate_change = change;
-	dc->writeback_rate_target = target;
+void bch_writeback_backing_busy(struct cached_dev *dc)
+{
+	if (atomic_xchg(&dc->backing_idle, 0) > 1)
+		set_writeback_rate(dc, writeback_rate_pi(dc));
 }
 
 static void update_writeback_rate(struct work_struct *work)
@@ -99,6 +133,7 @@ static unsigned writeback_delay(struct cached_dev *dc, unsigned sectors)
 struct dirty_io {
 	struct closure		cl;
 	struct cached_dev	*dc;
+	uint16_t		sequence;
 	struct bio		bio;
 };
 
@@ -181,14 +216,42 @@ static void write_dirty(struct closure *cl)
 {
 	struct dirty_io *io = container_of(cl, struct dirty_io, cl);
 	struct keybuf_key *w = io->bio.bi_private;
+	struct cached_dev *dc = io->dc;
 
-	dirty_init(w);
-	io->bio.bi_rw		= WRITE;
-	io->bio.bi_iter.bi_sector = KEY_START(&w->key);
-	io->bio.bi_bdev		= io->dc->bdev;
-	io->bio.bi_end_io	= dirty_endio;
+	/*
+	 * Issue the writes in the order of the keys, so the backing device
+	 * sees them sorted by offset.
+	 */
+	if (atomic_read(&dc->writeback_sequence_next) != io->sequence) {
+		closure_wait(&dc->writeback_ordering_wait, cl);
 
-	closure_bio_submit(&io->bio, cl);
+		/*
+		 * Our turn might have come before we were on the wait list,
+		 * make sure we don't miss it.
+		 */
+		if (atomic_read(&dc->writeback_sequence_next) == io->sequence)
+			closure_wake_up(&dc->writeback_ordering_wait);
+
+		continue_at(cl, write_dirty, system_wq);
+		return;
+	}
+
+	/*
+	 * A failed read clears the dirty bit of the key, don't write garbage
+	 * to the backing device then.
+	 */
+	if (KEY_DIRTY(&w->key)) {
+		dirty_init(w);
+		io->bio.bi_rw		= WRITE;
+		io->bio.bi_iter.bi_sector = KEY_START(&w->key);
+		io->bio.bi_bdev		= dc->bdev;
+		io->bio.bi_end_io	= dirty_endio;
+
+		closure_bio_submit(&io->bio, cl);
+	}
+
+	atomic_set(&dc->writeback_sequence_next, io->sequence + 1);
+	closure_wake_up(&dc->writeback_ordering_wait);
 
 	continue_at(cl, write_dirty_finish, system_wq);
 }
@@ -216,10 +279,15 @@ static void read_dirty_submit(struct closure *cl)
 static void read_dirty(struct cached_dev *dc)
 {
 	unsigned delay = 0;
-	struct keybuf_key *w;
+	struct keybuf_key *next, *keys[MAX_WRITEBACKS_IN_PASS], *w;
+	size_t size;
+	int nk, i;
 	struct dirty_io *io;
 	struct closure cl;
+	uint16_t sequence = 0;
 
+	BUG_ON(!llist_empty(&dc->writeback_ordering_wait.list));
+	atomic_set(&dc->writeback_sequence_next, sequence);
 	closure_init_stack(&cl);
 
 	/*
@@ -227,47 +295,75 @@ static void read_dirty(struct cached_dev *dc)
 	 * mempools.
 	 */
 
-	while (!kthread_should_stop()) {
-		try_to_freeze();
-
-		w = bch_keybuf_next(&dc->writeback_keys);
-		if (!w)
-			break;
+	next = bch_keybuf_next(&dc->writeback_keys);
 
-		BUG_ON(ptr_stale(dc->disk.c, &w->key, 0));
-
-		if (KEY_START(&w->key) != dc->last_read ||
-		    jiffies_to_msecs(delay) > 50)
-			while (!kthread_should_stop() && delay)
-				delay = schedule_timeout_interruptible(delay);
-
-		dc->last_read	= KEY_OFFSET(&w->key);
-
-		io = kzalloc(sizeof(struct dirty_io) + sizeof(struct bio_vec)
-			     * DIV_ROUND_UP(KEY_SIZE(&w->key), PAGE_SECTORS),
-			     GFP_KERNEL);
-		if (!io)
-			goto err;
-
-		w->private	= io;
-		io->dc		= dc;
-
-		dirty_init(w);
-		io->bio.bi_iter.bi_sector = PTR_OFFSET(&w->key, 0);
-		io->bio.bi_bdev		= PTR_CACHE(dc->disk.c,
-						    &w->key, 0)->bdev;
-		io->bio.bi_rw		= READ;
-		io->bio.bi_end_io	= read_dirty_endio;
-
-		if (bio_alloc_pages(&io->bio, GFP_KERNEL))
-			goto err_free;
+	while (!kthread_should_stop() && next) {
+		try_to_freeze();
 
-		trace_bcache_writeback(&w->key);
+		size = 0;
+		nk = 0;
+
+		/*
+		 * Take up to MAX_WRITEBACKS_IN_PASS contiguous keys, the
+		 * backing device gets them as one sequential run.
+		 */
+		do {
+			BUG_ON(ptr_stale(dc->disk.c, &next->key, 0));
+
+			if (nk >= MAX_WRITEBACKS_IN_PASS ||
+			    size >= MAX_WRITESIZE_IN_PASS)
+				break;
+
+			if (nk != 0 &&
+			    bkey_cmp(&keys[nk - 1]->key, &START_KEY(&next->key)))
+				break;
+
+			size += KEY_SIZE(&next->key);
+			keys[nk++] = next;
+		} while ((next = bch_keybuf_next(&dc->writeback_keys)));
+
+		for (i = 0; i < nk; i++) {
+			w = keys[i];
+
+			io = kzalloc(sizeof(struct dirty_io) +
+				     sizeof(struct bio_vec) *
+				     DIV_ROUND_UP(KEY_SIZE(&w->key),
+						  PAGE_SECTORS),
+				     GFP_KERNEL);
+			if (!io)
+				goto err;
+
+			w->private	= io;
+			io->dc		= dc;
+			io->sequence	= sequence++;
+
+			dirty_init(w);
+			io->bio.bi_iter.bi_sector = PTR_OFFSET(&w->key, 0);
+			io->bio.bi_bdev		= PTR_CACHE(dc->disk.c,
+							    &w->key, 0)->bdev;
+			io->bio.bi_rw		= READ;
+			io->bio.bi_end_io	= read_dirty_endio;
+
+			if (bio_alloc_pages(&io->bio, GFP_KERNEL))
+				goto err_free;
+
+			trace_bcache_writeback(&w->key);
+
+			/*
+			 * Up to dc->in_flight keys are read and written back
+			 * concurrently; write_dirty() keeps the writes in
+			 * order.
+			 */
+			down(&dc->in_flight);
+			closure_call(&io->cl, read_dirty_submit, NULL, &cl);
+		}
 
-		down(&dc->in_flight);
-		closure_call(&io->cl, read_dirty_submit, NULL, &cl);
+		delay = writeback_delay(dc, size);
 
-		delay = writeback_delay(dc, KEY_SIZE(&w->key));
+		while (!kthread_should_stop() && delay) {
+			schedule_timeout_interruptible(delay);
+			delay = writeback_delay(dc, 0);
+		}
 	}
 
 	if (0) {
@@ -275,6 +371,12 @@ err_free:
 		kfree(w->private);
 err:
 		bch_keybuf_del(&dc->writeback_keys, w);
+
+		/* give back the keys of this pass we didn't get to */
+		while (++i < nk)
+			bch_keybuf_del(&dc->writeback_keys, keys[i]);
+		if (next)
+			bch_keybuf_del(&dc->writeback_keys, next);
 	}
 
 	/*
@@ -497,8 +599,6 @@ void bch_sectors_dirty_init(struct cached_dev *dc)
 
 	bch_btree_map_keys(&op.op, dc->disk.c, &KEY(op.inode, 0, 0),
 			   sectors_dirty_init_fn, 0);
-
-	dc->disk.sectors_dirty_last = bcache_dev_sectors_dirty(&dc->disk);
 }
 
 void bch_cached_dev_writeback_init(struct cached_dev *dc)
@@ -514,8 +614,9 @@ void bch_cached_dev_writeback_init(struct cached_dev *dc)
 	dc->writeback_rate.rate		= 1024;
 
 	dc->writeback_rate_update_seconds = 5;
-	dc->writeback_rate_d_term	= 30;
-	dc->writeback_rate_p_term_inverse = 6000;
+	dc->writeback_rate_p_term_inverse = 40;
+	dc->writeback_rate_i_term_inverse = 10000;
+	dc->writeback_rate_minimum	= 8;
 
 	INIT_DELAYED_WORK(&dc->writeback_rate_update, update_writeback_rate);
 }
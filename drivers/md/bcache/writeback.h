@@ -4,6 +4,9 @@
 #define CUTOFF_WRITEBACK	40
 #define CUTOFF_WRITEBACK_SYNC	70
 
+#define MAX_WRITEBACKS_IN_PASS	5
+#define MAX_WRITESIZE_IN_PASS	5000	/* *512b */
+
 static inline uint64_t bcache_dev_sectors_dirty(struct bcache_device *d)
 {
 	uint64_t i, ret = 0;
@@ -61,6 +64,24 @@ static inline bool should_writeback(struct cached_dev *dc, struct bio *bio,
 		in_use <= CUTOFF_WRITEBACK;
 }
 
+/*
+ * The backing device counts as idle once a whole writeback rate update
+ * interval went by without foreground I/O.
+ */
+static inline bool bch_writeback_backing_idle(struct cached_dev *dc)
+{
+	return atomic_read(&dc->backing_idle) > 1;
+}
+
+void bch_writeback_backing_busy(struct cached_dev *);
+
+static inline void bch_writeback_foreground_io(struct cached_dev *dc)
+{
+	/* only the first request after an update writes the cacheline */
+	if (atomic_read(&dc->backing_idle))
+		bch_writeback_backing_busy(dc);
+}
+
 static inline void bch_writeback_queue(struct cached_dev *dc)
 {
 	if (!IS_ERR_OR_NULL(dc->writeback_thread))
@@ -78,6 +78,7 @@ static void __setup_new_cell(struct dm_cell_key *key,
        memcpy(&cell->key, key, sizeof(cell->key));
        cell->holder = holder;
        bio_list_init(&cell->bios);
+       cell->shared_count = 0;
 }
 
 static int cmp_keys(struct dm_cell_key *lhs,
@@ -176,6 +177,90 @@ int dm_get_cell(struct dm_bio_prison *prison,
 }
 EXPORT_SYMBOL_GPL(dm_get_cell);
 
+static int __bio_detain_shared(struct dm_bio_prison *prison,
+			       struct dm_cell_key *key,
+			       struct bio *inmate,
+			       struct dm_bio_prison_cell *cell_prealloc,
+			       struct dm_bio_prison_cell **cell_result)
+{
+	int r;
+	struct rb_node **new = &prison->cells.rb_node, *parent = NULL;
+
+	while (*new) {
+		struct dm_bio_prison_cell *cell =
+			container_of(*new, struct dm_bio_prison_cell, node);
+
+		r = cmp_keys(key, &cell->key);
+
+		parent = *new;
+		if (r < 0)
+			new = &((*new)->rb_left);
+		else if (r > 0)
+			new = &((*new)->rb_right);
+		else {
+			*cell_result = cell;
+
+			/*
+			 * Don't jump the queue if someone is waiting for
+			 * exclusive access, they would starve otherwise.
+			 */
+			if (!cell->shared_count || !bio_list_empty(&cell->bios)) {
+				bio_list_add(&cell->bios, inmate);
+				return 1;
+			}
+
+			cell->shared_count++;
+			return 0;
+		}
+	}
+
+	__setup_new_cell(key, NULL, cell_prealloc);
+	cell_prealloc->shared_count = 1;
+	*cell_result = cell_prealloc;
+
+	rb_link_node(&cell_prealloc->node, parent, new);
+	rb_insert_color(&cell_prealloc->node, &prison->cells);
+
+	return 0;
+}
+
+int dm_bio_detain_shared(struct dm_bio_prison *prison,
+			 struct dm_cell_key *key,
+			 struct bio *inmate,
+			 struct dm_bio_prison_cell *cell_prealloc,
+			 struct dm_bio_prison_cell **cell_result)
+{
+	int r;
+	unsigned long flags;
+
+	spin_lock_irqsave(&prison->lock, flags);
+	r = __bio_detain_shared(prison, key, inmate, cell_prealloc, cell_result);
+	spin_unlock_irqrestore(&prison->lock, flags);
+
+	return r;
+}
+EXPORT_SYMBOL_GPL(dm_bio_detain_shared);
+
+int dm_cell_put_shared(struct dm_bio_prison *prison,
+		       struct dm_bio_prison_cell *cell,
+		       struct bio_list *inmates)
+{
+	int r = 0;
+	unsigned long flags;
+
+	spin_lock_irqsave(&prison->lock, flags);
+	BUG_ON(!cell->shared_count);
+	if (!--cell->shared_count) {
+		rb_erase(&cell->node, &prison->cells);
+		bio_list_merge(inmates, &cell->bios);
+		r = 1;
+	}
+	spin_unlock_irqrestore(&prison->lock, flags);
+
+	return r;
+}
+EXPORT_SYMBOL_GPL(dm_cell_put_shared);
+
 /*
  * @inmates must have been initialised prior to this call
  */
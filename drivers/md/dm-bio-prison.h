@@ -44,6 +44,7 @@ struct dm_bio_prison_cell {
 	struct dm_cell_key key;
 	struct bio *holder;
 	struct bio_list bios;
+	unsigned shared_count;	/* zero for exclusive cells */
 };
 
 struct dm_bio_prison *dm_bio_prison_create(void);
@@ -84,6 +85,31 @@ int dm_bio_detain(struct dm_bio_prison *prison,
 		  struct dm_bio_prison_cell *cell_prealloc,
 		  struct dm_bio_prison_cell **cell_result);
 
+/*
+ * Shared cells have no holder, but any number of concurrent users that
+ * don't change what the key refers to, eg. remapping io to an already
+ * provisioned block.  Exclusive detainers, and anyone arriving after one,
+ * queue in the cell as usual until the last shared user is gone.
+ *
+ * Returns 1 if @inmate was queued in the cell, 0 if it got a shared
+ * reference.  @cell_prealloc is only used if 0 is returned and
+ * *@cell_result == @cell_prealloc.
+ */
+int dm_bio_detain_shared(struct dm_bio_prison *prison,
+			 struct dm_cell_key *key,
+			 struct bio *inmate,
+			 struct dm_bio_prison_cell *cell_prealloc,
+			 struct dm_bio_prison_cell **cell_result);
+
+/*
+ * Drops a shared reference.  Returns 1 if it was the last one, in which
+ * case the cell is released, the queued bios are added to @inmates, and
+ * the caller must free the cell.
+ */
+int dm_cell_put_shared(struct dm_bio_prison *prison,
+		       struct dm_bio_prison_cell *cell,
+		       struct bio_list *inmates);
+
 void dm_cell_release(struct dm_bio_prison *prison,
 		     struct dm_bio_prison_cell *cell,
 		     struct bio_list *bios);
@@ -18,6 +18,7 @@
 #include <linux/slab.h>
 #include <linux/crypto.h>
 #include <linux/workqueue.h>
+#include <linux/interrupt.h>
 #include <linux/kthread.h>
 #include <linux/backing-dev.h>
 #include <linux/atomic.h>
@@ -54,6 +55,7 @@ struct dm_crypt_io {
 	struct crypt_config *cc;
 	struct bio *base_bio;
 	struct work_struct work;
+	struct tasklet_struct tasklet;
 
 	struct convert_context ctx;
 
@@ -113,7 +115,8 @@ struct iv_tcw_private {
  */
 enum flags { DM_CRYPT_SUSPENDED, DM_CRYPT_KEY_VALID,
 	     DM_CRYPT_SAME_CPU, DM_CRYPT_NO_OFFLOAD,
-	     DM_CRYPT_EXIT_THREAD};
+	     DM_CRYPT_EXIT_THREAD, DM_CRYPT_NO_READ_WORKQUEUE,
+	     DM_CRYPT_NO_WRITE_WORKQUEUE, DM_CRYPT_SYNC_TFM};
 
 /*
  * The fields in here must be read only after initialization.
@@ -184,6 +187,19 @@ struct crypt_config {
 
 static void clone_init(struct dm_crypt_io *, struct bio *);
 static void kcryptd_queue_crypt(struct dm_crypt_io *io);
+
+/*
+ * Only synchronous ciphers are used without the kcryptd workqueue, async
+ * engines complete from their own context and keep the queued path.
+ */
+static bool kcryptd_crypt_inline(struct crypt_config *cc, int rw)
+{
+	if (!test_bit(DM_CRYPT_SYNC_TFM, &cc->flags))
+		return false;
+
+	return test_bit(rw == READ ? DM_CRYPT_NO_READ_WORKQUEUE :
+			DM_CRYPT_NO_WRITE_WORKQUEUE, &cc->flags);
+}
 static u8 *iv_of_dmreq(struct crypt_config *cc, struct dm_crypt_request *dmreq);
 
 /*
@@ -884,7 +900,7 @@ static void kcryptd_async_done(struct crypto_async_request *async_req,
 			       int error);
 
 static void crypt_alloc_req(struct crypt_config *cc,
-			    struct convert_context *ctx)
+			    struct convert_context *ctx, bool atomic)
 {
 	unsigned key_index = ctx->cc_sector & (cc->tfms_count - 1);
 
@@ -898,7 +914,8 @@ static void crypt_alloc_req(struct crypt_config *cc,
 	 * requests if driver request queue is full.
 	 */
 	ablkcipher_request_set_callback(ctx->req,
-	    CRYPTO_TFM_REQ_MAY_BACKLOG | CRYPTO_TFM_REQ_MAY_SLEEP,
+	    CRYPTO_TFM_REQ_MAY_BACKLOG |
+	    (atomic ? 0 : CRYPTO_TFM_REQ_MAY_SLEEP),
 	    kcryptd_async_done, dmreq_of_req(cc, ctx->req));
 }
 
@@ -913,9 +930,13 @@ static void crypt_free_req(struct crypt_config *cc,
 
 /*
  * Encrypt / decrypt data from one bio to another one (can be the same one)
+ *
+ * @atomic is set when called from bio completion context.  That is only
+ * done with synchronous ciphers, which never queue the request, and with
+ * the request preallocated in the per-bio data, so nothing here sleeps.
  */
 static int crypt_convert(struct crypt_config *cc,
-			 struct convert_context *ctx)
+			 struct convert_context *ctx, bool atomic)
 {
 	int r;
 
@@ -923,7 +944,7 @@ static int crypt_convert(struct crypt_config *cc,
 
 	while (ctx->iter_in.bi_size && ctx->iter_out.bi_size) {
 
-		crypt_alloc_req(cc, ctx);
+		crypt_alloc_req(cc, ctx, atomic);
 
 		atomic_inc(&ctx->cc_pending);
 
@@ -952,7 +973,8 @@ static int crypt_convert(struct crypt_config *cc,
 		case 0:
 			atomic_dec(&ctx->cc_pending);
 			ctx->cc_sector++;
-			cond_resched();
+			if (!atomic)
+				cond_resched();
 			continue;
 
 		/* There was an error while processing the request. */
@@ -1262,7 +1284,9 @@ static void kcryptd_crypt_write_io_submit(struct dm_crypt_io *io, int async)
 
 	clone->bi_iter.bi_sector = cc->start + io->sector;
 
-	if (likely(!async) && test_bit(DM_CRYPT_NO_OFFLOAD, &cc->flags)) {
+	if (likely(!async) &&
+	    (test_bit(DM_CRYPT_NO_OFFLOAD, &cc->flags) ||
+	     kcryptd_crypt_inline(cc, WRITE))) {
 		generic_make_request(clone);
 		return;
 	}
@@ -1311,7 +1335,7 @@ static void kcryptd_crypt_write_convert(struct dm_crypt_io *io)
 	sector += bio_sectors(clone);
 
 	crypt_inc_pending(io);
-	r = crypt_convert(cc, &io->ctx);
+	r = crypt_convert(cc, &io->ctx, false);
 	if (r)
 		io->error = -EIO;
 	crypt_finished = atomic_dec_and_test(&io->ctx.cc_pending);
@@ -1341,7 +1365,7 @@ static void kcryptd_crypt_read_convert(struct dm_crypt_io *io)
 	crypt_convert_init(cc, &io->ctx, io->base_bio, io->base_bio,
 			   io->sector);
 
-	r = crypt_convert(cc, &io->ctx);
+	r = crypt_convert(cc, &io->ctx, kcryptd_crypt_inline(cc, READ));
 	if (r < 0)
 		io->error = -EIO;
 
@@ -1396,10 +1420,31 @@ static void kcryptd_crypt(struct work_struct *work)
 		kcryptd_crypt_write_convert(io);
 }
 
+static void kcryptd_crypt_tasklet(unsigned long work)
+{
+	kcryptd_crypt((struct work_struct *)work);
+}
+
+/*
+ * With no_read_workqueue reads are decrypted in the bio completion context
+ * (or a tasklet, if that is hard irq context), and with no_write_workqueue
+ * writes are encrypted and submitted in the context of the submitter.
+ */
 static void kcryptd_queue_crypt(struct dm_crypt_io *io)
 {
 	struct crypt_config *cc = io->cc;
 
+	if (kcryptd_crypt_inline(cc, bio_data_dir(io->base_bio))) {
+		if (in_irq() || irqs_disabled()) {
+			tasklet_init(&io->tasklet, kcryptd_crypt_tasklet,
+				     (unsigned long)&io->work);
+			tasklet_schedule(&io->tasklet);
+			return;
+		}
+		kcryptd_crypt(&io->work);
+		return;
+	}
+
 	INIT_WORK(&io->work, kcryptd_crypt);
 	queue_work(cc->crypt_queue, &io->work);
 }
@@ -1741,7 +1786,7 @@ static int crypt_ctr(struct dm_target *ti, unsigned int argc, char **argv)
 	char dummy;
 
 	static struct dm_arg _args[] = {
-		{0, 3, "Invalid number of feature args"},
+		{0, 5, "Invalid number of feature args"},
 	};
 
 	if (argc < 5) {
@@ -1763,6 +1808,10 @@ static int crypt_ctr(struct dm_target *ti, unsigned int argc, char **argv)
 	if (ret < 0)
 		goto bad;
 
+	if (!(crypto_ablkcipher_tfm(any_tfm(cc))->__crt_alg->cra_flags &
+	      CRYPTO_ALG_ASYNC))
+		set_bit(DM_CRYPT_SYNC_TFM, &cc->flags);
+
 	cc->dmreq_start = sizeof(struct ablkcipher_request);
 	cc->dmreq_start += crypto_ablkcipher_reqsize(any_tfm(cc));
 	cc->dmreq_start = ALIGN(cc->dmreq_start, __alignof__(struct dm_crypt_request));
@@ -1856,6 +1905,12 @@ static int crypt_ctr(struct dm_target *ti, unsigned int argc, char **argv)
 			else if (!strcasecmp(opt_string, "submit_from_crypt_cpus"))
 				set_bit(DM_CRYPT_NO_OFFLOAD, &cc->flags);
 
+			else if (!strcasecmp(opt_string, "no_read_workqueue"))
+				set_bit(DM_CRYPT_NO_READ_WORKQUEUE, &cc->flags);
+
+			else if (!strcasecmp(opt_string, "no_write_workqueue"))
+				set_bit(DM_CRYPT_NO_WRITE_WORKQUEUE, &cc->flags);
+
 			else {
 				ti->error = "Invalid feature arguments";
 				goto bad;
@@ -1960,6 +2015,8 @@ static void crypt_status(struct dm_target *ti, status_type_t type,
 		num_feature_args += !!ti->num_discard_bios;
 		num_feature_args += test_bit(DM_CRYPT_SAME_CPU, &cc->flags);
 		num_feature_args += test_bit(DM_CRYPT_NO_OFFLOAD, &cc->flags);
+		num_feature_args += test_bit(DM_CRYPT_NO_READ_WORKQUEUE, &cc->flags);
+		num_feature_args += test_bit(DM_CRYPT_NO_WRITE_WORKQUEUE, &cc->flags);
 		if (num_feature_args) {
 			DMEMIT(" %d", num_feature_args);
 			if (ti->num_discard_bios)
@@ -1968,6 +2025,10 @@ static void crypt_status(struct dm_target *ti, status_type_t type,
 				DMEMIT(" same_cpu_crypt");
 			if (test_bit(DM_CRYPT_NO_OFFLOAD, &cc->flags))
 				DMEMIT(" submit_from_crypt_cpus");
+			if (test_bit(DM_CRYPT_NO_READ_WORKQUEUE, &cc->flags))
+				DMEMIT(" no_read_workqueue");
+			if (test_bit(DM_CRYPT_NO_WRITE_WORKQUEUE, &cc->flags))
+				DMEMIT(" no_write_workqueue");
 		}
 
 		break;
@@ -2061,7 +2122,7 @@ static void crypt_io_hints(struct dm_target *ti, struct queue_limits *limits)
 
 static struct target_type crypt_target = {
 	.name   = "crypt",
-	.version = {1, 14, 1},
+	.version = {1, 15, 0},
 	.module = THIS_MODULE,
 	.ctr    = crypt_ctr,
 	.dtr    = crypt_dtr,
@@ -429,6 +429,23 @@ static int bio_detain(struct pool *pool, struct dm_cell_key *key, struct bio *bi
 	return r;
 }
 
+static int bio_detain_shared(struct pool *pool, struct dm_cell_key *key,
+			     struct bio *bio,
+			     struct dm_bio_prison_cell **cell_result)
+{
+	int r;
+	struct dm_bio_prison_cell *cell_prealloc;
+
+	cell_prealloc = dm_bio_prison_alloc_cell(pool->prison, GFP_NOIO);
+
+	r = dm_bio_detain_shared(pool->prison, key, bio, cell_prealloc,
+				 cell_result);
+	if (r || *cell_result != cell_prealloc)
+		dm_bio_prison_free_cell(pool->prison, cell_prealloc);
+
+	return r;
+}
+
 static void cell_release(struct pool *pool,
 			 struct dm_bio_prison_cell *cell,
 			 struct bio_list *bios)
@@ -851,6 +868,31 @@ static void cell_defer_no_holder(struct thin_c *tc, struct dm_bio_prison_cell *c
 	wake_worker(pool);
 }
 
+/*
+ * Drops a shared reference, the last one sends any bios that queued up
+ * in the meantime to the deferred_bios list.
+ */
+static void cell_put_shared(struct thin_c *tc, struct dm_bio_prison_cell *cell)
+{
+	struct pool *pool = tc->pool;
+	struct bio_list bios;
+	unsigned long flags;
+
+	bio_list_init(&bios);
+	if (!dm_cell_put_shared(pool->prison, cell, &bios))
+		return;
+
+	dm_bio_prison_free_cell(pool->prison, cell);
+	if (bio_list_empty(&bios))
+		return;
+
+	spin_lock_irqsave(&tc->lock, flags);
+	bio_list_merge(&tc->deferred_bio_list, &bios);
+	spin_unlock_irqrestore(&tc->lock, flags);
+
+	wake_worker(pool);
+}
+
 static void thin_defer_bio(struct thin_c *tc, struct bio *bio);
 
 struct remap_info {
@@ -2519,6 +2561,19 @@ static void thin_defer_cell(struct thin_c *tc, struct dm_bio_prison_cell *cell)
 	wake_worker(pool);
 }
 
+/*
+ * Trades the shared virtual cell for an exclusive one, which the worker
+ * needs to provision or break sharing.
+ */
+static void thin_defer_virt_cell(struct thin_c *tc, struct dm_cell_key *key,
+				 struct bio *bio,
+				 struct dm_bio_prison_cell *virt_cell)
+{
+	cell_put_shared(tc, virt_cell);
+	if (!bio_detain(tc->pool, key, bio, &virt_cell))
+		thin_defer_cell(tc, virt_cell);
+}
+
 static void thin_hook_bio(struct thin_c *tc, struct bio *bio)
 {
 	struct dm_thin_endio_hook *h = dm_per_bio_data(bio, sizeof(struct dm_thin_endio_hook));
@@ -2564,9 +2619,14 @@ static int thin_bio_map(struct dm_target *ti, struct bio *bio)
 	/*
 	 * We must hold the virtual cell before doing the lookup, otherwise
 	 * there's a race with discard.
+	 *
+	 * Remapping to an already provisioned block changes nothing, so
+	 * both cells are only taken shared here: concurrent io to the same
+	 * block doesn't have to go through the worker.  Provisioning and
+	 * breaking sharing trade up for an exclusive cell first.
 	 */
 	build_virtual_key(tc->td, block, &key);
-	if (bio_detain(tc->pool, &key, bio, &virt_cell))
+	if (bio_detain_shared(tc->pool, &key, bio, &virt_cell))
 		return DM_MAPIO_SUBMITTED;
 
 	r = dm_thin_find_block(td, block, 0, &result);
@@ -2591,26 +2651,26 @@ static int thin_bio_map(struct dm_target *ti, struct bio *bio)
 			 * More distant ancestors are irrelevant. The
 			 * shared flag will be set in their case.
 			 */
-			thin_defer_cell(tc, virt_cell);
+			thin_defer_virt_cell(tc, &key, bio, virt_cell);
 			return DM_MAPIO_SUBMITTED;
 		}
 
 		build_data_key(tc->td, result.block, &key);
-		if (bio_detain(tc->pool, &key, bio, &data_cell)) {
-			cell_defer_no_holder(tc, virt_cell);
+		if (bio_detain_shared(tc->pool, &key, bio, &data_cell)) {
+			cell_put_shared(tc, virt_cell);
 			return DM_MAPIO_SUBMITTED;
 		}
 
 		inc_all_io_entry(tc->pool, bio);
-		cell_defer_no_holder(tc, data_cell);
-		cell_defer_no_holder(tc, virt_cell);
+		cell_put_shared(tc, data_cell);
+		cell_put_shared(tc, virt_cell);
 
 		remap(tc, bio, result.block);
 		return DM_MAPIO_REMAPPED;
 
 	case -ENODATA:
 	case -EWOULDBLOCK:
-		thin_defer_cell(tc, virt_cell);
+		thin_defer_virt_cell(tc, &key, bio, virt_cell);
 		return DM_MAPIO_SUBMITTED;
 
 	default:
@@ -2620,7 +2680,7 @@ static int thin_bio_map(struct dm_target *ti, struct bio *bio)
 		 * pool is switched to fail-io mode.
 		 */
 		bio_io_error(bio);
-		cell_defer_no_holder(tc, virt_cell);
+		cell_put_shared(tc, virt_cell);
 		return DM_MAPIO_SUBMITTED;
 	}
 }
@@ -296,6 +296,36 @@ static inline void update_head_pos(int disk, struct r1bio *r1_bio)
 		r1_bio->sector + (r1_bio->sectors);
 }
 
+/*
+ * Fold the completion time of a read into the average of its mirror, each
+ * sample weighs 1/8.  This runs without locking from completion context;
+ * a lost update only slows down how fast the average follows the device.
+ */
+static inline void update_read_latency(int disk, struct r1bio *r1_bio)
+{
+	struct r1conf *conf = r1_bio->mddev->private;
+	struct raid1_info *mirror = &conf->mirrors[disk];
+	unsigned long lat = ktime_us_delta(ktime_get(), r1_bio->start_time);
+	unsigned long avg = READ_ONCE(mirror->read_latency);
+
+	WRITE_ONCE(mirror->read_latency,
+		   avg - (avg >> RAID1_LATENCY_SHIFT) + lat);
+}
+
+/*
+ * Expected wait for a new read on a mirror: what is queued ahead of it,
+ * plus itself, at the recent completion time.  A device without samples
+ * yet costs its queue depth, so it gets used and sampled right away.
+ */
+static unsigned long read_cost(struct raid1_info *mirror,
+			       unsigned int pending)
+{
+	unsigned long lat = READ_ONCE(mirror->read_latency) >>
+		RAID1_LATENCY_SHIFT;
+
+	return (pending + 1) * (lat + 1);
+}
+
 /*
  * Find the disk number which triggered given bio
  */
@@ -328,9 +358,10 @@ static void raid1_end_read_request(struct bio *bio)
 	 */
 	update_head_pos(mirror, r1_bio);
 
-	if (uptodate)
+	if (uptodate) {
+		update_read_latency(mirror, r1_bio);
 		set_bit(R1BIO_Uptodate, &r1_bio->state);
-	else {
+	} else {
 		/* If all other devices have failed, we want to return
 		 * the error upwards rather than fail the last device.
 		 * Here we redefine "uptodate" to mean "Don't want to retry"
@@ -508,6 +539,9 @@ static void raid1_end_write_request(struct bio *bio)
  * If there are 2 mirrors in the same 2 devices, performance degrades
  * because position is mirror, not device based.
  *
+ * Non-rotational devices have no head to keep in place, so reads go to
+ * the one with the least expected wait, see read_cost().
+ *
  * The rdev for the device selected will have nr_pending incremented.
  */
 static int read_balance(struct r1conf *conf, struct r1bio *r1_bio, int *max_sectors)
@@ -519,10 +553,9 @@ static int read_balance(struct r1conf *conf, struct r1bio *r1_bio, int *max_sect
 	int has_nonrot_disk;
 	int disk;
 	sector_t best_dist;
-	unsigned int min_pending;
+	unsigned long min_cost;
 	struct md_rdev *rdev;
 	int choose_first;
-	int choose_next_idle;
 
 	rcu_read_lock();
 	/*
@@ -536,10 +569,9 @@ static int read_balance(struct r1conf *conf, struct r1bio *r1_bio, int *max_sect
 	best_dist_disk = -1;
 	best_dist = MaxSector;
 	best_pending_disk = -1;
-	min_pending = UINT_MAX;
+	min_cost = ULONG_MAX;
 	best_good_sectors = 0;
 	has_nonrot_disk = 0;
-	choose_next_idle = 0;
 
 	if ((conf->mddev->recovery_cp < this_sector + sectors) ||
 	    (mddev_is_clustered(conf->mddev) &&
@@ -554,6 +586,7 @@ static int read_balance(struct r1conf *conf, struct r1bio *r1_bio, int *max_sect
 		sector_t first_bad;
 		int bad_sectors;
 		unsigned int pending;
+		unsigned long cost;
 		bool nonrot;
 
 		rdev = rcu_dereference(conf->mirrors[disk].rdev);
@@ -616,39 +649,28 @@ static int read_balance(struct r1conf *conf, struct r1bio *r1_bio, int *max_sect
 		nonrot = blk_queue_nonrot(bdev_get_queue(rdev->bdev));
 		has_nonrot_disk |= nonrot;
 		pending = atomic_read(&rdev->nr_pending);
+		cost = read_cost(&conf->mirrors[disk], pending);
 		dist = abs(this_sector - conf->mirrors[disk].head_position);
 		if (choose_first) {
 			best_disk = disk;
 			break;
 		}
+		/*
+		 * Sequential reads and idle disks don't matter without a
+		 * head to move: balance by queue depth and latency so that
+		 * all mirrors serve reads, even for a single stream.
+		 */
+		if (nonrot) {
+			if (cost < min_cost) {
+				min_cost = cost;
+				best_pending_disk = disk;
+			}
+			continue;
+		}
 		/* Don't change to another disk for sequential reads */
 		if (conf->mirrors[disk].next_seq_sect == this_sector
 		    || dist == 0) {
-			int opt_iosize = bdev_io_opt(rdev->bdev) >> 9;
-			struct raid1_info *mirror = &conf->mirrors[disk];
-
 			best_disk = disk;
-			/*
-			 * If buffered sequential IO size exceeds optimal
-			 * iosize, check if there is idle disk. If yes, choose
-			 * the idle disk. read_balance could already choose an
-			 * idle disk before noticing it's a sequential IO in
-			 * this disk. This doesn't matter because this disk
-			 * will idle, next time it will be utilized after the
-			 * first disk has IO size exceeds optimal iosize. In
-			 * this way, iosize of the first disk will be optimal
-			 * iosize at least. iosize of the second disk might be
-			 * small, but not a big deal since when the second disk
-			 * starts IO, the first disk is likely still busy.
-			 */
-			if (nonrot && opt_iosize > 0 &&
-			    mirror->seq_start != MaxSector &&
-			    mirror->next_seq_sect > opt_iosize &&
-			    mirror->next_seq_sect - opt_iosize >=
-			    mirror->seq_start) {
-				choose_next_idle = 1;
-				continue;
-			}
 			break;
 		}
 		/* If device is idle, use it */
@@ -657,11 +679,8 @@ static int read_balance(struct r1conf *conf, struct r1bio *r1_bio, int *max_sect
 			break;
 		}
 
-		if (choose_next_idle)
-			continue;
-
-		if (min_pending > pending) {
-			min_pending = pending;
+		if (min_cost > cost) {
+			min_cost = cost;
 			best_pending_disk = disk;
 		}
 
@@ -673,7 +692,7 @@ static int read_balance(struct r1conf *conf, struct r1bio *r1_bio, int *max_sect
 
 	/*
 	 * If all disks are rotational, choose the closest disk. If any disk is
-	 * non-rotational, choose the disk with less pending request even the
+	 * non-rotational, choose the disk with the least expected wait even the
 	 * disk is rotational, which might/might not be optimal for raids with
 	 * mixed ratation/non-rotational disks depending on workload.
 	 */
@@ -698,10 +717,8 @@ static int read_balance(struct r1conf *conf, struct r1bio *r1_bio, int *max_sect
 		}
 		sectors = best_good_sectors;
 
-		if (conf->mirrors[best_disk].next_seq_sect != this_sector)
-			conf->mirrors[best_disk].seq_start = this_sector;
-
 		conf->mirrors[best_disk].next_seq_sect = this_sector + sectors;
+		r1_bio->start_time = ktime_get();
 	}
 	rcu_read_unlock();
 	*max_sectors = sectors;
@@ -1613,6 +1630,7 @@ static int raid1_add_disk(struct mddev *mddev, struct md_rdev *rdev)
 						  rdev->data_offset << 9);
 
 			p->head_position = 0;
+			p->read_latency = 0;
 			rdev->raid_disk = mirror;
 			err = 0;
 			/* As all devices are equivalent, we don't need a full recovery
@@ -2824,7 +2842,6 @@ static struct r1conf *setup_conf(struct mddev *mddev)
 		q = bdev_get_queue(rdev->bdev);
 
 		disk->head_position = 0;
-		disk->seq_start = MaxSector;
 	}
 	conf->raid_disks = mddev->raid_disks;
 	conf->mddev = mddev;
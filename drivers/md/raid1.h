@@ -9,9 +9,16 @@ struct raid1_info {
 	 * we try to keep sequential reads one the same device
 	 */
 	sector_t	next_seq_sect;
-	sector_t	seq_start;
+
+	/* Decaying average of read completion time in usecs, scaled by
+	 * 1 << RAID1_LATENCY_SHIFT.  Used to balance reads across
+	 * non-rotational devices.
+	 */
+	unsigned long	read_latency;
 };
 
+#define RAID1_LATENCY_SHIFT	3
+
 /*
  * memory pools need a pointer to the mddev, so they can force an unplug
  * when memory is tight, and a count of the number of drives that the
@@ -147,6 +154,8 @@ struct r1bio {
 	 * if the IO is in READ direction, then this is where we read
 	 */
 	int			read_disk;
+	/* when the read was sent to read_disk */
+	ktime_t			start_time;
 
 	struct list_head	retry_list;
 	/* Next two are only valid when R1BIO_BehindIO is set */
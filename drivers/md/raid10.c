@@ -331,6 +331,37 @@ static inline void update_head_pos(int slot, struct r10bio *r10_bio)
 		r10_bio->devs[slot].addr + (r10_bio->sectors);
 }
 
+/*
+ * Fold the completion time of a read into the average of its mirror, each
+ * sample weighs 1/8.  This runs without locking from completion context;
+ * a lost update only slows down how fast the average follows the device.
+ */
+static inline void update_read_latency(int slot, struct r10bio *r10_bio)
+{
+	struct r10conf *conf = r10_bio->mddev->private;
+	struct raid10_info *mirror =
+		&conf->mirrors[r10_bio->devs[slot].devnum];
+	unsigned long lat = ktime_us_delta(ktime_get(), r10_bio->start_time);
+	unsigned long avg = READ_ONCE(mirror->read_latency);
+
+	WRITE_ONCE(mirror->read_latency,
+		   avg - (avg >> RAID10_LATENCY_SHIFT) + lat);
+}
+
+/*
+ * Expected wait for a new read on a mirror: what is queued ahead of it,
+ * plus itself, at the recent completion time.  A device without samples
+ * yet costs its queue depth, so it gets used and sampled right away.
+ */
+static unsigned long read_cost(struct raid10_info *mirror,
+			       unsigned int pending)
+{
+	unsigned long lat = READ_ONCE(mirror->read_latency) >>
+		RAID10_LATENCY_SHIFT;
+
+	return (pending + 1) * (lat + 1);
+}
+
 /*
  * Find the disk number which triggered given bio
  */
@@ -386,6 +417,7 @@ static void raid10_end_read_request(struct bio *bio)
 		 * wait for the 'master' bio.
 		 */
 		set_bit(R10BIO_Uptodate, &r10_bio->state);
+		update_read_latency(slot, r10_bio);
 	} else {
 		/* If all other devices that store this block have
 		 * failed, we want to return the error upwards rather
@@ -684,6 +716,9 @@ static sector_t raid10_find_virt(struct r10conf *conf, sector_t sector, int dev)
  * If there are 2 mirrors in the same 2 devices, performance degrades
  * because position is mirror, not device based.
  *
+ * Non-rotational devices have no head to keep in place, so reads go to
+ * the one with the least expected wait, see read_cost().
+ *
  * The rdev for the device selected will have nr_pending incremented.
  */
 
@@ -703,6 +738,10 @@ static struct md_rdev *read_balance(struct r10conf *conf,
 	struct md_rdev *best_rdev, *rdev = NULL;
 	int do_balance;
 	int best_slot;
+	struct md_rdev *best_pending_rdev;
+	int best_pending_slot;
+	unsigned long min_cost;
+	int has_nonrot_disk;
 	struct geom *geo = &conf->geo;
 
 	raid10_find_phys(conf, r10_bio);
@@ -712,6 +751,10 @@ retry:
 	best_slot = -1;
 	best_rdev = NULL;
 	best_dist = MaxSector;
+	best_pending_slot = -1;
+	best_pending_rdev = NULL;
+	min_cost = ULONG_MAX;
+	has_nonrot_disk = 0;
 	best_good_sectors = 0;
 	do_balance = 1;
 	/*
@@ -728,6 +771,8 @@ retry:
 		sector_t first_bad;
 		int bad_sectors;
 		sector_t dev_sector;
+		unsigned long cost;
+		bool nonrot;
 
 		if (r10_bio->devs[slot].bio == IO_BLOCKED)
 			continue;
@@ -778,6 +823,23 @@ retry:
 		if (!do_balance)
 			break;
 
+		nonrot = blk_queue_nonrot(bdev_get_queue(rdev->bdev));
+		has_nonrot_disk |= nonrot;
+		cost = read_cost(&conf->mirrors[disk],
+				 atomic_read(&rdev->nr_pending));
+		if (cost < min_cost) {
+			min_cost = cost;
+			best_pending_slot = slot;
+			best_pending_rdev = rdev;
+		}
+		/*
+		 * Without a head to move, the layout and the position of the
+		 * last request don't matter: pick by queue depth and latency
+		 * below.
+		 */
+		if (nonrot)
+			continue;
+
 		/* This optimisation is debatable, and completely destroys
 		 * sequential read speed for 'far copies' arrays.  So only
 		 * keep it for 'near' arrays, and review those later.
@@ -797,9 +859,18 @@ retry:
 			best_rdev = rdev;
 		}
 	}
+	/*
+	 * If any disk is non-rotational, choose the disk with the least
+	 * expected wait even the disk is rotational, like raid1 does.
+	 */
 	if (slot >= conf->copies) {
-		slot = best_slot;
-		rdev = best_rdev;
+		if (has_nonrot_disk && best_pending_slot >= 0) {
+			slot = best_pending_slot;
+			rdev = best_pending_rdev;
+		} else {
+			slot = best_slot;
+			rdev = best_rdev;
+		}
 	}
 
 	if (slot >= 0) {
@@ -812,6 +883,7 @@ retry:
 			goto retry;
 		}
 		r10_bio->read_slot = slot;
+		r10_bio->start_time = ktime_get();
 	} else
 		rdev = NULL;
 	rcu_read_unlock();
@@ -1734,6 +1806,7 @@ static int raid10_add_disk(struct mddev *mddev, struct md_rdev *rdev)
 					  rdev->data_offset << 9);
 
 		p->head_position = 0;
+		p->read_latency = 0;
 		p->recovery_disabled = mddev->recovery_disabled - 1;
 		rdev->raid_disk = mirror;
 		err = 0;
@@ -9,8 +9,15 @@ struct raid10_info {
 						 * when we shouldn't try
 						 * recovering this device.
 						 */
+	/* Decaying average of read completion time in usecs, scaled by
+	 * 1 << RAID10_LATENCY_SHIFT.  Used to balance reads across
+	 * non-rotational devices.
+	 */
+	unsigned long	read_latency;
 };
 
+#define RAID10_LATENCY_SHIFT	3
+
 struct r10conf {
 	struct mddev		*mddev;
 	struct raid10_info	*mirrors;
@@ -111,6 +118,8 @@ struct r10bio {
 	 * if the IO is in READ direction, then this is where we read
 	 */
 	int			read_slot;
+	/* when the read was sent to read_slot */
+	ktime_t			start_time;
 
 	struct list_head	retry_list;
 	/*
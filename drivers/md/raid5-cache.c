@@ -20,6 +20,7 @@
 #include <linux/random.h>
 #include "md.h"
 #include "raid5.h"
+#include "bitmap.h"
 
 /*
  * metadata/data stored in disk with 4k size unit (a block) regardless
@@ -34,6 +35,41 @@
 #define RECLAIM_MAX_FREE_SPACE (10 * 1024 * 1024 * 2) /* sector */
 #define RECLAIM_MAX_FREE_SPACE_SHIFT (2)
 
+/* wake up reclaim thread periodically */
+#define R5C_RECLAIM_WAKEUP_INTERVAL (30 * HZ)
+/* start flush with these full stripes */
+#define R5C_FULL_STRIPE_FLUSH_BATCH 256
+/* reclaim stripes in groups */
+#define R5C_RECLAIM_STRIPE_GROUP (NR_STRIPE_HASH_LOCKS * 2)
+
+/*
+ * The journal works in two modes:
+ *
+ * write-through: a write is logged together with the parity computed for it,
+ * and completes once data and parity reach the raid disks.  The journal only
+ * closes the write hole.
+ *
+ * write-back: a full page write to a stripe is completed as soon as the data
+ * is in the journal.  Such a stripe is in the caching phase
+ * (STRIPE_R5C_CACHING): its data pages are marked R5_InJournal, nothing is
+ * written to the raid disks, and the idle stripe is parked on
+ * conf->r5c_full_stripe_list or conf->r5c_partial_stripe_list.  Reclaim
+ * moves cached stripes to the writing-out phase (r5c_make_stripe_write_out),
+ * which computes parity with reconstruct-write, logs the parity and writes
+ * data and parity to the raid disks.  Full stripes are preferred, they need
+ * no reads at all.
+ *
+ * Every stripe with data in the journal is on log->stripe_in_journal_list,
+ * ordered by sh->log_start.  The log tail can't move past the first of them.
+ */
+enum r5c_journal_mode {
+	R5C_JOURNAL_MODE_WRITE_THROUGH = 0,
+	R5C_JOURNAL_MODE_WRITE_BACK = 1,
+};
+
+static char *r5c_journal_mode_str[] = {"write-through",
+				       "write-back"};
+
 struct r5l_log {
 	struct md_rdev *rdev;
 
@@ -52,7 +88,6 @@ struct r5l_log {
 	u64 seq;			/* log head sequence */
 
 	sector_t next_checkpoint;
-	u64 next_cp_seq;
 
 	struct mutex io_mutex;
 	struct r5l_io_unit *current_io;	/* current io_unit accepting new data */
@@ -86,6 +121,16 @@ struct r5l_log {
 
 	bool need_cache_flush;
 	bool in_teardown;
+
+	enum r5c_journal_mode r5c_journal_mode;
+
+	/* stripes with data in the journal, in the order of sh->log_start */
+	struct list_head stripe_in_journal_list;
+	spinlock_t stripe_in_journal_lock;
+	atomic_t stripe_in_journal_count;
+
+	/* switch to write-through when the array becomes degraded */
+	struct work_struct disable_writeback_work;
 };
 
 /*
@@ -150,6 +195,66 @@ static bool r5l_has_free_space(struct r5l_log *log, sector_t size)
 	return log->device_size > used_size + size;
 }
 
+static void r5l_wake_reclaim(struct r5l_log *log, sector_t space);
+
+bool r5c_is_writeback(struct r5l_log *log)
+{
+	return (log != NULL &&
+		log->r5c_journal_mode == R5C_JOURNAL_MODE_WRITE_BACK);
+}
+
+/*
+ * Log space needed to write out everything in the cache: parity for every
+ * stripe in the journal, plus room for the stripes being handled.
+ */
+static sector_t r5c_log_required_to_flush_cache(struct r5conf *conf)
+{
+	struct r5l_log *log = conf->log;
+
+	return BLOCK_SECTORS *
+		((conf->max_degraded + 1) *
+		 atomic_read(&log->stripe_in_journal_count) +
+		 (conf->raid_disks - conf->max_degraded) *
+		 (conf->group_cnt + 1));
+}
+
+/*
+ * R5C_LOG_TIGHT makes reclaim write out the stripes at the log tail.
+ * R5C_LOG_CRITICAL stops stripes without data in the journal from using log
+ * space, what is left is reserved for writing out the cached stripes.
+ */
+static void r5c_update_log_state(struct r5l_log *log)
+{
+	struct r5conf *conf = log->rdev->mddev->private;
+	sector_t free_space;
+	sector_t reclaim_space;
+	bool wake_reclaim = false;
+
+	if (!r5c_is_writeback(log)) {
+		clear_bit(R5C_LOG_TIGHT, &conf->cache_state);
+		clear_bit(R5C_LOG_CRITICAL, &conf->cache_state);
+		return;
+	}
+
+	free_space = log->device_size -
+		r5l_ring_distance(log, log->last_checkpoint, log->log_start);
+	reclaim_space = r5c_log_required_to_flush_cache(conf);
+	if (free_space < 2 * reclaim_space)
+		set_bit(R5C_LOG_CRITICAL, &conf->cache_state);
+	else {
+		if (test_bit(R5C_LOG_CRITICAL, &conf->cache_state))
+			wake_reclaim = true;
+		clear_bit(R5C_LOG_CRITICAL, &conf->cache_state);
+	}
+	if (free_space < 3 * reclaim_space)
+		set_bit(R5C_LOG_TIGHT, &conf->cache_state);
+	else
+		clear_bit(R5C_LOG_TIGHT, &conf->cache_state);
+
+	if (wake_reclaim)
+		r5l_wake_reclaim(log, 0);
+}
+
 static void r5l_free_io_unit(struct r5l_log *log, struct r5l_io_unit *io)
 {
 	__free_page(io->meta_page);
@@ -179,12 +284,38 @@ static void __r5l_set_io_unit_state(struct r5l_io_unit *io,
 	io->state = state;
 }
 
+/*
+ * The log write of a stripe finished.  In the caching phase the data is
+ * safe now and the writes can be returned, otherwise data and parity are in
+ * the journal and can go to the raid disks; R5_InJournal on the parity
+ * disk tells r5c_finish_stripe_write_out() to release the journal space
+ * once they are there.
+ */
+static void r5c_finish_cache_stripe(struct stripe_head *sh)
+{
+	int i;
+
+	if (test_bit(STRIPE_R5C_CACHING, &sh->state)) {
+		for (i = sh->disks; i--; )
+			if (test_and_clear_bit(R5_Wantwrite,
+					       &sh->dev[i].flags)) {
+				set_bit(R5_InJournal, &sh->dev[i].flags);
+				clear_bit(R5_LOCKED, &sh->dev[i].flags);
+			}
+		clear_bit(STRIPE_LOG_TRAPPED, &sh->state);
+	} else
+		set_bit(R5_InJournal, &sh->dev[sh->pd_idx].flags);
+}
+
 static void r5l_io_run_stripes(struct r5l_io_unit *io)
 {
 	struct stripe_head *sh, *next;
 
 	list_for_each_entry_safe(sh, next, &io->stripe_list, log_list) {
 		list_del_init(&sh->log_list);
+
+		r5c_finish_cache_stripe(sh);
+
 		set_bit(STRIPE_HANDLE, &sh->state);
 		raid5_release_stripe(sh);
 	}
@@ -379,15 +510,17 @@ static void r5l_log_stripe(struct r5l_log *log, struct stripe_head *sh,
 
 	meta_size =
 		((sizeof(struct r5l_payload_data_parity) + sizeof(__le32))
-		 * data_pages) +
-		sizeof(struct r5l_payload_data_parity) +
-		sizeof(__le32) * parity_pages;
+		 * data_pages);
+	if (parity_pages)
+		meta_size += sizeof(struct r5l_payload_data_parity) +
+			sizeof(__le32) * parity_pages;
 
 	r5l_get_meta(log, meta_size);
 	io = log->current_io;
 
 	for (i = 0; i < sh->disks; i++) {
-		if (!test_bit(R5_Wantwrite, &sh->dev[i].flags))
+		if (!test_bit(R5_Wantwrite, &sh->dev[i].flags) ||
+		    test_bit(R5_InJournal, &sh->dev[i].flags))
 			continue;
 		if (i == sh->pd_idx || i == sh->qd_idx)
 			continue;
@@ -397,6 +530,10 @@ static void r5l_log_stripe(struct r5l_log *log, struct stripe_head *sh,
 		r5l_append_payload_page(log, sh->dev[i].page);
 	}
 
+	/* the caching phase only logs data */
+	if (!parity_pages)
+		goto out;
+
 	if (sh->qd_idx >= 0) {
 		r5l_append_payload_meta(log, R5LOG_PAYLOAD_PARITY,
 					sh->sector, sh->dev[sh->pd_idx].log_checksum,
@@ -409,19 +546,38 @@ static void r5l_log_stripe(struct r5l_log *log, struct stripe_head *sh,
 					0, false);
 		r5l_append_payload_page(log, sh->dev[sh->pd_idx].page);
 	}
-
+out:
 	list_add_tail(&sh->log_list, &io->stripe_list);
 	atomic_inc(&io->pending_stripe);
 	sh->log_io = io;
+
+	/* the log tail can't move past this until the stripe is written out */
+	if (sh->log_start == MaxSector) {
+		BUG_ON(!list_empty(&sh->r5c));
+		sh->log_start = io->log_start;
+		spin_lock_irq(&log->stripe_in_journal_lock);
+		list_add_tail(&sh->r5c, &log->stripe_in_journal_list);
+		spin_unlock_irq(&log->stripe_in_journal_lock);
+		atomic_inc(&log->stripe_in_journal_count);
+	}
+	r5c_update_log_state(log);
+}
+
+static void r5l_add_no_space_stripe(struct r5l_log *log,
+				    struct stripe_head *sh)
+{
+	spin_lock(&log->no_space_stripes_lock);
+	list_add_tail(&sh->log_list, &log->no_space_stripes);
+	spin_unlock(&log->no_space_stripes_lock);
 }
 
-static void r5l_wake_reclaim(struct r5l_log *log, sector_t space);
 /*
  * running in raid5d, where reclaim could wait for raid5d too (when it flushes
  * data from log to raid disks), so we shouldn't wait for reclaim here
  */
 int r5l_write_stripe(struct r5l_log *log, struct stripe_head *sh)
 {
+	struct r5conf *conf = sh->raid_conf;
 	int write_disks = 0;
 	int data_pages, parity_pages;
 	int meta_size;
@@ -441,7 +597,9 @@ int r5l_write_stripe(struct r5l_log *log, struct stripe_head *sh)
 	for (i = 0; i < sh->disks; i++) {
 		void *addr;
 
-		if (!test_bit(R5_Wantwrite, &sh->dev[i].flags))
+		/* data cached earlier is in the journal already */
+		if (!test_bit(R5_Wantwrite, &sh->dev[i].flags) ||
+		    test_bit(R5_InJournal, &sh->dev[i].flags))
 			continue;
 		write_disks++;
 		/* checksum is already calculated in last run */
@@ -475,15 +633,73 @@ int r5l_write_stripe(struct r5l_log *log, struct stripe_head *sh)
 	mutex_lock(&log->io_mutex);
 	/* meta + data */
 	reserve = (1 + write_disks) << (PAGE_SHIFT - 9);
-	if (r5l_has_free_space(log, reserve))
+	if (!r5c_is_writeback(log)) {
+		if (r5l_has_free_space(log, reserve))
+			r5l_log_stripe(log, sh, data_pages, parity_pages);
+		else {
+			r5l_add_no_space_stripe(log, sh);
+			r5l_wake_reclaim(log, reserve);
+		}
+	} else if ((test_bit(R5C_LOG_CRITICAL, &conf->cache_state) &&
+		    sh->log_start == MaxSector) ||
+		   !r5l_has_free_space(log, reserve)) {
+		/*
+		 * The space left is kept for the stripes already in the
+		 * journal, reclaim writes them out to free the log.
+		 */
+		r5l_add_no_space_stripe(log, sh);
+		r5l_wake_reclaim(log, 0);
+	} else
 		r5l_log_stripe(log, sh, data_pages, parity_pages);
-	else {
-		spin_lock(&log->no_space_stripes_lock);
-		list_add_tail(&sh->log_list, &log->no_space_stripes);
-		spin_unlock(&log->no_space_stripes_lock);
+	mutex_unlock(&log->io_mutex);
 
-		r5l_wake_reclaim(log, reserve);
+	return 0;
+}
+
+/*
+ * Log the data of a stripe in the caching phase.  Like r5l_write_stripe()
+ * this holds the stripe until the log write finishes.
+ */
+int r5c_cache_data(struct r5l_log *log, struct stripe_head *sh,
+		   struct stripe_head_state *s)
+{
+	struct r5conf *conf = sh->raid_conf;
+	int pages = 0;
+	int reserve;
+	int i;
+
+	BUG_ON(!log);
+
+	for (i = 0; i < sh->disks; i++) {
+		void *addr;
+
+		if (!test_bit(R5_Wantwrite, &sh->dev[i].flags))
+			continue;
+		addr = kmap_atomic(sh->dev[i].page);
+		sh->dev[i].log_checksum = crc32c_le(log->uuid_checksum,
+						    addr, PAGE_SIZE);
+		kunmap_atomic(addr);
+		pages++;
 	}
+	WARN_ON(pages == 0);
+
+	/*
+	 * The stripe must enter state machine again to return the writes, so
+	 * don't delay.
+	 */
+	clear_bit(STRIPE_DELAYED, &sh->state);
+	atomic_inc(&sh->count);
+
+	mutex_lock(&log->io_mutex);
+	/* meta + data */
+	reserve = (1 + pages) << (PAGE_SHIFT - 9);
+	if ((test_bit(R5C_LOG_CRITICAL, &conf->cache_state) &&
+	     sh->log_start == MaxSector) ||
+	    !r5l_has_free_space(log, reserve)) {
+		r5l_add_no_space_stripe(log, sh);
+		r5l_wake_reclaim(log, 0);
+	} else
+		r5l_log_stripe(log, sh, pages, 0);
 	mutex_unlock(&log->io_mutex);
 
 	return 0;
@@ -506,7 +722,8 @@ int r5l_handle_flush_request(struct r5l_log *log, struct bio *bio)
 	 * we flush log disk cache first, then write stripe data to raid disks.
 	 * So if bio is finished, the log disk cache is flushed already. The
 	 * recovery guarantees we can recovery the bio from log disk, so we
-	 * don't need to flush again
+	 * don't need to flush again.  The same holds for writes completed by
+	 * the write-back cache, they are only returned after the log flush.
 	 */
 	if (bio->bi_iter.bi_size == 0) {
 		bio_endio(bio);
@@ -532,10 +749,39 @@ static void r5l_run_no_space_stripes(struct r5l_log *log)
 	spin_unlock(&log->no_space_stripes_lock);
 }
 
+/*
+ * The log tail can move up to the first io_unit still in flight, or to the
+ * oldest stripe with data in the journal, whichever comes first.
+ */
+static sector_t r5c_calculate_new_cp(struct r5conf *conf)
+{
+	struct r5l_log *log = conf->log;
+	struct stripe_head *sh;
+	sector_t new_cp;
+	unsigned long flags;
+
+	spin_lock_irqsave(&log->stripe_in_journal_lock, flags);
+	if (list_empty(&log->stripe_in_journal_list)) {
+		spin_unlock_irqrestore(&log->stripe_in_journal_lock, flags);
+		return log->next_checkpoint;
+	}
+	sh = list_first_entry(&log->stripe_in_journal_list,
+			      struct stripe_head, r5c);
+	new_cp = sh->log_start;
+	spin_unlock_irqrestore(&log->stripe_in_journal_lock, flags);
+
+	if (r5l_ring_distance(log, log->last_checkpoint, new_cp) <
+	    r5l_ring_distance(log, log->last_checkpoint, log->next_checkpoint))
+		return new_cp;
+	return log->next_checkpoint;
+}
+
 static sector_t r5l_reclaimable_space(struct r5l_log *log)
 {
+	struct r5conf *conf = log->rdev->mddev->private;
+
 	return r5l_ring_distance(log, log->last_checkpoint,
-				 log->next_checkpoint);
+				 r5c_calculate_new_cp(conf));
 }
 
 static bool r5l_complete_finished_ios(struct r5l_log *log)
@@ -551,7 +797,6 @@ static bool r5l_complete_finished_ios(struct r5l_log *log)
 			break;
 
 		log->next_checkpoint = io->log_start;
-		log->next_cp_seq = io->seq;
 
 		list_del(&io->log_sibling);
 		r5l_free_io_unit(log, io);
@@ -649,6 +894,142 @@ void r5l_flush_stripe_to_raid(struct r5l_log *log)
 	submit_bio(WRITE_FLUSH, &log->flush_bio);
 }
 
+/*
+ * Put a cached stripe back on the handle list to be written out.  Called
+ * with device_lock held.
+ */
+static void r5c_flush_stripe(struct r5conf *conf, struct stripe_head *sh)
+{
+	BUG_ON(list_empty(&sh->lru));
+	BUG_ON(!test_bit(STRIPE_R5C_CACHING, &sh->state));
+	BUG_ON(test_bit(STRIPE_HANDLE, &sh->state));
+	assert_spin_locked(&conf->device_lock);
+
+	list_del_init(&sh->lru);
+	atomic_inc(&sh->count);
+
+	set_bit(STRIPE_HANDLE, &sh->state);
+	atomic_inc(&conf->active_stripes);
+	r5c_make_stripe_write_out(sh);
+
+	raid5_release_stripe(sh);
+}
+
+/*
+ * Flush all cached full stripes and up to @num partial ones.  Called with
+ * device_lock held.
+ */
+void r5c_flush_cache(struct r5conf *conf, int num)
+{
+	struct stripe_head *sh, *next;
+	int count = 0;
+
+	assert_spin_locked(&conf->device_lock);
+	if (!conf->log)
+		return;
+
+	list_for_each_entry_safe(sh, next, &conf->r5c_full_stripe_list, lru)
+		r5c_flush_stripe(conf, sh);
+
+	list_for_each_entry_safe(sh, next, &conf->r5c_partial_stripe_list, lru) {
+		if (count >= num)
+			break;
+		r5c_flush_stripe(conf, sh);
+		count++;
+	}
+}
+
+/* the stripe cache is filling up with cached stripes, start reclaim */
+void r5c_check_stripe_cache_usage(struct r5conf *conf)
+{
+	int total_cached;
+
+	if (!r5c_is_writeback(conf->log))
+		return;
+
+	total_cached = atomic_read(&conf->r5c_cached_partial_stripes) +
+		atomic_read(&conf->r5c_cached_full_stripes);
+
+	if (total_cached > conf->min_nr_stripes / 2 ||
+	    atomic_read(&conf->empty_inactive_list_nr) > 0)
+		r5l_wake_reclaim(conf->log, 0);
+}
+
+/* enough full stripes are cached to write them out in one go */
+void r5c_check_cached_full_stripe(struct r5conf *conf)
+{
+	if (!r5c_is_writeback(conf->log))
+		return;
+
+	if (atomic_read(&conf->r5c_cached_full_stripes) >=
+	    min(R5C_FULL_STRIPE_FLUSH_BATCH,
+		conf->chunk_sectors >> STRIPE_SHIFT))
+		r5l_wake_reclaim(conf->log, 0);
+}
+
+static void r5c_do_reclaim(struct r5conf *conf)
+{
+	struct r5l_log *log = conf->log;
+	struct stripe_head *sh;
+	int count = 0;
+	unsigned long flags;
+	int total_cached;
+	int stripes_to_flush;
+
+	if (!r5c_is_writeback(log))
+		return;
+
+	total_cached = atomic_read(&conf->r5c_cached_partial_stripes) +
+		atomic_read(&conf->r5c_cached_full_stripes);
+
+	if (total_cached > conf->min_nr_stripes * 3 / 4 ||
+	    atomic_read(&conf->empty_inactive_list_nr) > 0)
+		/*
+		 * stripe cache pressure is high, flush all full stripes and
+		 * some partial stripes
+		 */
+		stripes_to_flush = R5C_RECLAIM_STRIPE_GROUP;
+	else if (total_cached > conf->min_nr_stripes / 2 ||
+		 atomic_read(&conf->r5c_cached_full_stripes) >
+		 R5C_FULL_STRIPE_FLUSH_BATCH)
+		/* stripe cache pressure is moderate, flush all full stripes */
+		stripes_to_flush = 0;
+	else
+		stripes_to_flush = -1;
+
+	if (stripes_to_flush >= 0) {
+		spin_lock_irqsave(&conf->device_lock, flags);
+		r5c_flush_cache(conf, stripes_to_flush);
+		spin_unlock_irqrestore(&conf->device_lock, flags);
+	}
+
+	/* log space is tight, write out the stripes at the log tail */
+	if (test_bit(R5C_LOG_TIGHT, &conf->cache_state)) {
+		spin_lock_irqsave(&log->stripe_in_journal_lock, flags);
+		spin_lock(&conf->device_lock);
+		list_for_each_entry(sh, &log->stripe_in_journal_list, r5c) {
+			/*
+			 * stripes on the cached lists are idle; anything else
+			 * is already on its way to the raid disks
+			 */
+			if (!list_empty(&sh->lru) &&
+			    !test_bit(STRIPE_HANDLE, &sh->state) &&
+			    test_bit(STRIPE_R5C_CACHING, &sh->state) &&
+			    atomic_read(&sh->count) == 0)
+				r5c_flush_stripe(conf, sh);
+			if (count++ >= R5C_RECLAIM_STRIPE_GROUP)
+				break;
+		}
+		spin_unlock(&conf->device_lock);
+		spin_unlock_irqrestore(&log->stripe_in_journal_lock, flags);
+	}
+
+	if (!test_bit(R5C_LOG_CRITICAL, &conf->cache_state))
+		r5l_run_no_space_stripes(log);
+
+	md_wakeup_thread(conf->mddev->thread);
+}
+
 static void r5l_write_super(struct r5l_log *log, sector_t cp);
 static void r5l_write_super_and_discard_space(struct r5l_log *log,
 	sector_t end)
@@ -710,7 +1091,6 @@ static void r5l_do_reclaim(struct r5l_log *log)
 	sector_t reclaim_target = xchg(&log->reclaim_target, 0);
 	sector_t reclaimable;
 	sector_t next_checkpoint;
-	u64 next_cp_seq;
 
 	spin_lock_irq(&log->io_list_lock);
 	/*
@@ -733,8 +1113,7 @@ static void r5l_do_reclaim(struct r5l_log *log)
 				    log->io_list_lock);
 	}
 
-	next_checkpoint = log->next_checkpoint;
-	next_cp_seq = log->next_cp_seq;
+	next_checkpoint = r5c_calculate_new_cp(log->rdev->mddev->private);
 	spin_unlock_irq(&log->io_list_lock);
 
 	BUG_ON(reclaimable < 0);
@@ -750,7 +1129,7 @@ static void r5l_do_reclaim(struct r5l_log *log)
 
 	mutex_lock(&log->io_mutex);
 	log->last_checkpoint = next_checkpoint;
-	log->last_cp_seq = next_cp_seq;
+	r5c_update_log_state(log);
 	mutex_unlock(&log->io_mutex);
 
 	r5l_run_no_space_stripes(log);
@@ -764,6 +1143,7 @@ static void r5l_reclaim_thread(struct md_thread *thread)
 
 	if (!log)
 		return;
+	r5c_do_reclaim(conf);
 	r5l_do_reclaim(log);
 }
 
@@ -789,6 +1169,7 @@ void r5l_quiesce(struct r5l_log *log, int state)
 		log->in_teardown = 0;
 		log->reclaim_thread = md_register_thread(r5l_reclaim_thread,
 					log->rdev->mddev, "reclaim");
+		log->reclaim_thread->timeout = R5C_RECLAIM_WAKEUP_INTERVAL;
 	} else if (state == 1) {
 		/*
 		 * at this point all stripes are finished, so io_unit is at
@@ -812,11 +1193,299 @@ bool r5l_log_disk_error(struct r5conf *conf)
 	return test_bit(Faulty, &conf->log->rdev->flags);
 }
 
+/*
+ * Try to handle the writes of a stripe in the caching phase.  Returns 0 if
+ * the writes are cached (or will be, once the data in flight is in the
+ * journal), -EAGAIN if the stripe must be written out to the raid disks.
+ */
+int r5c_try_caching_write(struct r5conf *conf,
+			  struct stripe_head *sh,
+			  struct stripe_head_state *s,
+			  int disks)
+{
+	struct r5dev *dev;
+	int i;
+
+	if (!test_bit(STRIPE_R5C_CACHING, &sh->state)) {
+		/*
+		 * Either the stripe has cached data and is being written out,
+		 * or it is clean and can start caching.  Stripes which need
+		 * the raid disks for anything else don't cache.
+		 */
+		if (s->injournal > 0 || s->written || s->syncing ||
+		    s->failed || s->log_failed || conf->quiesce ||
+		    test_bit(STRIPE_DISCARD, &sh->state))
+			return -EAGAIN;
+		set_bit(STRIPE_R5C_CACHING, &sh->state);
+	}
+
+	/*
+	 * Partial page writes need the old data, and the journal only holds
+	 * whole pages: write the stripe out instead.
+	 */
+	for (i = disks; i--; ) {
+		dev = &sh->dev[i];
+		if (dev->towrite && !test_bit(R5_OVERWRITE, &dev->flags)) {
+			r5c_make_stripe_write_out(sh);
+			return -EAGAIN;
+		}
+	}
+
+	/* wait for the data already on its way to the journal */
+	for (i = disks; i--; ) {
+		dev = &sh->dev[i];
+		if (dev->towrite && (test_bit(R5_LOCKED, &dev->flags) ||
+				     dev->written))
+			return 0;
+	}
+
+	for (i = disks; i--; ) {
+		dev = &sh->dev[i];
+		if (dev->towrite) {
+			set_bit(R5_Wantwrite, &dev->flags);
+			set_bit(R5_Wantdrain, &dev->flags);
+			set_bit(R5_LOCKED, &dev->flags);
+			clear_bit(R5_UPTODATE, &dev->flags);
+			/* the new copy is logged again, after the old one */
+			clear_bit(R5_InJournal, &dev->flags);
+			s->locked++;
+		}
+	}
+
+	/* parity no longer matches the cached data */
+	clear_bit(R5_UPTODATE, &sh->dev[sh->pd_idx].flags);
+	if (sh->qd_idx >= 0)
+		clear_bit(R5_UPTODATE, &sh->dev[sh->qd_idx].flags);
+
+	set_bit(STRIPE_OP_BIODRAIN, &s->ops_request);
+	set_bit(STRIPE_LOG_TRAPPED, &sh->state);
+
+	return 0;
+}
+
+/*
+ * Data of the stripe is in the journal (and the log device cache is
+ * flushed), return the writes.
+ */
+void r5c_handle_cached_data_endio(struct r5conf *conf,
+				  struct stripe_head *sh, int disks,
+				  struct bio_list *return_bi)
+{
+	int i;
+
+	for (i = disks; i--; ) {
+		struct r5dev *dev = &sh->dev[i];
+		struct bio *wbi, *wbi2;
+
+		if (!test_bit(R5_InJournal, &dev->flags) || !dev->written)
+			continue;
+
+		set_bit(R5_UPTODATE, &dev->flags);
+		wbi = dev->written;
+		dev->written = NULL;
+		while (wbi && wbi->bi_iter.bi_sector <
+		       dev->sector + STRIPE_SECTORS) {
+			wbi2 = r5_next_bio(wbi, dev->sector);
+			if (!raid5_dec_bi_active_stripes(wbi)) {
+				md_write_end(conf->mddev);
+				bio_list_add(return_bi, wbi);
+			}
+			wbi = wbi2;
+		}
+		bitmap_endwrite(conf->mddev->bitmap, sh->sector,
+				STRIPE_SECTORS,
+				!test_bit(STRIPE_DEGRADED, &sh->state), 0);
+	}
+
+	r5l_stripe_write_finished(sh);
+}
+
+/* move a stripe from the caching phase to the write-out phase */
+void r5c_make_stripe_write_out(struct stripe_head *sh)
+{
+	struct r5conf *conf = sh->raid_conf;
+
+	WARN_ON(!test_bit(STRIPE_R5C_CACHING, &sh->state));
+	clear_bit(STRIPE_R5C_CACHING, &sh->state);
+
+	if (!test_and_set_bit(STRIPE_PREREAD_ACTIVE, &sh->state))
+		atomic_inc(&conf->preread_active_stripes);
+
+	if (test_and_clear_bit(STRIPE_R5C_PARTIAL_STRIPE, &sh->state)) {
+		BUG_ON(atomic_read(&conf->r5c_cached_partial_stripes) == 0);
+		atomic_dec(&conf->r5c_cached_partial_stripes);
+	}
+
+	if (test_and_clear_bit(STRIPE_R5C_FULL_STRIPE, &sh->state)) {
+		BUG_ON(atomic_read(&conf->r5c_cached_full_stripes) == 0);
+		atomic_dec(&conf->r5c_cached_full_stripes);
+	}
+}
+
+/*
+ * The stripe is on the raid disks, the journal doesn't need to keep it
+ * any longer.
+ */
+void r5c_finish_stripe_write_out(struct r5conf *conf,
+				 struct stripe_head *sh,
+				 struct stripe_head_state *s)
+{
+	struct r5l_log *log = conf->log;
+	int do_wakeup = 0;
+	int i;
+
+	if (!log || !test_bit(R5_InJournal, &sh->dev[sh->pd_idx].flags))
+		return;
+
+	WARN_ON(test_bit(STRIPE_R5C_CACHING, &sh->state));
+
+	for (i = sh->disks; i--; ) {
+		clear_bit(R5_InJournal, &sh->dev[i].flags);
+		if (test_and_clear_bit(R5_Overlap, &sh->dev[i].flags))
+			do_wakeup = 1;
+	}
+	s->injournal = 0;
+
+	if (do_wakeup)
+		wake_up(&conf->wait_for_overlap);
+
+	if (sh->log_start == MaxSector)
+		return;
+
+	spin_lock_irq(&log->stripe_in_journal_lock);
+	list_del_init(&sh->r5c);
+	spin_unlock_irq(&log->stripe_in_journal_lock);
+	sh->log_start = MaxSector;
+	atomic_dec(&log->stripe_in_journal_count);
+	r5c_update_log_state(log);
+
+	if (test_bit(R5C_LOG_TIGHT, &conf->cache_state))
+		r5l_wake_reclaim(log, 0);
+}
+
+static ssize_t r5c_journal_mode_show(struct mddev *mddev, char *page)
+{
+	struct r5conf *conf;
+	int ret = 0;
+
+	spin_lock(&mddev->lock);
+	conf = mddev->private;
+	if (!conf || !conf->log) {
+		spin_unlock(&mddev->lock);
+		return 0;
+	}
+
+	switch (conf->log->r5c_journal_mode) {
+	case R5C_JOURNAL_MODE_WRITE_THROUGH:
+		ret = snprintf(page, PAGE_SIZE, "[%s] %s\n",
+			       r5c_journal_mode_str[R5C_JOURNAL_MODE_WRITE_THROUGH],
+			       r5c_journal_mode_str[R5C_JOURNAL_MODE_WRITE_BACK]);
+		break;
+	case R5C_JOURNAL_MODE_WRITE_BACK:
+		ret = snprintf(page, PAGE_SIZE, "%s [%s]\n",
+			       r5c_journal_mode_str[R5C_JOURNAL_MODE_WRITE_THROUGH],
+			       r5c_journal_mode_str[R5C_JOURNAL_MODE_WRITE_BACK]);
+		break;
+	default:
+		ret = 0;
+	}
+	spin_unlock(&mddev->lock);
+	return ret;
+}
+
+static ssize_t r5c_journal_mode_store(struct mddev *mddev,
+				      const char *page, size_t length)
+{
+	struct r5conf *conf;
+	int mode = ARRAY_SIZE(r5c_journal_mode_str);
+	size_t len = length;
+	int err;
+
+	if (len < 2)
+		return -EINVAL;
+
+	if (page[len - 1] == '\n')
+		len--;
+
+	while (mode--)
+		if (strlen(r5c_journal_mode_str[mode]) == len &&
+		    !strncmp(page, r5c_journal_mode_str[mode], len))
+			break;
+	if (mode < 0)
+		return -EINVAL;
+
+	err = mddev_lock(mddev);
+	if (err)
+		return err;
+	conf = mddev->private;
+	if (!conf || !conf->log)
+		err = -ENODEV;
+	else if (mode == R5C_JOURNAL_MODE_WRITE_BACK && mddev->degraded)
+		/* the cache can't be written out without parity to spare */
+		err = -EINVAL;
+	else if (conf->log->r5c_journal_mode != mode) {
+		mddev_suspend(mddev);
+		conf->log->r5c_journal_mode = mode;
+		r5c_update_log_state(conf->log);
+		mddev_resume(mddev);
+		pr_debug("md/raid:%s: setting r5c cache mode to %d: %s\n",
+			 mdname(mddev), mode, r5c_journal_mode_str[mode]);
+	}
+	mddev_unlock(mddev);
+	return err ?: length;
+}
+
+struct md_sysfs_entry
+r5c_journal_mode = __ATTR(journal_mode, S_IRUGO | S_IWUSR,
+			  r5c_journal_mode_show, r5c_journal_mode_store);
+
+/*
+ * A degraded array can't rebuild a missing block of a cached stripe once
+ * more data is cached over it, so switch back to write-through.  The
+ * caller (the error handler) can't sleep, the switch is done from a work.
+ */
+static void r5c_disable_writeback_work(struct work_struct *work)
+{
+	struct r5l_log *log = container_of(work, struct r5l_log,
+					   disable_writeback_work);
+	struct mddev *mddev = log->rdev->mddev;
+	int locked = 0;
+
+	if (log->r5c_journal_mode == R5C_JOURNAL_MODE_WRITE_THROUGH)
+		return;
+
+	/* wait for the superblock update of the failure to go out first */
+	wait_event(mddev->sb_wait,
+		   log->r5c_journal_mode == R5C_JOURNAL_MODE_WRITE_THROUGH ||
+		   (!test_bit(MD_CHANGE_PENDING, &mddev->flags) &&
+		    (locked = mddev_trylock(mddev))));
+	if (!locked)
+		return;
+
+	if (log->r5c_journal_mode == R5C_JOURNAL_MODE_WRITE_BACK) {
+		pr_info("md/raid:%s: Disabling writeback cache for degraded array.\n",
+			mdname(mddev));
+		mddev_suspend(mddev);
+		log->r5c_journal_mode = R5C_JOURNAL_MODE_WRITE_THROUGH;
+		r5c_update_log_state(log);
+		mddev_resume(mddev);
+	}
+	mddev_unlock(mddev);
+}
+
+void r5c_disable_writeback_async(struct r5l_log *log)
+{
+	if (r5c_is_writeback(log))
+		schedule_work(&log->disable_writeback_work);
+}
+
 struct r5l_recovery_ctx {
 	struct page *meta_page;		/* current meta */
 	sector_t meta_total_blocks;	/* total size of current meta and data */
 	sector_t pos;			/* recovery position */
 	u64 seq;			/* recovery position seq */
+	struct list_head cached_list;	/* stripes with data not yet on the
+					 * raid disks */
 };
 
 static int r5l_read_meta_block(struct r5l_log *log,
@@ -851,78 +1520,89 @@ static int r5l_read_meta_block(struct r5l_log *log,
 	return 0;
 }
 
-static int r5l_recovery_flush_one_stripe(struct r5l_log *log,
-					 struct r5l_recovery_ctx *ctx,
-					 sector_t stripe_sect,
-					 int *offset, sector_t *log_offset)
+/*
+ * A meta block is only used if all its payload made it to the log, check
+ * every page before touching any stripe.
+ */
+static int r5l_recovery_verify_data_checksums(struct r5l_log *log,
+					      struct r5l_recovery_ctx *ctx,
+					      struct page *page)
 {
-	struct r5conf *conf = log->rdev->mddev->private;
-	struct stripe_head *sh;
+	struct r5l_meta_block *mb = page_address(ctx->meta_page);
 	struct r5l_payload_data_parity *payload;
-	int disk_index;
+	sector_t log_offset = r5l_ring_add(log, ctx->pos, BLOCK_SECTORS);
+	int offset = sizeof(struct r5l_meta_block);
 
-	sh = raid5_get_active_stripe(conf, stripe_sect, 0, 0, 0);
-	while (1) {
-		payload = page_address(ctx->meta_page) + *offset;
+	while (offset < le32_to_cpu(mb->meta_size)) {
+		int pages, i;
 
-		if (le16_to_cpu(payload->header.type) == R5LOG_PAYLOAD_DATA) {
-			raid5_compute_sector(conf,
-					     le64_to_cpu(payload->location), 0,
-					     &disk_index, sh);
-
-			sync_page_io(log->rdev, *log_offset, PAGE_SIZE,
-				     sh->dev[disk_index].page, READ, false);
-			sh->dev[disk_index].log_checksum =
-				le32_to_cpu(payload->checksum[0]);
-			set_bit(R5_Wantwrite, &sh->dev[disk_index].flags);
-			ctx->meta_total_blocks += BLOCK_SECTORS;
-		} else {
-			disk_index = sh->pd_idx;
-			sync_page_io(log->rdev, *log_offset, PAGE_SIZE,
-				     sh->dev[disk_index].page, READ, false);
-			sh->dev[disk_index].log_checksum =
-				le32_to_cpu(payload->checksum[0]);
-			set_bit(R5_Wantwrite, &sh->dev[disk_index].flags);
+		payload = (void *)mb + offset;
+		if (le16_to_cpu(payload->header.type) != R5LOG_PAYLOAD_DATA &&
+		    le16_to_cpu(payload->header.type) != R5LOG_PAYLOAD_PARITY)
+			return -EINVAL;
 
-			if (sh->qd_idx >= 0) {
-				disk_index = sh->qd_idx;
-				sync_page_io(log->rdev,
-					     r5l_ring_add(log, *log_offset, BLOCK_SECTORS),
-					     PAGE_SIZE, sh->dev[disk_index].page,
-					     READ, false);
-				sh->dev[disk_index].log_checksum =
-					le32_to_cpu(payload->checksum[1]);
-				set_bit(R5_Wantwrite,
-					&sh->dev[disk_index].flags);
-			}
-			ctx->meta_total_blocks += BLOCK_SECTORS * conf->max_degraded;
+		pages = le32_to_cpu(payload->size) >> (PAGE_SHIFT - 9);
+		for (i = 0; i < pages; i++) {
+			void *addr;
+			u32 checksum;
+
+			if (!sync_page_io(log->rdev, log_offset, PAGE_SIZE,
+					  page, READ, false))
+				return -EIO;
+			addr = kmap_atomic(page);
+			checksum = crc32c_le(log->uuid_checksum, addr,
+					     PAGE_SIZE);
+			kunmap_atomic(addr);
+			if (checksum != le32_to_cpu(payload->checksum[i]))
+				return -EINVAL;
+
+			log_offset = r5l_ring_add(log, log_offset,
+						  BLOCK_SECTORS);
+			ctx->meta_total_blocks += BLOCK_SECTORS;
 		}
 
-		*log_offset = r5l_ring_add(log, *log_offset,
-					   le32_to_cpu(payload->size));
-		*offset += sizeof(struct r5l_payload_data_parity) +
-			sizeof(__le32) *
-			(le32_to_cpu(payload->size) >> (PAGE_SHIFT - 9));
-		if (le16_to_cpu(payload->header.type) == R5LOG_PAYLOAD_PARITY)
-			break;
+		offset += sizeof(struct r5l_payload_data_parity) +
+			sizeof(__le32) * pages;
 	}
+	return 0;
+}
 
-	for (disk_index = 0; disk_index < sh->disks; disk_index++) {
-		void *addr;
-		u32 checksum;
-
-		if (!test_bit(R5_Wantwrite, &sh->dev[disk_index].flags))
-			continue;
-		addr = kmap_atomic(sh->dev[disk_index].page);
-		checksum = crc32c_le(log->uuid_checksum, addr, PAGE_SIZE);
-		kunmap_atomic(addr);
-		if (checksum != sh->dev[disk_index].log_checksum)
-			goto error;
+static struct stripe_head *
+r5c_recovery_get_stripe(struct r5conf *conf, struct r5l_recovery_ctx *ctx,
+			sector_t stripe_sect)
+{
+	struct stripe_head *sh;
+	int new_size;
+
+	list_for_each_entry(sh, &ctx->cached_list, lru)
+		if (sh->sector == stripe_sect)
+			return sh;
+
+	/* all stripes held by recovery: grow the stripe cache */
+	while (!(sh = raid5_get_active_stripe(conf, stripe_sect, 0, 1, 0))) {
+		new_size = conf->min_nr_stripes * 2;
+		pr_debug("md/raid:%s: Increasing stripe cache size to %d for recovery.\n",
+			 mdname(conf->mddev), new_size);
+		if (raid5_set_cache_size(conf->mddev, new_size)) {
+			pr_err("md/raid:%s: Cannot increase cache size, ret=%d, new_size=%d, min_nr_stripes=%d, max_nr_stripes=%d\n",
+			       mdname(conf->mddev), -ENOMEM, new_size,
+			       conf->min_nr_stripes, conf->max_nr_stripes);
+			return NULL;
+		}
 	}
 
-	for (disk_index = 0; disk_index < sh->disks; disk_index++) {
-		struct md_rdev *rdev, *rrdev;
+	list_add_tail(&sh->lru, &ctx->cached_list);
+	return sh;
+}
 
+/* write data and parity of a stripe to the raid disks */
+static void r5c_recovery_replay_stripe(struct r5conf *conf,
+				       struct stripe_head *sh)
+{
+	struct md_rdev *rdev, *rrdev;
+	int disk_index;
+
+	for (disk_index = 0; disk_index < sh->disks; disk_index++) {
 		if (!test_and_clear_bit(R5_Wantwrite,
 					&sh->dev[disk_index].flags))
 			continue;
@@ -930,62 +1610,120 @@ static int r5l_recovery_flush_one_stripe(struct r5l_log *log,
 		/* in case device is broken */
 		rdev = rcu_dereference(conf->disks[disk_index].rdev);
 		if (rdev)
-			sync_page_io(rdev, stripe_sect, PAGE_SIZE,
+			sync_page_io(rdev, sh->sector, PAGE_SIZE,
 				     sh->dev[disk_index].page, WRITE, false);
 		rrdev = rcu_dereference(conf->disks[disk_index].replacement);
 		if (rrdev)
-			sync_page_io(rrdev, stripe_sect, PAGE_SIZE,
+			sync_page_io(rrdev, sh->sector, PAGE_SIZE,
 				     sh->dev[disk_index].page, WRITE, false);
 	}
-	raid5_release_stripe(sh);
-	return 0;
-
-error:
-	for (disk_index = 0; disk_index < sh->disks; disk_index++)
-		sh->dev[disk_index].flags = 0;
-	raid5_release_stripe(sh);
-	return -EINVAL;
 }
 
-static int r5l_recovery_flush_one_meta(struct r5l_log *log,
-				       struct r5l_recovery_ctx *ctx)
+/*
+ * Load the payload of a meta block into the stripes.  Data stays in the
+ * stripe until its parity shows up; then the stripe is on the log in full
+ * and is replayed to the raid disks.  Stripes left on ctx->cached_list at
+ * the end of the log only have data in the journal.
+ */
+static int r5c_recovery_analyze_meta_block(struct r5l_log *log,
+					   struct r5l_recovery_ctx *ctx)
 {
 	struct r5conf *conf = log->rdev->mddev->private;
+	struct r5l_meta_block *mb = page_address(ctx->meta_page);
 	struct r5l_payload_data_parity *payload;
-	struct r5l_meta_block *mb;
-	int offset;
-	sector_t log_offset;
-	sector_t stripe_sector;
-
-	mb = page_address(ctx->meta_page);
-	offset = sizeof(struct r5l_meta_block);
-	log_offset = r5l_ring_add(log, ctx->pos, BLOCK_SECTORS);
+	struct stripe_head *sh;
+	sector_t log_offset = r5l_ring_add(log, ctx->pos, BLOCK_SECTORS);
+	sector_t stripe_sect;
+	int offset = sizeof(struct r5l_meta_block);
+	int dd;
 
 	while (offset < le32_to_cpu(mb->meta_size)) {
-		int dd;
-
 		payload = (void *)mb + offset;
-		stripe_sector = raid5_compute_sector(conf,
-						     le64_to_cpu(payload->location), 0, &dd, NULL);
-		if (r5l_recovery_flush_one_stripe(log, ctx, stripe_sector,
-						  &offset, &log_offset))
-			return -EINVAL;
+
+		if (le16_to_cpu(payload->header.type) == R5LOG_PAYLOAD_DATA)
+			stripe_sect = raid5_compute_sector(conf,
+					le64_to_cpu(payload->location), 0,
+					&dd, NULL);
+		else
+			stripe_sect = le64_to_cpu(payload->location);
+
+		sh = r5c_recovery_get_stripe(conf, ctx, stripe_sect);
+		if (!sh)
+			return -ENOMEM;
+
+		if (le16_to_cpu(payload->header.type) == R5LOG_PAYLOAD_DATA) {
+			sync_page_io(log->rdev, log_offset, PAGE_SIZE,
+				     sh->dev[dd].page, READ, false);
+			set_bit(R5_Wantwrite, &sh->dev[dd].flags);
+		} else {
+			sync_page_io(log->rdev, log_offset, PAGE_SIZE,
+				     sh->dev[sh->pd_idx].page, READ, false);
+			set_bit(R5_Wantwrite, &sh->dev[sh->pd_idx].flags);
+			if (sh->qd_idx >= 0) {
+				sync_page_io(log->rdev,
+					     r5l_ring_add(log, log_offset,
+							  BLOCK_SECTORS),
+					     PAGE_SIZE,
+					     sh->dev[sh->qd_idx].page,
+					     READ, false);
+				set_bit(R5_Wantwrite,
+					&sh->dev[sh->qd_idx].flags);
+			}
+
+			r5c_recovery_replay_stripe(conf, sh);
+			list_del_init(&sh->lru);
+			raid5_release_stripe(sh);
+		}
+
+		log_offset = r5l_ring_add(log, log_offset,
+					  le32_to_cpu(payload->size));
+		offset += sizeof(struct r5l_payload_data_parity) +
+			sizeof(__le32) *
+			(le32_to_cpu(payload->size) >> (PAGE_SHIFT - 9));
 	}
 	return 0;
 }
 
-/* copy data/parity from log to raid disks */
-static void r5l_recovery_flush_log(struct r5l_log *log,
-				   struct r5l_recovery_ctx *ctx)
+/* copy data/parity from log to raid disks, collect data-only stripes */
+static int r5l_recovery_flush_log(struct r5l_log *log,
+				  struct r5l_recovery_ctx *ctx)
 {
+	struct page *page;
+	int ret = 0;
+
+	page = alloc_page(GFP_KERNEL);
+	if (!page)
+		return -ENOMEM;
+
 	while (1) {
 		if (r5l_read_meta_block(log, ctx))
-			return;
-		if (r5l_recovery_flush_one_meta(log, ctx))
-			return;
+			break;
+		if (r5l_recovery_verify_data_checksums(log, ctx, page))
+			break;
+		ret = r5c_recovery_analyze_meta_block(log, ctx);
+		if (ret)
+			break;
 		ctx->seq++;
 		ctx->pos = r5l_ring_add(log, ctx->pos, ctx->meta_total_blocks);
 	}
+
+	__free_page(page);
+	return ret;
+}
+
+static void r5l_recovery_create_empty_meta_block(struct r5l_log *log,
+						 struct page *page,
+						 sector_t pos, u64 seq)
+{
+	struct r5l_meta_block *mb;
+
+	mb = page_address(page);
+	clear_page(mb);
+	mb->magic = cpu_to_le32(R5LOG_MAGIC);
+	mb->version = R5LOG_VERSION;
+	mb->meta_size = cpu_to_le32(sizeof(struct r5l_meta_block));
+	mb->seq = cpu_to_le64(seq);
+	mb->position = cpu_to_le64(pos);
 }
 
 static int r5l_log_write_empty_meta_block(struct r5l_log *log, sector_t pos,
@@ -995,15 +1733,11 @@ static int r5l_log_write_empty_meta_block(struct r5l_log *log, sector_t pos,
 	struct r5l_meta_block *mb;
 	u32 crc;
 
-	page = alloc_page(GFP_KERNEL | __GFP_ZERO);
+	page = alloc_page(GFP_KERNEL);
 	if (!page)
 		return -ENOMEM;
+	r5l_recovery_create_empty_meta_block(log, page, pos, seq);
 	mb = page_address(page);
-	mb->magic = cpu_to_le32(R5LOG_MAGIC);
-	mb->version = R5LOG_VERSION;
-	mb->meta_size = cpu_to_le32(sizeof(struct r5l_meta_block));
-	mb->seq = cpu_to_le64(seq);
-	mb->position = cpu_to_le64(pos);
 	crc = crc32c_le(log->uuid_checksum, mb, PAGE_SIZE);
 	mb->checksum = cpu_to_le32(crc);
 
@@ -1015,18 +1749,110 @@ static int r5l_log_write_empty_meta_block(struct r5l_log *log, sector_t pos,
 	return 0;
 }
 
+/*
+ * The data of the stripes on ctx->cached_list is only in the journal.  Log
+ * it again from ctx->pos on, so the log tail can move past everything
+ * recovery has replayed.
+ */
+static int r5c_recovery_rewrite_data_only_stripes(struct r5l_log *log,
+						  struct r5l_recovery_ctx *ctx)
+{
+	struct stripe_head *sh;
+	struct page *page;
+	sector_t needed = 0;
+	int i;
+
+	list_for_each_entry(sh, &ctx->cached_list, lru) {
+		needed += BLOCK_SECTORS;
+		for (i = sh->disks; i--; )
+			if (test_bit(R5_Wantwrite, &sh->dev[i].flags))
+				needed += BLOCK_SECTORS;
+	}
+	/* don't overwrite the old entries before the superblock moves */
+	if (needed >= log->device_size -
+	    r5l_ring_distance(log, log->last_checkpoint, ctx->pos)) {
+		pr_err("md/raid:%s: not enough journal space to rewrite cached data\n",
+		       mdname(log->rdev->mddev));
+		return -ENOSPC;
+	}
+
+	page = alloc_page(GFP_KERNEL);
+	if (!page)
+		return -ENOMEM;
+
+	list_for_each_entry(sh, &ctx->cached_list, lru) {
+		struct r5l_meta_block *mb;
+		sector_t write_pos;
+		int offset;
+
+		r5l_recovery_create_empty_meta_block(log, page, ctx->pos,
+						     ctx->seq);
+		mb = page_address(page);
+		offset = le32_to_cpu(mb->meta_size);
+		write_pos = r5l_ring_add(log, ctx->pos, BLOCK_SECTORS);
+
+		for (i = sh->disks; i--; ) {
+			struct r5dev *dev = &sh->dev[i];
+			struct r5l_payload_data_parity *payload;
+			void *addr;
+
+			if (!test_bit(R5_Wantwrite, &dev->flags))
+				continue;
+
+			payload = (void *)mb + offset;
+			payload->header.type = cpu_to_le16(R5LOG_PAYLOAD_DATA);
+			payload->size = cpu_to_le32(BLOCK_SECTORS);
+			payload->location = cpu_to_le64(
+				raid5_compute_blocknr(sh, i, 0));
+			addr = kmap_atomic(dev->page);
+			payload->checksum[0] = cpu_to_le32(
+				crc32c_le(log->uuid_checksum, addr,
+					  PAGE_SIZE));
+			kunmap_atomic(addr);
+			if (!sync_page_io(log->rdev, write_pos, PAGE_SIZE,
+					  dev->page, WRITE, false))
+				goto ioerr;
+			write_pos = r5l_ring_add(log, write_pos,
+						 BLOCK_SECTORS);
+			offset += sizeof(__le32) +
+				sizeof(struct r5l_payload_data_parity);
+		}
+		mb->meta_size = cpu_to_le32(offset);
+		mb->checksum = cpu_to_le32(crc32c_le(log->uuid_checksum,
+						     mb, PAGE_SIZE));
+		if (!sync_page_io(log->rdev, ctx->pos, PAGE_SIZE, page,
+				  WRITE_FLUSH_FUA, false))
+			goto ioerr;
+
+		sh->log_start = ctx->pos;
+		ctx->pos = write_pos;
+		ctx->seq++;
+	}
+	__free_page(page);
+	return 0;
+ioerr:
+	__free_page(page);
+	return -EIO;
+}
+
 static int r5l_recovery_log(struct r5l_log *log)
 {
 	struct r5l_recovery_ctx ctx;
+	struct stripe_head *sh, *next;
+	sector_t pos;
+	int ret;
 
 	ctx.pos = log->last_checkpoint;
 	ctx.seq = log->last_cp_seq;
+	INIT_LIST_HEAD(&ctx.cached_list);
 	ctx.meta_page = alloc_page(GFP_KERNEL);
 	if (!ctx.meta_page)
 		return -ENOMEM;
 
-	r5l_recovery_flush_log(log, &ctx);
+	ret = r5l_recovery_flush_log(log, &ctx);
 	__free_page(ctx.meta_page);
+	if (ret)
+		goto error;
 
 	/*
 	 * we did a recovery. Now ctx.pos points to an invalid meta block. New
@@ -1038,23 +1864,69 @@ static int r5l_recovery_log(struct r5l_log *log)
 	 * happens again, new recovery will start from meta 1. Since meta 2n is
 	 * valid now, recovery will think meta 3 is valid, which is wrong.
 	 * The solution is we create a new meta in meta2 with its seq == meta
-	 * 1's seq + 10 and let superblock points to meta2. The same recovery will
-	 * not think meta 3 is a valid meta, because its seq doesn't match
+	 * 1's seq + 10000 and let superblock points to meta2. The same recovery
+	 * will not think meta 3 is a valid meta, because its seq doesn't match.
+	 * Stripes whose data is only in the journal are logged again from
+	 * meta2 on instead, with the same jump in seq.
 	 */
-	if (ctx.seq > log->last_cp_seq + 1) {
-		int ret;
+	if (ctx.seq > log->last_cp_seq + 1 || !list_empty(&ctx.cached_list)) {
+		pos = ctx.pos;
+		ctx.seq += 10000;
+
+		if (list_empty(&ctx.cached_list)) {
+			ret = r5l_log_write_empty_meta_block(log, ctx.pos,
+							     ctx.seq);
+			if (ret)
+				goto error;
+			ctx.pos = r5l_ring_add(log, ctx.pos, BLOCK_SECTORS);
+			ctx.seq++;
+		} else {
+			ret = r5c_recovery_rewrite_data_only_stripes(log,
+								     &ctx);
+			if (ret)
+				goto error;
+		}
 
-		ret = r5l_log_write_empty_meta_block(log, ctx.pos, ctx.seq + 10);
-		if (ret)
-			return ret;
-		log->seq = ctx.seq + 11;
-		log->log_start = r5l_ring_add(log, ctx.pos, BLOCK_SECTORS);
-		r5l_write_super(log, ctx.pos);
+		log->log_start = ctx.pos;
+		log->seq = ctx.seq;
+		log->last_checkpoint = pos;
+		log->next_checkpoint = pos;
+		r5l_write_super(log, pos);
 	} else {
 		log->log_start = ctx.pos;
 		log->seq = ctx.seq;
+		log->next_checkpoint = log->last_checkpoint;
+	}
+
+	/*
+	 * The data-only stripes keep their reference, r5l_init_log() writes
+	 * them out once the log is up.
+	 */
+	list_for_each_entry_safe(sh, next, &ctx.cached_list, lru) {
+		int i;
+
+		for (i = sh->disks; i--; )
+			if (test_and_clear_bit(R5_Wantwrite,
+					       &sh->dev[i].flags)) {
+				set_bit(R5_InJournal, &sh->dev[i].flags);
+				set_bit(R5_UPTODATE, &sh->dev[i].flags);
+			}
+		list_del_init(&sh->lru);
+		list_add_tail(&sh->r5c, &log->stripe_in_journal_list);
+		atomic_inc(&log->stripe_in_journal_count);
 	}
 	return 0;
+
+error:
+	list_for_each_entry_safe(sh, next, &ctx.cached_list, lru) {
+		int i;
+
+		for (i = sh->disks; i--; )
+			sh->dev[i].flags = 0;
+		list_del_init(&sh->lru);
+		raid5_release_stripe(sh);
+	}
+	return ret;
 }
 
 static void r5l_write_super(struct r5l_log *log, sector_t cp)
@@ -1134,6 +2006,7 @@ ioerr:
 int r5l_init_log(struct r5conf *conf, struct md_rdev *rdev)
 {
 	struct r5l_log *log;
+	struct stripe_head *sh;
 
 	if (PAGE_SIZE != 4096)
 		return -EINVAL;
@@ -1164,15 +2037,34 @@ int r5l_init_log(struct r5conf *conf, struct md_rdev *rdev)
 						 log->rdev->mddev, "reclaim");
 	if (!log->reclaim_thread)
 		goto reclaim_thread;
+	log->reclaim_thread->timeout = R5C_RECLAIM_WAKEUP_INTERVAL;
+
 	init_waitqueue_head(&log->iounit_wait);
 
 	INIT_LIST_HEAD(&log->no_space_stripes);
 	spin_lock_init(&log->no_space_stripes_lock);
 
+	INIT_WORK(&log->disable_writeback_work, r5c_disable_writeback_work);
+
+	log->r5c_journal_mode = R5C_JOURNAL_MODE_WRITE_THROUGH;
+	INIT_LIST_HEAD(&log->stripe_in_journal_list);
+	spin_lock_init(&log->stripe_in_journal_lock);
+	atomic_set(&log->stripe_in_journal_count, 0);
+
 	if (r5l_load_log(log))
 		goto error;
 
 	conf->log = log;
+
+	/* write out the data recovery found only in the journal */
+	spin_lock_irq(&log->stripe_in_journal_lock);
+	list_for_each_entry(sh, &log->stripe_in_journal_list, r5c) {
+		set_bit(STRIPE_HANDLE, &sh->state);
+		if (!test_and_set_bit(STRIPE_PREREAD_ACTIVE, &sh->state))
+			atomic_inc(&conf->preread_active_stripes);
+		raid5_release_stripe(sh);
+	}
+	spin_unlock_irq(&log->stripe_in_journal_lock);
 	return 0;
 error:
 	md_unregister_thread(&log->reclaim_thread);
@@ -1185,6 +2077,13 @@ io_kc:
 
 void r5l_exit_log(struct r5l_log *log)
 {
+	struct mddev *mddev = log->rdev->mddev;
+
+	/* stop a pending switch to write-through from waiting on the array */
+	log->r5c_journal_mode = R5C_JOURNAL_MODE_WRITE_THROUGH;
+	wake_up(&mddev->sb_wait);
+	flush_work(&log->disable_writeback_work);
+
 	md_unregister_thread(&log->reclaim_thread);
 	kmem_cache_destroy(log->io_kc);
 	kfree(log);
@@ -46,6 +46,7 @@
 #include <linux/blkdev.h>
 #include <linux/kthread.h>
 #include <linux/raid/pq.h>
+#include <linux/raid/xor.h>
 #include <linux/async_tx.h>
 #include <linux/module.h>
 #include <linux/async.h>
@@ -135,55 +136,6 @@ static inline void unlock_all_device_hash_locks_irq(struct r5conf *conf)
  * This function is used to determine the 'next' bio in the list, given the sector
  * of the current stripe+device
  */
-static inline struct bio *r5_next_bio(struct bio *bio, sector_t sector)
-{
-	int sectors = bio_sectors(bio);
-	if (bio->bi_iter.bi_sector + sectors < sector + STRIPE_SECTORS)
-		return bio->bi_next;
-	else
-		return NULL;
-}
-
-/*
- * We maintain a biased count of active stripes in the bottom 16 bits of
- * bi_phys_segments, and a count of processed stripes in the upper 16 bits
- */
-static inline int raid5_bi_processed_stripes(struct bio *bio)
-{
-	atomic_t *segments = (atomic_t *)&bio->bi_phys_segments;
-	return (atomic_read(segments) >> 16) & 0xffff;
-}
-
-static inline int raid5_dec_bi_active_stripes(struct bio *bio)
-{
-	atomic_t *segments = (atomic_t *)&bio->bi_phys_segments;
-	return atomic_sub_return(1, segments) & 0xffff;
-}
-
-static inline void raid5_inc_bi_active_stripes(struct bio *bio)
-{
-	atomic_t *segments = (atomic_t *)&bio->bi_phys_segments;
-	atomic_inc(segments);
-}
-
-static inline void raid5_set_bi_processed_stripes(struct bio *bio,
-	unsigned int cnt)
-{
-	atomic_t *segments = (atomic_t *)&bio->bi_phys_segments;
-	int old, new;
-
-	do {
-		old = atomic_read(segments);
-		new = (old & 0xffff) | (cnt << 16);
-	} while (atomic_cmpxchg(segments, old, new) != old);
-}
-
-static inline void raid5_set_bi_stripes(struct bio *bio, unsigned int cnt)
-{
-	atomic_t *segments = (atomic_t *)&bio->bi_phys_segments;
-	atomic_set(segments, cnt);
-}
-
 /* Find first data disk in a raid6 stripe */
 static inline int raid6_d0(struct stripe_head *sh)
 {
@@ -289,8 +241,27 @@ static void raid5_wakeup_stripe_thread(struct stripe_head *sh)
 static void do_release_stripe(struct r5conf *conf, struct stripe_head *sh,
 			      struct list_head *temp_inactive_list)
 {
+	int i;
+	int injournal = 0;	/* number of data pages with R5_InJournal */
+
 	BUG_ON(!list_empty(&sh->lru));
 	BUG_ON(atomic_read(&conf->active_stripes)==0);
+
+	if (r5c_is_writeback(conf->log))
+		for (i = sh->disks; i--; )
+			if (test_bit(R5_InJournal, &sh->dev[i].flags))
+				injournal++;
+	/*
+	 * When quiescing in write-back mode, stripes with data in the journal
+	 * are written out rather than parked on the cached lists
+	 */
+	if (conf->quiesce && r5c_is_writeback(conf->log) &&
+	    !test_bit(STRIPE_HANDLE, &sh->state) && injournal != 0) {
+		if (test_bit(STRIPE_R5C_CACHING, &sh->state))
+			r5c_make_stripe_write_out(sh);
+		set_bit(STRIPE_HANDLE, &sh->state);
+	}
+
 	if (test_bit(STRIPE_HANDLE, &sh->state)) {
 		if (test_bit(STRIPE_DELAYED, &sh->state) &&
 		    !test_bit(STRIPE_PREREAD_ACTIVE, &sh->state))
@@ -316,8 +287,27 @@ static void do_release_stripe(struct r5conf *conf, struct stripe_head *sh,
 			    < IO_THRESHOLD)
 				md_wakeup_thread(conf->mddev->thread);
 		atomic_dec(&conf->active_stripes);
-		if (!test_bit(STRIPE_EXPANDING, &sh->state))
+		if (test_bit(STRIPE_EXPANDING, &sh->state))
+			return;
+		if (injournal == 0) {
+			clear_bit(STRIPE_R5C_CACHING, &sh->state);
 			list_add_tail(&sh->lru, temp_inactive_list);
+		} else if (injournal == conf->raid_disks - conf->max_degraded) {
+			/* full stripe */
+			if (!test_and_set_bit(STRIPE_R5C_FULL_STRIPE, &sh->state))
+				atomic_inc(&conf->r5c_cached_full_stripes);
+			if (test_and_clear_bit(STRIPE_R5C_PARTIAL_STRIPE,
+					       &sh->state))
+				atomic_dec(&conf->r5c_cached_partial_stripes);
+			list_add_tail(&sh->lru, &conf->r5c_full_stripe_list);
+			r5c_check_cached_full_stripe(conf);
+		} else {
+			/* partial stripe */
+			if (!test_and_set_bit(STRIPE_R5C_PARTIAL_STRIPE,
+					      &sh->state))
+				atomic_inc(&conf->r5c_cached_partial_stripes);
+			list_add_tail(&sh->lru, &conf->r5c_partial_stripe_list);
+		}
 	}
 }
 
@@ -677,6 +667,8 @@ raid5_get_active_stripe(struct r5conf *conf, sector_t sector,
 					set_bit(R5_ALLOC_MORE,
 						&conf->cache_state);
 			}
+			if (!sh)
+				r5c_check_stripe_cache_usage(conf);
 			if (noblock && sh == NULL)
 				break;
 			if (!sh) {
@@ -890,8 +882,15 @@ static void ops_run_io(struct stripe_head *sh, struct stripe_head_state *s)
 
 	might_sleep();
 
-	if (r5l_write_stripe(conf->log, sh) == 0)
+	if (!test_bit(STRIPE_R5C_CACHING, &sh->state)) {
+		/* writing out phase */
+		if (r5l_write_stripe(conf->log, sh) == 0)
+			return;
+	} else if (test_bit(STRIPE_LOG_TRAPPED, &sh->state)) {
+		/* caching phase: data only goes to the journal */
+		r5c_cache_data(conf->log, sh, s);
 		return;
+	}
 	for (i = disks; i--; ) {
 		int rw;
 		int replace_only = 0;
@@ -1147,7 +1146,8 @@ async_copy_data(int frombio, struct bio *bio, struct page **page,
 			if (frombio) {
 				if (sh->raid_conf->skip_copy &&
 				    b_offset == 0 && page_offset == 0 &&
-				    clen == STRIPE_SIZE)
+				    clen == STRIPE_SIZE &&
+				    !test_bit(STRIPE_R5C_CACHING, &sh->state))
 					*page = bio_page;
 				else
 					tx = async_memcpy(*page, bio_page, page_offset,
@@ -1951,6 +1951,12 @@ static void raid_run_ops(struct stripe_head *sh, unsigned long ops_request)
 	if (test_bit(STRIPE_OP_BIODRAIN, &ops_request)) {
 		tx = ops_run_biodrain(sh, tx);
 		overlap_clear++;
+		/*
+		 * the write-back cache drains data without computing parity,
+		 * and the journal write must see the copied data
+		 */
+		if (tx && !test_bit(STRIPE_OP_RECONSTRUCT, &ops_request))
+			async_tx_quiesce(&tx);
 	}
 
 	if (test_bit(STRIPE_OP_RECONSTRUCT, &ops_request)) {
@@ -1990,7 +1996,9 @@ static struct stripe_head *alloc_stripe(struct kmem_cache *sc, gfp_t gfp)
 		spin_lock_init(&sh->batch_lock);
 		INIT_LIST_HEAD(&sh->batch_list);
 		INIT_LIST_HEAD(&sh->lru);
+		INIT_LIST_HEAD(&sh->r5c);
 		atomic_set(&sh->count, 1);
+		sh->log_start = MaxSector;
 	}
 	return sh;
 }
@@ -2525,6 +2533,8 @@ static void error(struct mddev *mddev, struct md_rdev *rdev)
 	       bdevname(rdev->bdev, b),
 	       mdname(mddev),
 	       conf->raid_disks - mddev->degraded);
+	if (mddev->degraded)
+		r5c_disable_writeback_async(conf->log);
 }
 
 /*
@@ -2871,6 +2881,12 @@ schedule_reconstruction(struct stripe_head *sh, struct stripe_head_state *s,
 				set_bit(R5_Wantdrain, &dev->flags);
 				if (!expand)
 					clear_bit(R5_UPTODATE, &dev->flags);
+				/* the new data will be journaled with parity */
+				clear_bit(R5_InJournal, &dev->flags);
+				s->locked++;
+			} else if (test_bit(R5_InJournal, &dev->flags)) {
+				/* cached data, write it out with the parity */
+				set_bit(R5_LOCKED, &dev->flags);
 				s->locked++;
 			}
 		}
@@ -3566,10 +3582,13 @@ static void handle_stripe_dirtying(struct r5conf *conf,
 	 * In this case, we need to always do reconstruct-write, to ensure
 	 * that in case of drive failure or read-error correction, we
 	 * generate correct data from the parity.
+	 * Stripes written out from the write-back journal cache also use
+	 * reconstruct-write: the old data of the cached blocks is gone.
 	 */
 	if (conf->rmw_level == PARITY_DISABLE_RMW ||
 	    (recovery_cp < MaxSector && sh->sector >= recovery_cp &&
-	     s->failed == 0)) {
+	     s->failed == 0) ||
+	    s->injournal > 0) {
 		/* Calculate the real rcw later - for now make it
 		 * look like rcw is cheaper
 		 */
@@ -4066,6 +4085,11 @@ static void analyse_stripe(struct stripe_head *sh, struct stripe_head_state *s)
 		}
 		if (dev->written)
 			s->written++;
+		if (test_bit(R5_InJournal, &dev->flags)) {
+			s->injournal++;
+			if (dev->written)
+				s->just_cached++;
+		}
 		/* Prefer to use the replacement for reads, but only
 		 * if it is recovered enough and has no bad blocks.
 		 */
@@ -4288,6 +4312,136 @@ static void break_stripe_batch_list(struct stripe_head *head_sh,
 		wake_up(&head_sh->raid_conf->wait_for_overlap);
 }
 
+/*
+ * A stripe written out of the write-back journal cache holds new data in its
+ * R5_InJournal blocks while the member disks still hold the old data and the
+ * old parity.  Failed data blocks that are not in the journal can't be
+ * computed from the stripe cache, so rebuild them from the survivors read back
+ * from disk.  This is slow, but only cached stripes of a degraded array get
+ * here.
+ */
+static void r5c_rebuild_failed_blocks(struct r5conf *conf,
+				      struct stripe_head *sh,
+				      struct stripe_head_state *s)
+{
+	int disks = sh->disks, pd_idx = sh->pd_idx, qd_idx = sh->qd_idx;
+	int syndrome_disks = sh->ddf_layout ? disks : disks - 2;
+	int d0_idx = raid6_d0(sh);
+	int target[2], nr_target = 0;
+	int faila = -1, failb = -1;
+	int count, slot, i;
+	bool p_failed = false;
+	struct page **pages;
+	void **ptrs;
+
+	for (i = 0; i < s->failed; i++) {
+		int idx = s->failed_num[i];
+
+		if (idx == pd_idx)
+			p_failed = true;
+		else if (idx != qd_idx &&
+			 !test_bit(R5_UPTODATE, &sh->dev[idx].flags))
+			target[nr_target++] = idx;
+	}
+	if (!nr_target)
+		return;
+
+	pages = kcalloc(disks, sizeof(*pages), GFP_NOIO);
+	ptrs = kcalloc(syndrome_disks + 2, sizeof(*ptrs), GFP_NOIO);
+	if (!pages || !ptrs)
+		goto out;
+
+	for (i = 0; i < disks; i++) {
+		struct md_rdev *rdev;
+		bool ok = false;
+
+		pages[i] = alloc_page(GFP_NOIO);
+		if (!pages[i])
+			goto out;
+		if (i == s->failed_num[0] || i == s->failed_num[1])
+			continue;
+
+		rcu_read_lock();
+		rdev = rcu_dereference(conf->disks[i].rdev);
+		if (rdev)
+			atomic_inc(&rdev->nr_pending);
+		rcu_read_unlock();
+		if (rdev) {
+			ok = sync_page_io(rdev, sh->sector, STRIPE_SIZE,
+					  pages[i], READ, false);
+			if (!ok)
+				md_error(conf->mddev, rdev);
+			rdev_dec_pending(rdev, conf->mddev);
+		}
+		if (!ok)
+			goto out;
+	}
+
+	if (nr_target == 1 && !p_failed) {
+		/* P is the xor of the data blocks in every layout */
+		void *dest = page_address(pages[target[0]]);
+
+		memcpy(dest, page_address(pages[pd_idx]), STRIPE_SIZE);
+		count = 0;
+		for (i = 0; i < disks; i++) {
+			if (i == pd_idx || i == qd_idx || i == target[0])
+				continue;
+			ptrs[count++] = page_address(pages[i]);
+			if (count == MAX_XOR_BLOCKS) {
+				xor_blocks(count, STRIPE_SIZE, dest, ptrs);
+				count = 0;
+			}
+		}
+		if (count)
+			xor_blocks(count, STRIPE_SIZE, dest, ptrs);
+	} else {
+		for (slot = 0; slot < syndrome_disks + 2; slot++)
+			ptrs[slot] = (void *)raid6_empty_zero_page;
+		count = 0;
+		i = d0_idx;
+		do {
+			slot = raid6_idx_to_slot(i, sh, &count, syndrome_disks);
+			ptrs[slot] = page_address(pages[i]);
+			if (i == target[0] || (nr_target == 2 && i == target[1])) {
+				if (faila < 0)
+					faila = slot;
+				else
+					failb = slot;
+			}
+			i = raid6_next_disk(i, disks);
+		} while (i != d0_idx);
+
+		if (nr_target == 2) {
+			if (faila > failb)
+				swap(faila, failb);
+			raid6_2data_recov(syndrome_disks + 2, STRIPE_SIZE,
+					  faila, failb, ptrs);
+		} else
+			raid6_datap_recov(syndrome_disks + 2, STRIPE_SIZE,
+					  faila, ptrs);
+	}
+
+	for (i = 0; i < nr_target; i++) {
+		struct r5dev *dev = &sh->dev[target[i]];
+
+		memcpy(page_address(dev->page),
+		       page_address(pages[target[i]]), STRIPE_SIZE);
+		set_bit(R5_UPTODATE, &dev->flags);
+		s->uptodate++;
+	}
+	nr_target = 0;
+out:
+	/* try again later if the blocks couldn't be rebuilt */
+	if (nr_target)
+		set_bit(STRIPE_HANDLE, &sh->state);
+	if (pages)
+		for (i = 0; i < disks; i++)
+			if (pages[i])
+				__free_page(pages[i]);
+	kfree(pages);
+	kfree(ptrs);
+}
+
 static void handle_stripe(struct stripe_head *sh)
 {
 	struct stripe_head_state s;
@@ -4315,8 +4469,13 @@ static void handle_stripe(struct stripe_head *sh)
 
 	if (test_bit(STRIPE_SYNC_REQUESTED, &sh->state) && !sh->batch_head) {
 		spin_lock(&sh->stripe_lock);
-		/* Cannot process 'sync' concurrently with 'discard' */
+		/*
+		 * Cannot process 'sync' concurrently with 'discard', and data
+		 * in the journal has to reach the raid disks first
+		 */
 		if (!test_bit(STRIPE_DISCARD, &sh->state) &&
+		    !test_bit(STRIPE_R5C_CACHING, &sh->state) &&
+		    sh->log_start == MaxSector &&
 		    test_and_clear_bit(STRIPE_SYNC_REQUESTED, &sh->state)) {
 			set_bit(STRIPE_SYNCING, &sh->state);
 			clear_bit(STRIPE_INSYNC, &sh->state);
@@ -4337,6 +4496,17 @@ static void handle_stripe(struct stripe_head *sh)
 	if (test_bit(STRIPE_LOG_TRAPPED, &sh->state))
 		goto finish;
 
+	/*
+	 * Stop caching if the stripe can no longer be written out of the
+	 * journal cache later, or if a sync is waiting for it.
+	 */
+	if (test_bit(STRIPE_R5C_CACHING, &sh->state) &&
+	    (s.failed || s.log_failed ||
+	     test_bit(STRIPE_SYNC_REQUESTED, &sh->state))) {
+		r5c_make_stripe_write_out(sh);
+		set_bit(STRIPE_HANDLE, &sh->state);
+	}
+
 	if (s.handle_bad_blocks) {
 		set_bit(STRIPE_HANDLE, &sh->state);
 		goto finish;
@@ -4365,7 +4535,8 @@ static void handle_stripe(struct stripe_head *sh)
 	/* check if the array has lost more than max_degraded devices and,
 	 * if so, some requests might need to be failed.
 	 */
-	if (s.failed > conf->max_degraded || s.log_failed) {
+	if (s.failed > conf->max_degraded ||
+	    (s.log_failed && s.injournal == 0)) {
 		sh->check_state = 0;
 		sh->reconstruct_state = 0;
 		break_stripe_batch_list(sh, 0);
@@ -4373,6 +4544,11 @@ static void handle_stripe(struct stripe_head *sh)
 			handle_failed_stripe(conf, sh, &s, disks, &s.return_bi);
 		if (s.syncing + s.replacing)
 			handle_failed_sync(conf, sh, &s);
+		if (s.injournal) {
+			/* nothing in the journal can reach the array any more */
+			set_bit(R5_InJournal, &sh->dev[sh->pd_idx].flags);
+			r5c_finish_stripe_write_out(conf, sh, &s);
+		}
 	}
 
 	/* Now we check to see if any write operations have recently
@@ -4397,7 +4573,8 @@ static void handle_stripe(struct stripe_head *sh)
 			struct r5dev *dev = &sh->dev[i];
 			if (test_bit(R5_LOCKED, &dev->flags) &&
 				(i == sh->pd_idx || i == sh->qd_idx ||
-				 dev->written)) {
+				 dev->written ||
+				 test_bit(R5_InJournal, &dev->flags))) {
 				pr_debug("Writing block %d\n", i);
 				set_bit(R5_Wantwrite, &dev->flags);
 				if (prexor)
@@ -4426,7 +4603,7 @@ static void handle_stripe(struct stripe_head *sh)
 		|| (s.failed >= 2 && s.failed_num[1] == sh->qd_idx)
 		|| conf->level < 6;
 
-	if (s.written &&
+	if ((s.written || test_bit(R5_InJournal, &pdev->flags)) &&
 	    (s.p_failed || ((test_bit(R5_Insync, &pdev->flags)
 			     && !test_bit(R5_LOCKED, &pdev->flags)
 			     && (test_bit(R5_UPTODATE, &pdev->flags) ||
@@ -4434,8 +4611,25 @@ static void handle_stripe(struct stripe_head *sh)
 	    (s.q_failed || ((test_bit(R5_Insync, &qdev->flags)
 			     && !test_bit(R5_LOCKED, &qdev->flags)
 			     && (test_bit(R5_UPTODATE, &qdev->flags) ||
-				 test_bit(R5_Discard, &qdev->flags))))))
+				 test_bit(R5_Discard, &qdev->flags)))))) {
 		handle_stripe_clean_event(conf, sh, disks, &s.return_bi);
+		r5c_finish_stripe_write_out(conf, sh, &s);
+	}
+
+	/* return the writes which have just been committed to the journal */
+	if (s.just_cached)
+		r5c_handle_cached_data_endio(conf, sh, disks, &s.return_bi);
+
+	/*
+	 * Cached blocks are written out with the parity computed from them,
+	 * so failed blocks that are not in the journal must be rebuilt from
+	 * the old contents of the array before anything else uses them.
+	 */
+	if (s.injournal && s.failed && s.failed <= conf->max_degraded &&
+	    !test_bit(STRIPE_R5C_CACHING, &sh->state) &&
+	    !test_bit(R5_InJournal, &pdev->flags) &&
+	    s.locked == 0 && !sh->reconstruct_state && !sh->check_state)
+		r5c_rebuild_failed_blocks(conf, sh, &s);
 
 	/* Now we might consider reading some blocks, either to check/generate
 	 * parity, or to satisfy requests
@@ -4454,8 +4648,21 @@ static void handle_stripe(struct stripe_head *sh)
 	 * 2/ A 'check' operation is in flight, as it may clobber the parity
 	 *    block.
 	 */
-	if (s.to_write && !sh->reconstruct_state && !sh->check_state)
-		handle_stripe_dirtying(conf, sh, &s, disks);
+	if (!sh->reconstruct_state && !sh->check_state) {
+		int ret = -EAGAIN;
+
+		if (s.to_write && r5c_is_writeback(conf->log))
+			ret = r5c_try_caching_write(conf, sh, &s, disks);
+		/*
+		 * Write the stripe normally if it can't be cached, or if it
+		 * is being written out of the journal cache.
+		 */
+		if ((s.to_write && ret == -EAGAIN) ||
+		    (s.injournal > 0 &&
+		     !test_bit(STRIPE_R5C_CACHING, &sh->state) &&
+		     !test_bit(R5_InJournal, &pdev->flags)))
+			handle_stripe_dirtying(conf, sh, &s, disks);
+	}
 
 	/* maybe we need to check and possibly fix the parity for this stripe
 	 * Any reads will already have been scheduled, so we just see if enough
@@ -5170,8 +5377,11 @@ static void make_request(struct mddev *mddev, struct bio * bi)
 	 * If array is degraded, better not do chunk aligned read because
 	 * later we might have to read it again in order to reconstruct
 	 * data on failed drives.
+	 * The write-back journal cache may hold newer data than the raid
+	 * disks, so reads have to go through the stripe cache then.
 	 */
 	if (rw == READ && mddev->degraded == 0 &&
+	    !r5c_is_writeback(conf->log) &&
 	    mddev->reshape_position == MaxSector) {
 		bi = chunk_aligned_read(mddev, bi);
 		if (!bi)
@@ -6220,6 +6430,7 @@ static struct attribute *raid5_attrs[] =  {
 	&raid5_group_thread_cnt.attr,
 	&raid5_skip_copy.attr,
 	&raid5_rmw_level.attr,
+	&r5c_journal_mode.attr,
 	NULL,
 };
 static struct attribute_group raid5_attrs_group = {
@@ -6519,6 +6730,10 @@ static struct r5conf *setup_conf(struct mddev *mddev)
 	INIT_LIST_HEAD(&conf->hold_list);
 	INIT_LIST_HEAD(&conf->delayed_list);
 	INIT_LIST_HEAD(&conf->bitmap_list);
+	INIT_LIST_HEAD(&conf->r5c_full_stripe_list);
+	atomic_set(&conf->r5c_cached_full_stripes, 0);
+	INIT_LIST_HEAD(&conf->r5c_partial_stripe_list);
+	atomic_set(&conf->r5c_cached_partial_stripes, 0);
 	bio_list_init(&conf->return_bi);
 	init_llist_head(&conf->released_stripes);
 	atomic_set(&conf->active_stripes, 0);
@@ -7594,6 +7809,8 @@ static void raid5_quiesce(struct mddev *mddev, int state)
 		 * active stripes can drain
 		 */
 		conf->quiesce = 2;
+		/* write out everything parked in the journal cache */
+		r5c_flush_cache(conf, INT_MAX);
 		wait_event_cmd(conf->wait_for_quiescent,
 				    atomic_read(&conf->active_stripes) == 0 &&
 				    atomic_read(&conf->active_aligned_reads) == 0,
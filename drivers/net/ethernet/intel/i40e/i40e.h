@@ -48,6 +48,7 @@
 #include <linux/ipv6.h>
 #include <net/checksum.h>
 #include <net/ip6_checksum.h>
+#include <net/net_dim.h>
 #include <linux/ethtool.h>
 #include <linux/if_vlan.h>
 #include <linux/if_bridge.h>
@@ -533,6 +534,12 @@ struct i40e_vsi {
 	struct i40e_tc_configuration tc_config;
 	struct i40e_aqc_vsi_properties_data info;
 
+	/* mqprio channels while DCB is off: groups of queue pairs of this
+	 * VSI, unsteered traffic only goes to channel 0
+	 */
+	u8 num_channels;
+	struct i40e_tc_info channel[I40E_MAX_TRAFFIC_CLASS];
+
 	/* VSI BW limit (absolute across all TCs) */
 	u16 bw_limit;		/* VSI BW Limit (0 = disabled) */
 	u8  bw_max_quanta;	/* Max Quanta when BW limit is enabled */
@@ -573,6 +580,10 @@ struct i40e_q_vector {
 	struct i40e_ring_container rx;
 	struct i40e_ring_container tx;
 
+	struct net_dim dim;	/* dynamic Rx ITR */
+	u16 dim_itr;		/* Rx ITR picked by net_dim, register units */
+	u16 event_ctr;		/* completed polls, sampled by net_dim */
+
 	u8 num_ringpairs;	/* total number of ring pairs in vector */
 
 	cpumask_t affinity_mask;
@@ -581,8 +592,93 @@ struct i40e_q_vector {
 	bool arm_wb_state;
 #define ITR_COUNTDOWN_START 100
 	u8 itr_countdown;	/* when 0 should adjust ITR */
+#ifdef CONFIG_NET_RX_BUSY_POLL
+	atomic_t state;		/* owner of the Rx rings, see below */
+#endif
 } ____cacheline_internodealigned_in_smp;
 
+#ifdef CONFIG_NET_RX_BUSY_POLL
+enum i40e_qv_state_t {
+	I40E_QV_STATE_IDLE = 0,
+	I40E_QV_STATE_NAPI,
+	I40E_QV_STATE_POLL,
+	I40E_QV_STATE_DISABLE
+};
+
+static inline void i40e_qv_init_lock(struct i40e_q_vector *q_vector)
+{
+	atomic_set(&q_vector->state, I40E_QV_STATE_IDLE);
+}
+
+/* called from the NAPI poll routine to get ownership of the Rx rings */
+static inline bool i40e_qv_lock_napi(struct i40e_q_vector *q_vector)
+{
+	return atomic_cmpxchg(&q_vector->state, I40E_QV_STATE_IDLE,
+			      I40E_QV_STATE_NAPI) == I40E_QV_STATE_IDLE;
+}
+
+static inline void i40e_qv_unlock_napi(struct i40e_q_vector *q_vector)
+{
+	WARN_ON(atomic_read(&q_vector->state) != I40E_QV_STATE_NAPI);
+
+	/* busy polling bypasses GRO, don't hold packets back from it */
+	if (q_vector->napi.gro_list)
+		napi_gro_flush(&q_vector->napi, false);
+
+	atomic_set(&q_vector->state, I40E_QV_STATE_IDLE);
+}
+
+/* called from i40e_busy_poll() */
+static inline bool i40e_qv_lock_poll(struct i40e_q_vector *q_vector)
+{
+	return atomic_cmpxchg(&q_vector->state, I40E_QV_STATE_IDLE,
+			      I40E_QV_STATE_POLL) == I40E_QV_STATE_IDLE;
+}
+
+static inline void i40e_qv_unlock_poll(struct i40e_q_vector *q_vector)
+{
+	WARN_ON(atomic_read(&q_vector->state) != I40E_QV_STATE_POLL);
+
+	atomic_set(&q_vector->state, I40E_QV_STATE_IDLE);
+}
+
+/* true if a socket is polling the Rx rings right now */
+static inline bool i40e_qv_busy_polling(struct i40e_q_vector *q_vector)
+{
+	return atomic_read(&q_vector->state) == I40E_QV_STATE_POLL;
+}
+
+/* false if the q_vector is currently owned */
+static inline bool i40e_qv_disable(struct i40e_q_vector *q_vector)
+{
+	return atomic_cmpxchg(&q_vector->state, I40E_QV_STATE_IDLE,
+			      I40E_QV_STATE_DISABLE) == I40E_QV_STATE_IDLE;
+}
+#else /* CONFIG_NET_RX_BUSY_POLL */
+static inline void i40e_qv_init_lock(struct i40e_q_vector *q_vector)
+{
+}
+
+static inline bool i40e_qv_lock_napi(struct i40e_q_vector *q_vector)
+{
+	return true;
+}
+
+static inline void i40e_qv_unlock_napi(struct i40e_q_vector *q_vector)
+{
+}
+
+static inline bool i40e_qv_busy_polling(struct i40e_q_vector *q_vector)
+{
+	return false;
+}
+
+static inline bool i40e_qv_disable(struct i40e_q_vector *q_vector)
+{
+	return true;
+}
+#endif /* CONFIG_NET_RX_BUSY_POLL */
+
 /* lan device */
 struct i40e_device {
 	struct list_head list;
@@ -2570,6 +2570,10 @@ static int i40e_set_channels(struct net_device *dev,
 	if (count > i40e_max_channels(vsi))
 		return -EINVAL;
 
+	/* the mqprio channels are laid out over the current queues */
+	if (vsi->num_channels)
+		return -EBUSY;
+
 	/* update feature limits from largest to smallest supported values */
 	/* TODO: Flow director limit, DCB etc */
 
@@ -57,6 +57,7 @@ static void i40e_determine_queue_usage(struct i40e_pf *pf);
 static int i40e_setup_pf_filter_control(struct i40e_pf *pf);
 static void i40e_fdir_sb_setup(struct i40e_pf *pf);
 static int i40e_veb_get_bw_info(struct i40e_veb *veb);
+static int i40e_config_rss(struct i40e_pf *pf);
 
 /* i40e_pci_tbl - PCI Device ID Table
  *
@@ -2699,8 +2700,8 @@ static void i40e_config_xps_tx_ring(struct i40e_ring *ring)
 	if (!ring->q_vector || !ring->netdev)
 		return;
 
-	/* Single TC mode enable XPS */
-	if (vsi->tc_config.numtc <= 1) {
+	/* Single TC mode enable XPS, it would ignore the channels */
+	if (vsi->tc_config.numtc <= 1 && !vsi->num_channels) {
 		if (!test_and_set_bit(__I40E_TX_XPS_INIT_DONE, &ring->state))
 			netif_set_xps_queue(ring->netdev,
 					    &ring->q_vector->affinity_mask,
@@ -4089,9 +4090,12 @@ static void i40e_free_q_vector(struct i40e_vsi *vsi, int v_idx)
 		ring->q_vector = NULL;
 
 	/* only VSI w/ an associated netdev is set up w/ NAPI */
-	if (vsi->netdev)
+	if (vsi->netdev) {
+		napi_hash_del(&q_vector->napi);
 		netif_napi_del(&q_vector->napi);
+	}
 
+	cancel_work_sync(&q_vector->dim.work);
 	vsi->q_vectors[v_idx] = NULL;
 
 	kfree_rcu(q_vector, rcu);
@@ -4166,8 +4170,10 @@ static void i40e_napi_enable_all(struct i40e_vsi *vsi)
 	if (!vsi->netdev)
 		return;
 
-	for (q_idx = 0; q_idx < vsi->num_q_vectors; q_idx++)
+	for (q_idx = 0; q_idx < vsi->num_q_vectors; q_idx++) {
+		i40e_qv_init_lock(vsi->q_vectors[q_idx]);
 		napi_enable(&vsi->q_vectors[q_idx]->napi);
+	}
 }
 
 /**
@@ -4181,8 +4187,12 @@ static void i40e_napi_disable_all(struct i40e_vsi *vsi)
 	if (!vsi->netdev)
 		return;
 
-	for (q_idx = 0; q_idx < vsi->num_q_vectors; q_idx++)
+	for (q_idx = 0; q_idx < vsi->num_q_vectors; q_idx++) {
 		napi_disable(&vsi->q_vectors[q_idx]->napi);
+		/* wait for busy polling sockets to let go */
+		while (!i40e_qv_disable(vsi->q_vectors[q_idx]))
+			usleep_range(1000, 20000);
+	}
 }
 
 /**
@@ -4671,6 +4681,25 @@ static int i40e_vsi_configure_bw_alloc(struct i40e_vsi *vsi, u8 enabled_tc,
 	return 0;
 }
 
+/**
+ * i40e_vsi_config_netdev_channels - Expose the channels as netdev TCs
+ * @vsi: the VSI being configured
+ *
+ * The priority to TC map is left to the mqprio qdisc.
+ **/
+static void i40e_vsi_config_netdev_channels(struct i40e_vsi *vsi)
+{
+	struct net_device *netdev = vsi->netdev;
+	int i;
+
+	if (netdev_set_num_tc(netdev, vsi->num_channels))
+		return;
+
+	for (i = 0; i < vsi->num_channels; i++)
+		netdev_set_tc_queue(netdev, i, vsi->channel[i].qcount,
+				    vsi->channel[i].qoffset);
+}
+
 /**
  * i40e_vsi_config_netdev_tc - Setup the netdev TC configuration
  * @vsi: the VSI being configured
@@ -4689,6 +4718,11 @@ static void i40e_vsi_config_netdev_tc(struct i40e_vsi *vsi, u8 enabled_tc)
 	if (!netdev)
 		return;
 
+	if (vsi->num_channels) {
+		i40e_vsi_config_netdev_channels(vsi);
+		return;
+	}
+
 	if (!enabled_tc) {
 		netdev_reset_tc(netdev);
 		return;
@@ -5202,6 +5236,64 @@ void i40e_down(struct i40e_vsi *vsi)
 	}
 }
 
+/**
+ * i40e_setup_channels - split the LAN queues into channels
+ * @vsi: the LAN VSI
+ * @num_ch: number of channels, 0 or 1 to go back to a single group
+ *
+ * Channel 0 keeps RSS and thereby all traffic that is not steered
+ * elsewhere, e.g. with ethtool ntuple rules.  The other channels are
+ * left to applications: their Rx queues only get the flows steered to
+ * them, their Tx queues are picked through the mqprio priority map.
+ * Sockets of such an application can then busy poll the NAPI contexts
+ * of their channel, see SO_INCOMING_NAPI_ID.
+ **/
+static int i40e_setup_channels(struct i40e_vsi *vsi, u8 num_ch)
+{
+	struct i40e_pf *pf = vsi->back;
+	u16 qcount, qoffset = 0;
+	int i;
+
+	/* RSS and ntuple steering are only set up for the LAN VSI */
+	if (vsi->type != I40E_VSI_MAIN)
+		return -EINVAL;
+
+	if (num_ch > I40E_MAX_TRAFFIC_CLASS || num_ch > vsi->num_queue_pairs)
+		return -EINVAL;
+
+	if (num_ch <= 1) {
+		if (!vsi->num_channels)
+			return 0;
+		vsi->num_channels = 0;
+		netdev_reset_tc(vsi->netdev);
+	} else {
+		qcount = vsi->num_queue_pairs / num_ch;
+		for (i = 0; i < num_ch; i++) {
+			vsi->channel[i].qoffset = qoffset;
+			vsi->channel[i].qcount = qcount;
+			/* channel 0 gets the odd queues */
+			if (!i)
+				vsi->channel[i].qcount +=
+					vsi->num_queue_pairs % num_ch;
+			vsi->channel[i].netdev_tc = i;
+			qoffset += vsi->channel[i].qcount;
+		}
+		vsi->num_channels = num_ch;
+		i40e_vsi_config_netdev_channels(vsi);
+	}
+
+	/* XPS is on only without channels */
+	for (i = 0; i < vsi->num_queue_pairs; i++) {
+		clear_bit(__I40E_TX_XPS_INIT_DONE, &vsi->tx_rings[i]->state);
+		i40e_config_xps_tx_ring(vsi->tx_rings[i]);
+	}
+
+	if (pf->flags & I40E_FLAG_RSS_ENABLED)
+		return i40e_config_rss(pf);
+
+	return 0;
+}
+
 /**
  * i40e_setup_tc - configure multiple traffic classes
  * @netdev: net device to configure
@@ -5220,18 +5312,16 @@ static int i40e_setup_tc(struct net_device *netdev, u8 tc)
 	int ret = -EINVAL;
 	int i;
 
-	/* Check if DCB enabled to continue */
-	if (!(pf->flags & I40E_FLAG_DCB_ENABLED)) {
-		netdev_info(netdev, "DCB is not enabled for adapter\n");
-		goto exit;
-	}
-
 	/* Check if MFP enabled */
 	if (pf->flags & I40E_FLAG_MFP_ENABLED) {
 		netdev_info(netdev, "Configuring TC not supported in MFP mode\n");
 		goto exit;
 	}
 
+	/* Without DCB the traffic classes are channels */
+	if (!(pf->flags & I40E_FLAG_DCB_ENABLED))
+		return i40e_setup_channels(vsi, tc);
+
 	/* Check whether tc count is within enabled limit */
 	if (tc > i40e_pf_get_num_tc(pf)) {
 		netdev_info(netdev, "TC count greater than enabled on link for adapter\n");
@@ -7627,12 +7717,15 @@ static int i40e_vsi_alloc_q_vector(struct i40e_vsi *vsi, int v_idx)
 	q_vector->vsi = vsi;
 	q_vector->v_idx = v_idx;
 	cpumask_set_cpu(v_idx, &q_vector->affinity_mask);
-	if (vsi->netdev)
+	if (vsi->netdev) {
 		netif_napi_add(vsi->netdev, &q_vector->napi,
 			       i40e_napi_poll, NAPI_POLL_WEIGHT);
+		napi_hash_add(&q_vector->napi);
+	}
 
 	q_vector->rx.latency_range = I40E_LOW_LATENCY;
 	q_vector->tx.latency_range = I40E_LOW_LATENCY;
+	i40e_dim_init(q_vector);
 
 	/* tie q_vector and vsi together */
 	vsi->q_vectors[v_idx] = q_vector;
@@ -7899,6 +7992,10 @@ static int i40e_config_rss(struct i40e_pf *pf)
 	wr32(hw, I40E_PFQF_HENA(1), (u32)(hena >> 32));
 
 	vsi->rss_size = min_t(int, pf->rss_size, vsi->num_queue_pairs);
+	/* keep unsteered traffic off the application channels */
+	if (vsi->num_channels)
+		vsi->rss_size = min_t(int, vsi->rss_size,
+				      vsi->channel[0].qcount);
 
 	/* Determine the RSS table size based on the hardware capabilities */
 	reg_val = rd32(hw, I40E_PFQF_CTL_0);
@@ -8582,6 +8679,9 @@ static const struct net_device_ops i40e_netdev_ops = {
 	.ndo_vlan_rx_kill_vid	= i40e_vlan_rx_kill_vid,
 #ifdef CONFIG_NET_POLL_CONTROLLER
 	.ndo_poll_controller	= i40e_netpoll,
+#endif
+#ifdef CONFIG_NET_RX_BUSY_POLL
+	.ndo_busy_poll		= i40e_busy_poll,
 #endif
 	.ndo_setup_tc		= i40e_setup_tc,
 #ifdef I40E_FCOE
@@ -1302,7 +1302,10 @@ static void i40e_receive_skb(struct i40e_ring *rx_ring,
 	if (vlan_tag & VLAN_VID_MASK)
 		__vlan_hwaccel_put_tag(skb, htons(ETH_P_8021Q), vlan_tag);
 
-	napi_gro_receive(&q_vector->napi, skb);
+	if (i40e_qv_busy_polling(q_vector))
+		netif_receive_skb(skb);
+	else
+		napi_gro_receive(&q_vector->napi, skb);
 }
 
 /**
@@ -1762,6 +1765,7 @@ static int i40e_clean_rx_irq_1buf(struct i40e_ring *rx_ring, int budget)
 			continue;
 		}
 #endif
+		skb_mark_napi_id(skb, &rx_ring->q_vector->napi);
 		i40e_receive_skb(rx_ring, skb, vlan_tag);
 
 		rx_desc->wb.qword1.status_error_len = 0;
@@ -1789,6 +1793,53 @@ static u32 i40e_buildreg_itr(const int type, const u16 itr)
 	return val;
 }
 
+/* Rx ITR profiles for net_dim, in usecs; the default one is I40E_ITR_20K.
+ * The ITR registers have no packet count threshold.
+ */
+static const struct net_dim_cq_moder
+i40e_dim_profiles[NET_DIM_NUM_PROFILES] = {
+	{ 20,  0 },
+	{ 50,  0 },
+	{ 84,  0 },
+	{ 124, 0 },
+	{ 244, 0 },
+};
+
+/* Only publishes the new value, i40e_update_enable_itr() writes it to
+ * the hardware together with re-enabling the interrupt.
+ */
+static void i40e_dim_apply(struct net_dim *dim,
+			   const struct net_dim_cq_moder *moder)
+{
+	struct i40e_q_vector *q_vector =
+				container_of(dim, struct i40e_q_vector, dim);
+
+	WRITE_ONCE(q_vector->dim_itr, moder->usec >> 1);
+}
+
+/**
+ * i40e_dim_init - set up dynamic Rx interrupt moderation of a q_vector
+ * @q_vector: the vector, not yet in use
+ **/
+void i40e_dim_init(struct i40e_q_vector *q_vector)
+{
+	net_dim_init(&q_vector->dim, i40e_dim_profiles, i40e_dim_apply);
+	q_vector->dim_itr = net_dim_cur_profile(&q_vector->dim)->usec >> 1;
+}
+
+/* The Rx totals of the ring container are free running when net_dim is
+ * in use, i40e_set_new_dynamic_itr() only runs for Tx then.
+ */
+static void i40e_rx_dim(struct i40e_q_vector *q_vector)
+{
+	struct net_dim_sample sample;
+
+	net_dim_sample(++q_vector->event_ctr,
+		       q_vector->rx.total_packets,
+		       q_vector->rx.total_bytes, &sample);
+	net_dim(&q_vector->dim, &sample);
+}
+
 /* a small macro to shorten up some long lines */
 #define INTREG I40E_PFINT_DYN_CTLN
 
@@ -1802,47 +1853,38 @@ static inline void i40e_update_enable_itr(struct i40e_vsi *vsi,
 					  struct i40e_q_vector *q_vector)
 {
 	struct i40e_hw *hw = &vsi->back->hw;
-	bool rx = false, tx = false;
+	bool rx = false;
 	u32 rxval, txval;
 	int vector;
 
 	vector = (q_vector->v_idx + vsi->base_vector);
 
-	/* avoid dynamic calculation if in countdown mode OR if
-	 * all dynamic is disabled
-	 */
 	rxval = txval = i40e_buildreg_itr(I40E_ITR_NONE, 0);
 
-	if (q_vector->itr_countdown > 0 ||
-	    (!ITR_IS_DYNAMIC(vsi->rx_itr_setting) &&
-	     !ITR_IS_DYNAMIC(vsi->tx_itr_setting))) {
-		goto enable_int;
-	}
-
+	/* net_dim paces itself, feed it every interrupt */
 	if (ITR_IS_DYNAMIC(vsi->rx_itr_setting)) {
-		rx = i40e_set_new_dynamic_itr(&q_vector->rx);
-		rxval = i40e_buildreg_itr(I40E_RX_ITR, q_vector->rx.itr);
-	}
-
-	if (ITR_IS_DYNAMIC(vsi->tx_itr_setting)) {
-		tx = i40e_set_new_dynamic_itr(&q_vector->tx);
-		txval = i40e_buildreg_itr(I40E_TX_ITR, q_vector->tx.itr);
+		u16 itr;
+
+		i40e_rx_dim(q_vector);
+		itr = READ_ONCE(q_vector->dim_itr);
+		if (itr != q_vector->rx.itr) {
+			q_vector->rx.itr = itr;
+			rxval = i40e_buildreg_itr(I40E_RX_ITR, itr);
+			rx = true;
+		}
 	}
 
-	if (rx || tx) {
-		/* get the higher of the two ITR adjustments and
-		 * use the same value for both ITR registers
-		 * when in adaptive mode (Rx and/or Tx)
-		 */
-		u16 itr = max(q_vector->tx.itr, q_vector->rx.itr);
+	/* avoid dynamic Tx calculation if in countdown mode OR if
+	 * it is disabled
+	 */
+	if (q_vector->itr_countdown > 0 ||
+	    !ITR_IS_DYNAMIC(vsi->tx_itr_setting))
+		goto enable_int;
 
-		q_vector->tx.itr = q_vector->rx.itr = itr;
-		txval = i40e_buildreg_itr(I40E_TX_ITR, itr);
-		tx = true;
-		rxval = i40e_buildreg_itr(I40E_RX_ITR, itr);
-		rx = true;
-	}
+	i40e_set_new_dynamic_itr(&q_vector->tx);
+	txval = i40e_buildreg_itr(I40E_TX_ITR, q_vector->tx.itr);
 
+enable_int:
 	/* only need to enable the interrupt once, but need
 	 * to possibly update both ITR values
 	 */
@@ -1856,7 +1898,6 @@ static inline void i40e_update_enable_itr(struct i40e_vsi *vsi,
 		wr32(hw, INTREG(vector - 1), rxval);
 	}
 
-enable_int:
 	if (!test_bit(__I40E_DOWN, &vsi->state))
 		wr32(hw, INTREG(vector - 1), txval);
 
@@ -1905,6 +1946,10 @@ int i40e_napi_poll(struct napi_struct *napi, int budget)
 	if (budget <= 0)
 		goto tx_only;
 
+	/* a busy polling socket owns the Rx rings, come back later */
+	if (!i40e_qv_lock_napi(q_vector))
+		goto tx_only;
+
 	/* We attempt to distribute budget to each Rx queue fairly, but don't
 	 * allow the budget to go below 1 because that would exit polling early.
 	 */
@@ -1923,6 +1968,8 @@ int i40e_napi_poll(struct napi_struct *napi, int budget)
 		clean_complete &= (budget_per_ring != cleaned);
 	}
 
+	i40e_qv_unlock_napi(q_vector);
+
 	/* If work not completed, return budget and polling will return */
 	if (!clean_complete) {
 tx_only:
@@ -1957,6 +2004,42 @@ tx_only:
 	return 0;
 }
 
+#ifdef CONFIG_NET_RX_BUSY_POLL
+/**
+ * i40e_busy_poll - Rx cleanup on behalf of a busy polling socket
+ * @napi: napi struct of the q_vector the socket last received from
+ *
+ * Returns the number of packets cleaned, or one of the LL_FLUSH_ codes
+ **/
+int i40e_busy_poll(struct napi_struct *napi)
+{
+	struct i40e_q_vector *q_vector =
+			       container_of(napi, struct i40e_q_vector, napi);
+	struct i40e_vsi *vsi = q_vector->vsi;
+	struct i40e_ring *ring;
+	int found = 0;
+
+	if (test_bit(__I40E_DOWN, &vsi->state))
+		return LL_FLUSH_FAILED;
+
+	if (!i40e_qv_lock_poll(q_vector))
+		return LL_FLUSH_BUSY;
+
+	i40e_for_each_ring(ring, q_vector->rx) {
+		if (ring_is_ps_enabled(ring))
+			found = i40e_clean_rx_irq_ps(ring, 4);
+		else
+			found = i40e_clean_rx_irq_1buf(ring, 4);
+		if (found)
+			break;
+	}
+
+	i40e_qv_unlock_poll(q_vector);
+
+	return found;
+}
+
+#endif /* CONFIG_NET_RX_BUSY_POLL */
 /**
  * i40e_atr - Add a Flow Director ATR filter
  * @tx_ring:  ring to add programming descriptor to
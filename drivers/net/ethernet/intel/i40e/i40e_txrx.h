@@ -326,6 +326,10 @@ int i40e_setup_rx_descriptors(struct i40e_ring *rx_ring);
 void i40e_free_tx_resources(struct i40e_ring *tx_ring);
 void i40e_free_rx_resources(struct i40e_ring *rx_ring);
 int i40e_napi_poll(struct napi_struct *napi, int budget);
+void i40e_dim_init(struct i40e_q_vector *q_vector);
+#ifdef CONFIG_NET_RX_BUSY_POLL
+int i40e_busy_poll(struct napi_struct *napi);
+#endif
 #ifdef I40E_FCOE
 void i40e_tx_map(struct i40e_ring *tx_ring, struct sk_buff *skb,
 		 struct i40e_tx_buffer *first, u32 tx_flags,
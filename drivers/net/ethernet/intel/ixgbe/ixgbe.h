@@ -54,6 +54,8 @@
 #endif
 
 #include <net/busy_poll.h>
+#include <net/xdp_sock.h>
+#include <net/net_dim.h>
 
 #ifdef CONFIG_NET_RX_BUSY_POLL
 #define BP_EXTENDED_STATS
@@ -195,8 +197,13 @@ struct ixgbe_tx_buffer {
 struct ixgbe_rx_buffer {
 	struct sk_buff *skb;
 	dma_addr_t dma;
-	struct page *page;
-	unsigned int page_offset;
+	union {
+		struct {
+			struct page *page;
+			unsigned int page_offset;
+		};
+		u64 addr;	/* umem address of the frame, zero-copy rings */
+	};
 };
 
 struct ixgbe_queue_stats {
@@ -232,6 +239,7 @@ enum ixgbe_ring_state_t {
 	__IXGBE_RX_RSC_ENABLED,
 	__IXGBE_RX_CSUM_UDP_ZERO_ERR,
 	__IXGBE_RX_FCOE,
+	__IXGBE_RX_XSK_DISCARD,
 };
 
 struct ixgbe_fwd_adapter {
@@ -261,6 +269,8 @@ struct ixgbe_ring {
 	struct net_device *netdev;	/* netdev ring belongs to */
 	struct device *dev;		/* device for DMA mapping */
 	struct ixgbe_fwd_adapter *l2_accel_priv;
+	struct bpf_prog *xdp_prog;	/* XDP program, Rx rings only */
+	struct xdp_umem *xsk_umem;	/* AF_XDP zero-copy, Rx rings only */
 	void *desc;			/* descriptor ring memory */
 	union {
 		struct ixgbe_tx_buffer *tx_buffer_info;
@@ -341,6 +351,9 @@ struct ixgbe_ring_feature {
  */
 static inline unsigned int ixgbe_rx_bufsz(struct ixgbe_ring *ring)
 {
+	if (ring->xsk_umem)
+		return rounddown(ring->xsk_umem->chunk_size_nohr,
+				 1 << IXGBE_SRRCTL_BSIZEPKT_SHIFT);
 #ifdef IXGBE_FCOE
 	if (test_bit(__IXGBE_RX_FCOE, &ring->state))
 		return (PAGE_SIZE < 8192) ? IXGBE_RXBUFFER_4K :
@@ -388,7 +401,9 @@ struct ixgbe_q_vector {
 				 * finding the bit in EICR and friends that
 				 * represents the vector for this ring */
 	u16 itr;		/* Interrupt throttle rate written to EITR */
+	u16 event_ctr;		/* completed polls, sampled by net_dim */
 	struct ixgbe_ring_container rx, tx;
+	struct net_dim dim;	/* dynamic Rx ITR */
 
 	struct napi_struct napi;
 	cpumask_t affinity_mask;
@@ -675,6 +690,10 @@ struct ixgbe_adapter {
 
 	/* RX */
 	struct ixgbe_ring *rx_ring[MAX_RX_QUEUES];
+	struct bpf_prog *xdp_prog;	/* holds the reference, see ixgbe_xdp */
+	/* AF_XDP umems by rx queue, see ixgbe_xsk_umem_setup */
+	struct xdp_umem *xsk_umems[MAX_RX_QUEUES];
+	u16 num_xsk_umems;
 	int num_rx_pools;		/* == num_rx_queues in 82598 */
 	int num_rx_queues_per_pool;	/* 1 if 82598, can be many if 82599 */
 	u64 hw_csum_rx_error;
@@ -893,6 +912,7 @@ void ixgbe_unmap_and_free_tx_resource(struct ixgbe_ring *,
 				      struct ixgbe_tx_buffer *);
 void ixgbe_alloc_rx_buffers(struct ixgbe_ring *, u16);
 void ixgbe_write_eitr(struct ixgbe_q_vector *);
+void ixgbe_dim_init(struct ixgbe_q_vector *q_vector);
 int ixgbe_poll(struct napi_struct *napi, int budget);
 int ethtool_ioctl(struct ifreq *ifr);
 s32 ixgbe_reinit_fdir_tables_82599(struct ixgbe_hw *hw);
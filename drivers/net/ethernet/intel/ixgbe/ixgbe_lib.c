@@ -859,6 +859,9 @@ static int ixgbe_alloc_q_vector(struct ixgbe_adapter *adapter,
 	/* initialize work limits */
 	q_vector->tx.work_limit = adapter->tx_work_limit;
 
+	/* dynamic Rx ITR, starts out at IXGBE_20K_ITR like below */
+	ixgbe_dim_init(q_vector);
+
 	/* initialize pointer to rings */
 	ring = q_vector->ring;
 
@@ -978,6 +981,7 @@ static void ixgbe_free_q_vector(struct ixgbe_adapter *adapter, int v_idx)
 		adapter->rx_ring[ring->queue_index] = NULL;
 
 	adapter->q_vector[v_idx] = NULL;
+	cancel_work_sync(&q_vector->dim.work);
 	napi_hash_del(&q_vector->napi);
 	netif_napi_del(&q_vector->napi);
 
@@ -49,6 +49,8 @@
 #include <linux/if_macvlan.h>
 #include <linux/if_bridge.h>
 #include <linux/prefetch.h>
+#include <linux/bpf.h>
+#include <linux/filter.h>
 #include <scsi/fc/fc_fcoe.h>
 #include <net/vxlan.h>
 
@@ -1531,6 +1533,89 @@ static bool ixgbe_alloc_mapped_page(struct ixgbe_ring *rx_ring,
 	return true;
 }
 
+#ifdef CONFIG_XDP_SOCKETS
+/**
+ * ixgbe_alloc_rx_buffers_zc - Post umem frames to a zero-copy ring
+ * @rx_ring: ring to place buffers on
+ * @cleaned_count: number of buffers to replace
+ *
+ * Frames come from the umem fill ring, the umem pages are DMA mapped once
+ * when the umem is installed, see ixgbe_xsk_umem_enable.
+ *
+ * Returns false if the fill ring ran dry before all buffers were replaced.
+ **/
+static bool ixgbe_alloc_rx_buffers_zc(struct ixgbe_ring *rx_ring,
+				      u16 cleaned_count)
+{
+	struct xdp_umem *umem = rx_ring->xsk_umem;
+	union ixgbe_adv_rx_desc *rx_desc;
+	struct ixgbe_rx_buffer *bi;
+	u16 i = rx_ring->next_to_use;
+	bool ok = true;
+
+	/* nothing to do */
+	if (!cleaned_count)
+		return true;
+
+	rx_desc = IXGBE_RX_DESC(rx_ring, i);
+	bi = &rx_ring->rx_buffer_info[i];
+	i -= rx_ring->count;
+
+	do {
+		unsigned int offset;
+		u64 handle;
+
+		if (!xsk_umem_peek_addr(umem, &handle)) {
+			rx_ring->rx_stats.alloc_rx_buff_failed++;
+			ok = false;
+			break;
+		}
+
+		bi->addr = handle + umem->headroom;
+		bi->dma = umem->pages[bi->addr >> PAGE_SHIFT].dma;
+		xsk_umem_discard_addr(umem);
+
+		offset = bi->addr & (PAGE_SIZE - 1);
+		dma_sync_single_range_for_device(rx_ring->dev, bi->dma, offset,
+						 ixgbe_rx_bufsz(rx_ring),
+						 DMA_BIDIRECTIONAL);
+
+		rx_desc->read.pkt_addr = cpu_to_le64(bi->dma + offset);
+
+		rx_desc++;
+		bi++;
+		i++;
+		if (unlikely(!i)) {
+			rx_desc = IXGBE_RX_DESC(rx_ring, 0);
+			bi = rx_ring->rx_buffer_info;
+			i -= rx_ring->count;
+		}
+
+		/* clear the status bits for the next_to_use descriptor */
+		rx_desc->wb.upper.status_error = 0;
+
+		cleaned_count--;
+	} while (cleaned_count);
+
+	i += rx_ring->count;
+
+	if (rx_ring->next_to_use != i) {
+		rx_ring->next_to_use = i;
+
+		/* update next to alloc since we have filled the ring */
+		rx_ring->next_to_alloc = i;
+
+		/* Force memory writes to complete before letting h/w
+		 * know there are new descriptors to fetch.
+		 */
+		wmb();
+		writel(i, rx_ring->tail);
+	}
+
+	return ok;
+}
+
+#endif /* CONFIG_XDP_SOCKETS */
 /**
  * ixgbe_alloc_rx_buffers - Replace used receive buffers
  * @rx_ring: ring to place buffers on
@@ -1546,6 +1631,14 @@ void ixgbe_alloc_rx_buffers(struct ixgbe_ring *rx_ring, u16 cleaned_count)
 	if (!cleaned_count)
 		return;
 
+#ifdef CONFIG_XDP_SOCKETS
+	if (rx_ring->xsk_umem) {
+		ixgbe_alloc_rx_buffers_zc(rx_ring, cleaned_count);
+		return;
+	}
+
+#endif
+
 	rx_desc = IXGBE_RX_DESC(rx_ring, i);
 	bi = &rx_ring->rx_buffer_info[i];
 	i -= rx_ring->count;
@@ -2029,6 +2122,173 @@ dma_sync:
 	return skb;
 }
 
+/**
+ * ixgbe_run_xdp - run the XDP program on a frame before an skb is built
+ * @rx_ring: rx descriptor ring the frame was received on
+ * @rx_desc: descriptor of the first buffer of the frame
+ *
+ * Only frames held in a single buffer are handed to the program, which is
+ * every frame as long as ixgbe_xdp_setup constraints hold.  Dropped frames
+ * go straight back to the ring and next_to_clean is advanced past them.
+ *
+ * Returns the XDP verdict, XDP_ABORTED and unknown verdicts are folded
+ * into XDP_DROP.
+ **/
+static u32 ixgbe_run_xdp(struct ixgbe_ring *rx_ring,
+			 union ixgbe_adv_rx_desc *rx_desc)
+{
+	struct ixgbe_rx_buffer *rx_buffer;
+	struct bpf_prog *xdp_prog;
+	struct xdp_buff xdp;
+	u32 act = XDP_PASS;
+	u32 ntc;
+
+	rcu_read_lock();
+	xdp_prog = READ_ONCE(rx_ring->xdp_prog);
+	if (!xdp_prog)
+		goto out;
+
+	rx_buffer = &rx_ring->rx_buffer_info[rx_ring->next_to_clean];
+	if (rx_buffer->skb ||
+	    !ixgbe_test_staterr(rx_desc, IXGBE_RXD_STAT_EOP))
+		goto out;
+
+	dma_sync_single_range_for_cpu(rx_ring->dev,
+				      rx_buffer->dma,
+				      rx_buffer->page_offset,
+				      ixgbe_rx_bufsz(rx_ring),
+				      DMA_FROM_DEVICE);
+
+	xdp.data = page_address(rx_buffer->page) + rx_buffer->page_offset;
+	xdp.len = le16_to_cpu(rx_desc->wb.upper.length);
+
+	act = bpf_prog_run_xdp(xdp_prog, &xdp);
+	switch (act) {
+	case XDP_PASS:
+	case XDP_TX:
+		break;
+	default:
+		bpf_warn_invalid_xdp_action(act);
+	case XDP_ABORTED:
+	case XDP_DROP:
+		/* hand the buffer back to the hardware untouched */
+		ixgbe_reuse_rx_page(rx_ring, rx_buffer);
+		rx_buffer->page = NULL;
+
+		ntc = rx_ring->next_to_clean + 1;
+		rx_ring->next_to_clean = (ntc < rx_ring->count) ? ntc : 0;
+		prefetch(IXGBE_RX_DESC(rx_ring, rx_ring->next_to_clean));
+		act = XDP_DROP;
+		break;
+	}
+out:
+	rcu_read_unlock();
+	return act;
+}
+
+#ifdef CONFIG_XDP_SOCKETS
+/**
+ * ixgbe_clean_rx_irq_zc - Clean completed descriptors from a zero-copy ring
+ * @q_vector: structure containing interrupt and ring information
+ * @rx_ring: rx descriptor ring to transact packets on
+ * @budget: Total limit on number of packets to process
+ *
+ * Frames are written by the hardware straight into the umem and are only
+ * posted on the socket rx ring, no skb is built and the XDP program is not
+ * run.  Frames that cannot be delivered go back to the umem reuse queue.
+ *
+ * Returns amount of work completed, or the whole budget if the fill ring
+ * ran dry so that polling goes on until user space hands out more frames.
+ **/
+static int ixgbe_clean_rx_irq_zc(struct ixgbe_q_vector *q_vector,
+				 struct ixgbe_ring *rx_ring,
+				 const int budget)
+{
+	unsigned int total_rx_bytes = 0, total_rx_packets = 0;
+	struct xdp_umem *umem = rx_ring->xsk_umem;
+	u16 cleaned_count = ixgbe_desc_unused(rx_ring);
+	bool failure = false;
+
+	while (likely(total_rx_packets < budget)) {
+		union ixgbe_adv_rx_desc *rx_desc;
+		struct ixgbe_rx_buffer *bi;
+		unsigned int size;
+		bool discard;
+		u32 ntc;
+
+		/* return some buffers to hardware, one at a time is too slow */
+		if (cleaned_count >= IXGBE_RX_BUFFER_WRITE) {
+			failure |= !ixgbe_alloc_rx_buffers_zc(rx_ring,
+							      cleaned_count);
+			cleaned_count = 0;
+		}
+
+		rx_desc = IXGBE_RX_DESC(rx_ring, rx_ring->next_to_clean);
+
+		if (!rx_desc->wb.upper.status_error)
+			break;
+
+		/* This memory barrier is needed to keep us from reading
+		 * any other fields out of the rx_desc until we know the
+		 * descriptor has been written back
+		 */
+		dma_rmb();
+
+		bi = &rx_ring->rx_buffer_info[rx_ring->next_to_clean];
+		size = le16_to_cpu(rx_desc->wb.upper.length);
+
+		ntc = rx_ring->next_to_clean + 1;
+		rx_ring->next_to_clean = (ntc < rx_ring->count) ? ntc : 0;
+		prefetch(IXGBE_RX_DESC(rx_ring, rx_ring->next_to_clean));
+		cleaned_count++;
+
+		/* a frame spanning several buffers cannot be handed over
+		 * as one descriptor, drop all of its buffers
+		 */
+		discard = test_bit(__IXGBE_RX_XSK_DISCARD, &rx_ring->state);
+		if (!ixgbe_test_staterr(rx_desc, IXGBE_RXD_STAT_EOP)) {
+			set_bit(__IXGBE_RX_XSK_DISCARD, &rx_ring->state);
+			rx_ring->rx_stats.non_eop_descs++;
+			discard = true;
+		} else if (discard) {
+			clear_bit(__IXGBE_RX_XSK_DISCARD, &rx_ring->state);
+		}
+
+		if (unlikely(ixgbe_test_staterr(rx_desc,
+					IXGBE_RXDADV_ERR_FRAME_ERR_MASK) &&
+			     !(rx_ring->netdev->features & NETIF_F_RXALL)))
+			discard = true;
+
+		if (!discard) {
+			dma_sync_single_range_for_cpu(rx_ring->dev, bi->dma,
+						      bi->addr & (PAGE_SIZE - 1),
+						      size, DMA_BIDIRECTIONAL);
+			discard = xsk_umem_rcv(umem, bi->addr, size);
+		}
+
+		if (discard) {
+			xsk_umem_fq_reuse(umem, bi->addr & umem->chunk_mask);
+			continue;
+		}
+
+		total_rx_bytes += size;
+		total_rx_packets++;
+	}
+
+	if (total_rx_packets)
+		xsk_umem_flush(umem);
+
+	u64_stats_update_begin(&rx_ring->syncp);
+	rx_ring->stats.packets += total_rx_packets;
+	rx_ring->stats.bytes += total_rx_bytes;
+	u64_stats_update_end(&rx_ring->syncp);
+	q_vector->rx.total_packets += total_rx_packets;
+	q_vector->rx.total_bytes += total_rx_bytes;
+
+	return failure ? budget : (int)total_rx_packets;
+}
+
+#endif /* CONFIG_XDP_SOCKETS */
 /**
  * ixgbe_clean_rx_irq - Clean completed descriptors from Rx ring - bounce buf
  * @q_vector: structure containing interrupt and ring information
@@ -2054,9 +2314,15 @@ static int ixgbe_clean_rx_irq(struct ixgbe_q_vector *q_vector,
 #endif /* IXGBE_FCOE */
 	u16 cleaned_count = ixgbe_desc_unused(rx_ring);
 
+#ifdef CONFIG_XDP_SOCKETS
+	if (rx_ring->xsk_umem)
+		return ixgbe_clean_rx_irq_zc(q_vector, rx_ring, budget);
+
+#endif
 	while (likely(total_rx_packets < budget)) {
 		union ixgbe_adv_rx_desc *rx_desc;
 		struct sk_buff *skb;
+		u32 xdp_act;
 
 		/* return some buffers to hardware, one at a time is too slow */
 		if (cleaned_count >= IXGBE_RX_BUFFER_WRITE) {
@@ -2075,6 +2341,14 @@ static int ixgbe_clean_rx_irq(struct ixgbe_q_vector *q_vector,
 		 */
 		dma_rmb();
 
+		xdp_act = ixgbe_run_xdp(rx_ring, rx_desc);
+		if (xdp_act == XDP_DROP) {
+			total_rx_bytes += le16_to_cpu(rx_desc->wb.upper.length);
+			total_rx_packets++;
+			cleaned_count++;
+			continue;
+		}
+
 		/* retrieve a buffer from the ring */
 		skb = ixgbe_fetch_rx_buffer(rx_ring, rx_desc);
 
@@ -2095,6 +2369,12 @@ static int ixgbe_clean_rx_irq(struct ixgbe_q_vector *q_vector,
 		/* probably a little skewed due to removing CRC */
 		total_rx_bytes += skb->len;
 
+		if (xdp_act == XDP_TX) {
+			xdp_do_tx_skb(skb, rx_ring->netdev);
+			total_rx_packets++;
+			continue;
+		}
+
 		/* populate checksum, timestamp, VLAN, and protocol */
 		ixgbe_process_skb_fields(rx_ring, rx_desc, skb);
 
@@ -2379,6 +2659,50 @@ static void ixgbe_set_itr(struct ixgbe_q_vector *q_vector)
 	}
 }
 
+/* Rx ITR profiles for net_dim, in usecs; the default one is IXGBE_20K_ITR.
+ * EITR has no packet count threshold.
+ */
+static const struct net_dim_cq_moder
+ixgbe_dim_profiles[NET_DIM_NUM_PROFILES] = {
+	{ 10,  0 },
+	{ 50,  0 },
+	{ 84,  0 },
+	{ 125, 0 },
+	{ 200, 0 },
+};
+
+static void ixgbe_dim_apply(struct net_dim *dim,
+			    const struct net_dim_cq_moder *moder)
+{
+	struct ixgbe_q_vector *q_vector =
+				container_of(dim, struct ixgbe_q_vector, dim);
+
+	/* ethtool may have switched to a static ITR meanwhile */
+	if (q_vector->adapter->rx_itr_setting != 1)
+		return;
+
+	q_vector->itr = moder->usec << 2;
+	ixgbe_write_eitr(q_vector);
+}
+
+void ixgbe_dim_init(struct ixgbe_q_vector *q_vector)
+{
+	net_dim_init(&q_vector->dim, ixgbe_dim_profiles, ixgbe_dim_apply);
+}
+
+/* The Rx totals of the ring container are free running on vectors using
+ * net_dim, ixgbe_update_itr() is never called for them.
+ */
+static void ixgbe_rx_dim(struct ixgbe_q_vector *q_vector)
+{
+	struct net_dim_sample sample;
+
+	net_dim_sample(++q_vector->event_ctr,
+		       q_vector->rx.total_packets,
+		       q_vector->rx.total_bytes, &sample);
+	net_dim(&q_vector->dim, &sample);
+}
+
 /**
  * ixgbe_check_overtemp_subtask - check for over temperature
  * @adapter: pointer to adapter
@@ -2811,8 +3135,12 @@ int ixgbe_poll(struct napi_struct *napi, int budget)
 
 	/* all work done, exit the polling mode */
 	napi_complete_done(napi, work_done);
-	if (adapter->rx_itr_setting & 1)
-		ixgbe_set_itr(q_vector);
+	if (adapter->rx_itr_setting & 1) {
+		if (q_vector->rx.count)
+			ixgbe_rx_dim(q_vector);
+		else
+			ixgbe_set_itr(q_vector);
+	}
 	if (!test_bit(__IXGBE_DOWN, &adapter->state))
 		ixgbe_irq_enable_queues(adapter, ((u64)1 << q_vector->v_idx));
 
@@ -3617,6 +3945,11 @@ void ixgbe_configure_rx_ring(struct ixgbe_adapter *adapter,
 	rxdctl = IXGBE_READ_REG(hw, IXGBE_RXDCTL(reg_idx));
 	ixgbe_disable_rx_queue(adapter, ring);
 
+	WRITE_ONCE(ring->xdp_prog, adapter->xdp_prog);
+	ring->xsk_umem = NULL;
+	if (ring->netdev == adapter->netdev)
+		ring->xsk_umem = adapter->xsk_umems[ring->queue_index];
+
 	IXGBE_WRITE_REG(hw, IXGBE_RDBAL(reg_idx), (rdba & DMA_BIT_MASK(32)));
 	IXGBE_WRITE_REG(hw, IXGBE_RDBAH(reg_idx), (rdba >> 32));
 	IXGBE_WRITE_REG(hw, IXGBE_RDLEN(reg_idx),
@@ -4596,6 +4929,33 @@ static void ixgbe_fwd_psrtype(struct ixgbe_fwd_adapter *vadapter)
 	IXGBE_WRITE_REG(hw, IXGBE_PSRTYPE(VMDQ_P(pool)), psrtype);
 }
 
+#ifdef CONFIG_XDP_SOCKETS
+/**
+ * ixgbe_clean_rx_ring_zc - Give the frames of a zero-copy ring back
+ * @rx_ring: ring to free buffers from
+ *
+ * The frames posted to the hardware are returned to the umem reuse queue,
+ * they are handed out again the next time the ring is filled.
+ **/
+static void ixgbe_clean_rx_ring_zc(struct ixgbe_ring *rx_ring)
+{
+	struct xdp_umem *umem = rx_ring->xsk_umem;
+	u16 i = rx_ring->next_to_clean;
+
+	while (i != rx_ring->next_to_use) {
+		struct ixgbe_rx_buffer *bi = &rx_ring->rx_buffer_info[i];
+
+		xsk_umem_fq_reuse(umem, bi->addr & umem->chunk_mask);
+
+		i++;
+		if (i == rx_ring->count)
+			i = 0;
+	}
+
+	clear_bit(__IXGBE_RX_XSK_DISCARD, &rx_ring->state);
+}
+
+#endif /* CONFIG_XDP_SOCKETS */
 /**
  * ixgbe_clean_rx_ring - Free Rx Buffers per Queue
  * @rx_ring: ring to free buffers from
@@ -4610,6 +4970,13 @@ static void ixgbe_clean_rx_ring(struct ixgbe_ring *rx_ring)
 	if (!rx_ring->rx_buffer_info)
 		return;
 
+#ifdef CONFIG_XDP_SOCKETS
+	if (rx_ring->xsk_umem) {
+		ixgbe_clean_rx_ring_zc(rx_ring);
+		goto clear_ring;
+	}
+
+#endif
 	/* Free all the Rx ring sk_buffs */
 	for (i = 0; i < rx_ring->count; i++) {
 		struct ixgbe_rx_buffer *rx_buffer = &rx_ring->rx_buffer_info[i];
@@ -4635,6 +5002,9 @@ static void ixgbe_clean_rx_ring(struct ixgbe_ring *rx_ring)
 		rx_buffer->page = NULL;
 	}
 
+#ifdef CONFIG_XDP_SOCKETS
+clear_ring:
+#endif
 	size = sizeof(struct ixgbe_rx_buffer) * rx_ring->count;
 	memset(rx_ring->rx_buffer_info, 0, size);
 
@@ -5720,6 +6090,27 @@ static void ixgbe_free_all_rx_resources(struct ixgbe_adapter *adapter)
 			ixgbe_free_rx_resources(adapter->rx_ring[i]);
 }
 
+/* A frame of max_frame bytes has to fit in a single buffer on every ring
+ * receiving into an AF_XDP umem
+ */
+static bool ixgbe_xsk_frame_fits(struct ixgbe_adapter *adapter, int max_frame)
+{
+	int i;
+
+	if (!adapter->num_xsk_umems)
+		return true;
+
+	for (i = 0; i < MAX_RX_QUEUES; i++) {
+		struct xdp_umem *umem = adapter->xsk_umems[i];
+
+		if (umem && max_frame > rounddown(umem->chunk_size_nohr,
+					1 << IXGBE_SRRCTL_BSIZEPKT_SHIFT))
+			return false;
+	}
+
+	return true;
+}
+
 /**
  * ixgbe_change_mtu - Change the Maximum Transfer Unit
  * @netdev: network interface device structure
@@ -5736,6 +6127,14 @@ static int ixgbe_change_mtu(struct net_device *netdev, int new_mtu)
 	if ((new_mtu < 68) || (max_frame > IXGBE_MAX_JUMBO_FRAME_SIZE))
 		return -EINVAL;
 
+	/* XDP programs only see frames that fit in a single buffer */
+	if (adapter->xdp_prog && max_frame + VLAN_HLEN > IXGBE_RXBUFFER_2K)
+		return -EINVAL;
+
+	/* likewise for the rings receiving into an AF_XDP umem */
+	if (!ixgbe_xsk_frame_fits(adapter, max_frame + VLAN_HLEN))
+		return -EINVAL;
+
 	/*
 	 * For 82599EB we cannot allow legacy VFs to enable their receive
 	 * paths when MTU greater than 1500 is configured.  So display a
@@ -7993,6 +8392,10 @@ static netdev_features_t ixgbe_fix_features(struct net_device *netdev,
 	if (!(adapter->flags2 & IXGBE_FLAG2_RSC_CAPABLE))
 		features &= ~NETIF_F_LRO;
 
+	/* RSC coalesces frames across buffers, which XDP cannot look at */
+	if (adapter->xdp_prog || adapter->num_xsk_umems)
+		features &= ~NETIF_F_LRO;
+
 	return features;
 }
 
@@ -8392,6 +8795,162 @@ ixgbe_features_check(struct sk_buff *skb, struct net_device *dev,
 	return features;
 }
 
+static int ixgbe_xdp_setup(struct net_device *dev, struct bpf_prog *prog)
+{
+	struct ixgbe_adapter *adapter = netdev_priv(dev);
+	int max_frame = dev->mtu + ETH_HLEN + ETH_FCS_LEN + VLAN_HLEN;
+	struct bpf_prog *old_prog;
+	int i;
+
+	/* the program must see whole frames, so no jumbo frames spanning
+	 * several buffers and no RSC
+	 */
+	if (prog) {
+		if (max_frame > IXGBE_RXBUFFER_2K)
+			return -EINVAL;
+		if (adapter->flags2 & IXGBE_FLAG2_RSC_ENABLED)
+			return -EINVAL;
+	}
+
+	old_prog = xchg(&adapter->xdp_prog, prog);
+	for (i = 0; i < adapter->num_rx_queues; i++)
+		WRITE_ONCE(adapter->rx_ring[i]->xdp_prog, prog);
+
+	if (old_prog)
+		bpf_prog_put_rcu(old_prog);
+
+	netdev_update_features(dev);
+
+	return 0;
+}
+
+#ifdef CONFIG_XDP_SOCKETS
+static void ixgbe_xsk_umem_dma_unmap(struct ixgbe_adapter *adapter,
+				     struct xdp_umem *umem, u32 npgs)
+{
+	u32 i;
+
+	for (i = 0; i < npgs; i++) {
+		dma_unmap_page(&adapter->pdev->dev, umem->pages[i].dma,
+			       PAGE_SIZE, DMA_BIDIRECTIONAL);
+		umem->pages[i].dma = 0;
+	}
+}
+
+/* The buffers of the ring are replaced, which takes a reset */
+static void ixgbe_xsk_ring_update(struct ixgbe_adapter *adapter, u16 qid)
+{
+	if (netif_running(adapter->netdev))
+		ixgbe_reinit_locked(adapter);
+	else if (qid < adapter->num_rx_queues)
+		adapter->rx_ring[qid]->xsk_umem = adapter->xsk_umems[qid];
+}
+
+static int ixgbe_xsk_umem_enable(struct ixgbe_adapter *adapter,
+				 struct xdp_umem *umem, u16 qid)
+{
+	struct net_device *netdev = adapter->netdev;
+	int max_frame = netdev->mtu + ETH_HLEN + ETH_FCS_LEN + VLAN_HLEN;
+	struct xdp_umem_fq_reuse *reuseq;
+	u32 i;
+
+	if (qid >= adapter->num_rx_queues)
+		return -EINVAL;
+	if (adapter->xsk_umems[qid])
+		return -EBUSY;
+#ifdef IXGBE_FCOE
+	if (test_bit(__IXGBE_RX_FCOE, &adapter->rx_ring[qid]->state))
+		return -EINVAL;
+#endif
+
+	/* every frame has to fit in the part of a chunk past the headroom */
+	if (adapter->flags2 & IXGBE_FLAG2_RSC_ENABLED)
+		return -EINVAL;
+	if (max_frame > rounddown(umem->chunk_size_nohr,
+				  1 << IXGBE_SRRCTL_BSIZEPKT_SHIFT))
+		return -EINVAL;
+
+	/* sized for the largest ring, the frames held by the ring are
+	 * parked there whenever it is torn down
+	 */
+	reuseq = xsk_reuseq_prepare(IXGBE_MAX_RXD);
+	if (!reuseq)
+		return -ENOMEM;
+	xsk_reuseq_free(xsk_reuseq_swap(umem, reuseq));
+
+	for (i = 0; i < umem->npgs; i++) {
+		dma_addr_t dma;
+
+		dma = dma_map_page(&adapter->pdev->dev, umem->pgs[i], 0,
+				   PAGE_SIZE, DMA_BIDIRECTIONAL);
+		if (dma_mapping_error(&adapter->pdev->dev, dma)) {
+			ixgbe_xsk_umem_dma_unmap(adapter, umem, i);
+			return -ENOMEM;
+		}
+		umem->pages[i].dma = dma;
+	}
+
+	adapter->xsk_umems[qid] = umem;
+	adapter->num_xsk_umems++;
+	ixgbe_xsk_ring_update(adapter, qid);
+
+	return 0;
+}
+
+static int ixgbe_xsk_umem_disable(struct ixgbe_adapter *adapter, u16 qid)
+{
+	struct xdp_umem *umem;
+
+	if (qid >= MAX_RX_QUEUES || !adapter->xsk_umems[qid])
+		return -EINVAL;
+
+	umem = adapter->xsk_umems[qid];
+	adapter->xsk_umems[qid] = NULL;
+	adapter->num_xsk_umems--;
+	ixgbe_xsk_ring_update(adapter, qid);
+
+	ixgbe_xsk_umem_dma_unmap(adapter, umem, umem->npgs);
+
+	return 0;
+}
+
+/**
+ * ixgbe_xsk_umem_setup - Install or remove the umem of an rx queue
+ * @adapter: board private structure
+ * @umem: umem to receive into, NULL to go back to the regular buffers
+ * @qid: rx queue
+ *
+ * Called with RTNL held, when an AF_XDP socket binds in zero-copy mode or
+ * releases the queue.
+ **/
+static int ixgbe_xsk_umem_setup(struct ixgbe_adapter *adapter,
+				struct xdp_umem *umem, u16 qid)
+{
+	return umem ? ixgbe_xsk_umem_enable(adapter, umem, qid) :
+		      ixgbe_xsk_umem_disable(adapter, qid);
+}
+
+#endif /* CONFIG_XDP_SOCKETS */
+static int ixgbe_xdp(struct net_device *dev, struct netdev_xdp *xdp)
+{
+	struct ixgbe_adapter *adapter = netdev_priv(dev);
+
+	switch (xdp->command) {
+	case XDP_SETUP_PROG:
+		return ixgbe_xdp_setup(dev, xdp->prog);
+	case XDP_QUERY_PROG:
+		xdp->prog_attached = !!adapter->xdp_prog;
+		return 0;
+#ifdef CONFIG_XDP_SOCKETS
+	case XDP_SETUP_XSK_UMEM:
+		return ixgbe_xsk_umem_setup(adapter, xdp->xsk.umem,
+					    xdp->xsk.queue_id);
+#endif
+	default:
+		return -EINVAL;
+	}
+}
+
 static const struct net_device_ops ixgbe_netdev_ops = {
 	.ndo_open		= ixgbe_open,
 	.ndo_stop		= ixgbe_close,
@@ -8443,6 +9002,7 @@ static const struct net_device_ops ixgbe_netdev_ops = {
 	.ndo_del_vxlan_port	= ixgbe_del_vxlan_port,
 #endif /* CONFIG_IXGBE_VXLAN */
 	.ndo_features_check	= ixgbe_features_check,
+	.ndo_xdp		= ixgbe_xdp,
 };
 
 /**
@@ -9076,6 +9636,9 @@ static void ixgbe_remove(struct pci_dev *pdev)
 
 	ixgbe_clear_interrupt_scheme(adapter);
 
+	if (adapter->xdp_prog)
+		bpf_prog_put(adapter->xdp_prog);
+
 	ixgbe_release_hw_control(adapter);
 
 #ifdef CONFIG_DCB
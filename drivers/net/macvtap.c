@@ -707,7 +707,7 @@ static void macvtap_skb_to_vnet_hdr(struct macvtap_queue *q,
 #define MACVTAP_RESERVE HH_DATA_OFF(ETH_HLEN)
 
 /* Get packet from user space buffer */
-static ssize_t macvtap_get_user(struct macvtap_queue *q, struct msghdr *m,
+static ssize_t macvtap_get_user(struct macvtap_queue *q, void *msg_control,
 				struct iov_iter *from, int noblock)
 {
 	int good_linear = SKB_MAX_HEAD(MACVTAP_RESERVE);
@@ -753,7 +753,7 @@ static ssize_t macvtap_get_user(struct macvtap_queue *q, struct msghdr *m,
 	if (unlikely(len < ETH_HLEN))
 		goto err;
 
-	if (m && m->msg_control && sock_flag(&q->sk, SOCK_ZEROCOPY)) {
+	if (msg_control && sock_flag(&q->sk, SOCK_ZEROCOPY)) {
 		struct iov_iter i;
 
 		copylen = vnet_hdr.hdr_len ?
@@ -787,8 +787,8 @@ static ssize_t macvtap_get_user(struct macvtap_queue *q, struct msghdr *m,
 		err = zerocopy_sg_from_iter(skb, from);
 	else {
 		err = skb_copy_datagram_from_iter(skb, 0, from, len);
-		if (!err && m && m->msg_control) {
-			struct ubuf_info *uarg = m->msg_control;
+		if (!err && msg_control) {
+			struct ubuf_info *uarg = msg_control;
 			uarg->callback(uarg, false);
 		}
 	}
@@ -818,7 +818,7 @@ static ssize_t macvtap_get_user(struct macvtap_queue *q, struct msghdr *m,
 	vlan = rcu_dereference(q->vlan);
 	/* copy skb_ubuf_info for callback when skb has no error */
 	if (zerocopy) {
-		skb_shinfo(skb)->destructor_arg = m->msg_control;
+		skb_shinfo(skb)->destructor_arg = msg_control;
 		skb_shinfo(skb)->tx_flags |= SKBTX_DEV_ZEROCOPY;
 		skb_shinfo(skb)->tx_flags |= SKBTX_SHARED_FRAG;
 	}
@@ -1230,7 +1230,14 @@ static int macvtap_sendmsg(struct socket *sock, struct msghdr *m,
 			   size_t total_len)
 {
 	struct macvtap_queue *q = container_of(sock, struct macvtap_queue, sock);
-	return macvtap_get_user(q, m, &m->msg_iter, m->msg_flags & MSG_DONTWAIT);
+	struct tun_msg_ctl *ctl = m->msg_control;
+
+	/* Batches of packets are only supported by tun */
+	if (ctl && ctl->type != TUN_MSG_UBUF)
+		return -EINVAL;
+
+	return macvtap_get_user(q, ctl ? ctl->ptr : NULL, &m->msg_iter,
+				m->msg_flags & MSG_DONTWAIT);
 }
 
 static int macvtap_recvmsg(struct socket *sock, struct msghdr *m,
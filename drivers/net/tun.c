@@ -856,7 +856,7 @@ static netdev_tx_t tun_net_xmit(struct sk_buff *skb, struct net_device *dev)
 			  >= dev->tx_queue_len)
 		goto drop;
 
-	if (unlikely(skb_orphan_frags(skb, GFP_ATOMIC)))
+	if (unlikely(skb_orphan_frags_rx(skb, GFP_ATOMIC)))
 		goto drop;
 
 	if (skb->sk && sk_fullsock(skb->sk)) {
@@ -1077,10 +1077,14 @@ static struct sk_buff *tun_alloc_skb(struct tun_file *tfile,
 	return skb;
 }
 
-/* Get packet from user space buffer */
+/* Get packet from user space buffer
+ *
+ * If @queue is given the skb is added to it rather than passed to the
+ * stack, and the caller hands the whole batch over later.
+ */
 static ssize_t tun_get_user(struct tun_struct *tun, struct tun_file *tfile,
 			    void *msg_control, struct iov_iter *from,
-			    int noblock)
+			    int noblock, struct sk_buff_head *queue)
 {
 	struct tun_pi pi = { 0, cpu_to_be16(ETH_P_IP) };
 	struct sk_buff *skb;
@@ -1257,7 +1261,10 @@ static ssize_t tun_get_user(struct tun_struct *tun, struct tun_file *tfile,
 	skb_probe_transport_header(skb, 0);
 
 	rxhash = skb_get_hash(skb);
-	netif_rx_ni(skb);
+	if (queue)
+		__skb_queue_tail(queue, skb);
+	else
+		netif_rx_ni(skb);
 
 	tun->dev->stats.rx_packets++;
 	tun->dev->stats.rx_bytes += len;
@@ -1276,7 +1283,8 @@ static ssize_t tun_chr_write_iter(struct kiocb *iocb, struct iov_iter *from)
 	if (!tun)
 		return -EBADFD;
 
-	result = tun_get_user(tun, tfile, NULL, from, file->f_flags & O_NONBLOCK);
+	result = tun_get_user(tun, tfile, NULL, from,
+			      file->f_flags & O_NONBLOCK, NULL);
 
 	tun_put(tun);
 	return result;
@@ -1501,17 +1509,62 @@ static void tun_sock_write_space(struct sock *sk)
 	kill_fasync(&tfile->fasync, SIGIO, POLL_OUT);
 }
 
+/* Build the skbs for a batch of packets first, then queue all of them to
+ * the backlog with bottom halves disabled, so that the stack only runs
+ * once for the batch rather than once per packet.
+ *
+ * Returns the number of packets consumed.  Packets that were dropped count
+ * as consumed, so the caller only has to retry from the first one that
+ * could not be sent for lack of socket buffer space.
+ */
+static int tun_send_batch(struct tun_struct *tun, struct tun_file *tfile,
+			  struct iov_iter *iters, int num, int noblock)
+{
+	struct sk_buff_head queue;
+	struct sk_buff *skb;
+	ssize_t err;
+	int i;
+
+	__skb_queue_head_init(&queue);
+	for (i = 0; i < num; i++) {
+		err = tun_get_user(tun, tfile, NULL, &iters[i], noblock,
+				   &queue);
+		if (err == -EAGAIN)
+			break;
+	}
+
+	local_bh_disable();
+	while ((skb = __skb_dequeue(&queue)))
+		netif_rx(skb);
+	local_bh_enable();
+
+	return i ? i : -EAGAIN;
+}
+
 static int tun_sendmsg(struct socket *sock, struct msghdr *m, size_t total_len)
 {
 	int ret;
 	struct tun_file *tfile = container_of(sock, struct tun_file, socket);
 	struct tun_struct *tun = __tun_get(tfile);
+	struct tun_msg_ctl *ctl = m->msg_control;
 
 	if (!tun)
 		return -EBADFD;
 
-	ret = tun_get_user(tun, tfile, m->msg_control, &m->msg_iter,
-			   m->msg_flags & MSG_DONTWAIT);
+	if (ctl && ctl->type == TUN_MSG_PTR) {
+		ret = tun_send_batch(tun, tfile, ctl->ptr, ctl->num,
+				     m->msg_flags & MSG_DONTWAIT);
+		goto out;
+	}
+
+	if (ctl && ctl->type != TUN_MSG_UBUF) {
+		ret = -EINVAL;
+		goto out;
+	}
+
+	ret = tun_get_user(tun, tfile, ctl ? ctl->ptr : NULL, &m->msg_iter,
+			   m->msg_flags & MSG_DONTWAIT, NULL);
+out:
 	tun_put(tun);
 	return ret;
 }
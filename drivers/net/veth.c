@@ -26,15 +26,30 @@
 #define MIN_MTU 68		/* Min L3 MTU */
 #define MAX_MTU 65535		/* Max L3 MTU (arbitrary) */
 
+#define VETH_RING_SIZE	256	/* Max packets queued per NAPI rx queue */
+
 struct pcpu_vstats {
 	u64			packets;
 	u64			bytes;
 	struct u64_stats_sync	syncp;
 };
 
+/*
+ * In NAPI mode the peer queues packets on one of these instead of passing
+ * them to netif_rx(), and they are received in batches, through GRO, from
+ * the NAPI poll routine of the receiving device.  NAPI mode is enabled
+ * by turning GRO on for the receiving device.
+ */
+struct veth_rq {
+	struct napi_struct __rcu *active_napi;	/* &napi while in NAPI mode */
+	struct napi_struct	napi;
+	struct sk_buff_head	queue;
+};
+
 struct veth_priv {
 	struct net_device __rcu	*peer;
 	atomic64_t		dropped;
+	struct veth_rq		*rq;
 };
 
 /*
@@ -105,11 +120,33 @@ static const struct ethtool_ops veth_ethtool_ops = {
 	.get_ethtool_stats	= veth_get_ethtool_stats,
 };
 
+static int veth_forward_skb_napi(struct net_device *rcv, struct sk_buff *skb,
+				 struct veth_rq *rq, struct napi_struct *napi)
+{
+	if (__dev_forward_skb(rcv, skb))
+		return NET_RX_DROP;
+
+	spin_lock(&rq->queue.lock);
+	if (unlikely(skb_queue_len(&rq->queue) >= VETH_RING_SIZE)) {
+		spin_unlock(&rq->queue.lock);
+		kfree_skb(skb);
+		return NET_RX_DROP;
+	}
+	__skb_queue_tail(&rq->queue, skb);
+	spin_unlock(&rq->queue.lock);
+
+	napi_schedule(napi);
+	return NET_RX_SUCCESS;
+}
+
 static netdev_tx_t veth_xmit(struct sk_buff *skb, struct net_device *dev)
 {
-	struct veth_priv *priv = netdev_priv(dev);
+	struct veth_priv *rcv_priv, *priv = netdev_priv(dev);
+	struct napi_struct *napi = NULL;
+	struct veth_rq *rq = NULL;
 	struct net_device *rcv;
 	int length = skb->len;
+	int rxq, ret;
 
 	rcu_read_lock();
 	rcv = rcu_dereference(priv->peer);
@@ -118,7 +155,19 @@ static netdev_tx_t veth_xmit(struct sk_buff *skb, struct net_device *dev)
 		goto drop;
 	}
 
-	if (likely(dev_forward_skb(rcv, skb) == NET_RX_SUCCESS)) {
+	rcv_priv = netdev_priv(rcv);
+	rxq = skb_get_queue_mapping(skb);
+	if (rxq < rcv->real_num_rx_queues) {
+		rq = &rcv_priv->rq[rxq];
+		napi = rcu_dereference(rq->active_napi);
+	}
+
+	if (napi)
+		ret = veth_forward_skb_napi(rcv, skb, rq, napi);
+	else
+		ret = dev_forward_skb(rcv, skb);
+
+	if (likely(ret == NET_RX_SUCCESS)) {
 		struct pcpu_vstats *stats = this_cpu_ptr(dev->vstats);
 
 		u64_stats_update_begin(&stats->syncp);
@@ -188,6 +237,73 @@ static void veth_set_multicast_list(struct net_device *dev)
 {
 }
 
+static int veth_poll(struct napi_struct *napi, int budget)
+{
+	struct veth_rq *rq = container_of(napi, struct veth_rq, napi);
+	struct sk_buff_head batch;
+	struct sk_buff *skb;
+	int done = 0;
+
+	/* Take the whole batch with a single lock round trip */
+	__skb_queue_head_init(&batch);
+	spin_lock(&rq->queue.lock);
+	while (done < budget && (skb = __skb_dequeue(&rq->queue))) {
+		__skb_queue_tail(&batch, skb);
+		done++;
+	}
+	spin_unlock(&rq->queue.lock);
+
+	while ((skb = __skb_dequeue(&batch)))
+		napi_gro_receive(napi, skb);
+
+	if (done < budget) {
+		napi_complete_done(napi, done);
+		/* The peer may have queued more without rescheduling us, if
+		 * it saw NAPI still scheduled before the completion. */
+		if (!skb_queue_empty(&rq->queue) && napi_schedule_prep(napi))
+			__napi_schedule(napi);
+	}
+
+	return done;
+}
+
+static void veth_napi_enable(struct net_device *dev)
+{
+	struct veth_priv *priv = netdev_priv(dev);
+	int i;
+
+	for (i = 0; i < dev->real_num_rx_queues; i++) {
+		struct veth_rq *rq = &priv->rq[i];
+
+		netif_napi_add(dev, &rq->napi, veth_poll, NAPI_POLL_WEIGHT);
+		napi_enable(&rq->napi);
+		rcu_assign_pointer(rq->active_napi, &rq->napi);
+	}
+}
+
+static void veth_napi_disable(struct net_device *dev)
+{
+	struct veth_priv *priv = netdev_priv(dev);
+	int i;
+
+	if (!rtnl_dereference(priv->rq[0].active_napi))
+		return;
+
+	for (i = 0; i < dev->real_num_rx_queues; i++)
+		RCU_INIT_POINTER(priv->rq[i].active_napi, NULL);
+
+	/* Wait for the peer to stop queueing packets */
+	synchronize_net();
+
+	for (i = 0; i < dev->real_num_rx_queues; i++) {
+		struct veth_rq *rq = &priv->rq[i];
+
+		napi_disable(&rq->napi);
+		netif_napi_del(&rq->napi);
+		skb_queue_purge(&rq->queue);
+	}
+}
+
 static int veth_open(struct net_device *dev)
 {
 	struct veth_priv *priv = netdev_priv(dev);
@@ -196,6 +312,9 @@ static int veth_open(struct net_device *dev)
 	if (!peer)
 		return -ENOTCONN;
 
+	if (dev->features & NETIF_F_GRO)
+		veth_napi_enable(dev);
+
 	if (peer->flags & IFF_UP) {
 		netif_carrier_on(dev);
 		netif_carrier_on(peer);
@@ -212,6 +331,8 @@ static int veth_close(struct net_device *dev)
 	if (peer)
 		netif_carrier_off(peer);
 
+	veth_napi_disable(dev);
+
 	return 0;
 }
 
@@ -228,16 +349,47 @@ static int veth_change_mtu(struct net_device *dev, int new_mtu)
 	return 0;
 }
 
+static int veth_set_features(struct net_device *dev,
+			     netdev_features_t features)
+{
+	netdev_features_t changed = features ^ dev->features;
+
+	if (!(changed & NETIF_F_GRO) || !netif_running(dev))
+		return 0;
+
+	if (features & NETIF_F_GRO)
+		veth_napi_enable(dev);
+	else
+		veth_napi_disable(dev);
+
+	return 0;
+}
+
 static int veth_dev_init(struct net_device *dev)
 {
+	struct veth_priv *priv = netdev_priv(dev);
+	int i;
+
 	dev->vstats = netdev_alloc_pcpu_stats(struct pcpu_vstats);
 	if (!dev->vstats)
 		return -ENOMEM;
+
+	priv->rq = kcalloc(dev->num_rx_queues, sizeof(*priv->rq), GFP_KERNEL);
+	if (!priv->rq) {
+		free_percpu(dev->vstats);
+		return -ENOMEM;
+	}
+	for (i = 0; i < dev->num_rx_queues; i++)
+		skb_queue_head_init(&priv->rq[i].queue);
+
 	return 0;
 }
 
 static void veth_dev_free(struct net_device *dev)
 {
+	struct veth_priv *priv = netdev_priv(dev);
+
+	kfree(priv->rq);
 	free_percpu(dev->vstats);
 	free_netdev(dev);
 }
@@ -285,6 +437,7 @@ static const struct net_device_ops veth_netdev_ops = {
 #endif
 	.ndo_get_iflink		= veth_get_iflink,
 	.ndo_features_check	= passthru_features_check,
+	.ndo_set_features	= veth_set_features,
 };
 
 #define VETH_FEATURES (NETIF_F_SG | NETIF_F_FRAGLIST | NETIF_F_ALL_TSO |    \
@@ -338,6 +491,13 @@ static int veth_validate(struct nlattr *tb[], struct nlattr *data[])
 
 static struct rtnl_link_ops veth_link_ops;
 
+/* NAPI mode is opt-in: start with GRO off, which keeps to netif_rx() */
+static void veth_disable_gro(struct net_device *dev)
+{
+	dev->features &= ~NETIF_F_GRO;
+	dev->wanted_features &= ~NETIF_F_GRO;
+}
+
 static int veth_newlink(struct net *src_net, struct net_device *dev,
 			 struct nlattr *tb[], struct nlattr *data[])
 {
@@ -406,6 +566,7 @@ static int veth_newlink(struct net *src_net, struct net_device *dev,
 		goto err_register_peer;
 
 	netif_carrier_off(peer);
+	veth_disable_gro(peer);
 
 	err = rtnl_configure_link(peer, ifmp);
 	if (err < 0)
@@ -431,6 +592,7 @@ static int veth_newlink(struct net *src_net, struct net_device *dev,
 		goto err_register_dev;
 
 	netif_carrier_off(dev);
+	veth_disable_gro(dev);
 
 	/*
 	 * tie the deviced together
@@ -27,7 +27,10 @@
 #include <linux/slab.h>
 #include <linux/cpu.h>
 #include <linux/average.h>
+#include <linux/bpf.h>
+#include <linux/filter.h>
 #include <net/busy_poll.h>
+#include <net/page_pool.h>
 
 static int napi_weight = NAPI_POLL_WEIGHT;
 module_param(napi_weight, int, 0444);
@@ -81,6 +84,9 @@ struct receive_queue {
 
 	struct napi_struct napi;
 
+	/* XDP program, reference held by virtnet_info */
+	struct bpf_prog *xdp_prog;
+
 	/* Chain pages by the private ptr. */
 	struct page *pages;
 
@@ -90,6 +96,9 @@ struct receive_queue {
 	/* Page frag for packet buffer allocation. */
 	struct page_frag alloc_frag;
 
+	/* Recycles the alloc_frag pages of mergeable receive buffers. */
+	struct page_pool *page_pool;
+
 	/* RX: fragments + linear part + virtio header */
 	struct scatterlist sg[MAX_SKB_FRAGS + 2];
 
@@ -126,6 +135,9 @@ struct virtnet_info {
 	/* Packet virtio header size */
 	u8 hdr_len;
 
+	/* XDP program attached to all receive queues */
+	struct bpf_prog *xdp_prog;
+
 	/* Active statistics */
 	struct virtnet_stats __percpu *stats;
 
@@ -317,14 +329,56 @@ static struct sk_buff *page_to_skb(struct virtnet_info *vi,
 	return skb;
 }
 
-static struct sk_buff *receive_small(struct virtnet_info *vi, void *buf, unsigned int len)
+static u32 do_xdp_prog(struct bpf_prog *xdp_prog, void *data,
+		       unsigned int len)
+{
+	struct xdp_buff xdp;
+	u32 act;
+
+	xdp.data = data;
+	xdp.len = len;
+
+	act = bpf_prog_run_xdp(xdp_prog, &xdp);
+	switch (act) {
+	case XDP_PASS:
+	case XDP_TX:
+		return act;
+	default:
+		bpf_warn_invalid_xdp_action(act);
+	case XDP_ABORTED:
+	case XDP_DROP:
+		return XDP_DROP;
+	}
+}
+
+static struct sk_buff *receive_small(struct virtnet_info *vi,
+				     struct receive_queue *rq,
+				     void *buf, unsigned int len)
 {
 	struct sk_buff * skb = buf;
+	struct bpf_prog *xdp_prog;
+	u32 act = XDP_PASS;
 
 	len -= vi->hdr_len;
 	skb_trim(skb, len);
 
-	return skb;
+	rcu_read_lock();
+	xdp_prog = READ_ONCE(rq->xdp_prog);
+	if (xdp_prog)
+		act = do_xdp_prog(xdp_prog, skb->data, len);
+	rcu_read_unlock();
+
+	switch (act) {
+	case XDP_PASS:
+		return skb;
+	case XDP_TX:
+		xdp_do_tx_skb(skb, vi->dev);
+		return NULL;
+	default:
+		vi->dev->stats.rx_dropped++;
+		dev_kfree_skb(skb);
+		return NULL;
+	}
 }
 
 static struct sk_buff *receive_big(struct net_device *dev,
@@ -359,13 +413,39 @@ static struct sk_buff *receive_mergeable(struct net_device *dev,
 	struct page *page = virt_to_head_page(buf);
 	int offset = buf - page_address(page);
 	unsigned int truesize = max(len, mergeable_ctx_to_buf_truesize(ctx));
+	struct sk_buff *head_skb = NULL, *curr_skb;
+	struct bpf_prog *xdp_prog;
+	u32 act = XDP_PASS;
+
+	rcu_read_lock();
+	xdp_prog = READ_ONCE(rq->xdp_prog);
+	if (xdp_prog) {
+		/* frames spanning several buffers can't be handed to the
+		 * program, which virtnet_xdp_set tries to rule out
+		 */
+		if (unlikely(num_buf > 1)) {
+			rcu_read_unlock();
+			goto err_skb;
+		}
+		act = do_xdp_prog(xdp_prog, buf + sizeof(*hdr),
+				  len - vi->hdr_len);
+	}
+	rcu_read_unlock();
 
-	struct sk_buff *head_skb = page_to_skb(vi, rq, page, offset, len,
-					       truesize);
-	struct sk_buff *curr_skb = head_skb;
+	if (act == XDP_DROP)
+		goto err_skb;
+
+	head_skb = page_to_skb(vi, rq, page, offset, len, truesize);
+	curr_skb = head_skb;
 
 	if (unlikely(!curr_skb))
 		goto err_skb;
+
+	if (act == XDP_TX) {
+		xdp_do_tx_skb(head_skb, dev);
+		return NULL;
+	}
+
 	while (--num_buf) {
 		int num_skb_frags;
 
@@ -463,7 +543,7 @@ static void receive_buf(struct virtnet_info *vi, struct receive_queue *rq,
 	else if (vi->big_packets)
 		skb = receive_big(dev, vi, rq, buf, len);
 	else
-		skb = receive_small(vi, buf, len);
+		skb = receive_small(vi, rq, buf, len);
 
 	if (unlikely(!skb))
 		return;
@@ -616,6 +696,26 @@ static unsigned int get_mergeable_buf_len(struct ewma_pkt_len *avg_pkt_len)
 	return ALIGN(len, MERGEABLE_BUFFER_ALIGN);
 }
 
+/* Like skb_page_frag_refill(), but takes new pages from the page pool. */
+static bool virtnet_page_frag_refill(struct receive_queue *rq,
+				     unsigned int len, gfp_t gfp)
+{
+	struct page_frag *alloc_frag = &rq->alloc_frag;
+
+	if (alloc_frag->page) {
+		if (alloc_frag->offset + len <= alloc_frag->size)
+			return true;
+		put_page(alloc_frag->page);
+	}
+
+	alloc_frag->page = page_pool_alloc_pages(rq->page_pool, gfp, NULL);
+	if (!alloc_frag->page)
+		return false;
+	alloc_frag->offset = 0;
+	alloc_frag->size = PAGE_SIZE;
+	return true;
+}
+
 static int add_recvbuf_mergeable(struct receive_queue *rq, gfp_t gfp)
 {
 	struct page_frag *alloc_frag = &rq->alloc_frag;
@@ -625,7 +725,7 @@ static int add_recvbuf_mergeable(struct receive_queue *rq, gfp_t gfp)
 	unsigned int len, hole;
 
 	len = get_mergeable_buf_len(&rq->mrg_avg_pkt_len);
-	if (unlikely(!skb_page_frag_refill(len, alloc_frag, gfp)))
+	if (unlikely(!virtnet_page_frag_refill(rq, len, gfp)))
 		return -ENOMEM;
 
 	buf = (char *)page_address(alloc_frag->page) + alloc_frag->offset;
@@ -1392,12 +1492,65 @@ static const struct ethtool_ops virtnet_ethtool_ops = {
 
 static int virtnet_change_mtu(struct net_device *dev, int new_mtu)
 {
+	struct virtnet_info *vi = netdev_priv(dev);
+
 	if (new_mtu < MIN_MTU || new_mtu > MAX_MTU)
 		return -EINVAL;
+	/* XDP programs only see frames that fit in one receive buffer */
+	if (vi->xdp_prog && new_mtu > ETH_DATA_LEN)
+		return -EINVAL;
 	dev->mtu = new_mtu;
 	return 0;
 }
 
+static int virtnet_xdp_set(struct net_device *dev, struct bpf_prog *prog)
+{
+	struct virtnet_info *vi = netdev_priv(dev);
+	struct bpf_prog *old_prog;
+	int i;
+
+	if (prog) {
+		if (vi->big_packets ||
+		    virtio_has_feature(vi->vdev, VIRTIO_NET_F_GUEST_TSO4) ||
+		    virtio_has_feature(vi->vdev, VIRTIO_NET_F_GUEST_TSO6) ||
+		    virtio_has_feature(vi->vdev, VIRTIO_NET_F_GUEST_ECN) ||
+		    virtio_has_feature(vi->vdev, VIRTIO_NET_F_GUEST_UFO)) {
+			netdev_warn(dev, "can't set XDP while host is implementing LRO\n");
+			return -EOPNOTSUPP;
+		}
+
+		if (dev->mtu > ETH_DATA_LEN) {
+			netdev_warn(dev, "XDP requires MTU less than %d\n",
+				    ETH_DATA_LEN + 1);
+			return -EINVAL;
+		}
+	}
+
+	old_prog = xchg(&vi->xdp_prog, prog);
+	for (i = 0; i < vi->max_queue_pairs; i++)
+		WRITE_ONCE(vi->rq[i].xdp_prog, prog);
+
+	if (old_prog)
+		bpf_prog_put_rcu(old_prog);
+
+	return 0;
+}
+
+static int virtnet_xdp(struct net_device *dev, struct netdev_xdp *xdp)
+{
+	struct virtnet_info *vi = netdev_priv(dev);
+
+	switch (xdp->command) {
+	case XDP_SETUP_PROG:
+		return virtnet_xdp_set(dev, xdp->prog);
+	case XDP_QUERY_PROG:
+		xdp->prog_attached = !!vi->xdp_prog;
+		return 0;
+	default:
+		return -EINVAL;
+	}
+}
+
 static const struct net_device_ops virtnet_netdev = {
 	.ndo_open            = virtnet_open,
 	.ndo_stop   	     = virtnet_close,
@@ -1415,6 +1568,7 @@ static const struct net_device_ops virtnet_netdev = {
 #ifdef CONFIG_NET_RX_BUSY_POLL
 	.ndo_busy_poll		= virtnet_busy_poll,
 #endif
+	.ndo_xdp		= virtnet_xdp,
 };
 
 static void virtnet_config_changed_work(struct work_struct *work)
@@ -1482,9 +1636,11 @@ static void free_receive_bufs(struct virtnet_info *vi)
 static void free_receive_page_frags(struct virtnet_info *vi)
 {
 	int i;
-	for (i = 0; i < vi->max_queue_pairs; i++)
+	for (i = 0; i < vi->max_queue_pairs; i++) {
 		if (vi->rq[i].alloc_frag.page)
 			put_page(vi->rq[i].alloc_frag.page);
+		page_pool_destroy(vi->rq[i].page_pool);
+	}
 }
 
 static void free_unused_bufs(struct virtnet_info *vi)
@@ -1614,6 +1770,7 @@ static int virtnet_alloc_queues(struct virtnet_info *vi)
 	INIT_DELAYED_WORK(&vi->refill, refill_work);
 	for (i = 0; i < vi->max_queue_pairs; i++) {
 		vi->rq[i].pages = NULL;
+		vi->rq[i].xdp_prog = vi->xdp_prog;
 		netif_napi_add(vi->dev, &vi->rq[i].napi, virtnet_poll,
 			       napi_weight);
 		napi_hash_add(&vi->rq[i].napi);
@@ -1631,6 +1788,33 @@ err_sq:
 	return -ENOMEM;
 }
 
+static int virtnet_create_page_pools(struct virtnet_info *vi)
+{
+	struct page_pool_params pp = {
+		.order = 0,
+		.nid = NUMA_NO_NODE,
+	};
+	struct page_pool *pool;
+	int i;
+
+	for (i = 0; i < vi->max_queue_pairs; i++) {
+		/* Room for a full ring of buffers and as many in the stack */
+		pp.pool_size = min_t(unsigned int, PP_POOL_SIZE_MAX,
+			roundup_pow_of_two(virtqueue_get_vring_size(vi->rq[i].vq)) * 2);
+		pool = page_pool_create(&pp);
+		if (IS_ERR(pool)) {
+			while (--i >= 0) {
+				page_pool_destroy(vi->rq[i].page_pool);
+				vi->rq[i].page_pool = NULL;
+			}
+			return PTR_ERR(pool);
+		}
+		vi->rq[i].page_pool = pool;
+	}
+
+	return 0;
+}
+
 static int init_vqs(struct virtnet_info *vi)
 {
 	int ret;
@@ -1644,6 +1828,14 @@ static int init_vqs(struct virtnet_info *vi)
 	if (ret)
 		goto err_free;
 
+	if (vi->mergeable_rx_bufs) {
+		ret = virtnet_create_page_pools(vi);
+		if (ret) {
+			virtnet_del_vqs(vi);
+			goto err;
+		}
+	}
+
 	get_online_cpus();
 	virtnet_set_affinity(vi);
 	put_online_cpus();
@@ -1944,6 +2136,9 @@ static void virtnet_remove(struct virtio_device *vdev)
 
 	remove_vq_common(vi);
 
+	if (vi->xdp_prog)
+		bpf_prog_put(vi->xdp_prog);
+
 	free_percpu(vi->stats);
 	free_netdev(vi->dev);
 }
@@ -374,6 +374,7 @@ static void free_msi_irqs(struct pci_dev *dev)
 		}
 
 		list_del(&entry->list);
+		kfree(entry->affinity);
 		kfree(entry);
 	}
 
@@ -545,7 +546,8 @@ error_attrs:
 	return ret;
 }
 
-static struct msi_desc *msi_setup_entry(struct pci_dev *dev, int nvec)
+static struct msi_desc *msi_setup_entry(struct pci_dev *dev, int nvec,
+				       const struct irq_affinity *affd)
 {
 	u16 control;
 	struct msi_desc *entry;
@@ -555,6 +557,15 @@ static struct msi_desc *msi_setup_entry(struct pci_dev *dev, int nvec)
 	if (!entry)
 		return NULL;
 
+	if (affd) {
+		entry->affinity = irq_create_affinity_masks(nvec, affd);
+		if (!entry->affinity && nvec > affd->pre_vectors +
+					   affd->post_vectors) {
+			kfree(entry);
+			return NULL;
+		}
+	}
+
 	pci_read_config_word(dev, dev->msi_cap + PCI_MSI_FLAGS, &control);
 
 	entry->msi_attrib.is_msix	= 0;
@@ -596,6 +607,7 @@ static int msi_verify_entries(struct pci_dev *dev)
  * msi_capability_init - configure device's MSI capability structure
  * @dev: pointer to the pci_dev data structure of MSI device function
  * @nvec: number of interrupts to allocate
+ * @affd: description of automatic irq affinity assignments (may be %NULL)
  *
  * Setup the MSI capability structure of the device with the requested
  * number of interrupts.  A return value of zero indicates the successful
@@ -603,7 +615,8 @@ static int msi_verify_entries(struct pci_dev *dev)
  * an error, and a positive return value indicates the number of interrupts
  * which could have been allocated.
  */
-static int msi_capability_init(struct pci_dev *dev, int nvec)
+static int msi_capability_init(struct pci_dev *dev, int nvec,
+			       const struct irq_affinity *affd)
 {
 	struct msi_desc *entry;
 	int ret;
@@ -611,7 +624,7 @@ static int msi_capability_init(struct pci_dev *dev, int nvec)
 
 	pci_msi_set_enable(dev, 0);	/* Disable MSI during set up */
 
-	entry = msi_setup_entry(dev, nvec);
+	entry = msi_setup_entry(dev, nvec, affd);
 	if (!entry)
 		return -ENOMEM;
 
@@ -674,33 +687,58 @@ static void __iomem *msix_map_region(struct pci_dev *dev, unsigned nr_entries)
 }
 
 static int msix_setup_entries(struct pci_dev *dev, void __iomem *base,
-			      struct msix_entry *entries, int nvec)
+			      struct msix_entry *entries, int nvec,
+			      const struct irq_affinity *affd)
 {
+	struct cpumask *masks = NULL;
 	struct msi_desc *entry;
+	int ret = 0;
 	int i;
 
-	for (i = 0; i < nvec; i++) {
-		entry = alloc_msi_entry(&dev->dev);
-		if (!entry) {
-			if (!i)
-				iounmap(base);
-			else
-				free_msi_irqs(dev);
-			/* No enough memory. Don't try again */
+	if (affd) {
+		masks = irq_create_affinity_masks(nvec, affd);
+		if (!masks && nvec > affd->pre_vectors + affd->post_vectors) {
+			iounmap(base);
 			return -ENOMEM;
 		}
+	}
+
+	for (i = 0; i < nvec; i++) {
+		entry = alloc_msi_entry(&dev->dev);
+		if (!entry)
+			goto err;
 
 		entry->msi_attrib.is_msix	= 1;
 		entry->msi_attrib.is_64		= 1;
-		entry->msi_attrib.entry_nr	= entries[i].entry;
+		entry->msi_attrib.entry_nr	= entries ? entries[i].entry : i;
 		entry->msi_attrib.default_irq	= dev->irq;
 		entry->mask_base		= base;
 		entry->nvec_used		= 1;
 
 		list_add_tail(&entry->list, dev_to_msi_list(&dev->dev));
+
+		/* The vectors outside of the spread aren't managed */
+		if (masks && i >= affd->pre_vectors &&
+		    i < nvec - affd->post_vectors) {
+			entry->affinity = kmemdup(masks + i, sizeof(*masks),
+						  GFP_KERNEL);
+			if (!entry->affinity)
+				goto err;
+		}
 	}
 
-	return 0;
+out:
+	kfree(masks);
+	return ret;
+
+err:
+	if (list_empty(dev_to_msi_list(&dev->dev)))
+		iounmap(base);
+	else
+		free_msi_irqs(dev);
+	/* No enough memory. Don't try again */
+	ret = -ENOMEM;
+	goto out;
 }
 
 static void msix_program_entries(struct pci_dev *dev,
@@ -710,28 +748,30 @@ static void msix_program_entries(struct pci_dev *dev,
 	int i = 0;
 
 	for_each_pci_msi_entry(entry, dev) {
-		int offset = entries[i].entry * PCI_MSIX_ENTRY_SIZE +
+		int offset = entry->msi_attrib.entry_nr * PCI_MSIX_ENTRY_SIZE +
 						PCI_MSIX_ENTRY_VECTOR_CTRL;
 
-		entries[i].vector = entry->irq;
+		if (entries)
+			entries[i++].vector = entry->irq;
 		entry->masked = readl(entry->mask_base + offset);
 		msix_mask_irq(entry, 1);
-		i++;
 	}
 }
 
 /**
  * msix_capability_init - configure device's MSI-X capability
  * @dev: pointer to the pci_dev data structure of MSI-X device function
- * @entries: pointer to an array of struct msix_entry entries
+ * @entries: pointer to an array of struct msix_entry entries, or %NULL
+ *	     for entries 0 to @nvec - 1
  * @nvec: number of @entries
+ * @affd: description of automatic irq affinity assignments (may be %NULL)
  *
  * Setup the MSI-X capability structure of device function with a
  * single MSI-X irq. A return of zero indicates the successful setup of
  * requested MSI-X entries with allocated irqs or non-zero for otherwise.
  **/
-static int msix_capability_init(struct pci_dev *dev,
-				struct msix_entry *entries, int nvec)
+static int msix_capability_init(struct pci_dev *dev, struct msix_entry *entries,
+				int nvec, const struct irq_affinity *affd)
 {
 	int ret;
 	u16 control;
@@ -746,7 +786,7 @@ static int msix_capability_init(struct pci_dev *dev,
 	if (!base)
 		return -ENOMEM;
 
-	ret = msix_setup_entries(dev, base, entries, nvec);
+	ret = msix_setup_entries(dev, base, entries, nvec, affd);
 	if (ret)
 		return ret;
 
@@ -941,7 +981,8 @@ EXPORT_SYMBOL(pci_msix_vec_count);
  * of irqs or MSI-X vectors available. Driver should use the returned value to
  * re-send its request.
  **/
-int pci_enable_msix(struct pci_dev *dev, struct msix_entry *entries, int nvec)
+static int __pci_enable_msix(struct pci_dev *dev, struct msix_entry *entries,
+			     int nvec, const struct irq_affinity *affd)
 {
 	int nr_entries;
 	int i, j;
@@ -949,22 +990,21 @@ int pci_enable_msix(struct pci_dev *dev, struct msix_entry *entries, int nvec)
 	if (!pci_msi_supported(dev, nvec))
 		return -EINVAL;
 
-	if (!entries)
-		return -EINVAL;
-
 	nr_entries = pci_msix_vec_count(dev);
 	if (nr_entries < 0)
 		return nr_entries;
 	if (nvec > nr_entries)
 		return nr_entries;
 
-	/* Check for any invalid entries */
-	for (i = 0; i < nvec; i++) {
-		if (entries[i].entry >= nr_entries)
-			return -EINVAL;		/* invalid entry */
-		for (j = i + 1; j < nvec; j++) {
-			if (entries[i].entry == entries[j].entry)
-				return -EINVAL;	/* duplicate entry */
+	if (entries) {
+		/* Check for any invalid entries */
+		for (i = 0; i < nvec; i++) {
+			if (entries[i].entry >= nr_entries)
+				return -EINVAL;		/* invalid entry */
+			for (j = i + 1; j < nvec; j++) {
+				if (entries[i].entry == entries[j].entry)
+					return -EINVAL;	/* duplicate entry */
+			}
 		}
 	}
 	WARN_ON(!!dev->msix_enabled);
@@ -974,7 +1014,15 @@ int pci_enable_msix(struct pci_dev *dev, struct msix_entry *entries, int nvec)
 		dev_info(&dev->dev, "can't enable MSI-X (MSI IRQ already assigned)\n");
 		return -EINVAL;
 	}
-	return msix_capability_init(dev, entries, nvec);
+	return msix_capability_init(dev, entries, nvec, affd);
+}
+
+int pci_enable_msix(struct pci_dev *dev, struct msix_entry *entries, int nvec)
+{
+	if (!entries)
+		return -EINVAL;
+
+	return __pci_enable_msix(dev, entries, nvec, NULL);
 }
 EXPORT_SYMBOL(pci_enable_msix);
 
@@ -1040,7 +1088,8 @@ void pci_msi_init_pci_dev(struct pci_dev *dev)
  * and updates the @dev's irq member to the lowest new interrupt number;
  * the other interrupt numbers allocated to this device are consecutive.
  **/
-int pci_enable_msi_range(struct pci_dev *dev, int minvec, int maxvec)
+static int __pci_enable_msi_range(struct pci_dev *dev, int minvec, int maxvec,
+				  const struct irq_affinity *affd)
 {
 	int nvec;
 	int rc;
@@ -1068,8 +1117,14 @@ int pci_enable_msi_range(struct pci_dev *dev, int minvec, int maxvec)
 	else if (nvec > maxvec)
 		nvec = maxvec;
 
+	if (affd) {
+		nvec = irq_calc_affinity_vectors(nvec, affd);
+		if (nvec < minvec)
+			return -ENOSPC;
+	}
+
 	do {
-		rc = msi_capability_init(dev, nvec);
+		rc = msi_capability_init(dev, nvec, affd);
 		if (rc < 0) {
 			return rc;
 		} else if (rc > 0) {
@@ -1081,6 +1136,11 @@ int pci_enable_msi_range(struct pci_dev *dev, int minvec, int maxvec)
 
 	return nvec;
 }
+
+int pci_enable_msi_range(struct pci_dev *dev, int minvec, int maxvec)
+{
+	return __pci_enable_msi_range(dev, minvec, maxvec, NULL);
+}
 EXPORT_SYMBOL(pci_enable_msi_range);
 
 /**
@@ -1098,8 +1158,9 @@ EXPORT_SYMBOL(pci_enable_msi_range);
  * indicates the successful configuration of MSI-X capability structure
  * with new allocated MSI-X interrupts.
  **/
-int pci_enable_msix_range(struct pci_dev *dev, struct msix_entry *entries,
-			       int minvec, int maxvec)
+static int __pci_enable_msix_range(struct pci_dev *dev,
+				   struct msix_entry *entries, int minvec,
+				   int maxvec, const struct irq_affinity *affd)
 {
 	int nvec = maxvec;
 	int rc;
@@ -1107,8 +1168,14 @@ int pci_enable_msix_range(struct pci_dev *dev, struct msix_entry *entries,
 	if (maxvec < minvec)
 		return -ERANGE;
 
+	if (affd) {
+		nvec = irq_calc_affinity_vectors(nvec, affd);
+		if (nvec < minvec)
+			return -ENOSPC;
+	}
+
 	do {
-		rc = pci_enable_msix(dev, entries, nvec);
+		rc = __pci_enable_msix(dev, entries, nvec, affd);
 		if (rc < 0) {
 			return rc;
 		} else if (rc > 0) {
@@ -1120,8 +1187,159 @@ int pci_enable_msix_range(struct pci_dev *dev, struct msix_entry *entries,
 
 	return nvec;
 }
+
+int pci_enable_msix_range(struct pci_dev *dev, struct msix_entry *entries,
+			  int minvec, int maxvec)
+{
+	if (!entries)
+		return -EINVAL;
+
+	return __pci_enable_msix_range(dev, entries, minvec, maxvec, NULL);
+}
 EXPORT_SYMBOL(pci_enable_msix_range);
 
+/**
+ * pci_alloc_irq_vectors_affinity - allocate multiple IRQs for a device
+ * @dev:		PCI device to operate on
+ * @min_vecs:		minimum number of vectors required (must be >= 1)
+ * @max_vecs:		maximum (desired) number of vectors
+ * @flags:		flags or quirks for the allocation
+ * @affd:		optional description of the affinity requirements
+ *
+ * Allocate up to @max_vecs interrupt vectors for @dev, using MSI-X or MSI
+ * vectors if available, and fall back to a single legacy vector
+ * if neither is available.  Return the number of vectors allocated,
+ * (which might be smaller than @max_vecs) if successful, or a negative
+ * error code on error. If less than @min_vecs interrupt vectors are
+ * available for @dev the function will fail with -ENOSPC.
+ *
+ * With %PCI_IRQ_AFFINITY the vectors are spread over all cpus, and their
+ * affinity is managed by the kernel from then on.  Vectors split into
+ * sets by @affd can only be allocated all or nothing, so @min_vecs must
+ * equal @max_vecs then.
+ *
+ * To get the Linux IRQ number used for a vector that can be passed to
+ * request_irq() use the pci_irq_vector() helper.
+ */
+int pci_alloc_irq_vectors_affinity(struct pci_dev *dev, unsigned int min_vecs,
+				   unsigned int max_vecs, unsigned int flags,
+				   const struct irq_affinity *affd)
+{
+	static const struct irq_affinity msi_default_affd;
+	int vecs = -ENOSPC;
+
+	if (flags & PCI_IRQ_AFFINITY) {
+		if (!affd)
+			affd = &msi_default_affd;
+		if (affd->nr_sets && min_vecs != max_vecs)
+			return -EINVAL;
+	} else {
+		if (WARN_ON(affd))
+			affd = NULL;
+	}
+
+	if (flags & PCI_IRQ_MSIX) {
+		vecs = __pci_enable_msix_range(dev, NULL, min_vecs, max_vecs,
+					       affd);
+		if (vecs > 0)
+			return vecs;
+	}
+
+	if (flags & PCI_IRQ_MSI) {
+		vecs = __pci_enable_msi_range(dev, min_vecs, max_vecs, affd);
+		if (vecs > 0)
+			return vecs;
+	}
+
+	/* use legacy irq if allowed */
+	if ((flags & PCI_IRQ_LEGACY) && min_vecs == 1 && dev->irq)
+		return 1;
+
+	return vecs;
+}
+EXPORT_SYMBOL(pci_alloc_irq_vectors_affinity);
+
+/**
+ * pci_free_irq_vectors - free previously allocated IRQs for a device
+ * @dev:		PCI device to operate on
+ *
+ * Undoes the allocations and enabling in pci_alloc_irq_vectors().
+ */
+void pci_free_irq_vectors(struct pci_dev *dev)
+{
+	pci_disable_msix(dev);
+	pci_disable_msi(dev);
+}
+EXPORT_SYMBOL(pci_free_irq_vectors);
+
+/**
+ * pci_irq_vector - return Linux IRQ number of a device vector
+ * @dev: PCI device to operate on
+ * @nr: device-relative interrupt vector index (0-based).
+ */
+int pci_irq_vector(struct pci_dev *dev, unsigned int nr)
+{
+	if (dev->msix_enabled) {
+		struct msi_desc *entry;
+		int i = 0;
+
+		for_each_pci_msi_entry(entry, dev) {
+			if (i == nr)
+				return entry->irq;
+			i++;
+		}
+		WARN_ON_ONCE(1);
+		return -EINVAL;
+	}
+
+	if (dev->msi_enabled) {
+		struct msi_desc *entry = first_pci_msi_entry(dev);
+
+		if (WARN_ON_ONCE(nr >= entry->nvec_used))
+			return -EINVAL;
+	} else {
+		if (WARN_ON_ONCE(nr > 0))
+			return -EINVAL;
+	}
+
+	return dev->irq + nr;
+}
+EXPORT_SYMBOL(pci_irq_vector);
+
+/**
+ * pci_irq_get_affinity - return the affinity of a particular msi vector
+ * @dev:	PCI device to operate on
+ * @nr:		device-relative interrupt vector index (0-based).
+ *
+ * Returns %NULL for vectors without managed affinity.
+ */
+const struct cpumask *pci_irq_get_affinity(struct pci_dev *dev, int nr)
+{
+	if (dev->msix_enabled) {
+		struct msi_desc *entry;
+		int i = 0;
+
+		for_each_pci_msi_entry(entry, dev) {
+			if (i == nr)
+				return entry->affinity;
+			i++;
+		}
+		WARN_ON_ONCE(1);
+		return NULL;
+	}
+
+	if (dev->msi_enabled) {
+		struct msi_desc *entry = first_pci_msi_entry(dev);
+
+		if (WARN_ON_ONCE(!entry || nr >= entry->nvec_used))
+			return NULL;
+		return entry->affinity ? entry->affinity + nr : NULL;
+	}
+
+	return NULL;
+}
+EXPORT_SYMBOL(pci_irq_get_affinity);
+
 struct pci_dev *msi_desc_to_pci_dev(struct msi_desc *desc)
 {
 	return to_pci_dev(desc->dev);
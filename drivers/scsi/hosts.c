@@ -34,6 +34,7 @@
 #include <linux/platform_device.h>
 #include <linux/pm_runtime.h>
 
+#include <scsi/scsi_cmnd.h>
 #include <scsi/scsi_device.h>
 #include <scsi/scsi_host.h>
 #include <scsi/scsi_transport.h>
@@ -588,6 +589,37 @@ struct Scsi_Host *scsi_host_get(struct Scsi_Host *shost)
 }
 EXPORT_SYMBOL(scsi_host_get);
 
+static void scsi_host_check_in_flight(struct request *rq, void *data,
+		bool reserved)
+{
+	int *count = data;
+	struct scsi_cmnd *cmd = blk_mq_rq_to_pdu(rq);
+
+	if (test_bit(SCMD_STATE_INFLIGHT, &cmd->state))
+		(*count)++;
+}
+
+/**
+ * scsi_host_busy - Return the number of commands active on the low-level
+ * @shost:	Pointer to Scsi_Host.
+ *
+ * With blk-mq there is no host-wide counter to read; the commands are
+ * counted by walking the tags of the host's tag set instead, so this is
+ * meant for the slow paths only.
+ **/
+int scsi_host_busy(struct Scsi_Host *shost)
+{
+	int cnt = 0;
+
+	if (shost_use_blk_mq(shost))
+		blk_mq_tagset_busy_iter(&shost->tag_set,
+				scsi_host_check_in_flight, &cnt);
+	else
+		cnt = atomic_read(&shost->host_busy);
+	return cnt;
+}
+EXPORT_SYMBOL(scsi_host_busy);
+
 /**
  * scsi_host_put - dec a Scsi_Host ref count
  * @shost:	Pointer to Scsi_Host to dec.
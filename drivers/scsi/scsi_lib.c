@@ -155,7 +155,7 @@ static void __scsi_queue_insert(struct scsi_cmnd *cmd, int reason, int unbusy)
 	 * active on the host/device.
 	 */
 	if (unbusy)
-		scsi_device_unbusy(device);
+		scsi_device_unbusy(device, cmd);
 
 	/*
 	 * Requeue this command.  It will go before all other commands
@@ -306,13 +306,16 @@ static void scsi_init_cmd_errh(struct scsi_cmnd *cmd)
 		cmd->cmd_len = scsi_command_size(cmd->cmnd);
 }
 
-void scsi_device_unbusy(struct scsi_device *sdev)
+void scsi_device_unbusy(struct scsi_device *sdev, struct scsi_cmnd *cmd)
 {
 	struct Scsi_Host *shost = sdev->host;
 	struct scsi_target *starget = scsi_target(sdev);
 	unsigned long flags;
 
-	atomic_dec(&shost->host_busy);
+	if (shost_use_blk_mq(shost))
+		clear_bit(SCMD_STATE_INFLIGHT, &cmd->state);
+	else
+		atomic_dec(&shost->host_busy);
 	if (starget->can_queue > 0)
 		atomic_dec(&starget->target_busy);
 
@@ -402,7 +405,8 @@ static inline bool scsi_target_is_busy(struct scsi_target *starget)
 
 static inline bool scsi_host_is_busy(struct Scsi_Host *shost)
 {
-	if (shost->can_queue > 0 &&
+	/* with blk-mq the host's tag set enforces can_queue */
+	if (!shost_use_blk_mq(shost) && shost->can_queue > 0 &&
 	    atomic_read(&shost->host_busy) >= shost->can_queue)
 		return true;
 	if (atomic_read(&shost->host_blocked) > 0)
@@ -1503,7 +1507,17 @@ static inline int scsi_host_queue_ready(struct request_queue *q,
 	if (scsi_host_in_recovery(shost))
 		return 0;
 
-	busy = atomic_inc_return(&shost->host_busy) - 1;
+	/*
+	 * With blk-mq the host-wide tag set already bounds the number of
+	 * outstanding commands to can_queue, so don't bounce a host-wide
+	 * counter between CPUs for every command.  Only count what is in
+	 * flight when the host is blocked.
+	 */
+	if (q->mq_ops)
+		busy = atomic_read(&shost->host_blocked) > 0 ?
+			scsi_host_busy(shost) : 0;
+	else
+		busy = atomic_inc_return(&shost->host_busy) - 1;
 	if (atomic_read(&shost->host_blocked) > 0) {
 		if (busy)
 			goto starved;
@@ -1519,7 +1533,7 @@ static inline int scsi_host_queue_ready(struct request_queue *q,
 				     "unblocking host at zero depth\n"));
 	}
 
-	if (shost->can_queue > 0 && busy >= shost->can_queue)
+	if (!q->mq_ops && shost->can_queue > 0 && busy >= shost->can_queue)
 		goto starved;
 	if (shost->host_self_blocked)
 		goto starved;
@@ -1540,7 +1554,8 @@ starved:
 		list_add_tail(&sdev->starved_entry, &shost->starved_list);
 	spin_unlock_irq(shost->host_lock);
 out_dec:
-	atomic_dec(&shost->host_busy);
+	if (!q->mq_ops)
+		atomic_dec(&shost->host_busy);
 	return 0;
 }
 
@@ -1960,6 +1975,35 @@ static void scsi_mq_done(struct scsi_cmnd *cmd)
 	blk_mq_complete_request(cmd->request, cmd->request->errors);
 }
 
+static void scsi_mq_put_budget(struct blk_mq_hw_ctx *hctx)
+{
+	struct request_queue *q = hctx->queue;
+	struct scsi_device *sdev = q->queuedata;
+
+	atomic_dec(&sdev->device_busy);
+}
+
+/*
+ * Reserve a slot of the device queue depth before blk-mq takes a request
+ * off its lists.  The slot is given back by scsi_device_unbusy() when the
+ * command completes, or by scsi_queue_rq() if it can't be dispatched.
+ */
+static bool scsi_mq_get_budget(struct blk_mq_hw_ctx *hctx)
+{
+	struct request_queue *q = hctx->queue;
+	struct scsi_device *sdev = q->queuedata;
+
+	if (scsi_dev_queue_ready(q, sdev))
+		return true;
+
+	/* restarted from the completion path, or after a delay if idle */
+	blk_mq_stop_hw_queue(hctx);
+	if (atomic_read(&sdev->device_busy) == 0 &&
+	    !scsi_device_blocked(sdev))
+		blk_mq_delay_queue(hctx, SCSI_QUEUE_DELAY);
+	return false;
+}
+
 static int scsi_queue_rq(struct blk_mq_hw_ctx *hctx,
 			 const struct blk_mq_queue_data *bd)
 {
@@ -1971,22 +2015,20 @@ static int scsi_queue_rq(struct blk_mq_hw_ctx *hctx,
 	int ret;
 	int reason;
 
+	/* the device queue budget was reserved by scsi_mq_get_budget() */
 	ret = prep_to_mq(scsi_prep_state_check(sdev, req));
 	if (ret)
-		goto out;
+		goto out_put_budget;
 
 	ret = BLK_MQ_RQ_QUEUE_BUSY;
 	if (!get_device(&sdev->sdev_gendev))
-		goto out;
+		goto out_put_budget;
 
-	if (!scsi_dev_queue_ready(q, sdev))
-		goto out_put_device;
 	if (!scsi_target_queue_ready(shost, sdev))
-		goto out_dec_device_busy;
+		goto out_put_device;
 	if (!scsi_host_queue_ready(q, shost, sdev))
 		goto out_dec_target_busy;
 
-
 	if (!(req->cmd_flags & REQ_DONTPREP)) {
 		ret = prep_to_mq(scsi_mq_prep_fn(req));
 		if (ret)
@@ -2004,6 +2046,7 @@ static int scsi_queue_rq(struct blk_mq_hw_ctx *hctx,
 	scsi_init_cmd_errh(cmd);
 	cmd->scsi_done = scsi_mq_done;
 
+	set_bit(SCMD_STATE_INFLIGHT, &cmd->state);
 	reason = scsi_dispatch_cmd(cmd);
 	if (reason) {
 		scsi_set_blocked(cmd, reason);
@@ -2014,15 +2057,14 @@ static int scsi_queue_rq(struct blk_mq_hw_ctx *hctx,
 	return BLK_MQ_RQ_QUEUE_OK;
 
 out_dec_host_busy:
-	atomic_dec(&shost->host_busy);
+	clear_bit(SCMD_STATE_INFLIGHT, &cmd->state);
 out_dec_target_busy:
 	if (scsi_target(sdev)->can_queue > 0)
 		atomic_dec(&scsi_target(sdev)->target_busy);
-out_dec_device_busy:
-	atomic_dec(&sdev->device_busy);
 out_put_device:
 	put_device(&sdev->sdev_gendev);
-out:
+out_put_budget:
+	scsi_mq_put_budget(hctx);
 	switch (ret) {
 	case BLK_MQ_RQ_QUEUE_BUSY:
 		blk_mq_stop_hw_queue(hctx);
@@ -2161,6 +2203,8 @@ struct request_queue *scsi_alloc_queue(struct scsi_device *sdev)
 }
 
 static struct blk_mq_ops scsi_mq_ops = {
+	.get_budget	= scsi_mq_get_budget,
+	.put_budget	= scsi_mq_put_budget,
 	.map_queue	= blk_mq_map_queue,
 	.queue_rq	= scsi_queue_rq,
 	.complete	= scsi_softirq_done,
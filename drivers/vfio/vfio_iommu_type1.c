@@ -222,7 +222,7 @@ static int put_pfn(unsigned long pfn, int prot)
 		struct page *page = pfn_to_page(pfn);
 		if (prot & IOMMU_WRITE)
 			SetPageDirty(page);
-		put_page(page);
+		unpin_user_page(page);
 		return 1;
 	}
 	return 0;
@@ -234,7 +234,7 @@ static int vaddr_get_pfn(unsigned long vaddr, int prot, unsigned long *pfn)
 	struct vm_area_struct *vma;
 	int ret = -EFAULT;
 
-	if (get_user_pages_fast(vaddr, 1, !!(prot & IOMMU_WRITE), page) == 1) {
+	if (pin_user_pages_fast(vaddr, 1, !!(prot & IOMMU_WRITE), page) == 1) {
 		*pfn = page_to_pfn(page[0]);
 		return 0;
 	}
@@ -0,0 +1,558 @@
+/*
+ * This work is licensed under the terms of the GNU GPL, version 2.
+ *
+ * virtio-blk server in host kernel.
+ *
+ * Requests are taken off the virtqueues by the vhost worker and submitted
+ * to the backing file, a block device or a regular file, through its
+ * read_iter/write_iter methods.  With an O_DIRECT backend they complete
+ * asynchronously; the completion hands the request back to the worker,
+ * which writes the status byte and returns the buffer to the guest.
+ */
+
+#include <linux/compat.h>
+#include <linux/eventfd.h>
+#include <linux/vhost.h>
+#include <linux/virtio_blk.h>
+#include <linux/miscdevice.h>
+#include <linux/module.h>
+#include <linux/mutex.h>
+#include <linux/file.h>
+#include <linux/fs.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+#include <linux/llist.h>
+#include <linux/uio.h>
+
+#include "vhost.h"
+
+/* Max number of requests handled before giving other virtqueues a chance */
+#define VHOST_BLK_WEIGHT 256
+
+enum {
+	VHOST_BLK_FEATURES = (VHOST_FEATURES & ~(1ULL << VHOST_F_LOG_ALL)) |
+			     (1ULL << VIRTIO_BLK_F_FLUSH)
+};
+
+/* Guest queues handled by one instance */
+#define VHOST_BLK_VQ_MAX 16
+
+struct vhost_blk_req {
+	struct kiocb iocb;
+	struct llist_node node;
+	struct vhost_blk_virtqueue *bvq;
+	u8 __user *status;
+	u16 head;
+	bool in;
+	/* Bytes to transfer, and what actually was or an error */
+	size_t size;
+	long ret;
+	struct iovec iov[];
+};
+
+struct vhost_blk_virtqueue {
+	struct vhost_virtqueue vq;
+	/* Completed requests, waiting for the worker to return them */
+	struct llist_head done;
+	struct vhost_work done_work;
+};
+
+struct vhost_blk {
+	struct vhost_dev dev;
+	struct vhost_blk_virtqueue vqs[VHOST_BLK_VQ_MAX];
+	/* Requests submitted but not yet returned to the guest */
+	atomic_t inflight;
+	wait_queue_head_t inflight_wait;
+};
+
+/* May be called from interrupt context */
+static void vhost_blk_req_done(struct kiocb *iocb, long ret, long ret2)
+{
+	struct vhost_blk_req *req = container_of(iocb, struct vhost_blk_req,
+						 iocb);
+	struct vhost_blk_virtqueue *bvq = req->bvq;
+
+	req->ret = ret;
+	if (llist_add(&req->node, &bvq->done))
+		vhost_work_queue(bvq->vq.dev, &bvq->done_work);
+}
+
+static void vhost_blk_handle_done(struct vhost_work *work)
+{
+	struct vhost_blk_virtqueue *bvq = container_of(work,
+						struct vhost_blk_virtqueue,
+						done_work);
+	struct vhost_virtqueue *vq = &bvq->vq;
+	struct vhost_blk *blk = container_of(vq->dev, struct vhost_blk, dev);
+	struct vhost_blk_req *req, *tmp;
+	struct llist_node *list;
+	int done = 0;
+	u8 status;
+	int len;
+
+	list = llist_del_all(&bvq->done);
+	if (!list)
+		return;
+
+	mutex_lock(&vq->mutex);
+	llist_for_each_entry_safe(req, tmp, list, node) {
+		if (req->ret >= 0 && req->ret == req->size) {
+			status = VIRTIO_BLK_S_OK;
+			len = (req->in ? req->size : 0) + 1;
+		} else {
+			status = req->ret == -EOPNOTSUPP ? VIRTIO_BLK_S_UNSUPP :
+							   VIRTIO_BLK_S_IOERR;
+			len = 1;
+		}
+
+		if (put_user(status, req->status))
+			vq_err(vq, "Failed to write virtio-blk status\n");
+		vhost_add_used(vq, req->head, len);
+		kfree(req);
+		done++;
+	}
+	vhost_signal(&blk->dev, vq);
+	mutex_unlock(&vq->mutex);
+
+	if (atomic_sub_and_test(done, &blk->inflight))
+		wake_up(&blk->inflight_wait);
+}
+
+static void vhost_blk_rw(struct vhost_blk_req *req, struct file *file,
+			 u64 sector, unsigned out, unsigned in)
+{
+	struct iov_iter iter;
+
+	if (req->in) {
+		iov_iter_init(&iter, READ, req->iov + out, in,
+			      iov_length(req->iov + out, in));
+	} else {
+		iov_iter_init(&iter, WRITE, req->iov, out,
+			      iov_length(req->iov, out));
+		iov_iter_advance(&iter, sizeof(struct virtio_blk_outhdr));
+	}
+	req->size = iov_iter_count(&iter);
+
+	req->iocb.ki_filp = file;
+	req->iocb.ki_pos = sector << 9;
+	req->iocb.ki_flags = iocb_flags(file);
+	req->iocb.ki_complete = vhost_blk_req_done;
+
+	if (req->in)
+		req->ret = file->f_op->read_iter(&req->iocb, &iter);
+	else if (file->f_mode & FMODE_WRITE)
+		req->ret = file->f_op->write_iter(&req->iocb, &iter);
+	else
+		req->ret = -EROFS;
+
+	if (req->ret != -EIOCBQUEUED)
+		vhost_blk_req_done(&req->iocb, req->ret, 0);
+}
+
+static int vhost_blk_handle_req(struct vhost_blk_virtqueue *bvq,
+				struct file *file, int head,
+				unsigned out, unsigned in)
+{
+	struct vhost_virtqueue *vq = &bvq->vq;
+	struct vhost_blk *blk = container_of(vq->dev, struct vhost_blk, dev);
+	struct virtio_blk_outhdr hdr;
+	struct vhost_blk_req *req;
+	struct iovec *status;
+	struct iov_iter iter;
+	u32 type;
+
+	/* The status byte ends the last device writable buffer */
+	status = &vq->iov[out + in - 1];
+	if (unlikely(!in || !status->iov_len)) {
+		vq_err(vq, "virtio-blk request without status\n");
+		return -EINVAL;
+	}
+
+	iov_iter_init(&iter, WRITE, vq->iov, out, iov_length(vq->iov, out));
+	if (unlikely(copy_from_iter(&hdr, sizeof(hdr), &iter) != sizeof(hdr))) {
+		vq_err(vq, "Unexpected virtio-blk header size\n");
+		return -EINVAL;
+	}
+
+	req = kmalloc(sizeof(*req) + (out + in) * sizeof(struct iovec),
+		      GFP_KERNEL);
+	if (!req)
+		return -ENOMEM;
+
+	req->bvq = bvq;
+	req->head = head;
+	req->status = status->iov_base + status->iov_len - 1;
+	req->in = false;
+	req->size = 0;
+	memcpy(req->iov, vq->iov, (out + in) * sizeof(struct iovec));
+	req->iov[out + in - 1].iov_len--;
+
+	atomic_inc(&blk->inflight);
+
+	type = vhost32_to_cpu(vq, hdr.type) & ~VIRTIO_BLK_T_BARRIER;
+	switch (type) {
+	case VIRTIO_BLK_T_IN:
+		req->in = true;
+		/* fall through */
+	case VIRTIO_BLK_T_OUT:
+		vhost_blk_rw(req, file, vhost64_to_cpu(vq, hdr.sector),
+			     out, in);
+		break;
+	case VIRTIO_BLK_T_FLUSH:
+		vhost_blk_req_done(&req->iocb, vfs_fsync(file, 0), 0);
+		break;
+	default:
+		vhost_blk_req_done(&req->iocb, -EOPNOTSUPP, 0);
+		break;
+	}
+
+	return 0;
+}
+
+static void handle_blk(struct vhost_blk_virtqueue *bvq)
+{
+	struct vhost_virtqueue *vq = &bvq->vq;
+	struct vhost_blk *blk = container_of(vq->dev, struct vhost_blk, dev);
+	unsigned out, in;
+	struct file *file;
+	int head, r;
+	int count = 0;
+
+	mutex_lock(&vq->mutex);
+	file = vq->private_data;
+	if (!file)
+		goto out;
+
+	vhost_disable_notify(&blk->dev, vq);
+
+	for (;;) {
+		head = vhost_get_vq_desc(vq, vq->iov, ARRAY_SIZE(vq->iov),
+					 &out, &in, NULL, NULL);
+		/* On error, stop handling until the next kick. */
+		if (unlikely(head < 0))
+			break;
+		/* Nothing new?  Wait for eventfd to tell us they refilled. */
+		if (head == vq->num) {
+			if (unlikely(vhost_enable_notify(&blk->dev, vq))) {
+				vhost_disable_notify(&blk->dev, vq);
+				continue;
+			}
+			break;
+		}
+
+		r = vhost_blk_handle_req(bvq, file, head, out, in);
+		if (unlikely(r)) {
+			/* Malformed requests are dropped, like in vhost-net */
+			if (r == -ENOMEM) {
+				vhost_discard_vq_desc(vq, 1);
+				vhost_poll_queue(&vq->poll);
+			}
+			break;
+		}
+
+		if (unlikely(++count >= VHOST_BLK_WEIGHT)) {
+			vhost_poll_queue(&vq->poll);
+			break;
+		}
+	}
+out:
+	mutex_unlock(&vq->mutex);
+}
+
+static void handle_blk_kick(struct vhost_work *work)
+{
+	struct vhost_virtqueue *vq = container_of(work, struct vhost_virtqueue,
+						  poll.work);
+
+	handle_blk(container_of(vq, struct vhost_blk_virtqueue, vq));
+}
+
+static int vhost_blk_open(struct inode *inode, struct file *f)
+{
+	struct vhost_blk *blk;
+	struct vhost_virtqueue **vqs;
+	int i;
+
+	blk = kzalloc(sizeof(*blk), GFP_KERNEL | __GFP_NOWARN | __GFP_REPEAT);
+	if (!blk) {
+		blk = vzalloc(sizeof(*blk));
+		if (!blk)
+			return -ENOMEM;
+	}
+	vqs = kmalloc(VHOST_BLK_VQ_MAX * sizeof(*vqs), GFP_KERNEL);
+	if (!vqs) {
+		kvfree(blk);
+		return -ENOMEM;
+	}
+
+	for (i = 0; i < VHOST_BLK_VQ_MAX; i++) {
+		vqs[i] = &blk->vqs[i].vq;
+		blk->vqs[i].vq.handle_kick = handle_blk_kick;
+		init_llist_head(&blk->vqs[i].done);
+		vhost_work_init(&blk->vqs[i].done_work, vhost_blk_handle_done);
+	}
+	atomic_set(&blk->inflight, 0);
+	init_waitqueue_head(&blk->inflight_wait);
+	vhost_dev_init(&blk->dev, vqs, VHOST_BLK_VQ_MAX);
+
+	f->private_data = blk;
+
+	return 0;
+}
+
+static struct file *vhost_blk_stop_vq(struct vhost_blk *blk,
+				      struct vhost_virtqueue *vq)
+{
+	struct file *file;
+
+	mutex_lock(&vq->mutex);
+	file = vq->private_data;
+	vq->private_data = NULL;
+	mutex_unlock(&vq->mutex);
+	return file;
+}
+
+/* Wait until every submitted request has been returned to the guest */
+static void vhost_blk_flush(struct vhost_blk *blk)
+{
+	int i;
+
+	for (i = 0; i < VHOST_BLK_VQ_MAX; i++)
+		vhost_poll_flush(&blk->vqs[i].vq.poll);
+	wait_event(blk->inflight_wait, !atomic_read(&blk->inflight));
+}
+
+static void vhost_blk_stop(struct vhost_blk *blk, struct file **files)
+{
+	int i;
+
+	for (i = 0; i < VHOST_BLK_VQ_MAX; i++)
+		files[i] = vhost_blk_stop_vq(blk, &blk->vqs[i].vq);
+}
+
+static void vhost_blk_put_files(struct file **files)
+{
+	int i;
+
+	for (i = 0; i < VHOST_BLK_VQ_MAX; i++)
+		if (files[i])
+			fput(files[i]);
+}
+
+static int vhost_blk_release(struct inode *inode, struct file *f)
+{
+	struct vhost_blk *blk = f->private_data;
+	struct file *files[VHOST_BLK_VQ_MAX];
+
+	vhost_blk_stop(blk, files);
+	vhost_blk_flush(blk);
+	vhost_dev_stop(&blk->dev);
+	vhost_dev_cleanup(&blk->dev, false);
+	vhost_blk_put_files(files);
+	kfree(blk->dev.vqs);
+	kvfree(blk);
+	return 0;
+}
+
+static struct file *vhost_blk_get_file(int fd)
+{
+	struct file *file;
+
+	/* special case to disable backend */
+	if (fd == -1)
+		return NULL;
+
+	file = fget(fd);
+	if (!file)
+		return ERR_PTR(-EBADF);
+
+	if (!(file->f_mode & FMODE_READ) ||
+	    !file->f_op->read_iter || !file->f_op->write_iter ||
+	    (!S_ISBLK(file_inode(file)->i_mode) &&
+	     !S_ISREG(file_inode(file)->i_mode))) {
+		fput(file);
+		return ERR_PTR(-EINVAL);
+	}
+
+	return file;
+}
+
+static long vhost_blk_set_backend(struct vhost_blk *blk, unsigned index,
+				  int fd)
+{
+	struct file *file, *oldfile;
+	struct vhost_virtqueue *vq;
+	int r;
+
+	mutex_lock(&blk->dev.mutex);
+	r = vhost_dev_check_owner(&blk->dev);
+	if (r)
+		goto err;
+
+	if (index >= VHOST_BLK_VQ_MAX) {
+		r = -ENOBUFS;
+		goto err;
+	}
+	vq = &blk->vqs[index].vq;
+	mutex_lock(&vq->mutex);
+
+	/* Verify that ring has been setup correctly. */
+	if (!vhost_vq_access_ok(vq)) {
+		r = -EFAULT;
+		goto err_vq;
+	}
+	file = vhost_blk_get_file(fd);
+	if (IS_ERR(file)) {
+		r = PTR_ERR(file);
+		goto err_vq;
+	}
+
+	oldfile = vq->private_data;
+	if (file != oldfile) {
+		vq->private_data = file;
+		r = vhost_init_used(vq);
+		if (r) {
+			vq->private_data = oldfile;
+			goto err_file;
+		}
+	}
+
+	mutex_unlock(&vq->mutex);
+
+	if (oldfile) {
+		/* Requests may still be in flight on the old file */
+		vhost_blk_flush(blk);
+		fput(oldfile);
+	}
+
+	mutex_unlock(&blk->dev.mutex);
+	return 0;
+
+err_file:
+	if (file)
+		fput(file);
+err_vq:
+	mutex_unlock(&vq->mutex);
+err:
+	mutex_unlock(&blk->dev.mutex);
+	return r;
+}
+
+static long vhost_blk_reset_owner(struct vhost_blk *blk)
+{
+	struct file *files[VHOST_BLK_VQ_MAX] = { NULL };
+	struct vhost_memory *memory;
+	long err;
+
+	mutex_lock(&blk->dev.mutex);
+	err = vhost_dev_check_owner(&blk->dev);
+	if (err)
+		goto done;
+	memory = vhost_dev_reset_owner_prepare();
+	if (!memory) {
+		err = -ENOMEM;
+		goto done;
+	}
+	vhost_blk_stop(blk, files);
+	vhost_blk_flush(blk);
+	vhost_dev_reset_owner(&blk->dev, memory);
+done:
+	mutex_unlock(&blk->dev.mutex);
+	vhost_blk_put_files(files);
+	return err;
+}
+
+static int vhost_blk_set_features(struct vhost_blk *blk, u64 features)
+{
+	int i;
+
+	mutex_lock(&blk->dev.mutex);
+	for (i = 0; i < VHOST_BLK_VQ_MAX; ++i) {
+		mutex_lock(&blk->vqs[i].vq.mutex);
+		blk->vqs[i].vq.acked_features = features;
+		mutex_unlock(&blk->vqs[i].vq.mutex);
+	}
+	mutex_unlock(&blk->dev.mutex);
+	return 0;
+}
+
+static long vhost_blk_ioctl(struct file *f, unsigned int ioctl,
+			    unsigned long arg)
+{
+	struct vhost_blk *blk = f->private_data;
+	void __user *argp = (void __user *)arg;
+	u64 __user *featurep = argp;
+	struct vhost_vring_file backend;
+	u64 features;
+	int r;
+
+	switch (ioctl) {
+	case VHOST_BLK_SET_BACKEND:
+		if (copy_from_user(&backend, argp, sizeof backend))
+			return -EFAULT;
+		return vhost_blk_set_backend(blk, backend.index, backend.fd);
+	case VHOST_GET_FEATURES:
+		features = VHOST_BLK_FEATURES;
+		if (copy_to_user(featurep, &features, sizeof features))
+			return -EFAULT;
+		return 0;
+	case VHOST_SET_FEATURES:
+		if (copy_from_user(&features, featurep, sizeof features))
+			return -EFAULT;
+		if (features & ~VHOST_BLK_FEATURES)
+			return -EOPNOTSUPP;
+		return vhost_blk_set_features(blk, features);
+	case VHOST_RESET_OWNER:
+		return vhost_blk_reset_owner(blk);
+	default:
+		mutex_lock(&blk->dev.mutex);
+		r = vhost_dev_ioctl(&blk->dev, ioctl, argp);
+		if (r == -ENOIOCTLCMD)
+			r = vhost_vring_ioctl(&blk->dev, ioctl, argp);
+		else
+			vhost_blk_flush(blk);
+		mutex_unlock(&blk->dev.mutex);
+		return r;
+	}
+}
+
+#ifdef CONFIG_COMPAT
+static long vhost_blk_compat_ioctl(struct file *f, unsigned int ioctl,
+				   unsigned long arg)
+{
+	return vhost_blk_ioctl(f, ioctl, (unsigned long)compat_ptr(arg));
+}
+#endif
+
+static const struct file_operations vhost_blk_fops = {
+	.owner          = THIS_MODULE,
+	.release        = vhost_blk_release,
+	.unlocked_ioctl = vhost_blk_ioctl,
+#ifdef CONFIG_COMPAT
+	.compat_ioctl   = vhost_blk_compat_ioctl,
+#endif
+	.open           = vhost_blk_open,
+	.llseek		= noop_llseek,
+};
+
+static struct miscdevice vhost_blk_misc = {
+	.minor = MISC_DYNAMIC_MINOR,
+	.name = "vhost-blk",
+	.fops = &vhost_blk_fops,
+};
+
+static int vhost_blk_init(void)
+{
+	return misc_register(&vhost_blk_misc);
+}
+module_init(vhost_blk_init);
+
+static void vhost_blk_exit(void)
+{
+	misc_deregister(&vhost_blk_misc);
+}
+module_exit(vhost_blk_exit);
+
+MODULE_VERSION("0.0.1");
+MODULE_LICENSE("GPL v2");
+MODULE_DESCRIPTION("Host kernel accelerator for virtio blk");
@@ -27,6 +27,7 @@
 #include <linux/if_vlan.h>
 
 #include <net/sock.h>
+#include <net/busy_poll.h>
 
 #include "vhost.h"
 
@@ -41,6 +42,8 @@ MODULE_PARM_DESC(experimental_zcopytx, "Enable Zero Copy TX;"
 
 /* MAX number of TX used buffers for outstanding zerocopy */
 #define VHOST_MAX_PEND 128
+/* MAX number of copied TX buffers added to the used ring at once */
+#define VHOST_NET_BATCH 64
 #define VHOST_GOODCOPY_LEN 256
 
 /*
@@ -95,6 +98,15 @@ struct vhost_net_virtqueue {
 	/* Reference counting for outstanding ubufs.
 	 * Protected by vq mutex. Writers must also take device mutex. */
 	struct vhost_net_ubuf_ref *ubufs;
+	/* Copied TX buffers in vq->heads not yet added to the used ring.
+	 * Protected by vq mutex, always zero when it is released. */
+	int batched;
+	/* tun backend without zerocopy: the batched TX buffers are not sent
+	 * yet either, tx_iters holds them for tun to take all at once, and
+	 * their iovecs use the first tx_iov_used entries of vq->iov. */
+	bool tx_batch;
+	int tx_iov_used;
+	struct iov_iter tx_iters[VHOST_NET_BATCH];
 };
 
 struct vhost_net {
@@ -197,6 +209,9 @@ static void vhost_net_vq_reset(struct vhost_net *n)
 		n->vqs[i].ubufs = NULL;
 		n->vqs[i].vhost_hlen = 0;
 		n->vqs[i].sock_hlen = 0;
+		n->vqs[i].batched = 0;
+		n->vqs[i].tx_batch = false;
+		n->vqs[i].tx_iov_used = 0;
 	}
 
 }
@@ -287,6 +302,98 @@ static void vhost_zerocopy_callback(struct ubuf_info *ubuf, bool success)
 	rcu_read_unlock_bh();
 }
 
+static u64 busy_clock(void)
+{
+	return local_clock() >> 10;
+}
+
+static bool vhost_can_busy_poll(struct vhost_dev *dev,
+				unsigned long endtime)
+{
+	return likely(!need_resched()) &&
+	       likely(!time_after(busy_clock(), endtime)) &&
+	       likely(!signal_pending(current)) &&
+	       !vhost_has_work(dev);
+}
+
+/* Send the batched packets to tun, up to the first one it has no room
+ * for, and return how many it took. */
+static int vhost_net_tx_send_batch(struct vhost_net_virtqueue *nvq)
+{
+	struct socket *sock = nvq->vq.private_data;
+	struct tun_msg_ctl ctl = {
+		.type = TUN_MSG_PTR,
+		.num = nvq->batched,
+		.ptr = nvq->tx_iters,
+	};
+	struct msghdr msg = {
+		.msg_control = &ctl,
+		.msg_flags = MSG_DONTWAIT,
+	};
+	int sent;
+
+	sent = sock->ops->sendmsg(sock, &msg, 0);
+	return sent < 0 ? 0 : sent;
+}
+
+/* Returns false if tun could not take the whole TX batch.  The buffers it
+ * did not take are given back to the ring, to be sent again when the
+ * socket has room. */
+static bool vhost_net_signal_used(struct vhost_net *net,
+				  struct vhost_net_virtqueue *nvq)
+{
+	struct vhost_virtqueue *vq = &nvq->vq;
+	bool all_sent = true;
+	int sent;
+
+	if (!nvq->batched)
+		return true;
+
+	if (nvq->tx_batch) {
+		sent = vhost_net_tx_send_batch(nvq);
+		if (unlikely(sent < nvq->batched)) {
+			vhost_discard_vq_desc(vq, nvq->batched - sent);
+			nvq->batched = sent;
+			all_sent = false;
+		}
+		nvq->tx_iov_used = 0;
+	}
+
+	if (nvq->batched)
+		vhost_add_used_and_signal_n(&net->dev, vq, vq->heads,
+					    nvq->batched);
+	nvq->batched = 0;
+	return all_sent;
+}
+
+static int vhost_net_tx_get_vq_desc(struct vhost_net *net,
+				    struct vhost_net_virtqueue *nvq,
+				    unsigned int *out_num,
+				    unsigned int *in_num)
+{
+	struct vhost_virtqueue *vq = &nvq->vq;
+	unsigned long uninitialized_var(endtime);
+	int r;
+
+	r = vhost_get_vq_desc(vq, vq->iov + nvq->tx_iov_used,
+			      ARRAY_SIZE(vq->iov) - nvq->tx_iov_used,
+			      out_num, in_num, NULL, NULL);
+	if (r != vq->num || !vq->busyloop_timeout)
+		return r;
+
+	/* Let the guest reclaim what we sent before we spin */
+	if (!vhost_net_signal_used(net, nvq))
+		return -EAGAIN;
+
+	endtime = busy_clock() + vq->busyloop_timeout;
+	while (vhost_can_busy_poll(vq->dev, endtime) &&
+	       vhost_vq_avail_empty(vq->dev, vq))
+		cpu_relax_lowlatency();
+
+	return vhost_get_vq_desc(vq, vq->iov, ARRAY_SIZE(vq->iov),
+				 out_num, in_num, NULL, NULL);
+}
+
 /* Expects to be always run from workqueue - which acts as
  * read-size critical section for our kind of RCU. */
 static void handle_tx(struct vhost_net *net)
@@ -302,6 +409,8 @@ static void handle_tx(struct vhost_net *net)
 		.msg_controllen = 0,
 		.msg_flags = MSG_DONTWAIT,
 	};
+	struct tun_msg_ctl ctl;
+	struct iovec *iov;
 	size_t len, total_len = 0;
 	int err;
 	size_t hdr_size;
@@ -331,10 +440,7 @@ static void handle_tx(struct vhost_net *net)
 			      % UIO_MAXIOV == nvq->done_idx))
 			break;
 
-		head = vhost_get_vq_desc(vq, vq->iov,
-					 ARRAY_SIZE(vq->iov),
-					 &out, &in,
-					 NULL, NULL);
+		head = vhost_net_tx_get_vq_desc(net, nvq, &out, &in);
 		/* On error, stop handling until the next kick. */
 		if (unlikely(head < 0))
 			break;
@@ -352,8 +458,9 @@ static void handle_tx(struct vhost_net *net)
 			break;
 		}
 		/* Skip header. TODO: support TSO. */
-		len = iov_length(vq->iov, out);
-		iov_iter_init(&msg.msg_iter, WRITE, vq->iov, out, len);
+		iov = vq->iov + nvq->tx_iov_used;
+		len = iov_length(iov, out);
+		iov_iter_init(&msg.msg_iter, WRITE, iov, out, len);
 		iov_iter_advance(&msg.msg_iter, hdr_size);
 		/* Sanity check */
 		if (!msg_data_left(&msg)) {
@@ -379,8 +486,10 @@ static void handle_tx(struct vhost_net *net)
 			ubuf->callback = vhost_zerocopy_callback;
 			ubuf->ctx = nvq->ubufs;
 			ubuf->desc = nvq->upend_idx;
-			msg.msg_control = ubuf;
-			msg.msg_controllen = sizeof(ubuf);
+			ctl.type = TUN_MSG_UBUF;
+			ctl.ptr = ubuf;
+			msg.msg_control = &ctl;
+			msg.msg_controllen = sizeof(ctl);
 			ubufs = nvq->ubufs;
 			atomic_inc(&ubufs->refcount);
 			nvq->upend_idx = (nvq->upend_idx + 1) % UIO_MAXIOV;
@@ -388,24 +497,42 @@ static void handle_tx(struct vhost_net *net)
 			msg.msg_control = NULL;
 			ubufs = NULL;
 		}
-		/* TODO: Check specific error and bomb out unless ENOBUFS? */
-		err = sock->ops->sendmsg(sock, &msg, len);
-		if (unlikely(err < 0)) {
-			if (zcopy_used) {
-				vhost_net_ubuf_put(ubufs);
-				nvq->upend_idx = ((unsigned)nvq->upend_idx - 1)
-					% UIO_MAXIOV;
+		if (nvq->tx_batch) {
+			/* Sent along with the rest of the batch */
+			nvq->tx_iters[nvq->batched] = msg.msg_iter;
+			nvq->tx_iov_used += out;
+			err = len;
+		} else {
+			/* TODO: Check specific error and bomb out unless ENOBUFS? */
+			err = sock->ops->sendmsg(sock, &msg, len);
+			if (unlikely(err < 0)) {
+				if (zcopy_used) {
+					vhost_net_ubuf_put(ubufs);
+					nvq->upend_idx = ((unsigned)nvq->upend_idx - 1)
+						% UIO_MAXIOV;
+				}
+				vhost_discard_vq_desc(vq, 1);
+				break;
 			}
-			vhost_discard_vq_desc(vq, 1);
-			break;
 		}
 		if (err != len)
 			pr_debug("Truncated TX packet: "
 				 " len %d != %zd\n", err, len);
-		if (!zcopy_used)
-			vhost_add_used_and_signal(&net->dev, vq, head, 0);
-		else
+		if (zcopy_used)
 			vhost_zerocopy_signal_used(net, vq);
+		else if (zcopy)
+			vhost_add_used_and_signal(&net->dev, vq, head, 0);
+		else {
+			/* vq->heads is only used for zerocopy otherwise */
+			vq->heads[nvq->batched].id = cpu_to_vhost32(vq, head);
+			vq->heads[nvq->batched].len = 0;
+			/* Flush early too if a batch of long chains could
+			 * leave no room in vq->iov for the next one */
+			if ((++nvq->batched == VHOST_NET_BATCH ||
+			     nvq->tx_iov_used > ARRAY_SIZE(vq->iov) / 2) &&
+			    !vhost_net_signal_used(net, nvq))
+				break;
+		}
 		total_len += len;
 		vhost_net_tx_packet(net);
 		if (unlikely(total_len >= VHOST_NET_WEIGHT)) {
@@ -413,6 +540,7 @@ static void handle_tx(struct vhost_net *net)
 			break;
 		}
 	}
+	vhost_net_signal_used(net, nvq);
 out:
 	mutex_unlock(&vq->mutex);
 }
@@ -435,6 +563,43 @@ static int peek_head_len(struct sock *sk)
 	return len;
 }
 
+static bool vhost_sk_has_rx_data(struct sock *sk)
+{
+	if (sk_can_busy_loop(sk))
+		return sk_busy_loop(sk, 1);
+
+	return !skb_queue_empty(&sk->sk_receive_queue);
+}
+
+/* Poll the socket, and the TX ring since we are the only one serving
+ * it, for up to the RX busy loop timeout before giving up on RX. */
+static int vhost_net_rx_peek_head_len(struct vhost_net *net, struct sock *sk)
+{
+	struct vhost_virtqueue *rvq = &net->vqs[VHOST_NET_VQ_RX].vq;
+	struct vhost_virtqueue *tvq = &net->vqs[VHOST_NET_VQ_TX].vq;
+	unsigned long uninitialized_var(endtime);
+	int len = peek_head_len(sk);
+
+	if (len || !rvq->busyloop_timeout)
+		return len;
+
+	/* The RX vq mutex is already held by our caller */
+	mutex_lock_nested(&tvq->mutex, 1);
+	vhost_disable_notify(&net->dev, tvq);
+
+	endtime = busy_clock() + rvq->busyloop_timeout;
+	while (vhost_can_busy_poll(&net->dev, endtime) &&
+	       !vhost_sk_has_rx_data(sk) &&
+	       vhost_vq_avail_empty(&net->dev, tvq))
+		cpu_relax_lowlatency();
+
+	if (vhost_enable_notify(&net->dev, tvq))
+		vhost_poll_queue(&tvq->poll);
+	mutex_unlock(&tvq->mutex);
+
+	return peek_head_len(sk);
+}
+
 /* This is a multi-buffer version of vhost_get_desc, that works if
  *	vq has read descriptors only.
  * @vq		- the relevant virtqueue
@@ -553,7 +718,7 @@ static void handle_rx(struct vhost_net *net)
 		vq->log : NULL;
 	mergeable = vhost_has_feature(vq, VIRTIO_NET_F_MRG_RXBUF);
 
-	while ((sock_len = peek_head_len(sock->sk))) {
+	while ((sock_len = vhost_net_rx_peek_head_len(net, sock->sk))) {
 		sock_len += sock_hlen;
 		vhost_len = sock_len + vhost_hlen;
 		headcount = get_rx_bufs(vq, vq->heads, vhost_len,
@@ -703,6 +868,9 @@ static int vhost_net_open(struct inode *inode, struct file *f)
 		n->vqs[i].done_idx = 0;
 		n->vqs[i].vhost_hlen = 0;
 		n->vqs[i].sock_hlen = 0;
+		n->vqs[i].batched = 0;
+		n->vqs[i].tx_batch = false;
+		n->vqs[i].tx_iov_used = 0;
 	}
 	vhost_dev_init(dev, vqs, VHOST_NET_VQ_MAX);
 
@@ -926,6 +1094,8 @@ static long vhost_net_set_backend(struct vhost_net *n, unsigned index, int fd)
 
 		oldubufs = nvq->ubufs;
 		nvq->ubufs = ubufs;
+		nvq->tx_batch = index == VHOST_NET_VQ_TX && sock && !ubufs &&
+				!IS_ERR(tun_get_socket(sock->file));
 
 		n->tx_packets = 0;
 		n->tx_zcopy_err = 0;
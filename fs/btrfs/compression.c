@@ -755,6 +755,7 @@ static struct {
 static const struct btrfs_compress_op * const btrfs_compress_op[] = {
 	&btrfs_zlib_compress,
 	&btrfs_lzo_compress,
+	&btrfs_zstd_compress,
 };
 
 void __init btrfs_init_compress(void)
@@ -867,7 +868,8 @@ static void free_workspaces(void)
 }
 
 /*
- * given an address space and start/len, compress the bytes.
+ * given an address space and start/len, compress the bytes at the given
+ * level, 0 meaning the default level of the compression type.
  *
  * pages are allocated to hold the compressed result and stored
  * in 'pages'
@@ -885,7 +887,8 @@ static void free_workspaces(void)
  * max_out tells us the max number of bytes that we're allowed to
  * stuff into pages
  */
-int btrfs_compress_pages(int type, struct address_space *mapping,
+int btrfs_compress_pages(int type, unsigned int level,
+			 struct address_space *mapping,
 			 u64 start, unsigned long len,
 			 struct page **pages,
 			 unsigned long nr_dest_pages,
@@ -901,6 +904,9 @@ int btrfs_compress_pages(int type, struct address_space *mapping,
 	if (IS_ERR(workspace))
 		return PTR_ERR(workspace);
 
+	if (btrfs_compress_op[type-1]->set_level)
+		btrfs_compress_op[type-1]->set_level(workspace, level);
+
 	ret = btrfs_compress_op[type-1]->compress_pages(workspace, mapping,
 						      start, len, pages,
 						      nr_dest_pages, out_pages,
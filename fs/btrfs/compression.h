@@ -22,7 +22,8 @@
 void btrfs_init_compress(void);
 void btrfs_exit_compress(void);
 
-int btrfs_compress_pages(int type, struct address_space *mapping,
+int btrfs_compress_pages(int type, unsigned int level,
+			 struct address_space *mapping,
 			 u64 start, unsigned long len,
 			 struct page **pages,
 			 unsigned long nr_dest_pages,
@@ -53,6 +54,9 @@ struct btrfs_compress_op {
 
 	void (*free_workspace)(struct list_head *workspace);
 
+	/* optional, 0 selects the default level of the method */
+	void (*set_level)(struct list_head *workspace, unsigned int level);
+
 	int (*compress_pages)(struct list_head *workspace,
 			      struct address_space *mapping,
 			      u64 start, unsigned long len,
@@ -79,5 +83,6 @@ struct btrfs_compress_op {
 
 extern const struct btrfs_compress_op btrfs_zlib_compress;
 extern const struct btrfs_compress_op btrfs_lzo_compress;
+extern const struct btrfs_compress_op btrfs_zstd_compress;
 
 #endif
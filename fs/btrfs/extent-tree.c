@@ -2656,6 +2656,8 @@ static noinline int __btrfs_run_delayed_refs(struct btrfs_trans_handle *trans,
 		cond_resched();
 	}
 
+	atomic64_add(count, &fs_info->delayed_refs_run);
+
 	/*
 	 * We don't want to include ref heads since we can have empty ref heads
 	 * and those will drastically skew our runtime down since we just do
@@ -2811,78 +2813,101 @@ int btrfs_should_throttle_delayed_refs(struct btrfs_trans_handle *trans,
 	return btrfs_check_space_for_delayed_refs(trans, root);
 }
 
+/*
+ * Delayed refs are run in the background by a single work item per
+ * filesystem on the extent workers.  It runs them in batches, each in its
+ * own handle on the running transaction so that a commit never waits for
+ * more than one batch, for as long as btrfs_should_throttle_delayed_refs()
+ * says there is a backlog.  After a time slice it requeues itself, so that
+ * it does not hog the extent workers.
+ */
+#define BTRFS_ASYNC_DELAYED_REFS_BATCH	64
+#define BTRFS_ASYNC_DELAYED_REFS_SLICE	(NSEC_PER_SEC / 10)
+
 struct async_delayed_refs {
 	struct btrfs_root *root;
-	int count;
-	int error;
-	int sync;
-	struct completion wait;
 	struct btrfs_work work;
 };
 
 static void delayed_ref_async_start(struct btrfs_work *work)
 {
 	struct async_delayed_refs *async;
+	struct btrfs_fs_info *fs_info;
 	struct btrfs_trans_handle *trans;
+	u64 start = ktime_get_ns();
+	int more = 0;
 	int ret;
 
 	async = container_of(work, struct async_delayed_refs, work);
+	fs_info = async->root->fs_info;
 
-	trans = btrfs_join_transaction(async->root);
-	if (IS_ERR(trans)) {
-		async->error = PTR_ERR(trans);
-		goto done;
+	do {
+		/* don't start a transaction just to find nothing to run */
+		trans = btrfs_attach_transaction(async->root);
+		if (IS_ERR(trans))
+			break;
+
+		/*
+		 * trans->sync means that when we call end_transaction, we won't
+		 * wait on delayed refs
+		 */
+		trans->sync = true;
+		ret = btrfs_run_delayed_refs(trans, async->root,
+					     BTRFS_ASYNC_DELAYED_REFS_BATCH);
+
+		/* a committing transaction runs the rest itself */
+		more = !ret && !trans->transaction->delayed_refs.flushing &&
+		       btrfs_should_throttle_delayed_refs(trans, async->root);
+		btrfs_end_transaction(trans, async->root);
+
+		/* let the throttled tasks check their progress */
+		wake_up(&fs_info->delayed_refs_wait);
+	} while (more &&
+		 ktime_get_ns() - start < BTRFS_ASYNC_DELAYED_REFS_SLICE);
+
+	if (more) {
+		btrfs_queue_work(fs_info->extent_workers, &async->work);
+		return;
 	}
 
-	/*
-	 * trans->sync means that when we call end_transaciton, we won't
-	 * wait on delayed refs
-	 */
-	trans->sync = true;
-	ret = btrfs_run_delayed_refs(trans, async->root, async->count);
-	if (ret)
-		async->error = ret;
-
-	ret = btrfs_end_transaction(trans, async->root);
-	if (ret && !async->error)
-		async->error = ret;
-done:
-	if (async->sync)
-		complete(&async->wait);
-	else
-		kfree(async);
+	kfree(async);
+	atomic_set(&fs_info->async_delayed_refs, 0);
+	smp_mb__after_atomic();
+	wake_up(&fs_info->delayed_refs_wait);
 }
 
+/*
+ * Kick the background delayed ref worker.  With @wait, also wait until
+ * @count more delayed refs have been run, or the worker has run out of
+ * work.  This throttles the tasks that add refs faster than they can be
+ * run in proportion to what they added, rather than making one of them
+ * run everything that has piled up.
+ */
 int btrfs_async_run_delayed_refs(struct btrfs_root *root,
 				 unsigned long count, int wait)
 {
+	struct btrfs_fs_info *fs_info = root->fs_info;
+	atomic64_t *run = &fs_info->delayed_refs_run;
 	struct async_delayed_refs *async;
-	int ret;
+	u64 target = atomic64_read(run) + count;
 
-	async = kmalloc(sizeof(*async), GFP_NOFS);
-	if (!async)
-		return -ENOMEM;
-
-	async->root = root->fs_info->tree_root;
-	async->count = count;
-	async->error = 0;
-	if (wait)
-		async->sync = 1;
-	else
-		async->sync = 0;
-	init_completion(&async->wait);
-
-	btrfs_init_work(&async->work, btrfs_extent_refs_helper,
-			delayed_ref_async_start, NULL, NULL);
-
-	btrfs_queue_work(root->fs_info->extent_workers, &async->work);
+	if (!atomic_cmpxchg(&fs_info->async_delayed_refs, 0, 1)) {
+		async = kmalloc(sizeof(*async), GFP_NOFS);
+		if (!async) {
+			atomic_set(&fs_info->async_delayed_refs, 0);
+			return -ENOMEM;
+		}
 
-	if (wait) {
-		wait_for_completion(&async->wait);
-		ret = async->error;
-		kfree(async);
-		return ret;
+		async->root = fs_info->tree_root;
+		btrfs_init_work(&async->work, btrfs_extent_refs_helper,
+				delayed_ref_async_start, NULL, NULL);
+		btrfs_queue_work(fs_info->extent_workers, &async->work);
 	}
+
+	if (wait)
+		wait_event(fs_info->delayed_refs_wait,
+			   atomic64_read(run) >= target ||
+			   !atomic_read(&fs_info->async_delayed_refs));
 	return 0;
 }
 
@@ -419,6 +419,7 @@ static noinline void compress_file_range(struct inode *inode,
 	int i;
 	int will_compress;
 	int compress_type = root->fs_info->compress_type;
+	unsigned int compress_level = root->fs_info->compress_level;
 	int redirty = 0;
 
 	/* if this is a small write inside eof, kick off a defrag */
@@ -484,8 +485,11 @@ again:
 			goto cont;
 		}
 
-		if (BTRFS_I(inode)->force_compress)
+		if (BTRFS_I(inode)->force_compress &&
+		    BTRFS_I(inode)->force_compress != compress_type) {
 			compress_type = BTRFS_I(inode)->force_compress;
+			compress_level = 0;
+		}
 
 		/*
 		 * we need to call clear_page_dirty_for_io on each
@@ -498,7 +502,7 @@ again:
 		 */
 		extent_range_clear_dirty_for_io(inode, start, end);
 		redirty = 1;
-		ret = btrfs_compress_pages(compress_type,
+		ret = btrfs_compress_pages(compress_type, compress_level,
 					   inode->i_mapping, start,
 					   total_compressed, pages,
 					   nr_pages, &nr_pages_ret,
@@ -8475,7 +8479,7 @@ static ssize_t btrfs_direct_IO(struct kiocb *iocb, struct iov_iter *iter,
 		 * not unlock the i_mutex at this case.
 		 */
 		if (offset + count <= inode->i_size) {
-			mutex_unlock(&inode->i_mutex);
+			inode_unlock(inode);
 			relock = true;
 		}
 		ret = btrfs_delalloc_reserve_space(inode, offset, count);
@@ -8517,7 +8521,7 @@ out:
 	if (wakeup)
 		inode_dio_end(inode);
 	if (relock)
-		mutex_lock(&inode->i_mutex);
+		inode_lock(inode);
 
 	return ret;
 }
@@ -0,0 +1,411 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License v2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 021110-1307, USA.
+ */
+
+#include <linux/kernel.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+#include <linux/init.h>
+#include <linux/err.h>
+#include <linux/sched.h>
+#include <linux/pagemap.h>
+#include <linux/bio.h>
+#include <linux/zstd.h>
+#include "compression.h"
+
+/* Extents never hold more than 128K of uncompressed data */
+#define ZSTD_BTRFS_MAX_INPUT	(128 * 1024)
+#define ZSTD_BTRFS_DEFAULT_LEVEL 3
+
+struct workspace {
+	void *mem;
+	size_t size;
+	char *buf;
+	unsigned int level;
+	struct list_head list;
+};
+
+static void zstd_free_workspace(struct list_head *ws)
+{
+	struct workspace *workspace = list_entry(ws, struct workspace, list);
+
+	vfree(workspace->mem);
+	kfree(workspace->buf);
+	kfree(workspace);
+}
+
+static struct list_head *zstd_alloc_workspace(void)
+{
+	struct workspace *workspace;
+	struct zstd_parameters params;
+	int level;
+
+	workspace = kzalloc(sizeof(*workspace), GFP_NOFS);
+	if (!workspace)
+		return ERR_PTR(-ENOMEM);
+
+	/* Big enough for decompression and for compressing at any level */
+	workspace->size = zstd_dstream_workspace_bound(ZSTD_BTRFS_MAX_INPUT);
+	for (level = ZSTD_MIN_CLEVEL; level <= ZSTD_MAX_CLEVEL; level++) {
+		params = zstd_get_params(level, ZSTD_BTRFS_MAX_INPUT);
+		workspace->size = max(workspace->size,
+			zstd_cstream_workspace_bound(&params.cparams));
+	}
+	workspace->level = ZSTD_BTRFS_DEFAULT_LEVEL;
+	workspace->mem = vmalloc(workspace->size);
+	workspace->buf = kmalloc(PAGE_CACHE_SIZE, GFP_NOFS);
+	if (!workspace->mem || !workspace->buf)
+		goto fail;
+
+	INIT_LIST_HEAD(&workspace->list);
+
+	return &workspace->list;
+fail:
+	zstd_free_workspace(&workspace->list);
+	return ERR_PTR(-ENOMEM);
+}
+
+static void zstd_set_level(struct list_head *ws, unsigned int level)
+{
+	struct workspace *workspace = list_entry(ws, struct workspace, list);
+
+	workspace->level = level ? level : ZSTD_BTRFS_DEFAULT_LEVEL;
+}
+
+static int zstd_compress_pages(struct list_head *ws,
+			       struct address_space *mapping,
+			       u64 start, unsigned long len,
+			       struct page **pages,
+			       unsigned long nr_dest_pages,
+			       unsigned long *out_pages,
+			       unsigned long *total_in,
+			       unsigned long *total_out,
+			       unsigned long max_out)
+{
+	struct workspace *workspace = list_entry(ws, struct workspace, list);
+	struct zstd_parameters params;
+	struct zstd_cstream *stream;
+	struct zstd_in_buffer in_buf = { NULL, 0, 0 };
+	struct zstd_out_buffer out_buf = { NULL, 0, 0 };
+	struct page *in_page = NULL;
+	struct page *out_page = NULL;
+	unsigned long tot_in = 0;
+	unsigned long tot_out = 0;
+	int nr_pages = 0;
+	size_t ret2;
+	int ret = 0;
+
+	*out_pages = 0;
+	*total_out = 0;
+	*total_in = 0;
+
+	params = zstd_get_params(workspace->level, len);
+	stream = zstd_init_cstream(&params, len, workspace->mem,
+				   workspace->size);
+	if (!stream) {
+		printk(KERN_WARNING "BTRFS: zstd_init_cstream failed\n");
+		ret = -EIO;
+		goto out;
+	}
+
+	in_page = find_get_page(mapping, start >> PAGE_CACHE_SHIFT);
+	in_buf.src = kmap(in_page);
+	in_buf.size = min_t(size_t, len, PAGE_CACHE_SIZE);
+
+	out_page = alloc_page(GFP_NOFS | __GFP_HIGHMEM);
+	if (out_page == NULL) {
+		ret = -ENOMEM;
+		goto out;
+	}
+	pages[nr_pages++] = out_page;
+	out_buf.dst = kmap(out_page);
+	out_buf.size = min_t(size_t, max_out, PAGE_CACHE_SIZE);
+
+	while (1) {
+		ret2 = zstd_compress_stream(stream, &out_buf, &in_buf);
+		if (zstd_is_error(ret2)) {
+			printk(KERN_DEBUG "BTRFS: zstd_compress_stream returned %d\n",
+			       zstd_get_error(ret2));
+			ret = -EIO;
+			goto out;
+		}
+
+		/* we're making it bigger, give up */
+		if (tot_in + in_buf.pos > 8192 &&
+		    tot_in + in_buf.pos < tot_out + out_buf.pos) {
+			ret = -E2BIG;
+			goto out;
+		}
+
+		/* no room left for the compressed data */
+		if (out_buf.pos >= max_out) {
+			tot_out += out_buf.pos;
+			ret = -E2BIG;
+			goto out;
+		}
+
+		/* we need another page for writing out */
+		if (out_buf.pos == out_buf.size) {
+			tot_out += PAGE_CACHE_SIZE;
+			max_out -= PAGE_CACHE_SIZE;
+			kunmap(out_page);
+			if (nr_pages == nr_dest_pages) {
+				out_page = NULL;
+				ret = -E2BIG;
+				goto out;
+			}
+			out_page = alloc_page(GFP_NOFS | __GFP_HIGHMEM);
+			if (out_page == NULL) {
+				ret = -ENOMEM;
+				goto out;
+			}
+			pages[nr_pages++] = out_page;
+			out_buf.dst = kmap(out_page);
+			out_buf.pos = 0;
+			out_buf.size = min_t(size_t, max_out, PAGE_CACHE_SIZE);
+		}
+
+		/* we're all done */
+		if (in_buf.pos >= len) {
+			tot_in += in_buf.pos;
+			break;
+		}
+
+		/* we've read in a full page, get a new one */
+		if (in_buf.pos == in_buf.size) {
+			tot_in += PAGE_CACHE_SIZE;
+			kunmap(in_page);
+			page_cache_release(in_page);
+
+			start += PAGE_CACHE_SIZE;
+			len -= PAGE_CACHE_SIZE;
+			in_page = find_get_page(mapping,
+						start >> PAGE_CACHE_SHIFT);
+			in_buf.src = kmap(in_page);
+			in_buf.pos = 0;
+			in_buf.size = min_t(size_t, len, PAGE_CACHE_SIZE);
+		}
+	}
+
+	while (1) {
+		ret2 = zstd_end_stream(stream, &out_buf);
+		if (zstd_is_error(ret2)) {
+			printk(KERN_DEBUG "BTRFS: zstd_end_stream returned %d\n",
+			       zstd_get_error(ret2));
+			ret = -EIO;
+			goto out;
+		}
+		if (ret2 == 0) {
+			tot_out += out_buf.pos;
+			break;
+		}
+		if (out_buf.pos >= max_out) {
+			tot_out += out_buf.pos;
+			ret = -E2BIG;
+			goto out;
+		}
+
+		tot_out += PAGE_CACHE_SIZE;
+		max_out -= PAGE_CACHE_SIZE;
+		kunmap(out_page);
+		if (nr_pages == nr_dest_pages) {
+			out_page = NULL;
+			ret = -E2BIG;
+			goto out;
+		}
+		out_page = alloc_page(GFP_NOFS | __GFP_HIGHMEM);
+		if (out_page == NULL) {
+			ret = -ENOMEM;
+			goto out;
+		}
+		pages[nr_pages++] = out_page;
+		out_buf.dst = kmap(out_page);
+		out_buf.pos = 0;
+		out_buf.size = min_t(size_t, max_out, PAGE_CACHE_SIZE);
+	}
+
+	if (tot_out >= tot_in) {
+		ret = -E2BIG;
+		goto out;
+	}
+
+	ret = 0;
+	*total_in = tot_in;
+	*total_out = tot_out;
+out:
+	*out_pages = nr_pages;
+	if (in_page) {
+		kunmap(in_page);
+		page_cache_release(in_page);
+	}
+	if (out_page)
+		kunmap(out_page);
+	return ret;
+}
+
+static int zstd_decompress_biovec(struct list_head *ws, struct page **pages_in,
+				  u64 disk_start,
+				  struct bio_vec *bvec,
+				  int vcnt,
+				  size_t srclen)
+{
+	struct workspace *workspace = list_entry(ws, struct workspace, list);
+	struct zstd_dstream *stream;
+	struct zstd_in_buffer in_buf = { NULL, 0, 0 };
+	struct zstd_out_buffer out_buf = { NULL, 0, 0 };
+	unsigned long page_in_index = 0;
+	unsigned long page_out_index = 0;
+	unsigned long total_pages_in = DIV_ROUND_UP(srclen, PAGE_CACHE_SIZE);
+	unsigned long total_out = 0;
+	unsigned long buf_start;
+	unsigned long pg_offset = 0;
+	bool out_full;
+	size_t ret2;
+	int ret = 0;
+
+	stream = zstd_init_dstream(ZSTD_BTRFS_MAX_INPUT, workspace->mem,
+				   workspace->size);
+	if (!stream) {
+		printk(KERN_WARNING "BTRFS: zstd_init_dstream failed\n");
+		return -EIO;
+	}
+
+	in_buf.src = kmap(pages_in[page_in_index]);
+	in_buf.size = min_t(size_t, srclen, PAGE_CACHE_SIZE);
+
+	out_buf.dst = workspace->buf;
+	out_buf.size = PAGE_CACHE_SIZE;
+
+	while (1) {
+		ret2 = zstd_decompress_stream(stream, &out_buf, &in_buf);
+		if (zstd_is_error(ret2)) {
+			printk(KERN_DEBUG "BTRFS: zstd_decompress_stream returned %d\n",
+			       zstd_get_error(ret2));
+			ret = -EIO;
+			goto done;
+		}
+
+		buf_start = total_out;
+		total_out += out_buf.pos;
+		out_full = out_buf.pos == out_buf.size;
+		out_buf.pos = 0;
+
+		if (btrfs_decompress_buf2page(out_buf.dst, buf_start,
+					      total_out, disk_start, bvec,
+					      vcnt, &page_out_index,
+					      &pg_offset) == 0)
+			break;
+
+		/* end of the frame, everything has been handed out */
+		if (ret2 == 0)
+			break;
+
+		/* the decoder may still hold output for a full buffer */
+		if (in_buf.pos == in_buf.size && !out_full) {
+			kunmap(pages_in[page_in_index++]);
+			if (page_in_index >= total_pages_in) {
+				in_buf.src = NULL;
+				ret = -EIO;
+				goto done;
+			}
+			srclen -= PAGE_CACHE_SIZE;
+			in_buf.src = kmap(pages_in[page_in_index]);
+			in_buf.pos = 0;
+			in_buf.size = min_t(size_t, srclen, PAGE_CACHE_SIZE);
+		}
+	}
+	btrfs_clear_biovec_end(bvec, vcnt, page_out_index, pg_offset);
+done:
+	if (in_buf.src)
+		kunmap(pages_in[page_in_index]);
+	return ret;
+}
+
+static int zstd_decompress(struct list_head *ws, unsigned char *data_in,
+			   struct page *dest_page,
+			   unsigned long start_byte,
+			   size_t srclen, size_t destlen)
+{
+	struct workspace *workspace = list_entry(ws, struct workspace, list);
+	struct zstd_dstream *stream;
+	struct zstd_in_buffer in_buf = { data_in, srclen, 0 };
+	struct zstd_out_buffer out_buf = { workspace->buf, PAGE_CACHE_SIZE, 0 };
+	unsigned long total_out = 0;
+	unsigned long pg_offset = 0;
+	size_t ret2;
+	int ret = 0;
+	char *kaddr;
+
+	stream = zstd_init_dstream(ZSTD_BTRFS_MAX_INPUT, workspace->mem,
+				   workspace->size);
+	if (!stream) {
+		printk(KERN_WARNING "BTRFS: zstd_init_dstream failed\n");
+		return -EIO;
+	}
+
+	destlen = min_t(size_t, destlen, PAGE_SIZE);
+
+	while (pg_offset < destlen) {
+		unsigned long buf_start = total_out;
+		unsigned long buf_offset;
+		unsigned long bytes;
+
+		out_buf.pos = 0;
+		ret2 = zstd_decompress_stream(stream, &out_buf, &in_buf);
+		if (zstd_is_error(ret2)) {
+			ret = -EIO;
+			break;
+		}
+		total_out += out_buf.pos;
+
+		if (total_out > start_byte) {
+			buf_offset = start_byte > buf_start ?
+				     start_byte - buf_start : 0;
+			bytes = min_t(unsigned long,
+				      total_out - buf_start - buf_offset,
+				      destlen - pg_offset);
+
+			kaddr = kmap_atomic(dest_page);
+			memcpy(kaddr + pg_offset, workspace->buf + buf_offset,
+			       bytes);
+			kunmap_atomic(kaddr);
+			pg_offset += bytes;
+		}
+
+		/* end of the frame, or no input left to make progress with */
+		if (ret2 == 0 || total_out == buf_start)
+			break;
+	}
+
+	/*
+	 * btrfs_get_block is responsible for zeroing from the end of the
+	 * inline extent (destlen) to the end of the page
+	 */
+	if (pg_offset < destlen) {
+		kaddr = kmap_atomic(dest_page);
+		memset(kaddr + pg_offset, 0, destlen - pg_offset);
+		kunmap_atomic(kaddr);
+	}
+	return ret;
+}
+
+const struct btrfs_compress_op btrfs_zstd_compress = {
+	.alloc_workspace	= zstd_alloc_workspace,
+	.free_workspace		= zstd_free_workspace,
+	.set_level		= zstd_set_level,
+	.compress_pages		= zstd_compress_pages,
+	.decompress_biovec	= zstd_decompress_biovec,
+	.decompress		= zstd_decompress,
+};
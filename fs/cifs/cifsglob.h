@@ -63,6 +63,12 @@
  */
 #define CIFS_MAX_REQ 32767
 
+/*
+ * Connections per SMB3 session with multichannel, counting the first one
+ */
+#define CIFS_DEF_CHANNELS 2
+#define CIFS_MAX_CHANNELS 16
+
 #define RFC1001_NAME_LEN 15
 #define RFC1001_NAME_LEN_WITH_NULL (RFC1001_NAME_LEN + 1)
 
@@ -494,11 +500,14 @@ struct smb_vol {
 	bool multiuser:1;
 	bool rwpidforward:1; /* pid forward for read/write operations */
 	bool nosharesock:1;
+	bool multichannel:1;
+	bool is_channel:1; /* not an option: connection for a session channel */
 	bool persistent:1;
 	bool nopersistent:1;
 	bool resilient:1; /* noresilient not required since not fored for CA */
 	unsigned int rsize;
 	unsigned int wsize;
+	unsigned int max_channels;
 	bool sockopt_tcp_nodelay:1;
 	unsigned long actimeo; /* attribute cache timeout (jiffies) */
 	struct smb_version_operations *ops;
@@ -573,6 +582,7 @@ struct TCP_Server_Info {
 	__u16 sec_mode;
 	bool sign; /* is signing enabled on this connection? */
 	bool session_estab; /* mark when very first sess is established */
+	bool is_channel; /* extra channel of one session, never shared */
 #ifdef CONFIG_CIFS_SMB2
 	int echo_credits;  /* echo reserved slots */
 	int oplock_credits;  /* oplock break reserved slots */
@@ -811,6 +821,16 @@ struct cifs_ses {
 	__u16 session_flags;
 	char smb3signingkey[SMB3_SIGN_KEY_SIZE]; /* for signing smb3 packets */
 #endif /* CONFIG_CIFS_SMB2 */
+	/*
+	 * SMB3 multichannel: each extra connection bound to this session is
+	 * represented by a cifs_ses of its own, which sits on the smb_ses_list
+	 * of that connection and holds the channel's signing key. chans[] is
+	 * filled in before the session is published and not changed after.
+	 */
+	struct cifs_ses *chan_primary; /* session this is a channel of */
+	unsigned int chan_count;	/* bound channels in chans[] */
+	atomic_t chan_seq;		/* round robin cursor */
+	struct cifs_ses *chans[CIFS_MAX_CHANNELS - 1];
 };
 
 static inline bool
@@ -1087,6 +1107,7 @@ struct cifs_readdata {
 	unsigned int			pagesz;
 	unsigned int			tailsz;
 	unsigned int			credits;
+	struct TCP_Server_Info		*server; /* channel it was sent on */
 	unsigned int			nr_pages;
 	struct page			*pages[];
 };
@@ -1108,6 +1129,7 @@ struct cifs_writedata {
 	unsigned int			pagesz;
 	unsigned int			tailsz;
 	unsigned int			credits;
+	struct TCP_Server_Info		*server; /* channel it was sent on */
 	unsigned int			nr_pages;
 	struct page			*pages[];
 };
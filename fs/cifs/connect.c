@@ -87,6 +87,7 @@ enum {
 	Opt_sign, Opt_seal, Opt_noac,
 	Opt_fsc, Opt_mfsymlinks,
 	Opt_multiuser, Opt_sloppy, Opt_nosharesock,
+	Opt_multichannel, Opt_nomultichannel,
 	Opt_persistent, Opt_nopersistent,
 	Opt_resilient, Opt_noresilient,
 
@@ -95,6 +96,7 @@ enum {
 	Opt_cruid, Opt_gid, Opt_file_mode,
 	Opt_dirmode, Opt_port,
 	Opt_rsize, Opt_wsize, Opt_actimeo,
+	Opt_max_channels,
 
 	/* Mount options which take string value */
 	Opt_user, Opt_pass, Opt_ip,
@@ -171,6 +173,8 @@ static const match_table_t cifs_mount_option_tokens = {
 	{ Opt_multiuser, "multiuser" },
 	{ Opt_sloppy, "sloppy" },
 	{ Opt_nosharesock, "nosharesock" },
+	{ Opt_multichannel, "multichannel" },
+	{ Opt_nomultichannel, "nomultichannel" },
 	{ Opt_persistent, "persistenthandles"},
 	{ Opt_nopersistent, "nopersistenthandles"},
 	{ Opt_resilient, "resilienthandles"},
@@ -188,6 +192,7 @@ static const match_table_t cifs_mount_option_tokens = {
 	{ Opt_rsize, "rsize=%s" },
 	{ Opt_wsize, "wsize=%s" },
 	{ Opt_actimeo, "actimeo=%s" },
+	{ Opt_max_channels, "max_channels=%s" },
 
 	{ Opt_blank_user, "user=" },
 	{ Opt_blank_user, "username=" },
@@ -1271,6 +1276,7 @@ cifs_parse_mount_options(const char *mountdata, const char *devname,
 	vol->strict_io = true;
 
 	vol->actimeo = CIFS_DEF_ACTIMEO;
+	vol->max_channels = CIFS_DEF_CHANNELS;
 
 	/* FIXME: add autonegotiation -- for now, SMB1 is default */
 	vol->ops = &smb1_operations;
@@ -1503,6 +1509,12 @@ cifs_parse_mount_options(const char *mountdata, const char *devname,
 		case Opt_nosharesock:
 			vol->nosharesock = true;
 			break;
+		case Opt_multichannel:
+			vol->multichannel = true;
+			break;
+		case Opt_nomultichannel:
+			vol->multichannel = false;
+			break;
 		case Opt_nopersistent:
 			vol->nopersistent = true;
 			if (vol->persistent) {
@@ -1624,6 +1636,15 @@ cifs_parse_mount_options(const char *mountdata, const char *devname,
 				goto cifs_parse_mount_err;
 			}
 			break;
+		case Opt_max_channels:
+			if (get_option_ul(args, &option) || option < 1 ||
+			    option > CIFS_MAX_CHANNELS) {
+				cifs_dbg(VFS, "%s: Invalid max_channels value, needs to be 1-%d\n",
+					 __func__, CIFS_MAX_CHANNELS);
+				goto cifs_parse_mount_err;
+			}
+			vol->max_channels = option;
+			break;
 
 		/* String Arguments */
 
@@ -2070,7 +2091,7 @@ static int match_server(struct TCP_Server_Info *server, struct smb_vol *vol)
 {
 	struct sockaddr *addr = (struct sockaddr *)&vol->dstaddr;
 
-	if (vol->nosharesock)
+	if (vol->nosharesock || server->is_channel)
 		return 0;
 
 	if ((server->vals != vol->vals) || (server->ops != vol->ops))
@@ -2176,6 +2197,7 @@ cifs_get_tcp_session(struct smb_vol *volume_info)
 	tcp_ses->noblocksnd = volume_info->noblocksnd;
 	tcp_ses->noautotune = volume_info->noautotune;
 	tcp_ses->tcp_nodelay = volume_info->sockopt_tcp_nodelay;
+	tcp_ses->is_channel = volume_info->is_channel;
 	tcp_ses->in_flight = 0;
 	tcp_ses->credits = 1;
 	init_waitqueue_head(&tcp_ses->response_q);
@@ -2310,6 +2332,51 @@ cifs_find_smb_ses(struct TCP_Server_Info *server, struct smb_vol *vol)
 	return NULL;
 }
 
+static void
+cifs_put_channels(struct cifs_ses *ses)
+{
+	struct cifs_ses *chan;
+
+	while (ses->chan_count) {
+		chan = ses->chans[--ses->chan_count];
+
+		spin_lock(&cifs_tcp_ses_lock);
+		list_del_init(&chan->smb_ses_list);
+		spin_unlock(&cifs_tcp_ses_lock);
+
+		cifs_put_tcp_session(chan->server);
+		sesInfoFree(chan);
+	}
+}
+
+/**
+ * cifs_pick_channel - choose the connection for a read or write
+ * @ses: session the request belongs to
+ *
+ * Goes round robin over the session's own connection and its bound
+ * channels. A channel whose connection was lost is skipped: it is not
+ * bound again, so its traffic falls back to the other connections.
+ */
+struct TCP_Server_Info *
+cifs_pick_channel(struct cifs_ses *ses)
+{
+	struct cifs_ses *chan;
+	unsigned int i;
+
+	if (!ses->chan_count)
+		return ses->server;
+
+	i = (unsigned int)atomic_inc_return(&ses->chan_seq) %
+		(ses->chan_count + 1);
+	if (!i)
+		return ses->server;
+
+	chan = ses->chans[i - 1];
+	if (chan->need_reconnect || chan->server->tcpStatus != CifsGood)
+		return ses->server;
+	return chan->server;
+}
+
 static void
 cifs_put_smb_ses(struct cifs_ses *ses)
 {
@@ -2344,6 +2411,8 @@ cifs_put_smb_ses(struct cifs_ses *ses)
 	list_del_init(&ses->smb_ses_list);
 	spin_unlock(&cifs_tcp_ses_lock);
 
+	/* the logoff above ended the session on every channel */
+	cifs_put_channels(ses);
 	sesInfoFree(ses);
 	cifs_put_tcp_session(server);
 }
@@ -2479,6 +2548,126 @@ cifs_set_cifscreds(struct smb_vol *vol __attribute__((unused)),
 }
 #endif /* CONFIG_KEYS */
 
+#ifdef CONFIG_CIFS_SMB2
+/*
+ * Open one more connection to the server and bind it to @ses. The new
+ * channel is a cifs_ses of its own on that connection, with the same
+ * session id. The binding SESSION_SETUP is signed with the session's
+ * signing key and yields the key for the new channel.
+ */
+static struct cifs_ses *
+cifs_bind_channel(const unsigned int xid, struct cifs_ses *ses,
+		  struct smb_vol *volume_info)
+{
+	struct smb_vol chan_vol = *volume_info;
+	struct TCP_Server_Info *server;
+	struct cifs_ses *chan;
+	int rc = -ENOMEM;
+
+	chan_vol.is_channel = true;
+	server = cifs_get_tcp_session(&chan_vol);
+	if (IS_ERR(server))
+		return ERR_CAST(server);
+	memcpy(server->client_guid, ses->server->client_guid,
+	       SMB2_CLIENT_GUID_SIZE);
+
+	chan = sesInfoAlloc();
+	if (chan == NULL)
+		goto out_put_server;
+
+	chan->server = server;
+	chan->chan_primary = ses;
+	strcpy(chan->serverName, ses->serverName);
+	if (ses->user_name) {
+		chan->user_name = kstrdup(ses->user_name, GFP_KERNEL);
+		if (!chan->user_name)
+			goto out_free_chan;
+	}
+	if (ses->password) {
+		chan->password = kstrdup(ses->password, GFP_KERNEL);
+		if (!chan->password)
+			goto out_free_chan;
+	}
+	if (ses->domainName) {
+		chan->domainName = kstrdup(ses->domainName, GFP_KERNEL);
+		if (!chan->domainName)
+			goto out_free_chan;
+	}
+	chan->cred_uid = ses->cred_uid;
+	chan->linux_uid = ses->linux_uid;
+	chan->sectype = ses->sectype;
+	chan->sign = ses->sign;
+	chan->Suid = ses->Suid;
+	memcpy(chan->smb3signingkey, ses->smb3signingkey, SMB3_SIGN_KEY_SIZE);
+
+	mutex_lock(&chan->session_mutex);
+	rc = cifs_negotiate_protocol(xid, chan);
+	if (!rc && (server->dialect != ses->server->dialect || !server->sign))
+		rc = -EOPNOTSUPP;
+	if (!rc) {
+		/* lets smb2_sign_rqst() find the key for the binding request */
+		server->session_estab = true;
+		spin_lock(&cifs_tcp_ses_lock);
+		list_add(&chan->smb_ses_list, &server->smb_ses_list);
+		spin_unlock(&cifs_tcp_ses_lock);
+
+		rc = cifs_setup_session(xid, chan, volume_info->local_nls);
+	}
+	mutex_unlock(&chan->session_mutex);
+	if (rc)
+		goto out_free_chan;
+
+	return chan;
+
+out_free_chan:
+	spin_lock(&cifs_tcp_ses_lock);
+	list_del_init(&chan->smb_ses_list);
+	spin_unlock(&cifs_tcp_ses_lock);
+	sesInfoFree(chan);
+out_put_server:
+	cifs_put_tcp_session(server);
+	return ERR_PTR(rc);
+}
+
+/*
+ * Bind up to max_channels - 1 extra connections to a new SMB3 session.
+ * The mount goes ahead with whatever could be bound.
+ */
+static void
+cifs_add_channels(const unsigned int xid, struct cifs_ses *ses,
+		  struct smb_vol *volume_info)
+{
+	struct TCP_Server_Info *server = ses->server;
+	struct cifs_ses *chan;
+
+	if (server->dialect < SMB30_PROT_ID ||
+	    !(server->capabilities & SMB2_GLOBAL_CAP_MULTI_CHANNEL)) {
+		cifs_dbg(VFS, "server does not support multichannel\n");
+		return;
+	}
+	if (!server->sign) {
+		cifs_dbg(VFS, "multichannel requires signing\n");
+		return;
+	}
+
+	while (ses->chan_count < volume_info->max_channels - 1) {
+		chan = cifs_bind_channel(xid, ses, volume_info);
+		if (IS_ERR(chan)) {
+			cifs_dbg(VFS, "failed to bind channel %u, rc=%ld\n",
+				 ses->chan_count + 1, PTR_ERR(chan));
+			break;
+		}
+		ses->chans[ses->chan_count++] = chan;
+	}
+}
+#else
+static void
+cifs_add_channels(const unsigned int xid, struct cifs_ses *ses,
+		  struct smb_vol *volume_info)
+{
+}
+#endif /* CONFIG_CIFS_SMB2 */
+
 static struct cifs_ses *
 cifs_get_smb_ses(struct TCP_Server_Info *server, struct smb_vol *volume_info)
 {
@@ -2567,6 +2756,9 @@ cifs_get_smb_ses(struct TCP_Server_Info *server, struct smb_vol *volume_info)
 	if (rc)
 		goto get_ses_fail;
 
+	if (volume_info->multichannel && volume_info->max_channels > 1)
+		cifs_add_channels(xid, ses, volume_info);
+
 	/* success, put it on the list */
 	spin_lock(&cifs_tcp_ses_lock);
 	list_add(&ses->smb_ses_list, &server->smb_ses_list);
@@ -1958,7 +1958,14 @@ int cifs_getattr(struct vfsmount *mnt, struct dentry *dentry,
 	struct cifs_sb_info *cifs_sb = CIFS_SB(dentry->d_sb);
 	struct cifs_tcon *tcon = cifs_sb_master_tcon(cifs_sb);
 	struct inode *inode = d_inode(dentry);
-	int rc;
+	unsigned int query_flags = stat->query_flags;
+	int rc = 0;
+
+	/* statx() callers may only want what is always valid, or the cache */
+	if (!(query_flags & AT_STATX_FORCE_SYNC) &&
+	    ((query_flags & AT_STATX_DONT_SYNC) ||
+	     !(stat->request_mask & ~(STATX_TYPE | STATX_INO))))
+		goto fill;
 
 	/*
 	 * We need to be sure that all dirty pages are written and the server
@@ -1973,10 +1980,14 @@ int cifs_getattr(struct vfsmount *mnt, struct dentry *dentry,
 		}
 	}
 
+	if (query_flags & AT_STATX_FORCE_SYNC)
+		CIFS_I(inode)->time = 0;
+
 	rc = cifs_revalidate_dentry_attr(dentry);
 	if (rc)
 		return rc;
 
+fill:
 	generic_fillattr(inode, stat);
 	stat->blksize = CIFS_MAX_MSGSIZE;
 	stat->ino = CIFS_I(inode)->uniqueid;
@@ -629,8 +629,15 @@ ssetup_ntlmssp_authenticate:
 	if (rc)
 		return rc;
 
-	req->hdr.SessionId = 0; /* First session, not a reauthenticate */
-	req->Flags = 0; /* MBZ */
+	if (ses->chan_primary) {
+		/* bind this connection to the existing session */
+		req->hdr.SessionId = ses->Suid;
+		req->hdr.Flags |= SMB2_FLAGS_SIGNED;
+		req->Flags = SMB2_SESSION_REQ_FLAG_BINDING;
+	} else {
+		req->hdr.SessionId = 0; /* First session, not a reauthenticate */
+		req->Flags = 0; /* MBZ */
+	}
 	/* to enable echos and oplocks */
 	req->hdr.CreditRequest = cpu_to_le16(3);
 
@@ -1940,7 +1947,7 @@ smb2_readv_callback(struct mid_q_entry *mid)
 {
 	struct cifs_readdata *rdata = mid->callback_data;
 	struct cifs_tcon *tcon = tlink_tcon(rdata->cfile->tlink);
-	struct TCP_Server_Info *server = tcon->ses->server;
+	struct TCP_Server_Info *server = rdata->server;
 	struct smb2_hdr *buf = (struct smb2_hdr *)rdata->iov.iov_base;
 	unsigned int credits_received = 1;
 	struct smb_rqst rqst = { .rq_iov = &rdata->iov,
@@ -2016,7 +2023,10 @@ smb2_async_readv(struct cifs_readdata *rdata)
 	io_parms.volatile_fid = rdata->cfile->fid.volatile_fid;
 	io_parms.pid = rdata->pid;
 
-	server = io_parms.tcon->ses->server;
+	/* the caller may have picked a channel and taken credits on it */
+	if (!rdata->server)
+		rdata->server = io_parms.tcon->ses->server;
+	server = rdata->server;
 
 	rc = smb2_new_read_req(&rdata->iov, &io_parms, 0, 0);
 	if (rc) {
@@ -2047,7 +2057,7 @@ smb2_async_readv(struct cifs_readdata *rdata)
 	}
 
 	kref_get(&rdata->refcount);
-	rc = cifs_call_async(io_parms.tcon->ses->server, &rqst,
+	rc = cifs_call_async(server, &rqst,
 			     cifs_readv_receive, smb2_readv_callback,
 			     rdata, flags);
 	if (rc) {
@@ -2119,7 +2129,7 @@ smb2_writev_callback(struct mid_q_entry *mid)
 {
 	struct cifs_writedata *wdata = mid->callback_data;
 	struct cifs_tcon *tcon = tlink_tcon(wdata->cfile->tlink);
-	struct TCP_Server_Info *server = tcon->ses->server;
+	struct TCP_Server_Info *server = wdata->server;
 	unsigned int written;
 	struct smb2_write_rsp *rsp = (struct smb2_write_rsp *)mid->resp_buf;
 	unsigned int credits_received = 1;
@@ -2127,7 +2137,7 @@ smb2_writev_callback(struct mid_q_entry *mid)
 	switch (mid->mid_state) {
 	case MID_RESPONSE_RECEIVED:
 		credits_received = le16_to_cpu(rsp->hdr.CreditRequest);
-		wdata->result = smb2_check_receive(mid, tcon->ses->server, 0);
+		wdata->result = smb2_check_receive(mid, server, 0);
 		if (wdata->result != 0)
 			break;
 
@@ -2162,7 +2172,7 @@ smb2_writev_callback(struct mid_q_entry *mid)
 	mutex_lock(&server->srv_mutex);
 	DeleteMidQEntry(mid);
 	mutex_unlock(&server->srv_mutex);
-	add_credits(tcon->ses->server, credits_received, 0);
+	add_credits(server, credits_received, 0);
 }
 
 /* smb2_async_writev - send an async write, and set up mid to handle result */
@@ -2173,10 +2183,15 @@ smb2_async_writev(struct cifs_writedata *wdata,
 	int rc = -EACCES, flags = 0;
 	struct smb2_write_req *req = NULL;
 	struct cifs_tcon *tcon = tlink_tcon(wdata->cfile->tlink);
-	struct TCP_Server_Info *server = tcon->ses->server;
+	struct TCP_Server_Info *server;
 	struct kvec iov;
 	struct smb_rqst rqst;
 
+	/* the caller may have picked a channel and taken credits on it */
+	if (!wdata->server)
+		wdata->server = tcon->ses->server;
+	server = wdata->server;
+
 	rc = small_smb2_init(SMB2_WRITE, tcon, (void **) &req);
 	if (rc) {
 		if (rc == -EAGAIN && wdata->credits) {
@@ -218,10 +218,10 @@ ssize_t dax_do_io(struct kiocb *iocb, struct inode *inode,
 
 	if ((flags & DIO_LOCKING) && iov_iter_rw(iter) == READ) {
 		struct address_space *mapping = inode->i_mapping;
-		mutex_lock(&inode->i_mutex);
+		inode_lock(inode);
 		retval = filemap_write_and_wait_range(mapping, pos, end - 1);
 		if (retval) {
-			mutex_unlock(&inode->i_mutex);
+			inode_unlock(inode);
 			goto out;
 		}
 	}
@@ -233,7 +233,7 @@ ssize_t dax_do_io(struct kiocb *iocb, struct inode *inode,
 	retval = dax_io(inode, iter, pos, end, get_block, &bh);
 
 	if ((flags & DIO_LOCKING) && iov_iter_rw(iter) == READ)
-		mutex_unlock(&inode->i_mutex);
+		inode_unlock(inode);
 
 	if ((retval > 0) && end_io)
 		end_io(iocb, pos, retval, bh.b_private);
@@ -548,6 +548,12 @@ int __dax_pmd_fault(struct vm_area_struct *vma, unsigned long address,
 	/* Fall back to PTEs if we're going to COW */
 	if (write && !(vma->vm_flags & VM_SHARED))
 		return VM_FAULT_FALLBACK;
+	/*
+	 * A PMD is mapped writable without a ->pfn_mkwrite call, which is
+	 * where MAP_SYNC commits the metadata, so use PTEs for those.
+	 */
+	if (vma->vm_flags & VM_SYNC)
+		return VM_FAULT_FALLBACK;
 	/* If the PMD would extend outside the VMA */
 	if (pmd_addr < vma->vm_start)
 		return VM_FAULT_FALLBACK;
@@ -715,6 +721,35 @@ int dax_pfn_mkwrite(struct vm_area_struct *vma, struct vm_fault *vmf)
 }
 EXPORT_SYMBOL_GPL(dax_pfn_mkwrite);
 
+/**
+ * dax_finish_sync_fault - make the metadata of a MAP_SYNC write fault durable
+ * @vma: The virtual memory area where the fault occurred
+ * @vmf: The description of the fault
+ * @result: The fault result, flagged VM_FAULT_NEEDDSYNC by dax_sync_fault()
+ *
+ * DAX maps shared pages read-only first, and the pte only becomes writable
+ * once ->pfn_mkwrite (or ->page_mkwrite for a hole) has returned.  For a
+ * MAP_SYNC mapping the filesystem flags the fault with dax_sync_fault() in
+ * those handlers and calls this after sb_end_pagefault() and after dropping
+ * its lock against truncate, as fsync may take locks that rank above both.
+ * A truncate that gets in between zaps the pte and the fault is retried.
+ *
+ * Once the block allocation or unwritten extent conversion backing the page
+ * is on stable storage, userspace only needs to flush CPU caches to make its
+ * data persistent.
+ */
+int dax_finish_sync_fault(struct vm_area_struct *vma, struct vm_fault *vmf,
+		int result)
+{
+	loff_t start = (loff_t)vmf->pgoff << PAGE_SHIFT;
+
+	result &= ~VM_FAULT_NEEDDSYNC;
+	if (vfs_fsync_range(vma->vm_file, start, start + PAGE_SIZE - 1, 1))
+		return VM_FAULT_SIGBUS;
+	return result;
+}
+EXPORT_SYMBOL_GPL(dax_finish_sync_fault);
+
 /**
  * dax_zero_page_range - zero a range within a page of a DAX file
  * @inode: The file being truncated
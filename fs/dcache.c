@@ -515,7 +515,9 @@ static void __dentry_kill(struct dentry *dentry)
 	if (dentry->d_flags & DCACHE_OP_PRUNE)
 		dentry->d_op->d_prune(dentry);
 
-	if (dentry->d_flags & DCACHE_LRU_LIST) {
+	if (unlikely(d_in_lookup(dentry)))
+		__d_lookup_done(dentry);
+	else if (dentry->d_flags & DCACHE_LRU_LIST) {
 		if (!(dentry->d_flags & DCACHE_SHRINK_LIST))
 			d_lru_del(dentry);
 	}
@@ -2356,6 +2358,198 @@ struct dentry *d_hash_and_lookup(struct dentry *dir, struct qstr *name)
 }
 EXPORT_SYMBOL(d_hash_and_lookup);
 
+/*
+ * Dentries being looked up with the parent locked shared are kept in a
+ * separate hash, so that concurrent lookups of the same name find them
+ * and wait for ->lookup() to finish instead of calling it again.
+ */
+#define IN_LOOKUP_SHIFT 10
+static struct hlist_bl_head in_lookup_hashtable[1 << IN_LOOKUP_SHIFT];
+
+#define IN_LOOKUP_WAIT_SHIFT 6
+static wait_queue_head_t in_lookup_waitqueue[1 << IN_LOOKUP_WAIT_SHIFT];
+
+static inline struct hlist_bl_head *in_lookup_hash(const struct dentry *parent,
+					unsigned int hash)
+{
+	hash += (unsigned long) parent / L1_CACHE_BYTES;
+	return in_lookup_hashtable + hash_32(hash, IN_LOOKUP_SHIFT);
+}
+
+static inline wait_queue_head_t *in_lookup_wq(const struct dentry *dentry)
+{
+	return in_lookup_waitqueue + hash_ptr(dentry, IN_LOOKUP_WAIT_SHIFT);
+}
+
+/*
+ * ->i_dir_seq of the parent is bumped whenever an in-lookup dentry of it
+ * leaves the in-lookup hash. d_alloc_parallel() samples it before looking
+ * in the dcache and rechecks it under the in-lookup hash chain lock, which
+ * catches a lookup that completed between the two.
+ */
+static inline unsigned start_dir_add(struct inode *dir)
+{
+	for (;;) {
+		unsigned n = dir->i_dir_seq;
+		if (!(n & 1) && cmpxchg(&dir->i_dir_seq, n, n + 1) == n)
+			return n;
+		cpu_relax();
+	}
+}
+
+static inline void end_dir_add(struct inode *dir, unsigned n)
+{
+	smp_store_release(&dir->i_dir_seq, n + 2);
+}
+
+static bool d_same_name(const struct dentry *dentry,
+			const struct dentry *parent,
+			const struct qstr *name)
+{
+	if (parent->d_flags & DCACHE_OP_COMPARE)
+		return parent->d_op->d_compare(parent, dentry,
+					       dentry->d_name.len,
+					       dentry->d_name.name, name) == 0;
+	if (dentry->d_name.len != name->len)
+		return false;
+	return dentry_cmp(dentry, name->name, name->len) == 0;
+}
+
+/* Called with dentry->d_lock held, returns with it held. */
+static void d_wait_lookup(struct dentry *dentry)
+{
+	wait_queue_head_t *wq;
+	DEFINE_WAIT(wait);
+
+	if (!d_in_lookup(dentry))
+		return;
+
+	wq = in_lookup_wq(dentry);
+	do {
+		prepare_to_wait(wq, &wait, TASK_UNINTERRUPTIBLE);
+		spin_unlock(&dentry->d_lock);
+		schedule();
+		spin_lock(&dentry->d_lock);
+	} while (d_in_lookup(dentry));
+	finish_wait(wq, &wait);
+}
+
+/**
+ * d_alloc_parallel - find or allocate a dentry to look up a name
+ * @parent: parent of the entry
+ * @name: qstr of the name, hashed
+ *
+ * For lookups done with the parent's inode locked shared. Returns a
+ * referenced dentry that is either already in the dcache or has been
+ * allocated in-lookup (d_in_lookup() is true). In the latter case the
+ * caller is expected to call ->lookup() on it and then d_lookup_done();
+ * anybody else looking up the same name meanwhile waits for that and
+ * gets its result.
+ *
+ * Returns ERR_PTR(-ENOMEM) if the dentry could not be allocated.
+ */
+struct dentry *d_alloc_parallel(struct dentry *parent,
+				const struct qstr *name)
+{
+	unsigned int hash = name->hash;
+	struct hlist_bl_head *b = in_lookup_hash(parent, hash);
+	struct hlist_bl_node *node;
+	struct dentry *new = d_alloc(parent, name);
+	struct dentry *dentry;
+	unsigned seq;
+
+	if (unlikely(!new))
+		return ERR_PTR(-ENOMEM);
+
+retry:
+	seq = smp_load_acquire(&parent->d_inode->i_dir_seq) & ~1;
+	dentry = d_lookup(parent, name);
+	if (dentry) {
+		dput(new);
+		return dentry;
+	}
+
+	rcu_read_lock();
+	hlist_bl_lock(b);
+	if (unlikely(parent->d_inode->i_dir_seq != seq)) {
+		hlist_bl_unlock(b);
+		rcu_read_unlock();
+		goto retry;
+	}
+	/*
+	 * Entries only leave the chain with the chain locked, so everything
+	 * we find here stays put (and in-lookup) until we unlock it.
+	 */
+	hlist_bl_for_each_entry(dentry, node, b, d_in_lookup_hash) {
+		if (dentry->d_name.hash != hash)
+			continue;
+		if (dentry->d_parent != parent)
+			continue;
+		if (!d_same_name(dentry, parent, name))
+			continue;
+		hlist_bl_unlock(b);
+		if (!lockref_get_not_dead(&dentry->d_lockref)) {
+			rcu_read_unlock();
+			goto retry;
+		}
+		rcu_read_unlock();
+
+		/* somebody else is looking it up; wait for them */
+		spin_lock(&dentry->d_lock);
+		d_wait_lookup(dentry);
+		/*
+		 * If their lookup left a hashed dentry for our name, that is
+		 * what d_lookup() would find; otherwise start over.
+		 */
+		if (unlikely(dentry->d_parent != parent ||
+			     d_unhashed(dentry) ||
+			     !d_same_name(dentry, parent, name))) {
+			spin_unlock(&dentry->d_lock);
+			dput(dentry);
+			goto retry;
+		}
+		spin_unlock(&dentry->d_lock);
+		dput(new);
+		return dentry;
+	}
+	rcu_read_unlock();
+	/*
+	 * Nobody can see @new yet, so no ->d_lock is needed. It becomes
+	 * reachable under RCU now, hence DCACHE_RCUACCESS.
+	 */
+	new->d_flags |= DCACHE_PAR_LOOKUP | DCACHE_RCUACCESS;
+	hlist_bl_add_head(&new->d_in_lookup_hash, b);
+	hlist_bl_unlock(b);
+	return new;
+}
+EXPORT_SYMBOL(d_alloc_parallel);
+
+/**
+ * __d_lookup_done - end the in-lookup state of a dentry
+ * @dentry: the dentry, with ->d_lock held
+ *
+ * Takes @dentry off the in-lookup hash and wakes up everybody waiting in
+ * d_alloc_parallel() for it. If ->lookup() hashed a dentry for the name,
+ * that has to have happened before this.
+ */
+void __d_lookup_done(struct dentry *dentry)
+{
+	struct inode *dir = dentry->d_parent->d_inode;
+	struct hlist_bl_head *b = in_lookup_hash(dentry->d_parent,
+						 dentry->d_name.hash);
+	unsigned n;
+
+	hlist_bl_lock(b);
+	n = start_dir_add(dir);
+	dentry->d_flags &= ~DCACHE_PAR_LOOKUP;
+	__hlist_bl_del(&dentry->d_in_lookup_hash);
+	end_dir_add(dir, n);
+	hlist_bl_unlock(b);
+	INIT_LIST_HEAD(&dentry->d_lru);
+	wake_up_all(in_lookup_wq(dentry));
+}
+EXPORT_SYMBOL(__d_lookup_done);
+
 /*
  * When a file is deleted, we have two options:
  * - turn this dentry into a negative dentry
@@ -2454,7 +2648,7 @@ EXPORT_SYMBOL(d_rehash);
  */
 void dentry_update_name_case(struct dentry *dentry, struct qstr *name)
 {
-	BUG_ON(!mutex_is_locked(&dentry->d_parent->d_inode->i_mutex));
+	BUG_ON(!inode_is_locked(dentry->d_parent->d_inode));
 	BUG_ON(dentry->d_name.len != name->len); /* d_lookup gives this */
 
 	spin_lock(&dentry->d_lock);
@@ -2623,6 +2817,10 @@ static void __d_move(struct dentry *dentry, struct dentry *target,
 			   d_hash(dentry->d_parent, dentry->d_name.hash));
 	}
 
+	/* d_splice_alias() moving an alias over an in-lookup dentry */
+	if (unlikely(d_in_lookup(target)))
+		__d_lookup_done(target);
+
 	/* Switch the names.. */
 	if (exchange)
 		swap_names(dentry, target);
@@ -2719,7 +2917,8 @@ struct dentry *d_ancestor(struct dentry *p1, struct dentry *p2)
 static int __d_unalias(struct inode *inode,
 		struct dentry *dentry, struct dentry *alias)
 {
-	struct mutex *m1 = NULL, *m2 = NULL;
+	struct mutex *m1 = NULL;
+	struct rw_semaphore *m2 = NULL;
 	int ret = -ESTALE;
 
 	/* If alias and dentry share a parent, then no extra locks required */
@@ -2730,15 +2929,15 @@ static int __d_unalias(struct inode *inode,
 	if (!mutex_trylock(&dentry->d_sb->s_vfs_rename_mutex))
 		goto out_err;
 	m1 = &dentry->d_sb->s_vfs_rename_mutex;
-	if (!mutex_trylock(&alias->d_parent->d_inode->i_mutex))
+	if (!inode_trylock_shared(alias->d_parent->d_inode))
 		goto out_err;
-	m2 = &alias->d_parent->d_inode->i_mutex;
+	m2 = &alias->d_parent->d_inode->i_rwsem;
 out_unalias:
 	__d_move(alias, dentry, false);
 	ret = 0;
 out_err:
 	if (m2)
-		mutex_unlock(m2);
+		up_read(m2);
 	if (m1)
 		mutex_unlock(m1);
 	return ret;
@@ -3402,6 +3601,9 @@ static void __init dcache_init(void)
 {
 	unsigned int loop;
 
+	for (loop = 0; loop < ARRAY_SIZE(in_lookup_waitqueue); loop++)
+		init_waitqueue_head(in_lookup_waitqueue + loop);
+
 	/* 
 	 * A constructor could be added for stable state like the lists,
 	 * but it is probably not worth it because of the cache nature
@@ -20,6 +20,7 @@
 #include <linux/errno.h>
 #include <linux/mm.h>
 #include <linux/slab.h>
+#include <linux/vmalloc.h>
 #include <linux/poll.h>
 #include <linux/string.h>
 #include <linux/list.h>
@@ -42,6 +43,7 @@
 #include <linux/seq_file.h>
 #include <linux/compat.h>
 #include <linux/rculist.h>
+#include <net/busy_poll.h>
 
 /*
  * LOCKING:
@@ -92,7 +94,12 @@
  */
 
 /* Epoll private bits inside the event mask */
-#define EP_PRIVATE_BITS (EPOLLWAKEUP | EPOLLONESHOT | EPOLLET)
+#define EP_PRIVATE_BITS (EPOLLWAKEUP | EPOLLONESHOT | EPOLLET | EPOLLEXCLUSIVE)
+
+#define EPOLLINOUT_BITS (POLLIN | POLLOUT)
+
+#define EPOLLEXCLUSIVE_OK_BITS (EPOLLINOUT_BITS | POLLERR | POLLHUP | \
+				EPOLLWAKEUP | EPOLLET | EPOLLEXCLUSIVE)
 
 /* Maximum number of nesting allowed inside epoll sets */
 #define EP_MAX_NESTS 4
@@ -156,6 +163,9 @@ struct epitem {
 	/* Number of active wait queue attached to poll operations */
 	int nwait;
 
+	/* Index of the item in the shared ring header, if polled by user */
+	int bit;
+
 	/* List containing poll wait queues */
 	struct list_head pwqlist;
 
@@ -219,6 +229,23 @@ struct eventpoll {
 	/* used to optimize loop detection check */
 	int visited;
 	struct list_head visited_list_link;
+
+	/*
+	 * Shared ring of an EPOLL_USERPOLL instance: the header with the
+	 * items, the index ring right after it, the bitmap of used items
+	 * (protected by "mtx") and the private copy of the ring tail
+	 * (protected by "lock").
+	 */
+	struct epoll_uheader *user_header;
+	u32 *user_index;
+	unsigned long *items_bm;
+	unsigned int user_nr;
+	u32 user_tail;
+
+#ifdef CONFIG_NET_RX_BUSY_POLL
+	/* used to track busy poll napi_id */
+	unsigned int napi_id;
+#endif
 };
 
 /* Wait structure used by the poll hooks */
@@ -366,6 +393,24 @@ static void ep_nested_calls_init(struct nested_calls *ncalls)
 	spin_lock_init(&ncalls->lock);
 }
 
+static inline bool ep_polled_by_user(struct eventpoll *ep)
+{
+	return ep->user_header != NULL;
+}
+
+/* Number of entries userspace has yet to consume from the index ring */
+static inline unsigned int ep_user_events_nr(struct eventpoll *ep)
+{
+	unsigned int nr = READ_ONCE(ep->user_tail) -
+			  READ_ONCE(ep->user_header->head);
+
+	if (READ_ONCE(ep->user_header->overflow))
+		return max(min(nr, ep->user_nr), 1U);
+
+	/* ->head is written by userspace, don't trust it too much */
+	return min(nr, ep->user_nr);
+}
+
 /**
  * ep_events_available - Checks if ready events might be available.
  *
@@ -376,9 +421,93 @@ static void ep_nested_calls_init(struct nested_calls *ncalls)
  */
 static inline int ep_events_available(struct eventpoll *ep)
 {
+	if (ep_polled_by_user(ep))
+		return ep_user_events_nr(ep) != 0;
+
 	return !list_empty(&ep->rdllist) || ep->ovflist != EP_UNACTIVE_PTR;
 }
 
+#ifdef CONFIG_NET_RX_BUSY_POLL
+static bool ep_busy_loop_end(void *p)
+{
+	struct eventpoll *ep = p;
+
+	return ep_events_available(ep) || signal_pending(current);
+}
+
+/*
+ * Busy poll if globally on and supporting sockets found && no events,
+ * busy loop will return if need_resched or ep_events_available.
+ *
+ * we must do our busy polling with irqs enabled
+ */
+static void ep_busy_loop(struct eventpoll *ep, int nonblock)
+{
+	unsigned int napi_id = READ_ONCE(ep->napi_id);
+
+	if (napi_id && net_busy_loop_on())
+		napi_busy_loop(napi_id, nonblock ? 0 : busy_loop_end_time(),
+			       ep_busy_loop_end, ep);
+}
+
+static inline void ep_reset_busy_poll_napi_id(struct eventpoll *ep)
+{
+	if (ep->napi_id)
+		ep->napi_id = 0;
+}
+
+/*
+ * Set epoll busy poll NAPI ID from sk.
+ */
+static inline void ep_set_busy_poll_napi_id(struct epitem *epi)
+{
+	struct eventpoll *ep;
+	unsigned int napi_id;
+	struct socket *sock;
+	struct sock *sk;
+	int err;
+
+	if (!net_busy_loop_on())
+		return;
+
+	sock = sock_from_file(epi->ffd.file, &err);
+	if (!sock)
+		return;
+
+	sk = sock->sk;
+	if (!sk)
+		return;
+
+	napi_id = READ_ONCE(sk->sk_napi_id);
+	ep = epi->ep;
+
+	/* Non-NAPI IDs can be rejected
+	 *	or
+	 * Nothing to do if we already have this ID
+	 */
+	if (!napi_id || napi_id == ep->napi_id)
+		return;
+
+	/* record NAPI ID for use in next busy poll */
+	ep->napi_id = napi_id;
+}
+
+#else
+
+static inline void ep_busy_loop(struct eventpoll *ep, int nonblock)
+{
+}
+
+static inline void ep_reset_busy_poll_napi_id(struct eventpoll *ep)
+{
+}
+
+static inline void ep_set_busy_poll_napi_id(struct epitem *epi)
+{
+}
+
+#endif /* CONFIG_NET_RX_BUSY_POLL */
+
 /**
  * ep_call_nested - Perform a bound (possibly) nested call, by checking
  *                  that the recursion limit is not exceeded, and that
@@ -679,6 +808,117 @@ static int ep_scan_ready_list(struct eventpoll *ep,
 	return error;
 }
 
+static int ep_alloc_user_ring(struct eventpoll *ep, unsigned int nr)
+{
+	unsigned int header_length, index_length;
+	struct epoll_uheader *header;
+
+	header_length = PAGE_ALIGN(sizeof(*header) +
+				   nr * sizeof(struct epoll_uitem));
+	index_length = PAGE_ALIGN(nr * sizeof(u32));
+
+	ep->items_bm = kcalloc(BITS_TO_LONGS(nr), sizeof(long), GFP_KERNEL);
+	if (!ep->items_bm)
+		return -ENOMEM;
+
+	header = vmalloc_user(header_length + index_length);
+	if (!header) {
+		kfree(ep->items_bm);
+		ep->items_bm = NULL;
+		return -ENOMEM;
+	}
+
+	header->magic = EPOLL_USERPOLL_HEADER_MAGIC;
+	header->header_length = header_length;
+	header->index_length = index_length;
+	header->max_items_nr = nr;
+
+	ep->user_index = (void *)header + header_length;
+	ep->user_nr = nr;
+	ep->user_header = header;
+
+	return 0;
+}
+
+/* Must be called with "mtx" held */
+static int ep_user_get_item(struct eventpoll *ep, struct epitem *epi)
+{
+	struct epoll_uitem *uitem;
+
+	epi->bit = find_first_zero_bit(ep->items_bm, ep->user_nr);
+	if (epi->bit >= ep->user_nr)
+		return -ENOSPC;
+	__set_bit(epi->bit, ep->items_bm);
+
+	uitem = &ep->user_header->items[epi->bit];
+	WRITE_ONCE(uitem->ready_events, 0);
+	WRITE_ONCE(uitem->events, epi->event.events);
+	WRITE_ONCE(uitem->data, epi->event.data);
+
+	return 0;
+}
+
+/*
+ * Must be called with "mtx" held, after the poll callbacks of the item are
+ * gone.  A stale index for the item may still sit in the ring; userspace
+ * finds no ready events behind it and skips it.
+ */
+static void ep_user_put_item(struct eventpoll *ep, struct epitem *epi)
+{
+	struct epoll_uitem *uitem = &ep->user_header->items[epi->bit];
+
+	WRITE_ONCE(uitem->ready_events, 0);
+	WRITE_ONCE(uitem->events, 0);
+	__clear_bit(epi->bit, ep->items_bm);
+}
+
+/*
+ * Report @revents for @epi in the shared ring.  The index of the item is
+ * queued only when its ready events go from zero to non-zero, so an item
+ * sits in the ring at most once until userspace claims it.  Returns true if
+ * waiters should be woken up.  Must be called with "lock" held.
+ */
+static bool ep_user_publish(struct eventpoll *ep, struct epitem *epi,
+			    unsigned int revents)
+{
+	struct epoll_uheader *header = ep->user_header;
+	struct epoll_uitem *uitem = &header->items[epi->bit];
+	u32 old, tail;
+
+	revents &= epi->event.events & ~EP_PRIVATE_BITS;
+	if (!revents)
+		return false;
+
+	do {
+		old = READ_ONCE(uitem->ready_events);
+	} while (cmpxchg(&uitem->ready_events, old, old | revents) != old);
+
+	/* There is no delivery step, so a one shot item is disarmed here */
+	if (epi->event.events & EPOLLONESHOT)
+		epi->event.events &= EP_PRIVATE_BITS;
+
+	if (old)
+		return false;
+
+	tail = ep->user_tail;
+	if (tail - READ_ONCE(header->head) >= ep->user_nr) {
+		/*
+		 * Only stale indexes of removed items can fill the ring up,
+		 * have userspace scan the items instead.
+		 */
+		WRITE_ONCE(header->overflow, 1);
+		return true;
+	}
+
+	ep->user_index[tail & (ep->user_nr - 1)] = epi->bit;
+	/* Userspace must see the index before the new tail */
+	smp_wmb();
+	WRITE_ONCE(ep->user_tail, tail + 1);
+	WRITE_ONCE(header->tail, tail + 1);
+
+	return true;
+}
+
 static void epi_rcu_free(struct rcu_head *head)
 {
 	struct epitem *epi = container_of(head, struct epitem, rcu);
@@ -724,6 +964,9 @@ static int ep_remove(struct eventpoll *ep, struct epitem *epi)
 	 * ep->mtx. The rcu read side, reverse_path_check_proc(), does not make
 	 * use of the rbn field.
 	 */
+	if (ep_polled_by_user(ep))
+		ep_user_put_item(ep, epi);
+
 	call_rcu(&epi->rcu, epi_rcu_free);
 
 	atomic_long_dec(&ep->user->epoll_watches);
@@ -780,6 +1023,8 @@ static void ep_free(struct eventpoll *ep)
 	mutex_destroy(&ep->mtx);
 	free_uid(ep->user);
 	wakeup_source_unregister(ep->ws);
+	vfree(ep->user_header);
+	kfree(ep->items_bm);
 	kfree(ep);
 }
 
@@ -857,6 +1102,10 @@ static unsigned int ep_eventpoll_poll(struct file *file, poll_table *wait)
 	/* Insert inside our poll wait queue */
 	poll_wait(file, &ep->poll_wait, wait);
 
+	/* Nothing to walk, the ring tells */
+	if (ep_polled_by_user(ep))
+		return ep_events_available(ep) ? POLLIN | POLLRDNORM : 0;
+
 	/*
 	 * Proceed to find out if wanted events are really available inside
 	 * the ready list. This need to be done under ep_call_nested()
@@ -889,6 +1138,17 @@ static void ep_show_fdinfo(struct seq_file *m, struct file *f)
 }
 #endif
 
+static int ep_eventpoll_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	struct eventpoll *ep = file->private_data;
+
+	if (!ep_polled_by_user(ep))
+		return -ENODEV;
+
+	/* Checks the mapping against the size of the ring */
+	return remap_vmalloc_range(vma, ep->user_header, vma->vm_pgoff);
+}
+
 /* File callbacks that implement the eventpoll file behaviour */
 static const struct file_operations eventpoll_fops = {
 #ifdef CONFIG_PROC_FS
@@ -896,6 +1156,7 @@ static const struct file_operations eventpoll_fops = {
 #endif
 	.release	= ep_eventpoll_release,
 	.poll		= ep_eventpoll_poll,
+	.mmap		= ep_eventpoll_mmap,
 	.llseek		= noop_llseek,
 };
 
@@ -1002,6 +1263,7 @@ static int ep_poll_callback(wait_queue_t *wait, unsigned mode, int sync, void *k
 	unsigned long flags;
 	struct epitem *epi = ep_item_from_wait(wait);
 	struct eventpoll *ep = epi->ep;
+	int ewake = 0;
 
 	if ((unsigned long)key & POLLFREE) {
 		ep_pwq_from_wait(wait)->whead = NULL;
@@ -1034,6 +1296,18 @@ static int ep_poll_callback(wait_queue_t *wait, unsigned mode, int sync, void *k
 	if (key && !((unsigned long) key & epi->event.events))
 		goto out_unlock;
 
+	/*
+	 * A device that does not report the events gets the whole interest
+	 * mask reported, this is edge triggered only and userspace will see
+	 * EAGAIN where it was spurious.
+	 */
+	if (ep_polled_by_user(ep)) {
+		if (!ep_user_publish(ep, epi, key ? (unsigned long) key :
+						   epi->event.events))
+			goto out_unlock;
+		goto wakeup;
+	}
+
 	/*
 	 * If we are transferring events to userspace, we can hold no locks
 	 * (because we're accessing user memory, and because of linux f_op->poll()
@@ -1062,12 +1336,34 @@ static int ep_poll_callback(wait_queue_t *wait, unsigned mode, int sync, void *k
 		ep_pm_stay_awake_rcu(epi);
 	}
 
+wakeup:
 	/*
 	 * Wake up ( if active ) both the eventpoll wait list and the ->poll()
 	 * wait list.
 	 */
-	if (waitqueue_active(&ep->wq))
+	if (waitqueue_active(&ep->wq)) {
+		if ((epi->event.events & EPOLLEXCLUSIVE) &&
+		    !((unsigned long)key & POLLFREE)) {
+			/*
+			 * Only count this as the exclusive wakeup if the
+			 * event is one this waiter will actually consume.
+			 */
+			switch ((unsigned long)key & EPOLLINOUT_BITS) {
+			case POLLIN:
+				if (epi->event.events & POLLIN)
+					ewake = 1;
+				break;
+			case POLLOUT:
+				if (epi->event.events & POLLOUT)
+					ewake = 1;
+				break;
+			case 0:
+				ewake = 1;
+				break;
+			}
+		}
 		wake_up_locked(&ep->wq);
+	}
 	if (waitqueue_active(&ep->poll_wait))
 		pwake++;
 
@@ -1078,7 +1374,14 @@ out_unlock:
 	if (pwake)
 		ep_poll_safewake(&ep->poll_wait);
 
-	return 1;
+	/*
+	 * An exclusive entry stops the walk of the target's wait queue only
+	 * when it woke up a waiter; otherwise the next entry gets a chance.
+	 */
+	if (!(epi->event.events & EPOLLEXCLUSIVE))
+		ewake = 1;
+
+	return ewake;
 }
 
 /*
@@ -1095,7 +1398,10 @@ static void ep_ptable_queue_proc(struct file *file, wait_queue_head_t *whead,
 		init_waitqueue_func_entry(&pwq->wait, ep_poll_callback);
 		pwq->whead = whead;
 		pwq->base = epi;
-		add_wait_queue(whead, &pwq->wait);
+		if (epi->event.events & EPOLLEXCLUSIVE)
+			add_wait_queue_exclusive(whead, &pwq->wait);
+		else
+			add_wait_queue(whead, &pwq->wait);
 		list_add_tail(&pwq->llink, &epi->pwqlist);
 		epi->nwait++;
 	} else {
@@ -1293,6 +1599,12 @@ static int ep_insert(struct eventpoll *ep, struct epoll_event *event,
 		RCU_INIT_POINTER(epi->ws, NULL);
 	}
 
+	if (ep_polled_by_user(ep)) {
+		error = ep_user_get_item(ep, epi);
+		if (error)
+			goto error_user_item;
+	}
+
 	/* Initialize the poll table using the queue callback */
 	epq.epi = epi;
 	init_poll_funcptr(&epq.pt, ep_ptable_queue_proc);
@@ -1326,6 +1638,8 @@ static int ep_insert(struct eventpoll *ep, struct epoll_event *event,
 	 */
 	ep_rbtree_insert(ep, epi);
 
+	ep_set_busy_poll_napi_id(epi);
+
 	/* now check if we've created too many backpaths */
 	error = -EINVAL;
 	if (full_check && reverse_path_check())
@@ -1335,7 +1649,15 @@ static int ep_insert(struct eventpoll *ep, struct epoll_event *event,
 	spin_lock_irqsave(&ep->lock, flags);
 
 	/* If the file is already "ready" we drop it inside the ready list */
-	if ((revents & event->events) && !ep_is_linked(&epi->rdllink)) {
+	if (ep_polled_by_user(ep)) {
+		if (ep_user_publish(ep, epi, revents)) {
+			if (waitqueue_active(&ep->wq))
+				wake_up_locked(&ep->wq);
+			if (waitqueue_active(&ep->poll_wait))
+				pwake++;
+		}
+	} else if ((revents & event->events) &&
+		   !ep_is_linked(&epi->rdllink)) {
 		list_add_tail(&epi->rdllink, &ep->rdllist);
 		ep_pm_stay_awake(epi);
 
@@ -1377,6 +1699,10 @@ error_unregister:
 		list_del_init(&epi->rdllink);
 	spin_unlock_irqrestore(&ep->lock, flags);
 
+	if (ep_polled_by_user(ep))
+		ep_user_put_item(ep, epi);
+
+error_user_item:
 	wakeup_source_unregister(ep_wakeup_source(epi));
 
 error_create_wakeup_source:
@@ -1404,6 +1730,12 @@ static int ep_modify(struct eventpoll *ep, struct epitem *epi, struct epoll_even
 	 */
 	epi->event.events = event->events; /* need barrier below */
 	epi->event.data = event->data; /* protected by mtx */
+	if (ep_polled_by_user(ep)) {
+		struct epoll_uitem *uitem = &ep->user_header->items[epi->bit];
+
+		WRITE_ONCE(uitem->events, event->events);
+		WRITE_ONCE(uitem->data, event->data);
+	}
 	if (epi->event.events & EPOLLWAKEUP) {
 		if (!ep_has_wakeup_source(epi))
 			ep_create_wakeup_source(epi);
@@ -1443,7 +1775,14 @@ static int ep_modify(struct eventpoll *ep, struct epitem *epi, struct epoll_even
 	 */
 	if (revents & event->events) {
 		spin_lock_irq(&ep->lock);
-		if (!ep_is_linked(&epi->rdllink)) {
+		if (ep_polled_by_user(ep)) {
+			if (ep_user_publish(ep, epi, revents)) {
+				if (waitqueue_active(&ep->wq))
+					wake_up_locked(&ep->wq);
+				if (waitqueue_active(&ep->poll_wait))
+					pwake++;
+			}
+		} else if (!ep_is_linked(&epi->rdllink)) {
 			list_add_tail(&epi->rdllink, &ep->rdllist);
 			ep_pm_stay_awake(epi);
 
@@ -1520,6 +1859,8 @@ static int ep_send_events_proc(struct eventpoll *ep, struct list_head *head,
 			}
 			eventcnt++;
 			uevent++;
+			/* the socket may have been given a napi_id since */
+			ep_set_busy_poll_napi_id(epi);
 			if (epi->event.events & EPOLLONESHOT)
 				epi->event.events &= EP_PRIVATE_BITS;
 			else if (!(epi->event.events & EPOLLET)) {
@@ -1548,6 +1889,10 @@ static int ep_send_events(struct eventpoll *ep,
 {
 	struct ep_send_events_data esed;
 
+	/* The events are in the ring already, just say how many */
+	if (ep_polled_by_user(ep))
+		return ep_user_events_nr(ep);
+
 	esed.maxevents = maxevents;
 	esed.events = events;
 
@@ -1608,9 +1953,20 @@ static int ep_poll(struct eventpoll *ep, struct epoll_event __user *events,
 	}
 
 fetch_events:
+
+	if (!ep_events_available(ep))
+		ep_busy_loop(ep, timed_out);
+
 	spin_lock_irqsave(&ep->lock, flags);
 
 	if (!ep_events_available(ep)) {
+		/*
+		 * Busy poll timed out.  Drop NAPI ID for now, we can add
+		 * it back in when we have moved a socket with a valid NAPI
+		 * ID onto the ready list.
+		 */
+		ep_reset_busy_poll_napi_id(ep);
+
 		/*
 		 * We don't have any available event to return to the caller.
 		 * We need to sleep here, and we will be wake up by
@@ -1770,7 +2126,7 @@ SYSCALL_DEFINE1(epoll_create1, int, flags)
 	/* Check the EPOLL_* constant for consistency.  */
 	BUILD_BUG_ON(EPOLL_CLOEXEC != O_CLOEXEC);
 
-	if (flags & ~EPOLL_CLOEXEC)
+	if (flags & ~(EPOLL_CLOEXEC | EPOLL_USERPOLL))
 		return -EINVAL;
 	/*
 	 * Create the internal data structure ("struct eventpoll").
@@ -1778,6 +2134,11 @@ SYSCALL_DEFINE1(epoll_create1, int, flags)
 	error = ep_alloc(&ep);
 	if (error < 0)
 		return error;
+	if (flags & EPOLL_USERPOLL) {
+		error = ep_alloc_user_ring(ep, EPOLL_USERPOLL_MAX_ITEMS);
+		if (error)
+			goto out_free_ep;
+	}
 	/*
 	 * Creates all the items needed to setup an eventpoll file. That is,
 	 * a file structure and a free file descriptor.
@@ -1861,12 +2222,34 @@ SYSCALL_DEFINE4(epoll_ctl, int, epfd, int, op, int, fd,
 	if (f.file == tf.file || !is_file_epoll(f.file))
 		goto error_tgt_fput;
 
+	/*
+	 * epoll adds to the wakeup queue at EPOLL_CTL_ADD time only,
+	 * so EPOLLEXCLUSIVE is not allowed for an EPOLL_CTL_MOD operation.
+	 * Also, we do not currently support nested exclusive wakeups.
+	 */
+	if (ep_op_has_event(op) && (epds.events & EPOLLEXCLUSIVE)) {
+		if (op == EPOLL_CTL_MOD)
+			goto error_tgt_fput;
+		if (op == EPOLL_CTL_ADD && (is_file_epoll(tf.file) ||
+				(epds.events & ~EPOLLEXCLUSIVE_OK_BITS)))
+			goto error_tgt_fput;
+	}
+
 	/*
 	 * At this point it is safe to assume that the "private_data" contains
 	 * our own data structure.
 	 */
 	ep = f.file->private_data;
 
+	/*
+	 * Nothing polls the files again on behalf of the ring, so level
+	 * triggered items cannot be supported, and there is no delivery step
+	 * to release a wakeup source at.
+	 */
+	if (ep_polled_by_user(ep) && ep_op_has_event(op) &&
+	    (!(epds.events & EPOLLET) || (epds.events & EPOLLWAKEUP)))
+		goto error_tgt_fput;
+
 	/*
 	 * When we insert an epoll file descriptor, inside another epoll file
 	 * descriptor, there is the change of creating closed loops, which are
@@ -1932,8 +2315,10 @@ SYSCALL_DEFINE4(epoll_ctl, int, epfd, int, op, int, fd,
 		break;
 	case EPOLL_CTL_MOD:
 		if (epi) {
-			epds.events |= POLLERR | POLLHUP;
-			error = ep_modify(ep, epi, &epds);
+			if (!(epi->event.events & EPOLLEXCLUSIVE)) {
+				epds.events |= POLLERR | POLLHUP;
+				error = ep_modify(ep, epi, &epds);
+			}
 		} else
 			error = -ENOENT;
 		break;
@@ -1965,8 +2350,8 @@ SYSCALL_DEFINE4(epoll_wait, int, epfd, struct epoll_event __user *, events,
 	struct fd f;
 	struct eventpoll *ep;
 
-	/* The maximum number of event must be greater than zero */
-	if (maxevents <= 0 || maxevents > EP_MAX_EVENTS)
+	/* The maximum number of event must not be negative */
+	if (maxevents < 0 || maxevents > EP_MAX_EVENTS)
 		return -EINVAL;
 
 	/* Verify that the area passed by the user is writeable */
@@ -1992,6 +2377,13 @@ SYSCALL_DEFINE4(epoll_wait, int, epfd, struct epoll_event __user *, events,
 	 */
 	ep = f.file->private_data;
 
+	/*
+	 * A ring instance only waits for events, everything else needs room
+	 * for at least one.
+	 */
+	if (ep_polled_by_user(ep) ? maxevents != 0 : maxevents == 0)
+		goto error_fput;
+
 	/* Time to fish for events ... */
 	error = ep_poll(ep, events, maxevents, timeout);
 
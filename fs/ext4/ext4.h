@@ -848,6 +848,7 @@ do {									       \
 #endif /* defined(__KERNEL__) || defined(__linux__) */
 
 #include "extents_status.h"
+#include "fast_commit.h"
 
 /*
  * Lock subclasses for i_data_sem in the ext4_inode_info structure.
@@ -1014,6 +1015,13 @@ struct ext4_inode_info {
 	tid_t i_sync_tid;
 	tid_t i_datasync_tid;
 
+	/*
+	 * Fast commit: list of the inodes changed by the running transaction,
+	 * and the transaction that last added this one [s_fc_lock]
+	 */
+	struct list_head i_fc_list;
+	tid_t i_fc_tid;
+
 #ifdef CONFIG_QUOTA
 	struct dquot *i_dquot[MAXQUOTAS];
 #endif
@@ -1073,6 +1081,8 @@ struct ext4_inode_info {
 #define EXT4_MOUNT_DIOREAD_NOLOCK	0x400000 /* Enable support for dio read nolocking */
 #define EXT4_MOUNT_JOURNAL_CHECKSUM	0x800000 /* Journal checksums */
 #define EXT4_MOUNT_JOURNAL_ASYNC_COMMIT	0x1000000 /* Journal Async Commit */
+#define EXT4_MOUNT_MB_OPTIMIZE_SCAN	0x2000000 /* Pick groups from per-order lists */
+#define EXT4_MOUNT_JOURNAL_FAST_COMMIT	0x4000000 /* fsync writes fast commits */
 #define EXT4_MOUNT_DELALLOC		0x8000000 /* Delalloc support */
 #define EXT4_MOUNT_DATA_ERR_ABORT	0x10000000 /* Abort on file data write */
 #define EXT4_MOUNT_BLOCK_VALIDITY	0x20000000 /* Block validity checking */
@@ -1342,6 +1352,17 @@ struct ext4_sb_info {
 						   is a resizer */
 	unsigned long s_commit_interval;
 	u32 s_max_batch_time;
+
+	/*
+	 * Fast commit: the inodes changed by the running transaction and,
+	 * if s_fc_ineligible is set, the last transaction that did something
+	 * fast commits can't describe [s_fc_lock]
+	 */
+	spinlock_t s_fc_lock;
+	struct list_head s_fc_q;
+	bool s_fc_ineligible;
+	tid_t s_fc_ineligible_tid;
+	struct ext4_fc_replay_state s_fc_replay_state;
 	u32 s_min_batch_time;
 	struct block_device *journal_bdev;
 #ifdef CONFIG_QUOTA
@@ -1368,6 +1389,8 @@ struct ext4_sb_info {
 	unsigned short *s_mb_offsets;
 	unsigned int *s_mb_maxs;
 	unsigned int s_group_info_size;
+	struct list_head *s_mb_largest_free_orders;
+	rwlock_t *s_mb_largest_free_orders_locks;
 
 	/* tunables */
 	unsigned long s_stripe;
@@ -2414,6 +2437,14 @@ extern int ext4_check_all_de(struct inode *dir, struct buffer_head *bh,
 /* fsync.c */
 extern int ext4_sync_file(struct file *, loff_t, loff_t, int);
 
+/* fast_commit.c */
+extern void ext4_fc_init(struct super_block *sb, journal_t *journal);
+extern void ext4_fc_track_inode(handle_t *handle, struct inode *inode);
+extern void ext4_fc_mark_ineligible(struct super_block *sb, handle_t *handle);
+extern void ext4_fc_del(struct inode *inode);
+extern int ext4_fc_commit(journal_t *journal, tid_t commit_tid);
+extern int ext4_fc_replay_cleanup(struct super_block *sb);
+
 /* hash.c */
 extern int ext4fs_dirhash(const char *name, int len, struct
 			  dx_hash_info *hinfo);
@@ -2465,6 +2496,8 @@ extern int ext4_mb_add_groupinfo(struct super_block *sb,
 extern int ext4_group_add_blocks(handle_t *handle, struct super_block *sb,
 				ext4_fsblk_t block, unsigned long count);
 extern int ext4_trim_fs(struct super_block *, struct fstrim_range *);
+extern int ext4_mb_mark_bb(struct super_block *sb, ext4_fsblk_t block,
+			   int len);
 
 /* inode.c */
 int ext4_inode_is_fast_symlink(struct inode *inode);
@@ -2858,7 +2891,7 @@ do {								\
 static inline void ext4_update_i_disksize(struct inode *inode, loff_t newsize)
 {
 	WARN_ON_ONCE(S_ISREG(inode->i_mode) &&
-		     !mutex_is_locked(&inode->i_mutex));
+		     !inode_is_locked(inode));
 	down_write(&EXT4_I(inode)->i_data_sem);
 	if (newsize > EXT4_I(inode)->i_disksize)
 		EXT4_I(inode)->i_disksize = newsize;
@@ -2891,7 +2924,9 @@ struct ext4_group_info {
 	ext4_grpblk_t	bb_free;	/* total free blocks */
 	ext4_grpblk_t	bb_fragments;	/* nr of freespace fragments */
 	ext4_grpblk_t	bb_largest_free_order;/* order of largest frag in BG */
+	ext4_group_t	bb_group;	/* group number */
 	struct          list_head bb_prealloc_list;
+	struct		list_head bb_largest_free_order_node;
 #ifdef DOUBLE_CHECK
 	void            *bb_bitmap;
 #endif
@@ -316,6 +316,7 @@ int __ext4_handle_dirty_super(const char *where, unsigned int line,
 	int err = 0;
 
 	ext4_superblock_csum_set(sb);
+	ext4_fc_mark_ineligible(sb, handle);
 	if (ext4_handle_valid(handle)) {
 		err = jbd2_journal_dirty_metadata(handle, bh);
 		if (err)
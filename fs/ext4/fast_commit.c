@@ -0,0 +1,651 @@
+/*
+ * linux/fs/ext4/fast_commit.c
+ *
+ * Fast commits for fsync()
+ *
+ * A full jbd2 commit writes every metadata block the running transaction
+ * touched, plus a descriptor and a commit block, even when all fsync()
+ * needs to make durable is the size and the block map of one file. When
+ * the running transaction only changed regular files whose extent tree
+ * fits in the inode, fsync() instead writes the raw image of those inodes
+ * to the fast commit area at the end of the journal. Replay copies them
+ * back to the inode table once the regular log has been recovered, and
+ * marks the blocks they point to in use.
+ *
+ * Anything a raw inode can't describe (directory and xattr block changes,
+ * freed blocks, orphans, superblock and resize updates, quota, deeper
+ * extent trees, inline data, data journalling) makes the transaction
+ * ineligible and fsync() falls back to a full commit. The next full commit
+ * supersedes all the fast commits of its transaction.
+ */
+
+#include <linux/fs.h>
+#include <linux/crc32.h>
+#include <linux/slab.h>
+#include "ext4.h"
+#include "ext4_jbd2.h"
+#include "ext4_extents.h"
+
+static void ext4_fc_set_ineligible(struct super_block *sb, tid_t tid)
+{
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+
+	spin_lock(&sbi->s_fc_lock);
+	if (!sbi->s_fc_ineligible || tid_gt(tid, sbi->s_fc_ineligible_tid))
+		sbi->s_fc_ineligible_tid = tid;
+	sbi->s_fc_ineligible = true;
+	spin_unlock(&sbi->s_fc_lock);
+}
+
+/*
+ * The transaction of @handle changes something fast commits can't
+ * describe, fsync() has to fully commit it.
+ */
+void ext4_fc_mark_ineligible(struct super_block *sb, handle_t *handle)
+{
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	tid_t tid;
+
+	if (!test_opt(sb, JOURNAL_FAST_COMMIT) || !ext4_handle_valid(handle))
+		return;
+
+	tid = handle->h_transaction->t_tid;
+	if (READ_ONCE(sbi->s_fc_ineligible) &&
+	    READ_ONCE(sbi->s_fc_ineligible_tid) == tid)
+		return;
+	ext4_fc_set_ineligible(sb, tid);
+}
+
+static bool ext4_fc_is_ineligible(struct super_block *sb, tid_t tid)
+{
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	bool ret;
+
+	spin_lock(&sbi->s_fc_lock);
+	ret = sbi->s_fc_ineligible && !tid_gt(tid, sbi->s_fc_ineligible_tid);
+	spin_unlock(&sbi->s_fc_lock);
+
+	return ret;
+}
+
+/*
+ * Called whenever @inode is dirtied within @handle: remember it as part of
+ * the running transaction.
+ */
+void ext4_fc_track_inode(handle_t *handle, struct inode *inode)
+{
+	struct ext4_sb_info *sbi = EXT4_SB(inode->i_sb);
+	struct ext4_inode_info *ei = EXT4_I(inode);
+	tid_t tid;
+
+	if (!test_opt(inode->i_sb, JOURNAL_FAST_COMMIT) ||
+	    !ext4_handle_valid(handle))
+		return;
+
+	/* Directories and the like go along with changes to their blocks */
+	if (!S_ISREG(inode->i_mode)) {
+		ext4_fc_mark_ineligible(inode->i_sb, handle);
+		return;
+	}
+
+	tid = handle->h_transaction->t_tid;
+	if (READ_ONCE(ei->i_fc_tid) == tid && !list_empty(&ei->i_fc_list))
+		return;
+
+	spin_lock(&sbi->s_fc_lock);
+	ei->i_fc_tid = tid;
+	if (list_empty(&ei->i_fc_list))
+		list_add_tail(&ei->i_fc_list, &sbi->s_fc_q);
+	spin_unlock(&sbi->s_fc_lock);
+}
+
+/* @inode is going away */
+void ext4_fc_del(struct inode *inode)
+{
+	struct ext4_sb_info *sbi = EXT4_SB(inode->i_sb);
+	struct ext4_inode_info *ei = EXT4_I(inode);
+
+	if (list_empty(&ei->i_fc_list))
+		return;
+
+	spin_lock(&sbi->s_fc_lock);
+	list_del_init(&ei->i_fc_list);
+	spin_unlock(&sbi->s_fc_lock);
+}
+
+/* A full commit of @tid is on disk, forget about what it covers. */
+static void ext4_fc_cleanup(journal_t *journal, tid_t tid)
+{
+	struct super_block *sb = journal->j_private;
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	struct ext4_inode_info *ei, *tmp;
+
+	spin_lock(&sbi->s_fc_lock);
+	list_for_each_entry_safe(ei, tmp, &sbi->s_fc_q, i_fc_list)
+		if (!tid_gt(ei->i_fc_tid, tid))
+			list_del_init(&ei->i_fc_list);
+	if (sbi->s_fc_ineligible && !tid_gt(sbi->s_fc_ineligible_tid, tid))
+		sbi->s_fc_ineligible = false;
+	spin_unlock(&sbi->s_fc_lock);
+}
+
+static bool ext4_fc_inode_eligible(struct inode *inode)
+{
+	return S_ISREG(inode->i_mode) &&
+	       ext4_test_inode_flag(inode, EXT4_INODE_EXTENTS) &&
+	       !ext4_has_inline_data(inode) &&
+	       !ext4_should_journal_data(inode) &&
+	       ext_depth(inode) == 0;
+}
+
+struct ext4_fc_write {
+	journal_t *journal;
+	struct buffer_head *bh;	/* Block being filled, locked */
+	int off;		/* Where the next record goes in it */
+	int nr_pending;		/* Blocks not waited upon yet */
+	u32 crc;
+};
+
+/* Pad out the block being filled and send it to disk */
+static void ext4_fc_submit(struct ext4_fc_write *fcw, int op)
+{
+	int bsize = fcw->journal->j_blocksize;
+	struct buffer_head *bh = fcw->bh;
+	struct ext4_fc_tl *tl;
+
+	if (fcw->off < bsize) {
+		tl = (struct ext4_fc_tl *)(bh->b_data + fcw->off);
+		tl->fc_tag = cpu_to_le16(EXT4_FC_TAG_PAD);
+		tl->fc_len = cpu_to_le16(bsize - fcw->off - sizeof(*tl));
+		fcw->crc = crc32_le(fcw->crc, (u8 *)tl, bsize - fcw->off);
+	}
+
+	set_buffer_uptodate(bh);
+	clear_buffer_dirty(bh);
+	get_bh(bh);
+	bh->b_end_io = end_buffer_write_sync;
+	submit_bh(op, bh);
+	fcw->bh = NULL;
+}
+
+/*
+ * Start a record whose value is @len bytes long, on a new block if the
+ * current one is too full. The caller fills in the value and checksums
+ * the record.
+ */
+static struct ext4_fc_tl *ext4_fc_reserve(struct ext4_fc_write *fcw,
+					  int tag, int len)
+{
+	int bsize = fcw->journal->j_blocksize;
+	struct ext4_fc_tl *tl;
+	int ret;
+
+	if (fcw->bh && fcw->off + sizeof(*tl) + len > bsize)
+		ext4_fc_submit(fcw, WRITE_SYNC);
+
+	if (!fcw->bh) {
+		ret = jbd2_fc_get_buf(fcw->journal, &fcw->bh);
+		if (ret)
+			return ERR_PTR(ret);
+		fcw->nr_pending++;
+		lock_buffer(fcw->bh);
+		memset(fcw->bh->b_data, 0, bsize);
+		fcw->off = 0;
+	}
+
+	tl = (struct ext4_fc_tl *)(fcw->bh->b_data + fcw->off);
+	tl->fc_tag = cpu_to_le16(tag);
+	tl->fc_len = cpu_to_le16(len);
+	fcw->off += sizeof(*tl) + len;
+
+	return tl;
+}
+
+static void ext4_fc_csum(struct ext4_fc_write *fcw, struct ext4_fc_tl *tl)
+{
+	fcw->crc = crc32_le(fcw->crc, (u8 *)tl,
+			    sizeof(*tl) + le16_to_cpu(tl->fc_len));
+}
+
+static int ext4_fc_write_inode(struct ext4_fc_write *fcw, struct inode *inode)
+{
+	int inode_len = EXT4_INODE_SIZE(inode->i_sb);
+	struct ext4_inode_info *ei = EXT4_I(inode);
+	struct ext4_fc_inode *fc_inode;
+	struct ext4_fc_tl *tl;
+	struct ext4_iloc iloc;
+	int ret;
+
+	ret = ext4_get_inode_loc(inode, &iloc);
+	if (ret)
+		return ret;
+
+	tl = ext4_fc_reserve(fcw, EXT4_FC_TAG_INODE,
+			     sizeof(*fc_inode) + inode_len);
+	if (IS_ERR(tl)) {
+		brelse(iloc.bh);
+		return PTR_ERR(tl);
+	}
+
+	fc_inode = (struct ext4_fc_inode *)(tl + 1);
+	fc_inode->fc_ino = cpu_to_le32(inode->i_ino);
+	spin_lock(&ei->i_raw_lock);
+	memcpy(fc_inode->fc_raw_inode, ext4_raw_inode(&iloc), inode_len);
+	spin_unlock(&ei->i_raw_lock);
+	brelse(iloc.bh);
+
+	ext4_fc_csum(fcw, tl);
+	return 0;
+}
+
+/*
+ * Grab the inodes changed by the running transaction. Returns NULL with
+ * *nr set to 0 if there are none.
+ */
+static struct inode **ext4_fc_grab_inodes(struct super_block *sb, int *nr)
+{
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	struct ext4_inode_info *ei;
+	struct inode **inodes;
+	int nr_alloc = 0;
+
+	*nr = 0;
+	spin_lock(&sbi->s_fc_lock);
+	list_for_each_entry(ei, &sbi->s_fc_q, i_fc_list)
+		nr_alloc++;
+	spin_unlock(&sbi->s_fc_lock);
+	if (!nr_alloc)
+		return NULL;
+
+	inodes = kmalloc_array(nr_alloc, sizeof(*inodes), GFP_NOFS);
+	if (!inodes)
+		return ERR_PTR(-ENOMEM);
+
+	/* The list only shrinks while updates are locked out */
+	spin_lock(&sbi->s_fc_lock);
+	list_for_each_entry(ei, &sbi->s_fc_q, i_fc_list) {
+		if (WARN_ON_ONCE(*nr == nr_alloc))
+			break;
+		if (igrab(&ei->vfs_inode))
+			inodes[(*nr)++] = &ei->vfs_inode;
+	}
+	spin_unlock(&sbi->s_fc_lock);
+
+	return inodes;
+}
+
+static int ext4_fc_perform_commit(journal_t *journal, tid_t tid)
+{
+	struct super_block *sb = journal->j_private;
+	struct ext4_fc_write fcw = {
+		.journal = journal,
+		.crc = ~0,
+	};
+	struct inode **inodes = NULL;
+	struct ext4_fc_head *head;
+	struct ext4_fc_tail *tail;
+	struct ext4_fc_tl *tl;
+	int nr = 0, i, ret, err;
+
+	/*
+	 * Wait for the handles of the running transaction to stop and keep
+	 * new ones out, so that the inodes are copied in a consistent state,
+	 * just like a full commit would see them.
+	 */
+	jbd2_journal_lock_updates(journal);
+
+	ret = -EINVAL;
+	if (ext4_fc_is_ineligible(sb, tid))
+		goto out_unlock;
+
+	inodes = ext4_fc_grab_inodes(sb, &nr);
+	if (IS_ERR_OR_NULL(inodes)) {
+		ret = inodes ? PTR_ERR(inodes) : -EINVAL;
+		inodes = NULL;
+		goto out_unlock;
+	}
+
+	for (i = 0; i < nr; i++)
+		if (!ext4_fc_inode_eligible(inodes[i]))
+			goto out_unlock;
+	ret = 0;
+
+	tl = ext4_fc_reserve(&fcw, EXT4_FC_TAG_HEAD, sizeof(*head));
+	if (IS_ERR(tl)) {
+		ret = PTR_ERR(tl);
+		goto out_unlock;
+	}
+	head = (struct ext4_fc_head *)(tl + 1);
+	head->fc_features = 0;
+	head->fc_tid = cpu_to_le32(tid);
+	ext4_fc_csum(&fcw, tl);
+
+	for (i = 0; i < nr; i++) {
+		ret = ext4_fc_write_inode(&fcw, inodes[i]);
+		if (ret)
+			goto out_unlock;
+	}
+	ext4_fc_submit(&fcw, WRITE_SYNC);
+	jbd2_journal_unlock_updates(journal);
+
+	/*
+	 * In ordered mode, the data of the blocks the inodes point to has to
+	 * be on disk before the tail makes the fast commit valid.
+	 */
+	if (test_opt(sb, DATA_FLAGS) == EXT4_MOUNT_ORDERED_DATA) {
+		for (i = 0; i < nr; i++) {
+			err = filemap_write_and_wait(inodes[i]->i_mapping);
+			if (err && !ret)
+				ret = err;
+		}
+	}
+	err = jbd2_fc_wait_bufs(journal, fcw.nr_pending);
+	fcw.nr_pending = 0;
+	if (err && !ret)
+		ret = err;
+	if (ret)
+		goto out;
+
+	if ((journal->j_flags & JBD2_BARRIER) &&
+	    journal->j_fs_dev != journal->j_dev) {
+		ret = blkdev_issue_flush(journal->j_fs_dev, GFP_NOFS, NULL);
+		if (ret)
+			goto out;
+	}
+
+	/* The tail goes on a block of its own, once all the rest is on disk */
+	tl = ext4_fc_reserve(&fcw, EXT4_FC_TAG_TAIL, sizeof(*tail));
+	if (IS_ERR(tl)) {
+		ret = PTR_ERR(tl);
+		goto out;
+	}
+	tail = (struct ext4_fc_tail *)(tl + 1);
+	tail->fc_tid = cpu_to_le32(tid);
+	fcw.crc = crc32_le(fcw.crc, (u8 *)tl,
+			   sizeof(*tl) + offsetof(struct ext4_fc_tail, fc_crc));
+	tail->fc_crc = cpu_to_le32(fcw.crc);
+	ext4_fc_submit(&fcw, journal->j_flags & JBD2_BARRIER ?
+			     WRITE_FLUSH_FUA : WRITE_SYNC);
+	ret = jbd2_fc_wait_bufs(journal, fcw.nr_pending);
+	fcw.nr_pending = 0;
+	goto out;
+
+out_unlock:
+	jbd2_journal_unlock_updates(journal);
+out:
+	if (fcw.bh)
+		unlock_buffer(fcw.bh);
+	if (fcw.nr_pending)
+		jbd2_fc_wait_bufs(journal, fcw.nr_pending);
+	for (i = 0; i < nr; i++)
+		iput(inodes[i]);
+	kfree(inodes);
+	return ret;
+}
+
+/**
+ * ext4_fc_commit() - make the changes of a transaction durable for fsync
+ * @journal: the journal of the file system
+ * @commit_tid: the transaction to commit
+ *
+ * Returns 0 when a fast commit made the changes of @commit_tid durable,
+ * or an error when the caller has to wait for its full commit instead.
+ */
+int ext4_fc_commit(journal_t *journal, tid_t commit_tid)
+{
+	struct super_block *sb = journal->j_private;
+	int ret;
+
+	if (ext4_fc_is_ineligible(sb, commit_tid))
+		return -EINVAL;
+
+	ret = jbd2_fc_begin_commit(journal, commit_tid);
+	if (ret)
+		return ret;
+
+	ret = ext4_fc_perform_commit(journal, commit_tid);
+	/* Don't append to a fast commit that may have been cut short */
+	if (ret)
+		ext4_fc_set_ineligible(sb, commit_tid);
+
+	jbd2_fc_end_commit(journal);
+	return ret;
+}
+
+/* Remember the blocks used by a replayed inode */
+static int ext4_fc_record_regions(struct super_block *sb,
+				  struct ext4_inode *raw_inode)
+{
+	struct ext4_fc_replay_state *state = &EXT4_SB(sb)->s_fc_replay_state;
+	struct ext4_extent_header *eh;
+	struct ext4_fc_alloc_region *regions;
+	struct ext4_extent *ex;
+	int i, entries, size;
+
+	eh = (struct ext4_extent_header *)raw_inode->i_block;
+	if (!(le32_to_cpu(raw_inode->i_flags) & EXT4_EXTENTS_FL) ||
+	    eh->eh_magic != EXT4_EXT_MAGIC || eh->eh_depth ||
+	    le16_to_cpu(eh->eh_entries) > le16_to_cpu(eh->eh_max) ||
+	    le16_to_cpu(eh->eh_max) > (sizeof(raw_inode->i_block) -
+					sizeof(*eh)) / sizeof(*ex))
+		return -EFSCORRUPTED;
+
+	entries = le16_to_cpu(eh->eh_entries);
+	if (state->fc_regions_used + entries > state->fc_regions_size) {
+		size = state->fc_regions_size + 32;
+		regions = krealloc(state->fc_regions,
+				   size * sizeof(*regions), GFP_KERNEL);
+		if (!regions)
+			return -ENOMEM;
+		state->fc_regions = regions;
+		state->fc_regions_size = size;
+	}
+
+	ex = EXT_FIRST_EXTENT(eh);
+	for (i = 0; i < entries; i++, ex++) {
+		regions = &state->fc_regions[state->fc_regions_used++];
+		regions->pblk = ext4_ext_pblock(ex);
+		regions->len = ext4_ext_get_actual_len(ex);
+	}
+
+	return 0;
+}
+
+static int ext4_fc_replay_inode(struct super_block *sb,
+				struct ext4_fc_inode *fc_inode, int len)
+{
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	unsigned long ino = le32_to_cpu(fc_inode->fc_ino);
+	int inode_len = len - sizeof(*fc_inode);
+	struct ext4_group_desc *gdp;
+	struct buffer_head *bh;
+	ext4_fsblk_t block;
+	unsigned long offset;
+	int ret;
+
+	if (ino < EXT4_FIRST_INO(sb) ||
+	    ino > le32_to_cpu(sbi->s_es->s_inodes_count) ||
+	    inode_len != EXT4_INODE_SIZE(sb))
+		return -EFSCORRUPTED;
+
+	gdp = ext4_get_group_desc(sb, (ino - 1) / EXT4_INODES_PER_GROUP(sb),
+				  NULL);
+	if (!gdp)
+		return -EFSCORRUPTED;
+
+	offset = ((ino - 1) % EXT4_INODES_PER_GROUP(sb)) * inode_len;
+	block = ext4_inode_table(sb, gdp) +
+		(offset >> EXT4_BLOCK_SIZE_BITS(sb));
+	offset &= EXT4_BLOCK_SIZE(sb) - 1;
+
+	bh = sb_bread(sb, block);
+	if (!bh)
+		return -EIO;
+	lock_buffer(bh);
+	memcpy(bh->b_data + offset, fc_inode->fc_raw_inode, inode_len);
+	unlock_buffer(bh);
+	mark_buffer_dirty(bh);
+	ret = sync_dirty_buffer(bh);
+	brelse(bh);
+	if (ret)
+		return ret;
+
+	return ext4_fc_record_regions(sb,
+			(struct ext4_inode *)fc_inode->fc_raw_inode);
+}
+
+/*
+ * Find out how many records of the fast commit area belong to complete
+ * fast commits of @expected_tid, the transaction after the last one in
+ * the regular log.
+ */
+static int ext4_fc_replay_scan(journal_t *journal, struct buffer_head *bh,
+			       int off, tid_t expected_tid)
+{
+	struct super_block *sb = journal->j_private;
+	struct ext4_fc_replay_state *state = &EXT4_SB(sb)->s_fc_replay_state;
+	u8 *cur = bh->b_data, *end = bh->b_data + journal->j_blocksize;
+	struct ext4_fc_head *head;
+	struct ext4_fc_tail *tail;
+	struct ext4_fc_tl *tl;
+	int len;
+
+	if (off == 0) {
+		state->fc_replay_num_tags = 0;
+		state->fc_scan_tags = 0;
+		state->fc_scan_in_commit = false;
+	}
+
+	while (cur + sizeof(*tl) <= end) {
+		tl = (struct ext4_fc_tl *)cur;
+		len = le16_to_cpu(tl->fc_len);
+		if (cur + sizeof(*tl) + len > end)
+			return JBD2_FC_REPLAY_STOP;
+
+		switch (le16_to_cpu(tl->fc_tag)) {
+		case EXT4_FC_TAG_HEAD:
+			head = (struct ext4_fc_head *)(tl + 1);
+			if (state->fc_scan_in_commit ||
+			    len != sizeof(*head) || head->fc_features ||
+			    le32_to_cpu(head->fc_tid) != expected_tid)
+				return JBD2_FC_REPLAY_STOP;
+			state->fc_scan_in_commit = true;
+			state->fc_scan_tags = 1;
+			state->fc_crc = crc32_le(~0, cur, sizeof(*tl) + len);
+			break;
+		case EXT4_FC_TAG_PAD:
+			/* Padding after a tail */
+			if (!state->fc_scan_in_commit)
+				break;
+			/* fall through */
+		case EXT4_FC_TAG_INODE:
+			if (!state->fc_scan_in_commit)
+				return JBD2_FC_REPLAY_STOP;
+			state->fc_scan_tags++;
+			state->fc_crc = crc32_le(state->fc_crc, cur,
+						 sizeof(*tl) + len);
+			break;
+		case EXT4_FC_TAG_TAIL:
+			tail = (struct ext4_fc_tail *)(tl + 1);
+			if (!state->fc_scan_in_commit || len != sizeof(*tail))
+				return JBD2_FC_REPLAY_STOP;
+			state->fc_crc = crc32_le(state->fc_crc, cur,
+				sizeof(*tl) + offsetof(struct ext4_fc_tail, fc_crc));
+			if (le32_to_cpu(tail->fc_tid) != expected_tid ||
+			    le32_to_cpu(tail->fc_crc) != state->fc_crc)
+				return JBD2_FC_REPLAY_STOP;
+			state->fc_replay_num_tags += state->fc_scan_tags + 1;
+			state->fc_scan_in_commit = false;
+			break;
+		default:
+			return JBD2_FC_REPLAY_STOP;
+		}
+		cur += sizeof(*tl) + len;
+	}
+
+	return JBD2_FC_REPLAY_CONTINUE;
+}
+
+/* Apply the records the scan found to be part of complete fast commits */
+static int ext4_fc_replay_apply(journal_t *journal, struct buffer_head *bh,
+				int off)
+{
+	struct super_block *sb = journal->j_private;
+	struct ext4_fc_replay_state *state = &EXT4_SB(sb)->s_fc_replay_state;
+	u8 *cur = bh->b_data, *end = bh->b_data + journal->j_blocksize;
+	struct ext4_fc_tl *tl;
+	int len, ret;
+
+	if (off == 0) {
+		if (!state->fc_replay_num_tags)
+			return JBD2_FC_REPLAY_STOP;
+		ext4_msg(sb, KERN_INFO, "replaying fast commits");
+		state->fc_scan_in_commit = false;
+	}
+
+	while (state->fc_replay_num_tags && cur + sizeof(*tl) <= end) {
+		tl = (struct ext4_fc_tl *)cur;
+		len = le16_to_cpu(tl->fc_len);
+		cur += sizeof(*tl) + len;
+
+		switch (le16_to_cpu(tl->fc_tag)) {
+		case EXT4_FC_TAG_HEAD:
+			state->fc_scan_in_commit = true;
+			break;
+		case EXT4_FC_TAG_PAD:
+			if (!state->fc_scan_in_commit)
+				continue;
+			break;
+		case EXT4_FC_TAG_INODE:
+			ret = ext4_fc_replay_inode(sb,
+					(struct ext4_fc_inode *)(tl + 1), len);
+			if (ret)
+				return ret;
+			break;
+		case EXT4_FC_TAG_TAIL:
+			state->fc_scan_in_commit = false;
+			break;
+		default:
+			return -EFSCORRUPTED;
+		}
+		state->fc_replay_num_tags--;
+	}
+
+	return state->fc_replay_num_tags ? JBD2_FC_REPLAY_CONTINUE :
+					   JBD2_FC_REPLAY_STOP;
+}
+
+static int ext4_fc_replay(journal_t *journal, struct buffer_head *bh,
+			  enum passtype pass, int off, tid_t expected_tid)
+{
+	if (pass == PASS_SCAN)
+		return ext4_fc_replay_scan(journal, bh, off, expected_tid);
+	return ext4_fc_replay_apply(journal, bh, off);
+}
+
+/**
+ * ext4_fc_replay_cleanup() - finish the replay of fast commits
+ * @sb: the file system
+ *
+ * Marks the blocks used by the replayed inodes in the bitmaps. Called
+ * once mballoc is set up, before the free space counters are.
+ */
+int ext4_fc_replay_cleanup(struct super_block *sb)
+{
+	struct ext4_fc_replay_state *state = &EXT4_SB(sb)->s_fc_replay_state;
+	int i, ret = 0;
+
+	for (i = 0; i < state->fc_regions_used && !ret; i++)
+		ret = ext4_mb_mark_bb(sb, state->fc_regions[i].pblk,
+				      state->fc_regions[i].len);
+
+	kfree(state->fc_regions);
+	memset(state, 0, sizeof(*state));
+	return ret;
+}
+
+void ext4_fc_init(struct super_block *sb, journal_t *journal)
+{
+	journal->j_fc_replay_callback = ext4_fc_replay;
+	journal->j_fc_cleanup_callback = ext4_fc_cleanup;
+}
@@ -0,0 +1,59 @@
+#ifndef __FAST_COMMIT_H__
+#define __FAST_COMMIT_H__
+
+/*
+ * On-disk format of the fast commit area.
+ *
+ * The area is a stream of tag-length-value records. A fast commit starts
+ * on a block of its own with a HEAD record, carries the raw on-disk image
+ * of every inode changed by the running transaction and ends with a TAIL
+ * record whose checksum covers all the records from the HEAD on. Records
+ * never straddle a block boundary, a PAD record fills up the rest of a
+ * block instead. All record lengths are multiples of four.
+ */
+#define EXT4_FC_TAG_HEAD	0x0001
+#define EXT4_FC_TAG_INODE	0x0002
+#define EXT4_FC_TAG_PAD		0x0003
+#define EXT4_FC_TAG_TAIL	0x0004
+
+struct ext4_fc_tl {
+	__le16 fc_tag;
+	__le16 fc_len;		/* Length of the value that follows */
+};
+
+struct ext4_fc_head {
+	__le32 fc_features;	/* None defined yet, always 0 */
+	__le32 fc_tid;
+};
+
+struct ext4_fc_inode {
+	__le32 fc_ino;
+	__u8 fc_raw_inode[0];	/* Up to s_inode_size bytes */
+};
+
+struct ext4_fc_tail {
+	__le32 fc_tid;
+	__le32 fc_crc;		/* crc32 up to and including fc_tid */
+};
+
+/* Blocks used by a replayed inode, to be marked in the bitmaps */
+struct ext4_fc_alloc_region {
+	ext4_fsblk_t pblk;
+	int len;
+};
+
+/*
+ * Replay state, filled in while jbd2 recovery hands us the blocks of the
+ * fast commit area, first to scan and then to replay them.
+ */
+struct ext4_fc_replay_state {
+	int fc_replay_num_tags;		/* Records of the complete commits */
+	int fc_scan_tags;		/* Records of the commit being scanned */
+	bool fc_scan_in_commit;		/* Scanning past a HEAD */
+	u32 fc_crc;
+	struct ext4_fc_alloc_region *fc_regions;
+	int fc_regions_used;
+	int fc_regions_size;
+};
+
+#endif /* __FAST_COMMIT_H__ */
@@ -286,6 +286,7 @@ void ext4_free_inode(handle_t *handle, struct inode *inode)
 	ino = inode->i_ino;
 	ext4_debug("freeing inode %lu\n", ino);
 	trace_ext4_free_inode(inode);
+	ext4_fc_mark_ineligible(sb, handle);
 
 	/*
 	 * Note: we must free any quota before locking the superblock,
@@ -1320,6 +1321,7 @@ int ext4_init_inode_table(struct super_block *sb, ext4_group_t group,
 		ret = PTR_ERR(handle);
 		goto out;
 	}
+	ext4_fc_mark_ineligible(sb, handle);
 
 	down_write(&grp->alloc_sem);
 	/*
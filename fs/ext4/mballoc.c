@@ -704,17 +704,36 @@ static void ext4_mb_mark_free_simple(struct super_block *sb,
 static void
 mb_set_largest_free_order(struct super_block *sb, struct ext4_group_info *grp)
 {
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
 	int i;
-	int bits;
-
-	grp->bb_largest_free_order = -1; /* uninit */
 
-	bits = sb->s_blocksize_bits + 1;
-	for (i = bits; i >= 0; i--) {
-		if (grp->bb_counters[i] > 0) {
-			grp->bb_largest_free_order = i;
+	for (i = MB_NUM_ORDERS(sb) - 1; i >= 0; i--)
+		if (grp->bb_counters[i] > 0)
 			break;
-		}
+
+	/*
+	 * With mb_optimize_scan the group also sits on the list of its
+	 * largest free order, which has to follow the order around.
+	 */
+	if (!test_opt(sb, MB_OPTIMIZE_SCAN) ||
+	    i == grp->bb_largest_free_order) {
+		grp->bb_largest_free_order = i;
+		return;
+	}
+
+	if (grp->bb_largest_free_order >= 0) {
+		write_lock(&sbi->s_mb_largest_free_orders_locks[
+					grp->bb_largest_free_order]);
+		list_del_init(&grp->bb_largest_free_order_node);
+		write_unlock(&sbi->s_mb_largest_free_orders_locks[
+					grp->bb_largest_free_order]);
+	}
+	grp->bb_largest_free_order = i;
+	if (i >= 0 && grp->bb_free) {
+		write_lock(&sbi->s_mb_largest_free_orders_locks[i]);
+		list_add_tail(&grp->bb_largest_free_order_node,
+			      &sbi->s_mb_largest_free_orders[i]);
+		write_unlock(&sbi->s_mb_largest_free_orders_locks[i]);
 	}
 }
 
@@ -2089,6 +2108,87 @@ static int ext4_mb_good_group(struct ext4_allocation_context *ac,
 	return 0;
 }
 
+/*
+ * mb_optimize_scan picks the groups for criteria 0 and 1 from the largest
+ * free order lists rather than by walking all groups, which on a big and
+ * mostly full file system means loading and scanning thousands of buddy
+ * bitmaps. Criteria 2 and 3 still walk the groups in order.
+ */
+static bool ext4_mb_should_optimize_scan(struct ext4_allocation_context *ac)
+{
+	if (!test_opt(ac->ac_sb, MB_OPTIMIZE_SCAN))
+		return false;
+	if (ac->ac_criteria >= 2)
+		return false;
+	/* non-extent files are restricted to the low groups */
+	if (!ext4_test_inode_flag(ac->ac_inode, EXT4_INODE_EXTENTS))
+		return false;
+	return true;
+}
+
+/*
+ * Find the first group on the lists of orders @order and up that is good
+ * for criteria @cr. Groups on the lists have their buddy initialized, so
+ * ext4_mb_good_group() won't need to sleep here.
+ */
+static struct ext4_group_info *
+ext4_mb_find_group_by_order(struct ext4_allocation_context *ac, int order,
+			    int cr)
+{
+	struct ext4_sb_info *sbi = EXT4_SB(ac->ac_sb);
+	struct ext4_group_info *iter, *grp = NULL;
+	int i;
+
+	for (i = order; i < MB_NUM_ORDERS(ac->ac_sb) && !grp; i++) {
+		if (list_empty(&sbi->s_mb_largest_free_orders[i]))
+			continue;
+		read_lock(&sbi->s_mb_largest_free_orders_locks[i]);
+		list_for_each_entry(iter, &sbi->s_mb_largest_free_orders[i],
+				    bb_largest_free_order_node) {
+			if (!EXT4_MB_GRP_NEED_INIT(iter) &&
+			    ext4_mb_good_group(ac, iter->bb_group, cr) > 0) {
+				grp = iter;
+				break;
+			}
+		}
+		read_unlock(&sbi->s_mb_largest_free_orders_locks[i]);
+	}
+	return grp;
+}
+
+/*
+ * Pick the group to try after *@group. Sets *@new_cr to the next criteria
+ * if the lists have no suitable group left for the current one.
+ */
+static void ext4_mb_choose_next_group(struct ext4_allocation_context *ac,
+				      int *new_cr, ext4_group_t *group,
+				      ext4_group_t ngroups)
+{
+	struct ext4_group_info *grp;
+	int order;
+
+	*new_cr = ac->ac_criteria;
+	if (!ext4_mb_should_optimize_scan(ac)) {
+		/*
+		 * Artificially restricted ngroups for non-extent
+		 * files makes group > ngroups possible on first loop.
+		 */
+		*group = *group + 1 >= ngroups ? 0 : *group + 1;
+		return;
+	}
+
+	if (ac->ac_criteria == 0)
+		order = ac->ac_2order;
+	else
+		order = fls(ac->ac_g_ex.fe_len) - 1;
+
+	grp = ext4_mb_find_group_by_order(ac, order, ac->ac_criteria);
+	if (grp)
+		*group = grp->bb_group;
+	else
+		*new_cr = ac->ac_criteria + 1;
+}
+
 static noinline_for_stack int
 ext4_mb_regular_allocator(struct ext4_allocation_context *ac)
 {
@@ -2153,6 +2253,8 @@ ext4_mb_regular_allocator(struct ext4_allocation_context *ac)
 	 */
 repeat:
 	for (; cr < 4 && ac->ac_status == AC_STATUS_CONTINUE; cr++) {
+		int new_cr;
+
 		ac->ac_criteria = cr;
 		/*
 		 * searching for the right group start
@@ -2160,9 +2262,14 @@ repeat:
 		 */
 		group = ac->ac_g_ex.fe_group;
 
-		for (i = 0; i < ngroups; group++, i++) {
+		for (i = 0, new_cr = cr; i < ngroups; i++,
+		     ext4_mb_choose_next_group(ac, &new_cr, &group, ngroups)) {
 			int ret = 0;
 			cond_resched();
+			if (new_cr != cr) {
+				cr = new_cr;
+				goto repeat;
+			}
 			/*
 			 * Artificially restricted ngroups for non-extent
 			 * files makes group > ngroups possible on first loop.
@@ -2443,9 +2550,11 @@ int ext4_mb_add_groupinfo(struct super_block *sb, ext4_group_t group,
 	}
 
 	INIT_LIST_HEAD(&meta_group_info[i]->bb_prealloc_list);
+	INIT_LIST_HEAD(&meta_group_info[i]->bb_largest_free_order_node);
 	init_rwsem(&meta_group_info[i]->alloc_sem);
 	meta_group_info[i]->bb_free_root = RB_ROOT;
 	meta_group_info[i]->bb_largest_free_order = -1;  /* uninit */
+	meta_group_info[i]->bb_group = group;
 
 #ifdef DOUBLE_CHECK
 	{
@@ -2595,6 +2704,22 @@ int ext4_mb_init(struct super_block *sb)
 		goto out;
 	}
 
+	sbi->s_mb_largest_free_orders =
+		kmalloc_array(MB_NUM_ORDERS(sb), sizeof(struct list_head),
+			      GFP_KERNEL);
+	sbi->s_mb_largest_free_orders_locks =
+		kmalloc_array(MB_NUM_ORDERS(sb), sizeof(rwlock_t),
+			      GFP_KERNEL);
+	if (!sbi->s_mb_largest_free_orders ||
+	    !sbi->s_mb_largest_free_orders_locks) {
+		ret = -ENOMEM;
+		goto out;
+	}
+	for (i = 0; i < MB_NUM_ORDERS(sb); i++) {
+		INIT_LIST_HEAD(&sbi->s_mb_largest_free_orders[i]);
+		rwlock_init(&sbi->s_mb_largest_free_orders_locks[i]);
+	}
+
 	ret = ext4_groupinfo_create_slab(sb->s_blocksize);
 	if (ret < 0)
 		goto out;
@@ -2674,6 +2799,10 @@ out_free_locality_groups:
 	free_percpu(sbi->s_locality_groups);
 	sbi->s_locality_groups = NULL;
 out:
+	kfree(sbi->s_mb_largest_free_orders);
+	sbi->s_mb_largest_free_orders = NULL;
+	kfree(sbi->s_mb_largest_free_orders_locks);
+	sbi->s_mb_largest_free_orders_locks = NULL;
 	kfree(sbi->s_mb_offsets);
 	sbi->s_mb_offsets = NULL;
 	kfree(sbi->s_mb_maxs);
@@ -2726,6 +2855,8 @@ int ext4_mb_release(struct super_block *sb)
 			kfree(sbi->s_group_info[i]);
 		kvfree(sbi->s_group_info);
 	}
+	kfree(sbi->s_mb_largest_free_orders);
+	kfree(sbi->s_mb_largest_free_orders_locks);
 	kfree(sbi->s_mb_offsets);
 	kfree(sbi->s_mb_maxs);
 	iput(sbi->s_buddy_cache);
@@ -2991,6 +3122,73 @@ out_err:
 	return err;
 }
 
+/*
+ * Mark the blocks [block, block + len) in use in the on-disk bitmaps and
+ * group descriptors, outside of the journal. This is for fast commit
+ * replay at mount time, after ext4_mb_init() but before any buddy has
+ * been loaded and before the free space counters have been set up.
+ */
+int ext4_mb_mark_bb(struct super_block *sb, ext4_fsblk_t block, int len)
+{
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	struct buffer_head *bitmap_bh, *gdp_bh;
+	struct ext4_group_desc *gdp;
+	ext4_group_t group;
+	ext4_grpblk_t blkoff;
+	int i, count, newly, err;
+
+	if (!ext4_data_block_valid(sbi, block, len))
+		return -EFSCORRUPTED;
+
+	while (len > 0) {
+		ext4_get_group_no_and_offset(sb, block, &group, &blkoff);
+		count = min_t(int, len, EXT4_BLOCKS_PER_GROUP(sb) - blkoff);
+
+		bitmap_bh = ext4_read_block_bitmap(sb, group);
+		if (IS_ERR(bitmap_bh))
+			return PTR_ERR(bitmap_bh);
+		gdp = ext4_get_group_desc(sb, group, &gdp_bh);
+		if (!gdp) {
+			brelse(bitmap_bh);
+			return -EIO;
+		}
+
+		ext4_lock_group(sb, group);
+		newly = 0;
+		for (i = 0; i < count; i++)
+			if (!mb_test_bit(blkoff + i, bitmap_bh->b_data))
+				newly++;
+		ext4_set_bits(bitmap_bh->b_data, blkoff, count);
+		if (gdp->bg_flags & cpu_to_le16(EXT4_BG_BLOCK_UNINIT)) {
+			gdp->bg_flags &= cpu_to_le16(~EXT4_BG_BLOCK_UNINIT);
+			ext4_free_group_clusters_set(sb, gdp,
+				ext4_free_clusters_after_init(sb, group, gdp));
+		}
+		ext4_free_group_clusters_set(sb, gdp,
+				ext4_free_group_clusters(sb, gdp) - newly);
+		ext4_block_bitmap_csum_set(sb, group, gdp, bitmap_bh);
+		ext4_group_desc_csum_set(sb, group, gdp);
+		ext4_get_group_info(sb, group)->bb_free =
+				ext4_free_group_clusters(sb, gdp);
+		ext4_unlock_group(sb, group);
+
+		mark_buffer_dirty(bitmap_bh);
+		err = sync_dirty_buffer(bitmap_bh);
+		brelse(bitmap_bh);
+		if (!err) {
+			mark_buffer_dirty(gdp_bh);
+			err = sync_dirty_buffer(gdp_bh);
+		}
+		if (err)
+			return err;
+
+		block += count;
+		len -= count;
+	}
+
+	return 0;
+}
+
 /*
  * here we normalize request for locality group
  * Group request are normalized to s_mb_group_prealloc, which goes to
@@ -4685,6 +4883,8 @@ void ext4_free_blocks(handle_t *handle, struct inode *inode,
 	}
 
 	ext4_debug("freeing block %llu\n", block);
+	/* Replay only ever marks blocks in use */
+	ext4_fc_mark_ineligible(sb, handle);
 	trace_ext4_free_blocks(inode, block, count, flags);
 
 	if (bh && (flags & EXT4_FREE_BLOCKS_FORGET)) {
@@ -4926,6 +5126,8 @@ int ext4_group_add_blocks(handle_t *handle, struct super_block *sb,
 	if (count == 0)
 		return 0;
 
+	ext4_fc_mark_ineligible(sb, handle);
+
 	ext4_get_group_no_and_offset(sb, block, &block_group, &bit);
 	/*
 	 * Check to see if we are freeing blocks across a group
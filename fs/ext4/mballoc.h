@@ -84,6 +84,12 @@ extern ushort ext4_mballoc_debug;
  */
 #define MB_DEFAULT_ORDER2_REQS		2
 
+/*
+ * Number of buddy orders of a group, and of the largest free order lists
+ * used by mb_optimize_scan
+ */
+#define MB_NUM_ORDERS(sb)		((sb)->s_blocksize_bits + 2)
+
 /*
  * default group prealloc size 512 blocks
  */
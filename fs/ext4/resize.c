@@ -1443,6 +1443,7 @@ static int ext4_flex_group_add(struct super_block *sb,
 		err = PTR_ERR(handle);
 		goto exit;
 	}
+	ext4_fc_mark_ineligible(sb, handle);
 
 	BUFFER_TRACE(sbi->s_sbh, "get_write_access");
 	err = ext4_journal_get_write_access(handle, sbi->s_sbh);
@@ -1653,6 +1654,7 @@ static int ext4_group_extend_no_check(struct super_block *sb,
 		ext4_warning(sb, "error %d on journal start", err);
 		return err;
 	}
+	ext4_fc_mark_ineligible(sb, handle);
 
 	BUFFER_TRACE(EXT4_SB(sb)->s_sbh, "get_write_access");
 	err = ext4_journal_get_write_access(handle, EXT4_SB(sb)->s_sbh);
@@ -914,6 +914,8 @@ static struct inode *ext4_alloc_inode(struct super_block *sb)
 	spin_lock_init(&ei->i_completed_io_lock);
 	ei->i_sync_tid = 0;
 	ei->i_datasync_tid = 0;
+	INIT_LIST_HEAD(&ei->i_fc_list);
+	ei->i_fc_tid = 0;
 	atomic_set(&ei->i_ioend_count, 0);
 	atomic_set(&ei->i_unwritten, 0);
 	INIT_WORK(&ei->i_rsv_conversion_work, ext4_end_io_rsv_work);
@@ -991,6 +993,7 @@ void ext4_clear_inode(struct inode *inode)
 	dquot_drop(inode);
 	ext4_discard_preallocations(inode);
 	ext4_es_remove_extent(inode, 0, EXT_MAX_BLOCKS);
+	ext4_fc_del(inode);
 	if (EXT4_I(inode)->jinode) {
 		jbd2_journal_release_jbd_inode(EXT4_JOURNAL(inode),
 					       EXT4_I(inode)->jinode);
@@ -1163,6 +1166,7 @@ enum {
 	Opt_dioread_nolock, Opt_dioread_lock,
 	Opt_discard, Opt_nodiscard, Opt_init_itable, Opt_noinit_itable,
 	Opt_max_dir_size_kb, Opt_nojournal_checksum,
+	Opt_mb_optimize_scan, Opt_nomb_optimize_scan, Opt_fast_commit,
 };
 
 static const match_table_t tokens = {
@@ -1238,6 +1242,9 @@ static const match_table_t tokens = {
 	{Opt_dioread_lock, "dioread_lock"},
 	{Opt_discard, "discard"},
 	{Opt_nodiscard, "nodiscard"},
+	{Opt_mb_optimize_scan, "mb_optimize_scan"},
+	{Opt_nomb_optimize_scan, "nomb_optimize_scan"},
+	{Opt_fast_commit, "fast_commit"},
 	{Opt_init_itable, "init_itable=%u"},
 	{Opt_init_itable, "init_itable"},
 	{Opt_noinit_itable, "noinit_itable"},
@@ -1378,6 +1385,12 @@ static const struct mount_opts {
 	 MOPT_EXT4_ONLY | MOPT_CLEAR},
 	{Opt_discard, EXT4_MOUNT_DISCARD, MOPT_SET},
 	{Opt_nodiscard, EXT4_MOUNT_DISCARD, MOPT_CLEAR},
+	{Opt_mb_optimize_scan, EXT4_MOUNT_MB_OPTIMIZE_SCAN,
+	 MOPT_EXT4_ONLY | MOPT_SET},
+	{Opt_nomb_optimize_scan, EXT4_MOUNT_MB_OPTIMIZE_SCAN,
+	 MOPT_EXT4_ONLY | MOPT_CLEAR},
+	{Opt_fast_commit, EXT4_MOUNT_JOURNAL_FAST_COMMIT,
+	 MOPT_EXT4_ONLY | MOPT_SET},
 	{Opt_delalloc, EXT4_MOUNT_DELALLOC,
 	 MOPT_EXT4_ONLY | MOPT_SET | MOPT_EXPLICIT},
 	{Opt_nodelalloc, EXT4_MOUNT_DELALLOC,
@@ -2255,10 +2268,10 @@ static void ext4_orphan_cleanup(struct super_block *sb,
 					__func__, inode->i_ino, inode->i_size);
 			jbd_debug(2, "truncating inode %lu to %lld bytes\n",
 				  inode->i_ino, inode->i_size);
-			mutex_lock(&inode->i_mutex);
+			inode_lock(inode);
 			truncate_inode_pages(inode->i_mapping, inode->i_size);
 			ext4_truncate(inode);
-			mutex_unlock(&inode->i_mutex);
+			inode_unlock(inode);
 			nr_truncates++;
 		} else {
 			if (test_opt(sb, DEBUG))
@@ -3660,6 +3673,8 @@ static int ext4_fill_super(struct super_block *sb, void *data, int silent)
 	memcpy(sb->s_uuid, es->s_uuid, sizeof(es->s_uuid));
 
 	INIT_LIST_HEAD(&sbi->s_orphan); /* unlinked but open files */
+	spin_lock_init(&sbi->s_fc_lock);
+	INIT_LIST_HEAD(&sbi->s_fc_q);
 	mutex_init(&sbi->s_orphan_lock);
 
 	sb->s_root = NULL;
@@ -3695,6 +3710,11 @@ static int ext4_fill_super(struct super_block *sb, void *data, int silent)
 				 "journal_async_commit, fs mounted w/o journal");
 			goto failed_mount_wq;
 		}
+		if (test_opt(sb, JOURNAL_FAST_COMMIT)) {
+			ext4_msg(sb, KERN_ERR, "can't mount with "
+				 "fast_commit, fs mounted w/o journal");
+			goto failed_mount_wq;
+		}
 		if (sbi->s_commit_interval != JBD2_DEFAULT_MAX_COMMIT_AGE*HZ) {
 			ext4_msg(sb, KERN_ERR, "can't mount with "
 				 "commit=%lu, fs mounted w/o journal",
@@ -3756,6 +3776,21 @@ static int ext4_fill_super(struct super_block *sb, void *data, int silent)
 	}
 	set_task_ioprio(sbi->s_journal->j_task, journal_ioprio);
 
+	if (test_opt(sb, JOURNAL_FAST_COMMIT)) {
+		if (test_opt(sb, DATA_FLAGS) == EXT4_MOUNT_JOURNAL_DATA ||
+		    ext4_has_feature_bigalloc(sb)) {
+			ext4_msg(sb, KERN_ERR, "can't mount with fast_commit "
+				 "in data=journal mode or with bigalloc");
+			goto failed_mount_wq;
+		}
+		if (!jbd2_journal_set_features(sbi->s_journal, 0, 0,
+					JBD2_FEATURE_INCOMPAT_FAST_COMMIT)) {
+			ext4_msg(sb, KERN_ERR, "Failed to set fast commit "
+				 "journal feature");
+			goto failed_mount_wq;
+		}
+	}
+
 	sbi->s_journal->j_commit_callback = ext4_journal_commit_callback;
 
 no_journal:
@@ -3872,6 +3907,13 @@ no_journal:
 		goto failed_mount5;
 	}
 
+	err = ext4_fc_replay_cleanup(sb);
+	if (err) {
+		ext4_msg(sb, KERN_ERR, "failed to mark blocks of fast "
+			 "commit replay (%d)", err);
+		goto failed_mount6;
+	}
+
 	block = ext4_count_free_clusters(sb);
 	ext4_free_blocks_count_set(sbi->s_es, 
 				   EXT4_C2B(sbi, block));
@@ -3990,6 +4032,7 @@ failed_mount4:
 	if (EXT4_SB(sb)->rsv_conversion_wq)
 		destroy_workqueue(EXT4_SB(sb)->rsv_conversion_wq);
 failed_mount_wq:
+	kfree(sbi->s_fc_replay_state.fc_regions);
 	if (sbi->s_journal) {
 		jbd2_journal_destroy(sbi->s_journal);
 		sbi->s_journal = NULL;
@@ -4240,6 +4283,8 @@ static int ext4_load_journal(struct super_block *sb,
 			return -EINVAL;
 	}
 
+	ext4_fc_init(sb, journal);
+
 	if (!(journal->j_flags & JBD2_BARRIER))
 		ext4_msg(sb, KERN_INFO, "barriers disabled");
 
@@ -4628,6 +4673,20 @@ static int ext4_remount(struct super_block *sb, int *flags, char *data)
 		sbi->s_mount_opt ^= EXT4_MOUNT_DAX;
 	}
 
+	if ((sbi->s_mount_opt ^ old_opts.s_mount_opt) &
+	    EXT4_MOUNT_MB_OPTIMIZE_SCAN) {
+		ext4_msg(sb, KERN_WARNING, "warning: refusing change of "
+			"mb_optimize_scan while remounting");
+		sbi->s_mount_opt ^= EXT4_MOUNT_MB_OPTIMIZE_SCAN;
+	}
+
+	if ((sbi->s_mount_opt ^ old_opts.s_mount_opt) &
+	    EXT4_MOUNT_JOURNAL_FAST_COMMIT) {
+		ext4_msg(sb, KERN_WARNING, "warning: refusing change of "
+			"fast_commit while remounting");
+		sbi->s_mount_opt ^= EXT4_MOUNT_JOURNAL_FAST_COMMIT;
+	}
+
 	if (sbi->s_mount_flags & EXT4_MF_FS_ABORTED)
 		ext4_abort(sb, "Abort forced by user");
 
@@ -5171,6 +5230,8 @@ static ssize_t ext4_quota_write(struct super_block *sb, int type,
 	flush_dcache_page(bh->b_page);
 	unlock_buffer(bh);
 	err = ext4_handle_dirty_metadata(handle, NULL, bh);
+	/* Quota blocks are journalled, fast commits don't log them */
+	ext4_fc_mark_ineligible(sb, handle);
 	brelse(bh);
 out:
 	if (inode->i_size < off + len) {
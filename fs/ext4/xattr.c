@@ -786,6 +786,8 @@ ext4_xattr_block_set(handle_t *handle, struct inode *inode,
 
 	if (i->value && i->value_len > sb->s_blocksize)
 		return -ENOSPC;
+	/* Fast commits log the inode but not its xattr block */
+	ext4_fc_mark_ineligible(sb, handle);
 	if (s->base) {
 		ce = mb_cache_entry_get(ext4_mb_cache, bs->bh->b_bdev,
 					bs->bh->b_blocknr);
@@ -160,8 +160,8 @@ static void update_mem_info(struct f2fs_sb_info *sbi)
 	si->base_mem += f2fs_bitmap_size(MAIN_SECS(sbi));
 
 	/* build curseg */
-	si->base_mem += sizeof(struct curseg_info) * NR_CURSEG_TYPE;
-	si->base_mem += PAGE_CACHE_SIZE * NR_CURSEG_TYPE;
+	si->base_mem += sizeof(struct curseg_info) * NR_CURSEGS(sbi);
+	si->base_mem += PAGE_CACHE_SIZE * NR_CURSEGS(sbi);
 
 	/* build dirty segmap */
 	si->base_mem += sizeof(struct dirty_seglist_info);
@@ -569,10 +569,15 @@ static inline void set_new_dnode(struct dnode_of_data *dn, struct inode *inode,
  * logs individually according to the underlying devices. (default: 6)
  * Just in case, on-disk layout covers maximum 16 logs that consist of 8 for
  * data and 8 for node logs.
+ *
+ * With parallel_logs=x, each data log type gets x-1 more logs that are only
+ * kept in memory, so that writers on different CPUs can allocate blocks
+ * concurrently. (default: 1)
  */
 #define	NR_CURSEG_DATA_TYPE	(3)
 #define NR_CURSEG_NODE_TYPE	(3)
 #define NR_CURSEG_TYPE	(NR_CURSEG_DATA_TYPE + NR_CURSEG_NODE_TYPE)
+#define MAX_PARALLEL_LOGS	(8)
 
 enum {
 	CURSEG_HOT_DATA	= 0,	/* directory entry blocks */
@@ -603,6 +608,7 @@ struct f2fs_sm_info {
 	struct free_segmap_info *free_info;	/* free segment information */
 	struct dirty_seglist_info *dirty_info;	/* dirty segment information */
 	struct curseg_info *curseg_array;	/* active segment information */
+	int nr_cursegs;				/* # of active segments */
 
 	block_t seg0_blkaddr;		/* block address of 0'th segment */
 	block_t main_blkaddr;		/* start block address of main area */
@@ -772,6 +778,7 @@ struct f2fs_sb_info {
 	unsigned int total_valid_node_count;	/* valid node block count */
 	unsigned int total_valid_inode_count;	/* valid inode count */
 	int active_logs;			/* # of active logs */
+	int parallel_logs;			/* # of logs per data type */
 	int dir_level;				/* directory level */
 
 	block_t user_block_count;		/* # of user blocks */
@@ -1795,6 +1802,7 @@ void f2fs_wait_on_page_writeback(struct page *, enum page_type);
 void f2fs_wait_on_encrypted_page_writeback(struct f2fs_sb_info *, block_t);
 void write_data_summaries(struct f2fs_sb_info *, block_t);
 void write_node_summaries(struct f2fs_sb_info *, block_t);
+void write_parallel_log_summaries(struct f2fs_sb_info *);
 int lookup_journal_in_cursum(struct f2fs_summary_block *,
 					int, unsigned int, int);
 void flush_sit_entries(struct f2fs_sb_info *, struct cp_control *);
@@ -935,11 +935,12 @@ skip_left:
 		if (go_left && zoneno == 0)
 			goto got_it;
 	}
-	for (i = 0; i < NR_CURSEG_TYPE; i++)
-		if (CURSEG_I(sbi, i)->zone == zoneno)
+	for (i = 0; i < NR_CURSEGS(sbi); i++)
+		if (CURSEG_I(sbi, i)->segno != NULL_SEGNO &&
+				CURSEG_I(sbi, i)->zone == zoneno)
 			break;
 
-	if (i < NR_CURSEG_TYPE) {
+	if (i < NR_CURSEGS(sbi)) {
 		/* zone is in user, try another */
 		if (go_left)
 			hint = zoneno * sbi->secs_per_zone - 1;
@@ -970,11 +971,11 @@ static void reset_curseg(struct f2fs_sb_info *sbi, int type, int modified)
 
 	sum_footer = &(curseg->sum_blk->footer);
 	memset(sum_footer, 0, sizeof(struct summary_footer));
-	if (IS_DATASEG(type))
+	if (IS_DATASEG(curseg->log_type))
 		SET_SUM_TYPE(sum_footer, SUM_TYPE_DATA);
-	if (IS_NODESEG(type))
+	if (IS_NODESEG(curseg->log_type))
 		SET_SUM_TYPE(sum_footer, SUM_TYPE_NODE);
-	__set_sit_entry_type(sbi, type, curseg->segno, modified);
+	__set_sit_entry_type(sbi, curseg->log_type, curseg->segno, modified);
 }
 
 /*
@@ -987,9 +988,16 @@ static void new_curseg(struct f2fs_sb_info *sbi, int type, bool new_sec)
 	unsigned int segno = curseg->segno;
 	int dir = ALLOC_LEFT;
 
-	write_sum_page(sbi, curseg->sum_blk,
-				GET_SUM_BLOCK(sbi, segno));
-	if (type == CURSEG_WARM_DATA || type == CURSEG_COLD_DATA)
+	if (segno != NULL_SEGNO) {
+		write_sum_page(sbi, curseg->sum_blk,
+					GET_SUM_BLOCK(sbi, segno));
+	} else {
+		/* opening a parallel log, look for a section near its base */
+		segno = CURSEG_I(sbi, curseg->log_type)->segno;
+		new_sec = true;
+	}
+	if (curseg->log_type == CURSEG_WARM_DATA ||
+				curseg->log_type == CURSEG_COLD_DATA)
 		dir = ALLOC_RIGHT;
 
 	if (test_opt(sbi, NOHEAP))
@@ -1094,7 +1102,7 @@ static void allocate_segment_by_default(struct f2fs_sb_info *sbi,
 
 	if (force)
 		new_curseg(sbi, type, true);
-	else if (type == CURSEG_WARM_NODE)
+	else if (type == CURSEG_WARM_NODE || type >= NR_CURSEG_TYPE)
 		new_curseg(sbi, type, false);
 	else if (curseg->alloc_type == LFS && is_next_segment_free(sbi, type))
 		new_curseg(sbi, type, false);
@@ -1225,6 +1233,27 @@ static int __get_segment_type_6(struct page *page, enum page_type p_type)
 	}
 }
 
+/*
+ * With parallel_logs, data blocks are spread over several logs of the same
+ * type, one picked per CPU, so that concurrent writers do not all serialise
+ * on one curseg_mutex.  The additional logs are allocated in LFS manner
+ * only, so the base log of the type takes over again once SSR is needed.
+ */
+static int __get_parallel_log(struct f2fs_sb_info *sbi, int type)
+{
+	int nr_logs = sbi->parallel_logs;
+	int log;
+
+	if (nr_logs == 1 || !IS_DATASEG(type) || need_SSR(sbi) ||
+			unlikely(is_sbi_flag_set(sbi, SBI_POR_DOING)))
+		return type;
+
+	log = raw_smp_processor_id() % nr_logs;
+	if (!log)
+		return type;
+	return NR_CURSEG_TYPE + type * (nr_logs - 1) + log - 1;
+}
+
 static int __get_segment_type(struct page *page, enum page_type p_type)
 {
 	switch (F2FS_P_SB(page)->active_logs) {
@@ -1248,12 +1277,17 @@ void allocate_data_block(struct f2fs_sb_info *sbi, struct page *page,
 	bool direct_io = (type == CURSEG_DIRECT_IO);
 
 	type = direct_io ? CURSEG_WARM_DATA : type;
+	type = __get_parallel_log(sbi, type);
 
 	curseg = CURSEG_I(sbi, type);
 
 	mutex_lock(&curseg->curseg_mutex);
 	mutex_lock(&sit_i->sentry_lock);
 
+	/* parallel logs are opened on first use */
+	if (curseg->segno == NULL_SEGNO)
+		new_curseg(sbi, type, true);
+
 	/* direct_io'ed data is aligned to the segment for better performance */
 	if (direct_io && curseg->next_blkoff &&
 				!has_not_enough_free_secs(sbi, 0))
@@ -1282,7 +1316,7 @@ void allocate_data_block(struct f2fs_sb_info *sbi, struct page *page,
 
 	mutex_unlock(&sit_i->sentry_lock);
 
-	if (page && IS_NODESEG(type))
+	if (page && IS_NODESEG(curseg->log_type))
 		fill_node_footer_blkaddr(page, NEXT_FREE_BLKADDR(sbi, curseg));
 
 	mutex_unlock(&curseg->curseg_mutex);
@@ -1373,6 +1407,10 @@ static void __f2fs_replace_block(struct f2fs_sb_info *sbi,
 			type = CURSEG_WARM_DATA;
 	}
 
+	/* a segment open in a parallel log must be written through it */
+	if (curseg_of_segno(sbi, segno) >= NR_CURSEG_TYPE)
+		type = curseg_of_segno(sbi, segno);
+
 	curseg = CURSEG_I(sbi, type);
 
 	mutex_lock(&curseg->curseg_mutex);
@@ -1734,6 +1772,26 @@ void write_data_summaries(struct f2fs_sb_info *sbi, block_t start_blk)
 		write_normal_summaries(sbi, start_blk, CURSEG_HOT_DATA);
 }
 
+/*
+ * The parallel logs are not recorded in the checkpoint.  Write their summary
+ * blocks to SSA instead, so that their segments look like any other dirty
+ * segment to GC and fsck after the next mount.  They are kept open.
+ */
+void write_parallel_log_summaries(struct f2fs_sb_info *sbi)
+{
+	int i;
+
+	for (i = NR_CURSEG_TYPE; i < NR_CURSEGS(sbi); i++) {
+		struct curseg_info *curseg = CURSEG_I(sbi, i);
+
+		mutex_lock(&curseg->curseg_mutex);
+		if (curseg->segno != NULL_SEGNO)
+			write_sum_page(sbi, curseg->sum_blk,
+					GET_SUM_BLOCK(sbi, curseg->segno));
+		mutex_unlock(&curseg->curseg_mutex);
+	}
+}
+
 void write_node_summaries(struct f2fs_sb_info *sbi, block_t start_blk)
 {
 	write_normal_summaries(sbi, start_blk, CURSEG_HOT_NODE);
@@ -2100,19 +2158,28 @@ static int build_curseg(struct f2fs_sb_info *sbi)
 	struct curseg_info *array;
 	int i;
 
-	array = kcalloc(NR_CURSEG_TYPE, sizeof(*array), GFP_KERNEL);
+	int nr_cursegs = NR_CURSEG_TYPE +
+			NR_CURSEG_DATA_TYPE * (sbi->parallel_logs - 1);
+
+	array = kcalloc(nr_cursegs, sizeof(*array), GFP_KERNEL);
 	if (!array)
 		return -ENOMEM;
 
 	SM_I(sbi)->curseg_array = array;
+	SM_I(sbi)->nr_cursegs = nr_cursegs;
 
-	for (i = 0; i < NR_CURSEG_TYPE; i++) {
+	for (i = 0; i < nr_cursegs; i++) {
 		mutex_init(&array[i].curseg_mutex);
 		array[i].sum_blk = kzalloc(PAGE_CACHE_SIZE, GFP_KERNEL);
 		if (!array[i].sum_blk)
 			return -ENOMEM;
 		array[i].segno = NULL_SEGNO;
 		array[i].next_blkoff = 0;
+		if (i < NR_CURSEG_TYPE)
+			array[i].log_type = i;
+		else
+			array[i].log_type = (i - NR_CURSEG_TYPE) /
+						(sbi->parallel_logs - 1);
 	}
 	return restore_curseg_summaries(sbi);
 }
@@ -2383,7 +2450,7 @@ static void destroy_curseg(struct f2fs_sb_info *sbi)
 	if (!array)
 		return;
 	SM_I(sbi)->curseg_array = NULL;
-	for (i = 0; i < NR_CURSEG_TYPE; i++)
+	for (i = 0; i < NR_CURSEGS(sbi); i++)
 		kfree(array[i].sum_blk);
 	kfree(array);
 }
@@ -24,27 +24,11 @@
 #define IS_DATASEG(t)	(t <= CURSEG_COLD_DATA)
 #define IS_NODESEG(t)	(t >= CURSEG_HOT_NODE)
 
-#define IS_CURSEG(sbi, seg)						\
-	((seg == CURSEG_I(sbi, CURSEG_HOT_DATA)->segno) ||	\
-	 (seg == CURSEG_I(sbi, CURSEG_WARM_DATA)->segno) ||	\
-	 (seg == CURSEG_I(sbi, CURSEG_COLD_DATA)->segno) ||	\
-	 (seg == CURSEG_I(sbi, CURSEG_HOT_NODE)->segno) ||	\
-	 (seg == CURSEG_I(sbi, CURSEG_WARM_NODE)->segno) ||	\
-	 (seg == CURSEG_I(sbi, CURSEG_COLD_NODE)->segno))
-
-#define IS_CURSEC(sbi, secno)						\
-	((secno == CURSEG_I(sbi, CURSEG_HOT_DATA)->segno /		\
-	  sbi->segs_per_sec) ||	\
-	 (secno == CURSEG_I(sbi, CURSEG_WARM_DATA)->segno /		\
-	  sbi->segs_per_sec) ||	\
-	 (secno == CURSEG_I(sbi, CURSEG_COLD_DATA)->segno /		\
-	  sbi->segs_per_sec) ||	\
-	 (secno == CURSEG_I(sbi, CURSEG_HOT_NODE)->segno /		\
-	  sbi->segs_per_sec) ||	\
-	 (secno == CURSEG_I(sbi, CURSEG_WARM_NODE)->segno /		\
-	  sbi->segs_per_sec) ||	\
-	 (secno == CURSEG_I(sbi, CURSEG_COLD_NODE)->segno /		\
-	  sbi->segs_per_sec))	\
+/* # of current segments, including the additional parallel data logs */
+#define NR_CURSEGS(sbi)		(SM_I(sbi)->nr_cursegs)
+
+#define IS_CURSEG(sbi, seg)	(curseg_of_segno(sbi, seg) >= 0)
+#define IS_CURSEC(sbi, secno)	(curseg_of_secno(sbi, secno) >= 0)
 
 #define MAIN_BLKADDR(sbi)	(SM_I(sbi)->main_blkaddr)
 #define SEG0_BLKADDR(sbi)	(SM_I(sbi)->seg0_blkaddr)
@@ -258,6 +242,7 @@ struct curseg_info {
 	struct mutex curseg_mutex;		/* lock for consistency */
 	struct f2fs_summary_block *sum_blk;	/* cached summary block */
 	unsigned char alloc_type;		/* current allocation type */
+	unsigned char log_type;			/* log type like CURSEG_XXX */
 	unsigned int segno;			/* current segment number */
 	unsigned short next_blkoff;		/* next block offset to write */
 	unsigned int zone;			/* current zone number */
@@ -278,6 +263,29 @@ static inline struct curseg_info *CURSEG_I(struct f2fs_sb_info *sbi, int type)
 	return (struct curseg_info *)(SM_I(sbi)->curseg_array + type);
 }
 
+/* Return the index of the current segment @segno is open in, or -1 */
+static inline int curseg_of_segno(struct f2fs_sb_info *sbi,
+						unsigned int segno)
+{
+	int i;
+
+	for (i = 0; i < NR_CURSEGS(sbi); i++)
+		if (CURSEG_I(sbi, i)->segno == segno)
+			return i;
+	return -1;
+}
+
+static inline int curseg_of_secno(struct f2fs_sb_info *sbi,
+						unsigned int secno)
+{
+	int i;
+
+	for (i = 0; i < NR_CURSEGS(sbi); i++)
+		if (CURSEG_I(sbi, i)->segno / sbi->segs_per_sec == secno)
+			return i;
+	return -1;
+}
+
 static inline struct seg_entry *get_seg_entry(struct f2fs_sb_info *sbi,
 						unsigned int segno)
 {
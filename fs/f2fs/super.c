@@ -57,6 +57,7 @@ enum {
 	Opt_acl,
 	Opt_noacl,
 	Opt_active_logs,
+	Opt_parallel_logs,
 	Opt_disable_ext_identify,
 	Opt_inline_xattr,
 	Opt_inline_data,
@@ -81,6 +82,7 @@ static match_table_t f2fs_tokens = {
 	{Opt_acl, "acl"},
 	{Opt_noacl, "noacl"},
 	{Opt_active_logs, "active_logs=%u"},
+	{Opt_parallel_logs, "parallel_logs=%u"},
 	{Opt_disable_ext_identify, "disable_ext_identify"},
 	{Opt_inline_xattr, "inline_xattr"},
 	{Opt_inline_data, "inline_data"},
@@ -379,6 +381,13 @@ static int parse_options(struct super_block *sb, char *options)
 				return -EINVAL;
 			sbi->active_logs = arg;
 			break;
+		case Opt_parallel_logs:
+			if (args->from && match_int(args, &arg))
+				return -EINVAL;
+			if (arg < 1 || arg > MAX_PARALLEL_LOGS)
+				return -EINVAL;
+			sbi->parallel_logs = arg;
+			break;
 		case Opt_disable_ext_identify:
 			set_opt(sbi, DISABLE_EXT_IDENTIFY);
 			break;
@@ -687,6 +696,8 @@ static int f2fs_show_options(struct seq_file *seq, struct dentry *root)
 	else
 		seq_puts(seq, ",noextent_cache");
 	seq_printf(seq, ",active_logs=%u", sbi->active_logs);
+	if (sbi->parallel_logs > 1)
+		seq_printf(seq, ",parallel_logs=%u", sbi->parallel_logs);
 
 	return 0;
 }
@@ -735,6 +746,7 @@ static void default_options(struct f2fs_sb_info *sbi)
 {
 	/* init some FS parameters */
 	sbi->active_logs = NR_CURSEG_TYPE;
+	sbi->parallel_logs = 1;
 
 	set_opt(sbi, BG_GC);
 	set_opt(sbi, INLINE_DATA);
@@ -752,7 +764,7 @@ static int f2fs_remount(struct super_block *sb, int *flags, char *data)
 {
 	struct f2fs_sb_info *sbi = F2FS_SB(sb);
 	struct f2fs_mount_info org_mount_opt;
-	int err, active_logs;
+	int err, active_logs, parallel_logs;
 	bool need_restart_gc = false;
 	bool need_stop_gc = false;
 	bool no_extent_cache = !test_opt(sbi, EXTENT_CACHE);
@@ -765,6 +777,7 @@ static int f2fs_remount(struct super_block *sb, int *flags, char *data)
 	 */
 	org_mount_opt = sbi->mount_opt;
 	active_logs = sbi->active_logs;
+	parallel_logs = sbi->parallel_logs;
 
 	sbi->mount_opt.opt = 0;
 	default_options(sbi);
@@ -774,6 +787,14 @@ static int f2fs_remount(struct super_block *sb, int *flags, char *data)
 	if (err)
 		goto restore_opts;
 
+	/* the logs are set up at mount time */
+	if (parallel_logs != sbi->parallel_logs) {
+		err = -EINVAL;
+		f2fs_msg(sbi->sb, KERN_WARNING,
+				"switch parallel_logs option is not allowed");
+		goto restore_opts;
+	}
+
 	/*
 	 * Previous and new state of filesystem is RO,
 	 * so skip checking GC and FLUSH_MERGE conditions.
@@ -834,6 +855,7 @@ restore_gc:
 restore_opts:
 	sbi->mount_opt = org_mount_opt;
 	sbi->active_logs = active_logs;
+	sbi->parallel_logs = parallel_logs;
 	return err;
 }
 
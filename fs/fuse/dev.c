@@ -19,6 +19,7 @@
 #include <linux/pipe_fs_i.h>
 #include <linux/swap.h>
 #include <linux/splice.h>
+#include <linux/percpu.h>
 
 MODULE_ALIAS_MISCDEV(FUSE_MINOR);
 MODULE_ALIAS("devname:fuse");
@@ -327,11 +328,54 @@ static void queue_request(struct fuse_iqueue *fiq, struct fuse_req *req)
 {
 	req->in.h.len = sizeof(struct fuse_in_header) +
 		len_args(req->in.numargs, (struct fuse_arg *) req->in.args);
+	req->fiq = fiq;
 	list_add_tail(&req->list, &fiq->pending);
 	wake_up_locked(&fiq->waitq);
 	kill_fasync(&fiq->fasync, SIGIO, POLL_IN);
 }
 
+/*
+ * Pick the input queue for a new request: the queue of the submitting CPU
+ * if a daemon thread reads from it, the shared queue otherwise.  Returns
+ * with the queue locked.
+ */
+static struct fuse_iqueue *fuse_lock_iqueue(struct fuse_conn *fc)
+{
+	struct fuse_iqueue __percpu *cpu_iq = smp_load_acquire(&fc->cpu_iq);
+	struct fuse_iqueue *fiq;
+
+	if (cpu_iq) {
+		fiq = raw_cpu_ptr(cpu_iq);
+		if (READ_ONCE(fiq->attached)) {
+			spin_lock(&fiq->waitq.lock);
+			if (fiq->attached && fiq->connected)
+				return fiq;
+			spin_unlock(&fiq->waitq.lock);
+		}
+	}
+	fiq = &fc->iq;
+	spin_lock(&fiq->waitq.lock);
+	return fiq;
+}
+
+/*
+ * Lock the input queue a request was put on.  Requests move to the shared
+ * queue when the last reader of a per-cpu queue goes away, so recheck
+ * after taking the lock.
+ */
+static struct fuse_iqueue *fuse_lock_req_iqueue(struct fuse_req *req)
+{
+	struct fuse_iqueue *fiq;
+
+	for (;;) {
+		fiq = READ_ONCE(req->fiq);
+		spin_lock(&fiq->waitq.lock);
+		if (fiq == req->fiq)
+			return fiq;
+		spin_unlock(&fiq->waitq.lock);
+	}
+}
+
 void fuse_queue_forget(struct fuse_conn *fc, struct fuse_forget_link *forget,
 		       u64 nodeid, u64 nlookup)
 {
@@ -357,12 +401,12 @@ static void flush_bg_queue(struct fuse_conn *fc)
 	while (fc->active_background < fc->max_background &&
 	       !list_empty(&fc->bg_queue)) {
 		struct fuse_req *req;
-		struct fuse_iqueue *fiq = &fc->iq;
+		struct fuse_iqueue *fiq;
 
 		req = list_entry(fc->bg_queue.next, struct fuse_req, list);
 		list_del(&req->list);
 		fc->active_background++;
-		spin_lock(&fiq->waitq.lock);
+		fiq = fuse_lock_iqueue(fc);
 		req->in.h.unique = fuse_get_unique(fiq);
 		queue_request(fiq, req);
 		spin_unlock(&fiq->waitq.lock);
@@ -457,7 +501,7 @@ static void request_wait_answer(struct fuse_conn *fc, struct fuse_req *req)
 		if (!err)
 			return;
 
-		spin_lock(&fiq->waitq.lock);
+		fiq = fuse_lock_req_iqueue(req);
 		/* Request is not yet in userspace, bail out */
 		if (test_bit(FR_PENDING, &req->flags)) {
 			list_del(&req->list);
@@ -478,10 +522,10 @@ static void request_wait_answer(struct fuse_conn *fc, struct fuse_req *req)
 
 static void __fuse_request_send(struct fuse_conn *fc, struct fuse_req *req)
 {
-	struct fuse_iqueue *fiq = &fc->iq;
+	struct fuse_iqueue *fiq;
 
 	BUG_ON(test_bit(FR_BACKGROUND, &req->flags));
-	spin_lock(&fiq->waitq.lock);
+	fiq = fuse_lock_iqueue(fc);
 	if (!fiq->connected) {
 		spin_unlock(&fiq->waitq.lock);
 		req->out.h.error = -ENOTCONN;
@@ -1237,7 +1281,7 @@ static ssize_t fuse_dev_do_read(struct fuse_dev *fud, struct file *file,
 {
 	ssize_t err;
 	struct fuse_conn *fc = fud->fc;
-	struct fuse_iqueue *fiq = &fc->iq;
+	struct fuse_iqueue *fiq = READ_ONCE(fud->fiq);
 	struct fuse_pqueue *fpq = &fud->pq;
 	struct fuse_req *req;
 	struct fuse_in *in;
@@ -1318,7 +1362,7 @@ static ssize_t fuse_dev_do_read(struct fuse_dev *fud, struct file *file,
 	/* matches barrier in request_wait_answer() */
 	smp_mb__after_atomic();
 	if (test_bit(FR_INTERRUPTED, &req->flags))
-		queue_interrupt(fiq, req);
+		queue_interrupt(&fc->iq, req);
 
 	return reqsize;
 
@@ -2059,7 +2103,7 @@ static unsigned fuse_dev_poll(struct file *file, poll_table *wait)
 	if (!fud)
 		return POLLERR;
 
-	fiq = &fud->fc->iq;
+	fiq = READ_ONCE(fud->fiq);
 	poll_wait(file, &fiq->waitq, wait);
 
 	spin_lock(&fiq->waitq.lock);
@@ -2166,6 +2210,20 @@ void fuse_abort_conn(struct fuse_conn *fc)
 		wake_up_all_locked(&fiq->waitq);
 		spin_unlock(&fiq->waitq.lock);
 		kill_fasync(&fiq->fasync, SIGIO, POLL_IN);
+		if (fc->cpu_iq) {
+			int cpu;
+
+			for_each_possible_cpu(cpu) {
+				struct fuse_iqueue *cfiq;
+
+				cfiq = per_cpu_ptr(fc->cpu_iq, cpu);
+				spin_lock(&cfiq->waitq.lock);
+				cfiq->connected = 0;
+				list_splice_init(&cfiq->pending, &to_end2);
+				wake_up_all_locked(&cfiq->waitq);
+				spin_unlock(&cfiq->waitq.lock);
+			}
+		}
 		end_polls(fc);
 		wake_up_all(&fc->blocked_waitq);
 		spin_unlock(&fc->lock);
@@ -2183,6 +2241,87 @@ void fuse_abort_conn(struct fuse_conn *fc)
 }
 EXPORT_SYMBOL_GPL(fuse_abort_conn);
 
+/*
+ * Stop reading from a per-cpu queue.  When the last reader leaves, the
+ * requests still pending there are handed over to the shared queue and
+ * new requests from that CPU go there too.
+ */
+static void fuse_dev_detach_queue(struct fuse_dev *fud)
+{
+	struct fuse_conn *fc = fud->fc;
+	struct fuse_iqueue *fiq = fud->fiq;
+	struct fuse_req *req, *next;
+
+	if (fiq == &fc->iq)
+		return;
+
+	spin_lock(&fiq->waitq.lock);
+	if (!--fiq->attached && !list_empty(&fiq->pending)) {
+		spin_lock_nested(&fc->iq.waitq.lock, SINGLE_DEPTH_NESTING);
+		list_for_each_entry_safe(req, next, &fiq->pending, list) {
+			req->fiq = &fc->iq;
+			list_move_tail(&req->list, &fc->iq.pending);
+		}
+		wake_up_locked(&fc->iq.waitq);
+		spin_unlock(&fc->iq.waitq.lock);
+		kill_fasync(&fc->iq.fasync, SIGIO, POLL_IN);
+	}
+	spin_unlock(&fiq->waitq.lock);
+	fud->fiq = &fc->iq;
+}
+
+static int fuse_dev_attach_queue(struct fuse_dev *fud, u32 cpu)
+{
+	struct fuse_conn *fc = fud->fc;
+	struct fuse_iqueue __percpu *cpu_iq;
+	struct fuse_iqueue *fiq;
+	int i;
+
+	if (cpu >= nr_cpu_ids || !cpu_possible(cpu))
+		return -EINVAL;
+	if (fud->fiq != &fc->iq)
+		return -EBUSY;
+
+	cpu_iq = smp_load_acquire(&fc->cpu_iq);
+	if (!cpu_iq) {
+		cpu_iq = alloc_percpu(struct fuse_iqueue);
+		if (!cpu_iq)
+			return -ENOMEM;
+		for_each_possible_cpu(i) {
+			fiq = per_cpu_ptr(cpu_iq, i);
+			fuse_iqueue_init(fiq);
+			fiq->reqctr = (u64)(i + 1) << FUSE_IQUEUE_ID_SHIFT;
+		}
+
+		spin_lock(&fc->lock);
+		if (!fc->connected) {
+			spin_unlock(&fc->lock);
+			free_percpu(cpu_iq);
+			return -ENODEV;
+		}
+		if (fc->cpu_iq) {
+			free_percpu(cpu_iq);
+		} else {
+			/* pairs with smp_load_acquire() in fuse_lock_iqueue() */
+			smp_store_release(&fc->cpu_iq, cpu_iq);
+		}
+		cpu_iq = fc->cpu_iq;
+		spin_unlock(&fc->lock);
+	}
+
+	fiq = per_cpu_ptr(cpu_iq, cpu);
+	spin_lock(&fiq->waitq.lock);
+	if (!fiq->connected) {
+		spin_unlock(&fiq->waitq.lock);
+		return -ENODEV;
+	}
+	fiq->attached++;
+	spin_unlock(&fiq->waitq.lock);
+	WRITE_ONCE(fud->fiq, fiq);
+
+	return 0;
+}
+
 int fuse_dev_release(struct inode *inode, struct file *file)
 {
 	struct fuse_dev *fud = fuse_get_dev(file);
@@ -2191,6 +2330,7 @@ int fuse_dev_release(struct inode *inode, struct file *file)
 		struct fuse_conn *fc = fud->fc;
 		struct fuse_pqueue *fpq = &fud->pq;
 
+		fuse_dev_detach_queue(fud);
 		WARN_ON(!list_empty(&fpq->io));
 		end_requests(fc, &fpq->processing);
 		/* Are we the last open device? */
@@ -2232,40 +2372,107 @@ static int fuse_device_clone(struct fuse_conn *fc, struct file *new)
 	return 0;
 }
 
+static long fuse_dev_ioctl_clone(struct file *file, __u32 __user *argp)
+{
+	int oldfd;
+	int err;
+
+	err = -EFAULT;
+	if (!get_user(oldfd, argp)) {
+		struct file *old = fget(oldfd);
+
+		err = -EINVAL;
+		if (old) {
+			struct fuse_dev *fud = NULL;
+
+			/*
+			 * Check against file->f_op because CUSE
+			 * uses the same ioctl handler.
+			 */
+			if (old->f_op == file->f_op &&
+			    old->f_cred->user_ns == file->f_cred->user_ns)
+				fud = fuse_get_dev(old);
+
+			if (fud) {
+				mutex_lock(&fuse_mutex);
+				err = fuse_device_clone(fud->fc, file);
+				mutex_unlock(&fuse_mutex);
+			}
+			fput(old);
+		}
+	}
+	return err;
+}
+
+static long fuse_dev_ioctl_backing_open(struct file *file,
+					struct fuse_backing_map __user *argp)
+{
+	struct fuse_dev *fud = fuse_get_dev(file);
+	struct fuse_backing_map map;
+
+	if (!fud)
+		return -EPERM;
+
+	if (copy_from_user(&map, argp, sizeof(map)))
+		return -EFAULT;
+
+	return fuse_backing_open(fud->fc, &map);
+}
+
+static long fuse_dev_ioctl_backing_close(struct file *file, __u32 __user *argp)
+{
+	struct fuse_dev *fud = fuse_get_dev(file);
+	int backing_id;
+
+	if (!fud)
+		return -EPERM;
+
+	if (get_user(backing_id, argp))
+		return -EFAULT;
+
+	return fuse_backing_close(fud->fc, backing_id);
+}
+
+static long fuse_dev_ioctl_attach_queue(struct file *file, __u32 __user *argp)
+{
+	struct fuse_dev *fud = fuse_get_dev(file);
+	u32 cpu;
+	int err;
+
+	if (!fud)
+		return -EPERM;
+
+	if (get_user(cpu, argp))
+		return -EFAULT;
+
+	mutex_lock(&fuse_mutex);
+	err = fuse_dev_attach_queue(fud, cpu);
+	mutex_unlock(&fuse_mutex);
+
+	return err;
+}
+
 static long fuse_dev_ioctl(struct file *file, unsigned int cmd,
 			   unsigned long arg)
 {
-	int err = -ENOTTY;
+	void __user *argp = (void __user *)arg;
 
-	if (cmd == FUSE_DEV_IOC_CLONE) {
-		int oldfd;
+	switch (cmd) {
+	case FUSE_DEV_IOC_CLONE:
+		return fuse_dev_ioctl_clone(file, argp);
 
-		err = -EFAULT;
-		if (!get_user(oldfd, (__u32 __user *) arg)) {
-			struct file *old = fget(oldfd);
+	case FUSE_DEV_IOC_BACKING_OPEN:
+		return fuse_dev_ioctl_backing_open(file, argp);
 
-			err = -EINVAL;
-			if (old) {
-				struct fuse_dev *fud = NULL;
+	case FUSE_DEV_IOC_BACKING_CLOSE:
+		return fuse_dev_ioctl_backing_close(file, argp);
 
-				/*
-				 * Check against file->f_op because CUSE
-				 * uses the same ioctl handler.
-				 */
-				if (old->f_op == file->f_op &&
-				    old->f_cred->user_ns == file->f_cred->user_ns)
-					fud = fuse_get_dev(old);
+	case FUSE_DEV_IOC_ATTACH_QUEUE:
+		return fuse_dev_ioctl_attach_queue(file, argp);
 
-				if (fud) {
-					mutex_lock(&fuse_mutex);
-					err = fuse_device_clone(fud->fc, file);
-					mutex_unlock(&fuse_mutex);
-				}
-				fput(old);
-			}
-		}
+	default:
+		return -ENOTTY;
 	}
-	return err;
 }
 
 const struct file_operations fuse_dev_operations = {
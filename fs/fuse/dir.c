@@ -453,6 +453,8 @@ static int fuse_create_open(struct inode *dir, struct dentry *entry,
 	fuse_change_entry_timeout(entry, &outentry);
 	fuse_invalidate_attr(dir);
 	err = finish_open(file, entry, generic_file_open, opened);
+	if (!err && (ff->open_flags & FOPEN_PASSTHROUGH))
+		err = fuse_passthrough_open(fc, ff, outopen.backing_id);
 	if (err) {
 		fuse_sync_release(ff, flags);
 	} else {
@@ -913,11 +915,21 @@ int fuse_update_attributes(struct inode *inode, struct kstat *stat,
 	int err;
 	bool r;
 
-	if (time_before64(fi->i_time, get_jiffies_64())) {
+	/*
+	 * A statx() caller may force a GETATTR, or tell us the cache will do
+	 * because it said so or only wants the file type and inode number.
+	 */
+	if (stat && (stat->query_flags & AT_STATX_FORCE_SYNC))
 		r = true;
+	else if (stat && ((stat->query_flags & AT_STATX_DONT_SYNC) ||
+			  !(stat->request_mask & ~(STATX_TYPE | STATX_INO))))
+		r = false;
+	else
+		r = time_before64(fi->i_time, get_jiffies_64());
+
+	if (r) {
 		err = fuse_do_getattr(inode, stat, file);
 	} else {
-		r = false;
 		err = 0;
 		if (stat) {
 			generic_fillattr(inode, stat);
@@ -944,7 +956,7 @@ int fuse_reverse_inval_entry(struct super_block *sb, u64 parent_nodeid,
 	if (!parent)
 		return -ENOENT;
 
-	mutex_lock(&parent->i_mutex);
+	inode_lock(parent);
 	if (!S_ISDIR(parent->i_mode))
 		goto unlock;
 
@@ -962,7 +974,7 @@ int fuse_reverse_inval_entry(struct super_block *sb, u64 parent_nodeid,
 	fuse_invalidate_entry(entry);
 
 	if (child_nodeid != 0 && d_really_is_positive(entry)) {
-		mutex_lock(&d_inode(entry)->i_mutex);
+		inode_lock(d_inode(entry));
 		if (get_node_id(d_inode(entry)) != child_nodeid) {
 			err = -ENOENT;
 			goto badentry;
@@ -983,7 +995,7 @@ int fuse_reverse_inval_entry(struct super_block *sb, u64 parent_nodeid,
 		clear_nlink(d_inode(entry));
 		err = 0;
  badentry:
-		mutex_unlock(&d_inode(entry)->i_mutex);
+		inode_unlock(d_inode(entry));
 		if (!err)
 			d_delete(entry);
 	} else {
@@ -992,7 +1004,7 @@ int fuse_reverse_inval_entry(struct super_block *sb, u64 parent_nodeid,
 	dput(entry);
 
  unlock:
-	mutex_unlock(&parent->i_mutex);
+	inode_unlock(parent);
 	iput(parent);
 	return err;
 }
@@ -1500,7 +1512,7 @@ void fuse_set_nowrite(struct inode *inode)
 	struct fuse_conn *fc = get_fuse_conn(inode);
 	struct fuse_inode *fi = get_fuse_inode(inode);
 
-	BUG_ON(!mutex_is_locked(&inode->i_mutex));
+	BUG_ON(!inode_is_locked(inode));
 
 	spin_lock(&fc->lock);
 	BUG_ON(fi->writectr < 0);
@@ -23,6 +23,10 @@
 #include <linux/poll.h>
 #include <linux/workqueue.h>
 #include <linux/kref.h>
+#include <linux/idr.h>
+#include <linux/cred.h>
+
+#define FUSE_SUPER_MAGIC 0x65735546
 
 /** Max number of pages that can be used in a single read request */
 #define FUSE_MAX_PAGES_PER_REQ 32
@@ -124,6 +128,18 @@ enum {
 
 struct fuse_conn;
 
+/** A file registered by the filesystem daemon for passthrough I/O */
+struct fuse_backing {
+	/** The file I/O is forwarded to */
+	struct file *file;
+
+	/** Credentials of the daemon, used for the forwarded I/O */
+	const struct cred *cred;
+
+	/** Refcount */
+	atomic_t count;
+};
+
 /** FUSE specific file data */
 struct fuse_file {
 	/** Fuse connection for this file */
@@ -147,6 +163,9 @@ struct fuse_file {
 	/** FOPEN_* flags returned by open */
 	u32 open_flags;
 
+	/** Backing file for FOPEN_PASSTHROUGH opens */
+	struct fuse_backing *passthrough;
+
 	/** Entry on inode's write_files list */
 	struct list_head write_entry;
 
@@ -315,6 +334,9 @@ struct fuse_req {
 	/** Unique ID for the interrupt request */
 	u64 intr_unique;
 
+	/** Input queue the request was queued on */
+	struct fuse_iqueue *fiq;
+
 	/* Request flags, updated with test/set/clear_bit() */
 	unsigned long flags;
 
@@ -410,8 +432,17 @@ struct fuse_iqueue {
 
 	/** O_ASYNC requests */
 	struct fasync_struct *fasync;
+
+	/** Number of devices reading from a per-cpu queue */
+	unsigned attached;
 };
 
+/*
+ * Request IDs of the per-cpu queues start at (cpu + 1) << FUSE_IQUEUE_ID_SHIFT
+ * so that they never collide with each other or with the shared queue.
+ */
+#define FUSE_IQUEUE_ID_SHIFT	48
+
 struct fuse_pqueue {
 	/** Connection established */
 	unsigned connected;
@@ -433,6 +464,9 @@ struct fuse_dev {
 	/** Fuse connection for this device */
 	struct fuse_conn *fc;
 
+	/** Input queue this device reads requests from */
+	struct fuse_iqueue *fiq;
+
 	/** Processing queue */
 	struct fuse_pqueue pq;
 
@@ -474,9 +508,12 @@ struct fuse_conn {
 	/** Maximum write size */
 	unsigned max_write;
 
-	/** Input queue */
+	/** Input queue, also carries all FORGET and INTERRUPT requests */
 	struct fuse_iqueue iq;
 
+	/** Per-cpu input queues, allocated once a device attaches to one */
+	struct fuse_iqueue __percpu *cpu_iq;
+
 	/** The next unique kernel file handle */
 	u64 khctr;
 
@@ -614,6 +651,9 @@ struct fuse_conn {
 	/** Does the filesystem support asynchronous direct-IO submission? */
 	unsigned async_dio:1;
 
+	/** May files be opened in passthrough mode?  Only set in INIT */
+	unsigned passthrough:1;
+
 	/** The number of requests waiting for completion */
 	atomic_t num_waiting;
 
@@ -655,6 +695,9 @@ struct fuse_conn {
 
 	/** List of device instances belonging to this connection */
 	struct list_head devices;
+
+	/** Backing files registered for passthrough, protected by lock */
+	struct idr backing_files_map;
 };
 
 static inline struct fuse_conn *get_fuse_conn_super(struct super_block *sb)
@@ -867,6 +910,11 @@ void fuse_conn_init(struct fuse_conn *fc);
  */
 void fuse_conn_put(struct fuse_conn *fc);
 
+/**
+ * Initialize an input queue
+ */
+void fuse_iqueue_init(struct fuse_iqueue *fiq);
+
 struct fuse_dev *fuse_dev_alloc(struct fuse_conn *fc);
 void fuse_dev_free(struct fuse_dev *fud);
 
@@ -953,4 +1001,18 @@ int fuse_do_setattr(struct inode *inode, struct iattr *attr,
 
 void fuse_set_initialized(struct fuse_conn *fc);
 
+/* passthrough.c */
+int fuse_backing_open(struct fuse_conn *fc, struct fuse_backing_map *map);
+int fuse_backing_close(struct fuse_conn *fc, int backing_id);
+struct fuse_backing *fuse_backing_lookup(struct fuse_conn *fc, int backing_id);
+void fuse_backing_put(struct fuse_backing *fb);
+void fuse_backing_files_free(struct fuse_conn *fc);
+
+int fuse_passthrough_open(struct fuse_conn *fc, struct fuse_file *ff,
+			  int backing_id);
+
+ssize_t fuse_passthrough_read_iter(struct kiocb *iocb, struct iov_iter *to);
+ssize_t fuse_passthrough_write_iter(struct kiocb *iocb, struct iov_iter *from);
+int fuse_passthrough_mmap(struct file *file, struct vm_area_struct *vma);
+
 #endif /* _FS_FUSE_I_H */
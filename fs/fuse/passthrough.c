@@ -0,0 +1,234 @@
+/*
+  FUSE: Filesystem in Userspace
+
+  This program can be distributed under the terms of the GNU GPL.
+  See the file COPYING.
+*/
+
+/*
+ * Passthrough I/O: the daemon registers an open file with the connection
+ * and names it in the reply to OPEN.  Reads, writes and mmap of the FUSE
+ * file then go to that file directly, with the daemon's credentials,
+ * instead of taking a round trip through userspace.
+ */
+
+#include "fuse_i.h"
+
+#include <linux/file.h>
+#include <linux/slab.h>
+#include <linux/uio.h>
+#include <linux/mm.h>
+
+static void fuse_backing_free(struct fuse_backing *fb)
+{
+	fput(fb->file);
+	put_cred(fb->cred);
+	kfree(fb);
+}
+
+void fuse_backing_put(struct fuse_backing *fb)
+{
+	if (atomic_dec_and_test(&fb->count))
+		fuse_backing_free(fb);
+}
+
+int fuse_backing_open(struct fuse_conn *fc, struct fuse_backing_map *map)
+{
+	struct fuse_backing *fb;
+	struct file *file;
+	int err;
+
+	/* The daemon gets to do I/O on any file it can hand us */
+	if (!fc->passthrough || !capable(CAP_SYS_ADMIN))
+		return -EPERM;
+
+	if (map->flags || map->padding)
+		return -EINVAL;
+
+	file = fget(map->fd);
+	if (!file)
+		return -EBADF;
+
+	/* Don't stack passthrough files on top of each other */
+	err = -EOPNOTSUPP;
+	if (!file->f_op->read_iter || !file->f_op->write_iter ||
+	    file_inode(file)->i_sb->s_magic == FUSE_SUPER_MAGIC)
+		goto out_fput;
+
+	err = -ENOMEM;
+	fb = kmalloc(sizeof(*fb), GFP_KERNEL);
+	if (!fb)
+		goto out_fput;
+
+	fb->file = file;
+	fb->cred = prepare_creds();
+	if (!fb->cred) {
+		kfree(fb);
+		goto out_fput;
+	}
+	atomic_set(&fb->count, 1);
+
+	idr_preload(GFP_KERNEL);
+	spin_lock(&fc->lock);
+	err = idr_alloc(&fc->backing_files_map, fb, 1, 0, GFP_ATOMIC);
+	spin_unlock(&fc->lock);
+	idr_preload_end();
+
+	if (err < 0)
+		fuse_backing_free(fb);
+	return err;
+
+out_fput:
+	fput(file);
+	return err;
+}
+
+int fuse_backing_close(struct fuse_conn *fc, int backing_id)
+{
+	struct fuse_backing *fb;
+
+	if (!fc->passthrough || !capable(CAP_SYS_ADMIN))
+		return -EPERM;
+
+	if (backing_id <= 0)
+		return -EINVAL;
+
+	spin_lock(&fc->lock);
+	fb = idr_find(&fc->backing_files_map, backing_id);
+	if (fb)
+		idr_remove(&fc->backing_files_map, backing_id);
+	spin_unlock(&fc->lock);
+
+	if (!fb)
+		return -ENOENT;
+
+	/* Files already opened with it keep their reference */
+	fuse_backing_put(fb);
+	return 0;
+}
+
+struct fuse_backing *fuse_backing_lookup(struct fuse_conn *fc, int backing_id)
+{
+	struct fuse_backing *fb = NULL;
+
+	if (backing_id <= 0)
+		return NULL;
+
+	spin_lock(&fc->lock);
+	fb = idr_find(&fc->backing_files_map, backing_id);
+	if (fb)
+		atomic_inc(&fb->count);
+	spin_unlock(&fc->lock);
+
+	return fb;
+}
+
+static int fuse_backing_id_free(int id, void *p, void *data)
+{
+	fuse_backing_put(p);
+	return 0;
+}
+
+void fuse_backing_files_free(struct fuse_conn *fc)
+{
+	idr_for_each(&fc->backing_files_map, fuse_backing_id_free, NULL);
+	idr_destroy(&fc->backing_files_map);
+}
+
+/*
+ * Attach the backing file named in the reply to OPEN or CREATE.  Naming a
+ * file that was never registered fails the open.
+ */
+int fuse_passthrough_open(struct fuse_conn *fc, struct fuse_file *ff,
+			  int backing_id)
+{
+	if (!fc->passthrough)
+		return -EINVAL;
+
+	ff->passthrough = fuse_backing_lookup(fc, backing_id);
+	if (!ff->passthrough)
+		return -EIO;
+
+	return 0;
+}
+
+ssize_t fuse_passthrough_read_iter(struct kiocb *iocb, struct iov_iter *to)
+{
+	struct file *file = iocb->ki_filp;
+	struct fuse_file *ff = file->private_data;
+	struct fuse_backing *fb = ff->passthrough;
+	const struct cred *old_cred;
+	ssize_t ret;
+
+	if (!iov_iter_count(to))
+		return 0;
+
+	old_cred = override_creds(fb->cred);
+	ret = vfs_iter_read(fb->file, to, &iocb->ki_pos);
+	revert_creds(old_cred);
+
+	if (ret >= 0)
+		fuse_invalidate_atime(file_inode(file));
+	return ret;
+}
+
+ssize_t fuse_passthrough_write_iter(struct kiocb *iocb, struct iov_iter *from)
+{
+	struct file *file = iocb->ki_filp;
+	struct inode *inode = file_inode(file);
+	struct fuse_file *ff = file->private_data;
+	struct fuse_backing *fb = ff->passthrough;
+	const struct cred *old_cred;
+	ssize_t ret;
+
+	if (!iov_iter_count(from))
+		return 0;
+
+	inode_lock(inode);
+	if (iocb->ki_flags & IOCB_APPEND)
+		iocb->ki_pos = i_size_read(file_inode(fb->file));
+
+	old_cred = override_creds(fb->cred);
+	file_start_write(fb->file);
+	ret = vfs_iter_write(fb->file, from, &iocb->ki_pos);
+	file_end_write(fb->file);
+	revert_creds(old_cred);
+
+	if (ret > 0)
+		fuse_write_update_size(inode, iocb->ki_pos);
+	fuse_invalidate_attr(inode);
+	inode_unlock(inode);
+
+	return ret;
+}
+
+int fuse_passthrough_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	struct fuse_file *ff = file->private_data;
+	struct file *backing_file = ff->passthrough->file;
+	const struct cred *old_cred;
+	int ret;
+
+	if (!backing_file->f_op->mmap)
+		return -ENODEV;
+
+	if (WARN_ON(file != vma->vm_file))
+		return -EIO;
+
+	/* The mapping belongs to the backing file from now on */
+	vma->vm_file = get_file(backing_file);
+
+	old_cred = override_creds(ff->passthrough->cred);
+	ret = backing_file->f_op->mmap(backing_file, vma);
+	revert_creds(old_cred);
+
+	if (ret) {
+		vma->vm_file = file;
+		fput(backing_file);
+	} else {
+		fput(file);
+	}
+
+	file_accessed(file);
+	return ret;
+}
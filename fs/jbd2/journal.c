@@ -43,6 +43,7 @@
 #include <linux/backing-dev.h>
 #include <linux/bitops.h>
 #include <linux/ratelimit.h>
+#include <linux/percpu.h>
 
 #define CREATE_TRACE_POINTS
 #include <trace/events/jbd2.h>
@@ -98,6 +99,10 @@ EXPORT_SYMBOL(jbd2_journal_file_inode);
 EXPORT_SYMBOL(jbd2_journal_init_jbd_inode);
 EXPORT_SYMBOL(jbd2_journal_release_jbd_inode);
 EXPORT_SYMBOL(jbd2_journal_begin_ordered_truncate);
+EXPORT_SYMBOL(jbd2_fc_begin_commit);
+EXPORT_SYMBOL(jbd2_fc_end_commit);
+EXPORT_SYMBOL(jbd2_fc_get_buf);
+EXPORT_SYMBOL(jbd2_fc_wait_bufs);
 EXPORT_SYMBOL(jbd2_inode_cache);
 
 static void __journal_abort_soft (journal_t *journal, int errno);
@@ -795,6 +800,191 @@ int jbd2_journal_bmap(journal_t *journal, unsigned long blocknr,
 	return err;
 }
 
+/*
+ * Fast commits let the filesystem write a compact log of the changes of
+ * the running transaction to a separate area at the end of the journal,
+ * instead of committing the whole transaction. The area is only ever
+ * written by one fast commit at a time, never while a full commit is in
+ * progress, and a full commit supersedes all the fast commits made for its
+ * transaction so the area is reused from its start afterwards.
+ */
+
+/**
+ * int jbd2_fc_begin_commit() - start a fast commit
+ * @journal: Journal to act on.
+ * @tid: transaction whose changes are going to be written
+ *
+ * Waits for fast and full commits in progress to finish. Returns
+ * -EALREADY if @tid is no longer the running transaction, in which case
+ * the caller just has to wait for its full commit. -EINVAL is returned
+ * if the journal can't take a fast commit, and the caller has to fall
+ * back to a full commit.
+ */
+int jbd2_fc_begin_commit(journal_t *journal, tid_t tid)
+{
+	DEFINE_WAIT(wait);
+
+	if (!journal->j_fc_wbuf)
+		return -EINVAL;
+
+	write_lock(&journal->j_state_lock);
+	for (;;) {
+		if (!journal->j_running_transaction ||
+		    journal->j_running_transaction->t_tid != tid) {
+			write_unlock(&journal->j_state_lock);
+			return -EALREADY;
+		}
+		/*
+		 * Recovery skips an empty log along with the fast commit
+		 * area, let a full commit make the log live again first.
+		 */
+		if (journal->j_flags & (JBD2_FLUSHED | JBD2_ABORT)) {
+			write_unlock(&journal->j_state_lock);
+			return -EINVAL;
+		}
+		if (!(journal->j_flags & (JBD2_FAST_COMMIT_ONGOING |
+					  JBD2_FULL_COMMIT_ONGOING)))
+			break;
+		prepare_to_wait(&journal->j_fc_wait, &wait,
+				TASK_UNINTERRUPTIBLE);
+		write_unlock(&journal->j_state_lock);
+		schedule();
+		finish_wait(&journal->j_fc_wait, &wait);
+		write_lock(&journal->j_state_lock);
+	}
+	journal->j_flags |= JBD2_FAST_COMMIT_ONGOING;
+	write_unlock(&journal->j_state_lock);
+
+	return 0;
+}
+
+/**
+ * void jbd2_fc_end_commit() - finish a fast commit
+ * @journal: Journal to act on.
+ *
+ * Must be called after a successful jbd2_fc_begin_commit(), once all the
+ * buffers of the fast commit have been waited upon.
+ */
+void jbd2_fc_end_commit(journal_t *journal)
+{
+	write_lock(&journal->j_state_lock);
+	journal->j_flags &= ~JBD2_FAST_COMMIT_ONGOING;
+	write_unlock(&journal->j_state_lock);
+	wake_up(&journal->j_fc_wait);
+}
+
+/**
+ * int jbd2_fc_get_buf() - get the next block of the fast commit area
+ * @journal: Journal to act on.
+ * @bh_out: the buffer, on success
+ *
+ * The buffer is remembered so that jbd2_fc_wait_bufs() can wait for its
+ * write and release it. Returns -ENOSPC when the area is full.
+ */
+int jbd2_fc_get_buf(journal_t *journal, struct buffer_head **bh_out)
+{
+	unsigned long long pblock;
+	unsigned long blocknr;
+	struct buffer_head *bh;
+	int ret;
+
+	*bh_out = NULL;
+	if (journal->j_fc_first + journal->j_fc_off >= journal->j_fc_last)
+		return -ENOSPC;
+
+	blocknr = journal->j_fc_first + journal->j_fc_off;
+	ret = jbd2_journal_bmap(journal, blocknr, &pblock);
+	if (ret)
+		return ret;
+
+	bh = __getblk(journal->j_dev, pblock, journal->j_blocksize);
+	if (!bh)
+		return -ENOMEM;
+
+	journal->j_fc_wbuf[journal->j_fc_off++] = bh;
+	*bh_out = bh;
+
+	return 0;
+}
+
+/**
+ * int jbd2_fc_wait_bufs() - wait for the blocks of a fast commit
+ * @journal: Journal to act on.
+ * @num_blks: number of blocks handed out since the fast commit began
+ *
+ * Waits for the writes and drops the buffers. Returns -EIO if any of them
+ * failed.
+ */
+int jbd2_fc_wait_bufs(journal_t *journal, int num_blks)
+{
+	struct buffer_head *bh;
+	int i, ret = 0;
+
+	for (i = journal->j_fc_off - 1;
+	     i >= (int)journal->j_fc_off - num_blks; i--) {
+		bh = journal->j_fc_wbuf[i];
+		wait_on_buffer(bh);
+		if (unlikely(!buffer_uptodate(bh)))
+			ret = -EIO;
+		put_bh(bh);
+		journal->j_fc_wbuf[i] = NULL;
+	}
+
+	return ret;
+}
+
+/*
+ * Carve the fast commit area out of the end of the journal. Called at load
+ * time, before recovery looks at the log, or when the feature is turned on
+ * for a loaded journal, which must not have wrapped into the area yet.
+ */
+static int jbd2_journal_initialize_fast_commit(journal_t *journal)
+{
+	journal_superblock_t *sb = journal->j_superblock;
+	unsigned long num_fc_blks, last;
+	int ret = 0;
+
+	if (journal->j_fc_wbuf) {
+		/* Already set up, the superblock was merely read again */
+		journal->j_last = journal->j_fc_first;
+		return 0;
+	}
+
+	num_fc_blks = jbd2_journal_get_num_fc_blks(sb);
+	if (journal->j_last < journal->j_first + JBD2_MIN_JOURNAL_BLOCKS +
+			      num_fc_blks)
+		return -ENOSPC;
+	last = journal->j_last - num_fc_blks;
+
+	journal->j_fc_wbuf = kmalloc_array(num_fc_blks,
+					   sizeof(struct buffer_head *),
+					   GFP_KERNEL);
+	if (!journal->j_fc_wbuf)
+		return -ENOMEM;
+
+	write_lock(&journal->j_state_lock);
+	if (journal->j_flags & JBD2_LOADED) {
+		if (journal->j_head >= last ||
+		    journal->j_tail > journal->j_head) {
+			ret = -EBUSY;
+			goto out;
+		}
+		journal->j_free -= num_fc_blks;
+	}
+	journal->j_fc_wbufsize = num_fc_blks;
+	journal->j_fc_last = journal->j_last;
+	journal->j_last = last;
+	journal->j_fc_first = last;
+	journal->j_fc_off = 0;
+out:
+	write_unlock(&journal->j_state_lock);
+	if (ret) {
+		kfree(journal->j_fc_wbuf);
+		journal->j_fc_wbuf = NULL;
+	}
+	return ret;
+}
+
 /*
  * We play buffer_head aliasing tricks to write data/metadata blocks to
  * the journal without copying their contents, but for journal
@@ -1075,11 +1265,18 @@ static journal_t * journal_init_common (void)
 	if (!journal)
 		return NULL;
 
+	journal->j_updates = alloc_percpu(struct jbd2_update_count);
+	if (!journal->j_updates) {
+		kfree(journal);
+		return NULL;
+	}
+
 	init_waitqueue_head(&journal->j_wait_transaction_locked);
 	init_waitqueue_head(&journal->j_wait_done_commit);
 	init_waitqueue_head(&journal->j_wait_commit);
 	init_waitqueue_head(&journal->j_wait_updates);
 	init_waitqueue_head(&journal->j_wait_reserved);
+	init_waitqueue_head(&journal->j_fc_wait);
 	mutex_init(&journal->j_barrier);
 	mutex_init(&journal->j_checkpoint_mutex);
 	spin_lock_init(&journal->j_revoke_lock);
@@ -1097,6 +1294,7 @@ static journal_t * journal_init_common (void)
 	/* Set up a default-sized revoke table for the new mount. */
 	err = jbd2_journal_init_revoke(journal, JOURNAL_REVOKE_DEFAULT_HASH);
 	if (err) {
+		free_percpu(journal->j_updates);
 		kfree(journal);
 		return NULL;
 	}
@@ -1172,6 +1370,7 @@ journal_t * jbd2_journal_init_dev(struct block_device *bdev,
 out_err:
 	kfree(journal->j_wbuf);
 	jbd2_stats_proc_exit(journal);
+	free_percpu(journal->j_updates);
 	kfree(journal);
 	return NULL;
 }
@@ -1243,6 +1442,7 @@ journal_t * jbd2_journal_init_inode (struct inode *inode)
 out_err:
 	kfree(journal->j_wbuf);
 	jbd2_stats_proc_exit(journal);
+	free_percpu(journal->j_updates);
 	kfree(journal);
 	return NULL;
 }
@@ -1273,6 +1473,8 @@ static int journal_reset(journal_t *journal)
 
 	first = be32_to_cpu(sb->s_first);
 	last = be32_to_cpu(sb->s_maxlen);
+	if (journal->j_fc_wbuf)
+		last = journal->j_fc_first;
 	if (first + JBD2_MIN_JOURNAL_BLOCKS > last + 1) {
 		printk(KERN_ERR "JBD2: Journal too short (blocks %llu-%llu).\n",
 		       first, last);
@@ -1599,6 +1801,15 @@ static int load_superblock(journal_t *journal)
 	journal->j_last = be32_to_cpu(sb->s_maxlen);
 	journal->j_errno = be32_to_cpu(sb->s_errno);
 
+	if (jbd2_has_feature_fast_commit(journal)) {
+		err = jbd2_journal_initialize_fast_commit(journal);
+		if (err) {
+			printk(KERN_ERR "JBD2: Cannot set up the fast commit "
+			       "area: %d\n", err);
+			return err;
+		}
+	}
+
 	return 0;
 }
 
@@ -1738,6 +1949,8 @@ int jbd2_journal_destroy(journal_t *journal)
 	if (journal->j_chksum_driver)
 		crypto_free_shash(journal->j_chksum_driver);
 	kfree(journal->j_wbuf);
+	kfree(journal->j_fc_wbuf);
+	free_percpu(journal->j_updates);
 	kfree(journal);
 
 	return err;
@@ -1854,6 +2067,13 @@ int jbd2_journal_set_features (journal_t *journal, unsigned long compat,
 
 	sb = journal->j_superblock;
 
+	/* The fast commit area is taken from the end of the log */
+	if (INCOMPAT_FEATURE_ON(JBD2_FEATURE_INCOMPAT_FAST_COMMIT) &&
+	    jbd2_journal_initialize_fast_commit(journal)) {
+		printk(KERN_ERR "JBD2: Cannot set up the fast commit area.\n");
+		return 0;
+	}
+
 	/* If enabling v3 checksums, update superblock */
 	if (INCOMPAT_FEATURE_ON(JBD2_FEATURE_INCOMPAT_CSUM_V3)) {
 		sb->s_checksum_type = JBD2_CRC32C_CHKSUM;
@@ -29,6 +29,7 @@
 #include <linux/backing-dev.h>
 #include <linux/bug.h>
 #include <linux/module.h>
+#include <linux/percpu.h>
 
 #include <trace/events/jbd2.h>
 
@@ -39,10 +40,15 @@ static struct kmem_cache *transaction_cache;
 int __init jbd2_journal_init_transaction_cache(void)
 {
 	J_ASSERT(!transaction_cache);
+	/*
+	 * start_this_handle() looks at the running transaction without
+	 * j_state_lock, under rcu_read_lock(): keep the objects type-stable.
+	 */
 	transaction_cache = kmem_cache_create("jbd2_transaction_s",
 					sizeof(transaction_t),
 					0,
-					SLAB_HWCACHE_ALIGN|SLAB_TEMPORARY,
+					SLAB_HWCACHE_ALIGN|SLAB_TEMPORARY|
+					SLAB_DESTROY_BY_RCU,
 					NULL);
 	if (transaction_cache)
 		return 0;
@@ -88,10 +94,8 @@ jbd2_get_transaction(journal_t *journal, transaction_t *transaction)
 	transaction->t_tid = journal->j_transaction_sequence++;
 	transaction->t_expires = jiffies + journal->j_commit_interval;
 	spin_lock_init(&transaction->t_handle_lock);
-	atomic_set(&transaction->t_updates, 0);
 	atomic_set(&transaction->t_outstanding_credits,
 		   atomic_read(&journal->j_reserved_credits));
-	atomic_set(&transaction->t_handle_count, 0);
 	INIT_LIST_HEAD(&transaction->t_inode_list);
 	INIT_LIST_HEAD(&transaction->t_private_list);
 
@@ -99,12 +103,14 @@ jbd2_get_transaction(journal_t *journal, transaction_t *transaction)
 	journal->j_commit_timer.expires = round_jiffies_up(transaction->t_expires);
 	add_timer(&journal->j_commit_timer);
 
-	J_ASSERT(journal->j_running_transaction == NULL);
-	journal->j_running_transaction = transaction;
 	transaction->t_max_wait = 0;
 	transaction->t_start = jiffies;
 	transaction->t_requested = 0;
 
+	J_ASSERT(journal->j_running_transaction == NULL);
+	/* Publish it initialised to jbd2_try_join_running() */
+	smp_store_release(&journal->j_running_transaction, transaction);
+
 	return transaction;
 }
 
@@ -116,6 +122,110 @@ jbd2_get_transaction(journal_t *journal, transaction_t *transaction)
  * of that one update.
  */
 
+/*
+ * Handles running on the journal are counted in the per-CPU j_updates.
+ * All of them belong to the running transaction: the commit code waits
+ * for the count to drop to zero before the transaction stops being
+ * j_running_transaction, and so does jbd2_journal_lock_updates() before
+ * it lets a barrier through.
+ */
+static inline void jbd2_update_start(journal_t *journal)
+{
+	this_cpu_inc(journal->j_updates->nr_started);
+}
+
+static void jbd2_update_stop(journal_t *journal)
+{
+	this_cpu_inc(journal->j_updates->nr_stopped);
+	/* Pairs with set_current_state() in prepare_to_wait() */
+	smp_mb();
+	if (waitqueue_active(&journal->j_wait_updates))
+		wake_up(&journal->j_wait_updates);
+}
+
+/**
+ * jbd2_journal_running_updates() - count the updates running on a journal
+ * @journal: the journal
+ * @started: if not NULL, returns the number of handles ever started
+ *
+ * Stops are summed before starts: a handle is always counted as started
+ * before it is counted as stopped, so a zero result means that no handle
+ * was running at the time of the call. Callers preventing new handles
+ * from joining (by locking the transaction down or raising
+ * j_barrier_count) must issue a full barrier between that and the call.
+ */
+unsigned long jbd2_journal_running_updates(journal_t *journal,
+					   unsigned long *started)
+{
+	unsigned long nr_started = 0, nr_stopped = 0;
+	int cpu;
+
+	for_each_possible_cpu(cpu)
+		nr_stopped += READ_ONCE(per_cpu_ptr(journal->j_updates,
+						    cpu)->nr_stopped);
+	smp_mb();
+	for_each_possible_cpu(cpu)
+		nr_started += READ_ONCE(per_cpu_ptr(journal->j_updates,
+						    cpu)->nr_started);
+	if (started)
+		*started = nr_started;
+	return nr_started - nr_stopped;
+}
+
+/*
+ * Try to join the running transaction without taking j_state_lock.
+ *
+ * Only plain handles which fit into the running transaction and the log
+ * take this path, anything that needs to wait, reserve credits or create
+ * a transaction goes through the locked path in start_this_handle().
+ * Returns true if the handle was attached to the running transaction.
+ */
+static bool jbd2_try_join_running(journal_t *journal, handle_t *handle,
+				  int blocks)
+{
+	transaction_t *transaction;
+	int needed;
+
+	if (handle->h_reserved || handle->h_rsv_handle)
+		return false;
+
+	rcu_read_lock();
+	transaction = READ_ONCE(journal->j_running_transaction);
+	if (!transaction)
+		goto out_unlock;
+
+	jbd2_update_start(journal);
+	/*
+	 * Either the commit code or jbd2_journal_lock_updates() sees our
+	 * count when it sums the updates, or we see the transaction locked
+	 * down or the barrier raised here.
+	 */
+	smp_mb();
+	if (smp_load_acquire(&journal->j_running_transaction) != transaction ||
+	    READ_ONCE(transaction->t_state) != T_RUNNING ||
+	    READ_ONCE(journal->j_barrier_count) ||
+	    is_journal_aborted(journal) || journal->j_errno)
+		goto out_stop;
+
+	/* The transaction can't go away under us from here on */
+	needed = atomic_add_return(blocks, &transaction->t_outstanding_credits);
+	if (needed > journal->j_max_transaction_buffers ||
+	    jbd2_log_space_left(journal) < jbd2_space_needed(journal)) {
+		atomic_sub(blocks, &transaction->t_outstanding_credits);
+		goto out_stop;
+	}
+	rcu_read_unlock();
+
+	handle->h_transaction = transaction;
+	return true;
+
+out_stop:
+	jbd2_update_stop(journal);
+out_unlock:
+	rcu_read_unlock();
+	return false;
+}
+
 /*
  * Update transaction's maximum wait time, if debugging is enabled.
  *
@@ -294,6 +404,11 @@ static int start_this_handle(journal_t *journal, handle_t *handle,
 		return -ENOSPC;
 	}
 
+	if (jbd2_try_join_running(journal, handle, blocks)) {
+		transaction = handle->h_transaction;
+		goto joined;
+	}
+
 alloc_transaction:
 	if (!journal->j_running_transaction) {
 		/*
@@ -311,8 +426,8 @@ alloc_transaction:
 	jbd_debug(3, "New handle %p going live.\n", handle);
 
 	/*
-	 * We need to hold j_state_lock until t_updates has been incremented,
-	 * for proper journal barrier handling
+	 * We need to hold j_state_lock until the handle has been counted in
+	 * j_updates, for proper journal barrier handling
 	 */
 repeat:
 	read_lock(&journal->j_state_lock);
@@ -371,15 +486,14 @@ repeat:
 	 */
 	update_t_max_wait(transaction, ts);
 	handle->h_transaction = transaction;
+	jbd2_update_start(journal);
+	read_unlock(&journal->j_state_lock);
+joined:
 	handle->h_requested_credits = blocks;
 	handle->h_start_jiffies = jiffies;
-	atomic_inc(&transaction->t_updates);
-	atomic_inc(&transaction->t_handle_count);
-	jbd_debug(4, "Handle %p given %d credits (total %d, free %lu)\n",
+	jbd_debug(4, "Handle %p given %d credits (total %d)\n",
 		  handle, blocks,
-		  atomic_read(&transaction->t_outstanding_credits),
-		  jbd2_log_space_left(journal));
-	read_unlock(&journal->j_state_lock);
+		  atomic_read(&transaction->t_outstanding_credits));
 	current->journal_info = handle;
 
 	lock_map_acquire(&handle->h_lockdep_map);
@@ -648,21 +762,17 @@ int jbd2__journal_restart(handle_t *handle, int nblocks, gfp_t gfp_mask)
 	 * First unlink the handle from its current transaction, and start the
 	 * commit on that.
 	 */
-	J_ASSERT(atomic_read(&transaction->t_updates) > 0);
 	J_ASSERT(journal_current_handle() == handle);
 
 	read_lock(&journal->j_state_lock);
-	spin_lock(&transaction->t_handle_lock);
 	atomic_sub(handle->h_buffer_credits,
 		   &transaction->t_outstanding_credits);
 	if (handle->h_rsv_handle) {
 		sub_reserved_credits(journal,
 				     handle->h_rsv_handle->h_buffer_credits);
 	}
-	if (atomic_dec_and_test(&transaction->t_updates))
-		wake_up(&journal->j_wait_updates);
 	tid = transaction->t_tid;
-	spin_unlock(&transaction->t_handle_lock);
+	jbd2_update_stop(journal);
 	handle->h_transaction = NULL;
 	current->journal_info = NULL;
 
@@ -713,20 +823,19 @@ void jbd2_journal_lock_updates(journal_t *journal)
 
 	/* Wait until there are no running updates */
 	while (1) {
-		transaction_t *transaction = journal->j_running_transaction;
-
-		if (!transaction)
+		if (!journal->j_running_transaction)
 			break;
 
-		spin_lock(&transaction->t_handle_lock);
+		/*
+		 * prepare_to_wait() orders raising j_barrier_count against
+		 * summing the updates, see jbd2_try_join_running().
+		 */
 		prepare_to_wait(&journal->j_wait_updates, &wait,
 				TASK_UNINTERRUPTIBLE);
-		if (!atomic_read(&transaction->t_updates)) {
-			spin_unlock(&transaction->t_handle_lock);
+		if (!jbd2_journal_running_updates(journal, NULL)) {
 			finish_wait(&journal->j_wait_updates, &wait);
 			break;
 		}
-		spin_unlock(&transaction->t_handle_lock);
 		write_unlock(&journal->j_state_lock);
 		schedule();
 		finish_wait(&journal->j_wait_updates, &wait);
@@ -1644,8 +1753,6 @@ int jbd2_journal_stop(handle_t *handle)
 
 	if (is_handle_aborted(handle))
 		err = -EIO;
-	else
-		J_ASSERT(atomic_read(&transaction->t_updates) > 0);
 
 	if (--handle->h_ref > 0) {
 		jbd_debug(4, "h_ref %d -> %d\n", handle->h_ref + 1,
@@ -1752,17 +1859,12 @@ int jbd2_journal_stop(handle_t *handle)
 	}
 
 	/*
-	 * Once we drop t_updates, if it goes to zero the transaction
-	 * could start committing on us and eventually disappear.  So
-	 * once we do this, we must not dereference transaction
-	 * pointer again.
+	 * Once the handle is counted as stopped the transaction could
+	 * start committing on us and eventually disappear.  So once we
+	 * do this, we must not dereference transaction pointer again.
 	 */
 	tid = transaction->t_tid;
-	if (atomic_dec_and_test(&transaction->t_updates)) {
-		wake_up(&journal->j_wait_updates);
-		if (journal->j_barrier_count)
-			wake_up(&journal->j_wait_transaction_locked);
-	}
+	jbd2_update_stop(journal);
 
 	if (wait_for_commit)
 		err = jbd2_log_wait_commit(journal, tid);
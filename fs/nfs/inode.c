@@ -649,14 +649,28 @@ int nfs_getattr(struct vfsmount *mnt, struct dentry *dentry, struct kstat *stat)
 {
 	struct inode *inode = d_inode(dentry);
 	int need_atime = NFS_I(inode)->cache_validity & NFS_INO_INVALID_ATIME;
+	u32 request_mask = stat->request_mask;
+	unsigned int query_flags = stat->query_flags;
 	int err = 0;
 
 	trace_nfs_getattr_enter(inode);
+
+	/*
+	 * The file type and fileid never change, and statx() callers that
+	 * said cached values will do don't get a round trip either.
+	 */
+	if (!(query_flags & AT_STATX_FORCE_SYNC) &&
+	    ((query_flags & AT_STATX_DONT_SYNC) ||
+	     !(request_mask & ~(STATX_TYPE | STATX_INO))))
+		goto out_no_revalidate;
+
 	/* Flush out writes to the server in order to update c/mtime.  */
-	if (S_ISREG(inode->i_mode)) {
-		mutex_lock(&inode->i_mutex);
+	if (S_ISREG(inode->i_mode) &&
+	    (request_mask & (STATX_CTIME | STATX_MTIME | STATX_SIZE |
+			     STATX_BLOCKS))) {
+		inode_lock(inode);
 		err = nfs_sync_inode(inode);
-		mutex_unlock(&inode->i_mutex);
+		inode_unlock(inode);
 		if (err)
 			goto out;
 	}
@@ -670,17 +684,20 @@ int nfs_getattr(struct vfsmount *mnt, struct dentry *dentry, struct kstat *stat)
 	 *  - NFS never sets MS_NOATIME or MS_NODIRATIME so there is
 	 *    no point in checking those.
 	 */
- 	if ((mnt->mnt_flags & MNT_NOATIME) ||
+ 	if (!(request_mask & STATX_ATIME) ||
+	    (mnt->mnt_flags & MNT_NOATIME) ||
  	    ((mnt->mnt_flags & MNT_NODIRATIME) && S_ISDIR(inode->i_mode)))
 		need_atime = 0;
 
-	if (need_atime || nfs_need_revalidate_inode(inode)) {
+	if (need_atime || nfs_need_revalidate_inode(inode) ||
+	    (query_flags & AT_STATX_FORCE_SYNC)) {
 		struct nfs_server *server = NFS_SERVER(inode);
 
 		if (server->caps & NFS_CAP_READDIRPLUS)
 			nfs_request_parent_use_readdirplus(dentry);
 		err = __nfs_revalidate_inode(server, inode);
 	}
+out_no_revalidate:
 	if (!err) {
 		generic_fillattr(inode, stat);
 		stat->ino = nfs_compat_user_ino64(NFS_FILEID(inode));
@@ -1144,9 +1161,9 @@ static int __nfs_revalidate_mapping(struct inode *inode,
 	spin_unlock(&inode->i_lock);
 	trace_nfs_invalidate_mapping_enter(inode);
 	if (may_lock) {
-		mutex_lock(&inode->i_mutex);
+		inode_lock(inode);
 		ret = nfs_invalidate_mapping(inode, mapping);
-		mutex_unlock(&inode->i_mutex);
+		inode_unlock(inode);
 	} else
 		ret = nfs_invalidate_mapping(inode, mapping);
 	trace_nfs_invalidate_mapping_exit(inode, ret);
@@ -109,6 +109,12 @@ struct nfsd_net {
 	 */
 	unsigned int max_connections;
 
+	/*
+	 * Most threads each pool may grow to on demand.  Defaults to '0',
+	 * which keeps the number of threads at what was asked for.
+	 */
+	unsigned int max_threads;
+
 	u32 clientid_counter;
 	u32 clverifier_counter;
 
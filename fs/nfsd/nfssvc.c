@@ -418,6 +418,7 @@ int nfsd_create_serv(struct net *net)
 		return -ENOMEM;
 
 	nn->nfsd_serv->sv_maxconn = nn->max_connections;
+	nfsd_set_maxthreads(nn->max_threads, net);
 	error = svc_bind(nn->nfsd_serv, net);
 	if (error < 0) {
 		svc_destroy(nn->nfsd_serv);
@@ -452,6 +453,41 @@ int nfsd_get_nrthreads(int n, int *nthreads, struct net *net)
 	return 0;
 }
 
+void nfsd_set_maxthreads(unsigned int maxthreads, struct net *net)
+{
+	struct nfsd_net *nn = net_generic(net, nfsd_net_id);
+	int i;
+
+	WARN_ON(!mutex_is_locked(&nfsd_mutex));
+
+	nn->max_threads = maxthreads;
+	if (nn->nfsd_serv == NULL)
+		return;
+
+	for (i = 0; i < nn->nfsd_serv->sv_nrpools; i++)
+		nn->nfsd_serv->sv_pools[i].sp_nrthrmax = maxthreads;
+}
+
+/*
+ * Requests in this thread's pool had to wait for a thread: start
+ * another one.  Skipped if somebody else is reconfiguring the service;
+ * the next waiting request will ask again.
+ */
+static void nfsd_grow_pool(struct svc_rqst *rqstp, struct net *net)
+{
+	struct nfsd_net *nn = net_generic(net, nfsd_net_id);
+	struct svc_pool *pool = rqstp->rq_pool;
+
+	if (!mutex_trylock(&nfsd_mutex))
+		return;
+
+	/* our own reference keeps nn->nfsd_serv around */
+	if (test_and_clear_bit(SP_CONGESTED, &pool->sp_flags))
+		svc_pool_grow(nn->nfsd_serv, pool);
+
+	mutex_unlock(&nfsd_mutex);
+}
+
 void nfsd_destroy(struct net *net)
 {
 	struct nfsd_net *nn = net_generic(net, nfsd_net_id);
@@ -622,6 +658,8 @@ nfsd(void *vrqstp)
 			;
 		if (err == -EINTR)
 			break;
+		if (test_bit(SP_CONGESTED, &rqstp->rq_pool->sp_flags))
+			nfsd_grow_pool(rqstp, net);
 		validate_process_creds();
 		svc_process(rqstp);
 		validate_process_creds();
@@ -485,9 +485,9 @@ __be32 nfsd4_set_nfs4_label(struct svc_rqst *rqstp, struct svc_fh *fhp,
 
 	dentry = fhp->fh_dentry;
 
-	mutex_lock(&d_inode(dentry)->i_mutex);
+	inode_lock(d_inode(dentry));
 	host_error = security_inode_setsecctx(dentry, label->data, label->len);
-	mutex_unlock(&d_inode(dentry)->i_mutex);
+	inode_unlock(d_inode(dentry));
 	return nfserrno(host_error);
 }
 #else
@@ -1833,7 +1833,7 @@ static __be32 nfsd_buffered_readdir(struct file *file, nfsd_filldir_t func,
 		 * lookup_one_len() and the file system's ->lookup() method.
 		 * These expect i_mutex to be held, as it would within readdir.
 		 */
-		host_err = mutex_lock_killable(&dir_inode->i_mutex);
+		host_err = inode_lock_killable(dir_inode);
 		if (host_err)
 			break;
 
@@ -1853,7 +1853,7 @@ static __be32 nfsd_buffered_readdir(struct file *file, nfsd_filldir_t func,
 			size -= reclen;
 			de = (struct buffered_dirent *)((char *)de + reclen);
 		}
-		mutex_unlock(&dir_inode->i_mutex);
+		inode_unlock(dir_inode);
 		if (size > 0) /* We bailed out early */
 			break;
 
@@ -102,6 +102,12 @@ static int ovl_copy_up_data(struct path *old, struct path *new, loff_t len)
 		goto out_fput;
 	}
 
+	/* Share the extents if both layers are on a filesystem that can */
+	error = vfs_clone_file_range(old_file, 0, new_file, 0, len);
+	if (!error)
+		goto out;
+	error = 0;
+
 	/* FIXME: copy up sparse files efficiently */
 	while (len) {
 		size_t this_len = OVL_COPY_UP_CHUNK_SIZE;
@@ -126,7 +132,7 @@ static int ovl_copy_up_data(struct path *old, struct path *new, loff_t len)
 
 		len -= bytes;
 	}
-
+out:
 	fput(new_file);
 out_fput:
 	fput(old_file);
@@ -204,9 +210,97 @@ int ovl_set_attr(struct dentry *upperdentry, struct kstat *stat)
 	return err;
 }
 
+/*
+ * Only the metadata of a regular file is copied up when the data is not
+ * needed yet.  The upper file gets the size of the lower one and records
+ * where the data is in the metacopy xattr: the path of the file in the
+ * overlay, which is also its path in the lower layers since merged
+ * directories cannot be renamed.
+ */
+static bool ovl_need_meta_copy_up(struct dentry *dentry, umode_t mode,
+				  int flags)
+{
+	if (!ovl_metacopy_enabled(dentry) || !S_ISREG(mode))
+		return false;
+
+	if ((OPEN_FMODE(flags) & FMODE_WRITE) || (flags & O_TRUNC))
+		return false;
+
+	return true;
+}
+
+static bool ovl_need_data_copy_up(struct dentry *dentry, int flags)
+{
+	return ovl_dentry_is_metacopy(dentry) &&
+	       !ovl_need_meta_copy_up(dentry, dentry->d_inode->i_mode, flags);
+}
+
+static int ovl_set_metacopy(struct dentry *dentry, struct dentry *upper,
+			    struct kstat *stat)
+{
+	struct iattr attr = {
+		.ia_valid = ATTR_SIZE,
+		.ia_size = stat->size,
+	};
+	char *buf, *path;
+	int err;
+
+	buf = (char *) __get_free_page(GFP_KERNEL);
+	if (!buf)
+		return -ENOMEM;
+
+	path = dentry_path_raw(dentry, buf, PAGE_SIZE);
+	err = PTR_ERR(path);
+	if (IS_ERR(path))
+		goto out;
+
+	err = ovl_do_setxattr(upper, OVL_XATTR_METACOPY, path, strlen(path), 0);
+	if (err)
+		goto out;
+
+	inode_lock(upper->d_inode);
+	err = notify_change(upper, &attr, NULL);
+	inode_unlock(upper->d_inode);
+out:
+	free_page((unsigned long) buf);
+	return err;
+}
+
+/* Fill in the data of a metacopy upper file in place */
+static int ovl_copy_up_meta_inode_data(struct dentry *dentry,
+				       struct path *lowerpath,
+				       struct kstat *stat)
+{
+	struct path upperpath;
+	struct kstat ustat;
+	int err;
+
+	ovl_path_upper(dentry, &upperpath);
+	err = vfs_getattr(&upperpath, &ustat);
+	if (err)
+		return err;
+
+	err = ovl_copy_up_data(lowerpath, &upperpath, stat->size);
+	if (err)
+		return err;
+
+	err = ovl_do_removexattr(upperpath.dentry, OVL_XATTR_METACOPY);
+	if (err)
+		return err;
+
+	/* Writing the data must not show up in the timestamps */
+	inode_lock(upperpath.dentry->d_inode);
+	ovl_set_timestamps(upperpath.dentry, &ustat);
+	inode_unlock(upperpath.dentry->d_inode);
+
+	ovl_dentry_set_metacopy(dentry, false);
+	return 0;
+}
+
 static int ovl_copy_up_locked(struct dentry *workdir, struct dentry *upperdir,
 			      struct dentry *dentry, struct path *lowerpath,
-			      struct kstat *stat, const char *link)
+			      struct kstat *stat, const char *link,
+			      bool metacopy)
 {
 	struct inode *wdir = workdir->d_inode;
 	struct inode *udir = upperdir->d_inode;
@@ -233,7 +327,7 @@ static int ovl_copy_up_locked(struct dentry *workdir, struct dentry *upperdir,
 	if (err)
 		goto out2;
 
-	if (S_ISREG(stat->mode)) {
+	if (S_ISREG(stat->mode) && !metacopy) {
 		struct path upperpath;
 		ovl_path_upper(dentry, &upperpath);
 		BUG_ON(upperpath.dentry != NULL);
@@ -248,9 +342,15 @@ static int ovl_copy_up_locked(struct dentry *workdir, struct dentry *upperdir,
 	if (err)
 		goto out_cleanup;
 
-	mutex_lock(&newdentry->d_inode->i_mutex);
+	if (metacopy) {
+		err = ovl_set_metacopy(dentry, newdentry, stat);
+		if (err)
+			goto out_cleanup;
+	}
+
+	inode_lock(newdentry->d_inode);
 	err = ovl_set_attr(newdentry, stat);
-	mutex_unlock(&newdentry->d_inode->i_mutex);
+	inode_unlock(newdentry->d_inode);
 	if (err)
 		goto out_cleanup;
 
@@ -258,6 +358,8 @@ static int ovl_copy_up_locked(struct dentry *workdir, struct dentry *upperdir,
 	if (err)
 		goto out_cleanup;
 
+	/* Must be set before the upper dentry becomes visible */
+	ovl_dentry_set_metacopy(dentry, metacopy);
 	ovl_dentry_update(dentry, newdentry);
 	newdentry = NULL;
 
@@ -292,9 +394,12 @@ out_cleanup:
  * up uses upper parent i_mutex for exclusion.  Since rename can change
  * d_parent it is possible that the copy up will lock the old parent.  At
  * that point the file will have already been copied up anyway.
+ *
+ * @flags are the open flags the copy up is done for; they tell whether a
+ * regular file needs its data or only its metadata copied up.
  */
 int ovl_copy_up_one(struct dentry *parent, struct dentry *dentry,
-		    struct path *lowerpath, struct kstat *stat)
+		    struct path *lowerpath, struct kstat *stat, int flags)
 {
 	struct dentry *workdir = ovl_workdir(dentry);
 	int err;
@@ -354,11 +459,16 @@ int ovl_copy_up_one(struct dentry *parent, struct dentry *dentry,
 	if (upperdentry) {
 		/* Raced with another copy-up?  Nothing to do, then... */
 		err = 0;
+		/* ...unless only the metadata made it up so far */
+		if (ovl_need_data_copy_up(dentry, flags))
+			err = ovl_copy_up_meta_inode_data(dentry, lowerpath,
+							  stat);
 		goto out_unlock;
 	}
 
-	err = ovl_copy_up_locked(workdir, upperdir, dentry, lowerpath,
-				 stat, link);
+	err = ovl_copy_up_locked(workdir, upperdir, dentry, lowerpath, stat,
+				 link, ovl_need_meta_copy_up(dentry, stat->mode,
+							     flags));
 	if (!err) {
 		/* Restore timestamps on parent (best effort) */
 		ovl_set_timestamps(upperdir, &pstat);
@@ -375,7 +485,7 @@ out_free_link:
 	return err;
 }
 
-int ovl_copy_up(struct dentry *dentry)
+int ovl_copy_up_flags(struct dentry *dentry, int flags)
 {
 	int err;
 
@@ -387,7 +497,8 @@ int ovl_copy_up(struct dentry *dentry)
 		struct kstat stat;
 		enum ovl_path_type type = ovl_path_type(dentry);
 
-		if (OVL_TYPE_UPPER(type))
+		if (OVL_TYPE_UPPER(type) &&
+		    !ovl_need_data_copy_up(dentry, flags))
 			break;
 
 		next = dget(dentry);
@@ -406,7 +517,8 @@ int ovl_copy_up(struct dentry *dentry)
 		ovl_path_lower(next, &lowerpath);
 		err = vfs_getattr(&lowerpath, &stat);
 		if (!err)
-			err = ovl_copy_up_one(parent, next, &lowerpath, &stat);
+			err = ovl_copy_up_one(parent, next, &lowerpath, &stat,
+					      flags);
 
 		dput(parent);
 		dput(next);
@@ -414,3 +526,13 @@ int ovl_copy_up(struct dentry *dentry)
 
 	return err;
 }
+
+int ovl_copy_up(struct dentry *dentry)
+{
+	return ovl_copy_up_flags(dentry, 0);
+}
+
+int ovl_copy_up_with_data(struct dentry *dentry)
+{
+	return ovl_copy_up_flags(dentry, O_WRONLY);
+}
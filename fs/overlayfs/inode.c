@@ -30,7 +30,8 @@ static int ovl_copy_up_truncate(struct dentry *dentry)
 		goto out_dput_parent;
 
 	stat.size = 0;
-	err = ovl_copy_up_one(parent, dentry, &lowerpath, &stat);
+	err = ovl_copy_up_one(parent, dentry, &lowerpath, &stat,
+			      O_WRONLY | O_TRUNC);
 
 out_dput_parent:
 	dput(parent);
@@ -59,15 +60,19 @@ int ovl_setattr(struct dentry *dentry, struct iattr *attr)
 	if (err)
 		goto out;
 
-	err = ovl_copy_up(dentry);
+	/* Changing the size is the only attribute that needs the data */
+	if (attr->ia_valid & ATTR_SIZE)
+		err = ovl_copy_up_with_data(dentry);
+	else
+		err = ovl_copy_up(dentry);
 	if (!err) {
 		upperdentry = ovl_dentry_upper(dentry);
 
-		mutex_lock(&upperdentry->d_inode->i_mutex);
+		inode_lock(upperdentry->d_inode);
 		err = notify_change(upperdentry, attr, NULL);
 		if (!err)
 			ovl_copyattr(upperdentry->d_inode, dentry->d_inode);
-		mutex_unlock(&upperdentry->d_inode->i_mutex);
+		inode_unlock(upperdentry->d_inode);
 	}
 	ovl_drop_write(dentry);
 out:
@@ -78,9 +83,21 @@ static int ovl_getattr(struct vfsmount *mnt, struct dentry *dentry,
 			 struct kstat *stat)
 {
 	struct path realpath;
+	struct kstat lowerstat;
+	int err;
 
 	ovl_path_real(dentry, &realpath);
-	return vfs_getattr(&realpath, stat);
+	err = vfs_getattr(&realpath, stat);
+	if (err || !ovl_dentry_is_metacopy(dentry))
+		return err;
+
+	/* The upper file of a metacopy has no blocks allocated yet */
+	ovl_path_lower(dentry, &realpath);
+	err = vfs_getattr(&realpath, &lowerstat);
+	if (!err)
+		stat->blocks = lowerstat.blocks;
+
+	return err;
 }
 
 int ovl_permission(struct inode *inode, int mask)
@@ -252,7 +269,8 @@ static bool ovl_need_xattr_filter(struct dentry *dentry,
 				  enum ovl_path_type type)
 {
 	if ((type & (__OVL_PATH_PURE | __OVL_PATH_UPPER)) == __OVL_PATH_UPPER)
-		return S_ISDIR(dentry->d_inode->i_mode);
+		return S_ISDIR(dentry->d_inode->i_mode) ||
+		       ovl_dentry_is_metacopy(dentry);
 	else
 		return false;
 }
@@ -334,10 +352,11 @@ out:
 	return err;
 }
 
-static bool ovl_open_need_copy_up(int flags, enum ovl_path_type type,
+static bool ovl_open_need_copy_up(struct dentry *dentry, int flags,
+				  enum ovl_path_type type,
 				  struct dentry *realdentry)
 {
-	if (OVL_TYPE_UPPER(type))
+	if (OVL_TYPE_UPPER(type) && !ovl_dentry_is_metacopy(dentry))
 		return false;
 
 	if (special_file(realdentry->d_inode->i_mode))
@@ -359,7 +378,7 @@ struct inode *ovl_d_select_inode(struct dentry *dentry, unsigned file_flags)
 		return d_backing_inode(dentry);
 
 	type = ovl_path_real(dentry, &realpath);
-	if (ovl_open_need_copy_up(file_flags, type, realpath.dentry)) {
+	if (ovl_open_need_copy_up(dentry, file_flags, type, realpath.dentry)) {
 		err = ovl_want_write(dentry);
 		if (err)
 			return ERR_PTR(err);
@@ -367,12 +386,15 @@ struct inode *ovl_d_select_inode(struct dentry *dentry, unsigned file_flags)
 		if (file_flags & O_TRUNC)
 			err = ovl_copy_up_truncate(dentry);
 		else
-			err = ovl_copy_up(dentry);
+			err = ovl_copy_up_flags(dentry, file_flags);
 		ovl_drop_write(dentry);
 		if (err)
 			return ERR_PTR(err);
 
 		ovl_path_upper(dentry, &realpath);
+	} else if (ovl_dentry_is_metacopy(dentry)) {
+		/* Read-only opens get the data from where it still is */
+		ovl_path_lower(dentry, &realpath);
 	}
 
 	if (realpath.dentry->d_flags & DCACHE_OP_SELECT_INODE)
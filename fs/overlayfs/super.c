@@ -31,6 +31,7 @@ struct ovl_config {
 	char *lowerdir;
 	char *upperdir;
 	char *workdir;
+	bool metacopy;
 };
 
 /* private information held for overlayfs's superblock */
@@ -54,6 +55,7 @@ struct ovl_entry {
 		struct {
 			u64 version;
 			bool opaque;
+			bool metacopy;
 		};
 		struct rcu_head rcu;
 	};
@@ -208,11 +210,34 @@ void ovl_dentry_set_opaque(struct dentry *dentry, bool opaque)
 	oe->opaque = opaque;
 }
 
+bool ovl_dentry_is_metacopy(struct dentry *dentry)
+{
+	struct ovl_entry *oe = dentry->d_fsdata;
+
+	return READ_ONCE(oe->metacopy);
+}
+
+void ovl_dentry_set_metacopy(struct dentry *dentry, bool metacopy)
+{
+	struct ovl_entry *oe = dentry->d_fsdata;
+
+	/* Make sure the upper data is in place before clearing the flag */
+	smp_wmb();
+	WRITE_ONCE(oe->metacopy, metacopy);
+}
+
+bool ovl_metacopy_enabled(struct dentry *dentry)
+{
+	struct ovl_fs *ofs = dentry->d_sb->s_fs_info;
+
+	return ofs->config.metacopy;
+}
+
 void ovl_dentry_update(struct dentry *dentry, struct dentry *upperdentry)
 {
 	struct ovl_entry *oe = dentry->d_fsdata;
 
-	WARN_ON(!mutex_is_locked(&upperdentry->d_parent->d_inode->i_mutex));
+	WARN_ON(!inode_is_locked(upperdentry->d_parent->d_inode));
 	WARN_ON(oe->__upperdentry);
 	BUG_ON(!upperdentry->d_inode);
 	/*
@@ -227,7 +252,7 @@ void ovl_dentry_version_inc(struct dentry *dentry)
 {
 	struct ovl_entry *oe = dentry->d_fsdata;
 
-	WARN_ON(!mutex_is_locked(&dentry->d_inode->i_mutex));
+	WARN_ON(!inode_is_locked(dentry->d_inode));
 	oe->version++;
 }
 
@@ -235,7 +260,7 @@ u64 ovl_dentry_version_get(struct dentry *dentry)
 {
 	struct ovl_entry *oe = dentry->d_fsdata;
 
-	WARN_ON(!mutex_is_locked(&dentry->d_inode->i_mutex));
+	WARN_ON(!inode_is_locked(dentry->d_inode));
 	return oe->version;
 }
 
@@ -392,9 +417,9 @@ static inline struct dentry *ovl_lookup_real(struct dentry *dir,
 {
 	struct dentry *dentry;
 
-	mutex_lock(&dir->d_inode->i_mutex);
+	inode_lock(dir->d_inode);
 	dentry = lookup_one_len(name->name, dir, name->len);
-	mutex_unlock(&dir->d_inode->i_mutex);
+	inode_unlock(dir->d_inode);
 
 	if (IS_ERR(dentry)) {
 		if (PTR_ERR(dentry) == -ENOENT)
@@ -410,6 +435,78 @@ static inline struct dentry *ovl_lookup_real(struct dentry *dir,
 	return dentry;
 }
 
+/*
+ * A regular upper file carrying the metacopy xattr only has the metadata;
+ * find the file in the lower layers that holds the data.  Returns 0 with
+ * @lowerpath->dentry set to NULL for an upper file that is complete.
+ */
+static int ovl_lookup_metacopy(struct super_block *sb, struct dentry *upper,
+			       struct path *lowerpath)
+{
+	struct ovl_entry *roe = sb->s_root->d_fsdata;
+	struct inode *inode = upper->d_inode;
+	struct path path;
+	char *redirect;
+	unsigned int i;
+	ssize_t res;
+	int err;
+
+	lowerpath->dentry = NULL;
+	if (!inode->i_op->getxattr)
+		return 0;
+
+	res = inode->i_op->getxattr(upper, OVL_XATTR_METACOPY, NULL, 0);
+	if (res == -ENODATA || res == -EOPNOTSUPP)
+		return 0;
+	if (res < 0)
+		return res;
+	if (res == 0 || res >= PATH_MAX)
+		goto invalid;
+
+	redirect = kzalloc(res + 1, GFP_KERNEL);
+	if (!redirect)
+		return -ENOMEM;
+
+	res = inode->i_op->getxattr(upper, OVL_XATTR_METACOPY, redirect, res);
+	err = res;
+	if (res < 0)
+		goto out;
+
+	err = -EIO;
+	for (i = 0; i < roe->numlower; i++) {
+		struct path *layer = &roe->lowerstack[i];
+
+		res = vfs_path_lookup(layer->dentry, layer->mnt, redirect, 0,
+				      &path);
+		if (res == -ENOENT)
+			continue;
+		err = res;
+		if (res)
+			goto out;
+
+		/* The topmost lower file is the one that was copied up */
+		err = -EIO;
+		if (d_is_reg(path.dentry) && path.mnt == layer->mnt) {
+			lowerpath->dentry = dget(path.dentry);
+			lowerpath->mnt = layer->mnt;
+			err = 0;
+		}
+		path_put(&path);
+		break;
+	}
+	if (err)
+		pr_warn_ratelimited("overlayfs: no data for metacopy %pd2 at \"%s\"\n",
+				    upper, redirect);
+out:
+	kfree(redirect);
+	return err;
+
+invalid:
+	pr_warn_ratelimited("overlayfs: invalid metacopy xattr on %pd2\n",
+			    upper);
+	return -EIO;
+}
+
 /*
  * Returns next layer in stack starting from top.
  * Returns -1 if this is the last layer.
@@ -438,9 +535,11 @@ struct dentry *ovl_lookup(struct inode *dir, struct dentry *dentry,
 	struct ovl_entry *poe = dentry->d_parent->d_fsdata;
 	struct path *stack = NULL;
 	struct dentry *upperdir, *upperdentry = NULL;
+	struct path metapath;
 	unsigned int ctr = 0;
 	struct inode *inode = NULL;
 	bool upperopaque = false;
+	bool metacopy = false;
 	struct dentry *this, *prev = NULL;
 	unsigned int i;
 	int err;
@@ -469,6 +568,25 @@ struct dentry *ovl_lookup(struct inode *dir, struct dentry *dentry,
 		upperdentry = prev = this;
 	}
 
+	if (upperdentry && d_is_reg(upperdentry)) {
+		err = ovl_lookup_metacopy(dentry->d_sb, upperdentry, &metapath);
+		if (err)
+			goto out_put_upper;
+
+		/* The data comes from the lower file named in the xattr */
+		if (metapath.dentry) {
+			err = -ENOMEM;
+			stack = kmalloc(sizeof(struct path), GFP_KERNEL);
+			if (!stack) {
+				dput(metapath.dentry);
+				goto out_put_upper;
+			}
+			stack[ctr++] = metapath;
+			upperopaque = true;
+			metacopy = true;
+		}
+	}
+
 	if (!upperopaque && poe->numlower) {
 		err = -ENOMEM;
 		stack = kcalloc(poe->numlower, sizeof(struct path), GFP_KERNEL);
@@ -547,6 +665,7 @@ struct dentry *ovl_lookup(struct inode *dir, struct dentry *dentry,
 	}
 
 	oe->opaque = upperopaque;
+	oe->metacopy = metacopy;
 	oe->__upperdentry = upperdentry;
 	memcpy(oe->lowerstack, stack, sizeof(struct path) * ctr);
 	kfree(stack);
@@ -631,6 +750,8 @@ static int ovl_show_options(struct seq_file *m, struct dentry *dentry)
 		seq_show_option(m, "upperdir", ufs->config.upperdir);
 		seq_show_option(m, "workdir", ufs->config.workdir);
 	}
+	if (ufs->config.metacopy)
+		seq_puts(m, ",metacopy=on");
 	return 0;
 }
 
@@ -655,6 +776,8 @@ enum {
 	OPT_LOWERDIR,
 	OPT_UPPERDIR,
 	OPT_WORKDIR,
+	OPT_METACOPY_ON,
+	OPT_METACOPY_OFF,
 	OPT_ERR,
 };
 
@@ -662,6 +785,8 @@ static const match_table_t ovl_tokens = {
 	{OPT_LOWERDIR,			"lowerdir=%s"},
 	{OPT_UPPERDIR,			"upperdir=%s"},
 	{OPT_WORKDIR,			"workdir=%s"},
+	{OPT_METACOPY_ON,		"metacopy=on"},
+	{OPT_METACOPY_OFF,		"metacopy=off"},
 	{OPT_ERR,			NULL}
 };
 
@@ -722,6 +847,14 @@ static int ovl_parse_opt(char *opt, struct ovl_config *config)
 				return -ENOMEM;
 			break;
 
+		case OPT_METACOPY_ON:
+			config->metacopy = true;
+			break;
+
+		case OPT_METACOPY_OFF:
+			config->metacopy = false;
+			break;
+
 		default:
 			pr_err("overlayfs: unrecognized mount option \"%s\" or missing value\n", p);
 			return -EINVAL;
@@ -753,7 +886,7 @@ static struct dentry *ovl_workdir_create(struct vfsmount *mnt,
 	if (err)
 		return ERR_PTR(err);
 
-	mutex_lock_nested(&dir->i_mutex, I_MUTEX_PARENT);
+	inode_lock_nested(dir, I_MUTEX_PARENT);
 retry:
 	work = lookup_one_len(OVL_WORKDIR_NAME, dentry,
 			      strlen(OVL_WORKDIR_NAME));
@@ -779,7 +912,7 @@ retry:
 			goto out_dput;
 	}
 out_unlock:
-	mutex_unlock(&dir->i_mutex);
+	inode_unlock(dir);
 	mnt_drop_write(mnt);
 
 	return work;
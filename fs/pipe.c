@@ -38,6 +38,13 @@ unsigned int pipe_max_size = 1048576;
  */
 unsigned int pipe_min_size = PAGE_SIZE;
 
+/*
+ * How long, in milliseconds, readers of a pipe with a wakeup threshold may
+ * be kept waiting for data that is already there. Can be set by root in
+ * /proc/sys/fs/pipe-wake-delay-ms
+ */
+int pipe_wake_delay = 1;
+
 /*
  * We use a start+len construction, which provides full use of the 
  * allocated memory.
@@ -217,6 +224,21 @@ static const struct pipe_buf_operations anon_pipe_buf_ops = {
 	.get = generic_pipe_buf_get,
 };
 
+/* A compound page cannot be moved into the page cache */
+static int anon_pipe_large_buf_steal(struct pipe_inode_info *pipe,
+				     struct pipe_buffer *buf)
+{
+	return 1;
+}
+
+static const struct pipe_buf_operations anon_pipe_large_buf_ops = {
+	.can_merge = 1,
+	.confirm = generic_pipe_buf_confirm,
+	.release = generic_pipe_buf_release,
+	.steal = anon_pipe_large_buf_steal,
+	.get = generic_pipe_buf_get,
+};
+
 static const struct pipe_buf_operations packet_pipe_buf_ops = {
 	.can_merge = 0,
 	.confirm = generic_pipe_buf_confirm,
@@ -334,6 +356,42 @@ static inline int is_packetized(struct file *file)
 	return (file->f_flags & O_DIRECT) != 0;
 }
 
+static void pipe_wake_timer_fn(unsigned long data)
+{
+	struct pipe_inode_info *pipe = (struct pipe_inode_info *)data;
+
+	wake_up_interruptible_poll(&pipe->wait, POLLIN | POLLRDNORM);
+	kill_fasync(&pipe->fasync_readers, SIGIO, POLL_IN);
+}
+
+/*
+ * With a wakeup threshold set, readers are not woken up for every write
+ * but once @wake_bytes have been queued, or the pipe is full, or when the
+ * timer fires. The data itself is readable right away. Returns true if
+ * the wakeup for the @bytes just written can be skipped. Must be called
+ * with the pipe locked.
+ */
+static bool pipe_defer_wakeup(struct pipe_inode_info *pipe, size_t bytes)
+{
+	if (!pipe->wake_bytes)
+		return false;
+
+	if (!timer_pending(&pipe->wake_timer))
+		pipe->wake_pending = 0;
+	pipe->wake_pending += min_t(size_t, bytes, pipe->wake_bytes);
+
+	if (pipe->wake_pending < pipe->wake_bytes &&
+	    pipe->nrbufs < pipe->buffers) {
+		if (!timer_pending(&pipe->wake_timer))
+			mod_timer(&pipe->wake_timer,
+				  jiffies + msecs_to_jiffies(pipe_wake_delay));
+		return true;
+	}
+
+	del_timer(&pipe->wake_timer);
+	return false;
+}
+
 static ssize_t
 pipe_write(struct kiocb *iocb, struct iov_iter *from)
 {
@@ -365,7 +423,8 @@ pipe_write(struct kiocb *iocb, struct iov_iter *from)
 		const struct pipe_buf_operations *ops = buf->ops;
 		int offset = buf->offset + buf->len;
 
-		if (ops->can_merge && offset + chars <= PAGE_SIZE) {
+		if (ops->can_merge &&
+		    offset + chars <= PAGE_SIZE << compound_order(buf->page)) {
 			ret = ops->confirm(pipe, buf);
 			if (ret)
 				goto out;
@@ -395,9 +454,26 @@ pipe_write(struct kiocb *iocb, struct iov_iter *from)
 		if (bufs < pipe->buffers) {
 			int newbuf = (pipe->curbuf + bufs) & (pipe->buffers-1);
 			struct pipe_buffer *buf = pipe->bufs + newbuf;
-			struct page *page = pipe->tmp_page;
+			struct page *page = NULL;
+			size_t size = PAGE_SIZE;
 			int copied;
 
+			/*
+			 * Big writes go into a high-order buffer if the pipe
+			 * asked for it, falling back to a page at a time when
+			 * memory is fragmented. It comes from lowmem so that it
+			 * can be mapped in one go.
+			 */
+			if (pipe->buf_order && !is_packetized(filp) &&
+			    iov_iter_count(from) > PAGE_SIZE) {
+				page = alloc_pages(GFP_KERNEL | __GFP_COMP |
+						   __GFP_NOWARN | __GFP_NORETRY,
+						   pipe->buf_order);
+				if (page)
+					size <<= pipe->buf_order;
+			}
+			if (!page)
+				page = pipe->tmp_page;
 			if (!page) {
 				page = alloc_page(GFP_HIGHUSER);
 				if (unlikely(!page)) {
@@ -412,8 +488,10 @@ pipe_write(struct kiocb *iocb, struct iov_iter *from)
 			 * FIXME! Is this really true?
 			 */
 			do_wakeup = 1;
-			copied = copy_page_from_iter(page, 0, PAGE_SIZE, from);
-			if (unlikely(copied < PAGE_SIZE && iov_iter_count(from))) {
+			copied = copy_page_from_iter(page, 0, size, from);
+			if (unlikely(copied < size && iov_iter_count(from))) {
+				if (size > PAGE_SIZE)
+					put_page(page);
 				if (!ret)
 					ret = -EFAULT;
 				break;
@@ -431,7 +509,10 @@ pipe_write(struct kiocb *iocb, struct iov_iter *from)
 				buf->flags = PIPE_BUF_FLAG_PACKET;
 			}
 			pipe->nrbufs = ++bufs;
-			pipe->tmp_page = NULL;
+			if (size > PAGE_SIZE)
+				buf->ops = &anon_pipe_large_buf_ops;
+			else
+				pipe->tmp_page = NULL;
 
 			if (!iov_iter_count(from))
 				break;
@@ -449,6 +530,7 @@ pipe_write(struct kiocb *iocb, struct iov_iter *from)
 			break;
 		}
 		if (do_wakeup) {
+			del_timer(&pipe->wake_timer);
 			wake_up_interruptible_sync_poll(&pipe->wait, POLLIN | POLLRDNORM);
 			kill_fasync(&pipe->fasync_readers, SIGIO, POLL_IN);
 			do_wakeup = 0;
@@ -458,6 +540,8 @@ pipe_write(struct kiocb *iocb, struct iov_iter *from)
 		pipe->waiting_writers--;
 	}
 out:
+	if (do_wakeup && ret > 0 && pipe_defer_wakeup(pipe, ret))
+		do_wakeup = 0;
 	__pipe_unlock(pipe);
 	if (do_wakeup) {
 		wake_up_interruptible_sync_poll(&pipe->wait, POLLIN | POLLRDNORM);
@@ -595,6 +679,8 @@ struct pipe_inode_info *alloc_pipe_info(void)
 			pipe->r_counter = pipe->w_counter = 1;
 			pipe->buffers = PIPE_DEF_BUFFERS;
 			mutex_init(&pipe->mutex);
+			setup_timer(&pipe->wake_timer, pipe_wake_timer_fn,
+				    (unsigned long)pipe);
 			return pipe;
 		}
 		kfree(pipe);
@@ -607,6 +693,7 @@ void free_pipe_info(struct pipe_inode_info *pipe)
 {
 	int i;
 
+	del_timer_sync(&pipe->wake_timer);
 	for (i = 0; i < pipe->buffers; i++) {
 		struct pipe_buffer *buf = pipe->bufs + i;
 		if (buf->ops)
@@ -1066,7 +1153,8 @@ long pipe_fcntl(struct file *file, unsigned int cmd, unsigned long arg)
 		if (!nr_pages)
 			goto out;
 
-		if (!capable(CAP_SYS_RESOURCE) && size > pipe_max_size) {
+		if (!capable(CAP_SYS_RESOURCE) &&
+		    (size << pipe->buf_order) > pipe_max_size) {
 			ret = -EPERM;
 			goto out;
 		}
@@ -1076,6 +1164,45 @@ long pipe_fcntl(struct file *file, unsigned int cmd, unsigned long arg)
 	case F_GETPIPE_SZ:
 		ret = pipe->buffers * PAGE_SIZE;
 		break;
+	case F_SETPIPE_WAKE:
+		ret = -EINVAL;
+		if (arg > INT_MAX)
+			goto out;
+		pipe->wake_bytes = arg;
+		if (!arg && del_timer(&pipe->wake_timer)) {
+			wake_up_interruptible_poll(&pipe->wait,
+						   POLLIN | POLLRDNORM);
+			kill_fasync(&pipe->fasync_readers, SIGIO, POLL_IN);
+		}
+		ret = arg;
+		break;
+	case F_GETPIPE_WAKE:
+		ret = pipe->wake_bytes;
+		break;
+	case F_SETPIPE_BUFSZ: {
+		unsigned int order;
+
+		/*
+		 * Each buffer slot may now hold this much, which counts
+		 * against the pipe size limit.
+		 */
+		ret = -EINVAL;
+		if (arg < PAGE_SIZE || arg > PAGE_SIZE << PIPE_MAX_BUF_ORDER)
+			goto out;
+		order = get_order(arg);
+
+		if (!capable(CAP_SYS_RESOURCE) &&
+		    ((pipe->buffers * PAGE_SIZE) << order) > pipe_max_size) {
+			ret = -EPERM;
+			goto out;
+		}
+		pipe->buf_order = order;
+		ret = PAGE_SIZE << order;
+		break;
+		}
+	case F_GETPIPE_BUFSZ:
+		ret = PAGE_SIZE << pipe->buf_order;
+		break;
 	default:
 		ret = -EINVAL;
 		break;
@@ -3,6 +3,7 @@
 #include <linux/init.h>
 #include <linux/interrupt.h>
 #include <linux/kernel_stat.h>
+#include <linux/mutex.h>
 #include <linux/proc_fs.h>
 #include <linux/sched.h>
 #include <linux/seq_file.h>
@@ -77,7 +78,32 @@ static u64 get_iowait_time(int cpu)
 
 #endif
 
-static int show_stat(struct seq_file *p, void *v)
+static void show_irq_gap(struct seq_file *p, unsigned int gap)
+{
+	static const char zeros[] = " 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0";
+
+	while (gap > 0) {
+		unsigned int inc;
+
+		inc = min_t(unsigned int, gap, ARRAY_SIZE(zeros) / 2);
+		seq_write(p, zeros, 2 * inc);
+		gap -= inc;
+	}
+}
+
+static void show_all_irqs(struct seq_file *p)
+{
+	unsigned int i, next = 0;
+
+	for_each_active_irq(i) {
+		show_irq_gap(p, i - next);
+		seq_put_decimal_ull(p, ' ', kstat_irqs_usr(i));
+		next = i + 1;
+	}
+	show_irq_gap(p, nr_irqs - next);
+}
+
+static int __show_stat(struct seq_file *p)
 {
 	int i, j;
 	unsigned long jif;
@@ -156,10 +182,7 @@ static int show_stat(struct seq_file *p, void *v)
 		seq_putc(p, '\n');
 	}
 	seq_printf(p, "intr %llu", (unsigned long long)sum);
-
-	/* sum again ? it could be updated? */
-	for_each_irq_nr(j)
-		seq_put_decimal_ull(p, ' ', kstat_irqs_usr(j));
+	show_all_irqs(p);
 
 	seq_printf(p,
 		"\nctxt %llu\n"
@@ -182,6 +205,60 @@ static int show_stat(struct seq_file *p, void *v)
 	return 0;
 }
 
+/*
+ * With kernel.proc_stat_cache_ms set, readers within that many milliseconds
+ * of the last full walk get its output again: monitoring agents on large
+ * machines read the file every second and the walk is not cheap.  The
+ * file is the same for everyone, so one copy serves all readers.
+ */
+int sysctl_proc_stat_cache_ms __read_mostly;
+
+static DEFINE_MUTEX(stat_cache_mutex);
+static char *stat_cache;
+static size_t stat_cache_len, stat_cache_size;
+static unsigned long stat_cache_time;
+
+static void stat_cache_store(const char *buf, size_t len)
+{
+	if (len > stat_cache_size) {
+		char *cache = kmalloc(len, GFP_KERNEL);
+
+		if (!cache)
+			return;
+		kfree(stat_cache);
+		stat_cache = cache;
+		stat_cache_size = len;
+	}
+
+	memcpy(stat_cache, buf, len);
+	stat_cache_len = len;
+	stat_cache_time = jiffies;
+}
+
+static int show_stat(struct seq_file *p, void *v)
+{
+	unsigned int ms = READ_ONCE(sysctl_proc_stat_cache_ms);
+	size_t start = p->count;
+	int ret = 0;
+
+	if (!ms)
+		return __show_stat(p);
+
+	mutex_lock(&stat_cache_mutex);
+	if (stat_cache_len &&
+	    time_before(jiffies, stat_cache_time + msecs_to_jiffies(ms))) {
+		seq_write(p, stat_cache, stat_cache_len);
+	} else {
+		ret = __show_stat(p);
+		/* On overflow seq_read() retries with a bigger buffer. */
+		if (!ret && !seq_has_overflowed(p))
+			stat_cache_store(p->buf + start, p->count - start);
+	}
+	mutex_unlock(&stat_cache_mutex);
+
+	return ret;
+}
+
 static int stat_open(struct inode *inode, struct file *file)
 {
 	size_t size = 1024 + 128 * num_online_cpus();
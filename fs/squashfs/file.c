@@ -497,7 +497,80 @@ out:
 	return 0;
 }
 
+#ifdef CONFIG_SQUASHFS_FILE_DIRECT
+/*
+ * Readahead.  The pages are grouped by datablock, and every datablock is
+ * decompressed once, directly into the page cache.  Sparse blocks, the
+ * tail-end fragment and errors are left to squashfs_readpage().
+ */
+static int squashfs_readpages(struct file *file, struct address_space *mapping,
+	struct list_head *pages, unsigned nr_pages)
+{
+	struct inode *inode = mapping->host;
+	struct squashfs_sb_info *msblk = inode->i_sb->s_fs_info;
+	int shift = msblk->block_log - PAGE_CACHE_SHIFT;
+	int mask = (1 << shift) - 1;
+	pgoff_t file_end = (i_size_read(inode) - 1) >> PAGE_CACHE_SHIFT;
+	int block_end = i_size_read(inode) >> msblk->block_log;
+	gfp_t gfp = mapping_gfp_constraint(mapping, GFP_KERNEL);
+	struct page **page;
+
+	page = kmalloc_array(mask + 1, sizeof(void *), GFP_KERNEL);
+	if (page == NULL)
+		return -ENOMEM;
+
+	while (!list_empty(pages)) {
+		struct page *first = list_entry(pages->prev, struct page, lru);
+		pgoff_t start_index = first->index & ~mask;
+		pgoff_t end_index = min_t(pgoff_t, start_index | mask,
+					  file_end);
+		int index = first->index >> shift;
+		int bsize = 0;
+		u64 block = 0;
+
+		if (first->index <= file_end && (index < block_end ||
+				squashfs_i(inode)->fragment_block ==
+						SQUASHFS_INVALID_BLK))
+			bsize = read_blocklist(inode, index, &block);
+
+		if (bsize <= 0) {
+			list_del(&first->lru);
+			if (!add_to_page_cache_lru(first, mapping, first->index,
+						   gfp))
+				squashfs_readpage(file, first);
+			page_cache_release(first);
+			continue;
+		}
+
+		/* add the pages of this datablock to the page cache */
+		memset(page, 0, (mask + 1) * sizeof(void *));
+		while (!list_empty(pages)) {
+			struct page *p = list_entry(pages->prev, struct page,
+						    lru);
+
+			if (p->index > end_index)
+				break;
+			list_del(&p->lru);
+			if (add_to_page_cache_lru(p, mapping, p->index, gfp)) {
+				page_cache_release(p);
+				continue;
+			}
+			page[p->index - start_index] = p;
+		}
+
+		squashfs_readahead_block(inode, page,
+					 end_index - start_index + 1,
+					 start_index, block, bsize);
+	}
+
+	kfree(page);
+	return 0;
+}
+#endif
 
 const struct address_space_operations squashfs_aops = {
-	.readpage = squashfs_readpage
+	.readpage = squashfs_readpage,
+#ifdef CONFIG_SQUASHFS_FILE_DIRECT
+	.readpages = squashfs_readpages,
+#endif
 };
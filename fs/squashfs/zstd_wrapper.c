@@ -0,0 +1,142 @@
+/*
+ * Squashfs - a compressed read only filesystem for Linux
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * zstd_wrapper.c
+ */
+
+#include <linux/mutex.h>
+#include <linux/buffer_head.h>
+#include <linux/slab.h>
+#include <linux/zstd.h>
+#include <linux/vmalloc.h>
+
+#include "squashfs_fs.h"
+#include "squashfs_fs_sb.h"
+#include "squashfs.h"
+#include "decompressor.h"
+#include "page_actor.h"
+
+struct squashfs_zstd {
+	void *workspace;
+	struct zstd_dstream *stream;
+};
+
+static void *zstd_init(struct squashfs_sb_info *msblk, void *buff)
+{
+	/* Every block is a frame of its own, so the window never exceeds it */
+	size_t max_window = max_t(int, msblk->block_size,
+				  SQUASHFS_METADATA_SIZE);
+	size_t wksp_size = zstd_dstream_workspace_bound(max_window);
+	struct squashfs_zstd *zstd;
+
+	zstd = kzalloc(sizeof(*zstd), GFP_KERNEL);
+	if (zstd == NULL)
+		goto failed;
+	zstd->workspace = vmalloc(wksp_size);
+	if (zstd->workspace == NULL)
+		goto failed2;
+	zstd->stream = zstd_init_dstream(max_window, zstd->workspace,
+					 wksp_size);
+	if (zstd->stream == NULL)
+		goto failed3;
+
+	return zstd;
+
+failed3:
+	vfree(zstd->workspace);
+failed2:
+	kfree(zstd);
+failed:
+	ERROR("Failed to initialise zstd decompressor\n");
+	return ERR_PTR(-ENOMEM);
+}
+
+
+static void zstd_free(void *strm)
+{
+	struct squashfs_zstd *zstd = strm;
+
+	if (zstd)
+		vfree(zstd->workspace);
+	kfree(zstd);
+}
+
+
+static int zstd_uncompress(struct squashfs_sb_info *msblk, void *strm,
+	struct buffer_head **bh, int b, int offset, int length,
+	struct squashfs_page_actor *output)
+{
+	struct squashfs_zstd *zstd = strm;
+	struct zstd_in_buffer in_buf = { NULL, 0, 0 };
+	struct zstd_out_buffer out_buf = { NULL, 0, 0 };
+	int avail, total = 0, k = 0;
+	size_t zstd_err = 0;
+
+	zstd_reset_dstream(zstd->stream);
+	out_buf.dst = squashfs_first_page(output);
+	out_buf.size = PAGE_CACHE_SIZE;
+
+	do {
+		if (in_buf.pos == in_buf.size && k < b) {
+			avail = min(length, msblk->devblksize - offset);
+			length -= avail;
+			in_buf.src = bh[k]->b_data + offset;
+			in_buf.size = avail;
+			in_buf.pos = 0;
+			offset = 0;
+		}
+
+		if (out_buf.pos == out_buf.size) {
+			out_buf.dst = squashfs_next_page(output);
+			if (out_buf.dst == NULL)
+				break;
+			out_buf.pos = 0;
+			total += PAGE_CACHE_SIZE;
+		}
+
+		zstd_err = zstd_decompress_stream(zstd->stream, &out_buf,
+						  &in_buf);
+
+		if (in_buf.pos == in_buf.size && k < b)
+			put_bh(bh[k++]);
+
+		if (zstd_is_error(zstd_err))
+			break;
+		/* Out of input with room left for output: truncated */
+		if (zstd_err && k == b && in_buf.pos == in_buf.size &&
+		    out_buf.pos < out_buf.size)
+			break;
+	} while (zstd_err);
+
+	squashfs_finish_page(output);
+
+	if (zstd_err || k < b)
+		goto out;
+
+	return total + out_buf.pos;
+
+out:
+	for (; k < b; k++)
+		put_bh(bh[k]);
+
+	return -EIO;
+}
+
+const struct squashfs_decompressor squashfs_zstd_comp_ops = {
+	.init = zstd_init,
+	.free = zstd_free,
+	.decompress = zstd_uncompress,
+	.id = ZSTD_COMPRESSION,
+	.name = "zstd",
+	.supported = 1
+};
@@ -387,6 +387,7 @@ xfs_submit_ioend_bio(
 
 STATIC struct bio *
 xfs_alloc_ioend_bio(
+	struct writeback_control *wbc,
 	struct buffer_head	*bh)
 {
 	struct bio		*bio = bio_alloc(GFP_NOIO, BIO_MAX_PAGES);
@@ -394,6 +395,8 @@ xfs_alloc_ioend_bio(
 	ASSERT(bio->bi_private == NULL);
 	bio->bi_iter.bi_sector = bh->b_blocknr * (bh->b_size >> 9);
 	bio->bi_bdev = bh->b_bdev;
+	/* charge the I/O to the cgroup that owns the inode's writeback */
+	wbc_init_bio(wbc, bio);
 	return bio;
 }
 
@@ -508,7 +511,7 @@ xfs_submit_ioend(
 
 			if (!bio) {
  retry:
-				bio = xfs_alloc_ioend_bio(bh);
+				bio = xfs_alloc_ioend_bio(wbc, bh);
 			} else if (bh->b_blocknr != lastblock + 1) {
 				xfs_submit_ioend_bio(wbc, ioend, bio);
 				goto retry;
@@ -518,6 +521,7 @@ xfs_submit_ioend(
 				xfs_submit_ioend_bio(wbc, ioend, bio);
 				goto retry;
 			}
+			wbc_account_io(wbc, bh->b_page, bh->b_size);
 
 			lastblock = bh->b_blocknr;
 		}
@@ -31,6 +31,8 @@
 #include "xfs_log.h"
 #include "xfs_log_priv.h"
 
+#include <linux/list_sort.h>
+
 /*
  * Allocate a new ticket. Failing to get a new ticket makes it really hard to
  * recover, so we don't allow failure here. Also, we allocate in a context that
@@ -273,6 +275,9 @@ insert:
  * if the change requires additional log metadata. If it does, take that space
  * as well. Remove the amount of space we added to the checkpoint ticket from
  * the current transaction ticket so that the accounting works out correctly.
+ *
+ * Everything but the very first commit into a context only touches this cpu's
+ * part of the CIL, which the push aggregates.
  */
 static void
 xlog_cil_insert_items(
@@ -281,10 +286,13 @@ xlog_cil_insert_items(
 {
 	struct xfs_cil		*cil = log->l_cilp;
 	struct xfs_cil_ctx	*ctx = cil->xc_ctx;
+	struct xlog_cil_pcp	*cilpcp;
 	struct xfs_log_item_desc *lidp;
 	int			len = 0;
 	int			diff_iovecs = 0;
 	int			iclog_space;
+	bool			took_unit_res = false;
+	uint			order;
 
 	ASSERT(tp);
 
@@ -294,12 +302,31 @@ xlog_cil_insert_items(
 	 */
 	xlog_cil_insert_format_items(log, tp, &len, &diff_iovecs);
 
+	/* account for space used by new iovec headers  */
+	len += diff_iovecs * sizeof(xlog_op_header_t);
+
+	/*
+	 * The first commit into the context transfers enough transaction
+	 * reservation to the context ticket for the checkpoint. The context
+	 * ticket is special - the unit reservation has to grow as well as the
+	 * current reservation as we steal from tickets so we can correctly
+	 * determine the space used during the transaction commit. Clearing
+	 * XLOG_CIL_EMPTY needs only the shared context lock, setting it again
+	 * is done by the push with the lock held exclusively.
+	 */
+	if (test_bit(XLOG_CIL_EMPTY, &cil->xc_flags) &&
+	    test_and_clear_bit(XLOG_CIL_EMPTY, &cil->xc_flags)) {
+		ctx->ticket->t_curr_res = ctx->ticket->t_unit_res;
+		tp->t_ticket->t_curr_res -= ctx->ticket->t_unit_res;
+		took_unit_res = true;
+	}
+
 	/*
-	 * Now (re-)position everything modified at the tail of the CIL.
-	 * We do this here so we only need to take the CIL lock once during
-	 * the transaction commit.
+	 * Now (re-)stamp everything modified with the commit order and put
+	 * the items that aren't in the CIL yet on this cpu's list.
 	 */
-	spin_lock(&cil->xc_cil_lock);
+	order = atomic_inc_return(&ctx->order_id);
+	cilpcp = get_cpu_ptr(cil->xc_pcp);
 	list_for_each_entry(lidp, &tp->t_items, lid_trans) {
 		struct xfs_log_item	*lip = lidp->lid_item;
 
@@ -307,53 +334,43 @@ xlog_cil_insert_items(
 		if (!(lidp->lid_flags & XFS_LID_DIRTY))
 			continue;
 
-		/*
-		 * Only move the item if it isn't already at the tail. This is
-		 * to prevent a transient list_empty() state when reinserting
-		 * an item that is already the only item in the CIL.
-		 */
-		if (!list_is_last(&lip->li_cil, &cil->xc_cil))
-			list_move_tail(&lip->li_cil, &cil->xc_cil);
+		lip->li_order_id = order;
+		if (list_empty(&lip->li_cil))
+			list_add_tail(&lip->li_cil, &cilpcp->log_items);
 	}
 
-	/* account for space used by new iovec headers  */
-	len += diff_iovecs * sizeof(xlog_op_header_t);
-	ctx->nvecs += diff_iovecs;
-
 	/* attach the transaction to the CIL if it has any busy extents */
 	if (!list_empty(&tp->t_busy))
-		list_splice_init(&tp->t_busy, &ctx->busy_extents);
+		list_splice_init(&tp->t_busy, &cilpcp->busy_extents);
 
 	/*
-	 * Now transfer enough transaction reservation to the context ticket
-	 * for the checkpoint. The context ticket is special - the unit
-	 * reservation has to grow as well as the current reservation as we
-	 * steal from tickets so we can correctly determine the space used
-	 * during the transaction commit.
+	 * Do we need space for more log record headers? Each cpu accounts for
+	 * the headers of the space it adds, and as the space is split between
+	 * cpus it also takes one up front whenever it starts accumulating
+	 * again, unless the unit reservation we just stole covers that.
 	 */
-	if (ctx->ticket->t_curr_res == 0) {
-		ctx->ticket->t_curr_res = ctx->ticket->t_unit_res;
-		tp->t_ticket->t_curr_res -= ctx->ticket->t_unit_res;
-	}
-
-	/* do we need space for more log record headers? */
 	iclog_space = log->l_iclog_size - log->l_iclog_hsize;
-	if (len > 0 && (ctx->space_used / iclog_space !=
-				(ctx->space_used + len) / iclog_space)) {
+	if (len > 0 &&
+	    ((!cilpcp->space_used && !took_unit_res) ||
+	     cilpcp->space_used / iclog_space !=
+				(cilpcp->space_used + len) / iclog_space)) {
 		int hdrs;
 
 		hdrs = (len + iclog_space - 1) / iclog_space;
 		/* need to take into account split region headers, too */
 		hdrs *= log->l_iclog_hsize + sizeof(struct xlog_op_header);
-		ctx->ticket->t_unit_res += hdrs;
-		ctx->ticket->t_curr_res += hdrs;
+		cilpcp->space_reserved += hdrs;
 		tp->t_ticket->t_curr_res -= hdrs;
 		ASSERT(tp->t_ticket->t_curr_res >= len);
 	}
 	tp->t_ticket->t_curr_res -= len;
-	ctx->space_used += len;
 
-	spin_unlock(&cil->xc_cil_lock);
+	cilpcp->space_used += len;
+	if (cilpcp->space_used > XLOG_CIL_PCP_SPACE(log)) {
+		atomic_add(cilpcp->space_used, &ctx->space_used);
+		cilpcp->space_used = 0;
+	}
+	put_cpu_ptr(cil->xc_pcp);
 }
 
 static void
@@ -413,6 +430,46 @@ xlog_cil_committed(
 	kmem_free(ctx);
 }
 
+/* list_sort() callback putting CIL items back in commit order */
+static int
+xlog_cil_order_cmp(
+	void			*priv,
+	struct list_head	*a,
+	struct list_head	*b)
+{
+	struct xfs_log_item	*l1 = container_of(a, struct xfs_log_item, li_cil);
+	struct xfs_log_item	*l2 = container_of(b, struct xfs_log_item, li_cil);
+
+	return l1->li_order_id > l2->li_order_id;
+}
+
+/*
+ * Gather what the transaction commits left in the per-cpu parts of the CIL:
+ * the items in commit order onto @log_items, the busy extents and the log
+ * record header space they stole onto the context being pushed. Called with
+ * the context lock held exclusively, so there are no commits running.
+ */
+static void
+xlog_cil_pcp_aggregate(
+	struct xfs_cil		*cil,
+	struct xfs_cil_ctx	*ctx,
+	struct list_head	*log_items)
+{
+	int			cpu;
+
+	for_each_possible_cpu(cpu) {
+		struct xlog_cil_pcp	*cilpcp = per_cpu_ptr(cil->xc_pcp, cpu);
+
+		list_splice_init(&cilpcp->log_items, log_items);
+		list_splice_init(&cilpcp->busy_extents, &ctx->busy_extents);
+		ctx->ticket->t_unit_res += cilpcp->space_reserved;
+		ctx->ticket->t_curr_res += cilpcp->space_reserved;
+		cilpcp->space_reserved = 0;
+		cilpcp->space_used = 0;
+	}
+	list_sort(NULL, log_items, xlog_cil_order_cmp);
+}
+
 /*
  * Push the Committed Item List to the log. If @push_seq flag is zero, then it
  * is a background flush and so we can chose to ignore it. Otherwise, if the
@@ -444,6 +501,7 @@ xlog_cil_push(
 	struct xfs_log_vec	lvhdr = { NULL };
 	xfs_lsn_t		commit_lsn;
 	xfs_lsn_t		push_seq;
+	LIST_HEAD(log_items);
 
 	if (!cil)
 		return 0;
@@ -463,7 +521,7 @@ xlog_cil_push(
 	 * move on to a new sequence number and so we have to be able to push
 	 * this sequence again later.
 	 */
-	if (list_empty(&cil->xc_cil)) {
+	if (test_bit(XLOG_CIL_EMPTY, &cil->xc_flags)) {
 		cil->xc_push_seq = 0;
 		spin_unlock(&cil->xc_push_lock);
 		goto out_skip;
@@ -505,16 +563,17 @@ xlog_cil_push(
 
 	/*
 	 * pull all the log vectors off the items in the CIL, and
-	 * remove the items from the CIL. We don't need the CIL lock
-	 * here because it's only needed on the transaction commit
-	 * side which is currently locked out by the flush lock.
+	 * remove the items from the CIL. We don't need any locking for
+	 * the per-cpu lists here because the transaction commit side is
+	 * currently locked out by the flush lock.
 	 */
+	xlog_cil_pcp_aggregate(cil, ctx, &log_items);
 	lv = NULL;
 	num_iovecs = 0;
-	while (!list_empty(&cil->xc_cil)) {
+	while (!list_empty(&log_items)) {
 		struct xfs_log_item	*item;
 
-		item = list_first_entry(&cil->xc_cil,
+		item = list_first_entry(&log_items,
 					struct xfs_log_item, li_cil);
 		list_del_init(&item->li_cil);
 		if (!ctx->lv_chain)
@@ -537,6 +596,7 @@ xlog_cil_push(
 	new_ctx->sequence = ctx->sequence + 1;
 	new_ctx->cil = cil;
 	cil->xc_ctx = new_ctx;
+	set_bit(XLOG_CIL_EMPTY, &cil->xc_flags);
 
 	/*
 	 * The switch is now done, so we can drop the context lock and move out
@@ -693,13 +753,13 @@ xlog_cil_push_background(
 	 * The cil won't be empty because we are called while holding the
 	 * context lock so whatever we added to the CIL will still be there
 	 */
-	ASSERT(!list_empty(&cil->xc_cil));
+	ASSERT(!test_bit(XLOG_CIL_EMPTY, &cil->xc_flags));
 
 	/*
 	 * don't do a background push if we haven't used up all the
 	 * space available yet.
 	 */
-	if (cil->xc_ctx->space_used < XLOG_CIL_SPACE_LIMIT(log))
+	if (atomic_read(&cil->xc_ctx->space_used) < XLOG_CIL_SPACE_LIMIT(log))
 		return;
 
 	spin_lock(&cil->xc_push_lock);
@@ -737,7 +797,8 @@ xlog_cil_push_now(
 	 * there's no work we need to do.
 	 */
 	spin_lock(&cil->xc_push_lock);
-	if (list_empty(&cil->xc_cil) || push_seq <= cil->xc_push_seq) {
+	if (test_bit(XLOG_CIL_EMPTY, &cil->xc_flags) ||
+	    push_seq <= cil->xc_push_seq) {
 		spin_unlock(&cil->xc_push_lock);
 		return;
 	}
@@ -755,7 +816,7 @@ xlog_cil_empty(
 	bool		empty = false;
 
 	spin_lock(&cil->xc_push_lock);
-	if (list_empty(&cil->xc_cil))
+	if (test_bit(XLOG_CIL_EMPTY, &cil->xc_flags))
 		empty = true;
 	spin_unlock(&cil->xc_push_lock);
 	return empty;
@@ -894,7 +955,7 @@ restart:
 	 * we would have found the context on the committing list.
 	 */
 	if (sequence == cil->xc_current_sequence &&
-	    !list_empty(&cil->xc_cil)) {
+	    !test_bit(XLOG_CIL_EMPTY, &cil->xc_flags)) {
 		spin_unlock(&cil->xc_push_lock);
 		goto restart;
 	}
@@ -953,21 +1014,34 @@ xlog_cil_init(
 {
 	struct xfs_cil	*cil;
 	struct xfs_cil_ctx *ctx;
+	int		cpu;
 
 	cil = kmem_zalloc(sizeof(*cil), KM_SLEEP|KM_MAYFAIL);
 	if (!cil)
 		return -ENOMEM;
 
+	cil->xc_pcp = alloc_percpu(struct xlog_cil_pcp);
+	if (!cil->xc_pcp) {
+		kmem_free(cil);
+		return -ENOMEM;
+	}
+
 	ctx = kmem_zalloc(sizeof(*ctx), KM_SLEEP|KM_MAYFAIL);
 	if (!ctx) {
+		free_percpu(cil->xc_pcp);
 		kmem_free(cil);
 		return -ENOMEM;
 	}
 
+	for_each_possible_cpu(cpu) {
+		struct xlog_cil_pcp	*cilpcp = per_cpu_ptr(cil->xc_pcp, cpu);
+
+		INIT_LIST_HEAD(&cilpcp->log_items);
+		INIT_LIST_HEAD(&cilpcp->busy_extents);
+	}
+
 	INIT_WORK(&cil->xc_push_work, xlog_cil_push_work);
-	INIT_LIST_HEAD(&cil->xc_cil);
 	INIT_LIST_HEAD(&cil->xc_committing);
-	spin_lock_init(&cil->xc_cil_lock);
 	spin_lock_init(&cil->xc_push_lock);
 	init_rwsem(&cil->xc_ctx_lock);
 	init_waitqueue_head(&cil->xc_commit_wait);
@@ -978,6 +1052,7 @@ xlog_cil_init(
 	ctx->cil = cil;
 	cil->xc_ctx = ctx;
 	cil->xc_current_sequence = ctx->sequence;
+	set_bit(XLOG_CIL_EMPTY, &cil->xc_flags);
 
 	cil->xc_log = log;
 	log->l_cilp = cil;
@@ -994,7 +1069,8 @@ xlog_cil_destroy(
 		kmem_free(log->l_cilp->xc_ctx);
 	}
 
-	ASSERT(list_empty(&log->l_cilp->xc_cil));
+	ASSERT(test_bit(XLOG_CIL_EMPTY, &log->l_cilp->xc_flags));
+	free_percpu(log->l_cilp->xc_pcp);
 	kmem_free(log->l_cilp);
 }
 
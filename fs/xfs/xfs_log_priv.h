@@ -251,14 +251,29 @@ struct xfs_cil_ctx {
 	xfs_lsn_t		start_lsn;	/* first LSN of chkpt commit */
 	xfs_lsn_t		commit_lsn;	/* chkpt commit record lsn */
 	struct xlog_ticket	*ticket;	/* chkpt ticket */
-	int			nvecs;		/* number of regions */
-	int			space_used;	/* aggregate size of regions */
+	atomic_t		space_used;	/* aggregate size of regions */
+	atomic_t		order_id;	/* last item commit order */
 	struct list_head	busy_extents;	/* busy extents in chkpt */
 	struct xfs_log_vec	*lv_chain;	/* logvecs being pushed */
 	struct xfs_log_callback	log_cb;		/* completion callback hook. */
 	struct list_head	committing;	/* ctx committing list */
 };
 
+/*
+ * Per-cpu part of the CIL. Transaction commits insert their items, busy
+ * extents and space accounting here so that they don't have to serialise
+ * against each other; the push aggregates it all under the exclusive
+ * context lock. Items already in the CIL stay on whichever per-cpu list
+ * they were first inserted on, the push restores the commit order with
+ * the li_order_id stamped on each commit.
+ */
+struct xlog_cil_pcp {
+	int			space_used;	/* not yet in ctx->space_used */
+	int			space_reserved;	/* stolen iclog header space */
+	struct list_head	log_items;
+	struct list_head	busy_extents;
+};
+
 /*
  * Committed Item List structure
  *
@@ -277,8 +292,8 @@ struct xfs_cil_ctx {
  */
 struct xfs_cil {
 	struct xlog		*xc_log;
-	struct list_head	xc_cil;
-	spinlock_t		xc_cil_lock;
+	unsigned long		xc_flags;
+	struct xlog_cil_pcp __percpu *xc_pcp;
 
 	struct rw_semaphore	xc_ctx_lock ____cacheline_aligned_in_smp;
 	struct xfs_cil_ctx	*xc_ctx;
@@ -291,6 +306,9 @@ struct xfs_cil {
 	struct work_struct	xc_push_work;
 } ____cacheline_aligned_in_smp;
 
+/* xc_flags bit values */
+#define	XLOG_CIL_EMPTY		1	/* no commit into the current context */
+
 /*
  * The amount of log space we allow the CIL to aggregate is difficult to size.
  * Whatever we choose, we have to make sure we can get a reservation for the
@@ -340,6 +358,13 @@ struct xfs_cil {
  */
 #define XLOG_CIL_SPACE_LIMIT(log)	(log->l_logsize >> 3)
 
+/*
+ * Space a cpu may accumulate before folding it into the context's space_used,
+ * so background pushes run at most a quarter of the limit late.
+ */
+#define XLOG_CIL_PCP_SPACE(log)	\
+	(XLOG_CIL_SPACE_LIMIT(log) / (4 * num_online_cpus()))
+
 /*
  * ticket grant locks, queues and accounting have their own cachlines
  * as these are quite hot and can be operated on concurrently.
@@ -1508,6 +1508,7 @@ xfs_fs_fill_super(
 	sb->s_maxbytes = xfs_max_file_offset(sb->s_blocksize_bits);
 	sb->s_max_links = XFS_MAXLINK;
 	sb->s_time_gran = 1;
+	sb->s_iflags |= SB_I_CGROUPWB;
 	set_posix_acl_flag(sb);
 
 	/* version 5 superblocks support inode version counters. */
@@ -653,7 +653,10 @@
 
 #define INIT_CALLS_LEVEL(level)						\
 		VMLINUX_SYMBOL(__initcall##level##_start) = .;		\
+		*(.initcall##level##p.init)				\
+		VMLINUX_SYMBOL(__initcall##level##_serial) = .;		\
 		*(.initcall##level##.init)				\
+		VMLINUX_SYMBOL(__initcall##level##_sync) = .;		\
 		*(.initcall##level##s.init)				\
 
 #define INIT_CALLS							\
@@ -111,6 +111,7 @@ struct bdi_writeback {
 
 	struct fprop_local_percpu completions;
 	int dirty_exceeded;
+	unsigned long dirty_sleep;	/* last wait in balance_dirty_pages() */
 
 	spinlock_t work_lock;		/* protects work_list & dwork scheduling */
 	struct list_head work_list;
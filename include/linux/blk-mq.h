@@ -47,6 +47,8 @@ struct blk_mq_hw_ctx {
 
 	struct blk_mq_tags	*tags;
 
+	void			*sched_data;
+
 	unsigned long		queued;
 	unsigned long		run;
 #define BLK_MQ_MAX_DISPATCH_ORDER	10
@@ -88,7 +90,10 @@ struct blk_mq_queue_data {
 };
 
 typedef int (queue_rq_fn)(struct blk_mq_hw_ctx *, const struct blk_mq_queue_data *);
+typedef bool (get_budget_fn)(struct blk_mq_hw_ctx *);
+typedef void (put_budget_fn)(struct blk_mq_hw_ctx *);
 typedef struct blk_mq_hw_ctx *(map_queue_fn)(struct request_queue *, const int);
+typedef int (map_queues_fn)(struct blk_mq_tag_set *set, unsigned int *map);
 typedef enum blk_eh_timer_return (timeout_fn)(struct request *, bool);
 typedef int (init_hctx_fn)(struct blk_mq_hw_ctx *, void *, unsigned int);
 typedef void (exit_hctx_fn)(struct blk_mq_hw_ctx *, unsigned int);
@@ -109,11 +114,29 @@ struct blk_mq_ops {
 	 */
 	queue_rq_fn		*queue_rq;
 
+	/*
+	 * Reserve budget before a request is taken off the dispatch list or
+	 * out of the IO scheduler.  Once ->queue_rq has been called it is
+	 * the driver's job to release the budget, either when the request
+	 * completes or when ->queue_rq fails.  If no budget is available
+	 * the driver must make sure the hardware queue is run again later,
+	 * e.g. by stopping it and restarting it from its completion path.
+	 */
+	get_budget_fn		*get_budget;
+	put_budget_fn		*put_budget;
+
 	/*
 	 * Map to specific hardware queue
 	 */
 	map_queue_fn		*map_queue;
 
+	/*
+	 * Fill in the cpu to hardware queue map, e.g. from the affinity of
+	 * the device's interrupt vectors.  Optional, if not set or if it
+	 * fails, the cpus are spread evenly over the hardware queues.
+	 */
+	map_queues_fn		*map_queues;
+
 	/*
 	 * Called on request timeout
 	 */
@@ -190,6 +213,8 @@ void blk_mq_free_hctx_request(struct blk_mq_hw_ctx *, struct request *rq);
 bool blk_mq_can_queue(struct blk_mq_hw_ctx *);
 struct request *blk_mq_alloc_request(struct request_queue *q, int rw,
 		gfp_t gfp, bool reserved);
+struct request *blk_mq_alloc_request_hctx(struct request_queue *q, int rw,
+		bool reserved, unsigned int hctx_idx);
 struct request *blk_mq_tag_to_rq(struct blk_mq_tags *tags, unsigned int tag);
 struct cpumask *blk_mq_tags_cpumask(struct blk_mq_tags *tags);
 
@@ -225,6 +250,25 @@ void blk_mq_kick_requeue_list(struct request_queue *q);
 void blk_mq_abort_requeue_list(struct request_queue *q);
 void blk_mq_complete_request(struct request *rq, int error);
 
+/*
+ * Requests reaped in one pass over a completion queue, ended together by
+ * blk_mq_end_request_batch().  Linked through request->queuelist.
+ */
+struct blk_mq_comp_batch {
+	struct list_head list;
+	unsigned int nr;
+};
+
+static inline void blk_mq_init_comp_batch(struct blk_mq_comp_batch *batch)
+{
+	INIT_LIST_HEAD(&batch->list);
+	batch->nr = 0;
+}
+
+bool blk_mq_add_to_batch(struct request *rq, struct blk_mq_comp_batch *batch,
+			 int error);
+void blk_mq_end_request_batch(struct blk_mq_comp_batch *batch);
+
 void blk_mq_stop_hw_queue(struct blk_mq_hw_ctx *hctx);
 void blk_mq_start_hw_queue(struct blk_mq_hw_ctx *hctx);
 void blk_mq_stop_hw_queues(struct request_queue *q);
@@ -234,6 +278,8 @@ void blk_mq_run_hw_queues(struct request_queue *q, bool async);
 void blk_mq_delay_queue(struct blk_mq_hw_ctx *hctx, unsigned long msecs);
 void blk_mq_all_tag_busy_iter(struct blk_mq_tags *tags, busy_tag_iter_fn *fn,
 		void *priv);
+void blk_mq_tagset_busy_iter(struct blk_mq_tag_set *tagset,
+		busy_tag_iter_fn *fn, void *priv);
 void blk_mq_freeze_queue(struct request_queue *q);
 void blk_mq_unfreeze_queue(struct request_queue *q);
 void blk_mq_freeze_queue_start(struct request_queue *q);
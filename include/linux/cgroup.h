@@ -17,6 +17,7 @@
 #include <linux/seq_file.h>
 #include <linux/kernfs.h>
 #include <linux/jump_label.h>
+#include <linux/psi.h>
 
 #include <linux/cgroup-defs.h>
 
@@ -80,6 +81,7 @@ struct cgroup_subsys_state *cgroup_get_e_css(struct cgroup *cgroup,
 					     struct cgroup_subsys *ss);
 struct cgroup_subsys_state *css_tryget_online_from_dir(struct dentry *dentry,
 						       struct cgroup_subsys *ss);
+struct cgroup *cgroup_get_from_fd(int fd);
 
 bool cgroup_is_descendant(struct cgroup *cgrp, struct cgroup *ancestor);
 int cgroup_attach_task_all(struct task_struct *from, struct task_struct *);
@@ -92,6 +94,8 @@ void cgroup_file_notify(struct cgroup_file *cfile);
 
 char *task_cgroup_path(struct task_struct *task, char *buf, size_t buflen);
 int cgroupstats_build(struct cgroupstats *stats, struct dentry *dentry);
+int cgroup_grab_tasks(struct dentry *dentry, unsigned long pos,
+		      struct task_struct **tasks, int nr);
 int proc_cgroup_show(struct seq_file *m, struct pid_namespace *ns,
 		     struct pid *pid, struct task_struct *tsk);
 
@@ -364,6 +368,11 @@ static inline void css_put_many(struct cgroup_subsys_state *css, unsigned int n)
 		percpu_ref_put_many(&css->refcnt, n);
 }
 
+static inline void cgroup_put(struct cgroup *cgrp)
+{
+	css_put(&cgrp->self);
+}
+
 /**
  * task_css_set_check - obtain a task's css_set with extra access conditions
  * @task: the task to obtain css_set for
@@ -484,6 +493,13 @@ static inline ino_t cgroup_ino(struct cgroup *cgrp)
 }
 
 /* cft/css accessors for cftype->write() operation */
+#ifdef CONFIG_PSI
+static inline struct psi_group *cgroup_psi(struct cgroup *cgrp)
+{
+	return cgrp->self.parent ? &cgrp->psi : &psi_system;
+}
+#endif
+
 static inline struct cftype *of_cft(struct kernfs_open_file *of)
 {
 	return of->kn->priv;
@@ -537,6 +553,9 @@ static inline int cgroup_attach_task_all(struct task_struct *from,
 					 struct task_struct *t) { return 0; }
 static inline int cgroupstats_build(struct cgroupstats *stats,
 				    struct dentry *dentry) { return -EINVAL; }
+static inline int cgroup_grab_tasks(struct dentry *dentry, unsigned long pos,
+				    struct task_struct **tasks, int nr)
+{ return -EINVAL; }
 
 static inline void cgroup_fork(struct task_struct *p) {}
 static inline int cgroup_can_fork(struct task_struct *p,
@@ -554,4 +573,18 @@ static inline int cgroup_init(void) { return 0; }
 
 #endif /* !CONFIG_CGROUPS */
 
+/*
+ * sock->sk_bpf_cgrp handling, the cgroup on the default hierarchy whose
+ * bpf programs filter the socket's traffic.
+ */
+struct sock;
+
+#ifdef CONFIG_CGROUP_BPF
+void cgroup_sk_alloc(struct sock *sk);
+void cgroup_sk_free(struct sock *sk);
+#else
+static inline void cgroup_sk_alloc(struct sock *sk) {}
+static inline void cgroup_sk_free(struct sock *sk) {}
+#endif
+
 #endif /* _LINUX_CGROUP_H */
@@ -77,6 +77,9 @@ struct cpuidle_device {
 	unsigned int		cpu;
 
 	int			last_residency;
+	/* Bound on the polling state, 0 for none, and whether it was hit */
+	u64			poll_limit_ns;
+	bool			poll_time_limit;
 	struct cpuidle_state_usage	states_usage[CPUIDLE_STATE_MAX];
 	struct cpuidle_state_kobj *kobjs[CPUIDLE_STATE_MAX];
 	struct cpuidle_driver_kobj *kobj_driver;
@@ -120,6 +123,9 @@ struct cpuidle_driver {
 
 	/* the driver handles the cpus in cpumask */
 	struct cpumask		*cpumask;
+
+	/* preferred governor to switch to on registration, if available */
+	const char		*governor;
 };
 
 #ifdef CONFIG_CPU_IDLE
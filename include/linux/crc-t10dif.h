@@ -11,4 +11,17 @@ extern __u16 crc_t10dif_generic(__u16 crc, const unsigned char *buffer,
 extern __u16 crc_t10dif(unsigned char const *, size_t);
 extern __u16 crc_t10dif_update(__u16 crc, unsigned char const *, size_t);
 
+/*
+ * CRCs of @count consecutive blocks of @interval bytes each, as used for
+ * protection information.  Architectures can register a faster version.
+ */
+typedef void (crc_t10dif_blocks_fn)(const unsigned char *data,
+				    unsigned int interval, unsigned int count,
+				    __u16 *crcs);
+
+extern void crc_t10dif_blocks(const unsigned char *data, unsigned int interval,
+			      unsigned int count, __u16 *crcs);
+extern void crc_t10dif_register_blocks(crc_t10dif_blocks_fn *fn);
+extern void crc_t10dif_unregister_blocks(crc_t10dif_blocks_fn *fn);
+
 #endif
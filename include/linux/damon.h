@@ -0,0 +1,218 @@
+/*
+ * DAMON: Data Access MONitor
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#ifndef _LINUX_DAMON_H
+#define _LINUX_DAMON_H
+
+#include <linux/ktime.h>
+#include <linux/list.h>
+#include <linux/mutex.h>
+#include <linux/types.h>
+
+struct pid;
+struct task_struct;
+
+/* Minimal region size.  Every damon_region is aligned by this. */
+#define DAMON_MIN_REGION	PAGE_SIZE
+
+/**
+ * struct damon_addr_range - Represents an address region of [@start, @end).
+ * @start:	Start address of the region (inclusive).
+ * @end:	End address of the region (exclusive).
+ */
+struct damon_addr_range {
+	unsigned long start;
+	unsigned long end;
+};
+
+/**
+ * struct damon_region - Represents a monitoring target region.
+ * @ar:			The address range of the region.
+ * @sampling_addr:	Address of the sample for the next access check.
+ * @nr_accesses:	Access frequency of this region.
+ * @age:		Age of this region.
+ * @last_nr_accesses:	@nr_accesses of the last aggregation interval.
+ * @list:		List head for siblings.
+ *
+ * @nr_accesses counts the sampling intervals of the current aggregation
+ * interval in which an access to @sampling_addr was seen.  @age counts the
+ * aggregation intervals for which the access frequency of the region has
+ * stayed about the same.
+ */
+struct damon_region {
+	struct damon_addr_range ar;
+	unsigned long sampling_addr;
+	unsigned int nr_accesses;
+	unsigned int age;
+	unsigned int last_nr_accesses;
+	struct list_head list;
+};
+
+/**
+ * struct damon_target - Represents a monitoring target.
+ * @pid:		The pid of the process whose address space is monitored.
+ * @nr_regions:		Number of monitoring target regions of this target.
+ * @regions_list:	Head of the monitoring target regions of this target.
+ * @list:		List head for siblings.
+ *
+ * The target holds a reference to @pid.  The regions are kept sorted by
+ * address and never overlap.
+ */
+struct damon_target {
+	struct pid *pid;
+	unsigned int nr_regions;
+	struct list_head regions_list;
+	struct list_head list;
+};
+
+/**
+ * enum damos_action - What action a DAMON-based operation scheme applies.
+ * @DAMOS_WILLNEED:	Call madvise() for the region with MADV_WILLNEED.
+ * @DAMOS_COLD:		Call madvise() for the region with MADV_COLD.
+ * @DAMOS_PAGEOUT:	Call madvise() for the region with MADV_PAGEOUT.
+ * @DAMOS_HUGEPAGE:	Call madvise() for the region with MADV_HUGEPAGE.
+ * @DAMOS_NOHUGEPAGE:	Call madvise() for the region with MADV_NOHUGEPAGE.
+ * @DAMOS_STAT:		Do nothing but count the stat.
+ */
+enum damos_action {
+	DAMOS_WILLNEED,
+	DAMOS_COLD,
+	DAMOS_PAGEOUT,
+	DAMOS_HUGEPAGE,
+	DAMOS_NOHUGEPAGE,
+	DAMOS_STAT,
+	NR_DAMOS_ACTIONS,
+};
+
+/**
+ * struct damos - Represents a DAMON-based operation scheme.
+ * @min_sz_region:	Minimum size of target regions.
+ * @max_sz_region:	Maximum size of target regions.
+ * @min_nr_accesses:	Minimum ``->nr_accesses`` of target regions.
+ * @max_nr_accesses:	Maximum ``->nr_accesses`` of target regions.
+ * @min_age_region:	Minimum age of target regions.
+ * @max_age_region:	Maximum age of target regions.
+ * @action:		&damos_action to be applied to the target regions.
+ * @stat_count:		Total number of regions the action was applied to.
+ * @stat_sz:		Total size of regions the action was applied to.
+ * @list:		List head for siblings.
+ *
+ * At the end of each aggregation interval, @action is applied to every
+ * region whose size, access frequency and age are all within the ranges
+ * given by the scheme.
+ */
+struct damos {
+	unsigned long min_sz_region;
+	unsigned long max_sz_region;
+	unsigned int min_nr_accesses;
+	unsigned int max_nr_accesses;
+	unsigned int min_age_region;
+	unsigned int max_age_region;
+	enum damos_action action;
+	unsigned long stat_count;
+	unsigned long stat_sz;
+	struct list_head list;
+};
+
+/**
+ * struct damon_ctx - Represents a context for each monitoring.
+ * @sample_interval:		The time between access samplings, in us.
+ * @aggr_interval:		The time between monitor results aggregations.
+ * @primitive_update_interval:	The time between monitoring target region
+ *				updates from the address space layout.
+ * @min_nr_regions:		The minimum number of monitoring regions.
+ * @max_nr_regions:		The maximum number of monitoring regions.
+ * @last_aggregation:		Time of the last aggregation.
+ * @last_primitive_update:	Time of the last target region update.
+ * @last_nr_regions:		Number of regions at the last split.
+ * @kdamond:			Kernel thread doing the monitoring.
+ * @kdamond_lock:		Mutex protecting @kdamond.
+ * @targets_list:		Head of the monitoring targets list.
+ * @schemes_list:		Head of the schemes list.
+ *
+ * For each sampling interval, DAMON checks whether each region was accessed
+ * and counts the result in &damon_region->nr_accesses.  At the end of each
+ * aggregation interval, the results are reported through the
+ * damon_aggregated tracepoint, the schemes are applied and the counters are
+ * reset.  The target regions are split and merged so that their number
+ * stays within [@min_nr_regions, @max_nr_regions].
+ *
+ * The targets, schemes and attributes may be changed only while @kdamond
+ * is not running.
+ */
+struct damon_ctx {
+	unsigned long sample_interval;
+	unsigned long aggr_interval;
+	unsigned long primitive_update_interval;
+	unsigned long min_nr_regions;
+	unsigned long max_nr_regions;
+
+	ktime_t last_aggregation;
+	ktime_t last_primitive_update;
+	unsigned int last_nr_regions;
+
+	struct task_struct *kdamond;
+	struct mutex kdamond_lock;
+
+	struct list_head targets_list;
+	struct list_head schemes_list;
+};
+
+#define damon_next_region(r) \
+	(container_of(r->list.next, struct damon_region, list))
+
+#define damon_prev_region(r) \
+	(container_of(r->list.prev, struct damon_region, list))
+
+#define damon_for_each_region(r, t) \
+	list_for_each_entry(r, &t->regions_list, list)
+
+#define damon_for_each_region_safe(r, next, t) \
+	list_for_each_entry_safe(r, next, &t->regions_list, list)
+
+#define damon_for_each_target(t, ctx) \
+	list_for_each_entry(t, &(ctx)->targets_list, list)
+
+#define damon_for_each_target_safe(t, next, ctx)	\
+	list_for_each_entry_safe(t, next, &(ctx)->targets_list, list)
+
+#define damon_for_each_scheme(s, ctx) \
+	list_for_each_entry(s, &(ctx)->schemes_list, list)
+
+#define damon_for_each_scheme_safe(s, next, ctx) \
+	list_for_each_entry_safe(s, next, &(ctx)->schemes_list, list)
+
+#ifdef CONFIG_DAMON
+
+struct damon_region *damon_new_region(unsigned long start, unsigned long end);
+void damon_add_region(struct damon_region *r, struct damon_target *t);
+void damon_destroy_region(struct damon_region *r, struct damon_target *t);
+
+struct damon_target *damon_new_target(struct pid *pid);
+void damon_add_target(struct damon_ctx *ctx, struct damon_target *t);
+void damon_destroy_target(struct damon_target *t);
+
+struct damos *damon_new_scheme(unsigned long min_sz_region,
+		unsigned long max_sz_region, unsigned int min_nr_accesses,
+		unsigned int max_nr_accesses, unsigned int min_age_region,
+		unsigned int max_age_region, enum damos_action action);
+void damon_add_scheme(struct damon_ctx *ctx, struct damos *s);
+void damon_destroy_scheme(struct damos *s);
+
+struct damon_ctx *damon_new_ctx(void);
+void damon_destroy_ctx(struct damon_ctx *ctx);
+int damon_set_attrs(struct damon_ctx *ctx, unsigned long sample_int,
+		unsigned long aggr_int, unsigned long primitive_upd_int,
+		unsigned long min_nr_reg, unsigned long max_nr_reg);
+
+int damon_start(struct damon_ctx *ctx);
+int damon_stop(struct damon_ctx *ctx);
+
+#endif	/* CONFIG_DAMON */
+
+#endif	/* _LINUX_DAMON_H */
@@ -29,6 +29,27 @@ static inline int dax_pmd_fault(struct vm_area_struct *vma, unsigned long addr,
 #define __dax_pmd_fault dax_pmd_fault
 #endif
 int dax_pfn_mkwrite(struct vm_area_struct *, struct vm_fault *);
+#ifdef CONFIG_FS_DAX
+int dax_finish_sync_fault(struct vm_area_struct *, struct vm_fault *,
+			  int result);
+#else
+static inline int dax_finish_sync_fault(struct vm_area_struct *vma,
+					struct vm_fault *vmf, int result)
+{
+	return result & ~VM_FAULT_NEEDDSYNC;
+}
+#endif
+
+/*
+ * Flag a write fault on a MAP_SYNC mapping for dax_finish_sync_fault(),
+ * which the filesystem calls once it has dropped its fault locks.
+ */
+static inline int dax_sync_fault(struct vm_area_struct *vma, int result)
+{
+	if ((vma->vm_flags & VM_SYNC) && !(result & VM_FAULT_ERROR))
+		result |= VM_FAULT_NEEDDSYNC;
+	return result;
+}
 #define dax_mkwrite(vma, vmf, gb, iod)		dax_fault(vma, vmf, gb, iod)
 #define __dax_mkwrite(vma, vmf, gb, iod)	__dax_fault(vma, vmf, gb, iod)
 
@@ -348,6 +348,12 @@ struct sk_filter {
 	struct bpf_prog	*prog;
 };
 
+/* In-kernel view of a frame handed to an XDP program, see struct xdp_md */
+struct xdp_buff {
+	void *data;
+	unsigned int len;
+};
+
 #define BPF_PROG_RUN(filter, ctx)  (*filter->bpf_func)(ctx, filter->insnsi)
 
 static inline u32 bpf_prog_run_save_cb(const struct bpf_prog *prog,
@@ -383,6 +389,19 @@ static inline u32 bpf_prog_run_clear_cb(const struct bpf_prog *prog,
 	return BPF_PROG_RUN(prog, skb);
 }
 
+/* Drivers run this from their RX path with rcu_read_lock() held around both
+ * the load of the program pointer and the call, old programs are released
+ * with bpf_prog_put_rcu().
+ */
+static inline u32 bpf_prog_run_xdp(const struct bpf_prog *prog,
+				   struct xdp_buff *xdp)
+{
+	return BPF_PROG_RUN(prog, (void *)xdp);
+}
+
+void bpf_warn_invalid_xdp_action(u32 act);
+struct sock *do_sk_redirect_map(void);
+
 static inline unsigned int bpf_prog_size(unsigned int proglen)
 {
 	return max(sizeof(struct bpf_prog),
@@ -449,6 +468,8 @@ int sk_attach_filter(struct sock_fprog *fprog, struct sock *sk);
 int __sk_attach_filter(struct sock_fprog *fprog, struct sock *sk,
 		       bool locked);
 int sk_attach_bpf(u32 ufd, struct sock *sk);
+int sk_reuseport_attach_filter(struct sock_fprog *fprog, struct sock *sk);
+int sk_reuseport_attach_bpf(u32 ufd, struct sock *sk);
 int sk_detach_filter(struct sock *sk);
 int __sk_detach_filter(struct sock *sk, bool locked);
 
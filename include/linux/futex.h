@@ -55,6 +55,8 @@ union futex_key {
 #ifdef CONFIG_FUTEX
 extern void exit_robust_list(struct task_struct *curr);
 extern void exit_pi_state_list(struct task_struct *curr);
+extern int futex_hash_allocate(struct mm_struct *mm);
+extern void futex_hash_free(struct mm_struct *mm);
 #ifdef CONFIG_HAVE_FUTEX_CMPXCHG
 #define futex_cmpxchg_enabled 1
 #else
@@ -67,5 +69,12 @@ static inline void exit_robust_list(struct task_struct *curr)
 static inline void exit_pi_state_list(struct task_struct *curr)
 {
 }
+static inline int futex_hash_allocate(struct mm_struct *mm)
+{
+	return 0;
+}
+static inline void futex_hash_free(struct mm_struct *mm)
+{
+}
 #endif
 #endif
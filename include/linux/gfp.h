@@ -415,6 +415,28 @@ __alloc_pages(gfp_t gfp_mask, unsigned int order,
 	return __alloc_pages_nodemask(gfp_mask, order, zonelist, NULL);
 }
 
+unsigned long __alloc_pages_bulk(gfp_t gfp_mask, struct zonelist *zonelist,
+			nodemask_t *nodemask, unsigned long nr_pages,
+			struct list_head *page_list, struct page **page_array);
+
+/* Bulk allocate order-0 pages onto a list */
+static inline unsigned long
+alloc_pages_bulk_list(gfp_t gfp_mask, unsigned long nr_pages,
+		      struct list_head *list)
+{
+	return __alloc_pages_bulk(gfp_mask, node_zonelist(numa_mem_id(), gfp_mask),
+				  NULL, nr_pages, list, NULL);
+}
+
+/* Bulk allocate order-0 pages into the NULL slots of an array */
+static inline unsigned long
+alloc_pages_bulk_array(gfp_t gfp_mask, unsigned long nr_pages,
+		       struct page **page_array)
+{
+	return __alloc_pages_bulk(gfp_mask, node_zonelist(numa_mem_id(), gfp_mask),
+				  NULL, nr_pages, NULL, page_array);
+}
+
 /*
  * Allocate pages, preferring the node given as nid. The node must be valid and
  * online. For more general interface, see alloc_pages_node().
@@ -490,6 +512,7 @@ extern void __free_pages(struct page *page, unsigned int order);
 extern void free_pages(unsigned long addr, unsigned int order);
 extern void free_hot_cold_page(struct page *page, bool cold);
 extern void free_hot_cold_page_list(struct list_head *list, bool cold);
+extern void free_pages_bulk(struct page **page_array, unsigned long nr_pages);
 
 struct page_frag_cache;
 extern void *__alloc_page_frag(struct page_frag_cache *nc,
@@ -35,6 +35,13 @@ extern int change_huge_pmd(struct vm_area_struct *vma, pmd_t *pmd,
 			int prot_numa);
 int vmf_insert_pfn_pmd(struct vm_area_struct *, unsigned long addr, pmd_t *,
 			unsigned long pfn, bool write);
+#ifdef CONFIG_TRANSPARENT_HUGE_PAGECACHE
+extern int do_set_pmd(struct vm_area_struct *vma, unsigned long haddr,
+		      pmd_t *pmd, struct page *page, bool write);
+extern int huge_pmd_wp_shared(struct vm_area_struct *vma,
+			      unsigned long address, pmd_t *pmd);
+extern struct kobj_attribute shmem_enabled_attr;
+#endif
 
 enum transparent_hugepage_flag {
 	TRANSPARENT_HUGEPAGE_FLAG,
@@ -17,6 +17,21 @@
 
 #include <uapi/linux/if_tun.h>
 
+#define TUN_MSG_UBUF 1
+#define TUN_MSG_PTR  2
+
+/*
+ * In-kernel users of the tun/macvtap sockets pass this as msg_control:
+ * TUN_MSG_UBUF carries the ubuf_info of a zerocopy packet in @ptr, and
+ * TUN_MSG_PTR an array of @num struct iov_iter, one per packet, which tun
+ * sends as one batch.
+ */
+struct tun_msg_ctl {
+	unsigned short type;
+	unsigned short num;
+	void *ptr;
+};
+
 #if defined(CONFIG_TUN) || defined(CONFIG_TUN_MODULE)
 struct socket *tun_get_socket(struct file *);
 #else
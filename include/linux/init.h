@@ -218,6 +218,22 @@ extern bool initcall_debug;
 
 #define __initcall(fn) device_initcall(fn)
 
+/*
+ * Parallel initcalls are started from async workers at the beginning of
+ * their level and may run concurrently with each other and with every
+ * plain initcall of the level.  Only use them for code that neither
+ * depends on nor is depended on by anything else in the same level, e.g.
+ * drivers probing their own hardware.  All of them have returned before
+ * the _sync initcalls of the level run.
+ */
+#define core_initcall_parallel(fn)	__define_initcall(fn, 1p)
+#define postcore_initcall_parallel(fn)	__define_initcall(fn, 2p)
+#define arch_initcall_parallel(fn)	__define_initcall(fn, 3p)
+#define subsys_initcall_parallel(fn)	__define_initcall(fn, 4p)
+#define fs_initcall_parallel(fn)	__define_initcall(fn, 5p)
+#define device_initcall_parallel(fn)	__define_initcall(fn, 6p)
+#define late_initcall_parallel(fn)	__define_initcall(fn, 7p)
+
 #define __exitcall(fn) \
 	static exitcall_t __exitcall_##fn __exit_call = fn
 
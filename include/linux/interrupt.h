@@ -221,6 +221,26 @@ struct irq_affinity_notify {
 	void (*release)(struct kref *ref);
 };
 
+#define IRQ_AFFINITY_MAX_SETS	4
+
+/**
+ * struct irq_affinity - Description for automatic irq affinity assignements
+ * @pre_vectors:	Don't apply affinity to @pre_vectors at beginning of
+ *			the MSI(-X) vector space
+ * @post_vectors:	Don't apply affinity to @post_vectors at end of
+ *			the MSI(-X) vector space
+ * @nr_sets:		Number of sets the vectors in between are split into,
+ *			each is spread over all cpus on its own.  Zero means
+ *			a single set of all of them
+ * @set_size:		Number of vectors in each set
+ */
+struct irq_affinity {
+	int	pre_vectors;
+	int	post_vectors;
+	int	nr_sets;
+	int	set_size[IRQ_AFFINITY_MAX_SETS];
+};
+
 #if defined(CONFIG_SMP)
 
 extern cpumask_var_t irq_default_affinity;
@@ -260,6 +280,7 @@ irq_force_affinity(unsigned int irq, const struct cpumask *cpumask)
 }
 
 extern int irq_can_set_affinity(unsigned int irq);
+extern bool irq_can_set_affinity_usr(unsigned int irq);
 extern int irq_select_affinity(unsigned int irq);
 
 extern int irq_set_affinity_hint(unsigned int irq, const struct cpumask *m);
@@ -267,6 +288,10 @@ extern int irq_set_affinity_hint(unsigned int irq, const struct cpumask *m);
 extern int
 irq_set_affinity_notifier(unsigned int irq, struct irq_affinity_notify *notify);
 
+struct cpumask *irq_create_affinity_masks(int nvec,
+					  const struct irq_affinity *affd);
+int irq_calc_affinity_vectors(int maxvec, const struct irq_affinity *affd);
+
 #else /* CONFIG_SMP */
 
 static inline int irq_set_affinity(unsigned int irq, const struct cpumask *m)
@@ -284,6 +309,11 @@ static inline int irq_can_set_affinity(unsigned int irq)
 	return 0;
 }
 
+static inline bool irq_can_set_affinity_usr(unsigned int irq)
+{
+	return false;
+}
+
 static inline int irq_select_affinity(unsigned int irq)  { return 0; }
 
 static inline int irq_set_affinity_hint(unsigned int irq,
@@ -297,6 +327,18 @@ irq_set_affinity_notifier(unsigned int irq, struct irq_affinity_notify *notify)
 {
 	return 0;
 }
+
+static inline struct cpumask *
+irq_create_affinity_masks(int nvec, const struct irq_affinity *affd)
+{
+	return NULL;
+}
+
+static inline int
+irq_calc_affinity_vectors(int maxvec, const struct irq_affinity *affd)
+{
+	return maxvec;
+}
 #endif /* CONFIG_SMP */
 
 /*
@@ -70,6 +70,7 @@ extern void *jbd2_alloc(size_t size, gfp_t flags);
 extern void jbd2_free(void *ptr, size_t size);
 
 #define JBD2_MIN_JOURNAL_BLOCKS 1024
+#define JBD2_DEFAULT_FAST_COMMIT_BLOCKS 256
 
 #ifdef __KERNEL__
 
@@ -270,7 +271,8 @@ typedef struct journal_superblock_s
 /* 0x0050 */
 	__u8	s_checksum_type;	/* checksum type */
 	__u8	s_padding2[3];
-	__u32	s_padding[42];
+	__be32	s_num_fc_blks;		/* Number of fast commit blocks */
+	__u32	s_padding[41];
 	__be32	s_checksum;		/* crc32c(superblock) */
 
 /* 0x0100 */
@@ -278,6 +280,13 @@ typedef struct journal_superblock_s
 /* 0x0400 */
 } journal_superblock_t;
 
+static inline int jbd2_journal_get_num_fc_blks(journal_superblock_t *jsb)
+{
+	int num_fc_blocks = be32_to_cpu(jsb->s_num_fc_blks);
+
+	return num_fc_blocks ? num_fc_blocks : JBD2_DEFAULT_FAST_COMMIT_BLOCKS;
+}
+
 /* Use the jbd2_{has,set,clear}_feature_* helpers; these will be removed */
 #define JBD2_HAS_COMPAT_FEATURE(j,mask)					\
 	((j)->j_format_version >= 2 &&					\
@@ -296,6 +305,7 @@ typedef struct journal_superblock_s
 #define JBD2_FEATURE_INCOMPAT_ASYNC_COMMIT	0x00000004
 #define JBD2_FEATURE_INCOMPAT_CSUM_V2		0x00000008
 #define JBD2_FEATURE_INCOMPAT_CSUM_V3		0x00000010
+#define JBD2_FEATURE_INCOMPAT_FAST_COMMIT	0x00000020
 
 /* See "journal feature predicate functions" below */
 
@@ -306,7 +316,8 @@ typedef struct journal_superblock_s
 					JBD2_FEATURE_INCOMPAT_64BIT | \
 					JBD2_FEATURE_INCOMPAT_ASYNC_COMMIT | \
 					JBD2_FEATURE_INCOMPAT_CSUM_V2 | \
-					JBD2_FEATURE_INCOMPAT_CSUM_V3)
+					JBD2_FEATURE_INCOMPAT_CSUM_V3 | \
+					JBD2_FEATURE_INCOMPAT_FAST_COMMIT)
 
 #ifdef __KERNEL__
 
@@ -645,12 +656,6 @@ struct transaction_s
 	 */
 	struct transaction_chp_stats_s t_chp_stats;
 
-	/*
-	 * Number of outstanding updates running on this transaction
-	 * [t_handle_lock]
-	 */
-	atomic_t		t_updates;
-
 	/*
 	 * Number of buffers reserved for use by all handles in this transaction
 	 * handle but not yet modified. [t_handle_lock]
@@ -675,9 +680,10 @@ struct transaction_s
 	ktime_t			t_start_time;
 
 	/*
-	 * How many handles used this transaction? [t_handle_lock]
+	 * How many handles used this transaction? Filled in once the
+	 * transaction is locked down for commit. [j_state_lock]
 	 */
-	atomic_t		t_handle_count;
+	unsigned int		t_handle_count;
 
 	/*
 	 * This transaction is being forced and some process is
@@ -725,6 +731,22 @@ jbd2_time_diff(unsigned long start, unsigned long end)
 
 #define JBD2_NR_BATCH	64
 
+/* Recovery passes, also seen by the fast commit replay callback */
+enum passtype {PASS_SCAN, PASS_REVOKE, PASS_REPLAY};
+
+#define JBD2_FC_REPLAY_STOP	0
+#define JBD2_FC_REPLAY_CONTINUE	1
+
+/*
+ * Per-CPU handle accounting. A handle bumps nr_started on the CPU it is
+ * started on and nr_stopped on the CPU it is stopped on, the difference
+ * of the sums is the number of updates running on the journal.
+ */
+struct jbd2_update_count {
+	unsigned long		nr_started;
+	unsigned long		nr_stopped;
+};
+
 /**
  * struct journal_s - The journal_s type is the concrete type associated with
  *     journal_t.
@@ -746,6 +768,8 @@ jbd2_time_diff(unsigned long start, unsigned long end)
  * @j_wait_done_commit: Wait queue for waiting for commit to complete
  * @j_wait_commit: Wait queue to trigger commit
  * @j_wait_updates: Wait queue to wait for updates to complete
+ * @j_updates: Per-CPU counts of started and stopped handles
+ * @j_handles_started: Handles started up to the last locked transaction
  * @j_wait_reserved: Wait queue to wait for reserved buffer credits to drop
  * @j_checkpoint_mutex: Mutex for locking against concurrent checkpoints
  * @j_head: Journal head - identifies the first unused block in the journal
@@ -859,6 +883,16 @@ struct journal_s
 	/* Wait queue to wait for updates to complete */
 	wait_queue_head_t	j_wait_updates;
 
+	/*
+	 * Handles attached to the running transaction, counted per CPU so
+	 * starting and stopping a handle doesn't bounce a shared cache
+	 * line. Only ever summed by jbd2_journal_running_updates().
+	 */
+	struct jbd2_update_count __percpu *j_updates;
+
+	/* Sum of started handles when the last transaction was locked */
+	unsigned long		j_handles_started;
+
 	/* Wait queue to wait for reserved buffer credits to drop */
 	wait_queue_head_t	j_wait_reserved;
 
@@ -1014,6 +1048,38 @@ struct journal_s
 	void			(*j_commit_callback)(journal_t *,
 						     transaction_t *);
 
+	/*
+	 * Fast commit area: the blocks from j_fc_first up to one beyond
+	 * j_fc_last are kept out of the regular log. j_fc_off is the next
+	 * block to be written in it and j_fc_wbuf holds the buffers of the
+	 * fast commit in progress. [JBD2_FAST_COMMIT_ONGOING]
+	 */
+	unsigned long		j_fc_first;
+	unsigned long		j_fc_last;
+	unsigned long		j_fc_off;
+	struct buffer_head	**j_fc_wbuf;
+	int			j_fc_wbufsize;
+
+	/* Wait queue for fast and full commits to finish */
+	wait_queue_head_t	j_fc_wait;
+
+	/*
+	 * Called after a full commit of the given tid, which supersedes all
+	 * the fast commits made for it.
+	 */
+	void			(*j_fc_cleanup_callback)(journal_t *, tid_t);
+
+	/*
+	 * Called during recovery for every block of the fast commit area,
+	 * first with PASS_SCAN and then with PASS_REPLAY. Returns
+	 * JBD2_FC_REPLAY_CONTINUE to get the next block,
+	 * JBD2_FC_REPLAY_STOP when done or a negative error.
+	 */
+	int			(*j_fc_replay_callback)(journal_t *,
+							struct buffer_head *,
+							enum passtype, int,
+							tid_t);
+
 	/*
 	 * Journal statistics
 	 */
@@ -1099,6 +1165,7 @@ JBD2_FEATURE_INCOMPAT_FUNCS(64bit,		64BIT)
 JBD2_FEATURE_INCOMPAT_FUNCS(async_commit,	ASYNC_COMMIT)
 JBD2_FEATURE_INCOMPAT_FUNCS(csum2,		CSUM_V2)
 JBD2_FEATURE_INCOMPAT_FUNCS(csum3,		CSUM_V3)
+JBD2_FEATURE_INCOMPAT_FUNCS(fast_commit,	FAST_COMMIT)
 
 /*
  * Journal flag definitions
@@ -1113,6 +1180,8 @@ JBD2_FEATURE_INCOMPAT_FUNCS(csum3,		CSUM_V3)
 						 * data write error in ordered
 						 * mode */
 #define JBD2_REC_ERR	0x080	/* The errno in the sb has been recorded */
+#define JBD2_FAST_COMMIT_ONGOING	0x100	/* Fast commit is in progress */
+#define JBD2_FULL_COMMIT_ONGOING	0x200	/* Full commit is in progress */
 
 /*
  * Function declarations for the journaling transaction and buffer
@@ -1244,6 +1313,8 @@ extern int	 jbd2_journal_stop(handle_t *);
 extern int	 jbd2_journal_flush (journal_t *);
 extern void	 jbd2_journal_lock_updates (journal_t *);
 extern void	 jbd2_journal_unlock_updates (journal_t *);
+extern unsigned long jbd2_journal_running_updates(journal_t *,
+						  unsigned long *);
 
 extern journal_t * jbd2_journal_init_dev(struct block_device *bdev,
 				struct block_device *fs_dev,
@@ -1272,6 +1343,10 @@ extern int	   jbd2_journal_errno      (journal_t *);
 extern void	   jbd2_journal_ack_err    (journal_t *);
 extern int	   jbd2_journal_clear_err  (journal_t *);
 extern int	   jbd2_journal_bmap(journal_t *, unsigned long, unsigned long long *);
+extern int	   jbd2_fc_begin_commit(journal_t *journal, tid_t tid);
+extern void	   jbd2_fc_end_commit(journal_t *journal);
+extern int	   jbd2_fc_get_buf(journal_t *journal, struct buffer_head **bh_out);
+extern int	   jbd2_fc_wait_bufs(journal_t *journal, int num_blks);
 extern int	   jbd2_journal_force_commit(journal_t *);
 extern int	   jbd2_journal_force_commit_nested(journal_t *);
 extern int	   jbd2_journal_file_inode(handle_t *handle, struct jbd2_inode *inode);
@@ -1435,16 +1510,18 @@ static inline int jbd2_space_needed(journal_t *journal)
 }
 
 /*
- * Return number of free blocks in the log. Must be called under j_state_lock.
+ * Return number of free blocks in the log. Must be called under j_state_lock,
+ * or under rcu_read_lock() for an estimate (transactions are freed by RCU).
  */
 static inline unsigned long jbd2_log_space_left(journal_t *journal)
 {
 	/* Allow for rounding errors */
 	unsigned long free = journal->j_free - 32;
+	transaction_t *commit = READ_ONCE(journal->j_committing_transaction);
 
-	if (journal->j_committing_transaction) {
-		unsigned long committing = atomic_read(&journal->
-			j_committing_transaction->t_outstanding_credits);
+	if (commit) {
+		unsigned long committing =
+			atomic_read(&commit->t_outstanding_credits);
 
 		/* Transaction + control blocks */
 		free -= committing + (committing >> JBD2_CONTROL_BLOCKS_SHIFT);
@@ -318,6 +318,37 @@ int crash_shrink_memory(unsigned long new_size);
 size_t crash_get_memory_size(void);
 void crash_free_reserved_phys_range(unsigned long begin, unsigned long end);
 
+#define KEXEC_PRESERVE_NAME_LEN	32
+
+#ifdef CONFIG_KEXEC_PRESERVE_MEM
+int kexec_preserve_mem(const char *name, phys_addr_t start, phys_addr_t size);
+int kexec_unpreserve_mem(const char *name);
+int kexec_claim_preserved_mem(const char *name, phys_addr_t *start,
+			      phys_addr_t *size);
+int kexec_release_preserved_mem(const char *name);
+bool kexec_preserved_overlap(phys_addr_t start, phys_addr_t end,
+			     phys_addr_t *pstart, phys_addr_t *pend);
+phys_addr_t kexec_handover_paddr(void);
+unsigned int kexec_preserved_nr_ranges(void);
+int kexec_preserved_mem_walk(void *arg,
+			     int (*func)(u64 start, u64 size, void *arg));
+ssize_t kexec_preserved_mem_print(char *buf, size_t size);
+#else
+static inline bool kexec_preserved_overlap(phys_addr_t start, phys_addr_t end,
+					   phys_addr_t *pstart,
+					   phys_addr_t *pend)
+{
+	return false;
+}
+static inline phys_addr_t kexec_handover_paddr(void) { return 0; }
+static inline unsigned int kexec_preserved_nr_ranges(void) { return 0; }
+static inline int kexec_preserved_mem_walk(void *arg,
+		int (*func)(u64 start, u64 size, void *arg))
+{
+	return 0;
+}
+#endif
+
 int __weak arch_kexec_kernel_image_probe(struct kimage *image, void *buf,
 					 unsigned long buf_len);
 void * __weak arch_kexec_kernel_image_load(struct kimage *image);
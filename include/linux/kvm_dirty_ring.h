@@ -0,0 +1,82 @@
+#ifndef KVM_DIRTY_RING_H
+#define KVM_DIRTY_RING_H
+
+#include <linux/kvm.h>
+#include <linux/kvm_types.h>
+
+/**
+ * struct kvm_dirty_ring - per-vcpu ring of dirtied guest pages
+ * @dirty_index: free running producer index, only moved by the vcpu
+ * @reset_index: free running index of the next entry to be reset, only
+ *		 moved by KVM_RESET_DIRTY_RINGS
+ * @size: number of entries, a power of two
+ * @soft_limit: fill level at which the vcpu exits to userspace
+ * @dirty_gfns: the entries, shared with userspace
+ * @index: vcpu index, for tracing and debugging
+ */
+struct kvm_dirty_ring {
+	u32 dirty_index;
+	u32 reset_index;
+	u32 size;
+	u32 soft_limit;
+	struct kvm_dirty_gfn *dirty_gfns;
+	int index;
+};
+
+#ifndef KVM_DIRTY_RING_RSVD_ENTRIES
+#define KVM_DIRTY_RING_RSVD_ENTRIES 64
+#endif
+
+#define KVM_DIRTY_RING_MAX_ENTRIES 65536
+
+#ifdef KVM_DIRTY_LOG_PAGE_OFFSET
+
+int kvm_dirty_ring_alloc(struct kvm_dirty_ring *ring, int index, u32 size);
+void kvm_dirty_ring_free(struct kvm_dirty_ring *ring);
+bool kvm_dirty_ring_push(struct kvm_dirty_ring *ring, u32 slot, u64 offset);
+int kvm_dirty_ring_reset(struct kvm *kvm, struct kvm_dirty_ring *ring);
+bool kvm_dirty_ring_soft_full(struct kvm_dirty_ring *ring);
+struct page *kvm_dirty_ring_get_page(struct kvm_dirty_ring *ring, u32 offset);
+bool kvm_dirty_ring_check_request(struct kvm_vcpu *vcpu);
+
+#else
+
+static inline int kvm_dirty_ring_alloc(struct kvm_dirty_ring *ring,
+				       int index, u32 size)
+{
+	return 0;
+}
+
+static inline void kvm_dirty_ring_free(struct kvm_dirty_ring *ring) { }
+
+static inline bool kvm_dirty_ring_push(struct kvm_dirty_ring *ring,
+				       u32 slot, u64 offset)
+{
+	return false;
+}
+
+static inline int kvm_dirty_ring_reset(struct kvm *kvm,
+				       struct kvm_dirty_ring *ring)
+{
+	return 0;
+}
+
+static inline bool kvm_dirty_ring_soft_full(struct kvm_dirty_ring *ring)
+{
+	return false;
+}
+
+static inline struct page *kvm_dirty_ring_get_page(struct kvm_dirty_ring *ring,
+						   u32 offset)
+{
+	return NULL;
+}
+
+static inline bool kvm_dirty_ring_check_request(struct kvm_vcpu *vcpu)
+{
+	return false;
+}
+
+#endif /* KVM_DIRTY_LOG_PAGE_OFFSET */
+
+#endif /* KVM_DIRTY_RING_H */
@@ -585,7 +585,8 @@ struct mlx5_err_cqe {
 };
 
 struct mlx5_cqe64 {
-	u8		rsvd0[4];
+	u8		rsvd0[2];
+	__be16		wqe_id;
 	u8		lro_tcppsh_abort_dupack;
 	u8		lro_min_ttl;
 	__be16		lro_tcp_win;
@@ -626,6 +627,36 @@ static inline int cqe_has_vlan(struct mlx5_cqe64 *cqe)
 	return !!(cqe->l4_hdr_type_etc & 0x1);
 }
 
+/* Striding RQ: byte_cnt also carries the strides consumed by the packet,
+ * wqe_counter the index of its first stride and wqe_id its WQE.
+ */
+#define MPWRQ_CQE_BYTE_CNT_MASK			0xffff
+#define MPWRQ_CQE_CONSUMED_STRIDES_SHIFT	16
+#define MPWRQ_CQE_CONSUMED_STRIDES_MASK		(0x7fff << MPWRQ_CQE_CONSUMED_STRIDES_SHIFT)
+#define MPWRQ_CQE_FILLER_MASK			BIT(31)
+
+static inline u16 mpwrq_get_cqe_byte_cnt(struct mlx5_cqe64 *cqe)
+{
+	return be32_to_cpu(cqe->byte_cnt) & MPWRQ_CQE_BYTE_CNT_MASK;
+}
+
+static inline u16 mpwrq_get_cqe_consumed_strides(struct mlx5_cqe64 *cqe)
+{
+	return (be32_to_cpu(cqe->byte_cnt) & MPWRQ_CQE_CONSUMED_STRIDES_MASK) >>
+	       MPWRQ_CQE_CONSUMED_STRIDES_SHIFT;
+}
+
+/* Filler CQEs only pad out the tail of a WQE, there is no packet */
+static inline bool mpwrq_is_filler_cqe(struct mlx5_cqe64 *cqe)
+{
+	return be32_to_cpu(cqe->byte_cnt) & MPWRQ_CQE_FILLER_MASK;
+}
+
+static inline u16 mpwrq_get_cqe_stride_index(struct mlx5_cqe64 *cqe)
+{
+	return be16_to_cpu(cqe->wqe_counter);
+}
+
 enum {
 	CQE_L4_HDR_TYPE_NONE			= 0x0,
 	CQE_L4_HDR_TYPE_TCP_NO_ACK		= 0x1,
@@ -883,7 +883,13 @@ struct mlx5_ifc_wq_bits {
 	u8         reserved_6[0x3];
 	u8         log_wq_sz[0x5];
 
-	u8         reserved_7[0x4e0];
+	u8         reserved_7[0x15];
+	u8         log_wqe_num_of_strides[0x3];
+	u8         two_byte_shift_en[0x1];
+	u8         reserved_8[0x4];
+	u8         log_wqe_stride_size[0x3];
+
+	u8         reserved_9[0x4c0];
 
 	struct mlx5_ifc_cmd_pas_bits pas[0];
 };
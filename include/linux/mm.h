@@ -100,6 +100,7 @@ extern int overcommit_kbytes_handler(struct ctl_table *, int, void __user *,
  */
 
 extern struct kmem_cache *vm_area_cachep;
+extern void vm_area_free(struct vm_area_struct *vma);
 
 #ifndef CONFIG_MMU
 extern struct rb_root nommu_region_tree;
@@ -143,6 +144,7 @@ extern unsigned int kobjsize(const void *objp);
 #define VM_ACCOUNT	0x00100000	/* Is a VM accounted object */
 #define VM_NORESERVE	0x00200000	/* should the VM suppress accounting */
 #define VM_HUGETLB	0x00400000	/* Huge TLB Page VM */
+#define VM_SYNC		0x00800000	/* Synchronous page faults */
 #define VM_ARCH_1	0x01000000	/* Architecture-specific flag */
 #define VM_ARCH_2	0x02000000
 #define VM_DONTDUMP	0x04000000	/* Do not include in the core dump */
@@ -497,6 +499,26 @@ static inline void get_page(struct page *page)
 	atomic_inc(&page->_count);
 }
 
+/*
+ * A page pinned with pin_user_pages*(), typically for DMA that lasts as long
+ * as an RDMA memory registration or a VFIO mapping, holds
+ * GUP_PIN_COUNTING_BIAS references instead of one.  Compaction and migration
+ * use that to tell a pinned page apart from a briefly referenced one without
+ * a field of its own in struct page.
+ */
+#define GUP_PIN_COUNTING_BIAS (1U << 10)
+
+/*
+ * page_maybe_dma_pinned - is the page (or its compound page) pinned?
+ *
+ * May return a false positive for a page with more than
+ * GUP_PIN_COUNTING_BIAS ordinary references, never a false negative.
+ */
+static inline bool page_maybe_dma_pinned(struct page *page)
+{
+	return (unsigned int)page_count(page) >= GUP_PIN_COUNTING_BIAS;
+}
+
 static inline struct page *virt_to_head_page(const void *x)
 {
 	struct page *page = virt_to_page(x);
@@ -645,11 +667,12 @@ void do_set_pte(struct vm_area_struct *vma, unsigned long address,
  * sets it, so none of the operations on it need to be atomic.
  */
 
-/* Page flags: | [SECTION] | [NODE] | ZONE | [LAST_CPUPID] | ... | FLAGS | */
+/* Page flags: | [SECTION] | [NODE] | ZONE | [LAST_CPUPID] | [LRU_GEN] | ... | FLAGS | */
 #define SECTIONS_PGOFF		((sizeof(unsigned long)*8) - SECTIONS_WIDTH)
 #define NODES_PGOFF		(SECTIONS_PGOFF - NODES_WIDTH)
 #define ZONES_PGOFF		(NODES_PGOFF - ZONES_WIDTH)
 #define LAST_CPUPID_PGOFF	(ZONES_PGOFF - LAST_CPUPID_WIDTH)
+#define LRU_GEN_PGOFF		(LAST_CPUPID_PGOFF - LRU_GEN_WIDTH)
 
 /*
  * Define the bit shifts to access each section.  For non-existent
@@ -683,6 +706,7 @@ void do_set_pte(struct vm_area_struct *vma, unsigned long address,
 #define SECTIONS_MASK		((1UL << SECTIONS_WIDTH) - 1)
 #define LAST_CPUPID_MASK	((1UL << LAST_CPUPID_SHIFT) - 1)
 #define ZONEID_MASK		((1UL << ZONEID_SHIFT) - 1)
+#define LRU_GEN_MASK		(((1UL << LRU_GEN_WIDTH) - 1) << LRU_GEN_PGOFF)
 
 static inline enum zone_type page_zonenum(const struct page *page)
 {
@@ -1027,6 +1051,7 @@ static inline void clear_page_pfmemalloc(struct page *page)
 #define VM_FAULT_HWPOISON 0x0010	/* Hit poisoned small page */
 #define VM_FAULT_HWPOISON_LARGE 0x0020  /* Hit poisoned large page. Index encoded in upper bits */
 #define VM_FAULT_SIGSEGV 0x0040
+#define VM_FAULT_NEEDDSYNC 0x0080	/* MAP_SYNC fault must fsync() first */
 
 #define VM_FAULT_NOPAGE	0x0100	/* ->fault installed the pte, not return page */
 #define VM_FAULT_LOCKED	0x0200	/* ->fault locked the returned page */
@@ -1062,11 +1087,16 @@ extern bool skip_free_areas_node(unsigned int flags, int nid);
 int shmem_zero_setup(struct vm_area_struct *);
 #ifdef CONFIG_SHMEM
 bool shmem_mapping(struct address_space *mapping);
+bool vma_is_shmem(struct vm_area_struct *vma);
 #else
 static inline bool shmem_mapping(struct address_space *mapping)
 {
 	return false;
 }
+static inline bool vma_is_shmem(struct vm_area_struct *vma)
+{
+	return false;
+}
 #endif
 
 extern int can_do_mlock(void);
@@ -1210,6 +1240,16 @@ long get_user_pages_unlocked(struct task_struct *tsk, struct mm_struct *mm,
 		    int write, int force, struct page **pages);
 int get_user_pages_fast(unsigned long start, int nr_pages, int write,
 			struct page **pages);
+long pin_user_pages(struct task_struct *tsk, struct mm_struct *mm,
+		    unsigned long start, unsigned long nr_pages,
+		    int write, int force, struct page **pages,
+		    struct vm_area_struct **vmas);
+int pin_user_pages_fast(unsigned long start, int nr_pages, int write,
+			struct page **pages);
+void unpin_user_page(struct page *page);
+void unpin_user_pages(struct page **pages, unsigned long nr_pages);
+void unpin_user_pages_dirty_lock(struct page **pages, unsigned long nr_pages,
+				 bool make_dirty);
 
 /* Container for pinned pfns / pages */
 struct frame_vector {
@@ -1289,6 +1329,89 @@ static inline bool vma_is_anonymous(struct vm_area_struct *vma)
 	return !vma->vm_ops;
 }
 
+#ifdef CONFIG_PER_VMA_LOCK
+/*
+ * Page faults may run under the vma lock alone.  A writer holding mmap_sem
+ * for write calls vma_start_write() on every vma it is about to change, or
+ * to unlink, and vma_end_write_all() once done, before dropping mmap_sem.
+ * Faults finding the vma write locked fall back to taking mmap_sem.
+ */
+static inline void vma_init_lock(struct vm_area_struct *vma)
+{
+	init_rwsem(&vma->vm_lock);
+	vma->vm_lock_seq = -1;
+	vma->detached = false;
+}
+
+/*
+ * Try to read-lock a vma.  Fails if the vma is write locked, or if a
+ * writer is waiting for the lock.
+ */
+static inline bool vma_start_read(struct vm_area_struct *vma)
+{
+	/* Check before locking, a race only causes a false failure */
+	if (vma->vm_lock_seq == READ_ONCE(vma->vm_mm->mm_lock_seq))
+		return false;
+
+	if (unlikely(!down_read_trylock(&vma->vm_lock)))
+		return false;
+
+	/*
+	 * vm_lock_seq is only written with vm_lock held for write, so it
+	 * cannot change under us now.
+	 */
+	if (unlikely(vma->vm_lock_seq == READ_ONCE(vma->vm_mm->mm_lock_seq))) {
+		up_read(&vma->vm_lock);
+		return false;
+	}
+	return true;
+}
+
+static inline void vma_end_read(struct vm_area_struct *vma)
+{
+	up_read(&vma->vm_lock);
+}
+
+/* Wait for the faults running on @vma and keep new ones out */
+static inline void vma_start_write(struct vm_area_struct *vma)
+{
+	int mm_lock_seq = vma->vm_mm->mm_lock_seq;
+
+	if (vma->vm_lock_seq == mm_lock_seq)
+		return;
+
+	down_write(&vma->vm_lock);
+	vma->vm_lock_seq = mm_lock_seq;
+	up_write(&vma->vm_lock);
+}
+
+static inline void vma_mark_detached(struct vm_area_struct *vma)
+{
+	vma_start_write(vma);
+	vma->detached = true;
+}
+
+/* Unlock all the vmas locked by vma_start_write(), mmap_sem held for write */
+static inline void vma_end_write_all(struct mm_struct *mm)
+{
+	WRITE_ONCE(mm->mm_lock_seq, mm->mm_lock_seq + 1);
+}
+
+struct vm_area_struct *lock_vma_under_rcu(struct mm_struct *mm,
+					  unsigned long address);
+
+#else /* CONFIG_PER_VMA_LOCK */
+
+static inline void vma_init_lock(struct vm_area_struct *vma) {}
+static inline bool vma_start_read(struct vm_area_struct *vma)
+		{ return false; }
+static inline void vma_end_read(struct vm_area_struct *vma) {}
+static inline void vma_start_write(struct vm_area_struct *vma) {}
+static inline void vma_mark_detached(struct vm_area_struct *vma) {}
+static inline void vma_end_write_all(struct mm_struct *mm) {}
+
+#endif /* CONFIG_PER_VMA_LOCK */
+
 static inline int stack_guard_page_start(struct vm_area_struct *vma,
 					     unsigned long addr)
 {
@@ -1318,9 +1441,17 @@ extern unsigned long move_page_tables(struct vm_area_struct *vma,
 		unsigned long old_addr, struct vm_area_struct *new_vma,
 		unsigned long new_addr, unsigned long len,
 		bool need_rmap_locks);
+
+/* Flags for change_protection() */
+#define MM_CP_DIRTY_ACCT	(1UL << 0) /* map known dirty pages writable */
+#define MM_CP_PROT_NUMA		(1UL << 1) /* NUMA hinting update */
+#define MM_CP_UFFD_WP		(1UL << 2) /* userfaultfd write protect */
+#define MM_CP_UFFD_WP_RESOLVE	(1UL << 3) /* userfaultfd write unprotect */
+#define MM_CP_UFFD_WP_ALL	(MM_CP_UFFD_WP | MM_CP_UFFD_WP_RESOLVE)
+
 extern unsigned long change_protection(struct vm_area_struct *vma, unsigned long start,
 			      unsigned long end, pgprot_t newprot,
-			      int dirty_accountable, int prot_numa);
+			      unsigned long cp_flags);
 extern int mprotect_fixup(struct vm_area_struct *vma,
 			  struct vm_area_struct **pprev, unsigned long start,
 			  unsigned long end, unsigned long newflags);
@@ -1918,6 +2049,8 @@ extern unsigned long do_mmap(struct file *file, unsigned long addr,
 	unsigned long len, unsigned long prot, unsigned long flags,
 	vm_flags_t vm_flags, unsigned long pgoff, unsigned long *populate);
 extern int do_munmap(struct mm_struct *, unsigned long, size_t);
+extern int do_madvise(struct mm_struct *mm, unsigned long start,
+		      size_t len_in, int behavior);
 
 static inline unsigned long
 do_mmap_pgoff(struct file *file, unsigned long addr,
@@ -1998,6 +2131,9 @@ void task_dirty_inc(struct task_struct *tsk);
 
 int force_page_cache_readahead(struct address_space *mapping, struct file *filp,
 			pgoff_t offset, unsigned long nr_to_read);
+int force_page_cache_readahead_async(struct address_space *mapping,
+			struct file *filp, pgoff_t offset,
+			unsigned long nr_to_read);
 
 void page_cache_sync_readahead(struct address_space *mapping,
 			       struct file_ra_state *ra,
@@ -2028,6 +2164,10 @@ extern int expand_upwards(struct vm_area_struct *vma, unsigned long address);
 extern struct vm_area_struct * find_vma(struct mm_struct * mm, unsigned long addr);
 extern struct vm_area_struct * find_vma_prev(struct mm_struct * mm, unsigned long addr,
 					     struct vm_area_struct **pprev);
+#ifdef CONFIG_PER_VMA_LOCK
+extern struct vm_area_struct *find_vma_rcu(struct mm_struct *mm,
+					   unsigned long addr);
+#endif
 
 /* Look up the first VMA which intersects the interval start_addr..end_addr-1,
    NULL if none.  Assume start_addr < end_addr. */
@@ -2213,6 +2353,12 @@ void vmemmap_free(unsigned long start, unsigned long end);
 #endif
 void register_page_bootmem_memmap(unsigned long section_nr, struct page *map,
 				  unsigned long size);
+#ifdef CONFIG_HUGETLB_PAGE_FREE_VMEMMAP
+int vmemmap_remap_free(unsigned long start, unsigned long end,
+		       unsigned long reuse);
+int vmemmap_remap_alloc(unsigned long start, unsigned long end,
+			unsigned long reuse, gfp_t gfp_mask);
+#endif
 
 enum mf_flags {
 	MF_COUNT_INCREASED = 1 << 0,
@@ -3,6 +3,7 @@
 
 #include <linux/huge_mm.h>
 #include <linux/swap.h>
+#include <linux/static_key.h>
 
 /**
  * page_is_file_cache - should the page be on a file LRU or anon LRU?
@@ -22,24 +23,151 @@ static inline int page_is_file_cache(struct page *page)
 	return !PageSwapBacked(page);
 }
 
-static __always_inline void add_page_to_lru_list(struct page *page,
-				struct lruvec *lruvec, enum lru_list lru)
+#ifdef CONFIG_LRU_GEN
+
+extern struct static_key lru_gen_key;
+
+static inline bool lru_gen_enabled(void)
 {
-	int nr_pages = hpage_nr_pages(page);
-	mem_cgroup_update_lru_size(lruvec, lru, nr_pages);
-	list_add(&page->lru, &lruvec->lists[lru]);
-	__mod_zone_page_state(lruvec_zone(lruvec), NR_LRU_BASE + lru, nr_pages);
+#ifdef CONFIG_LRU_GEN_ENABLED
+	return static_key_true(&lru_gen_key);
+#else
+	return static_key_false(&lru_gen_key);
+#endif
 }
 
-static __always_inline void del_page_from_lru_list(struct page *page,
-				struct lruvec *lruvec, enum lru_list lru)
+static inline int lru_gen_from_seq(unsigned long seq)
+{
+	return seq % MAX_NR_GENS;
+}
+
+/*
+ * page_lru_gen - which generation is a page on?
+ * @page: the page to test
+ *
+ * Returns the generation of the multi-generational LRU list @page is on,
+ * or -1 if it is not on one of those.  Stable under zone->lru_lock.
+ */
+static inline int page_lru_gen(struct page *page)
+{
+	unsigned long flags = READ_ONCE(page->flags);
+
+	return ((flags & LRU_GEN_MASK) >> LRU_GEN_PGOFF) - 1;
+}
+
+/* The other bits in page->flags may be changed concurrently */
+static inline void set_page_lru_gen(struct page *page, int gen)
 {
+	unsigned long old_flags, flags;
+
+	do {
+		old_flags = READ_ONCE(page->flags);
+		flags = old_flags & ~LRU_GEN_MASK;
+		flags |= (unsigned long)(gen + 1) << LRU_GEN_PGOFF;
+	} while (unlikely(cmpxchg(&page->flags, old_flags, flags) != old_flags));
+}
+
+static inline void lru_gen_move_page(struct lruvec *lruvec, struct page *page,
+				     int old_gen, int new_gen)
+{
+	struct lru_gen_struct *lrugen = &lruvec->lrugen;
+	int type = page_is_file_cache(page);
 	int nr_pages = hpage_nr_pages(page);
-	mem_cgroup_update_lru_size(lruvec, lru, -nr_pages);
+
+	set_page_lru_gen(page, new_gen);
+	lrugen->nr_pages[old_gen][type] -= nr_pages;
+	lrugen->nr_pages[new_gen][type] += nr_pages;
+}
+
+/*
+ * Active pages, new anon pages and refaulting ones among them, start in
+ * the youngest generation.  Others start in the second oldest one if
+ * there is one that is not young, so that they are evicted soon but not
+ * before the pages which have aged without being used.
+ */
+static inline bool lru_gen_add_page(struct lruvec *lruvec, struct page *page)
+{
+	struct lru_gen_struct *lrugen = &lruvec->lrugen;
+	int type = page_is_file_cache(page);
+	unsigned long seq;
+	int gen;
+
+	if (!lru_gen_enabled() || PageUnevictable(page))
+		return false;
+
+	VM_BUG_ON_PAGE(page_lru_gen(page) != -1, page);
+
+	if (PageActive(page))
+		seq = lrugen->max_seq;
+	else if (lrugen->min_seq[type] + MIN_NR_GENS >= lrugen->max_seq)
+		seq = lrugen->min_seq[type];
+	else
+		seq = lrugen->min_seq[type] + 1;
+
+	gen = lru_gen_from_seq(seq);
+	ClearPageActive(page);
+	set_page_lru_gen(page, gen);
+	lrugen->nr_pages[gen][type] += hpage_nr_pages(page);
+	list_add(&page->lru, &lrugen->lists[gen][type]);
+	return true;
+}
+
+static inline bool lru_gen_del_page(struct lruvec *lruvec, struct page *page)
+{
+	int gen = page_lru_gen(page);
+
+	if (gen < 0)
+		return false;
+
+	set_page_lru_gen(page, -1);
+	lruvec->lrugen.nr_pages[gen][page_is_file_cache(page)] -=
+		hpage_nr_pages(page);
 	list_del(&page->lru);
-	__mod_zone_page_state(lruvec_zone(lruvec), NR_LRU_BASE + lru, -nr_pages);
+	return true;
+}
+
+/* Move a page to the tail of the oldest generation, to be evicted next */
+static inline bool lru_gen_rotate_page(struct lruvec *lruvec, struct page *page)
+{
+	struct lru_gen_struct *lrugen = &lruvec->lrugen;
+	int type = page_is_file_cache(page);
+	int old_gen = page_lru_gen(page);
+	int new_gen;
+
+	if (old_gen < 0)
+		return false;
+
+	new_gen = lru_gen_from_seq(lrugen->min_seq[type]);
+	if (new_gen != old_gen)
+		lru_gen_move_page(lruvec, page, old_gen, new_gen);
+	list_move_tail(&page->lru, &lrugen->lists[new_gen][type]);
+	return true;
+}
+
+#else /* CONFIG_LRU_GEN */
+
+static inline bool lru_gen_enabled(void)
+{
+	return false;
+}
+
+static inline bool lru_gen_add_page(struct lruvec *lruvec, struct page *page)
+{
+	return false;
+}
+
+static inline bool lru_gen_del_page(struct lruvec *lruvec, struct page *page)
+{
+	return false;
+}
+
+static inline bool lru_gen_rotate_page(struct lruvec *lruvec, struct page *page)
+{
+	return false;
 }
 
+#endif /* CONFIG_LRU_GEN */
+
 /**
  * page_lru_base_type - which LRU list type should a page be on?
  * @page: the page to test
@@ -55,6 +183,30 @@ static inline enum lru_list page_lru_base_type(struct page *page)
 	return LRU_INACTIVE_ANON;
 }
 
+static __always_inline void add_page_to_lru_list(struct page *page,
+				struct lruvec *lruvec, enum lru_list lru)
+{
+	int nr_pages = hpage_nr_pages(page);
+
+	/* pages on the generation lists are accounted as inactive */
+	if (lru_gen_add_page(lruvec, page))
+		lru = page_lru_base_type(page);
+	else
+		list_add(&page->lru, &lruvec->lists[lru]);
+	mem_cgroup_update_lru_size(lruvec, lru, nr_pages);
+	__mod_zone_page_state(lruvec_zone(lruvec), NR_LRU_BASE + lru, nr_pages);
+}
+
+static __always_inline void del_page_from_lru_list(struct page *page,
+				struct lruvec *lruvec, enum lru_list lru)
+{
+	int nr_pages = hpage_nr_pages(page);
+	mem_cgroup_update_lru_size(lruvec, lru, -nr_pages);
+	if (!lru_gen_del_page(lruvec, page))
+		list_del(&page->lru);
+	__mod_zone_page_state(lruvec_zone(lruvec), NR_LRU_BASE + lru, -nr_pages);
+}
+
 /**
  * page_off_lru - which LRU list was page on? clearing its lru flags.
  * @page: the page to test
@@ -22,6 +22,7 @@
 
 struct address_space;
 struct mem_cgroup;
+struct futex_private_hash;
 
 #define USE_SPLIT_PTE_PTLOCKS	(NR_CPUS >= CONFIG_SPLIT_PTLOCK_CPUS)
 #define USE_SPLIT_PMD_PTLOCKS	(USE_SPLIT_PTE_PTLOCKS && \
@@ -355,6 +356,18 @@ struct vm_area_struct {
 	struct mempolicy *vm_policy;	/* NUMA policy for the VMA */
 #endif
 	struct vm_userfaultfd_ctx vm_userfaultfd_ctx;
+#ifdef CONFIG_PER_VMA_LOCK
+	/*
+	 * Held for read by page faults running without mmap_sem.  A vma is
+	 * write locked, see vma_start_write(), while vm_lock_seq matches
+	 * vm_mm->mm_lock_seq.
+	 */
+	int vm_lock_seq;
+	struct rw_semaphore vm_lock;
+	/* Unlinked from the mm, waiting for vm_rcu to free it */
+	bool detached;
+	struct rcu_head vm_rcu;
+#endif
 };
 
 struct core_thread {
@@ -413,11 +426,23 @@ struct mm_struct {
 
 	spinlock_t page_table_lock;		/* Protects page tables and some counters */
 	struct rw_semaphore mmap_sem;
+#ifdef CONFIG_PER_VMA_LOCK
+	/*
+	 * Bumped, under mmap_sem held for write, once the vmas locked by the
+	 * current writer can be used again by page faults.
+	 */
+	int mm_lock_seq;
+#endif
 
 	struct list_head mmlist;		/* List of maybe swapped mm's.	These are globally strung
 						 * together off init_mm.mmlist, and are protected
 						 * by mmlist_lock
 						 */
+#ifdef CONFIG_LRU_GEN
+	struct list_head lru_gen_list;		/* Walked by the page aging, see
+						 * lru_gen_add_mm()
+						 */
+#endif
 
 
 	unsigned long hiwater_rss;	/* High-watermark of RSS usage */
@@ -511,6 +536,14 @@ struct mm_struct {
 #ifdef CONFIG_HUGETLB_PAGE
 	atomic_long_t hugetlb_usage;
 #endif
+#ifdef CONFIG_FUTEX
+	/* hash table for PRIVATE futexes, set up once the mm is shared */
+	struct futex_private_hash *futex_phash;
+#endif
+#ifdef CONFIG_MEMBARRIER
+	/* MEMBARRIER_STATE_* registrations, inherited on fork */
+	atomic_t membarrier_state;
+#endif
 };
 
 static inline void mm_init_cpumask(struct mm_struct *mm)
@@ -2,6 +2,15 @@
 #define _LINUX_MMZONE_H
 
 #ifndef __ASSEMBLY__
+
+/*
+ * Bounds on the number of generations the multi-generational LRU keeps per
+ * lruvec.  Also used by kernel/bounds.c to size the generation field in
+ * page->flags.
+ */
+#define MIN_NR_GENS		2U
+#define MAX_NR_GENS		4U
+
 #ifndef __GENERATING_BOUNDS_H
 
 #include <linux/spinlock.h>
@@ -156,6 +165,8 @@ enum zone_stat_item {
 	WORKINGSET_ACTIVATE,
 	WORKINGSET_NODERECLAIM,
 	NR_ANON_TRANSPARENT_HUGEPAGES,
+	NR_SHMEM_THPS,		/* huge pages in shmem page cache */
+	NR_SHMEM_PMDMAPPED,	/* of which mapped by PMD */
 	NR_FREE_CMA_PAGES,
 	NR_VM_ZONE_STAT_ITEMS };
 
@@ -213,9 +224,32 @@ struct zone_reclaim_stat {
 	unsigned long		recent_scanned[2];
 };
 
+#ifdef CONFIG_LRU_GEN
+/*
+ * With the multi-generational LRU enabled, the evictable pages of an lruvec
+ * are sorted into generations instead of the active and inactive lists.
+ * Generations are numbered by sequence: max_seq is the youngest one and
+ * min_seq[] the oldest one still holding pages of each type, anon in [0]
+ * and file in [1].  The aging walks page tables, moves the pages found
+ * accessed into max_seq and then opens a new generation; the eviction
+ * takes pages from min_seq[].  Pages on these lists are accounted to the
+ * inactive LRU of their type and record their generation in page->flags,
+ * see page_lru_gen().  Everything is protected by zone->lru_lock.
+ */
+struct lru_gen_struct {
+	unsigned long		max_seq;
+	unsigned long		min_seq[2];
+	struct list_head	lists[MAX_NR_GENS][2];
+	long			nr_pages[MAX_NR_GENS][2];
+};
+#endif
+
 struct lruvec {
 	struct list_head lists[NR_LRU_LISTS];
 	struct zone_reclaim_stat reclaim_stat;
+#ifdef CONFIG_LRU_GEN
+	struct lru_gen_struct lrugen;
+#endif
 #ifdef CONFIG_MEMCG
 	struct zone *zone;
 #endif
@@ -249,13 +283,19 @@ enum zone_watermarks {
 #define low_wmark_pages(z) (z->watermark[WMARK_LOW])
 #define high_wmark_pages(z) (z->watermark[WMARK_HIGH])
 
+/*
+ * Order-0 pages and the small high orders up to PAGE_ALLOC_COSTLY_ORDER
+ * are cached on the pcp-lists, one list per migrate type and order.
+ */
+#define NR_PCP_LISTS (MIGRATE_PCPTYPES * (PAGE_ALLOC_COSTLY_ORDER + 1))
+
 struct per_cpu_pages {
-	int count;		/* number of pages in the list */
+	int count;		/* number of base pages in the lists */
 	int high;		/* high watermark, emptying needed */
 	int batch;		/* chunk size for buddy add/remove */
 
-	/* Lists of pages, one per migrate type stored on the pcp-lists */
-	struct list_head lists[MIGRATE_PCPTYPES];
+	/* Lists of pages, one per migrate type and order */
+	struct list_head lists[NR_PCP_LISTS];
 };
 
 struct per_cpu_pageset {
@@ -671,6 +711,12 @@ typedef struct pglist_data {
 					   mem_hotplug_begin/end() */
 	int kswapd_max_order;
 	enum zone_type classzone_idx;
+#ifdef CONFIG_COMPACTION
+	int kcompactd_max_order;
+	enum zone_type kcompactd_classzone_idx;
+	wait_queue_head_t kcompactd_wait;
+	struct task_struct *kcompactd;
+#endif
 #ifdef CONFIG_NUMA_BALANCING
 	/* Lock serializing the migrate rate limiting window */
 	spinlock_t numabalancing_migrate_lock;
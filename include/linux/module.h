@@ -120,6 +120,14 @@ extern void cleanup_module(void);
 #define late_initcall(fn)		module_init(fn)
 #define late_initcall_sync(fn)		module_init(fn)
 
+#define core_initcall_parallel(fn)	module_init(fn)
+#define postcore_initcall_parallel(fn)	module_init(fn)
+#define arch_initcall_parallel(fn)	module_init(fn)
+#define subsys_initcall_parallel(fn)	module_init(fn)
+#define fs_initcall_parallel(fn)	module_init(fn)
+#define device_initcall_parallel(fn)	module_init(fn)
+#define late_initcall_parallel(fn)	module_init(fn)
+
 #define console_initcall(fn)		module_init(fn)
 #define security_initcall(fn)		module_init(fn)
 
@@ -365,6 +373,9 @@ struct module {
 	const unsigned long *gpl_future_crcs;
 	unsigned int num_gpl_future_syms;
 
+	/* All of the above, as entries of the exported symbol hash. */
+	struct ksym_hash_block *ksym_block;
+
 	/* Exception table */
 	unsigned int num_exentries;
 	struct exception_table_entry *extable;
@@ -226,6 +226,9 @@ struct xt_table_info {
 	unsigned int stacksize;
 	void ***jumpstack;
 
+	/* Rules compiled by the family, e.g. to BPF for ip_tables */
+	void *compiled;
+
 	unsigned char entries[0] __aligned(8);
 };
 
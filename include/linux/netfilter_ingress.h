@@ -17,11 +17,17 @@ static inline bool nf_hook_ingress_active(const struct sk_buff *skb)
 static inline int nf_hook_ingress(struct sk_buff *skb)
 {
 	struct nf_hook_state state;
+	int ret;
 
 	nf_hook_state_init(&state, &skb->dev->nf_hooks_ingress,
 			   NF_NETDEV_INGRESS, INT_MIN, NFPROTO_NETDEV,
 			   skb->dev, NULL, NULL, dev_net(skb->dev), NULL);
-	return nf_hook_slow(skb, &state);
+	ret = nf_hook_slow(skb, &state);
+	/* Stolen or queued: the packet is gone, stop processing it */
+	if (ret == 0)
+		return -1;
+
+	return ret;
 }
 
 static inline void nf_hook_ingress_init(struct net_device *dev)
@@ -67,6 +67,77 @@ extern unsigned int ipt_do_table(struct sk_buff *skb,
 				 const struct nf_hook_state *state,
 				 struct xt_table *table);
 
+/*
+ * Packet fields the rules compiled to BPF look at, filled in once per
+ * packet.  Ports are in host byte order, and only valid if @ports_ok.
+ */
+struct ipt_bpf_ctx {
+	__be32	saddr;
+	__be32	daddr;
+	char	indev[IFNAMSIZ] __aligned(4);
+	char	outdev[IFNAMSIZ] __aligned(4);
+	u32	mark;
+	u16	fragoff;
+	u8	protocol;
+	u8	ports_ok;
+	u16	sport;
+	u16	dport;
+};
+
+#ifdef CONFIG_IP_NF_IPTABLES_BPF
+void ipt_bpf_compile(struct xt_table_info *info);
+void ipt_bpf_free(struct xt_table_info *info);
+void __ipt_bpf_init_ctx(struct ipt_bpf_ctx *ctx, const struct sk_buff *skb,
+			const struct xt_action_param *par,
+			const char *indev, const char *outdev);
+unsigned int __ipt_bpf_skip(const struct xt_table_info *info,
+			    unsigned int offset,
+			    const struct ipt_bpf_ctx *ctx);
+
+static inline void ipt_bpf_init_ctx(const struct xt_table_info *info,
+				    struct ipt_bpf_ctx *ctx,
+				    const struct sk_buff *skb,
+				    const struct xt_action_param *par,
+				    const char *indev, const char *outdev)
+{
+	if (info->compiled)
+		__ipt_bpf_init_ctx(ctx, skb, par, indev, outdev);
+}
+
+/* Offset of the first rule from @offset on that may match the packet */
+static inline unsigned int ipt_bpf_skip(const struct xt_table_info *info,
+					unsigned int offset,
+					const struct ipt_bpf_ctx *ctx)
+{
+	if (info->compiled)
+		return __ipt_bpf_skip(info, offset, ctx);
+	return offset;
+}
+#else
+static inline void ipt_bpf_compile(struct xt_table_info *info)
+{
+}
+
+static inline void ipt_bpf_free(struct xt_table_info *info)
+{
+}
+
+static inline void ipt_bpf_init_ctx(const struct xt_table_info *info,
+				    struct ipt_bpf_ctx *ctx,
+				    const struct sk_buff *skb,
+				    const struct xt_action_param *par,
+				    const char *indev, const char *outdev)
+{
+}
+
+static inline unsigned int ipt_bpf_skip(const struct xt_table_info *info,
+					unsigned int offset,
+					const struct ipt_bpf_ctx *ctx)
+{
+	return offset;
+}
+#endif
+
 #ifdef CONFIG_COMPAT
 #include <net/compat.h>
 
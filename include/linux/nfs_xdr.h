@@ -380,6 +380,33 @@ struct nfs42_clone_res {
 	const struct nfs_server		*server;
 };
 
+struct nfs42_copy_args {
+	struct nfs4_sequence_args	seq_args;
+	struct nfs_fh			*src_fh;
+	struct nfs_fh			*dst_fh;
+	nfs4_stateid			src_stateid;
+	nfs4_stateid			dst_stateid;
+	__u64				src_pos;
+	__u64				dst_pos;
+	__u64				count;
+	const u32			*dst_bitmask;
+};
+
+struct nfs42_write_res {
+	__u64				count;
+	struct nfs_writeverf		verifier;
+};
+
+struct nfs42_copy_res {
+	struct nfs4_sequence_res	seq_res;
+	struct nfs42_write_res		write_res;
+	bool				consecutive;
+	bool				synchronous;
+	struct nfs_write_verifier	commit_verf;
+	struct nfs_fattr		*dst_fattr;
+	const struct nfs_server		*server;
+};
+
 struct stateowner_id {
 	__u64	create_time;
 	__u32	uniquifier;
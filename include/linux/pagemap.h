@@ -146,11 +146,19 @@ void release_pages(struct page **pages, int nr, bool cold);
  * Lookups racing against pagecache insertion isn't a big problem: either 1
  * will find the page or it will not. Likewise, the old find_get_page could run
  * either before the insertion or afterwards, depending on timing.
+ *
+ * A huge shmem page occupies HPAGE_PMD_NR slots, one per subpage.  Tail pages
+ * keep their _count at zero, so a tail is pinned through its head instead:
+ * __get_page_tail() does that under compound_lock, and fails if the huge page
+ * was split or freed meanwhile, in which case the lookup is simply retried.
  */
 static inline int page_cache_get_speculative(struct page *page)
 {
 	VM_BUG_ON(in_interrupt());
 
+	if (unlikely(PageTail(page)))
+		return __get_page_tail(page);
+
 #ifdef CONFIG_TINY_RCU
 # ifdef CONFIG_PREEMPT_COUNT
 	VM_BUG_ON(!in_atomic());
@@ -1,8 +1,13 @@
 #ifndef _LINUX_PIPE_FS_I_H
 #define _LINUX_PIPE_FS_I_H
 
+#include <linux/timer.h>
+
 #define PIPE_DEF_BUFFERS	16
 
+/* Largest buffer a pipe may use for big writes, as a page order */
+#define PIPE_MAX_BUF_ORDER	4
+
 #define PIPE_BUF_FLAG_LRU	0x01	/* page is on the LRU */
 #define PIPE_BUF_FLAG_ATOMIC	0x02	/* was atomically mapped */
 #define PIPE_BUF_FLAG_GIFT	0x04	/* page is a gift */
@@ -42,6 +47,10 @@ struct pipe_buffer {
  *	@fasync_readers: reader side fasync
  *	@fasync_writers: writer side fasync
  *	@bufs: the circular array of pipe buffers
+ *	@buf_order: page order of the buffers used for large writes
+ *	@wake_bytes: bytes to queue before readers are woken up, 0 for always
+ *	@wake_pending: bytes queued since the wakeup timer was armed
+ *	@wake_timer: wakes up readers when @wake_bytes is not reached in time
  **/
 struct pipe_inode_info {
 	struct mutex mutex;
@@ -57,6 +66,10 @@ struct pipe_inode_info {
 	struct fasync_struct *fasync_readers;
 	struct fasync_struct *fasync_writers;
 	struct pipe_buffer *bufs;
+	unsigned int buf_order;
+	unsigned int wake_bytes;
+	unsigned int wake_pending;
+	struct timer_list wake_timer;
 };
 
 /*
@@ -123,6 +136,7 @@ void pipe_unlock(struct pipe_inode_info *);
 void pipe_double_lock(struct pipe_inode_info *, struct pipe_inode_info *);
 
 extern unsigned int pipe_max_size, pipe_min_size;
+extern int pipe_wake_delay;
 int pipe_proc_fn(struct ctl_table *, int, void __user *, size_t *, loff_t *);
 
 
@@ -140,7 +154,7 @@ void generic_pipe_buf_release(struct pipe_inode_info *, struct pipe_buffer *);
 
 extern const struct pipe_buf_operations nosteal_pipe_buf_ops;
 
-/* for F_SETPIPE_SZ and F_GETPIPE_SZ */
+/* for F_SETPIPE_SZ, F_GETPIPE_SZ and the other pipe fcntls */
 long pipe_fcntl(struct file *, unsigned int, unsigned long arg);
 struct pipe_inode_info *get_pipe_info(struct file *file);
 
@@ -19,6 +19,13 @@
 #include <linux/uidgid.h>
 
 struct kstat {
+	u32		result_mask;	/* STATX_* fields filled in */
+	/*
+	 * What the caller of vfs_statx() asked for, so that ->getattr() of a
+	 * network filesystem can leave out a round trip to the server.
+	 */
+	u32		request_mask;	/* STATX_* fields wanted */
+	unsigned int	query_flags;	/* AT_STATX_SYNC_* */
 	u64		ino;
 	dev_t		dev;
 	umode_t		mode;
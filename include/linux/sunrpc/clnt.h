@@ -28,6 +28,17 @@
 
 struct rpc_inode;
 
+/*
+ * Extra transports to the same server that a client spreads its requests
+ * over, in addition to cl_xprt.  Shared by a client and its clones.
+ */
+struct rpc_xprt_set {
+	atomic_t		xs_count;	/* Number of references */
+	atomic_t		xs_next;	/* round robin cursor */
+	unsigned int		xs_nxprts;
+	struct rpc_xprt *	xs_xprt[];
+};
+
 /*
  * The high-level client handle
  */
@@ -38,6 +49,7 @@ struct rpc_clnt {
 	struct list_head	cl_tasks;	/* List of tasks */
 	spinlock_t		cl_lock;	/* spinlock */
 	struct rpc_xprt __rcu *	cl_xprt;	/* transport */
+	struct rpc_xprt_set __rcu *cl_xprts;	/* more transports, or NULL */
 	struct rpc_procinfo *	cl_procinfo;	/* procedure info */
 	u32			cl_prog,	/* RPC program number */
 				cl_vers,	/* RPC version number */
@@ -121,6 +133,7 @@ struct rpc_create_args {
 	unsigned long		flags;
 	char			*client_name;
 	struct svc_xprt		*bc_xprt;	/* NFSv4.1 backchannel */
+	unsigned int		nconnect;	/* transports to open, 0 means 1 */
 };
 
 /* Values for "flags" field */
@@ -150,6 +163,7 @@ int		rpc_switch_client_transport(struct rpc_clnt *,
 void		rpc_shutdown_client(struct rpc_clnt *);
 void		rpc_release_client(struct rpc_clnt *);
 void		rpc_task_release_client(struct rpc_task *);
+struct rpc_xprt	*rpc_task_get_xprt(struct rpc_task *);
 
 int		rpcb_create_local(struct net *);
 void		rpcb_put_local(struct net *);
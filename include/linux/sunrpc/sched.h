@@ -67,6 +67,7 @@ struct rpc_task {
 						 * be any workqueue
 						 */
 	struct rpc_wait_queue 	*tk_waitqueue;	/* RPC wait queue we're on */
+	struct rpc_xprt		*tk_xprt;	/* transport the task runs on */
 	union {
 		struct work_struct	tk_work;	/* Async task work queue */
 		struct rpc_wait		tk_wait;	/* RPC wait */
@@ -123,6 +124,7 @@ struct rpc_task_setup {
 #define RPC_TASK_TIMEOUT	0x1000		/* fail with ETIMEDOUT on timeout */
 #define RPC_TASK_NOCONNECT	0x2000		/* return ENOTCONN if not connected */
 #define RPC_TASK_NO_RETRANS_TIMEOUT	0x4000		/* wait forever for a reply */
+#define RPC_TASK_NO_ROUND_ROBIN	0x8000		/* always use the main transport */
 
 #define RPC_IS_ASYNC(t)		((t)->tk_flags & RPC_TASK_ASYNC)
 #define RPC_IS_SWAPPER(t)	((t)->tk_flags & RPC_TASK_SWAPPER)
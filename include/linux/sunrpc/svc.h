@@ -18,6 +18,7 @@
 #include <linux/sunrpc/svcauth.h>
 #include <linux/wait.h>
 #include <linux/mm.h>
+#include <linux/llist.h>
 
 /* statistics for svc_pool structures */
 struct svc_pool_stats {
@@ -36,19 +37,38 @@ struct svc_pool_stats {
  * services that can benefit from it (i.e. nfs but not lockd) will
  * have one pool per NUMA node.  This optimisation reduces cross-
  * node traffic on multi-node NUMA NFS servers.
+ *
+ * Idle threads push themselves onto sp_idle_threads without taking a
+ * lock; whoever hands them work pops them off under sp_idle_lock, which
+ * only serialises the poppers.  The most recently idled thread is used
+ * first, so the ones at the bottom stay asleep and can time out.
+ *
+ * A pool with a non-zero sp_nrthrmax sizes itself: a transport that has
+ * to wait for a thread makes the service start another one, up to
+ * sp_nrthrmax, and threads idle for SVC_POOL_IDLE_TIMEOUT exit as long as
+ * more than sp_nrthrmin remain.
  */
 struct svc_pool {
 	unsigned int		sp_id;	    	/* pool id; also node id on NUMA */
 	spinlock_t		sp_lock;	/* protects all fields */
 	struct list_head	sp_sockets;	/* pending sockets */
 	unsigned int		sp_nrthreads;	/* # of threads in pool */
+	unsigned int		sp_nrthrmin;	/* floor for idle threads exiting */
+	unsigned int		sp_nrthrmax;	/* ceiling for new threads, 0 for
+						 * a fixed number of threads */
 	struct list_head	sp_all_threads;	/* all server threads */
+	struct llist_head	sp_idle_threads; /* idle server threads */
+	spinlock_t		sp_idle_lock;	/* serialises idle list pops */
 	struct svc_pool_stats	sp_stats;	/* statistics on pool operation */
 #define	SP_TASK_PENDING		(0)		/* still work to do even if no
 						 * xprt is queued. */
+#define	SP_CONGESTED		(1)		/* a transport had to wait for
+						 * a thread */
 	unsigned long		sp_flags;
 } ____cacheline_aligned_in_smp;
 
+#define SVC_POOL_IDLE_TIMEOUT	(30 * HZ)
+
 struct svc_serv;
 
 struct svc_serv_ops {
@@ -226,6 +246,7 @@ static inline void svc_putu32(struct kvec *iov, __be32 val)
  */
 struct svc_rqst {
 	struct list_head	rq_all;		/* all threads list */
+	struct llist_node	rq_idle;	/* idle threads list */
 	struct rcu_head		rq_rcu_head;	/* for RCU deferred kfree */
 	struct svc_xprt *	rq_xprt;	/* transport ptr */
 
@@ -268,6 +289,9 @@ struct svc_rqst {
 						 * cache pages */
 #define	RQ_VICTIM	(5)			/* about to be shut down */
 #define	RQ_BUSY		(6)			/* request is busy */
+#define	RQ_IDLE		(7)			/* on the idle threads list */
+#define	RQ_RETIRED	(8)			/* exiting after idling, no
+						 * longer counted in the pool */
 	unsigned long		rq_flags;	/* flags field */
 
 	void *			rq_argp;	/* decoded arguments */
@@ -469,6 +493,7 @@ void		   svc_pool_map_put(void);
 struct svc_serv *  svc_create_pooled(struct svc_program *, unsigned int,
 			struct svc_serv_ops *);
 int		   svc_set_num_threads(struct svc_serv *, struct svc_pool *, int);
+int		   svc_pool_grow(struct svc_serv *, struct svc_pool *);
 int		   svc_pool_stats_open(struct svc_serv *serv, struct file *file);
 void		   svc_destroy(struct svc_serv *);
 void		   svc_shutdown_net(struct svc_serv *, struct net *);
@@ -47,6 +47,7 @@ struct sockaddr;
 struct stat;
 struct stat64;
 struct statfs;
+struct statx;
 struct statfs64;
 struct __sysctl_args;
 struct sysinfo;
@@ -66,6 +67,8 @@ struct perf_event_attr;
 struct file_handle;
 struct sigaltstack;
 union bpf_attr;
+struct io_uring_params;
+struct rseq;
 
 #include <linux/types.h>
 #include <linux/aio_abi.h>
@@ -886,7 +889,25 @@ asmlinkage long sys_execveat(int dfd, const char __user *filename,
 			const char __user *const __user *envp, int flags);
 
 asmlinkage long sys_membarrier(int cmd, int flags);
+asmlinkage long sys_rseq(struct rseq __user *rseq, u32 rseq_len,
+			 int flags, u32 sig);
 
 asmlinkage long sys_mlock2(unsigned long start, size_t len, int flags);
 
+asmlinkage long sys_io_uring_setup(u32 entries,
+				struct io_uring_params __user *p);
+asmlinkage long sys_io_uring_enter(unsigned int fd, u32 to_submit,
+				u32 min_complete, u32 flags,
+				const sigset_t __user *sig, size_t sigsz);
+asmlinkage long sys_io_uring_register(unsigned int fd, unsigned int op,
+				void __user *arg, unsigned int nr_args);
+asmlinkage long sys_copy_file_range(int fd_in, loff_t __user *off_in,
+				    int fd_out, loff_t __user *off_out,
+				    size_t len, unsigned int flags);
+asmlinkage long sys_statx(int dfd, const char __user *path, unsigned flags,
+			  unsigned mask, struct statx __user *buffer);
+asmlinkage long sys_process_madvise(int pidfd, const struct iovec __user *vec,
+				    size_t vlen, int behavior,
+				    unsigned int flags);
+
 #endif
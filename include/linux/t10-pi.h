@@ -13,10 +13,21 @@ struct t10_pi_tuple {
 	__be32 ref_tag;		/* Target LBA or indirect LBA */
 };
 
+/*
+ * NVMe protection information with a 64 bit guard.
+ */
+struct crc64_pi_tuple {
+	__be64 guard_tag;	/* CRC-64 of the data */
+	__be16 app_tag;		/* Opaque storage */
+	__u8   ref_tag[6];	/* Big endian 48 bit reference tag */
+};
+
 
 extern struct blk_integrity_profile t10_pi_type1_crc;
 extern struct blk_integrity_profile t10_pi_type1_ip;
 extern struct blk_integrity_profile t10_pi_type3_crc;
 extern struct blk_integrity_profile t10_pi_type3_ip;
+extern struct blk_integrity_profile ext_pi_type1_crc64;
+extern struct blk_integrity_profile ext_pi_type3_crc64;
 
 #endif
@@ -50,6 +50,12 @@ struct timer_list {
  * the timer will be serviced when the CPU eventually wakes up with a
  * subsequent non-deferrable timer.
  *
+ * TIMER_PINNED_BASE is managed by the timer code: it is set while the
+ * timer is queued through add_timer_on() or mod_timer_pinned(), which
+ * puts it into the local base of its CPU. Other timers go into the
+ * global base, whose timers are expired by another CPU while their own
+ * CPU is idle.
+ *
  * An irqsafe timer is executed with IRQ disabled and it's safe to wait for
  * the completion of the running instance from IRQ handlers, for example,
  * by calling del_timer_sync().
@@ -58,11 +64,14 @@ struct timer_list {
  * workqueue locking issues. It's not meant for executing random crap
  * with interrupts disabled. Abuse is monitored!
  */
-#define TIMER_CPUMASK		0x0007FFFF
-#define TIMER_MIGRATING		0x00080000
+#define TIMER_CPUMASK		0x0003FFFF
+#define TIMER_MIGRATING		0x00040000
 #define TIMER_BASEMASK		(TIMER_CPUMASK | TIMER_MIGRATING)
-#define TIMER_DEFERRABLE	0x00100000
+#define TIMER_DEFERRABLE	0x00080000
+#define TIMER_PINNED_BASE	0x00100000
 #define TIMER_IRQSAFE		0x00200000
+#define TIMER_ARRAYSHIFT	22
+#define TIMER_ARRAYMASK		0xFFC00000
 
 #define __TIMER_INITIALIZER(_function, _expires, _data, _flags) { \
 		.entry = { .next = TIMER_ENTRY_STATIC },	\
@@ -417,6 +417,7 @@ enum event_trigger_type {
 	ETT_SNAPSHOT		= (1 << 1),
 	ETT_STACKTRACE		= (1 << 2),
 	ETT_EVENT_ENABLE	= (1 << 3),
+	ETT_EVENT_HIST		= (1 << 4),
 };
 
 extern int filter_match_preds(struct event_filter *filter, void *rec);
@@ -616,6 +617,11 @@ extern int  ftrace_profile_set_filter(struct perf_event *event, int event_id,
 extern void ftrace_profile_free_filter(struct perf_event *event);
 extern void *perf_trace_buf_prepare(int size, unsigned short type,
 				    struct pt_regs **regs, int *rctxp);
+extern void perf_trace_run_bpf_submit(void *raw_data, int size, int rctx,
+				      struct trace_event_call *call, u64 addr,
+				      u64 count, struct pt_regs *regs,
+				      struct hlist_head *head,
+				      struct task_struct *task);
 
 static inline void
 perf_trace_buf_submit(void *raw_data, int size, int rctx, u64 addr,
@@ -51,6 +51,7 @@
 #include <linux/security.h>
 #include <linux/task_work.h>
 #include <linux/memcontrol.h>
+#include <linux/rseq.h>
 struct linux_binprm;
 
 /*
@@ -191,6 +192,8 @@ static inline void tracehook_notify_resume(struct pt_regs *regs)
 		task_work_run();
 
 	mem_cgroup_handle_over_high();
+
+	rseq_handle_notify_resume(NULL, regs);
 }
 
 #endif	/* <linux/tracehook.h> */
@@ -191,6 +191,7 @@ extern void __dec_zone_state(struct zone *, enum zone_stat_item);
 
 void cpu_vm_stats_fold(int cpu);
 void refresh_zone_stat_thresholds(void);
+void quiet_vmstat(void);
 
 void drain_zonestat(struct zone *zone, struct per_cpu_pageset *);
 
@@ -249,6 +250,7 @@ static inline void __dec_zone_page_state(struct page *page,
 
 static inline void refresh_zone_stat_thresholds(void) { }
 static inline void cpu_vm_stats_fold(int cpu) { }
+static inline void quiet_vmstat(void) { }
 
 static inline void drain_zonestat(struct zone *zone,
 			struct per_cpu_pageset *pset) { }
@@ -119,18 +119,36 @@ struct delayed_work {
 	int cpu;
 };
 
+/*
+ * Affinity scopes of unbound workqueues.  The CPUs are grouped into pods
+ * according to the scope, and a work item is executed by a worker of the
+ * pod of the CPU it was queued on.
+ */
+enum wq_affn_scope {
+	WQ_AFFN_DFL,			/* use system default */
+	WQ_AFFN_CPU,			/* one pod per CPU */
+	WQ_AFFN_SMT,			/* one pod per SMT core */
+	WQ_AFFN_CACHE,			/* one pod per last level cache */
+	WQ_AFFN_NUMA,			/* one pod per NUMA node */
+	WQ_AFFN_SYSTEM,			/* one pod for the whole system */
+
+	WQ_AFFN_NR_TYPES,
+};
+
 /*
  * A struct for workqueue attributes.  This can be used to change
  * attributes of an unbound workqueue.
  *
- * Unlike other fields, ->no_numa isn't a property of a worker_pool.  It
- * only modifies how apply_workqueue_attrs() select pools and thus doesn't
- * participate in pool hash calculations or equality comparisons.
+ * Unlike other fields, ->no_numa and ->affn_scope aren't properties of a
+ * worker_pool.  They only modify how apply_workqueue_attrs() select pools
+ * and thus don't participate in pool hash calculations or equality
+ * comparisons.
  */
 struct workqueue_attrs {
 	int			nice;		/* nice level */
 	cpumask_var_t		cpumask;	/* allowed CPUs */
-	bool			no_numa;	/* disable NUMA affinity */
+	bool			no_numa;	/* disable pod affinity */
+	enum wq_affn_scope	affn_scope;	/* pod affinity scope */
 };
 
 static inline struct delayed_work *to_delayed_work(struct work_struct *work)
@@ -0,0 +1,157 @@
+/*
+ * xxHash - fast non-cryptographic hash
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * The 64-bit variant of xxHash, which processes its input in 32 byte
+ * stripes of four independent lanes.  It is several times faster than
+ * jhash on large inputs and its output is part of on-disk formats such
+ * as the Zstandard frame checksum, so it must not be changed.
+ */
+#ifndef _LINUX_XXHASH_H
+#define _LINUX_XXHASH_H
+
+#include <linux/bitops.h>
+#include <linux/string.h>
+#include <linux/types.h>
+#include <asm/unaligned.h>
+
+#define XXH_PRIME64_1	11400714785074694791ULL
+#define XXH_PRIME64_2	14029467366897019727ULL
+#define XXH_PRIME64_3	1609587929392839161ULL
+#define XXH_PRIME64_4	9650029242287828579ULL
+#define XXH_PRIME64_5	2870177450012600261ULL
+
+/* Streaming state, for input that comes in several pieces */
+struct xxh64_state {
+	u64 total_len;
+	u64 seed;
+	u64 v[4];
+	u8 mem[32];
+	unsigned int mem_size;
+};
+
+static inline u64 xxh64_round(u64 acc, u64 input)
+{
+	acc += input * XXH_PRIME64_2;
+	acc = rol64(acc, 31);
+	return acc * XXH_PRIME64_1;
+}
+
+static inline u64 xxh64_merge(u64 acc, u64 val)
+{
+	acc ^= xxh64_round(0, val);
+	return acc * XXH_PRIME64_1 + XXH_PRIME64_4;
+}
+
+static inline void xxh64_reset(struct xxh64_state *state, u64 seed)
+{
+	memset(state, 0, sizeof(*state));
+	state->seed = seed;
+	state->v[0] = seed + XXH_PRIME64_1 + XXH_PRIME64_2;
+	state->v[1] = seed + XXH_PRIME64_2;
+	state->v[2] = seed;
+	state->v[3] = seed - XXH_PRIME64_1;
+}
+
+static inline void xxh64_stripe(struct xxh64_state *state, const u8 *p)
+{
+	state->v[0] = xxh64_round(state->v[0], get_unaligned_le64(p));
+	state->v[1] = xxh64_round(state->v[1], get_unaligned_le64(p + 8));
+	state->v[2] = xxh64_round(state->v[2], get_unaligned_le64(p + 16));
+	state->v[3] = xxh64_round(state->v[3], get_unaligned_le64(p + 24));
+}
+
+static inline void xxh64_update(struct xxh64_state *state,
+				const void *input, size_t len)
+{
+	const u8 *p = input;
+	const u8 *end = p + len;
+
+	state->total_len += len;
+
+	if (state->mem_size + len < 32) {
+		memcpy(state->mem + state->mem_size, p, len);
+		state->mem_size += len;
+		return;
+	}
+
+	if (state->mem_size) {
+		unsigned int fill = 32 - state->mem_size;
+
+		memcpy(state->mem + state->mem_size, p, fill);
+		xxh64_stripe(state, state->mem);
+		p += fill;
+		state->mem_size = 0;
+	}
+
+	for (; p + 32 <= end; p += 32)
+		xxh64_stripe(state, p);
+
+	if (p < end) {
+		memcpy(state->mem, p, end - p);
+		state->mem_size = end - p;
+	}
+}
+
+static inline u64 xxh64_digest(const struct xxh64_state *state)
+{
+	const u8 *p = state->mem;
+	const u8 *end = p + state->mem_size;
+	u64 h;
+
+	if (state->total_len >= 32) {
+		h = rol64(state->v[0], 1) + rol64(state->v[1], 7) +
+		    rol64(state->v[2], 12) + rol64(state->v[3], 18);
+		h = xxh64_merge(h, state->v[0]);
+		h = xxh64_merge(h, state->v[1]);
+		h = xxh64_merge(h, state->v[2]);
+		h = xxh64_merge(h, state->v[3]);
+	} else {
+		h = state->seed + XXH_PRIME64_5;
+	}
+
+	h += state->total_len;
+
+	for (; p + 8 <= end; p += 8) {
+		h ^= xxh64_round(0, get_unaligned_le64(p));
+		h = rol64(h, 27) * XXH_PRIME64_1 + XXH_PRIME64_4;
+	}
+	if (p + 4 <= end) {
+		h ^= (u64)get_unaligned_le32(p) * XXH_PRIME64_1;
+		h = rol64(h, 23) * XXH_PRIME64_2 + XXH_PRIME64_3;
+		p += 4;
+	}
+	for (; p < end; p++) {
+		h ^= *p * XXH_PRIME64_5;
+		h = rol64(h, 11) * XXH_PRIME64_1;
+	}
+
+	h ^= h >> 33;
+	h *= XXH_PRIME64_2;
+	h ^= h >> 29;
+	h *= XXH_PRIME64_3;
+	h ^= h >> 32;
+	return h;
+}
+
+/**
+ * xxh64() - calculate the 64-bit hash of a buffer in one go
+ * @input: the data to hash
+ * @len:   length of the data in bytes
+ * @seed:  the seed to start from
+ *
+ * Return: the 64-bit hash of the data
+ */
+static inline u64 xxh64(const void *input, size_t len, u64 seed)
+{
+	struct xxh64_state state;
+
+	xxh64_reset(&state, seed);
+	xxh64_update(&state, input, len);
+	return xxh64_digest(&state);
+}
+
+#endif /* _LINUX_XXHASH_H */
@@ -0,0 +1,186 @@
+/*
+ * Zstandard compression and decompression
+ *
+ * Produces and consumes frames in the Zstandard format (RFC 8878), so data
+ * written here can be read by the reference zstd tools and the other way
+ * round. Dictionaries are not supported.
+ *
+ * Nothing in here allocates memory: every context lives in a workspace
+ * provided by the caller, whose size is given by the matching
+ * *_workspace_bound() function. Stack usage is bounded and small, so the
+ * library can be called from filesystem and block layer paths.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+#ifndef _LINUX_ZSTD_H
+#define _LINUX_ZSTD_H
+
+#include <linux/err.h>
+#include <linux/types.h>
+
+#define ZSTD_MIN_CLEVEL		1
+#define ZSTD_DEFAULT_CLEVEL	3
+#define ZSTD_MAX_CLEVEL		15
+
+#define ZSTD_WINDOWLOG_MIN	10
+#define ZSTD_WINDOWLOG_MAX	27
+#define ZSTD_BLOCKSIZE_MAX	(128 * 1024)
+
+#define ZSTD_CONTENTSIZE_UNKNOWN	(~0ULL)
+
+/*
+ * Functions returning a size_t report errors as a negative errno cast to
+ * size_t, like the ERR_PTR() scheme:
+ *
+ *   -EINVAL	 corrupted input or invalid parameters
+ *   -ENOSPC	 the destination buffer is too small
+ *   -ENOMEM	 the workspace is too small for the parameters or the frame
+ *   -EOPNOTSUPP a frame using a dictionary
+ *   -EBADMSG	 content checksum mismatch
+ */
+static inline bool zstd_is_error(size_t ret)
+{
+	return ret >= (size_t)-MAX_ERRNO;
+}
+
+static inline int zstd_get_error(size_t ret)
+{
+	return zstd_is_error(ret) ? (int)(ssize_t)ret : 0;
+}
+
+/* Worst case size of a frame holding @src_size bytes */
+static inline size_t zstd_compress_bound(size_t src_size)
+{
+	return src_size + (src_size >> 8) +
+	       (src_size < ZSTD_BLOCKSIZE_MAX ?
+		(ZSTD_BLOCKSIZE_MAX - src_size) >> 11 : 0);
+}
+
+enum zstd_strategy {
+	ZSTD_fast = 1,		/* one candidate per hash bucket */
+	ZSTD_greedy,		/* hash chains, take the first good match */
+	ZSTD_lazy,		/* hash chains, look one byte ahead */
+	ZSTD_lazy2,		/* hash chains, look two bytes ahead */
+};
+
+/**
+ * struct zstd_compression_parameters - match finder tuning
+ * @window_log:	log2 of the largest match distance, and of the window
+ *		a decoder needs to keep around
+ * @chain_log:	log2 of the hash chain table size, 0 for ZSTD_fast
+ * @hash_log:	log2 of the hash table size
+ * @search_log:	log2 of the number of chain entries looked at per position
+ * @min_match:	shortest match searched for, 4 to 7
+ * @strategy:	see &enum zstd_strategy
+ */
+struct zstd_compression_parameters {
+	unsigned int window_log;
+	unsigned int chain_log;
+	unsigned int hash_log;
+	unsigned int search_log;
+	unsigned int min_match;
+	enum zstd_strategy strategy;
+};
+
+/**
+ * struct zstd_frame_parameters - what goes into the frame header
+ * @content_size: record the size of the content when it is known
+ * @checksum:	 append a checksum of the content to the frame
+ */
+struct zstd_frame_parameters {
+	bool content_size;
+	bool checksum;
+};
+
+struct zstd_parameters {
+	struct zstd_compression_parameters cparams;
+	struct zstd_frame_parameters fparams;
+};
+
+/**
+ * zstd_get_params() - parameters for a compression level
+ * @level:		from ZSTD_MIN_CLEVEL to ZSTD_MAX_CLEVEL, 0 picks
+ *			ZSTD_DEFAULT_CLEVEL
+ * @estimated_src_size:	size of the input if known, ZSTD_CONTENTSIZE_UNKNOWN
+ *			otherwise
+ *
+ * The window and tables are shrunk to fit small inputs, which makes the
+ * workspace of a context that only ever sees pages or extents small.
+ */
+struct zstd_parameters zstd_get_params(int level,
+				       unsigned long long estimated_src_size);
+
+struct zstd_in_buffer {
+	const void *src;
+	size_t size;
+	size_t pos;
+};
+
+struct zstd_out_buffer {
+	void *dst;
+	size_t size;
+	size_t pos;
+};
+
+/* Single pass compression of a buffer into one frame */
+struct zstd_cctx;
+
+size_t zstd_cctx_workspace_bound(const struct zstd_compression_parameters *cparams);
+struct zstd_cctx *zstd_init_cctx(void *workspace, size_t workspace_size);
+size_t zstd_compress_cctx(struct zstd_cctx *cctx, void *dst, size_t dst_capacity,
+			  const void *src, size_t src_size,
+			  const struct zstd_parameters *params);
+
+/*
+ * Streaming compression. zstd_compress_stream() consumes as much of @input
+ * as it can, zstd_flush_stream() pushes out everything buffered so far and
+ * zstd_end_stream() finishes the frame. All of them return the number of
+ * bytes still waiting to be written out, so flushing and ending have to be
+ * repeated with more room in @output until they return 0.
+ */
+struct zstd_cstream;
+
+size_t zstd_cstream_workspace_bound(const struct zstd_compression_parameters *cparams);
+struct zstd_cstream *zstd_init_cstream(const struct zstd_parameters *params,
+				       unsigned long long pledged_src_size,
+				       void *workspace, size_t workspace_size);
+size_t zstd_reset_cstream(struct zstd_cstream *cstream,
+			  unsigned long long pledged_src_size);
+size_t zstd_compress_stream(struct zstd_cstream *cstream,
+			    struct zstd_out_buffer *output,
+			    struct zstd_in_buffer *input);
+size_t zstd_flush_stream(struct zstd_cstream *cstream,
+			 struct zstd_out_buffer *output);
+size_t zstd_end_stream(struct zstd_cstream *cstream,
+		       struct zstd_out_buffer *output);
+
+/*
+ * Single pass decompression of one or more frames. Returns the number of
+ * bytes written to @dst.
+ */
+struct zstd_dctx;
+
+size_t zstd_dctx_workspace_bound(void);
+struct zstd_dctx *zstd_init_dctx(void *workspace, size_t workspace_size);
+size_t zstd_decompress_dctx(struct zstd_dctx *dctx, void *dst, size_t dst_capacity,
+			    const void *src, size_t src_size);
+
+/*
+ * Streaming decompression. zstd_decompress_stream() returns 0 once a frame
+ * has been decoded and fully flushed to @output, and a hint for the size of
+ * the next chunk of input otherwise. Frames whose window is larger than the
+ * @max_window_size the stream was set up with are refused with -ENOMEM.
+ */
+struct zstd_dstream;
+
+size_t zstd_dstream_workspace_bound(size_t max_window_size);
+struct zstd_dstream *zstd_init_dstream(size_t max_window_size,
+				       void *workspace, size_t workspace_size);
+size_t zstd_reset_dstream(struct zstd_dstream *dstream);
+size_t zstd_decompress_stream(struct zstd_dstream *dstream,
+			      struct zstd_out_buffer *output,
+			      struct zstd_in_buffer *input);
+
+#endif /* _LINUX_ZSTD_H */
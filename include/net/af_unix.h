@@ -61,6 +61,8 @@ struct unix_sock {
 	unsigned long		gc_flags;
 #define UNIX_GC_CANDIDATE	0
 #define UNIX_GC_MAYBE_CYCLE	1
+#define UNIX_GC_COMPONENT	2
+	struct unix_sock	*gc_leader;	/* union-find, see unix_gc() */
 	struct socket_wq	peer_wq;
 	wait_queue_t		peer_wake;
 };
@@ -55,6 +55,12 @@ struct fib6_config {
 	u16		fc_encap_type;
 };
 
+/*
+ * Lookups walk nodes and route lists under rcu_read_lock() alone, with
+ * lockless_dereference(); table->tb6_lock serializes writers, which
+ * publish new nodes and routes with rcu_assign_pointer() and free them
+ * after a grace period.
+ */
 struct fib6_node {
 	struct fib6_node	*parent;
 	struct fib6_node	*left;
@@ -68,6 +74,7 @@ struct fib6_node {
 	__u16			fn_flags;
 	int			fn_sernum;
 	struct rt6_info		*rr_ptr;
+	struct rcu_head		rcu;
 };
 
 #ifndef CONFIG_IPV6_SUBTREES
@@ -167,11 +174,14 @@ static inline void rt6_update_expires(struct rt6_info *rt0, int timeout)
 
 static inline u32 rt6_get_cookie(const struct rt6_info *rt)
 {
+	struct fib6_node *fn;
+
 	if (rt->rt6i_flags & RTF_PCPU ||
 	    (unlikely(rt->dst.flags & DST_NOCACHE) && rt->dst.from))
 		rt = (struct rt6_info *)(rt->dst.from);
 
-	return rt->rt6i_node ? rt->rt6i_node->fn_sernum : 0;
+	fn = lockless_dereference(rt->rt6i_node);
+	return fn ? fn->fn_sernum : 0;
 }
 
 static inline void ip6_rt_put(struct rt6_info *rt)
@@ -227,7 +237,7 @@ struct rt6_statistics {
 struct fib6_table {
 	struct hlist_node	tb6_hlist;
 	u32			tb6_id;
-	rwlock_t		tb6_lock;
+	spinlock_t		tb6_lock;
 	struct fib6_node	tb6_root;
 	struct inet_peer_base	tb6_peers;
 };
@@ -14,6 +14,7 @@
 #include <linux/atomic.h>               /* for struct atomic_t */
 #include <linux/compiler.h>
 #include <linux/timer.h>
+#include <linux/rhashtable.h>
 #include <linux/bug.h>
 
 #include <net/checksum.h>
@@ -50,9 +51,6 @@ static inline struct net *seq_file_single_net(struct seq_file *seq)
 #endif
 }
 
-/* Connections' size value needed by ip_vs_ctl.c */
-extern int ip_vs_conn_tab_size;
-
 struct ip_vs_iphdr {
 	int hdr_flags;	/* ipvs flags */
 	__u32 off;	/* Where IP or IPv4 header starts */
@@ -510,7 +508,7 @@ struct ip_vs_conn_param {
 
 /* IP_VS structure allocated for each dynamically scheduled connection */
 struct ip_vs_conn {
-	struct hlist_node	c_list;         /* hashed list heads */
+	struct rhash_head	c_node;         /* node in the netns conn_tab */
 	/* Protocol, addresses and port numbers */
 	__be16                  cport;
 	__be16                  dport;
@@ -861,6 +859,7 @@ struct netns_ipvs {
 #endif
 	/* ip_vs_conn */
 	atomic_t		conn_count;      /* connection counter */
+	struct rhashtable	conn_tab;        /* connection hash table */
 
 	/* ip_vs_ctl */
 	struct ip_vs_stats		tot_stats;  /* Statistics & est. */
@@ -1221,6 +1220,7 @@ const char *ip_vs_state_name(__u16 proto, int state);
 void ip_vs_tcp_conn_listen(struct ip_vs_conn *cp);
 int ip_vs_check_template(struct ip_vs_conn *ct);
 void ip_vs_random_dropentry(struct netns_ipvs *ipvs);
+unsigned int ip_vs_conn_tab_size(struct netns_ipvs *ipvs);
 int ip_vs_conn_init(void);
 void ip_vs_conn_cleanup(void);
 
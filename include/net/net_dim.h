@@ -0,0 +1,99 @@
+/*
+ * net_dim.h	Dynamic interrupt moderation
+ *
+ * A driver samples the packets, bytes and interrupt events of a queue
+ * from its NAPI poll routine and feeds the samples to net_dim().  Every
+ * NET_DIM_NEVENTS events the rates seen since the previous decision are
+ * compared with the ones before, and the moderation profile is moved one
+ * step along a small table of (usec, pkts) pairs: further in the same
+ * direction while throughput improves, back the other way when it does
+ * not.  Once the best profile is found the algorithm parks there until
+ * the traffic changes significantly.
+ *
+ * New profiles are applied from a work item through the driver's apply
+ * callback, so drivers may sleep there, e.g. to issue firmware commands.
+ * The driver must cancel_work_sync(&dim->work) before the queue goes away.
+ *
+ * net_dim() must be serialized by the caller, normally by only calling
+ * it from the NAPI poll routine of the queue.
+ */
+#ifndef _NET_NET_DIM_H
+#define _NET_NET_DIM_H
+
+#include <linux/types.h>
+#include <linux/ktime.h>
+#include <linux/workqueue.h>
+
+#define NET_DIM_NUM_PROFILES	5
+#define NET_DIM_DEF_PROFILE	1
+
+/* Number of events between two decisions */
+#define NET_DIM_NEVENTS		64
+
+/**
+ * struct net_dim_cq_moder - interrupt moderation profile
+ * @usec:	Maximum time an event may be held back
+ * @pkts:	Maximum number of packets an event may be held back for,
+ *		for devices that support it
+ */
+struct net_dim_cq_moder {
+	u16	usec;
+	u16	pkts;
+};
+
+struct net_dim_sample {
+	ktime_t	time;
+	u32	pkt_ctr;
+	u32	byte_ctr;
+	u16	event_ctr;
+};
+
+/* Rates per millisecond */
+struct net_dim_stats {
+	int	ppms;
+	int	bpms;
+	int	epms;
+};
+
+struct net_dim {
+	u8				state;
+	u8				tune_state;
+	u8				profile_ix;
+	u8				steps_right;
+	u8				steps_left;
+	u8				tired;
+	struct net_dim_stats		prev_stats;
+	struct net_dim_sample		start_sample;
+	const struct net_dim_cq_moder	*profiles;
+	void	(*apply)(struct net_dim *dim,
+			 const struct net_dim_cq_moder *moder);
+	struct work_struct		work;
+};
+
+/* From 1 to 256 usecs, for devices that also moderate on packets */
+extern const struct net_dim_cq_moder
+net_dim_default_profiles[NET_DIM_NUM_PROFILES];
+
+void net_dim_init(struct net_dim *dim,
+		  const struct net_dim_cq_moder *profiles,
+		  void (*apply)(struct net_dim *dim,
+				const struct net_dim_cq_moder *moder));
+void net_dim(struct net_dim *dim, const struct net_dim_sample *end_sample);
+
+/* Profile in use, or about to be applied */
+static inline const struct net_dim_cq_moder *
+net_dim_cur_profile(const struct net_dim *dim)
+{
+	return &dim->profiles[dim->profile_ix];
+}
+
+static inline void net_dim_sample(u16 event_ctr, u64 packets, u64 bytes,
+				  struct net_dim_sample *s)
+{
+	s->time	     = ktime_get();
+	s->pkt_ctr   = packets;
+	s->byte_ctr  = bytes;
+	s->event_ctr = event_ctr;
+}
+
+#endif /* _NET_NET_DIM_H */
@@ -0,0 +1,94 @@
+#ifndef _NF_FLOW_TABLE_H
+#define _NF_FLOW_TABLE_H
+
+#include <linux/in.h>
+#include <linux/netdevice.h>
+#include <linux/rhashtable.h>
+#include <linux/workqueue.h>
+#include <net/dst.h>
+#include <net/netfilter/nf_conntrack_tuple.h>
+
+/*
+ * A flow table holds established connections that are forwarded without
+ * going through the netfilter hooks, conntrack and the FIB: packets that
+ * match a flow at the ingress hook are NATed and sent out through the
+ * route cached in the flow.  A flow has an entry for each direction.
+ */
+
+enum flow_offload_tuple_dir {
+	FLOW_OFFLOAD_DIR_ORIGINAL = IP_CT_DIR_ORIGINAL,
+	FLOW_OFFLOAD_DIR_REPLY = IP_CT_DIR_REPLY,
+	FLOW_OFFLOAD_DIR_MAX = IP_CT_DIR_MAX
+};
+
+struct flow_offload_tuple {
+	/* lookup key, up to dir */
+	__be32				src_v4;
+	__be32				dst_v4;
+	__be16				src_port;
+	__be16				dst_port;
+	int				iifidx;
+	u8				l3proto;
+	u8				l4proto;
+
+	u8				dir;
+	u16				mtu;
+	int				oifidx;
+	struct dst_entry		*dst_cache;
+};
+
+struct flow_offload_tuple_rhash {
+	struct rhash_head		node;
+	struct flow_offload_tuple	tuple;
+};
+
+#define FLOW_OFFLOAD_SNAT	0x1
+#define FLOW_OFFLOAD_DNAT	0x2
+#define FLOW_OFFLOAD_TEARDOWN	0x4
+
+struct flow_offload {
+	struct flow_offload_tuple_rhash	tuplehash[FLOW_OFFLOAD_DIR_MAX];
+	struct nf_conn			*ct;
+	u32				flags;
+	u32				timeout;
+	struct rcu_head			rcu_head;
+};
+
+/* Flows not seen for that long are given back to conntrack */
+#define NF_FLOW_TIMEOUT		(30 * HZ)
+
+/* Route each direction of a flow is sent out with */
+struct nf_flow_route {
+	struct {
+		struct dst_entry	*dst;
+	} tuple[FLOW_OFFLOAD_DIR_MAX];
+};
+
+struct nf_flowtable {
+	struct rhashtable		rhashtable;
+	struct delayed_work		gc_work;
+};
+
+struct flow_offload *flow_offload_alloc(struct nf_conn *ct,
+					struct nf_flow_route *route);
+void flow_offload_free(struct flow_offload *flow);
+
+int flow_offload_add(struct nf_flowtable *flow_table, struct flow_offload *flow);
+struct flow_offload_tuple_rhash *flow_offload_lookup(struct nf_flowtable *flow_table,
+						     struct flow_offload_tuple *tuple);
+void flow_offload_teardown(struct flow_offload *flow);
+void nf_flow_table_cleanup(struct nf_flowtable *flow_table,
+			   struct net_device *dev);
+
+int nf_flow_table_init(struct nf_flowtable *flow_table);
+void nf_flow_table_free(struct nf_flowtable *flow_table);
+
+static inline void flow_offload_refresh(struct flow_offload *flow)
+{
+	flow->timeout = (u32)jiffies + NF_FLOW_TIMEOUT;
+}
+
+unsigned int nf_flow_offload_ip_hook(struct nf_flowtable *flow_table,
+				     struct sk_buff *skb);
+
+#endif /* _NF_FLOW_TABLE_H */
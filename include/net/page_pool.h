@@ -0,0 +1,73 @@
+/*
+ * page_pool.h	Recycling of driver RX pages
+ *
+ * A page pool hands out pages for an RX ring and takes them back once the
+ * stack is done with them.  Recycling is based on the page refcount: the
+ * pool keeps one reference on every page it handed out, and when the
+ * oldest of them is down to that single reference nobody else can see it
+ * any more, so it is given to the driver again without going through the
+ * page allocator and, for DMA mapped pools, without a new IOMMU mapping.
+ *
+ * Nothing has to change on the free side: skbs and drivers simply drop
+ * their references with put_page() as before.
+ *
+ * A pool is not locked.  page_pool_alloc_pages() must be serialized by the
+ * caller, normally by only calling it from the NAPI poll routine and the
+ * refill paths that run with NAPI disabled.
+ */
+#ifndef _NET_PAGE_POOL_H
+#define _NET_PAGE_POOL_H
+
+#include <linux/mm.h>
+#include <linux/dma-direction.h>
+
+#define PP_FLAG_DMA_MAP		BIT(0)	/* Map pages with the DMA API */
+
+#define PP_POOL_SIZE_MAX	32768
+
+/**
+ * struct page_pool_params - page pool configuration
+ * @flags:	PP_FLAG_*
+ * @order:	Allocation order of the pages
+ * @pool_size:	Number of pages tracked for recycling, a power of 2.  Should
+ *		cover the RX ring plus the pages typically held by the stack.
+ * @nid:	NUMA node to allocate from, or NUMA_NO_NODE for the local one
+ * @dev:	Device the pages are mapped for, with PP_FLAG_DMA_MAP
+ * @dma_dir:	DMA_FROM_DEVICE or DMA_BIDIRECTIONAL, with PP_FLAG_DMA_MAP
+ */
+struct page_pool_params {
+	unsigned int		flags;
+	unsigned int		order;
+	unsigned int		pool_size;
+	int			nid;
+	struct device		*dev;
+	enum dma_data_direction	dma_dir;
+};
+
+struct page_pool_entry {
+	struct page		*page;
+	dma_addr_t		dma;
+};
+
+/*
+ * The pages in flight form a FIFO: @tail is the oldest one, the first
+ * candidate for recycling, and new or recycled pages are added at @head.
+ */
+struct page_pool {
+	struct page_pool_params	p;
+	unsigned int		mask;
+	unsigned int		head;
+	unsigned int		tail;
+	struct page_pool_entry	*ring;
+
+	/* Statistics */
+	unsigned long		alloc;
+	unsigned long		recycle;
+};
+
+struct page_pool *page_pool_create(const struct page_pool_params *params);
+void page_pool_destroy(struct page_pool *pool);
+struct page *page_pool_alloc_pages(struct page_pool *pool, gfp_t gfp,
+				   dma_addr_t *dma);
+
+#endif /* _NET_PAGE_POOL_H */
@@ -27,6 +27,8 @@ enum qdisc_state_t {
 	__QDISC_STATE_SCHED,
 	__QDISC_STATE_DEACTIVATED,
 	__QDISC_STATE_THROTTLED,
+	__QDISC_STATE_RUNNING,
+	__QDISC_STATE_MISSED,
 };
 
 /*
@@ -64,6 +66,11 @@ struct Qdisc {
 #define TCQ_F_NOPARENT		0x40 /* root of its hierarchy :
 				      * qdisc_tree_decrease_qlen() should stop.
 				      */
+#define TCQ_F_NOLOCK		0x80 /* qdisc does not require locking :
+				      * enqueue and dequeue run without the
+				      * root lock, __QDISC_STATE_RUNNING
+				      * serializes dequeue.
+				      */
 	u32			limit;
 	const struct Qdisc_ops	*ops;
 	struct qdisc_size_table	__rcu *stab;
@@ -104,11 +111,26 @@ struct Qdisc {
 
 static inline bool qdisc_is_running(const struct Qdisc *qdisc)
 {
+	if (qdisc->flags & TCQ_F_NOLOCK)
+		return test_bit(__QDISC_STATE_RUNNING, &qdisc->state);
 	return (qdisc->__state & __QDISC___STATE_RUNNING) ? true : false;
 }
 
 static inline bool qdisc_run_begin(struct Qdisc *qdisc)
 {
+	if (qdisc->flags & TCQ_F_NOLOCK) {
+		if (!test_and_set_bit_lock(__QDISC_STATE_RUNNING, &qdisc->state))
+			return true;
+
+		/* The owner may be about to find the queue empty and stop:
+		 * tell it to look again, and try once more in case it
+		 * already left.
+		 */
+		if (test_and_set_bit(__QDISC_STATE_MISSED, &qdisc->state))
+			return false;
+		return !test_and_set_bit_lock(__QDISC_STATE_RUNNING,
+					      &qdisc->state);
+	}
 	if (qdisc_is_running(qdisc))
 		return false;
 	qdisc->__state |= __QDISC___STATE_RUNNING;
@@ -117,6 +139,13 @@ static inline bool qdisc_run_begin(struct Qdisc *qdisc)
 
 static inline void qdisc_run_end(struct Qdisc *qdisc)
 {
+	if (qdisc->flags & TCQ_F_NOLOCK) {
+		clear_bit_unlock(__QDISC_STATE_RUNNING, &qdisc->state);
+		smp_mb__after_atomic();
+		if (unlikely(test_bit(__QDISC_STATE_MISSED, &qdisc->state)))
+			__netif_schedule(qdisc);
+		return;
+	}
 	qdisc->__state &= ~__QDISC___STATE_RUNNING;
 }
 
@@ -199,6 +228,9 @@ struct Qdisc_ops {
 	int			(*dump)(struct Qdisc *, struct sk_buff *);
 	int			(*dump_stats)(struct Qdisc *, struct gnet_dump *);
 
+	/* may run without the root lock when attached to a tx queue */
+	bool			lockless;
+
 	struct module		*owner;
 };
 
@@ -272,6 +304,19 @@ static inline int qdisc_qlen(const struct Qdisc *q)
 	return q->q.qlen;
 }
 
+/* Lockless qdiscs count their packets per cpu, on top of q.qlen */
+static inline u32 qdisc_qlen_sum(const struct Qdisc *q)
+{
+	u32 qlen = q->q.qlen;
+	int i;
+
+	if (q->flags & TCQ_F_NOLOCK)
+		for_each_possible_cpu(i)
+			qlen += per_cpu_ptr(q->cpu_qstats, i)->qlen;
+
+	return qlen;
+}
+
 static inline struct qdisc_skb_cb *qdisc_skb_cb(const struct sk_buff *skb)
 {
 	return (struct qdisc_skb_cb *)skb->cb;
@@ -550,6 +595,28 @@ static inline void qdisc_qstats_backlog_inc(struct Qdisc *sch,
 	sch->qstats.backlog += qdisc_pkt_len(skb);
 }
 
+static inline void qdisc_qstats_cpu_backlog_dec(struct Qdisc *sch,
+						const struct sk_buff *skb)
+{
+	this_cpu_sub(sch->cpu_qstats->backlog, qdisc_pkt_len(skb));
+}
+
+static inline void qdisc_qstats_cpu_backlog_inc(struct Qdisc *sch,
+						const struct sk_buff *skb)
+{
+	this_cpu_add(sch->cpu_qstats->backlog, qdisc_pkt_len(skb));
+}
+
+static inline void qdisc_qstats_cpu_qlen_inc(struct Qdisc *sch)
+{
+	this_cpu_inc(sch->cpu_qstats->qlen);
+}
+
+static inline void qdisc_qstats_cpu_qlen_dec(struct Qdisc *sch)
+{
+	this_cpu_dec(sch->cpu_qstats->qlen);
+}
+
 static inline void __qdisc_qstats_drop(struct Qdisc *sch, int count)
 {
 	sch->qstats.drops += count;
@@ -725,6 +792,14 @@ static inline int qdisc_drop(struct sk_buff *skb, struct Qdisc *sch)
 	return NET_XMIT_DROP;
 }
 
+static inline int qdisc_drop_cpu(struct sk_buff *skb, struct Qdisc *sch)
+{
+	kfree_skb(skb);
+	qdisc_qstats_cpu_drop(sch);
+
+	return NET_XMIT_DROP;
+}
+
 static inline int qdisc_reshape_fail(struct sk_buff *skb, struct Qdisc *sch)
 {
 	qdisc_qstats_drop(sch);
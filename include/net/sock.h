@@ -301,6 +301,7 @@ struct cg_proto;
   *	@sk_stamp: time stamp of last packet received
   *	@sk_tsflags: SO_TIMESTAMPING socket options
   *	@sk_tskey: counter to disambiguate concurrent tstamp requests
+  *	@sk_zckey: counter to order MSG_ZEROCOPY notifications
   *	@sk_socket: Identd and reporting IO signals
   *	@sk_user_data: RPC layer private data
   *	@sk_frag: cached page frag
@@ -310,6 +311,7 @@ struct cg_proto;
   *	@sk_mark: generic packet mark
   *	@sk_classid: this socket's cgroup classid
   *	@sk_cgrp: this socket's cgroup-specific proto data
+  *	@sk_bpf_cgrp: cgroup whose bpf programs filter this socket's traffic
   *	@sk_write_pending: a write to stream socket waits to start
   *	@sk_state_change: callback to indicate change in the state of the sock
   *	@sk_data_ready: callback to indicate there is data to be processed
@@ -317,6 +319,7 @@ struct cg_proto;
   *	@sk_error_report: callback to indicate errors (e.g. %MSG_ERRQUEUE)
   *	@sk_backlog_rcv: callback to process the backlog
   *	@sk_destruct: called at sock freeing time, i.e. when all refcnt == 0
+  *	@sk_reuseport_cb: reuseport group container
  */
 struct sock {
 	/*
@@ -436,6 +439,7 @@ struct sock {
 	ktime_t			sk_stamp;
 	u16			sk_tsflags;
 	u32			sk_tskey;
+	atomic_t		sk_zckey;
 	struct socket		*sk_socket;
 	void			*sk_user_data;
 	struct page_frag	sk_frag;
@@ -450,6 +454,9 @@ struct sock {
 	u32			sk_classid;
 #endif
 	struct cg_proto		*sk_cgrp;
+#ifdef CONFIG_CGROUP_BPF
+	struct cgroup		*sk_bpf_cgrp;
+#endif
 	void			(*sk_state_change)(struct sock *sk);
 	void			(*sk_data_ready)(struct sock *sk);
 	void			(*sk_write_space)(struct sock *sk);
@@ -457,6 +464,7 @@ struct sock {
 	int			(*sk_backlog_rcv)(struct sock *sk,
 						  struct sk_buff *skb);
 	void                    (*sk_destruct)(struct sock *sk);
+	struct sock_reuseport __rcu	*sk_reuseport_cb;
 };
 
 #define __sk_user_data(sk) ((*((void __rcu **)&(sk)->sk_user_data)))
@@ -739,6 +747,7 @@ enum sock_flags {
 		     */
 	SOCK_FILTER_LOCKED, /* Filter cannot be changed anymore */
 	SOCK_SELECT_ERR_QUEUE, /* Wake select on error queue */
+	SOCK_TXTIME, /* SCM_TXTIME departure times are accepted */
 };
 
 #define SK_FLAGS_TIMESTAMP ((1UL << SOCK_TIMESTAMP) | (1UL << SOCK_TIMESTAMPING_RX_SOFTWARE))
@@ -1018,6 +1027,7 @@ struct proto {
 	/* Memory pressure */
 	void			(*enter_memory_pressure)(struct sock *sk);
 	atomic_long_t		*memory_allocated;	/* Current allocated memory. */
+	int __percpu		*per_cpu_fw_alloc;	/* Not yet in memory_allocated. */
 	struct percpu_counter	*sockets_allocated;	/* Current number of sockets. */
 	/*
 	 * Pressure flag: try to collapse.
@@ -1207,6 +1217,49 @@ static inline void memcg_memory_allocated_sub(struct cg_proto *prot,
 	page_counter_uncharge(&prot->memory_allocated, amt);
 }
 
+/*
+ * Protocols with per_cpu_fw_alloc batch their updates of memory_allocated:
+ * each cpu folds its share in once it drifts by SK_MEMORY_PCPU_RESERVE
+ * pages, so the global value is off by at most that much per cpu.
+ */
+#define SK_MEMORY_PCPU_RESERVE (1 << (20 - PAGE_SHIFT))
+
+static inline void proto_memory_allocated_add(struct proto *prot, int amt)
+{
+	int local;
+
+	if (!prot->per_cpu_fw_alloc) {
+		atomic_long_add(amt, prot->memory_allocated);
+		return;
+	}
+
+	preempt_disable();
+	local = __this_cpu_add_return(*prot->per_cpu_fw_alloc, amt);
+	if (local >= SK_MEMORY_PCPU_RESERVE) {
+		__this_cpu_sub(*prot->per_cpu_fw_alloc, local);
+		atomic_long_add(local, prot->memory_allocated);
+	}
+	preempt_enable();
+}
+
+static inline void proto_memory_allocated_sub(struct proto *prot, int amt)
+{
+	int local;
+
+	if (!prot->per_cpu_fw_alloc) {
+		atomic_long_sub(amt, prot->memory_allocated);
+		return;
+	}
+
+	preempt_disable();
+	local = __this_cpu_sub_return(*prot->per_cpu_fw_alloc, amt);
+	if (local <= -SK_MEMORY_PCPU_RESERVE) {
+		__this_cpu_sub(*prot->per_cpu_fw_alloc, local);
+		atomic_long_add(local, prot->memory_allocated);
+	}
+	preempt_enable();
+}
+
 static inline long
 sk_memory_allocated(const struct sock *sk)
 {
@@ -1226,11 +1279,12 @@ sk_memory_allocated_add(struct sock *sk, int amt, int *parent_status)
 	if (mem_cgroup_sockets_enabled && sk->sk_cgrp) {
 		memcg_memory_allocated_add(sk->sk_cgrp, amt, parent_status);
 		/* update the root cgroup regardless */
-		atomic_long_add_return(amt, prot->memory_allocated);
+		proto_memory_allocated_add(prot, amt);
 		return page_counter_read(&sk->sk_cgrp->memory_allocated);
 	}
 
-	return atomic_long_add_return(amt, prot->memory_allocated);
+	proto_memory_allocated_add(prot, amt);
+	return atomic_long_read(prot->memory_allocated);
 }
 
 static inline void
@@ -1241,7 +1295,7 @@ sk_memory_allocated_sub(struct sock *sk, int amt)
 	if (mem_cgroup_sockets_enabled && sk->sk_cgrp)
 		memcg_memory_allocated_sub(sk->sk_cgrp, amt);
 
-	atomic_long_sub(amt, prot->memory_allocated);
+	proto_memory_allocated_sub(prot, amt);
 }
 
 static inline void sk_sockets_allocated_dec(struct sock *sk)
@@ -1405,12 +1459,16 @@ static inline void sk_mem_reclaim(struct sock *sk)
 		__sk_mem_reclaim(sk, sk->sk_forward_alloc);
 }
 
+/* What sk_mem_reclaim_partial() leaves to the socket for its next skbs */
+#define SK_MEM_PARTIAL_RESERVE	(4 * SK_MEM_QUANTUM)
+
 static inline void sk_mem_reclaim_partial(struct sock *sk)
 {
 	if (!sk_has_account(sk))
 		return;
-	if (sk->sk_forward_alloc > SK_MEM_QUANTUM)
-		__sk_mem_reclaim(sk, sk->sk_forward_alloc - 1);
+	if (sk->sk_forward_alloc >= SK_MEM_PARTIAL_RESERVE + SK_MEM_QUANTUM)
+		__sk_mem_reclaim(sk, sk->sk_forward_alloc -
+				     SK_MEM_PARTIAL_RESERVE);
 }
 
 static inline void sk_mem_charge(struct sock *sk, int size)
@@ -1514,6 +1572,8 @@ void sk_free(struct sock *sk);
 void sk_destruct(struct sock *sk);
 struct sock *sk_clone_lock(const struct sock *sk, const gfp_t priority);
 
+struct sk_buff *sock_omalloc(struct sock *sk, unsigned long size,
+			     gfp_t priority);
 struct sk_buff *sock_wmalloc(struct sock *sk, unsigned long size, int force,
 			     gfp_t priority);
 void sock_wfree(struct sk_buff *skb);
@@ -1543,8 +1603,11 @@ void sk_send_sigurg(struct sock *sk);
 
 struct sockcm_cookie {
 	u32 mark;
+	u64 transmit_time;
 };
 
+int __sock_cmsg_send(struct sock *sk, struct msghdr *msg, struct cmsghdr *cmsg,
+		     struct sockcm_cookie *sockc);
 int sock_cmsg_send(struct sock *sk, struct msghdr *msg,
 		   struct sockcm_cookie *sockc);
 
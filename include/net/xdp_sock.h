@@ -0,0 +1,137 @@
+/* AF_XDP internal functions
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ */
+
+#ifndef _LINUX_XDP_SOCK_H
+#define _LINUX_XDP_SOCK_H
+
+#include <linux/workqueue.h>
+#include <linux/if_xdp.h>
+#include <linux/mutex.h>
+#include <linux/spinlock.h>
+#include <linux/mm.h>
+#include <net/sock.h>
+
+struct net_device;
+struct xsk_queue;
+
+struct xdp_umem_page {
+	void *addr;
+	dma_addr_t dma;
+};
+
+/* Frames taken off the fill ring that the driver had to give back, e.g.
+ * because the frame was received with errors or the ring was torn down.
+ * They are handed out again before new entries are read from the fill ring.
+ */
+struct xdp_umem_fq_reuse {
+	u32 nentries;
+	u32 length;
+	u64 handles[];
+};
+
+struct xdp_umem {
+	struct xsk_queue *fq;
+	struct xsk_queue *cq;
+	struct xdp_umem_page *pages;
+	u64 chunk_mask;
+	u64 size;
+	u32 headroom;
+	u32 chunk_size_nohr;
+	struct user_struct *user;
+	unsigned long address;
+	struct work_struct work;
+	struct page **pgs;
+	u32 npgs;
+	/* socket receiving into this umem in zero-copy mode, set while a
+	 * driver has the umem installed on one of its rx queues
+	 */
+	struct xdp_sock *xs;
+	struct xdp_umem_fq_reuse *fq_reuse;
+};
+
+struct xdp_sock {
+	/* struct sock must be the first member of struct xdp_sock */
+	struct sock sk;
+	struct xsk_queue *rx;
+	struct net_device *dev;
+	struct xdp_umem *umem;
+	u16 queue_id;
+	bool zc;
+	/* serializes the copy-mode receive path, which may run on several
+	 * cpus at once when RPS spreads the queue
+	 */
+	spinlock_t rx_lock;
+	struct xsk_queue *tx ____cacheline_aligned_in_smp;
+	/* Protects multiple processes in the control path */
+	struct mutex mutex;
+	/* Completions are posted from the skb destructor, which may run in
+	 * any context
+	 */
+	spinlock_t tx_completion_lock;
+	u64 rx_dropped;
+	struct list_head list;
+};
+
+static inline struct xdp_sock *xdp_sk(struct sock *sk)
+{
+	return (struct xdp_sock *)sk;
+}
+
+#ifdef CONFIG_XDP_SOCKETS
+bool xsk_generic_rcv(struct sk_buff *skb);
+bool xsk_skb_rx_queue_bound(const struct sk_buff *skb);
+extern struct static_key xsk_rx_needed;
+
+/* Zero-copy driver interface */
+bool xsk_umem_peek_addr(struct xdp_umem *umem, u64 *addr);
+void xsk_umem_discard_addr(struct xdp_umem *umem);
+int xsk_umem_rcv(struct xdp_umem *umem, u64 addr, u32 len);
+void xsk_umem_flush(struct xdp_umem *umem);
+
+struct xdp_umem_fq_reuse *xsk_reuseq_prepare(u32 nentries);
+struct xdp_umem_fq_reuse *xsk_reuseq_swap(struct xdp_umem *umem,
+					  struct xdp_umem_fq_reuse *newq);
+void xsk_reuseq_free(struct xdp_umem_fq_reuse *rq);
+
+static inline char *xdp_umem_get_data(struct xdp_umem *umem, u64 addr)
+{
+	return umem->pages[addr >> PAGE_SHIFT].addr + (addr & (PAGE_SIZE - 1));
+}
+
+static inline dma_addr_t xdp_umem_get_dma(struct xdp_umem *umem, u64 addr)
+{
+	return umem->pages[addr >> PAGE_SHIFT].dma + (addr & (PAGE_SIZE - 1));
+}
+
+/* Give a frame the driver took from xsk_umem_peek_addr() back to the umem.
+ * The driver must have sized the reuse queue, see xsk_reuseq_prepare(),
+ * for every frame it can hold at once.
+ */
+static inline void xsk_umem_fq_reuse(struct xdp_umem *umem, u64 addr)
+{
+	struct xdp_umem_fq_reuse *rq = umem->fq_reuse;
+
+	rq->handles[rq->length++] = addr;
+}
+#else
+static inline bool xsk_generic_rcv(struct sk_buff *skb)
+{
+	return false;
+}
+
+static inline bool xsk_skb_rx_queue_bound(const struct sk_buff *skb)
+{
+	return false;
+}
+#endif /* CONFIG_XDP_SOCKETS */
+
+#endif /* _LINUX_XDP_SOCK_H */
@@ -124,6 +124,13 @@ struct xfrm_state_walk {
 	struct xfrm_address_filter *filter;
 };
 
+/* Device an SA is offloaded to, see struct xfrmdev_ops. */
+struct xfrm_state_offload {
+	struct net_device	*dev;
+	unsigned long		offload_handle;
+	u8			flags;
+};
+
 /* Full description of state of transformer. */
 struct xfrm_state {
 	possible_net_t		xs_net;
@@ -176,6 +183,9 @@ struct xfrm_state {
 	/* Data for care-of address */
 	xfrm_address_t	*coaddr;
 
+	/* Inline transformation by a network device */
+	struct xfrm_state_offload xso;
+
 	/* IPComp needs an IPIP tunnel for handling uncompressed packets */
 	struct xfrm_state	*tunnel;
 
@@ -978,10 +988,36 @@ static inline void xfrm_dst_destroy(struct xfrm_dst *xdst)
 
 void xfrm_dst_ifdown(struct dst_entry *dst, struct net_device *dev);
 
+#define XFRM_MAX_OFFLOAD_DEPTH	1
+
+/*
+ * Per packet state of a transformation done by a device.  On receive
+ * CRYPTO_DONE says the device decrypted and authenticated the packet,
+ * with the outcome in status.  On transmit CRYPTO_DEV_ENCRYPT asks the
+ * device to encrypt; the stack only builds the ESP header and trailer.
+ */
+struct xfrm_offload {
+	struct {
+		__u32		low;
+		__u32		hi;
+	} seq;
+
+	__u32			flags;
+#define	CRYPTO_DONE		1
+#define	CRYPTO_DEV_ENCRYPT	2
+
+	__u32			status;
+#define CRYPTO_SUCCESS		1
+#define CRYPTO_GENERIC_ERROR	2
+#define CRYPTO_AUTH_FAILED	4
+};
+
 struct sec_path {
 	atomic_t		refcnt;
 	int			len;
+	int			olen;
 	struct xfrm_state	*xvec[XFRM_MAX_DEPTH];
+	struct xfrm_offload	ovec[XFRM_MAX_OFFLOAD_DEPTH];
 };
 
 static inline int secpath_exists(struct sk_buff *skb)
@@ -1503,6 +1539,8 @@ struct xfrmk_spdinfo {
 struct xfrm_state *xfrm_find_acq_byseq(struct net *net, u32 mark, u32 seq);
 int xfrm_state_delete(struct xfrm_state *x);
 int xfrm_state_flush(struct net *net, u8 proto, bool task_valid);
+int xfrm_dev_state_flush(struct net *net, struct net_device *dev,
+			 bool task_valid);
 void xfrm_sad_getinfo(struct net *net, struct xfrmk_sadinfo *si);
 void xfrm_spd_getinfo(struct net *net, struct xfrmk_spdinfo *si);
 u32 xfrm_replay_seqhi(struct xfrm_state *x, __be32 net_seq);
@@ -1778,6 +1816,72 @@ static inline struct xfrm_state *xfrm_input_state(struct sk_buff *skb)
 }
 #endif
 
+/* Offload state of the outermost transformation, if the device did it. */
+static inline struct xfrm_offload *xfrm_offload(struct sk_buff *skb)
+{
+#ifdef CONFIG_XFRM_OFFLOAD
+	struct sec_path *sp = skb->sp;
+
+	if (!sp || !sp->olen || sp->len != sp->olen)
+		return NULL;
+
+	return &sp->ovec[sp->olen - 1];
+#else
+	return NULL;
+#endif
+}
+
+#ifdef CONFIG_XFRM_OFFLOAD
+void __init xfrm_dev_init(void);
+int xfrm_dev_state_add(struct net *net, struct xfrm_state *x,
+		       struct xfrm_user_offload *xuo);
+int xfrm_dev_output(struct sk_buff *skb, struct xfrm_state *x);
+int xfrm_dev_input(struct sk_buff *skb, struct xfrm_state *x, u32 status);
+
+static inline void xfrm_dev_state_delete(struct xfrm_state *x)
+{
+	struct net_device *dev = x->xso.dev;
+
+	if (dev)
+		dev->xfrmdev_ops->xdo_dev_state_delete(x);
+}
+
+static inline void xfrm_dev_state_free(struct xfrm_state *x)
+{
+	struct net_device *dev = x->xso.dev;
+
+	if (dev) {
+		if (dev->xfrmdev_ops->xdo_dev_state_free)
+			dev->xfrmdev_ops->xdo_dev_state_free(x);
+		x->xso.dev = NULL;
+		dev_put(dev);
+	}
+}
+#else
+static inline void xfrm_dev_init(void)
+{
+}
+
+static inline int xfrm_dev_state_add(struct net *net, struct xfrm_state *x,
+				     struct xfrm_user_offload *xuo)
+{
+	return 0;
+}
+
+static inline int xfrm_dev_output(struct sk_buff *skb, struct xfrm_state *x)
+{
+	return 0;
+}
+
+static inline void xfrm_dev_state_delete(struct xfrm_state *x)
+{
+}
+
+static inline void xfrm_dev_state_free(struct xfrm_state *x)
+{
+}
+#endif
+
 static inline int xfrm_mark_get(struct nlattr **attrs, struct xfrm_mark *m)
 {
 	if (attrs[XFRMA_MARK])
@@ -573,7 +573,11 @@ struct Scsi_Host {
 		struct blk_mq_tag_set	tag_set;
 	};
 
-	atomic_t host_busy;		   /* commands actually active on low-level */
+	/*
+	 * Commands actually active on low-level, for the legacy request
+	 * path only; use scsi_host_busy() to read it.
+	 */
+	atomic_t host_busy;
 	atomic_t host_blocked;
 
 	unsigned int host_failed;	   /* commands that failed.
@@ -793,6 +797,7 @@ extern void scsi_rescan_device(struct device *);
 extern void scsi_remove_host(struct Scsi_Host *);
 extern struct Scsi_Host *scsi_host_get(struct Scsi_Host *);
 extern void scsi_host_put(struct Scsi_Host *t);
+extern int scsi_host_busy(struct Scsi_Host *shost);
 extern struct Scsi_Host *scsi_host_lookup(unsigned short);
 extern const char *scsi_host_state_name(enum scsi_host_state);
 extern void scsi_cmd_get_serial(struct Scsi_Host *, struct scsi_cmnd *);
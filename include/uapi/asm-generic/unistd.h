@@ -715,9 +715,27 @@ __SYSCALL(__NR_userfaultfd, sys_userfaultfd)
 __SYSCALL(__NR_membarrier, sys_membarrier)
 #define __NR_mlock2 284
 __SYSCALL(__NR_mlock2, sys_mlock2)
+#define __NR_copy_file_range 285
+__SYSCALL(__NR_copy_file_range, sys_copy_file_range)
+/* 286 through 290 are reserved */
+#define __NR_statx 291
+__SYSCALL(__NR_statx, sys_statx)
+/* 292 is reserved */
+#define __NR_rseq 293
+__SYSCALL(__NR_rseq, sys_rseq)
+/* 294 through 424 are reserved */
+#define __NR_io_uring_setup 425
+__SYSCALL(__NR_io_uring_setup, sys_io_uring_setup)
+#define __NR_io_uring_enter 426
+__SYSCALL(__NR_io_uring_enter, sys_io_uring_enter)
+#define __NR_io_uring_register 427
+__SYSCALL(__NR_io_uring_register, sys_io_uring_register)
+/* 428 through 439 are reserved */
+#define __NR_process_madvise 440
+__SYSCALL(__NR_process_madvise, sys_process_madvise)
 
 #undef __NR_syscalls
-#define __NR_syscalls 285
+#define __NR_syscalls 441
 
 /*
  * All syscalls below here should go away really,
@@ -73,6 +73,8 @@ enum bpf_cmd {
 	BPF_PROG_LOAD,
 	BPF_OBJ_PIN,
 	BPF_OBJ_GET,
+	BPF_PROG_ATTACH,
+	BPF_PROG_DETACH,
 };
 
 enum bpf_map_type {
@@ -81,6 +83,12 @@ enum bpf_map_type {
 	BPF_MAP_TYPE_ARRAY,
 	BPF_MAP_TYPE_PROG_ARRAY,
 	BPF_MAP_TYPE_PERF_EVENT_ARRAY,
+	BPF_MAP_TYPE_PERCPU_HASH,
+	BPF_MAP_TYPE_PERCPU_ARRAY,
+	BPF_MAP_TYPE_LRU_HASH,
+	BPF_MAP_TYPE_LRU_PERCPU_HASH,
+	BPF_MAP_TYPE_STACK_TRACE,
+	BPF_MAP_TYPE_SOCKMAP,
 };
 
 enum bpf_prog_type {
@@ -89,8 +97,21 @@ enum bpf_prog_type {
 	BPF_PROG_TYPE_KPROBE,
 	BPF_PROG_TYPE_SCHED_CLS,
 	BPF_PROG_TYPE_SCHED_ACT,
+	BPF_PROG_TYPE_XDP,
+	BPF_PROG_TYPE_TRACEPOINT,
+	BPF_PROG_TYPE_SK_SKB,
+	BPF_PROG_TYPE_CGROUP_SKB,
 };
 
+enum bpf_attach_type {
+	BPF_SK_SKB_VERDICT,
+	BPF_CGROUP_INET_INGRESS,
+	BPF_CGROUP_INET_EGRESS,
+	__MAX_BPF_ATTACH_TYPE
+};
+
+#define MAX_BPF_ATTACH_TYPE __MAX_BPF_ATTACH_TYPE
+
 #define BPF_PSEUDO_MAP_FD	1
 
 /* flags for BPF_MAP_UPDATE_ELEM command */
@@ -98,12 +119,22 @@ enum bpf_prog_type {
 #define BPF_NOEXIST	1 /* create new element if it didn't exist */
 #define BPF_EXIST	2 /* update existing element */
 
+/* flags for BPF_MAP_CREATE command */
+#define BPF_F_NO_PREALLOC	(1U << 0) /* allocate hash elements on update */
+
+/* flags for BPF_FUNC_get_stackid */
+#define BPF_F_SKIP_FIELD_MASK	0xffULL
+#define BPF_F_USER_STACK	(1ULL << 8)
+#define BPF_F_FAST_STACK_CMP	(1ULL << 9)
+#define BPF_F_REUSE_STACKID	(1ULL << 10)
+
 union bpf_attr {
 	struct { /* anonymous struct used by BPF_MAP_CREATE command */
 		__u32	map_type;	/* one of enum bpf_map_type */
 		__u32	key_size;	/* size of key in bytes */
 		__u32	value_size;	/* size of value in bytes */
 		__u32	max_entries;	/* max number of entries in a map */
+		__u32	map_flags;	/* BPF_F_* flags */
 	};
 
 	struct { /* anonymous struct used by BPF_MAP_*_ELEM commands */
@@ -131,6 +162,12 @@ union bpf_attr {
 		__aligned_u64	pathname;
 		__u32		bpf_fd;
 	};
+
+	struct { /* anonymous struct used by BPF_PROG_ATTACH/DETACH commands */
+		__u32		target_fd;	/* container object to attach to */
+		__u32		attach_bpf_fd;	/* eBPF program to attach */
+		__u32		attach_type;
+	};
 } __attribute__((aligned(8)));
 
 /* integer value in 'imm' field of BPF_CALL instruction selects which helper
@@ -269,6 +306,52 @@ enum bpf_func_id {
 	 * Return: 0 on success
 	 */
 	BPF_FUNC_perf_event_output,
+
+	/**
+	 * bpf_xdp_load_bytes(xdp, offset, to, len) - copy packet data to stack
+	 * @xdp: pointer to struct xdp_md
+	 * @offset: offset within the frame
+	 * @to: pointer to stack buffer
+	 * @len: number of bytes to copy
+	 * Return: 0 on success
+	 */
+	BPF_FUNC_xdp_load_bytes,
+
+	/**
+	 * bpf_xdp_store_bytes(xdp, offset, from, len) - rewrite packet data
+	 * @xdp: pointer to struct xdp_md
+	 * @offset: offset within the frame
+	 * @from: pointer where to copy bytes from
+	 * @len: number of bytes to store into the frame
+	 * Return: 0 on success
+	 */
+	BPF_FUNC_xdp_store_bytes,
+
+	/**
+	 * bpf_get_stackid(ctx, map, flags) - walk user or kernel stack and
+	 * return its id
+	 * @ctx: struct pt_regs*
+	 * @map: pointer to stack_trace map
+	 * @flags: bits 0-7 - number of stack frames to skip
+	 *         bit 8 - collect user stack instead of kernel
+	 *         bit 9 - compare stacks by hash only
+	 *         bit 10 - if two different stacks hash into the same stackid
+	 *                  discard old
+	 *         other bits - reserved
+	 * Return: >= 0 stackid on success or negative error
+	 */
+	BPF_FUNC_get_stackid,
+
+	/**
+	 * bpf_sk_redirect_map(skb, map, key, flags) - send the data of skb
+	 * out of the socket at index key of a sockmap
+	 * @skb: pointer to skb
+	 * @map: pointer to sockmap
+	 * @key: index of the socket in the map
+	 * @flags: reserved, must be 0
+	 * Return: SK_PASS on success, SK_DROP on error
+	 */
+	BPF_FUNC_sk_redirect_map,
 	__BPF_FUNC_MAX_ID,
 };
 
@@ -298,4 +381,32 @@ struct bpf_tunnel_key {
 	__u32 remote_ipv4;
 };
 
+/* User return codes for XDP prog type.
+ * A valid XDP program must return one of these defined values. All other
+ * return codes are reserved for future use. Unknown return codes will result
+ * in packet drop.
+ */
+enum xdp_action {
+	XDP_ABORTED = 0,
+	XDP_DROP,
+	XDP_PASS,
+	XDP_TX,
+};
+
+/* user accessible metadata for XDP packet hook
+ * new fields must be added to the end of this structure
+ */
+struct xdp_md {
+	__u32 len;
+};
+
+/* Return codes of BPF_PROG_TYPE_SK_SKB programs.  SK_PASS only forwards
+ * the data if bpf_sk_redirect_map() picked a socket, it is dropped
+ * otherwise.
+ */
+enum sk_action {
+	SK_DROP = 0,
+	SK_PASS,
+};
+
 #endif /* _UAPI__LINUX_BPF_H__ */
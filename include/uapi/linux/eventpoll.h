@@ -20,12 +20,20 @@
 
 /* Flags for epoll_create1.  */
 #define EPOLL_CLOEXEC O_CLOEXEC
+#define EPOLL_USERPOLL 1
 
 /* Valid opcodes to issue to sys_epoll_ctl() */
 #define EPOLL_CTL_ADD 1
 #define EPOLL_CTL_DEL 2
 #define EPOLL_CTL_MOD 3
 
+/*
+ * Set exclusive wakeup mode for the target file descriptor: of several
+ * epoll instances watching the same file, only one (or a few) is woken
+ * up per event.
+ */
+#define EPOLLEXCLUSIVE (1 << 28)
+
 /*
  * Request the handling of system wakeup events so as to prevent system suspends
  * from happening while those events are being processed.
@@ -61,6 +69,39 @@ struct epoll_event {
 	__u64 data;
 } EPOLL_PACKED;
 
+/*
+ * An epoll instance created with EPOLL_USERPOLL can be mmap()ed at offset 0
+ * for header_length + index_length bytes.  The kernel keeps one item per
+ * watched descriptor, with the readiness bits ORed into ->ready_events,
+ * and queues the item index on the index ring that follows the header
+ * whenever ->ready_events goes from zero to non-zero.  Userspace consumes
+ * the ring between ->head and ->tail, claims each item's events with an
+ * atomic exchange of ->ready_events against zero, and then advances ->head.
+ * If ->overflow is set, userspace must exchange it back to zero and scan
+ * all items.  epoll_wait() with no event buffer only blocks until the ring
+ * is non-empty.  Only edge triggered descriptors can be added.
+ */
+#define EPOLL_USERPOLL_HEADER_MAGIC 0xeb01eb01
+#define EPOLL_USERPOLL_MAX_ITEMS 4096
+
+struct epoll_uitem {
+	__u32 ready_events;
+	__u32 events;
+	__u64 data;
+};
+
+struct epoll_uheader {
+	__u32 magic;
+	__u32 header_length;	/* header and items, page aligned */
+	__u32 index_length;	/* index ring, page aligned */
+	__u32 max_items_nr;	/* items and index ring entries */
+	__u32 head;		/* written by userspace */
+	__u32 tail;		/* written by the kernel */
+	__u32 overflow;
+	__u32 padding[9];
+	struct epoll_uitem items[];
+};
+
 #ifdef CONFIG_PM_SLEEP
 static inline void ep_take_care_of_epollwakeup(struct epoll_event *epev)
 {
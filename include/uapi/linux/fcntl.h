@@ -33,6 +33,15 @@
 #define F_ADD_SEALS	(F_LINUX_SPECIFIC_BASE + 9)
 #define F_GET_SEALS	(F_LINUX_SPECIFIC_BASE + 10)
 
+/*
+ * Set/Get the number of bytes a pipe queues before it wakes up readers,
+ * and the size of the buffers it uses for large writes
+ */
+#define F_SETPIPE_WAKE	(F_LINUX_SPECIFIC_BASE + 11)
+#define F_GETPIPE_WAKE	(F_LINUX_SPECIFIC_BASE + 12)
+#define F_SETPIPE_BUFSZ	(F_LINUX_SPECIFIC_BASE + 13)
+#define F_GETPIPE_BUFSZ	(F_LINUX_SPECIFIC_BASE + 14)
+
 /*
  * Types of seals
  */
@@ -63,5 +72,10 @@
 #define AT_NO_AUTOMOUNT		0x800	/* Suppress terminal automount traversal */
 #define AT_EMPTY_PATH		0x1000	/* Allow empty relative pathname */
 
+#define AT_STATX_SYNC_TYPE	0x6000	/* Type of synchronisation required from statx() */
+#define AT_STATX_SYNC_AS_STAT	0x0000	/* - Do whatever stat() does */
+#define AT_STATX_FORCE_SYNC	0x2000	/* - Force the attributes to be sync'd with the server */
+#define AT_STATX_DONT_SYNC	0x4000	/* - Don't sync attributes with the server */
+
 
 #endif /* _UAPI_LINUX_FCNTL_H */
@@ -20,6 +20,7 @@
 #define FUTEX_WAKE_BITSET	10
 #define FUTEX_WAIT_REQUEUE_PI	11
 #define FUTEX_CMP_REQUEUE_PI	12
+#define FUTEX_WAIT_MULTIPLE	13
 
 #define FUTEX_PRIVATE_FLAG	128
 #define FUTEX_CLOCK_REALTIME	256
@@ -123,6 +124,21 @@ struct robust_list_head {
  */
 #define FUTEX_BITSET_MATCH_ANY	0xffffffff
 
+/*
+ * FUTEX_WAIT_MULTIPLE: uaddr points to an array of val futex_wait_block
+ * entries. The caller sleeps until one of the futexes is woken and gets
+ * its index back. The optional timeout is absolute, CLOCK_MONOTONIC
+ * unless FUTEX_CLOCK_REALTIME is set. Only FUTEX_PRIVATE_FLAG may be
+ * set in the per-entry flags.
+ */
+#define FUTEX_MULTIPLE_MAX_COUNT	128
+
+struct futex_wait_block {
+	__u64	uaddr;
+	__u32	val;
+	__u32	flags;
+};
+
 
 #define FUTEX_OP_SET		0	/* *(int *)UADDR2 = OPARG; */
 #define FUTEX_OP_ADD		1	/* *(int *)UADDR2 += OPARG; */
@@ -184,6 +184,7 @@ struct kvm_s390_skeys {
 #define KVM_EXIT_SYSTEM_EVENT     24
 #define KVM_EXIT_S390_STSI        25
 #define KVM_EXIT_IOAPIC_EOI       26
+#define KVM_EXIT_DIRTY_RING_FULL  27
 
 /* For KVM_EXIT_INTERNAL_ERROR */
 /* Emulate instruction failed. */
@@ -381,6 +382,27 @@ struct kvm_coalesced_mmio_ring {
 	((PAGE_SIZE - sizeof(struct kvm_coalesced_mmio_ring)) / \
 	 sizeof(struct kvm_coalesced_mmio))
 
+/*
+ * Per-vcpu dirty ring, enabled with KVM_CAP_DIRTY_LOG_RING and mapped
+ * from the vcpu fd at page offset KVM_DIRTY_LOG_PAGE_OFFSET.
+ *
+ * KVM publishes a dirtied page by filling in @slot (address space id in
+ * the upper 16 bits, memslot id in the lower 16) and @offset (page
+ * offset in the memslot) and then setting KVM_DIRTY_GFN_F_DIRTY.
+ * Userspace collects entries in order, sets KVM_DIRTY_GFN_F_RESET on
+ * each, and calls KVM_RESET_DIRTY_RINGS, which write protects the pages
+ * again and hands the entries back to KVM.  A vcpu whose ring is about
+ * to fill up exits with KVM_EXIT_DIRTY_RING_FULL.
+ */
+#define KVM_DIRTY_GFN_F_DIRTY	(1 << 0)
+#define KVM_DIRTY_GFN_F_RESET	(1 << 1)
+
+struct kvm_dirty_gfn {
+	__u32 flags;
+	__u32 slot;
+	__u64 offset;
+};
+
 /* for KVM_TRANSLATE */
 struct kvm_translation {
 	/* in */
@@ -831,6 +853,7 @@ struct kvm_ppc_smmu_info {
 #define KVM_CAP_GUEST_DEBUG_HW_WPS 120
 #define KVM_CAP_SPLIT_IRQCHIP 121
 #define KVM_CAP_IOEVENTFD_ANY_LENGTH 122
+#define KVM_CAP_DIRTY_LOG_RING 123
 
 #ifdef KVM_CAP_IRQ_ROUTING
 
@@ -1218,6 +1241,8 @@ struct kvm_s390_ucas_mapping {
 #define KVM_S390_GET_IRQ_STATE	  _IOW(KVMIO, 0xb6, struct kvm_s390_irq_state)
 /* Available with KVM_CAP_X86_SMM */
 #define KVM_SMI                   _IO(KVMIO,   0xb7)
+/* Available with KVM_CAP_DIRTY_LOG_RING */
+#define KVM_RESET_DIRTY_RINGS     _IO(KVMIO,   0xc7)
 
 #define KVM_DEV_ASSIGN_ENABLE_IOMMU	(1 << 0)
 #define KVM_DEV_ASSIGN_PCI_2_3		(1 << 1)
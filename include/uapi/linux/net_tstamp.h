@@ -9,6 +9,7 @@
 #ifndef _NET_TIMESTAMPING_H
 #define _NET_TIMESTAMPING_H
 
+#include <linux/types.h>
 #include <linux/socket.h>   /* for SO_TIMESTAMPING */
 
 /* SO_TIMESTAMPING gets an integer bit field comprised of these values */
@@ -116,4 +117,13 @@ enum hwtstamp_rx_filters {
 	HWTSTAMP_FILTER_PTP_V2_DELAY_REQ,
 };
 
+/* SO_TXTIME: packets carry their earliest departure time, passed with
+ * SCM_TXTIME as a __u64 in nanoseconds of @clockid.  Only CLOCK_MONOTONIC
+ * is supported, and no flags are defined yet.
+ */
+struct sock_txtime {
+	__kernel_clockid_t	clockid;
+	__u32			flags;
+};
+
 #endif /* _NET_TIMESTAMPING_H */
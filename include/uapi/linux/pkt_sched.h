@@ -801,6 +801,30 @@ struct tc_fq_qd_stats {
 	__u32	pad;
 };
 
+/* Carousel: timing wheel of departure times */
+
+enum {
+	TCA_CAROUSEL_UNSPEC,
+
+	TCA_CAROUSEL_PLIMIT,		/* limit of total number of packets in queue */
+
+	TCA_CAROUSEL_BUCKETS_LOG,	/* log2(number of slots in the wheel) */
+
+	TCA_CAROUSEL_GRANULARITY,	/* time covered by a slot, in ns */
+
+	__TCA_CAROUSEL_MAX
+};
+
+#define TCA_CAROUSEL_MAX	(__TCA_CAROUSEL_MAX - 1)
+
+struct tc_carousel_qd_stats {
+	__u64	horizon_drops;	/* departure time beyond the wheel */
+	__u64	late_packets;	/* departure time already passed */
+	__u64	immediate_packets; /* no departure time */
+	__u32	wheel_packets;	/* packets waiting in the wheel */
+	__u32	pad;
+};
+
 /* Heavy-Hitter Filter */
 
 enum {
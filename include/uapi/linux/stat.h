@@ -1,6 +1,8 @@
 #ifndef _UAPI_LINUX_STAT_H
 #define _UAPI_LINUX_STAT_H
 
+#include <linux/types.h>
+
 
 #if defined(__KERNEL__) || !defined(__GLIBC__) || (__GLIBC__ < 2)
 
@@ -41,5 +43,75 @@
 
 #endif
 
+/*
+ * Timestamp structure for the timestamps in struct statx.
+ */
+struct statx_timestamp {
+	__s64	tv_sec;
+	__u32	tv_nsec;
+	__s32	__reserved;
+};
+
+/*
+ * Structure for the enhanced basic file stats returned by statx().
+ *
+ * The caller passes a mask of the fields it wants; filesystems that have
+ * to ask a server for attributes may then skip the round trip when the
+ * fields wanted are known locally.  stx_mask says which fields were
+ * actually filled in, which may be more or fewer than were asked for.
+ *
+ * The sync behaviour is selected by the AT_STATX_SYNC_TYPE bits of the
+ * flags argument.
+ */
+struct statx {
+	/* 0x00 */
+	__u32	stx_mask;	/* What results were written */
+	__u32	stx_blksize;	/* Preferred general I/O size */
+	__u64	__spare0;
+	/* 0x10 */
+	__u32	stx_nlink;	/* Number of hard links */
+	__u32	stx_uid;	/* User ID of owner */
+	__u32	stx_gid;	/* Group ID of owner */
+	__u16	stx_mode;	/* File mode */
+	__u16	__spare1;
+	/* 0x20 */
+	__u64	stx_ino;	/* Inode number */
+	__u64	stx_size;	/* File size */
+	__u64	stx_blocks;	/* Number of 512-byte blocks allocated */
+	__u64	__spare2;
+	/* 0x40 */
+	struct statx_timestamp	stx_atime;	/* Last access time */
+	struct statx_timestamp	__spare3;
+	struct statx_timestamp	stx_ctime;	/* Last attribute change time */
+	struct statx_timestamp	stx_mtime;	/* Last data modification time */
+	/* 0x80 */
+	__u32	stx_rdev_major;	/* Device ID of special file */
+	__u32	stx_rdev_minor;
+	__u32	stx_dev_major;	/* ID of device containing file */
+	__u32	stx_dev_minor;
+	/* 0x90 */
+	__u64	__spare4[14];	/* Spare space for future expansion */
+	/* 0x100 */
+};
+
+/*
+ * Query request/result mask for statx() and struct statx::stx_mask.
+ */
+#define STATX_TYPE		0x00000001U	/* Want/got stx_mode & S_IFMT */
+#define STATX_MODE		0x00000002U	/* Want/got stx_mode & ~S_IFMT */
+#define STATX_NLINK		0x00000004U	/* Want/got stx_nlink */
+#define STATX_UID		0x00000008U	/* Want/got stx_uid */
+#define STATX_GID		0x00000010U	/* Want/got stx_gid */
+#define STATX_ATIME		0x00000020U	/* Want/got stx_atime */
+#define STATX_MTIME		0x00000040U	/* Want/got stx_mtime */
+#define STATX_CTIME		0x00000080U	/* Want/got stx_ctime */
+#define STATX_INO		0x00000100U	/* Want/got stx_ino */
+#define STATX_SIZE		0x00000200U	/* Want/got stx_size */
+#define STATX_BLOCKS		0x00000400U	/* Want/got stx_blocks */
+#define STATX_BASIC_STATS	0x000007ffU	/* The stuff in the normal stat struct */
+#define STATX_ALL		STATX_BASIC_STATS
+
+#define STATX__RESERVED		0x80000000U	/* Reserved for future struct statx expansion */
+
 
 #endif /* _UAPI_LINUX_STAT_H */
@@ -0,0 +1,139 @@
+/* task_diag.h - batched binary per-task information
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of version 2.1 of the GNU Lesser General Public License
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it would be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+#ifndef _LINUX_TASK_DIAG_H
+#define _LINUX_TASK_DIAG_H
+
+#include <linux/types.h>
+#include <linux/capability.h>
+#include <linux/cgroupstats.h>
+
+/*
+ * TASK_DIAG_CMD_GET is a dump request on the taskstats genetlink family.
+ * The kernel answers with one TASK_DIAG_CMD_NEW message per task, many of
+ * them to a read, each carrying the field groups asked for in
+ * TASK_DIAG_CMD_ATTR_SHOW as fixed layout structures.
+ *
+ * Without a filter every process of the caller's pid namespace is
+ * reported, or every thread with TASK_DIAG_DUMP_THREADS.
+ * TASK_DIAG_CMD_ATTR_PIDS restricts the dump to a set of pids and
+ * TASK_DIAG_CMD_ATTR_CGROUP_FD to the tasks of a cgroup directory.
+ *
+ * TASK_DIAG_STAT and TASK_DIAG_VM are only reported for tasks the caller
+ * could ptrace-read, as in /proc.
+ */
+
+enum {
+	TASK_DIAG_CMD_UNSPEC = __CGROUPSTATS_CMD_MAX,	/* Reserved */
+	TASK_DIAG_CMD_GET,		/* user->kernel dump request */
+	TASK_DIAG_CMD_NEW,		/* kernel->user, one per task */
+	__TASK_DIAG_CMD_MAX,
+};
+
+#define TASK_DIAG_CMD_MAX (__TASK_DIAG_CMD_MAX - 1)
+
+/* Field groups, also the attribute types of TASK_DIAG_CMD_NEW */
+enum {
+	TASK_DIAG_UNSPEC = 0,
+	TASK_DIAG_BASE,			/* struct task_diag_base */
+	TASK_DIAG_CRED,			/* struct task_diag_creds */
+	TASK_DIAG_STAT,			/* struct taskstats */
+	TASK_DIAG_VM,			/* struct task_diag_vm */
+	__TASK_DIAG_MAX,
+};
+
+#define TASK_DIAG_MAX (__TASK_DIAG_MAX - 1)
+
+#define TASK_DIAG_SHOW_BASE	(1ULL << TASK_DIAG_BASE)
+#define TASK_DIAG_SHOW_CRED	(1ULL << TASK_DIAG_CRED)
+#define TASK_DIAG_SHOW_STAT	(1ULL << TASK_DIAG_STAT)
+#define TASK_DIAG_SHOW_VM	(1ULL << TASK_DIAG_VM)
+
+#define TASK_DIAG_SHOW_ALL	(TASK_DIAG_SHOW_BASE | TASK_DIAG_SHOW_CRED | \
+				 TASK_DIAG_SHOW_STAT | TASK_DIAG_SHOW_VM)
+
+enum {
+	TASK_DIAG_CMD_ATTR_UNSPEC = 0,
+	TASK_DIAG_CMD_ATTR_SHOW,	/* __u64 mask of TASK_DIAG_SHOW_* */
+	TASK_DIAG_CMD_ATTR_FLAGS,	/* __u32 TASK_DIAG_DUMP_* */
+	TASK_DIAG_CMD_ATTR_PIDS,	/* array of __u32 pids */
+	TASK_DIAG_CMD_ATTR_CGROUP_FD,	/* __u32 fd of a cgroup directory */
+	__TASK_DIAG_CMD_ATTR_MAX,
+};
+
+#define TASK_DIAG_CMD_ATTR_MAX (__TASK_DIAG_CMD_ATTR_MAX - 1)
+
+/* Report every thread rather than thread group leaders only */
+#define TASK_DIAG_DUMP_THREADS	0x1
+
+/* task_diag_base.state, in the order of the /proc state letters */
+enum {
+	TASK_DIAG_RUNNING,		/* R */
+	TASK_DIAG_INTERRUPTIBLE,	/* S */
+	TASK_DIAG_UNINTERRUPTIBLE,	/* D */
+	TASK_DIAG_STOPPED,		/* T */
+	TASK_DIAG_TRACE_STOP,		/* t */
+	TASK_DIAG_DEAD,			/* X */
+	TASK_DIAG_ZOMBIE,		/* Z */
+};
+
+#define TASK_DIAG_COMM_LEN	16
+
+/* Pids are in the caller's pid namespace, 0 if not visible there */
+struct task_diag_base {
+	__u32	tgid;
+	__u32	pid;
+	__u32	ppid;
+	__u32	tpid;			/* tracer */
+	__u32	sid;
+	__u32	pgid;
+	__u32	state;
+	char	comm[TASK_DIAG_COMM_LEN];
+};
+
+struct task_diag_caps {
+	__u32	cap[_LINUX_CAPABILITY_U32S_3];
+};
+
+/* Ids are in the caller's user namespace */
+struct task_diag_creds {
+	struct task_diag_caps	cap_inheritable;
+	struct task_diag_caps	cap_permitted;
+	struct task_diag_caps	cap_effective;
+	struct task_diag_caps	cap_bset;
+
+	__u32	uid;
+	__u32	euid;
+	__u32	suid;
+	__u32	fsuid;
+	__u32	gid;
+	__u32	egid;
+	__u32	sgid;
+	__u32	fsgid;
+};
+
+/* All counts are in pages, not reported for kernel threads */
+struct task_diag_vm {
+	__u64	total_vm;
+	__u64	hiwater_vm;
+	__u64	locked_vm;
+	__u64	pinned_vm;
+	__u64	shared_vm;
+	__u64	exec_vm;
+	__u64	stack_vm;
+	__u64	hiwater_rss;
+	__u64	file_pages;
+	__u64	anon_pages;
+	__u64	swap_ents;
+	__u64	nr_ptes;
+};
+
+#endif /* _LINUX_TASK_DIAG_H */
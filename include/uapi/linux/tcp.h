@@ -115,6 +115,15 @@ enum {
 #define TCP_CC_INFO		26	/* Get Congestion Control (optional) info */
 #define TCP_SAVE_SYN		27	/* Record SYN headers for new connections */
 #define TCP_SAVED_SYN		28	/* Get SYN headers recorded for connection */
+#define TCP_ULP			31	/* Attach a ULP to a TCP connection */
+#define TCP_ZEROCOPY_RECEIVE	35	/* Map received pages, see tcp_mmap() */
+
+/* setsockopt(fd, IPPROTO_TCP, TCP_ZEROCOPY_RECEIVE, ...) */
+struct tcp_zerocopy_receive {
+	__u64 address;		/* in: address of mapping */
+	__u32 length;		/* in/out: number of bytes to map/mapped */
+	__u32 recv_skip_hint;	/* out: amount of bytes to read with recvmsg */
+};
 
 struct tcp_repair_opt {
 	__u32	opt_code;
@@ -0,0 +1,66 @@
+/*
+ * Userspace interface for memory-mapped ftrace ring buffers.
+ *
+ * A per_cpu/cpuN/trace_pipe_raw file can be mapped read-only:
+ *
+ *	meta = mmap(NULL, len, PROT_READ, MAP_SHARED, fd, 0);
+ *
+ * The first page holds a struct trace_buffer_meta, followed by
+ * meta->nr_subbufs sub-buffers of meta->subbuf_size bytes each, in ID order.
+ * Every sub-buffer starts with the ring buffer page header (see the
+ * events/header_page file) and the writer's commit offset in it tells how
+ * far the page has been filled.
+ *
+ * The consumer owns the reader page. It parses the bytes handed to it in
+ * place and asks for more with
+ *
+ *	ioctl(fd, TRACE_MMAP_IOCTL_GET_READER);
+ *
+ * which marks the previous hand-out consumed and, if that emptied the reader
+ * page, swaps in the oldest written page. No event data is copied.
+ */
+
+#ifndef _UAPI_LINUX_TRACE_MMAP_H
+#define _UAPI_LINUX_TRACE_MMAP_H
+
+#include <linux/types.h>
+
+/**
+ * struct trace_buffer_meta - Ring buffer meta page, first page of the mapping
+ * @meta_page_size:	Size of this page
+ * @meta_struct_len:	Size of this structure
+ * @subbuf_size:	Size of each sub-buffer, header included
+ * @nr_subbufs:		Number of sub-buffers in the mapping
+ * @reader.lost_events:	Events overwritten before the reader page was taken
+ * @reader.id:		ID of the sub-buffer that is the reader page
+ * @reader.read:	Start of the data handed out, offset into the page data
+ * @reader.commit:	End of the data handed out, offset into the page data
+ * @entries:		Events currently in the ring buffer
+ * @overrun:		Events lost to the writer wrapping around
+ * @read:		Events consumed so far
+ *
+ * Only updated by TRACE_MMAP_IOCTL_GET_READER and resets of the buffer.
+ */
+struct trace_buffer_meta {
+	__u32	meta_page_size;
+	__u32	meta_struct_len;
+
+	__u32	subbuf_size;
+	__u32	nr_subbufs;
+
+	struct {
+		__u64	lost_events;
+		__u32	id;
+		__u32	read;
+		__u32	commit;
+		__u32	__reserved;
+	} reader;
+
+	__u64	entries;
+	__u64	overrun;
+	__u64	read;
+};
+
+#define TRACE_MMAP_IOCTL_GET_READER	_IO('R', 0x20)
+
+#endif /* _UAPI_LINUX_TRACE_MMAP_H */
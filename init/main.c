@@ -488,7 +488,6 @@ static void __init mm_init(void)
 	page_ext_init_flatmem();
 	mem_init();
 	kmem_cache_init();
-	percpu_init_late();
 	pgtable_init();
 	vmalloc_init();
 	ioremap_huge_init();
@@ -820,6 +819,15 @@ extern initcall_t __initcall6_start[];
 extern initcall_t __initcall7_start[];
 extern initcall_t __initcall_end[];
 
+extern initcall_t __initcall0_serial[], __initcall0_sync[];
+extern initcall_t __initcall1_serial[], __initcall1_sync[];
+extern initcall_t __initcall2_serial[], __initcall2_sync[];
+extern initcall_t __initcall3_serial[], __initcall3_sync[];
+extern initcall_t __initcall4_serial[], __initcall4_sync[];
+extern initcall_t __initcall5_serial[], __initcall5_sync[];
+extern initcall_t __initcall6_serial[], __initcall6_sync[];
+extern initcall_t __initcall7_serial[], __initcall7_sync[];
+
 static initcall_t *initcall_levels[] __initdata = {
 	__initcall0_start,
 	__initcall1_start,
@@ -832,6 +840,29 @@ static initcall_t *initcall_levels[] __initdata = {
 	__initcall_end,
 };
 
+/* Each level: parallel initcalls, then plain ones, then _sync ones */
+static initcall_t *initcall_serial[] __initdata = {
+	__initcall0_serial,
+	__initcall1_serial,
+	__initcall2_serial,
+	__initcall3_serial,
+	__initcall4_serial,
+	__initcall5_serial,
+	__initcall6_serial,
+	__initcall7_serial,
+};
+
+static initcall_t *initcall_sync[] __initdata = {
+	__initcall0_sync,
+	__initcall1_sync,
+	__initcall2_sync,
+	__initcall3_sync,
+	__initcall4_sync,
+	__initcall5_sync,
+	__initcall6_sync,
+	__initcall7_sync,
+};
+
 /* Keep these in sync with initcalls in include/linux/init.h */
 static char *initcall_level_names[] __initdata = {
 	"early",
@@ -844,9 +875,48 @@ static char *initcall_level_names[] __initdata = {
 	"late",
 };
 
+/*
+ * Exclusive, so that parallel initcalls can use async_synchronize_full()
+ * without waiting for themselves.
+ */
+static ASYNC_DOMAIN_EXCLUSIVE(initcall_domain);
+
+static bool initcall_nopar __initdata;
+
+static int __init set_initcall_nopar(char *str)
+{
+	initcall_nopar = true;
+	return 1;
+}
+__setup("initcall_nopar", set_initcall_nopar);
+
+/* The longest running parallel initcall of the level, for initcall_debug */
+static DEFINE_SPINLOCK(initcall_par_lock);
+static initcall_t initcall_par_slowest __initdata;
+static s64 initcall_par_slowest_ns __initdata;
+
+static void __init do_one_initcall_async(void *data, async_cookie_t cookie)
+{
+	initcall_t fn = *(initcall_t *)data;
+	ktime_t calltime = ktime_get();
+	s64 delta;
+
+	do_one_initcall(fn);
+
+	delta = ktime_to_ns(ktime_sub(ktime_get(), calltime));
+	spin_lock(&initcall_par_lock);
+	if (delta > initcall_par_slowest_ns) {
+		initcall_par_slowest_ns = delta;
+		initcall_par_slowest = fn;
+	}
+	spin_unlock(&initcall_par_lock);
+}
+
 static void __init do_initcall_level(int level)
 {
+	ktime_t calltime = ktime_get();
 	initcall_t *fn;
+	s64 delta;
 
 	strcpy(initcall_command_line, saved_command_line);
 	parse_args(initcall_level_names[level],
@@ -855,8 +925,33 @@ static void __init do_initcall_level(int level)
 		   level, level,
 		   NULL, &repair_env_string);
 
-	for (fn = initcall_levels[level]; fn < initcall_levels[level+1]; fn++)
+	initcall_par_slowest = NULL;
+	initcall_par_slowest_ns = 0;
+
+	for (fn = initcall_levels[level]; fn < initcall_serial[level]; fn++) {
+		if (initcall_nopar)
+			do_one_initcall(*fn);
+		else
+			async_schedule_domain(do_one_initcall_async, fn,
+					      &initcall_domain);
+	}
+	for (; fn < initcall_sync[level]; fn++)
+		do_one_initcall(*fn);
+	async_synchronize_full_domain(&initcall_domain);
+	for (; fn < initcall_levels[level+1]; fn++)
 		do_one_initcall(*fn);
+
+	/*
+	 * When the two are close, the slowest parallel initcall is what
+	 * the level waited for.
+	 */
+	if (initcall_debug && initcall_par_slowest) {
+		delta = ktime_to_ns(ktime_sub(ktime_get(), calltime));
+		printk(KERN_DEBUG "initcall level %s took %lld usecs, slowest parallel initcall %pF took %lld usecs\n",
+		       initcall_level_names[level],
+		       (long long)delta >> 10, initcall_par_slowest,
+		       (long long)initcall_par_slowest_ns >> 10);
+	}
 }
 
 static void __init do_initcalls(void)
@@ -1216,6 +1216,7 @@ long do_shmat(int shmid, char __user *shmaddr, int shmflg, ulong *raddr,
 	if (IS_ERR_VALUE(addr))
 		err = (long)addr;
 invalid:
+	vma_end_write_all(current->mm);
 	up_write(&current->mm->mmap_sem);
 	if (populate)
 		mm_populate(addr, populate);
@@ -1357,6 +1358,7 @@ SYSCALL_DEFINE1(shmdt, char __user *, shmaddr)
 
 #endif
 
+	vma_end_write_all(mm);
 	up_write(&mm->mmap_sem);
 	return retval;
 }
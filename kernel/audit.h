@@ -256,6 +256,9 @@ extern struct mutex audit_filter_mutex;
 extern int audit_del_rule(struct audit_entry *);
 extern void audit_free_rule_rcu(struct rcu_head *);
 extern struct list_head audit_filter_list[];
+#ifdef CONFIG_AUDITSYSCALL
+extern u32 audit_syscall_mask[AUDIT_BITMASK_SIZE];
+#endif
 
 extern struct audit_entry *audit_dupe_rule(struct audit_krule *old);
 
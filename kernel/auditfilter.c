@@ -897,6 +897,39 @@ out:
 static u64 prio_low = ~0ULL/2;
 static u64 prio_high = ~0ULL/2 - 1;
 
+#ifdef CONFIG_AUDITSYSCALL
+static inline bool audit_is_syscall_list(int listnr)
+{
+	return listnr == AUDIT_FILTER_ENTRY || listnr == AUDIT_FILTER_EXIT;
+}
+
+/*
+ * Rebuild the mask of syscalls any syscall rule can match, used by
+ * __audit_syscall_entry() to skip filtering for all others.  Rules that
+ * go away without passing through here only leave stale bits, which
+ * cost time but never lose records.
+ *
+ * Caller must hold audit_filter_mutex.
+ */
+static void audit_update_syscalls(void)
+{
+	u32 mask[AUDIT_BITMASK_SIZE] = { 0 };
+	struct audit_krule *r;
+	int i, listnr;
+
+	for (listnr = 0; listnr < AUDIT_NR_FILTERS; listnr++) {
+		if (!audit_is_syscall_list(listnr))
+			continue;
+		list_for_each_entry(r, &audit_rules_list[listnr], list)
+			for (i = 0; i < AUDIT_BITMASK_SIZE; i++)
+				mask[i] |= r->mask[i];
+	}
+
+	for (i = 0; i < AUDIT_BITMASK_SIZE; i++)
+		WRITE_ONCE(audit_syscall_mask[i], mask[i]);
+}
+#endif
+
 /* Add rule to given filterlist if not a duplicate. */
 static inline int audit_add_rule(struct audit_entry *entry)
 {
@@ -971,6 +1004,9 @@ static inline int audit_add_rule(struct audit_entry *entry)
 
 	if (!audit_match_signal(entry))
 		audit_signals++;
+
+	if (audit_is_syscall_list(entry->rule.listnr))
+		audit_update_syscalls();
 #endif
 	mutex_unlock(&audit_filter_mutex);
 
@@ -1021,6 +1057,11 @@ int audit_del_rule(struct audit_entry *entry)
 	list_del(&e->rule.list);
 	call_rcu(&e->rcu, audit_free_rule_rcu);
 
+#ifdef CONFIG_AUDITSYSCALL
+	if (audit_is_syscall_list(entry->rule.listnr))
+		audit_update_syscalls();
+#endif
+
 out:
 	mutex_unlock(&audit_filter_mutex);
 
@@ -94,6 +94,9 @@ int audit_n_rules;
 /* determines whether we collect data for signals sent */
 int audit_signals;
 
+/* syscalls named by any syscall filter rule, see audit_update_syscalls() */
+u32 audit_syscall_mask[AUDIT_BITMASK_SIZE];
+
 struct audit_aux_data {
 	struct audit_aux_data	*next;
 	int			type;
@@ -740,6 +743,17 @@ static int audit_in_mask(const struct audit_krule *rule, unsigned long val)
 	return rule->mask[word] & bit;
 }
 
+/* Can any syscall filter rule match @major at all? */
+static inline bool audit_syscall_audited(int major)
+{
+	unsigned int word = AUDIT_WORD((unsigned int)major);
+
+	if (word >= AUDIT_BITMASK_SIZE)
+		return false;
+
+	return READ_ONCE(audit_syscall_mask[word]) & AUDIT_BIT(major);
+}
+
 /* At syscall entry and exit time, this filter is called if the
  * audit_state is not low enough that auditing cannot take place, but is
  * also not high enough that we already know we have to write an audit
@@ -1517,7 +1531,15 @@ void __audit_syscall_entry(int major, unsigned long a1, unsigned long a2,
 	context->dummy = !audit_n_rules;
 	if (!context->dummy && state == AUDIT_BUILD_CONTEXT) {
 		context->prio = 0;
-		state = audit_filter_syscall(tsk, context, &audit_filter_list[AUDIT_FILTER_ENTRY]);
+		/*
+		 * If no rule names this syscall, neither the entry nor the
+		 * exit filters can match it, so there is nothing to filter
+		 * or to collect: treat it as if there were no rules.
+		 */
+		if (likely(!audit_syscall_audited(major)))
+			context->dummy = 1;
+		else
+			state = audit_filter_syscall(tsk, context, &audit_filter_list[AUDIT_FILTER_ENTRY]);
 	}
 	if (state == AUDIT_DISABLED)
 		return;
@@ -13,38 +13,187 @@
 #include <linux/jhash.h>
 #include <linux/filter.h>
 #include <linux/vmalloc.h>
+#include <linux/percpu.h>
+#include "percpu_freelist.h"
+#include "bpf_lru_list.h"
+
+struct bucket {
+	struct hlist_head head;
+	raw_spinlock_t lock;
+};
 
 struct bpf_htab {
 	struct bpf_map map;
-	struct hlist_head *buckets;
-	raw_spinlock_t lock;
-	u32 count;	/* number of elements in this hashtable */
+	struct bucket *buckets;
+	void *elems;	/* preallocated elements, unless BPF_F_NO_PREALLOC */
+	union {
+		struct pcpu_freelist freelist;
+		struct bpf_lru lru;	/* LRU maps */
+	};
+	atomic_t count;	/* number of elements in this hashtable */
 	u32 n_buckets;	/* number of hash buckets */
 	u32 elem_size;	/* size of each element in bytes */
 };
 
-/* each htab element is struct htab_elem + key + value */
+/* each htab element is struct htab_elem + key + value, the value of a
+ * per-cpu hash element is a pointer to its per-cpu value area
+ */
 struct htab_elem {
 	struct hlist_node hash_node;
-	struct rcu_head rcu;
-	u32 hash;
+	union {
+		struct rcu_head rcu;
+		struct pcpu_freelist_node fnode;	/* preallocated maps */
+		struct bpf_lru_node lru_node;		/* LRU maps */
+	};
+	union {
+		u32 hash;
+		u32 key_size;	/* for the RCU callback of a per-cpu elem */
+	};
 	char key[0] __aligned(8);
 };
 
+static bool htab_is_lru(const struct bpf_htab *htab)
+{
+	return htab->map.map_type == BPF_MAP_TYPE_LRU_HASH ||
+	       htab->map.map_type == BPF_MAP_TYPE_LRU_PERCPU_HASH;
+}
+
+static bool htab_is_percpu(const struct bpf_htab *htab)
+{
+	return htab->map.map_type == BPF_MAP_TYPE_PERCPU_HASH ||
+	       htab->map.map_type == BPF_MAP_TYPE_LRU_PERCPU_HASH;
+}
+
+static bool htab_is_prealloc(const struct bpf_htab *htab)
+{
+	return !(htab->map.map_flags & BPF_F_NO_PREALLOC);
+}
+
+static inline void htab_elem_set_ptr(struct htab_elem *l, u32 key_size,
+				     void __percpu *pptr)
+{
+	*(void __percpu **)(l->key + key_size) = pptr;
+}
+
+static inline void __percpu *htab_elem_get_ptr(struct htab_elem *l, u32 key_size)
+{
+	return *(void __percpu **)(l->key + key_size);
+}
+
+static struct htab_elem *get_htab_elem(struct bpf_htab *htab, int i)
+{
+	return (struct htab_elem *) (htab->elems + i * htab->elem_size);
+}
+
+/* One spare element per cpu, so that replacing the value of an existing
+ * key still finds a free element when the map is full.  LRU maps evict
+ * an older element instead.
+ */
+static u32 htab_prealloc_entries(struct bpf_htab *htab)
+{
+	if (htab_is_lru(htab))
+		return htab->map.max_entries;
+	return htab->map.max_entries + num_possible_cpus();
+}
+
+static void htab_free_elems(struct bpf_htab *htab)
+{
+	int i;
+
+	if (htab_is_percpu(htab)) {
+		for (i = 0; i < htab_prealloc_entries(htab); i++)
+			free_percpu(htab_elem_get_ptr(get_htab_elem(htab, i),
+					round_up(htab->map.key_size, 8)));
+	}
+	vfree(htab->elems);
+}
+
+static bool htab_lru_map_delete_node(void *arg, struct bpf_lru_node *node);
+
+static int prealloc_init(struct bpf_htab *htab)
+{
+	u32 num_entries = htab_prealloc_entries(htab);
+	int err = -ENOMEM, i;
+
+	htab->elems = vzalloc((u64) htab->elem_size * num_entries);
+	if (!htab->elems)
+		return -ENOMEM;
+
+	if (htab_is_percpu(htab)) {
+		u32 size = round_up(htab->map.value_size, 8);
+		void __percpu *pptr;
+
+		for (i = 0; i < num_entries; i++) {
+			pptr = __alloc_percpu_gfp(size, 8,
+						  GFP_USER | __GFP_NOWARN);
+			if (!pptr)
+				goto free_elems;
+			htab_elem_set_ptr(get_htab_elem(htab, i),
+					  round_up(htab->map.key_size, 8),
+					  pptr);
+		}
+	}
+
+	if (htab_is_lru(htab)) {
+		err = bpf_lru_init(&htab->lru,
+				   offsetof(struct htab_elem, hash) -
+				   offsetof(struct htab_elem, lru_node),
+				   htab_lru_map_delete_node, htab);
+		if (err)
+			goto free_elems;
+
+		bpf_lru_populate(&htab->lru, htab->elems,
+				 offsetof(struct htab_elem, lru_node),
+				 htab->elem_size, num_entries);
+		return 0;
+	}
+
+	err = pcpu_freelist_init(&htab->freelist);
+	if (err)
+		goto free_elems;
+
+	pcpu_freelist_populate(&htab->freelist,
+			       htab->elems + offsetof(struct htab_elem, fnode),
+			       htab->elem_size, num_entries);
+	return 0;
+
+free_elems:
+	htab_free_elems(htab);
+	return err;
+}
+
 /* Called from syscall */
 static struct bpf_map *htab_map_alloc(union bpf_attr *attr)
 {
+	bool percpu = (attr->map_type == BPF_MAP_TYPE_PERCPU_HASH ||
+		       attr->map_type == BPF_MAP_TYPE_LRU_PERCPU_HASH);
+	bool lru = (attr->map_type == BPF_MAP_TYPE_LRU_HASH ||
+		    attr->map_type == BPF_MAP_TYPE_LRU_PERCPU_HASH);
 	struct bpf_htab *htab;
+	u32 num_entries;
 	int err, i;
+	u64 cost;
+
+	if (attr->map_flags & ~BPF_F_NO_PREALLOC)
+		/* reserved bits should not be used */
+		return ERR_PTR(-EINVAL);
+
+	if (lru && (attr->map_flags & BPF_F_NO_PREALLOC))
+		/* eviction works on the preallocated elements, and
+		 * kmalloc() in the update path is what LRU maps avoid
+		 */
+		return ERR_PTR(-EINVAL);
 
 	htab = kzalloc(sizeof(*htab), GFP_USER);
 	if (!htab)
 		return ERR_PTR(-ENOMEM);
 
 	/* mandatory map attributes */
+	htab->map.map_type = attr->map_type;
 	htab->map.key_size = attr->key_size;
 	htab->map.value_size = attr->value_size;
 	htab->map.max_entries = attr->max_entries;
+	htab->map.map_flags = attr->map_flags;
 
 	/* check sanity of attributes.
 	 * value_size == 0 may be allowed in the future to use map as a set
@@ -69,47 +218,73 @@ static struct bpf_map *htab_map_alloc(union bpf_attr *attr)
 		/* if value_size is bigger, the user space won't be able to
 		 * access the elements via bpf syscall. This check also makes
 		 * sure that the elem_size doesn't overflow and it's
-		 * kmalloc-able later in htab_map_update_elem()
+		 * kmalloc-able later in alloc_htab_elem()
 		 */
 		goto free_htab;
 
+	if (percpu && round_up(htab->map.value_size, 8) > PCPU_MIN_UNIT_SIZE)
+		/* make sure the size for pcpu_alloc() is reasonable */
+		goto free_htab;
+
 	htab->elem_size = sizeof(struct htab_elem) +
-			  round_up(htab->map.key_size, 8) +
-			  htab->map.value_size;
+			  round_up(htab->map.key_size, 8);
+	if (percpu)
+		htab->elem_size += sizeof(void *);
+	else
+		htab->elem_size += htab->map.value_size;
+
+	num_entries = htab->map.max_entries;
+	if (htab_is_prealloc(htab)) {
+		/* elements are laid out back to back */
+		htab->elem_size = round_up(htab->elem_size, 8);
+		num_entries = htab_prealloc_entries(htab);
+	}
 
 	/* prevent zero size kmalloc and check for u32 overflow */
 	if (htab->n_buckets == 0 ||
-	    htab->n_buckets > U32_MAX / sizeof(struct hlist_head))
+	    htab->n_buckets > U32_MAX / sizeof(struct bucket))
 		goto free_htab;
 
-	if ((u64) htab->n_buckets * sizeof(struct hlist_head) +
-	    (u64) htab->elem_size * htab->map.max_entries >=
-	    U32_MAX - PAGE_SIZE)
+	cost = (u64) htab->n_buckets * sizeof(struct bucket) +
+	       (u64) htab->elem_size * num_entries;
+
+	if (percpu)
+		cost += (u64) round_up(htab->map.value_size, 8) *
+			num_possible_cpus() * num_entries;
+
+	if (cost >= U32_MAX - PAGE_SIZE)
 		/* make sure page count doesn't overflow */
 		goto free_htab;
 
-	htab->map.pages = round_up(htab->n_buckets * sizeof(struct hlist_head) +
-				   htab->elem_size * htab->map.max_entries,
-				   PAGE_SIZE) >> PAGE_SHIFT;
+	htab->map.pages = round_up(cost, PAGE_SIZE) >> PAGE_SHIFT;
 
 	err = -ENOMEM;
-	htab->buckets = kmalloc_array(htab->n_buckets, sizeof(struct hlist_head),
+	htab->buckets = kmalloc_array(htab->n_buckets, sizeof(struct bucket),
 				      GFP_USER | __GFP_NOWARN);
 
 	if (!htab->buckets) {
-		htab->buckets = vmalloc(htab->n_buckets * sizeof(struct hlist_head));
+		htab->buckets = vmalloc(htab->n_buckets * sizeof(struct bucket));
 		if (!htab->buckets)
 			goto free_htab;
 	}
 
-	for (i = 0; i < htab->n_buckets; i++)
-		INIT_HLIST_HEAD(&htab->buckets[i]);
+	for (i = 0; i < htab->n_buckets; i++) {
+		INIT_HLIST_HEAD(&htab->buckets[i].head);
+		raw_spin_lock_init(&htab->buckets[i].lock);
+	}
 
-	raw_spin_lock_init(&htab->lock);
-	htab->count = 0;
+	atomic_set(&htab->count, 0);
+
+	if (htab_is_prealloc(htab)) {
+		err = prealloc_init(htab);
+		if (err)
+			goto free_buckets;
+	}
 
 	return &htab->map;
 
+free_buckets:
+	kvfree(htab->buckets);
 free_htab:
 	kfree(htab);
 	return ERR_PTR(err);
@@ -120,11 +295,16 @@ static inline u32 htab_map_hash(const void *key, u32 key_len)
 	return jhash(key, key_len, 0);
 }
 
-static inline struct hlist_head *select_bucket(struct bpf_htab *htab, u32 hash)
+static inline struct bucket *__select_bucket(struct bpf_htab *htab, u32 hash)
 {
 	return &htab->buckets[hash & (htab->n_buckets - 1)];
 }
 
+static inline struct hlist_head *select_bucket(struct bpf_htab *htab, u32 hash)
+{
+	return &__select_bucket(htab, hash)->head;
+}
+
 static struct htab_elem *lookup_elem_raw(struct hlist_head *head, u32 hash,
 					 void *key, u32 key_size)
 {
@@ -137,12 +317,39 @@ static struct htab_elem *lookup_elem_raw(struct hlist_head *head, u32 hash,
 	return NULL;
 }
 
-/* Called from syscall or from eBPF program */
-static void *htab_map_lookup_elem(struct bpf_map *map, void *key)
+/* Called by the LRU list, without any bucket lock held, to unlink an
+ * element it wants to reuse.  Fails if the element is not in the table
+ * (anymore, or not yet).
+ */
+static bool htab_lru_map_delete_node(void *arg, struct bpf_lru_node *node)
+{
+	struct bpf_htab *htab = (struct bpf_htab *)arg;
+	struct htab_elem *l = NULL, *tgt_l;
+	struct hlist_head *head;
+	unsigned long flags;
+	struct bucket *b;
+
+	tgt_l = container_of(node, struct htab_elem, lru_node);
+	b = __select_bucket(htab, tgt_l->hash);
+	head = &b->head;
+
+	raw_spin_lock_irqsave(&b->lock, flags);
+
+	hlist_for_each_entry_rcu(l, head, hash_node)
+		if (l == tgt_l) {
+			hlist_del_rcu(&l->hash_node);
+			break;
+		}
+
+	raw_spin_unlock_irqrestore(&b->lock, flags);
+
+	return l == tgt_l;
+}
+
+static struct htab_elem *__htab_map_lookup_elem(struct bpf_map *map, void *key)
 {
 	struct bpf_htab *htab = container_of(map, struct bpf_htab, map);
 	struct hlist_head *head;
-	struct htab_elem *l;
 	u32 hash, key_size;
 
 	/* Must be called with rcu_read_lock. */
@@ -154,7 +361,13 @@ static void *htab_map_lookup_elem(struct bpf_map *map, void *key)
 
 	head = select_bucket(htab, hash);
 
-	l = lookup_elem_raw(head, hash, key, key_size);
+	return lookup_elem_raw(head, hash, key, key_size);
+}
+
+/* Called from syscall or from eBPF program */
+static void *htab_map_lookup_elem(struct bpf_map *map, void *key)
+{
+	struct htab_elem *l = __htab_map_lookup_elem(map, key);
 
 	if (l)
 		return l->key + round_up(map->key_size, 8);
@@ -162,6 +375,76 @@ static void *htab_map_lookup_elem(struct bpf_map *map, void *key)
 	return NULL;
 }
 
+/* Called from syscall or from eBPF program, a hit only sets the ref bit
+ * of the elem and leaves moving it around the LRU lists to the next refill
+ */
+static void *htab_lru_map_lookup_elem(struct bpf_map *map, void *key)
+{
+	struct htab_elem *l = __htab_map_lookup_elem(map, key);
+
+	if (l) {
+		bpf_lru_node_set_ref(&l->lru_node);
+		return l->key + round_up(map->key_size, 8);
+	}
+
+	return NULL;
+}
+
+/* Called from eBPF program */
+static void *htab_percpu_map_lookup_elem(struct bpf_map *map, void *key)
+{
+	struct htab_elem *l = __htab_map_lookup_elem(map, key);
+
+	if (l)
+		return this_cpu_ptr(htab_elem_get_ptr(l,
+						      round_up(map->key_size, 8)));
+
+	return NULL;
+}
+
+/* Called from eBPF program */
+static void *htab_lru_percpu_map_lookup_elem(struct bpf_map *map, void *key)
+{
+	struct htab_elem *l = __htab_map_lookup_elem(map, key);
+
+	if (l) {
+		bpf_lru_node_set_ref(&l->lru_node);
+		return this_cpu_ptr(htab_elem_get_ptr(l,
+						      round_up(map->key_size, 8)));
+	}
+
+	return NULL;
+}
+
+/* Called from syscall, copies out the values of all possible cpus */
+int bpf_percpu_hash_copy(struct bpf_map *map, void *key, void *value)
+{
+	struct htab_elem *l;
+	void __percpu *pptr;
+	int ret = -ENOENT;
+	int cpu, off = 0;
+	u32 size;
+
+	/* per_cpu areas are zero-filled and bpf programs can only
+	 * access 'value_size' of them, so copying rounded areas
+	 * will not leak any kernel data
+	 */
+	size = round_up(map->value_size, 8);
+	rcu_read_lock();
+	l = __htab_map_lookup_elem(map, key);
+	if (!l)
+		goto out;
+	pptr = htab_elem_get_ptr(l, round_up(map->key_size, 8));
+	for_each_possible_cpu(cpu) {
+		memcpy(value + off, per_cpu_ptr(pptr, cpu), size);
+		off += size;
+	}
+	ret = 0;
+out:
+	rcu_read_unlock();
+	return ret;
+}
+
 /* Called from syscall */
 static int htab_map_get_next_key(struct bpf_map *map, void *key, void *next_key)
 {
@@ -220,6 +503,165 @@ find_first_elem:
 	return -ENOENT;
 }
 
+static void htab_percpu_elem_free(struct htab_elem *l)
+{
+	free_percpu(htab_elem_get_ptr(l, l->key_size));
+	kfree(l);
+}
+
+static void htab_percpu_elem_rcu_free(struct rcu_head *head)
+{
+	struct htab_elem *l = container_of(head, struct htab_elem, rcu);
+
+	htab_percpu_elem_free(l);
+}
+
+/* Free an element that was unlinked under its bucket lock.  Preallocated
+ * elements go straight back to the freelist: a program that still holds
+ * a pointer to the value may see it reused for another key, the price of
+ * never allocating in the update path.
+ */
+static void free_htab_elem(struct bpf_htab *htab, struct htab_elem *l)
+{
+	if (htab_is_prealloc(htab)) {
+		pcpu_freelist_push(&htab->freelist, &l->fnode);
+	} else if (htab_is_percpu(htab)) {
+		/* 'hash' isn't needed anymore, lookups that still walk
+		 * over this elem also compare the key
+		 */
+		l->key_size = round_up(htab->map.key_size, 8);
+		call_rcu(&l->rcu, htab_percpu_elem_rcu_free);
+	} else {
+		kfree_rcu(l, rcu);
+	}
+}
+
+static void pcpu_copy_value(struct bpf_htab *htab, void __percpu *pptr,
+			    void *value, bool onallcpus)
+{
+	if (!onallcpus) {
+		/* a program only ever updates the copy of its own cpu */
+		memcpy(this_cpu_ptr(pptr), value, htab->map.value_size);
+	} else {
+		u32 size = round_up(htab->map.value_size, 8);
+		int off = 0, cpu;
+
+		for_each_possible_cpu(cpu) {
+			memcpy(per_cpu_ptr(pptr, cpu), value + off, size);
+			off += size;
+		}
+	}
+}
+
+/* A preallocated elem may still hold the values of a deleted key, clear
+ * the copies of the cpus the program doesn't set
+ */
+static void pcpu_init_value(struct bpf_htab *htab, void __percpu *pptr,
+			    void *value, bool onallcpus)
+{
+	if (htab_is_prealloc(htab) && !onallcpus) {
+		u32 size = round_up(htab->map.value_size, 8);
+		int cpu;
+
+		for_each_possible_cpu(cpu)
+			memset(per_cpu_ptr(pptr, cpu), 0, size);
+	}
+	pcpu_copy_value(htab, pptr, value, onallcpus);
+}
+
+/* Called with the bucket lock held */
+static struct htab_elem *alloc_htab_elem(struct bpf_htab *htab, void *key,
+					 void *value, u32 key_size, u32 hash,
+					 bool onallcpus, bool old_elem_exists)
+{
+	bool percpu = htab_is_percpu(htab);
+	struct pcpu_freelist_node *node;
+	struct htab_elem *l_new;
+	void __percpu *pptr;
+
+	if (!old_elem_exists &&
+	    atomic_inc_return(&htab->count) > htab->map.max_entries) {
+		/* if elem with this 'key' doesn't exist and we've reached
+		 * max_entries limit, fail insertion of new elem
+		 */
+		atomic_dec(&htab->count);
+		return ERR_PTR(-E2BIG);
+	}
+
+	if (htab_is_prealloc(htab)) {
+		node = pcpu_freelist_pop(&htab->freelist);
+		if (!node) {
+			l_new = ERR_PTR(-E2BIG);
+			goto err;
+		}
+		l_new = container_of(node, struct htab_elem, fnode);
+		if (percpu) {
+			pptr = htab_elem_get_ptr(l_new, round_up(key_size, 8));
+			pcpu_init_value(htab, pptr, value, onallcpus);
+		}
+	} else {
+		l_new = kmalloc(htab->elem_size, GFP_ATOMIC | __GFP_NOWARN);
+		if (!l_new) {
+			l_new = ERR_PTR(-ENOMEM);
+			goto err;
+		}
+		if (percpu) {
+			/* zero-filled, see bpf_percpu_hash_copy() */
+			pptr = __alloc_percpu_gfp(round_up(htab->map.value_size, 8),
+						  8, GFP_ATOMIC | __GFP_NOWARN);
+			if (!pptr) {
+				kfree(l_new);
+				l_new = ERR_PTR(-ENOMEM);
+				goto err;
+			}
+			pcpu_copy_value(htab, pptr, value, onallcpus);
+			htab_elem_set_ptr(l_new, round_up(key_size, 8), pptr);
+		}
+	}
+
+	memcpy(l_new->key, key, key_size);
+	if (!percpu)
+		memcpy(l_new->key + round_up(key_size, 8), value,
+		       htab->map.value_size);
+
+	l_new->hash = hash;
+	return l_new;
+err:
+	if (!old_elem_exists)
+		atomic_dec(&htab->count);
+	return l_new;
+}
+
+static int check_flags(struct htab_elem *l_old, u64 map_flags)
+{
+	if (l_old && map_flags == BPF_NOEXIST)
+		/* elem already exists */
+		return -EEXIST;
+
+	if (!l_old && map_flags == BPF_EXIST)
+		/* elem doesn't exist, cannot update it */
+		return -ENOENT;
+
+	return 0;
+}
+
+/* Takes a free elem off the LRU lists, evicting an older one if needed.
+ * Must be called without any bucket lock held.
+ */
+static struct htab_elem *prealloc_lru_pop(struct bpf_htab *htab, void *key,
+					  u32 hash)
+{
+	struct bpf_lru_node *node = bpf_lru_pop_free(&htab->lru, hash);
+	struct htab_elem *l;
+
+	if (!node)
+		return NULL;
+
+	l = container_of(node, struct htab_elem, lru_node);
+	memcpy(l->key, key, htab->map.key_size);
+	return l;
+}
+
 /* Called from syscall or from eBPF program */
 static int htab_map_update_elem(struct bpf_map *map, void *key, void *value,
 				u64 map_flags)
@@ -228,7 +670,8 @@ static int htab_map_update_elem(struct bpf_map *map, void *key, void *value,
 	struct htab_elem *l_new, *l_old;
 	struct hlist_head *head;
 	unsigned long flags;
-	u32 key_size;
+	struct bucket *b;
+	u32 key_size, hash;
 	int ret;
 
 	if (map_flags > BPF_EXIST)
@@ -237,64 +680,254 @@ static int htab_map_update_elem(struct bpf_map *map, void *key, void *value,
 
 	WARN_ON_ONCE(!rcu_read_lock_held());
 
-	/* allocate new element outside of lock */
-	l_new = kmalloc(htab->elem_size, GFP_ATOMIC | __GFP_NOWARN);
-	if (!l_new)
-		return -ENOMEM;
-
 	key_size = map->key_size;
 
-	memcpy(l_new->key, key, key_size);
-	memcpy(l_new->key + round_up(key_size, 8), value, map->value_size);
+	hash = htab_map_hash(key, key_size);
 
-	l_new->hash = htab_map_hash(l_new->key, key_size);
+	b = __select_bucket(htab, hash);
+	head = &b->head;
 
 	/* bpf_map_update_elem() can be called in_irq() */
-	raw_spin_lock_irqsave(&htab->lock, flags);
+	raw_spin_lock_irqsave(&b->lock, flags);
 
-	head = select_bucket(htab, l_new->hash);
+	l_old = lookup_elem_raw(head, hash, key, key_size);
 
-	l_old = lookup_elem_raw(head, l_new->hash, key, key_size);
+	ret = check_flags(l_old, map_flags);
+	if (ret)
+		goto err;
 
-	if (!l_old && unlikely(htab->count >= map->max_entries)) {
-		/* if elem with this 'key' doesn't exist and we've reached
-		 * max_entries limit, fail insertion of new elem
-		 */
-		ret = -E2BIG;
+	l_new = alloc_htab_elem(htab, key, value, key_size, hash, false,
+				!!l_old);
+	if (IS_ERR(l_new)) {
+		ret = PTR_ERR(l_new);
 		goto err;
 	}
 
-	if (l_old && map_flags == BPF_NOEXIST) {
-		/* elem already exists */
-		ret = -EEXIST;
-		goto err;
+	/* add new element to the head of the list, so that concurrent
+	 * search will find it before old elem
+	 */
+	hlist_add_head_rcu(&l_new->hash_node, head);
+	if (l_old) {
+		hlist_del_rcu(&l_old->hash_node);
+		free_htab_elem(htab, l_old);
 	}
+	ret = 0;
+err:
+	raw_spin_unlock_irqrestore(&b->lock, flags);
+	return ret;
+}
 
-	if (!l_old && map_flags == BPF_EXIST) {
-		/* elem doesn't exist, cannot update it */
-		ret = -ENOENT;
+static int __htab_percpu_map_update_elem(struct bpf_map *map, void *key,
+					 void *value, u64 map_flags,
+					 bool onallcpus)
+{
+	struct bpf_htab *htab = container_of(map, struct bpf_htab, map);
+	struct htab_elem *l_new, *l_old;
+	struct hlist_head *head;
+	unsigned long flags;
+	struct bucket *b;
+	u32 key_size, hash;
+	int ret;
+
+	if (map_flags > BPF_EXIST)
+		/* unknown flags */
+		return -EINVAL;
+
+	WARN_ON_ONCE(!rcu_read_lock_held());
+
+	key_size = map->key_size;
+
+	hash = htab_map_hash(key, key_size);
+
+	b = __select_bucket(htab, hash);
+	head = &b->head;
+
+	/* bpf_map_update_elem() can be called in_irq() */
+	raw_spin_lock_irqsave(&b->lock, flags);
+
+	l_old = lookup_elem_raw(head, hash, key, key_size);
+
+	ret = check_flags(l_old, map_flags);
+	if (ret)
 		goto err;
+
+	if (l_old) {
+		/* per-cpu values are updated in place, without a new elem */
+		pcpu_copy_value(htab, htab_elem_get_ptr(l_old,
+							round_up(key_size, 8)),
+				value, onallcpus);
+	} else {
+		l_new = alloc_htab_elem(htab, key, value, key_size, hash,
+					onallcpus, false);
+		if (IS_ERR(l_new)) {
+			ret = PTR_ERR(l_new);
+			goto err;
+		}
+		hlist_add_head_rcu(&l_new->hash_node, head);
 	}
+	ret = 0;
+err:
+	raw_spin_unlock_irqrestore(&b->lock, flags);
+	return ret;
+}
+
+/* Called from syscall or from eBPF program.  A full map never fails the
+ * update, the least recently used elements make room for the new one.
+ */
+static int htab_lru_map_update_elem(struct bpf_map *map, void *key,
+				    void *value, u64 map_flags)
+{
+	struct bpf_htab *htab = container_of(map, struct bpf_htab, map);
+	struct htab_elem *l_new, *l_old = NULL;
+	struct hlist_head *head;
+	unsigned long flags;
+	struct bucket *b;
+	u32 key_size, hash;
+	int ret;
+
+	if (map_flags > BPF_EXIST)
+		/* unknown flags */
+		return -EINVAL;
+
+	WARN_ON_ONCE(!rcu_read_lock_held());
+
+	key_size = map->key_size;
+
+	hash = htab_map_hash(key, key_size);
+
+	b = __select_bucket(htab, hash);
+	head = &b->head;
+
+	/* evicting an older elem takes the bucket lock of that elem, so
+	 * get the new one before taking ours
+	 */
+	l_new = prealloc_lru_pop(htab, key, hash);
+	if (!l_new)
+		return -ENOMEM;
+	memcpy(l_new->key + round_up(key_size, 8), value, map->value_size);
+
+	/* bpf_map_update_elem() can be called in_irq() */
+	raw_spin_lock_irqsave(&b->lock, flags);
+
+	l_old = lookup_elem_raw(head, hash, key, key_size);
+
+	ret = check_flags(l_old, map_flags);
+	if (ret)
+		goto err;
 
 	/* add new element to the head of the list, so that concurrent
 	 * search will find it before old elem
 	 */
 	hlist_add_head_rcu(&l_new->hash_node, head);
 	if (l_old) {
+		bpf_lru_node_set_ref(&l_new->lru_node);
 		hlist_del_rcu(&l_old->hash_node);
-		kfree_rcu(l_old, rcu);
-	} else {
-		htab->count++;
 	}
-	raw_spin_unlock_irqrestore(&htab->lock, flags);
+	ret = 0;
+err:
+	raw_spin_unlock_irqrestore(&b->lock, flags);
 
-	return 0;
+	if (ret)
+		bpf_lru_push_free(&htab->lru, &l_new->lru_node);
+	else if (l_old)
+		bpf_lru_push_free(&htab->lru, &l_old->lru_node);
+
+	return ret;
+}
+
+static int __htab_lru_percpu_map_update_elem(struct bpf_map *map, void *key,
+					     void *value, u64 map_flags,
+					     bool onallcpus)
+{
+	struct bpf_htab *htab = container_of(map, struct bpf_htab, map);
+	struct htab_elem *l_new = NULL, *l_old;
+	struct hlist_head *head;
+	unsigned long flags;
+	struct bucket *b;
+	u32 key_size, hash;
+	int ret;
+
+	if (map_flags > BPF_EXIST)
+		/* unknown flags */
+		return -EINVAL;
+
+	WARN_ON_ONCE(!rcu_read_lock_held());
+
+	key_size = map->key_size;
+
+	hash = htab_map_hash(key, key_size);
+
+	b = __select_bucket(htab, hash);
+	head = &b->head;
+
+	/* see htab_lru_map_update_elem(), BPF_EXIST never needs a new elem */
+	if (map_flags != BPF_EXIST) {
+		l_new = prealloc_lru_pop(htab, key, hash);
+		if (!l_new)
+			return -ENOMEM;
+	}
+
+	/* bpf_map_update_elem() can be called in_irq() */
+	raw_spin_lock_irqsave(&b->lock, flags);
+
+	l_old = lookup_elem_raw(head, hash, key, key_size);
+
+	ret = check_flags(l_old, map_flags);
+	if (ret)
+		goto err;
+
+	if (l_old) {
+		bpf_lru_node_set_ref(&l_old->lru_node);
+
+		/* per-cpu values are updated in place */
+		pcpu_copy_value(htab, htab_elem_get_ptr(l_old,
+							round_up(key_size, 8)),
+				value, onallcpus);
+	} else {
+		pcpu_init_value(htab, htab_elem_get_ptr(l_new,
+							round_up(key_size, 8)),
+				value, onallcpus);
+		hlist_add_head_rcu(&l_new->hash_node, head);
+		l_new = NULL;
+	}
+	ret = 0;
 err:
-	raw_spin_unlock_irqrestore(&htab->lock, flags);
-	kfree(l_new);
+	raw_spin_unlock_irqrestore(&b->lock, flags);
+
+	if (l_new)
+		bpf_lru_push_free(&htab->lru, &l_new->lru_node);
+
 	return ret;
 }
 
+/* Called from eBPF program */
+static int htab_percpu_map_update_elem(struct bpf_map *map, void *key,
+				       void *value, u64 map_flags)
+{
+	return __htab_percpu_map_update_elem(map, key, value, map_flags, false);
+}
+
+/* Called from eBPF program */
+static int htab_lru_percpu_map_update_elem(struct bpf_map *map, void *key,
+					   void *value, u64 map_flags)
+{
+	return __htab_lru_percpu_map_update_elem(map, key, value, map_flags,
+						 false);
+}
+
+/* Called from syscall, @value holds the values of all possible cpus */
+int bpf_percpu_hash_update(struct bpf_map *map, void *key, void *value,
+			   u64 map_flags)
+{
+	struct bpf_htab *htab = container_of(map, struct bpf_htab, map);
+
+	if (htab_is_lru(htab))
+		return __htab_lru_percpu_map_update_elem(map, key, value,
+							 map_flags, true);
+
+	return __htab_percpu_map_update_elem(map, key, value, map_flags, true);
+}
+
 /* Called from syscall or from eBPF program */
 static int htab_map_delete_elem(struct bpf_map *map, void *key)
 {
@@ -302,6 +935,7 @@ static int htab_map_delete_elem(struct bpf_map *map, void *key)
 	struct hlist_head *head;
 	struct htab_elem *l;
 	unsigned long flags;
+	struct bucket *b;
 	u32 hash, key_size;
 	int ret = -ENOENT;
 
@@ -311,20 +945,59 @@ static int htab_map_delete_elem(struct bpf_map *map, void *key)
 
 	hash = htab_map_hash(key, key_size);
 
-	raw_spin_lock_irqsave(&htab->lock, flags);
+	b = __select_bucket(htab, hash);
+	head = &b->head;
 
-	head = select_bucket(htab, hash);
+	raw_spin_lock_irqsave(&b->lock, flags);
+
+	l = lookup_elem_raw(head, hash, key, key_size);
+
+	if (l) {
+		hlist_del_rcu(&l->hash_node);
+		free_htab_elem(htab, l);
+		atomic_dec(&htab->count);
+		ret = 0;
+	}
+
+	raw_spin_unlock_irqrestore(&b->lock, flags);
+	return ret;
+}
+
+/* Called from syscall or from eBPF program */
+static int htab_lru_map_delete_elem(struct bpf_map *map, void *key)
+{
+	struct bpf_htab *htab = container_of(map, struct bpf_htab, map);
+	struct hlist_head *head;
+	struct htab_elem *l;
+	unsigned long flags;
+	struct bucket *b;
+	u32 hash, key_size;
+	int ret = -ENOENT;
+
+	WARN_ON_ONCE(!rcu_read_lock_held());
+
+	key_size = map->key_size;
+
+	hash = htab_map_hash(key, key_size);
+
+	b = __select_bucket(htab, hash);
+	head = &b->head;
+
+	raw_spin_lock_irqsave(&b->lock, flags);
 
 	l = lookup_elem_raw(head, hash, key, key_size);
 
 	if (l) {
 		hlist_del_rcu(&l->hash_node);
-		htab->count--;
-		kfree_rcu(l, rcu);
 		ret = 0;
 	}
 
-	raw_spin_unlock_irqrestore(&htab->lock, flags);
+	raw_spin_unlock_irqrestore(&b->lock, flags);
+
+	/* the LRU lists have their own locks, nested outside ours */
+	if (l)
+		bpf_lru_push_free(&htab->lru, &l->lru_node);
+
 	return ret;
 }
 
@@ -339,8 +1012,13 @@ static void delete_all_elements(struct bpf_htab *htab)
 
 		hlist_for_each_entry_safe(l, n, head, hash_node) {
 			hlist_del_rcu(&l->hash_node);
-			htab->count--;
-			kfree(l);
+			atomic_dec(&htab->count);
+			if (htab_is_percpu(htab)) {
+				l->key_size = round_up(htab->map.key_size, 8);
+				htab_percpu_elem_free(l);
+			} else {
+				kfree(l);
+			}
 		}
 	}
 }
@@ -357,10 +1035,19 @@ static void htab_map_free(struct bpf_map *map)
 	 */
 	synchronize_rcu();
 
-	/* some of kfree_rcu() callbacks for elements of this map may not have
-	 * executed. It's ok. Proceed to free residual elements and map itself
+	/* some of free_htab_elem() callbacks for elements of this map may
+	 * not have executed. It's ok. Proceed to free residual elements and
+	 * map itself
 	 */
-	delete_all_elements(htab);
+	if (htab_is_prealloc(htab)) {
+		htab_free_elems(htab);
+		if (htab_is_lru(htab))
+			bpf_lru_destroy(&htab->lru);
+		else
+			pcpu_freelist_destroy(&htab->freelist);
+	} else {
+		delete_all_elements(htab);
+	}
 	kvfree(htab->buckets);
 	kfree(htab);
 }
@@ -379,9 +1066,54 @@ static struct bpf_map_type_list htab_type __read_mostly = {
 	.type = BPF_MAP_TYPE_HASH,
 };
 
+static const struct bpf_map_ops htab_percpu_ops = {
+	.map_alloc = htab_map_alloc,
+	.map_free = htab_map_free,
+	.map_get_next_key = htab_map_get_next_key,
+	.map_lookup_elem = htab_percpu_map_lookup_elem,
+	.map_update_elem = htab_percpu_map_update_elem,
+	.map_delete_elem = htab_map_delete_elem,
+};
+
+static struct bpf_map_type_list htab_percpu_type __read_mostly = {
+	.ops = &htab_percpu_ops,
+	.type = BPF_MAP_TYPE_PERCPU_HASH,
+};
+
+static const struct bpf_map_ops htab_lru_ops = {
+	.map_alloc = htab_map_alloc,
+	.map_free = htab_map_free,
+	.map_get_next_key = htab_map_get_next_key,
+	.map_lookup_elem = htab_lru_map_lookup_elem,
+	.map_update_elem = htab_lru_map_update_elem,
+	.map_delete_elem = htab_lru_map_delete_elem,
+};
+
+static struct bpf_map_type_list htab_lru_type __read_mostly = {
+	.ops = &htab_lru_ops,
+	.type = BPF_MAP_TYPE_LRU_HASH,
+};
+
+static const struct bpf_map_ops htab_lru_percpu_ops = {
+	.map_alloc = htab_map_alloc,
+	.map_free = htab_map_free,
+	.map_get_next_key = htab_map_get_next_key,
+	.map_lookup_elem = htab_lru_percpu_map_lookup_elem,
+	.map_update_elem = htab_lru_percpu_map_update_elem,
+	.map_delete_elem = htab_lru_map_delete_elem,
+};
+
+static struct bpf_map_type_list htab_lru_percpu_type __read_mostly = {
+	.ops = &htab_lru_percpu_ops,
+	.type = BPF_MAP_TYPE_LRU_PERCPU_HASH,
+};
+
 static int __init register_htab_map(void)
 {
 	bpf_register_map_type(&htab_type);
+	bpf_register_map_type(&htab_percpu_type);
+	bpf_register_map_type(&htab_lru_type);
+	bpf_register_map_type(&htab_lru_percpu_type);
 	return 0;
 }
 late_initcall(register_htab_map);
@@ -0,0 +1,802 @@
+/* This program is free software; you can redistribute it and/or
+ * modify it under the terms of version 2 of the GNU General Public
+ * License as published by the Free Software Foundation.
+ */
+
+/* A sockmap is an array of TCP sockets whose receive path is handed to
+ * the BPF_PROG_TYPE_SK_SKB program attached to the map.  Every skb read
+ * from a socket in the map runs the program, which sends the data out of
+ * another socket with bpf_sk_redirect_map() or drops it.  The data never
+ * reaches the receive queue of the socket, so a proxy can splice two
+ * connections without copying the payload through userspace.
+ *
+ * The program sees the skbs as TCP delivered them, there is no message
+ * parsing.  It may see the same data more than once: when the socket it
+ * redirects to has too much queued, reading stops and is retried once
+ * that socket has drained, leaving the TCP window to push back on the
+ * sender.
+ *
+ * The program used for a socket is the one attached to the map when the
+ * socket was added.
+ */
+#include <linux/bpf.h>
+#include <linux/filter.h>
+#include <linux/errno.h>
+#include <linux/file.h>
+#include <linux/net.h>
+#include <linux/skbuff.h>
+#include <linux/vmalloc.h>
+#include <linux/workqueue.h>
+#include <net/sock.h>
+#include <net/tcp.h>
+
+struct bpf_stab {
+	struct bpf_map map;
+	/* protects the sockets and the program */
+	spinlock_t lock;
+	struct bpf_prog *bpf_verdict;
+	struct sock **sock_map;
+};
+
+enum smap_psock_state {
+	SMAP_TX_RUNNING,
+};
+
+struct smap_psock {
+	struct rcu_head rcu;
+	struct sock *sock;
+	struct bpf_stab *stab;
+	u32 key;
+	unsigned long state;
+	struct bpf_prog *bpf_verdict;
+
+	/* skbs redirected to this socket, sent out by tx_work.  The queue
+	 * lock also covers queued, the bytes not sent yet, and the state.
+	 */
+	struct sk_buff_head rxqueue;
+	unsigned int queued;
+	struct sk_buff *save_skb;
+	int save_off;
+	int save_rem;
+	struct work_struct tx_work;
+
+	/* sockets that stopped reading because this one was full */
+	struct list_head waiters;
+	struct list_head wait_node;
+	struct work_struct rx_work;
+
+	struct work_struct gc_work;
+
+	struct proto *save_prot;
+	void (*save_data_ready)(struct sock *sk);
+	void (*save_write_space)(struct sock *sk);
+};
+
+/* protects the waiters lists, nests inside the rxqueue lock */
+static DEFINE_SPINLOCK(smap_wait_lock);
+
+enum {
+	SMAP_IPV4,
+	SMAP_IPV6,
+	SMAP_NUM_PROTS,
+};
+
+/* Sockets in a map get a copy of their proto with close() hooked, so
+ * that they leave the map when they are closed.
+ */
+static struct proto smap_prots[SMAP_NUM_PROTS];
+static struct proto *smap_prots_base[SMAP_NUM_PROTS];
+static DEFINE_SPINLOCK(smap_prots_lock);
+
+static void smap_release_sock(struct smap_psock *psock);
+
+static inline struct smap_psock *smap_psock_sk(const struct sock *sk)
+{
+	return rcu_dereference_sk_user_data(sk);
+}
+
+static void smap_wake_waiters(struct smap_psock *psock)
+{
+	struct smap_psock *w, *tmp;
+
+	spin_lock_bh(&smap_wait_lock);
+	list_for_each_entry_safe(w, tmp, &psock->waiters, wait_node) {
+		list_del_init(&w->wait_node);
+		schedule_work(&w->rx_work);
+	}
+	spin_unlock_bh(&smap_wait_lock);
+}
+
+/*
+ * Queue @skb, read from @psock's socket, for sending out of @peer.  If
+ * @peer has a sndbuf worth of data queued already, @psock is woken up
+ * to read again once half of it went out.
+ */
+static int smap_queue(struct smap_psock *peer, struct smap_psock *psock,
+		      struct sk_buff *skb)
+{
+	int err = 0;
+
+	spin_lock_bh(&peer->rxqueue.lock);
+	if (unlikely(!test_bit(SMAP_TX_RUNNING, &peer->state))) {
+		err = -EPIPE;
+	} else if (peer->queued >= peer->sock->sk_sndbuf) {
+		spin_lock(&smap_wait_lock);
+		if (list_empty(&psock->wait_node))
+			list_add_tail(&psock->wait_node, &peer->waiters);
+		spin_unlock(&smap_wait_lock);
+		err = -EAGAIN;
+	} else {
+		__skb_queue_tail(&peer->rxqueue, skb);
+		peer->queued += skb->len;
+		schedule_work(&peer->tx_work);
+	}
+	spin_unlock_bh(&peer->rxqueue.lock);
+
+	return err;
+}
+
+static int smap_recv(read_descriptor_t *desc, struct sk_buff *orig_skb,
+		     unsigned int offset, size_t len)
+{
+	struct smap_psock *psock = desc->arg.data;
+	struct smap_psock *peer;
+	struct sk_buff *skb;
+	struct sock *sk;
+	int rc, err;
+
+	skb = skb_clone(orig_skb, GFP_ATOMIC);
+	if (unlikely(!skb)) {
+		desc->error = -ENOMEM;
+		return 0;
+	}
+
+	if (unlikely(!pskb_pull(skb, offset) || pskb_trim(skb, len)))
+		goto drop;
+
+	/* the redirect target is kept per cpu until it is fetched */
+	preempt_disable();
+	rc = BPF_PROG_RUN(psock->bpf_verdict, skb);
+	sk = do_sk_redirect_map();
+	preempt_enable();
+
+	if (rc != SK_PASS || !sk)
+		goto drop;
+
+	peer = smap_psock_sk(sk);
+	if (unlikely(!peer))
+		goto drop;
+
+	err = smap_queue(peer, psock, skb);
+	if (err == -EAGAIN) {
+		/* leave it in the receive queue until peer has room */
+		kfree_skb(skb);
+		return 0;
+	}
+	if (err)
+		goto drop;
+
+	return len;
+
+drop:
+	kfree_skb(skb);
+	return len;
+}
+
+/* Called with the socket locked or owned */
+static void smap_read_sock(struct smap_psock *psock)
+{
+	read_descriptor_t desc = {
+		.arg.data = psock,
+		.count = 1,
+	};
+
+	rcu_read_lock();
+	tcp_read_sock(psock->sock, &desc, smap_recv);
+	rcu_read_unlock();
+}
+
+static void smap_data_ready(struct sock *sk)
+{
+	struct smap_psock *psock;
+
+	read_lock_bh(&sk->sk_callback_lock);
+	rcu_read_lock();
+	psock = smap_psock_sk(sk);
+	if (likely(psock))
+		smap_read_sock(psock);
+	rcu_read_unlock();
+	read_unlock_bh(&sk->sk_callback_lock);
+}
+
+static void smap_rx_work(struct work_struct *w)
+{
+	struct smap_psock *psock = container_of(w, struct smap_psock,
+						rx_work);
+	struct sock *sk = psock->sock;
+
+	lock_sock(sk);
+	rcu_read_lock();
+	if (likely(smap_psock_sk(sk) == psock))
+		smap_read_sock(psock);
+	rcu_read_unlock();
+	release_sock(sk);
+}
+
+static int smap_send_kvec(struct sock *sk, void *data, int len)
+{
+	struct msghdr msg = { .msg_flags = MSG_DONTWAIT };
+	struct kvec kv = { .iov_base = data, .iov_len = len };
+
+	iov_iter_kvec(&msg.msg_iter, WRITE | ITER_KVEC, &kv, 1, len);
+	return tcp_sendmsg_locked(sk, &msg, len);
+}
+
+static int smap_send_frag(struct sock *sk, skb_frag_t *frag, int off, int len)
+{
+	struct page *page = skb_frag_page(frag);
+	void *vaddr;
+	int ret;
+
+	off += frag->page_offset;
+	if ((sk->sk_route_caps & NETIF_F_SG) &&
+	    (sk->sk_route_caps & NETIF_F_ALL_CSUM))
+		return do_tcp_sendpages(sk, page, off, len, MSG_DONTWAIT);
+
+	vaddr = kmap(page);
+	ret = smap_send_kvec(sk, vaddr + off, len);
+	kunmap(page);
+	return ret;
+}
+
+/*
+ * Send up to @len bytes of @skb starting at @off out of @sk, socket
+ * locked.  The pages are passed on by reference where the route allows.
+ * Returns the number of bytes sent or an error if none were.
+ */
+static int smap_send_skb(struct sock *sk, struct sk_buff *skb, int off,
+			 int len)
+{
+	struct sk_buff *head = skb;
+	int orig_len = len;
+	int i, slen, ret;
+
+do_frag_list:
+	while (off < skb_headlen(skb) && len) {
+		slen = min_t(int, len, skb_headlen(skb) - off);
+		ret = smap_send_kvec(sk, skb->data + off, slen);
+		if (ret <= 0)
+			goto error;
+		off += ret;
+		len -= ret;
+	}
+
+	if (!len)
+		goto out;
+
+	/* make off relative to the start of the frags */
+	off -= skb_headlen(skb);
+
+	for (i = 0; i < skb_shinfo(skb)->nr_frags; i++) {
+		skb_frag_t *frag = &skb_shinfo(skb)->frags[i];
+
+		if (off < skb_frag_size(frag))
+			break;
+		off -= skb_frag_size(frag);
+	}
+
+	for (; len && i < skb_shinfo(skb)->nr_frags; i++) {
+		skb_frag_t *frag = &skb_shinfo(skb)->frags[i];
+
+		slen = min_t(int, len, skb_frag_size(frag) - off);
+		while (slen) {
+			ret = smap_send_frag(sk, frag, off, slen);
+			if (ret <= 0)
+				goto error;
+			len -= ret;
+			off += ret;
+			slen -= ret;
+		}
+		off = 0;
+	}
+
+	if (len) {
+		if (skb == head && skb_has_frag_list(skb)) {
+			skb = skb_shinfo(skb)->frag_list;
+			goto do_frag_list;
+		} else if (skb != head && skb->next) {
+			skb = skb->next;
+			goto do_frag_list;
+		}
+	}
+
+out:
+	return orig_len - len;
+error:
+	return orig_len == len ? ret : orig_len - len;
+}
+
+static void smap_tx_done(struct smap_psock *psock, unsigned int len)
+{
+	bool wake;
+
+	spin_lock_bh(&psock->rxqueue.lock);
+	psock->queued -= len;
+	wake = psock->queued <= psock->sock->sk_sndbuf / 2;
+	spin_unlock_bh(&psock->rxqueue.lock);
+
+	if (wake)
+		smap_wake_waiters(psock);
+}
+
+static void smap_stop_tx(struct smap_psock *psock)
+{
+	spin_lock_bh(&psock->rxqueue.lock);
+	clear_bit(SMAP_TX_RUNNING, &psock->state);
+	spin_unlock_bh(&psock->rxqueue.lock);
+
+	/* nothing is going to drain what is queued, let the waiters drop
+	 * their data instead of waiting for it
+	 */
+	smap_wake_waiters(psock);
+}
+
+static void smap_tx_work(struct work_struct *w)
+{
+	struct smap_psock *psock = container_of(w, struct smap_psock,
+						tx_work);
+	struct sock *sk = psock->sock;
+	struct sk_buff *skb;
+	int n, off, rem;
+
+	lock_sock(sk);
+
+	if (psock->save_skb) {
+		skb = psock->save_skb;
+		off = psock->save_off;
+		rem = psock->save_rem;
+		psock->save_skb = NULL;
+		goto start;
+	}
+
+	while ((skb = skb_dequeue(&psock->rxqueue))) {
+		off = 0;
+		rem = skb->len;
+start:
+		do {
+			n = -EPIPE;
+			if (likely(sk->sk_socket &&
+				   test_bit(SMAP_TX_RUNNING, &psock->state)))
+				n = smap_send_skb(sk, skb, off, rem);
+
+			if (n == -EAGAIN) {
+				/* smap_write_space() schedules us again */
+				psock->save_skb = skb;
+				psock->save_off = off;
+				psock->save_rem = rem;
+				goto out;
+			}
+
+			if (n <= 0) {
+				/* hard errors break the pipe for good */
+				sk->sk_err = n ? -n : EPIPE;
+				sk->sk_error_report(sk);
+				smap_stop_tx(psock);
+				kfree_skb(skb);
+				goto out;
+			}
+
+			off += n;
+			rem -= n;
+		} while (rem);
+
+		smap_tx_done(psock, skb->len);
+		kfree_skb(skb);
+	}
+out:
+	release_sock(sk);
+}
+
+static void smap_write_space(struct sock *sk)
+{
+	void (*write_space)(struct sock *sk) = NULL;
+	struct smap_psock *psock;
+
+	read_lock_bh(&sk->sk_callback_lock);
+	rcu_read_lock();
+	psock = smap_psock_sk(sk);
+	if (likely(psock)) {
+		if (test_bit(SMAP_TX_RUNNING, &psock->state))
+			schedule_work(&psock->tx_work);
+		write_space = psock->save_write_space;
+	}
+	rcu_read_unlock();
+	read_unlock_bh(&sk->sk_callback_lock);
+
+	/* the socket owner may be polling for room as well */
+	if (write_space)
+		write_space(sk);
+}
+
+static void smap_gc_work(struct work_struct *w)
+{
+	struct smap_psock *psock = container_of(w, struct smap_psock,
+						gc_work);
+
+	cancel_work_sync(&psock->rx_work);
+	cancel_work_sync(&psock->tx_work);
+
+	skb_queue_purge(&psock->rxqueue);
+	kfree_skb(psock->save_skb);
+
+	bpf_prog_put(psock->bpf_verdict);
+	sock_put(psock->sock);
+	kfree_rcu(psock, rcu);
+}
+
+/* Restore the socket after its map slot was cleared */
+static void smap_release_sock(struct smap_psock *psock)
+{
+	struct sock *sk = psock->sock;
+
+	write_lock_bh(&sk->sk_callback_lock);
+	sk->sk_data_ready = psock->save_data_ready;
+	sk->sk_write_space = psock->save_write_space;
+	WRITE_ONCE(sk->sk_prot, psock->save_prot);
+	rcu_assign_sk_user_data(sk, NULL);
+	write_unlock_bh(&sk->sk_callback_lock);
+
+	smap_stop_tx(psock);
+
+	spin_lock_bh(&smap_wait_lock);
+	list_del_init(&psock->wait_node);
+	spin_unlock_bh(&smap_wait_lock);
+
+	schedule_work(&psock->gc_work);
+}
+
+/* Called under rcu_read_lock() */
+static void smap_unlink(struct smap_psock *psock)
+{
+	struct bpf_stab *stab = psock->stab;
+	bool owner;
+
+	spin_lock_bh(&stab->lock);
+	owner = stab->sock_map[psock->key] == psock->sock;
+	if (owner)
+		stab->sock_map[psock->key] = NULL;
+	spin_unlock_bh(&stab->lock);
+
+	if (owner)
+		smap_release_sock(psock);
+}
+
+static void smap_tcp_close(struct sock *sk, long timeout)
+{
+	void (*close)(struct sock *sk, long timeout);
+	struct smap_psock *psock;
+
+	rcu_read_lock();
+	psock = smap_psock_sk(sk);
+	if (likely(psock)) {
+		close = psock->save_prot->close;
+		smap_unlink(psock);
+	} else {
+		close = READ_ONCE(sk->sk_prot)->close;
+	}
+	rcu_read_unlock();
+
+	close(sk, timeout);
+}
+
+static struct proto *smap_get_prot(struct sock *sk)
+{
+	int i = sk->sk_family == AF_INET6 ? SMAP_IPV6 : SMAP_IPV4;
+	struct proto *base = sk->sk_prot;
+
+	if (likely(smp_load_acquire(&smap_prots_base[i]) == base))
+		return &smap_prots[i];
+
+	spin_lock_bh(&smap_prots_lock);
+	if (smap_prots_base[i] != base) {
+		smap_prots[i] = *base;
+		smap_prots[i].close = smap_tcp_close;
+		smp_store_release(&smap_prots_base[i], base);
+	}
+	spin_unlock_bh(&smap_prots_lock);
+
+	return &smap_prots[i];
+}
+
+static bool smap_sock_ok(const struct sock *sk)
+{
+	return (sk->sk_family == AF_INET || sk->sk_family == AF_INET6) &&
+	       sk->sk_type == SOCK_STREAM &&
+	       sk->sk_protocol == IPPROTO_TCP &&
+	       sk->sk_state == TCP_ESTABLISHED;
+}
+
+static struct smap_psock *smap_init_psock(struct sock *sk,
+					  struct bpf_stab *stab, u32 key)
+{
+	struct smap_psock *psock;
+
+	psock = kzalloc(sizeof(*psock), GFP_ATOMIC | __GFP_NOWARN);
+	if (!psock)
+		return NULL;
+
+	psock->sock = sk;
+	psock->stab = stab;
+	psock->key = key;
+	skb_queue_head_init(&psock->rxqueue);
+	INIT_WORK(&psock->tx_work, smap_tx_work);
+	INIT_LIST_HEAD(&psock->waiters);
+	INIT_LIST_HEAD(&psock->wait_node);
+	INIT_WORK(&psock->rx_work, smap_rx_work);
+	INIT_WORK(&psock->gc_work, smap_gc_work);
+	set_bit(SMAP_TX_RUNNING, &psock->state);
+
+	return psock;
+}
+
+/* Called from syscall */
+static struct bpf_map *sock_map_alloc(union bpf_attr *attr)
+{
+	struct bpf_stab *stab;
+	u64 cost;
+
+	if (!capable(CAP_NET_ADMIN))
+		return ERR_PTR(-EPERM);
+
+	/* check sanity of attributes */
+	if (attr->max_entries == 0 || attr->key_size != 4 ||
+	    attr->value_size != 4 || attr->map_flags)
+		return ERR_PTR(-EINVAL);
+
+	cost = sizeof(*stab) + (u64) attr->max_entries * sizeof(struct sock *);
+	if (cost >= U32_MAX - PAGE_SIZE)
+		return ERR_PTR(-E2BIG);
+
+	stab = kzalloc(sizeof(*stab), GFP_USER);
+	if (!stab)
+		return ERR_PTR(-ENOMEM);
+
+	stab->sock_map = kzalloc(attr->max_entries * sizeof(struct sock *),
+				 GFP_USER | __GFP_NOWARN);
+	if (!stab->sock_map)
+		stab->sock_map = vzalloc(attr->max_entries *
+					 sizeof(struct sock *));
+	if (!stab->sock_map) {
+		kfree(stab);
+		return ERR_PTR(-ENOMEM);
+	}
+
+	stab->map.map_type = attr->map_type;
+	stab->map.key_size = attr->key_size;
+	stab->map.value_size = attr->value_size;
+	stab->map.max_entries = attr->max_entries;
+	stab->map.pages = round_up(cost, PAGE_SIZE) >> PAGE_SHIFT;
+	spin_lock_init(&stab->lock);
+
+	return &stab->map;
+}
+
+/* Called when map->refcnt goes to zero, either from workqueue or from syscall */
+static void sock_map_free(struct bpf_map *map)
+{
+	struct bpf_stab *stab = container_of(map, struct bpf_stab, map);
+	struct sock *sk;
+	u32 i;
+
+	/* wait for bpf programs to complete before releasing the sockets */
+	synchronize_rcu();
+
+	for (i = 0; i < map->max_entries; i++) {
+		spin_lock_bh(&stab->lock);
+		sk = stab->sock_map[i];
+		stab->sock_map[i] = NULL;
+		spin_unlock_bh(&stab->lock);
+
+		if (sk) {
+			rcu_read_lock();
+			smap_release_sock(smap_psock_sk(sk));
+			rcu_read_unlock();
+		}
+	}
+
+	/* and for smap_tcp_close() to be done with the lock */
+	synchronize_rcu();
+
+	if (stab->bpf_verdict)
+		bpf_prog_put(stab->bpf_verdict);
+
+	kvfree(stab->sock_map);
+	kfree(stab);
+}
+
+/* Called from syscall */
+static int sock_map_get_next_key(struct bpf_map *map, void *key,
+				 void *next_key)
+{
+	u32 index = *(u32 *)key;
+	u32 *next = (u32 *)next_key;
+
+	if (index >= map->max_entries) {
+		*next = 0;
+		return 0;
+	}
+
+	if (index == map->max_entries - 1)
+		return -ENOENT;
+
+	*next = index + 1;
+	return 0;
+}
+
+/* The sockets can't be handed out, only redirected to */
+static void *sock_map_lookup_elem(struct bpf_map *map, void *key)
+{
+	return NULL;
+}
+
+struct sock *__sock_map_lookup_elem(struct bpf_map *map, u32 key)
+{
+	struct bpf_stab *stab = container_of(map, struct bpf_stab, map);
+
+	if (key >= map->max_entries)
+		return NULL;
+
+	return READ_ONCE(stab->sock_map[key]);
+}
+
+/* Called from syscall under rcu_read_lock(), the value is a socket fd */
+static int sock_map_update_elem(struct bpf_map *map, void *key, void *value,
+				u64 map_flags)
+{
+	struct bpf_stab *stab = container_of(map, struct bpf_stab, map);
+	struct smap_psock *psock;
+	u32 i = *(u32 *)key;
+	struct socket *sock;
+	struct sock *sk, *osk;
+	int err;
+
+	if (unlikely(map_flags > BPF_EXIST))
+		return -EINVAL;
+
+	if (unlikely(i >= map->max_entries))
+		return -E2BIG;
+
+	sock = sockfd_lookup(*(u32 *)value, &err);
+	if (!sock)
+		return err;
+
+	sk = sock->sk;
+	err = -EOPNOTSUPP;
+	if (!smap_sock_ok(sk))
+		goto out;
+
+	err = -ENOMEM;
+	psock = smap_init_psock(sk, stab, i);
+	if (!psock)
+		goto out;
+
+	spin_lock_bh(&stab->lock);
+	osk = stab->sock_map[i];
+	err = -EEXIST;
+	if (osk && map_flags == BPF_NOEXIST)
+		goto out_unlock;
+	err = -ENOENT;
+	if (!osk && map_flags == BPF_EXIST)
+		goto out_unlock;
+	/* the program has to be there first, see sock_map_prog() */
+	if (!stab->bpf_verdict)
+		goto out_unlock;
+
+	write_lock(&sk->sk_callback_lock);
+	err = -EBUSY;
+	if (sk->sk_user_data) {
+		write_unlock(&sk->sk_callback_lock);
+		goto out_unlock;
+	}
+
+	psock->bpf_verdict = stab->bpf_verdict;
+	atomic_inc(&psock->bpf_verdict->aux->refcnt);
+	sock_hold(sk);
+
+	psock->save_prot = sk->sk_prot;
+	psock->save_data_ready = sk->sk_data_ready;
+	psock->save_write_space = sk->sk_write_space;
+	rcu_assign_sk_user_data(sk, psock);
+	sk->sk_data_ready = smap_data_ready;
+	sk->sk_write_space = smap_write_space;
+	WRITE_ONCE(sk->sk_prot, smap_get_prot(sk));
+	write_unlock(&sk->sk_callback_lock);
+
+	stab->sock_map[i] = sk;
+	spin_unlock_bh(&stab->lock);
+
+	if (osk)
+		smap_release_sock(smap_psock_sk(osk));
+
+	/* pick up what arrived before the callbacks were in place */
+	schedule_work(&psock->rx_work);
+
+	sockfd_put(sock);
+	return 0;
+
+out_unlock:
+	spin_unlock_bh(&stab->lock);
+	kfree(psock);
+out:
+	sockfd_put(sock);
+	return err;
+}
+
+/* Called from syscall */
+static int sock_map_delete_elem(struct bpf_map *map, void *key)
+{
+	struct bpf_stab *stab = container_of(map, struct bpf_stab, map);
+	u32 i = *(u32 *)key;
+	struct sock *sk;
+
+	if (unlikely(i >= map->max_entries))
+		return -E2BIG;
+
+	spin_lock_bh(&stab->lock);
+	sk = stab->sock_map[i];
+	stab->sock_map[i] = NULL;
+	spin_unlock_bh(&stab->lock);
+
+	if (!sk)
+		return -ENOENT;
+
+	smap_release_sock(smap_psock_sk(sk));
+	return 0;
+}
+
+/*
+ * Attach @prog as the verdict program of the sockets added from now on,
+ * or detach it if @prog is NULL.  Takes over the reference on @prog.
+ */
+int sock_map_prog(struct bpf_map *map, struct bpf_prog *prog, u32 type)
+{
+	struct bpf_stab *stab = container_of(map, struct bpf_stab, map);
+	struct bpf_prog *orig;
+
+	if (map->map_type != BPF_MAP_TYPE_SOCKMAP)
+		return -EINVAL;
+
+	if (type != BPF_SK_SKB_VERDICT)
+		return -EOPNOTSUPP;
+
+	spin_lock_bh(&stab->lock);
+	orig = stab->bpf_verdict;
+	stab->bpf_verdict = prog;
+	spin_unlock_bh(&stab->lock);
+
+	if (orig)
+		bpf_prog_put(orig);
+
+	return 0;
+}
+
+static const struct bpf_map_ops sock_map_ops = {
+	.map_alloc = sock_map_alloc,
+	.map_free = sock_map_free,
+	.map_get_next_key = sock_map_get_next_key,
+	.map_lookup_elem = sock_map_lookup_elem,
+	.map_update_elem = sock_map_update_elem,
+	.map_delete_elem = sock_map_delete_elem,
+};
+
+static struct bpf_map_type_list sock_map_type __read_mostly = {
+	.ops = &sock_map_ops,
+	.type = BPF_MAP_TYPE_SOCKMAP,
+};
+
+static int __init register_sock_map(void)
+{
+	bpf_register_map_type(&sock_map_type);
+	return 0;
+}
+late_initcall(register_sock_map);
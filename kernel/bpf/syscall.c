@@ -17,6 +17,8 @@
 #include <linux/license.h>
 #include <linux/filter.h>
 #include <linux/version.h>
+#include <linux/cgroup.h>
+#include <linux/bpf-cgroup.h>
 
 int sysctl_unprivileged_bpf_disabled __read_mostly;
 
@@ -34,6 +36,7 @@ static struct bpf_map *find_and_alloc_map(union bpf_attr *attr)
 				return map;
 			map->ops = tl->ops;
 			map->map_type = attr->map_type;
+			map->map_flags = attr->map_flags;
 			return map;
 		}
 	}
@@ -87,6 +90,9 @@ static void bpf_map_put_uref(struct bpf_map *map)
 	if (atomic_dec_and_test(&map->usercnt)) {
 		if (map->map_type == BPF_MAP_TYPE_PROG_ARRAY)
 			bpf_fd_array_map_clear(map);
+		/* the verdict program may refer to the map itself */
+		if (map->map_type == BPF_MAP_TYPE_SOCKMAP)
+			sock_map_prog(map, NULL, BPF_SK_SKB_VERDICT);
 	}
 }
 
@@ -131,7 +137,7 @@ int bpf_map_new_fd(struct bpf_map *map)
 		   offsetof(union bpf_attr, CMD##_LAST_FIELD) - \
 		   sizeof(attr->CMD##_LAST_FIELD)) != NULL
 
-#define BPF_MAP_CREATE_LAST_FIELD max_entries
+#define BPF_MAP_CREATE_LAST_FIELD map_flags
 /* called via syscall */
 static int map_create(union bpf_attr *attr)
 {
@@ -209,6 +215,19 @@ static void __user *u64_to_ptr(__u64 val)
 	return (void __user *) (unsigned long) val;
 }
 
+/* the syscall passes the values of all possible cpus for per-cpu maps,
+ * each rounded up to 8 bytes
+ */
+static u32 bpf_map_value_size(struct bpf_map *map)
+{
+	if (map->map_type == BPF_MAP_TYPE_PERCPU_HASH ||
+	    map->map_type == BPF_MAP_TYPE_LRU_PERCPU_HASH ||
+	    map->map_type == BPF_MAP_TYPE_PERCPU_ARRAY)
+		return round_up(map->value_size, 8) * num_possible_cpus();
+	else
+		return map->value_size;
+}
+
 /* last field in 'union bpf_attr' used by this command */
 #define BPF_MAP_LOOKUP_ELEM_LAST_FIELD value
 
@@ -219,6 +238,7 @@ static int map_lookup_elem(union bpf_attr *attr)
 	int ufd = attr->map_fd;
 	struct bpf_map *map;
 	void *key, *value, *ptr;
+	u32 value_size;
 	struct fd f;
 	int err;
 
@@ -239,23 +259,34 @@ static int map_lookup_elem(union bpf_attr *attr)
 	if (copy_from_user(key, ukey, map->key_size) != 0)
 		goto free_key;
 
+	value_size = bpf_map_value_size(map);
+
 	err = -ENOMEM;
-	value = kmalloc(map->value_size, GFP_USER | __GFP_NOWARN);
+	value = kmalloc(value_size, GFP_USER | __GFP_NOWARN);
 	if (!value)
 		goto free_key;
 
-	rcu_read_lock();
-	ptr = map->ops->map_lookup_elem(map, key);
-	if (ptr)
-		memcpy(value, ptr, map->value_size);
-	rcu_read_unlock();
+	if (map->map_type == BPF_MAP_TYPE_PERCPU_HASH ||
+	    map->map_type == BPF_MAP_TYPE_LRU_PERCPU_HASH) {
+		err = bpf_percpu_hash_copy(map, key, value);
+	} else if (map->map_type == BPF_MAP_TYPE_PERCPU_ARRAY) {
+		err = bpf_percpu_array_copy(map, key, value);
+	} else if (map->map_type == BPF_MAP_TYPE_STACK_TRACE) {
+		err = bpf_stackmap_copy(map, key, value);
+	} else {
+		rcu_read_lock();
+		ptr = map->ops->map_lookup_elem(map, key);
+		if (ptr)
+			memcpy(value, ptr, value_size);
+		rcu_read_unlock();
+		err = ptr ? 0 : -ENOENT;
+	}
 
-	err = -ENOENT;
-	if (!ptr)
+	if (err)
 		goto free_value;
 
 	err = -EFAULT;
-	if (copy_to_user(uvalue, value, map->value_size) != 0)
+	if (copy_to_user(uvalue, value, value_size) != 0)
 		goto free_value;
 
 	err = 0;
@@ -278,6 +309,7 @@ static int map_update_elem(union bpf_attr *attr)
 	int ufd = attr->map_fd;
 	struct bpf_map *map;
 	void *key, *value;
+	u32 value_size;
 	struct fd f;
 	int err;
 
@@ -298,21 +330,31 @@ static int map_update_elem(union bpf_attr *attr)
 	if (copy_from_user(key, ukey, map->key_size) != 0)
 		goto free_key;
 
+	value_size = bpf_map_value_size(map);
+
 	err = -ENOMEM;
-	value = kmalloc(map->value_size, GFP_USER | __GFP_NOWARN);
+	value = kmalloc(value_size, GFP_USER | __GFP_NOWARN);
 	if (!value)
 		goto free_key;
 
 	err = -EFAULT;
-	if (copy_from_user(value, uvalue, map->value_size) != 0)
+	if (copy_from_user(value, uvalue, value_size) != 0)
 		goto free_value;
 
-	/* eBPF program that use maps are running under rcu_read_lock(),
-	 * therefore all map accessors rely on this fact, so do the same here
-	 */
-	rcu_read_lock();
-	err = map->ops->map_update_elem(map, key, value, attr->flags);
-	rcu_read_unlock();
+	if (map->map_type == BPF_MAP_TYPE_PERCPU_HASH ||
+	    map->map_type == BPF_MAP_TYPE_LRU_PERCPU_HASH) {
+		err = bpf_percpu_hash_update(map, key, value, attr->flags);
+	} else if (map->map_type == BPF_MAP_TYPE_PERCPU_ARRAY) {
+		err = bpf_percpu_array_update(map, key, value, attr->flags);
+	} else {
+		/* eBPF program that use maps are running under rcu_read_lock(),
+		 * therefore all map accessors rely on this fact, so do the same
+		 * here
+		 */
+		rcu_read_lock();
+		err = map->ops->map_update_elem(map, key, value, attr->flags);
+		rcu_read_unlock();
+	}
 
 free_value:
 	kfree(value);
@@ -542,6 +584,7 @@ void bpf_prog_put_rcu(struct bpf_prog *prog)
 	if (atomic_dec_and_test(&prog->aux->refcnt))
 		call_rcu(&prog->aux->rcu, __prog_put_common);
 }
+EXPORT_SYMBOL_GPL(bpf_prog_put_rcu);
 
 void bpf_prog_put(struct bpf_prog *prog)
 {
@@ -706,6 +749,116 @@ static int bpf_obj_get(const union bpf_attr *attr)
 	return bpf_obj_get_user(u64_to_ptr(attr->pathname));
 }
 
+static int sock_map_attach(const union bpf_attr *attr, bool attach)
+{
+	struct bpf_prog *prog = NULL;
+	struct bpf_map *map;
+	struct fd f;
+	int err;
+
+	f = fdget(attr->target_fd);
+	map = __bpf_map_get(f);
+	if (IS_ERR(map))
+		return PTR_ERR(map);
+
+	if (attach) {
+		prog = bpf_prog_get(attr->attach_bpf_fd);
+		if (IS_ERR(prog)) {
+			fdput(f);
+			return PTR_ERR(prog);
+		}
+		if (prog->type != BPF_PROG_TYPE_SK_SKB) {
+			bpf_prog_put(prog);
+			fdput(f);
+			return -EINVAL;
+		}
+	}
+
+	err = sock_map_prog(map, prog, attr->attach_type);
+	if (err && prog)
+		bpf_prog_put(prog);
+
+	fdput(f);
+	return err;
+}
+
+#ifdef CONFIG_CGROUP_BPF
+static int cgroup_attach(const union bpf_attr *attr, bool attach)
+{
+	struct bpf_prog *prog = NULL;
+	struct cgroup *cgrp;
+
+	if (attach) {
+		prog = bpf_prog_get(attr->attach_bpf_fd);
+		if (IS_ERR(prog))
+			return PTR_ERR(prog);
+		if (prog->type != BPF_PROG_TYPE_CGROUP_SKB) {
+			bpf_prog_put(prog);
+			return -EINVAL;
+		}
+	}
+
+	cgrp = cgroup_get_from_fd(attr->target_fd);
+	if (IS_ERR(cgrp)) {
+		if (prog)
+			bpf_prog_put(prog);
+		return PTR_ERR(cgrp);
+	}
+
+	/* The cgroup keeps the reference on @prog until it is replaced. */
+	cgroup_bpf_update(cgrp, prog, attr->attach_type);
+	cgroup_put(cgrp);
+
+	return 0;
+}
+#endif /* CONFIG_CGROUP_BPF */
+
+#define BPF_PROG_ATTACH_LAST_FIELD attach_type
+
+static int bpf_prog_attach(const union bpf_attr *attr)
+{
+	if (!capable(CAP_NET_ADMIN))
+		return -EPERM;
+
+	if (CHECK_ATTR(BPF_PROG_ATTACH))
+		return -EINVAL;
+
+	switch (attr->attach_type) {
+	case BPF_SK_SKB_VERDICT:
+		return sock_map_attach(attr, true);
+#ifdef CONFIG_CGROUP_BPF
+	case BPF_CGROUP_INET_INGRESS:
+	case BPF_CGROUP_INET_EGRESS:
+		return cgroup_attach(attr, true);
+#endif
+	default:
+		return -EINVAL;
+	}
+}
+
+#define BPF_PROG_DETACH_LAST_FIELD attach_type
+
+static int bpf_prog_detach(const union bpf_attr *attr)
+{
+	if (!capable(CAP_NET_ADMIN))
+		return -EPERM;
+
+	if (CHECK_ATTR(BPF_PROG_DETACH))
+		return -EINVAL;
+
+	switch (attr->attach_type) {
+	case BPF_SK_SKB_VERDICT:
+		return sock_map_attach(attr, false);
+#ifdef CONFIG_CGROUP_BPF
+	case BPF_CGROUP_INET_INGRESS:
+	case BPF_CGROUP_INET_EGRESS:
+		return cgroup_attach(attr, false);
+#endif
+	default:
+		return -EINVAL;
+	}
+}
+
 SYSCALL_DEFINE3(bpf, int, cmd, union bpf_attr __user *, uattr, unsigned int, size)
 {
 	union bpf_attr attr = {};
@@ -772,6 +925,12 @@ SYSCALL_DEFINE3(bpf, int, cmd, union bpf_attr __user *, uattr, unsigned int, siz
 	case BPF_OBJ_GET:
 		err = bpf_obj_get(&attr);
 		break;
+	case BPF_PROG_ATTACH:
+		err = bpf_prog_attach(&attr);
+		break;
+	case BPF_PROG_DETACH:
+		err = bpf_prog_detach(&attr);
+		break;
 	default:
 		err = -EINVAL;
 		break;
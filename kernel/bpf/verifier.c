@@ -123,8 +123,24 @@
  *
  * After the call R0 is set to return type of the function and registers R1-R5
  * are set to NOT_INIT to indicate that they are no longer readable.
+ *
+ * To prune the search, the verifier keeps track of which registers and
+ * stack slots the rest of the program actually reads.  Each state points
+ * to the explored state it was derived from (its parent).  A read of a
+ * register walks up that chain and marks the register REG_LIVE_READ in
+ * every parent, until it reaches a state that wrote the register itself
+ * (REG_LIVE_WRITTEN) before reading it.  states_equal() then ignores the
+ * registers and stack slots an explored state never read: whatever they
+ * hold cannot change the outcome of the paths below it.
  */
 
+/* whether the value of a register or stack slot is used further down */
+enum reg_liveness {
+	REG_LIVE_NONE = 0,	/* not read, and not written in this state */
+	REG_LIVE_READ,		/* read by a state derived from this one */
+	REG_LIVE_WRITTEN,	/* overwritten, reads no longer reach the parent */
+};
+
 /* types of values stored in eBPF registers */
 enum bpf_reg_type {
 	NOT_INIT = 0,		 /* nothing was written into register */
@@ -149,6 +165,8 @@ struct reg_state {
 		 */
 		struct bpf_map *map_ptr;
 	};
+	/* must stay last, states_equal() doesn't compare it */
+	enum reg_liveness live;
 };
 
 enum bpf_stack_slot_type {
@@ -163,6 +181,7 @@ enum bpf_stack_slot_type {
  * type of all registers and stack info
  */
 struct verifier_state {
+	struct verifier_state *parent;	/* explored state we came from */
 	struct reg_state regs[MAX_BPF_REG];
 	u8 stack_slot_type[MAX_BPF_STACK];
 	struct reg_state spilled_regs[MAX_BPF_STACK / BPF_REG_SIZE];
@@ -246,6 +265,8 @@ static const struct {
 	{BPF_MAP_TYPE_PROG_ARRAY, BPF_FUNC_tail_call},
 	{BPF_MAP_TYPE_PERF_EVENT_ARRAY, BPF_FUNC_perf_event_read},
 	{BPF_MAP_TYPE_PERF_EVENT_ARRAY, BPF_FUNC_perf_event_output},
+	{BPF_MAP_TYPE_STACK_TRACE, BPF_FUNC_get_stackid},
+	{BPF_MAP_TYPE_SOCKMAP, BPF_FUNC_sk_redirect_map},
 };
 
 static void print_verifier_state(struct verifier_env *env)
@@ -486,6 +507,37 @@ static void init_reg_state(struct reg_state *regs)
 	regs[BPF_REG_1].type = PTR_TO_CTX;
 }
 
+/* the rest of the path depends on the value of @regno, so do the states
+ * that passed it down to us, up to the one that wrote it
+ */
+static void mark_reg_read(const struct verifier_state *state, u32 regno)
+{
+	struct verifier_state *parent = state->parent;
+
+	while (parent) {
+		/* if read wasn't screened by an earlier write ... */
+		if (state->regs[regno].live & REG_LIVE_WRITTEN)
+			break;
+		/* ... then we depend on parent's value */
+		parent->regs[regno].live |= REG_LIVE_READ;
+		state = parent;
+		parent = state->parent;
+	}
+}
+
+static void mark_stack_slot_read(const struct verifier_state *state, int slot)
+{
+	struct verifier_state *parent = state->parent;
+
+	while (parent) {
+		if (state->spilled_regs[slot].live & REG_LIVE_WRITTEN)
+			break;
+		parent->spilled_regs[slot].live |= REG_LIVE_READ;
+		state = parent;
+		parent = state->parent;
+	}
+}
+
 static void mark_reg_unknown_value(struct reg_state *regs, u32 regno)
 {
 	BUG_ON(regno >= MAX_BPF_REG);
@@ -500,9 +552,11 @@ enum reg_arg_type {
 	DST_OP_NO_MARK	/* same as above, check only, don't mark */
 };
 
-static int check_reg_arg(struct reg_state *regs, u32 regno,
+static int check_reg_arg(struct verifier_env *env, u32 regno,
 			 enum reg_arg_type t)
 {
+	struct reg_state *regs = env->cur_state.regs;
+
 	if (regno >= MAX_BPF_REG) {
 		verbose("R%d is invalid\n", regno);
 		return -EINVAL;
@@ -514,12 +568,14 @@ static int check_reg_arg(struct reg_state *regs, u32 regno,
 			verbose("R%d !read_ok\n", regno);
 			return -EACCES;
 		}
+		mark_reg_read(&env->cur_state, regno);
 	} else {
 		/* check whether register used as dest operand can be written to */
 		if (regno == BPF_REG_FP) {
 			verbose("frame pointer is read only\n");
 			return -EACCES;
 		}
+		regs[regno].live |= REG_LIVE_WRITTEN;
 		if (t == DST_OP)
 			mark_reg_unknown_value(regs, regno);
 	}
@@ -561,6 +617,8 @@ static bool is_spillable_regtype(enum bpf_reg_type type)
 static int check_stack_write(struct verifier_state *state, int off, int size,
 			     int value_regno)
 {
+	int slot = (MAX_BPF_STACK + off) / BPF_REG_SIZE;
+	enum reg_liveness live = state->spilled_regs[slot].live;
 	int i;
 	/* caller checked that off % size == 0 and -MAX_BPF_STACK <= off < 0,
 	 * so it's aligned access and [off, off + size) are within stack limits
@@ -576,15 +634,19 @@ static int check_stack_write(struct verifier_state *state, int off, int size,
 		}
 
 		/* save register state */
-		state->spilled_regs[(MAX_BPF_STACK + off) / BPF_REG_SIZE] =
-			state->regs[value_regno];
+		state->spilled_regs[slot] = state->regs[value_regno];
+		state->spilled_regs[slot].live = live | REG_LIVE_WRITTEN;
 
 		for (i = 0; i < BPF_REG_SIZE; i++)
 			state->stack_slot_type[MAX_BPF_STACK + off + i] = STACK_SPILL;
 	} else {
-		/* regular write of data into stack */
-		state->spilled_regs[(MAX_BPF_STACK + off) / BPF_REG_SIZE] =
-			(struct reg_state) {};
+		/* regular write of data into stack, only a write of the
+		 * whole slot hides its previous contents
+		 */
+		state->spilled_regs[slot] = (struct reg_state) {};
+		if (size == BPF_REG_SIZE)
+			live |= REG_LIVE_WRITTEN;
+		state->spilled_regs[slot].live = live;
 
 		for (i = 0; i < size; i++)
 			state->stack_slot_type[MAX_BPF_STACK + off + i] = STACK_MISC;
@@ -595,10 +657,12 @@ static int check_stack_write(struct verifier_state *state, int off, int size,
 static int check_stack_read(struct verifier_state *state, int off, int size,
 			    int value_regno)
 {
+	int slot = (MAX_BPF_STACK + off) / BPF_REG_SIZE;
 	u8 *slot_type;
 	int i;
 
 	slot_type = &state->stack_slot_type[MAX_BPF_STACK + off];
+	mark_stack_slot_read(state, slot);
 
 	if (slot_type[0] == STACK_SPILL) {
 		if (size != BPF_REG_SIZE) {
@@ -612,10 +676,11 @@ static int check_stack_read(struct verifier_state *state, int off, int size,
 			}
 		}
 
-		if (value_regno >= 0)
+		if (value_regno >= 0) {
 			/* restore register state from stack */
-			state->regs[value_regno] =
-				state->spilled_regs[(MAX_BPF_STACK + off) / BPF_REG_SIZE];
+			state->regs[value_regno] = state->spilled_regs[slot];
+			state->regs[value_regno].live = REG_LIVE_WRITTEN;
+		}
 		return 0;
 	} else {
 		for (i = 0; i < size; i++) {
@@ -754,12 +819,12 @@ static int check_xadd(struct verifier_env *env, struct bpf_insn *insn)
 	}
 
 	/* check src1 operand */
-	err = check_reg_arg(regs, insn->src_reg, SRC_OP);
+	err = check_reg_arg(env, insn->src_reg, SRC_OP);
 	if (err)
 		return err;
 
 	/* check src2 operand */
-	err = check_reg_arg(regs, insn->dst_reg, SRC_OP);
+	err = check_reg_arg(env, insn->dst_reg, SRC_OP);
 	if (err)
 		return err;
 
@@ -803,6 +868,10 @@ static int check_stack_boundary(struct verifier_env *env,
 			return -EACCES;
 		}
 	}
+
+	for (i = (MAX_BPF_STACK + off) / BPF_REG_SIZE;
+	     i <= (MAX_BPF_STACK + off + access_size - 1) / BPF_REG_SIZE; i++)
+		mark_stack_slot_read(state, i);
 	return 0;
 }
 
@@ -820,6 +889,7 @@ static int check_func_arg(struct verifier_env *env, u32 regno,
 		verbose("R%d !read_ok\n", regno);
 		return -EACCES;
 	}
+	mark_reg_read(&env->cur_state, regno);
 
 	if (arg_type == ARG_ANYTHING) {
 		if (is_pointer_value(env, regno)) {
@@ -915,6 +985,11 @@ static int check_map_func_compatibility(struct bpf_map *map, int func_id)
 			return -EINVAL;
 	}
 
+	/* a sockmap holds sockets, programs can only redirect to them */
+	if (map->map_type == BPF_MAP_TYPE_SOCKMAP &&
+	    func_id != BPF_FUNC_sk_redirect_map)
+		return -EINVAL;
+
 	return 0;
 }
 
@@ -969,6 +1044,7 @@ static int check_call(struct verifier_env *env, int func_id)
 		reg = regs + caller_saved[i];
 		reg->type = NOT_INIT;
 		reg->imm = 0;
+		reg->live |= REG_LIVE_WRITTEN;
 	}
 
 	/* update return register */
@@ -1024,7 +1100,7 @@ static int check_alu_op(struct verifier_env *env, struct bpf_insn *insn)
 		}
 
 		/* check src operand */
-		err = check_reg_arg(regs, insn->dst_reg, SRC_OP);
+		err = check_reg_arg(env, insn->dst_reg, SRC_OP);
 		if (err)
 			return err;
 
@@ -1035,7 +1111,7 @@ static int check_alu_op(struct verifier_env *env, struct bpf_insn *insn)
 		}
 
 		/* check dest operand */
-		err = check_reg_arg(regs, insn->dst_reg, DST_OP);
+		err = check_reg_arg(env, insn->dst_reg, DST_OP);
 		if (err)
 			return err;
 
@@ -1048,7 +1124,7 @@ static int check_alu_op(struct verifier_env *env, struct bpf_insn *insn)
 			}
 
 			/* check src operand */
-			err = check_reg_arg(regs, insn->src_reg, SRC_OP);
+			err = check_reg_arg(env, insn->src_reg, SRC_OP);
 			if (err)
 				return err;
 		} else {
@@ -1059,7 +1135,7 @@ static int check_alu_op(struct verifier_env *env, struct bpf_insn *insn)
 		}
 
 		/* check dest operand */
-		err = check_reg_arg(regs, insn->dst_reg, DST_OP);
+		err = check_reg_arg(env, insn->dst_reg, DST_OP);
 		if (err)
 			return err;
 
@@ -1069,6 +1145,7 @@ static int check_alu_op(struct verifier_env *env, struct bpf_insn *insn)
 				 * copy register state to dest reg
 				 */
 				regs[insn->dst_reg] = regs[insn->src_reg];
+				regs[insn->dst_reg].live = REG_LIVE_WRITTEN;
 			} else {
 				if (is_pointer_value(env, insn->src_reg)) {
 					verbose("R%d partial copy of pointer\n",
@@ -1100,7 +1177,7 @@ static int check_alu_op(struct verifier_env *env, struct bpf_insn *insn)
 				return -EINVAL;
 			}
 			/* check src1 operand */
-			err = check_reg_arg(regs, insn->src_reg, SRC_OP);
+			err = check_reg_arg(env, insn->src_reg, SRC_OP);
 			if (err)
 				return err;
 		} else {
@@ -1111,7 +1188,7 @@ static int check_alu_op(struct verifier_env *env, struct bpf_insn *insn)
 		}
 
 		/* check src2 operand */
-		err = check_reg_arg(regs, insn->dst_reg, SRC_OP);
+		err = check_reg_arg(env, insn->dst_reg, SRC_OP);
 		if (err)
 			return err;
 
@@ -1148,7 +1225,7 @@ static int check_alu_op(struct verifier_env *env, struct bpf_insn *insn)
 		}
 
 		/* check dest operand */
-		err = check_reg_arg(regs, insn->dst_reg, DST_OP);
+		err = check_reg_arg(env, insn->dst_reg, DST_OP);
 		if (err)
 			return err;
 
@@ -1181,7 +1258,7 @@ static int check_cond_jmp_op(struct verifier_env *env,
 		}
 
 		/* check src1 operand */
-		err = check_reg_arg(regs, insn->src_reg, SRC_OP);
+		err = check_reg_arg(env, insn->src_reg, SRC_OP);
 		if (err)
 			return err;
 
@@ -1198,7 +1275,7 @@ static int check_cond_jmp_op(struct verifier_env *env,
 	}
 
 	/* check src2 operand */
-	err = check_reg_arg(regs, insn->dst_reg, SRC_OP);
+	err = check_reg_arg(env, insn->dst_reg, SRC_OP);
 	if (err)
 		return err;
 
@@ -1292,7 +1369,7 @@ static int check_ld_imm(struct verifier_env *env, struct bpf_insn *insn)
 		return -EINVAL;
 	}
 
-	err = check_reg_arg(regs, insn->dst_reg, DST_OP);
+	err = check_reg_arg(env, insn->dst_reg, DST_OP);
 	if (err)
 		return err;
 
@@ -1314,6 +1391,8 @@ static bool may_access_skb(enum bpf_prog_type type)
 	case BPF_PROG_TYPE_SOCKET_FILTER:
 	case BPF_PROG_TYPE_SCHED_CLS:
 	case BPF_PROG_TYPE_SCHED_ACT:
+	case BPF_PROG_TYPE_SK_SKB:
+	case BPF_PROG_TYPE_CGROUP_SKB:
 		return true;
 	default:
 		return false;
@@ -1354,7 +1433,7 @@ static int check_ld_abs(struct verifier_env *env, struct bpf_insn *insn)
 	}
 
 	/* check whether implicit source operand (register R6) is readable */
-	err = check_reg_arg(regs, BPF_REG_6, SRC_OP);
+	err = check_reg_arg(env, BPF_REG_6, SRC_OP);
 	if (err)
 		return err;
 
@@ -1365,7 +1444,7 @@ static int check_ld_abs(struct verifier_env *env, struct bpf_insn *insn)
 
 	if (mode == BPF_IND) {
 		/* check explicit source operand */
-		err = check_reg_arg(regs, insn->src_reg, SRC_OP);
+		err = check_reg_arg(env, insn->src_reg, SRC_OP);
 		if (err)
 			return err;
 	}
@@ -1375,6 +1454,7 @@ static int check_ld_abs(struct verifier_env *env, struct bpf_insn *insn)
 		reg = regs + caller_saved[i];
 		reg->type = NOT_INIT;
 		reg->imm = 0;
+		reg->live |= REG_LIVE_WRITTEN;
 	}
 
 	/* mark destination R0 register as readable, since it contains
@@ -1605,14 +1685,20 @@ err_free:
  * Similarly with registers. If explored state has register type as invalid
  * whereas register type in current state is meaningful, it means that
  * the current state will reach 'bpf_exit' instruction safely
+ *
+ * Registers and stack slots that no path below the explored state read
+ * before overwriting them are not compared at all.
  */
 static bool states_equal(struct verifier_state *old, struct verifier_state *cur)
 {
 	int i;
 
 	for (i = 0; i < MAX_BPF_REG; i++) {
+		if (!(old->regs[i].live & REG_LIVE_READ))
+			/* explored state didn't use this */
+			continue;
 		if (memcmp(&old->regs[i], &cur->regs[i],
-			   sizeof(old->regs[0])) != 0) {
+			   offsetof(struct reg_state, live)) != 0) {
 			if (old->regs[i].type == NOT_INIT ||
 			    (old->regs[i].type == UNKNOWN_VALUE &&
 			     cur->regs[i].type != NOT_INIT))
@@ -1622,6 +1708,9 @@ static bool states_equal(struct verifier_state *old, struct verifier_state *cur)
 	}
 
 	for (i = 0; i < MAX_BPF_STACK; i++) {
+		if (!(old->spilled_regs[i / BPF_REG_SIZE].live & REG_LIVE_READ))
+			/* explored state didn't use this */
+			continue;
 		if (old->stack_slot_type[i] == STACK_INVALID)
 			continue;
 		if (old->stack_slot_type[i] != cur->stack_slot_type[i])
@@ -1635,7 +1724,7 @@ static bool states_equal(struct verifier_state *old, struct verifier_state *cur)
 			continue;
 		if (memcmp(&old->spilled_regs[i / BPF_REG_SIZE],
 			   &cur->spilled_regs[i / BPF_REG_SIZE],
-			   sizeof(old->spilled_regs[0])))
+			   offsetof(struct reg_state, live)))
 			/* when explored and current stack slot types are
 			 * the same, check that stored pointers types
 			 * are the same as well.
@@ -1653,6 +1742,34 @@ static bool states_equal(struct verifier_state *old, struct verifier_state *cur)
 	return true;
 }
 
+/* The paths below the explored state @old are also the paths below @cur,
+ * so whatever they read, the parents of @cur depend on as well.
+ */
+static void propagate_liveness(const struct verifier_state *old,
+			       struct verifier_state *cur)
+{
+	int i;
+
+	for (i = 0; i < MAX_BPF_REG; i++)
+		if (old->regs[i].live & REG_LIVE_READ)
+			mark_reg_read(cur, i);
+
+	for (i = 0; i < MAX_BPF_STACK / BPF_REG_SIZE; i++)
+		if (old->spilled_regs[i].live & REG_LIVE_READ)
+			mark_stack_slot_read(cur, i);
+}
+
+static void clear_liveness(struct verifier_state *state)
+{
+	int i;
+
+	for (i = 0; i < MAX_BPF_REG; i++)
+		state->regs[i].live = REG_LIVE_NONE;
+
+	for (i = 0; i < MAX_BPF_STACK / BPF_REG_SIZE; i++)
+		state->spilled_regs[i].live = REG_LIVE_NONE;
+}
+
 static int is_state_visited(struct verifier_env *env, int insn_idx)
 {
 	struct verifier_state_list *new_sl;
@@ -1666,11 +1783,13 @@ static int is_state_visited(struct verifier_env *env, int insn_idx)
 		return 0;
 
 	while (sl != STATE_LIST_MARK) {
-		if (states_equal(&sl->state, &env->cur_state))
+		if (states_equal(&sl->state, &env->cur_state)) {
 			/* reached equivalent register/stack state,
 			 * prune the search
 			 */
+			propagate_liveness(&sl->state, &env->cur_state);
 			return 1;
+		}
 		sl = sl->next;
 	}
 
@@ -1688,6 +1807,12 @@ static int is_state_visited(struct verifier_env *env, int insn_idx)
 	memcpy(&new_sl->state, &env->cur_state, sizeof(env->cur_state));
 	new_sl->next = env->explored_states[insn_idx];
 	env->explored_states[insn_idx] = new_sl;
+
+	/* from here on the reads of the current path are recorded in the
+	 * state just saved, whose own marks stay as they are
+	 */
+	env->cur_state.parent = &new_sl->state;
+	clear_liveness(&env->cur_state);
 	return 0;
 }
 
@@ -1760,11 +1885,11 @@ static int do_check(struct verifier_env *env)
 			/* check for reserved fields is already done */
 
 			/* check src operand */
-			err = check_reg_arg(regs, insn->src_reg, SRC_OP);
+			err = check_reg_arg(env, insn->src_reg, SRC_OP);
 			if (err)
 				return err;
 
-			err = check_reg_arg(regs, insn->dst_reg, DST_OP_NO_MARK);
+			err = check_reg_arg(env, insn->dst_reg, DST_OP_NO_MARK);
 			if (err)
 				return err;
 
@@ -1817,11 +1942,11 @@ static int do_check(struct verifier_env *env)
 			}
 
 			/* check src1 operand */
-			err = check_reg_arg(regs, insn->src_reg, SRC_OP);
+			err = check_reg_arg(env, insn->src_reg, SRC_OP);
 			if (err)
 				return err;
 			/* check src2 operand */
-			err = check_reg_arg(regs, insn->dst_reg, SRC_OP);
+			err = check_reg_arg(env, insn->dst_reg, SRC_OP);
 			if (err)
 				return err;
 
@@ -1850,7 +1975,7 @@ static int do_check(struct verifier_env *env)
 				return -EINVAL;
 			}
 			/* check src operand */
-			err = check_reg_arg(regs, insn->dst_reg, SRC_OP);
+			err = check_reg_arg(env, insn->dst_reg, SRC_OP);
 			if (err)
 				return err;
 
@@ -1904,7 +2029,7 @@ static int do_check(struct verifier_env *env)
 				 * of bpf_exit, which means that program wrote
 				 * something into it earlier
 				 */
-				err = check_reg_arg(regs, BPF_REG_0, SRC_OP);
+				err = check_reg_arg(env, BPF_REG_0, SRC_OP);
 				if (err)
 					return err;
 
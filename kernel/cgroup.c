@@ -59,6 +59,8 @@
 #include <linux/delay.h>
 #include <linux/cpuset.h>
 #include <linux/atomic.h>
+#include <linux/file.h>
+#include <net/sock.h>
 
 /*
  * pidlists linger the following amount before being destroyed.  The goal
@@ -440,11 +442,6 @@ static bool cgroup_tryget(struct cgroup *cgrp)
 	return css_tryget(&cgrp->self);
 }
 
-static void cgroup_put(struct cgroup *cgrp)
-{
-	css_put(&cgrp->self);
-}
-
 struct cgroup_subsys_state *of_css(struct kernfs_open_file *of)
 {
 	struct cgroup *cgrp = of->kn->parent->priv;
@@ -722,7 +719,7 @@ static void css_set_move_task(struct task_struct *task,
 
 		if (!css_set_populated(to_cset))
 			css_set_update_populated(to_cset, true);
-		rcu_assign_pointer(task->cgroups, to_cset);
+		cgroup_move_task(task, to_cset);
 		list_add_tail(&task->cg_list, use_mg_tasks ? &to_cset->mg_tasks :
 							     &to_cset->tasks);
 	}
@@ -4377,6 +4374,36 @@ static int pidlist_array_load(struct cgroup *cgrp, enum cgroup_filetype type,
 	return 0;
 }
 
+/*
+ * Look up the cgroup of a cgroupfs directory dentry which didn't come to
+ * us through kernfs.  Must be called with cgroup_mutex held.
+ */
+static struct cgroup *cgroup_from_dir_dentry(struct dentry *dentry)
+{
+	struct kernfs_node *kn = kernfs_node_from_dentry(dentry);
+	struct cgroup *cgrp;
+
+	lockdep_assert_held(&cgroup_mutex);
+
+	/* it should be kernfs_node belonging to cgroupfs and is a directory */
+	if (dentry->d_sb->s_type != &cgroup_fs_type || !kn ||
+	    kernfs_type(kn) != KERNFS_DIR)
+		return ERR_PTR(-EINVAL);
+
+	/*
+	 * We aren't being called from kernfs and there's no guarantee on
+	 * @kn->priv's validity.  For this and css_tryget_online_from_dir(),
+	 * @kn->priv is RCU safe.  Let's do the RCU dancing.
+	 */
+	rcu_read_lock();
+	cgrp = rcu_dereference(kn->priv);
+	if (!cgrp || cgroup_is_dead(cgrp))
+		cgrp = ERR_PTR(-ENOENT);
+	rcu_read_unlock();
+
+	return cgrp;
+}
+
 /**
  * cgroupstats_build - build and fill cgroupstats
  * @stats: cgroupstats to fill information into
@@ -4388,31 +4415,17 @@ static int pidlist_array_load(struct cgroup *cgrp, enum cgroup_filetype type,
  */
 int cgroupstats_build(struct cgroupstats *stats, struct dentry *dentry)
 {
-	struct kernfs_node *kn = kernfs_node_from_dentry(dentry);
 	struct cgroup *cgrp;
 	struct css_task_iter it;
 	struct task_struct *tsk;
 
-	/* it should be kernfs_node belonging to cgroupfs and is a directory */
-	if (dentry->d_sb->s_type != &cgroup_fs_type || !kn ||
-	    kernfs_type(kn) != KERNFS_DIR)
-		return -EINVAL;
-
 	mutex_lock(&cgroup_mutex);
 
-	/*
-	 * We aren't being called from kernfs and there's no guarantee on
-	 * @kn->priv's validity.  For this and css_tryget_online_from_dir(),
-	 * @kn->priv is RCU safe.  Let's do the RCU dancing.
-	 */
-	rcu_read_lock();
-	cgrp = rcu_dereference(kn->priv);
-	if (!cgrp || cgroup_is_dead(cgrp)) {
-		rcu_read_unlock();
+	cgrp = cgroup_from_dir_dentry(dentry);
+	if (IS_ERR(cgrp)) {
 		mutex_unlock(&cgroup_mutex);
-		return -ENOENT;
+		return PTR_ERR(cgrp);
 	}
-	rcu_read_unlock();
 
 	css_task_iter_start(&cgrp->self, &it);
 	while ((tsk = css_task_iter_next(&it))) {
@@ -4441,6 +4454,49 @@ int cgroupstats_build(struct cgroupstats *stats, struct dentry *dentry)
 	return 0;
 }
 
+/**
+ * cgroup_grab_tasks - take references on a batch of a cgroup's tasks
+ * @dentry: A dentry entry belonging to the cgroup
+ * @pos: number of tasks of the cgroup to skip
+ * @tasks: array to fill
+ * @nr: size of @tasks
+ *
+ * Lets taskstats walk the tasks of a cgroup over several calls without
+ * holding css_set_lock while it does work that may sleep.  Returns the
+ * number of tasks stored in @tasks, each with a reference the caller has
+ * to drop, or -errno.  Fewer than @nr means the walk is complete.
+ */
+int cgroup_grab_tasks(struct dentry *dentry, unsigned long pos,
+		      struct task_struct **tasks, int nr)
+{
+	struct cgroup *cgrp;
+	struct css_task_iter it;
+	struct task_struct *tsk;
+	int n = 0;
+
+	mutex_lock(&cgroup_mutex);
+
+	cgrp = cgroup_from_dir_dentry(dentry);
+	if (IS_ERR(cgrp)) {
+		mutex_unlock(&cgroup_mutex);
+		return PTR_ERR(cgrp);
+	}
+
+	css_task_iter_start(&cgrp->self, &it);
+	while (n < nr && (tsk = css_task_iter_next(&it))) {
+		if (pos) {
+			pos--;
+			continue;
+		}
+		get_task_struct(tsk);
+		tasks[n++] = tsk;
+	}
+	css_task_iter_end(&it);
+
+	mutex_unlock(&cgroup_mutex);
+	return n;
+}
+
 
 /*
  * seq_file methods for the tasks/procs files. The seq_file position is the
@@ -4578,6 +4634,21 @@ static int cgroup_clone_children_write(struct cgroup_subsys_state *css,
 	return 0;
 }
 
+#ifdef CONFIG_PSI
+static int cgroup_io_pressure_show(struct seq_file *seq, void *v)
+{
+	return psi_show(seq, cgroup_psi(seq_css(seq)->cgroup), PSI_IO);
+}
+static int cgroup_memory_pressure_show(struct seq_file *seq, void *v)
+{
+	return psi_show(seq, cgroup_psi(seq_css(seq)->cgroup), PSI_MEM);
+}
+static int cgroup_cpu_pressure_show(struct seq_file *seq, void *v)
+{
+	return psi_show(seq, cgroup_psi(seq_css(seq)->cgroup), PSI_CPU);
+}
+#endif
+
 /* cgroup core interface files for the default hierarchy */
 static struct cftype cgroup_dfl_base_files[] = {
 	{
@@ -4611,6 +4682,20 @@ static struct cftype cgroup_dfl_base_files[] = {
 		.file_offset = offsetof(struct cgroup, events_file),
 		.seq_show = cgroup_events_show,
 	},
+#ifdef CONFIG_PSI
+	{
+		.name = "io.pressure",
+		.seq_show = cgroup_io_pressure_show,
+	},
+	{
+		.name = "memory.pressure",
+		.seq_show = cgroup_memory_pressure_show,
+	},
+	{
+		.name = "cpu.pressure",
+		.seq_show = cgroup_cpu_pressure_show,
+	},
+#endif
 	{ }	/* terminate */
 };
 
@@ -4716,6 +4801,7 @@ static void css_free_work_fn(struct work_struct *work)
 			 */
 			cgroup_put(cgroup_parent(cgrp));
 			kernfs_put(cgrp->kn);
+			psi_cgroup_free(cgrp);
 			kfree(cgrp);
 		} else {
 			/*
@@ -4758,6 +4844,7 @@ static void css_release_work_fn(struct work_struct *work)
 		/* cgroup release path */
 		cgroup_idr_remove(&cgrp->root->cgroup_idr, cgrp->id);
 		cgrp->id = -1;
+		cgroup_bpf_put(cgrp);
 
 		/*
 		 * There are two control paths which try to determine
@@ -4948,6 +5035,10 @@ static int cgroup_mkdir(struct kernfs_node *parent_kn, const char *name,
 	if (ret)
 		goto out_free_cgrp;
 
+	ret = psi_cgroup_alloc(cgrp);
+	if (ret)
+		goto out_cancel_ref;
+
 	/*
 	 * Temporarily set the pointer to NULL, so idr_find() won't return
 	 * a half-baked cgroup.
@@ -4955,7 +5046,7 @@ static int cgroup_mkdir(struct kernfs_node *parent_kn, const char *name,
 	cgrp->id = cgroup_idr_alloc(&root->cgroup_idr, NULL, 2, 0, GFP_KERNEL);
 	if (cgrp->id < 0) {
 		ret = -ENOMEM;
-		goto out_cancel_ref;
+		goto out_psi_free;
 	}
 
 	init_cgroup_housekeeping(cgrp);
@@ -4969,6 +5060,8 @@ static int cgroup_mkdir(struct kernfs_node *parent_kn, const char *name,
 	if (test_bit(CGRP_CPUSET_CLONE_CHILDREN, &parent->flags))
 		set_bit(CGRP_CPUSET_CLONE_CHILDREN, &cgrp->flags);
 
+	cgroup_bpf_inherit(cgrp, parent);
+
 	/* create the directory */
 	kn = kernfs_create_dir(parent->kn, name, mode, cgrp);
 	if (IS_ERR(kn)) {
@@ -5030,6 +5123,8 @@ static int cgroup_mkdir(struct kernfs_node *parent_kn, const char *name,
 
 out_free_id:
 	cgroup_idr_remove(&root->cgroup_idr, cgrp->id);
+out_psi_free:
+	psi_cgroup_free(cgrp);
 out_cancel_ref:
 	percpu_ref_exit(&cgrp->self.refcnt);
 out_free_cgrp:
@@ -5855,6 +5950,89 @@ struct cgroup_subsys_state *css_from_id(int id, struct cgroup_subsys *ss)
 	return id > 0 ? idr_find(&ss->css_idr, id) : NULL;
 }
 
+/**
+ * cgroup_get_from_fd - get a cgroup pointer from a fd
+ * @fd: fd obtained by open(cgroup2_dir)
+ *
+ * Find the cgroup from a fd which should be obtained
+ * by opening a cgroup directory.  Returns a pointer to the
+ * cgroup on success. ERR_PTR is returned if the cgroup
+ * cannot be found or is not on the default hierarchy.
+ */
+struct cgroup *cgroup_get_from_fd(int fd)
+{
+	struct cgroup_subsys_state *css;
+	struct cgroup *cgrp;
+	struct file *f;
+
+	f = fget_raw(fd);
+	if (!f)
+		return ERR_PTR(-EBADF);
+
+	css = css_tryget_online_from_dir(f->f_path.dentry, NULL);
+	fput(f);
+	if (IS_ERR(css))
+		return ERR_CAST(css);
+
+	cgrp = css->cgroup;
+	if (!cgroup_on_dfl(cgrp)) {
+		cgroup_put(cgrp);
+		return ERR_PTR(-EBADF);
+	}
+
+	return cgrp;
+}
+EXPORT_SYMBOL_GPL(cgroup_get_from_fd);
+
+#ifdef CONFIG_CGROUP_BPF
+void cgroup_sk_alloc(struct sock *sk)
+{
+	/*
+	 * A clone shares the cgroup of its parent, which may be offline
+	 * by now; take a plain reference on it.
+	 */
+	if (sk->sk_bpf_cgrp) {
+		css_get(&sk->sk_bpf_cgrp->self);
+		return;
+	}
+
+	/* Don't associate sockets created in softirq with current. */
+	if (in_interrupt())
+		return;
+
+	rcu_read_lock();
+
+	while (true) {
+		struct css_set *cset = task_css_set(current);
+
+		if (likely(cgroup_tryget(cset->dfl_cgrp))) {
+			sk->sk_bpf_cgrp = cset->dfl_cgrp;
+			break;
+		}
+		cpu_relax();
+	}
+
+	rcu_read_unlock();
+}
+
+void cgroup_sk_free(struct sock *sk)
+{
+	if (sk->sk_bpf_cgrp)
+		cgroup_put(sk->sk_bpf_cgrp);
+}
+
+void cgroup_bpf_update(struct cgroup *cgrp,
+		       struct bpf_prog *prog,
+		       enum bpf_attach_type type)
+{
+	struct cgroup *parent = cgroup_parent(cgrp);
+
+	mutex_lock(&cgroup_mutex);
+	__cgroup_bpf_update(cgrp, parent, prog, type);
+	mutex_unlock(&cgroup_mutex);
+}
+#endif /* CONFIG_CGROUP_BPF */
+
 #ifdef CONFIG_CGROUP_DEBUG
 static struct cgroup_subsys_state *
 debug_css_alloc(struct cgroup_subsys_state *parent_css)
@@ -466,16 +466,94 @@ perf_cgroup_set_timestamp(struct task_struct *task,
 #define PERF_CGROUP_SWOUT	0x1 /* cgroup switch out every event */
 #define PERF_CGROUP_SWIN	0x2 /* cgroup switch in events based on task */
 
+/*
+ * The cpu contexts holding cgroup events on each CPU, so that a cgroup
+ * switch only visits those rather than the contexts of every PMU.
+ */
+static DEFINE_PER_CPU(struct list_head, cgrp_cpuctx_list);
+
+static inline void
+perf_cgroup_ctx_list_add(struct perf_event_context *ctx, int cpu)
+{
+	struct perf_cpu_context *cpuctx;
+
+	cpuctx = container_of(ctx, struct perf_cpu_context, ctx);
+	list_add(&cpuctx->cgrp_cpuctx_entry,
+		 per_cpu_ptr(&cgrp_cpuctx_list, cpu));
+}
+
+static inline void perf_cgroup_ctx_list_del(struct perf_event_context *ctx)
+{
+	struct perf_cpu_context *cpuctx;
+
+	cpuctx = container_of(ctx, struct perf_cpu_context, ctx);
+	list_del(&cpuctx->cgrp_cpuctx_entry);
+}
+
+/*
+ * Whether moving @cpuctx from cgroup @from to cgroup @to changes which of
+ * its cgroup events match.  Tasks of sibling cgroups that are only
+ * monitored through a common ancestor, or not at all, match the same
+ * events, and those can then stay on the PMU.
+ */
+static bool perf_cgroup_switch_needed(struct perf_cpu_context *cpuctx,
+				      struct perf_cgroup *from,
+				      struct perf_cgroup *to)
+{
+	struct perf_event *event;
+
+	if (from == to)
+		return false;
+	if (!from || !to)
+		return true;
+
+	list_for_each_entry(event, &cpuctx->ctx.event_list, event_entry) {
+		struct cgroup *cgrp;
+
+		if (!is_cgroup_event(event))
+			continue;
+
+		cgrp = event->cgrp->css.cgroup;
+		if (cgroup_is_descendant(from->css.cgroup, cgrp) !=
+		    cgroup_is_descendant(to->css.cgroup, cgrp))
+			return true;
+	}
+	return false;
+}
+
+/*
+ * Move @cpuctx over to cgroup @cgrp while its events stay scheduled:
+ * stop the clock of the old cgroup and start the one of the new.
+ */
+static void perf_cgroup_switch_time(struct perf_cpu_context *cpuctx,
+				    struct perf_cgroup *cgrp)
+{
+	struct perf_cgroup_info *info;
+
+	update_context_time(&cpuctx->ctx);
+	update_cgrp_time_from_cpuctx(cpuctx);
+
+	cpuctx->cgrp = cgrp;
+	info = this_cpu_ptr(cgrp->info);
+	info->timestamp = cpuctx->ctx.timestamp;
+}
+
 /*
  * reschedule events based on the cgroup constraint of task.
  *
- * mode SWOUT : schedule out everything
- * mode SWIN : schedule in based on cgroup for next
+ * mode SWOUT : schedule out everything, @next is the cgroup switched to
+ * mode SWIN : schedule in based on cgroup for task
+ *
+ * The PMU is only reprogrammed when the set of matching cgroup events
+ * changes, otherwise the cpu context is switched over in place, at SWOUT
+ * time already, and SWIN finds nothing left to do.
  */
-static void perf_cgroup_switch(struct task_struct *task, int mode)
+static void perf_cgroup_switch(struct task_struct *task,
+			       struct perf_cgroup *next, int mode)
 {
+	struct list_head *list = this_cpu_ptr(&cgrp_cpuctx_list);
 	struct perf_cpu_context *cpuctx;
-	struct pmu *pmu;
+	struct perf_cgroup *cgrp;
 	unsigned long flags;
 
 	/*
@@ -490,46 +568,52 @@ static void perf_cgroup_switch(struct task_struct *task, int mode)
 	 * constrained events.
 	 */
 
-	list_for_each_entry_rcu(pmu, &pmus, entry) {
-		cpuctx = this_cpu_ptr(pmu->pmu_cpu_context);
-		if (cpuctx->unique_pmu != pmu)
-			continue; /* ensure we process each cpuctx once */
+	list_for_each_entry(cpuctx, list, cgrp_cpuctx_entry) {
+		WARN_ON_ONCE(cpuctx->ctx.nr_cgroups == 0);
+
+		perf_ctx_lock(cpuctx, cpuctx->task_ctx);
 
 		/*
-		 * perf_cgroup_events says at least one
-		 * context on this CPU has cgroup events.
-		 *
-		 * ctx->nr_cgroups reports the number of cgroup
-		 * events for a context.
+		 * we pass the cpuctx->ctx to perf_cgroup_from_task()
+		 * because cgroup events are only per-cpu
 		 */
-		if (cpuctx->ctx.nr_cgroups > 0) {
-			perf_ctx_lock(cpuctx, cpuctx->task_ctx);
-			perf_pmu_disable(cpuctx->ctx.pmu);
-
-			if (mode & PERF_CGROUP_SWOUT) {
-				cpu_ctx_sched_out(cpuctx, EVENT_ALL);
-				/*
-				 * must not be done before ctxswout due
-				 * to event_filter_match() in event_sched_out()
-				 */
-				cpuctx->cgrp = NULL;
-			}
+		cgrp = next;
+		if (mode & PERF_CGROUP_SWIN)
+			cgrp = perf_cgroup_from_task(task, &cpuctx->ctx);
 
-			if (mode & PERF_CGROUP_SWIN) {
-				WARN_ON_ONCE(cpuctx->cgrp);
-				/*
-				 * set cgrp before ctxsw in to allow
-				 * event_filter_match() to not have to pass
-				 * task around
-				 * we pass the cpuctx->ctx to perf_cgroup_from_task()
-				 * because cgorup events are only per-cpu
-				 */
-				cpuctx->cgrp = perf_cgroup_from_task(task, &cpuctx->ctx);
-				cpu_ctx_sched_in(cpuctx, EVENT_ALL, task);
-			}
-			perf_pmu_enable(cpuctx->ctx.pmu);
+		if (!perf_cgroup_switch_needed(cpuctx, cpuctx->cgrp, cgrp)) {
+			if (cpuctx->cgrp != cgrp)
+				perf_cgroup_switch_time(cpuctx, cgrp);
 			perf_ctx_unlock(cpuctx, cpuctx->task_ctx);
+			continue;
+		}
+
+		perf_pmu_disable(cpuctx->ctx.pmu);
+
+		/*
+		 * SWIN alone can find the context switched in place to
+		 * another cgroup, when the task moved in the meantime.
+		 */
+		if ((mode & PERF_CGROUP_SWOUT) || cpuctx->cgrp) {
+			cpu_ctx_sched_out(cpuctx, EVENT_ALL);
+			/*
+			 * must not be done before ctxswout due
+			 * to event_filter_match() in event_sched_out()
+			 */
+			cpuctx->cgrp = NULL;
 		}
+
+		if (mode & PERF_CGROUP_SWIN) {
+			/*
+			 * set cgrp before ctxsw in to allow
+			 * event_filter_match() to not have to pass
+			 * task around
+			 */
+			cpuctx->cgrp = cgrp;
+			cpu_ctx_sched_in(cpuctx, EVENT_ALL, task);
+		}
+		perf_pmu_enable(cpuctx->ctx.pmu);
+		perf_ctx_unlock(cpuctx, cpuctx->task_ctx);
 	}
 
 	local_irq_restore(flags);
@@ -562,7 +646,7 @@ static inline void perf_cgroup_sched_out(struct task_struct *task,
 	 * do no touch the cgroup events.
 	 */
 	if (cgrp1 != cgrp2)
-		perf_cgroup_switch(task, PERF_CGROUP_SWOUT);
+		perf_cgroup_switch(task, cgrp2, PERF_CGROUP_SWOUT);
 
 	rcu_read_unlock();
 }
@@ -590,7 +674,7 @@ static inline void perf_cgroup_sched_in(struct task_struct *prev,
 	 * out of ctxsw out if that was not the case.
 	 */
 	if (cgrp1 != cgrp2)
-		perf_cgroup_switch(task, PERF_CGROUP_SWIN);
+		perf_cgroup_switch(task, NULL, PERF_CGROUP_SWIN);
 
 	rcu_read_unlock();
 }
@@ -724,6 +808,15 @@ perf_cgroup_set_timestamp(struct task_struct *task,
 {
 }
 
+static inline void
+perf_cgroup_ctx_list_add(struct perf_event_context *ctx, int cpu)
+{
+}
+
+static inline void perf_cgroup_ctx_list_del(struct perf_event_context *ctx)
+{
+}
+
 void
 perf_cgroup_switch(struct task_struct *task, struct task_struct *next)
 {
@@ -1233,8 +1326,8 @@ list_add_event(struct perf_event *event, struct perf_event_context *ctx)
 		list_add_tail(&event->group_entry, list);
 	}
 
-	if (is_cgroup_event(event))
-		ctx->nr_cgroups++;
+	if (is_cgroup_event(event) && !ctx->nr_cgroups++)
+		perf_cgroup_ctx_list_add(ctx, event->cpu);
 
 	list_add_rcu(&event->event_entry, &ctx->event_list);
 	ctx->nr_events++;
@@ -1423,8 +1516,10 @@ list_del_event(struct perf_event *event, struct perf_event_context *ctx)
 		 * then cler cgrp to avoid stale pointer
 		 * in update_cgrp_time_from_cpuctx()
 		 */
-		if (!ctx->nr_cgroups)
+		if (!ctx->nr_cgroups) {
 			cpuctx->cgrp = NULL;
+			perf_cgroup_ctx_list_del(ctx);
+		}
 	}
 
 	ctx->nr_events--;
@@ -4940,9 +5035,9 @@ static int perf_fasync(int fd, struct file *filp, int on)
 	struct perf_event *event = filp->private_data;
 	int retval;
 
-	mutex_lock(&inode->i_mutex);
+	inode_lock(inode);
 	retval = fasync_helper(fd, filp, on, &event->fasync);
-	mutex_unlock(&inode->i_mutex);
+	inode_unlock(inode);
 
 	if (retval < 0)
 		return retval;
@@ -7073,6 +7168,7 @@ static void perf_event_free_filter(struct perf_event *event)
 
 static int perf_event_set_bpf_prog(struct perf_event *event, u32 prog_fd)
 {
+	bool is_kprobe, is_tracepoint;
 	struct bpf_prog *prog;
 
 	if (event->attr.type != PERF_TYPE_TRACEPOINT)
@@ -7081,15 +7177,18 @@ static int perf_event_set_bpf_prog(struct perf_event *event, u32 prog_fd)
 	if (event->tp_event->prog)
 		return -EEXIST;
 
-	if (!(event->tp_event->flags & TRACE_EVENT_FL_UKPROBE))
-		/* bpf programs can only be attached to u/kprobes */
+	is_kprobe = event->tp_event->flags & TRACE_EVENT_FL_UKPROBE;
+	is_tracepoint = event->tp_event->flags & TRACE_EVENT_FL_TRACEPOINT;
+	if (!is_kprobe && !is_tracepoint)
+		/* bpf programs can only be attached to u/kprobe or tracepoint */
 		return -EINVAL;
 
 	prog = bpf_prog_get(prog_fd);
 	if (IS_ERR(prog))
 		return PTR_ERR(prog);
 
-	if (prog->type != BPF_PROG_TYPE_KPROBE) {
+	if ((is_kprobe && prog->type != BPF_PROG_TYPE_KPROBE) ||
+	    (is_tracepoint && prog->type != BPF_PROG_TYPE_TRACEPOINT)) {
 		/* valid fd, but invalid bpf program type */
 		bpf_prog_put(prog);
 		return -EINVAL;
@@ -9272,6 +9371,9 @@ static void __init perf_event_init_all_cpus(void)
 		swhash = &per_cpu(swevent_htable, cpu);
 		mutex_init(&swhash->hlist_mutex);
 		INIT_LIST_HEAD(&per_cpu(active_ctx_list, cpu));
+#ifdef CONFIG_CGROUP_PERF
+		INIT_LIST_HEAD(&per_cpu(cgrp_cpuctx_list, cpu));
+#endif
 	}
 }
 
@@ -9470,7 +9572,7 @@ static int __perf_cgroup_move(void *info)
 {
 	struct task_struct *task = info;
 	rcu_read_lock();
-	perf_cgroup_switch(task, PERF_CGROUP_SWOUT | PERF_CGROUP_SWIN);
+	perf_cgroup_switch(task, NULL, PERF_CGROUP_SWOUT | PERF_CGROUP_SWIN);
 	rcu_read_unlock();
 	return 0;
 }
@@ -75,6 +75,7 @@
 #include <linux/aio.h>
 #include <linux/compiler.h>
 #include <linux/sysctl.h>
+#include <linux/rseq.h>
 
 #include <asm/pgtable.h>
 #include <asm/pgalloc.h>
@@ -209,6 +210,29 @@ struct kmem_cache *fs_cachep;
 /* SLAB cache for vm_area_struct structures */
 struct kmem_cache *vm_area_cachep;
 
+#ifdef CONFIG_PER_VMA_LOCK
+static void vm_area_free_rcu_cb(struct rcu_head *head)
+{
+	struct vm_area_struct *vma = container_of(head, struct vm_area_struct,
+						  vm_rcu);
+
+	kmem_cache_free(vm_area_cachep, vma);
+}
+#endif
+
+/*
+ * Free a vma that has been linked into an mm.  Page faults running under
+ * rcu_read_lock() may still be looking at it, see lock_vma_under_rcu().
+ */
+void vm_area_free(struct vm_area_struct *vma)
+{
+#ifdef CONFIG_PER_VMA_LOCK
+	call_rcu(&vma->vm_rcu, vm_area_free_rcu_cb);
+#else
+	kmem_cache_free(vm_area_cachep, vma);
+#endif
+}
+
 /* SLAB cache for mm_struct structures (tsk->mm) */
 static struct kmem_cache *mm_cachep;
 
@@ -432,6 +456,8 @@ static int dup_mmap(struct mm_struct *mm, struct mm_struct *oldmm)
 	for (mpnt = oldmm->mmap; mpnt; mpnt = mpnt->vm_next) {
 		struct file *file;
 
+		/* copy_page_range() write protects the parent's ptes */
+		vma_start_write(mpnt);
 		if (mpnt->vm_flags & VM_DONTCOPY) {
 			vm_stat_account(mm, mpnt->vm_flags, mpnt->vm_file,
 							-vma_pages(mpnt));
@@ -449,6 +475,7 @@ static int dup_mmap(struct mm_struct *mm, struct mm_struct *oldmm)
 		if (!tmp)
 			goto fail_nomem;
 		*tmp = *mpnt;
+		vma_init_lock(tmp);
 		INIT_LIST_HEAD(&tmp->anon_vma_chain);
 		retval = vma_dup_policy(mpnt, tmp);
 		if (retval)
@@ -514,6 +541,7 @@ static int dup_mmap(struct mm_struct *mm, struct mm_struct *oldmm)
 out:
 	up_write(&mm->mmap_sem);
 	flush_tlb_mm(oldmm);
+	vma_end_write_all(oldmm);
 	up_write(&oldmm->mmap_sem);
 	uprobe_end_dup_mmap();
 	return retval;
@@ -610,6 +638,9 @@ static struct mm_struct *mm_init(struct mm_struct *mm, struct task_struct *p)
 #if defined(CONFIG_TRANSPARENT_HUGEPAGE) && !USE_SPLIT_PMD_PTLOCKS
 	mm->pmd_huge_pte = NULL;
 #endif
+#ifdef CONFIG_FUTEX
+	mm->futex_phash = NULL;
+#endif
 
 	if (current->mm) {
 		mm->flags = current->mm->flags & MMF_INIT_MASK;
@@ -625,6 +656,7 @@ static struct mm_struct *mm_init(struct mm_struct *mm, struct task_struct *p)
 	if (init_new_context(p, mm))
 		goto fail_nocontext;
 
+	lru_gen_add_mm(mm);
 	return mm;
 
 fail_nocontext:
@@ -701,7 +733,9 @@ void mmput(struct mm_struct *mm)
 		exit_aio(mm);
 		ksm_exit(mm);
 		khugepaged_exit(mm); /* must run before exit_mmap */
+		lru_gen_del_mm(mm); /* must run before exit_mmap */
 		exit_mmap(mm);
+		futex_hash_free(mm);
 		set_mm_exe_file(mm, NULL);
 		if (!list_empty(&mm->mmlist)) {
 			spin_lock(&mmlist_lock);
@@ -972,6 +1006,18 @@ static int copy_mm(unsigned long clone_flags, struct task_struct *tsk)
 	vmacache_flush(tsk);
 
 	if (clone_flags & CLONE_VM) {
+		/*
+		 * The first time the mm gets a second user, give it its own
+		 * hash table for private futexes. No other task can have a
+		 * private futex queued on this mm yet, so switching tables
+		 * here cannot strand a waiter. A vfork parent sleeps until
+		 * the child lets go of the mm, so vfork doesn't need one.
+		 */
+		if (!(clone_flags & CLONE_VFORK)) {
+			retval = futex_hash_allocate(oldmm);
+			if (retval)
+				goto fail_nomem;
+		}
 		atomic_inc(&oldmm->mm_users);
 		mm = oldmm;
 		goto good_mm;
@@ -1612,6 +1658,7 @@ static struct task_struct *copy_process(unsigned long clone_flags,
 	cgroup_post_fork(p, cgrp_ss_priv);
 	threadgroup_change_end(current);
 	perf_event_fork(p);
+	rseq_fork(p, clone_flags);
 
 	trace_task_newtask(p, clone_flags);
 	uprobe_copy_process(p, clone_flags);
@@ -45,6 +45,7 @@
  *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
  */
 #include <linux/slab.h>
+#include <linux/vmalloc.h>
 #include <linux/poll.h>
 #include <linux/fs.h>
 #include <linux/file.h>
@@ -267,6 +268,18 @@ static struct {
 #define futex_queues   (__futex_data.queues)
 #define futex_hashsize (__futex_data.hashsize)
 
+/*
+ * Hash table for the PRIVATE futexes of one mm. It is set up when the mm
+ * first gets shared by another thread and lives until the mm goes away.
+ * Keeping private futexes out of the global table stops unrelated
+ * processes from contending on the same buckets, and the buckets are
+ * allocated on the node the process was running on.
+ */
+struct futex_private_hash {
+	unsigned long hashmask;
+	struct futex_hash_bucket queues[];
+};
+
 
 /*
  * Fault injections for futexes.
@@ -378,12 +391,80 @@ static inline int hb_waiters_pending(struct futex_hash_bucket *hb)
  */
 static struct futex_hash_bucket *hash_futex(union futex_key *key)
 {
+	struct futex_private_hash *fph = NULL;
 	u32 hash = jhash2((u32*)&key->both.word,
 			  (sizeof(key->both.word)+sizeof(key->both.ptr))/4,
 			  key->both.offset);
+
+	if (!(key->both.offset & (FUT_OFF_INODE | FUT_OFF_MMSHARED)))
+		fph = READ_ONCE(key->private.mm->futex_phash);
+	if (fph)
+		return &fph->queues[hash & fph->hashmask];
+
 	return &futex_queues[hash & (futex_hashsize - 1)];
 }
 
+static void futex_hash_bucket_init(struct futex_hash_bucket *fhb)
+{
+	atomic_set(&fhb->waiters, 0);
+	plist_head_init(&fhb->chain);
+	spin_lock_init(&fhb->lock);
+}
+
+/**
+ * futex_hash_allocate() - Set up the private futex hash table of an mm
+ * @mm:		the mm about to be shared by a new thread
+ *
+ * Called from copy_mm() before a CLONE_VM child is created. As long as
+ * the mm has a single user no task of it can be queued on a private
+ * futex, so the table can be installed without rehashing anything.
+ * The table is sized once, from the CPUs the process may run on: that
+ * bounds the number of concurrent waiters far better than the thread
+ * count does, and moving queued waiters between tables later would
+ * need a protocol this code does not have.
+ *
+ * Return: 0 on success, -ENOMEM if the table could not be allocated.
+ */
+int futex_hash_allocate(struct mm_struct *mm)
+{
+	struct futex_private_hash *fph;
+	unsigned int i, cpus;
+	unsigned long buckets;
+	size_t size;
+
+	if (CONFIG_BASE_SMALL || mm->futex_phash)
+		return 0;
+
+	cpus = min(num_online_cpus(), cpumask_weight(tsk_cpus_allowed(current)));
+	buckets = roundup_pow_of_two(4 * max(cpus, 1U));
+	buckets = clamp(buckets, 16UL, futex_hashsize);
+
+	size = sizeof(*fph) + buckets * sizeof(struct futex_hash_bucket);
+	fph = kzalloc_node(size, GFP_KERNEL | __GFP_NOWARN, numa_node_id());
+	if (!fph)
+		fph = vzalloc_node(size, numa_node_id());
+	if (!fph)
+		return -ENOMEM;
+
+	fph->hashmask = buckets - 1;
+	for (i = 0; i < buckets; i++)
+		futex_hash_bucket_init(&fph->queues[i]);
+
+	/* Pairs with the READ_ONCE() in hash_futex(). */
+	smp_store_release(&mm->futex_phash, fph);
+	return 0;
+}
+
+/**
+ * futex_hash_free() - Release the private futex hash table of an mm
+ * @mm:		the mm, which has no users left
+ */
+void futex_hash_free(struct mm_struct *mm)
+{
+	kvfree(mm->futex_phash);
+	mm->futex_phash = NULL;
+}
+
 /*
  * Return 1 if two futex_keys are equal, 0 otherwise.
  */
@@ -2351,6 +2432,215 @@ out:
 }
 
 
+struct futex_vector {
+	struct futex_q q;
+	u32 __user *uaddr;
+	u32 val;
+	unsigned int flags;
+};
+
+/*
+ * Unqueue the first @count entries of @vs. Return the index of the last
+ * futex that had already been woken, or -1 if none was.
+ */
+static int unqueue_multiple(struct futex_vector *vs, int count)
+{
+	int ret = -1, i;
+
+	for (i = 0; i < count; i++) {
+		if (!unqueue_me(&vs[i].q))
+			ret = i;
+	}
+	return ret;
+}
+
+/**
+ * futex_wait_multiple_setup() - Queue the task on every futex of a vector
+ * @vs:		the futexes to wait on
+ * @count:	the number of entries in @vs
+ * @woken:	index of a futex woken during the setup
+ *
+ * Like futex_wait_setup(), each futex value is checked with its hash
+ * bucket locked, and the futex_q is queued before the lock is dropped.
+ * The task state is set up front, so a wakeup on an entry that is
+ * already queued is not lost while the later entries are set up.
+ *
+ * Return:
+ *  0 - all futexes are queued and the task is TASK_INTERRUPTIBLE;
+ *  1 - a futex was woken during the setup, its index is in @woken;
+ * <0 - -EFAULT, -EWOULDBLOCK (a value did not match) or a key error;
+ *      nothing is queued.
+ */
+static int futex_wait_multiple_setup(struct futex_vector *vs, int count,
+				     int *woken)
+{
+	struct futex_hash_bucket *hb;
+	int ret, i, j;
+	u32 uval;
+
+retry:
+	for (i = 0; i < count; i++) {
+		ret = get_futex_key(vs[i].uaddr, vs[i].flags & FLAGS_SHARED,
+				    &vs[i].q.key, VERIFY_READ);
+		if (unlikely(ret)) {
+			while (i--)
+				put_futex_key(&vs[i].q.key);
+			return ret;
+		}
+	}
+
+	set_current_state(TASK_INTERRUPTIBLE);
+
+	for (i = 0; i < count; i++) {
+		struct futex_q *q = &vs[i].q;
+
+		hb = queue_lock(q);
+		ret = get_futex_value_locked(&uval, vs[i].uaddr);
+		if (!ret && uval == vs[i].val) {
+			queue_me(q, hb);
+			continue;
+		}
+
+		queue_unlock(hb);
+		__set_current_state(TASK_RUNNING);
+
+		/* unqueue_me() drops the key refs of the queued entries */
+		*woken = unqueue_multiple(vs, i);
+		for (j = i; j < count; j++)
+			put_futex_key(&vs[j].q.key);
+		if (*woken >= 0)
+			return 1;
+
+		if (ret) {
+			if (get_user(uval, vs[i].uaddr))
+				return -EFAULT;
+			goto retry;
+		}
+		return -EWOULDBLOCK;
+	}
+
+	return 0;
+}
+
+/*
+ * Sleep until one of the queued futexes is woken, the timeout expires or
+ * a signal arrives. Called in TASK_INTERRUPTIBLE, returns TASK_RUNNING.
+ */
+static void futex_sleep_multiple(struct futex_vector *vs, int count,
+				 struct hrtimer_sleeper *timeout)
+{
+	int i;
+
+	if (timeout && !timeout->task)
+		goto out;
+
+	for (i = 0; i < count; i++) {
+		if (plist_node_empty(&vs[i].q.list))
+			goto out;
+	}
+
+	freezable_schedule();
+out:
+	__set_current_state(TASK_RUNNING);
+}
+
+/**
+ * futex_wait_multiple() - Wait on several futexes at once
+ * @uaddr:	user address of the futex_wait_block array
+ * @flags:	futex flags of the operation (only FLAGS_CLOCKRT is used)
+ * @count:	number of entries in the array
+ * @abs_time:	absolute timeout, or NULL to wait forever
+ *
+ * Return: the index of the futex that woke us, or a negative error.
+ */
+static int futex_wait_multiple(u32 __user *uaddr, unsigned int flags,
+			       u32 count, ktime_t *abs_time)
+{
+	struct futex_wait_block __user *ublock = (void __user *)uaddr;
+	struct hrtimer_sleeper timeout, *to = NULL;
+	struct futex_vector *vs;
+	int ret, woken = -1;
+	u32 i;
+
+	if (!count || count > FUTEX_MULTIPLE_MAX_COUNT)
+		return -EINVAL;
+
+	vs = kcalloc(count, sizeof(*vs), GFP_KERNEL);
+	if (!vs)
+		return -ENOMEM;
+
+	for (i = 0; i < count; i++) {
+		struct futex_wait_block wb;
+
+		if (copy_from_user(&wb, &ublock[i], sizeof(wb))) {
+			ret = -EFAULT;
+			goto out_free;
+		}
+		if ((wb.flags & ~FUTEX_PRIVATE_FLAG) ||
+		    wb.uaddr != (unsigned long)wb.uaddr) {
+			ret = -EINVAL;
+			goto out_free;
+		}
+
+		vs[i].q = futex_q_init;
+		vs[i].uaddr = (u32 __user *)(unsigned long)wb.uaddr;
+		vs[i].val = wb.val;
+		vs[i].flags = (wb.flags & FUTEX_PRIVATE_FLAG) ? 0 : FLAGS_SHARED;
+	}
+
+	if (abs_time) {
+		to = &timeout;
+
+		hrtimer_init_on_stack(&to->timer, (flags & FLAGS_CLOCKRT) ?
+				      CLOCK_REALTIME : CLOCK_MONOTONIC,
+				      HRTIMER_MODE_ABS);
+		hrtimer_init_sleeper(to, current);
+		hrtimer_set_expires_range_ns(&to->timer, *abs_time,
+					     current->timer_slack_ns);
+	}
+
+	for (;;) {
+		ret = futex_wait_multiple_setup(vs, count, &woken);
+		if (ret) {
+			if (ret > 0)
+				ret = woken;
+			break;
+		}
+
+		/* Arm the timer once we are queued, as futex_wait() does. */
+		if (to && !hrtimer_active(&to->timer))
+			hrtimer_start_expires(&to->timer, HRTIMER_MODE_ABS);
+
+		futex_sleep_multiple(vs, count, to);
+
+		/* If one of the futexes was woken, we succeeded. */
+		ret = unqueue_multiple(vs, count);
+		if (ret >= 0)
+			break;
+
+		ret = -ETIMEDOUT;
+		if (to && !to->task)
+			break;
+
+		/*
+		 * We expect signal_pending(current), but we might be the
+		 * victim of a spurious wakeup as well. The timeout is
+		 * absolute, so the syscall can simply be restarted.
+		 */
+		ret = -ERESTARTSYS;
+		if (signal_pending(current))
+			break;
+	}
+
+	if (to) {
+		hrtimer_cancel(&to->timer);
+		destroy_hrtimer_on_stack(&to->timer);
+	}
+out_free:
+	kfree(vs);
+	return ret;
+}
+
 static long futex_wait_restart(struct restart_block *restart)
 {
 	u32 __user *uaddr = restart->futex.uaddr;
@@ -3070,7 +3360,8 @@ long do_futex(u32 __user *uaddr, int op, u32 val, ktime_t *timeout,
 
 	if (op & FUTEX_CLOCK_REALTIME) {
 		flags |= FLAGS_CLOCKRT;
-		if (cmd != FUTEX_WAIT_BITSET && cmd != FUTEX_WAIT_REQUEUE_PI)
+		if (cmd != FUTEX_WAIT_BITSET && cmd != FUTEX_WAIT_REQUEUE_PI &&
+		    cmd != FUTEX_WAIT_MULTIPLE)
 			return -ENOSYS;
 	}
 
@@ -3111,6 +3402,8 @@ long do_futex(u32 __user *uaddr, int op, u32 val, ktime_t *timeout,
 					     uaddr2);
 	case FUTEX_CMP_REQUEUE_PI:
 		return futex_requeue(uaddr, flags, uaddr2, val, val2, &val3, 1);
+	case FUTEX_WAIT_MULTIPLE:
+		return futex_wait_multiple(uaddr, flags, val, timeout);
 	}
 	return -ENOSYS;
 }
@@ -3127,7 +3420,8 @@ SYSCALL_DEFINE6(futex, u32 __user *, uaddr, int, op, u32, val,
 
 	if (utime && (cmd == FUTEX_WAIT || cmd == FUTEX_LOCK_PI ||
 		      cmd == FUTEX_WAIT_BITSET ||
-		      cmd == FUTEX_WAIT_REQUEUE_PI)) {
+		      cmd == FUTEX_WAIT_REQUEUE_PI ||
+		      cmd == FUTEX_WAIT_MULTIPLE)) {
 		if (unlikely(should_fail_futex(!(op & FUTEX_PRIVATE_FLAG))))
 			return -EFAULT;
 		if (copy_from_user(&ts, utime, sizeof(ts)) != 0)
@@ -3191,11 +3485,8 @@ static int __init futex_init(void)
 
 	futex_detect_cmpxchg();
 
-	for (i = 0; i < futex_hashsize; i++) {
-		atomic_set(&futex_queues[i].waiters, 0);
-		plist_head_init(&futex_queues[i].chain);
-		spin_lock_init(&futex_queues[i].lock);
-	}
+	for (i = 0; i < futex_hashsize; i++)
+		futex_hash_bucket_init(&futex_queues[i]);
 
 	return 0;
 }
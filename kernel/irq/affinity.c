@@ -0,0 +1,298 @@
+/*
+ * Spreading of multiqueue device interrupts over the cpus, and cpu hotplug
+ * handling for the resulting managed interrupts.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ */
+#include <linux/interrupt.h>
+#include <linux/kernel.h>
+#include <linux/slab.h>
+#include <linux/cpu.h>
+#include <linux/irq.h>
+
+#include "internals.h"
+
+static void irq_spread_init_one(struct cpumask *irqmsk, struct cpumask *nmsk,
+				int cpus_per_vec)
+{
+	const struct cpumask *siblmsk;
+	int cpu, sibl;
+
+	while (cpus_per_vec > 0) {
+		cpu = cpumask_first(nmsk);
+		if (cpu >= nr_cpu_ids)
+			return;
+
+		cpumask_clear_cpu(cpu, nmsk);
+		cpumask_set_cpu(cpu, irqmsk);
+		cpus_per_vec--;
+
+		/* Keep thread siblings on the same vector */
+		siblmsk = topology_sibling_cpumask(cpu);
+		for_each_cpu(sibl, siblmsk) {
+			if (!cpus_per_vec)
+				break;
+			if (!cpumask_test_and_clear_cpu(sibl, nmsk))
+				continue;
+			cpumask_set_cpu(sibl, irqmsk);
+			cpus_per_vec--;
+		}
+	}
+}
+
+static void free_node_to_possible_cpumask(cpumask_var_t *masks)
+{
+	int node;
+
+	for (node = 0; node < nr_node_ids; node++)
+		free_cpumask_var(masks[node]);
+	kfree(masks);
+}
+
+/*
+ * Possible rather than online cpus: the spread must not change when cpus
+ * come and go, the vectors follow hotplug instead.
+ */
+static cpumask_var_t *alloc_node_to_possible_cpumask(void)
+{
+	cpumask_var_t *masks;
+	int node, cpu;
+
+	masks = kcalloc(nr_node_ids, sizeof(cpumask_var_t), GFP_KERNEL);
+	if (!masks)
+		return NULL;
+
+	for (node = 0; node < nr_node_ids; node++) {
+		if (!zalloc_cpumask_var(&masks[node], GFP_KERNEL)) {
+			free_node_to_possible_cpumask(masks);
+			return NULL;
+		}
+	}
+
+	for_each_possible_cpu(cpu) {
+		node = cpu_to_node(cpu);
+		cpumask_set_cpu(cpu, masks[node == NUMA_NO_NODE ? 0 : node]);
+	}
+
+	return masks;
+}
+
+/*
+ * Split @nvec vectors between the nodes as evenly as possible, then the cpus
+ * of each node between the node's vectors.  With fewer vectors than nodes,
+ * each vector gets whole nodes.
+ */
+static void irq_spread_set(struct cpumask *masks, int nvec,
+			   cpumask_var_t *node_cpus, struct cpumask *nmsk)
+{
+	int node, nodes = 0, v = 0;
+
+	for (node = 0; node < nr_node_ids; node++)
+		if (!cpumask_empty(node_cpus[node]))
+			nodes++;
+
+	if (nvec <= nodes) {
+		for (node = 0; node < nr_node_ids; node++) {
+			if (cpumask_empty(node_cpus[node]))
+				continue;
+			cpumask_or(masks + v, masks + v, node_cpus[node]);
+			if (++v == nvec)
+				v = 0;
+		}
+		return;
+	}
+
+	for (node = 0; node < nr_node_ids && v < nvec; node++) {
+		int ncpus, node_vecs;
+
+		if (cpumask_empty(node_cpus[node]))
+			continue;
+
+		cpumask_copy(nmsk, node_cpus[node]);
+		ncpus = cpumask_weight(nmsk);
+		node_vecs = min((nvec - v) / nodes, ncpus);
+		nodes--;
+
+		for (; node_vecs; node_vecs--, v++) {
+			irq_spread_init_one(masks + v, nmsk,
+					    DIV_ROUND_UP(ncpus, node_vecs));
+			ncpus = cpumask_weight(nmsk);
+		}
+	}
+}
+
+/**
+ * irq_create_affinity_masks - Create affinity masks for multiqueue spreading
+ * @nvec:	The total number of vectors
+ * @affd:	Description of the affinity requirements
+ *
+ * Returns an array of @nvec masks, to be freed by the caller, or NULL if
+ * allocation failed or there is nothing to spread.
+ */
+struct cpumask *
+irq_create_affinity_masks(int nvec, const struct irq_affinity *affd)
+{
+	int affvecs = nvec - affd->pre_vectors - affd->post_vectors;
+	int set_size[IRQ_AFFINITY_MAX_SETS];
+	int nr_sets, i, curvec;
+	struct cpumask *masks = NULL;
+	cpumask_var_t *node_cpus;
+	cpumask_var_t nmsk;
+
+	if (affvecs <= 0)
+		return NULL;
+
+	if (affd->nr_sets) {
+		int total = 0;
+
+		if (WARN_ON_ONCE(affd->nr_sets > IRQ_AFFINITY_MAX_SETS))
+			return NULL;
+
+		nr_sets = affd->nr_sets;
+		for (i = 0; i < nr_sets; i++) {
+			set_size[i] = affd->set_size[i];
+			total += set_size[i];
+		}
+		if (WARN_ON_ONCE(total != affvecs))
+			return NULL;
+	} else {
+		nr_sets = 1;
+		set_size[0] = affvecs;
+	}
+
+	if (!zalloc_cpumask_var(&nmsk, GFP_KERNEL))
+		return NULL;
+
+	node_cpus = alloc_node_to_possible_cpumask();
+	if (!node_cpus)
+		goto out;
+
+	masks = kcalloc(nvec, sizeof(*masks), GFP_KERNEL);
+	if (!masks)
+		goto out_node;
+
+	curvec = affd->pre_vectors;
+	for (i = 0; i < nr_sets; i++) {
+		irq_spread_set(masks + curvec, set_size[i], node_cpus, nmsk);
+		curvec += set_size[i];
+	}
+
+	/*
+	 * The vectors outside of the spread, and any that were left without
+	 * a cpu because there are more of them than cpus, can go anywhere.
+	 */
+	for (i = 0; i < nvec; i++)
+		if (cpumask_empty(masks + i))
+			cpumask_copy(masks + i, irq_default_affinity);
+
+out_node:
+	free_node_to_possible_cpumask(node_cpus);
+out:
+	free_cpumask_var(nmsk);
+	return masks;
+}
+
+/**
+ * irq_calc_affinity_vectors - Number of vectors worth spreading
+ * @maxvec:	The maximum number of vectors available
+ * @affd:	Description of the affinity requirements
+ *
+ * More than one vector per possible cpu is of no use.  Sets are sized by
+ * the caller and left alone.
+ */
+int irq_calc_affinity_vectors(int maxvec, const struct irq_affinity *affd)
+{
+	int resv = affd->pre_vectors + affd->post_vectors;
+	int vecs = maxvec - resv;
+
+	if (affd->nr_sets || vecs <= 0)
+		return maxvec;
+
+	return resv + min_t(int, vecs, num_possible_cpus());
+}
+
+/*
+ * Managed interrupts keep the affinity they were created with.  When the
+ * last cpu in the mask goes offline the interrupt is shut down rather than
+ * moved: nothing submits to the queue behind it anymore.  It is started
+ * again when one of its cpus comes back.
+ */
+
+/**
+ * irq_affinity_offline_managed - Shut down a managed irq without online cpus
+ * @desc:	The interrupt descriptor, desc->lock held
+ *
+ * For the cpu hotplug migration code, on interrupts which lost all the cpus
+ * in their affinity mask.  Returns true if the interrupt is managed and
+ * must not be migrated.
+ */
+bool irq_affinity_offline_managed(struct irq_desc *desc)
+{
+	struct irq_data *d = irq_desc_get_irq_data(desc);
+
+	if (!irqd_affinity_is_managed(d))
+		return false;
+
+	/* Not requested yet or already down, irq_startup() checks the mask */
+	if (!desc->action || irqd_has_set(d, IRQD_MANAGED_SHUTDOWN))
+		return true;
+
+	/* Don't mess with the nesting of a driver's disable_irq() */
+	if (irqd_irq_disabled(d))
+		return false;
+
+	irq_shutdown(desc);
+	irqd_set(d, IRQD_MANAGED_SHUTDOWN);
+	return true;
+}
+
+#ifdef CONFIG_HOTPLUG_CPU
+static void irq_affinity_restore_managed(struct irq_desc *desc,
+					 unsigned int cpu)
+{
+	struct irq_data *d = irq_desc_get_irq_data(desc);
+	const struct cpumask *affinity = irq_data_get_affinity_mask(d);
+
+	if (!irqd_has_set(d, IRQD_MANAGED_SHUTDOWN) || !desc->action ||
+	    !cpumask_test_cpu(cpu, affinity))
+		return;
+
+	/* Retarget first, it must not fire at the cpu that went away */
+	irq_do_set_affinity(d, affinity, false);
+	irq_startup(desc, false);
+}
+
+static int irq_affinity_cpu_callback(struct notifier_block *nfb,
+				     unsigned long action, void *hcpu)
+{
+	unsigned int cpu = (unsigned long)hcpu, irq;
+	struct irq_desc *desc;
+	unsigned long flags;
+
+	if ((action & ~CPU_TASKS_FROZEN) != CPU_ONLINE)
+		return NOTIFY_OK;
+
+	irq_lock_sparse();
+	for_each_active_irq(irq) {
+		desc = irq_to_desc(irq);
+		if (!desc)
+			continue;
+
+		raw_spin_lock_irqsave(&desc->lock, flags);
+		irq_affinity_restore_managed(desc, cpu);
+		raw_spin_unlock_irqrestore(&desc->lock, flags);
+	}
+	irq_unlock_sparse();
+
+	return NOTIFY_OK;
+}
+
+static int __init irq_affinity_init(void)
+{
+	hotcpu_notifier(irq_affinity_cpu_callback, 0);
+	return 0;
+}
+core_initcall(irq_affinity_init);
+#endif
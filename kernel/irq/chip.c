@@ -190,6 +190,16 @@ int irq_startup(struct irq_desc *desc, bool resend)
 {
 	int ret = 0;
 
+	/*
+	 * A managed interrupt without an online cpu in its mask stays down
+	 * until one comes up, see irq_affinity_offline_managed().
+	 */
+	if (irq_managed_mask_offline(desc)) {
+		irqd_set(&desc->irq_data, IRQD_MANAGED_SHUTDOWN);
+		return 0;
+	}
+	irqd_clear(&desc->irq_data, IRQD_MANAGED_SHUTDOWN);
+
 	irq_state_clr_disabled(desc);
 	desc->depth = 0;
 
@@ -687,7 +697,11 @@ void handle_percpu_irq(struct irq_desc *desc)
 {
 	struct irq_chip *chip = irq_desc_get_chip(desc);
 
-	kstat_incr_irqs_this_cpu(desc);
+	/*
+	 * PER CPU interrupts are not serialized. Do not touch
+	 * desc->tot_count.
+	 */
+	__kstat_incr_irqs_this_cpu(desc);
 
 	if (chip->irq_ack)
 		chip->irq_ack(&desc->irq_data);
@@ -717,7 +731,11 @@ void handle_percpu_devid_irq(struct irq_desc *desc)
 	unsigned int irq = irq_desc_get_irq(desc);
 	irqreturn_t res;
 
-	kstat_incr_irqs_this_cpu(desc);
+	/*
+	 * PER CPU interrupts are not serialized. Do not touch
+	 * desc->tot_count.
+	 */
+	__kstat_incr_irqs_this_cpu(desc);
 
 	if (chip->irq_ack)
 		chip->irq_ack(&desc->irq_data);
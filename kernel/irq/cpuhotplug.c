@@ -30,6 +30,8 @@ static bool migrate_one_irq(struct irq_desc *desc)
 		return false;
 
 	if (cpumask_any_and(affinity, cpu_online_mask) >= nr_cpu_ids) {
+		if (irq_affinity_offline_managed(desc))
+			return false;
 		affinity = cpu_online_mask;
 		ret = true;
 	}
@@ -188,12 +188,33 @@ static inline bool irqd_has_set(struct irq_data *d, unsigned int mask)
 	return __irqd_to_state(d) & mask;
 }
 
-static inline void kstat_incr_irqs_this_cpu(struct irq_desc *desc)
+/* Managed interrupt none of whose cpus is online */
+static inline bool irq_managed_mask_offline(struct irq_desc *desc)
+{
+	struct irq_data *d = &desc->irq_data;
+
+	return irqd_affinity_is_managed(d) &&
+		cpumask_any_and(irq_data_get_affinity_mask(d),
+				cpu_online_mask) >= nr_cpu_ids;
+}
+
+static inline void __kstat_incr_irqs_this_cpu(struct irq_desc *desc)
 {
 	__this_cpu_inc(*desc->kstat_irqs);
 	__this_cpu_inc(kstat.irqs_sum);
 }
 
+/*
+ * Also count in desc->tot_count, which kstat_irqs() reads instead of
+ * summing over all cpus.  Needs desc->lock, so the per cpu flow handlers
+ * use __kstat_incr_irqs_this_cpu().
+ */
+static inline void kstat_incr_irqs_this_cpu(struct irq_desc *desc)
+{
+	__kstat_incr_irqs_this_cpu(desc);
+	desc->tot_count++;
+}
+
 static inline int irq_desc_get_node(struct irq_desc *desc)
 {
 	return irq_common_data_get_node(&desc->irq_common_data);
@@ -133,6 +133,21 @@ int irq_can_set_affinity(unsigned int irq)
 	return __irq_can_set_affinity(irq_to_desc(irq));
 }
 
+/**
+ *	irq_can_set_affinity_usr - Check if affinity of a irq can be set from user space
+ *	@irq:		Interrupt to check
+ *
+ *	Like irq_can_set_affinity(), but the affinity of managed interrupts
+ *	belongs to the kernel.
+ */
+bool irq_can_set_affinity_usr(unsigned int irq)
+{
+	struct irq_desc *desc = irq_to_desc(irq);
+
+	return __irq_can_set_affinity(desc) &&
+		!irqd_affinity_is_managed(&desc->irq_data);
+}
+
 /**
  *	irq_set_thread_affinity - Notify irq threads to adjust affinity
  *	@desc:		irq descriptor which has affitnity changed
@@ -339,6 +354,20 @@ static int setup_affinity(struct irq_desc *desc, struct cpumask *mask)
 	if (!__irq_can_set_affinity(desc))
 		return 0;
 
+	/*
+	 * Managed interrupts keep their spread.  If none of their cpus is
+	 * online they are kept shut down, see irq_startup().
+	 */
+	if (irqd_affinity_is_managed(&desc->irq_data)) {
+		if (!cpumask_intersects(desc->irq_common_data.affinity,
+					cpu_online_mask))
+			return 0;
+		cpumask_and(mask, cpu_online_mask,
+			    desc->irq_common_data.affinity);
+		irq_do_set_affinity(&desc->irq_data, mask, false);
+		return 0;
+	}
+
 	/*
 	 * Preserve an userspace affinity setup, but make sure that
 	 * one of the targets is online.
@@ -32,6 +32,7 @@ struct msi_desc *alloc_msi_entry(struct device *dev)
 
 void free_msi_entry(struct msi_desc *entry)
 {
+	kfree(entry->affinity);
 	kfree(entry);
 }
 
@@ -284,7 +285,8 @@ int msi_domain_alloc_irqs(struct irq_domain *domain, struct device *dev,
 			virq = -1;
 
 		virq = __irq_domain_alloc_irqs(domain, virq, desc->nvec_used,
-					       dev_to_node(dev), &arg, false);
+					       dev_to_node(dev), &arg, false,
+					       desc->affinity);
 		if (virq < 0) {
 			ret = -ENOSPC;
 			if (ops->handle_error)
@@ -229,6 +229,21 @@ int sanity_check_segment_list(struct kimage *image)
 			    (mend > crashk_res.end))
 				return result;
 		}
+	} else {
+		/*
+		 * Memory preserved for the next kernel must survive the
+		 * copy of the image into place.
+		 */
+		result = -EADDRNOTAVAIL;
+		for (i = 0; i < nr_segments; i++) {
+			phys_addr_t mstart, mend, pstart, pend;
+
+			mstart = image->segment[i].mem;
+			mend = mstart + image->segment[i].memsz - 1;
+			if (kexec_preserved_overlap(mstart, mend,
+						    &pstart, &pend))
+				return result;
+		}
 	}
 
 	return 0;
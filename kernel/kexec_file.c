@@ -387,6 +387,7 @@ static int locate_mem_hole_top_down(unsigned long start, unsigned long end,
 {
 	struct kimage *image = kbuf->image;
 	unsigned long temp_start, temp_end;
+	phys_addr_t pstart, pend;
 
 	temp_end = min(end, kbuf->buf_max);
 	temp_start = temp_end - kbuf->memsz;
@@ -409,6 +410,15 @@ static int locate_mem_hole_top_down(unsigned long start, unsigned long end,
 			continue;
 		}
 
+		/* Skip over memory preserved for the next kernel */
+		if (kexec_preserved_overlap(temp_start, temp_end,
+					    &pstart, &pend)) {
+			if (pstart < kbuf->memsz)
+				return 0;
+			temp_start = pstart - kbuf->memsz;
+			continue;
+		}
+
 		/* We found a suitable memory range */
 		break;
 	} while (1);
@@ -425,6 +435,7 @@ static int locate_mem_hole_bottom_up(unsigned long start, unsigned long end,
 {
 	struct kimage *image = kbuf->image;
 	unsigned long temp_start, temp_end;
+	phys_addr_t pstart, pend;
 
 	temp_start = max(start, kbuf->buf_min);
 
@@ -443,6 +454,13 @@ static int locate_mem_hole_bottom_up(unsigned long start, unsigned long end,
 			continue;
 		}
 
+		/* Skip over memory preserved for the next kernel */
+		if (kexec_preserved_overlap(temp_start, temp_end,
+					    &pstart, &pend)) {
+			temp_start = pend + 1;
+			continue;
+		}
+
 		/* We found a suitable memory range */
 		break;
 	} while (1);
@@ -0,0 +1,466 @@
+/*
+ * kexec_preserve.c - memory preserved across kexec reboots.
+ *
+ * A range of physical memory registered here is described to the next
+ * kernel in a handover page, whose address is passed on the command line
+ * as "kexec_handover=<addr>".  The next kernel reserves the ranges in
+ * memblock while parsing the early parameters, before the memory can be
+ * handed out by any allocator, so that their contents survive the reboot.
+ * Inherited ranges stay reserved until their owner claims them and either
+ * preserves them again for the kernel after, or releases them to the page
+ * allocator.
+ *
+ * This source code is licensed under the GNU General Public License,
+ * Version 2.  See the file COPYING for more details.
+ */
+
+#define pr_fmt(fmt) "kexec_preserve: " fmt
+
+#include <linux/kernel.h>
+#include <linux/init.h>
+#include <linux/mm.h>
+#include <linux/slab.h>
+#include <linux/list.h>
+#include <linux/string.h>
+#include <linux/memblock.h>
+#include <linux/kexec.h>
+#include <linux/io.h>
+
+#include "kexec_internal.h"
+
+#define KEXEC_HANDOVER_MAGIC	0x4b484f31	/* "KHO1" */
+
+struct kexec_handover_range {
+	char name[KEXEC_PRESERVE_NAME_LEN];
+	u64 start;
+	u64 size;
+};
+
+/* The handover page, as found by the next kernel */
+struct kexec_handover {
+	u32 magic;
+	u32 nr_ranges;
+	struct kexec_handover_range range[0];
+};
+
+#define KEXEC_HANDOVER_MAX_RANGES \
+	((PAGE_SIZE - sizeof(struct kexec_handover)) / \
+	 sizeof(struct kexec_handover_range))
+
+struct kexec_preserved {
+	struct list_head list;
+	char name[KEXEC_PRESERVE_NAME_LEN];
+	phys_addr_t start;
+	phys_addr_t size;
+	bool inherited;		/* reserved for us by the previous kernel */
+	bool claimed;
+	bool preserved;		/* passed on to the next kernel */
+};
+
+/* Protected by kexec_mutex, so that loading an image sees a stable list */
+static LIST_HEAD(kexec_preserved_list);
+static unsigned int nr_preserved;
+static struct kexec_handover *handover;
+
+/* What the previous kernel handed over, until the allocators are up */
+static struct kexec_handover_range inherited[KEXEC_HANDOVER_MAX_RANGES]
+	__initdata;
+static unsigned int nr_inherited __initdata;
+static phys_addr_t inherited_handover __initdata;
+
+static int __init parse_kexec_handover(char *p)
+{
+	struct kexec_handover *kho;
+	unsigned long long paddr;
+	unsigned int i;
+
+	if (!p || kstrtoull(p, 0, &paddr))
+		return -EINVAL;
+	if (!paddr || (paddr & ~PAGE_MASK))
+		return -EINVAL;
+
+	kho = early_memremap(paddr, PAGE_SIZE);
+	if (!kho)
+		return -ENOMEM;
+
+	if (kho->magic != KEXEC_HANDOVER_MAGIC ||
+	    kho->nr_ranges > KEXEC_HANDOVER_MAX_RANGES) {
+		pr_warn("invalid handover page at 0x%llx\n", paddr);
+		goto out;
+	}
+
+	memblock_reserve(paddr, PAGE_SIZE);
+	inherited_handover = paddr;
+
+	for (i = 0; i < kho->nr_ranges; i++) {
+		struct kexec_handover_range *r = &kho->range[i];
+
+		if (!r->size || ((r->start | r->size) & ~PAGE_MASK)) {
+			pr_warn("ignoring misaligned range %llx-%llx\n",
+				r->start, r->start + r->size);
+			continue;
+		}
+
+		memblock_reserve(r->start, r->size);
+		inherited[nr_inherited] = *r;
+		r = &inherited[nr_inherited++];
+		r->name[KEXEC_PRESERVE_NAME_LEN - 1] = '\0';
+	}
+
+	pr_info("reserved %u preserved ranges\n", nr_inherited);
+out:
+	early_memunmap(kho, PAGE_SIZE);
+	return 0;
+}
+early_param("kexec_handover", parse_kexec_handover);
+
+/* Rewrite the handover page from the list.  Called under kexec_mutex. */
+static void kexec_handover_update(void)
+{
+	struct kexec_preserved *p;
+	unsigned int i = 0;
+
+	list_for_each_entry(p, &kexec_preserved_list, list) {
+		if (!p->preserved)
+			continue;
+		memcpy(handover->range[i].name, p->name, sizeof(p->name));
+		handover->range[i].start = p->start;
+		handover->range[i].size = p->size;
+		i++;
+	}
+	handover->nr_ranges = i;
+}
+
+static struct kexec_preserved *kexec_preserved_find(const char *name)
+{
+	struct kexec_preserved *p;
+
+	list_for_each_entry(p, &kexec_preserved_list, list) {
+		if (!strcmp(p->name, name))
+			return p;
+	}
+	return NULL;
+}
+
+/**
+ * kexec_preserved_overlap - check a range against preserved memory
+ * @start: first byte of the range
+ * @end: last byte of the range
+ * @pstart: returns the first byte of the overlapping range
+ * @pend: returns the last byte of the overlapping range
+ *
+ * Returns true if [@start, @end] overlaps memory preserved for the next
+ * kernel, inherited from the previous one, or the handover page itself.
+ * Must be called with kexec_mutex held.
+ */
+bool kexec_preserved_overlap(phys_addr_t start, phys_addr_t end,
+			     phys_addr_t *pstart, phys_addr_t *pend)
+{
+	struct kexec_preserved *p;
+	phys_addr_t paddr;
+
+	if (handover) {
+		paddr = virt_to_phys(handover);
+		if (start < paddr + PAGE_SIZE && end >= paddr) {
+			*pstart = paddr;
+			*pend = paddr + PAGE_SIZE - 1;
+			return true;
+		}
+	}
+
+	list_for_each_entry(p, &kexec_preserved_list, list) {
+		if (start < p->start + p->size && end >= p->start) {
+			*pstart = p->start;
+			*pend = p->start + p->size - 1;
+			return true;
+		}
+	}
+	return false;
+}
+
+/**
+ * kexec_handover_paddr - physical address of the handover page
+ *
+ * Returns 0 if there is none.  The address is meant to be passed to the
+ * next kernel as "kexec_handover=<addr>".
+ */
+phys_addr_t kexec_handover_paddr(void)
+{
+	return handover ? virt_to_phys(handover) : 0;
+}
+
+/**
+ * kexec_preserved_nr_ranges - number of ranges kexec_preserved_mem_walk visits
+ *
+ * Must be called with kexec_mutex held.
+ */
+unsigned int kexec_preserved_nr_ranges(void)
+{
+	return handover ? nr_preserved + 1 : 0;
+}
+
+/**
+ * kexec_preserved_mem_walk - walk the memory the next kernel must not touch
+ * @arg: passed on to @func
+ * @func: called with the start and size of each range
+ *
+ * Calls @func for the handover page and every range preserved for the
+ * next kernel.  Loaders use it to tell the early boot code of the next
+ * kernel, which runs before "kexec_handover=" is parsed, where it must
+ * not decompress or relocate itself to.  Stops at the first non-zero
+ * return from @func and returns it.  Must be called with kexec_mutex held.
+ */
+int kexec_preserved_mem_walk(void *arg,
+			     int (*func)(u64 start, u64 size, void *arg))
+{
+	struct kexec_preserved *p;
+	int ret;
+
+	if (!handover)
+		return 0;
+
+	ret = func(virt_to_phys(handover), PAGE_SIZE, arg);
+	if (ret)
+		return ret;
+
+	list_for_each_entry(p, &kexec_preserved_list, list) {
+		if (!p->preserved)
+			continue;
+		ret = func(p->start, p->size, arg);
+		if (ret)
+			break;
+	}
+	return ret;
+}
+
+/**
+ * kexec_preserve_mem - preserve a range of memory for the next kernel
+ * @name: name the next kernel finds the range by
+ * @start: physical start address, page aligned
+ * @size: size in bytes, page aligned
+ *
+ * The caller owns the memory and must keep it allocated; the contents
+ * are left alone by a kexec reboot.  Preserving an inherited range under
+ * the same name passes it on again.
+ */
+int kexec_preserve_mem(const char *name, phys_addr_t start, phys_addr_t size)
+{
+	struct kexec_preserved *p, *new;
+	phys_addr_t end = start + size - 1, pstart, pend;
+	int ret;
+
+	if (!name[0] || strlen(name) >= KEXEC_PRESERVE_NAME_LEN)
+		return -EINVAL;
+	if (!size || ((start | size) & ~PAGE_MASK) || end < start)
+		return -EINVAL;
+
+	new = kzalloc(sizeof(*new), GFP_KERNEL);
+	if (!new)
+		return -ENOMEM;
+
+	mutex_lock(&kexec_mutex);
+	ret = -ENOMEM;
+	if (!handover)
+		goto out;
+	ret = -ENOSPC;
+	if (nr_preserved >= KEXEC_HANDOVER_MAX_RANGES)
+		goto out;
+	/*
+	 * A loaded kexec_file image carries the list in its boot parameters,
+	 * for the decompressor of the next kernel.  It would miss the range.
+	 */
+	ret = -EBUSY;
+	if (kexec_image && kexec_image->file_mode)
+		goto out;
+
+	p = kexec_preserved_find(name);
+	if (p) {
+		ret = -EEXIST;
+		if (p->preserved || p->start != start || p->size != size)
+			goto out;
+		p->preserved = true;
+		goto done;
+	}
+
+	if (kexec_preserved_overlap(start, end, &pstart, &pend))
+		goto out;
+	/* An image that is already loaded would overwrite the range */
+	if (kexec_image &&
+	    kimage_is_destination_range(kexec_image, start, end))
+		goto out;
+
+	strcpy(new->name, name);
+	new->start = start;
+	new->size = size;
+	new->preserved = true;
+	list_add_tail(&new->list, &kexec_preserved_list);
+	new = NULL;
+done:
+	nr_preserved++;
+	kexec_handover_update();
+	ret = 0;
+out:
+	mutex_unlock(&kexec_mutex);
+	kfree(new);
+	return ret;
+}
+EXPORT_SYMBOL_GPL(kexec_preserve_mem);
+
+/**
+ * kexec_unpreserve_mem - stop passing a range on to the next kernel
+ * @name: name the range was preserved under
+ *
+ * An inherited range stays reserved until it is released.
+ */
+int kexec_unpreserve_mem(const char *name)
+{
+	struct kexec_preserved *p;
+	int ret = -ENOENT;
+
+	mutex_lock(&kexec_mutex);
+	p = kexec_preserved_find(name);
+	if (!p || !p->preserved)
+		goto out;
+
+	p->preserved = false;
+	nr_preserved--;
+	if (!p->inherited) {
+		list_del(&p->list);
+		kfree(p);
+	}
+	kexec_handover_update();
+	ret = 0;
+out:
+	mutex_unlock(&kexec_mutex);
+	return ret;
+}
+EXPORT_SYMBOL_GPL(kexec_unpreserve_mem);
+
+/**
+ * kexec_claim_preserved_mem - take ownership of an inherited range
+ * @name: name the previous kernel preserved the range under
+ * @start: returns the physical start address
+ * @size: returns the size in bytes
+ *
+ * A range can only be claimed once.  The memory stays reserved, the
+ * owner either preserves it again or releases it when done.
+ */
+int kexec_claim_preserved_mem(const char *name, phys_addr_t *start,
+			      phys_addr_t *size)
+{
+	struct kexec_preserved *p;
+	int ret = -ENOENT;
+
+	mutex_lock(&kexec_mutex);
+	p = kexec_preserved_find(name);
+	if (!p || !p->inherited)
+		goto out;
+
+	ret = -EBUSY;
+	if (p->claimed)
+		goto out;
+
+	p->claimed = true;
+	*start = p->start;
+	*size = p->size;
+	ret = 0;
+out:
+	mutex_unlock(&kexec_mutex);
+	return ret;
+}
+EXPORT_SYMBOL_GPL(kexec_claim_preserved_mem);
+
+/**
+ * kexec_release_preserved_mem - give an inherited range to the allocator
+ * @name: name the previous kernel preserved the range under
+ *
+ * The range must not be preserved for the next kernel any more.  Ranges
+ * that are not lowmem System RAM are only forgotten about.
+ */
+int kexec_release_preserved_mem(const char *name)
+{
+	struct kexec_preserved *p;
+	int ret = -ENOENT;
+
+	mutex_lock(&kexec_mutex);
+	p = kexec_preserved_find(name);
+	if (!p || !p->inherited)
+		goto out;
+
+	ret = -EBUSY;
+	if (p->preserved)
+		goto out;
+
+	list_del(&p->list);
+	ret = 0;
+out:
+	mutex_unlock(&kexec_mutex);
+	if (ret)
+		return ret;
+
+	if (!IS_ENABLED(CONFIG_HIGHMEM) &&
+	    region_intersects(p->start, p->size, "System RAM") ==
+	    REGION_INTERSECTS)
+		free_reserved_area(phys_to_virt(p->start),
+				   phys_to_virt(p->start + p->size), -1,
+				   p->name);
+	kfree(p);
+	return 0;
+}
+EXPORT_SYMBOL_GPL(kexec_release_preserved_mem);
+
+/* Format the list for sysfs, one range per line */
+ssize_t kexec_preserved_mem_print(char *buf, size_t size)
+{
+	struct kexec_preserved *p;
+	ssize_t len = 0;
+
+	mutex_lock(&kexec_mutex);
+	list_for_each_entry(p, &kexec_preserved_list, list) {
+		len += scnprintf(buf + len, size - len, "%s %llx %llx%s%s%s\n",
+				 p->name, (unsigned long long)p->start,
+				 (unsigned long long)p->size,
+				 p->inherited ? " inherited" : "",
+				 p->claimed ? " claimed" : "",
+				 p->preserved ? " preserved" : "");
+	}
+	mutex_unlock(&kexec_mutex);
+
+	return len;
+}
+
+static int __init kexec_preserve_init(void)
+{
+	struct kexec_preserved *p;
+	unsigned int i;
+
+	handover = (struct kexec_handover *)get_zeroed_page(GFP_KERNEL);
+	if (!handover) {
+		pr_warn("Memory allocation for the handover page failed\n");
+		return -ENOMEM;
+	}
+	handover->magic = KEXEC_HANDOVER_MAGIC;
+
+	for (i = 0; i < nr_inherited; i++) {
+		p = kzalloc(sizeof(*p), GFP_KERNEL);
+		if (!p) {
+			pr_warn("dropping inherited range %s\n",
+				inherited[i].name);
+			continue;
+		}
+		memcpy(p->name, inherited[i].name, sizeof(p->name));
+		p->start = inherited[i].start;
+		p->size = inherited[i].size;
+		p->inherited = true;
+		list_add_tail(&p->list, &kexec_preserved_list);
+	}
+
+	/* The ranges have been copied, the old handover page is done with */
+	if (inherited_handover && pfn_valid(PFN_DOWN(inherited_handover)))
+		free_reserved_area(phys_to_virt(inherited_handover),
+				   phys_to_virt(inherited_handover + PAGE_SIZE),
+				   -1, NULL);
+
+	return 0;
+}
+subsys_initcall(kexec_preserve_init);
@@ -136,6 +136,47 @@ KERNEL_ATTR_RO(vmcoreinfo);
 
 #endif /* CONFIG_KEXEC_CORE */
 
+#ifdef CONFIG_KEXEC_PRESERVE_MEM
+static ssize_t kexec_handover_show(struct kobject *kobj,
+				   struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%llx %lx\n",
+		       (unsigned long long)kexec_handover_paddr(), PAGE_SIZE);
+}
+KERNEL_ATTR_RO(kexec_handover);
+
+static ssize_t kexec_preserved_mem_show(struct kobject *kobj,
+					struct kobj_attribute *attr, char *buf)
+{
+	return kexec_preserved_mem_print(buf, PAGE_SIZE);
+}
+
+/*
+ * "preserve <name> <start> <size>", "unpreserve <name>" or
+ * "release <name>", addresses in hex as they are shown.
+ */
+static ssize_t kexec_preserved_mem_store(struct kobject *kobj,
+					 struct kobj_attribute *attr,
+					 const char *buf, size_t count)
+{
+	char name[KEXEC_PRESERVE_NAME_LEN];
+	unsigned long long start, size;
+	int ret;
+
+	if (sscanf(buf, "preserve %31s %llx %llx", name, &start, &size) == 3)
+		ret = kexec_preserve_mem(name, start, size);
+	else if (sscanf(buf, "unpreserve %31s", name) == 1)
+		ret = kexec_unpreserve_mem(name);
+	else if (sscanf(buf, "release %31s", name) == 1)
+		ret = kexec_release_preserved_mem(name);
+	else
+		ret = -EINVAL;
+
+	return ret < 0 ? ret : count;
+}
+KERNEL_ATTR_RW(kexec_preserved_mem);
+#endif /* CONFIG_KEXEC_PRESERVE_MEM */
+
 /* whether file capabilities are enabled */
 static ssize_t fscaps_show(struct kobject *kobj,
 				  struct kobj_attribute *attr, char *buf)
@@ -201,6 +242,10 @@ static struct attribute * kernel_attrs[] = {
 	&kexec_crash_loaded_attr.attr,
 	&kexec_crash_size_attr.attr,
 	&vmcoreinfo_attr.attr,
+#endif
+#ifdef CONFIG_KEXEC_PRESERVE_MEM
+	&kexec_handover_attr.attr,
+	&kexec_preserved_mem_attr.attr,
 #endif
 	&rcu_expedited_attr.attr,
 	NULL
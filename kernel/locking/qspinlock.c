@@ -19,7 +19,7 @@
  *          Peter Zijlstra <peterz@infradead.org>
  */
 
-#ifndef _GEN_PV_LOCK_SLOWPATH
+#if !defined(_GEN_PV_LOCK_SLOWPATH) && !defined(_GEN_CNA_LOCK_SLOWPATH)
 
 #include <linux/smp.h>
 #include <linux/bug.h>
@@ -68,7 +68,7 @@
 
 #include "mcs_spinlock.h"
 
-#ifdef CONFIG_PARAVIRT_SPINLOCKS
+#if defined(CONFIG_PARAVIRT_SPINLOCKS) || defined(CONFIG_NUMA_AWARE_SPINLOCKS)
 #define MAX_NODES	8
 #else
 #define MAX_NODES	4
@@ -80,7 +80,8 @@
  *
  * Exactly fits one 64-byte cacheline on a 64-bit architecture.
  *
- * PV doubles the storage and uses the second cacheline for PV state.
+ * PV doubles the storage and uses the second cacheline for PV state;
+ * CNA does the same for its NUMA node and secondary queue state.
  */
 static DEFINE_PER_CPU_ALIGNED(struct mcs_spinlock, mcs_nodes[MAX_NODES]);
 
@@ -234,8 +235,38 @@ static __always_inline void set_locked(struct qspinlock *lock)
 
 /*
  * Generate the native code for queued_spin_unlock_slowpath(); provide NOPs for
- * all the PV callbacks.
+ * all the PV callbacks and plain MCS behaviour for the CNA ones.
+ */
+
+static __always_inline void __cna_init_node(struct mcs_spinlock *node,
+					    u32 tail) { }
+
+/*
+ * We are the only waiter in the queue and the lock is free: clear the tail
+ * and take the lock in one go. On failure @val is updated with the current
+ * lock word.
  */
+static __always_inline bool __try_clear_tail(struct qspinlock *lock, u32 *val,
+					     struct mcs_spinlock *node)
+{
+	u32 old = atomic_cmpxchg(&lock->val, *val, _Q_LOCKED_VAL);
+
+	if (old == *val)
+		return true;
+
+	*val = old;
+	return false;
+}
+
+static __always_inline void __mcs_pass_lock(struct mcs_spinlock *node,
+					    struct mcs_spinlock *next)
+{
+	arch_mcs_spin_unlock_contended(&next->locked);
+}
+
+#define cna_init_node		__cna_init_node
+#define try_clear_tail		__try_clear_tail
+#define mcs_pass_lock		__mcs_pass_lock
 
 static __always_inline void __pv_init_node(struct mcs_spinlock *node) { }
 static __always_inline void __pv_wait_node(struct mcs_spinlock *node) { }
@@ -255,7 +286,7 @@ static __always_inline void __pv_wait_head(struct qspinlock *lock,
 #define queued_spin_lock_slowpath	native_queued_spin_lock_slowpath
 #endif
 
-#endif /* _GEN_PV_LOCK_SLOWPATH */
+#endif /* !_GEN_PV_LOCK_SLOWPATH && !_GEN_CNA_LOCK_SLOWPATH */
 
 /**
  * queued_spin_lock_slowpath - acquire the queued spinlock
@@ -365,6 +396,7 @@ queue:
 	node += idx;
 	node->locked = 0;
 	node->next = NULL;
+	cna_init_node(node, tail);
 	pv_init_node(node);
 
 	/*
@@ -426,11 +458,8 @@ queue:
 			set_locked(lock);
 			break;
 		}
-		old = atomic_cmpxchg(&lock->val, val, _Q_LOCKED_VAL);
-		if (old == val)
+		if (try_clear_tail(lock, &val, node))
 			goto release;	/* No contention */
-
-		val = old;
 	}
 
 	/*
@@ -439,7 +468,7 @@ queue:
 	while (!(next = READ_ONCE(node->next)))
 		cpu_relax();
 
-	arch_mcs_spin_unlock_contended(&next->locked);
+	mcs_pass_lock(node, next);
 	pv_kick_node(lock, next);
 
 release:
@@ -450,10 +479,40 @@ release:
 }
 EXPORT_SYMBOL(queued_spin_lock_slowpath);
 
+/*
+ * Generate the NUMA-aware (CNA) code for queued_spin_lock_slowpath().
+ */
+#if !defined(_GEN_CNA_LOCK_SLOWPATH) && !defined(_GEN_PV_LOCK_SLOWPATH) && \
+	defined(CONFIG_NUMA_AWARE_SPINLOCKS)
+#define _GEN_CNA_LOCK_SLOWPATH
+
+#undef cna_init_node
+#undef try_clear_tail
+#undef mcs_pass_lock
+
+#undef  queued_spin_lock_slowpath
+#define queued_spin_lock_slowpath	__cna_queued_spin_lock_slowpath
+
+#include "qspinlock_cna.h"
+#include "qspinlock.c"
+
+/* Back to the native hooks for the paravirt variant below. */
+#undef cna_init_node
+#undef try_clear_tail
+#undef mcs_pass_lock
+#define cna_init_node		__cna_init_node
+#define try_clear_tail		__try_clear_tail
+#define mcs_pass_lock		__mcs_pass_lock
+
+#undef _GEN_CNA_LOCK_SLOWPATH
+
+#endif
+
 /*
  * Generate the paravirt code for queued_spin_unlock_slowpath().
  */
-#if !defined(_GEN_PV_LOCK_SLOWPATH) && defined(CONFIG_PARAVIRT_SPINLOCKS)
+#if !defined(_GEN_PV_LOCK_SLOWPATH) && !defined(_GEN_CNA_LOCK_SLOWPATH) && \
+	defined(CONFIG_PARAVIRT_SPINLOCKS)
 #define _GEN_PV_LOCK_SLOWPATH
 
 #undef  pv_enabled
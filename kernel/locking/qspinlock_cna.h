@@ -0,0 +1,239 @@
+#ifndef _GEN_CNA_LOCK_SLOWPATH
+#error "do not include this file"
+#endif
+
+#include <linux/topology.h>
+
+/*
+ * Implement a NUMA-aware version of MCS (aka CNA, or compact NUMA-aware lock).
+ *
+ * In CNA, spinning threads are organized in two queues, a primary queue for
+ * threads running on the same NUMA node as the current lock holder, and a
+ * secondary queue for threads running on other nodes. Schematically, it
+ * looks like this:
+ *
+ *    cna_node
+ *   +----------+     +--------+         +--------+
+ *   |mcs:next  | --> |mcs:next| --> ... |mcs:next| --> NULL  [Primary queue]
+ *   |mcs:locked| -.  +--------+         +--------+
+ *   +----------+  |
+ *                 `----------------------.
+ *                                        v
+ *                 +--------+         +--------+
+ *                 |mcs:next| --> ... |mcs:next|            [Secondary queue]
+ *                 +--------+         +--------+
+ *                     ^                    |
+ *                     `--------------------'
+ *
+ * N.B. locked := 1 if secondary queue is absent. Otherwise, it contains the
+ * encoded tail of the secondary queue, which is organized as a circular
+ * list, so that the head of the secondary queue is tail->next.
+ *
+ * When handing the MCS lock over, the lock holder scans the linked part of
+ * the primary queue for a waiter running on its own node. If it finds one
+ * (call it T), all the waiters between the lock holder and T are moved to
+ * the end of the secondary queue and the MCS lock, along with the secondary
+ * queue, is passed to T. If the primary queue has no local waiter, or if the
+ * lock has been passed within the node too many times in a row, the
+ * secondary queue is spliced back in front of the primary one and the lock
+ * goes to its head. The same happens when the primary queue runs empty.
+ *
+ * For more details, see https://arxiv.org/abs/1810.05600.
+ */
+
+struct cna_node {
+	struct mcs_spinlock	mcs;
+	struct mcs_spinlock	__res[3];
+
+	int			numa_node;
+	u32			encoded_tail;	/* self */
+	u32			intra_count;	/* local handoffs in a row */
+};
+
+/*
+ * Controls the fairness threshold: the number of consecutive intra-node
+ * lock handoffs after which the remote waiters are given the lock.
+ */
+#define INTRA_NODE_HANDOFF_THRESHOLD	(1 << 16)
+
+static inline struct cna_node *to_cna_node(struct mcs_spinlock *node)
+{
+	return (struct cna_node *)node;
+}
+
+/* Encoded tail of the secondary queue carried by @node, or 0 if empty. */
+static inline u32 cna_tail_2nd(struct mcs_spinlock *node)
+{
+	u32 val = node->locked;
+
+	return val > 1 ? val : 0;
+}
+
+static void cna_init_qnode(struct mcs_spinlock *node, u32 tail)
+{
+	struct cna_node *cn = to_cna_node(node);
+
+	BUILD_BUG_ON(sizeof(struct cna_node) > 5*sizeof(struct mcs_spinlock));
+
+	cn->numa_node = numa_node_id();
+	cn->encoded_tail = tail;
+	cn->intra_count = 0;
+}
+
+/*
+ * Scan the primary queue from @next for a waiter on our own NUMA node. If
+ * there is one, move the remote waiters preceding it to the tail of the
+ * secondary queue, update @node->locked accordingly and return the local
+ * waiter.
+ *
+ * Only the part of the queue whose ->next links are already visible is
+ * scanned; the last node we look at may be the lock's tail and is never
+ * moved.
+ */
+static struct mcs_spinlock *cna_find_local(struct mcs_spinlock *node,
+					   struct mcs_spinlock *next)
+{
+	int numa_node = to_cna_node(node)->numa_node;
+	struct mcs_spinlock *last = NULL, *cur = next;
+	struct mcs_spinlock *head_2nd;
+	u32 tail_2nd = cna_tail_2nd(node);
+
+	while (cur && to_cna_node(cur)->numa_node != numa_node) {
+		last = cur;
+		cur = READ_ONCE(cur->next);
+	}
+
+	if (!cur || !last)
+		return cur;
+
+	/* Append [next, last] to the secondary queue. */
+	if (tail_2nd) {
+		struct mcs_spinlock *tail = decode_tail(tail_2nd);
+
+		head_2nd = tail->next;
+		tail->next = next;
+	} else {
+		head_2nd = next;
+	}
+	last->next = head_2nd;
+	node->locked = to_cna_node(last)->encoded_tail;
+
+	return cur;
+}
+
+static bool cna_try_clear_tail(struct qspinlock *lock, u32 *val,
+			       struct mcs_spinlock *node)
+{
+	struct mcs_spinlock *head_2nd, *tail_2nd;
+	u32 new, old, encoded = cna_tail_2nd(node);
+
+	/* Both queues are empty. Do what MCS does. */
+	if (!encoded)
+		return __try_clear_tail(lock, val, node);
+
+	/*
+	 * The primary queue is empty but there are remote waiters: make the
+	 * secondary queue the primary one while taking the lock, then pass
+	 * the MCS lock to its head. The tail must not point back to the head
+	 * by the time it becomes visible as the lock's tail.
+	 */
+	tail_2nd = decode_tail(encoded);
+	head_2nd = tail_2nd->next;
+	tail_2nd->next = NULL;
+
+	new = encoded | _Q_LOCKED_VAL;
+	old = atomic_cmpxchg(&lock->val, *val, new);
+	if (old != *val) {
+		tail_2nd->next = head_2nd;
+		*val = old;
+		return false;
+	}
+
+	to_cna_node(head_2nd)->intra_count = 0;
+	smp_store_release(&head_2nd->locked, 1);
+	return true;
+}
+
+static void cna_pass_lock(struct mcs_spinlock *node, struct mcs_spinlock *next)
+{
+	struct cna_node *cn = to_cna_node(node);
+	struct mcs_spinlock *next_holder, *tail;
+	u32 encoded;
+
+	if (cn->intra_count < INTRA_NODE_HANDOFF_THRESHOLD) {
+		next_holder = cna_find_local(node, next);
+		if (next_holder) {
+			to_cna_node(next_holder)->intra_count =
+				cn->intra_count + 1;
+			encoded = cna_tail_2nd(node);
+			smp_store_release(&next_holder->locked,
+					  encoded ? encoded : 1);
+			return;
+		}
+	}
+
+	/*
+	 * No local waiter, or we have been unfair long enough: splice the
+	 * secondary queue in front of the primary one and hand the lock to
+	 * the longest-waiting remote waiter.
+	 */
+	next_holder = next;
+	encoded = cna_tail_2nd(node);
+	if (encoded) {
+		tail = decode_tail(encoded);
+		next_holder = tail->next;
+		tail->next = next;
+	}
+
+	to_cna_node(next_holder)->intra_count = 0;
+	smp_store_release(&next_holder->locked, 1);
+}
+
+#define cna_init_node		cna_init_qnode
+#define try_clear_tail		cna_try_clear_tail
+#define mcs_pass_lock		cna_pass_lock
+
+/*
+ * numa_spinlock=auto|on|off
+ *
+ * auto (default) enables the NUMA-aware slowpath on machines with more
+ * than one node, unless a paravirt slowpath has already been installed.
+ */
+static int numa_spinlock_flag;
+
+static int __init numa_spinlock_setup(char *str)
+{
+	if (!strcmp(str, "auto")) {
+		numa_spinlock_flag = 0;
+		return 1;
+	} else if (!strcmp(str, "on")) {
+		numa_spinlock_flag = 1;
+		return 1;
+	} else if (!strcmp(str, "off")) {
+		numa_spinlock_flag = -1;
+		return 1;
+	}
+
+	return 0;
+}
+__setup("numa_spinlock=", numa_spinlock_setup);
+
+/*
+ * Switch to the NUMA-friendly slow path for spinlocks when we have
+ * multiple NUMA nodes in native environment. Called before the paravirt
+ * call sites are patched.
+ */
+void __init cna_configure_spin_lock_slowpath(void)
+{
+	if (numa_spinlock_flag < 0)
+		return;
+
+	if (numa_spinlock_flag == 0 && (nr_node_ids < 2 ||
+		    pv_lock_ops.queued_spin_lock_slowpath !=
+			native_queued_spin_lock_slowpath))
+		return;
+
+	pv_lock_ops.queued_spin_lock_slowpath = __cna_queued_spin_lock_slowpath;
+
+	pr_info("Enabling CNA spinlock\n");
+}
@@ -172,7 +172,6 @@ void __sched __down_read(struct rw_semaphore *sem)
 int __down_read_trylock(struct rw_semaphore *sem)
 {
 	unsigned long flags;
-	int ret = 0;
 
 
 	raw_spin_lock_irqsave(&sem->wait_lock, flags);
@@ -191,11 +190,12 @@ int __down_read_trylock(struct rw_semaphore *sem)
 /*
  * get a write lock on the semaphore
  */
-void __sched __down_write_nested(struct rw_semaphore *sem, int subclass)
+static int __sched __down_write_common(struct rw_semaphore *sem, int state)
 {
 	struct rwsem_waiter waiter;
 	struct task_struct *tsk;
 	unsigned long flags;
+	int ret = 0;
 
 	raw_spin_lock_irqsave(&sem->wait_lock, flags);
 
@@ -215,7 +215,9 @@ void __sched __down_write_nested(struct rw_semaphore *sem, int subclass)
 		 */
 		if (sem->count == 0)
 			break;
-		set_task_state(tsk, TASK_UNINTERRUPTIBLE);
+		if (signal_pending_state(state, tsk))
+			goto out_nolock;
+		set_task_state(tsk, state);
 		raw_spin_unlock_irqrestore(&sem->wait_lock, flags);
 		schedule();
 		raw_spin_lock_irqsave(&sem->wait_lock, flags);
@@ -225,6 +227,25 @@ void __sched __down_write_nested(struct rw_semaphore *sem, int subclass)
 	list_del(&waiter.list);
 
 	raw_spin_unlock_irqrestore(&sem->wait_lock, flags);
+	return 0;
+
+out_nolock:
+	list_del(&waiter.list);
+	/* We may have been the writer the waiters behind us waited for */
+	if (!list_empty(&sem->wait_list) && sem->count == 0)
+		__rwsem_do_wake(sem, 1);
+	raw_spin_unlock_irqrestore(&sem->wait_lock, flags);
+	return -EINTR;
+}
+
+void __sched __down_write_nested(struct rw_semaphore *sem, int subclass)
+{
+	__down_write_common(sem, TASK_UNINTERRUPTIBLE);
+}
+
+int __sched __down_write_killable(struct rw_semaphore *sem)
+{
+	return __down_write_common(sem, TASK_KILLABLE);
 }
 
 void __sched __down_write(struct rw_semaphore *sem)
@@ -8,6 +8,8 @@
  *
  * Optimistic spinning by Tim Chen <tim.c.chen@intel.com>
  * and Davidlohr Bueso <davidlohr@hp.com>. Based on mutexes.
+ *
+ * Reader optimistic spinning and lock handoff to starved waiters.
  */
 #include <linux/rwsem.h>
 #include <linux/sched.h>
@@ -85,6 +87,7 @@ void __init_rwsem(struct rw_semaphore *sem, const char *name,
 	INIT_LIST_HEAD(&sem->wait_list);
 #ifdef CONFIG_RWSEM_SPIN_ON_OWNER
 	sem->owner = NULL;
+	sem->handoff = false;
 	osq_lock_init(&sem->osq);
 #endif
 }
@@ -100,8 +103,50 @@ struct rwsem_waiter {
 	struct list_head list;
 	struct task_struct *task;
 	enum rwsem_waiter_type type;
+	unsigned long timeout;
 };
 
+/*
+ * A waiter at the head of the queue that keeps losing the lock to
+ * optimistic spinners for longer than this sets sem->handoff. Spinners
+ * then stop stealing until a queued waiter has been granted the lock,
+ * which bounds the starvation to about one timeout.
+ */
+#define RWSEM_WAIT_TIMEOUT	DIV_ROUND_UP(HZ, 250)
+
+#ifdef CONFIG_RWSEM_SPIN_ON_OWNER
+static inline void rwsem_set_handoff(struct rw_semaphore *sem)
+{
+	if (!sem->handoff)
+		WRITE_ONCE(sem->handoff, true);
+}
+
+static inline void rwsem_clear_handoff(struct rw_semaphore *sem)
+{
+	if (sem->handoff)
+		WRITE_ONCE(sem->handoff, false);
+}
+#else
+static inline void rwsem_set_handoff(struct rw_semaphore *sem)
+{
+}
+
+static inline void rwsem_clear_handoff(struct rw_semaphore *sem)
+{
+}
+#endif
+
+/*
+ * Called with wait_lock held when the waiter at the head of the queue
+ * failed to get the lock because somebody stole it.
+ */
+static inline void rwsem_check_handoff(struct rw_semaphore *sem,
+				       struct rwsem_waiter *waiter)
+{
+	if (time_after(jiffies, waiter->timeout))
+		rwsem_set_handoff(sem);
+}
+
 enum rwsem_wake_type {
 	RWSEM_WAKE_ANY,		/* Wake whatever's at head of wait list */
 	RWSEM_WAKE_READERS,	/* Wake readers only */
@@ -150,8 +195,10 @@ __rwsem_do_wake(struct rw_semaphore *sem, enum rwsem_wake_type wake_type)
 		if (unlikely(oldcount < RWSEM_WAITING_BIAS)) {
 			/* A writer stole the lock. Undo our reader grant. */
 			if (rwsem_atomic_update(-adjustment, sem) &
-						RWSEM_ACTIVE_MASK)
+						RWSEM_ACTIVE_MASK) {
+				rwsem_check_handoff(sem, waiter);
 				goto out;
+			}
 			/* Last active locker left. Retry waking readers. */
 			goto try_reader_grant;
 		}
@@ -181,6 +228,9 @@ __rwsem_do_wake(struct rw_semaphore *sem, enum rwsem_wake_type wake_type)
 	if (adjustment)
 		rwsem_atomic_add(adjustment, sem);
 
+	/* The wait queue got the lock; spinners may steal again. */
+	rwsem_clear_handoff(sem);
+
 	next = sem->wait_list.next;
 	loop = woken;
 	do {
@@ -207,6 +257,9 @@ __rwsem_do_wake(struct rw_semaphore *sem, enum rwsem_wake_type wake_type)
 	return sem;
 }
 
+static bool rwsem_optimistic_spin(struct rw_semaphore *sem, bool wlock);
+static inline bool rwsem_reader_can_spin(struct rw_semaphore *sem);
+
 /*
  * Wait for the read lock to be granted
  */
@@ -214,21 +267,42 @@ __visible
 struct rw_semaphore __sched *rwsem_down_read_failed(struct rw_semaphore *sem)
 {
 	long count, adjustment = -RWSEM_ACTIVE_READ_BIAS;
+	bool first = false;
 	struct rwsem_waiter waiter;
 	struct task_struct *tsk = current;
 
+	/*
+	 * If a running writer holds the lock, drop our read bias and spin
+	 * until it goes away instead of paying for a sleep and a wakeup.
+	 * Dropping the bias may leave the lock free with waiters queued;
+	 * in that case skip spinning and let the wakeup below sort it out.
+	 */
+	if (rwsem_reader_can_spin(sem)) {
+		count = rwsem_atomic_update(-RWSEM_ACTIVE_READ_BIAS, sem);
+		adjustment = 0;
+		if (count != RWSEM_WAITING_BIAS &&
+		    rwsem_optimistic_spin(sem, false))
+			return sem;
+	}
+
 	/* set up my own style of waitqueue */
 	waiter.task = tsk;
 	waiter.type = RWSEM_WAITING_FOR_READ;
+	waiter.timeout = jiffies + RWSEM_WAIT_TIMEOUT;
 	get_task_struct(tsk);
 
 	raw_spin_lock_irq(&sem->wait_lock);
-	if (list_empty(&sem->wait_list))
+	if (list_empty(&sem->wait_list)) {
 		adjustment += RWSEM_WAITING_BIAS;
+		first = true;
+	}
 	list_add_tail(&waiter.list, &sem->wait_list);
 
 	/* we're now waiting on the lock, but no longer actively locking */
-	count = rwsem_atomic_update(adjustment, sem);
+	if (adjustment)
+		count = rwsem_atomic_update(adjustment, sem);
+	else
+		count = READ_ONCE(sem->count);
 
 	/* If there are no active locks, wake the front queued process(es).
 	 *
@@ -236,8 +310,7 @@ struct rw_semaphore __sched *rwsem_down_read_failed(struct rw_semaphore *sem)
 	 * wake our own waiter to join the existing active readers !
 	 */
 	if (count == RWSEM_WAITING_BIAS ||
-	    (count > RWSEM_WAITING_BIAS &&
-	     adjustment != -RWSEM_ACTIVE_READ_BIAS))
+	    (count > RWSEM_WAITING_BIAS && first))
 		sem = __rwsem_do_wake(sem, RWSEM_WAKE_ANY);
 
 	raw_spin_unlock_irq(&sem->wait_lock);
@@ -267,6 +340,7 @@ static inline bool rwsem_try_write_lock(long count, struct rw_semaphore *sem)
 		if (!list_is_singular(&sem->wait_list))
 			rwsem_atomic_update(RWSEM_WAITING_BIAS, sem);
 		rwsem_set_owner(sem);
+		rwsem_clear_handoff(sem);
 		return true;
 	}
 
@@ -296,26 +370,42 @@ static inline bool rwsem_try_write_lock_unqueued(struct rw_semaphore *sem)
 	}
 }
 
+/*
+ * Try to acquire read lock before the reader has been put on wait queue.
+ * A non-negative count means no writer is active and nobody is queued, so
+ * taking the lock here does not jump ahead of any waiter.
+ */
+static inline bool rwsem_try_read_lock_unqueued(struct rw_semaphore *sem)
+{
+	long old, count = READ_ONCE(sem->count);
+
+	while (count >= 0) {
+		old = cmpxchg_acquire(&sem->count, count,
+				      count + RWSEM_ACTIVE_READ_BIAS);
+		if (old == count)
+			return true;
+
+		count = old;
+	}
+
+	return false;
+}
+
 static inline bool rwsem_can_spin_on_owner(struct rw_semaphore *sem)
 {
 	struct task_struct *owner;
 	bool ret = true;
 
-	if (need_resched())
+	if (need_resched() || READ_ONCE(sem->handoff))
 		return false;
 
 	rcu_read_lock();
 	owner = READ_ONCE(sem->owner);
-	if (!owner) {
-		long count = READ_ONCE(sem->count);
+	if (!rwsem_owner_is_writer(owner)) {
 		/*
-		 * If sem->owner is not set, yet we have just recently entered the
-		 * slowpath with the lock being active, then there is a possibility
-		 * reader(s) may have the lock. To be safe, bail spinning in these
-		 * situations.
+		 * Don't spin if the rwsem is readers owned.
 		 */
-		if (count & RWSEM_ACTIVE_MASK)
-			ret = false;
+		ret = !rwsem_owner_is_reader(owner);
 		goto done;
 	}
 
@@ -325,11 +415,33 @@ done:
 	return ret;
 }
 
+/*
+ * Readers only spin on a writer that is actually running; if the owner
+ * is unknown the lock may just as well be held by readers with a writer
+ * queued behind them, and then we have to queue as well.
+ */
+static inline bool rwsem_reader_can_spin(struct rw_semaphore *sem)
+{
+	struct task_struct *owner;
+	bool ret;
+
+	if (need_resched() || READ_ONCE(sem->handoff))
+		return false;
+
+	rcu_read_lock();
+	owner = READ_ONCE(sem->owner);
+	ret = rwsem_owner_is_writer(owner) && owner->on_cpu;
+	rcu_read_unlock();
+
+	return ret;
+}
+
+/*
+ * Return true only if we can still spin on the owner field of the rwsem.
+ */
 static noinline
 bool rwsem_spin_on_owner(struct rw_semaphore *sem, struct task_struct *owner)
 {
-	long count;
-
 	rcu_read_lock();
 	while (sem->owner == owner) {
 		/*
@@ -341,7 +453,8 @@ bool rwsem_spin_on_owner(struct rw_semaphore *sem, struct task_struct *owner)
 		barrier();
 
 		/* abort spinning when need_resched or owner is not running */
-		if (!owner->on_cpu || need_resched()) {
+		if (!owner->on_cpu || need_resched() ||
+		    READ_ONCE(sem->handoff)) {
 			rcu_read_unlock();
 			return false;
 		}
@@ -350,19 +463,14 @@ bool rwsem_spin_on_owner(struct rw_semaphore *sem, struct task_struct *owner)
 	}
 	rcu_read_unlock();
 
-	if (READ_ONCE(sem->owner))
-		return true; /* new owner, continue spinning */
-
 	/*
-	 * When the owner is not set, the lock could be free or
-	 * held by readers. Check the counter to verify the
-	 * state.
+	 * If there is a new owner or the owner is not set, we continue
+	 * spinning.
 	 */
-	count = READ_ONCE(sem->count);
-	return (count == 0 || count == RWSEM_WAITING_BIAS);
+	return !rwsem_owner_is_reader(READ_ONCE(sem->owner));
 }
 
-static bool rwsem_optimistic_spin(struct rw_semaphore *sem)
+static bool rwsem_optimistic_spin(struct rw_semaphore *sem, bool wlock)
 {
 	struct task_struct *owner;
 	bool taken = false;
@@ -370,23 +478,33 @@ static bool rwsem_optimistic_spin(struct rw_semaphore *sem)
 	preempt_disable();
 
 	/* sem->wait_lock should not be held when doing optimistic spinning */
-	if (!rwsem_can_spin_on_owner(sem))
+	if (wlock && !rwsem_can_spin_on_owner(sem))
 		goto done;
 
 	if (!osq_lock(&sem->osq))
 		goto done;
 
-	while (true) {
+	while (!READ_ONCE(sem->handoff)) {
 		owner = READ_ONCE(sem->owner);
-		if (owner && !rwsem_spin_on_owner(sem, owner))
+		if (rwsem_owner_is_writer(owner) &&
+		    !rwsem_spin_on_owner(sem, owner))
 			break;
 
 		/* wait_lock will be acquired if write_lock is obtained */
-		if (rwsem_try_write_lock_unqueued(sem)) {
+		if (wlock ? rwsem_try_write_lock_unqueued(sem) :
+			    rwsem_try_read_lock_unqueued(sem)) {
 			taken = true;
 			break;
 		}
 
+		/*
+		 * A reader cannot get in while there are waiters or the
+		 * lock is read-owned with a writer pending, and we only
+		 * know how long that lasts when a writer owns the lock.
+		 */
+		if (!wlock && !rwsem_owner_is_writer(READ_ONCE(sem->owner)))
+			break;
+
 		/*
 		 * When there's no owner, we might have preempted between the
 		 * owner acquiring the lock and setting the owner field. If
@@ -419,7 +537,12 @@ static inline bool rwsem_has_spinner(struct rw_semaphore *sem)
 }
 
 #else
-static bool rwsem_optimistic_spin(struct rw_semaphore *sem)
+static bool rwsem_optimistic_spin(struct rw_semaphore *sem, bool wlock)
+{
+	return false;
+}
+
+static inline bool rwsem_reader_can_spin(struct rw_semaphore *sem)
 {
 	return false;
 }
@@ -433,8 +556,8 @@ static inline bool rwsem_has_spinner(struct rw_semaphore *sem)
 /*
  * Wait until we successfully acquire the write lock
  */
-__visible
-struct rw_semaphore __sched *rwsem_down_write_failed(struct rw_semaphore *sem)
+static inline struct rw_semaphore *
+__rwsem_down_write_failed_common(struct rw_semaphore *sem, int state)
 {
 	long count;
 	bool waiting = true; /* any queued threads before us */
@@ -444,7 +567,7 @@ struct rw_semaphore __sched *rwsem_down_write_failed(struct rw_semaphore *sem)
 	count = rwsem_atomic_update(-RWSEM_ACTIVE_WRITE_BIAS, sem);
 
 	/* do optimistic spinning and steal lock if possible */
-	if (rwsem_optimistic_spin(sem))
+	if (rwsem_optimistic_spin(sem, true))
 		return sem;
 
 	/*
@@ -453,6 +576,7 @@ struct rw_semaphore __sched *rwsem_down_write_failed(struct rw_semaphore *sem)
 	 */
 	waiter.task = current;
 	waiter.type = RWSEM_WAITING_FOR_WRITE;
+	waiter.timeout = jiffies + RWSEM_WAIT_TIMEOUT;
 
 	raw_spin_lock_irq(&sem->wait_lock);
 
@@ -478,16 +602,21 @@ struct rw_semaphore __sched *rwsem_down_write_failed(struct rw_semaphore *sem)
 		count = rwsem_atomic_update(RWSEM_WAITING_BIAS, sem);
 
 	/* wait until we successfully acquire the lock */
-	set_current_state(TASK_UNINTERRUPTIBLE);
+	set_current_state(state);
 	while (true) {
 		if (rwsem_try_write_lock(count, sem))
 			break;
+		if (sem->wait_list.next == &waiter.list)
+			rwsem_check_handoff(sem, &waiter);
 		raw_spin_unlock_irq(&sem->wait_lock);
 
 		/* Block until there are no active lockers. */
 		do {
+			if (signal_pending_state(state, current))
+				goto out_nolock;
+
 			schedule();
-			set_current_state(TASK_UNINTERRUPTIBLE);
+			set_current_state(state);
 		} while ((count = sem->count) & RWSEM_ACTIVE_MASK);
 
 		raw_spin_lock_irq(&sem->wait_lock);
@@ -498,9 +627,46 @@ struct rw_semaphore __sched *rwsem_down_write_failed(struct rw_semaphore *sem)
 	raw_spin_unlock_irq(&sem->wait_lock);
 
 	return sem;
+
+out_nolock:
+	__set_current_state(TASK_RUNNING);
+	raw_spin_lock_irq(&sem->wait_lock);
+	list_del(&waiter.list);
+	if (list_empty(&sem->wait_list)) {
+		rwsem_atomic_update(-RWSEM_WAITING_BIAS, sem);
+		rwsem_clear_handoff(sem);
+	} else {
+		__rwsem_do_wake(sem, RWSEM_WAKE_ANY);
+	}
+	raw_spin_unlock_irq(&sem->wait_lock);
+
+	return ERR_PTR(-EINTR);
+}
+
+__visible
+struct rw_semaphore __sched *rwsem_down_write_failed(struct rw_semaphore *sem)
+{
+	return __rwsem_down_write_failed_common(sem, TASK_UNINTERRUPTIBLE);
 }
 EXPORT_SYMBOL(rwsem_down_write_failed);
 
+/*
+ * The architectures only provide an uninterruptible write lock fast path,
+ * so the killable one is built on rwsem_atomic_update() here.
+ */
+int __sched __down_write_killable(struct rw_semaphore *sem)
+{
+	long count = rwsem_atomic_update(RWSEM_ACTIVE_WRITE_BIAS, sem);
+
+	if (likely(count == RWSEM_ACTIVE_WRITE_BIAS))
+		return 0;
+
+	if (IS_ERR(__rwsem_down_write_failed_common(sem, TASK_KILLABLE)))
+		return -EINTR;
+
+	return 0;
+}
+
 /*
  * handle waking up a waiter on the semaphore
  * - up_read/up_write has decremented the active part of count if we come here
@@ -528,7 +694,9 @@ struct rw_semaphore *rwsem_wake(struct rw_semaphore *sem)
 	 * is just going to break out of the waiting loop, it will still do
 	 * a trylock in rwsem_down_write_failed() before sleeping. IOW, if
 	 * rwsem_has_spinner() is true, it will guarantee at least one
-	 * trylock attempt on the rwsem later on.
+	 * trylock attempt on the rwsem later on. A spinning reader that
+	 * gives up re-checks the count under wait_lock in
+	 * rwsem_down_read_failed() and wakes the queue if the lock is free.
 	 */
 	if (rwsem_has_spinner(sem)) {
 		/*
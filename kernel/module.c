@@ -59,6 +59,8 @@
 #include <linux/jump_label.h>
 #include <linux/pfn.h>
 #include <linux/bsearch.h>
+#include <linux/jhash.h>
+#include <linux/log2.h>
 #include <uapi/linux/module.h>
 #include "module-internal.h"
 
@@ -426,6 +428,52 @@ extern const unsigned long __start___kcrctab_unused_gpl[];
 #define symversion(base, idx) ((base != NULL) ? ((base) + (idx)) : NULL)
 #endif
 
+#ifdef CONFIG_UNUSED_SYMBOLS
+#define NR_SYMSEARCH 5
+#else
+#define NR_SYMSEARCH 3
+#endif
+
+static const struct symsearch vmlinux_syms[NR_SYMSEARCH] = {
+	{ __start___ksymtab, __stop___ksymtab, __start___kcrctab,
+	  NOT_GPL_ONLY, false },
+	{ __start___ksymtab_gpl, __stop___ksymtab_gpl,
+	  __start___kcrctab_gpl,
+	  GPL_ONLY, false },
+	{ __start___ksymtab_gpl_future, __stop___ksymtab_gpl_future,
+	  __start___kcrctab_gpl_future,
+	  WILL_BE_GPL_ONLY, false },
+#ifdef CONFIG_UNUSED_SYMBOLS
+	{ __start___ksymtab_unused, __stop___ksymtab_unused,
+	  __start___kcrctab_unused,
+	  NOT_GPL_ONLY, true },
+	{ __start___ksymtab_unused_gpl, __stop___ksymtab_unused_gpl,
+	  __start___kcrctab_unused_gpl,
+	  GPL_ONLY, true },
+#endif
+};
+
+static void module_symsearch(const struct module *mod,
+			     struct symsearch arr[NR_SYMSEARCH])
+{
+	arr[0] = (struct symsearch){ mod->syms, mod->syms + mod->num_syms,
+		mod->crcs, NOT_GPL_ONLY, false };
+	arr[1] = (struct symsearch){ mod->gpl_syms,
+		mod->gpl_syms + mod->num_gpl_syms, mod->gpl_crcs,
+		GPL_ONLY, false };
+	arr[2] = (struct symsearch){ mod->gpl_future_syms,
+		mod->gpl_future_syms + mod->num_gpl_future_syms,
+		mod->gpl_future_crcs, WILL_BE_GPL_ONLY, false };
+#ifdef CONFIG_UNUSED_SYMBOLS
+	arr[3] = (struct symsearch){ mod->unused_syms,
+		mod->unused_syms + mod->num_unused_syms, mod->unused_crcs,
+		NOT_GPL_ONLY, true };
+	arr[4] = (struct symsearch){ mod->unused_gpl_syms,
+		mod->unused_gpl_syms + mod->num_unused_gpl_syms,
+		mod->unused_gpl_crcs, GPL_ONLY, true };
+#endif
+}
+
 static bool each_symbol_in_section(const struct symsearch *arr,
 				   unsigned int arrsize,
 				   struct module *owner,
@@ -451,57 +499,21 @@ bool each_symbol_section(bool (*fn)(const struct symsearch *arr,
 			 void *data)
 {
 	struct module *mod;
-	static const struct symsearch arr[] = {
-		{ __start___ksymtab, __stop___ksymtab, __start___kcrctab,
-		  NOT_GPL_ONLY, false },
-		{ __start___ksymtab_gpl, __stop___ksymtab_gpl,
-		  __start___kcrctab_gpl,
-		  GPL_ONLY, false },
-		{ __start___ksymtab_gpl_future, __stop___ksymtab_gpl_future,
-		  __start___kcrctab_gpl_future,
-		  WILL_BE_GPL_ONLY, false },
-#ifdef CONFIG_UNUSED_SYMBOLS
-		{ __start___ksymtab_unused, __stop___ksymtab_unused,
-		  __start___kcrctab_unused,
-		  NOT_GPL_ONLY, true },
-		{ __start___ksymtab_unused_gpl, __stop___ksymtab_unused_gpl,
-		  __start___kcrctab_unused_gpl,
-		  GPL_ONLY, true },
-#endif
-	};
 
 	module_assert_mutex_or_preempt();
 
-	if (each_symbol_in_section(arr, ARRAY_SIZE(arr), NULL, fn, data))
+	if (each_symbol_in_section(vmlinux_syms, NR_SYMSEARCH, NULL,
+				   fn, data))
 		return true;
 
 	list_for_each_entry_rcu(mod, &modules, list) {
-		struct symsearch arr[] = {
-			{ mod->syms, mod->syms + mod->num_syms, mod->crcs,
-			  NOT_GPL_ONLY, false },
-			{ mod->gpl_syms, mod->gpl_syms + mod->num_gpl_syms,
-			  mod->gpl_crcs,
-			  GPL_ONLY, false },
-			{ mod->gpl_future_syms,
-			  mod->gpl_future_syms + mod->num_gpl_future_syms,
-			  mod->gpl_future_crcs,
-			  WILL_BE_GPL_ONLY, false },
-#ifdef CONFIG_UNUSED_SYMBOLS
-			{ mod->unused_syms,
-			  mod->unused_syms + mod->num_unused_syms,
-			  mod->unused_crcs,
-			  NOT_GPL_ONLY, true },
-			{ mod->unused_gpl_syms,
-			  mod->unused_gpl_syms + mod->num_unused_gpl_syms,
-			  mod->unused_gpl_crcs,
-			  GPL_ONLY, true },
-#endif
-		};
+		struct symsearch arr[NR_SYMSEARCH];
 
 		if (mod->state == MODULE_STATE_UNFORMED)
 			continue;
 
-		if (each_symbol_in_section(arr, ARRAY_SIZE(arr), mod, fn, data))
+		module_symsearch(mod, arr);
+		if (each_symbol_in_section(arr, NR_SYMSEARCH, mod, fn, data))
 			return true;
 	}
 	return false;
@@ -578,6 +590,141 @@ static bool find_symbol_in_section(const struct symsearch *syms,
 	return false;
 }
 
+/*
+ * Exported symbols of vmlinux and of every formed module, hashed by name,
+ * so that find_symbol() does not have to binary search each section of
+ * each module in turn.  Exported names are unique (verify_export_symbols()
+ * makes sure of that), so the first match is the only one.
+ *
+ * Blocks are linked and unlinked under module_mutex; lookups walk the
+ * chains under module_mutex or with preemption disabled, and unlinked
+ * blocks are freed after synchronize_sched().
+ */
+struct ksym_hash_entry {
+	struct hlist_node node;
+	const struct kernel_symbol *sym;
+	const struct symsearch *syms;
+	struct module *owner;
+};
+
+struct ksym_hash_block {
+	struct symsearch syms[NR_SYMSEARCH];
+	unsigned int num;
+	struct ksym_hash_entry entries[];
+};
+
+/* NULL until ksym_table_init(), find_symbol() searches sections until then. */
+static struct hlist_head *ksym_table __read_mostly;
+static unsigned int ksym_table_bits __read_mostly;
+
+static struct hlist_head *ksym_bucket(struct hlist_head *table,
+				      const char *name)
+{
+	return &table[jhash(name, strlen(name), 0) &
+		      jhash_mask(ksym_table_bits)];
+}
+
+static struct ksym_hash_block *ksym_block_alloc(const struct symsearch *syms,
+						struct module *owner)
+{
+	const struct kernel_symbol *ks;
+	struct ksym_hash_block *blk;
+	unsigned int i, num = 0;
+	size_t size;
+
+	for (i = 0; i < NR_SYMSEARCH; i++)
+		num += syms[i].stop - syms[i].start;
+
+	size = sizeof(*blk) + num * sizeof(blk->entries[0]);
+	blk = kzalloc(size, GFP_KERNEL | __GFP_NOWARN);
+	if (!blk)
+		blk = vzalloc(size);
+	if (!blk)
+		return NULL;
+
+	memcpy(blk->syms, syms, sizeof(blk->syms));
+	for (i = 0; i < NR_SYMSEARCH; i++) {
+		for (ks = syms[i].start; ks < syms[i].stop; ks++) {
+			struct ksym_hash_entry *e = &blk->entries[blk->num++];
+
+			e->sym = ks;
+			e->syms = &blk->syms[i];
+			e->owner = owner;
+		}
+	}
+	return blk;
+}
+
+/* Called with module_mutex held. */
+static void ksym_block_link(struct hlist_head *table,
+			    struct ksym_hash_block *blk)
+{
+	unsigned int i;
+
+	for (i = 0; i < blk->num; i++)
+		hlist_add_head_rcu(&blk->entries[i].node,
+				   ksym_bucket(table, blk->entries[i].sym->name));
+}
+
+/* Called with module_mutex held, the block may not have been linked. */
+static void ksym_block_unlink(struct ksym_hash_block *blk)
+{
+	unsigned int i;
+
+	if (!blk)
+		return;
+
+	for (i = 0; i < blk->num; i++)
+		hlist_del_init_rcu(&blk->entries[i].node);
+}
+
+static bool find_symbol_hashed(struct hlist_head *table,
+			       struct find_symbol_arg *fsa)
+{
+	struct ksym_hash_entry *e;
+
+	hlist_for_each_entry_rcu(e, ksym_bucket(table, fsa->name), node) {
+		if (strcmp(e->sym->name, fsa->name) != 0)
+			continue;
+		return check_symbol(e->syms, e->owner,
+				    e->sym - e->syms->start, fsa);
+	}
+	return false;
+}
+
+static int __init ksym_table_init(void)
+{
+	struct ksym_hash_block *blk;
+	struct hlist_head *table;
+	struct module *mod;
+	unsigned int i, num = 0;
+
+	for (i = 0; i < NR_SYMSEARCH; i++)
+		num += vmlinux_syms[i].stop - vmlinux_syms[i].start;
+
+	/* One bucket per vmlinux export; modules add a lot fewer. */
+	ksym_table_bits = order_base_2(max(num, 1024U));
+	table = vzalloc(sizeof(*table) << ksym_table_bits);
+	blk = ksym_block_alloc(vmlinux_syms, NULL);
+	if (!table || !blk) {
+		pr_warn("no memory for the exported symbol hash\n");
+		vfree(table);
+		kvfree(blk);
+		return 0;
+	}
+
+	mutex_lock(&module_mutex);
+	ksym_block_link(table, blk);
+	list_for_each_entry(mod, &modules, list) {
+		if (mod->state != MODULE_STATE_UNFORMED)
+			ksym_block_link(table, mod->ksym_block);
+	}
+	smp_store_release(&ksym_table, table);
+	mutex_unlock(&module_mutex);
+	return 0;
+}
+core_initcall(ksym_table_init);
+
 /* Find a symbol and return it, along with, (optional) crc and
  * (optional) module which owns it.  Needs preempt disabled or module_mutex. */
 const struct kernel_symbol *find_symbol(const char *name,
@@ -587,12 +734,22 @@ const struct kernel_symbol *find_symbol(const char *name,
 					bool warn)
 {
 	struct find_symbol_arg fsa;
+	struct hlist_head *table;
+	bool found;
 
 	fsa.name = name;
 	fsa.gplok = gplok;
 	fsa.warn = warn;
 
-	if (each_symbol_section(find_symbol_in_section, &fsa)) {
+	module_assert_mutex_or_preempt();
+
+	table = lockless_dereference(ksym_table);
+	if (table)
+		found = find_symbol_hashed(table, &fsa);
+	else
+		found = each_symbol_section(find_symbol_in_section, &fsa);
+
+	if (found) {
 		if (owner)
 			*owner = fsa.owner;
 		if (crc)
@@ -1384,24 +1541,20 @@ static inline int same_magic(const char *amagic, const char *bmagic,
 }
 #endif /* CONFIG_MODVERSIONS */
 
-/* Resolve a symbol for this module.  I.e. if we find one, record usage. */
-static const struct kernel_symbol *resolve_symbol(struct module *mod,
-						  const struct load_info *info,
-						  const char *name,
-						  char ownername[])
+/*
+ * Resolve a symbol for this module.  I.e. if we find one, record usage.
+ * Called with module_mutex held.
+ */
+static const struct kernel_symbol *__resolve_symbol(struct module *mod,
+						    const struct load_info *info,
+						    const char *name,
+						    char ownername[])
 {
 	struct module *owner;
 	const struct kernel_symbol *sym;
 	const unsigned long *crc;
 	int err;
 
-	/*
-	 * The module_mutex should not be a heavily contended lock;
-	 * if we get the occasional sleep here, we'll go an extra iteration
-	 * in the wait_event_interruptible(), which is harmless.
-	 */
-	sched_annotate_sleep();
-	mutex_lock(&module_mutex);
 	sym = find_symbol(name, &owner, &crc,
 			  !(mod->taints & (1 << TAINT_PROPRIETARY_MODULE)), true);
 	if (!sym)
@@ -1423,6 +1576,24 @@ getname:
 	/* We must make copy under the lock if we failed to get ref. */
 	strncpy(ownername, module_name(owner), MODULE_NAME_LEN);
 unlock:
+	return sym;
+}
+
+static const struct kernel_symbol *resolve_symbol(struct module *mod,
+						  const struct load_info *info,
+						  const char *name,
+						  char ownername[])
+{
+	const struct kernel_symbol *sym;
+
+	/*
+	 * The module_mutex should not be a heavily contended lock;
+	 * if we get the occasional sleep here, we'll go an extra iteration
+	 * in the wait_event_interruptible(), which is harmless.
+	 */
+	sched_annotate_sleep();
+	mutex_lock(&module_mutex);
+	sym = __resolve_symbol(mod, info, name, ownername);
 	mutex_unlock(&module_mutex);
 	return sym;
 }
@@ -2030,11 +2201,13 @@ static void free_module(struct module *mod)
 	/* Unlink carefully: kallsyms could be walking list. */
 	list_del_rcu(&mod->list);
 	mod_tree_remove(mod);
+	ksym_block_unlink(mod->ksym_block);
 	/* Remove this module from bug list, this uses list_del_rcu */
 	module_bug_cleanup(mod);
 	/* Wait for RCU-sched synchronizing before releasing mod->list and buglist. */
 	synchronize_sched();
 	mutex_unlock(&module_mutex);
+	kvfree(mod->ksym_block);
 
 	/* This may be NULL, but that's OK */
 	unset_module_init_ro_nx(mod);
@@ -2107,7 +2280,13 @@ static int verify_export_symbols(struct module *mod)
 	return 0;
 }
 
-/* Change all symbols so that st_value encodes the pointer directly. */
+/*
+ * Change all symbols so that st_value encodes the pointer directly.
+ *
+ * Undefined symbols are resolved in one go under module_mutex rather than
+ * taking it for each of them; it is only dropped to wait for an owner
+ * that is still initializing.
+ */
 static int simplify_symbols(struct module *mod, const struct load_info *info)
 {
 	Elf_Shdr *symsec = &info->sechdrs[info->index.sym];
@@ -2116,7 +2295,9 @@ static int simplify_symbols(struct module *mod, const struct load_info *info)
 	unsigned int i;
 	int ret = 0;
 	const struct kernel_symbol *ksym;
+	char owner[MODULE_NAME_LEN];
 
+	mutex_lock(&module_mutex);
 	for (i = 1; i < symsec->sh_size / sizeof(Elf_Sym); i++) {
 		const char *name = info->strtab + sym[i].st_name;
 
@@ -2141,7 +2322,12 @@ static int simplify_symbols(struct module *mod, const struct load_info *info)
 			break;
 
 		case SHN_UNDEF:
-			ksym = resolve_symbol_wait(mod, info, name);
+			ksym = __resolve_symbol(mod, info, name, owner);
+			if (PTR_ERR(ksym) == -EBUSY) {
+				mutex_unlock(&module_mutex);
+				ksym = resolve_symbol_wait(mod, info, name);
+				mutex_lock(&module_mutex);
+			}
 			/* Ok if resolved.  */
 			if (ksym && !IS_ERR(ksym)) {
 				sym[i].st_value = ksym->value;
@@ -2167,6 +2353,7 @@ static int simplify_symbols(struct module *mod, const struct load_info *info)
 			break;
 		}
 	}
+	mutex_unlock(&module_mutex);
 
 	return ret;
 }
@@ -3379,8 +3566,15 @@ out_unlocked:
 
 static int complete_formation(struct module *mod, struct load_info *info)
 {
+	struct symsearch arr[NR_SYMSEARCH];
 	int err;
 
+	/* Freed by whoever unlinks the module. */
+	module_symsearch(mod, arr);
+	mod->ksym_block = ksym_block_alloc(arr, mod);
+	if (!mod->ksym_block)
+		return -ENOMEM;
+
 	mutex_lock(&module_mutex);
 
 	/* Find duplicate symbols (must be called under lock). */
@@ -3388,6 +3582,9 @@ static int complete_formation(struct module *mod, struct load_info *info)
 	if (err < 0)
 		goto out;
 
+	if (ksym_table)
+		ksym_block_link(ksym_table, mod->ksym_block);
+
 	/* This relies on module_mutex for list integrity. */
 	module_bug_finalize(info->hdr, info->sechdrs, mod);
 
@@ -3584,10 +3781,12 @@ static int load_module(struct load_info *info, const char __user *uargs,
 	/* Unlink carefully: kallsyms could be walking list. */
 	list_del_rcu(&mod->list);
 	mod_tree_remove(mod);
+	ksym_block_unlink(mod->ksym_block);
 	wake_up_all(&module_wq);
 	/* Wait for RCU-sched synchronizing before releasing mod->list. */
 	synchronize_sched();
 	mutex_unlock(&module_mutex);
+	kvfree(mod->ksym_block);
  free_module:
 	/*
 	 * Ftrace needs to clean up what it initialized.
@@ -43,6 +43,7 @@
 #include <linux/rculist.h>
 #include <linux/poll.h>
 #include <linux/irq_work.h>
+#include <linux/kthread.h>
 #include <linux/utsname.h>
 #include <linux/ctype.h>
 #include <linux/uio.h>
@@ -1534,6 +1535,31 @@ static int console_trylock_for_printk(void)
 	return 1;
 }
 
+/*
+ * A slow console can take seconds to print a burst of messages, so once
+ * the system is up printk() only stores them and printk_kthread does the
+ * printing.  The caller still prints them itself while the kthread does
+ * not exist, when the system is going down or crashing, and always with
+ * printk.synchronous=1.
+ */
+static bool __read_mostly printk_sync;
+module_param_named(synchronous, printk_sync, bool, S_IRUGO | S_IWUSR);
+
+static struct task_struct *printk_kthread __read_mostly;
+static bool printk_kthread_need_flush;
+
+static inline bool printk_offload(void)
+{
+	return printk_kthread && !printk_sync && !oops_in_progress &&
+	       system_state == SYSTEM_RUNNING;
+}
+
+static void wake_up_printk_kthread(void)
+{
+	WRITE_ONCE(printk_kthread_need_flush, true);
+	wake_up_process(printk_kthread);
+}
+
 int printk_delay_msec __read_mostly;
 
 static inline void printk_delay(void)
@@ -1807,6 +1833,11 @@ asmlinkage int vprintk_emit(int facility, int level,
 
 	/* If called from the scheduler, we can not call up(). */
 	if (!in_sched) {
+		if (printk_offload()) {
+			wake_up_printk_kthread();
+			return printed_len;
+		}
+
 		lockdep_off();
 		/*
 		 * Disable preemption to avoid being preempted while holding
@@ -2719,9 +2750,13 @@ static void wake_up_klogd_work_func(struct irq_work *irq_work)
 	int pending = __this_cpu_xchg(printk_pending, 0);
 
 	if (pending & PRINTK_PENDING_OUTPUT) {
-		/* If trylock fails, someone else is doing the printing */
-		if (console_trylock())
-			console_unlock();
+		if (printk_offload()) {
+			wake_up_printk_kthread();
+		} else {
+			/* If trylock fails, someone else is doing the printing */
+			if (console_trylock())
+				console_unlock();
+		}
 	}
 
 	if (pending & PRINTK_PENDING_WAKEUP)
@@ -2743,6 +2778,42 @@ void wake_up_klogd(void)
 	preempt_enable();
 }
 
+static int printk_kthread_func(void *data)
+{
+	for (;;) {
+		set_current_state(TASK_INTERRUPTIBLE);
+		if (!READ_ONCE(printk_kthread_need_flush))
+			schedule();
+		__set_current_state(TASK_RUNNING);
+		WRITE_ONCE(printk_kthread_need_flush, false);
+
+		/*
+		 * console_lock() lets console_unlock() reschedule between
+		 * records.  If someone else holds the console, their
+		 * console_unlock() prints what we were woken for.
+		 */
+		console_lock();
+		console_unlock();
+	}
+
+	return 0;
+}
+
+static int __init init_printk_kthread(void)
+{
+	struct task_struct *thread;
+
+	thread = kthread_run(printk_kthread_func, NULL, "printk");
+	if (IS_ERR(thread)) {
+		pr_err("printk: unable to create printing thread\n");
+		return PTR_ERR(thread);
+	}
+
+	printk_kthread = thread;
+	return 0;
+}
+late_initcall(init_printk_kthread);
+
 int printk_deferred(const char *fmt, ...)
 {
 	va_list args;
@@ -56,6 +56,8 @@
 #include <linux/random.h>
 #include <linux/trace_events.h>
 #include <linux/suspend.h>
+#include <linux/slab.h>
+#include <linux/workqueue.h>
 
 #include "tree.h"
 #include "rcu.h"
@@ -3124,19 +3126,220 @@ void call_rcu_bh(struct rcu_head *head, rcu_callback_t func)
 EXPORT_SYMBOL_GPL(call_rcu_bh);
 
 /*
- * Queue an RCU callback for lazy invocation after a grace period.
- * This will likely be later named something like "call_rcu_lazy()",
- * but this change will require some way of tagging the lazy RCU
- * callbacks in the list of pending callbacks. Until then, this
- * function may only be called from __kfree_rcu().
+ * kfree_rcu() batching.
+ *
+ * Rather than queueing one RCU callback per object, kfree_call_rcu()
+ * collects the object pointers into per-CPU page-sized blocks. A delayed
+ * work drains them every KFREE_DRAIN_JIFFIES behind a single RCU callback,
+ * and once the grace period has elapsed the blocks are released with
+ * kfree_bulk() from process context. Objects for which no block could be
+ * allocated are chained through their rcu_head and kfree()d one by one.
+ */
+#define KFREE_DRAIN_JIFFIES	(HZ / 50)
+
+struct kfree_rcu_bulk_data {
+	unsigned long nr_records;
+	struct kfree_rcu_bulk_data *next;
+	void *records[];
+};
+
+#define KFREE_BULK_MAX_ENTR						\
+	((PAGE_SIZE - sizeof(struct kfree_rcu_bulk_data)) / sizeof(void *))
+
+/**
+ * struct kfree_rcu_cpu - batching state for kfree_rcu() on one CPU
+ * @lock: protects all the fields below
+ * @bhead: blocks of pointers being filled
+ * @head: objects waiting for the next batch that did not fit in a block
+ * @bhead_free: blocks of the batch waiting for its grace period
+ * @head_free: list counterpart of @bhead_free
+ * @bcached: an empty block kept around for the next batch
+ * @rh: rcu_head for the batch in flight
+ * @monitor_work: drains @bhead and @head into a new batch
+ * @free_work: frees the batch once its grace period has elapsed
+ * @monitor_todo: @monitor_work is pending
+ * @in_flight: a batch is waiting for its grace period or being freed
+ */
+struct kfree_rcu_cpu {
+	spinlock_t lock;
+	struct kfree_rcu_bulk_data *bhead;
+	struct rcu_head *head;
+	struct kfree_rcu_bulk_data *bhead_free;
+	struct rcu_head *head_free;
+	struct kfree_rcu_bulk_data *bcached;
+	struct rcu_head rh;
+	struct delayed_work monitor_work;
+	struct work_struct free_work;
+	bool monitor_todo;
+	bool in_flight;
+};
+
+static DEFINE_PER_CPU(struct kfree_rcu_cpu, krc);
+static bool kfree_rcu_batching __read_mostly;
+
+static void kfree_rcu_schedule_monitor(struct kfree_rcu_cpu *krcp)
+{
+	if (!krcp->monitor_todo) {
+		krcp->monitor_todo = true;
+		schedule_delayed_work(&krcp->monitor_work, KFREE_DRAIN_JIFFIES);
+	}
+}
+
+static void kfree_rcu_free_work(struct work_struct *work)
+{
+	struct kfree_rcu_cpu *krcp = container_of(work, struct kfree_rcu_cpu,
+						  free_work);
+	struct kfree_rcu_bulk_data *bhead, *bnext;
+	struct rcu_head *head, *next;
+	unsigned long flags;
+
+	spin_lock_irqsave(&krcp->lock, flags);
+	bhead = krcp->bhead_free;
+	head = krcp->head_free;
+	krcp->bhead_free = NULL;
+	krcp->head_free = NULL;
+	spin_unlock_irqrestore(&krcp->lock, flags);
+
+	for (; bhead; bhead = bnext) {
+		bnext = bhead->next;
+
+		kfree_bulk(bhead->nr_records, bhead->records);
+
+		spin_lock_irqsave(&krcp->lock, flags);
+		if (!krcp->bcached) {
+			bhead->nr_records = 0;
+			bhead->next = NULL;
+			krcp->bcached = bhead;
+			bhead = NULL;
+		}
+		spin_unlock_irqrestore(&krcp->lock, flags);
+		if (bhead)
+			free_page((unsigned long)bhead);
+
+		cond_resched();
+	}
+
+	for (; head; head = next) {
+		next = head->next;
+		__rcu_reclaim("kfree_rcu", head);
+		cond_resched();
+	}
+
+	spin_lock_irqsave(&krcp->lock, flags);
+	krcp->in_flight = false;
+	if (krcp->bhead || krcp->head)
+		kfree_rcu_schedule_monitor(krcp);
+	spin_unlock_irqrestore(&krcp->lock, flags);
+}
+
+/* The grace period of the batch has elapsed, free it from process context. */
+static void kfree_rcu_batch_gp(struct rcu_head *rh)
+{
+	struct kfree_rcu_cpu *krcp = container_of(rh, struct kfree_rcu_cpu, rh);
+
+	schedule_work(&krcp->free_work);
+}
+
+static void kfree_rcu_monitor(struct work_struct *work)
+{
+	struct kfree_rcu_cpu *krcp = container_of(to_delayed_work(work),
+						  struct kfree_rcu_cpu,
+						  monitor_work);
+	unsigned long flags;
+
+	spin_lock_irqsave(&krcp->lock, flags);
+	krcp->monitor_todo = false;
+
+	/*
+	 * Only one batch per CPU is in flight. If the previous one has not
+	 * been freed yet, free_work reschedules us once it has.
+	 */
+	if (!krcp->in_flight && (krcp->bhead || krcp->head)) {
+		krcp->bhead_free = krcp->bhead;
+		krcp->head_free = krcp->head;
+		krcp->bhead = NULL;
+		krcp->head = NULL;
+		krcp->in_flight = true;
+		call_rcu(&krcp->rh, kfree_rcu_batch_gp);
+	}
+	spin_unlock_irqrestore(&krcp->lock, flags);
+}
+
+/* Add @ptr to the current block, returns false if no block is available. */
+static bool kfree_rcu_bulk_add(struct kfree_rcu_cpu *krcp, void *ptr)
+{
+	struct kfree_rcu_bulk_data *bnode = krcp->bhead;
+
+	if (!bnode || bnode->nr_records == KFREE_BULK_MAX_ENTR) {
+		bnode = krcp->bcached;
+		krcp->bcached = NULL;
+		if (!bnode)
+			bnode = (struct kfree_rcu_bulk_data *)
+				__get_free_page(GFP_NOWAIT | __GFP_NOWARN);
+		if (!bnode)
+			return false;
+
+		bnode->nr_records = 0;
+		bnode->next = krcp->bhead;
+		krcp->bhead = bnode;
+	}
+
+	bnode->records[bnode->nr_records++] = ptr;
+	return true;
+}
+
+/*
+ * Queue an object for kfree() after a grace period. @func is really the
+ * offset of @head within the object, see __kfree_rcu(). This function
+ * may only be called from __kfree_rcu().
  */
 void kfree_call_rcu(struct rcu_head *head,
 		    rcu_callback_t func)
 {
-	__call_rcu(head, func, rcu_state_p, -1, 1);
+	struct kfree_rcu_cpu *krcp;
+	unsigned long flags;
+
+	if (!kfree_rcu_batching || IS_ENABLED(CONFIG_DEBUG_OBJECTS_RCU_HEAD)) {
+		/*
+		 * Too early in boot for the workqueues, or rcu_head debugging
+		 * wants to see every object go through __call_rcu().
+		 */
+		__call_rcu(head, func, rcu_state_p, -1, 1);
+		return;
+	}
+
+	local_irq_save(flags);
+	krcp = this_cpu_ptr(&krc);
+	spin_lock(&krcp->lock);
+
+	if (!kfree_rcu_bulk_add(krcp, (void *)head - (unsigned long)func)) {
+		head->func = func;
+		head->next = krcp->head;
+		krcp->head = head;
+	}
+	kfree_rcu_schedule_monitor(krcp);
+
+	spin_unlock(&krcp->lock);
+	local_irq_restore(flags);
 }
 EXPORT_SYMBOL_GPL(kfree_call_rcu);
 
+static int __init kfree_rcu_batch_init(void)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		struct kfree_rcu_cpu *krcp = per_cpu_ptr(&krc, cpu);
+
+		spin_lock_init(&krcp->lock);
+		INIT_DELAYED_WORK(&krcp->monitor_work, kfree_rcu_monitor);
+		INIT_WORK(&krcp->free_work, kfree_rcu_free_work);
+	}
+	kfree_rcu_batching = true;
+	return 0;
+}
+core_initcall(kfree_rcu_batch_init);
+
 /*
  * Because a context switch is a grace period for RCU-sched and RCU-bh,
  * any blocking grace-period wait automatically implies a grace period
@@ -9,6 +9,7 @@
 #include <linux/irq_work.h>
 #include <linux/tick.h>
 #include <linux/slab.h>
+#include <linux/psi.h>
 
 #include "cpupri.h"
 #include "cpudeadline.h"
@@ -28,6 +29,10 @@ extern atomic_long_t calc_load_tasks;
 
 extern void calc_global_load_tick(struct rq *this_rq);
 extern long calc_load_fold_active(struct rq *this_rq);
+extern unsigned long calc_load(unsigned long load, unsigned long exp,
+			       unsigned long active);
+extern unsigned long calc_load_n(unsigned long load, unsigned long exp,
+				 unsigned long active, unsigned int n);
 
 #ifdef CONFIG_SMP
 extern void update_cpu_load_active(struct rq *this_rq);
@@ -222,7 +227,7 @@ struct cfs_bandwidth {
 #ifdef CONFIG_CFS_BANDWIDTH
 	raw_spinlock_t lock;
 	ktime_t period;
-	u64 quota, runtime;
+	u64 quota, runtime, burst;
 	s64 hierarchical_quota;
 	u64 runtime_expires;
 
@@ -271,6 +276,13 @@ struct task_group {
 #endif
 
 	struct cfs_bandwidth cfs_bandwidth;
+
+#ifdef CONFIG_UCLAMP_TASK_GROUP
+	/* clamp values requested for the group */
+	unsigned int uclamp_req[UCLAMP_CNT];
+	/* effective clamp values, restricted by the parent */
+	unsigned int uclamp[UCLAMP_CNT];
+#endif
 };
 
 #ifdef CONFIG_FAIR_GROUP_SCHED
@@ -343,6 +355,25 @@ struct cfs_bandwidth { };
 
 #endif	/* CONFIG_CGROUP_SCHED */
 
+#ifdef CONFIG_UCLAMP_TASK
+/*
+ * Tasks enqueued on a rq are refcounted in the bucket of their clamp value.
+ * A bucket tracks the largest value of its tasks, the rq clamp is the one
+ * of the highest non-empty bucket: max aggregation, so that the most boosted
+ * task gets its minimum and the least capped task isn't restricted.
+ */
+struct uclamp_bucket {
+	unsigned int value;
+	unsigned int tasks;
+};
+
+struct uclamp_rq {
+	unsigned int value;
+	unsigned int nr_tasks;
+	struct uclamp_bucket bucket[UCLAMP_BUCKETS];
+};
+#endif /* CONFIG_UCLAMP_TASK */
+
 /* CFS-related fields in a runqueue */
 struct cfs_rq {
 	struct load_weight load;
@@ -588,6 +619,11 @@ struct rq {
 	struct rt_rq rt;
 	struct dl_rq dl;
 
+#ifdef CONFIG_UCLAMP_TASK
+	/* utilization clamp values of the enqueued tasks */
+	struct uclamp_rq uclamp[UCLAMP_CNT];
+#endif
+
 #ifdef CONFIG_FAIR_GROUP_SCHED
 	/* list of leaf cfs_rq on this cpu: */
 	struct list_head leaf_cfs_rq_list;
@@ -604,6 +640,10 @@ struct rq {
 	struct task_struct *curr, *idle, *stop;
 	unsigned long next_balance;
 	struct mm_struct *prev_mm;
+#ifdef CONFIG_MEMBARRIER
+	/* mm of curr, for membarrier() to compare without touching curr */
+	struct mm_struct *membarrier_mm;
+#endif
 
 	unsigned int clock_skip_update;
 	u64 clock;
@@ -833,6 +873,7 @@ static inline struct sched_domain *lowest_flag_domain(int cpu, int flag)
 DECLARE_PER_CPU(struct sched_domain *, sd_llc);
 DECLARE_PER_CPU(int, sd_llc_size);
 DECLARE_PER_CPU(int, sd_llc_id);
+DECLARE_PER_CPU(struct sched_domain_shared *, sd_llc_shared);
 DECLARE_PER_CPU(struct sched_domain *, sd_numa);
 DECLARE_PER_CPU(struct sched_domain *, sd_busy);
 DECLARE_PER_CPU(struct sched_domain *, sd_asym);
@@ -902,6 +943,22 @@ static inline void sched_ttwu_pending(void) { }
 
 #endif /* CONFIG_SMP */
 
+#ifdef CONFIG_SCHED_SMT
+
+extern struct static_key_false sched_smt_present;
+
+extern void __update_idle_core(struct rq *rq);
+
+static inline void update_idle_core(struct rq *rq)
+{
+	if (static_branch_unlikely(&sched_smt_present))
+		__update_idle_core(rq);
+}
+
+#else
+static inline void update_idle_core(struct rq *rq) { }
+#endif
+
 #include "stats.h"
 #include "auto_group.h"
 
@@ -1396,7 +1453,13 @@ static inline int hrtick_enabled(struct rq *rq)
 #ifdef CONFIG_SMP
 extern void sched_avg_update(struct rq *rq);
 
-#ifndef arch_scale_freq_capacity
+#ifdef arch_scale_freq_capacity
+#ifndef arch_scale_freq_invariant
+#define arch_scale_freq_invariant()	(true)
+#endif
+#else /* arch_scale_freq_capacity */
+#define arch_scale_freq_invariant()	(false)
+
 static __always_inline
 unsigned long arch_scale_freq_capacity(struct sched_domain *sd, int cpu)
 {
@@ -1783,3 +1846,104 @@ static inline void account_reset_rq(struct rq *rq)
 	rq->prev_steal_time_rq = 0;
 #endif
 }
+
+#ifdef CONFIG_CPU_FREQ
+DECLARE_PER_CPU(struct update_util_data *, cpufreq_update_util_data);
+
+/**
+ * cpufreq_update_util - Take a note about CPU utilization changes.
+ * @time: Current time.
+ * @util: Current utilization.
+ * @max: Utilization ceiling.
+ *
+ * This function is called by the scheduler on every invocation of
+ * update_load_avg() on the CPU whose utilization is being updated.
+ *
+ * It can only be called from RCU-sched read-side critical sections.
+ *
+ * The way cpufreq is currently arranged requires it to evaluate the CPU
+ * performance state (frequency/voltage) on a regular basis to prevent it from
+ * being stuck in a completely inadequate performance level for too long.
+ * That is not guaranteed to happen if the updates are only triggered from CFS,
+ * though, because they may not be coming in if RT or deadline tasks are active
+ * all the time (or there are RT and DL tasks only).
+ *
+ * As a workaround for that issue, this function is called by the RT and DL
+ * sched classes to trigger extra cpufreq updates to prevent it from stalling,
+ * but that really is a band-aid.  Going forward it should be replaced with
+ * solutions targeted more specifically at RT and DL tasks.
+ */
+static inline void cpufreq_update_util(u64 time, unsigned long util, unsigned long max)
+{
+	struct update_util_data *data;
+
+	data = rcu_dereference_sched(*this_cpu_ptr(&cpufreq_update_util_data));
+	if (data)
+		data->func(data, time, util, max);
+}
+
+/*
+ * RT and DL tasks are not tracked by PELT here; ULONG_MAX as utilization
+ * asks the governor to go to the maximum frequency.
+ */
+static inline void cpufreq_trigger_update(u64 time)
+{
+	cpufreq_update_util(time, ULONG_MAX, 0);
+}
+#else
+static inline void cpufreq_update_util(u64 time, unsigned long util, unsigned long max) {}
+static inline void cpufreq_trigger_update(u64 time) {}
+#endif /* CONFIG_CPU_FREQ */
+
+#ifdef CONFIG_UCLAMP_TASK
+unsigned int uclamp_eff_value(struct task_struct *p, enum uclamp_id clamp_id);
+
+/*
+ * Clamp @util into the [min, max] range requested by the tasks enqueued on
+ * @rq.  A boosting min above some other task's max wins.
+ */
+static inline unsigned long uclamp_util(struct rq *rq, unsigned long util)
+{
+	unsigned long min_util = READ_ONCE(rq->uclamp[UCLAMP_MIN].value);
+	unsigned long max_util = READ_ONCE(rq->uclamp[UCLAMP_MAX].value);
+
+	if (unlikely(min_util >= max_util))
+		return min_util;
+
+	return clamp(util, min_util, max_util);
+}
+
+static inline unsigned long uclamp_task_util(struct task_struct *p,
+					     unsigned long util)
+{
+	return clamp(util, (unsigned long)uclamp_eff_value(p, UCLAMP_MIN),
+		     (unsigned long)uclamp_eff_value(p, UCLAMP_MAX));
+}
+#else
+static inline unsigned long uclamp_util(struct rq *rq, unsigned long util)
+{
+	return util;
+}
+
+static inline unsigned long uclamp_task_util(struct task_struct *p,
+					     unsigned long util)
+{
+	return util;
+}
+#endif /* CONFIG_UCLAMP_TASK */
+
+#ifdef CONFIG_MEMBARRIER
+/*
+ * Called before switch_mm() to @mm.  Together with the barriers of the
+ * rq->lock acquisition in __schedule() and of switch_mm(), this orders
+ * the update against the user accesses of the previous and the next task,
+ * which membarrier_private_expedited() relies on.
+ */
+static inline void membarrier_switch_mm(struct rq *rq, struct mm_struct *mm)
+{
+	if (READ_ONCE(rq->membarrier_mm) != mm)
+		WRITE_ONCE(rq->membarrier_mm, mm);
+}
+#else
+static inline void membarrier_switch_mm(struct rq *rq, struct mm_struct *mm) { }
+#endif
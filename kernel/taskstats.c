@@ -24,7 +24,10 @@
 #include <linux/percpu.h>
 #include <linux/slab.h>
 #include <linux/cgroupstats.h>
+#include <linux/task_diag.h>
 #include <linux/cgroup.h>
+#include <linux/ptrace.h>
+#include <linux/mm.h>
 #include <linux/fs.h>
 #include <linux/file.h>
 #include <linux/pid_namespace.h>
@@ -58,6 +61,13 @@ static const struct nla_policy cgroupstats_cmd_get_policy[CGROUPSTATS_CMD_ATTR_M
 	[CGROUPSTATS_CMD_ATTR_FD] = { .type = NLA_U32 },
 };
 
+static const struct nla_policy taskdiag_cmd_get_policy[TASK_DIAG_CMD_ATTR_MAX+1] = {
+	[TASK_DIAG_CMD_ATTR_SHOW]	= { .type = NLA_U64 },
+	[TASK_DIAG_CMD_ATTR_FLAGS]	= { .type = NLA_U32 },
+	[TASK_DIAG_CMD_ATTR_PIDS]	= { .type = NLA_BINARY },
+	[TASK_DIAG_CMD_ATTR_CGROUP_FD]	= { .type = NLA_U32 },
+};
+
 struct listener {
 	struct list_head list;
 	pid_t pid;
@@ -579,6 +589,304 @@ static int taskstats_user_cmd(struct sk_buff *skb, struct genl_info *info)
 		return -EINVAL;
 }
 
+/*
+ * Batched task diag dump.  Each task goes out as its own TASK_DIAG_CMD_NEW
+ * message, so a dump stops on a task boundary when the skb fills up and
+ * cb->args[0] says where to resume: the next pid number, the index into
+ * the pid array, or the number of cgroup tasks already walked.
+ */
+#define TASK_DIAG_CGROUP_BATCH	32
+
+struct taskdiag_ctx {
+	struct sk_buff *skb;
+	struct netlink_callback *cb;
+	struct user_namespace *user_ns;
+	struct pid_namespace *pid_ns;
+	struct taskstats *stats;
+	u64 show;
+	u32 flags;
+};
+
+static int taskdiag_fill_base(struct taskdiag_ctx *ctx,
+			      struct task_struct *tsk)
+{
+	struct pid_namespace *ns = ctx->pid_ns;
+	struct task_diag_base base;
+	struct task_struct *tracer;
+
+	BUILD_BUG_ON(fls(TASK_REPORT) != TASK_DIAG_ZOMBIE);
+	BUILD_BUG_ON(TASK_DIAG_COMM_LEN != TASK_COMM_LEN);
+
+	memset(&base, 0, sizeof(base));
+	base.tgid = task_tgid_nr_ns(tsk, ns);
+	base.pid = task_pid_nr_ns(tsk, ns);
+	base.sid = task_session_nr_ns(tsk, ns);
+	base.pgid = task_pgrp_nr_ns(tsk, ns);
+	base.state = fls((tsk->state | tsk->exit_state) & TASK_REPORT);
+
+	rcu_read_lock();
+	if (pid_alive(tsk))
+		base.ppid = task_tgid_nr_ns(rcu_dereference(tsk->real_parent),
+					    ns);
+	tracer = ptrace_parent(tsk);
+	if (tracer)
+		base.tpid = task_pid_nr_ns(tracer, ns);
+	rcu_read_unlock();
+
+	get_task_comm(base.comm, tsk);
+
+	return nla_put(ctx->skb, TASK_DIAG_BASE, sizeof(base), &base);
+}
+
+static int taskdiag_fill_creds(struct taskdiag_ctx *ctx,
+			       struct task_struct *tsk)
+{
+	struct user_namespace *user_ns = ctx->user_ns;
+	struct task_diag_creds creds;
+	const struct cred *cred;
+	unsigned int i;
+
+	BUILD_BUG_ON(_KERNEL_CAPABILITY_U32S != _LINUX_CAPABILITY_U32S_3);
+
+	rcu_read_lock();
+	cred = __task_cred(tsk);
+	CAP_FOR_EACH_U32(i) {
+		creds.cap_inheritable.cap[i] = cred->cap_inheritable.cap[i];
+		creds.cap_permitted.cap[i] = cred->cap_permitted.cap[i];
+		creds.cap_effective.cap[i] = cred->cap_effective.cap[i];
+		creds.cap_bset.cap[i] = cred->cap_bset.cap[i];
+	}
+	creds.uid = from_kuid_munged(user_ns, cred->uid);
+	creds.euid = from_kuid_munged(user_ns, cred->euid);
+	creds.suid = from_kuid_munged(user_ns, cred->suid);
+	creds.fsuid = from_kuid_munged(user_ns, cred->fsuid);
+	creds.gid = from_kgid_munged(user_ns, cred->gid);
+	creds.egid = from_kgid_munged(user_ns, cred->egid);
+	creds.sgid = from_kgid_munged(user_ns, cred->sgid);
+	creds.fsgid = from_kgid_munged(user_ns, cred->fsgid);
+	rcu_read_unlock();
+
+	return nla_put(ctx->skb, TASK_DIAG_CRED, sizeof(creds), &creds);
+}
+
+static int taskdiag_fill_vm(struct taskdiag_ctx *ctx, struct task_struct *tsk)
+{
+	struct task_diag_vm vm;
+	struct mm_struct *mm;
+
+	mm = get_task_mm(tsk);
+	if (!mm)
+		return 0;
+
+	vm.total_vm = mm->total_vm;
+	vm.hiwater_vm = get_mm_hiwater_vm(mm);
+	vm.locked_vm = mm->locked_vm;
+	vm.pinned_vm = mm->pinned_vm;
+	vm.shared_vm = mm->shared_vm;
+	vm.exec_vm = mm->exec_vm;
+	vm.stack_vm = mm->stack_vm;
+	vm.hiwater_rss = get_mm_hiwater_rss(mm);
+	vm.file_pages = get_mm_counter(mm, MM_FILEPAGES);
+	vm.anon_pages = get_mm_counter(mm, MM_ANONPAGES);
+	vm.swap_ents = get_mm_counter(mm, MM_SWAPENTS);
+	vm.nr_ptes = atomic_long_read(&mm->nr_ptes);
+	mmput(mm);
+
+	return nla_put(ctx->skb, TASK_DIAG_VM, sizeof(vm), &vm);
+}
+
+static int taskdiag_fill(struct taskdiag_ctx *ctx, struct task_struct *tsk)
+{
+	struct netlink_callback *cb = ctx->cb;
+	u64 show = ctx->show;
+	void *reply;
+	int rc = 0;
+
+	reply = genlmsg_put(ctx->skb, NETLINK_CB(cb->skb).portid,
+			    cb->nlh->nlmsg_seq, &family, NLM_F_MULTI,
+			    TASK_DIAG_CMD_NEW);
+	if (!reply)
+		return -EMSGSIZE;
+
+	/* The same rule as /proc/<pid>/stat and /proc/<pid>/io */
+	if ((show & (TASK_DIAG_SHOW_STAT | TASK_DIAG_SHOW_VM)) &&
+	    !ptrace_may_access(tsk, PTRACE_MODE_READ_FSCREDS))
+		show &= ~(TASK_DIAG_SHOW_STAT | TASK_DIAG_SHOW_VM);
+
+	if (show & TASK_DIAG_SHOW_BASE)
+		rc = taskdiag_fill_base(ctx, tsk);
+	if (!rc && (show & TASK_DIAG_SHOW_CRED))
+		rc = taskdiag_fill_creds(ctx, tsk);
+	if (!rc && (show & TASK_DIAG_SHOW_STAT)) {
+		fill_stats(ctx->user_ns, ctx->pid_ns, tsk, ctx->stats);
+		rc = nla_put(ctx->skb, TASK_DIAG_STAT, sizeof(struct taskstats),
+			     ctx->stats);
+	}
+	if (!rc && (show & TASK_DIAG_SHOW_VM))
+		rc = taskdiag_fill_vm(ctx, tsk);
+
+	if (rc) {
+		genlmsg_cancel(ctx->skb, reply);
+		return rc;
+	}
+	genlmsg_end(ctx->skb, reply);
+	return 0;
+}
+
+static int taskdiag_dump_pids(struct taskdiag_ctx *ctx, struct nlattr *na)
+{
+	u32 *pids = nla_data(na);
+	long n = nla_len(na) / sizeof(u32);
+	long *pos = &ctx->cb->args[0];
+	struct task_struct *tsk;
+	int rc = 0;
+
+	if (nla_len(na) % sizeof(u32))
+		return -EINVAL;
+
+	for (; *pos < n; (*pos)++) {
+		rcu_read_lock();
+		tsk = find_task_by_pid_ns(pids[*pos], ctx->pid_ns);
+		if (tsk)
+			get_task_struct(tsk);
+		rcu_read_unlock();
+		/* Tasks that are gone are left out of the dump */
+		if (!tsk)
+			continue;
+
+		rc = taskdiag_fill(ctx, tsk);
+		put_task_struct(tsk);
+		if (rc)
+			break;
+	}
+	return rc;
+}
+
+static int taskdiag_dump_cgroup(struct taskdiag_ctx *ctx, u32 fd)
+{
+	struct task_struct *tasks[TASK_DIAG_CGROUP_BATCH];
+	long *pos = &ctx->cb->args[0];
+	int i, n, rc = 0;
+	struct fd f;
+
+	f = fdget(fd);
+	if (!f.file)
+		return -EBADF;
+
+	do {
+		n = cgroup_grab_tasks(f.file->f_path.dentry, *pos, tasks,
+				      ARRAY_SIZE(tasks));
+		if (n < 0) {
+			rc = n;
+			break;
+		}
+
+		for (i = 0; i < n; i++) {
+			if (!rc && ((ctx->flags & TASK_DIAG_DUMP_THREADS) ||
+				    thread_group_leader(tasks[i])))
+				rc = taskdiag_fill(ctx, tasks[i]);
+			if (!rc)
+				(*pos)++;
+			put_task_struct(tasks[i]);
+		}
+	} while (!rc && n == ARRAY_SIZE(tasks));
+
+	fdput(f);
+	return rc;
+}
+
+/* Like next_tgid() in fs/proc/base.c */
+static struct task_struct *taskdiag_next_task(struct pid_namespace *ns,
+					      long *nr, bool threads)
+{
+	struct task_struct *tsk;
+	struct pid *pid;
+
+	rcu_read_lock();
+retry:
+	tsk = NULL;
+	pid = find_ge_pid(*nr, ns);
+	if (pid) {
+		*nr = pid_nr_ns(pid, ns);
+		tsk = pid_task(pid, PIDTYPE_PID);
+		if (!tsk || (!threads && !has_group_leader_pid(tsk))) {
+			(*nr)++;
+			goto retry;
+		}
+		get_task_struct(tsk);
+	}
+	rcu_read_unlock();
+	return tsk;
+}
+
+static int taskdiag_dump_all(struct taskdiag_ctx *ctx)
+{
+	bool threads = ctx->flags & TASK_DIAG_DUMP_THREADS;
+	long *nr = &ctx->cb->args[0];
+	struct task_struct *tsk;
+	int rc = 0;
+
+	while ((tsk = taskdiag_next_task(ctx->pid_ns, nr, threads))) {
+		rc = taskdiag_fill(ctx, tsk);
+		put_task_struct(tsk);
+		if (rc)
+			break;
+		(*nr)++;
+	}
+	return rc;
+}
+
+static int taskdiag_dumpit(struct sk_buff *skb, struct netlink_callback *cb)
+{
+	struct nlattr *attrs[TASK_DIAG_CMD_ATTR_MAX + 1];
+	struct taskdiag_ctx ctx = {
+		.skb		= skb,
+		.cb		= cb,
+		.user_ns	= current_user_ns(),
+		.pid_ns		= task_active_pid_ns(current),
+		.show		= TASK_DIAG_SHOW_BASE,
+	};
+	int rc;
+
+	rc = nlmsg_parse(cb->nlh, GENL_HDRLEN, attrs, TASK_DIAG_CMD_ATTR_MAX,
+			 taskdiag_cmd_get_policy);
+	if (rc < 0)
+		return rc;
+
+	if (attrs[TASK_DIAG_CMD_ATTR_SHOW])
+		ctx.show = nla_get_u64(attrs[TASK_DIAG_CMD_ATTR_SHOW]);
+	if (attrs[TASK_DIAG_CMD_ATTR_FLAGS])
+		ctx.flags = nla_get_u32(attrs[TASK_DIAG_CMD_ATTR_FLAGS]);
+	if (ctx.show & ~TASK_DIAG_SHOW_ALL ||
+	    ctx.flags & ~TASK_DIAG_DUMP_THREADS)
+		return -EINVAL;
+	if (attrs[TASK_DIAG_CMD_ATTR_PIDS] &&
+	    attrs[TASK_DIAG_CMD_ATTR_CGROUP_FD])
+		return -EINVAL;
+
+	if (ctx.show & TASK_DIAG_SHOW_STAT) {
+		ctx.stats = kmem_cache_alloc(taskstats_cache, GFP_KERNEL);
+		if (!ctx.stats)
+			return -ENOMEM;
+	}
+
+	if (attrs[TASK_DIAG_CMD_ATTR_PIDS])
+		rc = taskdiag_dump_pids(&ctx, attrs[TASK_DIAG_CMD_ATTR_PIDS]);
+	else if (attrs[TASK_DIAG_CMD_ATTR_CGROUP_FD])
+		rc = taskdiag_dump_cgroup(&ctx,
+			nla_get_u32(attrs[TASK_DIAG_CMD_ATTR_CGROUP_FD]));
+	else
+		rc = taskdiag_dump_all(&ctx);
+
+	if (ctx.stats)
+		kmem_cache_free(taskstats_cache, ctx.stats);
+
+	/* A full skb is not an error, the dump resumes on the next read */
+	if (rc < 0 && rc != -EMSGSIZE)
+		return rc;
+	return skb->len;
+}
+
 static struct taskstats *taskstats_tgid_alloc(struct task_struct *tsk)
 {
 	struct signal_struct *sig = tsk->signal;
@@ -676,6 +984,11 @@ static const struct genl_ops taskstats_ops[] = {
 		.doit		= cgroupstats_user_cmd,
 		.policy		= cgroupstats_cmd_get_policy,
 	},
+	{
+		.cmd		= TASK_DIAG_CMD_GET,
+		.dumpit		= taskdiag_dumpit,
+		.policy		= taskdiag_cmd_get_policy,
+	},
 };
 
 /* Needed early in initialization */
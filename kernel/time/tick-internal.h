@@ -163,4 +163,18 @@ static inline void timers_update_migration(bool update_nohz) { }
 
 DECLARE_PER_CPU(struct hrtimer_cpu_base, hrtimer_bases);
 
-extern u64 get_next_timer_interrupt(unsigned long basej, u64 basem);
+extern u64 get_next_timer_interrupt(unsigned long basej, u64 basem,
+				    bool idle);
+extern u64 get_jiffies_update(unsigned long *basej);
+
+#ifdef CONFIG_TIMER_MIGRATION
+extern void timer_expire_remote(unsigned int cpu);
+extern u64 tmigr_cpu_deactivate(u64 nextexp);
+extern void tmigr_cpu_activate(void);
+extern void tmigr_cpu_update_remote(unsigned int cpu, u64 nextexp);
+extern void tmigr_handle_remote(void);
+#else
+static inline u64 tmigr_cpu_deactivate(u64 nextexp) { return nextexp; }
+static inline void tmigr_cpu_activate(void) { }
+static inline void tmigr_handle_remote(void) { }
+#endif
@@ -20,6 +20,7 @@
 #include <linux/profile.h>
 #include <linux/sched.h>
 #include <linux/module.h>
+#include <linux/vmstat.h>
 #include <linux/irq_work.h>
 #include <linux/posix-timers.h>
 #include <linux/perf_event.h>
@@ -92,6 +93,23 @@ static void tick_do_update_jiffies64(ktime_t now)
 	update_wall_time();
 }
 
+/*
+ * Read jiffies and the time when jiffies were updated last.
+ */
+u64 get_jiffies_update(unsigned long *basej)
+{
+	unsigned long seq, basejiff;
+	u64 basemono;
+
+	do {
+		seq = read_seqbegin(&jiffies_lock);
+		basemono = last_jiffies_update.tv64;
+		basejiff = jiffies;
+	} while (read_seqretry(&jiffies_lock, seq));
+	*basej = basejiff;
+	return basemono;
+}
+
 /*
  * Initialize and return retrieve the jiffies update.
  */
@@ -573,15 +591,10 @@ static ktime_t tick_nohz_stop_sched_tick(struct tick_sched *ts,
 {
 	struct clock_event_device *dev = __this_cpu_read(tick_cpu_device.evtdev);
 	u64 basemono, next_tick, next_tmr, next_rcu, delta, expires;
-	unsigned long seq, basejiff;
+	unsigned long basejiff;
 	ktime_t	tick;
 
-	/* Read jiffies and the time when jiffies were updated last */
-	do {
-		seq = read_seqbegin(&jiffies_lock);
-		basemono = last_jiffies_update.tv64;
-		basejiff = jiffies;
-	} while (read_seqretry(&jiffies_lock, seq));
+	basemono = get_jiffies_update(&basejiff);
 	ts->last_jiffies = basejiff;
 
 	if (rcu_needs_cpu(basemono, &next_rcu) ||
@@ -593,9 +606,11 @@ static ktime_t tick_nohz_stop_sched_tick(struct tick_sched *ts,
 		 * timers are enabled this only takes the timer wheel
 		 * timers into account. If high resolution timers are
 		 * disabled this also looks at the next expiring
-		 * hrtimer.
+		 * hrtimer. An idle CPU hands its global timers over
+		 * to the timer migration hierarchy here.
 		 */
-		next_tmr = get_next_timer_interrupt(basejiff, basemono);
+		next_tmr = get_next_timer_interrupt(basejiff, basemono,
+						    ts->inidle);
 		ts->next_timer = next_tmr;
 		/* Take the next rcu event into account */
 		next_tick = next_rcu < next_tmr ? next_rcu : next_tmr;
@@ -668,6 +683,7 @@ static ktime_t tick_nohz_stop_sched_tick(struct tick_sched *ts,
 	if (!ts->tick_stopped) {
 		nohz_balance_enter_idle(cpu);
 		calc_load_enter_idle();
+		quiet_vmstat();
 
 		ts->last_tick = hrtimer_get_expires(&ts->sched_timer);
 		ts->tick_stopped = 1;
@@ -908,6 +924,7 @@ void tick_nohz_idle_exit(void)
 	WARN_ON_ONCE(!ts->inidle);
 
 	ts->inidle = 0;
+	tmigr_cpu_activate();
 
 	if (ts->idle_active || ts->tick_stopped)
 		now = ktime_get();
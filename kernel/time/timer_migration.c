@@ -0,0 +1,457 @@
+/*
+ * kernel/time/timer_migration.c
+ *
+ * Pull model for the expiry of the global timers of idle CPUs
+ *
+ * Non-pinned timers are always queued on the local CPU. When a CPU goes
+ * idle, it does not wake up for them. Instead it reports its first global
+ * timer to a hierarchy of groups, and a CPU that is still busy at expiry
+ * time runs them on its behalf. Only the last CPU going idle has to wake
+ * up for the first global timer of the whole system.
+ *
+ * CPUs are grouped by NUMA node, TMIGR_CHILDREN_PER_GROUP to a group, and
+ * the groups are grouped again the same way until a single top level
+ * group is left. In each group one active child, the migrator, looks
+ * after the events of the idle children. For an active CPU this is a
+ * check of the first event of the groups it is the migrator of in the
+ * timer softirq.
+ *
+ * Group locks are taken bottom up, each one before the one of the child
+ * is dropped, so state changes of a child reach the parent in order. The
+ * global timer base of a CPU is locked around any update of its event.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+#include <linux/cpu.h>
+#include <linux/init.h>
+#include <linux/percpu.h>
+#include <linux/slab.h>
+#include <linux/spinlock.h>
+#include <linux/tick.h>
+#include <linux/topology.h>
+
+#include "tick-internal.h"
+#include "timer_migration.h"
+
+enum tmigr_op {
+	TMIGR_ACTIVATE,
+	TMIGR_DEACTIVATE,
+	TMIGR_UPDATE,
+};
+
+static DEFINE_PER_CPU(struct tmigr_cpu, tmigr_cpu);
+static struct tmigr_group *tmigr_root;
+
+/* Recompute the first event of @group. Caller holds group->lock. */
+static void tmigr_update_next_expiry(struct tmigr_group *group)
+{
+	u64 next = KTIME_MAX;
+	unsigned int i;
+
+	for (i = 0; i < group->num_children; i++)
+		next = min(next, group->child_expiry[i]);
+
+	WRITE_ONCE(group->next_expiry, next);
+}
+
+/*
+ * Apply @op with event @expiry to child @childidx of @group and walk up
+ * the hierarchy as long as the change has to be propagated:
+ *
+ * TMIGR_ACTIVATE:	the child became active. Propagated when the group
+ *			becomes active as well.
+ * TMIGR_DEACTIVATE:	the child went idle with first event @expiry.
+ *			Propagated when the group goes idle as well.
+ * TMIGR_UPDATE:	the first event of an idle child changed to @expiry.
+ *			Propagated while the first event of the group
+ *			changes and the group is idle.
+ *
+ * Must be called with interrupts disabled. Returns the first event of
+ * the hierarchy if the walk changed the top level group and left it
+ * idle, which means the caller has to wake up for it. KTIME_MAX
+ * otherwise.
+ */
+static u64 tmigr_walk_up(struct tmigr_group *group, unsigned int childidx,
+			 enum tmigr_op op, u64 expiry)
+{
+	u64 wakeup = KTIME_MAX;
+
+	raw_spin_lock(&group->lock);
+	for (;;) {
+		struct tmigr_group *parent = group->parent;
+		unsigned int bit = 1U << childidx;
+		bool was_active = group->active;
+		u64 old = group->next_expiry;
+		bool propagate;
+
+		switch (op) {
+		case TMIGR_ACTIVATE:
+			group->active |= bit;
+			group->child_expiry[childidx] = KTIME_MAX;
+			if (group->migrator == TMIGR_NONE)
+				group->migrator = childidx;
+			break;
+		case TMIGR_DEACTIVATE:
+			group->active &= ~bit;
+			group->child_expiry[childidx] = expiry;
+			if (group->migrator == childidx)
+				group->migrator = group->active ?
+					__ffs(group->active) : TMIGR_NONE;
+			break;
+		case TMIGR_UPDATE:
+			/* Stale update, the child became active meanwhile */
+			if (group->active & bit)
+				goto unlock;
+			group->child_expiry[childidx] = expiry;
+			break;
+		}
+		tmigr_update_next_expiry(group);
+
+		if (op == TMIGR_ACTIVATE)
+			propagate = !was_active;
+		else if (op == TMIGR_DEACTIVATE)
+			propagate = !group->active;
+		else
+			propagate = !group->active && group->next_expiry != old;
+
+		if (!propagate)
+			break;
+
+		if (!parent) {
+			if (!group->active)
+				wakeup = group->next_expiry;
+			break;
+		}
+
+		raw_spin_lock_nested(&parent->lock, parent->level);
+		expiry = group->next_expiry;
+		childidx = group->childidx;
+		raw_spin_unlock(&group->lock);
+		group = parent;
+	}
+unlock:
+	raw_spin_unlock(&group->lock);
+	return wakeup;
+}
+
+/**
+ * tmigr_cpu_deactivate - hand the global timers of a CPU going idle over
+ * @nextexp:	first global event of this CPU, KTIME_MAX if none
+ *
+ * Called with interrupts disabled and the global timer base of the CPU
+ * locked. Returns the first global event this CPU still has to wake up
+ * for: @nextexp itself if the CPU does not take part in the hierarchy,
+ * otherwise the first event of the hierarchy if this CPU is responsible
+ * for it, or KTIME_MAX.
+ */
+u64 tmigr_cpu_deactivate(u64 nextexp)
+{
+	struct tmigr_cpu *tmc = this_cpu_ptr(&tmigr_cpu);
+	enum tmigr_op op = tmc->idle ? TMIGR_UPDATE : TMIGR_DEACTIVATE;
+	u64 wakeup;
+
+	if (!tmc->online)
+		return nextexp;
+
+	wakeup = tmigr_walk_up(tmc->tmgroup, tmc->childidx, op, nextexp);
+	tmc->idle = true;
+	if (wakeup != KTIME_MAX)
+		tmc->wakeup = wakeup;
+
+	return tmc->wakeup;
+}
+
+/**
+ * tmigr_cpu_activate - take back the global timers of a CPU leaving idle
+ *
+ * Called with interrupts disabled.
+ */
+void tmigr_cpu_activate(void)
+{
+	struct tmigr_cpu *tmc = this_cpu_ptr(&tmigr_cpu);
+
+	if (!tmc->online || !tmc->idle)
+		return;
+
+	tmc->idle = false;
+	tmc->wakeup = KTIME_MAX;
+	tmigr_walk_up(tmc->tmgroup, tmc->childidx, TMIGR_ACTIVATE, KTIME_MAX);
+}
+
+/**
+ * tmigr_cpu_update_remote - update the first global event of an idle CPU
+ * @cpu:	the idle CPU
+ * @nextexp:	its new first global event, KTIME_MAX if none
+ *
+ * Called after its global timers were expired by another CPU, with
+ * interrupts disabled and the global timer base of @cpu locked.
+ */
+void tmigr_cpu_update_remote(unsigned int cpu, u64 nextexp)
+{
+	struct tmigr_cpu *tmc = per_cpu_ptr(&tmigr_cpu, cpu);
+
+	if (tmc->online)
+		tmigr_walk_up(tmc->tmgroup, tmc->childidx, TMIGR_UPDATE,
+			      nextexp);
+}
+
+/* Expire all events of the idle children of @group due by @now. */
+static void tmigr_handle_group(struct tmigr_group *group, u64 now)
+{
+	unsigned long expired = 0;
+	unsigned int i;
+
+	raw_spin_lock_irq(&group->lock);
+	for (i = 0; i < group->num_children; i++) {
+		if (group->child_expiry[i] <= now)
+			expired |= 1UL << i;
+	}
+	raw_spin_unlock_irq(&group->lock);
+
+	for_each_set_bit(i, &expired, TMIGR_CHILDREN_PER_GROUP) {
+		if (!group->level)
+			timer_expire_remote(group->child[i].cpu);
+		else
+			tmigr_handle_group(group->child[i].group, now);
+	}
+}
+
+/**
+ * tmigr_handle_remote - expire the global timers of idle CPUs
+ *
+ * Called from the timer softirq. An active CPU looks after the groups it
+ * is the migrator of, an idle one only after the first event of the
+ * hierarchy if it woke up for it.
+ */
+void tmigr_handle_remote(void)
+{
+	struct tmigr_cpu *tmc = this_cpu_ptr(&tmigr_cpu);
+	struct tmigr_group *group;
+	unsigned long basej;
+	int childidx;
+	u64 now = 0;
+
+	if (!tmc->online)
+		return;
+
+	if (tmc->idle) {
+		if (tmc->wakeup == KTIME_MAX)
+			return;
+
+		now = get_jiffies_update(&basej);
+		if (tmc->wakeup > now)
+			return;
+
+		tmigr_handle_group(tmigr_root, now);
+
+		raw_spin_lock_irq(&tmigr_root->lock);
+		tmc->wakeup = tmigr_root->active ? KTIME_MAX :
+			      tmigr_root->next_expiry;
+		raw_spin_unlock_irq(&tmigr_root->lock);
+		return;
+	}
+
+	/*
+	 * The lockless reads may race with an update, or even tear on 32bit.
+	 * That only delays the expiry to the next tick, which rereads them.
+	 */
+	group = tmc->tmgroup;
+	childidx = tmc->childidx;
+	while (group && READ_ONCE(group->migrator) == childidx) {
+		u64 next = READ_ONCE(group->next_expiry);
+
+		if (next != KTIME_MAX) {
+			if (!now)
+				now = get_jiffies_update(&basej);
+			if (next <= now)
+				tmigr_handle_group(group, now);
+		}
+		childidx = group->childidx;
+		group = group->parent;
+	}
+}
+
+static void tmigr_cpu_online(void)
+{
+	struct tmigr_cpu *tmc = this_cpu_ptr(&tmigr_cpu);
+
+	/*
+	 * A full dynticks CPU may run without tick, so it can neither be
+	 * trusted to act as migrator. It keeps its global timers to itself.
+	 */
+	if (!tmc->tmgroup || tick_nohz_full_cpu(smp_processor_id()))
+		return;
+
+	tmc->idle = false;
+	tmc->wakeup = KTIME_MAX;
+	tmigr_walk_up(tmc->tmgroup, tmc->childidx, TMIGR_ACTIVATE, KTIME_MAX);
+	WRITE_ONCE(tmc->online, true);
+}
+
+/*
+ * The timers of an outgoing CPU are migrated to another CPU later on, so
+ * it leaves without an event.
+ */
+static void tmigr_cpu_offline(void)
+{
+	struct tmigr_cpu *tmc = this_cpu_ptr(&tmigr_cpu);
+
+	if (!tmc->online)
+		return;
+
+	WRITE_ONCE(tmc->online, false);
+	tmigr_walk_up(tmc->tmgroup, tmc->childidx,
+		      tmc->idle ? TMIGR_UPDATE : TMIGR_DEACTIVATE, KTIME_MAX);
+	tmc->idle = false;
+	tmc->wakeup = KTIME_MAX;
+}
+
+static int tmigr_cpu_notify(struct notifier_block *self,
+			    unsigned long action, void *hcpu)
+{
+	switch (action & ~CPU_TASKS_FROZEN) {
+	case CPU_STARTING:
+		tmigr_cpu_online();
+		break;
+	case CPU_DYING:
+		tmigr_cpu_offline();
+		break;
+	default:
+		break;
+	}
+
+	return NOTIFY_OK;
+}
+
+/*
+ * Return a group of @level for @node with room for another child, or
+ * allocate a new one and add it to @groups.
+ */
+static struct tmigr_group * __init
+tmigr_get_group(struct tmigr_group **groups, unsigned int *nr,
+		unsigned int level, int node)
+{
+	struct tmigr_group *group;
+	unsigned int i;
+
+	for (i = 0; i < *nr; i++) {
+		group = groups[i];
+		if (group->numa_node == node &&
+		    group->num_children < TMIGR_CHILDREN_PER_GROUP)
+			return group;
+	}
+
+	group = kzalloc_node(sizeof(*group), GFP_KERNEL, node);
+	if (!group)
+		return NULL;
+
+	raw_spin_lock_init(&group->lock);
+	group->level = level;
+	group->numa_node = node;
+	group->migrator = TMIGR_NONE;
+	group->next_expiry = KTIME_MAX;
+	for (i = 0; i < TMIGR_CHILDREN_PER_GROUP; i++)
+		group->child_expiry[i] = KTIME_MAX;
+
+	groups[(*nr)++] = group;
+	return group;
+}
+
+/* Does any node have more than one of the @nr @groups? */
+static bool __init tmigr_split_nodes(struct tmigr_group **groups,
+				     unsigned int nr)
+{
+	unsigned int i, j;
+
+	for (i = 0; i < nr; i++) {
+		for (j = i + 1; j < nr; j++) {
+			if (groups[i]->numa_node == groups[j]->numa_node)
+				return true;
+		}
+	}
+	return false;
+}
+
+static int __init tmigr_build_hierarchy(void)
+{
+	struct tmigr_group **groups, **parents, **tmp, *group;
+	unsigned int nr = 0, nr_parents, level = 0, i;
+	int cpu, node, ret = -ENOMEM;
+
+	groups = kcalloc(nr_cpu_ids, sizeof(*groups), GFP_KERNEL);
+	parents = kcalloc(nr_cpu_ids, sizeof(*parents), GFP_KERNEL);
+	if (!groups || !parents)
+		goto out;
+
+	for_each_possible_cpu(cpu) {
+		struct tmigr_cpu *tmc = per_cpu_ptr(&tmigr_cpu, cpu);
+
+		group = tmigr_get_group(groups, &nr, 0, cpu_to_node(cpu));
+		if (!group)
+			goto out;
+		tmc->tmgroup = group;
+		tmc->childidx = group->num_children;
+		group->child[group->num_children++].cpu = cpu;
+	}
+
+	/*
+	 * Group the groups of a level until only the top level one is left.
+	 * Nodes are kept apart until each of them is down to a single group.
+	 */
+	while (nr > 1) {
+		bool split = tmigr_split_nodes(groups, nr);
+
+		level++;
+		nr_parents = 0;
+		for (i = 0; i < nr; i++) {
+			group = groups[i];
+			node = split ? group->numa_node : NUMA_NO_NODE;
+			group->parent = tmigr_get_group(parents, &nr_parents,
+							level, node);
+			if (!group->parent)
+				goto out;
+			group->childidx = group->parent->num_children;
+			group->parent->child[group->childidx].group = group;
+			group->parent->num_children++;
+		}
+
+		tmp = groups;
+		groups = parents;
+		parents = tmp;
+		nr = nr_parents;
+	}
+
+	tmigr_root = groups[0];
+	ret = 0;
+	pr_info("Timer migration: %u hierarchy levels\n", level + 1);
+out:
+	/*
+	 * Groups allocated before a failure stay around, but without a top
+	 * level group no CPU goes online in the hierarchy and each of them
+	 * keeps handling its global timers itself.
+	 */
+	kfree(groups);
+	kfree(parents);
+	return ret;
+}
+
+static int __init tmigr_init(void)
+{
+	int ret;
+
+	ret = tmigr_build_hierarchy();
+	if (ret) {
+		pr_warn("Timer migration: hierarchy setup failed\n");
+		return ret;
+	}
+
+	local_irq_disable();
+	tmigr_cpu_online();
+	local_irq_enable();
+
+	cpu_notifier(tmigr_cpu_notify, 0);
+	return 0;
+}
+early_initcall(tmigr_init);
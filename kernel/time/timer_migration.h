@@ -0,0 +1,68 @@
+#ifndef _KERNEL_TIME_TIMER_MIGRATION_H
+#define _KERNEL_TIME_TIMER_MIGRATION_H
+
+/* Number of children (CPUs or groups) per group of the hierarchy */
+#define TMIGR_CHILDREN_PER_GROUP	8
+
+/* No active child left to act as migrator */
+#define TMIGR_NONE			(-1)
+
+/**
+ * struct tmigr_group - a group of the timer migration hierarchy
+ * @lock:		protects all fields below
+ * @parent:		the parent group, NULL for the top level group
+ * @childidx:		index of this group in @parent
+ * @level:		level in the hierarchy, CPUs are grouped on level 0
+ * @numa_node:		node of all CPUs below, NUMA_NO_NODE if mixed
+ * @num_children:	number of valid entries in @child
+ * @active:		bitmask of the active children
+ * @migrator:		the active child that expires the events of the
+ *			idle children, TMIGR_NONE if the group is idle
+ * @next_expiry:	first of @child_expiry, KTIME_MAX if none
+ * @child_expiry:	first global event of each idle child, KTIME_MAX
+ *			for active children or idle ones without events
+ * @child:		the CPUs (level 0) or groups below
+ *
+ * A group is active as long as one of its children is. Only when its
+ * last child goes idle, the group reports its first event to its parent,
+ * where the events of all idle children are looked after by the active
+ * migrator. When the top level group goes idle, the last CPU going idle
+ * has to wake up for the first event of the whole hierarchy.
+ */
+struct tmigr_group {
+	raw_spinlock_t		lock;
+	struct tmigr_group	*parent;
+	unsigned int		childidx;
+	unsigned int		level;
+	int			numa_node;
+	unsigned int		num_children;
+	unsigned int		active;
+	int			migrator;
+	u64			next_expiry;
+	u64			child_expiry[TMIGR_CHILDREN_PER_GROUP];
+	union {
+		struct tmigr_group	*group;
+		unsigned int		cpu;
+	} child[TMIGR_CHILDREN_PER_GROUP];
+};
+
+/**
+ * struct tmigr_cpu - per CPU state of the timer migration hierarchy
+ * @online:	the CPU takes part in the hierarchy
+ * @idle:	the CPU went idle and handed its global timers over
+ * @wakeup:	first event of the hierarchy this idle CPU has to expire,
+ *		KTIME_MAX if none
+ * @tmgroup:	the level 0 group of the CPU
+ * @childidx:	index of the CPU in @tmgroup
+ *
+ * All fields but @online are only touched by the CPU itself.
+ */
+struct tmigr_cpu {
+	bool			online;
+	bool			idle;
+	u64			wakeup;
+	struct tmigr_group	*tmgroup;
+	unsigned int		childidx;
+};
+
+#endif
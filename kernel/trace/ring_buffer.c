@@ -6,6 +6,7 @@
 #include <linux/trace_events.h>
 #include <linux/ring_buffer.h>
 #include <linux/trace_clock.h>
+#include <linux/trace_mmap.h>
 #include <linux/trace_seq.h>
 #include <linux/spinlock.h>
 #include <linux/irq_work.h>
@@ -22,7 +23,9 @@
 #include <linux/hash.h>
 #include <linux/list.h>
 #include <linux/cpu.h>
+#include <linux/mm.h>
 
+#include <asm/cacheflush.h>
 #include <asm/local.h>
 
 static void update_pages_handler(struct work_struct *work);
@@ -300,6 +303,7 @@ struct buffer_page {
 	unsigned	 read;		/* index for next read */
 	local_t		 entries;	/* entries on this page */
 	unsigned long	 real_end;	/* real end of data */
+	unsigned	 id;		/* ID in a user mapping */
 	struct buffer_data_page *page;	/* Actual data page */
 };
 
@@ -464,6 +468,11 @@ struct ring_buffer_per_cpu {
 	struct completion		update_done;
 
 	struct rb_irq_work		irq_work;
+
+	/* user mappings of the pages, see ring_buffer_map() */
+	unsigned int			mapped;
+	unsigned long			*subbuf_ids;	/* ID to data page */
+	struct trace_buffer_meta	*meta_page;
 };
 
 struct ring_buffer {
@@ -1637,6 +1646,21 @@ static void update_pages_handler(struct work_struct *work)
 	complete(&cpu_buffer->update_done);
 }
 
+/* Mapped pages are handed out to userspace by ID and must stay put */
+static bool rb_buffer_mapped(struct ring_buffer *buffer, int cpu_id)
+{
+	int cpu;
+
+	if (cpu_id != RING_BUFFER_ALL_CPUS)
+		return buffer->buffers[cpu_id]->mapped;
+
+	for_each_buffer_cpu(buffer, cpu) {
+		if (buffer->buffers[cpu]->mapped)
+			return true;
+	}
+	return false;
+}
+
 /**
  * ring_buffer_resize - resize the ring buffer
  * @buffer: the buffer to resize.
@@ -1685,6 +1709,11 @@ int ring_buffer_resize(struct ring_buffer *buffer, unsigned long size,
 	/* prevent another thread from changing buffer sizes */
 	mutex_lock(&buffer->mutex);
 
+	if (rb_buffer_mapped(buffer, cpu_id)) {
+		mutex_unlock(&buffer->mutex);
+		return -EBUSY;
+	}
+
 	if (cpu_id == RING_BUFFER_ALL_CPUS) {
 		/* calculate the pages to update */
 		for_each_buffer_cpu(buffer, cpu) {
@@ -4171,6 +4200,27 @@ unsigned long ring_buffer_size(struct ring_buffer *buffer, int cpu)
 }
 EXPORT_SYMBOL_GPL(ring_buffer_size);
 
+/*
+ * Publish the reader page and the bytes on it that were handed out, @read
+ * to @commit, to a mapped buffer. Called with the reader_lock held.
+ */
+static void rb_update_meta_page(struct ring_buffer_per_cpu *cpu_buffer,
+				unsigned int read, unsigned int commit)
+{
+	struct trace_buffer_meta *meta = cpu_buffer->meta_page;
+
+	meta->reader.lost_events = cpu_buffer->lost_events;
+	meta->reader.id = cpu_buffer->reader_page->id;
+	meta->reader.read = read;
+	meta->reader.commit = commit;
+
+	meta->entries = local_read(&cpu_buffer->entries);
+	meta->overrun = local_read(&cpu_buffer->overrun);
+	meta->read = cpu_buffer->read;
+
+	flush_dcache_page(virt_to_page(meta));
+}
+
 static void
 rb_reset_cpu(struct ring_buffer_per_cpu *cpu_buffer)
 {
@@ -4210,6 +4260,9 @@ rb_reset_cpu(struct ring_buffer_per_cpu *cpu_buffer)
 	cpu_buffer->lost_events = 0;
 	cpu_buffer->last_overrun = 0;
 
+	if (cpu_buffer->mapped)
+		rb_update_meta_page(cpu_buffer, 0, 0);
+
 	rb_head_page_activate(cpu_buffer);
 }
 
@@ -4348,6 +4401,10 @@ int ring_buffer_swap_cpu(struct ring_buffer *buffer_a,
 	if (cpu_buffer_a->nr_pages != cpu_buffer_b->nr_pages)
 		goto out;
 
+	ret = -EBUSY;
+	if (cpu_buffer_a->mapped || cpu_buffer_b->mapped)
+		goto out;
+
 	ret = -EAGAIN;
 
 	if (atomic_read(&buffer_a->record_disabled))
@@ -4524,12 +4581,14 @@ int ring_buffer_read_page(struct ring_buffer *buffer,
 	/*
 	 * If this page has been partially read or
 	 * if len is not big enough to read the rest of the page or
-	 * a writer is still on the page, then
+	 * a writer is still on the page or
+	 * the pages are mapped to userspace, then
 	 * we must copy the data from the page to the buffer.
 	 * Otherwise, we can simply swap the page with the one passed in.
 	 */
 	if (read || (len < (commit - read)) ||
-	    cpu_buffer->reader_page == cpu_buffer->commit_page) {
+	    cpu_buffer->reader_page == cpu_buffer->commit_page ||
+	    cpu_buffer->mapped) {
 		struct buffer_data_page *rpage = cpu_buffer->reader_page->page;
 		unsigned int rpos = read;
 		unsigned int pos = 0;
@@ -4638,6 +4697,262 @@ int ring_buffer_read_page(struct ring_buffer *buffer,
 }
 EXPORT_SYMBOL_GPL(ring_buffer_read_page);
 
+/* Number the reader page 0 and the rest in ring order, from ->pages */
+static void rb_setup_ids(struct ring_buffer_per_cpu *cpu_buffer,
+			 unsigned long *subbuf_ids)
+{
+	struct buffer_page *bpage;
+	unsigned int id = 0;
+	unsigned int i;
+
+	bpage = cpu_buffer->reader_page;
+	bpage->id = id;
+	subbuf_ids[id++] = (unsigned long)bpage->page;
+
+	bpage = list_entry(cpu_buffer->pages, struct buffer_page, list);
+	for (i = 0; i < cpu_buffer->nr_pages; i++) {
+		bpage->id = id;
+		subbuf_ids[id++] = (unsigned long)bpage->page;
+		rb_inc_page(cpu_buffer, &bpage);
+	}
+}
+
+static int rb_map_pages(struct ring_buffer_per_cpu *cpu_buffer,
+			struct vm_area_struct *vma)
+{
+	unsigned long nr_pages = vma_pages(vma);
+	unsigned long addr = vma->vm_start;
+	struct page *page;
+	unsigned long i;
+	int err;
+
+	/* The meta page, then one page per sub-buffer */
+	if (vma->vm_pgoff || nr_pages > cpu_buffer->nr_pages + 2)
+		return -EINVAL;
+
+	vma->vm_flags &= ~(VM_MAYWRITE | VM_MAYEXEC);
+	vma->vm_flags |= VM_DONTCOPY | VM_DONTEXPAND | VM_DONTDUMP;
+
+	for (i = 0; i < nr_pages; i++, addr += PAGE_SIZE) {
+		if (!i)
+			page = virt_to_page(cpu_buffer->meta_page);
+		else
+			page = virt_to_page((void *)cpu_buffer->subbuf_ids[i - 1]);
+
+		err = vm_insert_page(vma, addr, page);
+		if (err)
+			return err;
+	}
+
+	return 0;
+}
+
+static void rb_unmap(struct ring_buffer_per_cpu *cpu_buffer)
+{
+	struct trace_buffer_meta *meta = NULL;
+	unsigned long *subbuf_ids = NULL;
+	unsigned long flags;
+
+	raw_spin_lock_irqsave(&cpu_buffer->reader_lock, flags);
+	if (!--cpu_buffer->mapped) {
+		meta = cpu_buffer->meta_page;
+		subbuf_ids = cpu_buffer->subbuf_ids;
+		cpu_buffer->meta_page = NULL;
+		cpu_buffer->subbuf_ids = NULL;
+	}
+	raw_spin_unlock_irqrestore(&cpu_buffer->reader_lock, flags);
+
+	free_page((unsigned long)meta);
+	kfree(subbuf_ids);
+}
+
+/**
+ * ring_buffer_map - map a per cpu buffer into a user address space
+ * @buffer: the ring buffer
+ * @cpu: the cpu buffer to map
+ * @vma: the read-only shared mapping to fill
+ *
+ * Maps a struct trace_buffer_meta page followed by every page of the
+ * cpu buffer, reader page included, in ID order. The consumer reads events
+ * in place and gets the next reader page with ring_buffer_map_get_reader().
+ *
+ * While the buffer is mapped it can not be resized or swapped, and
+ * ring_buffer_read_page() copies instead of taking pages out of it.
+ *
+ * Returns 0 on success, or a negative errno. Each successful call must be
+ * balanced by ring_buffer_unmap().
+ */
+int ring_buffer_map(struct ring_buffer *buffer, int cpu,
+		    struct vm_area_struct *vma)
+{
+	struct ring_buffer_per_cpu *cpu_buffer;
+	struct trace_buffer_meta *meta;
+	unsigned long *subbuf_ids;
+	unsigned long flags;
+	unsigned int read;
+	int err = 0;
+
+	if (!cpumask_test_cpu(cpu, buffer->cpumask))
+		return -EINVAL;
+
+	if (vma->vm_flags & (VM_WRITE | VM_EXEC))
+		return -EPERM;
+
+	cpu_buffer = buffer->buffers[cpu];
+
+	mutex_lock(&buffer->mutex);
+
+	if (cpu_buffer->mapped) {
+		raw_spin_lock_irqsave(&cpu_buffer->reader_lock, flags);
+		cpu_buffer->mapped++;
+		raw_spin_unlock_irqrestore(&cpu_buffer->reader_lock, flags);
+		goto map;
+	}
+
+	meta = (void *)get_zeroed_page(GFP_KERNEL);
+	if (!meta) {
+		err = -ENOMEM;
+		goto out;
+	}
+
+	subbuf_ids = kcalloc(cpu_buffer->nr_pages + 1, sizeof(*subbuf_ids),
+			     GFP_KERNEL);
+	if (!subbuf_ids) {
+		free_page((unsigned long)meta);
+		err = -ENOMEM;
+		goto out;
+	}
+
+	meta->meta_page_size = PAGE_SIZE;
+	meta->meta_struct_len = sizeof(*meta);
+	meta->subbuf_size = PAGE_SIZE;
+	meta->nr_subbufs = cpu_buffer->nr_pages + 1;
+
+	raw_spin_lock_irqsave(&cpu_buffer->reader_lock, flags);
+	rb_setup_ids(cpu_buffer, subbuf_ids);
+	cpu_buffer->subbuf_ids = subbuf_ids;
+	cpu_buffer->meta_page = meta;
+	cpu_buffer->mapped = 1;
+	/* Nothing handed out yet */
+	read = cpu_buffer->reader_page->read;
+	rb_update_meta_page(cpu_buffer, read, read);
+	raw_spin_unlock_irqrestore(&cpu_buffer->reader_lock, flags);
+
+ map:
+	err = rb_map_pages(cpu_buffer, vma);
+	if (err)
+		rb_unmap(cpu_buffer);
+ out:
+	mutex_unlock(&buffer->mutex);
+	return err;
+}
+EXPORT_SYMBOL_GPL(ring_buffer_map);
+
+/**
+ * ring_buffer_map_dup - account for a copy of a mapping
+ * @buffer: the ring buffer
+ * @cpu: the mapped cpu buffer
+ *
+ * Called when a VMA set up by ring_buffer_map() is split or moved, as the
+ * copy will be unmapped on its own.
+ */
+void ring_buffer_map_dup(struct ring_buffer *buffer, int cpu)
+{
+	struct ring_buffer_per_cpu *cpu_buffer = buffer->buffers[cpu];
+	unsigned long flags;
+
+	raw_spin_lock_irqsave(&cpu_buffer->reader_lock, flags);
+	if (!WARN_ON_ONCE(!cpu_buffer->mapped))
+		cpu_buffer->mapped++;
+	raw_spin_unlock_irqrestore(&cpu_buffer->reader_lock, flags);
+}
+EXPORT_SYMBOL_GPL(ring_buffer_map_dup);
+
+/**
+ * ring_buffer_unmap - drop a mapping made by ring_buffer_map()
+ * @buffer: the ring buffer
+ * @cpu: the mapped cpu buffer
+ *
+ * The meta page is freed with the last mapping, the pages themselves
+ * only once the user page tables let go of them.
+ */
+int ring_buffer_unmap(struct ring_buffer *buffer, int cpu)
+{
+	struct ring_buffer_per_cpu *cpu_buffer;
+	int err = 0;
+
+	if (!cpumask_test_cpu(cpu, buffer->cpumask))
+		return -EINVAL;
+
+	cpu_buffer = buffer->buffers[cpu];
+
+	mutex_lock(&buffer->mutex);
+	if (cpu_buffer->mapped)
+		rb_unmap(cpu_buffer);
+	else
+		err = -ENODEV;
+	mutex_unlock(&buffer->mutex);
+
+	return err;
+}
+EXPORT_SYMBOL_GPL(ring_buffer_unmap);
+
+/**
+ * ring_buffer_map_get_reader - hand the next events to a mapped consumer
+ * @buffer: the ring buffer
+ * @cpu: the mapped cpu buffer
+ *
+ * Everything handed out before is consumed. If that empties the reader
+ * page, the oldest written page is swapped in as the new reader page.
+ * The unread events on the reader page are then consumed on behalf of the
+ * user, and the meta page tells where they are: reader.id, and the
+ * reader.read to reader.commit range of its data. An empty range means
+ * there is nothing to read right now.
+ *
+ * Returns 0 on success, -ENODEV if the buffer is not mapped.
+ */
+int ring_buffer_map_get_reader(struct ring_buffer *buffer, int cpu)
+{
+	struct ring_buffer_per_cpu *cpu_buffer;
+	struct buffer_page *reader;
+	unsigned int read, commit;
+	unsigned long flags;
+	int ret = 0;
+
+	if (!cpumask_test_cpu(cpu, buffer->cpumask))
+		return -EINVAL;
+
+	cpu_buffer = buffer->buffers[cpu];
+
+	raw_spin_lock_irqsave(&cpu_buffer->reader_lock, flags);
+
+	if (!cpu_buffer->mapped) {
+		ret = -ENODEV;
+		goto out;
+	}
+
+	reader = rb_get_reader_page(cpu_buffer);
+	if (!reader) {
+		read = commit = cpu_buffer->reader_page->read;
+	} else {
+		/* The writer may still be adding to the page, stop here */
+		read = reader->read;
+		commit = rb_page_size(reader);
+		while (reader->read < commit)
+			rb_advance_reader(cpu_buffer);
+	}
+
+	rb_update_meta_page(cpu_buffer, read, commit);
+	cpu_buffer->lost_events = 0;
+
+	flush_dcache_page(virt_to_page(cpu_buffer->reader_page->page));
+ out:
+	raw_spin_unlock_irqrestore(&cpu_buffer->reader_lock, flags);
+
+	return ret;
+}
+EXPORT_SYMBOL_GPL(ring_buffer_map_get_reader);
+
 #ifdef CONFIG_HOTPLUG_CPU
 static int rb_cpu_notify(struct notifier_block *self,
 			 unsigned long action, void *hcpu)
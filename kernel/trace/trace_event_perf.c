@@ -297,6 +297,41 @@ void *perf_trace_buf_prepare(int size, unsigned short type,
 EXPORT_SYMBOL_GPL(perf_trace_buf_prepare);
 NOKPROBE_SYMBOL(perf_trace_buf_prepare);
 
+/*
+ * Run the bpf program attached to a tracepoint on the record, then hand
+ * the record to the perf events of the tracepoint.  The program sees the
+ * pt_regs pointer in place of the common fields at the start of the
+ * record, and its return value decides whether the perf events get the
+ * record at all.
+ */
+void perf_trace_run_bpf_submit(void *raw_data, int size, int rctx,
+			       struct trace_event_call *call, u64 addr,
+			       u64 count, struct pt_regs *regs,
+			       struct hlist_head *head,
+			       struct task_struct *task)
+{
+	struct bpf_prog *prog = call->prog;
+
+	if (prog) {
+		unsigned long common = *(unsigned long *)raw_data;
+		unsigned int ret;
+
+		BUILD_BUG_ON(sizeof(struct trace_entry) < sizeof(regs));
+
+		*(struct pt_regs **)raw_data = regs;
+		ret = trace_call_bpf(prog, raw_data);
+		*(unsigned long *)raw_data = common;
+
+		if (!ret || hlist_empty(head)) {
+			perf_swevent_put_recursion_context(rctx);
+			return;
+		}
+	}
+	perf_tp_event(addr, count, raw_data, size, regs, head, rctx, task);
+}
+EXPORT_SYMBOL_GPL(perf_trace_run_bpf_submit);
+NOKPROBE_SYMBOL(perf_trace_run_bpf_submit);
+
 #ifdef CONFIG_FUNCTION_TRACER
 static void
 perf_ftrace_function_call(unsigned long ip, unsigned long parent_ip,
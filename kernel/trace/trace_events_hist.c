@@ -0,0 +1,1231 @@
+/*
+ * trace_events_hist - trace event hist triggers
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * A hist trigger aggregates event fields in the kernel instead of
+ * writing every event out: each hit looks up its key in a tracing_map
+ * and adds its values to the sums kept there.  The result is read,
+ * sorted, from the event's 'hist' file.
+ *
+ *   hist:keys=<field1[,field2]>[:vals=<field1[,field2]>]
+ *       [:sort=<field1[,field2]>][:size=#entries]
+ *       [:pause][:continue][:clear] [if <filter>]
+ *
+ * Keys are event fields, possibly strings, or 'stacktrace' for the
+ * kernel stack at the time of the event.  Numeric keys can be shown
+ * as .hex, .sym or .sym-offset.  Values are numeric fields, summed per
+ * key; the number of hits per key, 'hitcount', is always kept.  The
+ * sort keys default to hitcount and take .ascending or .descending.
+ * pause, continue and clear act on the hist trigger already set on
+ * the event.
+ */
+
+#include <linux/module.h>
+#include <linux/kallsyms.h>
+#include <linux/mutex.h>
+#include <linux/slab.h>
+#include <linux/stacktrace.h>
+
+#include "tracing_map.h"
+#include "trace.h"
+
+struct hist_field;
+
+typedef u64 (*hist_field_fn_t) (struct hist_field *field, void *event);
+
+struct hist_field {
+	struct ftrace_event_field	*field;
+	unsigned long			flags;
+	hist_field_fn_t			fn;
+	unsigned int			size;
+	unsigned int			offset;
+	unsigned int			max_len;
+};
+
+static u64 hist_field_none(struct hist_field *field, void *event)
+{
+	return 0;
+}
+
+static u64 hist_field_counter(struct hist_field *field, void *event)
+{
+	return 1;
+}
+
+static u64 hist_field_string(struct hist_field *hist_field, void *event)
+{
+	char *addr = (char *)(event + hist_field->field->offset);
+
+	return (u64)(unsigned long)addr;
+}
+
+static u64 hist_field_dynstring(struct hist_field *hist_field, void *event)
+{
+	u32 str_item = *(u32 *)(event + hist_field->field->offset);
+	int str_loc = str_item & 0xffff;
+	char *addr = (char *)(event + str_loc);
+
+	return (u64)(unsigned long)addr;
+}
+
+static u64 hist_field_pstring(struct hist_field *hist_field, void *event)
+{
+	char **addr = (char **)(event + hist_field->field->offset);
+
+	return (u64)(unsigned long)*addr;
+}
+
+static u64 hist_field_comm(struct hist_field *hist_field, void *event)
+{
+	return (u64)(unsigned long)current->comm;
+}
+
+static u64 hist_field_cpu(struct hist_field *hist_field, void *event)
+{
+	return raw_smp_processor_id();
+}
+
+#define DEFINE_HIST_FIELD_FN(type)					\
+static u64 hist_field_##type(struct hist_field *hist_field, void *event)\
+{									\
+	type *addr = (type *)(event + hist_field->field->offset);	\
+									\
+	return (u64)*addr;						\
+}
+
+DEFINE_HIST_FIELD_FN(s64);
+DEFINE_HIST_FIELD_FN(u64);
+DEFINE_HIST_FIELD_FN(s32);
+DEFINE_HIST_FIELD_FN(u32);
+DEFINE_HIST_FIELD_FN(s16);
+DEFINE_HIST_FIELD_FN(u16);
+DEFINE_HIST_FIELD_FN(s8);
+DEFINE_HIST_FIELD_FN(u8);
+
+#define for_each_hist_field(i, hist_data)	\
+	for ((i) = 0; (i) < (hist_data)->n_fields; (i)++)
+
+#define for_each_hist_val_field(i, hist_data)	\
+	for ((i) = 0; (i) < (hist_data)->n_vals; (i)++)
+
+#define for_each_hist_key_field(i, hist_data)	\
+	for ((i) = (hist_data)->n_vals; (i) < (hist_data)->n_fields; (i)++)
+
+#define HIST_STACKTRACE_DEPTH	16
+#define HIST_STACKTRACE_SIZE	(HIST_STACKTRACE_DEPTH * sizeof(unsigned long))
+/*
+ * Skip 5:
+ *   save_stack_trace()
+ *   event_hist_trigger()
+ *   event_triggers_call()
+ *   event_trigger_unlock_commit()
+ *   trace_event_raw_event_xxx()
+ */
+#define HIST_STACKTRACE_SKIP	5
+
+#define HITCOUNT_IDX		0
+#define HIST_KEY_SIZE_MAX	(MAX_FILTER_STR_VAL + HIST_STACKTRACE_SIZE)
+
+enum hist_field_flags {
+	HIST_FIELD_FL_HITCOUNT		= 1,
+	HIST_FIELD_FL_KEY		= 2,
+	HIST_FIELD_FL_STRING		= 4,
+	HIST_FIELD_FL_HEX		= 8,
+	HIST_FIELD_FL_SYM		= 16,
+	HIST_FIELD_FL_SYM_OFFSET	= 32,
+	HIST_FIELD_FL_STACKTRACE	= 64,
+};
+
+struct hist_trigger_attrs {
+	char		*keys_str;
+	char		*vals_str;
+	char		*sort_key_str;
+	bool		pause;
+	bool		cont;
+	bool		clear;
+	unsigned int	map_bits;
+};
+
+/*
+ * The fields are laid out as the tracing_map's: the values, hitcount
+ * first, followed by the keys.  The same index names a field in both.
+ */
+struct hist_trigger_data {
+	struct hist_field		*fields[TRACING_MAP_FIELDS_MAX];
+	unsigned int			n_vals;
+	unsigned int			n_keys;
+	unsigned int			n_fields;
+	unsigned int			key_size;
+	struct tracing_map_sort_key	sort_keys[TRACING_MAP_SORT_KEYS_MAX];
+	unsigned int			n_sort_keys;
+	struct trace_event_file		*event_file;
+	struct hist_trigger_attrs	*attrs;
+	struct tracing_map		*map;
+};
+
+static hist_field_fn_t select_value_fn(int field_size, int field_is_signed)
+{
+	hist_field_fn_t fn = NULL;
+
+	switch (field_size) {
+	case 8:
+		fn = field_is_signed ? hist_field_s64 : hist_field_u64;
+		break;
+	case 4:
+		fn = field_is_signed ? hist_field_s32 : hist_field_u32;
+		break;
+	case 2:
+		fn = field_is_signed ? hist_field_s16 : hist_field_u16;
+		break;
+	case 1:
+		fn = field_is_signed ? hist_field_s8 : hist_field_u8;
+		break;
+	}
+
+	return fn;
+}
+
+static bool is_string_field(struct ftrace_event_field *field)
+{
+	return field->filter_type == FILTER_STATIC_STRING ||
+	       field->filter_type == FILTER_DYN_STRING ||
+	       field->filter_type == FILTER_PTR_STRING ||
+	       field->filter_type == FILTER_COMM;
+}
+
+static const char *hist_field_name(struct hist_field *hist_field)
+{
+	if (hist_field->flags & HIST_FIELD_FL_HITCOUNT)
+		return "hitcount";
+	if (hist_field->flags & HIST_FIELD_FL_STACKTRACE)
+		return "stacktrace";
+
+	return hist_field->field->name;
+}
+
+static int parse_map_size(char *str)
+{
+	unsigned long size, map_bits;
+	int ret;
+
+	strsep(&str, "=");
+	if (!str)
+		return -EINVAL;
+
+	ret = kstrtoul(str, 0, &size);
+	if (ret)
+		return ret;
+
+	map_bits = ilog2(roundup_pow_of_two(size));
+	if (map_bits < TRACING_MAP_BITS_MIN ||
+	    map_bits > TRACING_MAP_BITS_MAX)
+		return -EINVAL;
+
+	return map_bits;
+}
+
+static void destroy_hist_trigger_attrs(struct hist_trigger_attrs *attrs)
+{
+	if (!attrs)
+		return;
+
+	kfree(attrs->sort_key_str);
+	kfree(attrs->keys_str);
+	kfree(attrs->vals_str);
+	kfree(attrs);
+}
+
+static int parse_hist_trigger_attr(struct hist_trigger_attrs *attrs, char *str)
+{
+	char **attr_str = NULL;
+
+	if ((strncmp(str, "key=", strlen("key=")) == 0) ||
+	    (strncmp(str, "keys=", strlen("keys=")) == 0))
+		attr_str = &attrs->keys_str;
+	else if ((strncmp(str, "val=", strlen("val=")) == 0) ||
+		 (strncmp(str, "vals=", strlen("vals=")) == 0) ||
+		 (strncmp(str, "values=", strlen("values=")) == 0))
+		attr_str = &attrs->vals_str;
+	else if (strncmp(str, "sort=", strlen("sort=")) == 0)
+		attr_str = &attrs->sort_key_str;
+	else if (strcmp(str, "pause") == 0)
+		attrs->pause = true;
+	else if ((strcmp(str, "cont") == 0) ||
+		 (strcmp(str, "continue") == 0))
+		attrs->cont = true;
+	else if (strcmp(str, "clear") == 0)
+		attrs->clear = true;
+	else if (strncmp(str, "size=", strlen("size=")) == 0) {
+		int map_bits = parse_map_size(str);
+
+		if (map_bits < 0)
+			return map_bits;
+		attrs->map_bits = map_bits;
+	} else
+		return -EINVAL;
+
+	if (attr_str) {
+		if (*attr_str)
+			return -EINVAL;
+		*attr_str = kstrdup(str, GFP_KERNEL);
+		if (!*attr_str)
+			return -ENOMEM;
+	}
+
+	return 0;
+}
+
+static struct hist_trigger_attrs *parse_hist_trigger_attrs(char *trigger_str)
+{
+	struct hist_trigger_attrs *attrs;
+	int ret = 0;
+
+	attrs = kzalloc(sizeof(*attrs), GFP_KERNEL);
+	if (!attrs)
+		return ERR_PTR(-ENOMEM);
+
+	while (trigger_str) {
+		char *str = strsep(&trigger_str, ":");
+
+		ret = parse_hist_trigger_attr(attrs, str);
+		if (ret)
+			goto free;
+	}
+
+	if (!attrs->keys_str) {
+		ret = -EINVAL;
+		goto free;
+	}
+
+	return attrs;
+ free:
+	destroy_hist_trigger_attrs(attrs);
+
+	return ERR_PTR(ret);
+}
+
+static void destroy_hist_field(struct hist_field *hist_field)
+{
+	kfree(hist_field);
+}
+
+static struct hist_field *create_hist_field(struct ftrace_event_field *field,
+					    unsigned long flags)
+{
+	struct hist_field *hist_field;
+
+	hist_field = kzalloc(sizeof(*hist_field), GFP_KERNEL);
+	if (!hist_field)
+		return NULL;
+
+	if (flags & HIST_FIELD_FL_HITCOUNT) {
+		hist_field->fn = hist_field_counter;
+		goto out;
+	}
+
+	if (flags & HIST_FIELD_FL_STACKTRACE) {
+		hist_field->fn = hist_field_none;
+		goto out;
+	}
+
+	if (is_string_field(field)) {
+		flags |= HIST_FIELD_FL_STRING;
+
+		switch (field->filter_type) {
+		case FILTER_STATIC_STRING:
+			hist_field->fn = hist_field_string;
+			hist_field->max_len = field->size;
+			break;
+		case FILTER_DYN_STRING:
+			hist_field->fn = hist_field_dynstring;
+			hist_field->max_len = MAX_FILTER_STR_VAL - 1;
+			break;
+		case FILTER_COMM:
+			hist_field->fn = hist_field_comm;
+			hist_field->max_len = TASK_COMM_LEN;
+			break;
+		default:
+			hist_field->fn = hist_field_pstring;
+			hist_field->max_len = MAX_FILTER_STR_VAL - 1;
+			break;
+		}
+	} else if (field->filter_type == FILTER_CPU) {
+		hist_field->fn = hist_field_cpu;
+	} else {
+		hist_field->fn = select_value_fn(field->size,
+						 field->is_signed);
+		if (!hist_field->fn) {
+			destroy_hist_field(hist_field);
+			return NULL;
+		}
+	}
+ out:
+	hist_field->field = field;
+	hist_field->flags = flags;
+
+	return hist_field;
+}
+
+static void destroy_hist_fields(struct hist_trigger_data *hist_data)
+{
+	unsigned int i;
+
+	for (i = 0; i < TRACING_MAP_FIELDS_MAX; i++) {
+		if (hist_data->fields[i]) {
+			destroy_hist_field(hist_data->fields[i]);
+			hist_data->fields[i] = NULL;
+		}
+	}
+}
+
+static int create_hitcount_val(struct hist_trigger_data *hist_data)
+{
+	hist_data->fields[HITCOUNT_IDX] =
+		create_hist_field(NULL, HIST_FIELD_FL_HITCOUNT);
+	if (!hist_data->fields[HITCOUNT_IDX])
+		return -ENOMEM;
+
+	hist_data->n_vals++;
+
+	return 0;
+}
+
+static int create_val_field(struct hist_trigger_data *hist_data,
+			    unsigned int val_idx,
+			    struct trace_event_file *file,
+			    char *field_str)
+{
+	struct ftrace_event_field *field;
+
+	if (WARN_ON(val_idx >= TRACING_MAP_VALS_MAX))
+		return -EINVAL;
+
+	field = trace_find_event_field(file->event_call, field_str);
+	if (!field || is_string_field(field))
+		return -EINVAL;
+
+	hist_data->fields[val_idx] = create_hist_field(field, 0);
+	if (!hist_data->fields[val_idx])
+		return -ENOMEM;
+
+	hist_data->n_vals++;
+
+	return 0;
+}
+
+static int create_val_fields(struct hist_trigger_data *hist_data,
+			     struct trace_event_file *file)
+{
+	char *fields_str, *field_str;
+	unsigned int j = HITCOUNT_IDX + 1;
+	int ret;
+
+	ret = create_hitcount_val(hist_data);
+	if (ret)
+		return ret;
+
+	fields_str = hist_data->attrs->vals_str;
+	if (!fields_str)
+		return 0;
+
+	strsep(&fields_str, "=");
+	if (!fields_str)
+		return -EINVAL;
+
+	while ((field_str = strsep(&fields_str, ","))) {
+		if (strcmp(field_str, "hitcount") == 0)
+			continue;
+
+		if (j == TRACING_MAP_VALS_MAX)
+			return -EINVAL;
+
+		ret = create_val_field(hist_data, j++, file, field_str);
+		if (ret)
+			return ret;
+	}
+
+	return 0;
+}
+
+/* Returns the size of the key in the compound key, or errno */
+static int create_key_field(struct hist_trigger_data *hist_data,
+			    unsigned int key_idx,
+			    unsigned int key_offset,
+			    struct trace_event_file *file,
+			    char *field_str)
+{
+	struct ftrace_event_field *field = NULL;
+	struct hist_field *hist_field;
+	unsigned long flags = HIST_FIELD_FL_KEY;
+	unsigned int key_size;
+
+	if (WARN_ON(key_idx >= TRACING_MAP_FIELDS_MAX))
+		return -EINVAL;
+
+	if (strcmp(field_str, "stacktrace") == 0) {
+		flags |= HIST_FIELD_FL_STACKTRACE;
+	} else {
+		char *field_name = strsep(&field_str, ".");
+
+		if (field_str) {
+			if (strcmp(field_str, "hex") == 0)
+				flags |= HIST_FIELD_FL_HEX;
+			else if (strcmp(field_str, "sym") == 0)
+				flags |= HIST_FIELD_FL_SYM;
+			else if (strcmp(field_str, "sym-offset") == 0)
+				flags |= HIST_FIELD_FL_SYM_OFFSET;
+			else
+				return -EINVAL;
+		}
+
+		field = trace_find_event_field(file->event_call, field_name);
+		if (!field)
+			return -EINVAL;
+
+		/* Modifiers only make sense for numbers */
+		if (field_str && is_string_field(field))
+			return -EINVAL;
+	}
+
+	hist_field = create_hist_field(field, flags);
+	if (!hist_field)
+		return -ENOMEM;
+	hist_data->fields[key_idx] = hist_field;
+
+	if (hist_field->flags & HIST_FIELD_FL_STACKTRACE)
+		key_size = HIST_STACKTRACE_SIZE;
+	else if (hist_field->flags & HIST_FIELD_FL_STRING)
+		key_size = hist_field->max_len + 1;	/* always terminated */
+	else
+		key_size = sizeof(u64);
+
+	key_size = ALIGN(key_size, sizeof(u64));
+	hist_field->size = key_size;
+	hist_field->offset = key_offset;
+
+	hist_data->key_size += key_size;
+	if (hist_data->key_size > HIST_KEY_SIZE_MAX)
+		return -EINVAL;
+
+	hist_data->n_keys++;
+
+	return key_size;
+}
+
+static int create_key_fields(struct hist_trigger_data *hist_data,
+			     struct trace_event_file *file)
+{
+	unsigned int i = hist_data->n_vals, key_offset = 0;
+	char *fields_str, *field_str;
+	int ret;
+
+	fields_str = hist_data->attrs->keys_str;
+	strsep(&fields_str, "=");
+	if (!fields_str)
+		return -EINVAL;
+
+	while ((field_str = strsep(&fields_str, ","))) {
+		if (hist_data->n_keys == TRACING_MAP_KEYS_MAX)
+			return -EINVAL;
+
+		ret = create_key_field(hist_data, i++, key_offset, file,
+				       field_str);
+		if (ret < 0)
+			return ret;
+		key_offset += ret;
+	}
+
+	return 0;
+}
+
+static int create_hist_fields(struct hist_trigger_data *hist_data,
+			      struct trace_event_file *file)
+{
+	int ret;
+
+	ret = create_val_fields(hist_data, file);
+	if (ret)
+		goto out;
+
+	ret = create_key_fields(hist_data, file);
+	if (ret)
+		goto out;
+
+	hist_data->n_fields = hist_data->n_vals + hist_data->n_keys;
+ out:
+	return ret;
+}
+
+static int is_descending(const char *str)
+{
+	if (!str)
+		return 0;
+
+	if (strcmp(str, "descending") == 0)
+		return 1;
+
+	if (strcmp(str, "ascending") == 0)
+		return 0;
+
+	return -EINVAL;
+}
+
+static int create_sort_keys(struct hist_trigger_data *hist_data)
+{
+	char *fields_str = hist_data->attrs->sort_key_str;
+	struct tracing_map_sort_key *sort_key;
+	unsigned int i, j;
+	int descending;
+
+	/* Sort by hitcount, ascending, unless told otherwise */
+	hist_data->n_sort_keys = 1;
+
+	if (!fields_str)
+		return 0;
+
+	strsep(&fields_str, "=");
+	if (!fields_str)
+		return -EINVAL;
+
+	for (i = 0; i < TRACING_MAP_SORT_KEYS_MAX; i++) {
+		char *field_str, *field_name;
+
+		field_str = strsep(&fields_str, ",");
+		if (!field_str)
+			break;
+
+		field_name = strsep(&field_str, ".");
+		if (!strlen(field_name))
+			return -EINVAL;
+
+		for (j = 0; j < hist_data->n_fields; j++) {
+			if (strcmp(field_name,
+				   hist_field_name(hist_data->fields[j])) == 0)
+				break;
+		}
+		if (j == hist_data->n_fields)
+			return -EINVAL;
+
+		descending = is_descending(field_str);
+		if (descending < 0)
+			return descending;
+
+		sort_key = &hist_data->sort_keys[i];
+		sort_key->field_idx = j;
+		sort_key->descending = descending;
+	}
+
+	if (!i || fields_str)
+		return -EINVAL;
+
+	hist_data->n_sort_keys = i;
+
+	return 0;
+}
+
+static int create_tracing_map_fields(struct hist_trigger_data *hist_data)
+{
+	struct tracing_map *map = hist_data->map;
+	struct ftrace_event_field *field;
+	struct hist_field *hist_field;
+	tracing_map_cmp_fn_t cmp_fn;
+	unsigned int i;
+	int idx;
+
+	for_each_hist_field(i, hist_data) {
+		hist_field = hist_data->fields[i];
+
+		if (hist_field->flags & HIST_FIELD_FL_KEY) {
+			field = hist_field->field;
+
+			if (hist_field->flags & HIST_FIELD_FL_STACKTRACE)
+				cmp_fn = tracing_map_cmp_none;
+			else if (hist_field->flags & HIST_FIELD_FL_STRING)
+				cmp_fn = tracing_map_cmp_string;
+			else
+				cmp_fn = tracing_map_cmp_num(sizeof(u64),
+							     field->is_signed);
+
+			idx = tracing_map_add_key_field(map,
+							hist_field->offset,
+							cmp_fn);
+		} else {
+			idx = tracing_map_add_sum_field(map);
+		}
+
+		if (idx < 0)
+			return idx;
+
+		/* The map must number its fields the way we do */
+		if (WARN_ON(idx != i))
+			return -EINVAL;
+	}
+
+	return 0;
+}
+
+static void destroy_hist_data(struct hist_trigger_data *hist_data)
+{
+	if (!hist_data)
+		return;
+
+	destroy_hist_trigger_attrs(hist_data->attrs);
+	destroy_hist_fields(hist_data);
+	tracing_map_destroy(hist_data->map);
+	kfree(hist_data);
+}
+
+static struct hist_trigger_data *
+create_hist_data(unsigned int map_bits,
+		 struct hist_trigger_attrs *attrs,
+		 struct trace_event_file *file)
+{
+	struct hist_trigger_data *hist_data;
+	int ret = 0;
+
+	hist_data = kzalloc(sizeof(*hist_data), GFP_KERNEL);
+	if (!hist_data)
+		return ERR_PTR(-ENOMEM);
+
+	hist_data->attrs = attrs;
+	hist_data->event_file = file;
+
+	ret = create_hist_fields(hist_data, file);
+	if (ret)
+		goto free;
+
+	ret = create_sort_keys(hist_data);
+	if (ret)
+		goto free;
+
+	hist_data->map = tracing_map_create(map_bits, hist_data->key_size);
+	if (IS_ERR(hist_data->map)) {
+		ret = PTR_ERR(hist_data->map);
+		hist_data->map = NULL;
+		goto free;
+	}
+
+	ret = create_tracing_map_fields(hist_data);
+	if (ret)
+		goto free;
+
+	ret = tracing_map_init(hist_data->map);
+	if (ret)
+		goto free;
+
+	return hist_data;
+ free:
+	/* The attrs still belong to the caller */
+	hist_data->attrs = NULL;
+	destroy_hist_data(hist_data);
+
+	return ERR_PTR(ret);
+}
+
+static void hist_trigger_elt_update(struct hist_trigger_data *hist_data,
+				    struct tracing_map_elt *elt,
+				    void *rec)
+{
+	struct hist_field *hist_field;
+	unsigned int i;
+	u64 hist_val;
+
+	for_each_hist_val_field(i, hist_data) {
+		hist_field = hist_data->fields[i];
+		hist_val = hist_field->fn(hist_field, rec);
+		tracing_map_update_sum(elt, i, hist_val);
+	}
+}
+
+static void event_hist_trigger(struct event_trigger_data *data, void *rec)
+{
+	struct hist_trigger_data *hist_data = data->private_data;
+	unsigned long entries[HIST_STACKTRACE_DEPTH];
+	char compound_key[HIST_KEY_SIZE_MAX];
+	struct stack_trace stacktrace;
+	struct hist_field *key_field;
+	struct tracing_map_elt *elt;
+	u64 field_contents;
+	char *str;
+	unsigned int i;
+
+	/* Only while the TRIGGER_COND bit is being set up */
+	if (unlikely(!rec))
+		return;
+
+	memset(compound_key, 0, hist_data->key_size);
+
+	for_each_hist_key_field(i, hist_data) {
+		key_field = hist_data->fields[i];
+
+		if (key_field->flags & HIST_FIELD_FL_STACKTRACE) {
+			stacktrace.max_entries = HIST_STACKTRACE_DEPTH;
+			stacktrace.entries = entries;
+			stacktrace.nr_entries = 0;
+			stacktrace.skip = HIST_STACKTRACE_SKIP;
+
+			memset(entries, 0, HIST_STACKTRACE_SIZE);
+			save_stack_trace(&stacktrace);
+
+			memcpy(compound_key + key_field->offset, entries,
+			       HIST_STACKTRACE_SIZE);
+			continue;
+		}
+
+		field_contents = key_field->fn(key_field, rec);
+		if (key_field->flags & HIST_FIELD_FL_STRING) {
+			str = (char *)(unsigned long)field_contents;
+			if (str)
+				strncpy(compound_key + key_field->offset, str,
+					key_field->max_len);
+		} else {
+			memcpy(compound_key + key_field->offset,
+			       &field_contents, sizeof(field_contents));
+		}
+	}
+
+	elt = tracing_map_insert(hist_data->map, compound_key);
+	if (elt)
+		hist_trigger_elt_update(hist_data, elt, rec);
+}
+
+static void hist_trigger_stacktrace_print(struct seq_file *m,
+					  unsigned long *stacktrace_entries,
+					  unsigned int max_entries)
+{
+	char str[KSYM_SYMBOL_LEN];
+	unsigned int spaces = 8;
+	unsigned int i;
+
+	for (i = 0; i < max_entries; i++) {
+		if (!stacktrace_entries[i] || stacktrace_entries[i] == ULONG_MAX)
+			return;
+
+		seq_printf(m, "%*c", 1 + spaces, ' ');
+		sprint_symbol(str, stacktrace_entries[i]);
+		seq_printf(m, "%s\n", str);
+	}
+}
+
+static void hist_trigger_entry_print(struct seq_file *m,
+				     struct hist_trigger_data *hist_data,
+				     void *key,
+				     struct tracing_map_elt *elt)
+{
+	struct hist_field *key_field;
+	char str[KSYM_SYMBOL_LEN];
+	bool multiline = false;
+	const char *name;
+	unsigned int i;
+	u64 uval;
+
+	seq_puts(m, "{ ");
+
+	for_each_hist_key_field(i, hist_data) {
+		key_field = hist_data->fields[i];
+		name = hist_field_name(key_field);
+		uval = *(u64 *)(key + key_field->offset);
+
+		if (i > hist_data->n_vals)
+			seq_puts(m, ", ");
+
+		if (key_field->flags & HIST_FIELD_FL_HEX) {
+			seq_printf(m, "%s: %llx", name, uval);
+		} else if (key_field->flags & HIST_FIELD_FL_SYM) {
+			sprint_symbol_no_offset(str, (unsigned long)uval);
+			seq_printf(m, "%s: [%llx] %-45s", name, uval, str);
+		} else if (key_field->flags & HIST_FIELD_FL_SYM_OFFSET) {
+			sprint_symbol(str, (unsigned long)uval);
+			seq_printf(m, "%s: [%llx] %-55s", name, uval, str);
+		} else if (key_field->flags & HIST_FIELD_FL_STACKTRACE) {
+			seq_puts(m, "stacktrace:\n");
+			hist_trigger_stacktrace_print(m,
+						      key + key_field->offset,
+						      HIST_STACKTRACE_DEPTH);
+			multiline = true;
+		} else if (key_field->flags & HIST_FIELD_FL_STRING) {
+			seq_printf(m, "%s: %-50s", name,
+				   (char *)(key + key_field->offset));
+		} else if (key_field->field->is_signed) {
+			seq_printf(m, "%s: %10lld", name, (s64)uval);
+		} else {
+			seq_printf(m, "%s: %10llu", name, uval);
+		}
+	}
+
+	if (!multiline)
+		seq_puts(m, " ");
+
+	seq_puts(m, "}");
+
+	seq_printf(m, " hitcount: %10llu",
+		   tracing_map_read_sum(elt, HITCOUNT_IDX));
+
+	for (i = HITCOUNT_IDX + 1; i < hist_data->n_vals; i++) {
+		seq_printf(m, "  %s: %10llu",
+			   hist_field_name(hist_data->fields[i]),
+			   tracing_map_read_sum(elt, i));
+	}
+
+	seq_puts(m, "\n");
+}
+
+static int print_entries(struct seq_file *m,
+			 struct hist_trigger_data *hist_data)
+{
+	struct tracing_map_sort_entry *sort_entries;
+	int i, n_entries;
+
+	n_entries = tracing_map_sort_entries(hist_data->map,
+					     hist_data->sort_keys,
+					     hist_data->n_sort_keys,
+					     &sort_entries);
+	if (n_entries <= 0)
+		return n_entries;
+
+	for (i = 0; i < n_entries; i++)
+		hist_trigger_entry_print(m, hist_data, sort_entries[i].key,
+					 sort_entries[i].elt);
+
+	tracing_map_destroy_sort_entries(sort_entries);
+
+	return n_entries;
+}
+
+static void hist_trigger_show(struct seq_file *m,
+			      struct event_trigger_data *data, int n)
+{
+	struct hist_trigger_data *hist_data = data->private_data;
+	int n_entries;
+
+	if (n > 0)
+		seq_puts(m, "\n\n");
+
+	seq_puts(m, "# event histogram\n#\n# trigger info: ");
+	data->ops->print(m, data->ops, data);
+	seq_puts(m, "#\n\n");
+
+	n_entries = print_entries(m, hist_data);
+	if (n_entries < 0)
+		n_entries = 0;
+
+	seq_printf(m, "\nTotals:\n    Hits: %llu\n    Entries: %u\n    Dropped: %llu\n",
+		   (u64)atomic64_read(&hist_data->map->hits),
+		   n_entries, (u64)atomic64_read(&hist_data->map->drops));
+}
+
+static int hist_show(struct seq_file *m, void *v)
+{
+	struct event_trigger_data *data;
+	struct trace_event_file *event_file;
+	int n = 0, ret = 0;
+
+	mutex_lock(&event_mutex);
+
+	event_file = event_file_data(m->private);
+	if (unlikely(!event_file)) {
+		ret = -ENODEV;
+		goto out_unlock;
+	}
+
+	list_for_each_entry_rcu(data, &event_file->triggers, list) {
+		if (data->cmd_ops->trigger_type == ETT_EVENT_HIST)
+			hist_trigger_show(m, data, n++);
+	}
+
+ out_unlock:
+	mutex_unlock(&event_mutex);
+
+	return ret;
+}
+
+static int event_hist_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, hist_show, file);
+}
+
+const struct file_operations event_hist_fops = {
+	.open = event_hist_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+static void hist_field_print(struct seq_file *m, struct hist_field *hist_field)
+{
+	seq_puts(m, hist_field_name(hist_field));
+
+	if (hist_field->flags & HIST_FIELD_FL_HEX)
+		seq_puts(m, ".hex");
+	else if (hist_field->flags & HIST_FIELD_FL_SYM)
+		seq_puts(m, ".sym");
+	else if (hist_field->flags & HIST_FIELD_FL_SYM_OFFSET)
+		seq_puts(m, ".sym-offset");
+}
+
+static int event_hist_trigger_print(struct seq_file *m,
+				    struct event_trigger_ops *ops,
+				    struct event_trigger_data *data)
+{
+	struct hist_trigger_data *hist_data = data->private_data;
+	struct tracing_map_sort_key *sort_key;
+	unsigned int i;
+
+	seq_puts(m, "hist:keys=");
+
+	for_each_hist_key_field(i, hist_data) {
+		if (i > hist_data->n_vals)
+			seq_puts(m, ",");
+		hist_field_print(m, hist_data->fields[i]);
+	}
+
+	seq_puts(m, ":vals=");
+
+	for_each_hist_val_field(i, hist_data) {
+		if (i > HITCOUNT_IDX)
+			seq_puts(m, ",");
+		hist_field_print(m, hist_data->fields[i]);
+	}
+
+	seq_puts(m, ":sort=");
+
+	for (i = 0; i < hist_data->n_sort_keys; i++) {
+		sort_key = &hist_data->sort_keys[i];
+
+		if (i > 0)
+			seq_puts(m, ",");
+		seq_puts(m, hist_field_name(hist_data->fields[sort_key->field_idx]));
+		if (sort_key->descending)
+			seq_puts(m, ".descending");
+	}
+
+	seq_printf(m, ":size=%u", (1 << hist_data->map->map_bits));
+
+	if (data->filter_str)
+		seq_printf(m, " if %s", data->filter_str);
+
+	if (data->paused)
+		seq_puts(m, " [paused]");
+	else
+		seq_puts(m, " [active]");
+
+	seq_putc(m, '\n');
+
+	return 0;
+}
+
+static void event_hist_trigger_free(struct event_trigger_ops *ops,
+				    struct event_trigger_data *data)
+{
+	struct hist_trigger_data *hist_data = data->private_data;
+
+	if (WARN_ON_ONCE(data->ref <= 0))
+		return;
+
+	data->ref--;
+	if (!data->ref) {
+		/* Waits for the handlers still using the map */
+		trigger_data_free(data);
+		destroy_hist_data(hist_data);
+	}
+}
+
+static struct event_trigger_ops event_hist_trigger_ops = {
+	.func			= event_hist_trigger,
+	.print			= event_hist_trigger_print,
+	.init			= event_trigger_init,
+	.free			= event_hist_trigger_free,
+};
+
+static struct event_trigger_ops *event_hist_get_trigger_ops(char *cmd,
+							    char *param)
+{
+	return &event_hist_trigger_ops;
+}
+
+static void hist_clear(struct event_trigger_data *data)
+{
+	struct hist_trigger_data *hist_data = data->private_data;
+	bool paused;
+
+	paused = data->paused;
+	data->paused = true;
+
+	synchronize_sched();
+
+	tracing_map_clear(hist_data->map);
+
+	data->paused = paused;
+}
+
+/*
+ * Only one hist trigger per event; pause, continue and clear are
+ * applied to it instead of registering a new one.
+ */
+static int hist_register_trigger(char *glob, struct event_trigger_ops *ops,
+				 struct event_trigger_data *data,
+				 struct trace_event_file *file)
+{
+	struct hist_trigger_data *hist_data = data->private_data;
+	struct hist_trigger_attrs *attrs = hist_data->attrs;
+	struct event_trigger_data *test;
+	int ret = 0;
+
+	list_for_each_entry_rcu(test, &file->triggers, list) {
+		if (test->cmd_ops->trigger_type == ETT_EVENT_HIST) {
+			if (attrs->pause)
+				test->paused = true;
+			else if (attrs->cont)
+				test->paused = false;
+			else if (attrs->clear)
+				hist_clear(test);
+			else
+				ret = -EEXIST;
+			goto out;
+		}
+	}
+
+	if (attrs->cont || attrs->clear) {
+		ret = -ENOENT;
+		goto out;
+	}
+
+	if (attrs->pause)
+		data->paused = true;
+
+	if (data->ops->init) {
+		ret = data->ops->init(data->ops, data);
+		if (ret < 0)
+			goto out;
+	}
+
+	list_add_rcu(&data->list, &file->triggers);
+	ret++;
+
+	update_cond_flag(file);
+	if (trace_event_trigger_enable_disable(file, 1) < 0) {
+		list_del_rcu(&data->list);
+		update_cond_flag(file);
+		ret--;
+	}
+ out:
+	return ret;
+}
+
+static int event_hist_trigger_func(struct event_command *cmd_ops,
+				   struct trace_event_file *file,
+				   char *glob, char *cmd, char *param)
+{
+	unsigned int hist_trigger_bits = TRACING_MAP_BITS_DEFAULT;
+	struct event_trigger_data *trigger_data;
+	struct hist_trigger_attrs *attrs;
+	struct event_trigger_ops *trigger_ops;
+	struct hist_trigger_data *hist_data;
+	char *trigger;
+	int ret = 0;
+
+	if (!param)
+		return -EINVAL;
+
+	/* separate the trigger from the filter (k:v [if filter]) */
+	trigger = strsep(&param, " \t");
+	if (!trigger)
+		return -EINVAL;
+
+	attrs = parse_hist_trigger_attrs(trigger);
+	if (IS_ERR(attrs))
+		return PTR_ERR(attrs);
+
+	if (attrs->map_bits)
+		hist_trigger_bits = attrs->map_bits;
+
+	hist_data = create_hist_data(hist_trigger_bits, attrs, file);
+	if (IS_ERR(hist_data)) {
+		destroy_hist_trigger_attrs(attrs);
+		return PTR_ERR(hist_data);
+	}
+
+	trigger_ops = cmd_ops->get_trigger_ops(cmd, trigger);
+
+	ret = -ENOMEM;
+	trigger_data = kzalloc(sizeof(*trigger_data), GFP_KERNEL);
+	if (!trigger_data)
+		goto out_destroy;
+
+	trigger_data->count = -1;
+	trigger_data->ops = trigger_ops;
+	trigger_data->cmd_ops = cmd_ops;
+	INIT_LIST_HEAD(&trigger_data->list);
+	RCU_INIT_POINTER(trigger_data->filter, NULL);
+	trigger_data->private_data = hist_data;
+
+	if (glob[0] == '!') {
+		cmd_ops->unreg(glob+1, trigger_ops, trigger_data, file);
+		ret = 0;
+		goto out_free;
+	}
+
+	if (!param) /* if param is non-empty, it's supposed to be a filter */
+		goto out_reg;
+
+	if (!cmd_ops->set_filter)
+		goto out_reg;
+
+	ret = cmd_ops->set_filter(param, trigger_data, file);
+	if (ret < 0)
+		goto out_free;
+ out_reg:
+	ret = cmd_ops->reg(glob, trigger_ops, trigger_data, file);
+	/*
+	 * The above returns on success the # of triggers registered,
+	 * but if it didn't register any it returns zero.  That is a
+	 * failure, unless the command only acted on the existing one.
+	 */
+	if (!ret) {
+		if (!(attrs->pause || attrs->cont || attrs->clear))
+			ret = -ENOENT;
+		goto out_free;
+	} else if (ret < 0)
+		goto out_free;
+	/* Just return zero, not the number of registered triggers */
+	ret = 0;
+ out:
+	return ret;
+ out_free:
+	if (cmd_ops->set_filter)
+		cmd_ops->set_filter(NULL, trigger_data, NULL);
+	kfree(trigger_data);
+ out_destroy:
+	destroy_hist_data(hist_data);
+	goto out;
+}
+
+static struct event_command trigger_hist_cmd = {
+	.name			= "hist",
+	.trigger_type		= ETT_EVENT_HIST,
+	.needs_rec		= true,
+	.func			= event_hist_trigger_func,
+	.reg			= hist_register_trigger,
+	.unreg			= unregister_trigger,
+	.get_trigger_ops	= event_hist_get_trigger_ops,
+	.set_filter		= set_trigger_filter,
+};
+
+__init int register_trigger_hist_cmd(void)
+{
+	int ret;
+
+	ret = register_event_command(&trigger_hist_cmd);
+	WARN_ON(ret < 0);
+
+	return ret;
+}
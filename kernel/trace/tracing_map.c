@@ -0,0 +1,560 @@
+/*
+ * tracing_map - lock-free map for tracing
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * A hash map that aggregates per-key sums from event handlers.  All
+ * elements are allocated up front and the buckets are claimed with
+ * cmpxchg(), so updates can happen in any context without locks.
+ */
+
+#include <linux/err.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+#include <linux/jhash.h>
+#include <linux/sort.h>
+
+#include "tracing_map.h"
+
+/**
+ * tracing_map_update_sum - Add a value to an element's sum field
+ * @elt: The element containing the sum
+ * @i: The index of the sum field
+ * @n: The value to add
+ */
+void tracing_map_update_sum(struct tracing_map_elt *elt, unsigned int i, u64 n)
+{
+	atomic64_add(n, &elt->fields[i].sum);
+}
+
+/**
+ * tracing_map_read_sum - Return the value of an element's sum field
+ * @elt: The element containing the sum
+ * @i: The index of the sum field
+ */
+u64 tracing_map_read_sum(struct tracing_map_elt *elt, unsigned int i)
+{
+	return (u64)atomic64_read(&elt->fields[i].sum);
+}
+
+int tracing_map_cmp_string(void *val_a, void *val_b)
+{
+	char *a = val_a;
+	char *b = val_b;
+
+	return strcmp(a, b);
+}
+
+int tracing_map_cmp_none(void *val_a, void *val_b)
+{
+	return 0;
+}
+
+static int tracing_map_cmp_atomic64(void *val_a, void *val_b)
+{
+	u64 a = atomic64_read((atomic64_t *)val_a);
+	u64 b = atomic64_read((atomic64_t *)val_b);
+
+	return (a > b) ? 1 : ((a < b) ? -1 : 0);
+}
+
+#define DEFINE_TRACING_MAP_CMP_FN(type)					\
+static int tracing_map_cmp_##type(void *val_a, void *val_b)		\
+{									\
+	type a = *(type *)val_a;					\
+	type b = *(type *)val_b;					\
+									\
+	return (a > b) ? 1 : ((a < b) ? -1 : 0);			\
+}
+
+DEFINE_TRACING_MAP_CMP_FN(s64);
+DEFINE_TRACING_MAP_CMP_FN(u64);
+DEFINE_TRACING_MAP_CMP_FN(s32);
+DEFINE_TRACING_MAP_CMP_FN(u32);
+DEFINE_TRACING_MAP_CMP_FN(s16);
+DEFINE_TRACING_MAP_CMP_FN(u16);
+DEFINE_TRACING_MAP_CMP_FN(s8);
+DEFINE_TRACING_MAP_CMP_FN(u8);
+
+/**
+ * tracing_map_cmp_num - Return the compare function for a numeric key
+ * @field_size: Size of the key field in bytes
+ * @field_is_signed: Whether the key field is signed
+ */
+tracing_map_cmp_fn_t tracing_map_cmp_num(int field_size,
+					 int field_is_signed)
+{
+	tracing_map_cmp_fn_t fn = tracing_map_cmp_none;
+
+	switch (field_size) {
+	case 8:
+		fn = field_is_signed ? tracing_map_cmp_s64 : tracing_map_cmp_u64;
+		break;
+	case 4:
+		fn = field_is_signed ? tracing_map_cmp_s32 : tracing_map_cmp_u32;
+		break;
+	case 2:
+		fn = field_is_signed ? tracing_map_cmp_s16 : tracing_map_cmp_u16;
+		break;
+	case 1:
+		fn = field_is_signed ? tracing_map_cmp_s8 : tracing_map_cmp_u8;
+		break;
+	}
+
+	return fn;
+}
+
+static int tracing_map_add_field(struct tracing_map *map,
+				 tracing_map_cmp_fn_t cmp_fn)
+{
+	int ret = -EINVAL;
+
+	if (map->n_fields < TRACING_MAP_FIELDS_MAX) {
+		ret = map->n_fields;
+		map->fields[map->n_fields++].cmp_fn = cmp_fn;
+	}
+
+	return ret;
+}
+
+/**
+ * tracing_map_add_sum_field - Add a sum field to every element
+ * @map: The tracing_map, not yet initialized
+ *
+ * Return: the index of the new field, to be passed to
+ * tracing_map_update_sum() and friends, or -EINVAL.
+ */
+int tracing_map_add_sum_field(struct tracing_map *map)
+{
+	return tracing_map_add_field(map, tracing_map_cmp_atomic64);
+}
+
+/**
+ * tracing_map_add_key_field - Describe one part of the compound key
+ * @map: The tracing_map, not yet initialized
+ * @offset: Offset of the part within the key
+ * @cmp_fn: Compare function used when sorting on this part
+ *
+ * Return: the index of the new field, usable as a sort key, or -EINVAL.
+ */
+int tracing_map_add_key_field(struct tracing_map *map,
+			      unsigned int offset,
+			      tracing_map_cmp_fn_t cmp_fn)
+{
+	int idx;
+
+	if (map->n_keys >= TRACING_MAP_KEYS_MAX)
+		return -EINVAL;
+
+	idx = tracing_map_add_field(map, cmp_fn);
+	if (idx < 0)
+		return idx;
+
+	map->fields[idx].offset = offset;
+	map->n_keys++;
+
+	return idx;
+}
+
+static void tracing_map_elt_clear(struct tracing_map_elt *elt)
+{
+	unsigned int i;
+
+	for (i = 0; i < elt->map->n_fields; i++)
+		if (elt->fields[i].cmp_fn == tracing_map_cmp_atomic64)
+			atomic64_set(&elt->fields[i].sum, 0);
+}
+
+static void tracing_map_elt_init_fields(struct tracing_map_elt *elt)
+{
+	unsigned int i;
+
+	for (i = 0; i < elt->map->n_fields; i++) {
+		elt->fields[i].cmp_fn = elt->map->fields[i].cmp_fn;
+
+		if (elt->fields[i].cmp_fn != tracing_map_cmp_atomic64)
+			elt->fields[i].offset = elt->map->fields[i].offset;
+	}
+}
+
+static void tracing_map_elt_free(struct tracing_map_elt *elt)
+{
+	if (!elt)
+		return;
+
+	kfree(elt->fields);
+	kfree(elt->key);
+	kfree(elt);
+}
+
+static struct tracing_map_elt *tracing_map_elt_alloc(struct tracing_map *map)
+{
+	struct tracing_map_elt *elt;
+
+	elt = kzalloc(sizeof(*elt), GFP_KERNEL);
+	if (!elt)
+		return NULL;
+
+	elt->map = map;
+
+	elt->key = kzalloc(map->key_size, GFP_KERNEL);
+	elt->fields = kcalloc(map->n_fields, sizeof(*elt->fields), GFP_KERNEL);
+	if (!elt->key || !elt->fields) {
+		tracing_map_elt_free(elt);
+		return NULL;
+	}
+
+	tracing_map_elt_init_fields(elt);
+
+	return elt;
+}
+
+static struct tracing_map_elt *get_free_elt(struct tracing_map *map)
+{
+	int idx;
+
+	idx = atomic_inc_return(&map->next_elt);
+	if (idx < map->max_elts)
+		return map->elts[idx];
+
+	return NULL;
+}
+
+static void tracing_map_free_elts(struct tracing_map *map)
+{
+	unsigned int i;
+
+	if (!map->elts)
+		return;
+
+	for (i = 0; i < map->max_elts; i++)
+		tracing_map_elt_free(map->elts[i]);
+
+	vfree(map->elts);
+	map->elts = NULL;
+}
+
+static int tracing_map_alloc_elts(struct tracing_map *map)
+{
+	unsigned int i;
+
+	map->elts = vzalloc(map->max_elts * sizeof(*map->elts));
+	if (!map->elts)
+		return -ENOMEM;
+
+	for (i = 0; i < map->max_elts; i++) {
+		map->elts[i] = tracing_map_elt_alloc(map);
+		if (!map->elts[i]) {
+			tracing_map_free_elts(map);
+			return -ENOMEM;
+		}
+	}
+
+	return 0;
+}
+
+static inline bool keys_match(void *key, void *test_key, unsigned key_size)
+{
+	return memcmp(key, test_key, key_size) == 0;
+}
+
+/*
+ * A bucket whose hash is set but whose element isn't yet is being
+ * filled in by another CPU, so wait for it rather than adding the same
+ * key twice.  The wait is bounded in case the other writer is the
+ * context this one interrupted.
+ */
+static inline struct tracing_map_elt *
+__tracing_map_insert(struct tracing_map *map, void *key, bool lookup_only)
+{
+	u32 idx, key_hash, test_key;
+	struct tracing_map_entry *entry;
+	struct tracing_map_elt *val;
+	unsigned int dup_try = 0;
+
+	key_hash = jhash(key, map->key_size, 0);
+	/* A zero hash marks a free bucket */
+	if (key_hash == 0)
+		key_hash = 1;
+	idx = key_hash >> (32 - (map->map_bits + 1));
+
+	while (1) {
+		idx &= (map->map_size - 1);
+		entry = &map->map[idx];
+		test_key = ACCESS_ONCE(entry->key);
+
+		if (test_key && test_key == key_hash) {
+			val = smp_load_acquire(&entry->val);
+			if (val && keys_match(key, val->key, map->key_size)) {
+				atomic64_inc(&map->hits);
+				return val;
+			} else if (unlikely(!val)) {
+				if (++dup_try > map->map_size)
+					break;
+				cpu_relax();
+				continue;
+			}
+		}
+
+		if (!test_key) {
+			if (lookup_only)
+				return NULL;
+
+			if (!cmpxchg(&entry->key, 0, key_hash)) {
+				struct tracing_map_elt *elt;
+
+				elt = get_free_elt(map);
+				if (!elt) {
+					/* Give the bucket back */
+					ACCESS_ONCE(entry->key) = 0;
+					break;
+				}
+
+				memcpy(elt->key, key, map->key_size);
+				smp_store_release(&entry->val, elt);
+				atomic64_inc(&map->hits);
+
+				return elt;
+			}
+
+			/* Lost the bucket, it may have gone to the same key */
+			continue;
+		}
+
+		idx++;
+	}
+
+	atomic64_inc(&map->drops);
+
+	return NULL;
+}
+
+/**
+ * tracing_map_insert - Insert a key or find the element already holding it
+ * @map: The tracing_map
+ * @key: The key, map->key_size bytes
+ *
+ * Safe in any context.  The key is copied into the element the first
+ * time it is seen.
+ *
+ * Return: the element for @key, or NULL if the map is full, in which
+ * case the drop is counted.
+ */
+struct tracing_map_elt *tracing_map_insert(struct tracing_map *map, void *key)
+{
+	return __tracing_map_insert(map, key, false);
+}
+
+/**
+ * tracing_map_lookup - Find the element holding a key
+ * @map: The tracing_map
+ * @key: The key, map->key_size bytes
+ *
+ * Return: the element for @key, or NULL if it isn't in the map.
+ */
+struct tracing_map_elt *tracing_map_lookup(struct tracing_map *map, void *key)
+{
+	return __tracing_map_insert(map, key, true);
+}
+
+/**
+ * tracing_map_clear - Remove all keys and zero all sums
+ * @map: The tracing_map
+ *
+ * The caller must make sure no insertions run concurrently, e.g. by
+ * pausing the user and waiting for a sched RCU grace period.
+ */
+void tracing_map_clear(struct tracing_map *map)
+{
+	unsigned int i;
+
+	atomic_set(&map->next_elt, -1);
+	atomic64_set(&map->hits, 0);
+	atomic64_set(&map->drops, 0);
+
+	memset(map->map, 0, map->map_size * sizeof(*map->map));
+
+	for (i = 0; i < map->max_elts; i++)
+		tracing_map_elt_clear(map->elts[i]);
+}
+
+/**
+ * tracing_map_destroy - Free a tracing_map and all of its elements
+ * @map: The tracing_map
+ */
+void tracing_map_destroy(struct tracing_map *map)
+{
+	if (!map)
+		return;
+
+	tracing_map_free_elts(map);
+	vfree(map->map);
+	kfree(map);
+}
+
+/**
+ * tracing_map_create - Create a tracing_map
+ * @map_bits: The map holds up to 2^@map_bits keys
+ * @key_size: Size of every key
+ *
+ * Add the sum and key fields with tracing_map_add_sum_field() and
+ * tracing_map_add_key_field(), then allocate the elements with
+ * tracing_map_init().
+ *
+ * Return: the new map, or an ERR_PTR().
+ */
+struct tracing_map *tracing_map_create(unsigned int map_bits,
+				       unsigned int key_size)
+{
+	struct tracing_map *map;
+
+	if (map_bits < TRACING_MAP_BITS_MIN ||
+	    map_bits > TRACING_MAP_BITS_MAX || !key_size)
+		return ERR_PTR(-EINVAL);
+
+	map = kzalloc(sizeof(*map), GFP_KERNEL);
+	if (!map)
+		return ERR_PTR(-ENOMEM);
+
+	map->map_bits = map_bits;
+	map->max_elts = (1 << map_bits);
+	atomic_set(&map->next_elt, -1);
+
+	/* Keep the load factor at 1/2 at most, so probing stays short */
+	map->map_size = (1 << (map_bits + 1));
+	map->key_size = key_size;
+
+	map->map = vzalloc(map->map_size * sizeof(*map->map));
+	if (!map->map) {
+		kfree(map);
+		return ERR_PTR(-ENOMEM);
+	}
+
+	return map;
+}
+
+/**
+ * tracing_map_init - Allocate the elements of a tracing_map
+ * @map: The tracing_map, with all of its fields added
+ *
+ * Return: 0 on success, errno otherwise.
+ */
+int tracing_map_init(struct tracing_map *map)
+{
+	if (map->n_fields < 1)
+		return -EINVAL;
+
+	return tracing_map_alloc_elts(map);
+}
+
+static int cmp_entries_field(struct tracing_map *map,
+			     const struct tracing_map_sort_entry *a,
+			     const struct tracing_map_sort_entry *b,
+			     struct tracing_map_sort_key *sort_key)
+{
+	struct tracing_map_field *field = &map->fields[sort_key->field_idx];
+	void *val_a, *val_b;
+	int ret;
+
+	if (field->cmp_fn == tracing_map_cmp_atomic64) {
+		val_a = &a->elt->fields[sort_key->field_idx].sum;
+		val_b = &b->elt->fields[sort_key->field_idx].sum;
+	} else {
+		val_a = a->key + field->offset;
+		val_b = b->key + field->offset;
+	}
+
+	ret = field->cmp_fn(val_a, val_b);
+
+	return sort_key->descending ? -ret : ret;
+}
+
+static int cmp_entries(const void *A, const void *B)
+{
+	const struct tracing_map_sort_entry *a = A, *b = B;
+	struct tracing_map *map = a->elt->map;
+	unsigned int i;
+	int ret = 0;
+
+	for (i = 0; i < map->n_sort_keys && !ret; i++)
+		ret = cmp_entries_field(map, a, b, &map->sort_key[i]);
+
+	return ret;
+}
+
+/**
+ * tracing_map_destroy_sort_entries - Free tracing_map_sort_entries()' array
+ * @entries: The array returned by tracing_map_sort_entries()
+ */
+void tracing_map_destroy_sort_entries(struct tracing_map_sort_entry *entries)
+{
+	vfree(entries);
+}
+
+/**
+ * tracing_map_sort_entries - Return the map's elements, sorted
+ * @map: The tracing_map
+ * @sort_keys: Fields to sort on, in order of precedence
+ * @n_sort_keys: Number of sort keys
+ * @sort_entries: Returns the sorted array
+ *
+ * The elements themselves are returned, not copies, so sums keep
+ * moving while the caller prints them.  Calls are serialized by the
+ * caller, which owns map->sort_key while sorting.
+ *
+ * Return: the number of entries in @sort_entries, which must be freed
+ * with tracing_map_destroy_sort_entries(), or errno.
+ */
+int tracing_map_sort_entries(struct tracing_map *map,
+			     struct tracing_map_sort_key *sort_keys,
+			     unsigned int n_sort_keys,
+			     struct tracing_map_sort_entry **sort_entries)
+{
+	struct tracing_map_sort_entry *entries;
+	unsigned int i, n_entries = 0;
+
+	*sort_entries = NULL;
+
+	if (n_sort_keys > TRACING_MAP_SORT_KEYS_MAX)
+		return -EINVAL;
+
+	entries = vmalloc(map->max_elts * sizeof(*entries));
+	if (!entries)
+		return -ENOMEM;
+
+	for (i = 0; i < map->map_size && n_entries < map->max_elts; i++) {
+		struct tracing_map_elt *elt;
+
+		if (!ACCESS_ONCE(map->map[i].key))
+			continue;
+		elt = smp_load_acquire(&map->map[i].val);
+		if (!elt)
+			continue;
+
+		entries[n_entries].key = elt->key;
+		entries[n_entries].elt = elt;
+		n_entries++;
+	}
+
+	if (n_entries == 0) {
+		vfree(entries);
+		return 0;
+	}
+
+	memcpy(map->sort_key, sort_keys, n_sort_keys * sizeof(*sort_keys));
+	map->n_sort_keys = n_sort_keys;
+
+	sort(entries, n_entries, sizeof(*entries), cmp_entries, NULL);
+
+	*sort_entries = entries;
+
+	return n_entries;
+}
@@ -0,0 +1,118 @@
+#ifndef __TRACING_MAP_H
+#define __TRACING_MAP_H
+
+#define TRACING_MAP_BITS_DEFAULT	11
+#define TRACING_MAP_BITS_MAX		17
+#define TRACING_MAP_BITS_MIN		7
+
+#define TRACING_MAP_KEYS_MAX		2
+#define TRACING_MAP_VALS_MAX		3
+#define TRACING_MAP_FIELDS_MAX		(TRACING_MAP_KEYS_MAX + \
+					 TRACING_MAP_VALS_MAX)
+#define TRACING_MAP_SORT_KEYS_MAX	2
+
+typedef int (*tracing_map_cmp_fn_t) (void *val_a, void *val_b);
+
+/*
+ * A map field is either a sum, updated atomically from the event
+ * handlers, or describes one part of the compound key, found at
+ * @offset and compared with @cmp_fn when sorting.
+ */
+struct tracing_map_field {
+	tracing_map_cmp_fn_t		cmp_fn;
+	union {
+		atomic64_t		sum;
+		unsigned int		offset;
+	};
+};
+
+struct tracing_map_elt {
+	struct tracing_map		*map;
+	struct tracing_map_field	*fields;
+	void				*key;
+};
+
+struct tracing_map_entry {
+	u32				key;
+	struct tracing_map_elt		*val;
+};
+
+struct tracing_map_sort_key {
+	unsigned int			field_idx;
+	bool				descending;
+};
+
+struct tracing_map_sort_entry {
+	void				*key;
+	struct tracing_map_elt		*elt;
+};
+
+/**
+ * struct tracing_map - lock-free hash map for event aggregation
+ * @key_size: Size of the keys, all keys have the same size
+ * @map_bits: The map holds at most 2^@map_bits elements
+ * @map_size: Number of hash buckets, twice the number of elements
+ * @max_elts: Number of preallocated elements
+ * @next_elt: Index of the last element handed out
+ * @elts: The preallocated elements
+ * @map: The hash buckets, open addressed with linear probing
+ * @fields: Sum and key fields, copied into every element
+ * @sort_key: Sort keys in effect for tracing_map_sort_entries()
+ *
+ * Inserting never allocates and never takes a lock, so it can be done
+ * from any context, NMI included.  Once all elements are used up new
+ * keys are dropped and counted in @drops.  Elements are only freed
+ * when the whole map is cleared or destroyed.
+ */
+struct tracing_map {
+	unsigned int			key_size;
+	unsigned int			map_bits;
+	unsigned int			map_size;
+	unsigned int			max_elts;
+	atomic_t			next_elt;
+	struct tracing_map_elt		**elts;
+	struct tracing_map_entry	*map;
+	struct tracing_map_field	fields[TRACING_MAP_FIELDS_MAX];
+	unsigned int			n_fields;
+	unsigned int			n_keys;
+	struct tracing_map_sort_key	sort_key[TRACING_MAP_SORT_KEYS_MAX];
+	unsigned int			n_sort_keys;
+	atomic64_t			hits;
+	atomic64_t			drops;
+};
+
+extern struct tracing_map *tracing_map_create(unsigned int map_bits,
+					      unsigned int key_size);
+extern int tracing_map_init(struct tracing_map *map);
+
+extern int tracing_map_add_sum_field(struct tracing_map *map);
+extern int tracing_map_add_key_field(struct tracing_map *map,
+				     unsigned int offset,
+				     tracing_map_cmp_fn_t cmp_fn);
+
+extern void tracing_map_destroy(struct tracing_map *map);
+extern void tracing_map_clear(struct tracing_map *map);
+
+extern struct tracing_map_elt *
+tracing_map_insert(struct tracing_map *map, void *key);
+extern struct tracing_map_elt *
+tracing_map_lookup(struct tracing_map *map, void *key);
+
+extern tracing_map_cmp_fn_t tracing_map_cmp_num(int field_size,
+						int field_is_signed);
+extern int tracing_map_cmp_string(void *val_a, void *val_b);
+extern int tracing_map_cmp_none(void *val_a, void *val_b);
+
+extern void tracing_map_update_sum(struct tracing_map_elt *elt,
+				   unsigned int i, u64 n);
+extern u64 tracing_map_read_sum(struct tracing_map_elt *elt, unsigned int i);
+
+extern int
+tracing_map_sort_entries(struct tracing_map *map,
+			 struct tracing_map_sort_key *sort_keys,
+			 unsigned int n_sort_keys,
+			 struct tracing_map_sort_entry **sort_entries);
+extern void
+tracing_map_destroy_sort_entries(struct tracing_map_sort_entry *entries);
+
+#endif /* __TRACING_MAP_H */
@@ -46,6 +46,9 @@
  * Compress 'isize' bytes from 'source' into an output buffer 'dest' of
  * maximum size 'maxOutputSize'.  * If it cannot achieve it, compression
  * will stop, and result of the function will be zero.
+ * The match finder skips ahead faster the longer it goes without a match,
+ * 'acceleration' scales that step: 1 is the normal LZ4 speed and ratio,
+ * larger values trade compression ratio for speed.
  * return : the number of bytes written in buffer 'dest', or 0 if the
  * compression fails
  */
@@ -53,7 +56,8 @@ static inline int lz4_compressctx(void *ctx,
 		const char *source,
 		char *dest,
 		int isize,
-		int maxoutputsize)
+		int maxoutputsize,
+		int acceleration)
 {
 	HTYPE *hashtable = (HTYPE *)ctx;
 	const u8 *ip = (u8 *)source;
@@ -87,7 +91,7 @@ static inline int lz4_compressctx(void *ctx,
 
 	/* Main Loop */
 	for (;;) {
-		int findmatchattempts = (1U << skipstrength) + 3;
+		int findmatchattempts = (acceleration << skipstrength) + 3;
 		const u8 *forwardip = ip;
 		const u8 *ref;
 		u8 *token;
@@ -239,7 +243,8 @@ static inline int lz4_compress64kctx(void *ctx,
 		const char *source,
 		char *dest,
 		int isize,
-		int maxoutputsize)
+		int maxoutputsize,
+		int acceleration)
 {
 	u16 *hashtable = (u16 *)ctx;
 	const u8 *ip = (u8 *) source;
@@ -268,7 +273,7 @@ static inline int lz4_compress64kctx(void *ctx,
 
 	/* Main Loop */
 	for (;;) {
-		int findmatchattempts = (1U << skipstrength) + 3;
+		int findmatchattempts = (acceleration << skipstrength) + 3;
 		const u8 *forwardip = ip;
 		const u8 *ref;
 		u8 *token;
@@ -415,18 +420,24 @@ _last_literals:
 	return (int)(((char *)op) - dest);
 }
 
-int lz4_compress(const unsigned char *src, size_t src_len,
-			unsigned char *dst, size_t *dst_len, void *wrkmem)
+int lz4_compress_fast(const unsigned char *src, size_t src_len,
+			unsigned char *dst, size_t *dst_len, void *wrkmem,
+			int acceleration)
 {
 	int ret = -1;
 	int out_len = 0;
 
+	if (acceleration < 1)
+		acceleration = LZ4_ACCELERATION_DEFAULT;
+	else if (acceleration > LZ4_ACCELERATION_MAX)
+		acceleration = LZ4_ACCELERATION_MAX;
+
 	if (src_len < LZ4_64KLIMIT)
 		out_len = lz4_compress64kctx(wrkmem, src, dst, src_len,
-				lz4_compressbound(src_len));
+				lz4_compressbound(src_len), acceleration);
 	else
 		out_len = lz4_compressctx(wrkmem, src, dst, src_len,
-				lz4_compressbound(src_len));
+				lz4_compressbound(src_len), acceleration);
 
 	if (out_len < 0)
 		goto exit;
@@ -437,6 +448,14 @@ int lz4_compress(const unsigned char *src, size_t src_len,
 exit:
 	return ret;
 }
+EXPORT_SYMBOL(lz4_compress_fast);
+
+int lz4_compress(const unsigned char *src, size_t src_len,
+			unsigned char *dst, size_t *dst_len, void *wrkmem)
+{
+	return lz4_compress_fast(src, src_len, dst, dst_len, wrkmem,
+				 LZ4_ACCELERATION_DEFAULT);
+}
 EXPORT_SYMBOL(lz4_compress);
 
 MODULE_LICENSE("Dual BSD/GPL");
@@ -47,257 +47,176 @@
 
 #include "lz4defs.h"
 
-static const int dec32table[] = {0, 3, 2, 3, 0, 0, 0, 0};
-#if LZ4_ARCH64
+/*
+ * Offsets below 8 overlap the match with its own output.  The first 4 bytes
+ * are copied one by one, then these tables move the match pointer back so
+ * that it stays a whole number of periods behind, and the rest can be
+ * copied 8 bytes at a time.
+ */
+static const unsigned int dec32table[] = {0, 1, 2, 1, 4, 4, 4, 4};
 static const int dec64table[] = {0, 0, 0, -1, 0, 1, 2, 3};
-#endif
 
-static int lz4_uncompress(const char *source, char *dest, int osize)
+/*
+ * lz4_decompress_generic() - decompress one block
+ *
+ * With @end_on_input the input size is known and the output size is only a
+ * limit, the number of bytes decompressed is returned.  Otherwise the exact
+ * output size is known and the input is trusted to end where the output
+ * does, the number of bytes read is returned.  Malformed input makes this
+ * return a negative value, never read or write outside of the buffers.
+ */
+static __always_inline int lz4_decompress_generic(const u8 *const source,
+		u8 *const dest, int isize, int osize, const bool end_on_input)
 {
-	const BYTE *ip = (const BYTE *) source;
-	const BYTE *ref;
-	BYTE *op = (BYTE *) dest;
-	BYTE * const oend = op + osize;
-	BYTE *cpy;
-	unsigned token;
-	size_t length;
+	const u8 *ip = source;
+	const u8 *const iend = ip + isize;
+	u8 *op = dest;
+	u8 *const oend = op + osize;
+	u8 *cpy;
+
+	/* Special cases */
+	if (unlikely(osize == 0)) {
+		if (end_on_input)
+			return (isize == 1 && *ip == 0) ? 0 : -1;
+		return *ip == 0 ? 1 : -1;
+	}
 
+	/* Main Loop */
 	while (1) {
+		unsigned int token;
+		size_t length;
+		size_t offset;
+		const u8 *match;
 
-		/* get runlength */
+		/* get literal length */
 		token = *ip++;
-		length = (token >> ML_BITS);
+		length = token >> ML_BITS;
 		if (length == RUN_MASK) {
-			size_t len;
+			unsigned int s;
 
-			len = *ip++;
-			for (; len == 255; length += 255)
-				len = *ip++;
-			if (unlikely(length > (size_t)(length + len)))
+			do {
+				s = *ip++;
+				length += s;
+			} while (likely(end_on_input ?
+					ip < iend - RUN_MASK : 1) && s == 255);
+			if (end_on_input &&
+			    unlikely((uintptr_t)op + length < (uintptr_t)op))
+				goto _output_error;
+			if (end_on_input &&
+			    unlikely((uintptr_t)ip + length < (uintptr_t)ip))
 				goto _output_error;
-			length += len;
 		}
 
 		/* copy literals */
 		cpy = op + length;
-		if (unlikely(cpy > oend - COPYLENGTH)) {
+		if ((end_on_input && (cpy > oend - MFLIMIT ||
+				      ip + length > iend - (2 + 1 + LASTLITERALS))) ||
+		    (!end_on_input && cpy > oend - WILDCOPYLENGTH)) {
 			/*
-			 * Error: not enough place for another match
-			 * (min 4) + 5 literals
+			 * Only the last literals may come this close to
+			 * the end, and they must end the block exactly.
 			 */
-			if (cpy != oend)
+			if (!end_on_input && cpy != oend)
+				goto _output_error;
+			if (end_on_input && (ip + length != iend || cpy > oend))
 				goto _output_error;
-
 			memcpy(op, ip, length);
 			ip += length;
+			op += length;
 			break; /* EOF */
 		}
-		LZ4_WILDCOPY(ip, op, cpy);
-		ip -= (op - cpy);
+		lz4_wildcopy(op, ip, cpy);
+		ip += length;
 		op = cpy;
 
 		/* get offset */
-		LZ4_READ_LITTLEENDIAN_16(ref, cpy, ip);
+		offset = get_unaligned_le16(ip);
 		ip += 2;
-
-		/* Error: offset create reference outside destination buffer */
-		if (unlikely(ref < (BYTE *const) dest))
+		match = op - offset;
+		/* Error: offset creates reference outside destination buffer */
+		if (unlikely(match < dest))
 			goto _output_error;
 
-		/* get matchlength */
+		/* get match length */
 		length = token & ML_MASK;
 		if (length == ML_MASK) {
-			for (; *ip == 255; length += 255)
-				ip++;
-			if (unlikely(length > (size_t)(length + *ip)))
+			unsigned int s;
+
+			do {
+				s = *ip++;
+				if (end_on_input && ip > iend - LASTLITERALS)
+					goto _output_error;
+				length += s;
+			} while (s == 255);
+			if (end_on_input &&
+			    unlikely((uintptr_t)op + length < (uintptr_t)op))
 				goto _output_error;
-			length += *ip++;
 		}
+		length += MINMATCH;
 
-		/* copy repeated sequence */
-		if (unlikely((op - ref) < STEPSIZE)) {
-#if LZ4_ARCH64
-			int dec64 = dec64table[op - ref];
-#else
-			const int dec64 = 0;
-#endif
-			op[0] = ref[0];
-			op[1] = ref[1];
-			op[2] = ref[2];
-			op[3] = ref[3];
-			op += 4;
-			ref += 4;
-			ref -= dec32table[op-ref];
-			PUT4(ref, op);
-			op += STEPSIZE - 4;
-			ref -= dec64;
+		/* copy match within block */
+		cpy = op + length;
+		if (unlikely(offset < 8)) {
+			const int dec64 = dec64table[offset];
+
+			op[0] = match[0];
+			op[1] = match[1];
+			op[2] = match[2];
+			op[3] = match[3];
+			match += dec32table[offset];
+			memcpy(op + 4, match, 4);
+			match -= dec64;
 		} else {
-			LZ4_COPYSTEP(ref, op);
+			lz4_copy8(op, match);
+			match += 8;
 		}
-		cpy = op + length - (STEPSIZE - 4);
-		if (cpy > (oend - COPYLENGTH)) {
+		op += 8;
+
+		if (unlikely(cpy > oend - 12)) {
+			u8 *const ocopylimit = oend - (WILDCOPYLENGTH - 1);
 
-			/* Error: request to write beyond destination buffer */
-			if (cpy > oend)
-				goto _output_error;
-#if LZ4_ARCH64
-			if ((ref + COPYLENGTH) > oend)
-#else
-			if ((ref + COPYLENGTH) > oend ||
-					(op + COPYLENGTH) > oend)
-#endif
-				goto _output_error;
-			LZ4_SECURECOPY(ref, op, (oend - COPYLENGTH));
-			while (op < cpy)
-				*op++ = *ref++;
-			op = cpy;
 			/*
-			 * Check EOF (should never happen, since last 5 bytes
-			 * are supposed to be literals)
+			 * Error: last LASTLITERALS bytes must be literals
+			 * (uncompressed)
 			 */
-			if (op == oend)
+			if (cpy > oend - LASTLITERALS)
 				goto _output_error;
-			continue;
+			if (op < ocopylimit) {
+				lz4_wildcopy(op, match, ocopylimit);
+				match += ocopylimit - op;
+				op = ocopylimit;
+			}
+			while (op < cpy)
+				*op++ = *match++;
+		} else {
+			lz4_copy8(op, match);
+			if (length > 16)
+				lz4_wildcopy(op + 8, match + 8, cpy);
 		}
-		LZ4_SECURECOPY(ref, op, cpy);
 		op = cpy; /* correction */
 	}
+
 	/* end of decoding */
-	return (int) (((char *)ip) - source);
+	if (end_on_input)
+		return (int)(op - dest);	/* Nb of output bytes decoded */
+	return (int)(ip - source);		/* Nb of input bytes read */
 
-	/* write overflow error detected */
+	/* Overflow error detected */
 _output_error:
 	return -1;
 }
 
+static int lz4_uncompress(const char *source, char *dest, int osize)
+{
+	return lz4_decompress_generic((const u8 *)source, (u8 *)dest, 0,
+				      osize, false);
+}
+
 static int lz4_uncompress_unknownoutputsize(const char *source, char *dest,
 				int isize, size_t maxoutputsize)
 {
-	const BYTE *ip = (const BYTE *) source;
-	const BYTE *const iend = ip + isize;
-	const BYTE *ref;
-
-
-	BYTE *op = (BYTE *) dest;
-	BYTE * const oend = op + maxoutputsize;
-	BYTE *cpy;
-
-	/* Main Loop */
-	while (ip < iend) {
-
-		unsigned token;
-		size_t length;
-
-		/* get runlength */
-		token = *ip++;
-		length = (token >> ML_BITS);
-		if (length == RUN_MASK) {
-			int s = 255;
-			while ((ip < iend) && (s == 255)) {
-				s = *ip++;
-				if (unlikely(length > (size_t)(length + s)))
-					goto _output_error;
-				length += s;
-			}
-		}
-		/* copy literals */
-		cpy = op + length;
-		if ((cpy > oend - COPYLENGTH) ||
-			(ip + length > iend - COPYLENGTH)) {
-
-			if (cpy > oend)
-				goto _output_error;/* writes beyond buffer */
-
-			if (ip + length != iend)
-				goto _output_error;/*
-						    * Error: LZ4 format requires
-						    * to consume all input
-						    * at this stage
-						    */
-			memcpy(op, ip, length);
-			op += length;
-			break;/* Necessarily EOF, due to parsing restrictions */
-		}
-		LZ4_WILDCOPY(ip, op, cpy);
-		ip -= (op - cpy);
-		op = cpy;
-
-		/* get offset */
-		LZ4_READ_LITTLEENDIAN_16(ref, cpy, ip);
-		ip += 2;
-		if (ref < (BYTE * const) dest)
-			goto _output_error;
-			/*
-			 * Error : offset creates reference
-			 * outside of destination buffer
-			 */
-
-		/* get matchlength */
-		length = (token & ML_MASK);
-		if (length == ML_MASK) {
-			while (ip < iend) {
-				int s = *ip++;
-				if (unlikely(length > (size_t)(length + s)))
-					goto _output_error;
-				length += s;
-				if (s == 255)
-					continue;
-				break;
-			}
-		}
-
-		/* copy repeated sequence */
-		if (unlikely((op - ref) < STEPSIZE)) {
-#if LZ4_ARCH64
-			int dec64 = dec64table[op - ref];
-#else
-			const int dec64 = 0;
-#endif
-				op[0] = ref[0];
-				op[1] = ref[1];
-				op[2] = ref[2];
-				op[3] = ref[3];
-				op += 4;
-				ref += 4;
-				ref -= dec32table[op - ref];
-				PUT4(ref, op);
-				op += STEPSIZE - 4;
-				ref -= dec64;
-		} else {
-			LZ4_COPYSTEP(ref, op);
-		}
-		cpy = op + length - (STEPSIZE-4);
-		if (cpy > oend - COPYLENGTH) {
-			if (cpy > oend)
-				goto _output_error; /* write outside of buf */
-#if LZ4_ARCH64
-			if ((ref + COPYLENGTH) > oend)
-#else
-			if ((ref + COPYLENGTH) > oend ||
-					(op + COPYLENGTH) > oend)
-#endif
-				goto _output_error;
-			LZ4_SECURECOPY(ref, op, (oend - COPYLENGTH));
-			while (op < cpy)
-				*op++ = *ref++;
-			op = cpy;
-			/*
-			 * Check EOF (should never happen, since last 5 bytes
-			 * are supposed to be literals)
-			 */
-			if (op == oend)
-				goto _output_error;
-			continue;
-		}
-		LZ4_SECURECOPY(ref, op, cpy);
-		op = cpy; /* correction */
-	}
-	/* end of decoding */
-	return (int) (((char *) op) - dest);
-
-	/* write overflow error detected */
-_output_error:
-	return -1;
+	return lz4_decompress_generic((const u8 *)source, (u8 *)dest, isize,
+				      maxoutputsize, true);
 }
 
 int lz4_decompress(const unsigned char *src, size_t *src_len,
@@ -157,3 +157,33 @@ typedef struct _U64_S { u64 v; } U64_S;
 		LZ4_WILDCOPY(s, d, e);	\
 		d = e;	\
 	} while (0)
+
+/*
+ * Word at a time helpers, the decompressor copies literals and matches in
+ * 8 byte steps and may write up to WILDCOPYLENGTH bytes beyond their end.
+ */
+#define WILDCOPYLENGTH	8
+
+static __always_inline void lz4_copy8(void *dst, const void *src)
+{
+#if LZ4_ARCH64
+	put_unaligned(get_unaligned((const u64 *)src), (u64 *)dst);
+#else
+	put_unaligned(get_unaligned((const u32 *)src), (u32 *)dst);
+	put_unaligned(get_unaligned((const u32 *)src + 1), (u32 *)dst + 1);
+#endif
+}
+
+static __always_inline void lz4_wildcopy(void *dst, const void *src,
+					 void *dst_end)
+{
+	u8 *d = dst;
+	const u8 *s = src;
+	u8 *const e = dst_end;
+
+	do {
+		lz4_copy8(d, s);
+		d += 8;
+		s += 8;
+	} while (d < e);
+}
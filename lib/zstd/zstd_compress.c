@@ -0,0 +1,1698 @@
+/*
+ * Zstandard compression
+ *
+ * Matches are found with a hash table, backed by hash chains on the higher
+ * levels, optionally looking one or two bytes ahead for a better match
+ * before committing to one. Literals are Huffman coded, the sequences use
+ * FSE tables that are either the predefined ones or built for the block,
+ * whichever is cheaper. Blocks that do not shrink are stored raw.
+ *
+ * All tables live in the workspace handed to zstd_init_cctx() or
+ * zstd_init_cstream(), the streaming compressor additionally keeps a window
+ * of input there so that matches can reach back into earlier blocks.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/sort.h>
+#include <linux/string.h>
+#include <linux/zstd.h>
+#include <asm/unaligned.h>
+
+#include "zstd_internal.h"
+
+/* Positions skipped grow with the distance from the last match */
+#define ZSTD_SEARCH_STRENGTH	8
+/* Below this many literals Huffman coding does not pay off */
+#define ZSTD_MIN_HUF_LITERALS	64
+/* Smallest match the match finder looks for */
+#define ZSTD_MIN_MATCH_SEARCH	4
+
+#define ZSTD_ERROR(e)	((size_t)-(e))
+
+struct zstd_seq {
+	u32 lit_length;
+	u32 match_length;
+	u32 offset_value;	/* 1 for the last offset, offset + 3 otherwise */
+};
+
+/*
+ * Bit stream writer, filling bytes from their low bit up. Read backwards
+ * by the decoder once it has an end mark.
+ */
+struct zstd_bitc {
+	u64 container;
+	unsigned int nb_bits;
+	u8 *start;
+	u8 *ptr;
+	u8 *end;
+	bool overflow;
+};
+
+struct zstd_fse_ctable {
+	u16 state_table[1 << ZSTD_LL_FSE_LOG];
+	struct {
+		s32 delta_find_state;
+		u32 delta_nb_bits;
+	} symbol_tt[ZSTD_MAX_SEQ_SYMBOL + 1];
+	unsigned int table_log;
+	bool rle;
+};
+
+struct zstd_fse_cstate {
+	u32 value;
+	const struct zstd_fse_ctable *ct;
+};
+
+struct zstd_huf_node {
+	u32 count;
+	u16 parent;
+	u8 symbol;
+	u8 nb_bits;
+};
+
+struct zstd_cctx {
+	struct zstd_parameters params;
+	u8 *workspace;
+	size_t workspace_size;
+	size_t block_size;
+
+	/* Match finder, indices are relative to @base */
+	const u8 *base;
+	u32 *hash_table;
+	u32 *chain_table;
+	u32 next_to_update;
+	u32 low_limit;
+	u32 rep[ZSTD_REP_NUM];
+
+	/* Sequences and literals of the block being compressed */
+	struct zstd_seq *seqs;
+	size_t nb_seq;
+	u8 *lits;
+	size_t nb_lits;
+	u8 *ll_codes;
+	u8 *ml_codes;
+	u8 *of_codes;
+
+	/* Entropy coding */
+	struct zstd_fse_ctable ll_ct;
+	struct zstd_fse_ctable of_ct;
+	struct zstd_fse_ctable ml_ct;
+	struct zstd_fse_ctable weight_ct;
+	u16 huf_code[ZSTD_HUF_MAX_SYMBOL + 1];
+	u8 huf_bits[ZSTD_HUF_MAX_SYMBOL + 1];
+	u8 weights[ZSTD_HUF_MAX_SYMBOL + 1];
+	struct zstd_huf_node huf_nodes[2 * (ZSTD_HUF_MAX_SYMBOL + 1)];
+	u32 count[ZSTD_HUF_MAX_SYMBOL + 1];
+	s16 norm[ZSTD_MAX_SEQ_SYMBOL + 1];
+	u8 spread[1 << ZSTD_LL_FSE_LOG];
+
+	struct xxh64_state xxh;
+};
+
+struct zstd_cstream {
+	struct zstd_cctx cctx;
+	unsigned long long pledged_src_size;
+	unsigned long long consumed;
+	bool frame_ended;
+
+	/* Input window, the block being gathered starts at @block_start */
+	u8 *in_buf;
+	size_t in_buf_size;
+	size_t in_end;
+	size_t block_start;
+
+	/* Compressed output waiting to be handed to the caller */
+	u8 *out_buf;
+	size_t out_buf_size;
+	size_t out_len;
+	size_t out_flushed;
+};
+
+static const struct zstd_compression_parameters zstd_clevels[ZSTD_MAX_CLEVEL] = {
+	/*  W,  C,  H, S, MM, strategy */
+	{ 19,  0, 14, 0, 6, ZSTD_fast },	/* level 1 */
+	{ 19,  0, 16, 0, 5, ZSTD_fast },	/* level 2 */
+	{ 20, 16, 17, 1, 5, ZSTD_greedy },	/* level 3 */
+	{ 20, 17, 18, 2, 5, ZSTD_greedy },	/* level 4 */
+	{ 20, 17, 18, 2, 5, ZSTD_lazy },	/* level 5 */
+	{ 21, 18, 19, 3, 5, ZSTD_lazy },	/* level 6 */
+	{ 21, 18, 19, 3, 4, ZSTD_lazy },	/* level 7 */
+	{ 21, 19, 19, 4, 4, ZSTD_lazy },	/* level 8 */
+	{ 21, 19, 19, 4, 4, ZSTD_lazy2 },	/* level 9 */
+	{ 21, 20, 20, 5, 4, ZSTD_lazy2 },	/* level 10 */
+	{ 22, 20, 20, 5, 4, ZSTD_lazy2 },	/* level 11 */
+	{ 22, 20, 21, 6, 4, ZSTD_lazy2 },	/* level 12 */
+	{ 22, 21, 21, 6, 4, ZSTD_lazy2 },	/* level 13 */
+	{ 22, 21, 22, 7, 4, ZSTD_lazy2 },	/* level 14 */
+	{ 22, 22, 22, 8, 4, ZSTD_lazy2 },	/* level 15 */
+};
+
+static const u8 zstd_ll_code_table[64] = {
+	0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15,
+	16, 16, 17, 17, 18, 18, 19, 19, 20, 20, 20, 20, 21, 21, 21, 21,
+	22, 22, 22, 22, 22, 22, 22, 22, 23, 23, 23, 23, 23, 23, 23, 23,
+	24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24,
+};
+
+static const u8 zstd_ml_code_table[128] = {
+	0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15,
+	16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30, 31,
+	32, 32, 33, 33, 34, 34, 35, 35, 36, 36, 36, 36, 37, 37, 37, 37,
+	38, 38, 38, 38, 38, 38, 38, 38, 39, 39, 39, 39, 39, 39, 39, 39,
+	40, 40, 40, 40, 40, 40, 40, 40, 40, 40, 40, 40, 40, 40, 40, 40,
+	41, 41, 41, 41, 41, 41, 41, 41, 41, 41, 41, 41, 41, 41, 41, 41,
+	42, 42, 42, 42, 42, 42, 42, 42, 42, 42, 42, 42, 42, 42, 42, 42,
+	42, 42, 42, 42, 42, 42, 42, 42, 42, 42, 42, 42, 42, 42, 42, 42,
+};
+
+static inline unsigned int zstd_ll_code(u32 ll)
+{
+	return ll < 64 ? zstd_ll_code_table[ll] : zstd_highbit(ll) + 19;
+}
+
+static inline unsigned int zstd_ml_code(u32 ml)
+{
+	u32 mlb = ml - ZSTD_MINMATCH;
+
+	return mlb < 128 ? zstd_ml_code_table[mlb] : zstd_highbit(mlb) + 36;
+}
+
+/* Bit stream writer */
+
+static void zstd_bitc_init(struct zstd_bitc *bc, u8 *dst, size_t cap)
+{
+	bc->container = 0;
+	bc->nb_bits = 0;
+	bc->start = dst;
+	bc->ptr = dst;
+	bc->end = dst + cap;
+	bc->overflow = false;
+}
+
+/* At most 57 bits may be pending between two flushes */
+static inline void zstd_bitc_add(struct zstd_bitc *bc, u32 value,
+				 unsigned int nb)
+{
+	bc->container |= (u64)(value & ((1ULL << nb) - 1)) << bc->nb_bits;
+	bc->nb_bits += nb;
+}
+
+static inline void zstd_bitc_flush(struct zstd_bitc *bc)
+{
+	unsigned int nb_bytes = bc->nb_bits >> 3;
+
+	if (likely(bc->ptr + 8 <= bc->end)) {
+		put_unaligned_le64(bc->container, bc->ptr);
+		bc->ptr += nb_bytes;
+	} else {
+		unsigned int i;
+
+		for (i = 0; i < nb_bytes; i++) {
+			if (bc->ptr >= bc->end) {
+				bc->overflow = true;
+				break;
+			}
+			*bc->ptr++ = bc->container >> (8 * i);
+		}
+	}
+	bc->container >>= 8 * nb_bytes;
+	bc->nb_bits &= 7;
+}
+
+/* Flush the last partial byte; returns the stream size, 0 if it did not fit */
+static size_t zstd_bitc_finish(struct zstd_bitc *bc)
+{
+	zstd_bitc_flush(bc);
+	if (bc->nb_bits) {
+		if (bc->ptr >= bc->end)
+			return 0;
+		*bc->ptr++ = bc->container;
+	}
+	return bc->overflow ? 0 : bc->ptr - bc->start;
+}
+
+/* As above, with the end mark the decoder looks for */
+static size_t zstd_bitc_close(struct zstd_bitc *bc)
+{
+	zstd_bitc_add(bc, 1, 1);
+	return zstd_bitc_finish(bc);
+}
+
+/* FSE */
+
+static unsigned int zstd_fse_table_log(unsigned int max_log, size_t total,
+				       unsigned int max_symbol)
+{
+	int max_bits_src = (int)zstd_highbit(total - 1) - 2;
+	unsigned int min_bits = min(zstd_highbit(total) + 1,
+				    zstd_highbit(max_symbol) + 2);
+	int log = max_log;
+
+	if (max_bits_src < log)
+		log = max_bits_src;
+	if ((int)min_bits > log)
+		log = min_bits;
+	return clamp_t(int, log, ZSTD_FSE_MIN_LOG, max_log);
+}
+
+/*
+ * Scale the symbol counts to probabilities summing up to 1 << @log, every
+ * symbol that occurs getting at least 1.
+ */
+static int zstd_fse_normalize(s16 *norm, unsigned int log, const u32 *count,
+			      size_t total, unsigned int max_symbol)
+{
+	u32 size = 1U << log;
+	unsigned int s, largest = 0;
+	int diff = size;
+
+	for (s = 0; s <= max_symbol; s++) {
+		u32 p;
+
+		if (!count[s]) {
+			norm[s] = 0;
+			continue;
+		}
+		p = ((u64)count[s] * size + total / 2) / total;
+		norm[s] = max_t(u32, p, 1);
+		diff -= norm[s];
+		if (count[s] > count[largest])
+			largest = s;
+	}
+
+	if (diff > 0)
+		norm[largest] += diff;
+
+	while (diff < 0) {
+		unsigned int big = 0;
+
+		for (s = 1; s <= max_symbol; s++)
+			if (norm[s] > norm[big])
+				big = s;
+		if (norm[big] <= 1)
+			return -EINVAL;
+		norm[big]--;
+		diff++;
+	}
+	return 0;
+}
+
+/* The table description read back by the decoder's zstd_read_ncount() */
+static size_t zstd_write_ncount(u8 *dst, size_t cap, const s16 *norm,
+				unsigned int max_symbol, unsigned int log)
+{
+	int remaining = (1 << log) + 1;
+	int threshold = 1 << log;
+	unsigned int nb_bits = log + 1;
+	unsigned int s = 0;
+	bool prev0 = false;
+	struct zstd_bitc bc;
+
+	zstd_bitc_init(&bc, dst, cap);
+	zstd_bitc_add(&bc, log - ZSTD_FSE_MIN_LOG, 4);
+
+	while (remaining > 1 && s <= max_symbol) {
+		int count, max_v;
+
+		if (prev0) {
+			unsigned int start = s;
+
+			while (!norm[s])
+				s++;
+			while (s >= start + 24) {
+				start += 24;
+				zstd_bitc_add(&bc, 0xFFFF, 16);
+				zstd_bitc_flush(&bc);
+			}
+			while (s >= start + 3) {
+				start += 3;
+				zstd_bitc_add(&bc, 3, 2);
+			}
+			zstd_bitc_add(&bc, s - start, 2);
+			zstd_bitc_flush(&bc);
+		}
+
+		count = norm[s++];
+		max_v = (2 * threshold - 1) - remaining;
+		remaining -= count < 0 ? -count : count;
+		count++;
+		if (count >= threshold)
+			count += max_v;
+		zstd_bitc_add(&bc, count, nb_bits - (count < max_v));
+		zstd_bitc_flush(&bc);
+		prev0 = count == 1;
+		while (remaining < threshold) {
+			nb_bits--;
+			threshold >>= 1;
+		}
+	}
+
+	return zstd_bitc_finish(&bc);
+}
+
+static void zstd_build_fse_ctable(struct zstd_fse_ctable *ct, const s16 *norm,
+				  unsigned int max_symbol, unsigned int log,
+				  u8 *spread)
+{
+	u32 size = 1U << log;
+	u32 cumul[ZSTD_MAX_SEQ_SYMBOL + 2];
+	unsigned int s, u;
+	int total = 0;
+
+	zstd_fse_spread(spread, norm, max_symbol, log);
+
+	cumul[0] = 0;
+	for (s = 0; s <= max_symbol; s++)
+		cumul[s + 1] = cumul[s] + (norm[s] == -1 ? 1 : norm[s]);
+	for (u = 0; u < size; u++)
+		ct->state_table[cumul[spread[u]]++] = size + u;
+
+	for (s = 0; s <= max_symbol; s++) {
+		unsigned int max_bits_out;
+
+		switch (norm[s]) {
+		case 0:
+			break;
+		case -1:
+		case 1:
+			ct->symbol_tt[s].delta_nb_bits = (log << 16) - size;
+			ct->symbol_tt[s].delta_find_state = total - 1;
+			total++;
+			break;
+		default:
+			max_bits_out = log - zstd_highbit(norm[s] - 1);
+			ct->symbol_tt[s].delta_nb_bits = (max_bits_out << 16) -
+							 (norm[s] << max_bits_out);
+			ct->symbol_tt[s].delta_find_state = total - norm[s];
+			total += norm[s];
+			break;
+		}
+	}
+
+	ct->table_log = log;
+	ct->rle = false;
+}
+
+/* Start encoding with the state for the last symbol, costing no bits */
+static void zstd_fse_init_state(struct zstd_fse_cstate *st,
+				const struct zstd_fse_ctable *ct,
+				unsigned int symbol)
+{
+	u32 delta, nb, value;
+
+	st->ct = ct;
+	st->value = 0;
+	if (ct->rle)
+		return;
+	delta = ct->symbol_tt[symbol].delta_nb_bits;
+	nb = (delta + (1 << 15)) >> 16;
+	value = (nb << 16) - delta;
+	st->value = ct->state_table[(value >> nb) +
+				    ct->symbol_tt[symbol].delta_find_state];
+}
+
+static inline void zstd_fse_encode(struct zstd_bitc *bc,
+				   struct zstd_fse_cstate *st,
+				   unsigned int symbol)
+{
+	const struct zstd_fse_ctable *ct = st->ct;
+	u32 nb;
+
+	if (ct->rle)
+		return;
+	nb = (st->value + ct->symbol_tt[symbol].delta_nb_bits) >> 16;
+	zstd_bitc_add(bc, st->value, nb);
+	st->value = ct->state_table[(st->value >> nb) +
+				    ct->symbol_tt[symbol].delta_find_state];
+}
+
+static inline void zstd_fse_flush_state(struct zstd_bitc *bc,
+					const struct zstd_fse_cstate *st)
+{
+	if (!st->ct->rle)
+		zstd_bitc_add(bc, st->value, st->ct->table_log);
+}
+
+/* Approximate cost in bits of coding @count with a distribution */
+static u32 zstd_fse_cost(const u32 *count, unsigned int max_symbol,
+			 const s16 *norm, unsigned int norm_max,
+			 unsigned int log)
+{
+	u64 cost = 0;
+	unsigned int s;
+
+	for (s = 0; s <= max_symbol; s++) {
+		u32 p, hb;
+
+		if (!count[s])
+			continue;
+		if (s > norm_max || !norm[s])
+			return UINT_MAX;
+		p = norm[s] == -1 ? 1 : norm[s];
+		hb = zstd_highbit(p);
+		/* log2(p) in 8.8 fixed point, linear between powers of 2 */
+		cost += (u64)count[s] *
+			((log << 8) - ((hb << 8) + ((p << 8) >> hb) - 256));
+	}
+	return min_t(u64, cost >> 8, UINT_MAX - 1);
+}
+
+/* Huffman */
+
+static int zstd_huf_node_cmp(const void *a, const void *b)
+{
+	const struct zstd_huf_node *na = a, *nb = b;
+
+	if (na->count != nb->count)
+		return na->count < nb->count ? -1 : 1;
+	return na->symbol < nb->symbol ? -1 : 1;
+}
+
+/*
+ * Build a Huffman code for the literal counts in cctx->count, with codes
+ * no longer than ZSTD_HUF_MAX_LOG bits. Returns the longest code length.
+ */
+static unsigned int zstd_build_huf(struct zstd_cctx *cctx,
+				   unsigned int max_symbol)
+{
+	struct zstd_huf_node *nodes = cctx->huf_nodes;
+	u32 rank_count[ZSTD_HUF_MAX_LOG + 2] = { 0 };
+	u32 rank_start[ZSTD_HUF_MAX_LOG + 2];
+	u32 kraft = 0, target = 1U << ZSTD_HUF_MAX_LOG;
+	unsigned int n = 0, next, leaf, inner, max_bits = 0;
+	unsigned int s, i, w;
+	int j;
+
+	for (s = 0; s <= max_symbol; s++) {
+		cctx->huf_bits[s] = 0;
+		if (!cctx->count[s])
+			continue;
+		nodes[n].count = cctx->count[s];
+		nodes[n].symbol = s;
+		n++;
+	}
+	sort(nodes, n, sizeof(*nodes), zstd_huf_node_cmp, NULL);
+
+	/* Two queues: the sorted leaves and the inner nodes as created */
+	leaf = 0;
+	inner = n;
+	for (next = n; next < 2 * n - 1; next++) {
+		unsigned int pick[2];
+
+		for (i = 0; i < 2; i++) {
+			if (leaf < n && (inner >= next ||
+					 nodes[leaf].count <= nodes[inner].count))
+				pick[i] = leaf++;
+			else
+				pick[i] = inner++;
+		}
+		nodes[next].count = nodes[pick[0]].count + nodes[pick[1]].count;
+		nodes[pick[0]].parent = next;
+		nodes[pick[1]].parent = next;
+	}
+	nodes[2 * n - 2].nb_bits = 0;
+	for (j = 2 * n - 3; j >= 0; j--)
+		nodes[j].nb_bits = nodes[nodes[j].parent].nb_bits + 1;
+
+	/* Cap the code lengths, then restore a complete code */
+	for (i = 0; i < n; i++) {
+		if (nodes[i].nb_bits > ZSTD_HUF_MAX_LOG)
+			nodes[i].nb_bits = ZSTD_HUF_MAX_LOG;
+		kraft += target >> nodes[i].nb_bits;
+	}
+	while (kraft > target) {
+		for (i = 0; nodes[i].nb_bits >= ZSTD_HUF_MAX_LOG; i++)
+			;
+		nodes[i].nb_bits++;
+		kraft -= target >> nodes[i].nb_bits;
+	}
+	while (kraft < target) {
+		for (j = n - 1; j >= 0; j--) {
+			if (nodes[j].nb_bits > 1 &&
+			    kraft + (target >> nodes[j].nb_bits) <= target) {
+				kraft += target >> nodes[j].nb_bits;
+				nodes[j].nb_bits--;
+				break;
+			}
+		}
+	}
+
+	for (i = 0; i < n; i++) {
+		cctx->huf_bits[nodes[i].symbol] = nodes[i].nb_bits;
+		max_bits = max_t(unsigned int, max_bits, nodes[i].nb_bits);
+	}
+
+	/* Codes are handed out in the order the decoder fills its table */
+	for (s = 0; s <= max_symbol; s++) {
+		w = cctx->huf_bits[s] ? max_bits + 1 - cctx->huf_bits[s] : 0;
+		cctx->weights[s] = w;
+		rank_count[w]++;
+	}
+	rank_start[1] = 0;
+	for (w = 1; w <= max_bits; w++)
+		rank_start[w + 1] = rank_start[w] + (rank_count[w] << (w - 1));
+	for (s = 0; s <= max_symbol; s++) {
+		w = cctx->weights[s];
+		if (!w)
+			continue;
+		cctx->huf_code[s] = rank_start[w] >> (w - 1);
+		rank_start[w] += 1U << (w - 1);
+	}
+
+	return max_bits;
+}
+
+/* FSE coded Huffman weights, two states taking turns */
+static size_t zstd_compress_weights(struct zstd_cctx *cctx, u8 *dst,
+				    size_t cap, unsigned int n)
+{
+	struct zstd_fse_cstate st[2];
+	unsigned int max_w = 0, log, i;
+	u32 count[ZSTD_HUF_MAX_LOG + 1] = { 0 };
+	struct zstd_bitc bc;
+	size_t hdr, body;
+
+	for (i = 0; i < n; i++) {
+		count[cctx->weights[i]]++;
+		max_w = max_t(unsigned int, max_w, cctx->weights[i]);
+	}
+	for (i = 0; i <= max_w; i++)
+		if (count[i] == n)
+			return 0;
+
+	log = zstd_fse_table_log(ZSTD_HUF_WEIGHT_FSE_LOG, n, max_w);
+	if (zstd_fse_normalize(cctx->norm, log, count, n, max_w))
+		return 0;
+	hdr = zstd_write_ncount(dst, cap, cctx->norm, max_w, log);
+	if (!hdr)
+		return 0;
+	zstd_build_fse_ctable(&cctx->weight_ct, cctx->norm, max_w, log,
+			      cctx->spread);
+
+	zstd_bitc_init(&bc, dst + hdr, cap - hdr);
+	zstd_fse_init_state(&st[(n - 1) & 1], &cctx->weight_ct,
+			    cctx->weights[n - 1]);
+	zstd_fse_init_state(&st[(n - 2) & 1], &cctx->weight_ct,
+			    cctx->weights[n - 2]);
+	for (i = n - 2; i-- > 0; ) {
+		zstd_fse_encode(&bc, &st[i & 1], cctx->weights[i]);
+		zstd_bitc_flush(&bc);
+	}
+	zstd_fse_flush_state(&bc, &st[1]);
+	zstd_fse_flush_state(&bc, &st[0]);
+	body = zstd_bitc_close(&bc);
+
+	return body ? hdr + body : 0;
+}
+
+/* Huffman tree description, the weight of @max_symbol is implied */
+static size_t zstd_write_huf_tree(struct zstd_cctx *cctx, u8 *dst, size_t cap,
+				  unsigned int max_symbol)
+{
+	unsigned int n = max_symbol, i;
+	size_t direct = (n + 1) / 2, size = 0;
+
+	if (cap < 2)
+		return 0;
+
+	if (n > 2)
+		size = zstd_compress_weights(cctx, dst + 1,
+					     min_t(size_t, cap - 1, 127), n);
+	if (size && (size < direct || n > 128)) {
+		dst[0] = size;
+		return size + 1;
+	}
+
+	if (n > 128 || cap < direct + 1)
+		return 0;
+	dst[0] = 127 + n;
+	for (i = 0; i < n; i += 2)
+		dst[1 + i / 2] = (cctx->weights[i] << 4) |
+				 (i + 1 < n ? cctx->weights[i + 1] : 0);
+	return direct + 1;
+}
+
+static size_t zstd_huf_encode_stream(const struct zstd_cctx *cctx, u8 *dst,
+				     size_t cap, const u8 *src, size_t n)
+{
+	struct zstd_bitc bc;
+
+	zstd_bitc_init(&bc, dst, cap);
+	while (n--) {
+		zstd_bitc_add(&bc, cctx->huf_code[src[n]],
+			      cctx->huf_bits[src[n]]);
+		if (!(n & 3))
+			zstd_bitc_flush(&bc);
+	}
+	return zstd_bitc_close(&bc);
+}
+
+static size_t zstd_huf_encode_4streams(const struct zstd_cctx *cctx, u8 *dst,
+				       size_t cap, const u8 *src, size_t n)
+{
+	size_t seg = (n + 3) / 4;
+	size_t pos = 6, len;
+	int i;
+
+	if (cap < 6 + 4)
+		return 0;
+	for (i = 0; i < 4; i++) {
+		size_t this = i < 3 ? seg : n - 3 * seg;
+
+		len = zstd_huf_encode_stream(cctx, dst + pos, cap - pos,
+					     src + i * seg, this);
+		if (!len)
+			return 0;
+		if (i < 3) {
+			if (len > 0xFFFF)
+				return 0;
+			put_unaligned_le16(len, dst + 2 * i);
+		}
+		pos += len;
+	}
+	return pos;
+}
+
+/* Literals section */
+
+static size_t zstd_write_raw_literals(u8 *dst, size_t cap, const u8 *src,
+				      size_t size, enum zstd_literals_type type)
+{
+	size_t hs = size < 32 ? 1 : size < 4096 ? 2 : 3;
+	size_t body = type == ZSTD_LITS_RLE ? 1 : size;
+
+	if (cap < hs + body)
+		return 0;
+
+	switch (hs) {
+	case 1:
+		dst[0] = type | (size << 3);
+		break;
+	case 2:
+		put_unaligned_le16(type | (1 << 2) | (size << 4), dst);
+		break;
+	default:
+		dst[0] = type | (3 << 2) | (size << 4);
+		dst[1] = size >> 4;
+		dst[2] = size >> 12;
+		break;
+	}
+	memcpy(dst + hs, src, body);
+	return hs + body;
+}
+
+static size_t zstd_compress_literals(struct zstd_cctx *cctx, u8 *dst,
+				     size_t cap)
+{
+	const u8 *src = cctx->lits;
+	size_t size = cctx->nb_lits;
+	unsigned int max_symbol = 0, s;
+	size_t max_count = 0, hs, tree, streams, clit, i;
+	bool single = size < 256;
+	u32 lhc;
+
+	if (size < ZSTD_MIN_HUF_LITERALS)
+		return zstd_write_raw_literals(dst, cap, src, size,
+					       ZSTD_LITS_RAW);
+
+	memset(cctx->count, 0, sizeof(cctx->count));
+	for (i = 0; i < size; i++)
+		cctx->count[src[i]]++;
+	for (s = 0; s <= ZSTD_HUF_MAX_SYMBOL; s++) {
+		if (!cctx->count[s])
+			continue;
+		max_symbol = s;
+		max_count = max_t(size_t, max_count, cctx->count[s]);
+	}
+	if (max_count == size)
+		return zstd_write_raw_literals(dst, cap, src, size,
+					       ZSTD_LITS_RLE);
+	if (max_count <= (size >> 7) + 4)
+		goto raw;
+
+	zstd_build_huf(cctx, max_symbol);
+
+	hs = size < 1024 ? 3 : size < 16384 ? 4 : 5;
+	if (cap <= hs)
+		goto raw;
+	tree = zstd_write_huf_tree(cctx, dst + hs, cap - hs, max_symbol);
+	if (!tree)
+		goto raw;
+	if (single)
+		streams = zstd_huf_encode_stream(cctx, dst + hs + tree,
+						 cap - hs - tree, src, size);
+	else
+		streams = zstd_huf_encode_4streams(cctx, dst + hs + tree,
+						   cap - hs - tree, src, size);
+	if (!streams)
+		goto raw;
+	clit = tree + streams;
+	if (hs + clit >= size - (size >> 6))
+		goto raw;
+
+	switch (hs) {
+	case 3:
+		lhc = ZSTD_LITS_COMPRESSED | (!single << 2) | (size << 4) |
+		      (clit << 14);
+		dst[0] = lhc;
+		dst[1] = lhc >> 8;
+		dst[2] = lhc >> 16;
+		break;
+	case 4:
+		lhc = ZSTD_LITS_COMPRESSED | (2 << 2) | (size << 4) |
+		      (clit << 18);
+		put_unaligned_le32(lhc, dst);
+		break;
+	default:
+		lhc = ZSTD_LITS_COMPRESSED | (3 << 2) | (size << 4) |
+		      (clit << 22);
+		put_unaligned_le32(lhc, dst);
+		dst[4] = clit >> 10;
+		break;
+	}
+	return hs + clit;
+
+raw:
+	return zstd_write_raw_literals(dst, cap, src, size, ZSTD_LITS_RAW);
+}
+
+/* Sequences section */
+
+/*
+ * Pick the cheapest way to code one of the sequence fields, write its
+ * table description to *@opp and set up @ct. Returns the mode.
+ */
+static int zstd_select_seq_table(struct zstd_cctx *cctx,
+				 struct zstd_fse_ctable *ct,
+				 u8 **opp, u8 *oend,
+				 const u8 *codes, size_t nb_seq,
+				 unsigned int max_symbol, unsigned int max_log,
+				 const s16 *default_norm,
+				 unsigned int default_max,
+				 unsigned int default_log)
+{
+	u32 *count = cctx->count;
+	unsigned int max = 0, log, s;
+	u32 default_cost, cost = UINT_MAX;
+	size_t max_count = 0, hdr = 0, i;
+
+	memset(count, 0, (max_symbol + 1) * sizeof(*count));
+	for (i = 0; i < nb_seq; i++)
+		count[codes[i]]++;
+	for (s = 0; s <= max_symbol; s++) {
+		if (!count[s])
+			continue;
+		max = s;
+		max_count = max_t(size_t, max_count, count[s]);
+	}
+
+	if (max_count == nb_seq) {
+		if (*opp >= oend)
+			return -ENOSPC;
+		*(*opp)++ = codes[0];
+		ct->rle = true;
+		ct->table_log = 0;
+		return ZSTD_SEQ_RLE;
+	}
+
+	default_cost = zstd_fse_cost(count, max, default_norm, default_max,
+				     default_log);
+
+	log = zstd_fse_table_log(max_log, nb_seq, max);
+	if (!zstd_fse_normalize(cctx->norm, log, count, nb_seq, max)) {
+		hdr = zstd_write_ncount(*opp, oend - *opp, cctx->norm, max,
+					log);
+		if (hdr)
+			cost = hdr * 8 + zstd_fse_cost(count, max, cctx->norm,
+						       max, log);
+	}
+
+	if (default_cost <= cost) {
+		if (default_cost == UINT_MAX)
+			return -ENOSPC;
+		zstd_build_fse_ctable(ct, default_norm, default_max,
+				      default_log, cctx->spread);
+		return ZSTD_SEQ_PREDEFINED;
+	}
+
+	zstd_build_fse_ctable(ct, cctx->norm, max, log, cctx->spread);
+	*opp += hdr;
+	return ZSTD_SEQ_COMPRESSED;
+}
+
+static size_t zstd_compress_sequences(struct zstd_cctx *cctx, u8 *dst,
+				      size_t cap)
+{
+	const struct zstd_seq *seqs = cctx->seqs;
+	size_t nb_seq = cctx->nb_seq, i;
+	u8 *op = dst, *oend = dst + cap, *modes;
+	struct zstd_fse_cstate ll_st, of_st, ml_st;
+	int ll_mode, of_mode, ml_mode;
+	struct zstd_bitc bc;
+	size_t len;
+
+	if (cap < 4)
+		return 0;
+	if (nb_seq < 128) {
+		*op++ = nb_seq;
+	} else if (nb_seq < 0x7F00) {
+		*op++ = (nb_seq >> 8) + 128;
+		*op++ = nb_seq;
+	} else {
+		*op++ = 255;
+		put_unaligned_le16(nb_seq - 0x7F00, op);
+		op += 2;
+	}
+	if (!nb_seq)
+		return op - dst;
+
+	for (i = 0; i < nb_seq; i++) {
+		cctx->ll_codes[i] = zstd_ll_code(seqs[i].lit_length);
+		cctx->ml_codes[i] = zstd_ml_code(seqs[i].match_length);
+		cctx->of_codes[i] = zstd_highbit(seqs[i].offset_value);
+	}
+
+	modes = op++;
+	ll_mode = zstd_select_seq_table(cctx, &cctx->ll_ct, &op, oend,
+					cctx->ll_codes, nb_seq, ZSTD_MAX_LL,
+					ZSTD_LL_FSE_LOG, zstd_ll_default_norm,
+					ZSTD_MAX_LL, ZSTD_LL_DEFAULT_LOG);
+	if (ll_mode < 0)
+		return 0;
+	of_mode = zstd_select_seq_table(cctx, &cctx->of_ct, &op, oend,
+					cctx->of_codes, nb_seq, ZSTD_MAX_OF,
+					ZSTD_OF_FSE_LOG, zstd_of_default_norm,
+					ZSTD_OF_DEFAULT_MAX,
+					ZSTD_OF_DEFAULT_LOG);
+	if (of_mode < 0)
+		return 0;
+	ml_mode = zstd_select_seq_table(cctx, &cctx->ml_ct, &op, oend,
+					cctx->ml_codes, nb_seq, ZSTD_MAX_ML,
+					ZSTD_ML_FSE_LOG, zstd_ml_default_norm,
+					ZSTD_MAX_ML, ZSTD_ML_DEFAULT_LOG);
+	if (ml_mode < 0)
+		return 0;
+	*modes = (ll_mode << 6) | (of_mode << 4) | (ml_mode << 2);
+
+	/*
+	 * The decoder reads the sequences front to back from the end of the
+	 * stream, so write them back to front.
+	 */
+	zstd_bitc_init(&bc, op, oend - op);
+	i = nb_seq - 1;
+	zstd_fse_init_state(&ml_st, &cctx->ml_ct, cctx->ml_codes[i]);
+	zstd_fse_init_state(&of_st, &cctx->of_ct, cctx->of_codes[i]);
+	zstd_fse_init_state(&ll_st, &cctx->ll_ct, cctx->ll_codes[i]);
+	for (;;) {
+		unsigned int ll_code = cctx->ll_codes[i];
+		unsigned int ml_code = cctx->ml_codes[i];
+		unsigned int of_code = cctx->of_codes[i];
+
+		zstd_bitc_add(&bc, seqs[i].lit_length - zstd_ll_base[ll_code],
+			      zstd_ll_bits[ll_code]);
+		zstd_bitc_add(&bc, seqs[i].match_length - zstd_ml_base[ml_code],
+			      zstd_ml_bits[ml_code]);
+		zstd_bitc_flush(&bc);
+		zstd_bitc_add(&bc, seqs[i].offset_value - (1U << of_code),
+			      of_code);
+		zstd_bitc_flush(&bc);
+
+		if (!i--)
+			break;
+
+		zstd_fse_encode(&bc, &of_st, cctx->of_codes[i]);
+		zstd_fse_encode(&bc, &ml_st, cctx->ml_codes[i]);
+		zstd_fse_encode(&bc, &ll_st, cctx->ll_codes[i]);
+		zstd_bitc_flush(&bc);
+	}
+	zstd_fse_flush_state(&bc, &ml_st);
+	zstd_fse_flush_state(&bc, &of_st);
+	zstd_fse_flush_state(&bc, &ll_st);
+	len = zstd_bitc_close(&bc);
+	if (!len)
+		return 0;
+
+	return op + len - dst;
+}
+
+/* Match finder */
+
+static inline u32 zstd_hash(const u8 *p, unsigned int hash_log,
+			    unsigned int mls)
+{
+	if (mls == 4)
+		return (get_unaligned_le32(p) * 2654435761U) >> (32 - hash_log);
+	return ((get_unaligned_le64(p) << (64 - 8 * mls)) *
+		0xCF1BBCDCB7A56463ULL) >> (64 - hash_log);
+}
+
+static inline size_t zstd_count(const u8 *ip, const u8 *match, const u8 *iend)
+{
+	const u8 *start = ip;
+
+	while (ip + 8 <= iend) {
+		u64 diff = get_unaligned_le64(ip) ^ get_unaligned_le64(match);
+
+		if (diff)
+			return ip - start + (__ffs64(diff) >> 3);
+		ip += 8;
+		match += 8;
+	}
+	while (ip < iend && *ip == *match) {
+		ip++;
+		match++;
+	}
+	return ip - start;
+}
+
+static inline bool zstd_uses_chain(const struct zstd_compression_parameters *cp)
+{
+	return cp->strategy != ZSTD_fast;
+}
+
+/* Lowest index a match for position @cur may start at */
+static inline u32 zstd_lowest(const struct zstd_cctx *cctx, u32 cur)
+{
+	u32 window = 1U << cctx->params.cparams.window_log;
+
+	return max(cctx->low_limit, cur > window ? cur - window : 0);
+}
+
+/* Add the positions up to @ip to the tables, return the last one for @ip */
+static u32 zstd_insert_and_find(struct zstd_cctx *cctx, const u8 *ip)
+{
+	const struct zstd_compression_parameters *cp = &cctx->params.cparams;
+	u32 chain_mask = (1U << cp->chain_log) - 1;
+	u32 target = ip - cctx->base;
+	u32 idx, h;
+
+	for (idx = cctx->next_to_update; idx < target; idx++) {
+		h = zstd_hash(cctx->base + idx, cp->hash_log, cp->min_match);
+		if (zstd_uses_chain(cp))
+			cctx->chain_table[idx & chain_mask] = cctx->hash_table[h];
+		cctx->hash_table[h] = idx;
+	}
+	cctx->next_to_update = max(cctx->next_to_update, target);
+
+	return cctx->hash_table[zstd_hash(ip, cp->hash_log, cp->min_match)];
+}
+
+static size_t zstd_find_best_match(struct zstd_cctx *cctx, const u8 *ip,
+				   const u8 *iend, u32 *offset)
+{
+	const struct zstd_compression_parameters *cp = &cctx->params.cparams;
+	u32 chain_size = 1U << cp->chain_log;
+	u32 cur = ip - cctx->base;
+	u32 lowest = zstd_lowest(cctx, cur);
+	u32 chain_low = cur > chain_size ? cur - chain_size : 0;
+	unsigned int attempts = 1U << cp->search_log;
+	size_t best = cp->min_match - 1;
+	u32 idx;
+
+	idx = zstd_insert_and_find(cctx, ip);
+	while (idx >= lowest && attempts--) {
+		const u8 *match = cctx->base + idx;
+
+		if (match[best] == ip[best]) {
+			size_t len = zstd_count(ip, match, iend);
+
+			if (len > best) {
+				best = len;
+				*offset = cur - idx;
+				if (ip + len == iend)
+					break;
+			}
+		}
+		if (!zstd_uses_chain(cp) || idx <= chain_low)
+			break;
+		idx = cctx->chain_table[idx & (chain_size - 1)];
+	}
+
+	return best >= cp->min_match ? best : 0;
+}
+
+/* Length of a match at the last offset used */
+static inline size_t zstd_rep_match(const struct zstd_cctx *cctx,
+				    const u8 *ip, const u8 *iend)
+{
+	u32 cur = ip - cctx->base;
+	u32 rep = cctx->rep[0];
+
+	if (rep > cur || cur - rep < zstd_lowest(cctx, cur))
+		return 0;
+	if (get_unaligned_le32(ip) != get_unaligned_le32(ip - rep))
+		return 0;
+	return ZSTD_MIN_MATCH_SEARCH +
+	       zstd_count(ip + ZSTD_MIN_MATCH_SEARCH,
+			  ip + ZSTD_MIN_MATCH_SEARCH - rep, iend);
+}
+
+/*
+ * Look for a match at @ip worth more than the one in hand, given that
+ * taking it means one more literal. Offset 0 stands for the last offset.
+ */
+static bool zstd_lazy_better(struct zstd_cctx *cctx, const u8 *ip,
+			     const u8 *iend, size_t *len, u32 *off, int bonus)
+{
+	size_t len2;
+	u32 off2 = 0;
+	int gain1, gain2;
+
+	len2 = zstd_rep_match(cctx, ip, iend);
+	if (len2) {
+		gain2 = len2 * 3;
+		gain1 = *len * 3 - zstd_highbit(*off + 1) + 1;
+		if (gain2 > gain1) {
+			*len = len2;
+			*off = 0;
+			return true;
+		}
+	}
+
+	len2 = zstd_find_best_match(cctx, ip, iend, &off2);
+	if (len2) {
+		gain2 = len2 * 4 - zstd_highbit(off2 + 1);
+		gain1 = *len * 4 - zstd_highbit(*off + 1) + bonus;
+		if (gain2 > gain1) {
+			*len = len2;
+			*off = off2;
+			return true;
+		}
+	}
+	return false;
+}
+
+static void zstd_store_seq(struct zstd_cctx *cctx, const u8 *lit, size_t ll,
+			   u32 offset_value, size_t ml)
+{
+	struct zstd_seq *seq = &cctx->seqs[cctx->nb_seq++];
+
+	memcpy(cctx->lits + cctx->nb_lits, lit, ll);
+	cctx->nb_lits += ll;
+	seq->lit_length = ll;
+	seq->match_length = ml;
+	seq->offset_value = offset_value;
+}
+
+/* Split [@istart, @iend) into sequences and literals */
+static void zstd_find_sequences(struct zstd_cctx *cctx, const u8 *istart,
+				const u8 *iend)
+{
+	const struct zstd_compression_parameters *cp = &cctx->params.cparams;
+	unsigned int depth = cp->strategy > ZSTD_greedy ?
+			     cp->strategy - ZSTD_greedy : 0;
+	const u8 *ip = istart, *anchor = istart;
+	const u8 *ilimit = iend - 8;
+
+	cctx->nb_seq = 0;
+	cctx->nb_lits = 0;
+
+	while (ip < ilimit) {
+		const u8 *start = ip;
+		size_t len = 0, len2;
+		u32 off = 0, off2 = 0;
+
+		if (ip > anchor)
+			len = zstd_rep_match(cctx, ip, iend);
+		len2 = zstd_find_best_match(cctx, ip, iend, &off2);
+		if (len2 > len) {
+			len = len2;
+			off = off2;
+		}
+		if (!len) {
+			ip += ((ip - anchor) >> ZSTD_SEARCH_STRENGTH) + 1;
+			continue;
+		}
+
+		while (depth && ip < ilimit) {
+			ip++;
+			if (zstd_lazy_better(cctx, ip, iend, &len, &off, 4)) {
+				start = ip;
+				continue;
+			}
+			if (depth == 2 && ip < ilimit) {
+				ip++;
+				if (zstd_lazy_better(cctx, ip, iend, &len, &off,
+						     7)) {
+					start = ip;
+					continue;
+				}
+			}
+			break;
+		}
+
+		ip = start;
+		if (off) {
+			/* Extend the match backwards over the literals */
+			while (ip > anchor &&
+			       (u32)(ip - cctx->base) - off > cctx->low_limit &&
+			       ip[-1] == ip[-1 - (int)off]) {
+				ip--;
+				len++;
+			}
+			zstd_store_seq(cctx, anchor, ip - anchor,
+				       off + ZSTD_REP_NUM, len);
+			cctx->rep[2] = cctx->rep[1];
+			cctx->rep[1] = cctx->rep[0];
+			cctx->rep[0] = off;
+		} else {
+			zstd_store_seq(cctx, anchor, ip - anchor, 1, len);
+		}
+		ip += len;
+		anchor = ip;
+	}
+
+	memcpy(cctx->lits + cctx->nb_lits, anchor, iend - anchor);
+	cctx->nb_lits += iend - anchor;
+}
+
+/* Blocks and frames */
+
+static void zstd_write_block_header(u8 *dst, enum zstd_block_type type,
+				    size_t size, bool last)
+{
+	u32 bh = last | (type << 1) | (size << 3);
+
+	dst[0] = bh;
+	dst[1] = bh >> 8;
+	dst[2] = bh >> 16;
+}
+
+/*
+ * Compress one block of input, with the history preceding @src available
+ * to the match finder. Returns the size of the block written to @dst.
+ */
+static size_t zstd_compress_block(struct zstd_cctx *cctx, u8 *dst, size_t cap,
+				  const u8 *src, size_t size, bool last)
+{
+	u8 *body = dst + ZSTD_BLOCKHEADER_SIZE;
+	u32 rep[ZSTD_REP_NUM];
+	size_t lits, seqs, room;
+
+	if (cap < ZSTD_BLOCKHEADER_SIZE + 1)
+		return ZSTD_ERROR(ENOSPC);
+
+	if (size > 1 && !memcmp(src, src + 1, size - 1)) {
+		zstd_write_block_header(dst, ZSTD_BLOCK_RLE, size, last);
+		body[0] = src[0];
+		return ZSTD_BLOCKHEADER_SIZE + 1;
+	}
+
+	/* The decoder only sees offsets of blocks that end up compressed */
+	memcpy(rep, cctx->rep, sizeof(rep));
+	if (size > ZSTD_MIN_HUF_LITERALS) {
+		zstd_find_sequences(cctx, src, src + size);
+		room = min(cap - ZSTD_BLOCKHEADER_SIZE, size - 1);
+		lits = zstd_compress_literals(cctx, body, room);
+		if (lits) {
+			seqs = zstd_compress_sequences(cctx, body + lits,
+						       room - lits);
+			if (seqs) {
+				zstd_write_block_header(dst,
+							ZSTD_BLOCK_COMPRESSED,
+							lits + seqs, last);
+				return ZSTD_BLOCKHEADER_SIZE + lits + seqs;
+			}
+		}
+	}
+	memcpy(cctx->rep, rep, sizeof(rep));
+
+	if (cap < ZSTD_BLOCKHEADER_SIZE + size)
+		return ZSTD_ERROR(ENOSPC);
+	zstd_write_block_header(dst, ZSTD_BLOCK_RAW, size, last);
+	memcpy(dst + ZSTD_BLOCKHEADER_SIZE, src, size);
+	return ZSTD_BLOCKHEADER_SIZE + size;
+}
+
+static size_t zstd_write_frame_header(u8 *dst, size_t cap,
+				      const struct zstd_parameters *params,
+				      unsigned long long content_size)
+{
+	unsigned int window_log = params->cparams.window_log;
+	bool has_size = params->fparams.content_size &&
+			content_size != ZSTD_CONTENTSIZE_UNKNOWN;
+	bool single = has_size && content_size <= (1ULL << window_log);
+	unsigned int fcs_code = 0;
+	size_t pos = 5;
+
+	if (has_size)
+		fcs_code = content_size < 256 ? 0 :
+			   content_size < 0x10000 + 256 ? 1 :
+			   content_size <= 0xFFFFFFFFULL ? 2 : 3;
+	if (cap < ZSTD_FRAMEHEADER_MAX)
+		return ZSTD_ERROR(ENOSPC);
+
+	put_unaligned_le32(ZSTD_MAGIC, dst);
+	dst[4] = (fcs_code << 6) | (single << 5) |
+		 (params->fparams.checksum << 2);
+	if (!single)
+		dst[pos++] = (window_log - ZSTD_WINDOWLOG_MIN) << 3;
+	if (!has_size)
+		return pos;
+
+	switch (fcs_code) {
+	case 0:
+		dst[pos++] = content_size;
+		break;
+	case 1:
+		put_unaligned_le16(content_size - 256, dst + pos);
+		pos += 2;
+		break;
+	case 2:
+		put_unaligned_le32(content_size, dst + pos);
+		pos += 4;
+		break;
+	default:
+		put_unaligned_le64(content_size, dst + pos);
+		pos += 8;
+		break;
+	}
+	return pos;
+}
+
+static size_t zstd_write_checksum(struct zstd_cctx *cctx, u8 *dst, size_t cap)
+{
+	if (!cctx->params.fparams.checksum)
+		return 0;
+	if (cap < ZSTD_CHECKSUM_SIZE)
+		return ZSTD_ERROR(ENOSPC);
+	put_unaligned_le32(xxh64_digest(&cctx->xxh), dst);
+	return ZSTD_CHECKSUM_SIZE;
+}
+
+/* Parameters and workspace */
+
+static int zstd_check_cparams(const struct zstd_compression_parameters *cp)
+{
+	if (cp->window_log < ZSTD_WINDOWLOG_MIN ||
+	    cp->window_log > ZSTD_WINDOWLOG_MAX ||
+	    cp->hash_log < 6 || cp->hash_log > 26 ||
+	    cp->search_log > 10 ||
+	    cp->min_match < ZSTD_MIN_MATCH_SEARCH || cp->min_match > 7 ||
+	    cp->strategy < ZSTD_fast || cp->strategy > ZSTD_lazy2)
+		return -EINVAL;
+	if (cp->strategy != ZSTD_fast &&
+	    (cp->chain_log < 6 || cp->chain_log > 28))
+		return -EINVAL;
+	return 0;
+}
+
+static size_t zstd_block_size(const struct zstd_compression_parameters *cp)
+{
+	return min_t(size_t, ZSTD_BLOCKSIZE_MAX, 1U << cp->window_log);
+}
+
+static size_t zstd_tables_size(const struct zstd_compression_parameters *cp)
+{
+	size_t block_size = zstd_block_size(cp);
+	size_t max_seq = block_size / ZSTD_MIN_MATCH_SEARCH + 1;
+	size_t size;
+
+	size = sizeof(u32) << cp->hash_log;
+	if (zstd_uses_chain(cp))
+		size += sizeof(u32) << cp->chain_log;
+	size += ALIGN(max_seq * sizeof(struct zstd_seq), 8);
+	size += ALIGN(block_size, 8);
+	size += 3 * ALIGN(max_seq, 8);
+	return size;
+}
+
+struct zstd_parameters zstd_get_params(int level,
+				       unsigned long long estimated_src_size)
+{
+	struct zstd_parameters params;
+	struct zstd_compression_parameters *cp = &params.cparams;
+
+	if (!level)
+		level = ZSTD_DEFAULT_CLEVEL;
+	level = clamp(level, ZSTD_MIN_CLEVEL, ZSTD_MAX_CLEVEL);
+	*cp = zstd_clevels[level - 1];
+
+	if (estimated_src_size != ZSTD_CONTENTSIZE_UNKNOWN) {
+		unsigned int src_log = ZSTD_WINDOWLOG_MIN;
+
+		if (estimated_src_size > (1U << ZSTD_WINDOWLOG_MIN))
+			src_log = estimated_src_size >= (1U << 31) ?
+				  ZSTD_WINDOWLOG_MAX :
+				  zstd_highbit(estimated_src_size - 1) + 1;
+		cp->window_log = min(cp->window_log, src_log);
+		cp->hash_log = min(cp->hash_log, cp->window_log + 1);
+		if (cp->chain_log)
+			cp->chain_log = min(cp->chain_log, cp->window_log);
+	}
+
+	params.fparams.content_size = true;
+	params.fparams.checksum = false;
+	return params;
+}
+EXPORT_SYMBOL(zstd_get_params);
+
+size_t zstd_cctx_workspace_bound(const struct zstd_compression_parameters *cparams)
+{
+	return ALIGN(sizeof(struct zstd_cctx), 8) + zstd_tables_size(cparams);
+}
+EXPORT_SYMBOL(zstd_cctx_workspace_bound);
+
+static struct zstd_cctx *zstd_setup_cctx(struct zstd_cctx *cctx,
+					 void *workspace,
+					 size_t workspace_size)
+{
+	memset(cctx, 0, sizeof(*cctx));
+	cctx->workspace = workspace;
+	cctx->workspace_size = workspace_size;
+	return cctx;
+}
+
+struct zstd_cctx *zstd_init_cctx(void *workspace, size_t workspace_size)
+{
+	size_t hdr = ALIGN(sizeof(struct zstd_cctx), 8);
+
+	if (!workspace || !IS_ALIGNED((unsigned long)workspace, 8) ||
+	    workspace_size < hdr)
+		return NULL;
+	return zstd_setup_cctx(workspace, (u8 *)workspace + hdr,
+			       workspace_size - hdr);
+}
+EXPORT_SYMBOL(zstd_init_cctx);
+
+/* Lay out the tables for @params and start a new frame */
+static size_t zstd_reset_cctx(struct zstd_cctx *cctx,
+			      const struct zstd_parameters *params,
+			      const u8 *base)
+{
+	const struct zstd_compression_parameters *cp = &params->cparams;
+	size_t max_seq, hash_size;
+	u8 *p = cctx->workspace;
+
+	if (zstd_check_cparams(cp))
+		return ZSTD_ERROR(EINVAL);
+	if (zstd_tables_size(cp) > cctx->workspace_size)
+		return ZSTD_ERROR(ENOMEM);
+
+	cctx->params = *params;
+	cctx->block_size = zstd_block_size(cp);
+	max_seq = cctx->block_size / ZSTD_MIN_MATCH_SEARCH + 1;
+
+	hash_size = sizeof(u32) << cp->hash_log;
+	cctx->hash_table = (u32 *)p;
+	p += hash_size;
+	cctx->chain_table = NULL;
+	if (zstd_uses_chain(cp)) {
+		cctx->chain_table = (u32 *)p;
+		p += sizeof(u32) << cp->chain_log;
+	}
+	cctx->seqs = (struct zstd_seq *)p;
+	p += ALIGN(max_seq * sizeof(struct zstd_seq), 8);
+	cctx->lits = p;
+	p += ALIGN(cctx->block_size, 8);
+	cctx->ll_codes = p;
+	p += ALIGN(max_seq, 8);
+	cctx->ml_codes = p;
+	p += ALIGN(max_seq, 8);
+	cctx->of_codes = p;
+
+	/* Index 0 marks an empty slot, the chain never links to it */
+	memset(cctx->hash_table, 0, hash_size);
+	cctx->base = base;
+	cctx->low_limit = 1;
+	cctx->next_to_update = 1;
+	cctx->rep[0] = 1;
+	cctx->rep[1] = 4;
+	cctx->rep[2] = 8;
+	xxh64_reset(&cctx->xxh, 0);
+	return 0;
+}
+
+size_t zstd_compress_cctx(struct zstd_cctx *cctx, void *dst, size_t dst_capacity,
+			  const void *src, size_t src_size,
+			  const struct zstd_parameters *params)
+{
+	const u8 *ip = src;
+	u8 *op = dst, *oend = op + dst_capacity;
+	size_t ret;
+
+	if (src_size > U32_MAX - 1)
+		return ZSTD_ERROR(EINVAL);
+	ret = zstd_reset_cctx(cctx, params, ip);
+	if (zstd_is_error(ret))
+		return ret;
+
+	ret = zstd_write_frame_header(op, oend - op, params, src_size);
+	if (zstd_is_error(ret))
+		return ret;
+	op += ret;
+
+	if (params->fparams.checksum)
+		xxh64_update(&cctx->xxh, src, src_size);
+
+	do {
+		size_t len = min(src_size, cctx->block_size);
+
+		ret = zstd_compress_block(cctx, op, oend - op, ip, len,
+					  len == src_size);
+		if (zstd_is_error(ret))
+			return ret;
+		op += ret;
+		ip += len;
+		src_size -= len;
+	} while (src_size);
+
+	ret = zstd_write_checksum(cctx, op, oend - op);
+	if (zstd_is_error(ret))
+		return ret;
+	op += ret;
+
+	return op - (u8 *)dst;
+}
+EXPORT_SYMBOL(zstd_compress_cctx);
+
+/* Streaming */
+
+static size_t zstd_cstream_in_size(const struct zstd_compression_parameters *cp)
+{
+	/* One spare byte, as index 0 of the window is never used */
+	return 1 + (1U << cp->window_log) + zstd_block_size(cp);
+}
+
+static size_t zstd_cstream_out_size(const struct zstd_compression_parameters *cp)
+{
+	return ZSTD_FRAMEHEADER_MAX + zstd_compress_bound(zstd_block_size(cp)) +
+	       ZSTD_CHECKSUM_SIZE;
+}
+
+size_t zstd_cstream_workspace_bound(const struct zstd_compression_parameters *cparams)
+{
+	return ALIGN(sizeof(struct zstd_cstream), 8) +
+	       zstd_tables_size(cparams) +
+	       ALIGN(zstd_cstream_in_size(cparams), 8) +
+	       zstd_cstream_out_size(cparams);
+}
+EXPORT_SYMBOL(zstd_cstream_workspace_bound);
+
+struct zstd_cstream *zstd_init_cstream(const struct zstd_parameters *params,
+				       unsigned long long pledged_src_size,
+				       void *workspace, size_t workspace_size)
+{
+	const struct zstd_compression_parameters *cp = &params->cparams;
+	struct zstd_cstream *zcs = workspace;
+	u8 *p = workspace;
+
+	if (!workspace || !IS_ALIGNED((unsigned long)workspace, 8) ||
+	    zstd_check_cparams(cp) ||
+	    workspace_size < zstd_cstream_workspace_bound(cp))
+		return NULL;
+
+	p += ALIGN(sizeof(*zcs), 8);
+	zstd_setup_cctx(&zcs->cctx, p, zstd_tables_size(cp));
+	zcs->cctx.params = *params;
+	p += zstd_tables_size(cp);
+	zcs->in_buf = p;
+	zcs->in_buf_size = zstd_cstream_in_size(cp);
+	p += ALIGN(zcs->in_buf_size, 8);
+	zcs->out_buf = p;
+	zcs->out_buf_size = zstd_cstream_out_size(cp);
+
+	if (zstd_is_error(zstd_reset_cstream(zcs, pledged_src_size)))
+		return NULL;
+	return zcs;
+}
+EXPORT_SYMBOL(zstd_init_cstream);
+
+size_t zstd_reset_cstream(struct zstd_cstream *zcs,
+			  unsigned long long pledged_src_size)
+{
+	struct zstd_cctx *cctx = &zcs->cctx;
+	struct zstd_parameters params = cctx->params;
+	size_t ret;
+
+	ret = zstd_reset_cctx(cctx, &params, zcs->in_buf);
+	if (zstd_is_error(ret))
+		return ret;
+
+	zcs->pledged_src_size = pledged_src_size;
+	zcs->consumed = 0;
+	zcs->frame_ended = false;
+	zcs->in_end = 1;
+	zcs->block_start = 1;
+
+	ret = zstd_write_frame_header(zcs->out_buf, zcs->out_buf_size,
+				      &params, pledged_src_size);
+	if (zstd_is_error(ret))
+		return ret;
+	zcs->out_len = ret;
+	zcs->out_flushed = 0;
+	return 0;
+}
+EXPORT_SYMBOL(zstd_reset_cstream);
+
+/* Move the window down to make room for the next block */
+static void zstd_cstream_slide(struct zstd_cstream *zcs)
+{
+	struct zstd_cctx *cctx = &zcs->cctx;
+	const struct zstd_compression_parameters *cp = &cctx->params.cparams;
+	u32 shift = zcs->block_start - (1U << cp->window_log);
+	size_t i, n;
+
+	memmove(zcs->in_buf, zcs->in_buf + shift, zcs->in_end - shift);
+	zcs->in_end -= shift;
+	zcs->block_start -= shift;
+
+	n = 1U << cp->hash_log;
+	for (i = 0; i < n; i++)
+		cctx->hash_table[i] = cctx->hash_table[i] < shift ? 0 :
+				      cctx->hash_table[i] - shift;
+	if (zstd_uses_chain(cp)) {
+		n = 1U << cp->chain_log;
+		for (i = 0; i < n; i++)
+			cctx->chain_table[i] = cctx->chain_table[i] < shift ? 0 :
+					       cctx->chain_table[i] - shift;
+	}
+	cctx->next_to_update = cctx->next_to_update > shift ?
+			       cctx->next_to_update - shift : 1;
+	cctx->low_limit = max_t(u32, cctx->low_limit, shift + 1) - shift;
+}
+
+static size_t zstd_cstream_flush_out(struct zstd_cstream *zcs,
+				     struct zstd_out_buffer *output)
+{
+	size_t n = min(zcs->out_len - zcs->out_flushed,
+		       output->size - output->pos);
+
+	memcpy((u8 *)output->dst + output->pos,
+	       zcs->out_buf + zcs->out_flushed, n);
+	output->pos += n;
+	zcs->out_flushed += n;
+	if (zcs->out_flushed == zcs->out_len) {
+		zcs->out_len = 0;
+		zcs->out_flushed = 0;
+	}
+	return zcs->out_len - zcs->out_flushed;
+}
+
+/* Compress what has been gathered since the last block; out_buf is empty */
+static size_t zstd_cstream_block(struct zstd_cstream *zcs, bool last)
+{
+	struct zstd_cctx *cctx = &zcs->cctx;
+	size_t ret;
+
+	ret = zstd_compress_block(cctx, zcs->out_buf, zcs->out_buf_size,
+				  zcs->in_buf + zcs->block_start,
+				  zcs->in_end - zcs->block_start, last);
+	if (zstd_is_error(ret))
+		return ret;
+	zcs->out_len = ret;
+	zcs->block_start = zcs->in_end;
+
+	if (last) {
+		ret = zstd_write_checksum(cctx, zcs->out_buf + zcs->out_len,
+					  zcs->out_buf_size - zcs->out_len);
+		if (zstd_is_error(ret))
+			return ret;
+		zcs->out_len += ret;
+		zcs->frame_ended = true;
+	}
+	return 0;
+}
+
+size_t zstd_compress_stream(struct zstd_cstream *zcs,
+			    struct zstd_out_buffer *output,
+			    struct zstd_in_buffer *input)
+{
+	struct zstd_cctx *cctx = &zcs->cctx;
+	size_t pending, n, ret;
+
+	for (;;) {
+		pending = zstd_cstream_flush_out(zcs, output);
+		if (pending || input->pos == input->size)
+			return pending;
+		if (zcs->frame_ended)
+			return ZSTD_ERROR(EINVAL);
+
+		if (zcs->block_start + cctx->block_size > zcs->in_buf_size)
+			zstd_cstream_slide(zcs);
+
+		n = min(input->size - input->pos,
+			zcs->block_start + cctx->block_size - zcs->in_end);
+		if (zcs->pledged_src_size != ZSTD_CONTENTSIZE_UNKNOWN &&
+		    zcs->consumed + n > zcs->pledged_src_size)
+			return ZSTD_ERROR(EINVAL);
+		memcpy(zcs->in_buf + zcs->in_end,
+		       (const u8 *)input->src + input->pos, n);
+		if (cctx->params.fparams.checksum)
+			xxh64_update(&cctx->xxh, zcs->in_buf + zcs->in_end,
+				     n);
+		zcs->in_end += n;
+		zcs->consumed += n;
+		input->pos += n;
+
+		if (zcs->in_end - zcs->block_start == cctx->block_size) {
+			ret = zstd_cstream_block(zcs, false);
+			if (zstd_is_error(ret))
+				return ret;
+		}
+	}
+}
+EXPORT_SYMBOL(zstd_compress_stream);
+
+size_t zstd_flush_stream(struct zstd_cstream *zcs,
+			 struct zstd_out_buffer *output)
+{
+	size_t pending, ret;
+
+	pending = zstd_cstream_flush_out(zcs, output);
+	if (pending || zcs->frame_ended || zcs->in_end == zcs->block_start)
+		return pending;
+
+	ret = zstd_cstream_block(zcs, false);
+	if (zstd_is_error(ret))
+		return ret;
+	return zstd_cstream_flush_out(zcs, output);
+}
+EXPORT_SYMBOL(zstd_flush_stream);
+
+size_t zstd_end_stream(struct zstd_cstream *zcs,
+		       struct zstd_out_buffer *output)
+{
+	size_t pending, ret;
+
+	pending = zstd_cstream_flush_out(zcs, output);
+	if (pending || zcs->frame_ended)
+		return pending;
+
+	if (zcs->pledged_src_size != ZSTD_CONTENTSIZE_UNKNOWN &&
+	    zcs->consumed != zcs->pledged_src_size)
+		return ZSTD_ERROR(EINVAL);
+	ret = zstd_cstream_block(zcs, true);
+	if (zstd_is_error(ret))
+		return ret;
+	return zstd_cstream_flush_out(zcs, output);
+}
+EXPORT_SYMBOL(zstd_end_stream);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("Zstandard compressor");
@@ -0,0 +1,1258 @@
+/*
+ * Zstandard decompression
+ *
+ * Decodes frames as described in RFC 8878: raw, RLE and compressed blocks,
+ * Huffman coded literals and FSE coded sequences in all table modes, and
+ * the optional content checksum. Frames that need a dictionary are
+ * refused.
+ *
+ * A single pass decoder uses the destination buffer itself as the window,
+ * the streaming decoder keeps a window of its own in the workspace and
+ * decodes each block right behind the previous one.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/string.h>
+#include <linux/zstd.h>
+#include <asm/unaligned.h>
+
+#include "zstd_internal.h"
+
+struct zstd_fse_dentry {
+	u16 new_state;
+	u8 symbol;
+	u8 nb_bits;
+};
+
+struct zstd_huf_dentry {
+	u8 symbol;
+	u8 nb_bits;
+};
+
+struct zstd_frame_header {
+	unsigned long long content_size;
+	unsigned long long window_size;
+	unsigned int header_size;
+	bool checksum;
+};
+
+/*
+ * The entropy coded streams are read backwards, starting from the last
+ * set bit of their last byte. @bits counts the bits left and goes negative
+ * when a stream is overrun; bits below the start of the stream read as 0.
+ */
+struct zstd_bitd {
+	const u8 *start;
+	size_t size;
+	long bits;
+};
+
+struct zstd_dctx {
+	/* Sequence tables, kept across the blocks of a frame for repeat mode */
+	struct zstd_fse_dentry ll_table[1 << ZSTD_LL_FSE_LOG];
+	struct zstd_fse_dentry of_table[1 << ZSTD_OF_FSE_LOG];
+	struct zstd_fse_dentry ml_table[1 << ZSTD_ML_FSE_LOG];
+	unsigned int ll_log;
+	unsigned int of_log;
+	unsigned int ml_log;
+	bool ll_valid;
+	bool of_valid;
+	bool ml_valid;
+
+	/* Literals table, kept across blocks for treeless literals */
+	struct zstd_huf_dentry huf_table[1 << ZSTD_HUF_MAX_LOG];
+	unsigned int huf_log;
+	bool huf_valid;
+
+	u32 rep[ZSTD_REP_NUM];
+	struct zstd_frame_header fh;
+	struct xxh64_state xxh;
+
+	const u8 *lits;
+	size_t lits_size;
+	u8 lit_buf[ZSTD_BLOCKSIZE_MAX];
+
+	/* Scratch space for building tables */
+	s16 norm[ZSTD_MAX_SEQ_SYMBOL + 1];
+	u8 spread[1 << ZSTD_LL_FSE_LOG];
+	u8 weights[ZSTD_HUF_MAX_SYMBOL + 1];
+	struct zstd_fse_dentry weight_table[1 << ZSTD_HUF_WEIGHT_FSE_LOG];
+};
+
+enum zstd_dstream_stage {
+	ZSTD_DS_HEADER,
+	ZSTD_DS_SKIP,
+	ZSTD_DS_BLOCK_HEADER,
+	ZSTD_DS_BLOCK,
+	ZSTD_DS_CHECKSUM,
+	ZSTD_DS_DONE,
+};
+
+struct zstd_dstream {
+	struct zstd_dctx dctx;
+	enum zstd_dstream_stage stage;
+
+	/* Input is gathered here until a header or a whole block is in */
+	u8 *in_buf;
+	size_t in_len;
+	size_t in_need;
+	size_t skip_left;
+
+	/* Current block */
+	enum zstd_block_type block_type;
+	size_t block_size;
+	size_t block_max;
+	bool last_block;
+
+	/* Decoded data, flushed to the caller from @flushed to @wpos */
+	u8 *window;
+	size_t window_size;
+	size_t max_window;
+	size_t wpos;
+	size_t flushed;
+	unsigned long long produced;
+};
+
+#define ZSTD_ERROR(e)	((size_t)-(e))
+
+/* Bits [@pos, @pos + @nb) of a little endian bit stream, @nb <= 32 */
+static inline u32 zstd_get_bits(const u8 *src, size_t size, size_t pos,
+				unsigned int nb)
+{
+	size_t byte = pos >> 3;
+	u64 v = 0;
+	size_t i;
+
+	if (likely(byte + 8 <= size)) {
+		v = get_unaligned_le64(src + byte);
+	} else {
+		for (i = size; i > byte; i--)
+			v = (v << 8) | src[i - 1];
+	}
+	return (v >> (pos & 7)) & ((1ULL << nb) - 1);
+}
+
+static int zstd_bitd_init(struct zstd_bitd *bd, const u8 *src, size_t size)
+{
+	if (!size || !src[size - 1])
+		return -EINVAL;
+	bd->start = src;
+	bd->size = size;
+	bd->bits = (size - 1) * 8 + zstd_highbit(src[size - 1]);
+	return 0;
+}
+
+static inline u32 zstd_bitd_peek(const struct zstd_bitd *bd, unsigned int nb)
+{
+	long pos = bd->bits - nb;
+	unsigned int shift = 0;
+
+	if (pos < 0) {
+		if (pos + (long)nb <= 0)
+			return 0;
+		shift = -pos;
+		nb -= shift;
+		pos = 0;
+	}
+	return zstd_get_bits(bd->start, bd->size, pos, nb) << shift;
+}
+
+static inline u32 zstd_bitd_read(struct zstd_bitd *bd, unsigned int nb)
+{
+	u32 v = zstd_bitd_peek(bd, nb);
+
+	bd->bits -= nb;
+	return v;
+}
+
+/*
+ * Read the normalized counts of an FSE table description. Returns the
+ * number of bytes used.
+ */
+static int zstd_read_ncount(s16 *norm, unsigned int *max_symbol,
+			    unsigned int *table_log, unsigned int max_log,
+			    const u8 *src, size_t size)
+{
+	unsigned int max = *max_symbol;
+	unsigned int sym = 0;
+	int remaining, threshold, nb_bits;
+	bool prev0 = false;
+	size_t pos = 0;
+	unsigned int log;
+
+	if (!size)
+		return -EINVAL;
+
+	log = zstd_get_bits(src, size, 0, 4) + ZSTD_FSE_MIN_LOG;
+	pos = 4;
+	if (log > max_log)
+		return -EINVAL;
+
+	remaining = (1 << log) + 1;
+	threshold = 1 << log;
+	nb_bits = log + 1;
+
+	while (remaining > 1 && sym <= max) {
+		int max_v, count;
+		u32 v;
+
+		if (prev0) {
+			unsigned int n0 = sym;
+
+			while (zstd_get_bits(src, size, pos, 16) == 0xFFFF) {
+				n0 += 24;
+				pos += 16;
+				if (pos > size * 8)
+					return -EINVAL;
+			}
+			while ((v = zstd_get_bits(src, size, pos, 2)) == 3) {
+				n0 += 3;
+				pos += 2;
+			}
+			n0 += v;
+			pos += 2;
+			if (n0 > max)
+				return -EINVAL;
+			while (sym < n0)
+				norm[sym++] = 0;
+		}
+
+		max_v = (2 * threshold - 1) - remaining;
+		v = zstd_get_bits(src, size, pos, nb_bits - 1);
+		if ((int)v < max_v) {
+			count = v;
+			pos += nb_bits - 1;
+		} else {
+			count = zstd_get_bits(src, size, pos, nb_bits);
+			if (count >= threshold)
+				count -= max_v;
+			pos += nb_bits;
+		}
+
+		count--;
+		remaining -= count < 0 ? -count : count;
+		norm[sym++] = count;
+		prev0 = !count;
+		if (remaining < 1)
+			return -EINVAL;
+		while (remaining < threshold) {
+			nb_bits--;
+			threshold >>= 1;
+		}
+	}
+
+	if (remaining != 1 || pos > size * 8)
+		return -EINVAL;
+
+	*max_symbol = sym - 1;
+	*table_log = log;
+	return (pos + 7) >> 3;
+}
+
+static void zstd_build_fse_table(struct zstd_fse_dentry *table,
+				 const s16 *norm, unsigned int max_symbol,
+				 unsigned int table_log, u8 *spread)
+{
+	unsigned int size = 1U << table_log;
+	u16 next[ZSTD_MAX_SEQ_SYMBOL + 1];
+	unsigned int s, u;
+
+	zstd_fse_spread(spread, norm, max_symbol, table_log);
+
+	for (s = 0; s <= max_symbol; s++)
+		next[s] = norm[s] == -1 ? 1 : norm[s];
+
+	for (u = 0; u < size; u++) {
+		unsigned int n;
+
+		s = spread[u];
+		n = next[s]++;
+		table[u].symbol = s;
+		table[u].nb_bits = table_log - zstd_highbit(n);
+		table[u].new_state = (n << table[u].nb_bits) - size;
+	}
+}
+
+/*
+ * Set up one of the sequence tables according to its mode. Returns the
+ * number of bytes of table description used.
+ */
+static int zstd_build_seq_table(struct zstd_dctx *dctx,
+				struct zstd_fse_dentry *table,
+				unsigned int *table_log, bool *valid,
+				enum zstd_seq_mode mode,
+				unsigned int max_symbol, unsigned int max_log,
+				const s16 *default_norm,
+				unsigned int default_max,
+				unsigned int default_log,
+				const u8 *src, size_t size)
+{
+	unsigned int max = max_symbol;
+	int ret = 0;
+
+	switch (mode) {
+	case ZSTD_SEQ_PREDEFINED:
+		zstd_build_fse_table(table, default_norm, default_max,
+				     default_log, dctx->spread);
+		*table_log = default_log;
+		break;
+	case ZSTD_SEQ_RLE:
+		if (!size || src[0] > max_symbol)
+			return -EINVAL;
+		table[0].symbol = src[0];
+		table[0].nb_bits = 0;
+		table[0].new_state = 0;
+		*table_log = 0;
+		ret = 1;
+		break;
+	case ZSTD_SEQ_COMPRESSED:
+		ret = zstd_read_ncount(dctx->norm, &max, table_log, max_log,
+				       src, size);
+		if (ret < 0)
+			return ret;
+		zstd_build_fse_table(table, dctx->norm, max, *table_log,
+				     dctx->spread);
+		break;
+	case ZSTD_SEQ_REPEAT:
+		if (!*valid)
+			return -EINVAL;
+		break;
+	}
+
+	*valid = true;
+	return ret;
+}
+
+/* Huffman weights coded with FSE, two states taking turns */
+static int zstd_decode_huf_weights(struct zstd_dctx *dctx, const u8 *src,
+				   size_t size)
+{
+	const struct zstd_fse_dentry *table = dctx->weight_table;
+	unsigned int max = ZSTD_HUF_MAX_LOG;
+	unsigned int log, s1, s2;
+	struct zstd_bitd bd;
+	int hdr, n = 0;
+
+	hdr = zstd_read_ncount(dctx->norm, &max, &log,
+			       ZSTD_HUF_WEIGHT_FSE_LOG, src, size);
+	if (hdr < 0)
+		return hdr;
+	if (hdr >= size)
+		return -EINVAL;
+	zstd_build_fse_table(dctx->weight_table, dctx->norm, max, log,
+			     dctx->spread);
+
+	if (zstd_bitd_init(&bd, src + hdr, size - hdr))
+		return -EINVAL;
+	s1 = zstd_bitd_read(&bd, log);
+	s2 = zstd_bitd_read(&bd, log);
+	if (bd.bits < 0)
+		return -EINVAL;
+
+	/* The stream ends once a state update runs past its start */
+	for (;;) {
+		if (n > ZSTD_HUF_MAX_SYMBOL - 2)
+			return -EINVAL;
+		dctx->weights[n++] = table[s1].symbol;
+		s1 = table[s1].new_state +
+		     zstd_bitd_read(&bd, table[s1].nb_bits);
+		if (bd.bits < 0) {
+			dctx->weights[n++] = table[s2].symbol;
+			break;
+		}
+		dctx->weights[n++] = table[s2].symbol;
+		s2 = table[s2].new_state +
+		     zstd_bitd_read(&bd, table[s2].nb_bits);
+		if (bd.bits < 0) {
+			dctx->weights[n++] = table[s1].symbol;
+			break;
+		}
+	}
+
+	return n;
+}
+
+/*
+ * Read a Huffman tree description and build the decoding table from it.
+ * Returns the number of bytes used.
+ */
+static int zstd_read_huf_tree(struct zstd_dctx *dctx, const u8 *src,
+			      size_t size)
+{
+	u32 rank_count[ZSTD_HUF_MAX_LOG + 2] = { 0 };
+	u32 rank_start[ZSTD_HUF_MAX_LOG + 2];
+	unsigned int max_bits, last, w, s;
+	u32 total = 0, rest, start;
+	int n, used;
+
+	if (!size)
+		return -EINVAL;
+
+	if (src[0] >= 128) {
+		n = src[0] - 127;
+		used = 1 + (n + 1) / 2;
+		if (used > size)
+			return -EINVAL;
+		for (s = 0; s < n; s++) {
+			u8 b = src[1 + s / 2];
+
+			dctx->weights[s] = (s & 1) ? b & 15 : b >> 4;
+		}
+	} else {
+		used = 1 + src[0];
+		if (used > size)
+			return -EINVAL;
+		n = zstd_decode_huf_weights(dctx, src + 1, src[0]);
+		if (n < 0)
+			return n;
+	}
+
+	for (s = 0; s < n; s++) {
+		w = dctx->weights[s];
+		if (w > ZSTD_HUF_MAX_LOG)
+			return -EINVAL;
+		rank_count[w]++;
+		if (w)
+			total += 1U << (w - 1);
+	}
+	if (!total)
+		return -EINVAL;
+
+	/* The weight of the last symbol completes the tree */
+	max_bits = zstd_highbit(total) + 1;
+	if (max_bits > ZSTD_HUF_MAX_LOG)
+		return -EINVAL;
+	rest = (1U << max_bits) - total;
+	if (rest & (rest - 1))
+		return -EINVAL;
+	last = zstd_highbit(rest) + 1;
+	dctx->weights[n++] = last;
+	rank_count[last]++;
+	if (rank_count[1] < 2 || (rank_count[1] & 1))
+		return -EINVAL;
+
+	start = 0;
+	for (w = 1; w <= max_bits; w++) {
+		rank_start[w] = start;
+		start += rank_count[w] << (w - 1);
+	}
+
+	for (s = 0; s < n; s++) {
+		u32 len, u;
+
+		w = dctx->weights[s];
+		if (!w)
+			continue;
+		len = 1U << (w - 1);
+		for (u = rank_start[w]; u < rank_start[w] + len; u++) {
+			dctx->huf_table[u].symbol = s;
+			dctx->huf_table[u].nb_bits = max_bits + 1 - w;
+		}
+		rank_start[w] += len;
+	}
+
+	dctx->huf_log = max_bits;
+	dctx->huf_valid = true;
+	return used;
+}
+
+static int zstd_huf_decode_stream(const struct zstd_dctx *dctx, u8 *dst,
+				  size_t n, const u8 *src, size_t size)
+{
+	const struct zstd_huf_dentry *table = dctx->huf_table;
+	unsigned int log = dctx->huf_log;
+	struct zstd_bitd bd;
+	size_t i;
+
+	if (zstd_bitd_init(&bd, src, size))
+		return -EINVAL;
+
+	for (i = 0; i < n; i++) {
+		const struct zstd_huf_dentry *e = &table[zstd_bitd_peek(&bd, log)];
+
+		dst[i] = e->symbol;
+		bd.bits -= e->nb_bits;
+	}
+
+	return bd.bits ? -EINVAL : 0;
+}
+
+/* Returns the size of the literals section */
+static int zstd_decode_literals(struct zstd_dctx *dctx, const u8 *src,
+				size_t size)
+{
+	enum zstd_literals_type type;
+	size_t regen, comp, avail, hs;
+	const u8 *ip;
+	unsigned int sf;
+	bool single;
+	int ret;
+
+	if (!size)
+		return -EINVAL;
+
+	type = src[0] & 3;
+	sf = (src[0] >> 2) & 3;
+
+	switch (type) {
+	case ZSTD_LITS_RAW:
+	case ZSTD_LITS_RLE:
+		if (!(sf & 1)) {
+			hs = 1;
+			regen = src[0] >> 3;
+		} else if (sf == 1) {
+			hs = 2;
+			if (size < hs)
+				return -EINVAL;
+			regen = (src[0] >> 4) + (src[1] << 4);
+		} else {
+			hs = 3;
+			if (size < hs)
+				return -EINVAL;
+			regen = (src[0] >> 4) + (src[1] << 4) + (src[2] << 12);
+		}
+		if (regen > ZSTD_BLOCKSIZE_MAX)
+			return -EINVAL;
+
+		if (type == ZSTD_LITS_RAW) {
+			if (hs + regen > size)
+				return -EINVAL;
+			dctx->lits = src + hs;
+			dctx->lits_size = regen;
+			return hs + regen;
+		}
+		if (hs + 1 > size)
+			return -EINVAL;
+		memset(dctx->lit_buf, src[hs], regen);
+		dctx->lits = dctx->lit_buf;
+		dctx->lits_size = regen;
+		return hs + 1;
+
+	case ZSTD_LITS_COMPRESSED:
+	case ZSTD_LITS_TREELESS:
+		break;
+	}
+
+	single = sf == 0;
+	if (sf < 2) {
+		u32 lhc;
+
+		hs = 3;
+		if (size < hs)
+			return -EINVAL;
+		lhc = src[0] | (src[1] << 8) | (src[2] << 16);
+		regen = (lhc >> 4) & 0x3FF;
+		comp = (lhc >> 14) & 0x3FF;
+	} else if (sf == 2) {
+		u32 lhc;
+
+		hs = 4;
+		if (size < hs)
+			return -EINVAL;
+		lhc = get_unaligned_le32(src);
+		regen = (lhc >> 4) & 0x3FFF;
+		comp = lhc >> 18;
+	} else {
+		u32 lhc;
+
+		hs = 5;
+		if (size < hs)
+			return -EINVAL;
+		lhc = get_unaligned_le32(src);
+		regen = (lhc >> 4) & 0x3FFFF;
+		comp = (lhc >> 22) + (src[4] << 10);
+	}
+	if (regen > ZSTD_BLOCKSIZE_MAX || hs + comp > size)
+		return -EINVAL;
+
+	ip = src + hs;
+	avail = comp;
+	if (type == ZSTD_LITS_COMPRESSED) {
+		ret = zstd_read_huf_tree(dctx, ip, avail);
+		if (ret < 0)
+			return ret;
+		ip += ret;
+		avail -= ret;
+	} else if (!dctx->huf_valid) {
+		return -EINVAL;
+	}
+
+	if (single) {
+		ret = zstd_huf_decode_stream(dctx, dctx->lit_buf, regen,
+					     ip, avail);
+	} else {
+		size_t seg = (regen + 3) / 4;
+		size_t s1, s2, s3, s4;
+
+		if (avail < 10 || 3 * seg > regen)
+			return -EINVAL;
+		s1 = get_unaligned_le16(ip);
+		s2 = get_unaligned_le16(ip + 2);
+		s3 = get_unaligned_le16(ip + 4);
+		if (s1 + s2 + s3 + 6 >= avail)
+			return -EINVAL;
+		s4 = avail - 6 - s1 - s2 - s3;
+		ip += 6;
+
+		ret = zstd_huf_decode_stream(dctx, dctx->lit_buf, seg,
+					     ip, s1);
+		if (!ret)
+			ret = zstd_huf_decode_stream(dctx, dctx->lit_buf + seg,
+						     seg, ip + s1, s2);
+		if (!ret)
+			ret = zstd_huf_decode_stream(dctx,
+						     dctx->lit_buf + 2 * seg,
+						     seg, ip + s1 + s2, s3);
+		if (!ret)
+			ret = zstd_huf_decode_stream(dctx,
+						     dctx->lit_buf + 3 * seg,
+						     regen - 3 * seg,
+						     ip + s1 + s2 + s3, s4);
+	}
+	if (ret)
+		return ret;
+
+	dctx->lits = dctx->lit_buf;
+	dctx->lits_size = regen;
+	return hs + comp;
+}
+
+static void zstd_copy_match(u8 *op, size_t offset, size_t len)
+{
+	const u8 *match = op - offset;
+
+	if (offset >= len) {
+		memcpy(op, match, len);
+		return;
+	}
+	while (len--)
+		*op++ = *match++;
+}
+
+/*
+ * Decode a compressed block to @op, with history reaching back to
+ * @prefix. Returns the number of bytes written.
+ */
+static size_t zstd_decode_block(struct zstd_dctx *dctx, u8 *op, u8 *oend,
+				const u8 *prefix, const u8 *src, size_t size)
+{
+	const u8 *ip = src, *iend = src + size;
+	const u8 *lit, *lit_end;
+	u8 *ostart = op;
+	u32 rep[ZSTD_REP_NUM];
+	unsigned int ll_state, of_state, ml_state;
+	struct zstd_bitd bd;
+	size_t nb_seq, i;
+	u8 modes;
+	int ret;
+
+	ret = zstd_decode_literals(dctx, ip, size);
+	if (ret < 0)
+		return ZSTD_ERROR(-ret);
+	ip += ret;
+	lit = dctx->lits;
+	lit_end = lit + dctx->lits_size;
+
+	if (ip >= iend)
+		return ZSTD_ERROR(EINVAL);
+	nb_seq = *ip++;
+	if (nb_seq >= 128) {
+		if (nb_seq == 255) {
+			if (ip + 2 > iend)
+				return ZSTD_ERROR(EINVAL);
+			nb_seq = get_unaligned_le16(ip) + 0x7F00;
+			ip += 2;
+		} else {
+			if (ip >= iend)
+				return ZSTD_ERROR(EINVAL);
+			nb_seq = ((nb_seq - 128) << 8) + *ip++;
+		}
+	}
+
+	if (!nb_seq) {
+		if (ip != iend)
+			return ZSTD_ERROR(EINVAL);
+		if (lit_end - lit > oend - op)
+			return ZSTD_ERROR(ENOSPC);
+		memcpy(op, lit, lit_end - lit);
+		return lit_end - lit;
+	}
+
+	if (ip >= iend)
+		return ZSTD_ERROR(EINVAL);
+	modes = *ip++;
+	if (modes & 3)
+		return ZSTD_ERROR(EINVAL);
+
+	ret = zstd_build_seq_table(dctx, dctx->ll_table, &dctx->ll_log,
+				   &dctx->ll_valid, modes >> 6,
+				   ZSTD_MAX_LL, ZSTD_LL_FSE_LOG,
+				   zstd_ll_default_norm, ZSTD_MAX_LL,
+				   ZSTD_LL_DEFAULT_LOG, ip, iend - ip);
+	if (ret < 0)
+		return ZSTD_ERROR(-ret);
+	ip += ret;
+	ret = zstd_build_seq_table(dctx, dctx->of_table, &dctx->of_log,
+				   &dctx->of_valid, (modes >> 4) & 3,
+				   ZSTD_MAX_OF, ZSTD_OF_FSE_LOG,
+				   zstd_of_default_norm,
+				   ZSTD_OF_DEFAULT_MAX,
+				   ZSTD_OF_DEFAULT_LOG, ip, iend - ip);
+	if (ret < 0)
+		return ZSTD_ERROR(-ret);
+	ip += ret;
+	ret = zstd_build_seq_table(dctx, dctx->ml_table, &dctx->ml_log,
+				   &dctx->ml_valid, (modes >> 2) & 3,
+				   ZSTD_MAX_ML, ZSTD_ML_FSE_LOG,
+				   zstd_ml_default_norm, ZSTD_MAX_ML,
+				   ZSTD_ML_DEFAULT_LOG, ip, iend - ip);
+	if (ret < 0)
+		return ZSTD_ERROR(-ret);
+	ip += ret;
+
+	if (zstd_bitd_init(&bd, ip, iend - ip))
+		return ZSTD_ERROR(EINVAL);
+	ll_state = zstd_bitd_read(&bd, dctx->ll_log);
+	of_state = zstd_bitd_read(&bd, dctx->of_log);
+	ml_state = zstd_bitd_read(&bd, dctx->ml_log);
+
+	memcpy(rep, dctx->rep, sizeof(rep));
+
+	for (i = 0; i < nb_seq; i++) {
+		const struct zstd_fse_dentry *lle = &dctx->ll_table[ll_state];
+		const struct zstd_fse_dentry *ofe = &dctx->of_table[of_state];
+		const struct zstd_fse_dentry *mle = &dctx->ml_table[ml_state];
+		unsigned int ll_code = lle->symbol;
+		unsigned int of_code = ofe->symbol;
+		unsigned int ml_code = mle->symbol;
+		size_t ll, ml;
+		u32 ov, off;
+
+		ov = (1U << of_code) + zstd_bitd_read(&bd, of_code);
+		ml = zstd_ml_base[ml_code] +
+		     zstd_bitd_read(&bd, zstd_ml_bits[ml_code]);
+		ll = zstd_ll_base[ll_code] +
+		     zstd_bitd_read(&bd, zstd_ll_bits[ll_code]);
+
+		if (ov > ZSTD_REP_NUM) {
+			off = ov - ZSTD_REP_NUM;
+			rep[2] = rep[1];
+			rep[1] = rep[0];
+			rep[0] = off;
+		} else {
+			unsigned int idx = ov - 1 + !ll;
+
+			if (!idx) {
+				off = rep[0];
+			} else {
+				off = idx == 3 ? rep[0] - 1 : rep[idx];
+				if (idx != 1)
+					rep[2] = rep[1];
+				rep[1] = rep[0];
+				rep[0] = off;
+			}
+		}
+
+		if (i + 1 < nb_seq) {
+			ll_state = lle->new_state +
+				   zstd_bitd_read(&bd, lle->nb_bits);
+			ml_state = mle->new_state +
+				   zstd_bitd_read(&bd, mle->nb_bits);
+			of_state = ofe->new_state +
+				   zstd_bitd_read(&bd, ofe->nb_bits);
+		}
+
+		if (ll > lit_end - lit)
+			return ZSTD_ERROR(EINVAL);
+		if (ll + ml > oend - op)
+			return ZSTD_ERROR(ENOSPC);
+		memcpy(op, lit, ll);
+		op += ll;
+		lit += ll;
+
+		if (!off || off > op - prefix)
+			return ZSTD_ERROR(EINVAL);
+		zstd_copy_match(op, off, ml);
+		op += ml;
+	}
+
+	if (bd.bits)
+		return ZSTD_ERROR(EINVAL);
+	memcpy(dctx->rep, rep, sizeof(rep));
+
+	if (lit_end - lit > oend - op)
+		return ZSTD_ERROR(ENOSPC);
+	memcpy(op, lit, lit_end - lit);
+	op += lit_end - lit;
+
+	return op - ostart;
+}
+
+/* Size of the frame header starting at @src, which has at least 5 bytes */
+static size_t zstd_frame_header_size(const u8 *src)
+{
+	static const u8 did_size[4] = { 0, 1, 2, 4 };
+	static const u8 fcs_size[4] = { 0, 2, 4, 8 };
+	u8 fhd = src[4];
+	bool single = fhd & (1 << 5);
+
+	return 5 + !single + did_size[fhd & 3] + fcs_size[fhd >> 6] +
+	       (single && !(fhd >> 6));
+}
+
+static size_t zstd_parse_frame_header(struct zstd_frame_header *fh,
+				      const u8 *src, size_t size)
+{
+	const u8 *ip = src + 5;
+	u8 fhd;
+	bool single;
+	u32 dict_id = 0;
+
+	if (size < 5)
+		return ZSTD_ERROR(EINVAL);
+	if (get_unaligned_le32(src) != ZSTD_MAGIC)
+		return ZSTD_ERROR(EINVAL);
+	fh->header_size = zstd_frame_header_size(src);
+	if (size < fh->header_size)
+		return ZSTD_ERROR(EINVAL);
+
+	fhd = src[4];
+	if (fhd & (1 << 3))
+		return ZSTD_ERROR(EINVAL);
+	single = fhd & (1 << 5);
+	fh->checksum = fhd & (1 << 2);
+
+	fh->window_size = 0;
+	if (!single) {
+		unsigned int exponent = *ip >> 3;
+		unsigned int mantissa = *ip & 7;
+		unsigned long long base;
+
+		base = 1ULL << (exponent + ZSTD_WINDOWLOG_MIN);
+		fh->window_size = base + (base >> 3) * mantissa;
+		ip++;
+	}
+
+	switch (fhd & 3) {
+	case 1:
+		dict_id = *ip;
+		ip += 1;
+		break;
+	case 2:
+		dict_id = get_unaligned_le16(ip);
+		ip += 2;
+		break;
+	case 3:
+		dict_id = get_unaligned_le32(ip);
+		ip += 4;
+		break;
+	}
+	if (dict_id)
+		return ZSTD_ERROR(EOPNOTSUPP);
+
+	fh->content_size = ZSTD_CONTENTSIZE_UNKNOWN;
+	switch (fhd >> 6) {
+	case 0:
+		if (single)
+			fh->content_size = *ip;
+		break;
+	case 1:
+		fh->content_size = get_unaligned_le16(ip) + 256;
+		break;
+	case 2:
+		fh->content_size = get_unaligned_le32(ip);
+		break;
+	case 3:
+		fh->content_size = get_unaligned_le64(ip);
+		break;
+	}
+	if (single)
+		fh->window_size = fh->content_size;
+
+	return 0;
+}
+
+/* Per frame state of the decoder */
+static void zstd_reset_frame(struct zstd_dctx *dctx)
+{
+	dctx->ll_valid = false;
+	dctx->of_valid = false;
+	dctx->ml_valid = false;
+	dctx->huf_valid = false;
+	dctx->rep[0] = 1;
+	dctx->rep[1] = 4;
+	dctx->rep[2] = 8;
+	if (dctx->fh.checksum)
+		xxh64_reset(&dctx->xxh, 0);
+}
+
+static size_t zstd_decompress_frame(struct zstd_dctx *dctx, u8 *dst,
+				    size_t dst_capacity, const u8 **srcp,
+				    size_t *sizep)
+{
+	const u8 *ip = *srcp, *iend = ip + *sizep;
+	u8 *op = dst, *oend = dst + dst_capacity;
+	size_t block_max, ret;
+	bool last;
+
+	ret = zstd_parse_frame_header(&dctx->fh, ip, iend - ip);
+	if (zstd_is_error(ret))
+		return ret;
+	ip += dctx->fh.header_size;
+	zstd_reset_frame(dctx);
+	block_max = min_t(unsigned long long, dctx->fh.window_size,
+			  ZSTD_BLOCKSIZE_MAX);
+
+	do {
+		enum zstd_block_type type;
+		size_t bsize;
+		u32 bh;
+
+		if (iend - ip < ZSTD_BLOCKHEADER_SIZE)
+			return ZSTD_ERROR(EINVAL);
+		bh = ip[0] | (ip[1] << 8) | (ip[2] << 16);
+		ip += ZSTD_BLOCKHEADER_SIZE;
+		last = bh & 1;
+		type = (bh >> 1) & 3;
+		bsize = bh >> 3;
+		if (bsize > block_max)
+			return ZSTD_ERROR(EINVAL);
+
+		switch (type) {
+		case ZSTD_BLOCK_RAW:
+			if (bsize > iend - ip)
+				return ZSTD_ERROR(EINVAL);
+			if (bsize > oend - op)
+				return ZSTD_ERROR(ENOSPC);
+			memcpy(op, ip, bsize);
+			ret = bsize;
+			ip += bsize;
+			break;
+		case ZSTD_BLOCK_RLE:
+			if (ip >= iend)
+				return ZSTD_ERROR(EINVAL);
+			if (bsize > oend - op)
+				return ZSTD_ERROR(ENOSPC);
+			memset(op, *ip, bsize);
+			ret = bsize;
+			ip++;
+			break;
+		case ZSTD_BLOCK_COMPRESSED:
+			if (bsize > iend - ip)
+				return ZSTD_ERROR(EINVAL);
+			ret = zstd_decode_block(dctx, op, oend, dst, ip, bsize);
+			if (zstd_is_error(ret))
+				return ret;
+			if (ret > block_max)
+				return ZSTD_ERROR(EINVAL);
+			ip += bsize;
+			break;
+		default:
+			return ZSTD_ERROR(EINVAL);
+		}
+
+		if (dctx->fh.checksum)
+			xxh64_update(&dctx->xxh, op, ret);
+		op += ret;
+	} while (!last);
+
+	if (dctx->fh.checksum) {
+		if (iend - ip < ZSTD_CHECKSUM_SIZE)
+			return ZSTD_ERROR(EINVAL);
+		if (get_unaligned_le32(ip) != (u32)xxh64_digest(&dctx->xxh))
+			return ZSTD_ERROR(EBADMSG);
+		ip += ZSTD_CHECKSUM_SIZE;
+	}
+
+	if (dctx->fh.content_size != ZSTD_CONTENTSIZE_UNKNOWN &&
+	    dctx->fh.content_size != op - dst)
+		return ZSTD_ERROR(EINVAL);
+
+	*sizep = iend - ip;
+	*srcp = ip;
+	return op - dst;
+}
+
+size_t zstd_dctx_workspace_bound(void)
+{
+	return sizeof(struct zstd_dctx);
+}
+EXPORT_SYMBOL(zstd_dctx_workspace_bound);
+
+struct zstd_dctx *zstd_init_dctx(void *workspace, size_t workspace_size)
+{
+	if (!workspace || !IS_ALIGNED((unsigned long)workspace, 8) ||
+	    workspace_size < sizeof(struct zstd_dctx))
+		return NULL;
+	memset(workspace, 0, sizeof(struct zstd_dctx));
+	return workspace;
+}
+EXPORT_SYMBOL(zstd_init_dctx);
+
+size_t zstd_decompress_dctx(struct zstd_dctx *dctx, void *dst,
+			    size_t dst_capacity, const void *src,
+			    size_t src_size)
+{
+	const u8 *ip = src;
+	u8 *op = dst;
+	size_t ret;
+
+	while (src_size) {
+		u32 magic;
+
+		if (src_size < ZSTD_FRAMEHEADER_MIN)
+			return ZSTD_ERROR(EINVAL);
+		magic = get_unaligned_le32(ip);
+		if ((magic & ZSTD_MAGIC_SKIPPABLE_MASK) == ZSTD_MAGIC_SKIPPABLE) {
+			size_t skip;
+
+			if (src_size < ZSTD_SKIPPABLEHEADER_SIZE)
+				return ZSTD_ERROR(EINVAL);
+			skip = get_unaligned_le32(ip + 4) +
+			       ZSTD_SKIPPABLEHEADER_SIZE;
+			if (skip > src_size)
+				return ZSTD_ERROR(EINVAL);
+			ip += skip;
+			src_size -= skip;
+			continue;
+		}
+
+		ret = zstd_decompress_frame(dctx, op, dst_capacity, &ip,
+					    &src_size);
+		if (zstd_is_error(ret))
+			return ret;
+		op += ret;
+		dst_capacity -= ret;
+	}
+
+	return op - (u8 *)dst;
+}
+EXPORT_SYMBOL(zstd_decompress_dctx);
+
+size_t zstd_dstream_workspace_bound(size_t max_window_size)
+{
+	return ALIGN(sizeof(struct zstd_dstream), 8) + ZSTD_BLOCKSIZE_MAX +
+	       max_window_size + ZSTD_BLOCKSIZE_MAX;
+}
+EXPORT_SYMBOL(zstd_dstream_workspace_bound);
+
+size_t zstd_reset_dstream(struct zstd_dstream *zds)
+{
+	zds->stage = ZSTD_DS_HEADER;
+	zds->in_len = 0;
+	zds->in_need = 5;
+	zds->wpos = 0;
+	zds->flushed = 0;
+	return 0;
+}
+EXPORT_SYMBOL(zstd_reset_dstream);
+
+struct zstd_dstream *zstd_init_dstream(size_t max_window_size,
+				       void *workspace, size_t workspace_size)
+{
+	struct zstd_dstream *zds = workspace;
+
+	if (max_window_size < (1U << ZSTD_WINDOWLOG_MIN))
+		max_window_size = 1U << ZSTD_WINDOWLOG_MIN;
+	if (!workspace || !IS_ALIGNED((unsigned long)workspace, 8) ||
+	    workspace_size < zstd_dstream_workspace_bound(max_window_size))
+		return NULL;
+
+	memset(zds, 0, sizeof(*zds));
+	zds->in_buf = (u8 *)workspace + ALIGN(sizeof(*zds), 8);
+	zds->window = zds->in_buf + ZSTD_BLOCKSIZE_MAX;
+	zds->max_window = max_window_size;
+	zstd_reset_dstream(zds);
+	return zds;
+}
+EXPORT_SYMBOL(zstd_init_dstream);
+
+static size_t zstd_dstream_start_frame(struct zstd_dstream *zds)
+{
+	struct zstd_dctx *dctx = &zds->dctx;
+	size_t ret;
+
+	ret = zstd_parse_frame_header(&dctx->fh, zds->in_buf, zds->in_len);
+	if (zstd_is_error(ret))
+		return ret;
+	if (dctx->fh.window_size > zds->max_window)
+		return ZSTD_ERROR(ENOMEM);
+
+	zstd_reset_frame(dctx);
+	zds->window_size = max_t(size_t, dctx->fh.window_size,
+				 1U << ZSTD_WINDOWLOG_MIN);
+	zds->block_max = min_t(size_t, zds->window_size, ZSTD_BLOCKSIZE_MAX);
+	zds->wpos = 0;
+	zds->flushed = 0;
+	zds->produced = 0;
+	return 0;
+}
+
+static size_t zstd_dstream_decode_block(struct zstd_dstream *zds)
+{
+	struct zstd_dctx *dctx = &zds->dctx;
+	size_t size = zds->max_window + ZSTD_BLOCKSIZE_MAX;
+	size_t ret;
+	u8 *op;
+
+	/* Keep a window worth of history, everything in it was flushed */
+	if (zds->wpos + zds->block_max > size) {
+		size_t keep = min(zds->wpos, zds->window_size);
+
+		memmove(zds->window, zds->window + zds->wpos - keep, keep);
+		zds->wpos = keep;
+		zds->flushed = keep;
+	}
+	op = zds->window + zds->wpos;
+
+	switch (zds->block_type) {
+	case ZSTD_BLOCK_RAW:
+		memcpy(op, zds->in_buf, zds->block_size);
+		ret = zds->block_size;
+		break;
+	case ZSTD_BLOCK_RLE:
+		memset(op, zds->in_buf[0], zds->block_size);
+		ret = zds->block_size;
+		break;
+	default:
+		ret = zstd_decode_block(dctx, op, op + zds->block_max,
+					zds->window, zds->in_buf, zds->in_len);
+		if (zstd_is_error(ret))
+			return zstd_get_error(ret) == -ENOSPC ? ZSTD_ERROR(EINVAL) : ret;
+		break;
+	}
+
+	if (dctx->fh.checksum)
+		xxh64_update(&dctx->xxh, op, ret);
+	zds->wpos += ret;
+	zds->produced += ret;
+	return 0;
+}
+
+size_t zstd_decompress_stream(struct zstd_dstream *zds,
+			      struct zstd_out_buffer *output,
+			      struct zstd_in_buffer *input)
+{
+	struct zstd_dctx *dctx = &zds->dctx;
+	size_t n, ret;
+	u32 bh;
+
+	for (;;) {
+		if (zds->flushed < zds->wpos) {
+			n = min(zds->wpos - zds->flushed,
+				output->size - output->pos);
+			memcpy((u8 *)output->dst + output->pos,
+			       zds->window + zds->flushed, n);
+			output->pos += n;
+			zds->flushed += n;
+			if (zds->flushed < zds->wpos)
+				return max_t(size_t, zds->in_need - zds->in_len, 1);
+		}
+
+		if (zds->stage == ZSTD_DS_DONE) {
+			zstd_reset_dstream(zds);
+			return 0;
+		}
+
+		if (zds->stage == ZSTD_DS_SKIP) {
+			n = min(zds->skip_left, input->size - input->pos);
+			input->pos += n;
+			zds->skip_left -= n;
+			if (zds->skip_left)
+				return zds->skip_left;
+			zstd_reset_dstream(zds);
+			continue;
+		}
+
+		n = min(zds->in_need - zds->in_len, input->size - input->pos);
+		memcpy(zds->in_buf + zds->in_len,
+		       (const u8 *)input->src + input->pos, n);
+		input->pos += n;
+		zds->in_len += n;
+		if (zds->in_len < zds->in_need)
+			return zds->in_need - zds->in_len;
+
+		switch (zds->stage) {
+		case ZSTD_DS_HEADER:
+			if ((get_unaligned_le32(zds->in_buf) &
+			     ZSTD_MAGIC_SKIPPABLE_MASK) == ZSTD_MAGIC_SKIPPABLE) {
+				if (zds->in_len < ZSTD_SKIPPABLEHEADER_SIZE) {
+					zds->in_need = ZSTD_SKIPPABLEHEADER_SIZE;
+					continue;
+				}
+				zds->skip_left = get_unaligned_le32(zds->in_buf + 4);
+				zds->stage = ZSTD_DS_SKIP;
+				continue;
+			}
+			if (get_unaligned_le32(zds->in_buf) != ZSTD_MAGIC)
+				return ZSTD_ERROR(EINVAL);
+			n = zstd_frame_header_size(zds->in_buf);
+			if (zds->in_len < n) {
+				zds->in_need = n;
+				continue;
+			}
+			ret = zstd_dstream_start_frame(zds);
+			if (zstd_is_error(ret))
+				return ret;
+			zds->stage = ZSTD_DS_BLOCK_HEADER;
+			zds->in_need = ZSTD_BLOCKHEADER_SIZE;
+			break;
+
+		case ZSTD_DS_BLOCK_HEADER:
+			bh = zds->in_buf[0] | (zds->in_buf[1] << 8) |
+			     (zds->in_buf[2] << 16);
+			zds->last_block = bh & 1;
+			zds->block_type = (bh >> 1) & 3;
+			zds->block_size = bh >> 3;
+			if (zds->block_type == ZSTD_BLOCK_RESERVED ||
+			    zds->block_size > zds->block_max)
+				return ZSTD_ERROR(EINVAL);
+			zds->stage = ZSTD_DS_BLOCK;
+			zds->in_need = zds->block_type == ZSTD_BLOCK_RLE ?
+				       1 : zds->block_size;
+			break;
+
+		case ZSTD_DS_BLOCK:
+			ret = zstd_dstream_decode_block(zds);
+			if (zstd_is_error(ret))
+				return ret;
+			if (!zds->last_block) {
+				zds->stage = ZSTD_DS_BLOCK_HEADER;
+				zds->in_need = ZSTD_BLOCKHEADER_SIZE;
+			} else if (dctx->fh.checksum) {
+				zds->stage = ZSTD_DS_CHECKSUM;
+				zds->in_need = ZSTD_CHECKSUM_SIZE;
+			} else {
+				zds->stage = ZSTD_DS_DONE;
+				zds->in_need = 0;
+			}
+			break;
+
+		case ZSTD_DS_CHECKSUM:
+			if (get_unaligned_le32(zds->in_buf) !=
+			    (u32)xxh64_digest(&dctx->xxh))
+				return ZSTD_ERROR(EBADMSG);
+			zds->stage = ZSTD_DS_DONE;
+			zds->in_need = 0;
+			break;
+
+		default:
+			return ZSTD_ERROR(EINVAL);
+		}
+		zds->in_len = 0;
+
+		if (zds->stage == ZSTD_DS_DONE &&
+		    dctx->fh.content_size != ZSTD_CONTENTSIZE_UNKNOWN &&
+		    dctx->fh.content_size != zds->produced)
+			return ZSTD_ERROR(EINVAL);
+	}
+}
+EXPORT_SYMBOL(zstd_decompress_stream);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("Zstandard decompressor");
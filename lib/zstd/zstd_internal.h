@@ -0,0 +1,152 @@
+/*
+ * Definitions shared by the Zstandard compressor and decompressor
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+#ifndef _ZSTD_INTERNAL_H
+#define _ZSTD_INTERNAL_H
+
+#include <linux/bitops.h>
+#include <linux/kernel.h>
+#include <linux/types.h>
+#include <linux/xxhash.h>
+#include <linux/zstd.h>
+#include <asm/unaligned.h>
+
+#define ZSTD_MAGIC		0xFD2FB528U
+#define ZSTD_MAGIC_SKIPPABLE	0x184D2A50U	/* low 4 bits are free */
+#define ZSTD_MAGIC_SKIPPABLE_MASK 0xFFFFFFF0U
+
+#define ZSTD_FRAMEHEADER_MIN	6	/* magic, descriptor, window */
+#define ZSTD_FRAMEHEADER_MAX	18
+#define ZSTD_BLOCKHEADER_SIZE	3
+#define ZSTD_CHECKSUM_SIZE	4
+#define ZSTD_SKIPPABLEHEADER_SIZE 8
+
+enum zstd_block_type {
+	ZSTD_BLOCK_RAW,
+	ZSTD_BLOCK_RLE,
+	ZSTD_BLOCK_COMPRESSED,
+	ZSTD_BLOCK_RESERVED,
+};
+
+enum zstd_literals_type {
+	ZSTD_LITS_RAW,
+	ZSTD_LITS_RLE,
+	ZSTD_LITS_COMPRESSED,
+	ZSTD_LITS_TREELESS,
+};
+
+enum zstd_seq_mode {
+	ZSTD_SEQ_PREDEFINED,
+	ZSTD_SEQ_RLE,
+	ZSTD_SEQ_COMPRESSED,
+	ZSTD_SEQ_REPEAT,
+};
+
+#define ZSTD_MINMATCH		3	/* smallest match the format can encode */
+#define ZSTD_REP_NUM		3
+
+#define ZSTD_MAX_LL		35
+#define ZSTD_MAX_ML		52
+#define ZSTD_MAX_OF		31
+#define ZSTD_MAX_SEQ_SYMBOL	ZSTD_MAX_ML
+#define ZSTD_LL_FSE_LOG		9
+#define ZSTD_ML_FSE_LOG		9
+#define ZSTD_OF_FSE_LOG		8
+#define ZSTD_FSE_MIN_LOG	5
+
+#define ZSTD_HUF_MAX_LOG	11
+#define ZSTD_HUF_MAX_SYMBOL	255
+#define ZSTD_HUF_WEIGHT_FSE_LOG	6
+
+static const u32 zstd_ll_base[ZSTD_MAX_LL + 1] = {
+	0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15,
+	16, 18, 20, 22, 24, 28, 32, 40, 48, 64, 0x80, 0x100, 0x200, 0x400,
+	0x800, 0x1000, 0x2000, 0x4000, 0x8000, 0x10000,
+};
+
+static const u8 zstd_ll_bits[ZSTD_MAX_LL + 1] = {
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	1, 1, 1, 1, 2, 2, 3, 3, 4, 6, 7, 8, 9, 10,
+	11, 12, 13, 14, 15, 16,
+};
+
+static const u32 zstd_ml_base[ZSTD_MAX_ML + 1] = {
+	3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 17, 18,
+	19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30, 31, 32, 33, 34,
+	35, 37, 39, 41, 43, 47, 51, 59, 67, 83, 99, 0x83, 0x103, 0x203,
+	0x403, 0x803, 0x1003, 0x2003, 0x4003, 0x8003, 0x10003,
+};
+
+static const u8 zstd_ml_bits[ZSTD_MAX_ML + 1] = {
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	1, 1, 1, 1, 2, 2, 3, 3, 4, 4, 5, 7, 8, 9,
+	10, 11, 12, 13, 14, 15, 16,
+};
+
+/* Distributions used by the predefined sequence mode */
+#define ZSTD_LL_DEFAULT_LOG	6
+#define ZSTD_ML_DEFAULT_LOG	6
+#define ZSTD_OF_DEFAULT_LOG	5
+#define ZSTD_OF_DEFAULT_MAX	28
+
+static const s16 zstd_ll_default_norm[ZSTD_MAX_LL + 1] = {
+	4, 3, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 1, 1, 1,
+	2, 2, 2, 2, 2, 2, 2, 2, 2, 3, 2, 1, 1, 1, 1, 1,
+	-1, -1, -1, -1,
+};
+
+static const s16 zstd_ml_default_norm[ZSTD_MAX_ML + 1] = {
+	1, 4, 3, 2, 2, 2, 2, 2, 2, 1, 1, 1, 1, 1, 1, 1,
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, -1, -1,
+	-1, -1, -1, -1, -1,
+};
+
+static const s16 zstd_of_default_norm[ZSTD_OF_DEFAULT_MAX + 1] = {
+	1, 1, 1, 1, 1, 1, 2, 2, 2, 1, 1, 1, 1, 1, 1, 1,
+	1, 1, 1, 1, 1, 1, 1, 1, -1, -1, -1, -1, -1,
+};
+
+static inline unsigned int zstd_highbit(u32 val)
+{
+	return __fls(val);
+}
+
+/*
+ * The FSE symbol spread shared by the encoding and decoding tables: the
+ * low probability symbols go to the end of the table, the others are
+ * scattered with a step that visits every slot once. @spread must hold
+ * 1 << @table_log entries.
+ */
+static inline void zstd_fse_spread(u8 *spread, const s16 *norm,
+				   unsigned int max_symbol,
+				   unsigned int table_log)
+{
+	unsigned int size = 1U << table_log;
+	unsigned int mask = size - 1;
+	unsigned int step = (size >> 1) + (size >> 3) + 3;
+	unsigned int high = size - 1;
+	unsigned int pos = 0;
+	unsigned int s;
+	int i;
+
+	for (s = 0; s <= max_symbol; s++)
+		if (norm[s] == -1)
+			spread[high--] = s;
+
+	for (s = 0; s <= max_symbol; s++) {
+		for (i = 0; i < norm[s]; i++) {
+			spread[pos] = s;
+			do {
+				pos = (pos + step) & mask;
+			} while (pos > high);
+		}
+	}
+}
+
+#endif /* _ZSTD_INTERNAL_H */
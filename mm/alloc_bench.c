@@ -0,0 +1,652 @@
+/*
+ * Slab and page allocator microbenchmark
+ *
+ * Runs alloc/free patterns against the slab and page allocators from a
+ * number of kthreads, one per CPU, and reports the cost of every operation
+ * in cycles as a log2 histogram.  It is controlled through
+ * <debugfs>/alloc_bench/:
+ *
+ *   threads, loops, batch,	parameters of the next run
+ *   size, order, node
+ *   run			write a test name to run it, read for the tests
+ *   results			histograms of the last run
+ *
+ * Each loop of a thread allocates @batch objects and then frees them.  The
+ * cross-CPU tests hand the objects of every thread over to the thread on
+ * the next CPU to be freed, and the node tests allocate from @node rather
+ * than from the local node.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/kthread.h>
+#include <linux/completion.h>
+#include <linux/module.h>
+#include <linux/mutex.h>
+#include <linux/slab.h>
+#include <linux/gfp.h>
+#include <linux/cpu.h>
+#include <linux/timex.h>
+#include <linux/uaccess.h>
+
+#define AB_NR_BUCKETS	32
+#define AB_MAX_BATCH	4096
+
+enum ab_op {
+	AB_ALLOC,
+	AB_FREE,
+	AB_NR_OPS,
+};
+
+static const char * const ab_op_names[AB_NR_OPS] = {
+	[AB_ALLOC] = "alloc",
+	[AB_FREE] = "free",
+};
+
+struct ab_hist {
+	u64 count;
+	u64 sum;
+	u64 min;
+	u64 max;
+	u64 buckets[AB_NR_BUCKETS];
+};
+
+struct ab_thread {
+	struct task_struct *task;
+	int id;
+	int cpu;
+	void **objs;
+	unsigned int nr_objs;
+	unsigned long failed;
+	struct ab_hist hist[AB_NR_OPS];
+};
+
+struct ab_run;
+
+struct ab_test {
+	const char *name;
+	void *(*alloc)(struct ab_run *run);
+	void (*free)(struct ab_run *run, void *obj);
+	bool slab;		/* needs run->cache */
+	bool bulk;		/* uses the kmem_cache bulk interface */
+	bool cross_cpu;		/* objects are freed by the next thread */
+	bool remote_node;	/* allocates from run->node */
+};
+
+/* A run, with the parameters it was started with and its results */
+struct ab_run {
+	const struct ab_test *test;
+	unsigned int nr_threads;
+	unsigned int loops;
+	unsigned int batch;
+	unsigned int size;
+	unsigned int order;
+	int node;
+	struct kmem_cache *cache;
+	struct ab_thread *threads;
+};
+
+/* Parameters of the next run */
+static u32 ab_nr_threads;
+static u32 ab_loops = 1000;
+static u32 ab_batch = 64;
+static u32 ab_size = 64;
+static u32 ab_order;
+static int ab_node = NUMA_NO_NODE;
+
+static DEFINE_MUTEX(ab_mutex);
+static struct ab_run ab_last;
+static struct dentry *ab_dir;
+
+static atomic_t ab_running;
+static DECLARE_COMPLETION(ab_done);
+static atomic_t ab_barrier_count;
+static atomic_t ab_barrier_gen;
+
+static void *ab_slab_alloc(struct ab_run *run)
+{
+	return kmem_cache_alloc(run->cache, GFP_KERNEL);
+}
+
+static void *ab_slab_alloc_node(struct ab_run *run)
+{
+	return kmem_cache_alloc_node(run->cache, GFP_KERNEL, run->node);
+}
+
+static void ab_slab_free(struct ab_run *run, void *obj)
+{
+	kmem_cache_free(run->cache, obj);
+}
+
+static void *ab_page_alloc(struct ab_run *run)
+{
+	return alloc_pages(GFP_KERNEL, run->order);
+}
+
+static void *ab_page_alloc_node(struct ab_run *run)
+{
+	return alloc_pages_node(run->node, GFP_KERNEL | __GFP_THISNODE,
+				run->order);
+}
+
+static void ab_page_free(struct ab_run *run, void *obj)
+{
+	__free_pages(obj, run->order);
+}
+
+static const struct ab_test ab_tests[] = {
+	{
+		.name = "slab",
+		.alloc = ab_slab_alloc,
+		.free = ab_slab_free,
+		.slab = true,
+	}, {
+		.name = "slab_remote",
+		.alloc = ab_slab_alloc,
+		.free = ab_slab_free,
+		.slab = true,
+		.cross_cpu = true,
+	}, {
+		.name = "slab_bulk",
+		.slab = true,
+		.bulk = true,
+	}, {
+		.name = "slab_node",
+		.alloc = ab_slab_alloc_node,
+		.free = ab_slab_free,
+		.slab = true,
+		.remote_node = true,
+	}, {
+		.name = "page",
+		.alloc = ab_page_alloc,
+		.free = ab_page_free,
+	}, {
+		.name = "page_remote",
+		.alloc = ab_page_alloc,
+		.free = ab_page_free,
+		.cross_cpu = true,
+	}, {
+		.name = "page_node",
+		.alloc = ab_page_alloc_node,
+		.free = ab_page_free,
+		.remote_node = true,
+	},
+};
+
+static void ab_record(struct ab_hist *h, cycles_t start)
+{
+	u64 delta = get_cycles() - start;
+
+	h->count++;
+	h->sum += delta;
+	h->min = min(h->min, delta);
+	h->max = max(h->max, delta);
+	h->buckets[min(fls64(delta), AB_NR_BUCKETS - 1)]++;
+}
+
+/*
+ * Wait for all threads of the run to get here.  The threads are bound to
+ * different CPUs, so spinning is fine.
+ */
+static void ab_barrier(struct ab_run *run)
+{
+	int gen = atomic_read(&ab_barrier_gen);
+
+	if (atomic_inc_return(&ab_barrier_count) == run->nr_threads) {
+		atomic_set(&ab_barrier_count, 0);
+		smp_mb__before_atomic();
+		atomic_inc(&ab_barrier_gen);
+		return;
+	}
+
+	while (atomic_read(&ab_barrier_gen) == gen) {
+		cond_resched();
+		cpu_relax();
+	}
+}
+
+static void ab_alloc_batch(struct ab_run *run, struct ab_thread *t)
+{
+	struct ab_hist *h = &t->hist[AB_ALLOC];
+	unsigned int i;
+	cycles_t start;
+
+	if (run->test->bulk) {
+		start = get_cycles();
+		t->nr_objs = kmem_cache_alloc_bulk(run->cache, GFP_KERNEL,
+						   run->batch, t->objs);
+		ab_record(h, start);
+		if (!t->nr_objs)
+			t->failed++;
+		return;
+	}
+
+	t->nr_objs = 0;
+	for (i = 0; i < run->batch; i++) {
+		void *obj;
+
+		start = get_cycles();
+		obj = run->test->alloc(run);
+		ab_record(h, start);
+		if (!obj) {
+			t->failed++;
+			continue;
+		}
+		t->objs[t->nr_objs++] = obj;
+	}
+}
+
+/* Free the objects allocated by @victim, accounting them to @t */
+static void ab_free_batch(struct ab_run *run, struct ab_thread *t,
+			  struct ab_thread *victim)
+{
+	struct ab_hist *h = &t->hist[AB_FREE];
+	unsigned int i;
+	cycles_t start;
+
+	if (!victim->nr_objs)
+		return;
+
+	if (run->test->bulk) {
+		start = get_cycles();
+		kmem_cache_free_bulk(run->cache, victim->nr_objs, victim->objs);
+		ab_record(h, start);
+		return;
+	}
+
+	for (i = 0; i < victim->nr_objs; i++) {
+		start = get_cycles();
+		run->test->free(run, victim->objs[i]);
+		ab_record(h, start);
+	}
+}
+
+static int ab_thread_fn(void *data)
+{
+	struct ab_thread *t = data;
+	struct ab_run *run = &ab_last;
+	struct ab_thread *victim = t;
+	unsigned int loop;
+
+	if (run->test->cross_cpu)
+		victim = &run->threads[(t->id + 1) % run->nr_threads];
+
+	/* start all threads at the same time */
+	ab_barrier(run);
+
+	for (loop = 0; loop < run->loops; loop++) {
+		ab_alloc_batch(run, t);
+		if (run->test->cross_cpu)
+			ab_barrier(run);
+		ab_free_batch(run, t, victim);
+		if (run->test->cross_cpu)
+			ab_barrier(run);
+		cond_resched();
+	}
+
+	if (atomic_dec_and_test(&ab_running))
+		complete(&ab_done);
+
+	/* stay around until ab_run_test() is done with us */
+	set_current_state(TASK_INTERRUPTIBLE);
+	while (!kthread_should_stop()) {
+		schedule();
+		set_current_state(TASK_INTERRUPTIBLE);
+	}
+	__set_current_state(TASK_RUNNING);
+	return 0;
+}
+
+static void ab_free_run(struct ab_run *run)
+{
+	unsigned int i;
+
+	if (run->threads) {
+		for (i = 0; i < run->nr_threads; i++)
+			kfree(run->threads[i].objs);
+		kfree(run->threads);
+		run->threads = NULL;
+	}
+	if (run->cache) {
+		kmem_cache_destroy(run->cache);
+		run->cache = NULL;
+	}
+}
+
+static int ab_start_threads(struct ab_run *run)
+{
+	struct ab_thread *t;
+	unsigned int i;
+	int cpu = -1;
+
+	for (i = 0; i < run->nr_threads; i++) {
+		t = &run->threads[i];
+		cpu = cpumask_next(cpu, cpu_online_mask);
+		t->cpu = cpu;
+		t->task = kthread_create_on_node(ab_thread_fn, t,
+						 cpu_to_node(cpu),
+						 "alloc_bench/%d", cpu);
+		if (IS_ERR(t->task)) {
+			int err = PTR_ERR(t->task);
+
+			/* none of them ran yet, so they can be stopped */
+			while (i--)
+				kthread_stop(run->threads[i].task);
+			return err;
+		}
+		kthread_bind(t->task, cpu);
+	}
+
+	atomic_set(&ab_running, run->nr_threads);
+	atomic_set(&ab_barrier_count, 0);
+	reinit_completion(&ab_done);
+	for (i = 0; i < run->nr_threads; i++)
+		wake_up_process(run->threads[i].task);
+
+	return 0;
+}
+
+static int ab_run_test(const struct ab_test *test)
+{
+	struct ab_run *run = &ab_last;
+	unsigned int i, j;
+	int ret;
+
+	ab_free_run(run);
+	memset(run, 0, sizeof(*run));
+	run->test = test;
+	run->loops = ab_loops;
+	run->batch = ab_batch;
+	run->size = ab_size;
+	run->order = ab_order;
+	run->node = ab_node;
+
+	if (!run->loops || !run->batch || run->batch > AB_MAX_BATCH)
+		return -EINVAL;
+	if (test->slab && (!run->size || run->size > KMALLOC_MAX_SIZE))
+		return -EINVAL;
+	if (!test->slab && run->order >= MAX_ORDER)
+		return -EINVAL;
+	if (test->remote_node &&
+	    (run->node < 0 || run->node >= MAX_NUMNODES ||
+	     !node_online(run->node)))
+		return -EINVAL;
+
+	if (test->slab) {
+		run->cache = kmem_cache_create("alloc_bench", run->size, 0, 0,
+					       NULL);
+		if (!run->cache)
+			return -ENOMEM;
+	}
+
+	get_online_cpus();
+
+	run->nr_threads = ab_nr_threads ?: num_online_cpus();
+	run->nr_threads = min(run->nr_threads, num_online_cpus());
+	ret = -EINVAL;
+	if (test->cross_cpu && run->nr_threads < 2)
+		goto out;
+
+	ret = -ENOMEM;
+	run->threads = kcalloc(run->nr_threads, sizeof(*run->threads),
+			       GFP_KERNEL);
+	if (!run->threads)
+		goto out;
+	for (i = 0; i < run->nr_threads; i++) {
+		struct ab_thread *t = &run->threads[i];
+
+		t->id = i;
+		t->objs = kcalloc(run->batch, sizeof(*t->objs), GFP_KERNEL);
+		if (!t->objs)
+			goto out;
+		for (j = 0; j < AB_NR_OPS; j++)
+			t->hist[j].min = U64_MAX;
+	}
+
+	ret = ab_start_threads(run);
+	if (ret)
+		goto out;
+	wait_for_completion(&ab_done);
+	for (i = 0; i < run->nr_threads; i++)
+		kthread_stop(run->threads[i].task);
+out:
+	put_online_cpus();
+
+	if (run->cache) {
+		kmem_cache_destroy(run->cache);
+		run->cache = NULL;
+	}
+	if (ret)
+		ab_free_run(run);
+	return ret;
+}
+
+static ssize_t ab_run_read(struct file *file, char __user *ubuf,
+			   size_t count, loff_t *ppos)
+{
+	char buf[256];
+	int i, len = 0;
+
+	for (i = 0; i < ARRAY_SIZE(ab_tests); i++)
+		len += scnprintf(buf + len, sizeof(buf) - len, "%s%s",
+				 i ? " " : "", ab_tests[i].name);
+	len += scnprintf(buf + len, sizeof(buf) - len, "\n");
+
+	return simple_read_from_buffer(ubuf, count, ppos, buf, len);
+}
+
+static ssize_t ab_run_write(struct file *file, const char __user *ubuf,
+			    size_t count, loff_t *ppos)
+{
+	const struct ab_test *test = NULL;
+	char buf[32], *name;
+	int i, ret;
+
+	if (count >= sizeof(buf))
+		return -EINVAL;
+	if (copy_from_user(buf, ubuf, count))
+		return -EFAULT;
+	buf[count] = '\0';
+	name = strim(buf);
+
+	for (i = 0; i < ARRAY_SIZE(ab_tests); i++) {
+		if (!strcmp(name, ab_tests[i].name)) {
+			test = &ab_tests[i];
+			break;
+		}
+	}
+	if (!test)
+		return -EINVAL;
+
+	mutex_lock(&ab_mutex);
+	ret = ab_run_test(test);
+	mutex_unlock(&ab_mutex);
+
+	return ret ? ret : count;
+}
+
+static const struct file_operations ab_run_fops = {
+	.owner		= THIS_MODULE,
+	.read		= ab_run_read,
+	.write		= ab_run_write,
+	.llseek		= default_llseek,
+};
+
+static void ab_show_hist(struct seq_file *m, const char *name,
+			 struct ab_hist *h)
+{
+	int i;
+
+	if (!h->count)
+		return;
+
+	seq_printf(m, "%s: count %llu min %llu avg %llu max %llu cycles\n",
+		   name, h->count, h->min, div64_u64(h->sum, h->count),
+		   h->max);
+	for (i = 0; i < AB_NR_BUCKETS; i++) {
+		if (!h->buckets[i])
+			continue;
+		if (i == AB_NR_BUCKETS - 1)
+			seq_printf(m, "  >= %-11llu %llu\n", 1ULL << (i - 1),
+				   h->buckets[i]);
+		else
+			seq_printf(m, "  < %-12llu %llu\n", 1ULL << i,
+				   h->buckets[i]);
+	}
+}
+
+static int ab_results_show(struct seq_file *m, void *v)
+{
+	struct ab_run *run = &ab_last;
+	struct ab_hist total;
+	unsigned long failed = 0;
+	unsigned int i, j, op;
+
+	mutex_lock(&ab_mutex);
+	if (!run->threads)
+		goto out;
+
+	seq_printf(m, "test %s threads %u loops %u batch %u",
+		   run->test->name, run->nr_threads, run->loops, run->batch);
+	if (run->test->slab)
+		seq_printf(m, " size %u", run->size);
+	else
+		seq_printf(m, " order %u", run->order);
+	if (run->test->remote_node)
+		seq_printf(m, " node %d", run->node);
+	seq_puts(m, "\n");
+	if (run->test->bulk)
+		seq_printf(m, "cycles are per call of %u objects\n",
+			   run->batch);
+
+	for (op = 0; op < AB_NR_OPS; op++) {
+		memset(&total, 0, sizeof(total));
+		total.min = U64_MAX;
+		for (i = 0; i < run->nr_threads; i++) {
+			struct ab_hist *h = &run->threads[i].hist[op];
+
+			total.count += h->count;
+			total.sum += h->sum;
+			total.min = min(total.min, h->min);
+			total.max = max(total.max, h->max);
+			for (j = 0; j < AB_NR_BUCKETS; j++)
+				total.buckets[j] += h->buckets[j];
+		}
+		seq_puts(m, "\n");
+		ab_show_hist(m, ab_op_names[op], &total);
+	}
+
+	seq_puts(m, "\n");
+	for (i = 0; i < run->nr_threads; i++) {
+		struct ab_thread *t = &run->threads[i];
+
+		seq_printf(m, "cpu %d:", t->cpu);
+		for (op = 0; op < AB_NR_OPS; op++) {
+			struct ab_hist *h = &t->hist[op];
+
+			seq_printf(m, " %s avg %llu", ab_op_names[op],
+				   h->count ? div64_u64(h->sum, h->count) : 0);
+		}
+		seq_puts(m, "\n");
+		failed += t->failed;
+	}
+	if (failed)
+		seq_printf(m, "failed allocations: %lu\n", failed);
+out:
+	mutex_unlock(&ab_mutex);
+	return 0;
+}
+
+static int ab_results_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, ab_results_show, NULL);
+}
+
+static const struct file_operations ab_results_fops = {
+	.owner		= THIS_MODULE,
+	.open		= ab_results_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static int ab_node_get(void *data, u64 *val)
+{
+	*val = ab_node;
+	return 0;
+}
+
+static int ab_node_set(void *data, u64 val)
+{
+	int node = val;
+
+	if (node != NUMA_NO_NODE && (node < 0 || node >= MAX_NUMNODES))
+		return -EINVAL;
+	ab_node = node;
+	return 0;
+}
+DEFINE_SIMPLE_ATTRIBUTE(ab_node_fops, ab_node_get, ab_node_set, "%lld\n");
+
+static void alloc_bench_exit(void)
+{
+	debugfs_remove_recursive(ab_dir);
+	ab_free_run(&ab_last);
+}
+
+static int __init alloc_bench_init(void)
+{
+	struct dentry *dentry;
+
+	ab_dir = debugfs_create_dir("alloc_bench", NULL);
+	if (!ab_dir)
+		return -ENOMEM;
+
+	dentry = debugfs_create_u32("threads", 0600, ab_dir, &ab_nr_threads);
+	if (!dentry)
+		goto fail;
+
+	dentry = debugfs_create_u32("loops", 0600, ab_dir, &ab_loops);
+	if (!dentry)
+		goto fail;
+
+	dentry = debugfs_create_u32("batch", 0600, ab_dir, &ab_batch);
+	if (!dentry)
+		goto fail;
+
+	dentry = debugfs_create_u32("size", 0600, ab_dir, &ab_size);
+	if (!dentry)
+		goto fail;
+
+	dentry = debugfs_create_u32("order", 0600, ab_dir, &ab_order);
+	if (!dentry)
+		goto fail;
+
+	dentry = debugfs_create_file("node", 0600, ab_dir, NULL,
+				     &ab_node_fops);
+	if (!dentry)
+		goto fail;
+
+	dentry = debugfs_create_file("run", 0600, ab_dir, NULL, &ab_run_fops);
+	if (!dentry)
+		goto fail;
+
+	dentry = debugfs_create_file("results", 0400, ab_dir, NULL,
+				     &ab_results_fops);
+	if (!dentry)
+		goto fail;
+
+	return 0;
+fail:
+	alloc_bench_exit();
+	return -ENOMEM;
+}
+
+module_init(alloc_bench_init);
+module_exit(alloc_bench_exit);
+
+MODULE_DESCRIPTION("Slab and page allocator microbenchmark");
+MODULE_LICENSE("GPL");
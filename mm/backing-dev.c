@@ -302,6 +302,7 @@ static int wb_init(struct bdi_writeback *wb, struct backing_dev_info *bdi,
 	spin_lock_init(&wb->list_lock);
 
 	wb->bw_time_stamp = jiffies;
+	wb->dirty_sleep = jiffies;
 	wb->balanced_dirty_ratelimit = INIT_BW;
 	wb->dirty_ratelimit = INIT_BW;
 	wb->write_bandwidth = INIT_BW;
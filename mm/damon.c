@@ -0,0 +1,1440 @@
+/*
+ * DAMON: Data Access MONitor
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * DAMON reports how often each part of the virtual address space of a set
+ * of processes gets accessed, at a cost that does not grow with the size of
+ * the monitored memory.
+ *
+ * The address space of each target is divided into regions.  Each sampling
+ * interval, the accessed bit of one randomly picked page per region is
+ * cleared and checked again at the next sampling, and the result is counted
+ * as the access frequency of the whole region.  At the end of each
+ * aggregation interval, adjacent regions of similar frequency are merged
+ * and each region is split into randomly sized pieces again, so that the
+ * regions converge to areas of uniform access frequency while their number
+ * stays bounded.  The result is reported through the damon_aggregated
+ * tracepoint, and can drive madvise() actions on regions that match
+ * user-provided access patterns.
+ *
+ * Unlike idle page tracking, which reports per-page information that
+ * userspace has to scan and aggregate, this bounds both the monitoring
+ * overhead and the amount of reported data by the number of regions.
+ */
+
+#define pr_fmt(fmt) "damon: " fmt
+
+#include <linux/damon.h>
+#include <linux/debugfs.h>
+#include <linux/delay.h>
+#include <linux/kthread.h>
+#include <linux/mm.h>
+#include <linux/mman.h>
+#include <linux/mmu_notifier.h>
+#include <linux/page_idle.h>
+#include <linux/pid.h>
+#include <linux/random.h>
+#include <linux/sched.h>
+#include <linux/slab.h>
+#include <linux/uaccess.h>
+
+#define CREATE_TRACE_POINTS
+#include <trace/events/damon.h>
+
+/*
+ * Functions for the region, target and scheme lists
+ */
+
+struct damon_region *damon_new_region(unsigned long start, unsigned long end)
+{
+	struct damon_region *region;
+
+	region = kmalloc(sizeof(*region), GFP_KERNEL);
+	if (!region)
+		return NULL;
+
+	region->ar.start = start;
+	region->ar.end = end;
+	region->nr_accesses = 0;
+	region->age = 0;
+	region->last_nr_accesses = 0;
+	INIT_LIST_HEAD(&region->list);
+
+	return region;
+}
+
+/* Add a region between two other regions */
+static void damon_insert_region(struct damon_region *r,
+		struct damon_region *prev, struct damon_region *next,
+		struct damon_target *t)
+{
+	__list_add(&r->list, &prev->list, &next->list);
+	t->nr_regions++;
+}
+
+void damon_add_region(struct damon_region *r, struct damon_target *t)
+{
+	list_add_tail(&r->list, &t->regions_list);
+	t->nr_regions++;
+}
+
+void damon_destroy_region(struct damon_region *r, struct damon_target *t)
+{
+	list_del(&r->list);
+	t->nr_regions--;
+	kfree(r);
+}
+
+/* The target takes over the caller's reference to @pid */
+struct damon_target *damon_new_target(struct pid *pid)
+{
+	struct damon_target *t;
+
+	t = kmalloc(sizeof(*t), GFP_KERNEL);
+	if (!t)
+		return NULL;
+
+	t->pid = pid;
+	t->nr_regions = 0;
+	INIT_LIST_HEAD(&t->regions_list);
+	INIT_LIST_HEAD(&t->list);
+
+	return t;
+}
+
+void damon_add_target(struct damon_ctx *ctx, struct damon_target *t)
+{
+	list_add_tail(&t->list, &ctx->targets_list);
+}
+
+void damon_destroy_target(struct damon_target *t)
+{
+	struct damon_region *r, *next;
+
+	damon_for_each_region_safe(r, next, t)
+		damon_destroy_region(r, t);
+	list_del(&t->list);
+	put_pid(t->pid);
+	kfree(t);
+}
+
+struct damos *damon_new_scheme(unsigned long min_sz_region,
+		unsigned long max_sz_region, unsigned int min_nr_accesses,
+		unsigned int max_nr_accesses, unsigned int min_age_region,
+		unsigned int max_age_region, enum damos_action action)
+{
+	struct damos *scheme;
+
+	scheme = kmalloc(sizeof(*scheme), GFP_KERNEL);
+	if (!scheme)
+		return NULL;
+
+	scheme->min_sz_region = min_sz_region;
+	scheme->max_sz_region = max_sz_region;
+	scheme->min_nr_accesses = min_nr_accesses;
+	scheme->max_nr_accesses = max_nr_accesses;
+	scheme->min_age_region = min_age_region;
+	scheme->max_age_region = max_age_region;
+	scheme->action = action;
+	scheme->stat_count = 0;
+	scheme->stat_sz = 0;
+	INIT_LIST_HEAD(&scheme->list);
+
+	return scheme;
+}
+
+void damon_add_scheme(struct damon_ctx *ctx, struct damos *s)
+{
+	list_add_tail(&s->list, &ctx->schemes_list);
+}
+
+void damon_destroy_scheme(struct damos *s)
+{
+	list_del(&s->list);
+	kfree(s);
+}
+
+struct damon_ctx *damon_new_ctx(void)
+{
+	struct damon_ctx *ctx;
+
+	ctx = kzalloc(sizeof(*ctx), GFP_KERNEL);
+	if (!ctx)
+		return NULL;
+
+	ctx->sample_interval = 5 * 1000;
+	ctx->aggr_interval = 100 * 1000;
+	ctx->primitive_update_interval = 1000 * 1000;
+	ctx->min_nr_regions = 10;
+	ctx->max_nr_regions = 1000;
+
+	mutex_init(&ctx->kdamond_lock);
+	INIT_LIST_HEAD(&ctx->targets_list);
+	INIT_LIST_HEAD(&ctx->schemes_list);
+
+	return ctx;
+}
+
+void damon_destroy_ctx(struct damon_ctx *ctx)
+{
+	struct damon_target *t, *next_t;
+	struct damos *s, *next_s;
+
+	damon_stop(ctx);
+
+	damon_for_each_target_safe(t, next_t, ctx)
+		damon_destroy_target(t);
+	damon_for_each_scheme_safe(s, next_s, ctx)
+		damon_destroy_scheme(s);
+	kfree(ctx);
+}
+
+/**
+ * damon_set_attrs() - Set attributes for the monitoring.
+ * @ctx:		monitoring context
+ * @sample_int:		time interval between samplings
+ * @aggr_int:		time interval between aggregations
+ * @primitive_upd_int:	time interval between target region updates
+ * @min_nr_reg:		minimal number of regions
+ * @max_nr_reg:		maximum number of regions
+ *
+ * All time intervals are in micro-seconds.  Must not be called while the
+ * monitoring of @ctx is running.
+ *
+ * Return: 0 on success, negative error code otherwise.
+ */
+int damon_set_attrs(struct damon_ctx *ctx, unsigned long sample_int,
+		unsigned long aggr_int, unsigned long primitive_upd_int,
+		unsigned long min_nr_reg, unsigned long max_nr_reg)
+{
+	if (min_nr_reg < 3 || min_nr_reg > max_nr_reg)
+		return -EINVAL;
+	if (!sample_int || aggr_int < sample_int)
+		return -EINVAL;
+
+	ctx->sample_interval = sample_int;
+	ctx->aggr_interval = aggr_int;
+	ctx->primitive_update_interval = primitive_upd_int;
+	ctx->min_nr_regions = min_nr_reg;
+	ctx->max_nr_regions = max_nr_reg;
+
+	return 0;
+}
+
+static unsigned long damon_sz_region(struct damon_region *r)
+{
+	return r->ar.end - r->ar.start;
+}
+
+static bool damon_intersect(struct damon_region *r,
+		struct damon_addr_range *re)
+{
+	return !(r->ar.end <= re->start || re->end <= r->ar.start);
+}
+
+/* Returns a random page-aligned address in [@l, @r) */
+static unsigned long damon_rand(unsigned long l, unsigned long r)
+{
+	unsigned long nr_pages = (r - l) >> PAGE_SHIFT;
+
+	return l + ((unsigned long)prandom_u32_max(nr_pages) << PAGE_SHIFT);
+}
+
+/*
+ * Split a region into @nr_pieces regions of about the same size.
+ *
+ * Return: 0 on success, negative error code otherwise.
+ */
+static int damon_split_region_evenly(struct damon_target *t,
+		struct damon_region *r, unsigned int nr_pieces)
+{
+	unsigned long sz_piece, orig_end, start;
+	struct damon_region *n, *next;
+
+	if (!nr_pieces)
+		return -EINVAL;
+
+	orig_end = r->ar.end;
+	sz_piece = round_down(damon_sz_region(r) / nr_pieces,
+			      DAMON_MIN_REGION);
+	if (!sz_piece)
+		return -EINVAL;
+
+	r->ar.end = r->ar.start + sz_piece;
+	next = damon_next_region(r);
+	for (start = r->ar.end; start + sz_piece <= orig_end;
+			start += sz_piece) {
+		n = damon_new_region(start, start + sz_piece);
+		if (!n)
+			break;
+		damon_insert_region(n, r, next, t);
+		r = n;
+	}
+	/* The last piece takes what the rounding left over */
+	r->ar.end = orig_end;
+
+	return 0;
+}
+
+/*
+ * Primitives for the virtual address spaces of processes
+ */
+
+static struct mm_struct *damon_get_mm(struct damon_target *t)
+{
+	struct task_struct *task;
+	struct mm_struct *mm;
+
+	task = get_pid_task(t->pid, PIDTYPE_PID);
+	if (!task)
+		return NULL;
+
+	mm = get_task_mm(task);
+	put_task_struct(task);
+	return mm;
+}
+
+static unsigned long sz_range(struct damon_addr_range *r)
+{
+	return r->end - r->start;
+}
+
+/*
+ * Find three regions separated by the two biggest unmapped areas.
+ *
+ * The virtual address space of a process typically has two huge unmapped
+ * areas, between the heap and the mmap()-ed regions and between those and
+ * the stack.  Accesses to them can never be seen, so the monitoring covers
+ * only the three mapped regions around them.  Smaller holes are ignored,
+ * as they are not worth the extra regions.
+ *
+ * Return: 0 on success, negative error code otherwise.
+ */
+static int __damon_va_three_regions(struct mm_struct *mm,
+		struct damon_addr_range regions[3])
+{
+	struct damon_addr_range gap = {0}, first_gap = {0}, second_gap = {0};
+	struct vm_area_struct *vma, *prev = NULL;
+	unsigned long start = 0;
+
+	for (vma = mm->mmap; vma; vma = vma->vm_next) {
+		if (!prev) {
+			start = vma->vm_start;
+			goto next;
+		}
+		gap.start = prev->vm_end;
+		gap.end = vma->vm_start;
+		if (sz_range(&gap) > sz_range(&second_gap)) {
+			swap(gap, second_gap);
+			if (sz_range(&second_gap) > sz_range(&first_gap))
+				swap(second_gap, first_gap);
+		}
+next:
+		prev = vma;
+	}
+
+	if (!sz_range(&second_gap) || !sz_range(&first_gap))
+		return -EINVAL;
+
+	/* Sort the two biggest gaps by address */
+	if (first_gap.start > second_gap.start)
+		swap(first_gap, second_gap);
+
+	regions[0].start = round_down(start, DAMON_MIN_REGION);
+	regions[0].end = round_down(first_gap.start, DAMON_MIN_REGION);
+	regions[1].start = round_down(first_gap.end, DAMON_MIN_REGION);
+	regions[1].end = round_down(second_gap.start, DAMON_MIN_REGION);
+	regions[2].start = round_down(second_gap.end, DAMON_MIN_REGION);
+	regions[2].end = round_down(prev->vm_end, DAMON_MIN_REGION);
+
+	return 0;
+}
+
+static int damon_va_three_regions(struct damon_target *t,
+		struct damon_addr_range regions[3])
+{
+	struct mm_struct *mm;
+	int rc;
+
+	mm = damon_get_mm(t);
+	if (!mm)
+		return -EINVAL;
+
+	down_read(&mm->mmap_sem);
+	rc = __damon_va_three_regions(mm, regions);
+	up_read(&mm->mmap_sem);
+
+	mmput(mm);
+	return rc;
+}
+
+/* Initialize the monitoring target regions of a target */
+static void __damon_va_init_regions(struct damon_ctx *ctx,
+		struct damon_target *t)
+{
+	struct damon_region *r;
+	struct damon_addr_range regions[3];
+	unsigned long sz = 0, nr_pieces;
+	int i;
+
+	if (damon_va_three_regions(t, regions)) {
+		pr_debug("Failed to get three regions of target %d\n",
+			 pid_nr(t->pid));
+		return;
+	}
+
+	for (i = 0; i < 3; i++)
+		sz += regions[i].end - regions[i].start;
+	if (ctx->min_nr_regions)
+		sz /= ctx->min_nr_regions;
+	if (sz < DAMON_MIN_REGION)
+		sz = DAMON_MIN_REGION;
+
+	/* Set the initial three regions of the target */
+	for (i = 0; i < 3; i++) {
+		r = damon_new_region(regions[i].start, regions[i].end);
+		if (!r) {
+			pr_err("%d'th init region creation failed\n", i);
+			return;
+		}
+		damon_add_region(r, t);
+
+		nr_pieces = (regions[i].end - regions[i].start) / sz;
+		damon_split_region_evenly(t, r, nr_pieces);
+	}
+}
+
+static void damon_va_init(struct damon_ctx *ctx)
+{
+	struct damon_target *t;
+
+	damon_for_each_target(t, ctx) {
+		/* the user may set the target regions as they want */
+		if (!t->nr_regions)
+			__damon_va_init_regions(ctx, t);
+	}
+}
+
+/*
+ * Update the regions of a target to cover the new three regions, reusing
+ * the existing regions and their access history where they still overlap.
+ */
+static void damon_va_apply_three_regions(struct damon_target *t,
+		struct damon_addr_range bregions[3])
+{
+	struct damon_region *r, *next;
+	unsigned int i;
+
+	/* Remove regions which are not in the three regions */
+	damon_for_each_region_safe(r, next, t) {
+		for (i = 0; i < 3; i++) {
+			if (damon_intersect(r, &bregions[i]))
+				break;
+		}
+		if (i == 3)
+			damon_destroy_region(r, t);
+	}
+
+	/* Adjust intersecting regions to fit with the three regions */
+	for (i = 0; i < 3; i++) {
+		struct damon_region *first = NULL, *last = NULL, *newr;
+		struct damon_addr_range *br = &bregions[i];
+		struct list_head *pos = &t->regions_list;
+
+		damon_for_each_region(r, t) {
+			if (r->ar.start >= br->end) {
+				pos = &r->list;
+				break;
+			}
+			if (damon_intersect(r, br)) {
+				if (!first)
+					first = r;
+				last = r;
+			}
+		}
+		if (!first) {
+			/* no region intersects with this big region */
+			newr = damon_new_region(
+					round_down(br->start, DAMON_MIN_REGION),
+					ALIGN(br->end, DAMON_MIN_REGION));
+			if (!newr)
+				continue;
+			list_add_tail(&newr->list, pos);
+			t->nr_regions++;
+		} else {
+			first->ar.start = round_down(br->start,
+						     DAMON_MIN_REGION);
+			last->ar.end = ALIGN(br->end, DAMON_MIN_REGION);
+		}
+	}
+}
+
+static void damon_va_update(struct damon_ctx *ctx)
+{
+	struct damon_addr_range three_regions[3];
+	struct damon_target *t;
+
+	damon_for_each_target(t, ctx) {
+		if (damon_va_three_regions(t, three_regions))
+			continue;
+		damon_va_apply_three_regions(t, three_regions);
+	}
+}
+
+/*
+ * The accessed bit of the sampled page is cleared for the next check.  The
+ * page is marked idle so that an access through an unmapped alias or a
+ * read() of the page cache is seen as well, and the cleared bit is moved to
+ * the page flags so that reclaim does not lose it.
+ */
+static void damon_ptep_mkold(pte_t *pte, struct vm_area_struct *vma,
+		unsigned long addr)
+{
+	struct page *page;
+
+	page = vm_normal_page(vma, addr, *pte);
+	if (!page)
+		return;
+
+	if (ptep_clear_young_notify(vma, addr, pte))
+		set_page_young(page);
+	set_page_idle(page);
+}
+
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+static void damon_pmdp_mkold(pmd_t *pmd, struct vm_area_struct *vma,
+		unsigned long addr)
+{
+	struct page *page;
+
+	if (is_huge_zero_pmd(*pmd))
+		return;
+
+	page = pmd_page(*pmd);
+	if (pmdp_clear_young_notify(vma, addr & HPAGE_PMD_MASK, pmd))
+		set_page_young(page);
+	set_page_idle(page);
+}
+#endif
+
+struct damon_young_walk_private {
+	unsigned long *page_sz;
+	bool young;
+};
+
+static int damon_mkold_pmd_entry(pmd_t *pmd, unsigned long addr,
+		unsigned long next, struct mm_walk *walk)
+{
+	pte_t *pte;
+	spinlock_t *ptl;
+
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+	if (pmd_trans_huge_lock(pmd, walk->vma, &ptl) == 1) {
+		damon_pmdp_mkold(pmd, walk->vma, addr);
+		spin_unlock(ptl);
+		return 0;
+	}
+#endif
+	if (pmd_trans_unstable(pmd))
+		return 0;
+
+	pte = pte_offset_map_lock(walk->mm, pmd, addr, &ptl);
+	if (pte_present(*pte))
+		damon_ptep_mkold(pte, walk->vma, addr);
+	pte_unmap_unlock(pte, ptl);
+	return 0;
+}
+
+static int damon_young_pmd_entry(pmd_t *pmd, unsigned long addr,
+		unsigned long next, struct mm_walk *walk)
+{
+	struct damon_young_walk_private *priv = walk->private;
+	struct page *page;
+	pte_t *pte;
+	spinlock_t *ptl;
+
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+	if (pmd_trans_huge_lock(pmd, walk->vma, &ptl) == 1) {
+		if (!is_huge_zero_pmd(*pmd)) {
+			page = pmd_page(*pmd);
+			priv->young = pmd_young(*pmd) || !page_is_idle(page) ||
+				mmu_notifier_test_young(walk->mm, addr);
+			*priv->page_sz = HPAGE_PMD_SIZE;
+		}
+		spin_unlock(ptl);
+		return 0;
+	}
+#endif
+	if (pmd_trans_unstable(pmd))
+		return 0;
+
+	pte = pte_offset_map_lock(walk->mm, pmd, addr, &ptl);
+	if (!pte_present(*pte))
+		goto out;
+	page = vm_normal_page(walk->vma, addr, *pte);
+	if (!page)
+		goto out;
+	priv->young = pte_young(*pte) || !page_is_idle(page) ||
+		mmu_notifier_test_young(walk->mm, addr);
+	*priv->page_sz = PAGE_SIZE;
+out:
+	pte_unmap_unlock(pte, ptl);
+	return 0;
+}
+
+static void damon_va_mkold(struct mm_struct *mm, unsigned long addr)
+{
+	struct mm_walk walk = {
+		.pmd_entry = damon_mkold_pmd_entry,
+		.mm = mm,
+	};
+
+	down_read(&mm->mmap_sem);
+	walk_page_range(addr, addr + 1, &walk);
+	up_read(&mm->mmap_sem);
+}
+
+static bool damon_va_young(struct mm_struct *mm, unsigned long addr,
+		unsigned long *page_sz)
+{
+	struct damon_young_walk_private priv = {
+		.page_sz = page_sz,
+		.young = false,
+	};
+	struct mm_walk walk = {
+		.pmd_entry = damon_young_pmd_entry,
+		.mm = mm,
+		.private = &priv,
+	};
+
+	down_read(&mm->mmap_sem);
+	walk_page_range(addr, addr + 1, &walk);
+	up_read(&mm->mmap_sem);
+	return priv.young;
+}
+
+static void damon_va_prepare_access_checks(struct damon_ctx *ctx)
+{
+	struct damon_target *t;
+	struct damon_region *r;
+	struct mm_struct *mm;
+
+	damon_for_each_target(t, ctx) {
+		mm = damon_get_mm(t);
+		if (!mm)
+			continue;
+		damon_for_each_region(r, t) {
+			r->sampling_addr = damon_rand(r->ar.start, r->ar.end);
+			damon_va_mkold(mm, r->sampling_addr);
+		}
+		mmput(mm);
+	}
+}
+
+/*
+ * Check whether the sampled pages were accessed since the last preparation
+ * and return the highest access frequency among the regions.
+ *
+ * Regions may share a huge page, whose result is then reused instead of
+ * walking the page table again.
+ */
+static unsigned int damon_va_check_accesses(struct damon_ctx *ctx)
+{
+	struct damon_target *t;
+	struct damon_region *r;
+	struct mm_struct *mm;
+	unsigned long last_addr = 0, last_page_sz = PAGE_SIZE;
+	bool last_checked = false, last_accessed = false;
+	unsigned int max_nr_accesses = 0;
+
+	damon_for_each_target(t, ctx) {
+		mm = damon_get_mm(t);
+		if (!mm)
+			continue;
+		last_checked = false;
+		damon_for_each_region(r, t) {
+			if (!last_checked ||
+			    round_down(last_addr, last_page_sz) !=
+			    round_down(r->sampling_addr, last_page_sz)) {
+				last_page_sz = PAGE_SIZE;
+				last_accessed = damon_va_young(mm,
+						r->sampling_addr,
+						&last_page_sz);
+				last_addr = r->sampling_addr;
+				last_checked = true;
+			}
+			if (last_accessed)
+				r->nr_accesses++;
+			max_nr_accesses = max(r->nr_accesses,
+					      max_nr_accesses);
+		}
+		mmput(mm);
+	}
+
+	return max_nr_accesses;
+}
+
+static int damon_va_apply_scheme(struct damon_target *t,
+		struct damon_region *r, struct damos *scheme)
+{
+	struct mm_struct *mm;
+	int madv_action;
+	int ret;
+
+	switch (scheme->action) {
+	case DAMOS_WILLNEED:
+		madv_action = MADV_WILLNEED;
+		break;
+	case DAMOS_COLD:
+		madv_action = MADV_COLD;
+		break;
+	case DAMOS_PAGEOUT:
+		madv_action = MADV_PAGEOUT;
+		break;
+	case DAMOS_HUGEPAGE:
+		madv_action = MADV_HUGEPAGE;
+		break;
+	case DAMOS_NOHUGEPAGE:
+		madv_action = MADV_NOHUGEPAGE;
+		break;
+	case DAMOS_STAT:
+		return 0;
+	default:
+		return -EINVAL;
+	}
+
+	mm = damon_get_mm(t);
+	if (!mm)
+		return -ENOMEM;
+
+	ret = do_madvise(mm, PAGE_ALIGN(r->ar.start),
+			 PAGE_ALIGN(r->ar.end - r->ar.start), madv_action);
+	mmput(mm);
+	return ret;
+}
+
+/*
+ * Functions for the monitoring thread
+ */
+
+static bool damon_check_reset_time_interval(ktime_t *baseline,
+		unsigned long interval)
+{
+	ktime_t now = ktime_get();
+
+	if (ktime_us_delta(now, *baseline) < (s64)interval)
+		return false;
+	*baseline = now;
+	return true;
+}
+
+static bool damos_valid_target(struct damon_region *r, struct damos *s)
+{
+	unsigned long sz = damon_sz_region(r);
+
+	return s->min_sz_region <= sz && sz <= s->max_sz_region &&
+		s->min_nr_accesses <= r->nr_accesses &&
+		r->nr_accesses <= s->max_nr_accesses &&
+		s->min_age_region <= r->age && r->age <= s->max_age_region;
+}
+
+static void kdamond_apply_schemes(struct damon_ctx *ctx)
+{
+	struct damon_target *t;
+	struct damon_region *r;
+	struct damos *s;
+
+	damon_for_each_target(t, ctx) {
+		damon_for_each_region(r, t) {
+			damon_for_each_scheme(s, ctx) {
+				if (!damos_valid_target(r, s))
+					continue;
+				s->stat_count++;
+				s->stat_sz += damon_sz_region(r);
+				damon_va_apply_scheme(t, r, s);
+				/* Start tracking the result afresh */
+				if (s->action != DAMOS_STAT)
+					r->age = 0;
+			}
+		}
+	}
+}
+
+/* Report the aggregated monitoring results and reset them */
+static void kdamond_reset_aggregated(struct damon_ctx *ctx)
+{
+	struct damon_target *t;
+	struct damon_region *r;
+
+	damon_for_each_target(t, ctx) {
+		damon_for_each_region(r, t) {
+			trace_damon_aggregated(pid_nr(t->pid), r,
+					       t->nr_regions);
+			r->last_nr_accesses = r->nr_accesses;
+			r->nr_accesses = 0;
+		}
+	}
+}
+
+/*
+ * Age the regions whose access frequency stayed about the same during the
+ * last aggregation interval.
+ */
+static void kdamond_update_ages(struct damon_ctx *ctx, unsigned int thres)
+{
+	struct damon_target *t;
+	struct damon_region *r;
+	unsigned int diff;
+
+	damon_for_each_target(t, ctx) {
+		damon_for_each_region(r, t) {
+			diff = max(r->nr_accesses, r->last_nr_accesses) -
+				min(r->nr_accesses, r->last_nr_accesses);
+			if (diff > thres)
+				r->age = 0;
+			else
+				r->age++;
+		}
+	}
+}
+
+/* Merge region @r into its left neighbour @l */
+static void damon_merge_two_regions(struct damon_target *t,
+		struct damon_region *l, struct damon_region *r)
+{
+	unsigned long sz_l = damon_sz_region(l), sz_r = damon_sz_region(r);
+
+	l->nr_accesses = (l->nr_accesses * sz_l + r->nr_accesses * sz_r) /
+			(sz_l + sz_r);
+	l->age = (l->age * sz_l + r->age * sz_r) / (sz_l + sz_r);
+	l->ar.end = r->ar.end;
+	damon_destroy_region(r, t);
+}
+
+/*
+ * Merge adjacent regions whose access frequencies differ by at most
+ * @thres, as long as the result is no bigger than @sz_limit.
+ */
+static void damon_merge_regions_of(struct damon_target *t, unsigned int thres,
+		unsigned long sz_limit)
+{
+	struct damon_region *r, *prev = NULL, *next;
+	unsigned int diff;
+
+	damon_for_each_region_safe(r, next, t) {
+		if (prev && prev->ar.end == r->ar.start) {
+			diff = max(prev->nr_accesses, r->nr_accesses) -
+				min(prev->nr_accesses, r->nr_accesses);
+			if (diff <= thres && damon_sz_region(prev) +
+					damon_sz_region(r) <= sz_limit) {
+				damon_merge_two_regions(t, prev, r);
+				continue;
+			}
+		}
+		prev = r;
+	}
+}
+
+/*
+ * Merge similar regions, raising the threshold until the number of regions
+ * drops to the allowed maximum.
+ */
+static void kdamond_merge_regions(struct damon_ctx *ctx, unsigned int thres,
+		unsigned long sz_limit)
+{
+	struct damon_target *t;
+	unsigned int nr_regions;
+	unsigned int max_thres;
+
+	max_thres = ctx->aggr_interval / ctx->sample_interval;
+	do {
+		nr_regions = 0;
+		damon_for_each_target(t, ctx) {
+			damon_merge_regions_of(t, thres, sz_limit);
+			nr_regions += t->nr_regions;
+		}
+		thres = max(1U, thres * 2);
+	} while (nr_regions > ctx->max_nr_regions && thres / 2 < max_thres);
+}
+
+/* Split @r into two regions, the first of which is @sz_r bytes long */
+static void damon_split_region_at(struct damon_target *t,
+		struct damon_region *r, unsigned long sz_r)
+{
+	struct damon_region *new;
+
+	new = damon_new_region(r->ar.start + sz_r, r->ar.end);
+	if (!new)
+		return;
+
+	r->ar.end = new->ar.start;
+	new->age = r->age;
+	new->last_nr_accesses = r->last_nr_accesses;
+
+	damon_insert_region(new, r, damon_next_region(r), t);
+}
+
+/* Split every region of @t into @nr_subs regions of random sizes */
+static void damon_split_regions_of(struct damon_target *t, int nr_subs)
+{
+	struct damon_region *r, *next;
+	unsigned long sz_region, sz_sub = 0;
+	int i;
+
+	damon_for_each_region_safe(r, next, t) {
+		sz_region = damon_sz_region(r);
+
+		for (i = 0; i < nr_subs - 1 &&
+				sz_region > 2 * DAMON_MIN_REGION; i++) {
+			/*
+			 * Randomly select the size of the left sub-region to
+			 * be between 10% and 90% of the original region.
+			 */
+			sz_sub = round_down(sz_region *
+					    (prandom_u32_max(9) + 1) / 10,
+					    DAMON_MIN_REGION);
+			/* Do not allow a blank region */
+			if (sz_sub == 0 || sz_sub >= sz_region)
+				continue;
+
+			damon_split_region_at(t, r, sz_sub);
+			sz_region = sz_sub;
+		}
+	}
+}
+
+/*
+ * Split every target region into randomly sized regions, so that areas of
+ * different access frequencies inside a region can be found.
+ *
+ * The regions are split in two unless that could exceed the maximum number
+ * of regions.  If the number of regions did not change since the last
+ * split, they are split in three instead, as the middle of a region may
+ * have a different access frequency than its both ends.
+ */
+static void kdamond_split_regions(struct damon_ctx *ctx)
+{
+	struct damon_target *t;
+	unsigned int nr_regions = 0;
+	int nr_subregions = 2;
+
+	damon_for_each_target(t, ctx)
+		nr_regions += t->nr_regions;
+
+	if (nr_regions > ctx->max_nr_regions / 2)
+		return;
+
+	if (ctx->last_nr_regions == nr_regions &&
+	    nr_regions < ctx->max_nr_regions / 3)
+		nr_subregions = 3;
+
+	damon_for_each_target(t, ctx)
+		damon_split_regions_of(t, nr_subregions);
+
+	ctx->last_nr_regions = nr_regions;
+}
+
+/*
+ * The size limit of a region that keeps the number of regions from falling
+ * below the minimum through merging.
+ */
+static unsigned long damon_region_sz_limit(struct damon_ctx *ctx)
+{
+	struct damon_target *t;
+	struct damon_region *r;
+	unsigned long sz = 0;
+
+	damon_for_each_target(t, ctx) {
+		damon_for_each_region(r, t)
+			sz += damon_sz_region(r);
+	}
+
+	if (ctx->min_nr_regions)
+		sz /= ctx->min_nr_regions;
+	if (sz < DAMON_MIN_REGION)
+		sz = DAMON_MIN_REGION;
+
+	return sz;
+}
+
+/* Stop if asked to, or once every target process has exited */
+static bool kdamond_need_stop(struct damon_ctx *ctx)
+{
+	struct damon_target *t;
+	struct task_struct *task;
+
+	if (kthread_should_stop())
+		return true;
+
+	damon_for_each_target(t, ctx) {
+		task = get_pid_task(t->pid, PIDTYPE_PID);
+		if (task) {
+			put_task_struct(task);
+			return false;
+		}
+	}
+
+	return true;
+}
+
+static int kdamond_fn(void *data)
+{
+	struct damon_ctx *ctx = data;
+	struct damon_target *t;
+	struct damon_region *r, *next;
+	unsigned int max_nr_accesses;
+	unsigned long sz_limit;
+
+	pr_debug("kdamond (%d) starts\n", current->pid);
+
+	damon_va_init(ctx);
+	sz_limit = damon_region_sz_limit(ctx);
+	ctx->last_aggregation = ktime_get();
+	ctx->last_primitive_update = ctx->last_aggregation;
+	ctx->last_nr_regions = 0;
+
+	while (!kdamond_need_stop(ctx)) {
+		damon_va_prepare_access_checks(ctx);
+		usleep_range(ctx->sample_interval, ctx->sample_interval + 1);
+		max_nr_accesses = damon_va_check_accesses(ctx);
+
+		if (damon_check_reset_time_interval(&ctx->last_aggregation,
+						    ctx->aggr_interval)) {
+			kdamond_update_ages(ctx, max_nr_accesses / 10);
+			kdamond_merge_regions(ctx, max_nr_accesses / 10,
+					      sz_limit);
+			kdamond_apply_schemes(ctx);
+			kdamond_reset_aggregated(ctx);
+			kdamond_split_regions(ctx);
+		}
+
+		if (damon_check_reset_time_interval(
+				&ctx->last_primitive_update,
+				ctx->primitive_update_interval)) {
+			damon_va_update(ctx);
+			sz_limit = damon_region_sz_limit(ctx);
+		}
+	}
+
+	damon_for_each_target(t, ctx) {
+		damon_for_each_region_safe(r, next, t)
+			damon_destroy_region(r, t);
+	}
+
+	pr_debug("kdamond (%d) finishes\n", current->pid);
+
+	mutex_lock(&ctx->kdamond_lock);
+	ctx->kdamond = NULL;
+	mutex_unlock(&ctx->kdamond_lock);
+
+	return 0;
+}
+
+/**
+ * damon_start() - Start the monitoring of a context.
+ * @ctx:	monitoring context
+ *
+ * Return: 0 on success, negative error code otherwise.
+ */
+int damon_start(struct damon_ctx *ctx)
+{
+	int err = 0;
+
+	mutex_lock(&ctx->kdamond_lock);
+	if (ctx->kdamond) {
+		err = -EBUSY;
+		goto out;
+	}
+	if (list_empty(&ctx->targets_list)) {
+		err = -EINVAL;
+		goto out;
+	}
+
+	ctx->kdamond = kthread_run(kdamond_fn, ctx, "kdamond");
+	if (IS_ERR(ctx->kdamond)) {
+		err = PTR_ERR(ctx->kdamond);
+		ctx->kdamond = NULL;
+	}
+out:
+	mutex_unlock(&ctx->kdamond_lock);
+	return err;
+}
+
+/**
+ * damon_stop() - Stop the monitoring of a context.
+ * @ctx:	monitoring context
+ *
+ * Return: 0 on success, -EPERM if the monitoring was not running.
+ */
+int damon_stop(struct damon_ctx *ctx)
+{
+	struct task_struct *tsk;
+
+	mutex_lock(&ctx->kdamond_lock);
+	tsk = ctx->kdamond;
+	if (!tsk) {
+		mutex_unlock(&ctx->kdamond_lock);
+		return -EPERM;
+	}
+	/* kdamond may exit by itself once we drop the lock */
+	get_task_struct(tsk);
+	mutex_unlock(&ctx->kdamond_lock);
+
+	kthread_stop(tsk);
+	put_task_struct(tsk);
+	return 0;
+}
+
+#ifdef CONFIG_DEBUG_FS
+
+/*
+ * The debugfs interface, under <debugfs>/damon/:
+ *
+ * attrs	"<sample us> <aggr us> <update us> <min_nr> <max_nr>"
+ * target_ids	the pids of the processes to monitor
+ * schemes	one scheme per line, "<min_sz> <max_sz> <min_nr_accesses>
+ *		<max_nr_accesses> <min_age> <max_age> <action>"; reads also
+ *		show the count and total size of the regions it applied to
+ * monitor_on	"on" or "off"
+ *
+ * The access frequencies of schemes are in number of samplings per
+ * aggregation interval, and the ages in number of aggregation intervals.
+ */
+
+static struct damon_ctx *damon_dbgfs_ctx;
+static DEFINE_MUTEX(damon_dbgfs_lock);
+
+/* Copy a string from userspace into a new NUL-terminated kernel buffer */
+static char *user_input_str(const char __user *buf, size_t count,
+		loff_t *ppos)
+{
+	char *kbuf;
+
+	/* We do not accept continuous write */
+	if (*ppos)
+		return ERR_PTR(-EINVAL);
+
+	kbuf = kmalloc(count + 1, GFP_KERNEL | __GFP_NOWARN);
+	if (!kbuf)
+		return ERR_PTR(-ENOMEM);
+
+	if (copy_from_user(kbuf, buf, count)) {
+		kfree(kbuf);
+		return ERR_PTR(-EFAULT);
+	}
+	kbuf[count] = '\0';
+
+	return kbuf;
+}
+
+/* Must be called with damon_dbgfs_lock held */
+static bool damon_dbgfs_running(void)
+{
+	bool running;
+
+	mutex_lock(&damon_dbgfs_ctx->kdamond_lock);
+	running = damon_dbgfs_ctx->kdamond != NULL;
+	mutex_unlock(&damon_dbgfs_ctx->kdamond_lock);
+
+	return running;
+}
+
+static ssize_t dbgfs_attrs_read(struct file *file,
+		char __user *buf, size_t count, loff_t *ppos)
+{
+	struct damon_ctx *ctx = damon_dbgfs_ctx;
+	char kbuf[128];
+	int ret;
+
+	mutex_lock(&damon_dbgfs_lock);
+	ret = scnprintf(kbuf, ARRAY_SIZE(kbuf), "%lu %lu %lu %lu %lu\n",
+			ctx->sample_interval, ctx->aggr_interval,
+			ctx->primitive_update_interval, ctx->min_nr_regions,
+			ctx->max_nr_regions);
+	mutex_unlock(&damon_dbgfs_lock);
+
+	return simple_read_from_buffer(buf, count, ppos, kbuf, ret);
+}
+
+static ssize_t dbgfs_attrs_write(struct file *file,
+		const char __user *buf, size_t count, loff_t *ppos)
+{
+	unsigned long s, a, r, minr, maxr;
+	char *kbuf;
+	ssize_t ret;
+
+	kbuf = user_input_str(buf, count, ppos);
+	if (IS_ERR(kbuf))
+		return PTR_ERR(kbuf);
+
+	if (sscanf(kbuf, "%lu %lu %lu %lu %lu",
+		   &s, &a, &r, &minr, &maxr) != 5) {
+		ret = -EINVAL;
+		goto out;
+	}
+
+	mutex_lock(&damon_dbgfs_lock);
+	if (damon_dbgfs_running())
+		ret = -EBUSY;
+	else
+		ret = damon_set_attrs(damon_dbgfs_ctx, s, a, r, minr, maxr);
+	mutex_unlock(&damon_dbgfs_lock);
+	if (!ret)
+		ret = count;
+out:
+	kfree(kbuf);
+	return ret;
+}
+
+static ssize_t dbgfs_target_ids_read(struct file *file,
+		char __user *buf, size_t count, loff_t *ppos)
+{
+	struct damon_target *t;
+	char *kbuf;
+	int written = 0;
+	ssize_t ret;
+
+	kbuf = kmalloc(PAGE_SIZE, GFP_KERNEL);
+	if (!kbuf)
+		return -ENOMEM;
+
+	mutex_lock(&damon_dbgfs_lock);
+	damon_for_each_target(t, damon_dbgfs_ctx)
+		written += scnprintf(kbuf + written, PAGE_SIZE - written,
+				     "%d ", pid_vnr(t->pid));
+	if (written)
+		written--;
+	written += scnprintf(kbuf + written, PAGE_SIZE - written, "\n");
+	mutex_unlock(&damon_dbgfs_lock);
+
+	ret = simple_read_from_buffer(buf, count, ppos, kbuf, written);
+	kfree(kbuf);
+	return ret;
+}
+
+static ssize_t dbgfs_target_ids_write(struct file *file,
+		const char __user *buf, size_t count, loff_t *ppos)
+{
+	struct damon_ctx *ctx = damon_dbgfs_ctx;
+	struct damon_target *t, *next_t;
+	LIST_HEAD(new_targets);
+	char *kbuf, *pos;
+	int id, parsed;
+	struct pid *pid;
+	ssize_t ret = count;
+
+	kbuf = user_input_str(buf, count, ppos);
+	if (IS_ERR(kbuf))
+		return PTR_ERR(kbuf);
+
+	for (pos = kbuf; sscanf(pos, "%d%n", &id, &parsed) == 1;
+			pos += parsed) {
+		pid = find_get_pid(id);
+		if (!pid) {
+			ret = -EINVAL;
+			goto out;
+		}
+		t = damon_new_target(pid);
+		if (!t) {
+			put_pid(pid);
+			ret = -ENOMEM;
+			goto out;
+		}
+		list_add_tail(&t->list, &new_targets);
+	}
+
+	mutex_lock(&damon_dbgfs_lock);
+	if (damon_dbgfs_running()) {
+		ret = -EBUSY;
+	} else {
+		damon_for_each_target_safe(t, next_t, ctx)
+			damon_destroy_target(t);
+		list_splice_tail_init(&new_targets, &ctx->targets_list);
+	}
+	mutex_unlock(&damon_dbgfs_lock);
+out:
+	list_for_each_entry_safe(t, next_t, &new_targets, list)
+		damon_destroy_target(t);
+	kfree(kbuf);
+	return ret;
+}
+
+static ssize_t dbgfs_schemes_read(struct file *file, char __user *buf,
+		size_t count, loff_t *ppos)
+{
+	struct damos *s;
+	char *kbuf;
+	int written = 0;
+	ssize_t ret;
+
+	kbuf = kmalloc(PAGE_SIZE, GFP_KERNEL);
+	if (!kbuf)
+		return -ENOMEM;
+
+	mutex_lock(&damon_dbgfs_lock);
+	damon_for_each_scheme(s, damon_dbgfs_ctx)
+		written += scnprintf(kbuf + written, PAGE_SIZE - written,
+				     "%lu %lu %u %u %u %u %d %lu %lu\n",
+				     s->min_sz_region, s->max_sz_region,
+				     s->min_nr_accesses, s->max_nr_accesses,
+				     s->min_age_region, s->max_age_region,
+				     s->action, s->stat_count, s->stat_sz);
+	mutex_unlock(&damon_dbgfs_lock);
+
+	ret = simple_read_from_buffer(buf, count, ppos, kbuf, written);
+	kfree(kbuf);
+	return ret;
+}
+
+static ssize_t dbgfs_schemes_write(struct file *file, const char __user *buf,
+		size_t count, loff_t *ppos)
+{
+	struct damon_ctx *ctx = damon_dbgfs_ctx;
+	struct damos *s, *next_s;
+	LIST_HEAD(new_schemes);
+	unsigned long min_sz, max_sz;
+	unsigned int min_nr_a, max_nr_a, min_age, max_age, action;
+	char *kbuf, *pos;
+	int parsed;
+	ssize_t ret = count;
+
+	kbuf = user_input_str(buf, count, ppos);
+	if (IS_ERR(kbuf))
+		return PTR_ERR(kbuf);
+
+	for (pos = kbuf; sscanf(pos, "%lu %lu %u %u %u %u %u%n",
+				&min_sz, &max_sz, &min_nr_a, &max_nr_a,
+				&min_age, &max_age, &action, &parsed) == 7;
+			pos += parsed) {
+		if (action >= NR_DAMOS_ACTIONS || min_sz > max_sz ||
+		    min_nr_a > max_nr_a || min_age > max_age) {
+			ret = -EINVAL;
+			goto out;
+		}
+		s = damon_new_scheme(min_sz, max_sz, min_nr_a, max_nr_a,
+				     min_age, max_age, action);
+		if (!s) {
+			ret = -ENOMEM;
+			goto out;
+		}
+		list_add_tail(&s->list, &new_schemes);
+	}
+
+	mutex_lock(&damon_dbgfs_lock);
+	if (damon_dbgfs_running()) {
+		ret = -EBUSY;
+	} else {
+		damon_for_each_scheme_safe(s, next_s, ctx)
+			damon_destroy_scheme(s);
+		list_splice_tail_init(&new_schemes, &ctx->schemes_list);
+	}
+	mutex_unlock(&damon_dbgfs_lock);
+out:
+	list_for_each_entry_safe(s, next_s, &new_schemes, list)
+		damon_destroy_scheme(s);
+	kfree(kbuf);
+	return ret;
+}
+
+static ssize_t dbgfs_monitor_on_read(struct file *file,
+		char __user *buf, size_t count, loff_t *ppos)
+{
+	char monitor_on_buf[5];
+	bool monitor_on;
+	int len;
+
+	mutex_lock(&damon_dbgfs_lock);
+	monitor_on = damon_dbgfs_running();
+	mutex_unlock(&damon_dbgfs_lock);
+
+	len = scnprintf(monitor_on_buf, 5, monitor_on ? "on\n" : "off\n");
+
+	return simple_read_from_buffer(buf, count, ppos, monitor_on_buf, len);
+}
+
+static ssize_t dbgfs_monitor_on_write(struct file *file,
+		const char __user *buf, size_t count, loff_t *ppos)
+{
+	char *kbuf, *cmd;
+	ssize_t ret;
+
+	kbuf = user_input_str(buf, count, ppos);
+	if (IS_ERR(kbuf))
+		return PTR_ERR(kbuf);
+	cmd = strim(kbuf);
+
+	mutex_lock(&damon_dbgfs_lock);
+	if (!strcmp(cmd, "on"))
+		ret = damon_start(damon_dbgfs_ctx);
+	else if (!strcmp(cmd, "off"))
+		ret = damon_stop(damon_dbgfs_ctx);
+	else
+		ret = -EINVAL;
+	mutex_unlock(&damon_dbgfs_lock);
+
+	if (!ret)
+		ret = count;
+	kfree(kbuf);
+	return ret;
+}
+
+static const struct file_operations attrs_fops = {
+	.owner = THIS_MODULE,
+	.read = dbgfs_attrs_read,
+	.write = dbgfs_attrs_write,
+};
+
+static const struct file_operations target_ids_fops = {
+	.owner = THIS_MODULE,
+	.read = dbgfs_target_ids_read,
+	.write = dbgfs_target_ids_write,
+};
+
+static const struct file_operations schemes_fops = {
+	.owner = THIS_MODULE,
+	.read = dbgfs_schemes_read,
+	.write = dbgfs_schemes_write,
+};
+
+static const struct file_operations monitor_on_fops = {
+	.owner = THIS_MODULE,
+	.read = dbgfs_monitor_on_read,
+	.write = dbgfs_monitor_on_write,
+};
+
+static int __init damon_dbgfs_init(void)
+{
+	struct dentry *root;
+
+	damon_dbgfs_ctx = damon_new_ctx();
+	if (!damon_dbgfs_ctx)
+		return -ENOMEM;
+
+	root = debugfs_create_dir("damon", NULL);
+	if (!root)
+		goto err;
+
+	if (!debugfs_create_file("attrs", 0600, root, NULL, &attrs_fops) ||
+	    !debugfs_create_file("target_ids", 0600, root, NULL,
+				 &target_ids_fops) ||
+	    !debugfs_create_file("schemes", 0600, root, NULL,
+				 &schemes_fops) ||
+	    !debugfs_create_file("monitor_on", 0600, root, NULL,
+				 &monitor_on_fops)) {
+		debugfs_remove_recursive(root);
+		goto err;
+	}
+
+	return 0;
+err:
+	pr_err("failed to create the debugfs interface\n");
+	damon_destroy_ctx(damon_dbgfs_ctx);
+	damon_dbgfs_ctx = NULL;
+	return -ENOMEM;
+}
+late_initcall(damon_dbgfs_init);
+
+#endif	/* CONFIG_DEBUG_FS */
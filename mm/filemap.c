@@ -109,6 +109,35 @@
  *   ->tasklist_lock            (memory_failure, collect_procs_ao)
  */
 
+/*
+ * A huge shmem page is stored as HPAGE_PMD_NR consecutive slots, one per
+ * subpage.  Shadow entries are never used for shmem, so just clear them all.
+ */
+static void page_cache_tree_delete_huge(struct address_space *mapping,
+					struct page *page)
+{
+	pgoff_t index;
+	int i;
+
+	for (i = 0, index = page->index; i < HPAGE_PMD_NR; i++, index++) {
+		struct radix_tree_node *node;
+		unsigned int tag;
+		void **slot;
+
+		__radix_tree_lookup(&mapping->page_tree, index, &node, &slot);
+		VM_BUG_ON_PAGE(radix_tree_deref_slot_protected(slot,
+				&mapping->tree_lock) != page + i, page);
+		for (tag = 0; tag < RADIX_TREE_MAX_TAGS; tag++)
+			radix_tree_tag_clear(&mapping->page_tree, index, tag);
+		radix_tree_replace_slot(slot, NULL);
+		if (!node)
+			continue;
+		workingset_node_pages_dec(node);
+		__radix_tree_delete_node(&mapping->page_tree, node);
+	}
+	mapping->nrpages -= HPAGE_PMD_NR;
+}
+
 static void page_cache_tree_delete(struct address_space *mapping,
 				   struct page *page, void *shadow)
 {
@@ -120,6 +149,12 @@ static void page_cache_tree_delete(struct address_space *mapping,
 
 	VM_BUG_ON(!PageLocked(page));
 
+	if (PageTransHuge(page) && !PageHuge(page)) {
+		VM_BUG_ON_PAGE(shadow, page);
+		page_cache_tree_delete_huge(mapping, page);
+		return;
+	}
+
 	__radix_tree_lookup(&mapping->page_tree, page->index, &node, &slot);
 
 	if (shadow) {
@@ -201,9 +236,14 @@ void __delete_from_page_cache(struct page *page, void *shadow,
 
 	/* hugetlb pages do not participate in page cache accounting. */
 	if (!PageHuge(page))
-		__dec_zone_page_state(page, NR_FILE_PAGES);
-	if (PageSwapBacked(page))
-		__dec_zone_page_state(page, NR_SHMEM);
+		__mod_zone_page_state(page_zone(page), NR_FILE_PAGES,
+				      -hpage_nr_pages(page));
+	if (PageSwapBacked(page)) {
+		__mod_zone_page_state(page_zone(page), NR_SHMEM,
+				      -hpage_nr_pages(page));
+		if (PageTransHuge(page))
+			__dec_zone_page_state(page, NR_SHMEM_THPS);
+	}
 	BUG_ON(page_mapped(page));
 
 	/*
@@ -2085,9 +2125,11 @@ repeat:
 			goto repeat;
 		}
 
+		/* Huge pages are only mapped whole, by the ->pmd_fault path */
 		if (!PageUptodate(page) ||
 				PageReadahead(page) ||
-				PageHWPoison(page))
+				PageHWPoison(page) ||
+				PageTransCompound(page))
 			goto skip;
 		if (!trylock_page(page))
 			goto skip;
@@ -2682,11 +2724,11 @@ ssize_t generic_file_write_iter(struct kiocb *iocb, struct iov_iter *from)
 	struct inode *inode = file->f_mapping->host;
 	ssize_t ret;
 
-	mutex_lock(&inode->i_mutex);
+	inode_lock(inode);
 	ret = generic_write_checks(iocb, from);
 	if (ret > 0)
 		ret = __generic_file_write_iter(iocb, from);
-	mutex_unlock(&inode->i_mutex);
+	inode_unlock(inode);
 
 	if (ret > 0) {
 		ssize_t err;
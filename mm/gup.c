@@ -861,6 +861,224 @@ long get_user_pages(struct task_struct *tsk, struct mm_struct *mm,
 }
 EXPORT_SYMBOL(get_user_pages);
 
+/*
+ * Add @refs references (or drop them, if @refs is negative) to each of the
+ * @nr pages at @pages, which all belong to the compound page @head, or are
+ * @head itself.  A reference on a THP tail is accounted in the head page's
+ * _count plus the tail page's _mapcount, like get_page() does, so that
+ * __split_huge_page_refcount() can hand it over to the tail.  Doing it for a
+ * whole run of subpages at once costs a single atomic on the head page
+ * instead of one get_page() per subpage.
+ *
+ * The caller holds a reference on every page, so none can be freed; a THP
+ * may still be split from under us, and the compound lock excludes that.
+ */
+static bool gup_adjust_refs(struct page *head, struct page **pages,
+			    unsigned long nr, int refs)
+{
+	long head_refs = (long)nr * refs;
+	unsigned long flags, i;
+
+	if (refs > 0 &&
+	    WARN_ON_ONCE(atomic_read(&head->_count) > INT_MAX - head_refs))
+		return false;
+
+	for (i = 0; i < nr && pages[i] == head; i++)
+		;
+	if (i == nr) {
+		/* a normal page or a compound head, one or more times */
+		atomic_add(head_refs, &head->_count);
+		return true;
+	}
+
+	if (!__compound_tail_refcounted(head)) {
+		/* hugetlbfs tails are accounted in the head page only */
+		smp_rmb();
+		if (likely(PageTail(pages[i]))) {
+			atomic_add(head_refs, &head->_count);
+			return true;
+		}
+	}
+
+	if (!get_page_unless_zero(head)) {
+		/* the THP was split and its head freed: no tails left */
+		for (i = 0; i < nr; i++)
+			atomic_add(refs, &pages[i]->_count);
+		return true;
+	}
+
+	head_refs = 0;
+	flags = compound_lock_irqsave(head);
+	for (i = 0; i < nr; i++) {
+		struct page *page = pages[i];
+
+		if (PageTail(page)) {
+			atomic_add(refs, &page->_mapcount);
+			head_refs += refs;
+		} else if (page == head) {
+			head_refs += refs;
+		} else {
+			/* __split_huge_page_refcount() ran before us */
+			atomic_add(refs, &page->_count);
+		}
+	}
+	atomic_add(head_refs, &head->_count);
+	compound_unlock_irqrestore(head, flags);
+	put_page(head);
+
+	return true;
+}
+
+/* Number of pages from @pages that belong to the same compound page */
+static unsigned long gup_run_length(struct page **pages, unsigned long nr,
+				    struct page **headp)
+{
+	struct page *head = compound_head(pages[0]);
+	unsigned long i;
+
+	for (i = 1; i < nr; i++)
+		if (compound_head(pages[i]) != head)
+			break;
+	*headp = head;
+	return i;
+}
+
+/*
+ * Turn the single references that get_user_pages*() took on @pages into
+ * pins.  On failure the references of the pages that could not be pinned
+ * are dropped, and the number of pages that were pinned is returned.
+ */
+static long gup_make_pins(struct page **pages, long nr_pages)
+{
+	long i = 0;
+
+	while (i < nr_pages) {
+		struct page *head;
+		unsigned long nr;
+
+		nr = gup_run_length(pages + i, nr_pages - i, &head);
+		if (!gup_adjust_refs(head, pages + i, nr,
+				     GUP_PIN_COUNTING_BIAS - 1)) {
+			release_pages(pages + i, nr_pages - i, false);
+			return i ? i : -ENOMEM;
+		}
+		i += nr;
+	}
+
+	return nr_pages;
+}
+
+/**
+ * pin_user_pages() - pin user pages in memory for long-term use
+ *
+ * Takes the same arguments and returns the same as get_user_pages(), but
+ * every page returned is pinned: it holds GUP_PIN_COUNTING_BIAS references,
+ * so that page_maybe_dma_pinned() reports it, and must be released with
+ * unpin_user_page() or unpin_user_pages() rather than put_page().
+ *
+ * This is meant for pages that a device accesses for an unbounded time,
+ * like RDMA memory registrations or VFIO DMA mappings.
+ */
+long pin_user_pages(struct task_struct *tsk, struct mm_struct *mm,
+		unsigned long start, unsigned long nr_pages, int write,
+		int force, struct page **pages, struct vm_area_struct **vmas)
+{
+	long ret;
+
+	if (WARN_ON_ONCE(!pages))
+		return -EINVAL;
+
+	ret = get_user_pages(tsk, mm, start, nr_pages, write, force,
+			     pages, vmas);
+	if (ret > 0)
+		ret = gup_make_pins(pages, ret);
+	return ret;
+}
+EXPORT_SYMBOL(pin_user_pages);
+
+/**
+ * pin_user_pages_fast() - pin user pages in memory for long-term use
+ *
+ * get_user_pages_fast() for pin_user_pages().  Subpages of the same huge
+ * page are pinned with a single update of its head page, so pinning a large
+ * range backed by huge pages costs one atomic per huge page.
+ */
+int pin_user_pages_fast(unsigned long start, int nr_pages, int write,
+			struct page **pages)
+{
+	int ret;
+
+	ret = get_user_pages_fast(start, nr_pages, write, pages);
+	if (ret > 0)
+		ret = gup_make_pins(pages, ret);
+	return ret;
+}
+EXPORT_SYMBOL_GPL(pin_user_pages_fast);
+
+/*
+ * Drop the pins of @nr pages of the compound page @head.  All references but
+ * the last one go in a single gup_adjust_refs() call; the last one goes
+ * through put_page(), which knows how to free the page.
+ */
+static void gup_drop_pins(struct page *head, struct page **pages,
+			  unsigned long nr)
+{
+	struct page *last = pages[nr - 1];
+
+	if (nr > 1)
+		gup_adjust_refs(head, pages, nr - 1, -GUP_PIN_COUNTING_BIAS);
+	gup_adjust_refs(head, &pages[nr - 1], 1, 1 - GUP_PIN_COUNTING_BIAS);
+	put_page(last);
+}
+
+/**
+ * unpin_user_page() - release a page pinned by pin_user_pages*()
+ * @page: the page to release
+ */
+void unpin_user_page(struct page *page)
+{
+	gup_drop_pins(compound_head(page), &page, 1);
+}
+EXPORT_SYMBOL(unpin_user_page);
+
+/**
+ * unpin_user_pages_dirty_lock() - release and optionally dirty pinned pages
+ * @pages:	array of pages returned by pin_user_pages*()
+ * @nr_pages:	number of pages in @pages
+ * @make_dirty:	whether to set_page_dirty_lock() the pages first
+ *
+ * Runs of subpages of the same compound page are released together.
+ */
+void unpin_user_pages_dirty_lock(struct page **pages, unsigned long nr_pages,
+				 bool make_dirty)
+{
+	unsigned long i = 0;
+
+	while (i < nr_pages) {
+		struct page *head;
+		unsigned long nr, j;
+
+		nr = gup_run_length(pages + i, nr_pages - i, &head);
+		if (make_dirty)
+			for (j = i; j < i + nr; j++)
+				set_page_dirty_lock(pages[j]);
+		gup_drop_pins(head, pages + i, nr);
+		i += nr;
+	}
+}
+EXPORT_SYMBOL(unpin_user_pages_dirty_lock);
+
+/**
+ * unpin_user_pages() - release an array of pinned pages
+ * @pages:	array of pages returned by pin_user_pages*()
+ * @nr_pages:	number of pages in @pages
+ */
+void unpin_user_pages(struct page **pages, unsigned long nr_pages)
+{
+	unpin_user_pages_dirty_lock(pages, nr_pages, false);
+}
+EXPORT_SYMBOL(unpin_user_pages);
+
 /**
  * populate_vma_page_range() -  populate a range of pages in the vma.
  * @vma:   target vma
@@ -26,6 +26,8 @@
 #include <linux/hashtable.h>
 #include <linux/userfaultfd_k.h>
 #include <linux/page_idle.h>
+#include <linux/shmem_fs.h>
+#include <linux/file.h>
 
 #include <asm/tlb.h>
 #include <asm/pgalloc.h>
@@ -398,6 +400,9 @@ static struct attribute *hugepage_attr[] = {
 	&use_zero_page_attr.attr,
 #ifdef CONFIG_DEBUG_VM
 	&debug_cow_attr.attr,
+#endif
+#ifdef CONFIG_TRANSPARENT_HUGE_PAGECACHE
+	&shmem_enabled_attr.attr,
 #endif
 	NULL,
 };
@@ -912,6 +917,74 @@ int vmf_insert_pfn_pmd(struct vm_area_struct *vma, unsigned long addr,
 	return VM_FAULT_NOPAGE;
 }
 
+#ifdef CONFIG_TRANSPARENT_HUGE_PAGECACHE
+/*
+ * Map a huge page cache page, found locked by ->pmd_fault, with one huge pmd.
+ * On success the caller's page reference becomes the mapping's reference;
+ * on failure the caller still holds it and must drop it.
+ */
+int do_set_pmd(struct vm_area_struct *vma, unsigned long haddr, pmd_t *pmd,
+	       struct page *page, bool write)
+{
+	struct mm_struct *mm = vma->vm_mm;
+	pgtable_t pgtable;
+	spinlock_t *ptl;
+	pmd_t entry;
+
+	VM_BUG_ON_PAGE(!PageTransHuge(page), page);
+	VM_BUG_ON_PAGE(!PageLocked(page), page);
+
+	/* Deposited for a later split of the pmd, as for anonymous THP */
+	pgtable = pte_alloc_one(mm, haddr);
+	if (unlikely(!pgtable))
+		return VM_FAULT_OOM;
+
+	ptl = pmd_lock(mm, pmd);
+	if (unlikely(!pmd_none(*pmd))) {
+		spin_unlock(ptl);
+		pte_free(mm, pgtable);
+		return VM_FAULT_NOPAGE;
+	}
+
+	entry = mk_huge_pmd(page, vma->vm_page_prot);
+	if (write)
+		entry = maybe_pmd_mkwrite(pmd_mkdirty(entry), vma);
+	page_add_file_rmap(page);
+	add_mm_counter(mm, MM_FILEPAGES, HPAGE_PMD_NR);
+	pgtable_trans_huge_deposit(mm, pmd, pgtable);
+	atomic_long_inc(&mm->nr_ptes);
+	set_pmd_at(mm, haddr, pmd, entry);
+	update_mmu_cache_pmd(vma, haddr, pmd);
+	spin_unlock(ptl);
+
+	count_vm_event(THP_FILE_MAPPED);
+	return 0;
+}
+
+/*
+ * Write fault on a read-only huge pmd of a shared file mapping: there is
+ * nothing to copy, so just make it writable and dirty, as wp_page_reuse()
+ * does for a pte.
+ */
+int huge_pmd_wp_shared(struct vm_area_struct *vma, unsigned long address,
+		       pmd_t *pmd)
+{
+	spinlock_t *ptl;
+	pmd_t entry;
+
+	ptl = pmd_lock(vma->vm_mm, pmd);
+	if (likely(pmd_trans_huge(*pmd))) {
+		entry = pmd_mkyoung(pmd_mkdirty(*pmd));
+		entry = maybe_pmd_mkwrite(entry, vma);
+		if (pmdp_set_access_flags(vma, address & HPAGE_PMD_MASK,
+					  pmd, entry, 1))
+			update_mmu_cache_pmd(vma, address, pmd);
+	}
+	spin_unlock(ptl);
+	return 0;
+}
+#endif /* CONFIG_TRANSPARENT_HUGE_PAGECACHE */
+
 int copy_huge_pmd(struct mm_struct *dst_mm, struct mm_struct *src_mm,
 		  pmd_t *dst_pmd, pmd_t *src_pmd, unsigned long addr,
 		  struct vm_area_struct *vma)
@@ -965,6 +1038,13 @@ int copy_huge_pmd(struct mm_struct *dst_mm, struct mm_struct *src_mm,
 		wait_split_huge_page(vma->anon_vma, src_pmd); /* src_vma */
 		goto out;
 	}
+	/* Huge page cache pmds are not copied: the child refaults them */
+	if (!vma_is_anonymous(vma)) {
+		pte_free(dst_mm, pgtable);
+		ret = 0;
+		goto out_unlock;
+	}
+
 	src_page = pmd_page(pmd);
 	VM_BUG_ON_PAGE(!PageHead(src_page), src_page);
 	get_page(src_page);
@@ -1483,7 +1563,13 @@ int zap_huge_pmd(struct mmu_gather *tlb, struct vm_area_struct *vma,
 		struct page *page = pmd_page(orig_pmd);
 		page_remove_rmap(page);
 		VM_BUG_ON_PAGE(page_mapcount(page) < 0, page);
-		add_mm_counter(tlb->mm, MM_ANONPAGES, -HPAGE_PMD_NR);
+		if (PageAnon(page)) {
+			add_mm_counter(tlb->mm, MM_ANONPAGES, -HPAGE_PMD_NR);
+		} else {
+			if (pmd_dirty(orig_pmd))
+				set_page_dirty(page);
+			add_mm_counter(tlb->mm, MM_FILEPAGES, -HPAGE_PMD_NR);
+		}
 		VM_BUG_ON_PAGE(!PageHead(page), page);
 		pte_free(tlb->mm, pgtable_trans_huge_withdraw(tlb->mm, pmd));
 		atomic_long_dec(&tlb->mm->nr_ptes);
@@ -1567,8 +1653,10 @@ int change_huge_pmd(struct vm_area_struct *vma, pmd_t *pmd,
 		 * Avoid trapping faults against the zero page. The read-only
 		 * data is likely to be read-cached on the local CPU and
 		 * local/remote hits to the zero page are not interesting.
+		 * Huge page cache pages are not migrated on NUMA faults.
 		 */
-		if (prot_numa && is_huge_zero_pmd(*pmd)) {
+		if (prot_numa &&
+		    (is_huge_zero_pmd(*pmd) || !vma_is_anonymous(vma))) {
 			spin_unlock(ptl);
 			return ret;
 		}
@@ -1754,6 +1842,8 @@ static void __split_huge_page_refcount(struct page *page,
 				      (1L << PG_active) |
 				      (1L << PG_unevictable)));
 		page_tail->flags |= (1L << PG_dirty);
+		/* lru_add_page_tail() puts it next to the head page */
+		page_tail->flags |= (page->flags & LRU_GEN_MASK);
 
 		clear_compound_head(page_tail);
 
@@ -1784,8 +1874,8 @@ static void __split_huge_page_refcount(struct page *page,
 		page_tail->index = page->index + i;
 		page_cpupid_xchg_last(page_tail, page_cpupid_last(page));
 
-		BUG_ON(!PageAnon(page_tail));
-		BUG_ON(!PageUptodate(page_tail));
+		/* A fallocated shmem page is !Uptodate until first use */
+		BUG_ON(PageAnon(page_tail) && !PageUptodate(page_tail));
 		BUG_ON(!PageDirty(page_tail));
 		BUG_ON(!PageSwapBacked(page_tail));
 
@@ -1794,7 +1884,10 @@ static void __split_huge_page_refcount(struct page *page,
 	atomic_sub(tail_count, &page->_count);
 	BUG_ON(atomic_read(&page->_count) <= 0);
 
-	__mod_zone_page_state(zone, NR_ANON_TRANSPARENT_HUGEPAGES, -1);
+	if (PageAnon(page))
+		__mod_zone_page_state(zone, NR_ANON_TRANSPARENT_HUGEPAGES, -1);
+	else
+		__mod_zone_page_state(zone, NR_SHMEM_THPS, -1);
 
 	ClearPageCompound(page);
 	compound_unlock(page);
@@ -1803,6 +1896,12 @@ static void __split_huge_page_refcount(struct page *page,
 	for (i = 1; i < HPAGE_PMD_NR; i++) {
 		struct page *page_tail = page + i;
 		BUG_ON(page_count(page_tail) <= 0);
+		/*
+		 * A page cache tail keeps its extra reference: it stands
+		 * for its own radix tree slot now.
+		 */
+		if (!PageAnon(page))
+			continue;
 		/*
 		 * Tail pages may be freed if there wasn't any mapping
 		 * like if add_to_swap() is running on a lru page that
@@ -1947,12 +2046,83 @@ static void __split_huge_page(struct page *page,
 	}
 }
 
+/*
+ * Huge page cache pages are only ever mapped by pmds, and the page cache keeps
+ * their contents: so rather than being split into ptes, such a pmd is simply
+ * unmapped, leaving the deposited page table behind for the range to refault
+ * with small pages.  Called with the pmd lock held: returns the page, whose
+ * mapping reference the caller drops after releasing the lock.
+ */
+static struct page *__split_huge_file_pmd(struct vm_area_struct *vma,
+					  unsigned long haddr, pmd_t *pmd)
+{
+	struct mm_struct *mm = vma->vm_mm;
+	struct page *page;
+	pgtable_t pgtable;
+	pmd_t _pmd;
+
+	_pmd = pmdp_huge_clear_flush_notify(vma, haddr, pmd);
+	page = pmd_page(_pmd);
+	if (pmd_dirty(_pmd))
+		set_page_dirty(page);
+	page_remove_rmap(page);
+	add_mm_counter(mm, MM_FILEPAGES, -HPAGE_PMD_NR);
+
+	pgtable = pgtable_trans_huge_withdraw(mm, pmd);
+	pmd_populate(mm, pmd, pgtable);
+	return page;
+}
+
+/*
+ * The page lock, held by the caller, keeps ->pmd_fault from mapping the page
+ * again, and i_mmap_rwsem keeps the vmas in place while its pmds are unmapped.
+ */
+static int split_huge_file_page(struct page *page, struct list_head *list)
+{
+	struct address_space *mapping = page->mapping;
+	pgoff_t pgoff = page->index;
+	struct vm_area_struct *vma;
+
+	VM_BUG_ON_PAGE(!PageLocked(page), page);
+
+	/* Truncated: it will be freed whole */
+	if (!mapping)
+		return 1;
+
+	i_mmap_lock_write(mapping);
+	vma_interval_tree_foreach(vma, &mapping->i_mmap, pgoff, pgoff) {
+		unsigned long addr = vma_address(page, vma);
+		struct mm_struct *mm = vma->vm_mm;
+		spinlock_t *ptl;
+		pmd_t *pmd;
+
+		mmu_notifier_invalidate_range_start(mm, addr,
+						    addr + HPAGE_PMD_SIZE);
+		pmd = page_check_address_pmd(page, mm, addr,
+				PAGE_CHECK_ADDRESS_PMD_FLAG, &ptl);
+		if (pmd) {
+			__split_huge_file_pmd(vma, addr, pmd);
+			spin_unlock(ptl);
+			put_page(page);
+		}
+		mmu_notifier_invalidate_range_end(mm, addr,
+						  addr + HPAGE_PMD_SIZE);
+	}
+	VM_BUG_ON_PAGE(page_mapped(page), page);
+
+	__split_huge_page_refcount(page, list);
+	count_vm_event(THP_SPLIT);
+	i_mmap_unlock_write(mapping);
+	return 0;
+}
+
 /*
  * Split a hugepage into normal pages. This doesn't change the position of head
  * page. If @list is null, tail pages will be added to LRU list, otherwise, to
  * @list. Both head page and tail pages will inherit mapping, flags, and so on
  * from the hugepage.
  * Return 0 if the hugepage is split successfully otherwise return 1.
+ * A huge page cache page must be locked by the caller.
  */
 int split_huge_page_to_list(struct page *page, struct list_head *list)
 {
@@ -1960,7 +2130,8 @@ int split_huge_page_to_list(struct page *page, struct list_head *list)
 	int ret = 1;
 
 	BUG_ON(is_huge_zero_page(page));
-	BUG_ON(!PageAnon(page));
+	if (!PageAnon(page))
+		return split_huge_file_page(page, list);
 
 	/*
 	 * The caller does not necessarily hold an mmap_sem that would prevent
@@ -1995,6 +2166,9 @@ out:
 int hugepage_madvise(struct vm_area_struct *vma,
 		     unsigned long *vm_flags, int advice)
 {
+	/* shmem_huge_enabled() decides for shared memory */
+	unsigned long no_thp = vma_is_shmem(vma) ? VM_SPECIAL : VM_NO_THP;
+
 	switch (advice) {
 	case MADV_HUGEPAGE:
 #ifdef CONFIG_S390
@@ -2009,7 +2183,7 @@ int hugepage_madvise(struct vm_area_struct *vma,
 		/*
 		 * Be somewhat over-protective like KSM for now!
 		 */
-		if (*vm_flags & VM_NO_THP)
+		if (*vm_flags & no_thp)
 			return -EINVAL;
 		*vm_flags &= ~VM_NOHUGEPAGE;
 		*vm_flags |= VM_HUGEPAGE;
@@ -2025,7 +2199,7 @@ int hugepage_madvise(struct vm_area_struct *vma,
 		/*
 		 * Be somewhat over-protective like KSM for now!
 		 */
-		if (*vm_flags & VM_NO_THP)
+		if (*vm_flags & no_thp)
 			return -EINVAL;
 		*vm_flags &= ~VM_HUGEPAGE;
 		*vm_flags |= VM_NOHUGEPAGE;
@@ -2128,20 +2302,31 @@ int khugepaged_enter_vma_merge(struct vm_area_struct *vma,
 			       unsigned long vm_flags)
 {
 	unsigned long hstart, hend;
-	if (!vma->anon_vma)
-		/*
-		 * Not yet faulted in so we will register later in the
-		 * page fault if needed.
-		 */
-		return 0;
-	if (vma->vm_ops || (vm_flags & VM_NO_THP))
-		/* khugepaged not yet working on file or special mappings */
-		return 0;
+	bool shmem = vma_is_shmem(vma);
+
+	if (shmem) {
+		/* shmem_huge_enabled() is checked again at scan time */
+		if (vm_flags & (VM_NOHUGEPAGE | VM_SPECIAL))
+			return 0;
+	} else {
+		if (!vma->anon_vma)
+			/*
+			 * Not yet faulted in so we will register later in the
+			 * page fault if needed.
+			 */
+			return 0;
+		if (vma->vm_ops || (vm_flags & VM_NO_THP))
+			/* khugepaged not yet working on other file mappings */
+			return 0;
+	}
 	hstart = (vma->vm_start + ~HPAGE_PMD_MASK) & HPAGE_PMD_MASK;
 	hend = vma->vm_end & HPAGE_PMD_MASK;
-	if (hstart < hend)
-		return khugepaged_enter(vma, vm_flags);
-	return 0;
+	if (hstart >= hend)
+		return 0;
+	/* The shmem huge= policy is independent of the anon THP one */
+	if (shmem && !test_bit(MMF_VM_HUGEPAGE, &vma->vm_mm->flags))
+		return __khugepaged_enter(vma->vm_mm);
+	return khugepaged_enter(vma, vm_flags);
 }
 
 void __khugepaged_exit(struct mm_struct *mm)
@@ -2214,6 +2399,9 @@ static int __collapse_huge_page_isolate(struct vm_area_struct *vma,
 		}
 		if (!pte_present(pteval))
 			goto out;
+		/* a huge pmd can't carry the uffd-wp bit of a pte */
+		if (pte_uffd_wp(pteval))
+			goto out;
 		page = vm_normal_page(vma, address, pteval);
 		if (unlikely(!page))
 			goto out;
@@ -2555,6 +2743,7 @@ static void collapse_huge_page(struct mm_struct *mm,
 	if (!pmd)
 		goto out;
 
+	vma_start_write(vma);
 	anon_vma_lock_write(vma->anon_vma);
 
 	pte = pte_offset_map(pmd, address);
@@ -2628,6 +2817,7 @@ static void collapse_huge_page(struct mm_struct *mm,
 
 	khugepaged_pages_collapsed++;
 out_up_write:
+	vma_end_write_all(mm);
 	up_write(&mm->mmap_sem);
 	return;
 
@@ -2670,6 +2860,8 @@ static int khugepaged_scan_pmd(struct mm_struct *mm,
 		}
 		if (!pte_present(pteval))
 			goto out_unmap;
+		if (pte_uffd_wp(pteval))
+			goto out_unmap;
 		if (pte_write(pteval))
 			writable = true;
 
@@ -2714,6 +2906,151 @@ out:
 	return ret;
 }
 
+#ifdef CONFIG_TRANSPARENT_HUGE_PAGECACHE
+/*
+ * Free the now empty page tables over a freshly collapsed shmem range, so
+ * that the next fault maps the huge page with a pmd.  Failing to take a
+ * mmap_sem only leaves that mm faulting the range in with ptes, which
+ * splits the page again: not worth blocking khugepaged for.
+ */
+static void retract_page_tables(struct address_space *mapping, pgoff_t pgoff)
+{
+	struct vm_area_struct *vma;
+	struct mm_struct *mm;
+	unsigned long addr;
+	pmd_t *pmd, _pmd;
+	pte_t *pte;
+	spinlock_t *ptl;
+	int i;
+
+	i_mmap_lock_write(mapping);
+	vma_interval_tree_foreach(vma, &mapping->i_mmap, pgoff, pgoff) {
+		/* Private copies of the old pages live in these ptes */
+		if (vma->anon_vma)
+			continue;
+		addr = vma->vm_start + ((pgoff - vma->vm_pgoff) << PAGE_SHIFT);
+		if (addr & ~HPAGE_PMD_MASK)
+			continue;
+		if (vma->vm_end < addr + HPAGE_PMD_SIZE)
+			continue;
+		mm = vma->vm_mm;
+		pmd = mm_find_pmd(mm, addr);
+		if (!pmd)
+			continue;
+		if (!down_write_trylock(&mm->mmap_sem))
+			continue;
+		vma_start_write(vma);
+		pte = pte_offset_map_lock(mm, pmd, addr, &ptl);
+		for (i = 0; i < HPAGE_PMD_NR; i++)
+			if (!pte_none(pte[i]))
+				break;
+		pte_unmap_unlock(pte, ptl);
+		/* Nothing can refill the table: mmap_sem and i_mmap are held */
+		if (i == HPAGE_PMD_NR) {
+			ptl = pmd_lock(mm, pmd);
+			_pmd = pmdp_collapse_flush(vma, addr, pmd);
+			spin_unlock(ptl);
+			atomic_long_dec(&mm->nr_ptes);
+			pte_free(mm, pmd_pgtable(_pmd));
+		}
+		vma_end_write_all(mm);
+		up_write(&mm->mmap_sem);
+	}
+	i_mmap_unlock_write(mapping);
+}
+
+static void collapse_shmem(struct mm_struct *mm, struct address_space *mapping,
+			   pgoff_t start, struct page **hpage, int node)
+{
+	struct page *new_page;
+	gfp_t gfp;
+
+	/* Only allocate from the target node */
+	gfp = alloc_hugepage_gfpmask(khugepaged_defrag(), __GFP_OTHER_NODE) |
+		__GFP_THISNODE;
+
+	/* release the mmap_sem read lock. */
+	new_page = khugepaged_alloc_page(hpage, gfp, mm, 0, node);
+	if (!new_page)
+		return;
+
+	/* On failure new_page is left untouched for the next attempt */
+	if (shmem_collapse_huge(mapping, start, new_page, mm, gfp))
+		return;
+
+	retract_page_tables(mapping, start);
+	*hpage = NULL;
+	khugepaged_pages_collapsed++;
+}
+
+static int khugepaged_scan_shmem(struct mm_struct *mm,
+				 struct vm_area_struct *vma,
+				 unsigned long address,
+				 struct page **hpage)
+{
+	struct address_space *mapping = vma->vm_file->f_mapping;
+	struct inode *inode = mapping->host;
+	pgoff_t start = linear_page_index(vma, address);
+	struct radix_tree_iter iter;
+	struct page *page;
+	struct file *file;
+	void **slot;
+	int present = 0, node;
+
+	VM_BUG_ON(address & ~HPAGE_PMD_MASK);
+
+	/* Collapsing fills the holes: stay within i_size */
+	if (start + HPAGE_PMD_NR >
+	    round_up(i_size_read(inode), PAGE_SIZE) >> PAGE_SHIFT)
+		return 0;
+
+	memset(khugepaged_node_load, 0, sizeof(khugepaged_node_load));
+	rcu_read_lock();
+	radix_tree_for_each_slot(slot, &mapping->page_tree, &iter, start) {
+		if (iter.index >= start + HPAGE_PMD_NR)
+			break;
+		page = radix_tree_deref_slot(slot);
+		if (radix_tree_deref_retry(page)) {
+			slot = radix_tree_iter_retry(&iter);
+			continue;
+		}
+		if (!page)
+			continue;
+		/* Swapped out, or already huge */
+		if (radix_tree_exception(page) || PageTransCompound(page))
+			goto out_unlock;
+		node = page_to_nid(page);
+		if (khugepaged_scan_abort(node))
+			goto out_unlock;
+		khugepaged_node_load[node]++;
+		present++;
+	}
+	rcu_read_unlock();
+
+	if (present < HPAGE_PMD_NR - khugepaged_max_ptes_none)
+		return 0;
+
+	node = khugepaged_find_target_node();
+	file = get_file(vma->vm_file);
+	/* collapse_shmem will return with the mmap_sem released */
+	collapse_shmem(mm, file->f_mapping, start, hpage, node);
+	fput(file);
+	return 1;
+
+out_unlock:
+	rcu_read_unlock();
+	return 0;
+}
+#else
+static int khugepaged_scan_shmem(struct mm_struct *mm,
+				 struct vm_area_struct *vma,
+				 unsigned long address,
+				 struct page **hpage)
+{
+	return 0;
+}
+#endif
+
 static void collect_mm_slot(struct mm_slot *mm_slot)
 {
 	struct mm_struct *mm = mm_slot->mm;
@@ -2776,7 +3113,7 @@ static unsigned int khugepaged_scan_mm_slot(unsigned int pages,
 			progress++;
 			break;
 		}
-		if (!hugepage_vma_check(vma)) {
+		if (!hugepage_vma_check(vma) && !shmem_huge_enabled(vma)) {
 skip:
 			progress++;
 			continue;
@@ -2800,9 +3137,14 @@ skip:
 			VM_BUG_ON(khugepaged_scan.address < hstart ||
 				  khugepaged_scan.address + HPAGE_PMD_SIZE >
 				  hend);
-			ret = khugepaged_scan_pmd(mm, vma,
-						  khugepaged_scan.address,
-						  hpage);
+			if (vma_is_shmem(vma))
+				ret = khugepaged_scan_shmem(mm, vma,
+						khugepaged_scan.address,
+						hpage);
+			else
+				ret = khugepaged_scan_pmd(mm, vma,
+						khugepaged_scan.address,
+						hpage);
 			/* move to next address */
 			khugepaged_scan.address += HPAGE_PMD_SIZE;
 			progress += HPAGE_PMD_NR;
@@ -2960,7 +3302,7 @@ void __split_huge_page_pmd(struct vm_area_struct *vma, unsigned long address,
 		pmd_t *pmd)
 {
 	spinlock_t *ptl;
-	struct page *page = NULL;
+	struct page *page = NULL, *file_page = NULL;
 	struct mm_struct *mm = vma->vm_mm;
 	unsigned long haddr = address & HPAGE_PMD_MASK;
 	unsigned long mmun_start;	/* For mmu_notifiers */
@@ -2981,6 +3323,8 @@ again:
 			put_huge_zero_page();
 	} else if (is_huge_zero_pmd(*pmd)) {
 		__split_huge_zero_page_pmd(vma, haddr, pmd);
+	} else if (!vma_is_anonymous(vma)) {
+		file_page = __split_huge_file_pmd(vma, haddr, pmd);
 	} else {
 		page = pmd_page(*pmd);
 		VM_BUG_ON_PAGE(!page_count(page), page);
@@ -2990,6 +3334,8 @@ again:
 	spin_unlock(ptl);
 	mmu_notifier_invalidate_range_end(mm, mmun_start, mmun_end);
 
+	if (file_page)
+		put_page(file_page);
 	if (!page)
 		return;
 
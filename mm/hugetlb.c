@@ -24,6 +24,8 @@
 #include <linux/swapops.h>
 #include <linux/page-isolation.h>
 #include <linux/jhash.h>
+#include <linux/llist.h>
+#include <linux/workqueue.h>
 
 #include <asm/page.h>
 #include <asm/pgtable.h>
@@ -34,6 +36,7 @@
 #include <linux/hugetlb_cgroup.h>
 #include <linux/node.h>
 #include "internal.h"
+#include "hugetlb_vmemmap.h"
 
 int hugepages_treat_as_movable;
 
@@ -1139,15 +1142,10 @@ static inline int alloc_fresh_gigantic_page(struct hstate *h,
 					nodemask_t *nodes_allowed) { return 0; }
 #endif
 
-static void update_and_free_page(struct hstate *h, struct page *page)
+static void __update_and_free_page(struct hstate *h, struct page *page)
 {
 	int i;
 
-	if (hstate_is_gigantic(h) && !gigantic_page_supported())
-		return;
-
-	h->nr_huge_pages--;
-	h->nr_huge_pages_node[page_to_nid(page)]--;
 	for (i = 0; i < pages_per_huge_page(h); i++) {
 		page[i].flags &= ~(1 << PG_locked | 1 << PG_error |
 				1 << PG_referenced | 1 << PG_dirty |
@@ -1165,6 +1163,61 @@ static void update_and_free_page(struct hstate *h, struct page *page)
 	}
 }
 
+/*
+ * Pages whose vmemmap was freed need it back before they can be freed,
+ * which allocates memory and cannot be done under hugetlb_lock.  They are
+ * freed from a work item instead, chained through page->mapping.
+ */
+static LLIST_HEAD(hpage_freelist);
+
+static void free_hpage_workfn(struct work_struct *work)
+{
+	struct llist_node *node;
+	struct page *page;
+	struct hstate *h;
+
+	node = llist_del_all(&hpage_freelist);
+	while (node) {
+		page = container_of((struct address_space **)node,
+				    struct page, mapping);
+		node = node->next;
+		page->mapping = NULL;
+		h = page_hstate(page);
+
+		if (hugetlb_vmemmap_restore(h, page)) {
+			/* Keep the page in the pool rather than leak it */
+			spin_lock(&hugetlb_lock);
+			h->nr_huge_pages++;
+			h->nr_huge_pages_node[page_to_nid(page)]++;
+			INIT_LIST_HEAD(&page->lru);
+			enqueue_huge_page(h, page);
+			spin_unlock(&hugetlb_lock);
+			continue;
+		}
+
+		__update_and_free_page(h, page);
+	}
+}
+static DECLARE_WORK(free_hpage_work, free_hpage_workfn);
+
+static void update_and_free_page(struct hstate *h, struct page *page)
+{
+	if (hstate_is_gigantic(h) && !gigantic_page_supported())
+		return;
+
+	h->nr_huge_pages--;
+	h->nr_huge_pages_node[page_to_nid(page)]--;
+
+	if (page_vmemmap_optimized(page)) {
+		if (llist_add((struct llist_node *)&page->mapping,
+			      &hpage_freelist))
+			schedule_work(&free_hpage_work);
+		return;
+	}
+
+	__update_and_free_page(h, page);
+}
+
 struct hstate *size_to_hstate(unsigned long size)
 {
 	struct hstate *h;
@@ -1250,6 +1303,7 @@ void free_huge_page(struct page *page)
 
 static void prep_new_huge_page(struct hstate *h, struct page *page, int nid)
 {
+	hugetlb_vmemmap_optimize(h, page);
 	INIT_LIST_HEAD(&page->lru);
 	set_compound_page_dtor(page, HUGETLB_PAGE_DTOR);
 	spin_lock(&hugetlb_lock);
@@ -1441,6 +1495,9 @@ void dissolve_free_huge_pages(unsigned long start_pfn, unsigned long end_pfn)
 	VM_BUG_ON(!IS_ALIGNED(start_pfn, 1 << minimum_order));
 	for (pfn = start_pfn; pfn < end_pfn; pfn += 1 << minimum_order)
 		dissolve_free_huge_page(pfn_to_page(pfn));
+
+	/* Pages whose vmemmap was freed are only freed by the work item */
+	flush_work(&free_hpage_work);
 }
 
 /*
@@ -1569,6 +1626,8 @@ static struct page *__alloc_buddy_huge_page(struct hstate *h,
 	spin_unlock(&hugetlb_lock);
 
 	page = __hugetlb_alloc_buddy_huge_page(h, vma, addr, nid);
+	if (page)
+		hugetlb_vmemmap_optimize(h, page);
 
 	spin_lock(&hugetlb_lock);
 	if (page) {
@@ -2716,6 +2775,7 @@ void __init hugetlb_add_hstate(unsigned int order)
 	h->next_nid_to_free = first_node(node_states[N_MEMORY]);
 	snprintf(h->name, HSTATE_NAME_LEN, "hugepages-%lukB",
 					huge_page_size(h)/1024);
+	hugetlb_vmemmap_init(h);
 
 	parsed_hstate = h;
 }
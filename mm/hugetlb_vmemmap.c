@@ -0,0 +1,137 @@
+/*
+ * Freeing the vmemmap pages of HugeTLB pages
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * A HugeTLB page has a struct page for each of its base pages: 8 pages of
+ * vmemmap for a 2MB page and 4096 for a 1GB page.  Only the head page and
+ * the first tail pages carry compound page metadata.  All the other tail
+ * struct pages hold the same contents, and nothing writes to them while
+ * the page is a HugeTLB page.
+ *
+ * So when a page enters the HugeTLB pool, the vmemmap pages past the first
+ * two are remapped read-only to the second one, and freed.  That saves 6
+ * of 8 pages for a 2MB page and 4094 of 4096 for a 1GB page.  Before the
+ * page goes back to the buddy allocator, which does write to all of its
+ * struct pages, the vmemmap is allocated and filled in again.
+ *
+ * This is disabled by default, and enabled with "hugetlb_free_vmemmap=on".
+ */
+#define pr_fmt(fmt)	"HugeTLB: " fmt
+
+#include <linux/log2.h>
+#include <linux/mm.h>
+#include <linux/mutex.h>
+#include <linux/string.h>
+
+#include "hugetlb_vmemmap.h"
+
+/* The vmemmap pages of a HugeTLB page that are never remapped */
+#define RESERVE_VMEMMAP_NR	2U
+#define RESERVE_VMEMMAP_SIZE	(RESERVE_VMEMMAP_NR << PAGE_SHIFT)
+
+static bool hugetlb_free_vmemmap_enabled __initdata;
+
+/* Serializes restoring the vmemmap of a page from different paths */
+static DEFINE_MUTEX(hugetlb_vmemmap_mutex);
+
+static int __init early_hugetlb_free_vmemmap_param(char *buf)
+{
+	if (!buf)
+		return -EINVAL;
+
+	if (!strcmp(buf, "on"))
+		hugetlb_free_vmemmap_enabled = true;
+	else if (!strcmp(buf, "off"))
+		hugetlb_free_vmemmap_enabled = false;
+	else
+		return -EINVAL;
+
+	return 0;
+}
+early_param("hugetlb_free_vmemmap", early_hugetlb_free_vmemmap_param);
+
+void __init hugetlb_vmemmap_init(struct hstate *h)
+{
+	unsigned int vmemmap_pages;
+
+	h->nr_free_vmemmap_pages = 0;
+	if (!hugetlb_free_vmemmap_enabled)
+		return;
+
+	/* A struct page crossing a page boundary could not be shared */
+	if (!is_power_of_2(sizeof(struct page))) {
+		pr_warn_once("cannot free vmemmap pages because struct page crosses page boundaries\n");
+		return;
+	}
+
+	vmemmap_pages = (pages_per_huge_page(h) * sizeof(struct page)) >>
+			PAGE_SHIFT;
+	if (vmemmap_pages > RESERVE_VMEMMAP_NR)
+		h->nr_free_vmemmap_pages = vmemmap_pages - RESERVE_VMEMMAP_NR;
+
+	pr_info("can free %u vmemmap pages for %s\n",
+		h->nr_free_vmemmap_pages, h->name);
+}
+
+/*
+ * Free the tail vmemmap of a new HugeTLB page, whose struct pages must
+ * already be set up for the pool.
+ */
+void hugetlb_vmemmap_optimize(struct hstate *h, struct page *head)
+{
+	unsigned long vmemmap_addr = (unsigned long)head;
+	unsigned long vmemmap_end, vmemmap_reuse;
+
+	if (!h->nr_free_vmemmap_pages)
+		return;
+
+	vmemmap_addr += RESERVE_VMEMMAP_SIZE;
+	vmemmap_end = vmemmap_addr +
+		((unsigned long)h->nr_free_vmemmap_pages << PAGE_SHIFT);
+	vmemmap_reuse = vmemmap_addr - PAGE_SIZE;
+
+	/*
+	 * This only fails if a huge vmemmap mapping could not be split, in
+	 * which case the page keeps its vmemmap.
+	 */
+	if (!vmemmap_remap_free(vmemmap_addr, vmemmap_end, vmemmap_reuse))
+		SetPageChecked(&head[1]);
+}
+
+/*
+ * Give the tail struct pages of a HugeTLB page their own vmemmap again,
+ * before they get written to.  Might sleep.
+ *
+ * Return: 0 on success, -ENOMEM if the vmemmap could not be allocated.
+ */
+int hugetlb_vmemmap_restore(struct hstate *h, struct page *head)
+{
+	unsigned long vmemmap_addr = (unsigned long)head;
+	unsigned long vmemmap_end, vmemmap_reuse;
+	int ret = 0;
+
+	mutex_lock(&hugetlb_vmemmap_mutex);
+	if (!page_vmemmap_optimized(head))
+		goto out;
+
+	vmemmap_addr += RESERVE_VMEMMAP_SIZE;
+	vmemmap_end = vmemmap_addr +
+		((unsigned long)h->nr_free_vmemmap_pages << PAGE_SHIFT);
+	vmemmap_reuse = vmemmap_addr - PAGE_SIZE;
+
+	/*
+	 * The pages are allocated on the node of the HugeTLB page and
+	 * without retrying hard: this runs when the page is being freed,
+	 * which is likely to be done to relieve memory pressure.
+	 */
+	ret = vmemmap_remap_alloc(vmemmap_addr, vmemmap_end, vmemmap_reuse,
+				  GFP_KERNEL | __GFP_NORETRY | __GFP_THISNODE);
+	if (!ret)
+		ClearPageChecked(&head[1]);
+out:
+	mutex_unlock(&hugetlb_vmemmap_mutex);
+	return ret;
+}
@@ -0,0 +1,48 @@
+/*
+ * Freeing the vmemmap pages of HugeTLB pages
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+#ifndef _MM_HUGETLB_VMEMMAP_H
+#define _MM_HUGETLB_VMEMMAP_H
+
+#include <linux/hugetlb.h>
+
+#ifdef CONFIG_HUGETLB_PAGE_FREE_VMEMMAP
+void __init hugetlb_vmemmap_init(struct hstate *h);
+void hugetlb_vmemmap_optimize(struct hstate *h, struct page *head);
+int hugetlb_vmemmap_restore(struct hstate *h, struct page *head);
+
+/*
+ * Whether the tail vmemmap of a HugeTLB page is shared.  The flag lives in
+ * the first tail page, whose struct page always stays writable.
+ */
+static inline bool page_vmemmap_optimized(struct page *head)
+{
+	return PageChecked(&head[1]);
+}
+#else
+static inline void hugetlb_vmemmap_init(struct hstate *h)
+{
+}
+
+static inline void hugetlb_vmemmap_optimize(struct hstate *h,
+					    struct page *head)
+{
+}
+
+static inline int hugetlb_vmemmap_restore(struct hstate *h,
+					  struct page *head)
+{
+	return 0;
+}
+
+static inline bool page_vmemmap_optimized(struct page *head)
+{
+	return false;
+}
+#endif /* CONFIG_HUGETLB_PAGE_FREE_VMEMMAP */
+
+#endif /* _MM_HUGETLB_VMEMMAP_H */
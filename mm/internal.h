@@ -209,6 +209,7 @@ struct compact_control {
 	const gfp_t gfp_mask;		/* gfp mask of a direct compactor */
 	const int alloc_flags;		/* alloc flags of a direct compactor */
 	const int classzone_idx;	/* zone index of a direct compactor */
+	const bool proactive_compaction;/* kcompactd proactive compaction */
 	struct zone *zone;
 	int contended;			/* Signal need_sched() or lock
 					 * contention detected during
@@ -431,6 +432,7 @@ extern unsigned long vm_mmap_pgoff(struct file *, unsigned long,
 extern void set_pageblock_order(void);
 unsigned long reclaim_clean_pages_from_list(struct zone *zone,
 					    struct list_head *page_list);
+unsigned long reclaim_pages(struct list_head *page_list);
 /* The ALLOC_WMARK bits are used as an index to zone->watermark */
 #define ALLOC_WMARK_MIN		WMARK_MIN
 #define ALLOC_WMARK_LOW		WMARK_LOW
@@ -1861,9 +1861,11 @@ EXPORT_SYMBOL(mem_cgroup_end_page_stat);
 
 /*
  * size of first charge trial. "32" comes from vmscan.c's magic value.
- * TODO: maybe necessary to use big numbers in big irons.
+ * The trial grows up to MAX_CHARGE_BATCH when the memcg is far enough
+ * from its limits, see memcg_charge_batch().
  */
-#define CHARGE_BATCH	32U
+#define CHARGE_BATCH		32U
+#define MAX_CHARGE_BATCH	256U
 struct memcg_stock_pcp {
 	struct mem_cgroup *cached; /* this never be root cgroup */
 	unsigned int nr_pages;
@@ -1890,7 +1892,7 @@ static bool consume_stock(struct mem_cgroup *memcg, unsigned int nr_pages)
 	struct memcg_stock_pcp *stock;
 	bool ret = false;
 
-	if (nr_pages > CHARGE_BATCH)
+	if (nr_pages > MAX_CHARGE_BATCH)
 		return ret;
 
 	stock = &get_cpu_var(memcg_stock);
@@ -1943,9 +1945,35 @@ static void refill_stock(struct mem_cgroup *memcg, unsigned int nr_pages)
 		stock->cached = memcg;
 	}
 	stock->nr_pages += nr_pages;
+
+	if (stock->nr_pages > MAX_CHARGE_BATCH)
+		drain_stock(stock);
+
 	put_cpu_var(memcg_stock);
 }
 
+/*
+ * Size of the per-cpu charge batch for @memcg. Charging a big batch
+ * at once keeps the page_counter cachelines from bouncing between
+ * cpus, but the stocks of all cpus together must not eat up a large
+ * part of the headroom below memory.max and memory.high, or the
+ * limits would be enforced too late. Scale the batch so that the
+ * stocks can take at most a quarter of the current headroom.
+ */
+static unsigned int memcg_charge_batch(struct mem_cgroup *memcg)
+{
+	unsigned long usage = page_counter_read(&memcg->memory);
+	unsigned long limit = min(READ_ONCE(memcg->memory.limit),
+				  READ_ONCE(memcg->high));
+	unsigned long batch;
+
+	if (usage >= limit)
+		return CHARGE_BATCH;
+
+	batch = (limit - usage) / (4 * num_online_cpus());
+	return clamp_t(unsigned long, batch, CHARGE_BATCH, MAX_CHARGE_BATCH);
+}
+
 /*
  * Drains all per-CPU charge caches for given root_memcg resp. subtree
  * of the hierarchy under it.
@@ -1999,6 +2027,48 @@ static int memcg_cpu_hotplug_callback(struct notifier_block *nb,
 	return NOTIFY_OK;
 }
 
+static unsigned long memcg_high_async_wmark(struct mem_cgroup *memcg)
+{
+	unsigned long high = READ_ONCE(memcg->high);
+	unsigned int ratio = READ_ONCE(memcg->high_async_ratio);
+
+	if (!ratio || high == PAGE_COUNTER_MAX)
+		return PAGE_COUNTER_MAX;
+
+	return high / 100 * ratio;
+}
+
+/*
+ * Background reclaim worker, queued by try_charge() once usage crosses
+ * the async watermark. Reclaims the memcg back below the watermark so
+ * that the tasks of the group rarely hit memory.high and never have to
+ * reclaim synchronously on the way back to userland.
+ */
+static void high_work_func(struct work_struct *work)
+{
+	struct mem_cgroup *memcg;
+	int nr_retries = MEM_CGROUP_RECLAIM_RETRIES;
+
+	memcg = container_of(work, struct mem_cgroup, high_work);
+
+	for (;;) {
+		unsigned long usage = page_counter_read(&memcg->memory);
+		unsigned long wmark = memcg_high_async_wmark(memcg);
+		unsigned long nr_pages;
+
+		if (usage <= wmark)
+			break;
+
+		nr_pages = min(usage - wmark, (unsigned long)SWAP_CLUSTER_MAX);
+		if (!try_to_free_mem_cgroup_pages(memcg, nr_pages,
+						  GFP_KERNEL, true) &&
+		    !nr_retries--)
+			break;
+
+		cond_resched();
+	}
+}
+
 /*
  * Scheduled by try_charge() to be executed from the userland return path
  * and reclaims memory over the high limit.
@@ -2027,7 +2097,7 @@ void mem_cgroup_handle_over_high(void)
 static int try_charge(struct mem_cgroup *memcg, gfp_t gfp_mask,
 		      unsigned int nr_pages)
 {
-	unsigned int batch = max(CHARGE_BATCH, nr_pages);
+	unsigned int batch = 0;
 	int nr_retries = MEM_CGROUP_RECLAIM_RETRIES;
 	struct mem_cgroup *mem_over_limit;
 	struct page_counter *counter;
@@ -2041,6 +2111,9 @@ retry:
 	if (consume_stock(memcg, nr_pages))
 		return 0;
 
+	if (!batch)
+		batch = max(memcg_charge_batch(memcg), nr_pages);
+
 	if (!do_swap_account ||
 	    page_counter_try_charge(&memcg->memsw, batch, &counter)) {
 		if (page_counter_try_charge(&memcg->memory, batch, &counter))
@@ -2151,9 +2224,17 @@ done_restock:
 	 * not recorded as it most likely matches current's and won't
 	 * change in the meantime.  As high limit is checked again before
 	 * reclaim, the cost of mismatch is negligible.
+	 *
+	 * Groups with background reclaim enabled get their worker kicked
+	 * as soon as they cross the watermark below the high limit.
 	 */
 	do {
-		if (page_counter_read(&memcg->memory) > memcg->high) {
+		unsigned long usage = page_counter_read(&memcg->memory);
+
+		if (usage > memcg_high_async_wmark(memcg))
+			queue_work(system_unbound_wq, &memcg->high_work);
+
+		if (usage > memcg->high) {
 			current->memcg_nr_pages_over_high += batch;
 			set_notify_resume(current);
 			break;
@@ -4247,6 +4328,7 @@ mem_cgroup_css_alloc(struct cgroup_subsys_state *parent_css)
 	}
 
 	memcg->last_scanned_node = MAX_NUMNODES;
+	INIT_WORK(&memcg->high_work, high_work_func);
 	INIT_LIST_HEAD(&memcg->oom_notify);
 	memcg->move_charge_at_immigrate = 0;
 	mutex_init(&memcg->thresholds_lock);
@@ -4362,6 +4444,7 @@ static void mem_cgroup_css_free(struct cgroup_subsys_state *css)
 {
 	struct mem_cgroup *memcg = mem_cgroup_from_css(css);
 
+	cancel_work_sync(&memcg->high_work);
 	memcg_destroy_kmem(memcg);
 	__mem_cgroup_free(memcg);
 }
@@ -4388,6 +4471,7 @@ static void mem_cgroup_css_reset(struct cgroup_subsys_state *css)
 	memcg_update_kmem_limit(memcg, PAGE_COUNTER_MAX);
 	memcg->low = 0;
 	memcg->high = PAGE_COUNTER_MAX;
+	memcg->high_async_ratio = 0;
 	memcg->soft_limit = PAGE_COUNTER_MAX;
 	memcg_wb_domain_size_changed(memcg);
 }
@@ -5143,6 +5227,37 @@ static ssize_t memory_high_write(struct kernfs_open_file *of,
 	return nbytes;
 }
 
+static int memory_high_async_ratio_show(struct seq_file *m, void *v)
+{
+	struct mem_cgroup *memcg = mem_cgroup_from_css(seq_css(m));
+
+	seq_printf(m, "%u\n", READ_ONCE(memcg->high_async_ratio));
+	return 0;
+}
+
+static ssize_t memory_high_async_ratio_write(struct kernfs_open_file *of,
+					     char *buf, size_t nbytes,
+					     loff_t off)
+{
+	struct mem_cgroup *memcg = mem_cgroup_from_css(of_css(of));
+	unsigned int ratio;
+	int err;
+
+	err = kstrtouint(strstrip(buf), 0, &ratio);
+	if (err)
+		return err;
+
+	if (ratio > 100)
+		return -EINVAL;
+
+	memcg->high_async_ratio = ratio;
+
+	if (page_counter_read(&memcg->memory) > memcg_high_async_wmark(memcg))
+		queue_work(system_unbound_wq, &memcg->high_work);
+
+	return nbytes;
+}
+
 static int memory_max_show(struct seq_file *m, void *v)
 {
 	struct mem_cgroup *memcg = mem_cgroup_from_css(seq_css(m));
@@ -5235,6 +5350,12 @@ static struct cftype memory_files[] = {
 		.seq_show = memory_high_show,
 		.write = memory_high_write,
 	},
+	{
+		.name = "high_async_ratio",
+		.flags = CFTYPE_NOT_ON_ROOT,
+		.seq_show = memory_high_async_ratio_show,
+		.write = memory_high_async_ratio_write,
+	},
 	{
 		.name = "max",
 		.flags = CFTYPE_NOT_ON_ROOT,
@@ -58,6 +58,7 @@
 #include <linux/kfifo.h>
 #include <linux/ratelimit.h>
 #include "internal.h"
+#include "hugetlb_vmemmap.h"
 #include "ras/ras_event.h"
 
 int sysctl_memory_failure_early_kill __read_mostly = 0;
@@ -1087,6 +1088,14 @@ int memory_failure(unsigned long pfn, int trapno, int flags)
 
 	p = pfn_to_page(pfn);
 	orig_head = hpage = compound_head(p);
+
+	/* The poison flags below are set on tail pages */
+	if (PageHuge(p) && hugetlb_vmemmap_restore(page_hstate(hpage), hpage)) {
+		printk(KERN_ERR "MCE %#lx: cannot restore hugepage vmemmap\n",
+		       pfn);
+		return -EBUSY;
+	}
+
 	if (TestSetPageHWPoison(p)) {
 		printk(KERN_ERR "MCE %#lx: already hardware poisoned\n", pfn);
 		return 0;
@@ -1750,6 +1759,14 @@ int soft_offline_page(struct page *page, int flags)
 			put_hwpoison_page(page);
 		return -EBUSY;
 	}
+	if (PageHuge(page) &&
+	    hugetlb_vmemmap_restore(page_hstate(hpage), hpage)) {
+		pr_info("soft offline: %#lx: cannot restore hugepage vmemmap\n",
+			pfn);
+		if (flags & MF_COUNT_INCREASED)
+			put_hwpoison_page(page);
+		return -EBUSY;
+	}
 	if (!PageHuge(page) && PageTransHuge(hpage)) {
 		if (PageAnon(hpage) && unlikely(split_huge_page(hpage))) {
 			pr_info("soft offline: %#lx: failed to split THP\n",
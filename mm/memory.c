@@ -887,9 +887,13 @@ copy_one_pte(struct mm_struct *dst_mm, struct mm_struct *src_mm,
 				pte = swp_entry_to_pte(entry);
 				if (pte_swp_soft_dirty(*src_pte))
 					pte = pte_swp_mksoft_dirty(pte);
+				if (pte_swp_uffd_wp(*src_pte))
+					pte = pte_swp_mkuffd_wp(pte);
 				set_pte_at(src_mm, addr, src_pte, pte);
 			}
 		}
+		/* The child has no userfaultfd to report writes to */
+		pte = pte_swp_clear_uffd_wp(pte);
 		goto out_set_pte;
 	}
 
@@ -909,6 +913,7 @@ copy_one_pte(struct mm_struct *dst_mm, struct mm_struct *src_mm,
 	if (vm_flags & VM_SHARED)
 		pte = pte_mkclean(pte);
 	pte = pte_mkold(pte);
+	pte = pte_clear_uffd_wp(pte);
 
 	page = vm_normal_page(vma, addr, pte);
 	if (page) {
@@ -1236,7 +1241,9 @@ static inline unsigned long zap_pmd_range(struct mmu_gather *tlb,
 		if (pmd_trans_huge(*pmd)) {
 			if (next - addr != HPAGE_PMD_SIZE) {
 #ifdef CONFIG_DEBUG_VM
-				if (!rwsem_is_locked(&tlb->mm->mmap_sem)) {
+				/* File pmds are split under the pmd lock alone */
+				if (!rwsem_is_locked(&tlb->mm->mmap_sem) &&
+				    vma_is_anonymous(vma)) {
 					pr_err("%s: mmap_sem is unlocked! addr=0x%lx end=0x%lx vma->vm_start=0x%lx vma->vm_end=0x%lx\n",
 						__func__, addr, end,
 						vma->vm_start,
@@ -2598,7 +2605,8 @@ static int do_swap_page(struct mm_struct *mm, struct vm_area_struct *vma,
 	inc_mm_counter_fast(mm, MM_ANONPAGES);
 	dec_mm_counter_fast(mm, MM_SWAPENTS);
 	pte = mk_pte(page, vma->vm_page_prot);
-	if ((flags & FAULT_FLAG_WRITE) && reuse_swap_page(page)) {
+	if ((flags & FAULT_FLAG_WRITE) && !pte_swp_uffd_wp(orig_pte) &&
+	    reuse_swap_page(page)) {
 		pte = maybe_mkwrite(pte_mkdirty(pte), vma);
 		flags &= ~FAULT_FLAG_WRITE;
 		ret |= VM_FAULT_WRITE;
@@ -2607,6 +2615,14 @@ static int do_swap_page(struct mm_struct *mm, struct vm_area_struct *vma,
 	flush_icache_page(vma, page);
 	if (pte_swp_soft_dirty(orig_pte))
 		pte = pte_mksoft_dirty(pte);
+	if (pte_swp_uffd_wp(orig_pte)) {
+		/*
+		 * Map the page write protected, a write is reported
+		 * to the userfaultfd when the access is retried.
+		 */
+		pte = pte_mkuffd_wp(pte_wrprotect(pte));
+		flags &= ~FAULT_FLAG_WRITE;
+	}
 	set_pte_at(mm, address, page_table, pte);
 	if (page == swapcache) {
 		do_page_add_anon_rmap(page, vma, address, exclusive);
@@ -3347,9 +3363,15 @@ static int handle_pte_fault(struct mm_struct *mm,
 	if (unlikely(!pte_same(*pte, entry)))
 		goto unlock;
 	if (flags & FAULT_FLAG_WRITE) {
-		if (!pte_write(entry))
+		if (!pte_write(entry)) {
+			if (userfaultfd_pte_wp(vma, entry)) {
+				pte_unmap_unlock(pte, ptl);
+				return handle_userfault(vma, address, flags,
+							VM_UFFD_WP);
+			}
 			return do_wp_page(mm, vma, address,
 					pte, pmd, ptl, entry);
+		}
 		entry = pte_mkdirty(entry);
 	}
 	entry = pte_mkyoung(entry);
@@ -3394,7 +3416,8 @@ static int __handle_mm_fault(struct mm_struct *mm, struct vm_area_struct *vma,
 	pmd = pmd_alloc(mm, pud, address);
 	if (!pmd)
 		return VM_FAULT_OOM;
-	if (pmd_none(*pmd) && transparent_hugepage_enabled(vma)) {
+	if (pmd_none(*pmd) &&
+	    (transparent_hugepage_enabled(vma) || vma_is_shmem(vma))) {
 		int ret = create_huge_pmd(mm, vma, address, pmd, flags);
 		if (!(ret & VM_FAULT_FALLBACK))
 			return ret;
@@ -3507,6 +3530,55 @@ int handle_mm_fault(struct mm_struct *mm, struct vm_area_struct *vma,
 }
 EXPORT_SYMBOL_GPL(handle_mm_fault);
 
+#ifdef CONFIG_PER_VMA_LOCK
+/*
+ * Look up and read-lock the vma covering @address without taking mmap_sem.
+ * Only vmas whose faults never need mmap_sem are returned: anonymous and
+ * page cache backed ones, which are not stacks and not registered with
+ * userfaultfd.  Returns NULL if the caller has to fall back to mmap_sem.
+ */
+struct vm_area_struct *lock_vma_under_rcu(struct mm_struct *mm,
+					  unsigned long address)
+{
+	struct vm_area_struct *vma;
+
+	rcu_read_lock();
+	vma = find_vma_rcu(mm, address);
+	if (!vma)
+		goto inval;
+
+	if (!vma_start_read(vma))
+		goto inval;
+
+	/* The vma may have changed or been unlinked before we locked it */
+	if (unlikely(vma->detached ||
+		     address < vma->vm_start || address >= vma->vm_end))
+		goto inval_end_read;
+
+	if (!vma_is_anonymous(vma) && vma->vm_ops->fault != filemap_fault)
+		goto inval_end_read;
+
+	/* anon_vma_prepare() looks at the neighbouring vmas */
+	if (!(vma->vm_flags & VM_SHARED) && !vma->anon_vma)
+		goto inval_end_read;
+
+	/* Stack expansion and userfaultfd need mmap_sem */
+	if (vma->vm_flags & (VM_GROWSDOWN | VM_GROWSUP))
+		goto inval_end_read;
+	if (userfaultfd_armed(vma))
+		goto inval_end_read;
+
+	rcu_read_unlock();
+	return vma;
+
+inval_end_read:
+	vma_end_read(vma);
+inval:
+	rcu_read_unlock();
+	return NULL;
+}
+#endif /* CONFIG_PER_VMA_LOCK */
+
 #ifndef __PAGETABLE_PUD_FOLDED
 /*
  * Allocate page upper directory.
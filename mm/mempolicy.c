@@ -445,8 +445,11 @@ void mpol_rebind_mm(struct mm_struct *mm, nodemask_t *new)
 	struct vm_area_struct *vma;
 
 	down_write(&mm->mmap_sem);
-	for (vma = mm->mmap; vma; vma = vma->vm_next)
+	for (vma = mm->mmap; vma; vma = vma->vm_next) {
+		vma_start_write(vma);
 		mpol_rebind_policy(vma->vm_policy, new, MPOL_REBIND_ONCE);
+	}
+	vma_end_write_all(mm);
 	up_write(&mm->mmap_sem);
 }
 
@@ -569,7 +572,8 @@ unsigned long change_prot_numa(struct vm_area_struct *vma,
 {
 	int nr_updated;
 
-	nr_updated = change_protection(vma, addr, end, PAGE_NONE, 0, 1);
+	nr_updated = change_protection(vma, addr, end, PAGE_NONE,
+				       MM_CP_PROT_NUMA);
 	if (nr_updated)
 		count_vm_numa_events(NUMA_PTE_UPDATES, nr_updated);
 
@@ -678,6 +682,7 @@ static int vma_replace_policy(struct vm_area_struct *vma,
 			goto err_out;
 	}
 
+	vma_start_write(vma);
 	old = vma->vm_policy;
 	vma->vm_policy = new; /* protected by mmap_sem */
 	mpol_put(old);
@@ -1192,8 +1197,10 @@ static long do_mbind(unsigned long start, unsigned long len,
 			task_lock(current);
 			err = mpol_set_nodemask(new, nmask, scratch);
 			task_unlock(current);
-			if (err)
+			if (err) {
+				vma_end_write_all(mm);
 				up_write(&mm->mmap_sem);
+			}
 		} else
 			err = -ENOMEM;
 		NODEMASK_SCRATCH_FREE(scratch);
@@ -1222,6 +1229,7 @@ static long do_mbind(unsigned long start, unsigned long len,
 	} else
 		putback_movable_pages(&pagelist);
 
+	vma_end_write_all(mm);
 	up_write(&mm->mmap_sem);
  mpol_out:
 	mpol_put(new);
@@ -152,6 +152,9 @@ static int remove_migration_pte(struct page *new, struct vm_area_struct *vma,
 	if (is_write_migration_entry(entry))
 		pte = maybe_mkwrite(pte, vma);
 
+	if (pte_swp_uffd_wp(*ptep))
+		pte = pte_mkuffd_wp(pte_wrprotect(pte));
+
 #ifdef CONFIG_HUGETLB_PAGE
 	if (PageHuge(new)) {
 		pte = pte_mkhuge(pte);
@@ -943,9 +946,23 @@ static ICE_noinline int unmap_and_move(new_page_t get_new_page,
 		goto out;
 	}
 
-	if (unlikely(PageTransHuge(page)))
-		if (unlikely(split_huge_page(page)))
-			goto out;
+	if (unlikely(PageTransHuge(page))) {
+		if (PageAnon(page)) {
+			if (unlikely(split_huge_page(page)))
+				goto out;
+		} else {
+			/* Huge shmem pages are split under the page lock */
+			rc = -EAGAIN;
+			if (!trylock_page(page))
+				goto out;
+			if (unlikely(split_huge_page(page))) {
+				unlock_page(page);
+				goto out;
+			}
+			unlock_page(page);
+			rc = MIGRATEPAGE_SUCCESS;
+		}
+	}
 
 	rc = __unmap_and_move(page, newpage, force, mode);
 	if (rc == MIGRATEPAGE_SUCCESS)
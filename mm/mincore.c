@@ -74,7 +74,7 @@ static unsigned char mincore_page(struct address_space *mapping, pgoff_t pgoff)
 	page = find_get_page(mapping, pgoff);
 #endif
 	if (page) {
-		present = PageUptodate(page);
+		present = PageUptodate(compound_head(page));
 		page_cache_release(page);
 	}
 
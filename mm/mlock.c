@@ -545,6 +545,7 @@ success:
 	 * set VM_LOCKED, populate_vma_page_range will bring it back.
 	 */
 
+	vma_start_write(vma);
 	if (lock)
 		vma->vm_flags = newflags;
 	else
@@ -630,6 +631,7 @@ static int do_mlock(unsigned long start, size_t len, vm_flags_t flags)
 	if ((locked <= lock_limit) || capable(CAP_IPC_LOCK))
 		error = apply_vma_lock_flags(start, len, flags);
 
+	vma_end_write_all(current->mm);
 	up_write(&current->mm->mmap_sem);
 	if (error)
 		return error;
@@ -667,6 +669,7 @@ SYSCALL_DEFINE2(munlock, unsigned long, start, size_t, len)
 
 	down_write(&current->mm->mmap_sem);
 	ret = apply_vma_lock_flags(start, len, 0);
+	vma_end_write_all(current->mm);
 	up_write(&current->mm->mmap_sem);
 
 	return ret;
@@ -741,6 +744,7 @@ SYSCALL_DEFINE1(mlockall, int, flags)
 	if (!(flags & MCL_CURRENT) || (current->mm->total_vm <= lock_limit) ||
 	    capable(CAP_IPC_LOCK))
 		ret = apply_mlockall_flags(flags);
+	vma_end_write_all(current->mm);
 	up_write(&current->mm->mmap_sem);
 	if (!ret && (flags & MCL_CURRENT))
 		mm_populate(0, TASK_SIZE);
@@ -754,6 +758,7 @@ SYSCALL_DEFINE0(munlockall)
 
 	down_write(&current->mm->mmap_sem);
 	ret = apply_mlockall_flags(0);
+	vma_end_write_all(current->mm);
 	up_write(&current->mm->mmap_sem);
 	return ret;
 }
@@ -277,7 +277,7 @@ static struct vm_area_struct *remove_vma(struct vm_area_struct *vma)
 	if (vma->vm_file)
 		fput(vma->vm_file);
 	mpol_put(vma_policy(vma));
-	kmem_cache_free(vm_area_cachep, vma);
+	vm_area_free(vma);
 	return next;
 }
 
@@ -342,6 +342,7 @@ SYSCALL_DEFINE1(brk, unsigned long, brk)
 set_brk:
 	mm->brk = brk;
 	populate = newbrk > oldbrk && (mm->def_flags & VM_LOCKED) != 0;
+	vma_end_write_all(mm);
 	up_write(&mm->mmap_sem);
 	if (populate)
 		mm_populate(oldbrk, newbrk - oldbrk);
@@ -349,6 +350,7 @@ set_brk:
 
 out:
 	retval = mm->brk;
+	vma_end_write_all(mm);
 	up_write(&mm->mmap_sem);
 	return retval;
 }
@@ -784,6 +786,13 @@ again:			remove_next = 1 + (end > next->vm_end);
 		}
 	}
 
+	/* keep page faults off the vmas whose bounds are changing */
+	vma_start_write(vma);
+	if (remove_next || adjust_next)
+		vma_start_write(next);
+	if (insert)
+		vma_start_write(insert);
+
 	if (file) {
 		mapping = file->f_mapping;
 		root = &mapping->i_mmap;
@@ -851,6 +860,7 @@ again:			remove_next = 1 + (end > next->vm_end);
 		 * vma_merge has merged next into vma, and needs
 		 * us to remove next before dropping the locks.
 		 */
+		vma_mark_detached(next);
 		__vma_unlink(mm, next, vma);
 		if (file)
 			__remove_shared_vm_struct(next, file, mapping);
@@ -897,7 +907,7 @@ again:			remove_next = 1 + (end > next->vm_end);
 			anon_vma_merge(vma, next);
 		mm->map_count--;
 		mpol_put(vma_policy(next));
-		kmem_cache_free(vm_area_cachep, next);
+		vm_area_free(next);
 		/*
 		 * In mprotect's case 6 (see comments on vma_merge),
 		 * we must remove another next too. It would clutter
@@ -1325,9 +1335,23 @@ unsigned long do_mmap(struct file *file, unsigned long addr,
 
 	if (file) {
 		struct inode *inode = file_inode(file);
+		unsigned long flags_mask;
+
+		flags_mask = LEGACY_MAP_MASK | file->f_op->mmap_supported_flags;
 
 		switch (flags & MAP_TYPE) {
 		case MAP_SHARED:
+			/*
+			 * Unknown flags have always been silently ignored with
+			 * MAP_SHARED.  Keep it that way, so that a flag which
+			 * changes the consistency model, like MAP_SYNC, can
+			 * only be asked for with MAP_SHARED_VALIDATE.
+			 */
+			flags &= LEGACY_MAP_MASK;
+			/* fall through */
+		case MAP_SHARED_VALIDATE:
+			if (flags & ~flags_mask)
+				return -EOPNOTSUPP;
 			if ((prot&PROT_WRITE) && !(file->f_mode&FMODE_WRITE))
 				return -EACCES;
 
@@ -1347,6 +1371,8 @@ unsigned long do_mmap(struct file *file, unsigned long addr,
 			vm_flags |= VM_SHARED | VM_MAYSHARE;
 			if (!(file->f_mode & FMODE_WRITE))
 				vm_flags &= ~(VM_MAYWRITE | VM_SHARED);
+			if (flags & MAP_SYNC)
+				vm_flags |= VM_SYNC;
 
 			/* fall through */
 		case MAP_PRIVATE:
@@ -1606,6 +1632,7 @@ unsigned long mmap_region(struct file *file, unsigned long addr,
 	vma->vm_flags = vm_flags;
 	vma->vm_page_prot = vm_get_page_prot(vm_flags);
 	vma->vm_pgoff = pgoff;
+	vma_init_lock(vma);
 	INIT_LIST_HEAD(&vma->anon_vma_chain);
 
 	if (file) {
@@ -2071,6 +2098,39 @@ struct vm_area_struct *find_vma(struct mm_struct *mm, unsigned long addr)
 
 EXPORT_SYMBOL(find_vma);
 
+#ifdef CONFIG_PER_VMA_LOCK
+/*
+ * find_vma() for page faults running without mmap_sem, called under
+ * rcu_read_lock().  The rbtree may change under us: the walk cannot loop,
+ * vmas are freed after a grace period, but it can miss the vma or return
+ * one that is about to be unlinked.  The caller has to check the result
+ * once the vma is locked, see lock_vma_under_rcu().
+ */
+struct vm_area_struct *find_vma_rcu(struct mm_struct *mm, unsigned long addr)
+{
+	struct vm_area_struct *vma = NULL;
+	struct rb_node *rb_node;
+
+	rb_node = READ_ONCE(mm->mm_rb.rb_node);
+
+	while (rb_node) {
+		struct vm_area_struct *tmp;
+
+		tmp = rb_entry(rb_node, struct vm_area_struct, vm_rb);
+
+		if (READ_ONCE(tmp->vm_end) > addr) {
+			vma = tmp;
+			if (READ_ONCE(tmp->vm_start) <= addr)
+				break;
+			rb_node = READ_ONCE(rb_node->rb_left);
+		} else
+			rb_node = READ_ONCE(rb_node->rb_right);
+	}
+
+	return vma;
+}
+#endif
+
 /*
  * Same as find_vma, but also return a pointer to the previous VMA in *pprev.
  */
@@ -2427,6 +2487,7 @@ detach_vmas_to_be_unmapped(struct mm_struct *mm, struct vm_area_struct *vma,
 	insertion_point = (prev ? &prev->vm_next : &mm->mmap);
 	vma->vm_prev = NULL;
 	do {
+		vma_mark_detached(vma);
 		vma_rb_erase(vma, &mm->mm_rb);
 		mm->map_count--;
 		tail_vma = vma;
@@ -2465,6 +2526,7 @@ static int __split_vma(struct mm_struct *mm, struct vm_area_struct *vma,
 	/* most fields are the same, copy all, and then fixup */
 	*new = *vma;
 
+	vma_init_lock(new);
 	INIT_LIST_HEAD(&new->anon_vma_chain);
 
 	if (new_below)
@@ -2621,6 +2683,7 @@ int vm_munmap(unsigned long start, size_t len)
 
 	down_write(&mm->mmap_sem);
 	ret = do_munmap(mm, start, len);
+	vma_end_write_all(mm);
 	up_write(&mm->mmap_sem);
 	return ret;
 }
@@ -2717,6 +2780,7 @@ SYSCALL_DEFINE5(remap_file_pages, unsigned long, start, unsigned long, size,
 			prot, flags, pgoff, &populate);
 	fput(file);
 out:
+	vma_end_write_all(mm);
 	up_write(&mm->mmap_sem);
 	if (populate)
 		mm_populate(ret, populate);
@@ -2803,6 +2867,7 @@ static unsigned long do_brk(unsigned long addr, unsigned long len)
 		return -ENOMEM;
 	}
 
+	vma_init_lock(vma);
 	INIT_LIST_HEAD(&vma->anon_vma_chain);
 	vma->vm_mm = mm;
 	vma->vm_start = addr;
@@ -2829,6 +2894,7 @@ unsigned long vm_brk(unsigned long addr, unsigned long len)
 	down_write(&mm->mmap_sem);
 	ret = do_brk(addr, len);
 	populate = ((mm->def_flags & VM_LOCKED) != 0);
+	vma_end_write_all(mm);
 	up_write(&mm->mmap_sem);
 	if (populate)
 		mm_populate(addr, len);
@@ -2981,6 +3047,7 @@ struct vm_area_struct *copy_vma(struct vm_area_struct **vmap,
 		new_vma->vm_pgoff = pgoff;
 		if (vma_dup_policy(vma, new_vma))
 			goto out_free_vma;
+		vma_init_lock(new_vma);
 		INIT_LIST_HEAD(&new_vma->anon_vma_chain);
 		if (anon_vma_clone(new_vma, vma))
 			goto out_free_mempol;
@@ -3081,6 +3148,7 @@ static struct vm_area_struct *__install_special_mapping(
 	if (unlikely(vma == NULL))
 		return ERR_PTR(-ENOMEM);
 
+	vma_init_lock(vma);
 	INIT_LIST_HEAD(&vma->anon_vma_chain);
 	vma->vm_mm = mm;
 	vma->vm_start = addr;
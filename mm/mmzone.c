@@ -85,6 +85,24 @@ int memmap_valid_within(unsigned long pfn,
 }
 #endif /* CONFIG_ARCH_HAS_HOLES_MEMORYMODEL */
 
+#ifdef CONFIG_LRU_GEN
+static void lru_gen_init_lruvec(struct lruvec *lruvec)
+{
+	struct lru_gen_struct *lrugen = &lruvec->lrugen;
+	int gen, type;
+
+	/* start out with the minimum number of generations */
+	lrugen->max_seq = MIN_NR_GENS - 1;
+	for (gen = 0; gen < MAX_NR_GENS; gen++)
+		for (type = 0; type < 2; type++)
+			INIT_LIST_HEAD(&lrugen->lists[gen][type]);
+}
+#else
+static inline void lru_gen_init_lruvec(struct lruvec *lruvec)
+{
+}
+#endif
+
 void lruvec_init(struct lruvec *lruvec)
 {
 	enum lru_list lru;
@@ -93,6 +111,8 @@ void lruvec_init(struct lruvec *lruvec)
 
 	for_each_lru(lru)
 		INIT_LIST_HEAD(&lruvec->lists[lru]);
+
+	lru_gen_init_lruvec(lruvec);
 }
 
 #if defined(CONFIG_NUMA_BALANCING) && !defined(LAST_CPUPID_NOT_IN_PAGE_FLAGS)
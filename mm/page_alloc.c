@@ -62,6 +62,7 @@
 #include <linux/sched/rt.h>
 #include <linux/page_owner.h>
 #include <linux/kthread.h>
+#include <linux/padata.h>
 
 #include <asm/sections.h>
 #include <asm/tlbflush.h>
@@ -457,9 +458,11 @@ out:
  * This usage means that zero-order pages may not be compound.
  */
 
+static void free_the_page(struct page *page, unsigned int order);
+
 static void free_compound_page(struct page *page)
 {
-	__free_pages_ok(page, compound_order(page));
+	free_the_page(page, compound_order(page));
 }
 
 void prep_compound_page(struct page *page, unsigned int order)
@@ -783,6 +786,22 @@ static inline int free_pages_check(struct page *page)
 	return 0;
 }
 
+static inline unsigned int order_to_pindex(int migratetype, int order)
+{
+	VM_BUG_ON(order > PAGE_ALLOC_COSTLY_ORDER);
+	return (MIGRATE_PCPTYPES * order) + migratetype;
+}
+
+static inline int pindex_to_order(unsigned int pindex)
+{
+	return pindex / MIGRATE_PCPTYPES;
+}
+
+static inline bool pcp_allowed_order(unsigned int order)
+{
+	return order <= PAGE_ALLOC_COSTLY_ORDER;
+}
+
 /*
  * Frees a number of pages from the PCP lists
  * Assumes all pages on list are in same zone, and of same order.
@@ -797,17 +816,24 @@ static inline int free_pages_check(struct page *page)
 static void free_pcppages_bulk(struct zone *zone, int count,
 					struct per_cpu_pages *pcp)
 {
-	int migratetype = 0;
+	unsigned int pindex = 0;
 	int batch_free = 0;
-	int to_free = count;
+	int nr_freed = 0;
+	unsigned int order;
 	unsigned long nr_scanned;
 
+	/*
+	 * count is in base pages and so is pcp->count; make sure the
+	 * loop below cannot spin on lists that are all empty.
+	 */
+	count = min(pcp->count, count);
+
 	spin_lock(&zone->lock);
 	nr_scanned = zone_page_state(zone, NR_PAGES_SCANNED);
 	if (nr_scanned)
 		__mod_zone_page_state(zone, NR_PAGES_SCANNED, -nr_scanned);
 
-	while (to_free) {
+	while (count > 0) {
 		struct page *page;
 		struct list_head *list;
 
@@ -820,15 +846,16 @@ static void free_pcppages_bulk(struct zone *zone, int count,
 		 */
 		do {
 			batch_free++;
-			if (++migratetype == MIGRATE_PCPTYPES)
-				migratetype = 0;
-			list = &pcp->lists[migratetype];
+			if (++pindex == NR_PCP_LISTS)
+				pindex = 0;
+			list = &pcp->lists[pindex];
 		} while (list_empty(list));
 
 		/* This is the only non-empty list. Free them all. */
-		if (batch_free == MIGRATE_PCPTYPES)
-			batch_free = to_free;
+		if (batch_free == NR_PCP_LISTS)
+			batch_free = count;
 
+		order = pindex_to_order(pindex);
 		do {
 			int mt;	/* migratetype of the to-be-freed page */
 
@@ -843,10 +870,13 @@ static void free_pcppages_bulk(struct zone *zone, int count,
 			if (unlikely(has_isolate_pageblock(zone)))
 				mt = get_pageblock_migratetype(page);
 
-			__free_one_page(page, page_to_pfn(page), zone, 0, mt);
-			trace_mm_page_pcpu_drain(page, 0, mt);
-		} while (--to_free && --batch_free && !list_empty(list));
+			__free_one_page(page, page_to_pfn(page), zone, order, mt);
+			trace_mm_page_pcpu_drain(page, order, mt);
+			nr_freed += 1 << order;
+			count -= 1 << order;
+		} while (count > 0 && --batch_free && !list_empty(list));
 	}
+	pcp->count -= nr_freed;
 	spin_unlock(&zone->lock);
 }
 
@@ -1135,56 +1165,33 @@ static inline void __init pgdat_init_report_one_done(void)
 		complete(&pgdat_init_all_done_comp);
 }
 
-/* Initialise remaining memory on a node */
-static int __init deferred_init_memmap(void *data)
+/*
+ * Initialise struct pages of [start_pfn, end_pfn) that belong to the deferred
+ * zone of the node and free them to the buddy allocator. Returns the number
+ * of pages freed.
+ */
+static unsigned long __init
+deferred_init_pages(struct zone *zone, unsigned long start_pfn,
+		    unsigned long end_pfn)
 {
-	pg_data_t *pgdat = data;
-	int nid = pgdat->node_id;
+	int nid = zone_to_nid(zone);
+	int zid = zone_idx(zone);
 	struct mminit_pfnnid_cache nid_init_state = { };
-	unsigned long start = jiffies;
 	unsigned long nr_pages = 0;
 	unsigned long walk_start, walk_end;
-	int i, zid;
-	struct zone *zone;
-	unsigned long first_init_pfn = pgdat->first_deferred_pfn;
-	const struct cpumask *cpumask = cpumask_of_node(pgdat->node_id);
-
-	if (first_init_pfn == ULONG_MAX) {
-		pgdat_init_report_one_done();
-		return 0;
-	}
-
-	/* Bind memory initialisation thread to a local node if possible */
-	if (!cpumask_empty(cpumask))
-		set_cpus_allowed_ptr(current, cpumask);
-
-	/* Sanity check boundaries */
-	BUG_ON(pgdat->first_deferred_pfn < pgdat->node_start_pfn);
-	BUG_ON(pgdat->first_deferred_pfn > pgdat_end_pfn(pgdat));
-	pgdat->first_deferred_pfn = ULONG_MAX;
-
-	/* Only the highest zone is deferred so find it */
-	for (zid = 0; zid < MAX_NR_ZONES; zid++) {
-		zone = pgdat->node_zones + zid;
-		if (first_init_pfn < zone_end_pfn(zone))
-			break;
-	}
+	int i;
 
 	for_each_mem_pfn_range(i, nid, &walk_start, &walk_end, NULL) {
-		unsigned long pfn, end_pfn;
+		unsigned long pfn, epfn;
 		struct page *page = NULL;
 		struct page *free_base_page = NULL;
 		unsigned long free_base_pfn = 0;
 		int nr_to_free = 0;
 
-		end_pfn = min(walk_end, zone_end_pfn(zone));
-		pfn = first_init_pfn;
-		if (pfn < walk_start)
-			pfn = walk_start;
-		if (pfn < zone->zone_start_pfn)
-			pfn = zone->zone_start_pfn;
+		pfn = max(walk_start, start_pfn);
+		epfn = min(walk_end, end_pfn);
 
-		for (; pfn < end_pfn; pfn++) {
+		for (; pfn < epfn; pfn++) {
 			if (!pfn_valid_within(pfn))
 				goto free_range;
 
@@ -1242,14 +1249,88 @@ free_range:
 			free_base_pfn = nr_to_free = 0;
 		}
 
-		first_init_pfn = max(end_pfn, first_init_pfn);
+		/* Free whatever is left over at the end of the range */
+		nr_pages += nr_to_free;
+		deferred_free_range(free_base_page, free_base_pfn, nr_to_free);
+	}
+
+	return nr_pages;
+}
+
+struct deferred_init_args {
+	struct zone *zone;
+	atomic_long_t nr_pages;
+};
+
+static void __init
+deferred_init_memmap_chunk(unsigned long start_pfn, unsigned long end_pfn,
+			   void *arg)
+{
+	struct deferred_init_args *args = arg;
+
+	atomic_long_add(deferred_init_pages(args->zone, start_pfn, end_pfn),
+			&args->nr_pages);
+}
+
+/* Initialise remaining memory on a node */
+static int __init deferred_init_memmap(void *data)
+{
+	pg_data_t *pgdat = data;
+	int nid = pgdat->node_id;
+	unsigned long start = jiffies;
+	struct deferred_init_args args;
+	struct padata_mt_job job;
+	int zid;
+	struct zone *zone;
+	unsigned long first_init_pfn = pgdat->first_deferred_pfn;
+	const struct cpumask *cpumask = cpumask_of_node(pgdat->node_id);
+
+	if (first_init_pfn == ULONG_MAX) {
+		pgdat_init_report_one_done();
+		return 0;
+	}
+
+	/* Bind memory initialisation thread to a local node if possible */
+	if (!cpumask_empty(cpumask))
+		set_cpus_allowed_ptr(current, cpumask);
+
+	/* Sanity check boundaries */
+	BUG_ON(pgdat->first_deferred_pfn < pgdat->node_start_pfn);
+	BUG_ON(pgdat->first_deferred_pfn > pgdat_end_pfn(pgdat));
+	pgdat->first_deferred_pfn = ULONG_MAX;
+
+	/* Only the highest zone is deferred so find it */
+	for (zid = 0; zid < MAX_NR_ZONES; zid++) {
+		zone = pgdat->node_zones + zid;
+		if (first_init_pfn < zone_end_pfn(zone))
+			break;
 	}
+	first_init_pfn = max(first_init_pfn, zone->zone_start_pfn);
+
+	/*
+	 * Split the zone into section aligned chunks and initialise them
+	 * in parallel on all CPUs of the node. Chunk boundaries never split
+	 * a MAX_ORDER block, so large frees are batched as before.
+	 */
+	args.zone = zone;
+	atomic_long_set(&args.nr_pages, 0);
+
+	job.thread_fn = deferred_init_memmap_chunk;
+	job.fn_arg = &args;
+	job.start = first_init_pfn;
+	job.size = zone_end_pfn(zone) - first_init_pfn;
+	job.align = PAGES_PER_SECTION;
+	job.min_chunk = PAGES_PER_SECTION;
+	job.max_threads = max_t(int, cpumask_weight(cpumask), 1);
+
+	padata_do_multithreaded(&job);
 
 	/* Sanity check that the next zone really is unpopulated */
 	WARN_ON(++zid < MAX_NR_ZONES && populated_zone(++zone));
 
-	pr_info("node %d initialised, %lu pages in %ums\n", nid, nr_pages,
-					jiffies_to_msecs(jiffies - start));
+	pr_info("node %d initialised, %lu pages in %ums\n", nid,
+		atomic_long_read(&args.nr_pages),
+		jiffies_to_msecs(jiffies - start));
 
 	pgdat_init_report_one_done();
 	return 0;
@@ -1882,10 +1963,8 @@ void drain_zone_pages(struct zone *zone, struct per_cpu_pages *pcp)
 	local_irq_save(flags);
 	batch = READ_ONCE(pcp->batch);
 	to_drain = min(pcp->count, batch);
-	if (to_drain > 0) {
+	if (to_drain > 0)
 		free_pcppages_bulk(zone, to_drain, pcp);
-		pcp->count -= to_drain;
-	}
 	local_irq_restore(flags);
 }
 #endif
@@ -1907,10 +1986,8 @@ static void drain_pages_zone(unsigned int cpu, struct zone *zone)
 	pset = per_cpu_ptr(zone->pageset, cpu);
 
 	pcp = &pset->pcp;
-	if (pcp->count) {
+	if (pcp->count)
 		free_pcppages_bulk(zone, pcp->count, pcp);
-		pcp->count = 0;
-	}
 	local_irq_restore(flags);
 }
 
@@ -2037,25 +2114,33 @@ void mark_free_pages(struct zone *zone)
 }
 #endif /* CONFIG_PM */
 
+static bool free_hot_cold_page_prepare(struct page *page, unsigned long pfn,
+				       unsigned int order)
+{
+	int migratetype;
+
+	if (!free_pages_prepare(page, order))
+		return false;
+
+	migratetype = get_pfnblock_migratetype(page, pfn);
+	set_pcppage_migratetype(page, migratetype);
+	return true;
+}
+
 /*
- * Free a 0-order page
- * cold == true ? free a cold page : free a hot page
+ * Put a prepared page of at most PAGE_ALLOC_COSTLY_ORDER on the per-cpu
+ * lists. Must be called with interrupts disabled.
  */
-void free_hot_cold_page(struct page *page, bool cold)
+static void free_hot_cold_page_commit(struct page *page, unsigned long pfn,
+				      unsigned int order, bool cold)
 {
 	struct zone *zone = page_zone(page);
 	struct per_cpu_pages *pcp;
-	unsigned long flags;
-	unsigned long pfn = page_to_pfn(page);
+	struct list_head *list;
 	int migratetype;
 
-	if (!free_pages_prepare(page, 0))
-		return;
-
-	migratetype = get_pfnblock_migratetype(page, pfn);
-	set_pcppage_migratetype(page, migratetype);
-	local_irq_save(flags);
-	__count_vm_event(PGFREE);
+	migratetype = get_pcppage_migratetype(page);
+	__count_vm_events(PGFREE, 1 << order);
 
 	/*
 	 * We only track unmovable, reclaimable and movable on pcp lists.
@@ -2066,41 +2151,105 @@ void free_hot_cold_page(struct page *page, bool cold)
 	 */
 	if (migratetype >= MIGRATE_PCPTYPES) {
 		if (unlikely(is_migrate_isolate(migratetype))) {
-			free_one_page(zone, page, pfn, 0, migratetype);
-			goto out;
+			free_one_page(zone, page, pfn, order, migratetype);
+			return;
 		}
 		migratetype = MIGRATE_MOVABLE;
 	}
 
 	pcp = &this_cpu_ptr(zone->pageset)->pcp;
+	list = &pcp->lists[order_to_pindex(migratetype, order)];
 	if (!cold)
-		list_add(&page->lru, &pcp->lists[migratetype]);
+		list_add(&page->lru, list);
 	else
-		list_add_tail(&page->lru, &pcp->lists[migratetype]);
-	pcp->count++;
+		list_add_tail(&page->lru, list);
+	pcp->count += 1 << order;
 	if (pcp->count >= pcp->high) {
 		unsigned long batch = READ_ONCE(pcp->batch);
 		free_pcppages_bulk(zone, batch, pcp);
-		pcp->count -= batch;
 	}
+}
 
-out:
+static void __free_hot_cold_page(struct page *page, unsigned int order,
+				 bool cold)
+{
+	unsigned long flags;
+	unsigned long pfn = page_to_pfn(page);
+
+	if (!free_hot_cold_page_prepare(page, pfn, order))
+		return;
+
+	local_irq_save(flags);
+	free_hot_cold_page_commit(page, pfn, order, cold);
 	local_irq_restore(flags);
 }
 
+/*
+ * Free a 0-order page
+ * cold == true ? free a cold page : free a hot page
+ */
+void free_hot_cold_page(struct page *page, bool cold)
+{
+	__free_hot_cold_page(page, 0, cold);
+}
+
+/*
+ * Free a page whose last reference was dropped, through the per-cpu
+ * lists when the order is small enough to be cached there.
+ */
+static void free_the_page(struct page *page, unsigned int order)
+{
+	if (pcp_allowed_order(order))
+		__free_hot_cold_page(page, order, false);
+	else
+		__free_pages_ok(page, order);
+}
+
 /*
  * Free a list of 0-order pages
  */
 void free_hot_cold_page_list(struct list_head *list, bool cold)
 {
 	struct page *page, *next;
+	unsigned long flags;
 
+	list_for_each_entry_safe(page, next, list, lru) {
+		if (!free_hot_cold_page_prepare(page, page_to_pfn(page), 0))
+			list_del(&page->lru);
+	}
+
+	local_irq_save(flags);
 	list_for_each_entry_safe(page, next, list, lru) {
 		trace_mm_page_free_batched(page, cold);
-		free_hot_cold_page(page, cold);
+		free_hot_cold_page_commit(page, page_to_pfn(page), 0, cold);
 	}
+	local_irq_restore(flags);
 }
 
+/*
+ * Drop a reference on each of @nr_pages 0-order pages and free the ones
+ * that were the last user to the per-cpu lists in a single irq-disabled
+ * section. The counterpart of alloc_pages_bulk_array().
+ */
+void free_pages_bulk(struct page **page_array, unsigned long nr_pages)
+{
+	LIST_HEAD(list);
+	unsigned long i;
+
+	for (i = 0; i < nr_pages; i++) {
+		struct page *page = page_array[i];
+
+		if (!page)
+			continue;
+		VM_BUG_ON_PAGE(PageCompound(page), page);
+		if (put_page_testzero(page))
+			list_add(&page->lru, &list);
+	}
+
+	free_hot_cold_page_list(&list, false);
+}
+EXPORT_SYMBOL(free_pages_bulk);
+
 /*
  * split_page takes a non-compound higher-order page, and splits it into
  * n (1<<order) sub-pages: page[0..n]
@@ -2205,7 +2354,9 @@ int split_free_page(struct page *page)
 }
 
 /*
- * Allocate a page from the given zone. Use pcplists for order-0 allocations.
+ * Allocate a page from the given zone. Use pcplists for allocations up to
+ * PAGE_ALLOC_COSTLY_ORDER, except for the high-order atomic allocations
+ * that may have to dip into the MIGRATE_HIGHATOMIC reserve.
  */
 static inline
 struct page *buffered_rmqueue(struct zone *preferred_zone,
@@ -2216,17 +2367,42 @@ struct page *buffered_rmqueue(struct zone *preferred_zone,
 	struct page *page;
 	bool cold = ((gfp_flags & __GFP_COLD) != 0);
 
-	if (likely(order == 0)) {
+	if (unlikely(order && (gfp_flags & __GFP_NOFAIL))) {
+		/*
+		 * __GFP_NOFAIL is not to be used in new code.
+		 *
+		 * All __GFP_NOFAIL callers should be fixed so that they
+		 * properly detect and handle allocation failures.
+		 *
+		 * We most definitely don't want callers attempting to
+		 * allocate greater than order-1 page units with
+		 * __GFP_NOFAIL.
+		 */
+		WARN_ON_ONCE(order > 1);
+	}
+
+	if (likely(order == 0 || (pcp_allowed_order(order) &&
+				  !(alloc_flags & ALLOC_HARDER)))) {
 		struct per_cpu_pages *pcp;
 		struct list_head *list;
 
 		local_irq_save(flags);
 		pcp = &this_cpu_ptr(zone->pageset)->pcp;
-		list = &pcp->lists[migratetype];
+		list = &pcp->lists[order_to_pindex(migratetype, order)];
 		if (list_empty(list)) {
-			pcp->count += rmqueue_bulk(zone, 0,
-					pcp->batch, list,
-					migratetype, cold);
+			int batch = READ_ONCE(pcp->batch);
+
+			/*
+			 * Scale the refill by the order so a batch of
+			 * high-order pages doesn't pin much more memory than
+			 * a batch of base pages, but keep at least two so the
+			 * next allocation of the same order hits the list.
+			 */
+			if (order)
+				batch = max(batch >> order, 2);
+			pcp->count += rmqueue_bulk(zone, order,
+					batch, list,
+					migratetype, cold) << order;
 			if (unlikely(list_empty(list)))
 				goto failed;
 		}
@@ -2237,21 +2413,8 @@ struct page *buffered_rmqueue(struct zone *preferred_zone,
 			page = list_entry(list->next, struct page, lru);
 
 		list_del(&page->lru);
-		pcp->count--;
+		pcp->count -= 1 << order;
 	} else {
-		if (unlikely(gfp_flags & __GFP_NOFAIL)) {
-			/*
-			 * __GFP_NOFAIL is not to be used in new code.
-			 *
-			 * All __GFP_NOFAIL callers should be fixed so that they
-			 * properly detect and handle allocation failures.
-			 *
-			 * We most definitely don't want callers attempting to
-			 * allocate greater than order-1 page units with
-			 * __GFP_NOFAIL.
-			 */
-			WARN_ON_ONCE(order > 1);
-		}
 		spin_lock_irqsave(&zone->lock, flags);
 
 		page = NULL;
@@ -3274,6 +3437,175 @@ out:
 }
 EXPORT_SYMBOL(__alloc_pages_nodemask);
 
+/*
+ * __alloc_pages_bulk - Allocate a number of 0-order pages
+ * @gfp_mask: GFP flags for the allocation
+ * @zonelist: zonelist to allocate from
+ * @nodemask: Set of nodes to allocate from, may be NULL
+ * @nr_pages: The number of pages desired on the list or array
+ * @page_list: Optional list to store the allocated pages
+ * @page_array: Optional array to store the pages
+ *
+ * This is a batched version of the page allocator that attempts to
+ * allocate nr_pages quickly from the per-cpu lists of the preferred zone,
+ * refilling them from the buddy lists as needed, all within a single
+ * irq-disabled section. Pages are added to page_list if page_list is not
+ * NULL, otherwise the NULL entries of page_array are populated.
+ *
+ * No watermark boosting, reclaim or compaction is attempted for the batch:
+ * if the first suitable zone cannot satisfy the request from above its low
+ * watermark, a single page is allocated through the regular allocator so
+ * that callers still make forward progress.
+ *
+ * For lists, nr_pages is the number of pages that should be allocated.
+ *
+ * For arrays, only NULL elements are populated with pages and nr_pages
+ * is the maximum number of pages that will be stored in the array.
+ *
+ * Returns the number of pages on the list or array.
+ */
+unsigned long __alloc_pages_bulk(gfp_t gfp_mask, struct zonelist *zonelist,
+			nodemask_t *nodemask, unsigned long nr_pages,
+			struct list_head *page_list, struct page **page_array)
+{
+	struct zoneref *z;
+	struct zone *zone, *preferred_zone;
+	struct per_cpu_pages *pcp;
+	struct list_head *pcp_list;
+	struct page *page;
+	unsigned long flags;
+	unsigned long nr_populated = 0, nr_account = 0;
+	int alloc_flags = ALLOC_WMARK_LOW|ALLOC_CPUSET;
+	int migratetype = gfpflags_to_migratetype(gfp_mask);
+	enum zone_type high_zoneidx = gfp_zone(gfp_mask);
+	bool cold = ((gfp_mask & __GFP_COLD) != 0);
+	int classzone_idx;
+
+	/*
+	 * Skip populated array elements to determine if any pages need
+	 * to be allocated before disabling IRQs.
+	 */
+	while (page_array && nr_populated < nr_pages && page_array[nr_populated])
+		nr_populated++;
+
+	/* Already populated array? */
+	if (unlikely(page_array && nr_pages - nr_populated == 0))
+		return nr_populated;
+
+	/* Use the single page allocator for one page. */
+	if (nr_pages - nr_populated == 1)
+		goto failed;
+
+	/* kmemcheck allocates shadow pages, which cannot be done with IRQs off */
+	if (kmemcheck_enabled)
+		goto failed;
+
+	gfp_mask &= gfp_allowed_mask;
+	if (should_fail_alloc_page(gfp_mask, 0))
+		goto failed;
+
+	if (unlikely(!zonelist->_zonerefs->zone))
+		goto failed;
+
+	if (IS_ENABLED(CONFIG_CMA) && migratetype == MIGRATE_MOVABLE)
+		alloc_flags |= ALLOC_CMA;
+
+	z = first_zones_zonelist(zonelist, high_zoneidx,
+				 nodemask ? : &cpuset_current_mems_allowed,
+				 &preferred_zone);
+	if (!preferred_zone)
+		goto failed;
+	classzone_idx = zonelist_zone_idx(z);
+
+	/* Find an allowed zone that can take the whole batch */
+	for_each_zone_zonelist_nodemask(zone, z, zonelist, high_zoneidx,
+					nodemask) {
+		unsigned long mark;
+
+		if (cpusets_enabled() &&
+		    !cpuset_zone_allowed(zone, gfp_mask | __GFP_HARDWALL))
+			continue;
+
+		mark = low_wmark_pages(zone) + nr_pages;
+		if (zone_watermark_ok(zone, 0, mark, classzone_idx,
+				      alloc_flags))
+			break;
+	}
+
+	/*
+	 * If there are no allowed zones with enough free memory, leave it
+	 * to the slow path of the single page allocator.
+	 */
+	if (unlikely(!zone))
+		goto failed;
+
+	/* Attempt the batch allocation */
+	local_irq_save(flags);
+	pcp = &this_cpu_ptr(zone->pageset)->pcp;
+	pcp_list = &pcp->lists[order_to_pindex(migratetype, 0)];
+
+	while (nr_populated < nr_pages) {
+
+		/* Skip existing pages */
+		if (page_array && page_array[nr_populated]) {
+			nr_populated++;
+			continue;
+		}
+
+		if (list_empty(pcp_list)) {
+			pcp->count += rmqueue_bulk(zone, 0, pcp->batch,
+						   pcp_list, migratetype, cold);
+			if (unlikely(list_empty(pcp_list)))
+				break;
+		}
+
+		if (cold)
+			page = list_entry(pcp_list->prev, struct page, lru);
+		else
+			page = list_entry(pcp_list->next, struct page, lru);
+		list_del(&page->lru);
+		pcp->count--;
+
+		nr_account++;
+		zone_statistics(preferred_zone, zone, gfp_mask);
+
+		/* A bad page is leaked, just as get_page_from_freelist does */
+		if (unlikely(prep_new_page(page, 0, gfp_mask, 0)))
+			continue;
+
+		trace_mm_page_alloc(page, 0, gfp_mask, migratetype);
+
+		if (page_list)
+			list_add(&page->lru, page_list);
+		else
+			page_array[nr_populated] = page;
+		nr_populated++;
+	}
+
+	__mod_zone_page_state(zone, NR_ALLOC_BATCH, -nr_account);
+	if (atomic_long_read(&zone->vm_stat[NR_ALLOC_BATCH]) <= 0 &&
+	    !test_bit(ZONE_FAIR_DEPLETED, &zone->flags))
+		set_bit(ZONE_FAIR_DEPLETED, &zone->flags);
+	__count_zone_vm_events(PGALLOC, zone, nr_account);
+	local_irq_restore(flags);
+
+	if (nr_account)
+		return nr_populated;
+
+failed:
+	page = __alloc_pages_nodemask(gfp_mask, 0, zonelist, nodemask);
+	if (page) {
+		if (page_list)
+			list_add(&page->lru, page_list);
+		else
+			page_array[nr_populated] = page;
+		nr_populated++;
+	}
+
+	return nr_populated;
+}
+EXPORT_SYMBOL_GPL(__alloc_pages_bulk);
+
 /*
  * Common helper functions.
  */
@@ -3302,12 +3634,8 @@ EXPORT_SYMBOL(get_zeroed_page);
 
 void __free_pages(struct page *page, unsigned int order)
 {
-	if (put_page_testzero(page)) {
-		if (order == 0)
-			free_hot_cold_page(page, false);
-		else
-			__free_pages_ok(page, order);
-	}
+	if (put_page_testzero(page))
+		free_the_page(page, order);
 }
 
 EXPORT_SYMBOL(__free_pages);
@@ -3416,7 +3744,7 @@ void __free_page_frag(void *addr)
 	struct page *page = virt_to_head_page(addr);
 
 	if (unlikely(put_page_testzero(page)))
-		__free_pages_ok(page, compound_order(page));
+		free_the_page(page, compound_order(page));
 }
 EXPORT_SYMBOL(__free_page_frag);
 
@@ -4637,14 +4965,14 @@ static void pageset_set_batch(struct per_cpu_pageset *p, unsigned long batch)
 static void pageset_init(struct per_cpu_pageset *p)
 {
 	struct per_cpu_pages *pcp;
-	int migratetype;
+	int pindex;
 
 	memset(p, 0, sizeof(*p));
 
 	pcp = &p->pcp;
 	pcp->count = 0;
-	for (migratetype = 0; migratetype < MIGRATE_PCPTYPES; migratetype++)
-		INIT_LIST_HEAD(&pcp->lists[migratetype]);
+	for (pindex = 0; pindex < NR_PCP_LISTS; pindex++)
+		INIT_LIST_HEAD(&pcp->lists[pindex]);
 }
 
 static void setup_pageset(struct per_cpu_pageset *p, unsigned long batch)
@@ -5208,6 +5536,9 @@ static void __paginginit free_area_init_core(struct pglist_data *pgdat)
 #endif
 	init_waitqueue_head(&pgdat->kswapd_wait);
 	init_waitqueue_head(&pgdat->pfmemalloc_wait);
+#ifdef CONFIG_COMPACTION
+	init_waitqueue_head(&pgdat->kcompactd_wait);
+#endif
 	pgdat_page_ext_init(pgdat);
 
 	for (j = 0; j < MAX_NR_ZONES; j++) {
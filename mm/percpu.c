@@ -30,16 +30,19 @@
  * There are usually many small percpu allocations many of them being
  * as small as 4 bytes.  The allocator organizes chunks into lists
  * according to free size and tries to allocate from the fullest one.
- * Each chunk keeps the maximum contiguous area size hint which is
- * guaranteed to be equal to or larger than the maximum contiguous
- * area in the chunk.  This helps the allocator not to iterate the
- * chunk maps unnecessarily.
- *
- * Allocation state in each chunk is kept using an array of integers
- * on chunk->map.  A positive value in the map represents a free
- * region and negative allocated.  Allocation inside a chunk is done
- * by scanning this map sequentially and serving the first matching
- * entry.  This is mostly copied from the percpu_modalloc() allocator.
+ * Each chunk keeps the size of its largest contiguous free area, so
+ * chunks which can't serve a request are skipped without looking at
+ * their maps.
+ *
+ * Allocation state in each chunk is kept in a bitmap, one bit per
+ * PCPU_MIN_ALLOC_SIZE bytes, on chunk->alloc_map.  A second bitmap,
+ * chunk->bound_map, marks where each allocation starts and ends so that
+ * a free can find the size of the area.  The bitmap is split into
+ * page sized blocks which each keep a hint of their largest free area,
+ * the free areas along their edges and their first free bit.  An
+ * allocation walks the block hints and only searches the bitmap of the
+ * blocks which are known to fit it; a free only rescans the blocks it
+ * touches.
  * Chunks can be determined from the address using the index field
  * in the page struct. The index field contains a pointer to the chunk.
  *
@@ -75,9 +78,9 @@
 #include <asm/io.h>
 
 #define PCPU_SLOT_BASE_SHIFT		5	/* 1-31 shares the same slot */
-#define PCPU_DFL_MAP_ALLOC		16	/* start a map with 16 ents */
-#define PCPU_ATOMIC_MAP_MARGIN_LOW	32
-#define PCPU_ATOMIC_MAP_MARGIN_HIGH	64
+#define PCPU_MIN_ALLOC_SHIFT		2	/* one map bit per 4 bytes */
+#define PCPU_MIN_ALLOC_SIZE		(1 << PCPU_MIN_ALLOC_SHIFT)
+#define PCPU_BITMAP_BLOCK_BITS		(PAGE_SIZE >> PCPU_MIN_ALLOC_SHIFT)
 #define PCPU_EMPTY_POP_PAGES_LOW	2
 #define PCPU_EMPTY_POP_PAGES_HIGH	4
 
@@ -101,19 +104,31 @@
 #define __pcpu_ptr_to_addr(ptr)		(void __force *)(ptr)
 #endif	/* CONFIG_SMP */
 
+/*
+ * Allocation metadata of a page worth of a chunk's allocation map.  All
+ * offsets and sizes are in bits, relative to the start of the block.
+ */
+struct pcpu_block_md {
+	int			contig_hint;	/* largest free area */
+	int			contig_hint_start; /* where it starts */
+	int			left_free;	/* free bits at the start */
+	int			right_free;	/* free bits at the end */
+	int			first_free;	/* first free bit */
+};
+
 struct pcpu_chunk {
 	struct list_head	list;		/* linked to pcpu_slot lists */
-	int			free_size;	/* free bytes in the chunk */
-	int			contig_hint;	/* max contiguous size hint */
+	int			free_bytes;	/* free bytes in the chunk */
+	int			contig_bits;	/* max contiguous free bits */
+	int			contig_bits_start; /* where they start */
 	void			*base_addr;	/* base address of this chunk */
 
-	int			map_used;	/* # of map entries used before the sentry */
-	int			map_alloc;	/* # of map entries allocated */
-	int			*map;		/* allocation map */
-	struct work_struct	map_extend_work;/* async ->map[] extension */
+	unsigned long		*alloc_map;	/* allocation map */
+	unsigned long		*bound_map;	/* area boundary map */
+	struct pcpu_block_md	*md_blocks;	/* per page block metadata */
 
 	void			*data;		/* chunk data */
-	int			first_free;	/* no free below this */
+	int			first_bit;	/* no free below this */
 	bool			immutable;	/* no [de]population allowed */
 	int			nr_populated;	/* # of populated pages */
 	unsigned long		populated[];	/* populated bitmap */
@@ -124,6 +139,7 @@ static int pcpu_unit_size __read_mostly;
 static int pcpu_nr_units __read_mostly;
 static int pcpu_atom_size __read_mostly;
 static int pcpu_nr_slots __read_mostly;
+static int pcpu_chunk_map_bits __read_mostly;	/* bits in alloc_map */
 static size_t pcpu_chunk_struct_size __read_mostly;
 
 /* cpus with the lowest and highest unit addresses */
@@ -217,10 +233,10 @@ static int pcpu_size_to_slot(int size)
 
 static int pcpu_chunk_slot(const struct pcpu_chunk *chunk)
 {
-	if (chunk->free_size < sizeof(int) || chunk->contig_hint < sizeof(int))
+	if (chunk->free_bytes < PCPU_MIN_ALLOC_SIZE || !chunk->contig_bits)
 		return 0;
 
-	return pcpu_size_to_slot(chunk->free_size);
+	return pcpu_size_to_slot(chunk->free_bytes);
 }
 
 /* set the pointer to a chunk in a page struct */
@@ -317,36 +333,32 @@ static void pcpu_mem_free(void *ptr, size_t size)
 		vfree(ptr);
 }
 
-/**
- * pcpu_count_occupied_pages - count the number of pages an area occupies
- * @chunk: chunk of interest
- * @i: index of the area in question
- *
- * Count the number of pages chunk's @i'th area occupies.  When the area's
- * start and/or end address isn't aligned to page boundary, the straddled
- * page is included in the count iff the rest of the page is free.
+/*
+ * Helpers to move between a bit offset in a chunk's allocation map and
+ * the metadata block covering it.  Blocks are PCPU_BITMAP_BLOCK_BITS
+ * wide, which is a multiple of BITS_PER_LONG, so each one starts on a
+ * word of the map.
  */
-static int pcpu_count_occupied_pages(struct pcpu_chunk *chunk, int i)
+static int pcpu_off_to_block_index(int off)
 {
-	int off = chunk->map[i] & ~1;
-	int end = chunk->map[i + 1] & ~1;
-
-	if (!PAGE_ALIGNED(off) && i > 0) {
-		int prev = chunk->map[i - 1];
-
-		if (!(prev & 1) && prev <= round_down(off, PAGE_SIZE))
-			off = round_down(off, PAGE_SIZE);
-	}
+	return off / PCPU_BITMAP_BLOCK_BITS;
+}
 
-	if (!PAGE_ALIGNED(end) && i + 1 < chunk->map_used) {
-		int next = chunk->map[i + 1];
-		int nend = chunk->map[i + 2] & ~1;
+static int pcpu_off_to_block_off(int off)
+{
+	return off & (PCPU_BITMAP_BLOCK_BITS - 1);
+}
 
-		if (!(next & 1) && nend >= round_up(end, PAGE_SIZE))
-			end = round_up(end, PAGE_SIZE);
-	}
+static int pcpu_block_off_to_off(int index, int off)
+{
+	return index * PCPU_BITMAP_BLOCK_BITS + off;
+}
 
-	return max_t(int, PFN_DOWN(end) - PFN_UP(off), 0);
+static unsigned long *pcpu_index_alloc_map(struct pcpu_chunk *chunk,
+					   int index)
+{
+	return chunk->alloc_map +
+		(index * PCPU_BITMAP_BLOCK_BITS / BITS_PER_LONG);
 }
 
 /**
@@ -375,176 +387,375 @@ static void pcpu_chunk_relocate(struct pcpu_chunk *chunk, int oslot)
 }
 
 /**
- * pcpu_need_to_extend - determine whether chunk area map needs to be extended
+ * pcpu_update_empty_pages - account pages going from or to fully free
  * @chunk: chunk of interest
- * @is_atomic: the allocation context
+ * @index: index of the metadata block, ie. the page
+ * @nr: +1 if the page became free, -1 if it got its first allocation
  *
- * Determine whether area map of @chunk needs to be extended.  If
- * @is_atomic, only the amount necessary for a new allocation is
- * considered; however, async extension is scheduled if the left amount is
- * low.  If !@is_atomic, it aims for more empty space.  Combined, this
- * ensures that the map is likely to have enough available space to
- * accomodate atomic allocations which can't extend maps directly.
+ * pcpu_nr_empty_pop_pages counts the populated pages of the normal
+ * chunks which hold no allocation.  Unpopulated pages are accounted
+ * when they get populated.
  *
  * CONTEXT:
  * pcpu_lock.
+ */
+static void pcpu_update_empty_pages(struct pcpu_chunk *chunk, int index,
+				    int nr)
+{
+	if (chunk != pcpu_reserved_chunk && test_bit(index, chunk->populated))
+		pcpu_nr_empty_pop_pages += nr;
+}
+
+/**
+ * pcpu_block_refresh_hint - rebuild the metadata of a block
+ * @chunk: chunk of interest
+ * @index: index of the metadata block
  *
- * RETURNS:
- * New target map allocation length if extension is necessary, 0
- * otherwise.
+ * Scan the block's part of the allocation map and recompute its largest
+ * free area, the free areas along both edges and its first free bit.  A
+ * block is a page worth of bits, so this is bounded no matter how large
+ * or fragmented the chunk is.
  */
-static int pcpu_need_to_extend(struct pcpu_chunk *chunk, bool is_atomic)
+static void pcpu_block_refresh_hint(struct pcpu_chunk *chunk, int index)
 {
-	int margin, new_alloc;
+	struct pcpu_block_md *block = chunk->md_blocks + index;
+	unsigned long *alloc_map = pcpu_index_alloc_map(chunk, index);
+	int rs, re;	/* region start, region end */
+
+	block->contig_hint = 0;
+	block->left_free = 0;
+	block->right_free = 0;
+	block->first_free = find_first_zero_bit(alloc_map,
+						PCPU_BITMAP_BLOCK_BITS);
+
+	for (rs = block->first_free; rs < PCPU_BITMAP_BLOCK_BITS;
+	     rs = find_next_zero_bit(alloc_map, PCPU_BITMAP_BLOCK_BITS, re)) {
+		re = find_next_bit(alloc_map, PCPU_BITMAP_BLOCK_BITS, rs);
+
+		if (!rs)
+			block->left_free = re;
+		if (re == PCPU_BITMAP_BLOCK_BITS)
+			block->right_free = re - rs;
+		if (re - rs > block->contig_hint) {
+			block->contig_hint = re - rs;
+			block->contig_hint_start = rs;
+		}
+	}
+}
 
-	if (is_atomic) {
-		margin = 3;
+/* mark a metadata block fully free */
+static void pcpu_init_md_block(struct pcpu_block_md *block)
+{
+	block->contig_hint = PCPU_BITMAP_BLOCK_BITS;
+	block->contig_hint_start = 0;
+	block->left_free = PCPU_BITMAP_BLOCK_BITS;
+	block->right_free = PCPU_BITMAP_BLOCK_BITS;
+	block->first_free = 0;
+}
 
-		if (chunk->map_alloc <
-		    chunk->map_used + PCPU_ATOMIC_MAP_MARGIN_LOW &&
-		    pcpu_async_enabled)
-			schedule_work(&chunk->map_extend_work);
-	} else {
-		margin = PCPU_ATOMIC_MAP_MARGIN_HIGH;
+/*
+ * Record a free area of @bits at @bit_off as the chunk's largest one if
+ * it is larger than the current hint.
+ */
+static void pcpu_chunk_update(struct pcpu_chunk *chunk, int bit_off, int bits)
+{
+	if (bits > chunk->contig_bits) {
+		chunk->contig_bits = bits;
+		chunk->contig_bits_start = bit_off;
 	}
+}
 
-	if (chunk->map_alloc >= chunk->map_used + margin)
-		return 0;
+/**
+ * pcpu_chunk_refresh_hint - recompute the largest free area of a chunk
+ * @chunk: chunk of interest
+ *
+ * Free areas either lie within a block or are made of the right edge of
+ * a block, any number of fully free blocks and the left edge of the
+ * next one.  The block metadata has all of these, so the allocation map
+ * itself isn't touched.
+ */
+static void pcpu_chunk_refresh_hint(struct pcpu_chunk *chunk)
+{
+	struct pcpu_block_md *block;
+	int i, run = 0, run_start = 0;
+
+	chunk->contig_bits = 0;
+
+	for (i = 0, block = chunk->md_blocks; i < pcpu_unit_pages;
+	     i++, block++) {
+		int hint_start;
+
+		if (!run)
+			run_start = pcpu_block_off_to_off(i, 0);
+		run += block->left_free;
+		if (block->left_free == PCPU_BITMAP_BLOCK_BITS)
+			continue;
 
-	new_alloc = PCPU_DFL_MAP_ALLOC;
-	while (new_alloc < chunk->map_used + margin)
-		new_alloc *= 2;
+		hint_start = pcpu_block_off_to_off(i, block->contig_hint_start);
+		pcpu_chunk_update(chunk, run_start, run);
+		pcpu_chunk_update(chunk, hint_start, block->contig_hint);
 
-	return new_alloc;
+		run = block->right_free;
+		run_start = pcpu_block_off_to_off(i, PCPU_BITMAP_BLOCK_BITS -
+						  block->right_free);
+	}
+
+	pcpu_chunk_update(chunk, run_start, run);
 }
 
 /**
- * pcpu_extend_area_map - extend area map of a chunk
+ * pcpu_block_update_hint_alloc - update hints after an allocation
  * @chunk: chunk of interest
- * @new_alloc: new target allocation length of the area map
- *
- * Extend area map of @chunk to have @new_alloc entries.
+ * @bit_off: start of the allocated area
+ * @bits: size of the allocated area
  *
- * CONTEXT:
- * Does GFP_KERNEL allocation.  Grabs and releases pcpu_lock.
- *
- * RETURNS:
- * 0 on success, -errno on failure.
+ * The blocks at both ends of the area are rescanned and the ones in
+ * between are full.  The chunk-wide hint only needs to be recomputed if
+ * the allocation was carved out of the area it describes.
  */
-static int pcpu_extend_area_map(struct pcpu_chunk *chunk, int new_alloc)
+static void pcpu_block_update_hint_alloc(struct pcpu_chunk *chunk,
+					 int bit_off, int bits)
 {
-	int *old = NULL, *new = NULL;
-	size_t old_size = 0, new_size = new_alloc * sizeof(new[0]);
-	unsigned long flags;
+	int s_index = pcpu_off_to_block_index(bit_off);
+	int e_index = pcpu_off_to_block_index(bit_off + bits - 1);
+	struct pcpu_block_md *block;
+	int i;
 
-	new = pcpu_mem_zalloc(new_size);
-	if (!new)
-		return -ENOMEM;
+	for (i = s_index; i <= e_index; i++) {
+		block = chunk->md_blocks + i;
 
-	/* acquire pcpu_lock and switch to new area map */
-	spin_lock_irqsave(&pcpu_lock, flags);
+		if (block->contig_hint == PCPU_BITMAP_BLOCK_BITS)
+			pcpu_update_empty_pages(chunk, i, -1);
 
-	if (new_alloc <= chunk->map_alloc)
-		goto out_unlock;
+		if (i == s_index || i == e_index) {
+			pcpu_block_refresh_hint(chunk, i);
+		} else {
+			block->contig_hint = 0;
+			block->left_free = 0;
+			block->right_free = 0;
+			block->first_free = PCPU_BITMAP_BLOCK_BITS;
+		}
+	}
 
-	old_size = chunk->map_alloc * sizeof(chunk->map[0]);
-	old = chunk->map;
+	if (bit_off < chunk->contig_bits_start + chunk->contig_bits &&
+	    bit_off + bits > chunk->contig_bits_start)
+		pcpu_chunk_refresh_hint(chunk);
+}
 
-	memcpy(new, old, old_size);
+/**
+ * pcpu_block_update_hint_free - update hints after a free
+ * @chunk: chunk of interest
+ * @bit_off: start of the freed area
+ * @bits: size of the freed area
+ *
+ * The blocks at both ends of the area are rescanned and the ones in
+ * between are free.  If the resulting free area stays inside a single
+ * block, it is compared against the chunk-wide hint directly; only an
+ * area reaching a block edge can merge with the neighbours and requires
+ * walking the block metadata of the chunk.
+ */
+static void pcpu_block_update_hint_free(struct pcpu_chunk *chunk,
+					int bit_off, int bits)
+{
+	int s_index = pcpu_off_to_block_index(bit_off);
+	int e_index = pcpu_off_to_block_index(bit_off + bits - 1);
+	struct pcpu_block_md *block;
+	int i, start, end;
 
-	chunk->map_alloc = new_alloc;
-	chunk->map = new;
-	new = NULL;
+	for (i = s_index; i <= e_index; i++) {
+		block = chunk->md_blocks + i;
 
-out_unlock:
-	spin_unlock_irqrestore(&pcpu_lock, flags);
+		if (i == s_index || i == e_index)
+			pcpu_block_refresh_hint(chunk, i);
+		else
+			pcpu_init_md_block(block);
 
-	/*
-	 * pcpu_mem_free() might end up calling vfree() which uses
-	 * IRQ-unsafe lock and thus can't be called under pcpu_lock.
-	 */
-	pcpu_mem_free(old, old_size);
-	pcpu_mem_free(new, new_size);
+		if (block->contig_hint == PCPU_BITMAP_BLOCK_BITS)
+			pcpu_update_empty_pages(chunk, i, 1);
+	}
 
-	return 0;
+	if (s_index != e_index) {
+		pcpu_chunk_refresh_hint(chunk);
+		return;
+	}
+
+	/* find the edges of the free area @bit_off now is part of */
+	start = pcpu_off_to_block_off(bit_off);
+	end = start + bits;
+	i = find_last_bit(pcpu_index_alloc_map(chunk, s_index), start);
+	start = i < start ? i + 1 : 0;
+	end = find_next_bit(pcpu_index_alloc_map(chunk, s_index),
+			    PCPU_BITMAP_BLOCK_BITS, end);
+
+	if (!start || end == PCPU_BITMAP_BLOCK_BITS)
+		pcpu_chunk_refresh_hint(chunk);
+	else
+		pcpu_chunk_update(chunk, pcpu_block_off_to_off(s_index, start),
+				  end - start);
 }
 
-static void pcpu_map_extend_workfn(struct work_struct *work)
+/**
+ * pcpu_is_populated - determine if an area has been populated
+ * @chunk: chunk of interest
+ * @bit_off: start of the area
+ * @bits: size of the area
+ * @next_off: return value for the offset to resume the search from
+ *
+ * RETURNS:
+ * %true if all the pages backing the area are populated.  Otherwise
+ * %false, with @next_off set past the first unpopulated region.
+ */
+static bool pcpu_is_populated(struct pcpu_chunk *chunk, int bit_off, int bits,
+			      int *next_off)
 {
-	struct pcpu_chunk *chunk = container_of(work, struct pcpu_chunk,
-						map_extend_work);
-	int new_alloc;
+	int page_start, page_end, rs, re;
 
-	spin_lock_irq(&pcpu_lock);
-	new_alloc = pcpu_need_to_extend(chunk, false);
-	spin_unlock_irq(&pcpu_lock);
+	page_start = PFN_DOWN(bit_off * PCPU_MIN_ALLOC_SIZE);
+	page_end = PFN_UP((bit_off + bits) * PCPU_MIN_ALLOC_SIZE);
+
+	rs = page_start;
+	pcpu_next_unpop(chunk, &rs, &re, page_end);
+	if (rs >= page_end)
+		return true;
 
-	if (new_alloc)
-		pcpu_extend_area_map(chunk, new_alloc);
+	*next_off = re * PAGE_SIZE / PCPU_MIN_ALLOC_SIZE;
+	return false;
+}
+
+/*
+ * Does a free area of @bits starting at @bit_off hold @alloc_bits at
+ * @align bits?
+ */
+static bool pcpu_region_fits(int bit_off, int bits, int alloc_bits, int align)
+{
+	return bits >= ALIGN(bit_off, align) - bit_off + alloc_bits;
 }
 
 /**
- * pcpu_fit_in_area - try to fit the requested allocation in a candidate area
- * @chunk: chunk the candidate area belongs to
- * @off: the offset to the start of the candidate area
- * @this_size: the size of the candidate area
- * @size: the size of the target allocation
- * @align: the alignment of the target allocation
- * @pop_only: only allocate from already populated region
- *
- * We're trying to allocate @size bytes aligned at @align.  @chunk's area
- * at @off sized @this_size is a candidate.  This function determines
- * whether the target allocation fits in the candidate area and returns the
- * number of bytes to pad after @off.  If the target area doesn't fit, -1
- * is returned.
- *
- * If @pop_only is %true, this function only considers the already
- * populated part of the candidate area.
+ * pcpu_next_fit_region - find the next free area that fits an allocation
+ * @chunk: chunk of interest
+ * @alloc_bits: size of the allocation
+ * @align: alignment of the allocation in bits
+ * @bit_off: in: where to start looking, out: start of the found area
+ * @bits: out: size of the found area
+ *
+ * A fit is either a run built from the right edge of a block, fully free
+ * blocks and the left edge of the following one, which the block
+ * metadata describes, or an area within a single block.  The bitmap of
+ * a block is only searched if its largest free area could hold the
+ * allocation.  The allocation fits at @bit_off aligned up to @align.  If
+ * nothing fits, @bit_off is set to the end of the chunk.
  */
-static int pcpu_fit_in_area(struct pcpu_chunk *chunk, int off, int this_size,
-			    int size, int align, bool pop_only)
+static void pcpu_next_fit_region(struct pcpu_chunk *chunk, int alloc_bits,
+				 int align, int *bit_off, int *bits)
 {
-	int cand_off = off;
+	int i = pcpu_off_to_block_index(*bit_off);
+	int block_off = pcpu_off_to_block_off(*bit_off);
+	struct pcpu_block_md *block;
+
+	*bits = 0;
+	for (block = chunk->md_blocks + i; i < pcpu_unit_pages; block++, i++) {
+		/* extend the run ending at the previous block, or start one */
+		if (!block_off) {
+			if (!*bits)
+				*bit_off = pcpu_block_off_to_off(i, 0);
+			*bits += block->left_free;
+			if (pcpu_region_fits(*bit_off, *bits, alloc_bits,
+					     align))
+				return;
+			if (block->left_free == PCPU_BITMAP_BLOCK_BITS)
+				continue;
+		}
 
-	while (true) {
-		int head = ALIGN(cand_off, align) - off;
-		int page_start, page_end, rs, re;
+		/*
+		 * The largest free area doesn't tell whether an aligned
+		 * allocation fits, nor whether a smaller area further down
+		 * does, so search the block for its lowest fit.
+		 */
+		if (block->contig_hint >= alloc_bits) {
+			unsigned long start;
+
+			start = bitmap_find_next_zero_area(
+					pcpu_index_alloc_map(chunk, i),
+					PCPU_BITMAP_BLOCK_BITS,
+					max(block->first_free, block_off),
+					alloc_bits, align - 1);
+			if (start + alloc_bits <= PCPU_BITMAP_BLOCK_BITS) {
+				*bit_off = pcpu_block_off_to_off(i, start);
+				*bits = alloc_bits;
+				return;
+			}
+		}
+		block_off = 0;
+
+		/* start a run at the right edge */
+		*bit_off = pcpu_block_off_to_off(i, PCPU_BITMAP_BLOCK_BITS -
+						 block->right_free);
+		*bits = block->right_free;
+	}
 
-		if (this_size < head + size)
-			return -1;
+	if (*bits && pcpu_region_fits(*bit_off, *bits, alloc_bits, align))
+		return;
 
-		if (!pop_only)
-			return head;
+	*bit_off = pcpu_chunk_map_bits;
+}
 
-		/*
-		 * If the first unpopulated page is beyond the end of the
-		 * allocation, the whole allocation is populated;
-		 * otherwise, retry from the end of the unpopulated area.
-		 */
-		page_start = PFN_DOWN(head + off);
-		page_end = PFN_UP(head + off + size);
-
-		rs = page_start;
-		pcpu_next_unpop(chunk, &rs, &re, PFN_UP(off + this_size));
-		if (rs >= page_end)
-			return head;
-		cand_off = re * PAGE_SIZE;
+/*
+ * Free area iterator.  Iterate over the areas of @chunk that may hold
+ * @alloc_bits at @align, from @bit_off on.  @bit_off and @bits should be
+ * integer variables and will be set to the start and size of each area.
+ */
+#define pcpu_for_each_fit_region(chunk, alloc_bits, align, bit_off, bits) \
+	for (pcpu_next_fit_region((chunk), (alloc_bits), (align),	  \
+				  &(bit_off), &(bits));			  \
+	     (bit_off) < pcpu_chunk_map_bits;				  \
+	     (bit_off) += (bits),					  \
+	     pcpu_next_fit_region((chunk), (alloc_bits), (align),	  \
+				  &(bit_off), &(bits)))
+
+/**
+ * pcpu_find_block_fit - find the offset to allocate from
+ * @chunk: chunk of interest
+ * @alloc_bits: size of the allocation
+ * @align: alignment of the allocation in bits
+ * @pop_only: only allocate from already populated pages
+ *
+ * Walk the areas which fit the allocation, lowest first, and return the
+ * first one that is populated if @pop_only.
+ *
+ * RETURNS:
+ * The bit offset of the allocation, -1 if @chunk can't serve it.
+ */
+static int pcpu_find_block_fit(struct pcpu_chunk *chunk, int alloc_bits,
+			       int align, bool pop_only)
+{
+	int bit_off, bits, next_off;
+
+	bit_off = chunk->first_bit;
+	pcpu_for_each_fit_region(chunk, alloc_bits, align, bit_off, bits) {
+		int off = ALIGN(bit_off, align);
+
+		if (!pop_only || pcpu_is_populated(chunk, off, alloc_bits,
+						   &next_off))
+			return off;
+
+		bit_off = next_off;
+		bits = 0;
 	}
+
+	return -1;
 }
 
 /**
  * pcpu_alloc_area - allocate area from a pcpu_chunk
  * @chunk: chunk of interest
- * @size: wanted size in bytes
- * @align: wanted align
+ * @alloc_bits: size of the allocation in allocation map bits
+ * @align: alignment of the allocation in bits
  * @pop_only: allocate only from the populated area
- * @occ_pages_p: out param for the number of pages the area occupies
- *
- * Try to allocate @size bytes area aligned at @align from @chunk.
- * Note that this function only allocates the offset.  It doesn't
- * populate or map the area.
  *
- * @chunk->map must have at least two free slots.
+ * Try to allocate @alloc_bits aligned at @align from @chunk.  Note that
+ * this function only allocates the offset.  It doesn't populate or map
+ * the area.
  *
  * CONTEXT:
  * pcpu_lock.
@@ -553,208 +764,131 @@ static int pcpu_fit_in_area(struct pcpu_chunk *chunk, int off, int this_size,
  * Allocated offset in @chunk on success, -1 if no matching area is
  * found.
  */
-static int pcpu_alloc_area(struct pcpu_chunk *chunk, int size, int align,
-			   bool pop_only, int *occ_pages_p)
+static int pcpu_alloc_area(struct pcpu_chunk *chunk, int alloc_bits,
+			   int align, bool pop_only)
 {
 	int oslot = pcpu_chunk_slot(chunk);
-	int max_contig = 0;
-	int i, off;
-	bool seen_free = false;
-	int *p;
+	int bit_off;
 
-	for (i = chunk->first_free, p = chunk->map + i; i < chunk->map_used; i++, p++) {
-		int head, tail;
-		int this_size;
+	bit_off = pcpu_find_block_fit(chunk, alloc_bits, align, pop_only);
+	if (bit_off < 0)
+		return -1;
 
-		off = *p;
-		if (off & 1)
-			continue;
+	bitmap_set(chunk->alloc_map, bit_off, alloc_bits);
 
-		this_size = (p[1] & ~1) - off;
+	/* the area is delimited by its own bit and the one past its end */
+	set_bit(bit_off, chunk->bound_map);
+	bitmap_clear(chunk->bound_map, bit_off + 1, alloc_bits - 1);
+	set_bit(bit_off + alloc_bits, chunk->bound_map);
 
-		head = pcpu_fit_in_area(chunk, off, this_size, size, align,
-					pop_only);
-		if (head < 0) {
-			if (!seen_free) {
-				chunk->first_free = i;
-				seen_free = true;
-			}
-			max_contig = max(this_size, max_contig);
-			continue;
-		}
+	chunk->free_bytes -= alloc_bits * PCPU_MIN_ALLOC_SIZE;
 
-		/*
-		 * If head is small or the previous block is free,
-		 * merge'em.  Note that 'small' is defined as smaller
-		 * than sizeof(int), which is very small but isn't too
-		 * uncommon for percpu allocations.
-		 */
-		if (head && (head < sizeof(int) || !(p[-1] & 1))) {
-			*p = off += head;
-			if (p[-1] & 1)
-				chunk->free_size -= head;
-			else
-				max_contig = max(*p - p[-1], max_contig);
-			this_size -= head;
-			head = 0;
-		}
+	if (bit_off == chunk->first_bit)
+		chunk->first_bit = find_next_zero_bit(chunk->alloc_map,
+						      pcpu_chunk_map_bits,
+						      bit_off + alloc_bits);
 
-		/* if tail is small, just keep it around */
-		tail = this_size - head - size;
-		if (tail < sizeof(int)) {
-			tail = 0;
-			size = this_size - head;
-		}
-
-		/* split if warranted */
-		if (head || tail) {
-			int nr_extra = !!head + !!tail;
-
-			/* insert new subblocks */
-			memmove(p + nr_extra + 1, p + 1,
-				sizeof(chunk->map[0]) * (chunk->map_used - i));
-			chunk->map_used += nr_extra;
-
-			if (head) {
-				if (!seen_free) {
-					chunk->first_free = i;
-					seen_free = true;
-				}
-				*++p = off += head;
-				++i;
-				max_contig = max(head, max_contig);
-			}
-			if (tail) {
-				p[1] = off + size;
-				max_contig = max(tail, max_contig);
-			}
-		}
-
-		if (!seen_free)
-			chunk->first_free = i + 1;
-
-		/* update hint and mark allocated */
-		if (i + 1 == chunk->map_used)
-			chunk->contig_hint = max_contig; /* fully scanned */
-		else
-			chunk->contig_hint = max(chunk->contig_hint,
-						 max_contig);
-
-		chunk->free_size -= size;
-		*p |= 1;
-
-		*occ_pages_p = pcpu_count_occupied_pages(chunk, i);
-		pcpu_chunk_relocate(chunk, oslot);
-		return off;
-	}
-
-	chunk->contig_hint = max_contig;	/* fully scanned */
+	pcpu_block_update_hint_alloc(chunk, bit_off, alloc_bits);
 	pcpu_chunk_relocate(chunk, oslot);
 
-	/* tell the upper layer that this chunk has no matching area */
-	return -1;
+	return bit_off * PCPU_MIN_ALLOC_SIZE;
 }
 
 /**
  * pcpu_free_area - free area to a pcpu_chunk
  * @chunk: chunk of interest
- * @freeme: offset of area to free
- * @occ_pages_p: out param for the number of pages the area occupies
+ * @off: offset of area to free
  *
- * Free area starting from @freeme to @chunk.  Note that this function
+ * Free area starting from @off to @chunk.  Note that this function
  * only modifies the allocation map.  It doesn't depopulate or unmap
  * the area.
  *
  * CONTEXT:
  * pcpu_lock.
  */
-static void pcpu_free_area(struct pcpu_chunk *chunk, int freeme,
-			   int *occ_pages_p)
+static void pcpu_free_area(struct pcpu_chunk *chunk, int off)
 {
 	int oslot = pcpu_chunk_slot(chunk);
-	int off = 0;
-	unsigned i, j;
-	int to_free = 0;
-	int *p;
-
-	freeme |= 1;	/* we are searching for <given offset, in use> pair */
-
-	i = 0;
-	j = chunk->map_used;
-	while (i != j) {
-		unsigned k = (i + j) / 2;
-		off = chunk->map[k];
-		if (off < freeme)
-			i = k + 1;
-		else if (off > freeme)
-			j = k;
-		else
-			i = j = k;
-	}
-	BUG_ON(off != freeme);
+	int bit_off, bits, end;
 
-	if (i < chunk->first_free)
-		chunk->first_free = i;
+	bit_off = off / PCPU_MIN_ALLOC_SIZE;
+	BUG_ON(!test_bit(bit_off, chunk->bound_map) ||
+	       !test_bit(bit_off, chunk->alloc_map));
 
-	p = chunk->map + i;
-	*p = off &= ~1;
-	chunk->free_size += (p[1] & ~1) - off;
+	/* the size of the area is given by the next boundary */
+	end = find_next_bit(chunk->bound_map, pcpu_chunk_map_bits,
+			    bit_off + 1);
+	bits = end - bit_off;
+	bitmap_clear(chunk->alloc_map, bit_off, bits);
 
-	*occ_pages_p = pcpu_count_occupied_pages(chunk, i);
+	chunk->free_bytes += bits * PCPU_MIN_ALLOC_SIZE;
+	chunk->first_bit = min(chunk->first_bit, bit_off);
 
-	/* merge with next? */
-	if (!(p[1] & 1))
-		to_free++;
-	/* merge with previous? */
-	if (i > 0 && !(p[-1] & 1)) {
-		to_free++;
-		i--;
-		p--;
-	}
-	if (to_free) {
-		chunk->map_used -= to_free;
-		memmove(p + 1, p + 1 + to_free,
-			(chunk->map_used - i) * sizeof(chunk->map[0]));
-	}
-
-	chunk->contig_hint = max(chunk->map[i + 1] - chunk->map[i] - 1, chunk->contig_hint);
+	pcpu_block_update_hint_free(chunk, bit_off, bits);
 	pcpu_chunk_relocate(chunk, oslot);
 }
 
+static void pcpu_free_chunk(struct pcpu_chunk *chunk)
+{
+	if (!chunk)
+		return;
+	pcpu_mem_free(chunk->md_blocks,
+		      pcpu_unit_pages * sizeof(chunk->md_blocks[0]));
+	pcpu_mem_free(chunk->bound_map,
+		      BITS_TO_LONGS(pcpu_chunk_map_bits + 1) *
+		      sizeof(chunk->bound_map[0]));
+	pcpu_mem_free(chunk->alloc_map,
+		      BITS_TO_LONGS(pcpu_chunk_map_bits) *
+		      sizeof(chunk->alloc_map[0]));
+	pcpu_mem_free(chunk, pcpu_chunk_struct_size);
+}
+
 static struct pcpu_chunk *pcpu_alloc_chunk(void)
 {
 	struct pcpu_chunk *chunk;
+	int i;
 
 	chunk = pcpu_mem_zalloc(pcpu_chunk_struct_size);
 	if (!chunk)
 		return NULL;
 
-	chunk->map = pcpu_mem_zalloc(PCPU_DFL_MAP_ALLOC *
-						sizeof(chunk->map[0]));
-	if (!chunk->map) {
-		pcpu_mem_free(chunk, pcpu_chunk_struct_size);
+	chunk->alloc_map = pcpu_mem_zalloc(
+			BITS_TO_LONGS(pcpu_chunk_map_bits) *
+			sizeof(chunk->alloc_map[0]));
+	chunk->bound_map = pcpu_mem_zalloc(
+			BITS_TO_LONGS(pcpu_chunk_map_bits + 1) *
+			sizeof(chunk->bound_map[0]));
+	chunk->md_blocks = pcpu_mem_zalloc(
+			pcpu_unit_pages * sizeof(chunk->md_blocks[0]));
+	if (!chunk->alloc_map || !chunk->bound_map || !chunk->md_blocks) {
+		pcpu_free_chunk(chunk);
 		return NULL;
 	}
 
-	chunk->map_alloc = PCPU_DFL_MAP_ALLOC;
-	chunk->map[0] = 0;
-	chunk->map[1] = pcpu_unit_size | 1;
-	chunk->map_used = 1;
-
 	INIT_LIST_HEAD(&chunk->list);
-	INIT_WORK(&chunk->map_extend_work, pcpu_map_extend_workfn);
-	chunk->free_size = pcpu_unit_size;
-	chunk->contig_hint = pcpu_unit_size;
+	for (i = 0; i < pcpu_unit_pages; i++)
+		pcpu_init_md_block(chunk->md_blocks + i);
+	chunk->free_bytes = pcpu_unit_size;
+	chunk->contig_bits = pcpu_chunk_map_bits;
+	chunk->contig_bits_start = 0;
+	chunk->first_bit = 0;
 
 	return chunk;
 }
 
-static void pcpu_free_chunk(struct pcpu_chunk *chunk)
+/*
+ * The number of pages in [@page_start,@page_end) of @chunk which hold no
+ * allocation.
+ */
+static int pcpu_count_empty_pages(struct pcpu_chunk *chunk,
+				  int page_start, int page_end)
 {
-	if (!chunk)
-		return;
-	pcpu_mem_free(chunk->map, chunk->map_alloc * sizeof(chunk->map[0]));
-	pcpu_mem_free(chunk, pcpu_chunk_struct_size);
+	int i, nr = 0;
+
+	for (i = page_start; i < page_end; i++)
+		if (chunk->md_blocks[i].contig_hint == PCPU_BITMAP_BLOCK_BITS)
+			nr++;
+	return nr;
 }
 
 /**
@@ -776,7 +910,8 @@ static void pcpu_chunk_populated(struct pcpu_chunk *chunk,
 
 	bitmap_set(chunk->populated, page_start, nr);
 	chunk->nr_populated += nr;
-	pcpu_nr_empty_pop_pages += nr;
+	pcpu_nr_empty_pop_pages += pcpu_count_empty_pages(chunk, page_start,
+							  page_end);
 }
 
 /**
@@ -798,7 +933,8 @@ static void pcpu_chunk_depopulated(struct pcpu_chunk *chunk,
 
 	bitmap_clear(chunk->populated, page_start, nr);
 	chunk->nr_populated -= nr;
-	pcpu_nr_empty_pop_pages -= nr;
+	pcpu_nr_empty_pop_pages -= pcpu_count_empty_pages(chunk, page_start,
+							  page_end);
 }
 
 /*
@@ -877,19 +1013,18 @@ static void __percpu *pcpu_alloc(size_t size, size_t align, bool reserved,
 	struct pcpu_chunk *chunk;
 	const char *err;
 	bool is_atomic = (gfp & GFP_KERNEL) != GFP_KERNEL;
-	int occ_pages = 0;
-	int slot, off, new_alloc, cpu, ret;
+	int slot, off, cpu, ret;
+	int bits, bit_align;
 	unsigned long flags;
 	void __percpu *ptr;
 
-	/*
-	 * We want the lowest bit of offset available for in-use/free
-	 * indicator, so force >= 16bit alignment and make size even.
-	 */
-	if (unlikely(align < 2))
-		align = 2;
+	/* the allocation map tracks PCPU_MIN_ALLOC_SIZE units */
+	if (unlikely(align < PCPU_MIN_ALLOC_SIZE))
+		align = PCPU_MIN_ALLOC_SIZE;
 
-	size = ALIGN(size, 2);
+	size = ALIGN(size, PCPU_MIN_ALLOC_SIZE);
+	bits = size >> PCPU_MIN_ALLOC_SHIFT;
+	bit_align = align >> PCPU_MIN_ALLOC_SHIFT;
 
 	if (unlikely(!size || size > PCPU_MIN_UNIT_SIZE || align > PAGE_SIZE)) {
 		WARN(true, "illegal size (%zu) or align (%zu) for "
@@ -903,23 +1038,12 @@ static void __percpu *pcpu_alloc(size_t size, size_t align, bool reserved,
 	if (reserved && pcpu_reserved_chunk) {
 		chunk = pcpu_reserved_chunk;
 
-		if (size > chunk->contig_hint) {
+		if (bits > chunk->contig_bits) {
 			err = "alloc from reserved chunk failed";
 			goto fail_unlock;
 		}
 
-		while ((new_alloc = pcpu_need_to_extend(chunk, is_atomic))) {
-			spin_unlock_irqrestore(&pcpu_lock, flags);
-			if (is_atomic ||
-			    pcpu_extend_area_map(chunk, new_alloc) < 0) {
-				err = "failed to extend area map of reserved chunk";
-				goto fail;
-			}
-			spin_lock_irqsave(&pcpu_lock, flags);
-		}
-
-		off = pcpu_alloc_area(chunk, size, align, is_atomic,
-				      &occ_pages);
+		off = pcpu_alloc_area(chunk, bits, bit_align, is_atomic);
 		if (off >= 0)
 			goto area_found;
 
@@ -931,29 +1055,11 @@ restart:
 	/* search through normal chunks */
 	for (slot = pcpu_size_to_slot(size); slot < pcpu_nr_slots; slot++) {
 		list_for_each_entry(chunk, &pcpu_slot[slot], list) {
-			if (size > chunk->contig_hint)
+			if (bits > chunk->contig_bits)
 				continue;
 
-			new_alloc = pcpu_need_to_extend(chunk, is_atomic);
-			if (new_alloc) {
-				if (is_atomic)
-					continue;
-				spin_unlock_irqrestore(&pcpu_lock, flags);
-				if (pcpu_extend_area_map(chunk,
-							 new_alloc) < 0) {
-					err = "failed to extend area map";
-					goto fail;
-				}
-				spin_lock_irqsave(&pcpu_lock, flags);
-				/*
-				 * pcpu_lock has been dropped, need to
-				 * restart cpu_slot list walking.
-				 */
-				goto restart;
-			}
-
-			off = pcpu_alloc_area(chunk, size, align, is_atomic,
-					      &occ_pages);
+			off = pcpu_alloc_area(chunk, bits, bit_align,
+					      is_atomic);
 			if (off >= 0)
 				goto area_found;
 		}
@@ -1008,7 +1114,7 @@ area_found:
 			spin_lock_irqsave(&pcpu_lock, flags);
 			if (ret) {
 				mutex_unlock(&pcpu_alloc_mutex);
-				pcpu_free_area(chunk, off, &occ_pages);
+				pcpu_free_area(chunk, off);
 				err = "failed to populate";
 				goto fail_unlock;
 			}
@@ -1019,9 +1125,6 @@ area_found:
 		mutex_unlock(&pcpu_alloc_mutex);
 	}
 
-	if (chunk != pcpu_reserved_chunk)
-		pcpu_nr_empty_pop_pages -= occ_pages;
-
 	if (pcpu_nr_empty_pop_pages < PCPU_EMPTY_POP_PAGES_LOW)
 		pcpu_schedule_balance_work();
 
@@ -1233,7 +1336,7 @@ void free_percpu(void __percpu *ptr)
 	void *addr;
 	struct pcpu_chunk *chunk;
 	unsigned long flags;
-	int off, occ_pages;
+	int off;
 
 	if (!ptr)
 		return;
@@ -1247,13 +1350,10 @@ void free_percpu(void __percpu *ptr)
 	chunk = pcpu_chunk_addr_search(addr);
 	off = addr - chunk->base_addr;
 
-	pcpu_free_area(chunk, off, &occ_pages);
-
-	if (chunk != pcpu_reserved_chunk)
-		pcpu_nr_empty_pop_pages += occ_pages;
+	pcpu_free_area(chunk, off);
 
 	/* if there are more than one fully free chunks, wake up grim reaper */
-	if (chunk->free_size == pcpu_unit_size) {
+	if (chunk->free_bytes == pcpu_unit_size) {
 		struct pcpu_chunk *pos;
 
 		list_for_each_entry(pos, &pcpu_slot[pcpu_nr_slots - 1], list)
@@ -1469,6 +1569,66 @@ static void pcpu_dump_alloc_info(const char *lvl,
 	printk(KERN_CONT "\n");
 }
 
+/**
+ * pcpu_alloc_first_chunk - create a chunk over part of the first unit
+ * @base_addr: mapped address of the first unit
+ * @start: offset of the area served by the chunk
+ * @size: size of the area served by the chunk
+ *
+ * The static and reserved chunks share the memory of the first unit,
+ * but each only serves its own part of it.  The rest is marked allocated
+ * in the chunk's maps, as a pair of areas nobody will ever free.
+ *
+ * RETURNS:
+ * The new chunk, which is fully populated and immutable.
+ */
+static struct pcpu_chunk * __init pcpu_alloc_first_chunk(void *base_addr,
+							 int start, int size)
+{
+	struct pcpu_chunk *chunk;
+	int start_bit, end_bit, i;
+
+	chunk = memblock_virt_alloc(pcpu_chunk_struct_size, 0);
+	INIT_LIST_HEAD(&chunk->list);
+	chunk->base_addr = base_addr;
+	chunk->immutable = true;
+	bitmap_fill(chunk->populated, pcpu_unit_pages);
+	chunk->nr_populated = pcpu_unit_pages;
+
+	chunk->alloc_map = memblock_virt_alloc(
+			BITS_TO_LONGS(pcpu_chunk_map_bits) *
+			sizeof(chunk->alloc_map[0]), 0);
+	chunk->bound_map = memblock_virt_alloc(
+			BITS_TO_LONGS(pcpu_chunk_map_bits + 1) *
+			sizeof(chunk->bound_map[0]), 0);
+	chunk->md_blocks = memblock_virt_alloc(
+			pcpu_unit_pages * sizeof(chunk->md_blocks[0]), 0);
+
+	start_bit = DIV_ROUND_UP(start, PCPU_MIN_ALLOC_SIZE);
+	end_bit = (start + size) / PCPU_MIN_ALLOC_SIZE;
+
+	if (start_bit) {
+		bitmap_set(chunk->alloc_map, 0, start_bit);
+		set_bit(0, chunk->bound_map);
+		set_bit(start_bit, chunk->bound_map);
+	}
+	if (end_bit < pcpu_chunk_map_bits) {
+		bitmap_set(chunk->alloc_map, end_bit,
+			   pcpu_chunk_map_bits - end_bit);
+		set_bit(end_bit, chunk->bound_map);
+		set_bit(pcpu_chunk_map_bits, chunk->bound_map);
+	}
+
+	for (i = 0; i < pcpu_unit_pages; i++)
+		pcpu_block_refresh_hint(chunk, i);
+	pcpu_chunk_refresh_hint(chunk);
+
+	chunk->free_bytes = (end_bit - start_bit) * PCPU_MIN_ALLOC_SIZE;
+	chunk->first_bit = start_bit;
+
+	return chunk;
+}
+
 /**
  * pcpu_setup_first_chunk - initialize the first percpu chunk
  * @ai: pcpu_alloc_info describing how to percpu area is shaped
@@ -1528,8 +1688,6 @@ static void pcpu_dump_alloc_info(const char *lvl,
 int __init pcpu_setup_first_chunk(const struct pcpu_alloc_info *ai,
 				  void *base_addr)
 {
-	static int smap[PERCPU_DYNAMIC_EARLY_SLOTS] __initdata;
-	static int dmap[PERCPU_DYNAMIC_EARLY_SLOTS] __initdata;
 	size_t dyn_size = ai->dyn_size;
 	size_t size_sum = ai->static_size + ai->reserved_size + dyn_size;
 	struct pcpu_chunk *schunk, *dchunk = NULL;
@@ -1626,6 +1784,7 @@ int __init pcpu_setup_first_chunk(const struct pcpu_alloc_info *ai,
 	pcpu_atom_size = ai->atom_size;
 	pcpu_chunk_struct_size = sizeof(struct pcpu_chunk) +
 		BITS_TO_LONGS(pcpu_unit_pages) * sizeof(unsigned long);
+	pcpu_chunk_map_bits = pcpu_unit_size >> PCPU_MIN_ALLOC_SHIFT;
 
 	/*
 	 * Allocate chunk slots.  The additional last slot is for
@@ -1644,56 +1803,27 @@ int __init pcpu_setup_first_chunk(const struct pcpu_alloc_info *ai,
 	 * covers static area + reserved area (mostly used for module
 	 * static percpu allocation).
 	 */
-	schunk = memblock_virt_alloc(pcpu_chunk_struct_size, 0);
-	INIT_LIST_HEAD(&schunk->list);
-	INIT_WORK(&schunk->map_extend_work, pcpu_map_extend_workfn);
-	schunk->base_addr = base_addr;
-	schunk->map = smap;
-	schunk->map_alloc = ARRAY_SIZE(smap);
-	schunk->immutable = true;
-	bitmap_fill(schunk->populated, pcpu_unit_pages);
-	schunk->nr_populated = pcpu_unit_pages;
-
 	if (ai->reserved_size) {
-		schunk->free_size = ai->reserved_size;
+		schunk = pcpu_alloc_first_chunk(base_addr, ai->static_size,
+						ai->reserved_size);
 		pcpu_reserved_chunk = schunk;
 		pcpu_reserved_chunk_limit = ai->static_size + ai->reserved_size;
 	} else {
-		schunk->free_size = dyn_size;
+		schunk = pcpu_alloc_first_chunk(base_addr, ai->static_size,
+						dyn_size);
 		dyn_size = 0;			/* dynamic area covered */
 	}
-	schunk->contig_hint = schunk->free_size;
-
-	schunk->map[0] = 1;
-	schunk->map[1] = ai->static_size;
-	schunk->map_used = 1;
-	if (schunk->free_size)
-		schunk->map[++schunk->map_used] = ai->static_size + schunk->free_size;
-	schunk->map[schunk->map_used] |= 1;
 
 	/* init dynamic chunk if necessary */
-	if (dyn_size) {
-		dchunk = memblock_virt_alloc(pcpu_chunk_struct_size, 0);
-		INIT_LIST_HEAD(&dchunk->list);
-		INIT_WORK(&dchunk->map_extend_work, pcpu_map_extend_workfn);
-		dchunk->base_addr = base_addr;
-		dchunk->map = dmap;
-		dchunk->map_alloc = ARRAY_SIZE(dmap);
-		dchunk->immutable = true;
-		bitmap_fill(dchunk->populated, pcpu_unit_pages);
-		dchunk->nr_populated = pcpu_unit_pages;
-
-		dchunk->contig_hint = dchunk->free_size = dyn_size;
-		dchunk->map[0] = 1;
-		dchunk->map[1] = pcpu_reserved_chunk_limit;
-		dchunk->map[2] = (pcpu_reserved_chunk_limit + dchunk->free_size) | 1;
-		dchunk->map_used = 2;
-	}
+	if (dyn_size)
+		dchunk = pcpu_alloc_first_chunk(base_addr,
+						pcpu_reserved_chunk_limit,
+						dyn_size);
 
 	/* link the first chunk in */
 	pcpu_first_chunk = dchunk ?: schunk;
-	pcpu_nr_empty_pop_pages +=
-		pcpu_count_occupied_pages(pcpu_first_chunk, 1);
+	pcpu_nr_empty_pop_pages =
+		pcpu_count_empty_pages(pcpu_first_chunk, 0, pcpu_unit_pages);
 	pcpu_chunk_relocate(pcpu_first_chunk, -1);
 
 	/* we're done */
@@ -2251,36 +2381,6 @@ void __init setup_per_cpu_areas(void)
 
 #endif	/* CONFIG_SMP */
 
-/*
- * First and reserved chunks are initialized with temporary allocation
- * map in initdata so that they can be used before slab is online.
- * This function is called after slab is brought up and replaces those
- * with properly allocated maps.
- */
-void __init percpu_init_late(void)
-{
-	struct pcpu_chunk *target_chunks[] =
-		{ pcpu_first_chunk, pcpu_reserved_chunk, NULL };
-	struct pcpu_chunk *chunk;
-	unsigned long flags;
-	int i;
-
-	for (i = 0; (chunk = target_chunks[i]); i++) {
-		int *map;
-		const size_t size = PERCPU_DYNAMIC_EARLY_SLOTS * sizeof(map[0]);
-
-		BUILD_BUG_ON(size > PAGE_SIZE);
-
-		map = pcpu_mem_zalloc(size);
-		BUG_ON(!map);
-
-		spin_lock_irqsave(&pcpu_lock, flags);
-		memcpy(map, chunk->map, size);
-		chunk->map = map;
-		spin_unlock_irqrestore(&pcpu_lock, flags);
-	}
-}
-
 /*
  * Percpu allocator is initialized early during boot when neither slab or
  * workqueue is available.  Plug async management until everything is up
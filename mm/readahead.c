@@ -17,6 +17,8 @@
 #include <linux/pagemap.h>
 #include <linux/syscalls.h>
 #include <linux/file.h>
+#include <linux/slab.h>
+#include <linux/workqueue.h>
 
 #include "internal.h"
 
@@ -232,6 +234,100 @@ int force_page_cache_readahead(struct address_space *mapping, struct file *filp,
 	return 0;
 }
 
+struct willneed_work {
+	struct work_struct work;
+	struct file *file;
+};
+
+static void willneed_readahead_work(struct work_struct *work)
+{
+	struct willneed_work *ww = container_of(work, struct willneed_work,
+						work);
+	struct file *filp = ww->file;
+	struct file_ra_state *ra = &filp->f_ra;
+	unsigned long this_chunk = (2 * 1024 * 1024) / PAGE_CACHE_SIZE;
+
+	for (;;) {
+		unsigned long nr;
+		pgoff_t offset;
+
+		spin_lock(&filp->f_lock);
+		offset = ra->willneed_next;
+		nr = min(ra->willneed_end - offset, this_chunk);
+		ra->willneed_next += nr;
+		spin_unlock(&filp->f_lock);
+		if (!nr)
+			break;
+
+		/* read_pages() submits each chunk under one plug */
+		__do_page_cache_readahead(filp->f_mapping, filp, offset, nr, 0);
+		cond_resched();
+	}
+
+	fput(filp);
+	kfree(ww);
+}
+
+/*
+ * Like force_page_cache_readahead(), but a range larger than the readahead
+ * window is read in the background and is not capped to the window size:
+ * the caller returns right away while a worker reads the range in 2MB
+ * chunks. What is left to read is tracked in filp->f_ra. A new request
+ * overlapping the one in flight extends it; a disjoint one replaces it.
+ */
+int force_page_cache_readahead_async(struct address_space *mapping,
+		struct file *filp, pgoff_t offset, unsigned long nr_to_read)
+{
+	struct file_ra_state *ra = &filp->f_ra;
+	struct willneed_work *ww;
+	loff_t isize = i_size_read(mapping->host);
+	pgoff_t end_index;
+	bool busy;
+
+	if (unlikely(!mapping->a_ops->readpage && !mapping->a_ops->readpages))
+		return -EINVAL;
+
+	if (isize == 0)
+		return 0;
+	end_index = ((isize - 1) >> PAGE_CACHE_SHIFT) + 1;
+	if (offset >= end_index)
+		return 0;
+	nr_to_read = min(nr_to_read, end_index - offset);
+
+	if (nr_to_read <= inode_to_bdi(mapping->host)->ra_pages)
+		goto sync;
+
+	ww = kmalloc(sizeof(*ww), GFP_KERNEL);
+	if (!ww)
+		goto sync;
+
+	spin_lock(&filp->f_lock);
+	busy = ra->willneed_next != ra->willneed_end;
+	if (busy && offset <= ra->willneed_end &&
+	    offset + nr_to_read >= ra->willneed_next) {
+		ra->willneed_next = min(ra->willneed_next, offset);
+		ra->willneed_end = max(ra->willneed_end, offset + nr_to_read);
+	} else {
+		ra->willneed_next = offset;
+		ra->willneed_end = offset + nr_to_read;
+	}
+	spin_unlock(&filp->f_lock);
+
+	/* the running worker picks the new range up */
+	if (busy) {
+		kfree(ww);
+		return 0;
+	}
+
+	INIT_WORK(&ww->work, willneed_readahead_work);
+	ww->file = get_file(filp);
+	queue_work(system_unbound_wq, &ww->work);
+	return 0;
+
+sync:
+	return force_page_cache_readahead(mapping, filp, offset, nr_to_read);
+}
+
 /*
  * Set the initial window size, round to next power of 2 and square
  * for small size, x 4 for medium, and x 2 for large
@@ -32,6 +32,8 @@
 #include <linux/export.h>
 #include <linux/swap.h>
 #include <linux/uio.h>
+#include <linux/khugepaged.h>
+#include <linux/shmem_fs.h>
 
 static struct vfsmount *shm_mnt;
 
@@ -50,7 +52,6 @@ static struct vfsmount *shm_mnt;
 #include <linux/string.h>
 #include <linux/slab.h>
 #include <linux/backing-dev.h>
-#include <linux/shmem_fs.h>
 #include <linux/writeback.h>
 #include <linux/blkdev.h>
 #include <linux/pagevec.h>
@@ -104,8 +105,66 @@ enum sgp_type {
 	SGP_DIRTY,	/* like SGP_CACHE, but set new page dirty */
 	SGP_WRITE,	/* may exceed i_size, may allocate !Uptodate page */
 	SGP_FALLOC,	/* like SGP_WRITE, but make existing page Uptodate */
+	SGP_HUGE,	/* like SGP_CACHE, but huge page wanted for pmd */
 };
 
+#ifdef CONFIG_TRANSPARENT_HUGE_PAGECACHE
+/* Values of the huge= mount option, and of sbinfo->huge */
+#define SHMEM_HUGE_NEVER	0
+#define SHMEM_HUGE_ALWAYS	1
+#define SHMEM_HUGE_WITHIN_SIZE	2
+#define SHMEM_HUGE_ADVISE	3
+
+/*
+ * Special values only for the shmem_enabled sysfs knob, to override all
+ * mounts at once: DENY for emergencies, FORCE for testing.
+ */
+#define SHMEM_HUGE_DENY		(-1)
+#define SHMEM_HUGE_FORCE	(-2)
+
+static int shmem_huge __read_mostly;
+
+#if defined(CONFIG_SYSFS) || defined(CONFIG_TMPFS)
+static int shmem_parse_huge(const char *str)
+{
+	if (!strcmp(str, "never"))
+		return SHMEM_HUGE_NEVER;
+	if (!strcmp(str, "always"))
+		return SHMEM_HUGE_ALWAYS;
+	if (!strcmp(str, "within_size"))
+		return SHMEM_HUGE_WITHIN_SIZE;
+	if (!strcmp(str, "advise"))
+		return SHMEM_HUGE_ADVISE;
+	if (!strcmp(str, "deny"))
+		return SHMEM_HUGE_DENY;
+	if (!strcmp(str, "force"))
+		return SHMEM_HUGE_FORCE;
+	return -EINVAL;
+}
+
+static const char *shmem_format_huge(int huge)
+{
+	switch (huge) {
+	case SHMEM_HUGE_NEVER:
+		return "never";
+	case SHMEM_HUGE_ALWAYS:
+		return "always";
+	case SHMEM_HUGE_WITHIN_SIZE:
+		return "within_size";
+	case SHMEM_HUGE_ADVISE:
+		return "advise";
+	case SHMEM_HUGE_DENY:
+		return "deny";
+	case SHMEM_HUGE_FORCE:
+		return "force";
+	default:
+		VM_BUG_ON(1);
+		return "bad_val";
+	}
+}
+#endif
+#endif /* CONFIG_TRANSPARENT_HUGE_PAGECACHE */
+
 #ifdef CONFIG_TMPFS
 static unsigned long shmem_default_max_blocks(void)
 {
@@ -136,6 +195,30 @@ static inline struct shmem_sb_info *SHMEM_SB(struct super_block *sb)
 	return sb->s_fs_info;
 }
 
+/*
+ * shmem_getpage returns a huge page by its head, locked and referenced:
+ * this is the subpage holding @index.
+ */
+static inline struct page *shmem_subpage(struct page *page, pgoff_t index)
+{
+	return page + (index - page->index);
+}
+
+/*
+ * Trade the reference on a huge page returned by shmem_getpage for one on
+ * the subpage holding @index.  The head stays locked.
+ */
+static struct page *shmem_get_subpage(struct page *page, pgoff_t index)
+{
+	struct page *subpage = shmem_subpage(page, index);
+
+	if (subpage != page) {
+		get_page(subpage);
+		page_cache_release(page);
+	}
+	return subpage;
+}
+
 /*
  * shmem_file_setup pre-accounts the whole fixed size of a VM object,
  * for shared memory and for shared anonymous (/dev/zero) mappings
@@ -173,10 +256,11 @@ static inline int shmem_reacct_size(unsigned long flags,
  * shmem_getpage reports shmem_acct_block failure as -ENOSPC not -ENOMEM,
  * so that a failure on a sparse tmpfs mapping will give SIGBUS not OOM.
  */
-static inline int shmem_acct_block(unsigned long flags)
+static inline int shmem_acct_block(unsigned long flags, long pages)
 {
 	return (flags & VM_NORESERVE) ?
-		security_vm_enough_memory_mm(current->mm, VM_ACCT(PAGE_CACHE_SIZE)) : 0;
+		security_vm_enough_memory_mm(current->mm,
+			pages * VM_ACCT(PAGE_CACHE_SIZE)) : 0;
 }
 
 static inline void shmem_unacct_blocks(unsigned long flags, long pages)
@@ -295,25 +379,46 @@ static int shmem_add_to_page_cache(struct page *page,
 				   struct address_space *mapping,
 				   pgoff_t index, void *expected)
 {
-	int error;
+	int error, i, nr = hpage_nr_pages(page);
 
 	VM_BUG_ON_PAGE(!PageLocked(page), page);
 	VM_BUG_ON_PAGE(!PageSwapBacked(page), page);
+	VM_BUG_ON_PAGE(PageTail(page), page);
+	VM_BUG_ON_PAGE(index & (nr - 1), page);
+	VM_BUG_ON(expected && PageTransHuge(page));
 
 	page_cache_get(page);
 	page->mapping = mapping;
 	page->index = index;
 
 	spin_lock_irq(&mapping->tree_lock);
-	if (!expected)
+	if (PageTransHuge(page)) {
+		/*
+		 * One slot per subpage.  The nodes needed usually all come
+		 * from the caller's preload: if not, the atomic allocation
+		 * may fail, and then we unwind.
+		 */
+		for (i = 0; i < nr; i++) {
+			error = radix_tree_insert(&mapping->page_tree,
+						  index + i, page + i);
+			if (error) {
+				while (i--)
+					radix_tree_delete(&mapping->page_tree,
+							  index + i);
+				break;
+			}
+		}
+	} else if (!expected)
 		error = radix_tree_insert(&mapping->page_tree, index, page);
 	else
 		error = shmem_radix_tree_replace(mapping, index, expected,
 								 page);
 	if (!error) {
-		mapping->nrpages++;
-		__inc_zone_page_state(page, NR_FILE_PAGES);
-		__inc_zone_page_state(page, NR_SHMEM);
+		mapping->nrpages += nr;
+		if (PageTransHuge(page))
+			__inc_zone_page_state(page, NR_SHMEM_THPS);
+		__mod_zone_page_state(page_zone(page), NR_FILE_PAGES, nr);
+		__mod_zone_page_state(page_zone(page), NR_SHMEM, nr);
 		spin_unlock_irq(&mapping->tree_lock);
 	} else {
 		page->mapping = NULL;
@@ -389,6 +494,47 @@ void shmem_unlock_mapping(struct address_space *mapping)
 	}
 }
 
+/*
+ * A huge page met while removing a range: drop it whole if it lies inside
+ * the range, otherwise split it so that the range can be handled page by
+ * page.  Returns true when the caller is done with @page, a subpage which
+ * it holds a reference on.
+ */
+static bool shmem_punch_compound(struct address_space *mapping,
+				 struct page *page, pgoff_t start, pgoff_t end,
+				 bool unfalloc, bool wait)
+{
+	struct page *head = compound_head(page);
+	bool done = true;
+
+	/* Fails only if split and freed meanwhile */
+	if (!get_page_unless_zero(head))
+		return false;
+	if (wait)
+		lock_page(head);
+	else if (!trylock_page(head)) {
+		page_cache_release(head);
+		return true;
+	}
+
+	if (!PageTransHuge(head) || compound_head(page) != head)
+		done = false;
+	else if (head->mapping != mapping)
+		;	/* truncated meanwhile */
+	else if (unfalloc && PageUptodate(head))
+		;	/* not ours to undo */
+	else if (head->index >= start &&
+		 head->index + hpage_nr_pages(head) <= end)
+		truncate_inode_page(mapping, head);
+	else {
+		split_huge_page(head);
+		done = false;
+	}
+	unlock_page(head);
+	page_cache_release(head);
+	return done;
+}
+
 /*
  * Remove range of pages and swap entries from radix tree, and free them.
  * If !unfalloc, truncate or punch hole; if unfalloc, undo failed fallocate.
@@ -434,6 +580,11 @@ static void shmem_undo_range(struct inode *inode, loff_t lstart, loff_t lend,
 				continue;
 			}
 
+			if (PageTransCompound(page) &&
+			    shmem_punch_compound(mapping, page, start, end,
+						 unfalloc, false))
+				continue;
+
 			if (!trylock_page(page))
 				continue;
 			if (!unfalloc || !PageUptodate(page)) {
@@ -459,7 +610,8 @@ static void shmem_undo_range(struct inode *inode, loff_t lstart, loff_t lend,
 				top = partial_end;
 				partial_end = 0;
 			}
-			zero_user_segment(page, partial_start, top);
+			zero_user_segment(shmem_subpage(page, start - 1),
+					  partial_start, top);
 			set_page_dirty(page);
 			unlock_page(page);
 			page_cache_release(page);
@@ -469,7 +621,8 @@ static void shmem_undo_range(struct inode *inode, loff_t lstart, loff_t lend,
 		struct page *page = NULL;
 		shmem_getpage(inode, end, &page, SGP_READ, NULL);
 		if (page) {
-			zero_user_segment(page, 0, partial_end);
+			zero_user_segment(shmem_subpage(page, end),
+					  0, partial_end);
 			set_page_dirty(page);
 			unlock_page(page);
 			page_cache_release(page);
@@ -512,6 +665,11 @@ static void shmem_undo_range(struct inode *inode, loff_t lstart, loff_t lend,
 				continue;
 			}
 
+			if (PageTransCompound(page) &&
+			    shmem_punch_compound(mapping, page, start, end,
+						 unfalloc, true))
+				continue;
+
 			lock_page(page);
 			if (!unfalloc || !PageUptodate(page)) {
 				if (page->mapping == mapping) {
@@ -772,6 +930,8 @@ static int shmem_writepage(struct page *page, struct writeback_control *wbc)
 	pgoff_t index;
 
 	BUG_ON(!PageLocked(page));
+	/* Reclaim splits huge pages before they get here */
+	VM_BUG_ON_PAGE(PageCompound(page), page);
 	mapping = page->mapping;
 	index = page->index;
 	inode = mapping->host;
@@ -934,6 +1094,30 @@ static struct page *shmem_alloc_page(gfp_t gfp,
 
 	return page;
 }
+
+#ifdef CONFIG_TRANSPARENT_HUGE_PAGECACHE
+static struct page *shmem_alloc_hugepage(gfp_t gfp,
+			struct shmem_inode_info *info, pgoff_t index)
+{
+	struct vm_area_struct pvma;
+	struct page *page;
+
+	/* Create a pseudo vma that just contains the policy */
+	pvma.vm_start = 0;
+	/* Bias interleave by inode number to distribute better across nodes */
+	pvma.vm_pgoff = index + info->vfs_inode.i_ino;
+	pvma.vm_ops = NULL;
+	pvma.vm_policy = mpol_shared_policy_lookup(&info->policy, index);
+
+	page = alloc_pages_vma(gfp | __GFP_COMP | __GFP_NORETRY | __GFP_NOWARN,
+			       HPAGE_PMD_ORDER, &pvma, 0, numa_node_id(), true);
+
+	/* Drop reference taken by mpol_shared_policy_lookup() */
+	mpol_cond_put(pvma.vm_policy);
+
+	return page;
+}
+#endif /* CONFIG_TRANSPARENT_HUGE_PAGECACHE */
 #else /* !CONFIG_NUMA */
 #ifdef CONFIG_TMPFS
 static inline void shmem_show_mpol(struct seq_file *seq, struct mempolicy *mpol)
@@ -952,8 +1136,25 @@ static inline struct page *shmem_alloc_page(gfp_t gfp,
 {
 	return alloc_page(gfp);
 }
+
+#ifdef CONFIG_TRANSPARENT_HUGE_PAGECACHE
+static inline struct page *shmem_alloc_hugepage(gfp_t gfp,
+			struct shmem_inode_info *info, pgoff_t index)
+{
+	return alloc_pages(gfp | __GFP_COMP | __GFP_NORETRY | __GFP_NOWARN,
+			   HPAGE_PMD_ORDER);
+}
+#endif /* CONFIG_TRANSPARENT_HUGE_PAGECACHE */
 #endif /* CONFIG_NUMA */
 
+#ifndef CONFIG_TRANSPARENT_HUGE_PAGECACHE
+static inline struct page *shmem_alloc_hugepage(gfp_t gfp,
+			struct shmem_inode_info *info, pgoff_t index)
+{
+	return NULL;
+}
+#endif
+
 #if !defined(CONFIG_NUMA) || !defined(CONFIG_TMPFS)
 static inline struct mempolicy *shmem_get_sbmpol(struct shmem_sb_info *sbinfo)
 {
@@ -1044,12 +1245,151 @@ static int shmem_replace_page(struct page **pagep, gfp_t gfp,
 	return error;
 }
 
+#ifdef CONFIG_TRANSPARENT_HUGE_PAGECACHE
+/*
+ * Should shmem_getpage allocate a huge page to hold @index?  Only where
+ * nothing of the huge page's range is in the cache yet, not even swap.
+ */
+static bool shmem_huge_wanted(struct inode *inode, pgoff_t index,
+			      enum sgp_type sgp)
+{
+	struct address_space *mapping = inode->i_mapping;
+	struct shmem_sb_info *sbinfo = SHMEM_SB(inode->i_sb);
+	pgoff_t hindex = round_down(index, HPAGE_PMD_NR);
+	struct radix_tree_iter iter;
+	void **slot;
+	bool empty = true;
+	loff_t i_size;
+
+	if (shmem_huge == SHMEM_HUGE_DENY || !S_ISREG(inode->i_mode))
+		return false;
+	if (sgp != SGP_WRITE && sgp != SGP_FALLOC && sgp != SGP_HUGE)
+		return false;
+
+	switch (shmem_huge == SHMEM_HUGE_FORCE ?
+		SHMEM_HUGE_ALWAYS : sbinfo->huge) {
+	case SHMEM_HUGE_ALWAYS:
+		break;
+	case SHMEM_HUGE_WITHIN_SIZE:
+		i_size = round_up(i_size_read(inode), PAGE_SIZE);
+		if (i_size >> PAGE_SHIFT >= hindex + HPAGE_PMD_NR)
+			break;
+		/* fallthrough */
+	case SHMEM_HUGE_ADVISE:
+		/* Only for a pmd fault on a madvised vma */
+		if (sgp == SGP_HUGE)
+			break;
+		/* fallthrough */
+	default:
+		return false;
+	}
+
+	rcu_read_lock();
+	radix_tree_for_each_slot(slot, &mapping->page_tree, &iter, hindex) {
+		if (iter.index < hindex + HPAGE_PMD_NR)
+			empty = false;
+		break;
+	}
+	rcu_read_unlock();
+	return empty;
+}
+#else
+static inline bool shmem_huge_wanted(struct inode *inode, pgoff_t index,
+				     enum sgp_type sgp)
+{
+	return false;
+}
+#endif /* CONFIG_TRANSPARENT_HUGE_PAGECACHE */
+
+/*
+ * Like find_lock_entry, but a huge page is returned by its head: that is
+ * what gets locked, and what the reference is held on.
+ */
+static struct page *shmem_find_lock_entry(struct address_space *mapping,
+					  pgoff_t index)
+{
+	struct page *page, *head;
+
+repeat:
+	page = find_get_entry(mapping, index);
+	if (!page || radix_tree_exceptional_entry(page))
+		return page;
+
+	head = compound_head(page);
+	if (head != page) {
+		if (!get_page_unless_zero(head)) {
+			page_cache_release(page);
+			goto repeat;
+		}
+		page_cache_release(page);
+	}
+
+	lock_page(head);
+	/* Has the page been truncated or split while we slept? */
+	if (unlikely(head->mapping != mapping || head->index > index ||
+		     head->index + hpage_nr_pages(head) <= index)) {
+		unlock_page(head);
+		page_cache_release(head);
+		goto repeat;
+	}
+	return head;
+}
+
+/*
+ * Account and allocate a new page, huge if asked, for shmem_getpage_gfp.
+ * Returns it locked and SwapBacked, or ERR_PTR(-ENOSPC or -ENOMEM).
+ */
+static struct page *shmem_alloc_and_acct_page(gfp_t gfp,
+		struct shmem_inode_info *info, struct shmem_sb_info *sbinfo,
+		pgoff_t index, bool huge)
+{
+	struct page *page;
+	int nr;
+	int err = -ENOSPC;
+
+	if (!IS_ENABLED(CONFIG_TRANSPARENT_HUGE_PAGECACHE))
+		huge = false;
+	nr = huge ? HPAGE_PMD_NR : 1;
+
+	if (shmem_acct_block(info->flags, nr))
+		goto failed;
+	if (sbinfo->max_blocks) {
+		if (percpu_counter_compare(&sbinfo->used_blocks,
+					   sbinfo->max_blocks - nr) > 0)
+			goto unacct;
+		percpu_counter_add(&sbinfo->used_blocks, nr);
+	}
+
+	if (huge)
+		page = shmem_alloc_hugepage(gfp, info, index);
+	else
+		page = shmem_alloc_page(gfp, info, index);
+	if (page) {
+		if (huge)
+			count_vm_event(THP_FILE_ALLOC);
+		__SetPageSwapBacked(page);
+		__set_page_locked(page);
+		return page;
+	}
+
+	err = -ENOMEM;
+	if (sbinfo->max_blocks)
+		percpu_counter_add(&sbinfo->used_blocks, -nr);
+unacct:
+	shmem_unacct_blocks(info->flags, nr);
+failed:
+	return ERR_PTR(err);
+}
+
 /*
  * shmem_getpage_gfp - find page in cache, or get from swap, or allocate
  *
  * If we allocate a new one we do not mark it dirty. That's up to the
  * vm. If we swap it in we mark it dirty since we also free the swap
  * entry since a page cannot live in both the swap and page cache
+ *
+ * A huge page is returned by its head.  SGP_CACHE and SGP_DIRTY split
+ * it first, since their callers go on to use the page on its own.
  */
 static int shmem_getpage_gfp(struct inode *inode, pgoff_t index,
 	struct page **pagep, enum sgp_type sgp, gfp_t gfp, int *fault_type)
@@ -1060,20 +1400,30 @@ static int shmem_getpage_gfp(struct inode *inode, pgoff_t index,
 	struct mem_cgroup *memcg;
 	struct page *page;
 	swp_entry_t swap;
+	pgoff_t hindex;
 	int error;
 	int once = 0;
 	int alloced = 0;
+	int nr;
 
 	if (index > (MAX_LFS_FILESIZE >> PAGE_CACHE_SHIFT))
 		return -EFBIG;
 repeat:
 	swap.val = 0;
-	page = find_lock_entry(mapping, index);
+	page = shmem_find_lock_entry(mapping, index);
 	if (radix_tree_exceptional_entry(page)) {
 		swap = radix_to_swp_entry(page);
 		page = NULL;
 	}
 
+	if (page && PageTransCompound(page) &&
+	    (sgp == SGP_CACHE || sgp == SGP_DIRTY)) {
+		split_huge_page(page);
+		unlock_page(page);
+		page_cache_release(page);
+		goto repeat;
+	}
+
 	if (sgp != SGP_WRITE && sgp != SGP_FALLOC &&
 	    ((loff_t)index << PAGE_CACHE_SHIFT) >= i_size_read(inode)) {
 		error = -EINVAL;
@@ -1175,27 +1525,21 @@ repeat:
 		swap_free(swap);
 
 	} else {
-		if (shmem_acct_block(info->flags)) {
-			error = -ENOSPC;
+		bool huge = shmem_huge_wanted(inode, index, sgp);
+
+		page = shmem_alloc_and_acct_page(gfp, info, sbinfo,
+						 index, huge);
+		if (IS_ERR(page) && huge)
+			page = shmem_alloc_and_acct_page(gfp, info, sbinfo,
+							 index, false);
+		if (IS_ERR(page)) {
+			error = PTR_ERR(page);
+			page = NULL;
 			goto failed;
 		}
-		if (sbinfo->max_blocks) {
-			if (percpu_counter_compare(&sbinfo->used_blocks,
-						sbinfo->max_blocks) >= 0) {
-				error = -ENOSPC;
-				goto unacct;
-			}
-			percpu_counter_inc(&sbinfo->used_blocks);
-		}
+		nr = hpage_nr_pages(page);
+		hindex = round_down(index, nr);
 
-		page = shmem_alloc_page(gfp, info, index);
-		if (!page) {
-			error = -ENOMEM;
-			goto decused;
-		}
-
-		__SetPageSwapBacked(page);
-		__set_page_locked(page);
 		if (sgp == SGP_WRITE)
 			__SetPageReferenced(page);
 
@@ -1204,7 +1548,7 @@ repeat:
 			goto decused;
 		error = radix_tree_maybe_preload(gfp & GFP_RECLAIM_MASK);
 		if (!error) {
-			error = shmem_add_to_page_cache(page, mapping, index,
+			error = shmem_add_to_page_cache(page, mapping, hindex,
 							NULL);
 			radix_tree_preload_end();
 		}
@@ -1216,8 +1560,8 @@ repeat:
 		lru_cache_add_anon(page);
 
 		spin_lock(&info->lock);
-		info->alloced++;
-		inode->i_blocks += BLOCKS_PER_PAGE;
+		info->alloced += nr;
+		inode->i_blocks += BLOCKS_PER_PAGE * nr;
 		shmem_recalc_inode(inode);
 		spin_unlock(&info->lock);
 		alloced = true;
@@ -1234,8 +1578,12 @@ clear:
 		 * it now, lest undo on failure cancel our earlier guarantee.
 		 */
 		if (sgp != SGP_WRITE) {
-			clear_highpage(page);
-			flush_dcache_page(page);
+			int i;
+
+			for (i = 0; i < hpage_nr_pages(page); i++) {
+				clear_highpage(page + i);
+				flush_dcache_page(page + i);
+			}
 			SetPageUptodate(page);
 		}
 		if (sgp == SGP_DIRTY)
@@ -1263,9 +1611,8 @@ clear:
 	 */
 decused:
 	if (sbinfo->max_blocks)
-		percpu_counter_add(&sbinfo->used_blocks, -1);
-unacct:
-	shmem_unacct_blocks(info->flags, 1);
+		percpu_counter_add(&sbinfo->used_blocks, -nr);
+	shmem_unacct_blocks(info->flags, nr);
 failed:
 	if (swap.val && !shmem_confirm_swap(mapping, index, swap))
 		error = -EEXIST;
@@ -1361,6 +1708,64 @@ static int shmem_fault(struct vm_area_struct *vma, struct vm_fault *vmf)
 	return ret;
 }
 
+#ifdef CONFIG_TRANSPARENT_HUGE_PAGECACHE
+/*
+ * Map a huge page with a pmd if we can, else fall back to shmem_fault().
+ * Huge pages are only ever mapped whole: whoever maps one with ptes has to
+ * split it first, so a private mapping gets a read-only pmd, and copy on
+ * write goes through the ptes.
+ */
+static int shmem_pmd_fault(struct vm_area_struct *vma, unsigned long address,
+			   pmd_t *pmd, unsigned int flags)
+{
+	struct inode *inode = file_inode(vma->vm_file);
+	unsigned long haddr = address & HPAGE_PMD_MASK;
+	bool write = flags & FAULT_FLAG_WRITE;
+	struct page *page;
+	pgoff_t pgoff;
+	int ret;
+
+	if (!pmd_none(*pmd)) {
+		/* Write fault on a read-only huge pmd */
+		if (vma->vm_flags & VM_SHARED)
+			return huge_pmd_wp_shared(vma, address, pmd);
+		split_huge_page_pmd(vma, address, pmd);
+		return VM_FAULT_FALLBACK;
+	}
+
+	if (haddr < vma->vm_start || haddr + HPAGE_PMD_SIZE > vma->vm_end)
+		return VM_FAULT_FALLBACK;
+	if (write && !(vma->vm_flags & VM_SHARED))
+		return VM_FAULT_FALLBACK;
+	if (!shmem_huge_enabled(vma))
+		return VM_FAULT_FALLBACK;
+	/* Leave racing with hole-punch and fallocate to shmem_fault() */
+	if (unlikely(inode->i_private))
+		return VM_FAULT_FALLBACK;
+
+	pgoff = linear_page_index(vma, haddr);
+	if (pgoff + HPAGE_PMD_NR >
+	    round_up(i_size_read(inode), PAGE_SIZE) >> PAGE_SHIFT)
+		return VM_FAULT_FALLBACK;
+
+	if (shmem_getpage(inode, pgoff, &page, SGP_HUGE, NULL))
+		return VM_FAULT_FALLBACK;
+	if (!PageTransHuge(page)) {
+		unlock_page(page);
+		page_cache_release(page);
+		return VM_FAULT_FALLBACK;
+	}
+	VM_BUG_ON_PAGE(page->index != pgoff, page);
+
+	/* On success, our reference is the one held by the pmd */
+	ret = do_set_pmd(vma, haddr, pmd, page, write);
+	unlock_page(page);
+	if (ret)
+		page_cache_release(page);
+	return ret;
+}
+#endif /* CONFIG_TRANSPARENT_HUGE_PAGECACHE */
+
 #ifdef CONFIG_NUMA
 static int shmem_set_policy(struct vm_area_struct *vma, struct mempolicy *mpol)
 {
@@ -1408,6 +1813,8 @@ static int shmem_mmap(struct file *file, struct vm_area_struct *vma)
 {
 	file_accessed(file);
 	vma->vm_ops = &shmem_vm_ops;
+	if (shmem_huge_enabled(vma))
+		return khugepaged_enter_vma_merge(vma, vma->vm_flags);
 	return 0;
 }
 
@@ -1477,6 +1884,11 @@ bool shmem_mapping(struct address_space *mapping)
 	return mapping->host->i_sb->s_op == &shmem_ops;
 }
 
+bool vma_is_shmem(struct vm_area_struct *vma)
+{
+	return vma->vm_ops == &shmem_vm_ops;
+}
+
 #ifdef CONFIG_TMPFS
 static const struct inode_operations shmem_symlink_inode_operations;
 static const struct inode_operations shmem_short_symlink_operations;
@@ -1495,6 +1907,7 @@ shmem_write_begin(struct file *file, struct address_space *mapping,
 	struct inode *inode = mapping->host;
 	struct shmem_inode_info *info = SHMEM_I(inode);
 	pgoff_t index = pos >> PAGE_CACHE_SHIFT;
+	int error;
 
 	/* i_mutex is held by caller */
 	if (unlikely(info->seals)) {
@@ -1504,7 +1917,10 @@ shmem_write_begin(struct file *file, struct address_space *mapping,
 			return -EPERM;
 	}
 
-	return shmem_getpage(inode, index, pagep, SGP_WRITE, NULL);
+	error = shmem_getpage(inode, index, pagep, SGP_WRITE, NULL);
+	if (!error)
+		*pagep = shmem_get_subpage(*pagep, index);
+	return error;
 }
 
 static int
@@ -1513,20 +1929,31 @@ shmem_write_end(struct file *file, struct address_space *mapping,
 			struct page *page, void *fsdata)
 {
 	struct inode *inode = mapping->host;
+	struct page *head = compound_head(page);
 
 	if (pos + copied > inode->i_size)
 		i_size_write(inode, pos + copied);
 
-	if (!PageUptodate(page)) {
+	if (!PageUptodate(head)) {
+		if (PageTransHuge(head)) {
+			int i;
+
+			for (i = 0; i < HPAGE_PMD_NR; i++) {
+				if (head + i == page)
+					continue;
+				clear_highpage(head + i);
+				flush_dcache_page(head + i);
+			}
+		}
 		if (copied < PAGE_CACHE_SIZE) {
 			unsigned from = pos & (PAGE_CACHE_SIZE - 1);
 			zero_user_segments(page, 0, from,
 					from + copied, PAGE_CACHE_SIZE);
 		}
-		SetPageUptodate(page);
+		SetPageUptodate(head);
 	}
-	set_page_dirty(page);
-	unlock_page(page);
+	set_page_dirty(head);
+	unlock_page(head);
 	page_cache_release(page);
 
 	return copied;
@@ -1576,8 +2003,12 @@ static ssize_t shmem_file_read_iter(struct kiocb *iocb, struct iov_iter *to)
 				error = 0;
 			break;
 		}
-		if (page)
-			unlock_page(page);
+		if (page) {
+			struct page *head = page;
+
+			page = shmem_get_subpage(head, index);
+			unlock_page(head);
+		}
 
 		/*
 		 * We must evaluate after, since reads (unlike writes)
@@ -1608,7 +2039,7 @@ static ssize_t shmem_file_read_iter(struct kiocb *iocb, struct iov_iter *to)
 			 * Mark the page accessed if we read the beginning.
 			 */
 			if (!offset)
-				mark_page_accessed(page);
+				mark_page_accessed(compound_head(page));
 		} else {
 			page = ZERO_PAGE(0);
 			page_cache_get(page);
@@ -1704,7 +2135,9 @@ static ssize_t shmem_file_splice_read(struct file *in, loff_t *ppos,
 		this_len = min_t(unsigned long, len, PAGE_CACHE_SIZE - loff);
 		page = spd.pages[page_nr];
 
-		if (!PageUptodate(page) || page->mapping != mapping) {
+		/* SGP_CACHE splits a huge page for splicing */
+		if (!PageUptodate(page) || page->mapping != mapping ||
+		    PageTransCompound(page)) {
 			error = shmem_getpage(inode, index, &page,
 							SGP_CACHE, NULL);
 			if (error)
@@ -1785,7 +2218,7 @@ static pgoff_t shmem_seek_hole_data(struct address_space *mapping,
 			}
 			page = pvec.pages[i];
 			if (page && !radix_tree_exceptional_entry(page)) {
-				if (!PageUptodate(page))
+				if (!PageUptodate(compound_head(page)))
 					page = NULL;
 			}
 			if (index >= end ||
@@ -1813,7 +2246,7 @@ static loff_t shmem_file_llseek(struct file *file, loff_t offset, int whence)
 	if (whence != SEEK_DATA && whence != SEEK_HOLE)
 		return generic_file_llseek_size(file, offset, whence,
 					MAX_LFS_FILESIZE, i_size_read(inode));
-	mutex_lock(&inode->i_mutex);
+	inode_lock(inode);
 	/* We're holding i_mutex so we can access i_size directly */
 
 	if (offset < 0)
@@ -1837,7 +2270,7 @@ static loff_t shmem_file_llseek(struct file *file, loff_t offset, int whence)
 
 	if (offset >= 0)
 		offset = vfs_setpos(file, offset, MAX_LFS_FILESIZE);
-	mutex_unlock(&inode->i_mutex);
+	inode_unlock(inode);
 	return offset;
 }
 
@@ -2002,7 +2435,7 @@ int shmem_add_seals(struct file *file, unsigned int seals)
 	if (seals & ~(unsigned int)F_ALL_SEALS)
 		return -EINVAL;
 
-	mutex_lock(&inode->i_mutex);
+	inode_lock(inode);
 
 	if (info->seals & F_SEAL_SEAL) {
 		error = -EPERM;
@@ -2025,7 +2458,7 @@ int shmem_add_seals(struct file *file, unsigned int seals)
 	error = 0;
 
 unlock:
-	mutex_unlock(&inode->i_mutex);
+	inode_unlock(inode);
 	return error;
 }
 EXPORT_SYMBOL_GPL(shmem_add_seals);
@@ -2075,7 +2508,7 @@ static long shmem_fallocate(struct file *file, int mode, loff_t offset,
 	if (mode & ~(FALLOC_FL_KEEP_SIZE | FALLOC_FL_PUNCH_HOLE))
 		return -EOPNOTSUPP;
 
-	mutex_lock(&inode->i_mutex);
+	inode_lock(inode);
 
 	if (mode & FALLOC_FL_PUNCH_HOLE) {
 		struct address_space *mapping = file->f_mapping;
@@ -2139,6 +2572,7 @@ static long shmem_fallocate(struct file *file, int mode, loff_t offset,
 
 	for (index = start; index < end; index++) {
 		struct page *page;
+		pgoff_t nr;
 
 		/*
 		 * Good, the fallocate(2) manpage permits EINTR: we may have
@@ -2162,10 +2596,12 @@ static long shmem_fallocate(struct file *file, int mode, loff_t offset,
 		/*
 		 * Inform shmem_writepage() how far we have reached.
 		 * No need for lock or barrier: we have the page lock.
+		 * A huge page covers the rest of its range too.
 		 */
-		shmem_falloc.next++;
+		nr = page->index + hpage_nr_pages(page) - index;
+		shmem_falloc.next += nr;
 		if (!PageUptodate(page))
-			shmem_falloc.nr_falloced++;
+			shmem_falloc.nr_falloced += nr;
 
 		/*
 		 * If !PageUptodate, leave it that way so that freeable pages
@@ -2177,6 +2613,7 @@ static long shmem_fallocate(struct file *file, int mode, loff_t offset,
 		set_page_dirty(page);
 		unlock_page(page);
 		page_cache_release(page);
+		index += nr - 1;
 		cond_resched();
 	}
 
@@ -2188,7 +2625,7 @@ undone:
 	inode->i_private = NULL;
 	spin_unlock(&inode->i_lock);
 out:
-	mutex_unlock(&inode->i_mutex);
+	inode_unlock(inode);
 	return error;
 }
 
@@ -2830,6 +3267,19 @@ static int shmem_parse_options(char *options, struct shmem_sb_info *sbinfo,
 			mpol = NULL;
 			if (mpol_parse_str(value, &mpol))
 				goto bad_val;
+#ifdef CONFIG_TRANSPARENT_HUGE_PAGECACHE
+		} else if (!strcmp(this_char, "huge")) {
+			int huge;
+
+			/* deny and force are only for the sysfs knob */
+			huge = shmem_parse_huge(value);
+			if (huge < 0)
+				goto bad_val;
+			if (!has_transparent_hugepage() &&
+			    huge != SHMEM_HUGE_NEVER)
+				goto bad_val;
+			sbinfo->huge = huge;
+#endif
 		} else {
 			printk(KERN_ERR "tmpfs: Bad mount option %s\n",
 			       this_char);
@@ -2879,6 +3329,7 @@ static int shmem_remount_fs(struct super_block *sb, int *flags, char *data)
 	sbinfo->max_blocks  = config.max_blocks;
 	sbinfo->max_inodes  = config.max_inodes;
 	sbinfo->free_inodes = config.max_inodes - inodes;
+	sbinfo->huge = config.huge;
 
 	/*
 	 * Preserve previous mempolicy unless mpol remount option was specified.
@@ -2909,6 +3360,11 @@ static int shmem_show_options(struct seq_file *seq, struct dentry *root)
 	if (!gid_eq(sbinfo->gid, GLOBAL_ROOT_GID))
 		seq_printf(seq, ",gid=%u",
 				from_kgid_munged(&init_user_ns, sbinfo->gid));
+#ifdef CONFIG_TRANSPARENT_HUGE_PAGECACHE
+	/* Shown as mounted, even where the shmem_enabled knob overrides it */
+	if (sbinfo->huge)
+		seq_printf(seq, ",huge=%s", shmem_format_huge(sbinfo->huge));
+#endif
 	shmem_show_mpol(seq, sbinfo->mpol);
 	return 0;
 }
@@ -3203,6 +3659,9 @@ static const struct super_operations shmem_ops = {
 static const struct vm_operations_struct shmem_vm_ops = {
 	.fault		= shmem_fault,
 	.map_pages	= filemap_map_pages,
+#ifdef CONFIG_TRANSPARENT_HUGE_PAGECACHE
+	.pmd_fault	= shmem_pmd_fault,
+#endif
 #ifdef CONFIG_NUMA
 	.set_policy     = shmem_set_policy,
 	.get_policy     = shmem_get_policy,
@@ -3258,6 +3717,245 @@ out3:
 	return error;
 }
 
+#ifdef CONFIG_TRANSPARENT_HUGE_PAGECACHE
+#ifdef CONFIG_SYSFS
+static ssize_t shmem_enabled_show(struct kobject *kobj,
+		struct kobj_attribute *attr, char *buf)
+{
+	int values[] = {
+		SHMEM_HUGE_ALWAYS,
+		SHMEM_HUGE_WITHIN_SIZE,
+		SHMEM_HUGE_ADVISE,
+		SHMEM_HUGE_NEVER,
+		SHMEM_HUGE_DENY,
+		SHMEM_HUGE_FORCE,
+	};
+	int i, count;
+
+	for (i = 0, count = 0; i < ARRAY_SIZE(values); i++) {
+		const char *fmt = shmem_huge == values[i] ? "[%s] " : "%s ";
+
+		count += sprintf(buf + count, fmt,
+				 shmem_format_huge(values[i]));
+	}
+	buf[count - 1] = '\n';
+	return count;
+}
+
+static ssize_t shmem_enabled_store(struct kobject *kobj,
+		struct kobj_attribute *attr, const char *buf, size_t count)
+{
+	char tmp[16];
+	int huge;
+
+	if (count + 1 > sizeof(tmp))
+		return -EINVAL;
+	memcpy(tmp, buf, count);
+	tmp[count] = '\0';
+	if (count && tmp[count - 1] == '\n')
+		tmp[count - 1] = '\0';
+
+	huge = shmem_parse_huge(tmp);
+	if (huge == -EINVAL)
+		return -EINVAL;
+	if (!has_transparent_hugepage() &&
+	    huge != SHMEM_HUGE_NEVER && huge != SHMEM_HUGE_DENY)
+		return -EINVAL;
+
+	shmem_huge = huge;
+	/* The internal mount, behind MAP_SHARED|MAP_ANONYMOUS, follows it */
+	if (shmem_huge >= SHMEM_HUGE_NEVER)
+		SHMEM_SB(shm_mnt->mnt_sb)->huge = shmem_huge;
+	return count;
+}
+
+struct kobj_attribute shmem_enabled_attr =
+	__ATTR(shmem_enabled, 0644, shmem_enabled_show, shmem_enabled_store);
+#endif /* CONFIG_SYSFS */
+
+/*
+ * Whether ->pmd_fault may map huge pages in @vma, and khugepaged collapse
+ * them there.
+ */
+bool shmem_huge_enabled(struct vm_area_struct *vma)
+{
+	struct inode *inode;
+	struct shmem_sb_info *sbinfo;
+	loff_t i_size;
+	pgoff_t off;
+
+	if (!vma_is_shmem(vma) || (vma->vm_flags & VM_NOHUGEPAGE))
+		return false;
+	/* File offset and virtual address must agree on the pmd boundary */
+	if (!IS_ALIGNED((vma->vm_start >> PAGE_SHIFT) - vma->vm_pgoff,
+			HPAGE_PMD_NR))
+		return false;
+	if (shmem_huge == SHMEM_HUGE_FORCE)
+		return true;
+	if (shmem_huge == SHMEM_HUGE_DENY)
+		return false;
+
+	inode = file_inode(vma->vm_file);
+	sbinfo = SHMEM_SB(inode->i_sb);
+	switch (sbinfo->huge) {
+	case SHMEM_HUGE_NEVER:
+		return false;
+	case SHMEM_HUGE_ALWAYS:
+		return true;
+	case SHMEM_HUGE_WITHIN_SIZE:
+		off = round_up(vma->vm_pgoff, HPAGE_PMD_NR);
+		i_size = round_up(i_size_read(inode), PAGE_SIZE);
+		if (i_size >= HPAGE_PMD_SIZE &&
+		    i_size >> PAGE_SHIFT >= off)
+			return true;
+		/* fallthrough */
+	case SHMEM_HUGE_ADVISE:
+		return vma->vm_flags & VM_HUGEPAGE;
+	default:
+		VM_BUG_ON(1);
+		return false;
+	}
+}
+
+/**
+ * shmem_collapse_huge - replace the small pages of a range by a huge page
+ * @mapping:	the shmem mapping, pinned by the caller
+ * @start:	first index of the range, aligned to HPAGE_PMD_NR
+ * @new_page:	the huge page to copy the range into
+ * @mm:		mm to charge @new_page to
+ * @gfp:	gfp mask for the charge
+ *
+ * Used by khugepaged.  Holes in the range are filled first; then each small
+ * page is held locked, unmapped and isolated while its contents are copied,
+ * and finally, with its references frozen so that nobody can see it go,
+ * replaced by its subpage of @new_page in the radix tree.
+ *
+ * Returns 0 when @new_page has become part of the page cache, or an error,
+ * in which case @new_page is left just as it was passed in.
+ */
+int shmem_collapse_huge(struct address_space *mapping, pgoff_t start,
+			struct page *new_page, struct mm_struct *mm, gfp_t gfp)
+{
+	struct inode *inode = mapping->host;
+	pgoff_t index, end = start + HPAGE_PMD_NR;
+	struct mem_cgroup *memcg;
+	struct page *page, *tmp;
+	LIST_HEAD(pagelist);
+	int nr_frozen = 0;
+	int error, i;
+
+	VM_BUG_ON(start & (HPAGE_PMD_NR - 1));
+	VM_BUG_ON_PAGE(!PageTransHuge(new_page), new_page);
+
+	error = mem_cgroup_try_charge(new_page, mm, gfp, &memcg);
+	if (error)
+		return error;
+
+	for (index = start; index < end; index++) {
+		/* This fills any hole, and splits any huge page found */
+		error = shmem_getpage(inode, index, &page, SGP_CACHE, NULL);
+		if (error)
+			goto out_putback;
+		if (page_mapped(page))
+			unmap_mapping_range(mapping,
+					(loff_t)index << PAGE_CACHE_SHIFT,
+					PAGE_CACHE_SIZE, 0);
+		if (!PageLRU(page))
+			lru_add_drain();
+		/*
+		 * Anyone else holding a reference, such as a gup pin, might
+		 * still write to the page after we copied it: give up.
+		 * Our own references are the lookup's and the cache's.
+		 */
+		if (page_count(page) != 2 || isolate_lru_page(page)) {
+			unlock_page(page);
+			page_cache_release(page);
+			error = -EBUSY;
+			goto out_putback;
+		}
+		inc_zone_page_state(page, NR_ISOLATED_ANON);
+		list_add_tail(&page->lru, &pagelist);
+	}
+
+	/* Locked and unmapped, the small pages can no longer change */
+	i = 0;
+	list_for_each_entry(page, &pagelist, lru) {
+		VM_BUG_ON_PAGE(page->index != start + i, page);
+		copy_highpage(new_page + i, page);
+		i++;
+	}
+
+	spin_lock_irq(&mapping->tree_lock);
+	/* References: the cache's, the lookup's and the isolation's */
+	list_for_each_entry(page, &pagelist, lru) {
+		if (!page_freeze_refs(page, 3)) {
+			error = -EBUSY;
+			break;
+		}
+		nr_frozen++;
+	}
+	if (error) {
+		list_for_each_entry(page, &pagelist, lru) {
+			if (!nr_frozen--)
+				break;
+			page_unfreeze_refs(page, 3);
+		}
+		spin_unlock_irq(&mapping->tree_lock);
+		goto out_putback;
+	}
+
+	__set_page_locked(new_page);
+	__SetPageSwapBacked(new_page);
+	__SetPageUptodate(new_page);
+	new_page->mapping = mapping;
+	new_page->index = start;
+
+	i = 0;
+	list_for_each_entry(page, &pagelist, lru) {
+		void **slot;
+
+		slot = radix_tree_lookup_slot(&mapping->page_tree, page->index);
+		radix_tree_replace_slot(slot, new_page + i);
+		__dec_zone_page_state(page, NR_FILE_PAGES);
+		__dec_zone_page_state(page, NR_SHMEM);
+		i++;
+	}
+	__inc_zone_page_state(new_page, NR_SHMEM_THPS);
+	__mod_zone_page_state(page_zone(new_page), NR_FILE_PAGES, HPAGE_PMD_NR);
+	__mod_zone_page_state(page_zone(new_page), NR_SHMEM, HPAGE_PMD_NR);
+	spin_unlock_irq(&mapping->tree_lock);
+
+	/* The reference from allocation becomes the page cache's */
+	mem_cgroup_commit_charge(new_page, memcg, false);
+	lru_cache_add_anon(new_page);
+	set_page_dirty(new_page);
+	unlock_page(new_page);
+
+	list_for_each_entry_safe(page, tmp, &pagelist, lru) {
+		list_del(&page->lru);
+		page->mapping = NULL;
+		ClearPageActive(page);
+		ClearPageUnevictable(page);
+		dec_zone_page_state(page, NR_ISOLATED_ANON);
+		unlock_page(page);
+		page_unfreeze_refs(page, 1);
+		page_cache_release(page);
+	}
+	return 0;
+
+out_putback:
+	list_for_each_entry_safe(page, tmp, &pagelist, lru) {
+		list_del(&page->lru);
+		dec_zone_page_state(page, NR_ISOLATED_ANON);
+		unlock_page(page);
+		putback_lru_page(page);
+		page_cache_release(page);
+	}
+	mem_cgroup_cancel_charge(new_page, memcg);
+	return error;
+}
+#endif /* CONFIG_TRANSPARENT_HUGE_PAGECACHE */
+
 #else /* !CONFIG_SHMEM */
 
 /*
@@ -3426,6 +4124,8 @@ int shmem_zero_setup(struct vm_area_struct *vma)
 		fput(vma->vm_file);
 	vma->vm_file = file;
 	vma->vm_ops = &shmem_vm_ops;
+	if (shmem_huge_enabled(vma))
+		return khugepaged_enter_vma_merge(vma, vma->vm_flags);
 	return 0;
 }
 
@@ -2841,6 +2841,7 @@ int build_detached_freelist(struct kmem_cache *s, size_t size,
 	size_t first_skipped_index = 0;
 	int lookahead = 3;
 	void *object;
+	struct page *page;
 
 	/* Always re-init detached_freelist */
 	df->page = NULL;
@@ -2852,12 +2853,26 @@ int build_detached_freelist(struct kmem_cache *s, size_t size,
 	if (!object)
 		return 0;
 
-	/* Support for memcg, compiler can optimize this out */
-	df->s = cache_from_obj(s, object);
+	page = virt_to_head_page(object);
+	if (!s) {
+		/* Handle kmalloc'ed objects that bypassed the slab */
+		if (unlikely(!PageSlab(page))) {
+			BUG_ON(!PageCompound(page));
+			kfree_hook(object);
+			__free_kmem_pages(page, compound_order(page));
+			p[size] = NULL; /* mark object processed */
+			return size;
+		}
+		/* Derive kmem_cache from object */
+		df->s = page->slab_cache;
+	} else {
+		/* Support for memcg, compiler can optimize this out */
+		df->s = cache_from_obj(s, object);
+	}
 
 	/* Start new detached freelist */
 	set_freepointer(df->s, object, NULL);
-	df->page = virt_to_head_page(object);
+	df->page = page;
 	df->tail = object;
 	df->freelist = object;
 	p[size] = NULL; /* mark object processed */
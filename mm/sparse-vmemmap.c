@@ -21,6 +21,7 @@
 #include <linux/mmzone.h>
 #include <linux/bootmem.h>
 #include <linux/highmem.h>
+#include <linux/memory_hotplug.h>
 #include <linux/slab.h>
 #include <linux/spinlock.h>
 #include <linux/vmalloc.h>
@@ -28,6 +29,7 @@
 #include <asm/dma.h>
 #include <asm/pgalloc.h>
 #include <asm/pgtable.h>
+#include <asm/tlbflush.h>
 
 /*
  * Allocate a block of memory to be used to back the virtual memory map
@@ -233,3 +235,200 @@ void __init sparse_mem_maps_populate_node(struct page **map_map,
 		vmemmap_buf_end = NULL;
 	}
 }
+
+#ifdef CONFIG_HUGETLB_PAGE_FREE_VMEMMAP
+/*
+ * Remapping of vmemmap ranges.
+ *
+ * The struct pages of a HugeTLB page are never written to past the first
+ * few tail pages, so their vmemmap can be backed by a single page mapped
+ * read-only many times.  These helpers switch a range of the vmemmap
+ * between its own pages and such a shared page.
+ */
+
+/*
+ * The freed pages are kept in an array rather than a list, as the list
+ * head of a page from bootmem holds its hot-remove registration.
+ */
+#define VMEMMAP_FREE_BATCH	32
+
+/* Serializes the splitting of huge vmemmap mappings */
+static DEFINE_SPINLOCK(vmemmap_split_lock);
+
+/* Map a huge vmemmap pmd with base pages, if it is not already */
+static int split_vmemmap_huge_pmd(pmd_t *pmd, unsigned long start)
+{
+	struct page *page;
+	pmd_t __pmd;
+	pte_t *pgtable;
+	unsigned long addr = start;
+	int i;
+
+	pgtable = pte_alloc_one_kernel(&init_mm, start);
+	if (!pgtable)
+		return -ENOMEM;
+
+	spin_lock(&vmemmap_split_lock);
+	if (!pmd_large(*pmd)) {
+		spin_unlock(&vmemmap_split_lock);
+		pte_free_kernel(&init_mm, pgtable);
+		return 0;
+	}
+
+	page = pmd_page(*pmd);
+	pmd_populate_kernel(&init_mm, &__pmd, pgtable);
+	for (i = 0; i < PTRS_PER_PTE; i++, addr += PAGE_SIZE)
+		set_pte_at(&init_mm, addr, pte_offset_kernel(&__pmd, addr),
+			   mk_pte(page + i, PAGE_KERNEL));
+
+	/* Make the ptes visible before the pmd */
+	smp_wmb();
+	pmd_populate_kernel(&init_mm, pmd, pgtable);
+	flush_tlb_kernel_range(start, start + PMD_SIZE);
+	spin_unlock(&vmemmap_split_lock);
+
+	return 0;
+}
+
+/*
+ * Free a page that backed the vmemmap.  Pages from bootmem may still be
+ * registered for memory hot-remove, which holds a reference to them.
+ */
+static void vmemmap_free_page(struct page *page)
+{
+	if (PageReserved(page)) {
+#ifdef CONFIG_HAVE_BOOTMEM_INFO_NODE
+		unsigned long type = (unsigned long)page->lru.next;
+
+		if (type == SECTION_INFO || type == MIX_SECTION_INFO) {
+			put_page_bootmem(page);
+			return;
+		}
+#endif
+		free_reserved_page(page);
+	} else {
+		__free_page(page);
+	}
+}
+
+/* Return the pte mapping @addr of the vmemmap, splitting huge mappings */
+static pte_t *vmemmap_pte_lookup(unsigned long addr, bool split)
+{
+	pgd_t *pgd;
+	pud_t *pud;
+	pmd_t *pmd;
+
+	pgd = pgd_offset_k(addr);
+	if (pgd_none(*pgd))
+		return NULL;
+	pud = pud_offset(pgd, addr);
+	if (pud_none(*pud) || pud_large(*pud))
+		return NULL;
+	pmd = pmd_offset(pud, addr);
+	if (pmd_none(*pmd))
+		return NULL;
+	if (pmd_large(*pmd)) {
+		if (!split || split_vmemmap_huge_pmd(pmd, addr & PMD_MASK))
+			return NULL;
+	}
+
+	return pte_offset_kernel(pmd, addr);
+}
+
+/**
+ * vmemmap_remap_free - remap a vmemmap range to a shared page and free the
+ *			pages that backed it
+ * @start:	start address of the vmemmap range to remap
+ * @end:	end address of the vmemmap range to remap
+ * @reuse:	address of the vmemmap page that [@start, @end) will map,
+ *		which must lie right below @start
+ *
+ * The range is mapped read-only, so any write to the struct pages it
+ * covers faults.
+ *
+ * Return: 0 on success, -ENOMEM if a huge mapping could not be split.  On
+ * failure, nothing has been remapped.
+ */
+int vmemmap_remap_free(unsigned long start, unsigned long end,
+		       unsigned long reuse)
+{
+	struct page *pages[VMEMMAP_FREE_BATCH];
+	struct page *reuse_page;
+	unsigned long addr, batch_start;
+	pte_t *pte;
+	int i, nr;
+
+	VM_BUG_ON(reuse + PAGE_SIZE != start);
+
+	/* Make sure that the whole range is mapped with base pages first */
+	for (addr = reuse; addr < end; addr += PAGE_SIZE) {
+		if (!vmemmap_pte_lookup(addr, true))
+			return -ENOMEM;
+	}
+
+	reuse_page = pte_page(*vmemmap_pte_lookup(reuse, false));
+	for (addr = start; addr < end; ) {
+		batch_start = addr;
+		for (nr = 0; addr < end && nr < VMEMMAP_FREE_BATCH;
+				addr += PAGE_SIZE) {
+			pte = vmemmap_pte_lookup(addr, false);
+			pages[nr++] = pte_page(*pte);
+			set_pte_at(&init_mm, addr, pte,
+				   mk_pte(reuse_page, PAGE_KERNEL_RO));
+		}
+		flush_tlb_kernel_range(batch_start, addr);
+
+		for (i = 0; i < nr; i++)
+			vmemmap_free_page(pages[i]);
+	}
+
+	return 0;
+}
+
+/**
+ * vmemmap_remap_alloc - give a vmemmap range remapped by
+ *			 vmemmap_remap_free() pages of its own again
+ * @start:	start address of the vmemmap range to restore
+ * @end:	end address of the vmemmap range to restore
+ * @reuse:	address of the vmemmap page the range currently maps
+ * @gfp_mask:	allocation flags for the new vmemmap pages
+ *
+ * Return: 0 on success, -ENOMEM if the pages could not be allocated.  On
+ * failure, the range is left as it was.
+ */
+int vmemmap_remap_alloc(unsigned long start, unsigned long end,
+			unsigned long reuse, gfp_t gfp_mask)
+{
+	int nid = page_to_nid((struct page *)start);
+	struct page *page, *next;
+	unsigned long addr;
+	LIST_HEAD(vmemmap_pages);
+	pte_t *pte;
+
+	VM_BUG_ON(reuse + PAGE_SIZE != start);
+
+	for (addr = start; addr < end; addr += PAGE_SIZE) {
+		page = alloc_pages_node(nid, gfp_mask, 0);
+		if (!page)
+			goto out_free;
+		list_add_tail(&page->lru, &vmemmap_pages);
+	}
+
+	for (addr = start; addr < end; addr += PAGE_SIZE) {
+		page = list_first_entry(&vmemmap_pages, struct page, lru);
+		list_del(&page->lru);
+		copy_page(page_address(page), (void *)reuse);
+		pte = vmemmap_pte_lookup(addr, false);
+		set_pte_at(&init_mm, addr, pte, mk_pte(page, PAGE_KERNEL));
+	}
+	flush_tlb_kernel_range(start, end);
+
+	return 0;
+out_free:
+	list_for_each_entry_safe(page, next, &vmemmap_pages, lru) {
+		list_del(&page->lru);
+		__free_page(page);
+	}
+	return -ENOMEM;
+}
+#endif /* CONFIG_HUGETLB_PAGE_FREE_VMEMMAP */
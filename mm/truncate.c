@@ -151,7 +151,7 @@ int truncate_inode_page(struct address_space *mapping, struct page *page)
 	if (page_mapped(page)) {
 		unmap_mapping_range(mapping,
 				   (loff_t)page->index << PAGE_CACHE_SHIFT,
-				   PAGE_CACHE_SIZE, 0);
+				   hpage_nr_pages(page) * PAGE_CACHE_SIZE, 0);
 	}
 	return truncate_complete_page(mapping, page);
 }
@@ -478,6 +478,10 @@ unsigned long invalidate_mapping_pages(struct address_space *mapping,
 				continue;
 			}
 
+			/* Huge shmem pages are never clean: leave them be */
+			if (PageTransCompound(page))
+				continue;
+
 			if (!trylock_page(page))
 				continue;
 			WARN_ON(page->index != index);
@@ -66,9 +66,14 @@ static int mcopy_atomic_pte(struct mm_struct *dst_mm,
 	if (mem_cgroup_try_charge(page, dst_mm, GFP_KERNEL, &memcg))
 		goto out_release;
 
-	_dst_pte = mk_pte(page, dst_vma->vm_page_prot);
+	/*
+	 * Always mark the pte dirty, even in a read-only vma: reclaim
+	 * would otherwise take the new page for a clean MADV_FREE page
+	 * and discard its contents.
+	 */
+	_dst_pte = pte_mkdirty(mk_pte(page, dst_vma->vm_page_prot));
 	if (dst_vma->vm_flags & VM_WRITE)
-		_dst_pte = pte_mkwrite(pte_mkdirty(_dst_pte));
+		_dst_pte = pte_mkwrite(_dst_pte);
 
 	ret = -EEXIST;
 	dst_pte = pte_offset_map_lock(dst_mm, dst_pmd, dst_addr, &ptl);
@@ -306,3 +311,45 @@ ssize_t mfill_zeropage(struct mm_struct *dst_mm, unsigned long start,
 {
 	return __mcopy_atomic(dst_mm, start, 0, len, true);
 }
+
+int mwriteprotect_range(struct mm_struct *dst_mm, unsigned long start,
+			unsigned long len, bool enable_wp)
+{
+	struct vm_area_struct *dst_vma;
+	unsigned long cp_flags;
+	int err;
+
+	/*
+	 * Sanitize the command parameters:
+	 */
+	BUG_ON(start & ~PAGE_MASK);
+	BUG_ON(len & ~PAGE_MASK);
+
+	/* Does the address range wrap, or is the span zero-sized? */
+	BUG_ON(start + len <= start);
+
+	down_read(&dst_mm->mmap_sem);
+
+	/*
+	 * Make sure the vma is not shared, that the range is both valid
+	 * and fully within a single existing vma registered for write
+	 * protection.
+	 */
+	err = -EINVAL;
+	dst_vma = find_vma(dst_mm, start);
+	if (!dst_vma || (dst_vma->vm_flags & VM_SHARED))
+		goto out_unlock;
+	if (start < dst_vma->vm_start || start + len > dst_vma->vm_end)
+		goto out_unlock;
+	if (!userfaultfd_wp(dst_vma) || dst_vma->vm_ops)
+		goto out_unlock;
+
+	cp_flags = enable_wp ? MM_CP_UFFD_WP : MM_CP_UFFD_WP_RESOLVE;
+	change_protection(dst_vma, start, start + len, dst_vma->vm_page_prot,
+			  cp_flags);
+
+	err = 0;
+out_unlock:
+	up_read(&dst_mm->mmap_sem);
+	return err;
+}
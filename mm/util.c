@@ -296,6 +296,7 @@ unsigned long vm_mmap_pgoff(struct file *file, unsigned long addr,
 		down_write(&mm->mmap_sem);
 		ret = do_mmap_pgoff(file, addr, len, prot, flag, pgoff,
 				    &populate);
+		vma_end_write_all(mm);
 		up_write(&mm->mmap_sem);
 		if (populate)
 			mm_populate(ret, populate);
@@ -22,6 +22,7 @@
 #include <linux/kallsyms.h>
 #include <linux/list.h>
 #include <linux/rbtree.h>
+#include <linux/rbtree_augmented.h>
 #include <linux/radix-tree.h>
 #include <linux/rcupdate.h>
 #include <linux/pfn.h>
@@ -29,6 +30,8 @@
 #include <linux/atomic.h>
 #include <linux/compiler.h>
 #include <linux/llist.h>
+#include <linux/mutex.h>
+#include <linux/workqueue.h>
 #include <linux/bitops.h>
 
 #include <asm/uaccess.h>
@@ -274,8 +277,6 @@ EXPORT_SYMBOL(vmalloc_to_pfn);
 
 /*** Global kva allocator ***/
 
-#define VM_LAZY_FREE	0x01
-#define VM_LAZY_FREEING	0x02
 #define VM_VM_AREA	0x04
 
 static DEFINE_SPINLOCK(vmap_area_lock);
@@ -283,14 +284,51 @@ static DEFINE_SPINLOCK(vmap_area_lock);
 LIST_HEAD(vmap_area_list);
 static struct rb_root vmap_area_root = RB_ROOT;
 
-/* The vmap cache globals are protected by vmap_area_lock */
-static struct rb_node *free_vmap_cache;
-static unsigned long cached_hole_size;
-static unsigned long cached_vstart;
-static unsigned long cached_align;
+/*
+ * The free KVA space is tracked in its own rbtree and list of vmap_areas,
+ * both address sorted and protected by vmap_area_lock.  Every node of the
+ * tree caches the size of the largest free area in its subtree, so the
+ * lowest area that fits a request is found in O(log n), no matter how
+ * fragmented the busy areas are.
+ */
+static struct rb_root free_vmap_area_root = RB_ROOT;
+static LIST_HEAD(free_vmap_area_list);
+
+/*
+ * Allocating from the middle of a free area splits it in two, which needs
+ * a new vmap_area under vmap_area_lock.  alloc_vmap_area() preloads one
+ * per cpu before taking the lock.
+ */
+static DEFINE_PER_CPU(struct vmap_area *, ne_fit_preload_node);
 
 static unsigned long vmap_area_pcpu_hole;
 
+static __always_inline unsigned long va_size(struct vmap_area *va)
+{
+	return (va->va_end - va->va_start);
+}
+
+static __always_inline unsigned long
+get_subtree_max_size(struct rb_node *node)
+{
+	struct vmap_area *va;
+
+	va = rb_entry_safe(node, struct vmap_area, rb_node);
+	return va ? va->subtree_max_size : 0;
+}
+
+static __always_inline unsigned long
+compute_subtree_max_size(struct vmap_area *va)
+{
+	return max3(va_size(va),
+		get_subtree_max_size(va->rb_node.rb_left),
+		get_subtree_max_size(va->rb_node.rb_right));
+}
+
+RB_DECLARE_CALLBACKS(static, free_vmap_area_rb_augment_cb,
+	struct vmap_area, rb_node, unsigned long, subtree_max_size,
+	compute_subtree_max_size)
+
 static struct vmap_area *__find_vmap_area(unsigned long addr)
 {
 	struct rb_node *n = vmap_area_root.rb_node;
@@ -310,36 +348,354 @@ static struct vmap_area *__find_vmap_area(unsigned long addr)
 	return NULL;
 }
 
-static void __insert_vmap_area(struct vmap_area *va)
+/*
+ * Find where @va is to be linked into @root, and its parent.  The areas
+ * of a tree never overlap, only neighbours can share an edge.
+ */
+static __always_inline struct rb_node **
+find_va_links(struct vmap_area *va, struct rb_root *root,
+	      struct rb_node **parent)
+{
+	struct rb_node **link = &root->rb_node;
+	struct vmap_area *tmp_va;
+
+	*parent = NULL;
+	while (*link) {
+		*parent = *link;
+		tmp_va = rb_entry(*parent, struct vmap_area, rb_node);
+
+		if (va->va_end <= tmp_va->va_start)
+			link = &(*link)->rb_left;
+		else if (va->va_start >= tmp_va->va_end)
+			link = &(*link)->rb_right;
+		else
+			BUG();
+	}
+
+	return link;
+}
+
+/*
+ * The list entry that will follow an area linked at @link, or NULL if the
+ * tree is empty.
+ */
+static __always_inline struct list_head *
+get_va_next_sibling(struct rb_node *parent, struct rb_node **link)
+{
+	struct vmap_area *va;
+
+	if (unlikely(!parent))
+		return NULL;
+
+	va = rb_entry(parent, struct vmap_area, rb_node);
+	return (&parent->rb_right == link ? va->list.next : &va->list);
+}
+
+/*
+ * Recompute the largest free size of the subtrees from @va up, stopping
+ * at the first node whose value does not change.
+ */
+static __always_inline void
+augment_tree_propagate_from(struct vmap_area *va)
 {
-	struct rb_node **p = &vmap_area_root.rb_node;
-	struct rb_node *parent = NULL;
-	struct rb_node *tmp;
+	free_vmap_area_rb_augment_cb_propagate(&va->rb_node, NULL);
+}
 
-	while (*p) {
-		struct vmap_area *tmp_va;
+static __always_inline void
+link_va(struct vmap_area *va, struct rb_root *root,
+	struct rb_node *parent, struct rb_node **link, struct list_head *head)
+{
+	/* The address sorted list follows the position in the tree */
+	if (likely(parent)) {
+		head = &rb_entry(parent, struct vmap_area, rb_node)->list;
+		if (&parent->rb_right != link)
+			head = head->prev;
+	}
+
+	rb_link_node(&va->rb_node, parent, link);
+	if (root == &free_vmap_area_root) {
+		/*
+		 * Account for the new leaf in its ancestors before the tree
+		 * is rebalanced: the rotations then keep the augmented
+		 * values right.
+		 */
+		va->subtree_max_size = 0;
+		augment_tree_propagate_from(va);
+		rb_insert_augmented(&va->rb_node, root,
+				    &free_vmap_area_rb_augment_cb);
+	} else {
+		rb_insert_color(&va->rb_node, root);
+	}
+
+	list_add(&va->list, head);
+}
+
+static __always_inline void
+unlink_va(struct vmap_area *va, struct rb_root *root)
+{
+	BUG_ON(RB_EMPTY_NODE(&va->rb_node));
+
+	if (root == &free_vmap_area_root)
+		rb_erase_augmented(&va->rb_node, root,
+				   &free_vmap_area_rb_augment_cb);
+	else
+		rb_erase(&va->rb_node, root);
+
+	list_del(&va->list);
+	RB_CLEAR_NODE(&va->rb_node);
+}
+
+static void insert_vmap_area(struct vmap_area *va, struct rb_root *root,
+			     struct list_head *head)
+{
+	struct rb_node **link;
+	struct rb_node *parent;
+
+	link = find_va_links(va, root, &parent);
+	link_va(va, root, parent, link, head);
+}
 
-		parent = *p;
-		tmp_va = rb_entry(parent, struct vmap_area, rb_node);
-		if (va->va_start < tmp_va->va_end)
-			p = &(*p)->rb_left;
-		else if (va->va_end > tmp_va->va_start)
-			p = &(*p)->rb_right;
+/*
+ * Give the range of @va back to the free space, merging it with the free
+ * areas on either side when they touch.  @va itself is freed if merged.
+ */
+static void merge_or_add_vmap_area(struct vmap_area *va)
+{
+	struct list_head *head = &free_vmap_area_list;
+	struct rb_root *root = &free_vmap_area_root;
+	struct vmap_area *sibling;
+	struct list_head *next;
+	struct rb_node **link;
+	struct rb_node *parent;
+	bool merged = false;
+
+	link = find_va_links(va, root, &parent);
+	next = get_va_next_sibling(parent, link);
+	if (unlikely(!next))
+		goto insert;
+
+	/* |<------VA------>|<-----Next----->| */
+	if (next != head) {
+		sibling = list_entry(next, struct vmap_area, list);
+		if (sibling->va_start == va->va_end) {
+			sibling->va_start = va->va_start;
+			augment_tree_propagate_from(sibling);
+			kfree_rcu(va, rcu_head);
+
+			va = sibling;
+			merged = true;
+		}
+	}
+
+	/* |<-----Prev----->|<------VA------>| */
+	if (next->prev != head) {
+		sibling = list_entry(next->prev, struct vmap_area, list);
+		if (sibling->va_end == va->va_start) {
+			/* Drop the merged next area before prev covers it */
+			if (merged)
+				unlink_va(va, root);
+
+			sibling->va_end = va->va_end;
+			augment_tree_propagate_from(sibling);
+			kfree_rcu(va, rcu_head);
+			return;
+		}
+	}
+
+insert:
+	if (!merged)
+		link_va(va, root, parent, link, head);
+}
+
+static __always_inline bool
+is_within_this_va(struct vmap_area *va, unsigned long size,
+	unsigned long align, unsigned long vstart)
+{
+	unsigned long nva_start_addr;
+
+	if (va->va_start > vstart)
+		nva_start_addr = ALIGN(va->va_start, align);
+	else
+		nva_start_addr = ALIGN(vstart, align);
+
+	/* Can be overflowed due to big size or alignment. */
+	if (nva_start_addr + size < nva_start_addr ||
+			nva_start_addr < vstart)
+		return false;
+
+	return (nva_start_addr + size <= va->va_end);
+}
+
+/*
+ * Find the lowest free area above @vstart that fits @size at @align.
+ * Any area of at least size + align - 1 fits, so the subtrees without
+ * one are skipped.
+ */
+static __always_inline struct vmap_area *
+find_vmap_lowest_match(unsigned long size,
+	unsigned long align, unsigned long vstart)
+{
+	struct vmap_area *va;
+	struct rb_node *node;
+	unsigned long length;
+
+	node = free_vmap_area_root.rb_node;
+	length = size + align - 1;
+
+	while (node) {
+		va = rb_entry(node, struct vmap_area, rb_node);
+
+		if (get_subtree_max_size(node->rb_left) >= length &&
+				vstart < va->va_start) {
+			node = node->rb_left;
+		} else {
+			if (is_within_this_va(va, size, align, vstart))
+				return va;
+
+			/*
+			 * There is no point in going right if the right
+			 * subtree has no large enough area.
+			 */
+			if (get_subtree_max_size(node->rb_right) >= length) {
+				node = node->rb_right;
+				continue;
+			}
+
+			/*
+			 * Go back up to the first right subtree that fits.
+			 * Everything in it lies above @vstart, so this can
+			 * only happen once.
+			 */
+			while ((node = rb_parent(node))) {
+				va = rb_entry(node, struct vmap_area, rb_node);
+				if (is_within_this_va(va, size, align, vstart))
+					return va;
+
+				if (get_subtree_max_size(node->rb_right) >=
+						length &&
+						vstart <= va->va_start) {
+					node = node->rb_right;
+					break;
+				}
+			}
+		}
+	}
+
+	return NULL;
+}
+
+enum fit_type {
+	NOTHING_FIT = 0,
+	FL_FIT_TYPE = 1,	/* full fit */
+	LE_FIT_TYPE = 2,	/* left edge fit */
+	RE_FIT_TYPE = 3,	/* right edge fit */
+	NE_FIT_TYPE = 4		/* no edge fit */
+};
+
+static __always_inline enum fit_type
+classify_va_fit_type(struct vmap_area *va,
+	unsigned long nva_start_addr, unsigned long size)
+{
+	enum fit_type type;
+
+	/* Check if it is within VA. */
+	if (nva_start_addr < va->va_start ||
+			nva_start_addr + size > va->va_end)
+		return NOTHING_FIT;
+
+	if (va->va_start == nva_start_addr) {
+		if (va->va_end == nva_start_addr + size)
+			type = FL_FIT_TYPE;
 		else
-			BUG();
+			type = LE_FIT_TYPE;
+	} else if (va->va_end == nva_start_addr + size) {
+		type = RE_FIT_TYPE;
+	} else {
+		type = NE_FIT_TYPE;
 	}
 
-	rb_link_node(&va->rb_node, parent, p);
-	rb_insert_color(&va->rb_node, &vmap_area_root);
+	return type;
+}
 
-	/* address-sort this list */
-	tmp = rb_prev(&va->rb_node);
-	if (tmp) {
-		struct vmap_area *prev;
-		prev = rb_entry(tmp, struct vmap_area, rb_node);
-		list_add_rcu(&va->list, &prev->list);
-	} else
-		list_add_rcu(&va->list, &vmap_area_list);
+/*
+ * Take [nva_start_addr, nva_start_addr + size) out of the free area @va.
+ */
+static __always_inline int
+adjust_va_to_fit_type(struct vmap_area *va,
+	unsigned long nva_start_addr, unsigned long size,
+	enum fit_type type)
+{
+	struct vmap_area *lva = NULL;
+
+	switch (type) {
+	case FL_FIT_TYPE:
+		unlink_va(va, &free_vmap_area_root);
+		kfree_rcu(va, rcu_head);
+		return 0;
+	case LE_FIT_TYPE:
+		va->va_start += size;
+		break;
+	case RE_FIT_TYPE:
+		va->va_end = nva_start_addr;
+		break;
+	case NE_FIT_TYPE:
+		lva = __this_cpu_xchg(ne_fit_preload_node, NULL);
+		if (unlikely(!lva)) {
+			lva = kmalloc(sizeof(struct vmap_area), GFP_NOWAIT);
+			if (!lva)
+				return -ENOMEM;
+		}
+
+		/* The part left of the allocation becomes a new area */
+		lva->va_start = va->va_start;
+		lva->va_end = nva_start_addr;
+
+		va->va_start = nva_start_addr + size;
+		break;
+	default:
+		return -EINVAL;
+	}
+
+	augment_tree_propagate_from(va);
+	if (lva)
+		insert_vmap_area(lva, &free_vmap_area_root,
+				 &free_vmap_area_list);
+	return 0;
+}
+
+/*
+ * Returns the start address of the allocated range, or @vend if there is
+ * no room.
+ */
+static __always_inline unsigned long
+__alloc_vmap_area(unsigned long size, unsigned long align,
+	unsigned long vstart, unsigned long vend)
+{
+	unsigned long nva_start_addr;
+	struct vmap_area *va;
+	enum fit_type type;
+
+	va = find_vmap_lowest_match(size, align, vstart);
+	if (unlikely(!va))
+		return vend;
+
+	if (va->va_start > vstart)
+		nva_start_addr = ALIGN(va->va_start, align);
+	else
+		nva_start_addr = ALIGN(vstart, align);
+
+	/* Check the "vend" restriction. */
+	if (nva_start_addr + size > vend)
+		return vend;
+
+	type = classify_va_fit_type(va, nva_start_addr, size);
+	if (WARN_ON_ONCE(type == NOTHING_FIT))
+		return vend;
+
+	if (adjust_va_to_fit_type(va, nva_start_addr, size, type))
+		return vend;
+
+	return nva_start_addr;
 }
 
 static void purge_vmap_area_lazy(void);
@@ -353,11 +709,9 @@ static struct vmap_area *alloc_vmap_area(unsigned long size,
 				unsigned long vstart, unsigned long vend,
 				int node, gfp_t gfp_mask)
 {
-	struct vmap_area *va;
-	struct rb_node *n;
+	struct vmap_area *va, *pva;
 	unsigned long addr;
 	int purged = 0;
-	struct vmap_area *first;
 
 	BUG_ON(!size);
 	BUG_ON(offset_in_page(size));
@@ -375,85 +729,32 @@ static struct vmap_area *alloc_vmap_area(unsigned long size,
 	kmemleak_scan_area(&va->rb_node, SIZE_MAX, gfp_mask & GFP_RECLAIM_MASK);
 
 retry:
-	spin_lock(&vmap_area_lock);
 	/*
-	 * Invalidate cache if we have more permissive parameters.
-	 * cached_hole_size notes the largest hole noticed _below_
-	 * the vmap_area cached in free_vmap_cache: if size fits
-	 * into that hole, we want to scan from vstart to reuse
-	 * the hole instead of allocating above free_vmap_cache.
-	 * Note that __free_vmap_area may update free_vmap_cache
-	 * without updating cached_hole_size or cached_align.
+	 * Preload the spare area for a split of a free area.  If it is
+	 * not used this time, it stays there for the next allocation.
 	 */
-	if (!free_vmap_cache ||
-			size < cached_hole_size ||
-			vstart < cached_vstart ||
-			align < cached_align) {
-nocache:
-		cached_hole_size = 0;
-		free_vmap_cache = NULL;
-	}
-	/* record if we encounter less permissive parameters */
-	cached_vstart = vstart;
-	cached_align = align;
-
-	/* find starting point for our search */
-	if (free_vmap_cache) {
-		first = rb_entry(free_vmap_cache, struct vmap_area, rb_node);
-		addr = ALIGN(first->va_end, align);
-		if (addr < vstart)
-			goto nocache;
-		if (addr + size < addr)
-			goto overflow;
-
-	} else {
-		addr = ALIGN(vstart, align);
-		if (addr + size < addr)
-			goto overflow;
-
-		n = vmap_area_root.rb_node;
-		first = NULL;
-
-		while (n) {
-			struct vmap_area *tmp;
-			tmp = rb_entry(n, struct vmap_area, rb_node);
-			if (tmp->va_end >= addr) {
-				first = tmp;
-				if (tmp->va_start <= addr)
-					break;
-				n = n->rb_left;
-			} else
-				n = n->rb_right;
-		}
-
-		if (!first)
-			goto found;
+	preempt_disable();
+	if (!__this_cpu_read(ne_fit_preload_node)) {
+		preempt_enable();
+		pva = kmalloc_node(sizeof(struct vmap_area),
+				gfp_mask & GFP_RECLAIM_MASK, node);
+		preempt_disable();
+
+		if (__this_cpu_cmpxchg(ne_fit_preload_node, NULL, pva))
+			kfree(pva);
 	}
 
-	/* from the starting point, walk areas until a suitable hole is found */
-	while (addr + size > first->va_start && addr + size <= vend) {
-		if (addr + cached_hole_size < first->va_start)
-			cached_hole_size = first->va_start - addr;
-		addr = ALIGN(first->va_end, align);
-		if (addr + size < addr)
-			goto overflow;
-
-		if (list_is_last(&first->list, &vmap_area_list))
-			goto found;
-
-		first = list_entry(first->list.next,
-				struct vmap_area, list);
-	}
+	spin_lock(&vmap_area_lock);
+	preempt_enable();
 
-found:
-	if (addr + size > vend)
+	addr = __alloc_vmap_area(size, align, vstart, vend);
+	if (unlikely(addr == vend))
 		goto overflow;
 
 	va->va_start = addr;
 	va->va_end = addr + size;
 	va->flags = 0;
-	__insert_vmap_area(va);
-	free_vmap_cache = &va->rb_node;
+	insert_vmap_area(va, &vmap_area_root, &vmap_area_list);
 	spin_unlock(&vmap_area_lock);
 
 	BUG_ON(va->va_start & (align-1));
@@ -478,26 +779,7 @@ overflow:
 
 static void __free_vmap_area(struct vmap_area *va)
 {
-	BUG_ON(RB_EMPTY_NODE(&va->rb_node));
-
-	if (free_vmap_cache) {
-		if (va->va_end < cached_vstart) {
-			free_vmap_cache = NULL;
-		} else {
-			struct vmap_area *cache;
-			cache = rb_entry(free_vmap_cache, struct vmap_area, rb_node);
-			if (va->va_start <= cache->va_start) {
-				free_vmap_cache = rb_prev(&va->rb_node);
-				/*
-				 * We don't try to update cached_hole_size or
-				 * cached_align, but it won't go very wrong.
-				 */
-			}
-		}
-	}
-	rb_erase(&va->rb_node, &vmap_area_root);
-	RB_CLEAR_NODE(&va->rb_node);
-	list_del_rcu(&va->list);
+	unlink_va(va, &vmap_area_root);
 
 	/*
 	 * Track the highest possible candidate for pcpu area
@@ -508,7 +790,7 @@ static void __free_vmap_area(struct vmap_area *va)
 	if (va->va_end > VMALLOC_START && va->va_end <= VMALLOC_END)
 		vmap_area_pcpu_hole = max(vmap_area_pcpu_hole, va->va_end);
 
-	kfree_rcu(va, rcu_head);
+	merge_or_add_vmap_area(va);
 }
 
 /*
@@ -577,6 +859,16 @@ static unsigned long lazy_max_pages(void)
 
 static atomic_t vmap_lazy_nr = ATOMIC_INIT(0);
 
+/*
+ * Lazily freed areas wait for the next purge on a list of the cpu that
+ * freed them, so that vfree() neither takes a lock nor shares a cacheline
+ * with the other cpus.  The purge, serialized by vmap_purge_lock, flushes
+ * the TLB without any spinlock held and only then takes vmap_area_lock to
+ * give the areas back.
+ */
+static DEFINE_PER_CPU(struct llist_head, vmap_purge_list);
+static DEFINE_MUTEX(vmap_purge_lock);
+
 /* for per-CPU blocks */
 static void purge_fragmented_blocks_allcpus(void);
 
@@ -592,85 +884,75 @@ void set_iounmap_nonlazy(void)
 /*
  * Purges all lazily-freed vmap areas.
  *
- * If sync is 0 then don't purge if there is already a purge in progress.
- * If force_flush is 1, then flush kernel TLBs between *start and *end even
- * if we found no lazy vmap areas to unmap (callers can use this to optimise
- * their own TLB flushing).
- * Returns with *start = min(*start, lowest purged address)
- *              *end = max(*end, highest purged address)
+ * The kernel TLBs are flushed between start and the lowest purged address
+ * and between end and the highest one.  Returns false, without flushing,
+ * if there was nothing to purge.
  */
-static void __purge_vmap_area_lazy(unsigned long *start, unsigned long *end,
-					int sync, int force_flush)
+static bool __purge_vmap_area_lazy(unsigned long start, unsigned long end)
 {
-	static DEFINE_SPINLOCK(purge_lock);
-	LIST_HEAD(valist);
-	struct vmap_area *va;
-	struct vmap_area *n_va;
-	int nr = 0;
+	struct llist_node *valist = NULL;
+	struct vmap_area *va, *n_va;
+	int cpu;
 
-	/*
-	 * If sync is 0 but force_flush is 1, we'll go sync anyway but callers
-	 * should not expect such behaviour. This just simplifies locking for
-	 * the case that isn't actually used at the moment anyway.
-	 */
-	if (!sync && !force_flush) {
-		if (!spin_trylock(&purge_lock))
-			return;
-	} else
-		spin_lock(&purge_lock);
+	lockdep_assert_held(&vmap_purge_lock);
 
-	if (sync)
-		purge_fragmented_blocks_allcpus();
+	for_each_possible_cpu(cpu) {
+		struct llist_node *first, *last = NULL;
+
+		first = llist_del_all(per_cpu_ptr(&vmap_purge_list, cpu));
+		llist_for_each_entry(va, first, purge_list) {
+			if (va->va_start < start)
+				start = va->va_start;
+			if (va->va_end > end)
+				end = va->va_end;
+			last = &va->purge_list;
+		}
 
-	rcu_read_lock();
-	list_for_each_entry_rcu(va, &vmap_area_list, list) {
-		if (va->flags & VM_LAZY_FREE) {
-			if (va->va_start < *start)
-				*start = va->va_start;
-			if (va->va_end > *end)
-				*end = va->va_end;
-			nr += (va->va_end - va->va_start) >> PAGE_SHIFT;
-			list_add_tail(&va->purge_list, &valist);
-			va->flags |= VM_LAZY_FREEING;
-			va->flags &= ~VM_LAZY_FREE;
+		if (last) {
+			last->next = valist;
+			valist = first;
 		}
 	}
-	rcu_read_unlock();
 
-	if (nr)
-		atomic_sub(nr, &vmap_lazy_nr);
+	if (!valist)
+		return false;
 
-	if (nr || force_flush)
-		flush_tlb_kernel_range(*start, *end);
+	flush_tlb_kernel_range(start, end);
 
-	if (nr) {
-		spin_lock(&vmap_area_lock);
-		list_for_each_entry_safe(va, n_va, &valist, purge_list)
-			__free_vmap_area(va);
-		spin_unlock(&vmap_area_lock);
+	spin_lock(&vmap_area_lock);
+	llist_for_each_entry_safe(va, n_va, valist, purge_list) {
+		int nr = (va->va_end - va->va_start) >> PAGE_SHIFT;
+
+		__free_vmap_area(va);
+		atomic_sub(nr, &vmap_lazy_nr);
+		cond_resched_lock(&vmap_area_lock);
 	}
-	spin_unlock(&purge_lock);
+	spin_unlock(&vmap_area_lock);
+	return true;
 }
 
 /*
- * Kick off a purge of the outstanding lazy areas. Don't bother if somebody
- * is already purging.
+ * Purge the outstanding lazy areas in the background, so that the task
+ * freeing an area does not pay for the TLB flush.
  */
-static void try_purge_vmap_area_lazy(void)
+static void drain_vmap_area_work(struct work_struct *work)
 {
-	unsigned long start = ULONG_MAX, end = 0;
-
-	__purge_vmap_area_lazy(&start, &end, 0, 0);
+	mutex_lock(&vmap_purge_lock);
+	__purge_vmap_area_lazy(ULONG_MAX, 0);
+	mutex_unlock(&vmap_purge_lock);
 }
 
+static DECLARE_WORK(drain_vmap_work, drain_vmap_area_work);
+
 /*
  * Kick off a purge of the outstanding lazy areas.
  */
 static void purge_vmap_area_lazy(void)
 {
-	unsigned long start = ULONG_MAX, end = 0;
-
-	__purge_vmap_area_lazy(&start, &end, 1, 0);
+	mutex_lock(&vmap_purge_lock);
+	purge_fragmented_blocks_allcpus();
+	__purge_vmap_area_lazy(ULONG_MAX, 0);
+	mutex_unlock(&vmap_purge_lock);
 }
 
 /*
@@ -680,10 +962,16 @@ static void purge_vmap_area_lazy(void)
  */
 static void free_vmap_area_noflush(struct vmap_area *va)
 {
-	va->flags |= VM_LAZY_FREE;
-	atomic_add((va->va_end - va->va_start) >> PAGE_SHIFT, &vmap_lazy_nr);
-	if (unlikely(atomic_read(&vmap_lazy_nr) > lazy_max_pages()))
-		try_purge_vmap_area_lazy();
+	int nr_lazy;
+
+	nr_lazy = atomic_add_return((va->va_end - va->va_start) >> PAGE_SHIFT,
+				    &vmap_lazy_nr);
+
+	/* After this point, we may free va at any time */
+	llist_add(&va->purge_list, raw_cpu_ptr(&vmap_purge_list));
+
+	if (unlikely(nr_lazy > lazy_max_pages()))
+		schedule_work(&drain_vmap_work);
 }
 
 /*
@@ -1070,7 +1358,11 @@ void vm_unmap_aliases(void)
 		rcu_read_unlock();
 	}
 
-	__purge_vmap_area_lazy(&start, &end, 1, flush);
+	mutex_lock(&vmap_purge_lock);
+	purge_fragmented_blocks_allcpus();
+	if (!__purge_vmap_area_lazy(start, end) && flush)
+		flush_tlb_kernel_range(start, end);
+	mutex_unlock(&vmap_purge_lock);
 }
 EXPORT_SYMBOL_GPL(vm_unmap_aliases);
 
@@ -1195,6 +1487,45 @@ void __init vm_area_register_early(struct vm_struct *vm, size_t align)
 	vm_area_add_early(vm);
 }
 
+static void __init vmap_init_free_space(void)
+{
+	unsigned long vmap_start = 1;
+	const unsigned long vmap_end = ULONG_MAX;
+	struct vmap_area *busy, *free;
+
+	/*
+	 *     B     F     B     B     B     F
+	 * -|-----|.....|-----|-----|-----|.....|-
+	 *  |           The KVA space           |
+	 *  |<--------------------------------->|
+	 */
+	list_for_each_entry(busy, &vmap_area_list, list) {
+		if (busy->va_start - vmap_start > 0) {
+			free = kzalloc(sizeof(struct vmap_area), GFP_NOWAIT);
+			if (!WARN_ON_ONCE(!free)) {
+				free->va_start = vmap_start;
+				free->va_end = busy->va_start;
+
+				insert_vmap_area(free, &free_vmap_area_root,
+						 &free_vmap_area_list);
+			}
+		}
+
+		vmap_start = busy->va_end;
+	}
+
+	if (vmap_end - vmap_start > 0) {
+		free = kzalloc(sizeof(struct vmap_area), GFP_NOWAIT);
+		if (!WARN_ON_ONCE(!free)) {
+			free->va_start = vmap_start;
+			free->va_end = vmap_end;
+
+			insert_vmap_area(free, &free_vmap_area_root,
+					 &free_vmap_area_list);
+		}
+	}
+}
+
 void __init vmalloc_init(void)
 {
 	struct vmap_area *va;
@@ -1220,9 +1551,11 @@ void __init vmalloc_init(void)
 		va->va_start = (unsigned long)tmp->addr;
 		va->va_end = va->va_start + tmp->size;
 		va->vm = tmp;
-		__insert_vmap_area(va);
+		insert_vmap_area(va, &vmap_area_root, &vmap_area_list);
 	}
 
+	/* Now all the imported areas are in place, set up the free space. */
+	vmap_init_free_space();
 	vmap_area_pcpu_hole = VMALLOC_END;
 
 	vmap_initialized = true;
@@ -2278,6 +2611,28 @@ static struct vmap_area *node_to_va(struct rb_node *n)
 	return n ? rb_entry(n, struct vmap_area, rb_node) : NULL;
 }
 
+/*
+ * Find the free area that contains @addr, if any.
+ */
+static struct vmap_area *pvm_find_va_enclose_addr(unsigned long addr)
+{
+	struct rb_node *n = free_vmap_area_root.rb_node;
+
+	while (n) {
+		struct vmap_area *va;
+
+		va = rb_entry(n, struct vmap_area, rb_node);
+		if (addr < va->va_start)
+			n = n->rb_left;
+		else if (addr >= va->va_end)
+			n = n->rb_right;
+		else
+			return va;
+	}
+
+	return NULL;
+}
+
 /**
  * pvm_find_next_prev - find the next and prev vmap_area surrounding @end
  * @end: target address
@@ -2389,7 +2744,7 @@ struct vm_struct **pcpu_get_vm_areas(const unsigned long *offsets,
 	struct vmap_area **vas, *prev, *next;
 	struct vm_struct **vms;
 	int area, area2, last_area, term_area;
-	unsigned long base, start, end, last_end;
+	unsigned long base, start, size, end, last_end;
 	bool purged = false;
 
 	/* verify parameters and allocate data structures */
@@ -2502,13 +2857,29 @@ retry:
 		pvm_find_next_prev(base + end, &next, &prev);
 	}
 found:
-	/* we've found a fitting base, insert all va's */
+	/*
+	 * We've found a fitting base, carve all va's out of the free
+	 * space and insert them.  The free tree is the complement of the
+	 * busy one, so each of them lies within a single free area.
+	 */
 	for (area = 0; area < nr_vms; area++) {
 		struct vmap_area *va = vas[area];
-
-		va->va_start = base + offsets[area];
-		va->va_end = va->va_start + sizes[area];
-		__insert_vmap_area(va);
+		struct vmap_area *free_va;
+		enum fit_type type;
+
+		start = base + offsets[area];
+		size = sizes[area];
+
+		free_va = pvm_find_va_enclose_addr(start);
+		type = free_va ? classify_va_fit_type(free_va, start, size) :
+				 NOTHING_FIT;
+		if (WARN_ON_ONCE(type == NOTHING_FIT) ||
+		    adjust_va_to_fit_type(free_va, start, size, type))
+			goto recovery;
+
+		va->va_start = start;
+		va->va_end = start + size;
+		insert_vmap_area(va, &vmap_area_root, &vmap_area_list);
 	}
 
 	vmap_area_pcpu_hole = base + offsets[last_area];
@@ -2523,6 +2894,14 @@ found:
 	kfree(vas);
 	return vms;
 
+recovery:
+	/* Give back the areas already inserted, the rest are still unused */
+	while (area--) {
+		__free_vmap_area(vas[area]);
+		vas[area] = NULL;
+	}
+	spin_unlock(&vmap_area_lock);
+
 err_free:
 	for (area = 0; area < nr_vms; area++) {
 		kfree(vas[area]);
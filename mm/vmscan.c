@@ -46,6 +46,7 @@
 #include <linux/oom.h>
 #include <linux/prefetch.h>
 #include <linux/printk.h>
+#include <linux/psi.h>
 
 #include <asm/tlbflush.h>
 #include <asm/div64.h>
@@ -906,6 +907,7 @@ static unsigned long shrink_page_list(struct list_head *page_list,
 		int may_enter_fs;
 		enum page_references references = PAGEREF_RECLAIM_CLEAN;
 		bool dirty, writeback;
+		bool lazyfree = false;
 
 		cond_resched();
 
@@ -1049,10 +1051,15 @@ static unsigned long shrink_page_list(struct list_head *page_list,
 				goto keep_locked;
 			if (!add_to_swap(page, page_list))
 				goto activate_locked;
+			lazyfree = true;
 			may_enter_fs = 1;
 
 			/* Adding to swap updated mapping */
 			mapping = page_mapping(page);
+		} else if (unlikely(PageTransHuge(page))) {
+			/* Split file THP: tails go back on page_list */
+			if (split_huge_page_to_list(page, page_list))
+				goto keep_locked;
 		}
 
 		/*
@@ -1060,14 +1067,18 @@ static unsigned long shrink_page_list(struct list_head *page_list,
 		 * processes. Try to unmap it here.
 		 */
 		if (page_mapped(page) && mapping) {
-			switch (try_to_unmap(page,
-					ttu_flags|TTU_BATCH_FLUSH)) {
+			switch (try_to_unmap(page, lazyfree ?
+				(ttu_flags | TTU_BATCH_FLUSH | TTU_LZFREE) :
+				(ttu_flags | TTU_BATCH_FLUSH))) {
 			case SWAP_FAIL:
 				goto activate_locked;
 			case SWAP_AGAIN:
 				goto keep_locked;
 			case SWAP_MLOCK:
 				goto cull_mlocked;
+			case SWAP_LZFREE:
+				count_vm_event(PGLAZYFREED);
+				goto lazyfree;
 			case SWAP_SUCCESS:
 				; /* try to free the page below */
 			}
@@ -1174,6 +1185,7 @@ static unsigned long shrink_page_list(struct list_head *page_list,
 			}
 		}
 
+lazyfree:
 		if (!mapping || !__remove_mapping(mapping, page, true))
 			goto keep_locked;
 
@@ -1259,6 +1271,65 @@ unsigned long reclaim_clean_pages_from_list(struct zone *zone,
 	return ret;
 }
 
+static unsigned long reclaim_zone_pages(struct zone *zone,
+					struct list_head *page_list)
+{
+	struct scan_control sc = {
+		.gfp_mask = GFP_KERNEL,
+		.priority = DEF_PRIORITY,
+		.may_writepage = 1,
+		.may_unmap = 1,
+		.may_swap = 1,
+	};
+	unsigned long ret, dummy1, dummy2, dummy3, dummy4, dummy5;
+	struct page *page;
+
+	ret = shrink_page_list(page_list, zone, &sc, TTU_UNMAP,
+			&dummy1, &dummy2, &dummy3, &dummy4, &dummy5, false);
+
+	while (!list_empty(page_list)) {
+		page = lru_to_page(page_list);
+		list_del(&page->lru);
+		putback_lru_page(page);
+	}
+	return ret;
+}
+
+/*
+ * reclaim_pages - reclaim a list of pages isolated with isolate_lru_page()
+ *
+ * Used by madvise(MADV_PAGEOUT): the pages are unmapped and written out
+ * or freed through shrink_page_list(), zone by zone, and the ones that
+ * cannot be reclaimed are put back on the LRU.
+ */
+unsigned long reclaim_pages(struct list_head *page_list)
+{
+	struct zone *zone = NULL;
+	unsigned long nr_reclaimed = 0;
+	LIST_HEAD(zone_page_list);
+	struct page *page;
+
+	while (!list_empty(page_list)) {
+		page = lru_to_page(page_list);
+		if (!zone)
+			zone = page_zone(page);
+
+		if (zone == page_zone(page)) {
+			ClearPageActive(page);
+			list_move(&page->lru, &zone_page_list);
+			continue;
+		}
+
+		nr_reclaimed += reclaim_zone_pages(zone, &zone_page_list);
+		zone = NULL;
+	}
+
+	if (!list_empty(&zone_page_list))
+		nr_reclaimed += reclaim_zone_pages(zone, &zone_page_list);
+
+	return nr_reclaimed;
+}
+
 /*
  * Attempt to remove the specified page from its LRU.  Only take this page
  * if it is of the appropriate PageActive status.  Pages which are being
@@ -1333,6 +1404,44 @@ int __isolate_lru_page(struct page *page, isolate_mode_t mode)
 	return ret;
 }
 
+#ifdef CONFIG_LRU_GEN
+/* Retire the oldest generations once they are empty */
+static void lru_gen_inc_min_seq(struct lruvec *lruvec, int type)
+{
+	struct lru_gen_struct *lrugen = &lruvec->lrugen;
+
+	while (lrugen->max_seq - lrugen->min_seq[type] + 1 > MIN_NR_GENS) {
+		int gen = lru_gen_from_seq(lrugen->min_seq[type]);
+
+		if (!list_empty(&lrugen->lists[gen][type]))
+			break;
+		WRITE_ONCE(lrugen->min_seq[type], lrugen->min_seq[type] + 1);
+	}
+}
+
+/*
+ * The generation list pages of @type are to be evicted from, or NULL if
+ * only the young generations are left and the lruvec has to be aged
+ * first.  Called with zone->lru_lock held.
+ */
+static struct list_head *lru_gen_evict_list(struct lruvec *lruvec, int type)
+{
+	struct lru_gen_struct *lrugen = &lruvec->lrugen;
+
+	lru_gen_inc_min_seq(lruvec, type);
+	if (lrugen->max_seq - lrugen->min_seq[type] + 1 <= MIN_NR_GENS)
+		return NULL;
+
+	return &lrugen->lists[lru_gen_from_seq(lrugen->min_seq[type])][type];
+}
+#else
+static inline struct list_head *lru_gen_evict_list(struct lruvec *lruvec,
+						   int type)
+{
+	return NULL;
+}
+#endif /* CONFIG_LRU_GEN */
+
 /*
  * zone->lru_lock is heavily contended.  Some of the functions that
  * shrink the lists perform better by taking out a batch of pages
@@ -1360,9 +1469,16 @@ static unsigned long isolate_lru_pages(unsigned long nr_to_scan,
 {
 	struct list_head *src = &lruvec->lists[lru];
 	unsigned long nr_taken = 0;
-	unsigned long scan;
+	unsigned long scan = 0;
 
-	for (scan = 0; scan < nr_to_scan && nr_taken < nr_to_scan &&
+	/* the inactive lists are replaced by the oldest generation */
+	if (lru_gen_enabled() && !is_active_lru(lru)) {
+		src = lru_gen_evict_list(lruvec, is_file_lru(lru));
+		if (!src)
+			goto out;
+	}
+
+	for (; scan < nr_to_scan && nr_taken < nr_to_scan &&
 					!list_empty(src); scan++) {
 		struct page *page;
 		int nr_pages;
@@ -1376,7 +1492,10 @@ static unsigned long isolate_lru_pages(unsigned long nr_to_scan,
 		case 0:
 			nr_pages = hpage_nr_pages(page);
 			mem_cgroup_update_lru_size(lruvec, lru, -nr_pages);
-			list_move(&page->lru, dst);
+			if (lru_gen_del_page(lruvec, page))
+				list_add(&page->lru, dst);
+			else
+				list_move(&page->lru, dst);
 			nr_taken += nr_pages;
 			break;
 
@@ -1390,6 +1509,7 @@ static unsigned long isolate_lru_pages(unsigned long nr_to_scan,
 		}
 	}
 
+out:
 	*nr_scanned = scan;
 	trace_mm_vmscan_lru_isolate(sc->order, nr_to_scan, scan,
 				    nr_taken, mode, is_file_lru(lru));
@@ -2048,8 +2168,10 @@ static void get_scan_count(struct lruvec *lruvec, int swappiness,
 	/*
 	 * There is enough inactive page cache, do not reclaim
 	 * anything from the anonymous working set right now.
+	 * The generation lists account all their pages as
+	 * inactive, so this does not tell anything about them.
 	 */
-	if (!inactive_file_is_low(lruvec)) {
+	if (!lru_gen_enabled() && !inactive_file_is_low(lruvec)) {
 		scan_balance = SCAN_FILE;
 		goto out;
 	}
@@ -2176,11 +2298,557 @@ static inline void init_tlb_ubc(void)
 }
 #endif /* CONFIG_ARCH_WANT_BATCHED_UNMAP_TLB_FLUSH */
 
+#ifdef CONFIG_LRU_GEN
+/*
+ * Multi-generational LRU
+ *
+ * The aging walks the page tables of the mms on lru_gen_mm_list, harvests
+ * the accessed bits a page table at a time and moves the pages found young
+ * to the youngest generation of their lruvec, then opens a new one.  It is
+ * only needed once the eviction has consumed all but MIN_NR_GENS
+ * generations, so the rmap is only consulted, by shrink_page_list(), on
+ * the pages which made it to the oldest generation.
+ */
+
+#define LRU_GEN_BATCH		64
+#define LRU_GEN_WALK_BATCH	32
+
+#ifdef CONFIG_LRU_GEN_ENABLED
+struct static_key lru_gen_key __read_mostly = STATIC_KEY_INIT_TRUE;
+#else
+struct static_key lru_gen_key __read_mostly = STATIC_KEY_INIT_FALSE;
+#endif
+
+static struct lru_gen_mm_list {
+	struct list_head	fifo;
+	unsigned long		nr;
+	spinlock_t		lock;
+	/* the mm being walked, lru_gen_del_mm() waits for it */
+	struct mm_struct	*cur;
+	wait_queue_head_t	wait;
+} lru_gen_mm_list = {
+	.fifo	= LIST_HEAD_INIT(lru_gen_mm_list.fifo),
+	.lock	= __SPIN_LOCK_UNLOCKED(lru_gen_mm_list.lock),
+	.wait	= __WAIT_QUEUE_HEAD_INITIALIZER(lru_gen_mm_list.wait),
+};
+
+/* Serializes the aging, which walks lru_gen_mm_list */
+static DEFINE_MUTEX(lru_gen_aging_mutex);
+/* Serializes switching the multi-generational LRU on and off */
+static DEFINE_MUTEX(lru_gen_state_mutex);
+
+void lru_gen_add_mm(struct mm_struct *mm)
+{
+	spin_lock(&lru_gen_mm_list.lock);
+	list_add_tail(&mm->lru_gen_list, &lru_gen_mm_list.fifo);
+	lru_gen_mm_list.nr++;
+	spin_unlock(&lru_gen_mm_list.lock);
+}
+
+/*
+ * Called before exit_mmap(), the page tables of @mm stay around for as
+ * long as the aging is walking them.
+ */
+void lru_gen_del_mm(struct mm_struct *mm)
+{
+	spin_lock(&lru_gen_mm_list.lock);
+	while (lru_gen_mm_list.cur == mm) {
+		spin_unlock(&lru_gen_mm_list.lock);
+		wait_event(lru_gen_mm_list.wait,
+			   READ_ONCE(lru_gen_mm_list.cur) != mm);
+		spin_lock(&lru_gen_mm_list.lock);
+	}
+	list_del(&mm->lru_gen_list);
+	lru_gen_mm_list.nr--;
+	spin_unlock(&lru_gen_mm_list.lock);
+}
+
+struct lru_gen_walk {
+	unsigned long nr_promoted;
+	int nr;
+	struct page *pages[LRU_GEN_WALK_BATCH];
+};
+
+/*
+ * Move the pages found young to the youngest generation of their lruvec.
+ * The page table lock mapping them is held, so they cannot be freed.
+ */
+static void lru_gen_walk_flush(struct lru_gen_walk *walk)
+{
+	struct zone *zone = NULL;
+	int i;
+
+	for (i = 0; i < walk->nr; i++) {
+		struct page *page = walk->pages[i];
+		struct zone *pagezone = page_zone(page);
+		struct lru_gen_struct *lrugen;
+		struct lruvec *lruvec;
+		int old_gen, new_gen, type;
+
+		if (pagezone != zone) {
+			if (zone)
+				spin_unlock_irq(&zone->lru_lock);
+			zone = pagezone;
+			spin_lock_irq(&zone->lru_lock);
+		}
+
+		if (!PageLRU(page))
+			continue;
+		old_gen = page_lru_gen(page);
+		if (old_gen < 0)
+			continue;
+
+		lruvec = mem_cgroup_page_lruvec(page, zone);
+		lrugen = &lruvec->lrugen;
+		new_gen = lru_gen_from_seq(lrugen->max_seq);
+		if (new_gen == old_gen)
+			continue;
+
+		type = page_is_file_cache(page);
+		lru_gen_move_page(lruvec, page, old_gen, new_gen);
+		list_move(&page->lru, &lrugen->lists[new_gen][type]);
+		/* balances anon and file reclaim, see get_scan_count() */
+		lruvec->reclaim_stat.recent_rotated[type] +=
+			hpage_nr_pages(page);
+		walk->nr_promoted += hpage_nr_pages(page);
+	}
+	if (zone)
+		spin_unlock_irq(&zone->lru_lock);
+
+	walk->nr = 0;
+}
+
+static void lru_gen_walk_add(struct lru_gen_walk *walk, struct page *page)
+{
+	walk->pages[walk->nr++] = page;
+	if (walk->nr == LRU_GEN_WALK_BATCH)
+		lru_gen_walk_flush(walk);
+}
+
+static int lru_gen_walk_pmd_range(pmd_t *pmd, unsigned long addr,
+				  unsigned long end, struct mm_walk *mm_walk)
+{
+	struct lru_gen_walk *walk = mm_walk->private;
+	struct vm_area_struct *vma = mm_walk->vma;
+	pte_t *orig_pte, *pte;
+	spinlock_t *ptl;
+
+	if (pmd_trans_huge_lock(pmd, vma, &ptl) == 1) {
+		if (pmdp_test_and_clear_young(vma, addr, pmd)) {
+			lru_gen_walk_add(walk, pmd_page(*pmd));
+			lru_gen_walk_flush(walk);
+		}
+		spin_unlock(ptl);
+		return 0;
+	}
+
+	if (pmd_trans_unstable(pmd))
+		return 0;
+
+	orig_pte = pte = pte_offset_map_lock(vma->vm_mm, pmd, addr, &ptl);
+	for (; addr != end; pte++, addr += PAGE_SIZE) {
+		pte_t ptent = *pte;
+		struct page *page;
+
+		if (!pte_present(ptent) || !pte_young(ptent))
+			continue;
+
+		page = vm_normal_page(vma, addr, ptent);
+		if (!page)
+			continue;
+
+		if (ptep_test_and_clear_young(vma, addr, pte))
+			lru_gen_walk_add(walk, page);
+	}
+	if (walk->nr)
+		lru_gen_walk_flush(walk);
+	pte_unmap_unlock(orig_pte, ptl);
+	cond_resched();
+	return 0;
+}
+
+static int lru_gen_walk_test(unsigned long start, unsigned long end,
+			     struct mm_walk *mm_walk)
+{
+	struct vm_area_struct *vma = mm_walk->vma;
+
+	/* no evictable pages there */
+	if (vma->vm_flags & (VM_SPECIAL | VM_HUGETLB | VM_LOCKED))
+		return 1;
+
+	return 0;
+}
+
+/* Walk the mms on lru_gen_mm_list which are charged to @memcg */
+static void lru_gen_walk_mms(struct mem_cgroup *memcg)
+{
+	struct lru_gen_mm_list *mm_list = &lru_gen_mm_list;
+	struct lru_gen_walk walk = {};
+	struct mm_walk mm_walk = {
+		.pmd_entry = lru_gen_walk_pmd_range,
+		.test_walk = lru_gen_walk_test,
+		.private = &walk,
+	};
+	unsigned long nr;
+
+	spin_lock(&mm_list->lock);
+	nr = mm_list->nr;
+	spin_unlock(&mm_list->lock);
+
+	while (nr--) {
+		struct mm_struct *mm;
+
+		spin_lock(&mm_list->lock);
+		if (list_empty(&mm_list->fifo)) {
+			spin_unlock(&mm_list->lock);
+			break;
+		}
+		mm = list_first_entry(&mm_list->fifo, struct mm_struct,
+				      lru_gen_list);
+		list_move_tail(&mm->lru_gen_list, &mm_list->fifo);
+		mm_list->cur = mm;
+		spin_unlock(&mm_list->lock);
+
+		if (atomic_read(&mm->mm_users) &&
+		    (!memcg || mm_match_cgroup(mm, memcg)) &&
+		    down_read_trylock(&mm->mmap_sem)) {
+			mm_walk.mm = mm;
+			walk_page_range(0, mm->highest_vm_end, &mm_walk);
+			up_read(&mm->mmap_sem);
+		}
+
+		spin_lock(&mm_list->lock);
+		mm_list->cur = NULL;
+		spin_unlock(&mm_list->lock);
+		wake_up_all(&mm_list->wait);
+
+		cond_resched();
+	}
+
+	count_vm_events(PGACTIVATE, walk.nr_promoted);
+}
+
+/*
+ * Make room for a new generation by moving the pages of the oldest one
+ * into the next.  Returns false if it has to be called again, after the
+ * lru_lock has been dropped for a while.
+ */
+static bool lru_gen_fold_oldest(struct lruvec *lruvec, int type)
+{
+	struct lru_gen_struct *lrugen = &lruvec->lrugen;
+	int old_gen = lru_gen_from_seq(lrugen->min_seq[type]);
+	int new_gen = lru_gen_from_seq(lrugen->min_seq[type] + 1);
+	struct list_head *head = &lrugen->lists[old_gen][type];
+	int batch = 0;
+
+	while (!list_empty(head)) {
+		struct page *page = list_first_entry(head, struct page, lru);
+
+		lru_gen_move_page(lruvec, page, old_gen, new_gen);
+		list_move_tail(&page->lru, &lrugen->lists[new_gen][type]);
+		if (++batch == LRU_GEN_BATCH)
+			return false;
+	}
+
+	WRITE_ONCE(lrugen->min_seq[type], lrugen->min_seq[type] + 1);
+	return true;
+}
+
+static void lru_gen_age(struct lruvec *lruvec, struct mem_cgroup *memcg)
+{
+	struct lru_gen_struct *lrugen = &lruvec->lrugen;
+	struct zone *zone = lruvec_zone(lruvec);
+	unsigned long max_seq = READ_ONCE(lrugen->max_seq);
+	int type;
+
+	mutex_lock(&lru_gen_aging_mutex);
+
+	/* aged by somebody else while we were waiting */
+	if (max_seq != READ_ONCE(lrugen->max_seq))
+		goto unlock;
+
+	lru_gen_walk_mms(memcg);
+
+	spin_lock_irq(&zone->lru_lock);
+	for (type = 0; type < 2; type++) {
+		while (lrugen->max_seq - lrugen->min_seq[type] + 1 >=
+		       MAX_NR_GENS) {
+			if (lru_gen_fold_oldest(lruvec, type))
+				continue;
+			spin_unlock_irq(&zone->lru_lock);
+			cond_resched();
+			spin_lock_irq(&zone->lru_lock);
+		}
+	}
+	WRITE_ONCE(lrugen->max_seq, lrugen->max_seq + 1);
+	spin_unlock_irq(&zone->lru_lock);
+unlock:
+	mutex_unlock(&lru_gen_aging_mutex);
+}
+
+static bool lru_gen_need_aging(struct lruvec *lruvec, int type)
+{
+	struct zone *zone = lruvec_zone(lruvec);
+	bool need_aging;
+
+	spin_lock_irq(&zone->lru_lock);
+	need_aging = !lru_gen_evict_list(lruvec, type);
+	spin_unlock_irq(&zone->lru_lock);
+
+	return need_aging;
+}
+
+/*
+ * Move the pages on the active and inactive lists to the generation lists,
+ * or the other way around.  Pages can be found on the lists which are not
+ * in use for a short while after the mode has been switched.
+ */
+static void lru_gen_fill_lruvec(struct lruvec *lruvec)
+{
+	struct zone *zone = lruvec_zone(lruvec);
+	enum lru_list lru;
+	int batch = 0;
+
+	spin_lock_irq(&zone->lru_lock);
+	for_each_evictable_lru(lru) {
+		struct list_head *head = &lruvec->lists[lru];
+
+		while (!list_empty(head) && lru_gen_enabled()) {
+			struct page *page = lru_to_page(head);
+
+			VM_BUG_ON_PAGE(!PageLRU(page), page);
+			del_page_from_lru_list(page, lruvec, lru);
+			add_page_to_lru_list(page, lruvec, lru);
+
+			if (++batch % LRU_GEN_BATCH == 0) {
+				spin_unlock_irq(&zone->lru_lock);
+				cond_resched();
+				spin_lock_irq(&zone->lru_lock);
+			}
+		}
+	}
+	spin_unlock_irq(&zone->lru_lock);
+}
+
+static void lru_gen_drain_lruvec(struct lruvec *lruvec)
+{
+	struct lru_gen_struct *lrugen = &lruvec->lrugen;
+	struct zone *zone = lruvec_zone(lruvec);
+	int batch = 0;
+	int type;
+
+	spin_lock_irq(&zone->lru_lock);
+	for (type = 0; type < 2; type++) {
+		unsigned long seq;
+
+		/* oldest first, so that they end up at the tail */
+		for (seq = lrugen->min_seq[type]; seq <= lrugen->max_seq;
+		     seq++) {
+			int gen = lru_gen_from_seq(seq);
+			struct list_head *head = &lrugen->lists[gen][type];
+
+			while (!list_empty(head) && !lru_gen_enabled()) {
+				struct page *page = lru_to_page(head);
+				enum lru_list lru = page_lru_base_type(page);
+
+				VM_BUG_ON_PAGE(!PageLRU(page), page);
+				del_page_from_lru_list(page, lruvec, lru);
+				if (seq == lrugen->max_seq)
+					SetPageActive(page);
+				add_page_to_lru_list(page, lruvec,
+						     page_lru(page));
+
+				if (++batch % LRU_GEN_BATCH == 0) {
+					spin_unlock_irq(&zone->lru_lock);
+					cond_resched();
+					spin_lock_irq(&zone->lru_lock);
+				}
+			}
+		}
+	}
+	spin_unlock_irq(&zone->lru_lock);
+}
+
+static bool lru_gen_lruvec_empty(struct lruvec *lruvec)
+{
+	int gen, type;
+
+	for (gen = 0; gen < MAX_NR_GENS; gen++)
+		for (type = 0; type < 2; type++)
+			if (!list_empty(&lruvec->lrugen.lists[gen][type]))
+				return false;
+
+	return true;
+}
+
+static bool lru_gen_lruvec_stray(struct lruvec *lruvec)
+{
+	enum lru_list lru;
+
+	for_each_evictable_lru(lru)
+		if (!list_empty(&lruvec->lists[lru]))
+			return true;
+
+	return false;
+}
+
+static void lru_gen_change_state(bool enable)
+{
+	struct zone *zone;
+
+	mutex_lock(&lru_gen_state_mutex);
+	if (enable == lru_gen_enabled())
+		goto unlock;
+
+	if (enable)
+		static_key_slow_inc(&lru_gen_key);
+	else
+		static_key_slow_dec(&lru_gen_key);
+
+	for_each_populated_zone(zone) {
+		struct mem_cgroup *memcg = mem_cgroup_iter(NULL, NULL, NULL);
+
+		do {
+			struct lruvec *lruvec;
+
+			lruvec = mem_cgroup_zone_lruvec(zone, memcg);
+			if (enable)
+				lru_gen_fill_lruvec(lruvec);
+			else
+				lru_gen_drain_lruvec(lruvec);
+		} while ((memcg = mem_cgroup_iter(NULL, memcg, NULL)));
+	}
+unlock:
+	mutex_unlock(&lru_gen_state_mutex);
+}
+
+/*
+ * Evict from the oldest generations, aging the lruvec whenever only the
+ * young ones are left.  The anon and file balance is the one the classic
+ * LRU would have used.
+ */
+static void lru_gen_shrink_lruvec(struct lruvec *lruvec,
+				  struct mem_cgroup *memcg, int swappiness,
+				  struct scan_control *sc,
+				  unsigned long *lru_pages)
+{
+	unsigned long nr[NR_LRU_LISTS];
+	unsigned long nr_reclaimed = 0;
+	unsigned long nr_to_reclaim = sc->nr_to_reclaim;
+	struct blk_plug plug;
+
+	if (unlikely(lru_gen_lruvec_stray(lruvec)))
+		lru_gen_fill_lruvec(lruvec);
+
+	get_scan_count(lruvec, swappiness, sc, nr, lru_pages);
+
+	init_tlb_ubc();
+
+	blk_start_plug(&plug);
+	while (nr[LRU_INACTIVE_ANON] || nr[LRU_INACTIVE_FILE]) {
+		enum lru_list lru;
+
+		for (lru = LRU_INACTIVE_ANON; lru <= LRU_INACTIVE_FILE;
+		     lru += LRU_FILE) {
+			unsigned long nr_to_scan;
+
+			if (!nr[lru])
+				continue;
+
+			if (lru_gen_need_aging(lruvec, is_file_lru(lru)))
+				lru_gen_age(lruvec, memcg);
+
+			nr_to_scan = min(nr[lru], SWAP_CLUSTER_MAX);
+			nr[lru] -= nr_to_scan;
+			nr_reclaimed += shrink_inactive_list(nr_to_scan, lruvec,
+							     sc, lru);
+		}
+
+		if (nr_reclaimed >= nr_to_reclaim)
+			break;
+	}
+	blk_finish_plug(&plug);
+	sc->nr_reclaimed += nr_reclaimed;
+
+	throttle_vm_writeout(sc->gfp_mask);
+}
+
+#ifdef CONFIG_SYSFS
+static ssize_t lru_gen_enabled_show(struct kobject *kobj,
+				    struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%d\n", lru_gen_enabled());
+}
+
+static ssize_t lru_gen_enabled_store(struct kobject *kobj,
+				     struct kobj_attribute *attr,
+				     const char *buf, size_t count)
+{
+	unsigned int enable;
+	int err;
+
+	err = kstrtouint(buf, 10, &enable);
+	if (err)
+		return err;
+	if (enable > 1)
+		return -EINVAL;
+
+	lru_gen_change_state(enable);
+	return count;
+}
+
+static struct kobj_attribute lru_gen_enabled_attr =
+	__ATTR(enabled, 0644, lru_gen_enabled_show, lru_gen_enabled_store);
+
+static struct attribute *lru_gen_attrs[] = {
+	&lru_gen_enabled_attr.attr,
+	NULL,
+};
+
+static struct attribute_group lru_gen_attr_group = {
+	.name = "lru_gen",
+	.attrs = lru_gen_attrs,
+};
+
+static int __init lru_gen_init(void)
+{
+	int err;
+
+	err = sysfs_create_group(mm_kobj, &lru_gen_attr_group);
+	if (err)
+		pr_err("failed to register lru_gen group\n");
+	return err;
+}
+module_init(lru_gen_init)
+#endif /* CONFIG_SYSFS */
+
+#else /* CONFIG_LRU_GEN */
+
+static inline bool lru_gen_lruvec_empty(struct lruvec *lruvec)
+{
+	return true;
+}
+
+static inline void lru_gen_drain_lruvec(struct lruvec *lruvec)
+{
+}
+
+static inline void lru_gen_shrink_lruvec(struct lruvec *lruvec,
+					 struct mem_cgroup *memcg,
+					 int swappiness,
+					 struct scan_control *sc,
+					 unsigned long *lru_pages)
+{
+}
+
+#endif /* CONFIG_LRU_GEN */
+
 /*
  * This is a basic per-zone page freer.  Used by both kswapd and direct reclaim.
  */
-static void shrink_lruvec(struct lruvec *lruvec, int swappiness,
-			  struct scan_control *sc, unsigned long *lru_pages)
+static void shrink_lruvec(struct lruvec *lruvec, struct mem_cgroup *memcg,
+			  int swappiness, struct scan_control *sc,
+			  unsigned long *lru_pages)
 {
 	unsigned long nr[NR_LRU_LISTS];
 	unsigned long targets[NR_LRU_LISTS];
@@ -2191,6 +2859,15 @@ static void shrink_lruvec(struct lruvec *lruvec, int swappiness,
 	struct blk_plug plug;
 	bool scan_adjusted;
 
+	if (lru_gen_enabled()) {
+		lru_gen_shrink_lruvec(lruvec, memcg, swappiness, sc, lru_pages);
+		return;
+	}
+
+	/* left over from the multi-generational LRU */
+	if (unlikely(!lru_gen_lruvec_empty(lruvec)))
+		lru_gen_drain_lruvec(lruvec);
+
 	get_scan_count(lruvec, swappiness, sc, nr, lru_pages);
 
 	/* Record the original scan target for proportional adjustments later */
@@ -2407,7 +3084,7 @@ static bool shrink_zone(struct zone *zone, struct scan_control *sc,
 			swappiness = mem_cgroup_swappiness(memcg);
 			scanned = sc->nr_scanned;
 
-			shrink_lruvec(lruvec, swappiness, sc, &lru_pages);
+			shrink_lruvec(lruvec, memcg, swappiness, sc, &lru_pages);
 			zone_lru_pages += lru_pages;
 
 			if (memcg && is_classzone)
@@ -2827,6 +3504,7 @@ unsigned long try_to_free_pages(struct zonelist *zonelist, int order,
 				gfp_t gfp_mask, nodemask_t *nodemask)
 {
 	unsigned long nr_reclaimed;
+	unsigned long pflags;
 	struct scan_control sc = {
 		.nr_to_reclaim = SWAP_CLUSTER_MAX,
 		.gfp_mask = (gfp_mask = memalloc_noio_flags(gfp_mask)),
@@ -2850,7 +3528,9 @@ unsigned long try_to_free_pages(struct zonelist *zonelist, int order,
 				sc.may_writepage,
 				gfp_mask);
 
+	psi_memstall_enter(&pflags);
 	nr_reclaimed = do_try_to_free_pages(zonelist, &sc);
+	psi_memstall_leave(&pflags);
 
 	trace_mm_vmscan_direct_reclaim_end(nr_reclaimed);
 
@@ -2889,7 +3569,7 @@ unsigned long mem_cgroup_shrink_node_zone(struct mem_cgroup *memcg,
 	 * will pick up pages from other mem cgroup's as well. We hack
 	 * the priority and make it zero.
 	 */
-	shrink_lruvec(lruvec, swappiness, &sc, &lru_pages);
+	shrink_lruvec(lruvec, memcg, swappiness, &sc, &lru_pages);
 
 	trace_mm_vmscan_memcg_softlimit_reclaim_end(sc.nr_reclaimed);
 
@@ -2904,6 +3584,7 @@ unsigned long try_to_free_mem_cgroup_pages(struct mem_cgroup *memcg,
 {
 	struct zonelist *zonelist;
 	unsigned long nr_reclaimed;
+	unsigned long pflags;
 	int nid;
 	struct scan_control sc = {
 		.nr_to_reclaim = max(nr_pages, SWAP_CLUSTER_MAX),
@@ -2929,7 +3610,9 @@ unsigned long try_to_free_mem_cgroup_pages(struct mem_cgroup *memcg,
 					    sc.may_writepage,
 					    sc.gfp_mask);
 
+	psi_memstall_enter(&pflags);
 	nr_reclaimed = do_try_to_free_pages(zonelist, &sc);
+	psi_memstall_leave(&pflags);
 
 	trace_mm_vmscan_memcg_reclaim_end(nr_reclaimed);
 
@@ -3353,6 +4036,12 @@ static void kswapd_try_to_sleep(pg_data_t *pgdat, int order, int classzone_idx)
 
 	/* Try to sleep for a short interval */
 	if (prepare_kswapd_sleep(pgdat, order, remaining, classzone_idx)) {
+		/*
+		 * We have freed the memory, now we should compact it to make
+		 * allocation of the requested order possible.
+		 */
+		wakeup_kcompactd(pgdat, order, classzone_idx);
+
 		remaining = schedule_timeout(HZ/10);
 		finish_wait(&pgdat->kswapd_wait, &wait);
 		prepare_to_wait(&pgdat->kswapd_wait, &wait, TASK_INTERRUPTIBLE);
@@ -3415,6 +4104,7 @@ static int kswapd(void *p)
 	unsigned balanced_order;
 	int classzone_idx, new_classzone_idx;
 	int balanced_classzone_idx;
+	unsigned long pflags;
 	pg_data_t *pgdat = (pg_data_t*)p;
 	struct task_struct *tsk = current;
 
@@ -3493,8 +4183,10 @@ static int kswapd(void *p)
 		if (!ret) {
 			trace_mm_vmscan_kswapd_wake(pgdat->node_id, order);
 			balanced_classzone_idx = classzone_idx;
+			psi_memstall_enter(&pflags);
 			balanced_order = balance_pgdat(pgdat, order,
 						&balanced_classzone_idx);
+			psi_memstall_leave(&pflags);
 		}
 	}
 
@@ -30,6 +30,8 @@
 
 #include "internal.h"
 
+int sysctl_stat_interval __read_mostly = HZ;
+
 #ifdef CONFIG_VM_EVENT_COUNTERS
 DEFINE_PER_CPU(struct vm_event_state, vm_event_states) = {{0}};
 EXPORT_PER_CPU_SYMBOL(vm_event_states);
@@ -459,8 +461,11 @@ static int fold_diff(int *diff)
  * bouncing and will have to be only done when necessary.
  *
  * The function returns the number of global counters updated.
+ *
+ * With @do_pagesets false it neither drains remote pagesets nor
+ * reschedules, which makes it usable with interrupts disabled.
  */
-static int refresh_cpu_vm_stats(void)
+static int refresh_cpu_vm_stats(bool do_pagesets)
 {
 	struct zone *zone;
 	int i;
@@ -484,6 +489,8 @@ static int refresh_cpu_vm_stats(void)
 #endif
 			}
 		}
+		if (!do_pagesets)
+			continue;
 		cond_resched();
 #ifdef CONFIG_NUMA
 		/*
@@ -685,6 +692,24 @@ static int __fragmentation_index(unsigned int order, struct contig_page_info *in
 	return 1000 - div_u64( (1000+(div_u64(info->free_pages * 1000ULL, requested))), info->free_blocks_total);
 }
 
+/*
+ * Calculates external fragmentation within a zone wrt the given order.
+ * It is defined as the percentage of pages found in blocks of size
+ * less than 1 << order. It returns values in range [0, 100].
+ */
+unsigned int extfrag_for_order(struct zone *zone, unsigned int order)
+{
+	struct contig_page_info info;
+
+	fill_contig_page_info(zone, order, &info);
+	if (info.free_pages == 0)
+		return 0;
+
+	return div_u64((info.free_pages -
+			(info.free_blocks_suitable << order)) * 100,
+			info.free_pages);
+}
+
 /* Same as __fragmentation index but allocs contig_page_info on stack */
 int fragmentation_index(struct zone *zone, unsigned int order)
 {
@@ -760,6 +785,8 @@ const char * const vmstat_text[] = {
 	"workingset_activate",
 	"workingset_nodereclaim",
 	"nr_anon_transparent_hugepages",
+	"nr_shmem_hugepages",
+	"nr_shmem_pmdmapped",
 	"nr_free_cma",
 
 	/* enum writeback_stat_item counters */
@@ -801,6 +828,7 @@ const char * const vmstat_text[] = {
 	"allocstall",
 
 	"pgrotated",
+	"pglazyfreed",
 
 	"drop_pagecache",
 	"drop_slab",
@@ -823,6 +851,7 @@ const char * const vmstat_text[] = {
 	"compact_stall",
 	"compact_fail",
 	"compact_success",
+	"compact_daemon_wake",
 #endif
 
 #ifdef CONFIG_HUGETLB_PAGE
@@ -840,6 +869,8 @@ const char * const vmstat_text[] = {
 #ifdef CONFIG_TRANSPARENT_HUGEPAGE
 	"thp_fault_alloc",
 	"thp_fault_fallback",
+	"thp_file_alloc",
+	"thp_file_mapped",
 	"thp_collapse_alloc",
 	"thp_collapse_alloc_failed",
 	"thp_split",
@@ -1301,6 +1332,33 @@ enum writeback_stat_item {
 	NR_VM_WRITEBACK_STAT_ITEMS,
 };
 
+#ifdef CONFIG_VM_EVENT_COUNTERS
+/*
+ * Summing the event counters of every cpu is what makes a read of
+ * /proc/vmstat expensive on large machines.  Readers within
+ * sysctl_stat_interval of the last sum share it: the zone counters next
+ * to them lag by as much already.
+ */
+static unsigned long vm_events_snapshot[NR_VM_EVENT_ITEMS];
+static unsigned long vm_events_snapshot_time;
+static bool vm_events_snapshot_valid;
+static DEFINE_MUTEX(vm_events_snapshot_lock);
+
+static void snapshot_vm_events(unsigned long *ret)
+{
+	mutex_lock(&vm_events_snapshot_lock);
+	if (!vm_events_snapshot_valid ||
+	    time_after_eq(jiffies, vm_events_snapshot_time +
+				   sysctl_stat_interval)) {
+		all_vm_events(vm_events_snapshot);
+		vm_events_snapshot_time = jiffies;
+		vm_events_snapshot_valid = true;
+	}
+	memcpy(ret, vm_events_snapshot, sizeof(vm_events_snapshot));
+	mutex_unlock(&vm_events_snapshot_lock);
+}
+#endif
+
 static void *vmstat_start(struct seq_file *m, loff_t *pos)
 {
 	unsigned long *v;
@@ -1328,7 +1386,7 @@ static void *vmstat_start(struct seq_file *m, loff_t *pos)
 	v += NR_VM_WRITEBACK_STAT_ITEMS;
 
 #ifdef CONFIG_VM_EVENT_COUNTERS
-	all_vm_events(v);
+	snapshot_vm_events(v);
 	v[PGPGIN] /= 2;		/* sectors -> kbytes */
 	v[PGPGOUT] /= 2;
 #endif
@@ -1381,12 +1439,11 @@ static const struct file_operations proc_vmstat_file_operations = {
 #ifdef CONFIG_SMP
 static struct workqueue_struct *vmstat_wq;
 static DEFINE_PER_CPU(struct delayed_work, vmstat_work);
-int sysctl_stat_interval __read_mostly = HZ;
 static cpumask_var_t cpu_stat_off;
 
 static void vmstat_update(struct work_struct *w)
 {
-	if (refresh_cpu_vm_stats()) {
+	if (refresh_cpu_vm_stats(true)) {
 		/*
 		 * Counters were updated so we expect more updates
 		 * to occur in the future. Keep on running the
@@ -1402,18 +1459,11 @@ static void vmstat_update(struct work_struct *w)
 		 * We may be uselessly running vmstat_update.
 		 * Defer the checking for differentials to the
 		 * shepherd thread on a different processor.
+		 *
+		 * quiet_vmstat() may have handed the cpu over
+		 * already, so the bit can be set.
 		 */
-		int r;
-		/*
-		 * Shepherd work thread does not race since it never
-		 * changes the bit if its zero but the cpu
-		 * online / off line code may race if
-		 * worker threads are still allowed during
-		 * shutdown / startup.
-		 */
-		r = cpumask_test_and_set_cpu(smp_processor_id(),
-			cpu_stat_off);
-		VM_BUG_ON(r);
+		cpumask_set_cpu(smp_processor_id(), cpu_stat_off);
 	}
 }
 
@@ -1440,6 +1490,27 @@ static bool need_update(int cpu)
 	return false;
 }
 
+/*
+ * Called when the tick stops on this cpu, for idle or for a nohz_full
+ * task.  Fold the differentials now and leave the cpu to the shepherd,
+ * so that vmstat_update does not have to come back to it later.  The
+ * pending vmstat_update, if any, is left alone: it is deferrable, and
+ * cancelling it from here would cost more than letting it run.
+ */
+void quiet_vmstat(void)
+{
+	if (system_state != SYSTEM_RUNNING)
+		return;
+
+	/* Already in the hands of the shepherd, nothing to fold. */
+	if (cpumask_test_and_set_cpu(smp_processor_id(), cpu_stat_off))
+		return;
+
+	if (!need_update(smp_processor_id()))
+		return;
+
+	refresh_cpu_vm_stats(false);
+}
 
 /*
  * Shepherd worker thread that checks the
@@ -1476,7 +1547,7 @@ static void __init start_shepherd_timer(void)
 	int cpu;
 
 	for_each_possible_cpu(cpu)
-		INIT_DELAYED_WORK(per_cpu_ptr(&vmstat_work, cpu),
+		INIT_DEFERRABLE_WORK(per_cpu_ptr(&vmstat_work, cpu),
 			vmstat_update);
 
 	if (!alloc_cpumask_var(&cpu_stat_off, GFP_KERNEL))
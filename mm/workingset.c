@@ -12,6 +12,7 @@
 #include <linux/swap.h>
 #include <linux/fs.h>
 #include <linux/mm.h>
+#include <linux/mm_inline.h>
 
 /*
  *		Double CLOCK lists
@@ -231,12 +232,24 @@ void *workingset_eviction(struct address_space *mapping, struct page *page)
 bool workingset_refault(void *shadow)
 {
 	unsigned long refault_distance;
+	unsigned long protected;
 	struct zone *zone;
 
 	unpack_shadow(shadow, &zone, &refault_distance);
 	inc_zone_state(zone, WORKINGSET_REFAULT);
 
-	if (refault_distance <= zone_page_state(zone, NR_ACTIVE_FILE)) {
+	/*
+	 * The multi-generational LRU has no active list and accounts
+	 * all its pages as inactive.  There, pages refaulting within
+	 * the size of the file LRU are activated, which puts them in
+	 * the youngest generation.
+	 */
+	if (lru_gen_enabled())
+		protected = zone_page_state(zone, NR_INACTIVE_FILE);
+	else
+		protected = zone_page_state(zone, NR_ACTIVE_FILE);
+
+	if (refault_distance <= protected) {
 		inc_zone_state(zone, WORKINGSET_ACTIVATE);
 		return true;
 	}
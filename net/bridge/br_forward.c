@@ -120,6 +120,8 @@ static void __br_forward(const struct net_bridge_port *to, struct sk_buff *skb)
 	indev = skb->dev;
 	skb->dev = to->dev;
 	skb_forward_csum(skb);
+	/* The receive timestamp is not a departure time */
+	skb->tstamp.tv64 = 0;
 
 	NF_HOOK(NFPROTO_BRIDGE, NF_BR_FORWARD,
 		dev_net(indev), NULL, skb, indev, skb->dev,
@@ -196,7 +196,10 @@ int br_handle_frame_finish(struct net *net, struct sock *sk, struct sk_buff *skb
 
 	if (skb) {
 		if (dst) {
-			dst->used = jiffies;
+			unsigned long now = jiffies;
+
+			if (now != dst->used)
+				dst->used = now;
 			br_forward(dst->dst, skb, skb2);
 		} else
 			br_flood_forward(br, skb, skb2, unicast);
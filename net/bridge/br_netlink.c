@@ -1138,7 +1138,7 @@ static int br_fill_info(struct sk_buff *skb, const struct net_device *brdev)
 	clockval = br_timer_value(&br->topology_change_timer);
 	if (nla_put_u64(skb, IFLA_BR_TOPOLOGY_CHANGE_TIMER, clockval))
 		return -EMSGSIZE;
-	clockval = br_timer_value(&br->gc_timer);
+	clockval = br_timer_value(&br->gc_work.timer);
 	if (nla_put_u64(skb, IFLA_BR_GC_TIMER, clockval))
 		return -EMSGSIZE;
 
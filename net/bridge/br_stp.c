@@ -590,7 +590,7 @@ int br_set_ageing_time(struct net_bridge *br, u32 ageing_time)
 		return err;
 
 	br->ageing_time = t;
-	mod_timer(&br->gc_timer, jiffies);
+	mod_delayed_work(system_long_wq, &br->gc_work, 0);
 
 	return 0;
 }
@@ -155,7 +155,7 @@ void br_stp_timer_init(struct net_bridge *br)
 		      br_topology_change_timer_expired,
 		      (unsigned long) br);
 
-	setup_timer(&br->gc_timer, br_fdb_cleanup, (unsigned long) br);
+	INIT_DELAYED_WORK(&br->gc_work, br_fdb_cleanup);
 }
 
 void br_stp_port_timer_init(struct net_bridge_port *p)
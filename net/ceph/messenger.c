@@ -296,8 +296,14 @@ int ceph_msgr_init(void)
 	/*
 	 * The number of active work items is limited by the number of
 	 * connections, so leave @max_active at default.
+	 *
+	 * Connection work is queued from the socket callbacks, i.e. on
+	 * whichever CPU took the network interrupt.  Keep it unbound so
+	 * that busy connections are processed on different CPUs instead
+	 * of queueing up behind each other on that one.
 	 */
-	ceph_msgr_wq = alloc_workqueue("ceph-msgr", WQ_MEM_RECLAIM, 0);
+	ceph_msgr_wq = alloc_workqueue("ceph-msgr",
+				       WQ_UNBOUND | WQ_MEM_RECLAIM, 0);
 	if (ceph_msgr_wq)
 		return 0;
 
@@ -535,8 +541,13 @@ static int ceph_tcp_recvmsg(struct socket *sock, void *buf, size_t len)
 	return r;
 }
 
+/*
+ * Receive straight into a data page.  If @crc is given, it is updated
+ * over whatever arrived while the page is still mapped and the bytes
+ * are still in cache, instead of mapping and reading the page again.
+ */
 static int ceph_tcp_recvpage(struct socket *sock, struct page *page,
-		     int page_offset, size_t length)
+		     int page_offset, size_t length, u32 *crc)
 {
 	void *kaddr;
 	int ret;
@@ -546,6 +557,8 @@ static int ceph_tcp_recvpage(struct socket *sock, struct page *page,
 	kaddr = kmap(page);
 	BUG_ON(!kaddr);
 	ret = ceph_tcp_recvmsg(sock, kaddr + page_offset, length);
+	if (ret > 0 && crc)
+		*crc = crc32c(*crc, kaddr + page_offset, ret);
 	kunmap(page);
 
 	return ret;
@@ -2276,7 +2289,8 @@ static int read_partial_msg_data(struct ceph_connection *con)
 		crc = con->in_data_crc;
 	while (cursor->resid) {
 		page = ceph_msg_data_next(cursor, &page_offset, &length, NULL);
-		ret = ceph_tcp_recvpage(con->sock, page, page_offset, length);
+		ret = ceph_tcp_recvpage(con->sock, page, page_offset, length,
+					do_datacrc ? &crc : NULL);
 		if (ret <= 0) {
 			if (do_datacrc)
 				con->in_data_crc = crc;
@@ -2284,8 +2298,6 @@ static int read_partial_msg_data(struct ceph_connection *con)
 			return ret;
 		}
 
-		if (do_datacrc)
-			crc = ceph_crc32c_page(crc, page, page_offset, ret);
 		(void) ceph_msg_data_advance(cursor, (size_t)ret);
 	}
 	if (do_datacrc)
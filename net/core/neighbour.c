@@ -51,6 +51,9 @@ do {						\
 
 #define PNEIGH_HASHMASK		0xF
 
+/* Entries neigh_periodic_work() looks at before it drops tbl->lock */
+#define NEIGH_GC_BATCH		256
+
 static void neigh_timer_handler(unsigned long arg);
 static void __neigh_notify(struct neighbour *n, int type, int flags);
 static void neigh_update_notify(struct neighbour *neigh);
@@ -62,6 +65,8 @@ static const struct file_operations neigh_stat_seq_fops;
 
 /*
    Neighbour hash table buckets are protected with rwlock tbl->lock.
+   So is tbl->gc_list, which links all entries the garbage collectors
+   may reclaim, i.e. all but the NUD_PERMANENT ones.
 
    - All the scans/updates to hash buckets MUST be made under this lock.
    - NOTHING clever should be made under this lock: no callbacks
@@ -116,42 +121,122 @@ unsigned long neigh_rand_reach_time(unsigned long base)
 EXPORT_SYMBOL(neigh_rand_reach_time);
 
 
+/* Called with tbl->lock held for writing, once @n is out of the hash */
+static void neigh_mark_dead(struct neighbour *n)
+{
+	n->dead = 1;
+	if (!list_empty(&n->gc_list)) {
+		list_del_init(&n->gc_list);
+		atomic_dec(&n->tbl->gc_entries);
+	}
+}
+
+static void neigh_update_gc_list(struct neighbour *n)
+{
+	bool on_gc_list, exempt_from_gc;
+
+	write_lock_bh(&n->tbl->lock);
+	write_lock(&n->lock);
+
+	/* Remove from the gc list if the entry became permanent, add it
+	 * back once it is not anymore.
+	 */
+	if (n->dead)
+		goto out;
+
+	exempt_from_gc = n->nud_state & NUD_PERMANENT;
+	on_gc_list = !list_empty(&n->gc_list);
+
+	if (exempt_from_gc && on_gc_list) {
+		list_del_init(&n->gc_list);
+		atomic_dec(&n->tbl->gc_entries);
+	} else if (!exempt_from_gc && !on_gc_list) {
+		list_add_tail(&n->gc_list, &n->tbl->gc_list);
+		atomic_inc(&n->tbl->gc_entries);
+	}
+out:
+	write_unlock(&n->lock);
+	write_unlock_bh(&n->tbl->lock);
+}
+
+/*
+ * Unlink @n, found at @np, if nobody refers to it and it is not
+ * permanent.  Called with tbl->lock held for writing.
+ */
+static bool neigh_del(struct neighbour *n, struct neighbour __rcu **np,
+		      struct neigh_table *tbl)
+{
+	bool retval = false;
+
+	write_lock(&n->lock);
+	if (atomic_read(&n->refcnt) == 1 &&
+	    !(n->nud_state & NUD_PERMANENT)) {
+		rcu_assign_pointer(*np,
+			rcu_dereference_protected(n->next,
+						  lockdep_is_held(&tbl->lock)));
+		neigh_mark_dead(n);
+		retval = true;
+	}
+	write_unlock(&n->lock);
+	if (retval)
+		neigh_cleanup_and_release(n);
+	return retval;
+}
+
+static bool neigh_remove_one(struct neighbour *ndel, struct neigh_table *tbl)
+{
+	struct neigh_hash_table *nht;
+	struct neighbour __rcu **np;
+	struct neighbour *n;
+	u32 hash_val;
+
+	nht = rcu_dereference_protected(tbl->nht,
+					lockdep_is_held(&tbl->lock));
+	hash_val = tbl->hash(ndel->primary_key, ndel->dev, nht->hash_rnd);
+	hash_val = hash_val >> (32 - nht->hash_shift);
+
+	np = &nht->hash_buckets[hash_val];
+	while ((n = rcu_dereference_protected(*np,
+				lockdep_is_held(&tbl->lock))) != NULL) {
+		if (n == ndel)
+			return neigh_del(n, np, tbl);
+		np = &n->next;
+	}
+	return false;
+}
+
+/*
+ * Bring the number of reclaimable entries back to gc_thresh2.  Only the
+ * gc list is walked, oldest entries first, and entries updated in the
+ * last five seconds are kept so that a burst of resolutions does not
+ * evict the entries in use.
+ */
 static int neigh_forced_gc(struct neigh_table *tbl)
 {
+	int max_clean = atomic_read(&tbl->gc_entries) - tbl->gc_thresh2;
+	unsigned long tref = jiffies - 5 * HZ;
+	struct neighbour *n, *tmp;
 	int shrunk = 0;
-	int i;
-	struct neigh_hash_table *nht;
 
 	NEIGH_CACHE_STAT_INC(tbl, forced_gc_runs);
 
 	write_lock_bh(&tbl->lock);
-	nht = rcu_dereference_protected(tbl->nht,
-					lockdep_is_held(&tbl->lock));
-	for (i = 0; i < (1 << nht->hash_shift); i++) {
-		struct neighbour *n;
-		struct neighbour __rcu **np;
 
-		np = &nht->hash_buckets[i];
-		while ((n = rcu_dereference_protected(*np,
-					lockdep_is_held(&tbl->lock))) != NULL) {
-			/* Neighbour record may be discarded if:
-			 * - nobody refers to it.
-			 * - it is not permanent
-			 */
+	list_for_each_entry_safe(n, tmp, &tbl->gc_list, gc_list) {
+		if (shrunk >= max_clean)
+			break;
+
+		if (atomic_read(&n->refcnt) == 1) {
+			bool remove = false;
+
 			write_lock(&n->lock);
-			if (atomic_read(&n->refcnt) == 1 &&
-			    !(n->nud_state & NUD_PERMANENT)) {
-				rcu_assign_pointer(*np,
-					rcu_dereference_protected(n->next,
-						  lockdep_is_held(&tbl->lock)));
-				n->dead = 1;
-				shrunk	= 1;
-				write_unlock(&n->lock);
-				neigh_cleanup_and_release(n);
-				continue;
-			}
+			if (n->nud_state == NUD_FAILED ||
+			    time_after(tref, n->updated))
+				remove = true;
 			write_unlock(&n->lock);
-			np = &n->next;
+
+			if (remove && neigh_remove_one(n, tbl))
+				shrunk++;
 		}
 	}
 
@@ -162,6 +247,14 @@ static int neigh_forced_gc(struct neigh_table *tbl)
 	return shrunk;
 }
 
+static void neigh_forced_gc_work(struct work_struct *work)
+{
+	struct neigh_table *tbl = container_of(work, struct neigh_table,
+					       forced_gc_work);
+
+	neigh_forced_gc(tbl);
+}
+
 static void neigh_add_timer(struct neighbour *n, unsigned long when)
 {
 	neigh_hold(n);
@@ -215,7 +308,7 @@ static void neigh_flush_dev(struct neigh_table *tbl, struct net_device *dev)
 						lockdep_is_held(&tbl->lock)));
 			write_lock(&n->lock);
 			neigh_del_timer(n);
-			n->dead = 1;
+			neigh_mark_dead(n);
 
 			if (atomic_read(&n->refcnt) != 1) {
 				/* The most unpleasant situation.
@@ -269,17 +362,22 @@ static struct neighbour *neigh_alloc(struct neigh_table *tbl, struct net_device
 	unsigned long now = jiffies;
 	int entries;
 
-	entries = atomic_inc_return(&tbl->entries) - 1;
-	if (entries >= tbl->gc_thresh3 ||
-	    (entries >= tbl->gc_thresh2 &&
-	     time_after(now, tbl->last_flush + 5 * HZ))) {
-		if (!neigh_forced_gc(tbl) &&
-		    entries >= tbl->gc_thresh3) {
+	atomic_inc(&tbl->entries);
+
+	/* Past gc_thresh2 the collection is left to a worker, only a full
+	 * table makes the allocation wait for it.
+	 */
+	entries = atomic_read(&tbl->gc_entries);
+	if (entries >= tbl->gc_thresh3) {
+		if (!neigh_forced_gc(tbl)) {
 			net_info_ratelimited("%s: neighbor table overflow!\n",
 					     tbl->id);
 			NEIGH_CACHE_STAT_INC(tbl, table_fulls);
 			goto out_entries;
 		}
+	} else if (entries >= tbl->gc_thresh2 &&
+		   time_after(now, tbl->last_flush + 5 * HZ)) {
+		queue_work(system_power_efficient_wq, &tbl->forced_gc_work);
 	}
 
 	n = kzalloc(tbl->entry_size + dev->neigh_priv_len, GFP_ATOMIC);
@@ -287,6 +385,7 @@ static struct neighbour *neigh_alloc(struct neigh_table *tbl, struct net_device
 		goto out_entries;
 
 	__skb_queue_head_init(&n->arp_queue);
+	INIT_LIST_HEAD(&n->gc_list);
 	rwlock_init(&n->lock);
 	seqlock_init(&n->ha_lock);
 	n->updated	  = n->used = now;
@@ -517,6 +616,10 @@ struct neighbour *__neigh_create(struct neigh_table *tbl, const void *pkey,
 	}
 
 	n->dead = 0;
+	if (!(n->nud_state & NUD_PERMANENT)) {
+		list_add_tail(&n->gc_list, &tbl->gc_list);
+		atomic_inc(&tbl->gc_entries);
+	}
 	if (want_ref)
 		neigh_hold(n);
 	rcu_assign_pointer(n->next,
@@ -741,15 +844,11 @@ static void neigh_periodic_work(struct work_struct *work)
 {
 	struct neigh_table *tbl = container_of(work, struct neigh_table, gc_work.work);
 	struct neighbour *n;
-	struct neighbour __rcu **np;
-	unsigned int i;
-	struct neigh_hash_table *nht;
+	int todo, done = 0;
 
 	NEIGH_CACHE_STAT_INC(tbl, periodic_gc_runs);
 
 	write_lock_bh(&tbl->lock);
-	nht = rcu_dereference_protected(tbl->nht,
-					lockdep_is_held(&tbl->lock));
 
 	/*
 	 *	periodically recompute ReachableTime from random function
@@ -763,41 +862,42 @@ static void neigh_periodic_work(struct work_struct *work)
 				neigh_rand_reach_time(NEIGH_VAR(p, BASE_REACHABLE_TIME));
 	}
 
-	if (atomic_read(&tbl->entries) < tbl->gc_thresh1)
+	if (atomic_read(&tbl->gc_entries) < tbl->gc_thresh1)
 		goto out;
 
-	for (i = 0 ; i < (1 << nht->hash_shift); i++) {
-		np = &nht->hash_buckets[i];
+	/* Only the gc list is walked.  Each entry is rotated to its tail
+	 * once looked at, so the lock can be dropped in between.
+	 */
+	todo = atomic_read(&tbl->gc_entries);
+	while (todo-- > 0 && !list_empty(&tbl->gc_list)) {
+		unsigned int state;
+		bool remove;
 
-		while ((n = rcu_dereference_protected(*np,
-				lockdep_is_held(&tbl->lock))) != NULL) {
-			unsigned int state;
+		n = list_first_entry(&tbl->gc_list, struct neighbour, gc_list);
+		list_move_tail(&n->gc_list, &tbl->gc_list);
 
-			write_lock(&n->lock);
+		write_lock(&n->lock);
 
-			state = n->nud_state;
-			if (state & (NUD_PERMANENT | NUD_IN_TIMER)) {
-				write_unlock(&n->lock);
-				goto next_elt;
-			}
+		state = n->nud_state;
+		if (state & (NUD_PERMANENT | NUD_IN_TIMER)) {
+			write_unlock(&n->lock);
+			goto next_elt;
+		}
 
-			if (time_before(n->used, n->confirmed))
-				n->used = n->confirmed;
+		if (time_before(n->used, n->confirmed))
+			n->used = n->confirmed;
 
-			if (atomic_read(&n->refcnt) == 1 &&
-			    (state == NUD_FAILED ||
-			     time_after(jiffies, n->used + NEIGH_VAR(n->parms, GC_STALETIME)))) {
-				*np = n->next;
-				n->dead = 1;
-				write_unlock(&n->lock);
-				neigh_cleanup_and_release(n);
-				continue;
-			}
-			write_unlock(&n->lock);
+		remove = atomic_read(&n->refcnt) == 1 &&
+			 (state == NUD_FAILED ||
+			  time_after(jiffies, n->used + NEIGH_VAR(n->parms, GC_STALETIME)));
+		write_unlock(&n->lock);
+
+		if (remove)
+			neigh_remove_one(n, tbl);
 
 next_elt:
-			np = &n->next;
-		}
+		if (++done % NEIGH_GC_BATCH)
+			continue;
 		/*
 		 * It's fine to release lock here, even if hash table
 		 * grows while we are preempted.
@@ -805,11 +905,9 @@ next_elt:
 		write_unlock_bh(&tbl->lock);
 		cond_resched();
 		write_lock_bh(&tbl->lock);
-		nht = rcu_dereference_protected(tbl->nht,
-						lockdep_is_held(&tbl->lock));
 	}
 out:
-	/* Cycle through all hash buckets every BASE_REACHABLE_TIME/2 ticks.
+	/* Cycle through the gc list every BASE_REACHABLE_TIME/2 ticks.
 	 * ARP entry timeouts range from 1/2 BASE_REACHABLE_TIME to 3/2
 	 * BASE_REACHABLE_TIME.
 	 */
@@ -1080,6 +1178,7 @@ int neigh_update(struct neighbour *neigh, const u8 *lladdr, u8 new,
 	int notify = 0;
 	struct net_device *dev;
 	int update_isrouter = 0;
+	bool gc_update = false;
 
 	write_lock_bh(&neigh->lock);
 
@@ -1229,8 +1328,13 @@ out:
 			(neigh->flags | NTF_ROUTER) :
 			(neigh->flags & ~NTF_ROUTER);
 	}
+	if ((old ^ neigh->nud_state) & NUD_PERMANENT)
+		gc_update = true;
 	write_unlock_bh(&neigh->lock);
 
+	if (gc_update)
+		neigh_update_gc_list(neigh);
+
 	if (notify)
 		neigh_update_notify(neigh);
 
@@ -1531,6 +1635,8 @@ void neigh_table_init(int index, struct neigh_table *tbl)
 		WARN_ON(tbl->entry_size % NEIGH_PRIV_ALIGN);
 
 	rwlock_init(&tbl->lock);
+	INIT_LIST_HEAD(&tbl->gc_list);
+	INIT_WORK(&tbl->forced_gc_work, neigh_forced_gc_work);
 	INIT_DEFERRABLE_WORK(&tbl->gc_work, neigh_periodic_work);
 	queue_delayed_work(system_power_efficient_wq, &tbl->gc_work,
 			tbl->parms.reachable_time);
@@ -1550,6 +1656,7 @@ int neigh_table_clear(int index, struct neigh_table *tbl)
 	neigh_tables[index] = NULL;
 	/* It is not clean... Fix it to unload IPv6 module safely */
 	cancel_delayed_work_sync(&tbl->gc_work);
+	cancel_work_sync(&tbl->forced_gc_work);
 	del_timer_sync(&tbl->proxy_timer);
 	pneigh_queue_purge(&tbl->proxy_queue);
 	neigh_ifdown(tbl, NULL);
@@ -2445,7 +2552,7 @@ void __neigh_for_each_release(struct neigh_table *tbl,
 				rcu_assign_pointer(*np,
 					rcu_dereference_protected(n->next,
 						lockdep_is_held(&tbl->lock)));
-				n->dead = 1;
+				neigh_mark_dead(n);
 			} else
 				np = &n->next;
 			write_unlock(&n->lock);
@@ -3211,7 +3318,8 @@ static int __init neigh_init(void)
 {
 	rtnl_register(PF_UNSPEC, RTM_NEWNEIGH, neigh_add, NULL, NULL);
 	rtnl_register(PF_UNSPEC, RTM_DELNEIGH, neigh_delete, NULL, NULL);
-	rtnl_register(PF_UNSPEC, RTM_GETNEIGH, NULL, neigh_dump_info, NULL);
+	rtnl_register_flags(PF_UNSPEC, RTM_GETNEIGH, NULL, neigh_dump_info,
+			    NULL, RTNL_FLAG_DUMP_UNLOCKED);
 
 	rtnl_register(PF_UNSPEC, RTM_GETNEIGHTBL, NULL, neightbl_dump_info,
 		      NULL);
@@ -0,0 +1,311 @@
+/*
+ * net_dim.c	Dynamic interrupt moderation
+ *
+ * See include/net/net_dim.h for an overview.
+ *
+ *	This program is free software; you can redistribute it and/or
+ *	modify it under the terms of the GNU General Public License
+ *	as published by the Free Software Foundation; either version
+ *	2 of the License, or (at your option) any later version.
+ */
+
+#include <linux/kernel.h>
+#include <linux/export.h>
+#include <net/net_dim.h>
+
+const struct net_dim_cq_moder
+net_dim_default_profiles[NET_DIM_NUM_PROFILES] = {
+	{ 1,   256 },
+	{ 8,   256 },
+	{ 64,  256 },
+	{ 128, 256 },
+	{ 256, 256 },
+};
+EXPORT_SYMBOL(net_dim_default_profiles);
+
+enum {
+	NET_DIM_START_MEASURE,
+	NET_DIM_MEASURE_IN_PROGRESS,
+	NET_DIM_APPLY_NEW_PROFILE,
+};
+
+enum {
+	NET_DIM_PARKING_ON_TOP,
+	NET_DIM_PARKING_TIRED,
+	NET_DIM_GOING_RIGHT,
+	NET_DIM_GOING_LEFT,
+};
+
+enum {
+	NET_DIM_STATS_WORSE,
+	NET_DIM_STATS_SAME,
+	NET_DIM_STATS_BETTER,
+};
+
+enum {
+	NET_DIM_STEPPED,
+	NET_DIM_TOO_TIRED,
+	NET_DIM_ON_EDGE,
+};
+
+/* A change of more than 10% */
+#define IS_SIGNIFICANT_DIFF(val, ref) \
+	(((100UL * abs((val) - (ref))) / (ref)) > 10)
+
+/* Distance between two samples of a wrapping counter of @bits bits */
+#define BIT_GAP(bits, end, start) \
+	((((end) - (start)) + BIT_ULL(bits)) & (BIT_ULL(bits) - 1))
+
+/* We found the best profile if we just came from the other side of it */
+static bool net_dim_on_top(struct net_dim *dim)
+{
+	switch (dim->tune_state) {
+	case NET_DIM_PARKING_ON_TOP:
+	case NET_DIM_PARKING_TIRED:
+		return true;
+	case NET_DIM_GOING_RIGHT:
+		return dim->steps_left > 1 && dim->steps_right == 1;
+	default: /* NET_DIM_GOING_LEFT */
+		return dim->steps_right > 1 && dim->steps_left == 1;
+	}
+}
+
+static void net_dim_turn(struct net_dim *dim)
+{
+	switch (dim->tune_state) {
+	case NET_DIM_PARKING_ON_TOP:
+	case NET_DIM_PARKING_TIRED:
+		break;
+	case NET_DIM_GOING_RIGHT:
+		dim->tune_state = NET_DIM_GOING_LEFT;
+		dim->steps_left = 0;
+		break;
+	case NET_DIM_GOING_LEFT:
+		dim->tune_state = NET_DIM_GOING_RIGHT;
+		dim->steps_right = 0;
+		break;
+	}
+}
+
+static int net_dim_step(struct net_dim *dim)
+{
+	if (dim->tired == NET_DIM_NUM_PROFILES * 2)
+		return NET_DIM_TOO_TIRED;
+
+	switch (dim->tune_state) {
+	case NET_DIM_PARKING_ON_TOP:
+	case NET_DIM_PARKING_TIRED:
+		break;
+	case NET_DIM_GOING_RIGHT:
+		if (dim->profile_ix == NET_DIM_NUM_PROFILES - 1)
+			return NET_DIM_ON_EDGE;
+		dim->profile_ix++;
+		dim->steps_right++;
+		break;
+	case NET_DIM_GOING_LEFT:
+		if (dim->profile_ix == 0)
+			return NET_DIM_ON_EDGE;
+		dim->profile_ix--;
+		dim->steps_left++;
+		break;
+	}
+
+	dim->tired++;
+	return NET_DIM_STEPPED;
+}
+
+static void net_dim_park_on_top(struct net_dim *dim)
+{
+	dim->steps_right = 0;
+	dim->steps_left	 = 0;
+	dim->tired	 = 0;
+	dim->tune_state	 = NET_DIM_PARKING_ON_TOP;
+}
+
+/* Too many steps without settling: stay put for a while */
+static void net_dim_park_tired(struct net_dim *dim)
+{
+	dim->steps_right = 0;
+	dim->steps_left	 = 0;
+	dim->tune_state	 = NET_DIM_PARKING_TIRED;
+}
+
+static void net_dim_exit_parking(struct net_dim *dim)
+{
+	dim->tune_state = dim->profile_ix ? NET_DIM_GOING_LEFT :
+					    NET_DIM_GOING_RIGHT;
+	net_dim_step(dim);
+}
+
+/* Throughput first, then packet rate, then fewer events for the same */
+static int net_dim_stats_compare(const struct net_dim_stats *curr,
+				 const struct net_dim_stats *prev)
+{
+	if (!prev->bpms)
+		return curr->bpms ? NET_DIM_STATS_BETTER : NET_DIM_STATS_SAME;
+
+	if (IS_SIGNIFICANT_DIFF(curr->bpms, prev->bpms))
+		return curr->bpms > prev->bpms ? NET_DIM_STATS_BETTER :
+						 NET_DIM_STATS_WORSE;
+
+	if (!prev->ppms)
+		return curr->ppms ? NET_DIM_STATS_BETTER : NET_DIM_STATS_SAME;
+
+	if (IS_SIGNIFICANT_DIFF(curr->ppms, prev->ppms))
+		return curr->ppms > prev->ppms ? NET_DIM_STATS_BETTER :
+						 NET_DIM_STATS_WORSE;
+
+	if (!prev->epms)
+		return NET_DIM_STATS_SAME;
+
+	if (IS_SIGNIFICANT_DIFF(curr->epms, prev->epms))
+		return curr->epms < prev->epms ? NET_DIM_STATS_BETTER :
+						 NET_DIM_STATS_WORSE;
+
+	return NET_DIM_STATS_SAME;
+}
+
+/* Returns true if a new profile was picked */
+static bool net_dim_decision(const struct net_dim_stats *curr_stats,
+			     struct net_dim *dim)
+{
+	int prev_state = dim->tune_state;
+	int prev_ix = dim->profile_ix;
+	int stats_res;
+
+	switch (dim->tune_state) {
+	case NET_DIM_PARKING_ON_TOP:
+		stats_res = net_dim_stats_compare(curr_stats, &dim->prev_stats);
+		if (stats_res != NET_DIM_STATS_SAME)
+			net_dim_exit_parking(dim);
+		break;
+
+	case NET_DIM_PARKING_TIRED:
+		dim->tired--;
+		if (!dim->tired)
+			net_dim_exit_parking(dim);
+		break;
+
+	case NET_DIM_GOING_RIGHT:
+	case NET_DIM_GOING_LEFT:
+		stats_res = net_dim_stats_compare(curr_stats, &dim->prev_stats);
+		if (stats_res != NET_DIM_STATS_BETTER)
+			net_dim_turn(dim);
+
+		if (net_dim_on_top(dim)) {
+			net_dim_park_on_top(dim);
+			break;
+		}
+
+		switch (net_dim_step(dim)) {
+		case NET_DIM_ON_EDGE:
+			net_dim_park_on_top(dim);
+			break;
+		case NET_DIM_TOO_TIRED:
+			net_dim_park_tired(dim);
+			break;
+		}
+		break;
+	}
+
+	/* While parked keep comparing against the stats we parked with */
+	if (prev_state != NET_DIM_PARKING_ON_TOP ||
+	    dim->tune_state != NET_DIM_PARKING_ON_TOP)
+		dim->prev_stats = *curr_stats;
+
+	return dim->profile_ix != prev_ix;
+}
+
+static void net_dim_calc_stats(const struct net_dim_sample *start,
+			       const struct net_dim_sample *end,
+			       struct net_dim_stats *curr_stats)
+{
+	/* u32 holds up to 71 minutes, should be enough */
+	u32 delta_us = ktime_us_delta(end->time, start->time);
+	u32 npkts = BIT_GAP(BITS_PER_BYTE * sizeof(u32),
+			    end->pkt_ctr, start->pkt_ctr);
+	u32 nbytes = BIT_GAP(BITS_PER_BYTE * sizeof(u32),
+			     end->byte_ctr, start->byte_ctr);
+
+	if (!delta_us)
+		delta_us = 1;
+
+	curr_stats->ppms = DIV_ROUND_UP_ULL((u64)npkts * USEC_PER_MSEC,
+					    delta_us);
+	curr_stats->bpms = DIV_ROUND_UP_ULL((u64)nbytes * USEC_PER_MSEC,
+					    delta_us);
+	curr_stats->epms = DIV_ROUND_UP(NET_DIM_NEVENTS * USEC_PER_MSEC,
+					delta_us);
+}
+
+/**
+ * net_dim - feed a sample to the moderation algorithm
+ * @dim:	Moderation state of the queue
+ * @end_sample:	Counters of the queue, taken with net_dim_sample()
+ *
+ * Called from the NAPI poll routine, typically once per poll that
+ * completed.  When a new profile is picked it is handed to the apply
+ * callback from a work item, and measuring resumes once it has been
+ * applied.
+ */
+void net_dim(struct net_dim *dim, const struct net_dim_sample *end_sample)
+{
+	struct net_dim_stats curr_stats;
+	u16 nevents;
+
+	switch (dim->state) {
+	case NET_DIM_MEASURE_IN_PROGRESS:
+		nevents = BIT_GAP(BITS_PER_BYTE * sizeof(u16),
+				  end_sample->event_ctr,
+				  dim->start_sample.event_ctr);
+		if (nevents < NET_DIM_NEVENTS)
+			break;
+		net_dim_calc_stats(&dim->start_sample, end_sample, &curr_stats);
+		if (net_dim_decision(&curr_stats, dim)) {
+			dim->state = NET_DIM_APPLY_NEW_PROFILE;
+			schedule_work(&dim->work);
+			break;
+		}
+		/* fall through */
+	case NET_DIM_START_MEASURE:
+		dim->start_sample = *end_sample;
+		dim->state = NET_DIM_MEASURE_IN_PROGRESS;
+		break;
+	case NET_DIM_APPLY_NEW_PROFILE:
+		break;
+	}
+}
+EXPORT_SYMBOL(net_dim);
+
+static void net_dim_work(struct work_struct *work)
+{
+	struct net_dim *dim = container_of(work, struct net_dim, work);
+
+	dim->apply(dim, net_dim_cur_profile(dim));
+	dim->state = NET_DIM_START_MEASURE;
+}
+
+/**
+ * net_dim_init - set up the moderation state of a queue
+ * @dim:	Moderation state to initialize
+ * @profiles:	NET_DIM_NUM_PROFILES profiles from least to most moderated,
+ *		e.g. net_dim_default_profiles
+ * @apply:	Called from process context to program a new profile
+ *
+ * The algorithm starts from profile NET_DIM_DEF_PROFILE, which the driver
+ * should program itself, see net_dim_cur_profile().
+ */
+void net_dim_init(struct net_dim *dim,
+		  const struct net_dim_cq_moder *profiles,
+		  void (*apply)(struct net_dim *dim,
+				const struct net_dim_cq_moder *moder))
+{
+	memset(dim, 0, sizeof(*dim));
+	dim->state = NET_DIM_START_MEASURE;
+	dim->tune_state = NET_DIM_GOING_RIGHT;
+	dim->profile_ix = NET_DIM_DEF_PROFILE;
+	dim->profiles = profiles;
+	dim->apply = apply;
+	INIT_WORK(&dim->work, net_dim_work);
+}
+EXPORT_SYMBOL(net_dim_init);
@@ -0,0 +1,164 @@
+/*
+ * page_pool.c	Recycling of driver RX pages
+ *
+ * See include/net/page_pool.h for how recycling works.
+ *
+ *	This program is free software; you can redistribute it and/or
+ *	modify it under the terms of the GNU General Public License
+ *	as published by the Free Software Foundation; either version
+ *	2 of the License, or (at your option) any later version.
+ */
+
+#include <linux/kernel.h>
+#include <linux/export.h>
+#include <linux/slab.h>
+#include <linux/log2.h>
+#include <linux/err.h>
+#include <linux/dma-mapping.h>
+#include <net/page_pool.h>
+
+struct page_pool *page_pool_create(const struct page_pool_params *params)
+{
+	struct page_pool *pool;
+	int nid = params->nid;
+
+	if (!is_power_of_2(params->pool_size) ||
+	    params->pool_size > PP_POOL_SIZE_MAX)
+		return ERR_PTR(-EINVAL);
+
+	if (params->flags & PP_FLAG_DMA_MAP) {
+		if (!params->dev)
+			return ERR_PTR(-EINVAL);
+		if (params->dma_dir != DMA_FROM_DEVICE &&
+		    params->dma_dir != DMA_BIDIRECTIONAL)
+			return ERR_PTR(-EINVAL);
+	}
+
+	pool = kzalloc_node(sizeof(*pool), GFP_KERNEL, nid);
+	if (!pool)
+		return ERR_PTR(-ENOMEM);
+
+	pool->ring = kzalloc_node(params->pool_size * sizeof(*pool->ring),
+				  GFP_KERNEL, nid);
+	if (!pool->ring) {
+		kfree(pool);
+		return ERR_PTR(-ENOMEM);
+	}
+
+	pool->p = *params;
+	pool->mask = params->pool_size - 1;
+
+	return pool;
+}
+EXPORT_SYMBOL(page_pool_create);
+
+static void page_pool_release(struct page_pool *pool,
+			      struct page_pool_entry *e)
+{
+	if (pool->p.flags & PP_FLAG_DMA_MAP)
+		dma_unmap_page(pool->p.dev, e->dma, PAGE_SIZE << pool->p.order,
+			       pool->p.dma_dir);
+	put_page(e->page);
+}
+
+/*
+ * Pages still in use elsewhere are not freed here; they go back to the
+ * page allocator when their last user drops its reference.
+ */
+void page_pool_destroy(struct page_pool *pool)
+{
+	if (!pool)
+		return;
+
+	while (pool->tail != pool->head)
+		page_pool_release(pool, &pool->ring[pool->tail++ & pool->mask]);
+
+	kfree(pool->ring);
+	kfree(pool);
+}
+EXPORT_SYMBOL(page_pool_destroy);
+
+/* Reserve and remote node pages go back to the page allocator */
+static bool page_pool_page_reusable(struct page_pool *pool, struct page *page)
+{
+	int nid = pool->p.nid == NUMA_NO_NODE ? numa_mem_id() : pool->p.nid;
+
+	return !page_is_pfmemalloc(page) && page_to_nid(page) == nid;
+}
+
+/**
+ * page_pool_alloc_pages - get a page for an RX buffer
+ * @pool: pool to allocate from
+ * @gfp: allocation flags, used if no page can be recycled
+ * @dma: set to the DMA address of the page with PP_FLAG_DMA_MAP, else unused
+ *
+ * The caller owns one reference on the returned page and passes it on to
+ * the stack, or drops it with put_page(), like for any other page.  The
+ * page is synced for the device if it is recycled.
+ */
+struct page *page_pool_alloc_pages(struct page_pool *pool, gfp_t gfp,
+				   dma_addr_t *dma)
+{
+	struct page_pool_entry e;
+	struct page *page;
+
+	if (pool->tail != pool->head) {
+		e = pool->ring[pool->tail & pool->mask];
+
+		/* Only the pool's reference left: the stack is done with it */
+		if (page_count(e.page) == 1 &&
+		    page_pool_page_reusable(pool, e.page)) {
+			pool->tail++;
+			pool->ring[pool->head++ & pool->mask] = e;
+			pool->recycle++;
+
+			if (pool->p.flags & PP_FLAG_DMA_MAP) {
+				dma_sync_single_for_device(pool->p.dev, e.dma,
+							   PAGE_SIZE << pool->p.order,
+							   pool->p.dma_dir);
+				*dma = e.dma;
+			}
+			get_page(e.page);
+			return e.page;
+		}
+
+		/*
+		 * Stop tracking the oldest page if it cannot be reused, or if
+		 * it is still busy and there is no room to track another one.
+		 * It is freed when its last user releases it.
+		 */
+		if (page_count(e.page) == 1 ||
+		    pool->head - pool->tail > pool->mask) {
+			page_pool_release(pool, &e);
+			pool->tail++;
+		}
+	}
+
+	if (pool->p.order)
+		gfp |= __GFP_COMP;
+
+	page = alloc_pages_node(pool->p.nid, gfp, pool->p.order);
+	if (unlikely(!page))
+		return NULL;
+
+	e.page = page;
+	e.dma = 0;
+	if (pool->p.flags & PP_FLAG_DMA_MAP) {
+		e.dma = dma_map_page(pool->p.dev, page, 0,
+				     PAGE_SIZE << pool->p.order,
+				     pool->p.dma_dir);
+		if (dma_mapping_error(pool->p.dev, e.dma)) {
+			put_page(page);
+			return NULL;
+		}
+		*dma = e.dma;
+	}
+
+	/* One reference for the pool, one for the caller */
+	pool->ring[pool->head++ & pool->mask] = e;
+	pool->alloc++;
+	get_page(page);
+
+	return page;
+}
+EXPORT_SYMBOL(page_pool_alloc_pages);
@@ -124,6 +124,7 @@ static int esp_output(struct xfrm_state *x, struct sk_buff *skb)
 	struct ip_esp_hdr *esph;
 	struct crypto_aead *aead;
 	struct aead_request *req;
+	struct xfrm_offload *xo;
 	struct scatterlist *sg;
 	struct sk_buff *trailer;
 	void *tmp;
@@ -173,17 +174,6 @@ static int esp_output(struct xfrm_state *x, struct sk_buff *skb)
 		assoclen += seqhilen;
 	}
 
-	tmp = esp_alloc_tmp(aead, nfrags, seqhilen);
-	if (!tmp) {
-		err = -ENOMEM;
-		goto error;
-	}
-
-	seqhi = esp_tmp_seqhi(tmp);
-	iv = esp_tmp_iv(aead, tmp, seqhilen);
-	req = esp_tmp_req(aead, iv);
-	sg = esp_req_sg(aead, req);
-
 	/* Fill padding... */
 	tail = skb_tail_pointer(trailer);
 	if (tfclen) {
@@ -240,6 +230,34 @@ static int esp_output(struct xfrm_state *x, struct sk_buff *skb)
 
 	esph->seq_no = htonl(XFRM_SKB_CB(skb)->seq.output.low);
 
+	seqno = cpu_to_be64(XFRM_SKB_CB(skb)->seq.output.low +
+			    ((u64)XFRM_SKB_CB(skb)->seq.output.hi << 32));
+
+	xo = xfrm_offload(skb);
+	if (xo && (xo->flags & CRYPTO_DEV_ENCRYPT)) {
+		/*
+		 * The device encrypts on transmit and fills in the ICV,
+		 * for which room is left in the trailer.  Use the sequence
+		 * number as IV like seqiv does, the device may replace it.
+		 */
+		esph->spi = x->id.spi;
+		memset(esph->enc_data, 0, ivlen);
+		memcpy(esph->enc_data + ivlen - min(ivlen, 8),
+		       (u8 *)&seqno + 8 - min(ivlen, 8), min(ivlen, 8));
+		return 0;
+	}
+
+	tmp = esp_alloc_tmp(aead, nfrags, seqhilen);
+	if (!tmp) {
+		err = -ENOMEM;
+		goto error;
+	}
+
+	seqhi = esp_tmp_seqhi(tmp);
+	iv = esp_tmp_iv(aead, tmp, seqhilen);
+	req = esp_tmp_req(aead, iv);
+	sg = esp_req_sg(aead, req);
+
 	aead_request_set_callback(req, 0, esp_output_done, skb);
 
 	/* For ESN we move the header forward by 4 bytes to
@@ -263,9 +281,6 @@ static int esp_output(struct xfrm_state *x, struct sk_buff *skb)
 	aead_request_set_crypt(req, sg, sg, ivlen + clen, iv);
 	aead_request_set_ad(req, assoclen);
 
-	seqno = cpu_to_be64(XFRM_SKB_CB(skb)->seq.output.low +
-			    ((u64)XFRM_SKB_CB(skb)->seq.output.hi << 32));
-
 	memset(iv, 0, ivlen);
 	memcpy(iv + ivlen - min(ivlen, 8), (u8 *)&seqno + 8 - min(ivlen, 8),
 	       min(ivlen, 8));
@@ -407,6 +422,7 @@ static int esp_input(struct xfrm_state *x, struct sk_buff *skb)
 	struct ip_esp_hdr *esph;
 	struct crypto_aead *aead = x->data;
 	struct aead_request *req;
+	struct xfrm_offload *xo;
 	struct sk_buff *trailer;
 	int ivlen = crypto_aead_ivsize(aead);
 	int elen = skb->len - sizeof(*esph) - ivlen;
@@ -425,6 +441,14 @@ static int esp_input(struct xfrm_state *x, struct sk_buff *skb)
 	if (elen <= 0)
 		goto out;
 
+	xo = xfrm_offload(skb);
+	if (xo && (xo->flags & CRYPTO_DONE)) {
+		/* The device decrypted the payload and checked the ICV. */
+		ESP_SKB_CB(skb)->tmp = NULL;
+		err = esp_input_done2(skb, 0);
+		goto out;
+	}
+
 	err = skb_cow_data(skb, 0, &trailer);
 	if (err < 0)
 		goto out;
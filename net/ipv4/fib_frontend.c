@@ -1309,7 +1309,8 @@ void __init ip_fib_init(void)
 {
 	rtnl_register(PF_INET, RTM_NEWROUTE, inet_rtm_newroute, NULL, NULL);
 	rtnl_register(PF_INET, RTM_DELROUTE, inet_rtm_delroute, NULL, NULL);
-	rtnl_register(PF_INET, RTM_GETROUTE, NULL, inet_dump_fib, NULL);
+	rtnl_register_flags(PF_INET, RTM_GETROUTE, NULL, inet_dump_fib, NULL,
+			    RTNL_FLAG_DUMP_UNLOCKED);
 
 	register_pernet_subsys(&fib_net_ops);
 	register_netdevice_notifier(&fib_netdev_notifier);
@@ -103,7 +103,8 @@ int inet_csk_get_port(struct sock *sk, unsigned short snum)
 
 	local_bh_disable();
 	if (!snum) {
-		int remaining, rover, low, high;
+		int i, remaining, rover, low, high;
+		u32 offset;
 
 again:
 		inet_get_local_port_range(net, &low, &high);
@@ -115,13 +116,24 @@ again:
 			else
 				low = half;
 		}
-		remaining = (high - low) + 1;
-		smallest_rover = rover = prandom_u32() % remaining + low;
+		high++; /* [32768, 60999] -> [32768, 61000[ */
+		remaining = high - low;
+		if (likely(remaining > 1))
+			remaining &= ~1U;
+
+		/* __inet_hash_connect() favors ports having @low parity,
+		 * we do the opposite to not pollute connect() users.
+		 */
+		offset = (prandom_u32() % remaining) | 1U;
 
 		smallest_size = -1;
-		do {
+other_parity_scan:
+		rover = low + offset;
+		for (i = 0; i < remaining; i += 2, rover += 2) {
+			if (unlikely(rover >= high))
+				rover -= remaining;
 			if (inet_is_local_reserved_port(net, rover))
-				goto next_nolock;
+				continue;
 			head = &hashinfo->bhash[inet_bhashfn(net, rover,
 					hashinfo->bhash_size)];
 			spin_lock(&head->lock);
@@ -143,37 +155,31 @@ again:
 					}
 					goto next;
 				}
-			break;
+			/* OK, here is the one we will use.  HEAD is
+			 * non-NULL and we hold it's mutex.
+			 */
+			snum = rover;
+			goto found;
 		next:
 			spin_unlock(&head->lock);
-		next_nolock:
-			if (++rover > high)
-				rover = low;
-		} while (--remaining > 0);
-
-		/* Exhausted local port range during search?  It is not
-		 * possible for us to be holding one of the bind hash
-		 * locks if this test triggers, because if 'remaining'
-		 * drops to zero, we broke out of the do/while loop at
-		 * the top level, not from the 'break;' statement.
-		 */
+		}
+
+		offset--;
+		if (!(offset & 1))
+			goto other_parity_scan;
+
+		/* Exhausted local port range during search */
 		ret = 1;
-		if (remaining <= 0) {
-			if (smallest_size != -1) {
-				snum = smallest_rover;
-				goto have_snum;
-			}
-			if (attempt_half == 1) {
-				/* OK we now try the upper half of the range */
-				attempt_half = 2;
-				goto again;
-			}
-			goto fail;
+		if (smallest_size != -1) {
+			snum = smallest_rover;
+			goto have_snum;
 		}
-		/* OK, here is the one we will use.  HEAD is
-		 * non-NULL and we hold it's mutex.
-		 */
-		snum = rover;
+		if (attempt_half == 1) {
+			/* OK we now try the upper half of the range */
+			attempt_half = 2;
+			goto again;
+		}
+		goto fail;
 	} else {
 have_snum:
 		head = &hashinfo->bhash[inet_bhashfn(net, snum,
@@ -183,6 +189,7 @@ have_snum:
 			if (net_eq(ib_net(tb), net) && tb->port == snum)
 				goto tb_found;
 	}
+found:
 	tb = NULL;
 	goto tb_not_found;
 tb_found:
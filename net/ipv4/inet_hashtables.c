@@ -13,6 +13,7 @@
  *      2 of the License, or (at your option) any later version.
  */
 
+#include <linux/hash.h>
 #include <linux/module.h>
 #include <linux/random.h>
 #include <linux/sched.h>
@@ -24,6 +25,8 @@
 #include <net/inet_hashtables.h>
 #include <net/secure_seq.h>
 #include <net/ip.h>
+#include <net/ipv6.h>
+#include <net/sock_reuseport.h>
 
 static u32 inet_ehashfn(const struct net *net, const __be32 laddr,
 			const __u16 lport, const __be32 faddr,
@@ -72,7 +75,7 @@ struct inet_bind_bucket *inet_bind_bucket_create(struct kmem_cache *cachep,
 		tb->fastreuseport = 0;
 		tb->num_owners = 0;
 		INIT_HLIST_HEAD(&tb->owners);
-		hlist_add_head(&tb->node, &head->chain);
+		hlist_add_head_rcu(&tb->node, &head->chain);
 	}
 	return tb;
 }
@@ -205,6 +208,7 @@ static inline int compute_score(struct sock *sk, struct net *net,
 
 struct sock *__inet_lookup_listener(struct net *net,
 				    struct inet_hashinfo *hashinfo,
+				    struct sk_buff *skb, int doff,
 				    const __be32 saddr, __be16 sport,
 				    const __be32 daddr, const unsigned short hnum,
 				    const int dif)
@@ -223,14 +227,18 @@ begin:
 	sk_nulls_for_each_rcu(sk, node, &ilb->head) {
 		score = compute_score(sk, net, hnum, daddr, dif);
 		if (score > hiscore) {
-			result = sk;
-			hiscore = score;
 			reuseport = sk->sk_reuseport;
 			if (reuseport) {
 				phash = inet_ehashfn(net, daddr, hnum,
 						     saddr, sport);
+				result = reuseport_select_sock(sk, phash,
+							       skb, doff);
+				if (result)
+					goto found;
 				matches = 1;
 			}
+			result = sk;
+			hiscore = score;
 		} else if (score == hiscore && reuseport) {
 			matches++;
 			if (reciprocal_scale(phash, matches) == 0)
@@ -246,6 +254,7 @@ begin:
 	if (get_nulls_value(node) != hash + LISTENING_NULLS_BASE)
 		goto begin;
 	if (result) {
+found:
 		if (unlikely(!atomic_inc_not_zero(&result->sk_refcnt)))
 			result = NULL;
 		else if (unlikely(compute_score(result, net, hnum, daddr,
@@ -449,6 +458,43 @@ bool inet_ehash_nolisten(struct sock *sk, struct sock *osk)
 }
 EXPORT_SYMBOL_GPL(inet_ehash_nolisten);
 
+/* Bound address equality without wildcard matching. */
+static bool inet_rcv_saddr_same(const struct sock *sk, const struct sock *sk2)
+{
+#if IS_ENABLED(CONFIG_IPV6)
+	if (sk->sk_family == AF_INET6)
+		return ipv6_addr_equal(&sk->sk_v6_rcv_saddr,
+				       &sk2->sk_v6_rcv_saddr);
+#endif
+	return sk->sk_rcv_saddr == sk2->sk_rcv_saddr;
+}
+
+static int inet_reuseport_add_sock(struct sock *sk,
+				   struct inet_listen_hashbucket *ilb)
+{
+	struct inet_bind_bucket *tb = inet_csk(sk)->icsk_bind_hash;
+	struct hlist_nulls_node *node;
+	kuid_t uid = sock_i_uid(sk);
+	struct sock *sk2;
+
+	sk_nulls_for_each(sk2, node, &ilb->head) {
+		if (sk2 != sk &&
+		    sk2->sk_family == sk->sk_family &&
+		    ipv6_only_sock(sk2) == ipv6_only_sock(sk) &&
+		    sk2->sk_bound_dev_if == sk->sk_bound_dev_if &&
+		    inet_csk(sk2)->icsk_bind_hash == tb &&
+		    sk2->sk_reuseport && uid_eq(uid, sock_i_uid(sk2)) &&
+		    rcu_access_pointer(sk2->sk_reuseport_cb) &&
+		    inet_rcv_saddr_same(sk, sk2))
+			return reuseport_add_sock(sk, sk2);
+	}
+
+	/* Initial allocation may have already happened via setsockopt */
+	if (!rcu_access_pointer(sk->sk_reuseport_cb))
+		return reuseport_alloc(sk);
+	return 0;
+}
+
 void __inet_hash(struct sock *sk, struct sock *osk)
 {
 	struct inet_hashinfo *hashinfo = sk->sk_prot->h.hashinfo;
@@ -462,6 +508,11 @@ void __inet_hash(struct sock *sk, struct sock *osk)
 	ilb = &hashinfo->listening_hash[inet_sk_listen_hashfn(sk)];
 
 	spin_lock(&ilb->lock);
+	/* If the group can't be joined (-ENOMEM) the listener is still
+	 * hashed; lookups then fall back to walking the chain for it.
+	 */
+	if (sk->sk_reuseport)
+		inet_reuseport_add_sock(sk, ilb);
 	__sk_nulls_add_node_rcu(sk, &ilb->head);
 	sock_prot_inuse_add(sock_net(sk), sk->sk_prot, 1);
 	spin_unlock(&ilb->lock);
@@ -493,6 +544,8 @@ void inet_unhash(struct sock *sk)
 		lock = inet_ehash_lockp(hashinfo, sk->sk_hash);
 
 	spin_lock_bh(lock);
+	if (rcu_access_pointer(sk->sk_reuseport_cb))
+		reuseport_detach_sock(sk);
 	done = __sk_nulls_del_node_init_rcu(sk);
 	if (done)
 		sock_prot_inuse_add(sock_net(sk), sk->sk_prot, -1);
@@ -500,6 +553,40 @@ void inet_unhash(struct sock *sk)
 }
 EXPORT_SYMBOL_GPL(inet_unhash);
 
+/*
+ * Where the port scan starts for a destination.  Each slot moves on by
+ * the ports it consumed, so consecutive connect()s to the same peer do
+ * not probe the same used ports again, while other peers are not
+ * affected.  Peers share a slot through the secure port_offset hash.
+ */
+#define INET_TABLE_PERTURB_SHIFT 8
+static u32 table_perturb[1 << INET_TABLE_PERTURB_SHIFT];
+
+/*
+ * Lockless check whether bind() owns @port, which connect() can never
+ * share.  Bind buckets are SLAB_DESTROY_BY_RCU and may be reused under
+ * us, so the answer is a hint: a wrong one only skips a port or takes
+ * the bucket lock for nothing.
+ */
+static bool inet_bind_bucket_owned(struct inet_bind_hashbucket *head,
+				   struct net *net, unsigned short port)
+{
+	struct inet_bind_bucket *tb;
+	bool owned = false;
+
+	rcu_read_lock();
+	hlist_for_each_entry_rcu(tb, &head->chain, node) {
+		if (net_eq(ib_net(tb), net) && tb->port == port) {
+			owned = READ_ONCE(tb->fastreuse) >= 0 ||
+				READ_ONCE(tb->fastreuseport) >= 0;
+			break;
+		}
+	}
+	rcu_read_unlock();
+
+	return owned;
+}
+
 int __inet_hash_connect(struct inet_timewait_death_row *death_row,
 		struct sock *sk, u32 port_offset,
 		int (*check_established)(struct inet_timewait_death_row *,
@@ -514,26 +601,37 @@ int __inet_hash_connect(struct inet_timewait_death_row *death_row,
 
 	if (!snum) {
 		int i, remaining, low, high, port;
-		static u32 hint;
-		u32 offset = hint + port_offset;
+		u32 offset, index;
 		struct inet_timewait_sock *tw = NULL;
 
 		inet_get_local_port_range(net, &low, &high);
-		remaining = (high - low) + 1;
-
-		/* By starting with offset being an even number,
-		 * we tend to leave about 50% of ports for other uses,
-		 * like bind(0).
+		high++; /* [32768, 60999] -> [32768, 61000[ */
+		remaining = high - low;
+		if (likely(remaining > 1))
+			remaining &= ~1U;
+
+		net_get_random_once(table_perturb, sizeof(table_perturb));
+		index = hash_32(port_offset, INET_TABLE_PERTURB_SHIFT);
+		offset = (READ_ONCE(table_perturb[index]) + port_offset) %
+			 remaining;
+
+		/* In the first pass we try ports of @low parity, leaving
+		 * the other half to bind(0), see inet_csk_get_port().
 		 */
-		offset &= ~1;
+		offset &= ~1U;
 
 		local_bh_disable();
-		for (i = 0; i < remaining; i++) {
-			port = low + (i + offset) % remaining;
+other_parity_scan:
+		port = low + offset;
+		for (i = 0; i < remaining; i += 2, port += 2) {
+			if (unlikely(port >= high))
+				port -= remaining;
 			if (inet_is_local_reserved_port(net, port))
 				continue;
 			head = &hinfo->bhash[inet_bhashfn(net, port,
 					hinfo->bhash_size)];
+			if (inet_bind_bucket_owned(head, net, port))
+				continue;
 			spin_lock(&head->lock);
 
 			/* Does not bother with rcv_saddr checks,
@@ -567,12 +665,19 @@ int __inet_hash_connect(struct inet_timewait_death_row *death_row,
 		next_port:
 			spin_unlock(&head->lock);
 		}
+
+		offset++;
+		if ((offset & 1) && remaining > 1)
+			goto other_parity_scan;
+
 		local_bh_enable();
 
 		return -EADDRNOTAVAIL;
 
 ok:
-		hint += (i + 2) & ~1;
+		/* Skip the ports we just found busy on the next attempt */
+		WRITE_ONCE(table_perturb[index],
+			   READ_ONCE(table_perturb[index]) + i + 2);
 
 		/* Head lock still held and bh's disabled */
 		inet_bind_hash(sk, tb, port);
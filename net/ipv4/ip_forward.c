@@ -72,6 +72,8 @@ static int ip_forward_finish(struct net *net, struct sock *sk, struct sk_buff *s
 		ip_forward_options(skb);
 
 	skb_sender_cpu_clear(skb);
+	/* The receive timestamp is not a departure time */
+	skb->tstamp.tv64 = 0;
 	return dst_output(net, sk, skb);
 }
 
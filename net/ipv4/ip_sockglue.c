@@ -219,15 +219,26 @@ void ip_cmsg_recv_offset(struct msghdr *msg, struct sk_buff *skb,
 }
 EXPORT_SYMBOL(ip_cmsg_recv_offset);
 
-int ip_cmsg_send(struct net *net, struct msghdr *msg, struct ipcm_cookie *ipc,
+int ip_cmsg_send(struct sock *sk, struct msghdr *msg, struct ipcm_cookie *ipc,
 		 bool allow_ipv6)
 {
+	struct net *net = sock_net(sk);
 	int err, val;
 	struct cmsghdr *cmsg;
 
 	for_each_cmsghdr(cmsg, msg) {
 		if (!CMSG_OK(msg, cmsg))
 			return -EINVAL;
+		if (cmsg->cmsg_level == SOL_SOCKET &&
+		    cmsg->cmsg_type == SCM_TXTIME) {
+			struct sockcm_cookie sockc = {};
+
+			err = __sock_cmsg_send(sk, msg, cmsg, &sockc);
+			if (err)
+				return err;
+			ipc->transmit_time = sockc.transmit_time;
+			continue;
+		}
 #if IS_ENABLED(CONFIG_IPV6)
 		if (allow_ipv6 &&
 		    cmsg->cmsg_level == SOL_IPV6 &&
@@ -299,6 +299,7 @@ ipt_do_table(struct sk_buff *skb,
 	unsigned int stackidx, cpu;
 	const struct xt_table_info *private;
 	struct xt_action_param acpar;
+	struct ipt_bpf_ctx bpf_ctx;
 	unsigned int addend;
 
 	/* Initialization */
@@ -344,7 +345,10 @@ ipt_do_table(struct sk_buff *skb,
 	if (static_key_false(&xt_tee_enabled))
 		jumpstack += private->stacksize * __this_cpu_read(nf_skb_duplicated);
 
-	e = get_entry(table_base, private->hook_entry[hook]);
+	/* Compiled rules skip straight to the first one that may match */
+	ipt_bpf_init_ctx(private, &bpf_ctx, skb, &acpar, indev, outdev);
+	e = get_entry(table_base,
+		      ipt_bpf_skip(private, private->hook_entry[hook], &bpf_ctx));
 
 	pr_debug("Entering %s(hook %u), UF %p\n",
 		 table->name, hook,
@@ -413,7 +417,10 @@ ipt_do_table(struct sk_buff *skb,
 					 e, stackidx - 1);
 			}
 
-			e = get_entry(table_base, v);
+			/* Targets on the way may have changed the mark */
+			bpf_ctx.mark = skb->mark;
+			e = get_entry(table_base,
+				      ipt_bpf_skip(private, v, &bpf_ctx));
 			continue;
 		}
 
@@ -1211,9 +1218,12 @@ __do_replace(struct net *net, const char *name, unsigned int valid_hooks,
 		goto put_module;
 	}
 
+	ipt_bpf_compile(newinfo);
 	oldinfo = xt_replace_table(t, num_counters, newinfo, &ret);
-	if (!oldinfo)
+	if (!oldinfo) {
+		ipt_bpf_free(newinfo);
 		goto put_module;
+	}
 
 	/* Update module usage count based on number of rules */
 	duprintf("do_replace: oldnum=%u, initnum=%u, newnum=%u\n",
@@ -1232,6 +1242,7 @@ __do_replace(struct net *net, const char *name, unsigned int valid_hooks,
 	xt_entry_foreach(iter, oldinfo->entries, oldinfo->size)
 		cleanup_entry(iter, net);
 
+	ipt_bpf_free(oldinfo);
 	xt_free_table_info(oldinfo);
 	if (copy_to_user(counters_ptr, counters,
 			 sizeof(struct xt_counters) * num_counters) != 0) {
@@ -2085,6 +2096,7 @@ struct xt_table *ipt_register_table(struct net *net,
 	if (ret != 0)
 		goto out_free;
 
+	ipt_bpf_compile(newinfo);
 	new_table = xt_register_table(net, table, &bootstrap, newinfo);
 	if (IS_ERR(new_table)) {
 		ret = PTR_ERR(new_table);
@@ -2094,6 +2106,7 @@ struct xt_table *ipt_register_table(struct net *net,
 	return new_table;
 
 out_free:
+	ipt_bpf_free(newinfo);
 	xt_free_table_info(newinfo);
 out:
 	return ERR_PTR(ret);
@@ -2114,6 +2127,7 @@ void ipt_unregister_table(struct net *net, struct xt_table *table)
 		cleanup_entry(iter, net);
 	if (private->number > private->initial_entries)
 		module_put(table_owner);
+	ipt_bpf_free(private);
 	xt_free_table_info(private);
 }
 
@@ -0,0 +1,549 @@
+/*
+ * Compile ip_tables rules to BPF.
+ *
+ * ipt_do_table() goes through the rules of a chain one by one, and most
+ * of them don't match.  Rules that only look at the IP header, the
+ * interfaces, the mark and TCP or UDP ports, which is what large
+ * generated rulesets are made of, are compiled into a BPF program per
+ * chain that returns the offset of the first rule that may match.  The
+ * interpreter carries on from there, so everything else, counters and
+ * targets included, works as before: skipped rules are rules that don't
+ * match, and those have no side effect.
+ *
+ * A chain's program stops at the first rule it can't compile, which is
+ * left to the interpreter.  Programs are only used when the JIT is
+ * available, the BPF interpreter wouldn't beat ipt_do_table().
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#define pr_fmt(fmt) "ip_tables: " fmt
+#include <linux/kernel.h>
+#include <linux/filter.h>
+#include <linux/skbuff.h>
+#include <linux/slab.h>
+#include <linux/sort.h>
+#include <linux/tcp.h>
+#include <linux/udp.h>
+#include <linux/vmalloc.h>
+#include <linux/netfilter/x_tables.h>
+#include <linux/netfilter/xt_tcpudp.h>
+#include <linux/netfilter/xt_mark.h>
+#include <linux/netfilter_ipv4/ip_tables.h>
+#include <asm/unaligned.h>
+
+/* Rules per program, longer chains are split, to keep the JIT happy */
+#define IPT_BPF_MAX_RULES	1024
+/* Matches per rule, bounds the jumps to patch */
+#define IPT_BPF_MAX_MATCHES	4
+#define IPT_BPF_MAX_FIXUPS	(8 + IPT_BPF_MAX_MATCHES * 8)
+
+struct ipt_bpf_chain {
+	unsigned int		offset;
+	struct bpf_prog		*prog;
+};
+
+struct ipt_bpf_table {
+	unsigned int		nchains;
+	struct ipt_bpf_chain	chain[0];
+};
+
+/* Program being built, @insns is NULL on the sizing pass */
+struct ipt_bpf_jit {
+	struct bpf_insn		*insns;
+	unsigned int		len;
+	unsigned int		nnext;
+	unsigned int		nhit;
+	unsigned int		next[IPT_BPF_MAX_FIXUPS];
+	unsigned int		hit[IPT_BPF_MAX_FIXUPS];
+};
+
+#define CTX_OFF(field)		offsetof(struct ipt_bpf_ctx, field)
+
+static void emit(struct ipt_bpf_jit *jit, struct bpf_insn insn)
+{
+	if (jit->insns)
+		jit->insns[jit->len] = insn;
+	jit->len++;
+}
+
+/* Conditional jump to the next rule, patched once the rule is done */
+static void emit_next(struct ipt_bpf_jit *jit, u8 op, u32 imm)
+{
+	jit->next[jit->nnext++] = jit->len;
+	emit(jit, BPF_JMP_IMM(op, BPF_REG_2, imm, 0));
+}
+
+/* Conditional jump to the end of the rule: left to the interpreter */
+static void emit_hit(struct ipt_bpf_jit *jit, u8 op, u32 imm)
+{
+	jit->hit[jit->nhit++] = jit->len;
+	emit(jit, BPF_JMP_IMM(op, BPF_REG_2, imm, 0));
+}
+
+static void patch(struct ipt_bpf_jit *jit, const unsigned int *fixup,
+		  unsigned int n)
+{
+	unsigned int i;
+
+	if (!jit->insns)
+		return;
+
+	for (i = 0; i < n; i++)
+		jit->insns[fixup[i]].off = jit->len - fixup[i] - 1;
+}
+
+/* Mismatch if ((addr & mask) != val) ^ inv */
+static void emit_addr(struct ipt_bpf_jit *jit, int off, __be32 val,
+		      __be32 mask, bool inv)
+{
+	if (!mask && !inv)
+		return;
+
+	emit(jit, BPF_LDX_MEM(BPF_W, BPF_REG_2, BPF_REG_1, off));
+	emit(jit, BPF_ALU32_IMM(BPF_AND, BPF_REG_2, (__force u32)mask));
+	emit(jit, BPF_ALU32_IMM(BPF_XOR, BPF_REG_2, (__force u32)val));
+	emit_next(jit, inv ? BPF_JEQ : BPF_JNE, 0);
+}
+
+/* Same as ifname_compare_aligned(), four bytes at a time */
+static void emit_iface(struct ipt_bpf_jit *jit, int off, const char *name,
+		       const unsigned char *mask, bool inv)
+{
+	unsigned int i;
+	u32 m;
+
+	if (!memchr_inv(mask, 0, IFNAMSIZ) && !inv)
+		return;
+
+	emit(jit, BPF_MOV64_IMM(BPF_REG_3, 0));
+	for (i = 0; i < IFNAMSIZ; i += sizeof(u32)) {
+		m = get_unaligned((const u32 *)(mask + i));
+		if (!m)
+			continue;
+
+		emit(jit, BPF_LDX_MEM(BPF_W, BPF_REG_2, BPF_REG_1, off + i));
+		emit(jit, BPF_ALU32_IMM(BPF_XOR, BPF_REG_2,
+					get_unaligned((const u32 *)(name + i))));
+		emit(jit, BPF_ALU32_IMM(BPF_AND, BPF_REG_2, m));
+		emit(jit, BPF_ALU64_REG(BPF_OR, BPF_REG_3, BPF_REG_2));
+	}
+	emit(jit, BPF_MOV64_REG(BPF_REG_2, BPF_REG_3));
+	emit_next(jit, inv ? BPF_JEQ : BPF_JNE, 0);
+}
+
+/* Mismatch if (port < min || port > max) ^ inv */
+static void emit_port(struct ipt_bpf_jit *jit, int off, const u16 *range,
+		      bool inv)
+{
+	if (range[0] == 0 && range[1] == 0xffff && !inv)
+		return;
+
+	emit(jit, BPF_LDX_MEM(BPF_H, BPF_REG_2, BPF_REG_1, off));
+	if (!inv) {
+		emit_next(jit, BPF_JGT, range[1]);
+		emit(jit, BPF_JMP_IMM(BPF_JGE, BPF_REG_2, range[0], 1));
+		emit_next(jit, BPF_JA, 0);
+	} else {
+		emit(jit, BPF_JMP_IMM(BPF_JGT, BPF_REG_2, range[1], 1));
+		emit_next(jit, BPF_JGE, range[0]);
+	}
+}
+
+/*
+ * tcp_mt() and udp_mt(): fragments never match, and a first fragment or
+ * a header that can't be read gets the packet dropped, which is the
+ * interpreter's call.
+ */
+static void emit_ports(struct ipt_bpf_jit *jit, const u16 *spts,
+		       const u16 *dpts, u8 invflags, bool tcp)
+{
+	emit(jit, BPF_LDX_MEM(BPF_H, BPF_REG_2, BPF_REG_1, CTX_OFF(fragoff)));
+	if (tcp)
+		emit_hit(jit, BPF_JEQ, 1);
+	emit_next(jit, BPF_JNE, 0);
+
+	emit(jit, BPF_LDX_MEM(BPF_B, BPF_REG_2, BPF_REG_1, CTX_OFF(ports_ok)));
+	emit_hit(jit, BPF_JEQ, 0);
+
+	emit_port(jit, CTX_OFF(sport), spts, invflags & XT_TCP_INV_SRCPT);
+	emit_port(jit, CTX_OFF(dport), dpts, invflags & XT_TCP_INV_DSTPT);
+}
+
+static void emit_match(struct ipt_bpf_jit *jit,
+		       const struct xt_entry_match *ematch)
+{
+	const char *name = ematch->u.kernel.match->name;
+
+	if (!strcmp(name, "tcp")) {
+		const struct xt_tcp *info = (const void *)ematch->data;
+
+		emit_ports(jit, info->spts, info->dpts, info->invflags, true);
+	} else if (!strcmp(name, "udp")) {
+		const struct xt_udp *info = (const void *)ematch->data;
+
+		emit_ports(jit, info->spts, info->dpts, info->invflags, false);
+	} else if (!strcmp(name, "mark")) {
+		const struct xt_mark_mtinfo1 *info = (const void *)ematch->data;
+
+		emit(jit, BPF_LDX_MEM(BPF_W, BPF_REG_2, BPF_REG_1,
+				      CTX_OFF(mark)));
+		emit(jit, BPF_ALU32_IMM(BPF_AND, BPF_REG_2, info->mask));
+		emit(jit, BPF_ALU32_IMM(BPF_XOR, BPF_REG_2, info->mark));
+		emit_next(jit, info->invert ? BPF_JEQ : BPF_JNE, 0);
+	}
+	/* "comment" never fails */
+}
+
+static bool ipt_bpf_match_supported(const struct xt_entry_match *ematch)
+{
+	const struct xt_match *match = ematch->u.kernel.match;
+
+	if (!strcmp(match->name, "tcp") && match->revision == 0) {
+		const struct xt_tcp *info = (const void *)ematch->data;
+
+		return !info->option && !info->flg_mask &&
+		       !(info->invflags & ~(XT_TCP_INV_SRCPT |
+					    XT_TCP_INV_DSTPT));
+	}
+	if (!strcmp(match->name, "udp") && match->revision == 0)
+		return true;
+	if (!strcmp(match->name, "mark") && match->revision == 1)
+		return true;
+	if (!strcmp(match->name, "comment"))
+		return true;
+
+	return false;
+}
+
+static bool ipt_bpf_rule_supported(struct ipt_entry *e)
+{
+	struct xt_entry_match *ematch;
+	unsigned int n = 0;
+
+	xt_ematch_foreach(ematch, e) {
+		if (++n > IPT_BPF_MAX_MATCHES ||
+		    !ipt_bpf_match_supported(ematch))
+			return false;
+	}
+
+	return true;
+}
+
+/*
+ * Emit the checks of rule @e at @offset, in the order of ipt_do_table(),
+ * followed by returning @offset.  Returns false if the rule has no check
+ * at all: it always matches, and ends the program.
+ */
+static bool ipt_bpf_emit_rule(struct ipt_bpf_jit *jit, struct ipt_entry *e,
+			      unsigned int offset)
+{
+	const struct ipt_ip *ip = &e->ip;
+	struct xt_entry_match *ematch;
+	unsigned int start = jit->len;
+
+	jit->nnext = 0;
+	jit->nhit = 0;
+
+	emit_addr(jit, CTX_OFF(saddr), ip->src.s_addr, ip->smsk.s_addr,
+		  ip->invflags & IPT_INV_SRCIP);
+	emit_addr(jit, CTX_OFF(daddr), ip->dst.s_addr, ip->dmsk.s_addr,
+		  ip->invflags & IPT_INV_DSTIP);
+	emit_iface(jit, CTX_OFF(indev), ip->iniface, ip->iniface_mask,
+		   ip->invflags & IPT_INV_VIA_IN);
+	emit_iface(jit, CTX_OFF(outdev), ip->outiface, ip->outiface_mask,
+		   ip->invflags & IPT_INV_VIA_OUT);
+
+	if (ip->proto) {
+		emit(jit, BPF_LDX_MEM(BPF_B, BPF_REG_2, BPF_REG_1,
+				      CTX_OFF(protocol)));
+		emit_next(jit, ip->invflags & IPT_INV_PROTO ? BPF_JEQ : BPF_JNE,
+			  ip->proto);
+	}
+
+	if (ip->flags & IPT_F_FRAG || ip->invflags & IPT_INV_FRAG) {
+		emit(jit, BPF_LDX_MEM(BPF_H, BPF_REG_2, BPF_REG_1,
+				      CTX_OFF(fragoff)));
+		if (!(ip->flags & IPT_F_FRAG))
+			emit_next(jit, BPF_JA, 0);
+		else
+			emit_next(jit, ip->invflags & IPT_INV_FRAG ?
+				  BPF_JNE : BPF_JEQ, 0);
+	}
+
+	xt_ematch_foreach(ematch, e)
+		emit_match(jit, ematch);
+
+	if (jit->len == start)
+		return false;
+
+	patch(jit, jit->hit, jit->nhit);
+	emit(jit, BPF_MOV64_IMM(BPF_REG_0, offset));
+	emit(jit, BPF_EXIT_INSN());
+	patch(jit, jit->next, jit->nnext);
+
+	return true;
+}
+
+/*
+ * Emit a program for the rules from @offset on, up to the end of the
+ * chain or IPT_BPF_MAX_RULES.  Returns the number of rules it skips, and
+ * the offset to go on from in @end.
+ */
+static unsigned int ipt_bpf_emit_chain(struct ipt_bpf_jit *jit,
+				       const struct xt_table_info *info,
+				       unsigned int offset, unsigned int *end)
+{
+	unsigned int n = 0;
+	struct ipt_entry *e;
+
+	jit->len = 0;
+	while (offset < info->size && n < IPT_BPF_MAX_RULES) {
+		e = (void *)info->entries + offset;
+		if (!ipt_bpf_rule_supported(e) ||
+		    !ipt_bpf_emit_rule(jit, e, offset))
+			break;
+
+		offset += e->next_offset;
+		n++;
+	}
+
+	/* Either the first rule that needs the interpreter or the next chunk */
+	emit(jit, BPF_MOV64_IMM(BPF_REG_0, offset));
+	emit(jit, BPF_EXIT_INSN());
+
+	*end = offset;
+	return n;
+}
+
+static struct bpf_prog *ipt_bpf_compile_chain(const struct xt_table_info *info,
+					      struct ipt_bpf_jit *jit,
+					      unsigned int offset,
+					      unsigned int *end)
+{
+	struct bpf_prog *prog;
+
+	if (!ipt_bpf_emit_chain(jit, info, offset, end))
+		return NULL;
+
+	prog = bpf_prog_alloc(bpf_prog_size(jit->len), 0);
+	if (prog == NULL)
+		return ERR_PTR(-ENOMEM);
+
+	jit->insns = prog->insnsi;
+	ipt_bpf_emit_chain(jit, info, offset, end);
+	jit->insns = NULL;
+
+	prog->len = jit->len;
+	bpf_prog_select_runtime(prog);
+	if (!prog->jited) {
+		bpf_prog_free(prog);
+		return ERR_PTR(-EOPNOTSUPP);
+	}
+
+	return prog;
+}
+
+static int ipt_bpf_cmp_offset(const void *a, const void *b)
+{
+	const unsigned int *x = a, *y = b;
+
+	return *x < *y ? -1 : *x > *y;
+}
+
+static int ipt_bpf_cmp_chain(const void *a, const void *b)
+{
+	const struct ipt_bpf_chain *x = a, *y = b;
+
+	return ipt_bpf_cmp_offset(&x->offset, &y->offset);
+}
+
+/* Hook entry points and jump targets */
+static unsigned int *ipt_bpf_chain_heads(const struct xt_table_info *info,
+					 unsigned int *n)
+{
+	const struct xt_standard_target *t;
+	unsigned int *heads, i, j;
+	struct ipt_entry *iter;
+
+	heads = vmalloc((info->number + NF_INET_NUMHOOKS) * sizeof(*heads));
+	if (heads == NULL)
+		return NULL;
+
+	j = 0;
+	for (i = 0; i < NF_INET_NUMHOOKS; i++) {
+		if (info->hook_entry[i] != 0xFFFFFFFF)
+			heads[j++] = info->hook_entry[i];
+	}
+
+	xt_entry_foreach(iter, info->entries, info->size) {
+		t = (void *)ipt_get_target(iter);
+		if (t->target.u.kernel.target->target || t->verdict < 0)
+			continue;
+		if (t->verdict == (void *)iter - (void *)info->entries +
+				  iter->next_offset)
+			continue;
+		heads[j++] = t->verdict;
+	}
+
+	sort(heads, j, sizeof(*heads), ipt_bpf_cmp_offset, NULL);
+	for (*n = 0, i = 0; i < j; i++) {
+		if (!*n || heads[*n - 1] != heads[i])
+			heads[(*n)++] = heads[i];
+	}
+
+	return heads;
+}
+
+void ipt_bpf_free(struct xt_table_info *info)
+{
+	struct ipt_bpf_table *bt = info->compiled;
+	unsigned int i;
+
+	if (bt == NULL)
+		return;
+
+	for (i = 0; i < bt->nchains; i++)
+		bpf_prog_free(bt->chain[i].prog);
+	kvfree(bt);
+	info->compiled = NULL;
+}
+EXPORT_SYMBOL_GPL(ipt_bpf_free);
+
+/**
+ * ipt_bpf_compile - compile the rules of a table to BPF
+ * @info: translated table, not in use yet
+ *
+ * Best effort: a table or chain that can't be compiled, for lack of
+ * memory or of a JIT, is left to the interpreter.
+ */
+void ipt_bpf_compile(struct xt_table_info *info)
+{
+	unsigned int *heads, nheads, offset, end, i, max;
+	struct ipt_bpf_jit *jit;
+	struct ipt_bpf_table *bt;
+	struct bpf_prog *prog;
+
+	heads = ipt_bpf_chain_heads(info, &nheads);
+	if (heads == NULL)
+		return;
+
+	/* Long chains take a program per IPT_BPF_MAX_RULES rules */
+	max = nheads + info->number / IPT_BPF_MAX_RULES;
+	bt = vzalloc(sizeof(*bt) + max * sizeof(bt->chain[0]));
+	jit = kzalloc(sizeof(*jit), GFP_KERNEL);
+	if (bt == NULL || jit == NULL)
+		goto out;
+
+	for (i = 0, prog = NULL; i < nheads && !IS_ERR(prog); i++) {
+		/* Until a rule for the interpreter, a chunk at a time */
+		for (offset = heads[i]; bt->nchains < max; offset = end) {
+			prog = ipt_bpf_compile_chain(info, jit, offset, &end);
+			if (IS_ERR_OR_NULL(prog))
+				break;
+
+			bt->chain[bt->nchains].offset = offset;
+			bt->chain[bt->nchains].prog = prog;
+			bt->nchains++;
+		}
+	}
+
+	if (bt->nchains) {
+		sort(bt->chain, bt->nchains, sizeof(bt->chain[0]),
+		     ipt_bpf_cmp_chain, NULL);
+		info->compiled = bt;
+		bt = NULL;
+	}
+out:
+	if (bt != NULL) {
+		info->compiled = bt;
+		ipt_bpf_free(info);
+	}
+	kfree(jit);
+	vfree(heads);
+}
+EXPORT_SYMBOL_GPL(ipt_bpf_compile);
+
+void __ipt_bpf_init_ctx(struct ipt_bpf_ctx *ctx, const struct sk_buff *skb,
+			const struct xt_action_param *par,
+			const char *indev, const char *outdev)
+{
+	const struct iphdr *ip = ip_hdr(skb);
+	const __be16 *ports;
+	unsigned int len;
+	union {
+		struct tcphdr	tcp;
+		struct udphdr	udp;
+	} _hdr;
+
+	ctx->saddr = ip->saddr;
+	ctx->daddr = ip->daddr;
+	memcpy(ctx->indev, indev, IFNAMSIZ);
+	memcpy(ctx->outdev, outdev, IFNAMSIZ);
+	ctx->mark = skb->mark;
+	ctx->fragoff = par->fragoff;
+	ctx->protocol = ip->protocol;
+	ctx->ports_ok = 0;
+
+	if (par->fragoff)
+		return;
+
+	switch (ip->protocol) {
+	case IPPROTO_TCP:
+		len = sizeof(struct tcphdr);
+		break;
+	case IPPROTO_UDP:
+		len = sizeof(struct udphdr);
+		break;
+	default:
+		return;
+	}
+
+	ports = skb_header_pointer(skb, par->thoff, len, &_hdr);
+	if (ports == NULL)
+		return;
+
+	ctx->sport = ntohs(ports[0]);
+	ctx->dport = ntohs(ports[1]);
+	ctx->ports_ok = 1;
+}
+EXPORT_SYMBOL_GPL(__ipt_bpf_init_ctx);
+
+static const struct bpf_prog *
+ipt_bpf_find(const struct ipt_bpf_table *bt, unsigned int offset)
+{
+	unsigned int lo = 0, hi = bt->nchains, mid;
+
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+		if (bt->chain[mid].offset == offset)
+			return bt->chain[mid].prog;
+		if (bt->chain[mid].offset < offset)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return NULL;
+}
+
+unsigned int __ipt_bpf_skip(const struct xt_table_info *info,
+			    unsigned int offset,
+			    const struct ipt_bpf_ctx *ctx)
+{
+	const struct bpf_prog *prog;
+	unsigned int next;
+
+	/* A program that runs to its end continues with the next one */
+	while ((prog = ipt_bpf_find(info->compiled, offset)) != NULL) {
+		next = BPF_PROG_RUN(prog, (void *)ctx);
+		if (next == offset)
+			break;
+		offset = next;
+	}
+
+	return offset;
+}
+EXPORT_SYMBOL_GPL(__ipt_bpf_skip);
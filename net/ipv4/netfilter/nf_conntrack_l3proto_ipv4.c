@@ -217,7 +217,7 @@ static struct ctl_table ip_ct_sysctl_table[] = {
 		.procname	= "ip_conntrack_count",
 		.maxlen		= sizeof(int),
 		.mode		= 0444,
-		.proc_handler	= proc_dointvec,
+		.proc_handler	= proc_nf_conntrack_count,
 	},
 	{
 		.procname	= "ip_conntrack_buckets",
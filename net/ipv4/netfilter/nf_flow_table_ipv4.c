@@ -0,0 +1,246 @@
+/*
+ * IPv4 flow table fast path: forwards the packets of offloaded flows from
+ * the ingress hook.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <linux/kernel.h>
+#include <linux/init.h>
+#include <linux/module.h>
+#include <linux/netfilter.h>
+#include <linux/ip.h>
+#include <linux/tcp.h>
+#include <linux/udp.h>
+#include <net/ip.h>
+#include <net/route.h>
+#include <net/neighbour.h>
+#include <net/checksum.h>
+#include <net/netfilter/nf_flow_table.h>
+
+static unsigned int nf_flow_l4_hdrsize(u8 protocol)
+{
+	switch (protocol) {
+	case IPPROTO_TCP:
+		return sizeof(struct tcphdr);
+	case IPPROTO_UDP:
+		return sizeof(struct udphdr);
+	}
+
+	return 0;
+}
+
+/* Fill in the lookup key for @skb, which arrived on @dev */
+static int nf_flow_tuple_ip(struct sk_buff *skb, const struct net_device *dev,
+			    struct flow_offload_tuple *tuple,
+			    unsigned int *thoffp)
+{
+	unsigned int thoff, hdrsize;
+	struct iphdr *iph;
+	__be16 *ports;
+
+	if (!pskb_may_pull(skb, sizeof(*iph)))
+		return -1;
+
+	iph = ip_hdr(skb);
+	thoff = iph->ihl * 4;
+
+	/* Leave options, fragments and anything dubious to the slow path */
+	if (iph->version != 4 || thoff != sizeof(*iph) ||
+	    ip_is_fragment(iph) ||
+	    unlikely(ip_fast_csum((u8 *)iph, iph->ihl)))
+		return -1;
+
+	hdrsize = nf_flow_l4_hdrsize(iph->protocol);
+	if (!hdrsize)
+		return -1;
+
+	if (ntohs(iph->tot_len) < thoff + hdrsize ||
+	    !pskb_may_pull(skb, thoff + hdrsize))
+		return -1;
+
+	iph = ip_hdr(skb);
+	ports = (__be16 *)(skb_network_header(skb) + thoff);
+
+	tuple->src_v4 = iph->saddr;
+	tuple->dst_v4 = iph->daddr;
+	tuple->src_port = ports[0];
+	tuple->dst_port = ports[1];
+	tuple->l3proto = AF_INET;
+	tuple->l4proto = iph->protocol;
+	tuple->iifidx = dev->ifindex;
+
+	*thoffp = thoff;
+	return 0;
+}
+
+/* Connection closing or reset: conntrack has to see that */
+static bool nf_flow_state_check(struct flow_offload *flow, struct sk_buff *skb,
+				unsigned int thoff)
+{
+	struct tcphdr *tcph;
+
+	if (ip_hdr(skb)->protocol != IPPROTO_TCP)
+		return false;
+
+	tcph = (struct tcphdr *)(skb_network_header(skb) + thoff);
+	if (unlikely(tcph->fin || tcph->rst)) {
+		flow_offload_teardown(flow);
+		return true;
+	}
+
+	return false;
+}
+
+static __sum16 *nf_flow_l4_csum(struct sk_buff *skb, unsigned int thoff)
+{
+	struct udphdr *udph;
+
+	switch (ip_hdr(skb)->protocol) {
+	case IPPROTO_TCP:
+		return &((struct tcphdr *)(skb_network_header(skb) + thoff))->check;
+	case IPPROTO_UDP:
+		udph = (struct udphdr *)(skb_network_header(skb) + thoff);
+		if (udph->check || skb->ip_summed == CHECKSUM_PARTIAL)
+			return &udph->check;
+		break;
+	}
+
+	return NULL;
+}
+
+static void nf_flow_nat_addr(struct sk_buff *skb, __sum16 *check,
+			     __be32 *addr, __be32 new_addr)
+{
+	if (*addr == new_addr)
+		return;
+
+	if (check)
+		inet_proto_csum_replace4(check, skb, *addr, new_addr, true);
+	csum_replace4(&ip_hdr(skb)->check, *addr, new_addr);
+	*addr = new_addr;
+}
+
+static void nf_flow_nat_port(struct sk_buff *skb, __sum16 *check,
+			     __be16 *port, __be16 new_port)
+{
+	if (*port == new_port)
+		return;
+
+	if (check)
+		inet_proto_csum_replace2(check, skb, *port, new_port, false);
+	*port = new_port;
+}
+
+/*
+ * A packet in one direction leaves with the addresses and ports the other
+ * direction's tuple expects to see, swapped: this covers SNAT and DNAT.
+ */
+static void nf_flow_nat_ip(const struct flow_offload *flow, struct sk_buff *skb,
+			   unsigned int thoff, enum flow_offload_tuple_dir dir)
+{
+	const struct flow_offload_tuple *other = &flow->tuplehash[!dir].tuple;
+	__be16 *ports = (__be16 *)(skb_network_header(skb) + thoff);
+	struct iphdr *iph = ip_hdr(skb);
+	__sum16 *check;
+
+	if (!(flow->flags & (FLOW_OFFLOAD_SNAT | FLOW_OFFLOAD_DNAT)))
+		return;
+
+	check = nf_flow_l4_csum(skb, thoff);
+
+	nf_flow_nat_addr(skb, check, &iph->saddr, other->dst_v4);
+	nf_flow_nat_addr(skb, check, &iph->daddr, other->src_v4);
+	nf_flow_nat_port(skb, check, &ports[0], other->dst_port);
+	nf_flow_nat_port(skb, check, &ports[1], other->src_port);
+
+	if (check && iph->protocol == IPPROTO_UDP && !*check)
+		*check = CSUM_MANGLED_0;
+}
+
+/**
+ * nf_flow_offload_ip_hook - forward an IPv4 packet through the flow table
+ * @flow_table: flow table to look the packet up in
+ * @skb: packet, from the ingress hook
+ *
+ * Returns NF_STOLEN if the packet was transmitted, NF_DROP if it had to be
+ * dropped on the way, and NF_ACCEPT to leave it to the classic forwarding
+ * path: no flow, or something only the slow path handles, like TTL expiry,
+ * fragmentation or the end of a TCP connection.
+ */
+unsigned int nf_flow_offload_ip_hook(struct nf_flowtable *flow_table,
+				     struct sk_buff *skb)
+{
+	struct flow_offload_tuple_rhash *tuplehash;
+	struct flow_offload_tuple tuple = {};
+	enum flow_offload_tuple_dir dir;
+	struct flow_offload *flow;
+	struct net_device *outdev;
+	unsigned int thoff;
+	struct rtable *rt;
+	struct iphdr *iph;
+	__be32 nexthop;
+
+	if (skb->protocol != htons(ETH_P_IP) ||
+	    skb->pkt_type != PACKET_HOST || skb_shared(skb))
+		return NF_ACCEPT;
+
+	if (nf_flow_tuple_ip(skb, skb->dev, &tuple, &thoff) < 0)
+		return NF_ACCEPT;
+
+	tuplehash = flow_offload_lookup(flow_table, &tuple);
+	if (!tuplehash)
+		return NF_ACCEPT;
+
+	dir = tuplehash->tuple.dir;
+	flow = container_of(tuplehash, struct flow_offload, tuplehash[dir]);
+	rt = (struct rtable *)tuplehash->tuple.dst_cache;
+
+	if (unlikely(flow->flags & FLOW_OFFLOAD_TEARDOWN))
+		return NF_ACCEPT;
+
+	outdev = dev_get_by_index_rcu(dev_net(skb->dev),
+				      tuplehash->tuple.oifidx);
+	if (!outdev)
+		return NF_ACCEPT;
+
+	if (ip_hdr(skb)->ttl <= 1 ||
+	    (ntohs(ip_hdr(skb)->tot_len) > tuplehash->tuple.mtu &&
+	     !skb_is_gso(skb)))
+		return NF_ACCEPT;
+
+	if (nf_flow_state_check(flow, skb, thoff))
+		return NF_ACCEPT;
+
+	/* The route changed since the flow was set up */
+	if (!dst_check(&rt->dst, 0)) {
+		flow_offload_teardown(flow);
+		return NF_ACCEPT;
+	}
+
+	if (pskb_trim_rcsum(skb, ntohs(ip_hdr(skb)->tot_len)))
+		return NF_DROP;
+
+	if (!skb_make_writable(skb, thoff +
+			       nf_flow_l4_hdrsize(ip_hdr(skb)->protocol)))
+		return NF_DROP;
+
+	flow_offload_refresh(flow);
+
+	nf_flow_nat_ip(flow, skb, thoff, dir);
+
+	iph = ip_hdr(skb);
+	ip_decrease_ttl(iph);
+	skb_forward_csum(skb);
+
+	skb->dev = outdev;
+	nexthop = rt_nexthop(rt, iph->daddr);
+	neigh_xmit(NEIGH_ARP_TABLE, outdev, &nexthop, skb);
+
+	return NF_STOLEN;
+}
+EXPORT_SYMBOL_GPL(nf_flow_offload_ip_hook);
+
+MODULE_LICENSE("GPL");
@@ -29,12 +29,66 @@ static void tcp_gso_tstamp(struct sk_buff *skb, unsigned int ts_seq,
 	}
 }
 
+static void tcp4_gso_segment_list_fixup(struct sk_buff *seg, __be32 *oldip,
+					__be32 newip, __be16 *oldport,
+					__be16 newport)
+{
+	struct tcphdr *th = tcp_hdr(seg);
+
+	if (*oldip == newip && *oldport == newport)
+		return;
+
+	inet_proto_csum_replace4(&th->check, seg, *oldip, newip, true);
+	inet_proto_csum_replace2(&th->check, seg, *oldport, newport, false);
+	*oldip = newip;
+	*oldport = newport;
+}
+
+/*
+ * The packets behind a fraglist GRO head still have the headers they were
+ * received with, while the head may have been NATed or had its TTL
+ * decremented on the way.  Carry those changes over, the IP checksums are
+ * recomputed by inet_gso_segment().
+ */
+static struct sk_buff *tcp4_gso_segment_list(struct sk_buff *skb,
+					     netdev_features_t features)
+{
+	unsigned int offset = skb_network_header(skb) - skb_mac_header(skb);
+	struct sk_buff *segs, *seg;
+	struct iphdr *iph, *iph2;
+	struct tcphdr *th, *th2;
+
+	segs = skb_segment_list(skb, features, offset);
+	if (IS_ERR(segs))
+		return segs;
+
+	iph = ip_hdr(segs);
+	th = tcp_hdr(segs);
+
+	for (seg = segs->next; seg; seg = seg->next) {
+		iph2 = ip_hdr(seg);
+		th2 = tcp_hdr(seg);
+
+		iph2->ttl = iph->ttl;
+		iph2->tos = iph->tos;
+		tcp4_gso_segment_list_fixup(seg, &iph2->saddr, iph->saddr,
+					    &th2->source, th->source);
+		tcp4_gso_segment_list_fixup(seg, &iph2->daddr, iph->daddr,
+					    &th2->dest, th->dest);
+	}
+
+	return segs;
+}
+
 static struct sk_buff *tcp4_gso_segment(struct sk_buff *skb,
 					netdev_features_t features)
 {
 	if (!pskb_may_pull(skb, sizeof(struct tcphdr)))
 		return ERR_PTR(-EINVAL);
 
+	if (skb_shinfo(skb)->gso_type & SKB_GSO_FRAGLIST)
+		return tcp4_gso_segment_list(skb, features);
+
 	if (unlikely(skb->ip_summed != CHECKSUM_PARTIAL)) {
 		const struct iphdr *iph = ip_hdr(skb);
 		struct tcphdr *th = tcp_hdr(skb);
@@ -246,6 +300,23 @@ found:
 
 	flush |= (len - 1) >= mss;
 	flush |= (ntohl(th2->seq) + skb_gro_len(p)) ^ ntohl(th->seq);
+	flush |= NAPI_GRO_CB(p)->is_flist ^ NAPI_GRO_CB(skb)->is_flist;
+
+	if (NAPI_GRO_CB(p)->is_flist) {
+		/* Every packet is sent out again as received: they must
+		 * agree on flags and checksum state, not just on options.
+		 */
+		flush |= (__force int)(flags ^ tcp_flag_word(th2));
+		flush |= skb->ip_summed != p->ip_summed;
+		flush |= skb->csum_level != p->csum_level;
+		flush |= NAPI_GRO_CB(p)->count >= 64;
+		flush |= !pskb_may_pull(skb, skb_gro_offset(skb));
+
+		if (flush || skb_gro_receive_list(p, skb))
+			mss = 1;
+
+		goto out_check_final;
+	}
 
 	if (flush || skb_gro_receive(head, skb)) {
 		mss = 1;
@@ -288,6 +359,38 @@ int tcp_gro_complete(struct sk_buff *skb)
 }
 EXPORT_SYMBOL(tcp_gro_complete);
 
+/*
+ * Segments of a connection that doesn't end here are most likely being
+ * forwarded: with NETIF_F_GRO_FRAGLIST, chain them unmodified instead of
+ * merging them, so that they can go out again without resegmentation.
+ */
+static void tcp4_check_fraglist_gro(struct sk_buff *skb)
+{
+	const struct iphdr *iph;
+	struct tcphdr *th;
+	struct sock *sk;
+
+	if (likely(!(skb->dev->features & NETIF_F_GRO_FRAGLIST)))
+		return;
+
+	th = skb_gro_header_fast(skb, skb_gro_offset(skb));
+	if (skb_gro_header_hard(skb, skb_gro_offset(skb) + sizeof(*th))) {
+		th = skb_gro_header_slow(skb, skb_gro_offset(skb) + sizeof(*th),
+					 skb_gro_offset(skb));
+		if (unlikely(!th))
+			return;
+	}
+
+	iph = skb_gro_network_header(skb);
+	sk = __inet_lookup_established(dev_net(skb->dev), &tcp_hashinfo,
+				       iph->saddr, th->source,
+				       iph->daddr, ntohs(th->dest),
+				       skb->dev->ifindex);
+	NAPI_GRO_CB(skb)->is_flist = !sk;
+	if (sk)
+		sock_gen_put(sk);
+}
+
 static struct sk_buff **tcp4_gro_receive(struct sk_buff **head, struct sk_buff *skb)
 {
 	/* Don't bother verifying checksum if we're going to flush anyway. */
@@ -298,6 +401,8 @@ static struct sk_buff **tcp4_gro_receive(struct sk_buff **head, struct sk_buff *
 		return NULL;
 	}
 
+	tcp4_check_fraglist_gro(skb);
+
 	return tcp_gro_receive(head, skb);
 }
 
@@ -306,6 +411,23 @@ static int tcp4_gro_complete(struct sk_buff *skb, int thoff)
 	const struct iphdr *iph = ip_hdr(skb);
 	struct tcphdr *th = tcp_hdr(skb);
 
+	if (NAPI_GRO_CB(skb)->is_flist) {
+		skb_shinfo(skb)->gso_type |= SKB_GSO_FRAGLIST | SKB_GSO_TCPV4;
+		skb_shinfo(skb)->gso_segs = NAPI_GRO_CB(skb)->count;
+
+		/* The head no longer covers what a CHECKSUM_COMPLETE value
+		 * was computed over, each packet was validated on its own.
+		 */
+		if (skb->ip_summed == CHECKSUM_UNNECESSARY) {
+			if (skb->csum_level < SKB_MAX_CSUM_LEVEL)
+				skb->csum_level++;
+		} else {
+			skb->ip_summed = CHECKSUM_UNNECESSARY;
+			skb->csum_level = 0;
+		}
+		return 0;
+	}
+
 	th->check = ~tcp_v4_check(skb->len - thoff, iph->saddr,
 				  iph->daddr, 0);
 	skb_shinfo(skb)->gso_type |= SKB_GSO_TCPV4;
@@ -889,6 +889,28 @@ out:
 	sk_free(sk);
 }
 
+/* Earliest departure time of @len bytes of data at the pacing rate, for
+ * the qdiscs that honour skb->tstamp.  Zero when the flow isn't paced.
+ */
+static u64 tcp_departure_time(struct sock *sk, unsigned int len)
+{
+	struct tcp_sock *tp = tcp_sk(sk);
+	u32 rate = ACCESS_ONCE(sk->sk_pacing_rate);
+	u64 now, tstamp;
+
+	if (!rate || rate == ~0U)
+		return 0;
+
+	now = ktime_get_ns();
+	tstamp = max(tp->tcp_wstamp_ns, now);
+	/* Nobody down the path paces on it, don't drift away from now */
+	if (unlikely(tstamp - now > NSEC_PER_SEC))
+		tstamp = now;
+	tp->tcp_wstamp_ns = tstamp + div_u64((u64)len * NSEC_PER_SEC, rate);
+
+	return tstamp;
+}
+
 /* This routine actually transmits TCP packets queued in by
  * tcp_do_sendmsg().  This is used by both the initial
  * transmission and possible later retransmissions.
@@ -917,6 +939,7 @@ static int tcp_transmit_skb(struct sock *sk, struct sk_buff *skb, int clone_it,
 
 	if (clone_it) {
 		skb_mstamp_get(&skb->skb_mstamp);
+		tcp_rate_skb_sent(sk, skb);
 
 		if (unlikely(skb_cloned(skb)))
 			skb = pskb_copy(skb, gfp_mask);
@@ -1018,8 +1041,12 @@ static int tcp_transmit_skb(struct sock *sk, struct sk_buff *skb, int clone_it,
 	skb_shinfo(skb)->gso_segs = tcp_skb_pcount(skb);
 	skb_shinfo(skb)->gso_size = tcp_skb_mss(skb);
 
-	/* Our usage of tstamp should remain private */
+	/* Our usage of tstamp should remain private, data leaves at its
+	 * departure time.
+	 */
 	skb->tstamp.tv64 = 0;
+	if (skb->len != tcp_header_size)
+		skb->tstamp.tv64 = tcp_departure_time(sk, skb->len);
 
 	/* Cleanup our debris for IP stacks */
 	memset(skb->cb, 0, max(sizeof(struct inet_skb_parm),
@@ -1530,7 +1557,8 @@ static bool tcp_nagle_check(bool partial, const struct tcp_sock *tp,
 /* Return how many segs we'd like on a TSO packet,
  * to send one TSO packet per ms
  */
-static u32 tcp_tso_autosize(const struct sock *sk, unsigned int mss_now)
+u32 tcp_tso_autosize(const struct sock *sk, unsigned int mss_now,
+		     int min_tso_segs)
 {
 	u32 bytes, segs;
 
@@ -1542,10 +1570,23 @@ static u32 tcp_tso_autosize(const struct sock *sk, unsigned int mss_now)
 	 * This preserves ACK clocking and is consistent
 	 * with tcp_tso_should_defer() heuristic.
 	 */
-	segs = max_t(u32, bytes / mss_now, sysctl_tcp_min_tso_segs);
+	segs = max_t(u32, bytes / mss_now, min_tso_segs);
 
 	return min_t(u32, segs, sk->sk_gso_max_segs);
 }
+EXPORT_SYMBOL(tcp_tso_autosize);
+
+/* Return the number of segments we want in the skb we are transmitting.
+ * See if congestion control module wants to decide; otherwise, autosize.
+ */
+static u32 tcp_tso_segs(struct sock *sk, unsigned int mss_now)
+{
+	const struct tcp_congestion_ops *ca_ops = inet_csk(sk)->icsk_ca_ops;
+	u32 tso_segs = ca_ops->tso_segs_goal ? ca_ops->tso_segs_goal(sk) : 0;
+
+	return tso_segs ? :
+		tcp_tso_autosize(sk, mss_now, sysctl_tcp_min_tso_segs);
+}
 
 /* Returns the portion of skb which can be sent right away */
 static unsigned int tcp_mss_split_point(const struct sock *sk,
@@ -2040,7 +2081,7 @@ static bool tcp_write_xmit(struct sock *sk, unsigned int mss_now, int nonagle,
 		}
 	}
 
-	max_segs = tcp_tso_autosize(sk, mss_now);
+	max_segs = tcp_tso_segs(sk, mss_now);
 	while ((skb = tcp_send_head(sk))) {
 		unsigned int limit;
 
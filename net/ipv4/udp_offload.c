@@ -175,6 +175,152 @@ out_unlock:
 	return segs;
 }
 
+/*
+ * Split a UDP_SEGMENT datagram in gso_size sized datagrams, each with its
+ * own UDP header.  The IP headers are fixed up by the network layer.
+ */
+struct sk_buff *__udp_gso_segment(struct sk_buff *gso_skb,
+				  netdev_features_t features)
+{
+	struct sock *sk = gso_skb->sk;
+	unsigned int sum_truesize = 0;
+	struct sk_buff *segs, *seg;
+	struct udphdr *uh;
+	unsigned int mss;
+	bool copy_dtor;
+	__sum16 check;
+	__be16 newlen;
+
+	mss = skb_shinfo(gso_skb)->gso_size;
+	if (gso_skb->len <= sizeof(*uh) + mss)
+		return ERR_PTR(-EINVAL);
+
+	skb_pull(gso_skb, sizeof(*uh));
+
+	/* clear destructor to avoid skb_segment assigning it to tail */
+	copy_dtor = gso_skb->destructor == sock_wfree;
+	if (copy_dtor)
+		gso_skb->destructor = NULL;
+
+	segs = skb_segment(gso_skb, features);
+	if (unlikely(IS_ERR_OR_NULL(segs))) {
+		if (copy_dtor)
+			gso_skb->destructor = sock_wfree;
+		return segs;
+	}
+
+	seg = segs;
+	uh = udp_hdr(seg);
+
+	/* compute checksum adjustment based on old length versus new */
+	newlen = htons(sizeof(*uh) + mss);
+	check = csum16_add(csum16_sub(uh->check, uh->len), newlen);
+
+	for (;;) {
+		if (copy_dtor) {
+			seg->destructor = sock_wfree;
+			seg->sk = sk;
+			sum_truesize += seg->truesize;
+		}
+
+		if (!seg->next)
+			break;
+
+		uh->len = newlen;
+		uh->check = check;
+
+		if (seg->ip_summed != CHECKSUM_PARTIAL)
+			uh->check = gso_make_checksum(seg, ~check) ? :
+				    CSUM_MANGLED_0;
+
+		seg = seg->next;
+		uh = udp_hdr(seg);
+	}
+
+	/* last packet can be partial gso_size, account for that in checksum */
+	newlen = htons(skb_tail_pointer(seg) - skb_transport_header(seg) +
+		       seg->data_len);
+	check = csum16_add(csum16_sub(uh->check, uh->len), newlen);
+
+	uh->len = newlen;
+	uh->check = check;
+
+	if (seg->ip_summed != CHECKSUM_PARTIAL)
+		uh->check = gso_make_checksum(seg, ~check) ? : CSUM_MANGLED_0;
+
+	/* update refcount for the packet */
+	if (copy_dtor) {
+		int delta = sum_truesize - gso_skb->truesize;
+
+		/* In some pathological cases, delta can be negative */
+		if (likely(delta >= 0))
+			atomic_add(delta, &sk->sk_wmem_alloc);
+		else
+			WARN_ON_ONCE(atomic_sub_and_test(-delta,
+							 &sk->sk_wmem_alloc));
+	}
+	return segs;
+}
+EXPORT_SYMBOL_GPL(__udp_gso_segment);
+
+static void udp4_gso_segment_list_fixup(struct sk_buff *seg, __be32 *oldip,
+					__be32 newip, __be16 *oldport,
+					__be16 newport)
+{
+	struct udphdr *uh = udp_hdr(seg);
+
+	if (*oldip == newip && *oldport == newport)
+		return;
+
+	if (uh->check) {
+		inet_proto_csum_replace4(&uh->check, seg, *oldip, newip, true);
+		inet_proto_csum_replace2(&uh->check, seg, *oldport, newport,
+					 false);
+		if (!uh->check)
+			uh->check = CSUM_MANGLED_0;
+	}
+	*oldip = newip;
+	*oldport = newport;
+}
+
+/*
+ * Restore the datagrams chained by fraglist GRO, carrying over what the
+ * stack changed in the head's headers since, see tcp4_gso_segment_list().
+ */
+static struct sk_buff *udp4_gso_segment_list(struct sk_buff *skb,
+					     netdev_features_t features)
+{
+	unsigned int offset = skb_network_header(skb) - skb_mac_header(skb);
+	unsigned int mss = skb_shinfo(skb)->gso_size;
+	struct sk_buff *segs, *seg;
+	struct iphdr *iph, *iph2;
+	struct udphdr *uh, *uh2;
+
+	segs = skb_segment_list(skb, features, offset);
+	if (IS_ERR(segs))
+		return segs;
+
+	/* udp4_gro_complete() made the head cover all datagrams */
+	udp_hdr(segs)->len = htons(sizeof(struct udphdr) + mss);
+
+	iph = ip_hdr(segs);
+	uh = udp_hdr(segs);
+
+	for (seg = segs->next; seg; seg = seg->next) {
+		iph2 = ip_hdr(seg);
+		uh2 = udp_hdr(seg);
+
+		iph2->ttl = iph->ttl;
+		iph2->tos = iph->tos;
+		udp4_gso_segment_list_fixup(seg, &iph2->saddr, iph->saddr,
+					    &uh2->source, uh->source);
+		udp4_gso_segment_list_fixup(seg, &iph2->daddr, iph->daddr,
+					    &uh2->dest, uh->dest);
+	}
+
+	return segs;
+}
+
 static struct sk_buff *udp4_ufo_fragment(struct sk_buff *skb,
 					 netdev_features_t features)
 {
@@ -194,6 +340,12 @@ static struct sk_buff *udp4_ufo_fragment(struct sk_buff *skb,
 	if (!pskb_may_pull(skb, sizeof(struct udphdr)))
 		goto out;
 
+	if (skb_shinfo(skb)->gso_type & SKB_GSO_FRAGLIST)
+		return udp4_gso_segment_list(skb, features);
+
+	if (skb_shinfo(skb)->gso_type & SKB_GSO_UDP_L4)
+		return __udp_gso_segment(skb, features);
+
 	mss = skb_shinfo(skb)->gso_size;
 	if (unlikely(skb->len <= mss))
 		goto out;
@@ -290,8 +442,112 @@ unlock:
 }
 EXPORT_SYMBOL(udp_del_offload);
 
+#define UDP_GRO_CNT_MAX 64
+static struct sk_buff **udp_gro_receive_segment(struct sk_buff **head,
+						struct sk_buff *skb,
+						struct udphdr *uh)
+{
+	struct sk_buff *p, **pp = NULL;
+	unsigned int off = skb_gro_offset(skb);
+	unsigned int ulen = ntohs(uh->len);
+	struct udphdr *uh2;
+	int ret;
+
+	/* requires non zero csum, for symmetry with GSO */
+	if (!uh->check || ulen <= sizeof(*uh) || ulen != skb_gro_len(skb)) {
+		NAPI_GRO_CB(skb)->flush = 1;
+		return NULL;
+	}
+	NAPI_GRO_CB(skb)->udp_gro_sk = 1;
+
+	skb_gro_pull(skb, sizeof(struct udphdr)); /* pull the udp header */
+	skb_gro_postpull_rcsum(skb, uh, sizeof(struct udphdr));
+
+	for (; (p = *head); head = &p->next) {
+		if (!NAPI_GRO_CB(p)->same_flow)
+			continue;
+
+		uh2 = (struct udphdr *)(p->data + off);
+
+		/* Match ports only, as csum is always non zero */
+		if (*(u32 *)&uh->source != *(u32 *)&uh2->source ||
+		    !NAPI_GRO_CB(p)->udp_gro_sk ||
+		    NAPI_GRO_CB(p)->is_flist != NAPI_GRO_CB(skb)->is_flist) {
+			NAPI_GRO_CB(p)->same_flow = 0;
+			continue;
+		}
+
+		/* All segments but the last must be gso_size long: merge the
+		 * first datagram shorter than that and complete the packet,
+		 * a longer one starts a new flow.  Also cap the number of
+		 * segments, so small packet floods can't grow truesize too
+		 * much.  Chained datagrams go out again as received, so they
+		 * must also agree on their checksum state.
+		 */
+		if (ulen > ntohs(uh2->len))
+			return head;
+
+		if (NAPI_GRO_CB(skb)->is_flist)
+			ret = skb->ip_summed != p->ip_summed ||
+			      skb->csum_level != p->csum_level ||
+			      !pskb_may_pull(skb, skb_gro_offset(skb)) ||
+			      skb_gro_receive_list(p, skb);
+		else
+			ret = skb_gro_receive(head, skb);
+
+		if (ret || ulen != ntohs(uh2->len) ||
+		    NAPI_GRO_CB(p)->count >= UDP_GRO_CNT_MAX)
+			pp = head;
+
+		return pp;
+	}
+
+	/* no match, skb starts a new flow */
+	return NULL;
+}
+
+static bool udp_gro_sk_enabled(struct sk_buff *skb, struct udphdr *uh,
+			       udp_lookup_t lookup)
+{
+	struct sock *sk;
+	bool ret;
+
+	if (!static_key_false(&udp_gro_needed) || !lookup)
+		return false;
+
+	sk = lookup(skb, uh->source, uh->dest);
+	if (!sk)
+		return false;
+
+	ret = udp_sk(sk)->gro_enabled;
+	sock_put(sk);
+	return ret;
+}
+
+/*
+ * Datagrams nobody here receives are most likely forwarded: with
+ * NETIF_F_GRO_FRAGLIST, chain them unmodified so that they can go out
+ * again without being resegmented.
+ */
+static bool udp_gro_fraglist_enabled(struct sk_buff *skb, struct udphdr *uh,
+				     udp_lookup_t lookup)
+{
+	struct sock *sk;
+
+	if (likely(!(skb->dev->features & NETIF_F_GRO_FRAGLIST)) ||
+	    NAPI_GRO_CB(skb)->is_ipv6 || !lookup)
+		return false;
+
+	sk = lookup(skb, uh->source, uh->dest);
+	if (!sk)
+		return true;
+
+	sock_put(sk);
+	return false;
+}
+
 struct sk_buff **udp_gro_receive(struct sk_buff **head, struct sk_buff *skb,
-				 struct udphdr *uh)
+				 struct udphdr *uh, udp_lookup_t lookup)
 {
 	struct udp_offload_priv *uo_priv;
 	struct sk_buff *p, **pp = NULL;
@@ -315,6 +571,15 @@ struct sk_buff **udp_gro_receive(struct sk_buff **head, struct sk_buff *skb,
 		    uo_priv->offload->callbacks.gro_receive)
 			goto unflush;
 	}
+
+	if (udp_gro_sk_enabled(skb, uh, lookup)) {
+		flush = 0;
+		pp = udp_gro_receive_segment(head, skb, uh);
+	} else if (udp_gro_fraglist_enabled(skb, uh, lookup)) {
+		NAPI_GRO_CB(skb)->is_flist = 1;
+		flush = 0;
+		pp = udp_gro_receive_segment(head, skb, uh);
+	}
 	goto out_unlock;
 
 unflush:
@@ -349,6 +614,15 @@ out:
 	return pp;
 }
 
+static struct sock *udp4_gro_lookup_skb(struct sk_buff *skb, __be16 sport,
+					__be16 dport)
+{
+	const struct iphdr *iph = skb_gro_network_header(skb);
+
+	return udp4_lib_lookup(dev_net(skb->dev), iph->saddr, sport,
+			       iph->daddr, dport, skb->dev->ifindex);
+}
+
 static struct sk_buff **udp4_gro_receive(struct sk_buff **head,
 					 struct sk_buff *skb)
 {
@@ -369,13 +643,24 @@ static struct sk_buff **udp4_gro_receive(struct sk_buff **head,
 					     inet_gro_compute_pseudo);
 skip:
 	NAPI_GRO_CB(skb)->is_ipv6 = 0;
-	return udp_gro_receive(head, skb, uh);
+	return udp_gro_receive(head, skb, uh, udp4_gro_lookup_skb);
 
 flush:
 	NAPI_GRO_CB(skb)->flush = 1;
 	return NULL;
 }
 
+static int udp_gro_complete_segment(struct sk_buff *skb, struct udphdr *uh)
+{
+	skb->csum_start = (unsigned char *)uh - skb->head;
+	skb->csum_offset = offsetof(struct udphdr, check);
+	skb->ip_summed = CHECKSUM_PARTIAL;
+
+	skb_shinfo(skb)->gso_segs = NAPI_GRO_CB(skb)->count;
+	skb_shinfo(skb)->gso_type |= SKB_GSO_UDP_L4;
+	return 0;
+}
+
 int udp_gro_complete(struct sk_buff *skb, int nhoff)
 {
 	struct udp_offload_priv *uo_priv;
@@ -385,6 +670,12 @@ int udp_gro_complete(struct sk_buff *skb, int nhoff)
 
 	uh->len = newlen;
 
+	if (NAPI_GRO_CB(skb)->udp_gro_sk)
+		return udp_gro_complete_segment(skb, uh);
+
+	skb_shinfo(skb)->gso_type |= uh->check ? SKB_GSO_UDP_TUNNEL_CSUM :
+						 SKB_GSO_UDP_TUNNEL;
+
 	rcu_read_lock();
 
 	uo_priv = rcu_dereference(udp_offload_base);
@@ -417,13 +708,27 @@ static int udp4_gro_complete(struct sk_buff *skb, int nhoff)
 	const struct iphdr *iph = ip_hdr(skb);
 	struct udphdr *uh = (struct udphdr *)(skb->data + nhoff);
 
-	if (uh->check) {
-		skb_shinfo(skb)->gso_type |= SKB_GSO_UDP_TUNNEL_CSUM;
+	if (NAPI_GRO_CB(skb)->is_flist) {
+		uh->len = htons(skb->len - nhoff);
+		skb_shinfo(skb)->gso_type |= SKB_GSO_FRAGLIST | SKB_GSO_UDP_L4;
+		skb_shinfo(skb)->gso_segs = NAPI_GRO_CB(skb)->count;
+
+		/* The head no longer covers what a CHECKSUM_COMPLETE value
+		 * was computed over, each packet was validated on its own.
+		 */
+		if (skb->ip_summed == CHECKSUM_UNNECESSARY) {
+			if (skb->csum_level < SKB_MAX_CSUM_LEVEL)
+				skb->csum_level++;
+		} else {
+			skb->ip_summed = CHECKSUM_UNNECESSARY;
+			skb->csum_level = 0;
+		}
+		return 0;
+	}
+
+	if (uh->check)
 		uh->check = ~udp_v4_check(skb->len - nhoff, iph->saddr,
 					  iph->daddr, 0);
-	} else {
-		skb_shinfo(skb)->gso_type |= SKB_GSO_UDP_TUNNEL;
-	}
 
 	return udp_gro_complete(skb, nhoff);
 }
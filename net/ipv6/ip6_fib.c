@@ -150,14 +150,17 @@ static struct fib6_node *node_alloc(void)
 	return fn;
 }
 
-static void node_free(struct fib6_node *fn)
+static void node_free_rcu(struct rcu_head *head)
 {
+	struct fib6_node *fn = container_of(head, struct fib6_node, rcu);
+
 	kmem_cache_free(fib6_node_kmem, fn);
 }
 
-static void rt6_rcu_free(struct rt6_info *rt)
+/* Lookups may still be walking through fn */
+static void node_free(struct fib6_node *fn)
 {
-	call_rcu(&rt->dst.rcu_head, dst_rcu_free);
+	call_rcu(&fn->rcu, node_free_rcu);
 }
 
 static void rt6_free_pcpu(struct rt6_info *non_pcpu_rt)
@@ -174,20 +177,31 @@ static void rt6_free_pcpu(struct rt6_info *non_pcpu_rt)
 		ppcpu_rt = per_cpu_ptr(non_pcpu_rt->rt6i_pcpu, cpu);
 		pcpu_rt = *ppcpu_rt;
 		if (pcpu_rt) {
-			rt6_rcu_free(pcpu_rt);
+			dst_free(&pcpu_rt->dst);
 			*ppcpu_rt = NULL;
 		}
 	}
 
+	free_percpu(non_pcpu_rt->rt6i_pcpu);
 	non_pcpu_rt->rt6i_pcpu = NULL;
 }
 
+/* Lookups that found rt before it left the tree may still be adding
+ * per cpu copies to it: free those only after a grace period too.
+ */
+static void rt6_free_rcu(struct rcu_head *head)
+{
+	struct rt6_info *rt = container_of(head, struct rt6_info,
+					   dst.rcu_head);
+
+	rt6_free_pcpu(rt);
+	dst_free(&rt->dst);
+}
+
 static void rt6_release(struct rt6_info *rt)
 {
-	if (atomic_dec_and_test(&rt->rt6i_ref)) {
-		rt6_free_pcpu(rt);
-		rt6_rcu_free(rt);
-	}
+	if (atomic_dec_and_test(&rt->rt6i_ref))
+		call_rcu(&rt->dst.rcu_head, rt6_free_rcu);
 }
 
 static void fib6_link_table(struct net *net, struct fib6_table *tb)
@@ -198,7 +212,7 @@ static void fib6_link_table(struct net *net, struct fib6_table *tb)
 	 * Initialize table lock at a single place to give lockdep a key,
 	 * tables aren't visible prior to being linked to the list.
 	 */
-	rwlock_init(&tb->tb6_lock);
+	spin_lock_init(&tb->tb6_lock);
 
 	h = tb->tb6_id & (FIB6_TABLE_HASHSZ - 1);
 
@@ -358,9 +372,9 @@ static int fib6_dump_table(struct fib6_table *table, struct sk_buff *skb,
 		w->count = 0;
 		w->skip = 0;
 
-		read_lock_bh(&table->tb6_lock);
+		spin_lock_bh(&table->tb6_lock);
 		res = fib6_walk(w);
-		read_unlock_bh(&table->tb6_lock);
+		spin_unlock_bh(&table->tb6_lock);
 		if (res > 0) {
 			cb->args[4] = 1;
 			cb->args[5] = w->root->fn_sernum;
@@ -375,9 +389,9 @@ static int fib6_dump_table(struct fib6_table *table, struct sk_buff *skb,
 		} else
 			w->skip = 0;
 
-		read_lock_bh(&table->tb6_lock);
+		spin_lock_bh(&table->tb6_lock);
 		res = fib6_walk_continue(w);
-		read_unlock_bh(&table->tb6_lock);
+		spin_unlock_bh(&table->tb6_lock);
 		if (res <= 0) {
 			fib6_walker_unlink(w);
 			cb->args[4] = 0;
@@ -551,9 +565,9 @@ static struct fib6_node *fib6_add_1(struct fib6_node *root,
 	ln->fn_sernum = sernum;
 
 	if (dir)
-		pn->right = ln;
+		rcu_assign_pointer(pn->right, ln);
 	else
-		pn->left  = ln;
+		rcu_assign_pointer(pn->left, ln);
 
 	return ln;
 
@@ -610,16 +624,9 @@ insert_above:
 
 		in->fn_sernum = sernum;
 
-		/* update parent pointer */
-		if (dir)
-			pn->right = in;
-		else
-			pn->left  = in;
-
 		ln->fn_bit = plen;
 
 		ln->parent = in;
-		fn->parent = in;
 
 		ln->fn_sernum = sernum;
 
@@ -630,6 +637,14 @@ insert_above:
 			in->left  = ln;
 			in->right = fn;
 		}
+
+		/* update parent pointer, lookups see in complete */
+		if (dir)
+			rcu_assign_pointer(pn->right, in);
+		else
+			rcu_assign_pointer(pn->left, in);
+
+		fn->parent = in;
 	} else { /* plen <= bit */
 
 		/*
@@ -649,16 +664,16 @@ insert_above:
 
 		ln->fn_sernum = sernum;
 
-		if (dir)
-			pn->right = ln;
-		else
-			pn->left  = ln;
-
 		if (addr_bit_set(&key->addr, plen))
 			ln->right = fn;
 		else
 			ln->left  = fn;
 
+		if (dir)
+			rcu_assign_pointer(pn->right, ln);
+		else
+			rcu_assign_pointer(pn->left, ln);
+
 		fn->parent = ln;
 	}
 	return ln;
@@ -826,8 +841,8 @@ next_iter:
 		while (sibling) {
 			if (sibling->rt6i_metric == rt->rt6i_metric &&
 			    rt6_qualify_for_ecmp(sibling)) {
-				list_add_tail(&rt->rt6i_siblings,
-					      &sibling->rt6i_siblings);
+				list_add_tail_rcu(&rt->rt6i_siblings,
+						  &sibling->rt6i_siblings);
 				break;
 			}
 			sibling = sibling->dst.rt6_next;
@@ -859,9 +874,9 @@ add:
 			return err;
 
 		rt->dst.rt6_next = iter;
-		*ins = rt;
 		rt->rt6i_node = fn;
 		atomic_inc(&rt->rt6i_ref);
+		rcu_assign_pointer(*ins, rt);
 		inet6_rt_notify(RTM_NEWROUTE, rt, info, 0);
 		info->nl_net->ipv6.rt6_stats->fib_rt_entries++;
 
@@ -884,10 +899,10 @@ add:
 		if (err)
 			return err;
 
-		*ins = rt;
 		rt->rt6i_node = fn;
 		rt->dst.rt6_next = iter->dst.rt6_next;
 		atomic_inc(&rt->rt6i_ref);
+		rcu_assign_pointer(*ins, rt);
 		inet6_rt_notify(RTM_NEWROUTE, rt, info, NLM_F_REPLACE);
 		if (!(fn->fn_flags & RTN_RTINFO)) {
 			info->nl_net->ipv6.rt6_stats->fib_route_nodes++;
@@ -1019,7 +1034,7 @@ int fib6_add(struct fib6_node *root, struct rt6_info *rt,
 
 			/* Now link new subtree to main tree */
 			sfn->parent = fn;
-			fn->subtree = sfn;
+			rcu_assign_pointer(fn->subtree, sfn);
 		} else {
 			sn = fib6_add_1(fn->subtree, &rt->rt6i_src.addr,
 					rt->rt6i_src.plen,
@@ -1118,7 +1133,8 @@ static struct fib6_node *fib6_lookup_1(struct fib6_node *root,
 
 		dir = addr_bit_set(args->addr, fn->fn_bit);
 
-		next = dir ? fn->right : fn->left;
+		next = dir ? lockless_dereference(fn->right) :
+			     lockless_dereference(fn->left);
 
 		if (next) {
 			fn = next;
@@ -1128,11 +1144,14 @@ static struct fib6_node *fib6_lookup_1(struct fib6_node *root,
 	}
 
 	while (fn) {
-		if (FIB6_SUBTREE(fn) || fn->fn_flags & RTN_RTINFO) {
+		struct rt6_info *leaf = lockless_dereference(fn->leaf);
+
+		/* leaf goes NULL before RTN_RTINFO is cleared on removal */
+		if (leaf &&
+		    (FIB6_SUBTREE(fn) || fn->fn_flags & RTN_RTINFO)) {
 			struct rt6key *key;
 
-			key = (struct rt6key *) ((u8 *) fn->leaf +
-						 args->offset);
+			key = (struct rt6key *) ((u8 *) leaf + args->offset);
 
 			if (ipv6_prefix_equal(&key->addr, args->addr, key->plen)) {
 #ifdef CONFIG_IPV6_SUBTREES
@@ -1155,7 +1174,7 @@ backtrack:
 		if (fn->fn_flags & RTN_ROOT)
 			break;
 
-		fn = fn->parent;
+		fn = lockless_dereference(fn->parent);
 	}
 
 	return NULL;
@@ -1407,7 +1426,7 @@ static void fib6_del_route(struct fib6_node *fn, struct rt6_info **rtp,
 					 &rt->rt6i_siblings, rt6i_siblings)
 			sibling->rt6i_nsiblings--;
 		rt->rt6i_nsiblings = 0;
-		list_del_init(&rt->rt6i_siblings);
+		list_del_rcu(&rt->rt6i_siblings);
 	}
 
 	/* Adjust walkers */
@@ -1422,7 +1441,7 @@ static void fib6_del_route(struct fib6_node *fn, struct rt6_info **rtp,
 	}
 	read_unlock(&fib6_walker_lock);
 
-	rt->dst.rt6_next = NULL;
+	/* rt->dst.rt6_next stays: lookups may still be walking from rt */
 
 	/* If it was last route, expunge its radix tree node */
 	if (!fn->leaf) {
@@ -1683,10 +1702,10 @@ static void __fib6_clean_all(struct net *net,
 	for (h = 0; h < FIB6_TABLE_HASHSZ; h++) {
 		head = &net->ipv6.fib_table_hash[h];
 		hlist_for_each_entry_rcu(table, head, tb6_hlist) {
-			write_lock_bh(&table->tb6_lock);
+			spin_lock_bh(&table->tb6_lock);
 			fib6_clean_tree(net, &table->tb6_root,
 					func, false, sernum, arg);
-			write_unlock_bh(&table->tb6_lock);
+			spin_unlock_bh(&table->tb6_lock);
 		}
 	}
 	rcu_read_unlock();
@@ -2037,9 +2056,9 @@ static void *ipv6_route_seq_next(struct seq_file *seq, void *v, loff_t *pos)
 
 iter_table:
 	ipv6_route_check_sernum(iter);
-	read_lock(&iter->tbl->tb6_lock);
+	spin_lock(&iter->tbl->tb6_lock);
 	r = fib6_walk_continue(&iter->w);
-	read_unlock(&iter->tbl->tb6_lock);
+	spin_unlock(&iter->tbl->tb6_lock);
 	if (r > 0) {
 		if (v)
 			++*pos;
@@ -31,7 +31,6 @@
 #include <linux/net.h>
 #include <linux/kernel.h>
 #include <linux/module.h>
-#include <linux/vmalloc.h>
 #include <linux/proc_fs.h>		/* for proc_net_* */
 #include <linux/slab.h>
 #include <linux/seq_file.h>
@@ -47,20 +46,12 @@
 #endif
 
 /*
- * Connection hash size. Default is what was selected at compile time.
+ * Initial connection hash size. Default is what was selected at compile
+ * time, each netns table grows and shrinks from there on its own.
 */
 static int ip_vs_conn_tab_bits = CONFIG_IP_VS_TAB_BITS;
 module_param_named(conn_tab_bits, ip_vs_conn_tab_bits, int, 0444);
-MODULE_PARM_DESC(conn_tab_bits, "Set connections' hash size");
-
-/* size and mask values */
-int ip_vs_conn_tab_size __read_mostly;
-static int ip_vs_conn_tab_mask __read_mostly;
-
-/*
- *  Connection hash table: for input and output packets lookups of IPVS
- */
-static struct hlist_head *ip_vs_conn_tab __read_mostly;
+MODULE_PARM_DESC(conn_tab_bits, "Set connections' initial hash size");
 
 /*  SLAB cache for IPVS connections */
 static struct kmem_cache *ip_vs_conn_cachep __read_mostly;
@@ -68,16 +59,6 @@ static struct kmem_cache *ip_vs_conn_cachep __read_mostly;
 /*  counter for no client port connections */
 static atomic_t ip_vs_conn_no_cport_cnt = ATOMIC_INIT(0);
 
-/* random value for IPVS connection hash */
-static unsigned int ip_vs_conn_rnd __read_mostly;
-
-/*
- *  Fine locking granularity for big connection hash table
- */
-#define CT_LOCKARRAY_BITS  5
-#define CT_LOCKARRAY_SIZE  (1<<CT_LOCKARRAY_BITS)
-#define CT_LOCKARRAY_MASK  (CT_LOCKARRAY_SIZE-1)
-
 /* We need an addrstrlen that works with or without v6 */
 #ifdef CONFIG_IP_VS_IPV6
 #define IP_VS_ADDRSTRLEN INET6_ADDRSTRLEN
@@ -85,53 +66,31 @@ static unsigned int ip_vs_conn_rnd __read_mostly;
 #define IP_VS_ADDRSTRLEN (8+1)
 #endif
 
-struct ip_vs_aligned_lock
-{
-	spinlock_t	l;
-} __attribute__((__aligned__(SMP_CACHE_BYTES)));
-
-/* lock array for conn table */
-static struct ip_vs_aligned_lock
-__ip_vs_conntbl_lock_array[CT_LOCKARRAY_SIZE] __cacheline_aligned;
-
-static inline void ct_write_lock_bh(unsigned int key)
-{
-	spin_lock_bh(&__ip_vs_conntbl_lock_array[key&CT_LOCKARRAY_MASK].l);
-}
-
-static inline void ct_write_unlock_bh(unsigned int key)
-{
-	spin_unlock_bh(&__ip_vs_conntbl_lock_array[key&CT_LOCKARRAY_MASK].l);
-}
-
 
 /*
  *	Returns hash value for IPVS connection entry
  */
-static unsigned int ip_vs_conn_hashkey(struct netns_ipvs *ipvs, int af, unsigned int proto,
-				       const union nf_inet_addr *addr,
-				       __be16 port)
+static u32 ip_vs_conn_hashkey(int af, unsigned int proto,
+			      const union nf_inet_addr *addr, __be16 port,
+			      u32 seed)
 {
 #ifdef CONFIG_IP_VS_IPV6
 	if (af == AF_INET6)
-		return (jhash_3words(jhash(addr, 16, ip_vs_conn_rnd),
-				    (__force u32)port, proto, ip_vs_conn_rnd) ^
-			((size_t)ipvs>>8)) & ip_vs_conn_tab_mask;
+		return jhash_3words(jhash(addr, 16, seed),
+				    (__force u32)port, proto, seed);
 #endif
-	return (jhash_3words((__force u32)addr->ip, (__force u32)port, proto,
-			    ip_vs_conn_rnd) ^
-		((size_t)ipvs>>8)) & ip_vs_conn_tab_mask;
+	return jhash_3words((__force u32)addr->ip, (__force u32)port, proto,
+			    seed);
 }
 
-static unsigned int ip_vs_conn_hashkey_param(const struct ip_vs_conn_param *p,
-					     bool inverse)
+static u32 ip_vs_conn_hashkey_param(const struct ip_vs_conn_param *p,
+				    bool inverse, u32 seed)
 {
 	const union nf_inet_addr *addr;
 	__be16 port;
 
 	if (p->pe_data && p->pe->hashkey_raw)
-		return p->pe->hashkey_raw(p, ip_vs_conn_rnd, inverse) &
-			ip_vs_conn_tab_mask;
+		return p->pe->hashkey_raw(p, seed, inverse);
 
 	if (likely(!inverse)) {
 		addr = p->caddr;
@@ -141,11 +100,13 @@ static unsigned int ip_vs_conn_hashkey_param(const struct ip_vs_conn_param *p,
 		port = p->vport;
 	}
 
-	return ip_vs_conn_hashkey(p->ipvs, p->af, p->protocol, addr, port);
+	return ip_vs_conn_hashkey(p->af, p->protocol, addr, port, seed);
 }
 
-static unsigned int ip_vs_conn_hashkey_conn(const struct ip_vs_conn *cp)
+/* Connections are hashed by protocol, client address and port */
+static u32 ip_vs_conn_obj_hashfn(const void *data, u32 len, u32 seed)
 {
+	const struct ip_vs_conn *cp = data;
 	struct ip_vs_conn_param p;
 
 	ip_vs_conn_fill_param(cp->ipvs, cp->af, cp->protocol,
@@ -157,107 +118,208 @@ static unsigned int ip_vs_conn_hashkey_conn(const struct ip_vs_conn *cp)
 		p.pe_data_len = cp->pe_data_len;
 	}
 
-	return ip_vs_conn_hashkey_param(&p, false);
+	return ip_vs_conn_hashkey_param(&p, false, seed);
+}
+
+/* Lookup keys are a struct ip_vs_conn_param */
+static u32 ip_vs_conn_hashfn(const void *data, u32 len, u32 seed)
+{
+	return ip_vs_conn_hashkey_param(data, false, seed);
+}
+
+static u32 ip_vs_conn_hashfn_out(const void *data, u32 len, u32 seed)
+{
+	return ip_vs_conn_hashkey_param(data, true, seed);
 }
 
 /*
- *	Hashes ip_vs_conn in ip_vs_conn_tab by netns,proto,addr,port.
+ * The compare functions below also take the reference on a match, so that
+ * an entry that is being released does not end the lookup: it is skipped
+ * like a mismatch and the rest of the chain is still searched.
+ */
+static int ip_vs_conn_cmp(struct rhashtable_compare_arg *arg, const void *obj)
+{
+	const struct ip_vs_conn_param *p = arg->key;
+	struct ip_vs_conn *cp = (struct ip_vs_conn *)obj;
+
+	if (p->cport == cp->cport && p->vport == cp->vport &&
+	    cp->af == p->af &&
+	    ip_vs_addr_equal(p->af, p->caddr, &cp->caddr) &&
+	    ip_vs_addr_equal(p->af, p->vaddr, &cp->vaddr) &&
+	    ((!p->cport) ^ (!(cp->flags & IP_VS_CONN_F_NO_CPORT))) &&
+	    p->protocol == cp->protocol &&
+	    __ip_vs_conn_get(cp))
+		return 0;
+
+	return 1;
+}
+
+/* Connection templates */
+static int ip_vs_conn_cmp_ct(struct rhashtable_compare_arg *arg,
+			     const void *obj)
+{
+	const struct ip_vs_conn_param *p = arg->key;
+	struct ip_vs_conn *cp = (struct ip_vs_conn *)obj;
+
+	if (unlikely(p->pe_data && p->pe->ct_match)) {
+		if (p->pe == cp->pe && p->pe->ct_match(p, cp) &&
+		    __ip_vs_conn_get(cp))
+			return 0;
+		return 1;
+	}
+
+	if (cp->af == p->af &&
+	    ip_vs_addr_equal(p->af, p->caddr, &cp->caddr) &&
+	    /* protocol should only be IPPROTO_IP if
+	     * p->vaddr is a fwmark */
+	    ip_vs_addr_equal(p->protocol == IPPROTO_IP ? AF_UNSPEC :
+			     p->af, p->vaddr, &cp->vaddr) &&
+	    p->vport == cp->vport && p->cport == cp->cport &&
+	    cp->flags & IP_VS_CONN_F_TEMPLATE &&
+	    p->protocol == cp->protocol &&
+	    __ip_vs_conn_get(cp))
+		return 0;
+
+	return 1;
+}
+
+/* Inverse match, see ip_vs_conn_out_get() */
+static int ip_vs_conn_cmp_out(struct rhashtable_compare_arg *arg,
+			      const void *obj)
+{
+	const struct ip_vs_conn_param *p = arg->key;
+	struct ip_vs_conn *cp = (struct ip_vs_conn *)obj;
+
+	if (p->vport == cp->cport && p->cport == cp->dport &&
+	    cp->af == p->af &&
+	    ip_vs_addr_equal(p->af, p->vaddr, &cp->caddr) &&
+	    ip_vs_addr_equal(p->af, p->caddr, &cp->daddr) &&
+	    p->protocol == cp->protocol &&
+	    __ip_vs_conn_get(cp))
+		return 0;
+
+	return 1;
+}
+
+/*
+ * Templates and connections without client port share their key with
+ * other entries, so chains may legitimately be longer than usual.
+ */
+static const struct rhashtable_params ip_vs_conn_rht_params = {
+	.head_offset		= offsetof(struct ip_vs_conn, c_node),
+	.min_size		= 256,
+	.insecure_elasticity	= true,
+	.automatic_shrinking	= true,
+	.hashfn			= ip_vs_conn_hashfn,
+	.obj_hashfn		= ip_vs_conn_obj_hashfn,
+	.obj_cmpfn		= ip_vs_conn_cmp,
+};
+
+/* Lookup only variants, sharing the table layout and hashing above */
+static const struct rhashtable_params ip_vs_conn_ct_rht_params = {
+	.hashfn			= ip_vs_conn_hashfn,
+	.obj_cmpfn		= ip_vs_conn_cmp_ct,
+};
+
+static const struct rhashtable_params ip_vs_conn_out_rht_params = {
+	.hashfn			= ip_vs_conn_hashfn_out,
+	.obj_cmpfn		= ip_vs_conn_cmp_out,
+};
+
+/*
+ *	Hashes ip_vs_conn in the netns conn_tab by proto,addr,port.
  *	returns bool success.
  */
 static inline int ip_vs_conn_hash(struct ip_vs_conn *cp)
 {
-	unsigned int hash;
 	int ret;
 
 	if (cp->flags & IP_VS_CONN_F_ONE_PACKET)
 		return 0;
 
-	/* Hash by protocol, client address and port */
-	hash = ip_vs_conn_hashkey_conn(cp);
-
-	ct_write_lock_bh(hash);
-	spin_lock(&cp->lock);
+	spin_lock_bh(&cp->lock);
 
 	if (!(cp->flags & IP_VS_CONN_F_HASHED)) {
-		cp->flags |= IP_VS_CONN_F_HASHED;
 		atomic_inc(&cp->refcnt);
-		hlist_add_head_rcu(&cp->c_list, &ip_vs_conn_tab[hash]);
-		ret = 1;
+		ret = rhashtable_insert_fast(&cp->ipvs->conn_tab, &cp->c_node,
+					     ip_vs_conn_rht_params);
+		if (!ret) {
+			cp->flags |= IP_VS_CONN_F_HASHED;
+			ret = 1;
+		} else {
+			/* Left unhashed, it lives until its timer expires */
+			atomic_dec(&cp->refcnt);
+			IP_VS_ERR_RL("%s(): cannot hash connection: %d\n",
+				     __func__, ret);
+			ret = 0;
+		}
 	} else {
 		pr_err("%s(): request for already hashed, called from %pF\n",
 		       __func__, __builtin_return_address(0));
 		ret = 0;
 	}
 
-	spin_unlock(&cp->lock);
-	ct_write_unlock_bh(hash);
+	spin_unlock_bh(&cp->lock);
 
 	return ret;
 }
 
 
 /*
- *	UNhashes ip_vs_conn from ip_vs_conn_tab.
+ *	UNhashes ip_vs_conn from the netns conn_tab.
  *	returns bool success. Caller should hold conn reference.
  */
 static inline int ip_vs_conn_unhash(struct ip_vs_conn *cp)
 {
-	unsigned int hash;
 	int ret;
 
 	/* unhash it and decrease its reference counter */
-	hash = ip_vs_conn_hashkey_conn(cp);
-
-	ct_write_lock_bh(hash);
-	spin_lock(&cp->lock);
+	spin_lock_bh(&cp->lock);
 
 	if (cp->flags & IP_VS_CONN_F_HASHED) {
-		hlist_del_rcu(&cp->c_list);
+		rhashtable_remove_fast(&cp->ipvs->conn_tab, &cp->c_node,
+				       ip_vs_conn_rht_params);
 		cp->flags &= ~IP_VS_CONN_F_HASHED;
 		atomic_dec(&cp->refcnt);
 		ret = 1;
 	} else
 		ret = 0;
 
-	spin_unlock(&cp->lock);
-	ct_write_unlock_bh(hash);
+	spin_unlock_bh(&cp->lock);
 
 	return ret;
 }
 
-/* Try to unlink ip_vs_conn from ip_vs_conn_tab.
+/* Try to unlink ip_vs_conn from the netns conn_tab.
  * returns bool success.
  */
 static inline bool ip_vs_conn_unlink(struct ip_vs_conn *cp)
 {
-	unsigned int hash;
 	bool ret;
 
-	hash = ip_vs_conn_hashkey_conn(cp);
-
-	ct_write_lock_bh(hash);
-	spin_lock(&cp->lock);
+	spin_lock_bh(&cp->lock);
 
 	if (cp->flags & IP_VS_CONN_F_HASHED) {
 		ret = false;
 		/* Decrease refcnt and unlink conn only if we are last user */
 		if (atomic_cmpxchg(&cp->refcnt, 1, 0) == 1) {
-			hlist_del_rcu(&cp->c_list);
+			rhashtable_remove_fast(&cp->ipvs->conn_tab,
+					       &cp->c_node,
+					       ip_vs_conn_rht_params);
 			cp->flags &= ~IP_VS_CONN_F_HASHED;
 			ret = true;
 		}
 	} else
 		ret = atomic_read(&cp->refcnt) ? false : true;
 
-	spin_unlock(&cp->lock);
-	ct_write_unlock_bh(hash);
+	spin_unlock_bh(&cp->lock);
 
 	return ret;
 }
 
 
 /*
- *  Gets ip_vs_conn associated with supplied parameters in the ip_vs_conn_tab.
+ *  Gets ip_vs_conn associated with supplied parameters in the conn_tab.
  *  Called for pkts coming from OUTside-to-INside.
  *	p->caddr, p->cport: pkt source address (foreign host)
  *	p->vaddr, p->vport: pkt dest address (load balancer)
@@ -265,32 +327,8 @@ static inline bool ip_vs_conn_unlink(struct ip_vs_conn *cp)
 static inline struct ip_vs_conn *
 __ip_vs_conn_in_get(const struct ip_vs_conn_param *p)
 {
-	unsigned int hash;
-	struct ip_vs_conn *cp;
-
-	hash = ip_vs_conn_hashkey_param(p, false);
-
-	rcu_read_lock();
-
-	hlist_for_each_entry_rcu(cp, &ip_vs_conn_tab[hash], c_list) {
-		if (p->cport == cp->cport && p->vport == cp->vport &&
-		    cp->af == p->af &&
-		    ip_vs_addr_equal(p->af, p->caddr, &cp->caddr) &&
-		    ip_vs_addr_equal(p->af, p->vaddr, &cp->vaddr) &&
-		    ((!p->cport) ^ (!(cp->flags & IP_VS_CONN_F_NO_CPORT))) &&
-		    p->protocol == cp->protocol &&
-		    cp->ipvs == p->ipvs) {
-			if (!__ip_vs_conn_get(cp))
-				continue;
-			/* HIT */
-			rcu_read_unlock();
-			return cp;
-		}
-	}
-
-	rcu_read_unlock();
-
-	return NULL;
+	return rhashtable_lookup_fast(&p->ipvs->conn_tab, p,
+				      ip_vs_conn_rht_params);
 }
 
 struct ip_vs_conn *ip_vs_conn_in_get(const struct ip_vs_conn_param *p)
@@ -351,42 +389,10 @@ EXPORT_SYMBOL_GPL(ip_vs_conn_in_get_proto);
 /* Get reference to connection template */
 struct ip_vs_conn *ip_vs_ct_in_get(const struct ip_vs_conn_param *p)
 {
-	unsigned int hash;
 	struct ip_vs_conn *cp;
 
-	hash = ip_vs_conn_hashkey_param(p, false);
-
-	rcu_read_lock();
-
-	hlist_for_each_entry_rcu(cp, &ip_vs_conn_tab[hash], c_list) {
-		if (unlikely(p->pe_data && p->pe->ct_match)) {
-			if (cp->ipvs != p->ipvs)
-				continue;
-			if (p->pe == cp->pe && p->pe->ct_match(p, cp)) {
-				if (__ip_vs_conn_get(cp))
-					goto out;
-			}
-			continue;
-		}
-
-		if (cp->af == p->af &&
-		    ip_vs_addr_equal(p->af, p->caddr, &cp->caddr) &&
-		    /* protocol should only be IPPROTO_IP if
-		     * p->vaddr is a fwmark */
-		    ip_vs_addr_equal(p->protocol == IPPROTO_IP ? AF_UNSPEC :
-				     p->af, p->vaddr, &cp->vaddr) &&
-		    p->vport == cp->vport && p->cport == cp->cport &&
-		    cp->flags & IP_VS_CONN_F_TEMPLATE &&
-		    p->protocol == cp->protocol &&
-		    cp->ipvs == p->ipvs) {
-			if (__ip_vs_conn_get(cp))
-				goto out;
-		}
-	}
-	cp = NULL;
-
-  out:
-	rcu_read_unlock();
+	cp = rhashtable_lookup_fast(&p->ipvs->conn_tab, p,
+				    ip_vs_conn_ct_rht_params);
 
 	IP_VS_DBG_BUF(9, "template lookup/in %s %s:%d->%s:%d %s\n",
 		      ip_vs_proto_name(p->protocol),
@@ -397,38 +403,19 @@ struct ip_vs_conn *ip_vs_ct_in_get(const struct ip_vs_conn_param *p)
 	return cp;
 }
 
-/* Gets ip_vs_conn associated with supplied parameters in the ip_vs_conn_tab.
+/* Gets ip_vs_conn associated with supplied parameters in the conn_tab.
  * Called for pkts coming from inside-to-OUTside.
  *	p->caddr, p->cport: pkt source address (inside host)
  *	p->vaddr, p->vport: pkt dest address (foreign host) */
 struct ip_vs_conn *ip_vs_conn_out_get(const struct ip_vs_conn_param *p)
 {
-	unsigned int hash;
-	struct ip_vs_conn *cp, *ret=NULL;
+	struct ip_vs_conn *ret;
 
 	/*
 	 *	Check for "full" addressed entries
 	 */
-	hash = ip_vs_conn_hashkey_param(p, true);
-
-	rcu_read_lock();
-
-	hlist_for_each_entry_rcu(cp, &ip_vs_conn_tab[hash], c_list) {
-		if (p->vport == cp->cport && p->cport == cp->dport &&
-		    cp->af == p->af &&
-		    ip_vs_addr_equal(p->af, p->vaddr, &cp->caddr) &&
-		    ip_vs_addr_equal(p->af, p->caddr, &cp->daddr) &&
-		    p->protocol == cp->protocol &&
-		    cp->ipvs == p->ipvs) {
-			if (!__ip_vs_conn_get(cp))
-				continue;
-			/* HIT */
-			ret = cp;
-			break;
-		}
-	}
-
-	rcu_read_unlock();
+	ret = rhashtable_lookup_fast(&p->ipvs->conn_tab, p,
+				     ip_vs_conn_out_rht_params);
 
 	IP_VS_DBG_BUF(9, "lookup/out %s %s:%d->%s:%d %s\n",
 		      ip_vs_proto_name(p->protocol),
@@ -868,7 +855,7 @@ void ip_vs_conn_expire_now(struct ip_vs_conn *cp)
 
 
 /*
- *	Create a new connection entry and hash it into the ip_vs_conn_tab
+ *	Create a new connection entry and hash it into the conn_tab
  */
 struct ip_vs_conn *
 ip_vs_conn_new(const struct ip_vs_conn_param *p, int dest_af,
@@ -886,7 +873,6 @@ ip_vs_conn_new(const struct ip_vs_conn_param *p, int dest_af,
 		return NULL;
 	}
 
-	INIT_HLIST_NODE(&cp->c_list);
 	setup_timer(&cp->timer, ip_vs_conn_expire, (unsigned long)cp);
 	cp->ipvs	   = ipvs;
 	cp->af		   = p->af;
@@ -967,7 +953,7 @@ ip_vs_conn_new(const struct ip_vs_conn_param *p, int dest_af,
 	if (ip_vs_conntrack_enabled(ipvs))
 		cp->flags |= IP_VS_CONN_F_NFCT;
 
-	/* Hash it in the ip_vs_conn_tab finally */
+	/* Hash it in the conn_tab finally */
 	ip_vs_conn_hash(cp);
 
 	return cp;
@@ -979,74 +965,77 @@ ip_vs_conn_new(const struct ip_vs_conn_param *p, int dest_af,
 #ifdef CONFIG_PROC_FS
 struct ip_vs_iter_state {
 	struct seq_net_private	p;
-	struct hlist_head	*l;
+	struct rhashtable_iter	hti;
+	bool			walking;
 };
 
-static void *ip_vs_conn_array(struct seq_file *seq, loff_t pos)
+static int ip_vs_conn_walk_start(struct seq_file *seq)
 {
-	int idx;
-	struct ip_vs_conn *cp;
 	struct ip_vs_iter_state *iter = seq->private;
+	struct netns_ipvs *ipvs = net_ipvs(seq_file_net(seq));
+	int err;
 
-	for (idx = 0; idx < ip_vs_conn_tab_size; idx++) {
-		hlist_for_each_entry_rcu(cp, &ip_vs_conn_tab[idx], c_list) {
-			/* __ip_vs_conn_get() is not needed by
-			 * ip_vs_conn_seq_show and ip_vs_conn_sync_seq_show
-			 */
-			if (pos-- == 0) {
-				iter->l = &ip_vs_conn_tab[idx];
-				return cp;
-			}
-		}
-		cond_resched_rcu();
-	}
+	err = rhashtable_walk_init(&ipvs->conn_tab, &iter->hti);
+	if (err)
+		return err;
+	iter->walking = true;
+
+	/* A resize in progress only means we may see entries twice */
+	err = rhashtable_walk_start(&iter->hti);
+	return err == -EAGAIN ? 0 : err;
+}
+
+static void ip_vs_conn_walk_stop(struct ip_vs_iter_state *iter)
+{
+	if (!iter->walking)
+		return;
+	rhashtable_walk_stop(&iter->hti);
+	rhashtable_walk_exit(&iter->hti);
+	iter->walking = false;
+}
 
-	return NULL;
+static void *__ip_vs_conn_seq_next(struct seq_file *seq)
+{
+	struct ip_vs_iter_state *iter = seq->private;
+	struct ip_vs_conn *cp;
+
+	/* __ip_vs_conn_get() is not needed by
+	 * ip_vs_conn_seq_show and ip_vs_conn_sync_seq_show
+	 */
+	do {
+		cp = rhashtable_walk_next(&iter->hti);
+	} while (IS_ERR(cp) && PTR_ERR(cp) == -EAGAIN);
+
+	return cp;
 }
 
 static void *ip_vs_conn_seq_start(struct seq_file *seq, loff_t *pos)
 	__acquires(RCU)
 {
-	struct ip_vs_iter_state *iter = seq->private;
+	void *obj = SEQ_START_TOKEN;
+	loff_t n;
+	int err;
 
-	iter->l = NULL;
-	rcu_read_lock();
-	return *pos ? ip_vs_conn_array(seq, *pos - 1) :SEQ_START_TOKEN;
+	err = ip_vs_conn_walk_start(seq);
+	if (err)
+		return ERR_PTR(err);
+
+	for (n = *pos; n && obj && !IS_ERR(obj); n--)
+		obj = __ip_vs_conn_seq_next(seq);
+
+	return obj;
 }
 
 static void *ip_vs_conn_seq_next(struct seq_file *seq, void *v, loff_t *pos)
 {
-	struct ip_vs_conn *cp = v;
-	struct ip_vs_iter_state *iter = seq->private;
-	struct hlist_node *e;
-	struct hlist_head *l = iter->l;
-	int idx;
-
 	++*pos;
-	if (v == SEQ_START_TOKEN)
-		return ip_vs_conn_array(seq, 0);
-
-	/* more on same hash chain? */
-	e = rcu_dereference(hlist_next_rcu(&cp->c_list));
-	if (e)
-		return hlist_entry(e, struct ip_vs_conn, c_list);
-
-	idx = l - ip_vs_conn_tab;
-	while (++idx < ip_vs_conn_tab_size) {
-		hlist_for_each_entry_rcu(cp, &ip_vs_conn_tab[idx], c_list) {
-			iter->l = &ip_vs_conn_tab[idx];
-			return cp;
-		}
-		cond_resched_rcu();
-	}
-	iter->l = NULL;
-	return NULL;
+	return __ip_vs_conn_seq_next(seq);
 }
 
 static void ip_vs_conn_seq_stop(struct seq_file *seq, void *v)
 	__releases(RCU)
 {
-	rcu_read_unlock();
+	ip_vs_conn_walk_stop(seq->private);
 }
 
 static int ip_vs_conn_seq_show(struct seq_file *seq, void *v)
@@ -1057,13 +1046,10 @@ static int ip_vs_conn_seq_show(struct seq_file *seq, void *v)
    "Pro FromIP   FPrt ToIP     TPrt DestIP   DPrt State       Expires PEName PEData\n");
 	else {
 		const struct ip_vs_conn *cp = v;
-		struct net *net = seq_file_net(seq);
 		char pe_data[IP_VS_PENAME_MAXLEN + IP_VS_PEDATA_MAXLEN + 3];
 		size_t len = 0;
 		char dbuf[IP_VS_ADDRSTRLEN];
 
-		if (!net_eq(cp->ipvs->net, net))
-			return 0;
 		if (cp->pe_data) {
 			pe_data[0] = ' ';
 			len = strlen(cp->pe->name);
@@ -1145,10 +1131,6 @@ static int ip_vs_conn_sync_seq_show(struct seq_file *seq, void *v)
    "Pro FromIP   FPrt ToIP     TPrt DestIP   DPrt State       Origin Expires\n");
 	else {
 		const struct ip_vs_conn *cp = v;
-		struct net *net = seq_file_net(seq);
-
-		if (!net_eq(cp->ipvs->net, net))
-			return 0;
 
 #ifdef CONFIG_IP_VS_IPV6
 		if (cp->daf == AF_INET6)
@@ -1243,22 +1225,23 @@ static inline int todrop_entry(struct ip_vs_conn *cp)
 /* Called from keventd and must protect itself from softirqs */
 void ip_vs_random_dropentry(struct netns_ipvs *ipvs)
 {
-	int idx;
+	const struct bucket_table *tbl;
 	struct ip_vs_conn *cp, *cp_c;
+	struct rhash_head *pos;
+	unsigned int idx;
 
 	rcu_read_lock();
+	tbl = rht_dereference_rcu(ipvs->conn_tab.tbl, &ipvs->conn_tab);
 	/*
 	 * Randomly scan 1/32 of the whole table every second
 	 */
-	for (idx = 0; idx < (ip_vs_conn_tab_size>>5); idx++) {
-		unsigned int hash = prandom_u32() & ip_vs_conn_tab_mask;
+	for (idx = 0; idx < (tbl->size >> 5); idx++) {
+		unsigned int hash = prandom_u32() & (tbl->size - 1);
 
-		hlist_for_each_entry_rcu(cp, &ip_vs_conn_tab[hash], c_list) {
+		rht_for_each_entry_rcu(cp, pos, tbl, hash, c_node) {
 			if (cp->flags & IP_VS_CONN_F_TEMPLATE)
 				/* connection template */
 				continue;
-			if (cp->ipvs != ipvs)
-				continue;
 			if (cp->protocol == IPPROTO_TCP) {
 				switch(cp->state) {
 				case IP_VS_TCP_S_SYN_RECV:
@@ -1301,26 +1284,29 @@ void ip_vs_random_dropentry(struct netns_ipvs *ipvs)
 			}
 		}
 		cond_resched_rcu();
+		/* The table may have been replaced by a resize meanwhile */
+		tbl = rht_dereference_rcu(ipvs->conn_tab.tbl, &ipvs->conn_tab);
 	}
 	rcu_read_unlock();
 }
 
 
 /*
- *      Flush all the connection entries in the ip_vs_conn_tab
+ *      Flush all the connection entries in the netns conn_tab
  */
 static void ip_vs_conn_flush(struct netns_ipvs *ipvs)
 {
-	int idx;
+	const struct bucket_table *tbl;
 	struct ip_vs_conn *cp, *cp_c;
+	struct rhash_head *pos;
+	unsigned int idx;
 
 flush_again:
 	rcu_read_lock();
-	for (idx = 0; idx < ip_vs_conn_tab_size; idx++) {
+	tbl = rht_dereference_rcu(ipvs->conn_tab.tbl, &ipvs->conn_tab);
+	for (idx = 0; idx < tbl->size; idx++) {
 
-		hlist_for_each_entry_rcu(cp, &ip_vs_conn_tab[idx], c_list) {
-			if (cp->ipvs != ipvs)
-				continue;
+		rht_for_each_entry_rcu(cp, pos, tbl, idx, c_node) {
 			IP_VS_DBG(4, "del connection\n");
 			ip_vs_conn_expire_now(cp);
 			cp_c = cp->control;
@@ -1332,6 +1318,8 @@ flush_again:
 			}
 		}
 		cond_resched_rcu();
+		/* Entries missed across a resize are caught on the next pass */
+		tbl = rht_dereference_rcu(ipvs->conn_tab.tbl, &ipvs->conn_tab);
 	}
 	rcu_read_unlock();
 
@@ -1342,13 +1330,36 @@ flush_again:
 		goto flush_again;
 	}
 }
+/* Current number of buckets in the connection table of @ipvs */
+unsigned int ip_vs_conn_tab_size(struct netns_ipvs *ipvs)
+{
+	const struct bucket_table *tbl;
+	unsigned int size;
+
+	rcu_read_lock();
+	tbl = rht_dereference_rcu(ipvs->conn_tab.tbl, &ipvs->conn_tab);
+	size = tbl->size;
+	rcu_read_unlock();
+
+	return size;
+}
+
 /*
  * per netns init and exit
  */
 int __net_init ip_vs_conn_net_init(struct netns_ipvs *ipvs)
 {
+	struct rhashtable_params params = ip_vs_conn_rht_params;
+	int err;
+
 	atomic_set(&ipvs->conn_count, 0);
 
+	/* rhashtable sizes for 75% load, start at 1 << conn_tab_bits */
+	params.nelem_hint = (1 << ip_vs_conn_tab_bits) / 4 * 3;
+	err = rhashtable_init(&ipvs->conn_tab, &params);
+	if (err)
+		return err;
+
 	proc_create("ip_vs_conn", 0, ipvs->net->proc_net, &ip_vs_conn_fops);
 	proc_create("ip_vs_conn_sync", 0, ipvs->net->proc_net,
 		    &ip_vs_conn_sync_fops);
@@ -1361,49 +1372,31 @@ void __net_exit ip_vs_conn_net_cleanup(struct netns_ipvs *ipvs)
 	ip_vs_conn_flush(ipvs);
 	remove_proc_entry("ip_vs_conn", ipvs->net->proc_net);
 	remove_proc_entry("ip_vs_conn_sync", ipvs->net->proc_net);
+#ifdef CONFIG_SYSCTL
+	/* The defense work scans the table */
+	cancel_delayed_work_sync(&ipvs->defense_work);
+#endif
+	rhashtable_destroy(&ipvs->conn_tab);
 }
 
 int __init ip_vs_conn_init(void)
 {
-	int idx;
-
-	/* Compute size and mask */
-	ip_vs_conn_tab_size = 1 << ip_vs_conn_tab_bits;
-	ip_vs_conn_tab_mask = ip_vs_conn_tab_size - 1;
-
-	/*
-	 * Allocate the connection hash table and initialize its list heads
-	 */
-	ip_vs_conn_tab = vmalloc(ip_vs_conn_tab_size * sizeof(*ip_vs_conn_tab));
-	if (!ip_vs_conn_tab)
-		return -ENOMEM;
+	/* Keep the initial size sane, the tables resize themselves anyway */
+	ip_vs_conn_tab_bits = clamp_val(ip_vs_conn_tab_bits, 8, 20);
 
 	/* Allocate ip_vs_conn slab cache */
 	ip_vs_conn_cachep = kmem_cache_create("ip_vs_conn",
 					      sizeof(struct ip_vs_conn), 0,
 					      SLAB_HWCACHE_ALIGN, NULL);
-	if (!ip_vs_conn_cachep) {
-		vfree(ip_vs_conn_tab);
+	if (!ip_vs_conn_cachep)
 		return -ENOMEM;
-	}
 
 	pr_info("Connection hash table configured "
-		"(size=%d, memory=%ldKbytes)\n",
-		ip_vs_conn_tab_size,
-		(long)(ip_vs_conn_tab_size*sizeof(struct list_head))/1024);
+		"(initial size=%d, resizable per netns)\n",
+		1 << ip_vs_conn_tab_bits);
 	IP_VS_DBG(0, "Each connection entry needs %Zd bytes at least\n",
 		  sizeof(struct ip_vs_conn));
 
-	for (idx = 0; idx < ip_vs_conn_tab_size; idx++)
-		INIT_HLIST_HEAD(&ip_vs_conn_tab[idx]);
-
-	for (idx = 0; idx < CT_LOCKARRAY_SIZE; idx++)  {
-		spin_lock_init(&__ip_vs_conntbl_lock_array[idx].l);
-	}
-
-	/* calculate the random value for connection hash */
-	get_random_bytes(&ip_vs_conn_rnd, sizeof(ip_vs_conn_rnd));
-
 	return 0;
 }
 
@@ -1413,5 +1406,4 @@ void ip_vs_conn_cleanup(void)
 	rcu_barrier();
 	/* Release the empty cache */
 	kmem_cache_destroy(ip_vs_conn_cachep);
-	vfree(ip_vs_conn_tab);
 }
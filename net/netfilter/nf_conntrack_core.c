@@ -25,6 +25,7 @@
 #include <linux/jhash.h>
 #include <linux/err.h>
 #include <linux/percpu.h>
+#include <linux/percpu_counter.h>
 #include <linux/moduleparam.h>
 #include <linux/notifier.h>
 #include <linux/kernel.h>
@@ -126,6 +127,14 @@ EXPORT_PER_CPU_SYMBOL(nf_conntrack_untracked);
 unsigned int nf_conntrack_hash_rnd __read_mostly;
 EXPORT_SYMBOL_GPL(nf_conntrack_hash_rnd);
 
+/* net->ct.count is per-cpu, deltas are folded in once they reach this */
+#define NF_CT_COUNT_BATCH	32
+
+static void nf_ct_count_add(struct net *net, s64 amount)
+{
+	__percpu_counter_add(&net->ct.count, amount, NF_CT_COUNT_BATCH);
+}
+
 static u32 hash_conntrack_raw(const struct nf_conntrack_tuple *tuple)
 {
 	unsigned int n;
@@ -738,24 +747,35 @@ EXPORT_SYMBOL_GPL(nf_conntrack_tuple_taken);
 
 #define NF_CT_EVICTION_RANGE	8
 
+/* Where the next early drop on this cpu starts scanning.  Under a flood
+ * successive drops move on through the table instead of starting over
+ * from the buckets the previous attempt already found assured.
+ */
+static DEFINE_PER_CPU(unsigned int, nf_ct_early_drop_cursor);
+
 /* There's a small race here where we may free a just-assured
    connection.  Too bad: we're in trouble anyway. */
-static noinline int early_drop(struct net *net, unsigned int _hash)
+static noinline int early_drop(struct net *net)
 {
-	/* Use oldest entry, which is roughly LRU */
+	struct nf_conn *victims[NF_CT_EVICTION_RANGE];
 	struct nf_conntrack_tuple_hash *h;
-	struct nf_conn *ct = NULL, *tmp;
+	struct nf_conn *tmp;
 	struct hlist_nulls_node *n;
-	unsigned int i = 0, cnt = 0;
+	unsigned int i, nr, cursor;
 	int dropped = 0;
 	unsigned int hash, sequence;
 	spinlock_t *lockp;
 
 	local_bh_disable();
+	cursor = __this_cpu_read(nf_ct_early_drop_cursor);
 restart:
+	nr = 0;
 	sequence = read_seqcount_begin(&net->ct.generation);
-	hash = hash_bucket(_hash, net);
-	for (; i < net->ct.htable_size; i++) {
+	/* Look at up to NF_CT_EVICTION_RANGE buckets, and evict all the
+	 * unassured entries of the first one that has any.
+	 */
+	for (i = 0; i < NF_CT_EVICTION_RANGE && !nr; i++) {
+		hash = (cursor + i) % net->ct.htable_size;
 		lockp = &nf_conntrack_locks[hash % CONNTRACK_LOCKS];
 		spin_lock(lockp);
 		if (read_seqcount_retry(&net->ct.generation, sequence)) {
@@ -764,35 +784,34 @@ restart:
 		}
 		hlist_nulls_for_each_entry_rcu(h, n, &net->ct.hash[hash],
 					 hnnode) {
+			/* Each conntrack is visited through its original
+			 * tuple only, so it is not taken twice.
+			 */
+			if (NF_CT_DIRECTION(h))
+				continue;
 			tmp = nf_ct_tuplehash_to_ctrack(h);
-			if (!test_bit(IPS_ASSURED_BIT, &tmp->status) &&
-			    !nf_ct_is_dying(tmp) &&
-			    atomic_inc_not_zero(&tmp->ct_general.use)) {
-				ct = tmp;
+			if (test_bit(IPS_ASSURED_BIT, &tmp->status) ||
+			    nf_ct_is_dying(tmp) ||
+			    !atomic_inc_not_zero(&tmp->ct_general.use))
+				continue;
+			victims[nr++] = tmp;
+			if (nr == ARRAY_SIZE(victims))
 				break;
-			}
-			cnt++;
 		}
-
-		hash = (hash + 1) % net->ct.htable_size;
 		spin_unlock(lockp);
-
-		if (ct || cnt >= NF_CT_EVICTION_RANGE)
-			break;
-
 	}
+	__this_cpu_write(nf_ct_early_drop_cursor, cursor + i);
 	local_bh_enable();
 
-	if (!ct)
-		return dropped;
-
-	if (del_timer(&ct->timeout)) {
-		if (nf_ct_delete(ct, 0, 0)) {
-			dropped = 1;
-			NF_CT_STAT_INC_ATOMIC(net, early_drop);
-		}
+	for (i = 0; i < nr; i++) {
+		if (del_timer(&victims[i]->timeout) &&
+		    nf_ct_delete(victims[i], 0, 0))
+			dropped++;
+		nf_ct_put(victims[i]);
 	}
-	nf_ct_put(ct);
+	if (dropped)
+		NF_CT_STAT_ADD_ATOMIC(net, early_drop, dropped);
+
 	return dropped;
 }
 
@@ -827,12 +846,15 @@ __nf_conntrack_alloc(struct net *net,
 	}
 
 	/* We don't want any race condition at early drop stage */
-	atomic_inc(&net->ct.count);
+	nf_ct_count_add(net, 1);
 
+	/* The folded count lags by up to NF_CT_COUNT_BATCH per cpu, which
+	 * is the slack allowed over nf_conntrack_max.
+	 */
 	if (nf_conntrack_max &&
-	    unlikely(atomic_read(&net->ct.count) > nf_conntrack_max)) {
-		if (!early_drop(net, hash)) {
-			atomic_dec(&net->ct.count);
+	    unlikely(percpu_counter_read(&net->ct.count) > nf_conntrack_max)) {
+		if (!early_drop(net)) {
+			nf_ct_count_add(net, -1);
 			net_warn_ratelimited("nf_conntrack: table full, dropping packet\n");
 			return ERR_PTR(-ENOMEM);
 		}
@@ -871,7 +893,7 @@ __nf_conntrack_alloc(struct net *net,
 out_free:
 	kmem_cache_free(net->ct.nf_conntrack_cachep, ct);
 out:
-	atomic_dec(&net->ct.count);
+	nf_ct_count_add(net, -1);
 	return ERR_PTR(-ENOMEM);
 }
 
@@ -897,8 +919,8 @@ void nf_conntrack_free(struct nf_conn *ct)
 	nf_ct_ext_destroy(ct);
 	nf_ct_ext_free(ct);
 	kmem_cache_free(net->ct.nf_conntrack_cachep, ct);
-	smp_mb__before_atomic();
-	atomic_dec(&net->ct.count);
+	smp_mb();
+	nf_ct_count_add(net, -1);
 }
 EXPORT_SYMBOL_GPL(nf_conntrack_free);
 
@@ -1513,7 +1535,7 @@ i_see_dead_people:
 	busy = 0;
 	list_for_each_entry(net, net_exit_list, exit_list) {
 		nf_ct_iterate_cleanup(net, kill_all, NULL, 0, 0);
-		if (atomic_read(&net->ct.count) != 0)
+		if (percpu_counter_sum(&net->ct.count) != 0)
 			busy = 1;
 	}
 	if (busy) {
@@ -1533,6 +1555,7 @@ i_see_dead_people:
 		kfree(net->ct.slabname);
 		free_percpu(net->ct.stat);
 		free_percpu(net->ct.pcpu_lists);
+		percpu_counter_destroy(&net->ct.count);
 	}
 }
 
@@ -1715,6 +1738,10 @@ int nf_conntrack_init_start(void)
 	}
 	/*  - and look it like as a confirmed connection */
 	nf_ct_untracked_status_or(IPS_CONFIRMED | IPS_UNTRACKED);
+
+	/* Spread the early drop scans of the cpus over the table */
+	for_each_possible_cpu(cpu)
+		per_cpu(nf_ct_early_drop_cursor, cpu) = prandom_u32();
 	return 0;
 
 err_proto:
@@ -1760,7 +1787,8 @@ int nf_conntrack_init_net(struct net *net)
 	int ret = -ENOMEM;
 	int cpu;
 
-	atomic_set(&net->ct.count, 0);
+	if (percpu_counter_init(&net->ct.count, 0, GFP_KERNEL))
+		return -ENOMEM;
 	seqcount_init(&net->ct.generation);
 
 	net->ct.pcpu_lists = alloc_percpu(struct ct_pcpu);
@@ -1838,5 +1866,6 @@ err_slabname:
 err_pcpu_lists:
 	free_percpu(net->ct.pcpu_lists);
 err_stat:
+	percpu_counter_destroy(&net->ct.count);
 	return ret;
 }
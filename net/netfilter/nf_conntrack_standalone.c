@@ -336,7 +336,8 @@ static void ct_cpu_seq_stop(struct seq_file *seq, void *v)
 static int ct_cpu_seq_show(struct seq_file *seq, void *v)
 {
 	struct net *net = seq_file_net(seq);
-	unsigned int nr_conntracks = atomic_read(&net->ct.count);
+	unsigned int nr_conntracks =
+		percpu_counter_sum_positive(&net->ct.count);
 	const struct ip_conntrack_stat *st = v;
 
 	if (v == SEQ_START_TOKEN) {
@@ -434,6 +435,18 @@ static int log_invalid_proto_max = 255;
 
 static struct ctl_table_header *nf_ct_netfilter_header;
 
+/* The count is per-cpu, report the folded sum */
+int proc_nf_conntrack_count(struct ctl_table *table, int write,
+			    void __user *buffer, size_t *lenp, loff_t *ppos)
+{
+	int count = percpu_counter_sum_positive(table->data);
+	struct ctl_table tmp = *table;
+
+	tmp.data = &count;
+	return proc_dointvec(&tmp, write, buffer, lenp, ppos);
+}
+EXPORT_SYMBOL_GPL(proc_nf_conntrack_count);
+
 static struct ctl_table nf_ct_sysctl_table[] = {
 	{
 		.procname	= "nf_conntrack_max",
@@ -447,7 +460,7 @@ static struct ctl_table nf_ct_sysctl_table[] = {
 		.data		= &init_net.ct.count,
 		.maxlen		= sizeof(int),
 		.mode		= 0444,
-		.proc_handler	= proc_dointvec,
+		.proc_handler	= proc_nf_conntrack_count,
 	},
 	{
 		.procname       = "nf_conntrack_buckets",
@@ -2274,7 +2274,8 @@ nft_select_set_ops(const struct nlattr * const nla[],
 	features = 0;
 	if (nla[NFTA_SET_FLAGS] != NULL) {
 		features = ntohl(nla_get_be32(nla[NFTA_SET_FLAGS]));
-		features &= NFT_SET_INTERVAL | NFT_SET_MAP | NFT_SET_TIMEOUT;
+		features &= NFT_SET_INTERVAL | NFT_SET_MAP | NFT_SET_TIMEOUT |
+			    NFT_SET_CONCAT;
 	}
 
 	bops	   = NULL;
@@ -2337,6 +2338,11 @@ static const struct nla_policy nft_set_policy[NFTA_SET_MAX + 1] = {
 
 static const struct nla_policy nft_set_desc_policy[NFTA_SET_DESC_MAX + 1] = {
 	[NFTA_SET_DESC_SIZE]		= { .type = NLA_U32 },
+	[NFTA_SET_DESC_CONCAT]		= { .type = NLA_NESTED },
+};
+
+static const struct nla_policy nft_set_field_policy[NFTA_SET_FIELD_MAX + 1] = {
+	[NFTA_SET_FIELD_LEN]		= { .type = NLA_U32 },
 };
 
 static int nft_ctx_init_from_setattr(struct nft_ctx *ctx, struct net *net,
@@ -2443,6 +2449,30 @@ cont:
 	return 0;
 }
 
+static int nf_tables_fill_set_concat(struct sk_buff *skb,
+				     const struct nft_set *set)
+{
+	struct nlattr *concat, *field;
+	int i;
+
+	concat = nla_nest_start(skb, NFTA_SET_DESC_CONCAT);
+	if (concat == NULL)
+		return -ENOMEM;
+
+	for (i = 0; i < set->field_count; i++) {
+		field = nla_nest_start(skb, NFTA_LIST_ELEM);
+		if (field == NULL)
+			return -ENOMEM;
+		if (nla_put_be32(skb, NFTA_SET_FIELD_LEN,
+				 htonl(set->field_len[i])))
+			return -ENOMEM;
+		nla_nest_end(skb, field);
+	}
+
+	nla_nest_end(skb, concat);
+	return 0;
+}
+
 static int nf_tables_fill_set(struct sk_buff *skb, const struct nft_ctx *ctx,
 			      const struct nft_set *set, u16 event, u16 flags)
 {
@@ -2500,6 +2530,9 @@ static int nf_tables_fill_set(struct sk_buff *skb, const struct nft_ctx *ctx,
 	if (set->size &&
 	    nla_put_be32(skb, NFTA_SET_DESC_SIZE, htonl(set->size)))
 		goto nla_put_failure;
+	if (set->field_count > 1 &&
+	    nf_tables_fill_set_concat(skb, set))
+		goto nla_put_failure;
 	nla_nest_end(skb, desc);
 
 	nlmsg_end(skb, nlh);
@@ -2671,6 +2704,42 @@ err:
 	return err;
 }
 
+/* Fields are padded to a register each: they have to add up to the key */
+static int nf_tables_set_desc_concat_parse(struct nft_set_desc *desc,
+					   const struct nlattr *nla)
+{
+	struct nlattr *tb[NFTA_SET_FIELD_MAX + 1];
+	const struct nlattr *attr;
+	unsigned int len, klen = 0;
+	int rem, err;
+
+	nla_for_each_nested(attr, nla, rem) {
+		if (nla_type(attr) != NFTA_LIST_ELEM)
+			return -EINVAL;
+		if (desc->field_count >= ARRAY_SIZE(desc->field_len))
+			return -E2BIG;
+
+		err = nla_parse_nested(tb, NFTA_SET_FIELD_MAX, attr,
+				       nft_set_field_policy);
+		if (err < 0)
+			return err;
+		if (tb[NFTA_SET_FIELD_LEN] == NULL)
+			return -EINVAL;
+
+		len = ntohl(nla_get_be32(tb[NFTA_SET_FIELD_LEN]));
+		if (len == 0 || len > U8_MAX)
+			return -EINVAL;
+
+		desc->field_len[desc->field_count++] = len;
+		klen += round_up(len, NFT_REG32_SIZE);
+	}
+
+	if (desc->field_count && klen != desc->klen)
+		return -EINVAL;
+
+	return 0;
+}
+
 static int nf_tables_set_desc_parse(const struct nft_ctx *ctx,
 				    struct nft_set_desc *desc,
 				    const struct nlattr *nla)
@@ -2684,6 +2753,9 @@ static int nf_tables_set_desc_parse(const struct nft_ctx *ctx,
 
 	if (da[NFTA_SET_DESC_SIZE] != NULL)
 		desc->size = ntohl(nla_get_be32(da[NFTA_SET_DESC_SIZE]));
+	if (da[NFTA_SET_DESC_CONCAT] != NULL)
+		return nf_tables_set_desc_concat_parse(desc,
+						       da[NFTA_SET_DESC_CONCAT]);
 
 	return 0;
 }
@@ -2730,7 +2802,11 @@ static int nf_tables_newset(struct net *net, struct sock *nlsk,
 		flags = ntohl(nla_get_be32(nla[NFTA_SET_FLAGS]));
 		if (flags & ~(NFT_SET_ANONYMOUS | NFT_SET_CONSTANT |
 			      NFT_SET_INTERVAL | NFT_SET_TIMEOUT |
-			      NFT_SET_MAP | NFT_SET_EVAL))
+			      NFT_SET_MAP | NFT_SET_EVAL | NFT_SET_CONCAT))
+			return -EINVAL;
+		/* Concatenations are matched field by field as ranges */
+		if ((flags & (NFT_SET_CONCAT | NFT_SET_INTERVAL)) ==
+		    NFT_SET_CONCAT)
 			return -EINVAL;
 		/* Only one of both operations is supported */
 		if ((flags & (NFT_SET_MAP | NFT_SET_EVAL)) ==
@@ -2842,6 +2918,8 @@ static int nf_tables_newset(struct net *net, struct sock *nlsk,
 	set->policy = policy;
 	set->timeout = timeout;
 	set->gc_int = gc_int;
+	set->field_count = desc.field_count;
+	memcpy(set->field_len, desc.field_len, sizeof(set->field_len));
 
 	err = ops->init(set, &desc, nla);
 	if (err < 0)
@@ -2995,6 +3073,9 @@ const struct nft_set_ext_type nft_set_ext_types[] = {
 		.len	= sizeof(struct nft_userdata),
 		.align	= __alignof__(struct nft_userdata),
 	},
+	[NFT_SET_EXT_KEY_END]		= {
+		.align	= __alignof__(u32),
+	},
 };
 EXPORT_SYMBOL_GPL(nft_set_ext_types);
 
@@ -3009,6 +3090,7 @@ static const struct nla_policy nft_set_elem_policy[NFTA_SET_ELEM_MAX + 1] = {
 	[NFTA_SET_ELEM_TIMEOUT]		= { .type = NLA_U64 },
 	[NFTA_SET_ELEM_USERDATA]	= { .type = NLA_BINARY,
 					    .len = NFT_USERDATA_MAXLEN },
+	[NFTA_SET_ELEM_KEY_END]		= { .type = NLA_NESTED },
 };
 
 static const struct nla_policy nft_set_elem_list_policy[NFTA_SET_ELEM_LIST_MAX + 1] = {
@@ -3058,6 +3140,11 @@ static int nf_tables_fill_setelem(struct sk_buff *skb,
 			  NFT_DATA_VALUE, set->klen) < 0)
 		goto nla_put_failure;
 
+	if (nft_set_ext_exists(ext, NFT_SET_EXT_KEY_END) &&
+	    nft_data_dump(skb, NFTA_SET_ELEM_KEY_END, nft_set_ext_key_end(ext),
+			  NFT_DATA_VALUE, set->klen) < 0)
+		goto nla_put_failure;
+
 	if (nft_set_ext_exists(ext, NFT_SET_EXT_DATA) &&
 	    nft_data_dump(skb, NFTA_SET_ELEM_DATA, nft_set_ext_data(ext),
 			  set->dtype == NFT_DATA_VERDICT ? NFT_DATA_VERDICT : NFT_DATA_VALUE,
@@ -3388,6 +3475,9 @@ static int nft_add_set_elem(struct nft_ctx *ctx, struct nft_set *set,
 
 	if (nla[NFTA_SET_ELEM_KEY] == NULL)
 		return -EINVAL;
+	if (nla[NFTA_SET_ELEM_KEY_END] != NULL &&
+	    !(set->flags & NFT_SET_CONCAT))
+		return -EINVAL;
 
 	nft_set_ext_prepare(&tmpl);
 
@@ -3399,6 +3489,10 @@ static int nft_add_set_elem(struct nft_ctx *ctx, struct nft_set *set,
 		if (!(set->flags & NFT_SET_INTERVAL) &&
 		    flags & NFT_SET_ELEM_INTERVAL_END)
 			return -EINVAL;
+		/* Concatenated ranges come with both ends in one element */
+		if (set->flags & NFT_SET_CONCAT &&
+		    flags & NFT_SET_ELEM_INTERVAL_END)
+			return -EINVAL;
 		if (flags != 0)
 			nft_set_ext_add(&tmpl, NFT_SET_EXT_FLAGS);
 	}
@@ -3433,6 +3527,22 @@ static int nft_add_set_elem(struct nft_ctx *ctx, struct nft_set *set,
 		goto err2;
 
 	nft_set_ext_add_length(&tmpl, NFT_SET_EXT_KEY, d1.len);
+
+	if (nla[NFTA_SET_ELEM_KEY_END] != NULL) {
+		err = nft_data_init(ctx, &elem.key_end.val,
+				    sizeof(elem.key_end), &d2,
+				    nla[NFTA_SET_ELEM_KEY_END]);
+		if (err < 0)
+			goto err2;
+		nft_data_uninit(&elem.key_end.val, d2.type);
+
+		err = -EINVAL;
+		if (d2.type != NFT_DATA_VALUE || d2.len != set->klen)
+			goto err2;
+
+		nft_set_ext_add_length(&tmpl, NFT_SET_EXT_KEY_END, d2.len);
+	}
+
 	if (timeout > 0) {
 		nft_set_ext_add(&tmpl, NFT_SET_EXT_EXPIRATION);
 		if (timeout != set->timeout)
@@ -3489,6 +3599,9 @@ static int nft_add_set_elem(struct nft_ctx *ctx, struct nft_set *set,
 		goto err3;
 
 	ext = nft_set_elem_ext(set, elem.priv);
+	if (nla[NFTA_SET_ELEM_KEY_END] != NULL)
+		memcpy(nft_set_ext_key_end(ext), elem.key_end.val.data,
+		       set->klen);
 	if (flags)
 		*nft_set_ext_flags(ext) = flags;
 	if (ulen > 0) {
@@ -3593,6 +3706,28 @@ static int nft_del_setelem(struct nft_ctx *ctx, struct nft_set *set,
 	if (desc.type != NFT_DATA_VALUE || desc.len != set->klen)
 		goto err2;
 
+	if (nla[NFTA_SET_ELEM_KEY_END] != NULL) {
+		struct nft_data_desc desc_end;
+
+		if (!(set->flags & NFT_SET_CONCAT))
+			goto err2;
+
+		err = nft_data_init(ctx, &elem.key_end.val,
+				    sizeof(elem.key_end), &desc_end,
+				    nla[NFTA_SET_ELEM_KEY_END]);
+		if (err < 0)
+			goto err2;
+		nft_data_uninit(&elem.key_end.val, desc_end.type);
+
+		err = -EINVAL;
+		if (desc_end.type != NFT_DATA_VALUE ||
+		    desc_end.len != set->klen)
+			goto err2;
+	} else {
+		/* A single value is a range of its own */
+		memcpy(&elem.key_end, &elem.key, sizeof(elem.key_end));
+	}
+
 	trans = nft_trans_elem_alloc(ctx, NFT_MSG_DELSETELEM, set);
 	if (trans == NULL) {
 		err = -ENOMEM;
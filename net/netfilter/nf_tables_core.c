@@ -161,6 +161,7 @@ next_rule:
 	case NF_ACCEPT:
 	case NF_DROP:
 	case NF_QUEUE:
+	case NF_STOLEN:
 		nft_trace_packet(pkt, chain, rulenum, NFT_TRACE_RULE);
 		return regs.verdict.code;
 	}
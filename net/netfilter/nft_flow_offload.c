@@ -0,0 +1,306 @@
+/*
+ * "flow_offload" expression: moves established IPv4 connections to the
+ * flow table from the forward hook, and forwards their packets from a
+ * netdev ingress chain, e.g.:
+ *
+ *	table ip filter {
+ *		chain forward {
+ *			type filter hook forward priority 0;
+ *			ct state established flow_offload
+ *		}
+ *	}
+ *	table netdev fast {
+ *		chain eth0 {
+ *			type filter hook ingress device eth0 priority 0;
+ *			flow_offload
+ *		}
+ *	}
+ *
+ * There is one flow table per network namespace.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <linux/kernel.h>
+#include <linux/init.h>
+#include <linux/module.h>
+#include <linux/netlink.h>
+#include <linux/netfilter.h>
+#include <linux/netfilter/nf_tables.h>
+#include <net/netns/generic.h>
+#include <net/netfilter/nf_tables.h>
+#include <net/netfilter/nf_conntrack.h>
+#include <net/netfilter/nf_conntrack_core.h>
+#include <net/netfilter/nf_conntrack_helper.h>
+#include <net/netfilter/nf_flow_table.h>
+
+static int nft_flow_offload_net_id __read_mostly;
+
+static inline struct nf_flowtable *nft_flow_offload_pernet(struct net *net)
+{
+	return net_generic(net, nft_flow_offload_net_id);
+}
+
+static int nft_flow_route(const struct nft_pktinfo *pkt,
+			  const struct nf_conn *ct,
+			  struct nf_flow_route *route,
+			  enum ip_conntrack_dir dir)
+{
+	struct dst_entry *this_dst = skb_dst(pkt->skb);
+	struct dst_entry *other_dst = NULL;
+	const struct nf_afinfo *afinfo;
+	struct flowi fl;
+
+	afinfo = nf_get_afinfo(NFPROTO_IPV4);
+	if (!afinfo || !this_dst)
+		return -ENOENT;
+
+	/* The other direction goes back to where this packet came from */
+	memset(&fl, 0, sizeof(fl));
+	fl.u.ip4.daddr = ct->tuplehash[dir].tuple.src.u3.ip;
+
+	afinfo->route(pkt->net, &other_dst, &fl, false);
+	if (!other_dst)
+		return -ENOENT;
+
+	route->tuple[dir].dst = this_dst;
+	route->tuple[!dir].dst = other_dst;
+
+	return 0;
+}
+
+static bool nft_flow_offload_skip(struct nf_conn *ct)
+{
+	struct nf_conn_help *help = nfct_help(ct);
+
+	/* Helpers and sequence adjustment need to see every packet */
+	if (help && rcu_access_pointer(help->helper))
+		return true;
+
+	return ct->status & IPS_SEQ_ADJUST;
+}
+
+static void nft_flow_offload_eval(const struct nft_expr *expr,
+				  struct nft_regs *regs,
+				  const struct nft_pktinfo *pkt)
+{
+	struct nf_flowtable *flowtable = nft_flow_offload_pernet(pkt->net);
+	enum ip_conntrack_info ctinfo;
+	struct nf_flow_route route;
+	struct flow_offload *flow;
+	enum ip_conntrack_dir dir;
+	struct nf_conn *ct;
+	int ret;
+
+	ct = nf_ct_get(pkt->skb, &ctinfo);
+	if (!ct || nf_ct_is_untracked(ct))
+		goto out;
+
+	switch (ct->tuplehash[IP_CT_DIR_ORIGINAL].tuple.dst.protonum) {
+	case IPPROTO_TCP:
+	case IPPROTO_UDP:
+		break;
+	default:
+		goto out;
+	}
+
+	if (ctinfo == IP_CT_NEW || ctinfo == IP_CT_RELATED ||
+	    nft_flow_offload_skip(ct))
+		goto out;
+
+	if (test_and_set_bit(IPS_OFFLOAD_BIT, &ct->status))
+		goto out;
+
+	dir = CTINFO2DIR(ctinfo);
+	if (nft_flow_route(pkt, ct, &route, dir) < 0)
+		goto err_flow_route;
+
+	flow = flow_offload_alloc(ct, &route);
+	if (!flow)
+		goto err_flow_alloc;
+
+	/* Window tracking loses track of the packets that bypass it */
+	if (nf_ct_protonum(ct) == IPPROTO_TCP) {
+		ct->proto.tcp.seen[0].flags |= IP_CT_TCP_FLAG_BE_LIBERAL;
+		ct->proto.tcp.seen[1].flags |= IP_CT_TCP_FLAG_BE_LIBERAL;
+	}
+
+	ret = flow_offload_add(flowtable, flow);
+	if (ret < 0)
+		goto err_flow_add;
+
+	dst_release(route.tuple[!dir].dst);
+	return;
+
+err_flow_add:
+	flow_offload_free(flow);
+err_flow_alloc:
+	dst_release(route.tuple[!dir].dst);
+err_flow_route:
+	clear_bit(IPS_OFFLOAD_BIT, &ct->status);
+out:
+	regs->verdict.code = NFT_BREAK;
+}
+
+static int nft_flow_offload_validate(const struct nft_ctx *ctx,
+				     const struct nft_expr *expr,
+				     const struct nft_data **data)
+{
+	return nft_chain_validate_hooks(ctx->chain, 1 << NF_INET_FORWARD);
+}
+
+static int nft_flow_offload_init(const struct nft_ctx *ctx,
+				 const struct nft_expr *expr,
+				 const struct nlattr * const tb[])
+{
+	int err;
+
+	err = nft_flow_offload_validate(ctx, expr, NULL);
+	if (err < 0)
+		return err;
+
+	return nf_ct_l3proto_try_module_get(ctx->afi->family);
+}
+
+static void nft_flow_offload_destroy(const struct nft_ctx *ctx,
+				     const struct nft_expr *expr)
+{
+	nf_ct_l3proto_module_put(ctx->afi->family);
+}
+
+static int nft_flow_offload_dump(struct sk_buff *skb,
+				 const struct nft_expr *expr)
+{
+	return 0;
+}
+
+static struct nft_expr_type nft_flow_offload_type;
+static const struct nft_expr_ops nft_flow_offload_ops = {
+	.type		= &nft_flow_offload_type,
+	.size		= NFT_EXPR_SIZE(0),
+	.eval		= nft_flow_offload_eval,
+	.init		= nft_flow_offload_init,
+	.destroy	= nft_flow_offload_destroy,
+	.validate	= nft_flow_offload_validate,
+	.dump		= nft_flow_offload_dump,
+};
+
+static struct nft_expr_type nft_flow_offload_type __read_mostly = {
+	.family		= NFPROTO_IPV4,
+	.name		= "flow_offload",
+	.ops		= &nft_flow_offload_ops,
+	.owner		= THIS_MODULE,
+};
+
+/* Packets of flows in the table are forwarded and stolen, the others
+ * carry on through the chain.
+ */
+static void nft_flow_offload_netdev_eval(const struct nft_expr *expr,
+					 struct nft_regs *regs,
+					 const struct nft_pktinfo *pkt)
+{
+	struct nf_flowtable *flowtable = nft_flow_offload_pernet(pkt->net);
+	unsigned int verdict;
+
+	verdict = nf_flow_offload_ip_hook(flowtable, pkt->skb);
+	if (verdict != NF_ACCEPT)
+		regs->verdict.code = verdict;
+}
+
+static struct nft_expr_type nft_flow_offload_netdev_type;
+static const struct nft_expr_ops nft_flow_offload_netdev_ops = {
+	.type		= &nft_flow_offload_netdev_type,
+	.size		= NFT_EXPR_SIZE(0),
+	.eval		= nft_flow_offload_netdev_eval,
+	.dump		= nft_flow_offload_dump,
+};
+
+static struct nft_expr_type nft_flow_offload_netdev_type __read_mostly = {
+	.family		= NFPROTO_NETDEV,
+	.name		= "flow_offload",
+	.ops		= &nft_flow_offload_netdev_ops,
+	.owner		= THIS_MODULE,
+};
+
+static int nft_flow_offload_netdev_event(struct notifier_block *this,
+					 unsigned long event, void *ptr)
+{
+	struct net_device *dev = netdev_notifier_info_to_dev(ptr);
+
+	if (event != NETDEV_DOWN)
+		return NOTIFY_DONE;
+
+	nf_flow_table_cleanup(nft_flow_offload_pernet(dev_net(dev)), dev);
+
+	return NOTIFY_DONE;
+}
+
+static struct notifier_block flow_offload_netdev_notifier = {
+	.notifier_call	= nft_flow_offload_netdev_event,
+};
+
+static int __net_init nft_flow_offload_net_init(struct net *net)
+{
+	return nf_flow_table_init(nft_flow_offload_pernet(net));
+}
+
+static void __net_exit nft_flow_offload_net_exit(struct net *net)
+{
+	nf_flow_table_free(nft_flow_offload_pernet(net));
+}
+
+static struct pernet_operations nft_flow_offload_net_ops = {
+	.init	= nft_flow_offload_net_init,
+	.exit	= nft_flow_offload_net_exit,
+	.id	= &nft_flow_offload_net_id,
+	.size	= sizeof(struct nf_flowtable),
+};
+
+static int __init nft_flow_offload_module_init(void)
+{
+	int err;
+
+	err = register_pernet_subsys(&nft_flow_offload_net_ops);
+	if (err < 0)
+		goto err1;
+
+	err = register_netdevice_notifier(&flow_offload_netdev_notifier);
+	if (err < 0)
+		goto err2;
+
+	err = nft_register_expr(&nft_flow_offload_type);
+	if (err < 0)
+		goto err3;
+
+	err = nft_register_expr(&nft_flow_offload_netdev_type);
+	if (err < 0)
+		goto err4;
+
+	return 0;
+
+err4:
+	nft_unregister_expr(&nft_flow_offload_type);
+err3:
+	unregister_netdevice_notifier(&flow_offload_netdev_notifier);
+err2:
+	unregister_pernet_subsys(&nft_flow_offload_net_ops);
+err1:
+	return err;
+}
+
+static void __exit nft_flow_offload_module_exit(void)
+{
+	nft_unregister_expr(&nft_flow_offload_netdev_type);
+	nft_unregister_expr(&nft_flow_offload_type);
+	unregister_netdevice_notifier(&flow_offload_netdev_notifier);
+	unregister_pernet_subsys(&nft_flow_offload_net_ops);
+}
+
+module_init(nft_flow_offload_module_init);
+module_exit(nft_flow_offload_module_exit);
+
+MODULE_LICENSE("GPL");
+MODULE_ALIAS_NFT_AF_EXPR(AF_INET, "flow_offload");
+MODULE_ALIAS_NFT_AF_EXPR(5, "flow_offload"); /* NFPROTO_NETDEV */
@@ -0,0 +1,773 @@
+/*
+ * "pipapo" set type (PIle PAcket POlicies): concatenations of ranges.
+ *
+ * Each field of the key is split into groups of four bits, and every group
+ * has a lookup table with one bucket per value of the group.  Ranges are
+ * expanded into prefixes, each prefix is a rule of the field, and a bucket
+ * is a bitmap of the rules that accept that value of the group: a lookup
+ * ANDs together the buckets selected by the groups of the packet field,
+ * which leaves the rules matching the whole field.
+ *
+ * The rules of a field map to the rules of the next field that belong to
+ * the same element, those of the last field map to the elements.  The
+ * matching rules of one field select the candidates for the next one, so a
+ * lookup costs a fixed number of bitmap ANDs whatever the number of
+ * elements, and there is no per element evaluation.  On x86 the bitmaps
+ * are ANDed with AVX2, 256 bits at a time.
+ *
+ * Updates are serialised by the nfnetlink mutex and done in place, under
+ * a write lock that lookups take for reading.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <linux/kernel.h>
+#include <linux/init.h>
+#include <linux/module.h>
+#include <linux/bitmap.h>
+#include <linux/percpu.h>
+#include <linux/slab.h>
+#include <linux/mm.h>
+#include <linux/vmalloc.h>
+#include <linux/netlink.h>
+#include <linux/netfilter.h>
+#include <linux/netfilter/nf_tables.h>
+#include <net/netfilter/nf_tables.h>
+
+#if defined(CONFIG_X86_64) && defined(CONFIG_AS_AVX2)
+#include <asm/cpufeature.h>
+#include <asm/fpu/api.h>
+#define NFT_PIPAPO_AVX2
+#endif
+
+#define NFT_PIPAPO_GROUP_BITS	4
+#define NFT_PIPAPO_BUCKETS	(1 << NFT_PIPAPO_GROUP_BITS)
+
+/* Buckets are sized in multiples of 256 bits, for AVX2 */
+#define NFT_PIPAPO_ALIGN_LONGS	(32 / sizeof(unsigned long))
+
+struct nft_pipapo_elem;
+
+/**
+ *	struct nft_pipapo_map - what a rule of a field maps to
+ *
+ *	@to: first rule of the element in the next field
+ *	@n: number of rules of the element in the next field
+ *	@e: element, for rules of the last field
+ */
+struct nft_pipapo_map {
+	u32			to;
+	u32			n;
+	struct nft_pipapo_elem	*e;
+};
+
+/**
+ *	struct nft_pipapo_field - lookup and mapping tables of a field
+ *
+ *	@groups: number of four bit groups
+ *	@rules: number of rules
+ *	@bsize: size of a bucket, in longs
+ *	@lt: lookup table, @groups * NFT_PIPAPO_BUCKETS buckets
+ *	@mt: mapping table, one entry per rule
+ */
+struct nft_pipapo_field {
+	unsigned int		groups;
+	unsigned int		rules;
+	unsigned int		bsize;
+	unsigned long		*lt;
+	struct nft_pipapo_map	*mt;
+};
+
+/**
+ *	struct nft_pipapo - pipapo set private data
+ *
+ *	@lock: taken for writing by updates, for reading by lookups
+ *	@field_count: number of fields
+ *	@field_len: length of each field, in bytes
+ *	@bsize_max: largest bucket size of all fields
+ *	@scratch: per-cpu result and fill bitmaps of @bsize_max longs each
+ *	@f: fields
+ */
+struct nft_pipapo {
+	rwlock_t		lock;
+	unsigned int		field_count;
+	u8			field_len[NFT_REG32_COUNT];
+	unsigned int		bsize_max;
+	unsigned long * __percpu *scratch;
+	struct nft_pipapo_field	f[NFT_REG32_COUNT];
+};
+
+struct nft_pipapo_elem {
+	struct nft_set_ext	ext;
+};
+
+static const u8 *nft_pipapo_elem_key(const struct nft_pipapo_elem *e)
+{
+	return (const u8 *)nft_set_ext_key(&e->ext);
+}
+
+/* Elements added without a closing key are ranges of a single value */
+static const u8 *nft_pipapo_elem_key_end(const struct nft_pipapo_elem *e)
+{
+	if (nft_set_ext_exists(&e->ext, NFT_SET_EXT_KEY_END))
+		return (const u8 *)nft_set_ext_key_end(&e->ext);
+	return nft_pipapo_elem_key(e);
+}
+
+static inline u8 pipapo_group(const u8 *data, unsigned int group)
+{
+	if (group % 2)
+		return data[group / 2] & 0x0f;
+	return data[group / 2] >> 4;
+}
+
+static inline unsigned long *pipapo_bucket(const struct nft_pipapo_field *f,
+					   unsigned int group, unsigned int v)
+{
+	return f->lt + (group * NFT_PIPAPO_BUCKETS + v) * f->bsize;
+}
+
+static void pipapo_and_field(unsigned long *map,
+			     const struct nft_pipapo_field *f, const u8 *data)
+{
+	unsigned int g;
+
+	for (g = 0; g < f->groups; g++) {
+		if (!bitmap_and(map, map, pipapo_bucket(f, g, pipapo_group(data, g)),
+				f->rules))
+			return;
+	}
+}
+
+#ifdef NFT_PIPAPO_AVX2
+/*
+ * Keep 256 bits of the result in %ymm0 and AND the buckets of all groups
+ * into it before storing it back.  Buckets are padded with zeroes up to
+ * NFT_PIPAPO_ALIGN_LONGS, which clears whatever the scratch map holds
+ * past the rules.  Must run between kernel_fpu_begin() and _end().
+ */
+static void pipapo_and_field_avx2(unsigned long *map,
+				  const struct nft_pipapo_field *f,
+				  const u8 *data)
+{
+	unsigned int longs = BITS_TO_LONGS(f->rules);
+	unsigned int i, g;
+
+	for (i = 0; i < longs; i += NFT_PIPAPO_ALIGN_LONGS) {
+		asm volatile("vmovdqu %0, %%ymm0" : : "m" (map[i]));
+		for (g = 0; g < f->groups; g++) {
+			const unsigned long *b;
+
+			b = pipapo_bucket(f, g, pipapo_group(data, g)) + i;
+			asm volatile("vpand %0, %%ymm0, %%ymm0" : : "m" (*b));
+		}
+		asm volatile("vmovdqu %%ymm0, %0" : "=m" (map[i]) : : "memory");
+	}
+}
+#endif
+
+/*
+ * Find an element matching @data in generation @genmask: with @end, only
+ * the one covering exactly the ranges from @data to @end.  Called with
+ * the lock held and bottom halves disabled, as it uses the scratch maps.
+ */
+static struct nft_pipapo_elem *pipapo_get(const struct nft_pipapo *priv,
+					  const u8 *data, const u8 *end,
+					  unsigned int klen, u8 genmask,
+					  bool simd)
+{
+	const struct nft_pipapo_field *f;
+	unsigned long *res_map, *fill_map;
+	struct nft_pipapo_elem *e;
+	const u8 *key = data;
+	unsigned int i, r;
+
+	if (!priv->f[0].rules)
+		return NULL;
+
+	res_map = *this_cpu_ptr(priv->scratch);
+	fill_map = res_map + priv->bsize_max;
+	bitmap_fill(res_map, priv->f[0].rules);
+
+	for (i = 0, f = priv->f; ; i++, f++) {
+#ifdef NFT_PIPAPO_AVX2
+		if (simd)
+			pipapo_and_field_avx2(res_map, f, data);
+		else
+#endif
+			pipapo_and_field(res_map, f, data);
+
+		if (bitmap_empty(res_map, f->rules))
+			return NULL;
+		if (i == priv->field_count - 1)
+			break;
+
+		/* Matching rules select the candidates of the next field */
+		bitmap_zero(fill_map, f[1].rules);
+		for_each_set_bit(r, res_map, f->rules)
+			bitmap_set(fill_map, f->mt[r].to, f->mt[r].n);
+		swap(res_map, fill_map);
+
+		data += round_up(priv->field_len[i], NFT_REG32_SIZE);
+	}
+
+	for_each_set_bit(r, res_map, f->rules) {
+		e = f->mt[r].e;
+		if (!nft_set_elem_active(&e->ext, genmask))
+			continue;
+		if (end &&
+		    (memcmp(nft_pipapo_elem_key(e), key, klen) ||
+		     memcmp(nft_pipapo_elem_key_end(e), end, klen)))
+			continue;
+		return e;
+	}
+
+	return NULL;
+}
+
+static bool nft_pipapo_lookup(const struct nft_set *set, const u32 *key,
+			      const struct nft_set_ext **ext)
+{
+	struct nft_pipapo *priv = nft_set_priv(set);
+	u8 genmask = nft_genmask_cur(read_pnet(&set->pnet));
+	const struct nft_pipapo_elem *e;
+
+	read_lock_bh(&priv->lock);
+	e = pipapo_get(priv, (const u8 *)key, NULL, set->klen, genmask, false);
+	read_unlock_bh(&priv->lock);
+
+	if (e == NULL)
+		return false;
+
+	*ext = &e->ext;
+	return true;
+}
+
+#ifdef NFT_PIPAPO_AVX2
+static bool nft_pipapo_avx2_lookup(const struct nft_set *set, const u32 *key,
+				   const struct nft_set_ext **ext)
+{
+	struct nft_pipapo *priv = nft_set_priv(set);
+	u8 genmask = nft_genmask_cur(read_pnet(&set->pnet));
+	const struct nft_pipapo_elem *e;
+
+	read_lock_bh(&priv->lock);
+	if (irq_fpu_usable()) {
+		kernel_fpu_begin();
+		e = pipapo_get(priv, (const u8 *)key, NULL, set->klen, genmask,
+			       true);
+		kernel_fpu_end();
+	} else {
+		e = pipapo_get(priv, (const u8 *)key, NULL, set->klen, genmask,
+			       false);
+	}
+	read_unlock_bh(&priv->lock);
+
+	if (e == NULL)
+		return false;
+
+	*ext = &e->ext;
+	return true;
+}
+#endif
+
+static unsigned int pipapo_ctz(const u8 *v, unsigned int len)
+{
+	unsigned int i, n = 0;
+
+	for (i = len; i-- > 0; n += BITS_PER_BYTE) {
+		if (v[i])
+			return n + __ffs(v[i]);
+	}
+
+	return n;
+}
+
+/* @dst = @v with the @bits lowest bits set */
+static void pipapo_fill_low(u8 *dst, const u8 *v, unsigned int len,
+			    unsigned int bits)
+{
+	int i = len - 1;
+
+	memcpy(dst, v, len);
+	for (; bits >= BITS_PER_BYTE; bits -= BITS_PER_BYTE)
+		dst[i--] = 0xff;
+	if (bits)
+		dst[i] |= (1 << bits) - 1;
+}
+
+static void pipapo_inc(u8 *v, unsigned int len)
+{
+	while (len-- > 0 && !++v[len])
+		;
+}
+
+/* Rule @rule accepts the values with the @plen leading bits of @base */
+static void pipapo_insert_prefix(struct nft_pipapo_field *f,
+				 unsigned int rule, const u8 *base,
+				 unsigned int plen)
+{
+	unsigned int g, b, fixed;
+	u8 v, mask;
+
+	for (g = 0; g < f->groups; g++) {
+		fixed = clamp_t(int, (int)plen - g * NFT_PIPAPO_GROUP_BITS, 0,
+				NFT_PIPAPO_GROUP_BITS);
+		mask = (0x0f << (NFT_PIPAPO_GROUP_BITS - fixed)) & 0x0f;
+		v = pipapo_group(base, g) & mask;
+
+		for (b = 0; b < NFT_PIPAPO_BUCKETS; b++) {
+			if ((b & mask) == v)
+				__set_bit(rule, pipapo_bucket(f, g, b));
+		}
+	}
+}
+
+/*
+ * Split the range from @start to @end of a field into prefixes: from the
+ * start, take the largest aligned block that doesn't go past the end.
+ * Returns the number of prefixes, and adds them as rules from @rule on
+ * if @f is given.
+ */
+static unsigned int pipapo_expand(struct nft_pipapo_field *f,
+				  const u8 *start, const u8 *end,
+				  unsigned int len, unsigned int rule)
+{
+	u8 base[NFT_DATA_VALUE_MAXLEN], last[NFT_DATA_VALUE_MAXLEN];
+	unsigned int step, n = 0;
+
+	memcpy(base, start, len);
+	for (;;) {
+		step = pipapo_ctz(base, len);
+		for (;;) {
+			pipapo_fill_low(last, base, len, step);
+			if (memcmp(last, end, len) <= 0)
+				break;
+			step--;
+		}
+
+		if (f)
+			pipapo_insert_prefix(f, rule + n, base,
+					     len * BITS_PER_BYTE - step);
+		n++;
+
+		if (!memcmp(last, end, len))
+			break;
+
+		memcpy(base, last, len);
+		pipapo_inc(base, len);
+	}
+
+	return n;
+}
+
+static void *pipapo_zalloc(size_t size)
+{
+	void *p = NULL;
+
+	if (size <= (PAGE_SIZE << PAGE_ALLOC_COSTLY_ORDER))
+		p = kzalloc(size, GFP_KERNEL | __GFP_NOWARN | __GFP_NORETRY);
+	if (p == NULL)
+		p = vzalloc(size);
+
+	return p;
+}
+
+static void pipapo_free_scratch(unsigned long * __percpu *scratch)
+{
+	int cpu;
+
+	if (scratch == NULL)
+		return;
+
+	for_each_possible_cpu(cpu)
+		kfree(*per_cpu_ptr(scratch, cpu));
+	free_percpu(scratch);
+}
+
+static unsigned long * __percpu *pipapo_alloc_scratch(unsigned int bsize)
+{
+	unsigned long * __percpu *scratch;
+	unsigned long *map;
+	int cpu;
+
+	scratch = alloc_percpu(unsigned long *);
+	if (scratch == NULL)
+		return NULL;
+
+	for_each_possible_cpu(cpu) {
+		map = kmalloc_node(2 * bsize * sizeof(*map), GFP_KERNEL,
+				   cpu_to_node(cpu));
+		if (map == NULL) {
+			pipapo_free_scratch(scratch);
+			return NULL;
+		}
+		*per_cpu_ptr(scratch, cpu) = map;
+	}
+
+	return scratch;
+}
+
+static unsigned int pipapo_bsize(unsigned int rules)
+{
+	return round_up(BITS_TO_LONGS(rules), NFT_PIPAPO_ALIGN_LONGS);
+}
+
+/*
+ * Make room for @n[i] more rules in each field.  Bucket sizes are doubled
+ * when they run out, the tables are copied outside of the lock, which
+ * only covers switching to them: lookups never write to the tables.
+ */
+static int pipapo_grow(struct nft_pipapo *priv, const unsigned int *n)
+{
+	unsigned long * __percpu *scratch = NULL;
+	struct nft_pipapo_map *mt[NFT_REG32_COUNT] = {};
+	unsigned long *lt[NFT_REG32_COUNT] = {};
+	unsigned int bsize[NFT_REG32_COUNT];
+	unsigned int bsize_max = priv->bsize_max;
+	struct nft_pipapo_field *f;
+	unsigned int i, row;
+	int err = -ENOMEM;
+
+	for (i = 0, f = priv->f; i < priv->field_count; i++, f++) {
+		bsize[i] = pipapo_bsize(f->rules + n[i]);
+		if (bsize[i] <= f->bsize)
+			continue;
+		bsize[i] = max(bsize[i], 2 * f->bsize);
+
+		lt[i] = pipapo_zalloc(f->groups * NFT_PIPAPO_BUCKETS *
+				      bsize[i] * sizeof(*lt[i]));
+		mt[i] = pipapo_zalloc(bsize[i] * BITS_PER_LONG *
+				      sizeof(*mt[i]));
+		if (lt[i] == NULL || mt[i] == NULL)
+			goto out;
+
+		for (row = 0; row < f->groups * NFT_PIPAPO_BUCKETS; row++)
+			memcpy(lt[i] + row * bsize[i], f->lt + row * f->bsize,
+			       f->bsize * sizeof(*lt[i]));
+		memcpy(mt[i], f->mt, f->rules * sizeof(*mt[i]));
+
+		bsize_max = max(bsize_max, bsize[i]);
+	}
+
+	if (bsize_max > priv->bsize_max) {
+		scratch = pipapo_alloc_scratch(bsize_max);
+		if (scratch == NULL)
+			goto out;
+	}
+
+	write_lock_bh(&priv->lock);
+	for (i = 0, f = priv->f; i < priv->field_count; i++, f++) {
+		if (lt[i] == NULL)
+			continue;
+		swap(f->lt, lt[i]);
+		swap(f->mt, mt[i]);
+		f->bsize = bsize[i];
+	}
+	if (scratch != NULL) {
+		swap(priv->scratch, scratch);
+		priv->bsize_max = bsize_max;
+	}
+	write_unlock_bh(&priv->lock);
+
+	err = 0;
+out:
+	/* The old tables, once switched */
+	for (i = 0; i < priv->field_count; i++) {
+		kvfree(lt[i]);
+		kvfree(mt[i]);
+	}
+	pipapo_free_scratch(scratch);
+
+	return err;
+}
+
+static int nft_pipapo_insert(const struct nft_set *set,
+			     const struct nft_set_elem *elem)
+{
+	struct nft_pipapo *priv = nft_set_priv(set);
+	struct nft_pipapo_elem *e = elem->priv;
+	u8 genmask = nft_genmask_next(read_pnet(&set->pnet));
+	const u8 *start = nft_pipapo_elem_key(e);
+	const u8 *end = nft_pipapo_elem_key_end(e);
+	unsigned int n[NFT_REG32_COUNT];
+	unsigned int i, r, len, off;
+	struct nft_pipapo_field *f;
+	int err;
+
+	for (i = 0, off = 0; i < priv->field_count; i++) {
+		len = priv->field_len[i];
+		if (memcmp(start + off, end + off, len) > 0)
+			return -EINVAL;
+
+		n[i] = pipapo_expand(NULL, start + off, end + off, len, 0);
+		off += round_up(len, NFT_REG32_SIZE);
+	}
+
+	err = pipapo_grow(priv, n);
+	if (err < 0)
+		return err;
+
+	write_lock_bh(&priv->lock);
+	if (pipapo_get(priv, start, end, set->klen, genmask, false)) {
+		write_unlock_bh(&priv->lock);
+		return -EEXIST;
+	}
+
+	for (i = 0, off = 0, f = priv->f; i < priv->field_count; i++, f++) {
+		len = priv->field_len[i];
+		pipapo_expand(f, start + off, end + off, len, f->rules);
+
+		for (r = f->rules; r < f->rules + n[i]; r++) {
+			if (i == priv->field_count - 1) {
+				f->mt[r].e = e;
+			} else {
+				f->mt[r].to = f[1].rules;
+				f->mt[r].n = n[i + 1];
+			}
+		}
+		f->rules += n[i];
+		off += round_up(len, NFT_REG32_SIZE);
+	}
+	write_unlock_bh(&priv->lock);
+
+	return 0;
+}
+
+/* Drop bits @first to @first + @cut - 1 of @map, shifting down the rest */
+static void pipapo_bitmap_cut(unsigned long *map, unsigned int first,
+			      unsigned int cut, unsigned int nbits)
+{
+	unsigned int w = BIT_WORD(first);
+	unsigned long mask = BIT(first % BITS_PER_LONG) - 1;
+	unsigned long low = map[w] & mask;
+
+	bitmap_shift_right(map + w, map + w, cut, nbits - w * BITS_PER_LONG);
+	map[w] = (map[w] & ~mask) | low;
+}
+
+static void pipapo_drop(struct nft_pipapo_field *f, unsigned int first,
+			unsigned int n)
+{
+	unsigned int row;
+
+	for (row = 0; row < f->groups * NFT_PIPAPO_BUCKETS; row++)
+		pipapo_bitmap_cut(f->lt + row * f->bsize, first, n, f->rules);
+
+	memmove(&f->mt[first], &f->mt[first + n],
+		(f->rules - first - n) * sizeof(*f->mt));
+	f->rules -= n;
+}
+
+static void nft_pipapo_remove(const struct nft_set *set,
+			      const struct nft_set_elem *elem)
+{
+	struct nft_pipapo *priv = nft_set_priv(set);
+	struct nft_pipapo_elem *e = elem->priv;
+	unsigned int first[NFT_REG32_COUNT], n[NFT_REG32_COUNT];
+	int i, last = priv->field_count - 1;
+	struct nft_pipapo_field *f;
+	unsigned int r;
+
+	write_lock_bh(&priv->lock);
+
+	/* Rules of the element in the last field, then back to the first */
+	f = &priv->f[last];
+	for (r = 0; r < f->rules && f->mt[r].e != e; r++)
+		;
+	if (WARN_ON_ONCE(r == f->rules))
+		goto out;
+
+	first[last] = r;
+	for (n[last] = 0; r < f->rules && f->mt[r].e == e; r++)
+		n[last]++;
+
+	for (i = last - 1; i >= 0; i--) {
+		f = &priv->f[i];
+		for (r = 0; r < f->rules && f->mt[r].to != first[i + 1]; r++)
+			;
+		first[i] = r;
+		for (n[i] = 0; r < f->rules && f->mt[r].to == first[i + 1]; r++)
+			n[i]++;
+	}
+
+	for (i = 0, f = priv->f; i <= last; i++, f++) {
+		pipapo_drop(f, first[i], n[i]);
+		if (i == 0)
+			continue;
+
+		for (r = 0; r < f[-1].rules; r++) {
+			if (f[-1].mt[r].to > first[i])
+				f[-1].mt[r].to -= n[i];
+		}
+	}
+out:
+	write_unlock_bh(&priv->lock);
+}
+
+static void nft_pipapo_activate(const struct nft_set *set,
+				const struct nft_set_elem *elem)
+{
+	struct nft_pipapo_elem *e = elem->priv;
+
+	nft_set_elem_change_active(set, &e->ext);
+}
+
+static void *nft_pipapo_deactivate(const struct nft_set *set,
+				   const struct nft_set_elem *elem)
+{
+	struct nft_pipapo *priv = nft_set_priv(set);
+	u8 genmask = nft_genmask_cur(read_pnet(&set->pnet));
+	struct nft_pipapo_elem *e;
+
+	read_lock_bh(&priv->lock);
+	e = pipapo_get(priv, (const u8 *)elem->key.val.data,
+		       (const u8 *)elem->key_end.val.data, set->klen,
+		       genmask, false);
+	if (e != NULL)
+		nft_set_elem_change_active(set, &e->ext);
+	read_unlock_bh(&priv->lock);
+
+	return e;
+}
+
+static void nft_pipapo_walk(const struct nft_ctx *ctx,
+			    const struct nft_set *set,
+			    struct nft_set_iter *iter)
+{
+	struct nft_pipapo *priv = nft_set_priv(set);
+	u8 genmask = nft_genmask_cur(read_pnet(&set->pnet));
+	struct nft_pipapo_field *f;
+	struct nft_pipapo_elem *e;
+	struct nft_set_elem elem;
+	unsigned int r;
+
+	read_lock_bh(&priv->lock);
+	f = &priv->f[priv->field_count - 1];
+	for (r = 0; r < f->rules; r++) {
+		/* Rules of an element are next to each other */
+		e = f->mt[r].e;
+		if (r && e == f->mt[r - 1].e)
+			continue;
+
+		if (iter->count < iter->skip)
+			goto cont;
+		if (!nft_set_elem_active(&e->ext, genmask))
+			goto cont;
+
+		elem.priv = e;
+
+		iter->err = iter->fn(ctx, set, iter, &elem);
+		if (iter->err < 0)
+			break;
+cont:
+		iter->count++;
+	}
+	read_unlock_bh(&priv->lock);
+}
+
+static unsigned int nft_pipapo_privsize(const struct nlattr * const nla[])
+{
+	return sizeof(struct nft_pipapo);
+}
+
+static int nft_pipapo_init(const struct nft_set *set,
+			   const struct nft_set_desc *desc,
+			   const struct nlattr * const nla[])
+{
+	struct nft_pipapo *priv = nft_set_priv(set);
+	unsigned int i;
+
+	rwlock_init(&priv->lock);
+
+	/* Without a description, the whole key is a single field */
+	if (desc->field_count) {
+		priv->field_count = desc->field_count;
+		memcpy(priv->field_len, desc->field_len,
+		       sizeof(priv->field_len));
+	} else {
+		priv->field_count = 1;
+		priv->field_len[0] = desc->klen;
+	}
+
+	for (i = 0; i < priv->field_count; i++)
+		priv->f[i].groups = priv->field_len[i] * BITS_PER_BYTE /
+				    NFT_PIPAPO_GROUP_BITS;
+
+	return 0;
+}
+
+static void nft_pipapo_destroy(const struct nft_set *set)
+{
+	struct nft_pipapo *priv = nft_set_priv(set);
+	struct nft_pipapo_field *f;
+	struct nft_pipapo_elem *e;
+	unsigned int i, r;
+
+	f = &priv->f[priv->field_count - 1];
+	for (r = 0; r < f->rules; r++) {
+		e = f->mt[r].e;
+		if (r && e == f->mt[r - 1].e)
+			continue;
+		nft_set_elem_destroy(set, e);
+	}
+
+	for (i = 0, f = priv->f; i < priv->field_count; i++, f++) {
+		kvfree(f->lt);
+		kvfree(f->mt);
+	}
+	pipapo_free_scratch(priv->scratch);
+}
+
+static bool nft_pipapo_estimate(const struct nft_set_desc *desc, u32 features,
+				struct nft_set_estimate *est)
+{
+	/* Only meant for concatenations, single ranges go to the rbtree */
+	if (!(features & NFT_SET_CONCAT))
+		return false;
+
+	est->size = sizeof(struct nft_pipapo) +
+		    desc->size * sizeof(struct nft_pipapo_elem);
+	est->class = NFT_SET_CLASS_O_LOG_N;
+
+	return true;
+}
+
+static struct nft_set_ops nft_pipapo_ops __read_mostly = {
+	.privsize	= nft_pipapo_privsize,
+	.elemsize	= offsetof(struct nft_pipapo_elem, ext),
+	.estimate	= nft_pipapo_estimate,
+	.init		= nft_pipapo_init,
+	.destroy	= nft_pipapo_destroy,
+	.insert		= nft_pipapo_insert,
+	.remove		= nft_pipapo_remove,
+	.deactivate	= nft_pipapo_deactivate,
+	.activate	= nft_pipapo_activate,
+	.lookup		= nft_pipapo_lookup,
+	.walk		= nft_pipapo_walk,
+	.features	= NFT_SET_INTERVAL | NFT_SET_MAP | NFT_SET_CONCAT,
+	.owner		= THIS_MODULE,
+};
+
+static int __init nft_pipapo_module_init(void)
+{
+#ifdef NFT_PIPAPO_AVX2
+	if (boot_cpu_has(X86_FEATURE_AVX2) && boot_cpu_has(X86_FEATURE_AVX) &&
+	    cpu_has_xfeatures(XFEATURE_MASK_SSE | XFEATURE_MASK_YMM, NULL))
+		nft_pipapo_ops.lookup = nft_pipapo_avx2_lookup;
+#endif
+	return nft_register_set(&nft_pipapo_ops);
+}
+
+static void __exit nft_pipapo_module_exit(void)
+{
+	nft_unregister_set(&nft_pipapo_ops);
+}
+
+module_init(nft_pipapo_module_init);
+module_exit(nft_pipapo_module_exit);
+
+MODULE_LICENSE("GPL");
+MODULE_ALIAS_NFT_SET();
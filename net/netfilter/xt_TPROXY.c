@@ -117,7 +117,7 @@ nf_tproxy_get_sock_v4(struct net *net, const u8 protocol,
 	case IPPROTO_TCP:
 		switch (lookup_type) {
 		case NFT_LOOKUP_LISTENER:
-			sk = inet_lookup_listener(net, &tcp_hashinfo,
+			sk = inet_lookup_listener(net, &tcp_hashinfo, NULL, 0,
 						    saddr, sport,
 						    daddr, dport,
 						    in->ifindex);
@@ -181,7 +181,7 @@ nf_tproxy_get_sock_v6(struct net *net, const u8 protocol,
 	case IPPROTO_TCP:
 		switch (lookup_type) {
 		case NFT_LOOKUP_LISTENER:
-			sk = inet6_lookup_listener(net, &tcp_hashinfo,
+			sk = inet6_lookup_listener(net, &tcp_hashinfo, NULL, 0,
 						   saddr, sport,
 						   daddr, ntohs(dport),
 						   in->ifindex);
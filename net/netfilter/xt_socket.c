@@ -119,7 +119,7 @@ xt_socket_get_sock_v4(struct net *net, const u8 protocol,
 {
 	switch (protocol) {
 	case IPPROTO_TCP:
-		return __inet_lookup(net, &tcp_hashinfo,
+		return __inet_lookup(net, &tcp_hashinfo, NULL, 0,
 				     saddr, sport, daddr, dport,
 				     in->ifindex);
 	case IPPROTO_UDP:
@@ -325,7 +325,7 @@ xt_socket_get_sock_v6(struct net *net, const u8 protocol,
 {
 	switch (protocol) {
 	case IPPROTO_TCP:
-		return inet6_lookup(net, &tcp_hashinfo,
+		return inet6_lookup(net, &tcp_hashinfo, NULL, 0,
 				    saddr, sport, daddr, dport,
 				    in->ifindex);
 	case IPPROTO_UDP:
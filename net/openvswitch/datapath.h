@@ -50,12 +50,16 @@
  * @n_mask_hit: Number of masks looked up for flow match.
  *   @n_mask_hit / (@n_hit + @n_missed)  will be the average masks looked
  *   up per packet.
+ * @n_cache_hit: Number of received packets whose flow was found in the per-CPU
+ *   exact match cache, without looking up any mask.  The cache misses are
+ *   @n_hit + @n_missed - @n_cache_hit.
  */
 struct dp_stats_percpu {
 	u64 n_hit;
 	u64 n_missed;
 	u64 n_lost;
 	u64 n_mask_hit;
+	u64 n_cache_hit;
 	struct u64_stats_sync syncp;
 };
 
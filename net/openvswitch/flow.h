@@ -175,6 +175,9 @@ struct sw_flow {
 	int stats_last_writer;		/* NUMA-node id of the last writer on
 					 * 'stats[0]'.
 					 */
+	bool removed;			/* Unlinked from the flow table, must
+					 * not be handed out by the EMC.
+					 */
 	struct sw_flow_key key;
 	struct sw_flow_id id;
 	struct sw_flow_mask *mask;
@@ -41,6 +41,7 @@
 #include <linux/icmp.h>
 #include <linux/icmpv6.h>
 #include <linux/rculist.h>
+#include <linux/random.h>
 #include <net/ip.h>
 #include <net/ipv6.h>
 #include <net/ndisc.h>
@@ -90,6 +91,7 @@ struct sw_flow *ovs_flow_alloc(void)
 	flow->id.unmasked_key = NULL;
 	flow->id.ufid_len = 0;
 	flow->stats_last_writer = NUMA_NO_NODE;
+	flow->removed = false;
 
 	/* Initialize the default stat node. */
 	stats = kmem_cache_alloc_node(flow_stats_cache,
@@ -210,10 +212,14 @@ int ovs_flow_tbl_init(struct flow_table *table)
 {
 	struct table_instance *ti, *ufid_ti;
 
+	table->emc = alloc_percpu(struct flow_emc);
+	if (!table->emc)
+		return -ENOMEM;
+
 	ti = table_instance_alloc(TBL_MIN_BUCKETS);
 
 	if (!ti)
-		return -ENOMEM;
+		goto free_emc;
 
 	ufid_ti = table_instance_alloc(TBL_MIN_BUCKETS);
 	if (!ufid_ti)
@@ -229,6 +235,8 @@ int ovs_flow_tbl_init(struct flow_table *table)
 
 free_ti:
 	__table_instance_destroy(ti);
+free_emc:
+	free_percpu(table->emc);
 	return -ENOMEM;
 }
 
@@ -285,6 +293,7 @@ void ovs_flow_tbl_destroy(struct flow_table *table)
 	struct table_instance *ti = rcu_dereference_raw(table->ti);
 	struct table_instance *ufid_ti = rcu_dereference_raw(table->ufid_ti);
 
+	free_percpu(table->emc);
 	table_instance_destroy(ti, ufid_ti, false);
 }
 
@@ -383,6 +392,59 @@ static struct table_instance *table_instance_rehash(struct table_instance *ti,
 	return new_ti;
 }
 
+/* Drop every cache entry that points at 'flow'.  Must be called with
+ * ovs-mutex held, after 'flow->removed' is set and before 'flow' is freed.
+ *
+ * A CPU that found 'flow' in the table just before it was unlinked may still
+ * be inserting it: emc_insert() stores the entry and then checks
+ * 'flow->removed', while we set 'flow->removed' and then look at the
+ * entries, with a full barrier on both sides, so at least one of us drops
+ * the entry.
+ */
+static void flow_emc_invalidate(struct flow_table *table, struct sw_flow *flow)
+{
+	int cpu, i;
+
+	for_each_possible_cpu(cpu) {
+		struct flow_emc *emc = per_cpu_ptr(table->emc, cpu);
+
+		for (i = 0; i < FLOW_EMC_ENTRIES; i++) {
+			struct flow_emc_entry *e = &emc->entries[i];
+
+			if (READ_ONCE(e->flow) == flow)
+				cmpxchg(&e->flow, flow, NULL);
+		}
+	}
+}
+
+/* Empty the cache of every CPU once all flows of 'ti' are being freed.  Must
+ * be called with ovs-mutex held, after 'ti' was replaced in the table.
+ */
+static void flow_emc_flush(struct flow_table *table,
+			   struct table_instance *ti)
+{
+	int ver = ti->node_ver;
+	int cpu, i;
+
+	for (i = 0; i < ti->n_buckets; i++) {
+		struct hlist_head *head = flex_array_get(ti->buckets, i);
+		struct sw_flow *flow;
+
+		hlist_for_each_entry(flow, head, flow_table.node[ver])
+			WRITE_ONCE(flow->removed, true);
+	}
+
+	/* Pairs with the barrier in emc_insert(). */
+	smp_mb();
+
+	for_each_possible_cpu(cpu) {
+		struct flow_emc *emc = per_cpu_ptr(table->emc, cpu);
+
+		for (i = 0; i < FLOW_EMC_ENTRIES; i++)
+			WRITE_ONCE(emc->entries[i].flow, NULL);
+	}
+}
+
 int ovs_flow_tbl_flush(struct flow_table *flow_table)
 {
 	struct table_instance *old_ti, *new_ti;
@@ -404,6 +466,7 @@ int ovs_flow_tbl_flush(struct flow_table *flow_table)
 	flow_table->count = 0;
 	flow_table->ufid_count = 0;
 
+	flow_emc_flush(flow_table, old_ti);
 	table_instance_destroy(old_ti, old_ufid_ti, true);
 	return 0;
 
@@ -488,11 +551,11 @@ static struct sw_flow *masked_flow_lookup(struct table_instance *ti,
 	return NULL;
 }
 
-struct sw_flow *ovs_flow_tbl_lookup_stats(struct flow_table *tbl,
-				    const struct sw_flow_key *key,
-				    u32 *n_mask_hit)
+static struct sw_flow *flow_lookup(struct flow_table *tbl,
+				   struct table_instance *ti,
+				   const struct sw_flow_key *key,
+				   u32 *n_mask_hit)
 {
-	struct table_instance *ti = rcu_dereference_ovsl(tbl->ti);
 	struct sw_flow_mask *mask;
 	struct sw_flow *flow;
 
@@ -506,12 +569,84 @@ struct sw_flow *ovs_flow_tbl_lookup_stats(struct flow_table *tbl,
 	return NULL;
 }
 
+/* Checks whether a flow found in the cache still applies to 'key'. */
+static bool emc_flow_match(const struct sw_flow *flow,
+			   const struct sw_flow_key *key)
+{
+	const struct sw_flow_mask *mask;
+	struct sw_flow_key masked_key;
+
+	if (unlikely(READ_ONCE(flow->removed)))
+		return false;
+
+	mask = flow->mask;
+	ovs_flow_mask_key(&masked_key, key, false, mask);
+	return flow_cmp_masked_key(flow, &masked_key, &mask->range);
+}
+
+static void emc_insert(struct flow_emc_entry *e, struct sw_flow *flow,
+		       u32 hash)
+{
+	e->hash = hash;
+	WRITE_ONCE(e->flow, flow);
+
+	/* Pairs with the barrier in ovs_flow_tbl_remove() and
+	 * flow_emc_flush(): either they see our entry or we see that
+	 * 'flow' is on its way out.
+	 */
+	smp_mb();
+	if (unlikely(READ_ONCE(flow->removed)))
+		cmpxchg(&e->flow, flow, NULL);
+}
+
+/* Must be called with rcu_read_lock and BHs disabled, the cache entries are
+ * per-CPU.  'skb_hash' selects the cache entry; a zero hash bypasses the
+ * cache.
+ */
+struct sw_flow *ovs_flow_tbl_lookup_stats(struct flow_table *tbl,
+				    const struct sw_flow_key *key,
+				    u32 skb_hash,
+				    u32 *n_mask_hit,
+				    u32 *n_cache_hit)
+{
+	struct table_instance *ti = rcu_dereference_ovsl(tbl->ti);
+	struct flow_emc_entry *e = NULL;
+	struct sw_flow *flow;
+
+	*n_cache_hit = 0;
+	if (skb_hash) {
+		/* Recirculated packets share the skb hash of the original
+		 * packet, but not its flow.
+		 */
+		if (key->recirc_id)
+			skb_hash = jhash_1word(skb_hash, key->recirc_id);
+
+		e = &this_cpu_ptr(tbl->emc)->entries[skb_hash & FLOW_EMC_MASK];
+		flow = READ_ONCE(e->flow);
+		if (flow && e->hash == skb_hash) {
+			if (likely(emc_flow_match(flow, key))) {
+				*n_mask_hit = 0;
+				*n_cache_hit = 1;
+				return flow;
+			}
+			WRITE_ONCE(e->flow, NULL);
+		}
+	}
+
+	flow = flow_lookup(tbl, ti, key, n_mask_hit);
+	if (flow && e && !prandom_u32_max(FLOW_EMC_INSERT_INV_PROB))
+		emc_insert(e, flow, skb_hash);
+
+	return flow;
+}
+
 struct sw_flow *ovs_flow_tbl_lookup(struct flow_table *tbl,
 				    const struct sw_flow_key *key)
 {
+	struct table_instance *ti = rcu_dereference_ovsl(tbl->ti);
 	u32 __always_unused n_mask_hit;
 
-	return ovs_flow_tbl_lookup_stats(tbl, key, &n_mask_hit);
+	return flow_lookup(tbl, ti, key, &n_mask_hit);
 }
 
 struct sw_flow *ovs_flow_tbl_lookup_exact(struct flow_table *tbl,
@@ -620,6 +755,11 @@ void ovs_flow_tbl_remove(struct flow_table *table, struct sw_flow *flow)
 		table->ufid_count--;
 	}
 
+	WRITE_ONCE(flow->removed, true);
+	/* Pairs with the barrier in emc_insert(). */
+	smp_mb();
+	flow_emc_invalidate(table, flow);
+
 	/* RCU delete the mask. 'flow->mask' is not NULLed, as it should be
 	 * accessible as long as the RCU read lock is held.
 	 */
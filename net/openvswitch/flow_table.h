@@ -36,6 +36,30 @@
 
 #include "flow.h"
 
+/* Per-CPU exact match cache in front of the megaflow masks.  An entry
+ * remembers which flow the last packet with a given skb hash matched; a hit
+ * still checks the packet against that flow under its own mask, so
+ * colliding hashes only cost a miss.
+ */
+#define FLOW_EMC_SHIFT		10
+#define FLOW_EMC_ENTRIES	(1 << FLOW_EMC_SHIFT)
+#define FLOW_EMC_MASK		(FLOW_EMC_ENTRIES - 1)
+
+/* One in this many megaflow hits is inserted into the cache, so that a
+ * large number of short lived microflows does not keep evicting the long
+ * lived ones.
+ */
+#define FLOW_EMC_INSERT_INV_PROB	32
+
+struct flow_emc_entry {
+	struct sw_flow *flow;
+	u32 hash;
+};
+
+struct flow_emc {
+	struct flow_emc_entry entries[FLOW_EMC_ENTRIES];
+};
+
 struct table_instance {
 	struct flex_array *buckets;
 	unsigned int n_buckets;
@@ -49,6 +73,7 @@ struct flow_table {
 	struct table_instance __rcu *ti;
 	struct table_instance __rcu *ufid_ti;
 	struct list_head mask_list;
+	struct flow_emc __percpu *emc;
 	unsigned long last_rehash;
 	unsigned int count;
 	unsigned int ufid_count;
@@ -75,7 +100,9 @@ struct sw_flow *ovs_flow_tbl_dump_next(struct table_instance *table,
 				       u32 *bucket, u32 *idx);
 struct sw_flow *ovs_flow_tbl_lookup_stats(struct flow_table *,
 				    const struct sw_flow_key *,
-				    u32 *n_mask_hit);
+				    u32 skb_hash,
+				    u32 *n_mask_hit,
+				    u32 *n_cache_hit);
 struct sw_flow *ovs_flow_tbl_lookup(struct flow_table *,
 				    const struct sw_flow_key *);
 struct sw_flow *ovs_flow_tbl_lookup_exact(struct flow_table *tbl,
@@ -0,0 +1,479 @@
+/*
+ * net/sched/sch_carousel.c Carousel: timing wheel packet scheduler
+ *
+ *	This program is free software; you can redistribute it and/or
+ *	modify it under the terms of the GNU General Public License
+ *	as published by the Free Software Foundation; either version
+ *	2 of the License, or (at your option) any later version.
+ *
+ *  Packets carry their earliest departure time in skb->tstamp, in
+ *  CLOCK_MONOTONIC nanoseconds: TCP sets it from sk->sk_pacing_rate,
+ *  applications with SO_TXTIME.  Instead of keeping pacing state per flow,
+ *  like sch_fq does, packets are filed in a timing wheel: an array of
+ *  slots covering @granularity ns each, @horizon = slots * granularity
+ *  ahead of now.
+ *
+ *  enqueue() : O(1), appends the packet to the slot of its departure time.
+ *   Packets without departure time, or whose time has come, go to the
+ *   ready list.  Packets beyond the horizon are dropped.
+ *
+ *  dequeue() : moves the slots whose time has come to the ready list, and
+ *   serves it in FIFO order.  A bitmap of busy slots finds the next one
+ *   to arm the watchdog for, when nothing is ready yet.
+ *
+ *  Packets of a slot leave at the start of the slot, up to @granularity
+ *  early, and in their order of arrival.
+ */
+
+#include <linux/module.h>
+#include <linux/types.h>
+#include <linux/kernel.h>
+#include <linux/errno.h>
+#include <linux/init.h>
+#include <linux/skbuff.h>
+#include <linux/slab.h>
+#include <linux/bitmap.h>
+#include <linux/vmalloc.h>
+#include <net/netlink.h>
+#include <net/pkt_sched.h>
+
+struct carousel_slot {
+	struct sk_buff	*head;
+	struct sk_buff	*tail;
+	u32		qlen;
+};
+
+struct carousel_sched_data {
+	struct carousel_slot	ready;		/* packets due for departure */
+
+	struct carousel_slot	*slots;
+	unsigned long		*busy;		/* bitmap of non empty slots */
+	u32			buckets_log;
+	u32			granularity;	/* ns covered by a slot */
+	u32			cur;		/* slot starting at time_base */
+	u32			wheel_packets;	/* packets in slots */
+	u64			time_base;
+
+	u64			stat_horizon_drops;
+	u64			stat_late_packets;
+	u64			stat_immediate_packets;
+	struct qdisc_watchdog	watchdog;
+};
+
+static void carousel_slot_add(struct carousel_slot *slot, struct sk_buff *skb)
+{
+	skb->next = NULL;
+	if (slot->head)
+		slot->tail->next = skb;
+	else
+		slot->head = skb;
+	slot->tail = skb;
+	slot->qlen++;
+}
+
+static void carousel_slot_splice(struct carousel_slot *to,
+				 struct carousel_slot *from)
+{
+	if (!from->head)
+		return;
+
+	if (to->head)
+		to->tail->next = from->head;
+	else
+		to->head = from->head;
+	to->tail = from->tail;
+	to->qlen += from->qlen;
+
+	from->head = NULL;
+	from->qlen = 0;
+}
+
+static struct sk_buff *carousel_slot_dequeue(struct carousel_slot *slot)
+{
+	struct sk_buff *skb = slot->head;
+
+	if (skb) {
+		slot->head = skb->next;
+		skb->next = NULL;
+		slot->qlen--;
+	}
+	return skb;
+}
+
+/* Distance from the current slot to the next busy one, there must be one */
+static u32 carousel_next_busy(const struct carousel_sched_data *q)
+{
+	u32 nslots = 1U << q->buckets_log;
+	unsigned long idx;
+
+	idx = find_next_bit(q->busy, nslots, q->cur);
+	if (idx >= nslots)
+		idx = find_first_bit(q->busy, nslots);
+
+	return (idx - q->cur) & (nslots - 1);
+}
+
+static void carousel_release(struct carousel_sched_data *q, u32 idx)
+{
+	struct carousel_slot *slot = &q->slots[idx];
+
+	q->wheel_packets -= slot->qlen;
+	carousel_slot_splice(&q->ready, slot);
+	__clear_bit(idx, q->busy);
+}
+
+/* Turn the wheel to @now, releasing the slots on the way */
+static void carousel_advance(struct carousel_sched_data *q, u64 now)
+{
+	u32 mask = (1U << q->buckets_log) - 1;
+	u64 steps;
+
+	while (q->wheel_packets) {
+		u32 dist = carousel_next_busy(q);
+		u64 t = q->time_base + (u64)dist * q->granularity;
+
+		if (t > now)
+			break;
+		q->cur = (q->cur + dist) & mask;
+		q->time_base = t;
+		carousel_release(q, q->cur);
+	}
+
+	/* Slots skipped from here on are empty */
+	if (now >= q->time_base + q->granularity) {
+		steps = div_u64(now - q->time_base, q->granularity);
+		q->cur = (q->cur + steps) & mask;
+		q->time_base += steps * q->granularity;
+	}
+}
+
+/* File @skb for its departure time, false if it is beyond the horizon */
+static bool carousel_insert(struct carousel_sched_data *q,
+			    struct sk_buff *skb)
+{
+	u32 mask = (1U << q->buckets_log) - 1;
+	u64 tstamp = skb->tstamp.tv64;
+	u64 dist;
+	u32 idx;
+
+	if (tstamp < q->time_base + q->granularity) {
+		carousel_slot_add(&q->ready, skb);
+		return true;
+	}
+
+	dist = div_u64(tstamp - q->time_base, q->granularity);
+	if (dist > mask)
+		return false;
+
+	idx = (q->cur + dist) & mask;
+	carousel_slot_add(&q->slots[idx], skb);
+	__set_bit(idx, q->busy);
+	q->wheel_packets++;
+	return true;
+}
+
+static int carousel_enqueue(struct sk_buff *skb, struct Qdisc *sch)
+{
+	struct carousel_sched_data *q = qdisc_priv(sch);
+	u64 now;
+
+	if (unlikely(sch->q.qlen >= sch->limit))
+		return qdisc_drop(skb, sch);
+
+	if (!skb->tstamp.tv64) {
+		q->stat_immediate_packets++;
+		carousel_slot_add(&q->ready, skb);
+	} else {
+		now = ktime_get_ns();
+		carousel_advance(q, now);
+
+		if (unlikely(!carousel_insert(q, skb))) {
+			q->stat_horizon_drops++;
+			return qdisc_drop(skb, sch);
+		}
+		if ((u64)skb->tstamp.tv64 < now)
+			q->stat_late_packets++;
+	}
+
+	qdisc_qstats_backlog_inc(sch, skb);
+	sch->q.qlen++;
+
+	return NET_XMIT_SUCCESS;
+}
+
+static struct sk_buff *carousel_dequeue(struct Qdisc *sch)
+{
+	struct carousel_sched_data *q = qdisc_priv(sch);
+	struct sk_buff *skb;
+
+	if (!q->ready.head && q->wheel_packets)
+		carousel_advance(q, ktime_get_ns());
+
+	skb = carousel_slot_dequeue(&q->ready);
+	if (!skb) {
+		if (q->wheel_packets)
+			qdisc_watchdog_schedule_ns(&q->watchdog,
+						   q->time_base +
+						   (u64)carousel_next_busy(q) *
+						   q->granularity,
+						   false);
+		return NULL;
+	}
+
+	qdisc_qstats_backlog_dec(sch, skb);
+	sch->q.qlen--;
+	qdisc_bstats_update(sch, skb);
+	return skb;
+}
+
+static void carousel_purge(struct carousel_slot *slot)
+{
+	struct sk_buff *skb;
+
+	while ((skb = carousel_slot_dequeue(slot)) != NULL)
+		kfree_skb(skb);
+}
+
+static void carousel_reset(struct Qdisc *sch)
+{
+	struct carousel_sched_data *q = qdisc_priv(sch);
+	u32 nslots = 1U << q->buckets_log;
+	u32 idx;
+
+	carousel_purge(&q->ready);
+
+	if (q->slots) {
+		for_each_set_bit(idx, q->busy, nslots)
+			carousel_purge(&q->slots[idx]);
+		bitmap_zero(q->busy, nslots);
+	}
+	q->wheel_packets = 0;
+
+	sch->q.qlen = 0;
+	sch->qstats.backlog = 0;
+}
+
+static void *carousel_alloc_node(size_t sz, int node)
+{
+	void *ptr;
+
+	ptr = kzalloc_node(sz, GFP_KERNEL | __GFP_REPEAT | __GFP_NOWARN, node);
+	if (!ptr)
+		ptr = vzalloc_node(sz, node);
+	return ptr;
+}
+
+/* Build a new wheel, and move the waiting packets over to it */
+static int carousel_resize(struct Qdisc *sch, u32 log, u32 granularity)
+{
+	struct carousel_sched_data *q = qdisc_priv(sch);
+	struct carousel_slot pending = { NULL }, *slots, *old_slots;
+	unsigned long *busy, *old_busy;
+	u32 idx, nslots, drop_count = 0;
+	struct sk_buff *skb;
+	int node;
+
+	/* If XPS was setup, we can allocate memory on right NUMA node */
+	node = netdev_queue_numa_node_read(sch->dev_queue);
+	slots = carousel_alloc_node(sizeof(*slots) << log, node);
+	busy = carousel_alloc_node(BITS_TO_LONGS(1U << log) * sizeof(long),
+				   node);
+	if (!slots || !busy) {
+		kvfree(slots);
+		kvfree(busy);
+		return -ENOMEM;
+	}
+
+	sch_tree_lock(sch);
+
+	old_slots = q->slots;
+	old_busy = q->busy;
+	if (old_slots) {
+		nslots = 1U << q->buckets_log;
+		for (idx = 0; idx < nslots; idx++)
+			carousel_slot_splice(&pending,
+					     &old_slots[(q->cur + idx) &
+							(nslots - 1)]);
+	}
+
+	q->slots = slots;
+	q->busy = busy;
+	q->buckets_log = log;
+	q->granularity = granularity;
+	q->cur = 0;
+	q->wheel_packets = 0;
+	q->time_base = ktime_get_ns();
+
+	while ((skb = carousel_slot_dequeue(&pending)) != NULL) {
+		if (carousel_insert(q, skb))
+			continue;
+		q->stat_horizon_drops++;
+		qdisc_qstats_backlog_dec(sch, skb);
+		sch->q.qlen--;
+		qdisc_drop(skb, sch);
+		drop_count++;
+	}
+	qdisc_tree_decrease_qlen(sch, drop_count);
+
+	sch_tree_unlock(sch);
+
+	kvfree(old_slots);
+	kvfree(old_busy);
+
+	return 0;
+}
+
+static const struct nla_policy carousel_policy[TCA_CAROUSEL_MAX + 1] = {
+	[TCA_CAROUSEL_PLIMIT]		= { .type = NLA_U32 },
+	[TCA_CAROUSEL_BUCKETS_LOG]	= { .type = NLA_U32 },
+	[TCA_CAROUSEL_GRANULARITY]	= { .type = NLA_U32 },
+};
+
+static int carousel_change(struct Qdisc *sch, struct nlattr *opt)
+{
+	struct carousel_sched_data *q = qdisc_priv(sch);
+	struct nlattr *tb[TCA_CAROUSEL_MAX + 1];
+	u32 log, granularity;
+	int err, drop_count = 0;
+
+	if (!opt)
+		return -EINVAL;
+
+	err = nla_parse_nested(tb, TCA_CAROUSEL_MAX, opt, carousel_policy);
+	if (err < 0)
+		return err;
+
+	log = q->buckets_log;
+	granularity = q->granularity;
+
+	if (tb[TCA_CAROUSEL_BUCKETS_LOG]) {
+		u32 nval = nla_get_u32(tb[TCA_CAROUSEL_BUCKETS_LOG]);
+
+		if (nval < 1 || nval > ilog2(1024*1024))
+			return -EINVAL;
+		log = nval;
+	}
+
+	if (tb[TCA_CAROUSEL_GRANULARITY]) {
+		u32 nval = nla_get_u32(tb[TCA_CAROUSEL_GRANULARITY]);
+
+		if (nval < NSEC_PER_USEC)
+			return -EINVAL;
+		granularity = nval;
+	}
+
+	if (!q->slots || log != q->buckets_log ||
+	    granularity != q->granularity) {
+		err = carousel_resize(sch, log, granularity);
+		if (err)
+			return err;
+	}
+
+	sch_tree_lock(sch);
+
+	if (tb[TCA_CAROUSEL_PLIMIT])
+		sch->limit = nla_get_u32(tb[TCA_CAROUSEL_PLIMIT]);
+
+	while (sch->q.qlen > sch->limit) {
+		struct sk_buff *skb = carousel_dequeue(sch);
+
+		if (!skb)
+			break;
+		kfree_skb(skb);
+		drop_count++;
+	}
+	qdisc_tree_decrease_qlen(sch, drop_count);
+
+	sch_tree_unlock(sch);
+	return 0;
+}
+
+static void carousel_destroy(struct Qdisc *sch)
+{
+	struct carousel_sched_data *q = qdisc_priv(sch);
+
+	carousel_reset(sch);
+	kvfree(q->slots);
+	kvfree(q->busy);
+	qdisc_watchdog_cancel(&q->watchdog);
+}
+
+static int carousel_init(struct Qdisc *sch, struct nlattr *opt)
+{
+	struct carousel_sched_data *q = qdisc_priv(sch);
+
+	sch->limit		= 10000;
+	q->buckets_log		= ilog2(8192);
+	q->granularity		= 128 * NSEC_PER_USEC;
+	q->slots		= NULL;
+	q->busy			= NULL;
+	qdisc_watchdog_init(&q->watchdog, sch);
+
+	if (opt)
+		return carousel_change(sch, opt);
+
+	return carousel_resize(sch, q->buckets_log, q->granularity);
+}
+
+static int carousel_dump(struct Qdisc *sch, struct sk_buff *skb)
+{
+	struct carousel_sched_data *q = qdisc_priv(sch);
+	struct nlattr *opts;
+
+	opts = nla_nest_start(skb, TCA_OPTIONS);
+	if (opts == NULL)
+		goto nla_put_failure;
+
+	if (nla_put_u32(skb, TCA_CAROUSEL_PLIMIT, sch->limit) ||
+	    nla_put_u32(skb, TCA_CAROUSEL_BUCKETS_LOG, q->buckets_log) ||
+	    nla_put_u32(skb, TCA_CAROUSEL_GRANULARITY, q->granularity))
+		goto nla_put_failure;
+
+	return nla_nest_end(skb, opts);
+
+nla_put_failure:
+	return -1;
+}
+
+static int carousel_dump_stats(struct Qdisc *sch, struct gnet_dump *d)
+{
+	struct carousel_sched_data *q = qdisc_priv(sch);
+	struct tc_carousel_qd_stats st = {
+		.horizon_drops		= q->stat_horizon_drops,
+		.late_packets		= q->stat_late_packets,
+		.immediate_packets	= q->stat_immediate_packets,
+		.wheel_packets		= q->wheel_packets,
+	};
+
+	return gnet_stats_copy_app(d, &st, sizeof(st));
+}
+
+static struct Qdisc_ops carousel_qdisc_ops __read_mostly = {
+	.id		=	"carousel",
+	.priv_size	=	sizeof(struct carousel_sched_data),
+
+	.enqueue	=	carousel_enqueue,
+	.dequeue	=	carousel_dequeue,
+	.peek		=	qdisc_peek_dequeued,
+	.init		=	carousel_init,
+	.reset		=	carousel_reset,
+	.destroy	=	carousel_destroy,
+	.change		=	carousel_change,
+	.dump		=	carousel_dump,
+	.dump_stats	=	carousel_dump_stats,
+	.owner		=	THIS_MODULE,
+};
+
+static int __init carousel_module_init(void)
+{
+	return register_qdisc(&carousel_qdisc_ops);
+}
+
+static void __exit carousel_module_exit(void)
+{
+	unregister_qdisc(&carousel_qdisc_ops);
+}
+
+module_init(carousel_module_init)
+module_exit(carousel_module_exit)
+MODULE_LICENSE("GPL");
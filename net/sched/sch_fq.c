@@ -22,6 +22,10 @@
  *  bunch of packets, and this packet scheduler adds delay between
  *  packets to respect rate limitation.
  *
+ *  Senders can instead set skb->tstamp to the earliest departure time of
+ *  each packet (TCP does, and SO_TXTIME users), which is then honoured
+ *  in place of sk->sk_pacing_rate.
+ *
  *  enqueue() :
  *   - lookup one RB tree (out of 1024 or more) to find the flow.
  *     If non existent flow, create it, add it to the tree.
@@ -460,11 +464,16 @@ begin:
 	}
 
 	skb = f->head;
-	if (unlikely(skb && now < f->time_next_packet &&
-		     !skb_is_tcp_pure_ack(skb))) {
-		head->first = f->next;
-		fq_flow_set_throttled(q, f);
-		goto begin;
+	if (skb && !skb_is_tcp_pure_ack(skb)) {
+		u64 time_next_packet = max_t(u64, skb->tstamp.tv64,
+					     f->time_next_packet);
+
+		if (now < time_next_packet) {
+			head->first = f->next;
+			f->time_next_packet = time_next_packet;
+			fq_flow_set_throttled(q, f);
+			goto begin;
+		}
 	}
 
 	skb = fq_dequeue_head(sch, f);
@@ -490,7 +499,8 @@ begin:
 		goto out;
 
 	rate = q->flow_max_rate;
-	if (skb->sk)
+	/* A departure time set by the sender already paced this packet */
+	if (skb->sk && !skb->tstamp.tv64)
 		rate = min(skb->sk->sk_pacing_rate, rate);
 
 	if (rate != ~0U) {
@@ -284,6 +284,46 @@ static struct rpc_xprt *rpc_clnt_set_transport(struct rpc_clnt *clnt,
 	return old;
 }
 
+static void rpc_xprt_set_put(struct rpc_xprt_set *xs)
+{
+	unsigned int i;
+
+	if (xs == NULL || !atomic_dec_and_test(&xs->xs_count))
+		return;
+	for (i = 0; i < xs->xs_nxprts; i++)
+		xprt_put(xs->xs_xprt[i]);
+	kfree(xs);
+}
+
+/*
+ * Open the nconnect - 1 transports that go next to the main one.  They
+ * are set up the same way, and connect when they are first used.
+ */
+static struct rpc_xprt_set *rpc_create_xprt_set(struct rpc_create_args *args,
+		struct xprt_create *xprtargs, unsigned int resvport)
+{
+	unsigned int nxprts = args->nconnect - 1;
+	struct rpc_xprt_set *xs;
+	struct rpc_xprt *xprt;
+
+	xs = kzalloc(sizeof(*xs) + nxprts * sizeof(xs->xs_xprt[0]),
+			GFP_KERNEL);
+	if (xs == NULL)
+		return ERR_PTR(-ENOMEM);
+	atomic_set(&xs->xs_count, 1);
+
+	while (xs->xs_nxprts < nxprts) {
+		xprt = xprt_create_transport(xprtargs);
+		if (IS_ERR(xprt)) {
+			rpc_xprt_set_put(xs);
+			return ERR_CAST(xprt);
+		}
+		xprt->resvport = resvport;
+		xs->xs_xprt[xs->xs_nxprts++] = xprt;
+	}
+	return xs;
+}
+
 static void rpc_clnt_set_nodename(struct rpc_clnt *clnt, const char *nodename)
 {
 	clnt->cl_nodelen = strlcpy(clnt->cl_nodename,
@@ -488,6 +528,8 @@ EXPORT_SYMBOL_GPL(rpc_create_xprt);
  */
 struct rpc_clnt *rpc_create(struct rpc_create_args *args)
 {
+	struct rpc_xprt_set *xs = NULL;
+	struct rpc_clnt *clnt;
 	struct rpc_xprt *xprt;
 	struct xprt_create xprtargs = {
 		.net = args->net,
@@ -552,7 +594,25 @@ struct rpc_clnt *rpc_create(struct rpc_create_args *args)
 	if (args->flags & RPC_CLNT_CREATE_NONPRIVPORT)
 		xprt->resvport = 0;
 
-	return rpc_create_xprt(args, xprt);
+	/*
+	 * rpcbind only ever binds the main transport, so the extra ones
+	 * need the server's port up front.
+	 */
+	if (args->nconnect > 1 && !(args->flags & RPC_CLNT_CREATE_AUTOBIND)) {
+		xs = rpc_create_xprt_set(args, &xprtargs, xprt->resvport);
+		if (IS_ERR(xs)) {
+			xprt_put(xprt);
+			return ERR_CAST(xs);
+		}
+	}
+
+	clnt = rpc_create_xprt(args, xprt);
+	if (IS_ERR(clnt)) {
+		rpc_xprt_set_put(xs);
+		return clnt;
+	}
+	rcu_assign_pointer(clnt->cl_xprts, xs);
+	return clnt;
 }
 EXPORT_SYMBOL_GPL(rpc_create);
 
@@ -564,6 +624,7 @@ EXPORT_SYMBOL_GPL(rpc_create);
 static struct rpc_clnt *__rpc_clone_client(struct rpc_create_args *args,
 					   struct rpc_clnt *clnt)
 {
+	struct rpc_xprt_set *xs;
 	struct rpc_xprt *xprt;
 	struct rpc_clnt *new;
 	int err;
@@ -583,6 +644,14 @@ static struct rpc_clnt *__rpc_clone_client(struct rpc_create_args *args,
 		goto out_err;
 	}
 
+	/* Clones spread their requests over the same transports */
+	rcu_read_lock();
+	xs = rcu_dereference(clnt->cl_xprts);
+	if (xs != NULL)
+		atomic_inc(&xs->xs_count);
+	rcu_read_unlock();
+	rcu_assign_pointer(new->cl_xprts, xs);
+
 	/* Turn off autobind on clones */
 	new->cl_autobind = 0;
 	new->cl_softrtry = clnt->cl_softrtry;
@@ -657,6 +726,7 @@ int rpc_switch_client_transport(struct rpc_clnt *clnt,
 {
 	const struct rpc_timeout *old_timeo;
 	rpc_authflavor_t pseudoflavor;
+	struct rpc_xprt_set *old_xs;
 	struct rpc_xprt *xprt, *old;
 	struct rpc_clnt *parent;
 	int err;
@@ -694,9 +764,17 @@ int rpc_switch_client_transport(struct rpc_clnt *clnt,
 	if (err)
 		goto out_revert;
 
+	/* The extra transports still go to the old server */
+	spin_lock(&clnt->cl_lock);
+	old_xs = rcu_dereference_protected(clnt->cl_xprts,
+			lockdep_is_held(&clnt->cl_lock));
+	RCU_INIT_POINTER(clnt->cl_xprts, NULL);
+	spin_unlock(&clnt->cl_lock);
+
 	synchronize_rcu();
 	if (parent != clnt)
 		rpc_release_client(parent);
+	rpc_xprt_set_put(old_xs);
 	xprt_put(old);
 	dprintk("RPC:       replaced xprt for clnt %p\n", clnt);
 	return 0;
@@ -782,6 +860,7 @@ rpc_free_client(struct rpc_clnt *clnt)
 	rpc_unregister_client(clnt);
 	rpc_free_iostats(clnt->cl_metrics);
 	clnt->cl_metrics = NULL;
+	rpc_xprt_set_put(rcu_dereference_raw(clnt->cl_xprts));
 	xprt_put(rcu_dereference_raw(clnt->cl_xprt));
 	rpciod_down();
 	rpc_free_clid(clnt);
@@ -876,10 +955,43 @@ void rpc_task_release_client(struct rpc_task *task)
 		spin_unlock(&clnt->cl_lock);
 		task->tk_client = NULL;
 
+		if (task->tk_xprt != NULL) {
+			xprt_put(task->tk_xprt);
+			task->tk_xprt = NULL;
+		}
 		rpc_release_client(clnt);
 	}
 }
 
+/**
+ * rpc_task_get_xprt - pick the transport for a task
+ * @task: task about to reserve its first request slot
+ *
+ * Clients with extra transports hand them out round robin, together
+ * with the main one.  Tasks flagged RPC_TASK_NO_ROUND_ROBIN always get
+ * the main transport.  Returns a counted reference.
+ */
+struct rpc_xprt *rpc_task_get_xprt(struct rpc_task *task)
+{
+	struct rpc_clnt *clnt = task->tk_client;
+	struct rpc_xprt *xprt = NULL;
+	struct rpc_xprt_set *xs;
+	unsigned int i;
+
+	rcu_read_lock();
+	xs = rcu_dereference(clnt->cl_xprts);
+	if (xs != NULL && !(task->tk_flags & RPC_TASK_NO_ROUND_ROBIN)) {
+		i = (unsigned int)atomic_inc_return(&xs->xs_next) %
+			(xs->xs_nxprts + 1);
+		if (i != 0)
+			xprt = xprt_get(xs->xs_xprt[i - 1]);
+	}
+	if (xprt == NULL)
+		xprt = xprt_get(rcu_dereference(clnt->cl_xprt));
+	rcu_read_unlock();
+	return xprt;
+}
+
 static
 void rpc_task_set_client(struct rpc_task *task, struct rpc_clnt *clnt)
 {
@@ -462,6 +462,8 @@ __svc_create(struct svc_program *prog, unsigned int bufsize, int npools,
 		INIT_LIST_HEAD(&pool->sp_sockets);
 		INIT_LIST_HEAD(&pool->sp_all_threads);
 		spin_lock_init(&pool->sp_lock);
+		init_llist_head(&pool->sp_idle_threads);
+		spin_lock_init(&pool->sp_idle_lock);
 	}
 
 	return serv;
@@ -685,6 +687,39 @@ found_pool:
 	return task;
 }
 
+/*
+ * Start a service thread in the given pool.
+ */
+static int
+svc_start_kthread(struct svc_serv *serv, struct svc_pool *pool)
+{
+	struct svc_rqst	*rqstp;
+	struct task_struct *task;
+	int node;
+
+	node = svc_pool_map_get_node(pool->sp_id);
+	rqstp = svc_prepare_thread(serv, pool, node);
+	if (IS_ERR(rqstp))
+		return PTR_ERR(rqstp);
+
+	__module_get(serv->sv_ops->svo_module);
+	task = kthread_create_on_node(serv->sv_ops->svo_function, rqstp,
+				      node, "%s", serv->sv_name);
+	if (IS_ERR(task)) {
+		module_put(serv->sv_ops->svo_module);
+		svc_exit_thread(rqstp);
+		return PTR_ERR(task);
+	}
+
+	rqstp->rq_task = task;
+	if (serv->sv_nrpools > 1)
+		svc_pool_map_set_cpumask(task, pool->sp_id);
+
+	svc_sock_update_bufs(serv);
+	wake_up_process(task);
+	return 0;
+}
+
 /*
  * Create or destroy enough new threads to make the number
  * of threads the given number.  If `pool' is non-NULL, applies
@@ -698,22 +733,27 @@ found_pool:
  *
  * Based on code that used to be in nfsd_svc() but tweaked
  * to be pool-aware.
+ *
+ * The number asked for also becomes the floor below which threads of a
+ * self-sizing pool do not exit on their own.
  */
 int
 svc_set_num_threads(struct svc_serv *serv, struct svc_pool *pool, int nrservs)
 {
-	struct svc_rqst	*rqstp;
 	struct task_struct *task;
-	struct svc_pool *chosen_pool;
 	int error = 0;
 	unsigned int state = serv->sv_nrthreads-1;
-	int node;
+	unsigned int i;
 
 	if (pool == NULL) {
+		for (i = 0; i < serv->sv_nrpools; i++)
+			serv->sv_pools[i].sp_nrthrmin = nrservs / serv->sv_nrpools +
+				(i < nrservs % serv->sv_nrpools);
 		/* The -1 assumes caller has done a svc_get() */
 		nrservs -= (serv->sv_nrthreads-1);
 	} else {
 		spin_lock_bh(&pool->sp_lock);
+		pool->sp_nrthrmin = nrservs;
 		nrservs -= pool->sp_nrthreads;
 		spin_unlock_bh(&pool->sp_lock);
 	}
@@ -721,31 +761,9 @@ svc_set_num_threads(struct svc_serv *serv, struct svc_pool *pool, int nrservs)
 	/* create new threads */
 	while (nrservs > 0) {
 		nrservs--;
-		chosen_pool = choose_pool(serv, pool, &state);
-
-		node = svc_pool_map_get_node(chosen_pool->sp_id);
-		rqstp = svc_prepare_thread(serv, chosen_pool, node);
-		if (IS_ERR(rqstp)) {
-			error = PTR_ERR(rqstp);
-			break;
-		}
-
-		__module_get(serv->sv_ops->svo_module);
-		task = kthread_create_on_node(serv->sv_ops->svo_function, rqstp,
-					      node, "%s", serv->sv_name);
-		if (IS_ERR(task)) {
-			error = PTR_ERR(task);
-			module_put(serv->sv_ops->svo_module);
-			svc_exit_thread(rqstp);
+		error = svc_start_kthread(serv, choose_pool(serv, pool, &state));
+		if (error)
 			break;
-		}
-
-		rqstp->rq_task = task;
-		if (serv->sv_nrpools > 1)
-			svc_pool_map_set_cpumask(task, chosen_pool->sp_id);
-
-		svc_sock_update_bufs(serv);
-		wake_up_process(task);
 	}
 	/* destroy old threads */
 	while (nrservs < 0 &&
@@ -758,6 +776,21 @@ svc_set_num_threads(struct svc_serv *serv, struct svc_pool *pool, int nrservs)
 }
 EXPORT_SYMBOL_GPL(svc_set_num_threads);
 
+/*
+ * Add a thread to a self-sizing pool whose transports had to wait for
+ * one, unless it already runs sp_nrthrmax of them.  Same exclusion rules
+ * as svc_set_num_threads().
+ */
+int
+svc_pool_grow(struct svc_serv *serv, struct svc_pool *pool)
+{
+	if (pool->sp_nrthreads >= pool->sp_nrthrmax)
+		return 0;
+
+	return svc_start_kthread(serv, pool);
+}
+EXPORT_SYMBOL_GPL(svc_pool_grow);
+
 /*
  * Called from a server thread as it's exiting. Caller must hold the "service
  * mutex" for the service.
@@ -773,14 +806,40 @@ svc_rqst_free(struct svc_rqst *rqstp)
 }
 EXPORT_SYMBOL_GPL(svc_rqst_free);
 
+/*
+ * An exiting thread may still sit on the idle list if it was woken by
+ * something else than the pool handing it work.  It is busy by now, so
+ * nobody puts it back once it is off.
+ */
+static void
+svc_pool_unlist_idle(struct svc_pool *pool, struct svc_rqst *rqstp)
+{
+	struct llist_node *node, *next;
+
+	spin_lock_bh(&pool->sp_idle_lock);
+	if (test_bit(RQ_IDLE, &rqstp->rq_flags)) {
+		node = llist_del_all(&pool->sp_idle_threads);
+		while (node) {
+			next = llist_next(node);
+			if (node != &rqstp->rq_idle)
+				llist_add(node, &pool->sp_idle_threads);
+			node = next;
+		}
+	}
+	spin_unlock_bh(&pool->sp_idle_lock);
+}
+
 void
 svc_exit_thread(struct svc_rqst *rqstp)
 {
 	struct svc_serv	*serv = rqstp->rq_server;
 	struct svc_pool	*pool = rqstp->rq_pool;
 
+	svc_pool_unlist_idle(pool, rqstp);
+
 	spin_lock_bh(&pool->sp_lock);
-	pool->sp_nrthreads--;
+	if (!test_bit(RQ_RETIRED, &rqstp->rq_flags))
+		pool->sp_nrthreads--;
 	if (!test_and_set_bit(RQ_VICTIM, &rqstp->rq_flags))
 		list_del_rcu(&rqstp->rq_all);
 	spin_unlock_bh(&pool->sp_lock);
@@ -319,12 +319,54 @@ static bool svc_xprt_has_something_to_do(struct svc_xprt *xprt)
 	return false;
 }
 
+/*
+ * Pop an idle thread off the pool and mark it busy, handing it @xprt if
+ * there is one.  Entries for threads that woke up on their own are
+ * dropped on the way.  Caller must hold rcu_read_lock().
+ */
+static struct svc_rqst *svc_pool_claim_idle(struct svc_pool *pool,
+					    struct svc_xprt *xprt)
+{
+	struct svc_rqst *rqstp;
+	struct llist_node *node;
+	bool claimed;
+
+	for (;;) {
+		spin_lock_bh(&pool->sp_idle_lock);
+		node = llist_del_first(&pool->sp_idle_threads);
+		spin_unlock_bh(&pool->sp_idle_lock);
+		if (!node)
+			return NULL;
+		rqstp = llist_entry(node, struct svc_rqst, rq_idle);
+
+		spin_lock_bh(&rqstp->rq_lock);
+		claimed = !test_and_set_bit(RQ_BUSY, &rqstp->rq_flags);
+		if (claimed && xprt) {
+			rqstp->rq_xprt = xprt;
+			svc_xprt_get(xprt);
+		}
+		spin_unlock_bh(&rqstp->rq_lock);
+
+		clear_bit(RQ_IDLE, &rqstp->rq_flags);
+		smp_mb__after_atomic();
+		if (claimed)
+			return rqstp;
+
+		/*
+		 * It was busy, but may have gone idle again while we held it
+		 * off the list, seen RQ_IDLE and not put itself back.
+		 */
+		if (!test_bit(RQ_BUSY, &rqstp->rq_flags) &&
+		    !test_and_set_bit(RQ_IDLE, &rqstp->rq_flags))
+			llist_add(&rqstp->rq_idle, &pool->sp_idle_threads);
+	}
+}
+
 void svc_xprt_do_enqueue(struct svc_xprt *xprt)
 {
 	struct svc_pool *pool;
 	struct svc_rqst	*rqstp = NULL;
 	int cpu;
-	bool queued = false;
 
 	if (!svc_xprt_has_something_to_do(xprt))
 		goto out;
@@ -345,58 +387,32 @@ void svc_xprt_do_enqueue(struct svc_xprt *xprt)
 
 	atomic_long_inc(&pool->sp_stats.packets);
 
-redo_search:
-	/* find a thread for this xprt */
+	/* hand this xprt to an idle thread */
 	rcu_read_lock();
-	list_for_each_entry_rcu(rqstp, &pool->sp_all_threads, rq_all) {
-		/* Do a lockless check first */
-		if (test_bit(RQ_BUSY, &rqstp->rq_flags))
-			continue;
-
+	rqstp = svc_pool_claim_idle(pool, xprt);
+	if (!rqstp) {
 		/*
-		 * Once the xprt has been queued, it can only be dequeued by
-		 * the task that intends to service it. All we can do at that
-		 * point is to try to wake this thread back up so that it can
-		 * do so.
+		 * We didn't find an idle thread to use, so we need to queue
+		 * the xprt.  Do so and then look again: a thread that went
+		 * idle meanwhile can't be handed this one directly, but once
+		 * woken it will pick it up from the queue.
 		 */
-		if (!queued) {
-			spin_lock_bh(&rqstp->rq_lock);
-			if (test_and_set_bit(RQ_BUSY, &rqstp->rq_flags)) {
-				/* already busy, move on... */
-				spin_unlock_bh(&rqstp->rq_lock);
-				continue;
-			}
-
-			/* this one will do */
-			rqstp->rq_xprt = xprt;
-			svc_xprt_get(xprt);
-			spin_unlock_bh(&rqstp->rq_lock);
-		}
-		rcu_read_unlock();
-
-		atomic_long_inc(&pool->sp_stats.threads_woken);
-		wake_up_process(rqstp->rq_task);
-		put_cpu();
-		goto out;
-	}
-	rcu_read_unlock();
-
-	/*
-	 * We didn't find an idle thread to use, so we need to queue the xprt.
-	 * Do so and then search again. If we find one, we can't hook this one
-	 * up to it directly but we can wake the thread up in the hopes that it
-	 * will pick it up once it searches for a xprt to service.
-	 */
-	if (!queued) {
-		queued = true;
 		dprintk("svc: transport %p put into queue\n", xprt);
 		spin_lock_bh(&pool->sp_lock);
 		list_add_tail(&xprt->xpt_ready, &pool->sp_sockets);
 		pool->sp_stats.sockets_queued++;
 		spin_unlock_bh(&pool->sp_lock);
-		goto redo_search;
+
+		rqstp = svc_pool_claim_idle(pool, NULL);
+		if (!rqstp && pool->sp_nrthreads < pool->sp_nrthrmax &&
+		    !test_bit(SP_CONGESTED, &pool->sp_flags))
+			set_bit(SP_CONGESTED, &pool->sp_flags);
+	}
+	if (rqstp) {
+		atomic_long_inc(&pool->sp_stats.threads_woken);
+		wake_up_process(rqstp->rq_task);
 	}
-	rqstp = NULL;
+	rcu_read_unlock();
 	put_cpu();
 out:
 	trace_svc_xprt_do_enqueue(xprt, rqstp);
@@ -513,14 +529,12 @@ void svc_wake_up(struct svc_serv *serv)
 	pool = &serv->sv_pools[0];
 
 	rcu_read_lock();
-	list_for_each_entry_rcu(rqstp, &pool->sp_all_threads, rq_all) {
-		/* skip any that aren't queued */
-		if (test_bit(RQ_BUSY, &rqstp->rq_flags))
-			continue;
-		rcu_read_unlock();
+	rqstp = svc_pool_claim_idle(pool, NULL);
+	if (rqstp) {
 		dprintk("svc: daemon %p woken up.\n", rqstp);
 		wake_up_process(rqstp->rq_task);
 		trace_svc_wake_up(rqstp->rq_task->pid);
+		rcu_read_unlock();
 		return;
 	}
 	rcu_read_unlock();
@@ -601,7 +615,7 @@ static int svc_alloc_arg(struct svc_rqst *rqstp)
 {
 	struct svc_serv *serv = rqstp->rq_server;
 	struct xdr_buf *arg;
-	int pages;
+	unsigned long pages, filled, ret;
 	int i;
 
 	/* now allocate needed pages.  If we get a failure, sleep briefly */
@@ -610,19 +624,21 @@ static int svc_alloc_arg(struct svc_rqst *rqstp)
 	if (pages >= RPCSVC_MAXPAGES)
 		/* use as many pages as possible */
 		pages = RPCSVC_MAXPAGES - 1;
-	for (i = 0; i < pages ; i++)
-		while (rqstp->rq_pages[i] == NULL) {
-			struct page *p = alloc_page(GFP_KERNEL);
-			if (!p) {
-				set_current_state(TASK_INTERRUPTIBLE);
-				if (signalled() || kthread_should_stop()) {
-					set_current_state(TASK_RUNNING);
-					return -EINTR;
-				}
-				schedule_timeout(msecs_to_jiffies(500));
-			}
-			rqstp->rq_pages[i] = p;
+	for (filled = 0; filled < pages; filled = ret) {
+		ret = alloc_pages_bulk_array(GFP_KERNEL, pages,
+					     rqstp->rq_pages);
+		if (ret > filled)
+			/* Made progress, don't sleep yet */
+			continue;
+
+		set_current_state(TASK_INTERRUPTIBLE);
+		if (signalled() || kthread_should_stop()) {
+			set_current_state(TASK_RUNNING);
+			return -EINTR;
 		}
+		schedule_timeout(msecs_to_jiffies(500));
+	}
+	i = pages;
 	rqstp->rq_page_end = &rqstp->rq_pages[i];
 	rqstp->rq_pages[i++] = NULL; /* this might be seen in nfs_read_actor */
 
@@ -639,6 +655,32 @@ static int svc_alloc_arg(struct svc_rqst *rqstp)
 	return 0;
 }
 
+/*
+ * A thread of a self-sizing pool that sat idle for a whole timeout leaves,
+ * unless that would take the pool below the number it was asked to run.
+ */
+static bool
+svc_thread_retire(struct svc_rqst *rqstp)
+{
+	struct svc_pool		*pool = rqstp->rq_pool;
+	bool			retire = false;
+
+	if (!pool->sp_nrthrmax)
+		return false;
+
+	spin_lock_bh(&pool->sp_lock);
+	if (pool->sp_nrthreads > pool->sp_nrthrmin &&
+	    !test_and_set_bit(RQ_VICTIM, &rqstp->rq_flags)) {
+		/* so that svc_set_num_threads() won't pick it either */
+		list_del_rcu(&rqstp->rq_all);
+		pool->sp_nrthreads--;
+		set_bit(RQ_RETIRED, &rqstp->rq_flags);
+		retire = true;
+	}
+	spin_unlock_bh(&pool->sp_lock);
+	return retire;
+}
+
 static bool
 rqst_should_sleep(struct svc_rqst *rqstp)
 {
@@ -672,6 +714,10 @@ static struct svc_xprt *svc_get_next_xprt(struct svc_rqst *rqstp, long timeout)
 	/* rq_xprt should be clear on entry */
 	WARN_ON_ONCE(rqstp->rq_xprt);
 
+	/* threads beyond what the pool was asked for don't idle forever */
+	if (pool->sp_nrthrmax)
+		timeout = min_t(long, timeout, SVC_POOL_IDLE_TIMEOUT);
+
 	/* Normally we will wait up to 5 seconds for any required
 	 * cache information to be provided.
 	 */
@@ -696,6 +742,9 @@ static struct svc_xprt *svc_get_next_xprt(struct svc_rqst *rqstp, long timeout)
 	 */
 	set_current_state(TASK_INTERRUPTIBLE);
 	clear_bit(RQ_BUSY, &rqstp->rq_flags);
+	smp_mb__after_atomic();
+	if (!test_and_set_bit(RQ_IDLE, &rqstp->rq_flags))
+		llist_add(&rqstp->rq_idle, &pool->sp_idle_threads);
 	smp_mb();
 
 	if (likely(rqst_should_sleep(rqstp)))
@@ -713,8 +762,11 @@ static struct svc_xprt *svc_get_next_xprt(struct svc_rqst *rqstp, long timeout)
 	if (xprt != NULL)
 		return xprt;
 
-	if (!time_left)
+	if (!time_left) {
 		atomic_long_inc(&pool->sp_stats.threads_timedout);
+		if (svc_thread_retire(rqstp))
+			return ERR_PTR(-EINTR);
+	}
 
 	if (signalled() || kthread_should_stop())
 		return ERR_PTR(-EINTR);
@@ -787,6 +839,9 @@ out:
  * Receive the next request on any transport.  This code is carefully
  * organised not to touch any cachelines in the shared svc_serv
  * structure, only cachelines in the local svc_pool.
+ *
+ * Returns -EINTR when the thread should exit: it was signalled, or it
+ * idled out of a self-sizing pool.
  */
 int svc_recv(struct svc_rqst *rqstp, long timeout)
 {
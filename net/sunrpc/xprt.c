@@ -1188,11 +1188,11 @@ void xprt_reserve(struct rpc_task *task)
 
 	task->tk_timeout = 0;
 	task->tk_status = -EAGAIN;
-	rcu_read_lock();
-	xprt = rcu_dereference(task->tk_client->cl_xprt);
+	if (task->tk_xprt == NULL)
+		task->tk_xprt = rpc_task_get_xprt(task);
+	xprt = task->tk_xprt;
 	if (!xprt_throttle_congested(xprt, task))
 		xprt->ops->alloc_slot(xprt, task);
-	rcu_read_unlock();
 }
 
 /**
@@ -1214,10 +1214,10 @@ void xprt_retry_reserve(struct rpc_task *task)
 
 	task->tk_timeout = 0;
 	task->tk_status = -EAGAIN;
-	rcu_read_lock();
-	xprt = rcu_dereference(task->tk_client->cl_xprt);
+	if (task->tk_xprt == NULL)
+		task->tk_xprt = rpc_task_get_xprt(task);
+	xprt = task->tk_xprt;
 	xprt->ops->alloc_slot(xprt, task);
-	rcu_read_unlock();
 }
 
 static inline __be32 xprt_alloc_xid(struct rpc_xprt *xprt)
@@ -1263,13 +1263,9 @@ void xprt_release(struct rpc_task *task)
 	struct rpc_rqst	*req = task->tk_rqstp;
 
 	if (req == NULL) {
-		if (task->tk_client) {
-			rcu_read_lock();
-			xprt = rcu_dereference(task->tk_client->cl_xprt);
-			if (xprt->snd_task == task)
-				xprt_release_write(xprt, task);
-			rcu_read_unlock();
-		}
+		xprt = task->tk_xprt;
+		if (xprt != NULL && xprt->snd_task == task)
+			xprt_release_write(xprt, task);
 		return;
 	}
 
@@ -80,6 +80,8 @@
 #include <linux/proc_fs.h>
 #include <linux/mutex.h>
 #include <linux/wait.h>
+#include <linux/workqueue.h>
+#include <linux/cred.h>
 
 #include <net/sock.h>
 #include <net/af_unix.h>
@@ -91,7 +93,6 @@
 static LIST_HEAD(gc_inflight_list);
 static LIST_HEAD(gc_candidates);
 static DEFINE_SPINLOCK(unix_gc_lock);
-static DECLARE_WAIT_QUEUE_HEAD(unix_gc_wait);
 
 unsigned int unix_tot_inflight;
 
@@ -132,6 +133,7 @@ void unix_inflight(struct user_struct *user, struct file *fp)
 			BUG_ON(list_empty(&u->link));
 		}
 		unix_tot_inflight++;
+		unix_graph_maybe_cyclic = true;
 	}
 	user->unix_inflight++;
 	spin_unlock(&unix_gc_lock);
@@ -254,63 +256,136 @@ static void inc_inflight_move_tail(struct unix_sock *u)
 }
 
 static bool gc_in_progress;
+/* Set when a socket goes in flight, a new cycle may have formed */
+static bool unix_graph_maybe_cyclic;
+
+static void __unix_gc(struct work_struct *work);
+static DECLARE_WORK(unix_gc_work, __unix_gc);
+
 #define UNIX_INFLIGHT_TRIGGER_GC 16000
+#define UNIX_INFLIGHT_SANE_USER (SCM_MAX_FD * 8)
 
 void wait_for_unix_gc(void)
 {
+	struct user_struct *user = current_user();
+
 	/* If number of inflight sockets is insane,
-	 * force a garbage collect right now.
+	 * kick the garbage collector right now.
 	 */
-	if (unix_tot_inflight > UNIX_INFLIGHT_TRIGGER_GC && !gc_in_progress)
+	if (READ_ONCE(unix_tot_inflight) > UNIX_INFLIGHT_TRIGGER_GC &&
+	    !READ_ONCE(gc_in_progress))
 		unix_gc();
-	wait_event(unix_gc_wait, gc_in_progress == false);
+
+	/* Only senders with lots of sockets in flight that nobody
+	 * received wait for the collection to finish.
+	 */
+	if (READ_ONCE(user->unix_inflight) < UNIX_INFLIGHT_SANE_USER)
+		return;
+
+	if (READ_ONCE(gc_in_progress))
+		flush_work(&unix_gc_work);
 }
 
-/* The external entry point: unix_gc() */
-void unix_gc(void)
+/*
+ * Candidates are split into the connected components of the graph formed
+ * by "holds in its receive queue" edges, with a union-find over ->gc_leader.
+ * No edge links two components, so each one is collected on its own and
+ * unix_gc_lock is dropped in between.
+ */
+static struct unix_sock *gc_find(struct unix_sock *u)
+{
+	while (u->gc_leader != u) {
+		u->gc_leader = u->gc_leader->gc_leader;
+		u = u->gc_leader;
+	}
+	return u;
+}
+
+/* The socket whose children scan_children() is reporting to gc_union() */
+static struct unix_sock *gc_scan_parent;
+
+static void gc_union(struct unix_sock *u)
+{
+	struct unix_sock *a = gc_find(gc_scan_parent);
+	struct unix_sock *b = gc_find(u);
+
+	if (a != b)
+		b->gc_leader = a;
+}
+
+/*
+ * Move the candidates onto @components, grouped by connected component.
+ * The first socket of each group has UNIX_GC_COMPONENT set.
+ */
+static void unix_gc_partition(struct list_head *components)
+{
+	struct unix_sock *u, *next;
+
+	list_for_each_entry(u, &gc_candidates, link)
+		u->gc_leader = u;
+
+	list_for_each_entry(u, &gc_candidates, link) {
+		gc_scan_parent = u;
+		scan_children(&u->sk, gc_union, NULL);
+	}
+
+	list_for_each_entry_safe(u, next, &gc_candidates, link) {
+		if (gc_find(u) == u) {
+			list_move_tail(&u->link, components);
+			__set_bit(UNIX_GC_COMPONENT, &u->gc_flags);
+		}
+	}
+
+	/* Whatever is left goes right behind the leader of its component */
+	list_for_each_entry_safe(u, next, &gc_candidates, link)
+		list_move(&u->link, &gc_find(u)->link);
+
+	/* Candidates are selected again, one component at a time */
+	list_for_each_entry(u, components, link) {
+		__clear_bit(UNIX_GC_CANDIDATE, &u->gc_flags);
+		__clear_bit(UNIX_GC_MAYBE_CYCLE, &u->gc_flags);
+	}
+}
+
+/*
+ * Collect the first component of @components.  Called with unix_gc_lock
+ * held, which is dropped while the garbage is freed.
+ */
+static void unix_gc_component(struct list_head *components)
 {
 	struct unix_sock *u;
 	struct unix_sock *next;
 	struct sk_buff_head hitlist;
 	struct list_head cursor;
 	LIST_HEAD(not_cycle_list);
+	bool first = true;
 
-	spin_lock(&unix_gc_lock);
-
-	/* Avoid a recursive GC. */
-	if (gc_in_progress)
-		goto out;
-
-	gc_in_progress = true;
-	/* First, select candidates for garbage collection.  Only
-	 * in-flight sockets are considered, and from those only ones
-	 * which don't have any external reference.
+	/* The lock was dropped since the candidates were selected.  Members
+	 * which gained an external reference meanwhile are not candidates
+	 * anymore, and sockets which left flight were unlinked.
 	 *
-	 * Holding unix_gc_lock will protect these candidates from
-	 * being detached, and hence from gaining an external
-	 * reference.  Since there are no possible receivers, all
-	 * buffers currently on the candidates' queues stay there
-	 * during the garbage collection.
-	 *
-	 * We also know that no new candidate can be added onto the
-	 * receive queues.  Other, non candidate sockets _can_ be
-	 * added to queue, so we must make sure only to touch
-	 * candidates.
+	 * Holding unix_gc_lock will protect the candidates from being
+	 * detached, and hence from gaining an external reference.  Since
+	 * there are no possible receivers, all buffers currently on the
+	 * candidates' queues stay there during the collection.  Sockets
+	 * outside of the component never have UNIX_GC_CANDIDATE set, so
+	 * they are not touched.
 	 */
-	list_for_each_entry_safe(u, next, &gc_inflight_list, link) {
-		long total_refs;
-		long inflight_refs;
-
-		total_refs = file_count(u->sk.sk_socket->file);
-		inflight_refs = atomic_long_read(&u->inflight);
-
-		BUG_ON(inflight_refs < 1);
-		BUG_ON(total_refs < inflight_refs);
-		if (total_refs == inflight_refs) {
-			list_move_tail(&u->link, &gc_candidates);
-			__set_bit(UNIX_GC_CANDIDATE, &u->gc_flags);
-			__set_bit(UNIX_GC_MAYBE_CYCLE, &u->gc_flags);
+	list_for_each_entry_safe(u, next, components, link) {
+		if (!first && test_bit(UNIX_GC_COMPONENT, &u->gc_flags))
+			break;
+		first = false;
+		__clear_bit(UNIX_GC_COMPONENT, &u->gc_flags);
+
+		if (file_count(u->sk.sk_socket->file) !=
+		    atomic_long_read(&u->inflight)) {
+			list_move_tail(&u->link, &gc_inflight_list);
+			continue;
 		}
+
+		list_move_tail(&u->link, &gc_candidates);
+		__set_bit(UNIX_GC_CANDIDATE, &u->gc_flags);
+		__set_bit(UNIX_GC_MAYBE_CYCLE, &u->gc_flags);
 	}
 
 	/* Now remove all internal in-flight reference to children of
@@ -356,7 +431,7 @@ void unix_gc(void)
 	 */
 	skb_queue_head_init(&hitlist);
 	list_for_each_entry(u, &gc_candidates, link)
-	scan_children(&u->sk, inc_inflight, &hitlist);
+		scan_children(&u->sk, inc_inflight, &hitlist);
 
 	spin_unlock(&unix_gc_lock);
 
@@ -367,9 +442,67 @@ void unix_gc(void)
 
 	/* All candidates should have been detached by now. */
 	BUG_ON(!list_empty(&gc_candidates));
-	gc_in_progress = false;
-	wake_up(&unix_gc_wait);
+}
 
- out:
+static void __unix_gc(struct work_struct *work)
+{
+	struct unix_sock *u;
+	struct unix_sock *next;
+	LIST_HEAD(components);
+
+	spin_lock(&unix_gc_lock);
+
+	/* Nothing went in flight since the last collection */
+	if (!unix_graph_maybe_cyclic)
+		goto out;
+	unix_graph_maybe_cyclic = false;
+
+	/* First, select candidates for garbage collection.  Only
+	 * in-flight sockets are considered, and from those only ones
+	 * which don't have any external reference.
+	 */
+	list_for_each_entry_safe(u, next, &gc_inflight_list, link) {
+		long total_refs;
+		long inflight_refs;
+
+		total_refs = file_count(u->sk.sk_socket->file);
+		inflight_refs = atomic_long_read(&u->inflight);
+
+		BUG_ON(inflight_refs < 1);
+		BUG_ON(total_refs < inflight_refs);
+		if (total_refs == inflight_refs) {
+			list_move_tail(&u->link, &gc_candidates);
+			__set_bit(UNIX_GC_CANDIDATE, &u->gc_flags);
+		}
+	}
+
+	unix_gc_partition(&components);
+
+	while (!list_empty(&components)) {
+		unix_gc_component(&components);
+
+		/* Let senders and receivers in between components */
+		spin_unlock(&unix_gc_lock);
+		cond_resched();
+		spin_lock(&unix_gc_lock);
+	}
+
+out:
+	WRITE_ONCE(gc_in_progress, false);
 	spin_unlock(&unix_gc_lock);
 }
+
+/*
+ * The external entry point: unix_gc()
+ *
+ * The collection runs from a worker, so that neither close() nor sendmsg()
+ * wait for it, see wait_for_unix_gc().
+ */
+void unix_gc(void)
+{
+	if (!READ_ONCE(unix_graph_maybe_cyclic))
+		return;
+
+	WRITE_ONCE(gc_in_progress, true);
+	queue_work(system_unbound_wq, &unix_gc_work);
+}
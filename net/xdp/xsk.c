@@ -0,0 +1,929 @@
+/* XDP sockets
+ *
+ * AF_XDP sockets give user space direct access to the frames received on
+ * one queue of a network device, and let it transmit frames on that queue,
+ * without going through the rest of the network stack.  Frames live in a
+ * memory area registered by the application, the UMEM, and are exchanged
+ * through the fill, completion, RX and TX rings described in if_xdp.h.
+ *
+ * Drivers that support it receive straight into UMEM frames (zero-copy
+ * mode).  For all other devices the frames are copied out of the skb at
+ * the start of __netif_receive_skb_core() instead (copy mode).  Transmit
+ * always builds an skb from the UMEM frame and hands it to the bound queue.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ */
+
+#define pr_fmt(fmt) "AF_XDP: %s: " fmt, __func__
+
+#include <linux/if_xdp.h>
+#include <linux/init.h>
+#include <linux/log2.h>
+#include <linux/sched.h>
+#include <linux/socket.h>
+#include <linux/file.h>
+#include <linux/uaccess.h>
+#include <linux/net.h>
+#include <linux/netdevice.h>
+#include <linux/rtnetlink.h>
+#include <linux/static_key.h>
+#include <net/xdp_sock.h>
+
+#include "xsk_queue.h"
+#include "xdp_umem.h"
+
+#define TX_BATCH_SIZE 16
+
+/* Enabled while at least one socket is bound in copy mode */
+struct static_key xsk_rx_needed __read_mostly;
+
+/* All XDP sockets, for the netdevice notifier */
+static DEFINE_MUTEX(xsk_list_mutex);
+static LIST_HEAD(xsk_list);
+
+static struct xdp_sock *xsk_skb_rx_sock(const struct sk_buff *skb)
+{
+	struct net_device *dev = skb->dev;
+	u16 index = 0;
+
+	if (skb_rx_queue_recorded(skb))
+		index = skb_get_rx_queue(skb);
+	if (unlikely(index >= dev->real_num_rx_queues))
+		return NULL;
+
+	return rcu_dereference(dev->_rx[index].xsk);
+}
+
+/* Frames for a copy-mode socket have to reach it as they were received,
+ * so they are kept out of GRO.
+ */
+bool xsk_skb_rx_queue_bound(const struct sk_buff *skb)
+{
+	struct xdp_sock *xs;
+	bool bound;
+
+	rcu_read_lock();
+	xs = xsk_skb_rx_sock(skb);
+	bound = xs && !xs->zc;
+	rcu_read_unlock();
+
+	return bound;
+}
+
+static void xsk_flush(struct xdp_sock *xs)
+{
+	xskq_produce_flush_desc(xs->rx);
+	xs->sk.sk_data_ready(&xs->sk);
+}
+
+static int xsk_rcv_copy(struct xdp_sock *xs, struct sk_buff *skb)
+{
+	struct xdp_umem *umem = xs->umem;
+	u32 len = skb->len;
+	void *buffer;
+	u64 addr;
+	int err;
+
+	if (!xskq_peek_addr(umem->fq, &addr) ||
+	    len > umem->chunk_size_nohr) {
+		xs->rx_dropped++;
+		return -ENOSPC;
+	}
+
+	addr += umem->headroom;
+	buffer = xdp_umem_get_data(umem, addr);
+	skb_copy_bits(skb, 0, buffer, len);
+
+	err = xskq_produce_batch_desc(xs->rx, addr, len);
+	if (err) {
+		xs->rx_dropped++;
+		return err;
+	}
+
+	xskq_discard_addr(umem->fq);
+	return 0;
+}
+
+/**
+ * xsk_generic_rcv - deliver a frame to a copy-mode XDP socket
+ * @skb: received buffer, as it enters __netif_receive_skb_core()
+ *
+ * If an XDP socket is bound in copy mode to the queue the frame was
+ * received on, the frame is copied into its UMEM and the skb is freed.
+ * Called under rcu_read_lock().
+ *
+ * Returns true if the skb was consumed.
+ */
+bool xsk_generic_rcv(struct sk_buff *skb)
+{
+	struct xdp_sock *xs;
+	int mac_len, err;
+
+	xs = xsk_skb_rx_sock(skb);
+	if (!xs || xs->zc)
+		return false;
+
+	/* hand over the frame from its link layer header on */
+	mac_len = skb->data - skb_mac_header(skb);
+	__skb_push(skb, mac_len);
+
+	spin_lock_bh(&xs->rx_lock);
+	err = xsk_rcv_copy(xs, skb);
+	if (!err)
+		xsk_flush(xs);
+	spin_unlock_bh(&xs->rx_lock);
+
+	if (err)
+		kfree_skb(skb);
+	else
+		consume_skb(skb);
+	return true;
+}
+
+/**
+ * xsk_umem_peek_addr - get a frame to receive into
+ * @umem: umem installed on the rx queue
+ * @addr: filled with the address of the start of the frame
+ *
+ * Frames given back with xsk_umem_fq_reuse() are handed out before new
+ * entries are taken from the fill ring.  The frame stays at the head until
+ * xsk_umem_discard_addr() is called.
+ */
+bool xsk_umem_peek_addr(struct xdp_umem *umem, u64 *addr)
+{
+	struct xdp_umem_fq_reuse *rq = umem->fq_reuse;
+
+	if (rq->length) {
+		*addr = rq->handles[rq->length - 1];
+		return true;
+	}
+
+	return xskq_peek_addr(umem->fq, addr);
+}
+EXPORT_SYMBOL(xsk_umem_peek_addr);
+
+void xsk_umem_discard_addr(struct xdp_umem *umem)
+{
+	struct xdp_umem_fq_reuse *rq = umem->fq_reuse;
+
+	if (rq->length)
+		rq->length--;
+	else
+		xskq_discard_addr(umem->fq);
+}
+EXPORT_SYMBOL(xsk_umem_discard_addr);
+
+/**
+ * xsk_umem_rcv - post a frame received in zero-copy mode
+ * @umem: umem installed on the rx queue
+ * @addr: address of the frame data, including the umem headroom
+ * @len: length of the frame
+ *
+ * The descriptor becomes visible to user space on xsk_umem_flush().  On
+ * error the frame still belongs to the driver, which should recycle it.
+ */
+int xsk_umem_rcv(struct xdp_umem *umem, u64 addr, u32 len)
+{
+	struct xdp_sock *xs = umem->xs;
+	int err;
+
+	err = xskq_produce_batch_desc(xs->rx, addr, len);
+	if (err)
+		xs->rx_dropped++;
+	return err;
+}
+EXPORT_SYMBOL(xsk_umem_rcv);
+
+void xsk_umem_flush(struct xdp_umem *umem)
+{
+	xsk_flush(umem->xs);
+}
+EXPORT_SYMBOL(xsk_umem_flush);
+
+static void xsk_destruct_skb(struct sk_buff *skb)
+{
+	u64 addr = (u64)(long)skb_shinfo(skb)->destructor_arg;
+	struct xdp_sock *xs = xdp_sk(skb->sk);
+	unsigned long flags;
+
+	spin_lock_irqsave(&xs->tx_completion_lock, flags);
+	WARN_ON_ONCE(xskq_produce_addr(xs->umem->cq, addr));
+	spin_unlock_irqrestore(&xs->tx_completion_lock, flags);
+
+	sock_wfree(skb);
+}
+
+/* Like dev_queue_xmit() but bypassing the qdisc and queue selection.  A
+ * frame the driver is too busy to take is left to the caller.
+ */
+static int xsk_direct_xmit(struct sk_buff *skb, u16 queue_id)
+{
+	struct net_device *dev = skb->dev;
+	struct netdev_queue *txq;
+	int ret = NETDEV_TX_BUSY;
+
+	if (unlikely(!netif_running(dev) ||
+		     !netif_carrier_ok(dev)))
+		goto drop;
+
+	skb_set_queue_mapping(skb, queue_id);
+	txq = skb_get_tx_queue(dev, skb);
+
+	local_bh_disable();
+
+	HARD_TX_LOCK(dev, txq, smp_processor_id());
+	if (!netif_xmit_frozen_or_drv_stopped(txq))
+		ret = netdev_start_xmit(skb, dev, txq, false);
+	HARD_TX_UNLOCK(dev, txq);
+
+	local_bh_enable();
+
+	if (!dev_xmit_complete(ret))
+		return NETDEV_TX_BUSY;
+
+	return ret;
+drop:
+	atomic_long_inc(&dev->tx_dropped);
+	kfree_skb(skb);
+	return NET_XMIT_DROP;
+}
+
+static void xsk_cancel_completion(struct xdp_sock *xs)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&xs->tx_completion_lock, flags);
+	xskq_cancel_addr(xs->umem->cq);
+	spin_unlock_irqrestore(&xs->tx_completion_lock, flags);
+}
+
+static int xsk_generic_xmit(struct sock *sk, struct msghdr *m,
+			    size_t total_len)
+{
+	u32 max_batch = TX_BATCH_SIZE;
+	struct xdp_sock *xs = xdp_sk(sk);
+	bool sent_frame = false;
+	struct xdp_desc desc;
+	struct sk_buff *skb;
+	unsigned long flags;
+	int err = 0;
+
+	mutex_lock(&xs->mutex);
+
+	if (unlikely(!xs->dev)) {
+		err = -ENXIO;
+		goto out;
+	}
+	if (unlikely(!(xs->dev->flags & IFF_UP))) {
+		err = -ENETDOWN;
+		goto out;
+	}
+
+	while (xskq_peek_desc(xs->tx, &desc)) {
+		char *buffer;
+		u32 len;
+
+		if (max_batch-- == 0) {
+			err = -EAGAIN;
+			goto out;
+		}
+
+		len = desc.len;
+		if (unlikely(len > xs->dev->mtu + xs->dev->hard_header_len)) {
+			xs->tx->invalid_descs++;
+			xskq_discard_desc(xs->tx);
+			continue;
+		}
+
+		spin_lock_irqsave(&xs->tx_completion_lock, flags);
+		err = xskq_reserve_addr(xs->umem->cq);
+		spin_unlock_irqrestore(&xs->tx_completion_lock, flags);
+		if (err) {
+			err = -EAGAIN;
+			goto out;
+		}
+
+		skb = sock_alloc_send_skb(sk, len, 1, &err);
+		if (unlikely(!skb)) {
+			xsk_cancel_completion(xs);
+			err = -EAGAIN;
+			goto out;
+		}
+
+		skb_put(skb, len);
+		buffer = xdp_umem_get_data(xs->umem, desc.addr);
+		skb_copy_to_linear_data(skb, buffer, len);
+
+		skb->dev = xs->dev;
+		skb->priority = sk->sk_priority;
+		skb->mark = sk->sk_mark;
+		skb_shinfo(skb)->destructor_arg = (void *)(long)desc.addr;
+		skb->destructor = xsk_destruct_skb;
+
+		err = xsk_direct_xmit(skb, xs->queue_id);
+		if (err == NETDEV_TX_BUSY) {
+			/* the frame stays on the TX ring for a later retry */
+			skb->destructor = sock_wfree;
+			consume_skb(skb);
+			xsk_cancel_completion(xs);
+			err = -EAGAIN;
+			goto out;
+		}
+
+		xskq_discard_desc(xs->tx);
+		/* Ignore NET_XMIT_CN as packet might have been sent */
+		if (err == NET_XMIT_DROP) {
+			/* completed through the destructor, but not sent */
+			err = -EBUSY;
+			goto out;
+		}
+
+		err = 0;
+		sent_frame = true;
+	}
+
+out:
+	if (sent_frame)
+		sk->sk_write_space(sk);
+
+	mutex_unlock(&xs->mutex);
+	return err;
+}
+
+static int xsk_sendmsg(struct socket *sock, struct msghdr *m, size_t total_len)
+{
+	bool need_wait = !(m->msg_flags & MSG_DONTWAIT);
+	struct sock *sk = sock->sk;
+	struct xdp_sock *xs = xdp_sk(sk);
+
+	if (unlikely(!xs->tx))
+		return -ENOBUFS;
+	if (need_wait)
+		return -EOPNOTSUPP;
+
+	return xsk_generic_xmit(sk, m, total_len);
+}
+
+static unsigned int xsk_poll(struct file *file, struct socket *sock,
+			     struct poll_table_struct *wait)
+{
+	unsigned int mask = datagram_poll(file, sock, wait);
+	struct sock *sk = sock->sk;
+	struct xdp_sock *xs = xdp_sk(sk);
+
+	if (xs->rx && !xskq_empty_desc(xs->rx))
+		mask |= POLLIN | POLLRDNORM;
+	if (xs->tx && !xskq_full_desc(xs->tx))
+		mask |= POLLOUT | POLLWRNORM;
+
+	return mask;
+}
+
+static int xsk_init_queue(u32 entries, struct xsk_queue **queue,
+			  bool umem_queue)
+{
+	struct xsk_queue *q;
+
+	if (entries == 0 || *queue || !is_power_of_2(entries))
+		return -EINVAL;
+
+	q = xskq_create(entries, umem_queue);
+	if (!q)
+		return -ENOMEM;
+
+	/* Make sure queue is ready before it can be seen by others */
+	smp_wmb();
+	WRITE_ONCE(*queue, q);
+	return 0;
+}
+
+static int xsk_bind_rx_queue(struct xdp_sock *xs, struct net_device *dev,
+			     u16 flags)
+{
+	struct netdev_rx_queue *rxq = &dev->_rx[xs->queue_id];
+	const struct net_device_ops *ops = dev->netdev_ops;
+	struct netdev_xdp xdp = {};
+	int err;
+
+	if (rtnl_dereference(rxq->xsk))
+		return -EBUSY;
+
+	if (!(flags & XDP_COPY) && ops->ndo_xdp) {
+		xs->umem->xs = xs;
+		xdp.command = XDP_SETUP_XSK_UMEM;
+		xdp.xsk.umem = xs->umem;
+		xdp.xsk.queue_id = xs->queue_id;
+		err = ops->ndo_xdp(dev, &xdp);
+		if (!err) {
+			xs->zc = true;
+			goto out;
+		}
+		xs->umem->xs = NULL;
+		if (flags & XDP_ZEROCOPY)
+			return err;
+	} else if (flags & XDP_ZEROCOPY) {
+		return -EOPNOTSUPP;
+	}
+
+	static_key_slow_inc(&xsk_rx_needed);
+out:
+	rcu_assign_pointer(rxq->xsk, xs);
+	return 0;
+}
+
+static void xsk_unbind_dev(struct xdp_sock *xs)
+{
+	struct net_device *dev = xs->dev;
+	struct netdev_xdp xdp = {};
+
+	ASSERT_RTNL();
+
+	if (!dev)
+		return;
+
+	if (xs->rx) {
+		RCU_INIT_POINTER(dev->_rx[xs->queue_id].xsk, NULL);
+		if (xs->zc) {
+			xdp.command = XDP_SETUP_XSK_UMEM;
+			xdp.xsk.umem = NULL;
+			xdp.xsk.queue_id = xs->queue_id;
+			WARN_ON(dev->netdev_ops->ndo_xdp(dev, &xdp));
+		} else {
+			static_key_slow_dec(&xsk_rx_needed);
+		}
+	}
+
+	/* wait for the receive path to let go of the socket */
+	synchronize_net();
+
+	xs->umem->xs = NULL;
+	xs->zc = false;
+	xs->dev = NULL;
+	dev_put(dev);
+}
+
+static int xsk_release(struct socket *sock)
+{
+	struct sock *sk = sock->sk;
+	struct xdp_sock *xs;
+	struct net *net;
+
+	if (!sk)
+		return 0;
+
+	xs = xdp_sk(sk);
+	net = sock_net(sk);
+
+	mutex_lock(&xsk_list_mutex);
+	list_del(&xs->list);
+	mutex_unlock(&xsk_list_mutex);
+
+	local_bh_disable();
+	sock_prot_inuse_add(net, sk->sk_prot, -1);
+	local_bh_enable();
+
+	rtnl_lock();
+	mutex_lock(&xs->mutex);
+	xsk_unbind_dev(xs);
+	mutex_unlock(&xs->mutex);
+	rtnl_unlock();
+
+	sock_orphan(sk);
+	sock->sk = NULL;
+
+	sk_refcnt_debug_release(sk);
+	sock_put(sk);
+
+	return 0;
+}
+
+static int xsk_bind(struct socket *sock, struct sockaddr *addr, int addr_len)
+{
+	struct sockaddr_xdp *sxdp = (struct sockaddr_xdp *)addr;
+	struct sock *sk = sock->sk;
+	struct xdp_sock *xs = xdp_sk(sk);
+	struct xdp_umem *umem;
+	struct net_device *dev;
+	u16 flags;
+	u32 qid;
+	int err = 0;
+
+	if (addr_len < sizeof(struct sockaddr_xdp))
+		return -EINVAL;
+	if (sxdp->sxdp_family != AF_XDP)
+		return -EINVAL;
+
+	flags = sxdp->sxdp_flags;
+	if ((flags & ~(XDP_COPY | XDP_ZEROCOPY)) ||
+	    ((flags & XDP_COPY) && (flags & XDP_ZEROCOPY)) ||
+	    sxdp->sxdp_shared_umem_fd)
+		return -EINVAL;
+
+	rtnl_lock();
+	mutex_lock(&xs->mutex);
+	if (xs->dev) {
+		err = -EBUSY;
+		goto out_unlock;
+	}
+
+	dev = __dev_get_by_index(sock_net(sk), sxdp->sxdp_ifindex);
+	if (!dev) {
+		err = -ENODEV;
+		goto out_unlock;
+	}
+
+	umem = xs->umem;
+	if ((!xs->rx && !xs->tx) || !umem || !xdp_umem_validate_queues(umem)) {
+		err = -EINVAL;
+		goto out_unlock;
+	}
+
+	qid = sxdp->sxdp_queue_id;
+	if (qid >= dev->real_num_rx_queues ||
+	    (xs->tx && qid >= dev->real_num_tx_queues)) {
+		err = -EINVAL;
+		goto out_unlock;
+	}
+
+	xskq_set_umem(umem->fq, umem->size, umem->chunk_mask);
+	xskq_set_umem(umem->cq, umem->size, umem->chunk_mask);
+	xskq_set_umem(xs->rx, umem->size, umem->chunk_mask);
+	xskq_set_umem(xs->tx, umem->size, umem->chunk_mask);
+
+	xs->queue_id = qid;
+	if (xs->rx) {
+		err = xsk_bind_rx_queue(xs, dev, flags);
+		if (err)
+			goto out_unlock;
+	}
+
+	dev_hold(dev);
+	xs->dev = dev;
+
+out_unlock:
+	mutex_unlock(&xs->mutex);
+	rtnl_unlock();
+	return err;
+}
+
+static int xsk_setsockopt(struct socket *sock, int level, int optname,
+			  char __user *optval, unsigned int optlen)
+{
+	struct sock *sk = sock->sk;
+	struct xdp_sock *xs = xdp_sk(sk);
+	int err;
+
+	if (level != SOL_XDP)
+		return -ENOPROTOOPT;
+
+	switch (optname) {
+	case XDP_RX_RING:
+	case XDP_TX_RING:
+	{
+		struct xsk_queue **q;
+		int entries;
+
+		if (optlen < sizeof(entries))
+			return -EINVAL;
+		if (copy_from_user(&entries, optval, sizeof(entries)))
+			return -EFAULT;
+
+		mutex_lock(&xs->mutex);
+		if (xs->dev) {
+			mutex_unlock(&xs->mutex);
+			return -EBUSY;
+		}
+		q = (optname == XDP_TX_RING) ? &xs->tx : &xs->rx;
+		err = xsk_init_queue(entries, q, false);
+		mutex_unlock(&xs->mutex);
+		return err;
+	}
+	case XDP_UMEM_REG:
+	{
+		struct xdp_umem_reg mr;
+		struct xdp_umem *umem;
+
+		if (optlen < sizeof(mr))
+			return -EINVAL;
+		if (copy_from_user(&mr, optval, sizeof(mr)))
+			return -EFAULT;
+
+		mutex_lock(&xs->mutex);
+		if (xs->umem) {
+			mutex_unlock(&xs->mutex);
+			return -EBUSY;
+		}
+
+		umem = xdp_umem_create(&mr);
+		if (IS_ERR(umem)) {
+			mutex_unlock(&xs->mutex);
+			return PTR_ERR(umem);
+		}
+
+		/* Make sure umem is ready before it can be seen by others */
+		smp_wmb();
+		WRITE_ONCE(xs->umem, umem);
+		mutex_unlock(&xs->mutex);
+		return 0;
+	}
+	case XDP_UMEM_FILL_RING:
+	case XDP_UMEM_COMPLETION_RING:
+	{
+		struct xsk_queue **q;
+		int entries;
+
+		if (optlen < sizeof(entries))
+			return -EINVAL;
+		if (copy_from_user(&entries, optval, sizeof(entries)))
+			return -EFAULT;
+
+		mutex_lock(&xs->mutex);
+		if (!xs->umem || xs->dev) {
+			mutex_unlock(&xs->mutex);
+			return -EINVAL;
+		}
+
+		q = (optname == XDP_UMEM_FILL_RING) ? &xs->umem->fq :
+			&xs->umem->cq;
+		err = xsk_init_queue(entries, q, true);
+		mutex_unlock(&xs->mutex);
+		return err;
+	}
+	default:
+		break;
+	}
+
+	return -ENOPROTOOPT;
+}
+
+static int xsk_getsockopt(struct socket *sock, int level, int optname,
+			  char __user *optval, int __user *optlen)
+{
+	struct sock *sk = sock->sk;
+	struct xdp_sock *xs = xdp_sk(sk);
+	int len;
+
+	if (level != SOL_XDP)
+		return -ENOPROTOOPT;
+
+	if (get_user(len, optlen))
+		return -EFAULT;
+	if (len < 0)
+		return -EINVAL;
+
+	switch (optname) {
+	case XDP_STATISTICS:
+	{
+		struct xdp_statistics stats;
+
+		if (len < sizeof(stats))
+			return -EINVAL;
+
+		mutex_lock(&xs->mutex);
+		stats.rx_dropped = xs->rx_dropped;
+		stats.rx_invalid_descs =
+			xs->umem ? xskq_nb_invalid_descs(xs->umem->fq) : 0;
+		stats.tx_invalid_descs = xskq_nb_invalid_descs(xs->tx);
+		mutex_unlock(&xs->mutex);
+
+		if (copy_to_user(optval, &stats, sizeof(stats)))
+			return -EFAULT;
+		if (put_user(sizeof(stats), optlen))
+			return -EFAULT;
+
+		return 0;
+	}
+	case XDP_MMAP_OFFSETS:
+	{
+		struct xdp_mmap_offsets off;
+
+		if (len < sizeof(off))
+			return -EINVAL;
+
+		off.rx.producer = offsetof(struct xdp_rxtx_ring, ptrs.producer);
+		off.rx.consumer = offsetof(struct xdp_rxtx_ring, ptrs.consumer);
+		off.rx.desc	= offsetof(struct xdp_rxtx_ring, desc);
+		off.tx.producer = offsetof(struct xdp_rxtx_ring, ptrs.producer);
+		off.tx.consumer = offsetof(struct xdp_rxtx_ring, ptrs.consumer);
+		off.tx.desc	= offsetof(struct xdp_rxtx_ring, desc);
+
+		off.fr.producer = offsetof(struct xdp_umem_ring, ptrs.producer);
+		off.fr.consumer = offsetof(struct xdp_umem_ring, ptrs.consumer);
+		off.fr.desc	= offsetof(struct xdp_umem_ring, desc);
+		off.cr.producer = offsetof(struct xdp_umem_ring, ptrs.producer);
+		off.cr.consumer = offsetof(struct xdp_umem_ring, ptrs.consumer);
+		off.cr.desc	= offsetof(struct xdp_umem_ring, desc);
+
+		len = sizeof(off);
+		if (copy_to_user(optval, &off, len))
+			return -EFAULT;
+		if (put_user(len, optlen))
+			return -EFAULT;
+
+		return 0;
+	}
+	default:
+		break;
+	}
+
+	return -EOPNOTSUPP;
+}
+
+static int xsk_mmap(struct file *file, struct socket *sock,
+		    struct vm_area_struct *vma)
+{
+	loff_t offset = (loff_t)vma->vm_pgoff << PAGE_SHIFT;
+	unsigned long size = vma->vm_end - vma->vm_start;
+	struct xdp_sock *xs = xdp_sk(sock->sk);
+	struct xsk_queue *q = NULL;
+	struct xdp_umem *umem;
+	unsigned long pfn;
+	struct page *qpg;
+
+	if (offset == XDP_PGOFF_RX_RING) {
+		q = READ_ONCE(xs->rx);
+	} else if (offset == XDP_PGOFF_TX_RING) {
+		q = READ_ONCE(xs->tx);
+	} else {
+		umem = READ_ONCE(xs->umem);
+		if (!umem)
+			return -EINVAL;
+
+		/* Matches the smp_wmb() in XDP_UMEM_REG */
+		smp_rmb();
+		if (offset == XDP_UMEM_PGOFF_FILL_RING)
+			q = READ_ONCE(umem->fq);
+		else if (offset == XDP_UMEM_PGOFF_COMPLETION_RING)
+			q = READ_ONCE(umem->cq);
+	}
+
+	if (!q)
+		return -EINVAL;
+
+	/* Matches the smp_wmb() in xsk_init_queue */
+	smp_rmb();
+	qpg = virt_to_head_page(q->ring);
+	if (size > (PAGE_SIZE << compound_order(qpg)))
+		return -EINVAL;
+
+	pfn = virt_to_phys(q->ring) >> PAGE_SHIFT;
+	return remap_pfn_range(vma, vma->vm_start, pfn,
+			       size, vma->vm_page_prot);
+}
+
+static int xsk_notifier(struct notifier_block *this,
+			unsigned long msg, void *ptr)
+{
+	struct net_device *dev = netdev_notifier_info_to_dev(ptr);
+	struct xdp_sock *xs;
+
+	if (msg != NETDEV_UNREGISTER)
+		return NOTIFY_DONE;
+
+	mutex_lock(&xsk_list_mutex);
+	list_for_each_entry(xs, &xsk_list, list) {
+		struct sock *sk = &xs->sk;
+
+		mutex_lock(&xs->mutex);
+		if (xs->dev == dev) {
+			sk->sk_err = ENETDOWN;
+			if (!sock_flag(sk, SOCK_DEAD))
+				sk->sk_error_report(sk);
+			xsk_unbind_dev(xs);
+		}
+		mutex_unlock(&xs->mutex);
+	}
+	mutex_unlock(&xsk_list_mutex);
+	return NOTIFY_DONE;
+}
+
+static struct proto xsk_proto = {
+	.name =		"XDP",
+	.owner =	THIS_MODULE,
+	.obj_size =	sizeof(struct xdp_sock),
+};
+
+static const struct proto_ops xsk_proto_ops = {
+	.family		= PF_XDP,
+	.owner		= THIS_MODULE,
+	.release	= xsk_release,
+	.bind		= xsk_bind,
+	.connect	= sock_no_connect,
+	.socketpair	= sock_no_socketpair,
+	.accept		= sock_no_accept,
+	.getname	= sock_no_getname,
+	.poll		= xsk_poll,
+	.ioctl		= sock_no_ioctl,
+	.listen		= sock_no_listen,
+	.shutdown	= sock_no_shutdown,
+	.setsockopt	= xsk_setsockopt,
+	.getsockopt	= xsk_getsockopt,
+	.sendmsg	= xsk_sendmsg,
+	.recvmsg	= sock_no_recvmsg,
+	.mmap		= xsk_mmap,
+	.sendpage	= sock_no_sendpage,
+};
+
+static void xsk_destruct(struct sock *sk)
+{
+	struct xdp_sock *xs = xdp_sk(sk);
+
+	if (!sock_flag(sk, SOCK_DEAD))
+		return;
+
+	xskq_destroy(xs->rx);
+	xskq_destroy(xs->tx);
+	xdp_umem_destroy(xs->umem);
+
+	sk_refcnt_debug_dec(sk);
+}
+
+static int xsk_create(struct net *net, struct socket *sock, int protocol,
+		      int kern)
+{
+	struct sock *sk;
+	struct xdp_sock *xs;
+
+	if (!ns_capable(net->user_ns, CAP_NET_RAW))
+		return -EPERM;
+	if (sock->type != SOCK_RAW)
+		return -ESOCKTNOSUPPORT;
+
+	if (protocol)
+		return -EPROTONOSUPPORT;
+
+	sock->state = SS_UNCONNECTED;
+
+	sk = sk_alloc(net, PF_XDP, GFP_KERNEL, &xsk_proto, kern);
+	if (!sk)
+		return -ENOBUFS;
+
+	sock->ops = &xsk_proto_ops;
+
+	sock_init_data(sock, sk);
+
+	sk->sk_family = PF_XDP;
+
+	sk->sk_destruct = xsk_destruct;
+	sk_refcnt_debug_inc(sk);
+
+	xs = xdp_sk(sk);
+	mutex_init(&xs->mutex);
+	spin_lock_init(&xs->rx_lock);
+	spin_lock_init(&xs->tx_completion_lock);
+
+	mutex_lock(&xsk_list_mutex);
+	list_add(&xs->list, &xsk_list);
+	mutex_unlock(&xsk_list_mutex);
+
+	local_bh_disable();
+	sock_prot_inuse_add(net, &xsk_proto, 1);
+	local_bh_enable();
+
+	return 0;
+}
+
+static const struct net_proto_family xsk_family_ops = {
+	.family = PF_XDP,
+	.create = xsk_create,
+	.owner	= THIS_MODULE,
+};
+
+static struct notifier_block xsk_netdev_notifier = {
+	.notifier_call	= xsk_notifier,
+};
+
+static int __init xsk_init(void)
+{
+	int err;
+
+	err = proto_register(&xsk_proto, 0 /* no slab */);
+	if (err)
+		goto out;
+
+	err = sock_register(&xsk_family_ops);
+	if (err)
+		goto out_proto;
+
+	err = register_netdevice_notifier(&xsk_netdev_notifier);
+	if (err)
+		goto out_sk;
+
+	return 0;
+
+out_sk:
+	sock_unregister(PF_XDP);
+out_proto:
+	proto_unregister(&xsk_proto);
+out:
+	return err;
+}
+
+fs_initcall(xsk_init);
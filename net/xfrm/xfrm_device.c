@@ -0,0 +1,179 @@
+/*
+ * xfrm_device.c - IPsec device offloading code.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ */
+
+#include <linux/errno.h>
+#include <linux/module.h>
+#include <linux/netdevice.h>
+#include <linux/skbuff.h>
+#include <linux/slab.h>
+#include <linux/spinlock.h>
+#include <net/dst.h>
+#include <net/xfrm.h>
+#include <linux/notifier.h>
+
+/* Attach @x to @skb as the only transformation, with room for its result. */
+static struct xfrm_offload *xfrm_dev_attach(struct sk_buff *skb,
+					    struct xfrm_state *x)
+{
+	struct sec_path *sp;
+
+	sp = secpath_dup(NULL);
+	if (!sp)
+		return NULL;
+
+	secpath_put(skb->sp);
+	skb->sp = sp;
+
+	xfrm_state_hold(x);
+	sp->xvec[sp->len++] = x;
+
+	return &sp->ovec[sp->olen++];
+}
+
+static bool xfrm_dev_offload_ok(struct sk_buff *skb, struct xfrm_state *x)
+{
+	struct dst_entry *dst = skb_dst(skb);
+	struct net_device *dev = x->xso.dev;
+
+	if (!dev || (x->xso.flags & XFRM_OFFLOAD_INBOUND))
+		return false;
+
+	/*
+	 * The device has to see the packet right after this transformation,
+	 * so it must be the last one and the route must leave through it.
+	 */
+	if (dst->child->xfrm || dst->path->dev != dev)
+		return false;
+
+	if (!(dev->features & NETIF_F_HW_ESP))
+		return false;
+
+	if (dev->xfrmdev_ops->xdo_dev_offload_ok &&
+	    !dev->xfrmdev_ops->xdo_dev_offload_ok(skb, x))
+		return false;
+
+	return true;
+}
+
+/*
+ * Called before x->type->output().  If the packet leaves through the
+ * device the SA is offloaded to, mark it so that the type only frames
+ * the packet and the device encrypts it on transmit.
+ */
+int xfrm_dev_output(struct sk_buff *skb, struct xfrm_state *x)
+{
+	struct xfrm_offload *xo;
+
+	if (!xfrm_dev_offload_ok(skb, x))
+		return 0;
+
+	xo = xfrm_dev_attach(skb, x);
+	if (!xo)
+		return -ENOMEM;
+
+	xo->flags = CRYPTO_DEV_ENCRYPT;
+	xo->status = 0;
+	xo->seq.low = XFRM_SKB_CB(skb)->seq.output.low;
+	xo->seq.hi = XFRM_SKB_CB(skb)->seq.output.hi;
+
+	return 0;
+}
+
+/**
+ * xfrm_dev_input - pass on a packet the device has decrypted
+ * @skb: the packet, ESP header, trailer and ICV still in place
+ * @x: the SA the device used
+ * @status: CRYPTO_SUCCESS or the reason the device rejected it
+ *
+ * Called by drivers before handing @skb to the stack.  xfrm_input() then
+ * does the replay and lifetime checks and strips the ESP framing without
+ * going through the crypto layer again.
+ */
+int xfrm_dev_input(struct sk_buff *skb, struct xfrm_state *x, u32 status)
+{
+	struct xfrm_offload *xo;
+
+	xo = xfrm_dev_attach(skb, x);
+	if (!xo)
+		return -ENOMEM;
+
+	xo->flags = CRYPTO_DONE;
+	xo->status = status;
+
+	return 0;
+}
+EXPORT_SYMBOL_GPL(xfrm_dev_input);
+
+int xfrm_dev_state_add(struct net *net, struct xfrm_state *x,
+		       struct xfrm_user_offload *xuo)
+{
+	struct xfrm_state_offload *xso = &x->xso;
+	struct net_device *dev;
+	int err;
+
+	if (xuo->flags & ~(XFRM_OFFLOAD_IPV6 | XFRM_OFFLOAD_INBOUND))
+		return -EINVAL;
+
+	/* Only the IPv4 ESP datapath knows how to skip the crypto layer. */
+	if ((xuo->flags & XFRM_OFFLOAD_IPV6) || x->props.family != AF_INET)
+		return -EAFNOSUPPORT;
+
+	if (x->id.proto != IPPROTO_ESP || x->encap ||
+	    (x->props.mode != XFRM_MODE_TRANSPORT &&
+	     x->props.mode != XFRM_MODE_TUNNEL))
+		return -EINVAL;
+
+	dev = dev_get_by_index(net, xuo->ifindex);
+	if (!dev)
+		return -ENODEV;
+
+	/* Devices without the offload keep the SA in software. */
+	if (!dev->xfrmdev_ops || !dev->xfrmdev_ops->xdo_dev_state_add ||
+	    !(dev->features & NETIF_F_HW_ESP)) {
+		dev_put(dev);
+		return 0;
+	}
+
+	xso->dev = dev;
+	xso->flags = xuo->flags;
+
+	err = dev->xfrmdev_ops->xdo_dev_state_add(x);
+	if (err) {
+		xso->dev = NULL;
+		dev_put(dev);
+		return err;
+	}
+
+	return 0;
+}
+EXPORT_SYMBOL_GPL(xfrm_dev_state_add);
+
+static int xfrm_dev_event(struct notifier_block *this, unsigned long event,
+			  void *ptr)
+{
+	struct net_device *dev = netdev_notifier_info_to_dev(ptr);
+
+	switch (event) {
+	case NETDEV_DOWN:
+	case NETDEV_UNREGISTER:
+		/* The SAs are lost with the device state, and hold it. */
+		xfrm_dev_state_flush(dev_net(dev), dev, true);
+		break;
+	}
+	return NOTIFY_DONE;
+}
+
+static struct notifier_block xfrm_dev_notifier = {
+	.notifier_call	= xfrm_dev_event,
+};
+
+void __init xfrm_dev_init(void)
+{
+	register_netdevice_notifier(&xfrm_dev_notifier);
+}
@@ -111,6 +111,7 @@ struct sec_path *secpath_dup(struct sec_path *src)
 		return NULL;
 
 	sp->len = 0;
+	sp->olen = 0;
 	if (src) {
 		int i;
 
@@ -188,10 +189,12 @@ int xfrm_input(struct sk_buff *skb, int nexthdr, __be32 spi, int encap_type)
 	struct xfrm_state *x = NULL;
 	xfrm_address_t *daddr;
 	struct xfrm_mode *inner_mode;
+	struct xfrm_offload *xo;
 	u32 mark = skb->mark;
 	unsigned int family;
 	int decaps = 0;
 	int async = 0;
+	bool crypto_done = false;
 
 	/* A negative encap_type indicates async resumption. */
 	if (encap_type < 0) {
@@ -232,6 +235,11 @@ int xfrm_input(struct sk_buff *skb, int nexthdr, __be32 spi, int encap_type)
 		skb->sp = sp;
 	}
 
+	/* The device already did the outermost transformation. */
+	xo = xfrm_offload(skb);
+	if (xo && (xo->flags & CRYPTO_DONE))
+		crypto_done = true;
+
 	seq = 0;
 	if (!spi && (err = xfrm_parse_spi(skb, nexthdr, &spi, &seq)) != 0) {
 		XFRM_INC_STATS(net, LINUX_MIB_XFRMINHDRERROR);
@@ -244,14 +252,35 @@ int xfrm_input(struct sk_buff *skb, int nexthdr, __be32 spi, int encap_type)
 			goto drop;
 		}
 
-		x = xfrm_state_lookup(net, mark, daddr, spi, nexthdr, family);
-		if (x == NULL) {
-			XFRM_INC_STATS(net, LINUX_MIB_XFRMINNOSTATES);
-			xfrm_audit_state_notfound(skb, family, spi, seq);
-			goto drop;
-		}
+		if (crypto_done) {
+			x = xfrm_input_state(skb);
+			crypto_done = false;
+
+			if (x->id.spi != spi || x->id.proto != nexthdr) {
+				XFRM_INC_STATS(net, LINUX_MIB_XFRMINSTATEMISMATCH);
+				goto drop;
+			}
 
-		skb->sp->xvec[skb->sp->len++] = x;
+			if (unlikely(xo->status != CRYPTO_SUCCESS)) {
+				if (xo->status & CRYPTO_AUTH_FAILED) {
+					xfrm_audit_state_icvfail(x, skb,
+								 x->type->proto);
+					x->stats.integrity_failed++;
+				}
+				XFRM_INC_STATS(net, LINUX_MIB_XFRMINSTATEPROTOERROR);
+				goto drop;
+			}
+		} else {
+			x = xfrm_state_lookup(net, mark, daddr, spi, nexthdr,
+					      family);
+			if (x == NULL) {
+				XFRM_INC_STATS(net, LINUX_MIB_XFRMINNOSTATES);
+				xfrm_audit_state_notfound(skb, family, spi, seq);
+				goto drop;
+			}
+
+			skb->sp->xvec[skb->sp->len++] = x;
+		}
 
 		spin_lock(&x->lock);
 
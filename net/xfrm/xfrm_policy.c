@@ -3082,6 +3082,7 @@ static struct pernet_operations __net_initdata xfrm_net_ops = {
 void __init xfrm_init(void)
 {
 	register_pernet_subsys(&xfrm_net_ops);
+	xfrm_dev_init();
 	xfrm_input_init();
 }
 
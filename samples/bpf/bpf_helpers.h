@@ -39,6 +39,10 @@ static int (*bpf_redirect)(int ifindex, int flags) =
 	(void *) BPF_FUNC_redirect;
 static int (*bpf_perf_event_output)(void *ctx, void *map, int index, void *data, int size) =
 	(void *) BPF_FUNC_perf_event_output;
+static int (*bpf_xdp_load_bytes)(void *ctx, int off, void *to, int len) =
+	(void *) BPF_FUNC_xdp_load_bytes;
+static int (*bpf_xdp_store_bytes)(void *ctx, int off, void *from, int len) =
+	(void *) BPF_FUNC_xdp_store_bytes;
 
 /* llvm builtin functions that eBPF C program may use to
  * emit BPF_LD_ABS and BPF_LD_IND instructions
@@ -251,6 +251,25 @@ unsigned int aa_str_perms(struct aa_dfa *dfa, unsigned int start,
 	return state;
 }
 
+/*
+ * aa_str_perms for the name of a file being accessed: the same few names
+ * are checked over and over, so use the match cache.
+ */
+static void path_str_perms(struct aa_profile *profile, const char *name,
+			   struct path_cond *cond, struct file_perms *perms)
+{
+	struct aa_dfa *dfa = profile->file.dfa;
+	unsigned int state;
+
+	if (!dfa) {
+		*perms = nullperms;
+		return;
+	}
+
+	state = aa_dfa_match_cached(dfa, profile->file.start, name);
+	*perms = compute_perms(dfa, state, cond);
+}
+
 /**
  * is_deleted - test if a file has been completely unlinked
  * @dentry: dentry of file to test for deletion  (NOT NULL)
@@ -295,8 +314,7 @@ int aa_path_perm(int op, struct aa_profile *profile, struct path *path,
 			perms.allow = request;
 		}
 	} else {
-		aa_str_perms(profile->file.dfa, profile->file.start, name, cond,
-			     &perms);
+		path_str_perms(profile, name, cond, &perms);
 		if (request & ~perms.allow)
 			error = -EACCES;
 	}
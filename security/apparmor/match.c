@@ -19,12 +19,40 @@
 #include <linux/vmalloc.h>
 #include <linux/err.h>
 #include <linux/kref.h>
+#include <linux/jhash.h>
+#include <linux/percpu.h>
+#include <linux/string.h>
 
 #include "include/apparmor.h"
 #include "include/match.h"
 
 #define base_idx(X) ((X) & 0xffffff)
 
+/*
+ * Per cpu cache of recently matched strings.  The state a string ends in
+ * only depends on the dfa and the start state, so a result stays good for
+ * as long as its dfa lives.  A dfa address can be reused once it is freed,
+ * so freeing any dfa moves the generation on and drops every entry.
+ */
+#define MATCH_CACHE_SIZE	16	/* power of 2 */
+#define MATCH_CACHE_STRLEN	128
+
+struct match_cache_entry {
+	struct aa_dfa *dfa;
+	unsigned int gen;
+	unsigned int start;
+	unsigned int state;
+	unsigned int len;
+	char str[MATCH_CACHE_STRLEN];
+};
+
+struct match_cache {
+	struct match_cache_entry entry[MATCH_CACHE_SIZE];
+};
+
+static DEFINE_PER_CPU(struct match_cache, match_cache);
+static atomic_t match_cache_gen = ATOMIC_INIT(1);
+
 /**
  * unpack_table - unpack a dfa table (one of accept, default, base, next check)
  * @blob: data to unpack (NOT NULL)
@@ -186,6 +214,9 @@ void aa_dfa_free_kref(struct kref *kref)
 {
 	struct aa_dfa *dfa = container_of(kref, struct aa_dfa, count);
 	dfa_free(dfa);
+	/* after the free, see match_cache */
+	smp_mb__before_atomic();
+	atomic_inc(&match_cache_gen);
 }
 
 /**
@@ -385,6 +416,54 @@ unsigned int aa_dfa_match(struct aa_dfa *dfa, unsigned int start,
 	return state;
 }
 
+/**
+ * aa_dfa_match_cached - traverse @dfa to find state @str stops at
+ * @dfa: the dfa to match @str against  (NOT NULL)
+ * @start: the state of the dfa to start matching in
+ * @str: the null terminated string of bytes to match against the dfa (NOT NULL)
+ *
+ * Same as aa_dfa_match, but looks up the result of a recent match of the
+ * same string from the same state first.  Strings are hashed and compared
+ * instead of walked, which is much cheaper per byte than the dfa tables.
+ *
+ * Returns: final state reached after input is consumed
+ */
+unsigned int aa_dfa_match_cached(struct aa_dfa *dfa, unsigned int start,
+				 const char *str)
+{
+	struct match_cache_entry *e;
+	unsigned int gen, state, hash;
+	size_t len = strlen(str);
+
+	if (start == 0 || len >= MATCH_CACHE_STRLEN)
+		return aa_dfa_match(dfa, start, str);
+
+	gen = atomic_read(&match_cache_gen);
+	hash = jhash(str, len, start) & (MATCH_CACHE_SIZE - 1);
+
+	e = &get_cpu_var(match_cache).entry[hash];
+	if (e->dfa == dfa && e->gen == gen && e->start == start &&
+	    e->len == len && memcmp(e->str, str, len) == 0) {
+		state = e->state;
+		put_cpu_var(match_cache);
+		return state;
+	}
+	put_cpu_var(match_cache);
+
+	state = aa_dfa_match(dfa, start, str);
+
+	e = &get_cpu_var(match_cache).entry[hash];
+	e->dfa = dfa;
+	e->gen = gen;
+	e->start = start;
+	e->state = state;
+	e->len = len;
+	memcpy(e->str, str, len);
+	put_cpu_var(match_cache);
+
+	return state;
+}
+
 /**
  * aa_dfa_next - step one character to the next state in the dfa
  * @dfa: the dfa to tranverse (NOT NULL)
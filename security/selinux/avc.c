@@ -22,7 +22,11 @@
 #include <linux/init.h>
 #include <linux/skbuff.h>
 #include <linux/percpu.h>
+#include <linux/percpu_counter.h>
 #include <linux/list.h>
+#include <linux/log2.h>
+#include <linux/mutex.h>
+#include <linux/vmalloc.h>
 #include <net/sock.h>
 #include <linux/un.h>
 #include <net/af_unix.h>
@@ -34,9 +38,11 @@
 #include "avc_ss.h"
 #include "classmap.h"
 
-#define AVC_CACHE_SLOTS			512
+#define AVC_CACHE_MIN_SLOTS		512
+#define AVC_CACHE_MAX_SLOTS		65536
 #define AVC_DEF_CACHE_THRESHOLD		512
 #define AVC_CACHE_RECLAIM		16
+#define AVC_PCPU_ENTRIES		8	/* power of two */
 
 #ifdef CONFIG_SECURITY_SELINUX_AVC_STATS
 #define avc_cache_stats_incr(field)	this_cpu_inc(avc_cache_stats.field)
@@ -54,7 +60,7 @@ struct avc_entry {
 
 struct avc_node {
 	struct avc_entry	ae;
-	struct hlist_node	list; /* anchored in avc_cache->slots[i] */
+	struct hlist_node	list; /* anchored in avc_table->slots[i] */
 	struct rcu_head		rhead;
 };
 
@@ -68,14 +74,42 @@ struct avc_xperms_node {
 	struct list_head xpd_head; /* list head of extended_perms_decision */
 };
 
+struct avc_slot {
+	struct hlist_head	head;	/* head for avc_node->list */
+	spinlock_t		lock;	/* lock for writes */
+};
+
+struct avc_table {
+	unsigned int		size;	/* power of two */
+	struct avc_slot		slots[];
+};
+
 struct avc_cache {
-	struct hlist_head	slots[AVC_CACHE_SLOTS]; /* head for avc_node->list */
-	spinlock_t		slots_lock[AVC_CACHE_SLOTS]; /* lock for writes */
+	struct avc_table __rcu	*table;
 	atomic_t		lru_hint;	/* LRU hint for reclaim scan */
-	atomic_t		active_nodes;
+	struct percpu_counter	active_nodes;
+	atomic_t		generation;	/* see avc_generation_bump() */
 	u32			latest_notif;	/* latest revocation notification */
 };
 
+/*
+ * Per-CPU copies of recently used decisions, checked before the hash table.
+ * An entry is only valid while its generation matches avc_cache.generation,
+ * which moves whenever a cached decision is changed or dropped by a flush.
+ * Reclaim leaves the decisions themselves intact and does not move it.
+ */
+struct avc_pcpu_entry {
+	u32			ssid;
+	u32			tsid;
+	u16			tclass;
+	u32			generation;
+	struct av_decision	avd;
+};
+
+struct avc_pcpu_cache {
+	struct avc_pcpu_entry	entries[AVC_PCPU_ENTRIES];
+};
+
 struct avc_callback_node {
 	int (*callback) (u32 event);
 	u32 events;
@@ -90,15 +124,121 @@ DEFINE_PER_CPU(struct avc_cache_stats, avc_cache_stats) = { 0 };
 #endif
 
 static struct avc_cache avc_cache;
+static DEFINE_PER_CPU(struct avc_pcpu_cache, avc_pcpu_cache);
+static DEFINE_MUTEX(avc_resize_mutex);
 static struct avc_callback_node *avc_callbacks;
 static struct kmem_cache *avc_node_cachep;
 static struct kmem_cache *avc_xperms_data_cachep;
 static struct kmem_cache *avc_xperms_decision_cachep;
 static struct kmem_cache *avc_xperms_cachep;
 
-static inline int avc_hash(u32 ssid, u32 tsid, u16 tclass)
+static inline u32 avc_hash(u32 ssid, u32 tsid, u16 tclass)
+{
+	return ssid ^ (tsid<<2) ^ (tclass<<4);
+}
+
+static inline struct avc_slot *avc_slot(struct avc_table *table,
+					u32 ssid, u32 tsid, u16 tclass)
+{
+	return &table->slots[avc_hash(ssid, tsid, tclass) & (table->size - 1)];
+}
+
+static struct avc_table *avc_table_alloc(unsigned int size)
+{
+	struct avc_table *table;
+	size_t bytes = sizeof(*table) + size * sizeof(table->slots[0]);
+	unsigned int i;
+
+	table = kzalloc(bytes, GFP_KERNEL | __GFP_NOWARN);
+	if (!table)
+		table = vzalloc(bytes);
+	if (!table)
+		return NULL;
+
+	table->size = size;
+	for (i = 0; i < size; i++) {
+		INIT_HLIST_HEAD(&table->slots[i].head);
+		spin_lock_init(&table->slots[i].lock);
+	}
+	return table;
+}
+
+/* Number of slots for @threshold entries: about one node per chain. */
+static unsigned int avc_table_size(unsigned int threshold)
 {
-	return (ssid ^ (tsid<<2) ^ (tclass<<4)) & (AVC_CACHE_SLOTS - 1);
+	if (threshold <= AVC_CACHE_MIN_SLOTS)
+		return AVC_CACHE_MIN_SLOTS;
+	if (threshold >= AVC_CACHE_MAX_SLOTS)
+		return AVC_CACHE_MAX_SLOTS;
+	return roundup_pow_of_two(threshold);
+}
+
+static inline u32 avc_generation(void)
+{
+	u32 gen = atomic_read(&avc_cache.generation);
+
+	/* Pairs with avc_generation_bump(), see there. */
+	smp_rmb();
+	return gen;
+}
+
+/*
+ * Called after a cached decision was replaced or deleted: a lookup that
+ * sees the new generation is ordered after the change, and so cannot put
+ * the old decision back into a per-CPU cache under it.
+ */
+static inline void avc_generation_bump(void)
+{
+	smp_mb__before_atomic();
+	atomic_inc(&avc_cache.generation);
+}
+
+static inline struct avc_pcpu_entry *avc_pcpu_entry(u32 ssid, u32 tsid,
+						    u16 tclass)
+{
+	struct avc_pcpu_cache *pc = this_cpu_ptr(&avc_pcpu_cache);
+
+	return &pc->entries[avc_hash(ssid, tsid, tclass) &
+			    (AVC_PCPU_ENTRIES - 1)];
+}
+
+/*
+ * Permission checks also come from softirq context, so the entries are
+ * only touched with interrupts off.
+ */
+static inline bool avc_pcpu_lookup(u32 ssid, u32 tsid, u16 tclass, u32 gen,
+				   struct av_decision *avd)
+{
+	struct avc_pcpu_entry *e;
+	unsigned long flags;
+	bool hit = false;
+
+	local_irq_save(flags);
+	e = avc_pcpu_entry(ssid, tsid, tclass);
+	if (e->generation == gen && e->ssid == ssid &&
+	    e->tsid == tsid && e->tclass == tclass) {
+		memcpy(avd, &e->avd, sizeof(*avd));
+		hit = true;
+	}
+	local_irq_restore(flags);
+
+	return hit;
+}
+
+static inline void avc_pcpu_store(u32 ssid, u32 tsid, u16 tclass, u32 gen,
+				  struct av_decision *avd)
+{
+	struct avc_pcpu_entry *e;
+	unsigned long flags;
+
+	local_irq_save(flags);
+	e = avc_pcpu_entry(ssid, tsid, tclass);
+	e->ssid = ssid;
+	e->tsid = tsid;
+	e->tclass = tclass;
+	e->generation = gen;
+	memcpy(&e->avd, avd, sizeof(e->avd));
+	local_irq_restore(flags);
 }
 
 /**
@@ -176,14 +316,16 @@ static void avc_dump_query(struct audit_buffer *ab, u32 ssid, u32 tsid, u16 tcla
  */
 void __init avc_init(void)
 {
-	int i;
+	struct avc_table *table;
 
-	for (i = 0; i < AVC_CACHE_SLOTS; i++) {
-		INIT_HLIST_HEAD(&avc_cache.slots[i]);
-		spin_lock_init(&avc_cache.slots_lock[i]);
-	}
-	atomic_set(&avc_cache.active_nodes, 0);
+	table = avc_table_alloc(avc_table_size(avc_cache_threshold));
+	if (!table || percpu_counter_init(&avc_cache.active_nodes, 0,
+					  GFP_KERNEL))
+		panic("SELinux: unable to allocate the AVC\n");
+	RCU_INIT_POINTER(avc_cache.table, table);
 	atomic_set(&avc_cache.lru_hint, 0);
+	/* Zeroed per-CPU entries must not match. */
+	atomic_set(&avc_cache.generation, 1);
 
 	avc_node_cachep = kmem_cache_create("avc_node", sizeof(struct avc_node),
 					0, SLAB_PANIC, NULL);
@@ -203,16 +345,19 @@ void __init avc_init(void)
 
 int avc_get_hash_stats(char *page)
 {
-	int i, chain_len, max_chain_len, slots_used;
+	int i, chain_len, max_chain_len, slots_used, size;
+	struct avc_table *table;
 	struct avc_node *node;
 	struct hlist_head *head;
 
 	rcu_read_lock();
 
+	table = rcu_dereference(avc_cache.table);
+	size = table->size;
 	slots_used = 0;
 	max_chain_len = 0;
-	for (i = 0; i < AVC_CACHE_SLOTS; i++) {
-		head = &avc_cache.slots[i];
+	for (i = 0; i < size; i++) {
+		head = &table->slots[i].head;
 		if (!hlist_empty(head)) {
 			slots_used++;
 			chain_len = 0;
@@ -227,8 +372,9 @@ int avc_get_hash_stats(char *page)
 
 	return scnprintf(page, PAGE_SIZE, "entries: %d\nbuckets used: %d/%d\n"
 			 "longest chain: %d\n",
-			 atomic_read(&avc_cache.active_nodes),
-			 slots_used, AVC_CACHE_SLOTS, max_chain_len);
+			 (int)percpu_counter_sum_positive(
+				 &avc_cache.active_nodes),
+			 slots_used, size, max_chain_len);
 }
 
 /*
@@ -494,7 +640,7 @@ static void avc_node_delete(struct avc_node *node)
 {
 	hlist_del_rcu(&node->list);
 	call_rcu(&node->rhead, avc_node_free);
-	atomic_dec(&avc_cache.active_nodes);
+	percpu_counter_dec(&avc_cache.active_nodes);
 }
 
 static void avc_node_kill(struct avc_node *node)
@@ -502,47 +648,49 @@ static void avc_node_kill(struct avc_node *node)
 	avc_xperms_free(node->ae.xp_node);
 	kmem_cache_free(avc_node_cachep, node);
 	avc_cache_stats_incr(frees);
-	atomic_dec(&avc_cache.active_nodes);
+	percpu_counter_dec(&avc_cache.active_nodes);
 }
 
 static void avc_node_replace(struct avc_node *new, struct avc_node *old)
 {
 	hlist_replace_rcu(&old->list, &new->list);
 	call_rcu(&old->rhead, avc_node_free);
-	atomic_dec(&avc_cache.active_nodes);
+	percpu_counter_dec(&avc_cache.active_nodes);
 }
 
 static inline int avc_reclaim_node(void)
 {
+	struct avc_table *table;
 	struct avc_node *node;
 	int hvalue, try, ecx;
 	unsigned long flags;
 	struct hlist_head *head;
 	spinlock_t *lock;
 
-	for (try = 0, ecx = 0; try < AVC_CACHE_SLOTS; try++) {
-		hvalue = atomic_inc_return(&avc_cache.lru_hint) & (AVC_CACHE_SLOTS - 1);
-		head = &avc_cache.slots[hvalue];
-		lock = &avc_cache.slots_lock[hvalue];
+	rcu_read_lock();
+	table = rcu_dereference(avc_cache.table);
+	for (try = 0, ecx = 0; try < table->size; try++) {
+		hvalue = atomic_inc_return(&avc_cache.lru_hint) &
+			 (table->size - 1);
+		head = &table->slots[hvalue].head;
+		lock = &table->slots[hvalue].lock;
 
 		if (!spin_trylock_irqsave(lock, flags))
 			continue;
 
-		rcu_read_lock();
 		hlist_for_each_entry(node, head, list) {
 			avc_node_delete(node);
 			avc_cache_stats_incr(reclaims);
 			ecx++;
 			if (ecx >= AVC_CACHE_RECLAIM) {
-				rcu_read_unlock();
 				spin_unlock_irqrestore(lock, flags);
 				goto out;
 			}
 		}
-		rcu_read_unlock();
 		spin_unlock_irqrestore(lock, flags);
 	}
 out:
+	rcu_read_unlock();
 	return ecx;
 }
 
@@ -557,7 +705,13 @@ static struct avc_node *avc_alloc_node(void)
 	INIT_HLIST_NODE(&node->list);
 	avc_cache_stats_incr(allocations);
 
-	if (atomic_inc_return(&avc_cache.active_nodes) > avc_cache_threshold)
+	/*
+	 * The approximate count is good enough here, the threshold is a
+	 * soft limit anyway.
+	 */
+	percpu_counter_inc(&avc_cache.active_nodes);
+	if (percpu_counter_read_positive(&avc_cache.active_nodes) >
+	    avc_cache_threshold)
 		avc_reclaim_node();
 
 out:
@@ -575,12 +729,10 @@ static void avc_node_populate(struct avc_node *node, u32 ssid, u32 tsid, u16 tcl
 static inline struct avc_node *avc_search_node(u32 ssid, u32 tsid, u16 tclass)
 {
 	struct avc_node *node, *ret = NULL;
-	int hvalue;
-	struct hlist_head *head;
+	struct avc_slot *slot;
 
-	hvalue = avc_hash(ssid, tsid, tclass);
-	head = &avc_cache.slots[hvalue];
-	hlist_for_each_entry_rcu(node, head, list) {
+	slot = avc_slot(rcu_dereference(avc_cache.table), ssid, tsid, tclass);
+	hlist_for_each_entry_rcu(node, &slot->head, list) {
 		if (ssid == node->ae.ssid &&
 		    tclass == node->ae.tclass &&
 		    tsid == node->ae.tsid) {
@@ -663,7 +815,6 @@ static struct avc_node *avc_insert(u32 ssid, u32 tsid, u16 tclass,
 				struct avc_xperms_node *xp_node)
 {
 	struct avc_node *pos, *node = NULL;
-	int hvalue;
 	unsigned long flag;
 
 	if (avc_latest_notif_update(avd->seqno, 1))
@@ -671,19 +822,21 @@ static struct avc_node *avc_insert(u32 ssid, u32 tsid, u16 tclass,
 
 	node = avc_alloc_node();
 	if (node) {
+		struct avc_slot *slot;
 		struct hlist_head *head;
 		spinlock_t *lock;
 		int rc = 0;
 
-		hvalue = avc_hash(ssid, tsid, tclass);
 		avc_node_populate(node, ssid, tsid, tclass, avd);
 		rc = avc_xperms_populate(node, xp_node);
 		if (rc) {
 			kmem_cache_free(avc_node_cachep, node);
 			return NULL;
 		}
-		head = &avc_cache.slots[hvalue];
-		lock = &avc_cache.slots_lock[hvalue];
+		slot = avc_slot(rcu_dereference(avc_cache.table),
+				ssid, tsid, tclass);
+		head = &slot->head;
+		lock = &slot->lock;
 
 		spin_lock_irqsave(lock, flag);
 		hlist_for_each_entry(pos, head, list) {
@@ -691,11 +844,12 @@ static struct avc_node *avc_insert(u32 ssid, u32 tsid, u16 tclass,
 			    pos->ae.tsid == tsid &&
 			    pos->ae.tclass == tclass) {
 				avc_node_replace(node, pos);
-				goto found;
+				spin_unlock_irqrestore(lock, flag);
+				avc_generation_bump();
+				goto out;
 			}
 		}
 		hlist_add_head_rcu(&node->list, head);
-found:
 		spin_unlock_irqrestore(lock, flag);
 	}
 out:
@@ -822,9 +976,10 @@ static int avc_update_node(u32 event, u32 perms, u8 driver, u8 xperm, u32 ssid,
 			struct extended_perms_decision *xpd,
 			u32 flags)
 {
-	int hvalue, rc = 0;
+	int rc = 0;
 	unsigned long flag;
 	struct avc_node *pos, *node, *orig = NULL;
+	struct avc_slot *slot;
 	struct hlist_head *head;
 	spinlock_t *lock;
 
@@ -835,10 +990,10 @@ static int avc_update_node(u32 event, u32 perms, u8 driver, u8 xperm, u32 ssid,
 	}
 
 	/* Lock the target slot */
-	hvalue = avc_hash(ssid, tsid, tclass);
+	slot = avc_slot(rcu_dereference(avc_cache.table), ssid, tsid, tclass);
 
-	head = &avc_cache.slots[hvalue];
-	lock = &avc_cache.slots_lock[hvalue];
+	head = &slot->head;
+	lock = &slot->lock;
 
 	spin_lock_irqsave(lock, flag);
 
@@ -899,6 +1054,9 @@ static int avc_update_node(u32 event, u32 perms, u8 driver, u8 xperm, u32 ssid,
 		break;
 	}
 	avc_node_replace(node, orig);
+	spin_unlock_irqrestore(lock, flag);
+	avc_generation_bump();
+	return 0;
 out_unlock:
 	spin_unlock_irqrestore(lock, flag);
 out:
@@ -910,27 +1068,82 @@ out:
  */
 static void avc_flush(void)
 {
+	struct avc_table *table;
 	struct hlist_head *head;
 	struct avc_node *node;
 	spinlock_t *lock;
 	unsigned long flag;
 	int i;
 
-	for (i = 0; i < AVC_CACHE_SLOTS; i++) {
-		head = &avc_cache.slots[i];
-		lock = &avc_cache.slots_lock[i];
+	/*
+	 * With preemptable RCU, the slot spinlocks do not prevent RCU
+	 * grace periods from ending.
+	 */
+	rcu_read_lock();
+	table = rcu_dereference(avc_cache.table);
+	for (i = 0; i < table->size; i++) {
+		head = &table->slots[i].head;
+		lock = &table->slots[i].lock;
 
 		spin_lock_irqsave(lock, flag);
-		/*
-		 * With preemptable RCU, the outer spinlock does not
-		 * prevent RCU grace periods from ending.
-		 */
-		rcu_read_lock();
 		hlist_for_each_entry(node, head, list)
 			avc_node_delete(node);
-		rcu_read_unlock();
 		spin_unlock_irqrestore(lock, flag);
 	}
+	rcu_read_unlock();
+
+	avc_generation_bump();
+}
+
+/**
+ * avc_set_cache_threshold - Set the number of entries kept in the cache
+ * @threshold: entries above which the cache starts reclaiming
+ *
+ * Resize the hash table to match @threshold, so that chains stay short.
+ * The entries cached so far are dropped when the table changes.  Return
+ * %0 on success or -%ENOMEM.
+ */
+int avc_set_cache_threshold(unsigned int threshold)
+{
+	struct avc_table *table, *old;
+	struct avc_node *node;
+	struct hlist_node *tmp;
+	unsigned int size, i;
+
+	size = avc_table_size(threshold);
+
+	mutex_lock(&avc_resize_mutex);
+	old = rcu_dereference_protected(avc_cache.table,
+					lockdep_is_held(&avc_resize_mutex));
+	if (old->size == size) {
+		avc_cache_threshold = threshold;
+		mutex_unlock(&avc_resize_mutex);
+		return 0;
+	}
+
+	table = avc_table_alloc(size);
+	if (!table) {
+		mutex_unlock(&avc_resize_mutex);
+		return -ENOMEM;
+	}
+
+	avc_cache_threshold = threshold;
+	rcu_assign_pointer(avc_cache.table, table);
+	mutex_unlock(&avc_resize_mutex);
+
+	/*
+	 * Inserts into the old table can only be in flight until here,
+	 * after that nobody can see its nodes anymore.
+	 */
+	synchronize_rcu();
+
+	for (i = 0; i < old->size; i++)
+		hlist_for_each_entry_safe(node, tmp, &old->slots[i].head, list)
+			avc_node_kill(node);
+	kvfree(old);
+
+	avc_generation_bump();
+	return 0;
 }
 
 /**
@@ -1103,18 +1316,27 @@ inline int avc_has_perm_noaudit(u32 ssid, u32 tsid,
 	struct avc_node *node;
 	struct avc_xperms_node xp_node;
 	int rc = 0;
-	u32 denied;
+	u32 denied, gen;
 
 	BUG_ON(!requested);
 
 	rcu_read_lock();
 
+	gen = avc_generation();
+	if (avc_pcpu_lookup(ssid, tsid, tclass, gen, avd)) {
+		avc_cache_stats_incr(lookups);
+		goto decision;
+	}
+
 	node = avc_lookup(ssid, tsid, tclass);
 	if (unlikely(!node))
 		node = avc_compute_av(ssid, tsid, tclass, avd, &xp_node);
 	else
 		memcpy(avd, &node->ae.avd, sizeof(*avd));
+	if (node)
+		avc_pcpu_store(ssid, tsid, tclass, gen, avd);
 
+decision:
 	denied = requested & ~(avd->allowed);
 	if (unlikely(denied))
 		rc = avc_denied(ssid, tsid, tclass, requested, 0, 0, flags, avd);
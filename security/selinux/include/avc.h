@@ -177,6 +177,7 @@ int avc_add_callback(int (*callback)(u32 event), u32 events);
 
 /* Exported to selinuxfs */
 int avc_get_hash_stats(char *page);
+int avc_set_cache_threshold(unsigned int threshold);
 extern unsigned int avc_cache_threshold;
 
 /* Attempt to free avc node cache */
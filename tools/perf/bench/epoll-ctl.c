@@ -0,0 +1,354 @@
+/*
+ * epoll-ctl: Measure epoll_ctl(2) scalability.
+ *
+ * A number of worker threads each own a set of eventfds and keep adding,
+ * modifying and removing them in an epoll instance, either one shared by
+ * all workers or one per worker (multiq), in random order.  Optionally a
+ * number of waiter threads sit in epoll_wait(2) on the same instance(s), and
+ * a fraction of the eventfds is kept signalled, so that the ready list and
+ * the wakeup path contend with the control operations on ep->mtx and
+ * ep->lock.
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/stat.h"
+#include "../util/parse-options.h"
+#include "../util/header.h"
+#include "bench.h"
+
+#include <err.h>
+#include <stdlib.h>
+#include <sys/time.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <pthread.h>
+
+enum {
+	OP_EPOLL_ADD,
+	OP_EPOLL_MOD,
+	OP_EPOLL_DEL,
+	EPOLL_NR_OPS,
+};
+
+static const char * const op_names[EPOLL_NR_OPS] = {
+	[OP_EPOLL_ADD] = "ADD",
+	[OP_EPOLL_MOD] = "MOD",
+	[OP_EPOLL_DEL] = "DEL",
+};
+
+static unsigned int nthreads = 0;
+static unsigned int nwaiters = 0;
+static unsigned int nsecs    = 8;
+/* amount of eventfds per thread */
+static unsigned int nfds     = 64;
+static bool done, silent, multiq, noaffinity;
+static bool signalled;
+
+static int epollfd;
+static struct timeval start, end, runtime;
+static pthread_mutex_t thread_lock;
+static unsigned int threads_starting;
+static struct stats all_stats[EPOLL_NR_OPS];
+static pthread_cond_t thread_parent, thread_worker;
+
+struct worker {
+	int tid;
+	int epollfd;	/* shared unless multiq */
+	pthread_t thread;
+	unsigned long ops[EPOLL_NR_OPS];
+	int *fds;
+	bool *added;
+};
+
+static const struct option options[] = {
+	OPT_UINTEGER('t', "threads",    &nthreads,   "Specify amount of threads"),
+	OPT_UINTEGER('w', "waiters",    &nwaiters,   "Specify amount of threads blocked in epoll_wait"),
+	OPT_UINTEGER('r', "runtime",    &nsecs,      "Specify runtime (in seconds)"),
+	OPT_UINTEGER('f', "nfds",       &nfds,       "Specify amount of file descriptors per thread"),
+	OPT_BOOLEAN( 'm', "multiq",     &multiq,     "Use an epoll instance per thread"),
+	OPT_BOOLEAN( 'S', "signalled",  &signalled,  "Keep half of the fds signalled, so they are on the ready list"),
+	OPT_BOOLEAN( 'N', "noaffinity", &noaffinity, "Do not bind threads to CPUs"),
+	OPT_BOOLEAN( 's', "silent",     &silent,     "Silent mode: do not display data/details"),
+	OPT_END()
+};
+
+static const char * const bench_epoll_ctl_usage[] = {
+	"perf bench epoll ctl <options>",
+	NULL
+};
+
+/*
+ * Pick the next operation for an fd: a removed fd can only be added back,
+ * a registered one is modified or removed.
+ */
+static int next_op(struct worker *w, unsigned int i, unsigned int *seed)
+{
+	if (!w->added[i])
+		return OP_EPOLL_ADD;
+	return rand_r(seed) & 1 ? OP_EPOLL_MOD : OP_EPOLL_DEL;
+}
+
+static void do_epoll_op(struct worker *w, int op, unsigned int i)
+{
+	struct epoll_event ev = {
+		.events = EPOLLIN,
+		.data.u32 = i,
+	};
+	int fd = w->fds[i];
+
+	switch (op) {
+	case OP_EPOLL_ADD:
+		if (epoll_ctl(w->epollfd, EPOLL_CTL_ADD, fd, &ev))
+			err(EXIT_FAILURE, "epoll_ctl add");
+		w->added[i] = true;
+		break;
+	case OP_EPOLL_MOD:
+		/* flip between level and edge triggered */
+		ev.events |= (w->ops[OP_EPOLL_MOD] & 1) ? EPOLLET : 0;
+		if (epoll_ctl(w->epollfd, EPOLL_CTL_MOD, fd, &ev))
+			err(EXIT_FAILURE, "epoll_ctl mod");
+		break;
+	case OP_EPOLL_DEL:
+		if (epoll_ctl(w->epollfd, EPOLL_CTL_DEL, fd, NULL))
+			err(EXIT_FAILURE, "epoll_ctl del");
+		w->added[i] = false;
+		break;
+	}
+	w->ops[op]++;
+}
+
+static void *workerfn(void *arg)
+{
+	struct worker *w = (struct worker *) arg;
+	unsigned int seed = w->tid;
+	unsigned int i, j;
+
+	pthread_mutex_lock(&thread_lock);
+	threads_starting--;
+	if (!threads_starting)
+		pthread_cond_signal(&thread_parent);
+	pthread_cond_wait(&thread_worker, &thread_lock);
+	pthread_mutex_unlock(&thread_lock);
+
+	do {
+		for (i = 0; i < nfds && !done; i++) {
+			j = rand_r(&seed) % nfds;
+			do_epoll_op(w, next_op(w, j, &seed), j);
+		}
+	} while (!done);
+
+	return NULL;
+}
+
+/* Waiters only keep epoll_wait(2) busy, the events are not consumed */
+static void *waiterfn(void *arg)
+{
+	int efd = (int)(long) arg;
+	struct epoll_event ev[16];
+
+	while (!done) {
+		if (epoll_wait(efd, ev, ARRAY_SIZE(ev), 1) < 0 &&
+		    errno != EINTR)
+			err(EXIT_FAILURE, "epoll_wait");
+	}
+
+	return NULL;
+}
+
+static void setup_worker_fds(struct worker *w)
+{
+	unsigned int i;
+	u64 val = 1;
+
+	w->epollfd = epollfd;
+	if (multiq) {
+		w->epollfd = epoll_create1(0);
+		if (w->epollfd < 0)
+			err(EXIT_FAILURE, "epoll_create1");
+	}
+
+	w->fds = calloc(nfds, sizeof(*w->fds));
+	w->added = calloc(nfds, sizeof(*w->added));
+	if (!w->fds || !w->added)
+		err(EXIT_FAILURE, "calloc");
+
+	for (i = 0; i < nfds; i++) {
+		w->fds[i] = eventfd(0, EFD_NONBLOCK);
+		if (w->fds[i] < 0)
+			err(EXIT_FAILURE, "eventfd");
+		if (signalled && (i & 1) &&
+		    write(w->fds[i], &val, sizeof(val)) < 0)
+			err(EXIT_FAILURE, "write");
+		/* start out with half of the fds registered */
+		if (i & 1)
+			do_epoll_op(w, OP_EPOLL_ADD, i);
+	}
+	memset(w->ops, 0, sizeof(w->ops));
+}
+
+static void toggle_done(int sig __maybe_unused,
+			siginfo_t *info __maybe_unused,
+			void *uc __maybe_unused)
+{
+	/* inform all threads that we're done for the day */
+	done = true;
+	gettimeofday(&end, NULL);
+	timersub(&end, &start, &runtime);
+}
+
+static void print_summary(void)
+{
+	int i;
+
+	printf("\n");
+	for (i = 0; i < EPOLL_NR_OPS; i++) {
+		unsigned long avg = avg_stats(&all_stats[i]);
+		double stddev = stddev_stats(&all_stats[i]);
+
+		printf("Averaged %ld %s operations/sec (+- %.2f%%), total secs = %d\n",
+		       avg, op_names[i], rel_stddev_stats(stddev, avg),
+		       (int) runtime.tv_sec);
+	}
+}
+
+int bench_epoll_ctl(int argc, const char **argv,
+		    const char *prefix __maybe_unused)
+{
+	int ret = 0;
+	cpu_set_t cpu;
+	struct sigaction act;
+	unsigned int i, j, ncpus;
+	pthread_attr_t thread_attr;
+	pthread_t *waiter = NULL;
+	struct worker *worker = NULL;
+
+	argc = parse_options(argc, argv, options, bench_epoll_ctl_usage, 0);
+	if (argc || !nfds) {
+		usage_with_options(bench_epoll_ctl_usage, options);
+		exit(EXIT_FAILURE);
+	}
+
+	ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+	sigfillset(&act.sa_mask);
+	act.sa_sigaction = toggle_done;
+	sigaction(SIGINT, &act, NULL);
+
+	if (!nthreads) /* default to the number of CPUs */
+		nthreads = ncpus;
+
+	worker = calloc(nthreads, sizeof(*worker));
+	waiter = calloc(nwaiters * (multiq ? nthreads : 1) + 1,
+			sizeof(*waiter));
+	if (!worker || !waiter)
+		err(EXIT_FAILURE, "calloc");
+
+	if (!multiq) {
+		epollfd = epoll_create1(0);
+		if (epollfd < 0)
+			err(EXIT_FAILURE, "epoll_create1");
+	}
+
+	printf("Run summary [PID %d]: %d threads doing epoll_ctl ops on %d fds each, %d waiters%s, on %s for %d secs.\n\n",
+	       getpid(), nthreads, nfds, nwaiters,
+	       multiq ? " per thread" : "",
+	       multiq ? "one epoll instance each" : "a single epoll instance",
+	       nsecs);
+
+	for (i = 0; i < EPOLL_NR_OPS; i++)
+		init_stats(&all_stats[i]);
+	pthread_mutex_init(&thread_lock, NULL);
+	pthread_cond_init(&thread_parent, NULL);
+	pthread_cond_init(&thread_worker, NULL);
+
+	threads_starting = nthreads;
+	pthread_attr_init(&thread_attr);
+	for (i = 0; i < nthreads; i++) {
+		worker[i].tid = i;
+		setup_worker_fds(&worker[i]);
+
+		if (!noaffinity) {
+			CPU_ZERO(&cpu);
+			CPU_SET(i % ncpus, &cpu);
+
+			ret = pthread_attr_setaffinity_np(&thread_attr, sizeof(cpu_set_t), &cpu);
+			if (ret)
+				err(EXIT_FAILURE, "pthread_attr_setaffinity_np");
+		}
+
+		ret = pthread_create(&worker[i].thread, &thread_attr, workerfn,
+				     (void *)(struct worker *) &worker[i]);
+		if (ret)
+			err(EXIT_FAILURE, "pthread_create");
+	}
+	pthread_attr_destroy(&thread_attr);
+
+	for (i = 0, j = 0; i < (multiq ? nthreads : 1); i++) {
+		unsigned int k;
+
+		for (k = 0; k < nwaiters; k++, j++) {
+			ret = pthread_create(&waiter[j], NULL, waiterfn,
+					     (void *)(long) worker[i].epollfd);
+			if (ret)
+				err(EXIT_FAILURE, "pthread_create");
+		}
+	}
+
+	pthread_mutex_lock(&thread_lock);
+	while (threads_starting)
+		pthread_cond_wait(&thread_parent, &thread_lock);
+	gettimeofday(&start, NULL);
+	pthread_cond_broadcast(&thread_worker);
+	pthread_mutex_unlock(&thread_lock);
+
+	sleep(nsecs);
+	toggle_done(0, NULL, NULL);
+
+	for (i = 0; i < nthreads; i++) {
+		ret = pthread_join(worker[i].thread, NULL);
+		if (ret)
+			err(EXIT_FAILURE, "pthread_join");
+	}
+	while (j--) {
+		ret = pthread_join(waiter[j], NULL);
+		if (ret)
+			err(EXIT_FAILURE, "pthread_join");
+	}
+
+	/* cleanup & report results */
+	pthread_cond_destroy(&thread_parent);
+	pthread_cond_destroy(&thread_worker);
+	pthread_mutex_destroy(&thread_lock);
+
+	for (i = 0; i < nthreads; i++) {
+		unsigned long t[EPOLL_NR_OPS];
+		int op;
+
+		for (op = 0; op < EPOLL_NR_OPS; op++) {
+			t[op] = worker[i].ops[op] / (runtime.tv_sec ?: 1);
+			update_stats(&all_stats[op], t[op]);
+		}
+
+		if (!silent)
+			printf("[thread %2d] fds: %d ... %d [ add: %ld ops; mod: %ld ops; del: %ld ops ]\n",
+			       worker[i].tid, worker[i].fds[0],
+			       worker[i].fds[nfds - 1], t[OP_EPOLL_ADD],
+			       t[OP_EPOLL_MOD], t[OP_EPOLL_DEL]);
+
+		for (j = 0; j < nfds; j++)
+			close(worker[i].fds[j]);
+		free(worker[i].fds);
+		free(worker[i].added);
+		if (multiq)
+			close(worker[i].epollfd);
+	}
+	if (!multiq)
+		close(epollfd);
+
+	print_summary();
+
+	free(waiter);
+	free(worker);
+	return ret;
+}
@@ -0,0 +1,360 @@
+/*
+ * epoll-wait: Measure epoll_wait(2) wakeup throughput and latency.
+ *
+ * A number of worker threads each own a set of eventfds that are added to
+ * an epoll instance, either one shared by all workers or one per worker
+ * (multiq).  A single writer thread keeps signalling every eventfd of every
+ * worker, and the workers reap the events with epoll_wait(2), one at a time.
+ * This exercises ep_poll_callback() and the ready list handling, which is
+ * where concurrent waiters on a single instance contend.
+ *
+ * Wakeup latency is the time from the writer signalling an eventfd to a
+ * worker returning from epoll_wait(2) with it.
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/stat.h"
+#include "../util/parse-options.h"
+#include "../util/header.h"
+#include "bench.h"
+
+#include <err.h>
+#include <stdlib.h>
+#include <time.h>
+#include <sys/time.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <pthread.h>
+
+static unsigned int nthreads = 0;
+static unsigned int nsecs    = 8;
+/* amount of eventfds per thread */
+static unsigned int nfds     = 64;
+static bool wdone, done, silent, multiq, nonblocking, noaffinity;
+static bool et, oneshot;
+
+static int epollfd;
+static int epoll_flags;
+static struct timeval start, end, runtime;
+static pthread_mutex_t thread_lock;
+static unsigned int threads_starting;
+static struct stats throughput_stats, latency_stats;
+static pthread_cond_t thread_parent, thread_worker;
+
+/* An eventfd, along with the time the writer last signalled it */
+struct efd {
+	int fd;
+	int epollfd;
+	u64 stamp;
+};
+
+struct worker {
+	int tid;
+	int epollfd;	/* shared unless multiq */
+	pthread_t thread;
+	unsigned long ops;
+	struct stats latency;
+	struct efd *efds;
+};
+
+static const struct option options[] = {
+	OPT_UINTEGER('t', "threads",     &nthreads,    "Specify amount of threads"),
+	OPT_UINTEGER('r', "runtime",     &nsecs,       "Specify runtime (in seconds)"),
+	OPT_UINTEGER('f', "nfds",        &nfds,        "Specify amount of file descriptors per thread"),
+	OPT_BOOLEAN( 'm', "multiq",      &multiq,      "Use an epoll instance per thread"),
+	OPT_BOOLEAN( 'n', "nonblocking", &nonblocking, "Poll with a zero timeout instead of blocking"),
+	OPT_BOOLEAN( 'E', "edge",        &et,          "Use edge-triggered events (EPOLLET)"),
+	OPT_BOOLEAN( 'O', "oneshot",     &oneshot,     "Use one-shot events (EPOLLONESHOT)"),
+	OPT_BOOLEAN( 'N', "noaffinity",  &noaffinity,  "Do not bind threads to CPUs"),
+	OPT_BOOLEAN( 's', "silent",      &silent,      "Silent mode: do not display data/details"),
+	OPT_END()
+};
+
+static const char * const bench_epoll_wait_usage[] = {
+	"perf bench epoll wait <options>",
+	NULL
+};
+
+static u64 now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void *workerfn(void *arg)
+{
+	struct worker *w = (struct worker *) arg;
+	struct epoll_event ev;
+	int timeout = nonblocking ? 0 : 1;
+	u64 val;
+	int ret;
+
+	pthread_mutex_lock(&thread_lock);
+	threads_starting--;
+	if (!threads_starting)
+		pthread_cond_signal(&thread_parent);
+	pthread_cond_wait(&thread_worker, &thread_lock);
+	pthread_mutex_unlock(&thread_lock);
+
+	do {
+		struct efd *efd;
+		u64 stamp;
+
+		/*
+		 * Block for a short time only, so that the workers notice
+		 * the end of the run even when no more events come in.
+		 */
+		ret = epoll_wait(w->epollfd, &ev, 1, timeout);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			err(EXIT_FAILURE, "epoll_wait");
+		}
+		if (!ret)
+			continue;
+
+		efd = ev.data.ptr;
+		stamp = efd->stamp;
+
+		/*
+		 * Drain the counter.  With a shared instance another worker
+		 * may have beaten us to it for level-triggered events.
+		 */
+		ret = read(efd->fd, &val, sizeof(val));
+		if (ret < 0 && errno != EAGAIN)
+			err(EXIT_FAILURE, "read");
+
+		if (ret > 0) {
+			update_stats(&w->latency, now_ns() - stamp);
+			w->ops++;
+		}
+
+		if (oneshot) {
+			ev.events = EPOLLIN | epoll_flags;
+			ev.data.ptr = efd;
+			if (epoll_ctl(efd->epollfd, EPOLL_CTL_MOD, efd->fd, &ev))
+				err(EXIT_FAILURE, "epoll_ctl");
+		}
+	} while (!done);
+
+	return NULL;
+}
+
+static void *writerfn(void *arg)
+{
+	struct worker *worker = (struct worker *) arg;
+	struct timespec ts = { .tv_sec = 0, .tv_nsec = 500 };
+	unsigned int i, j;
+	u64 val = 1;
+
+	while (!wdone) {
+		for (i = 0; i < nthreads && !wdone; i++) {
+			for (j = 0; j < nfds; j++) {
+				struct efd *efd = &worker[i].efds[j];
+
+				efd->stamp = now_ns();
+				if (write(efd->fd, &val, sizeof(val)) < 0 &&
+				    errno != EAGAIN)
+					err(EXIT_FAILURE, "write");
+			}
+		}
+		/* give the workers a chance to keep up */
+		nanosleep(&ts, NULL);
+	}
+
+	return NULL;
+}
+
+static void setup_worker_fds(struct worker *w)
+{
+	struct epoll_event ev;
+	unsigned int i;
+
+	w->epollfd = epollfd;
+	if (multiq) {
+		w->epollfd = epoll_create1(0);
+		if (w->epollfd < 0)
+			err(EXIT_FAILURE, "epoll_create1");
+	}
+
+	w->efds = calloc(nfds, sizeof(*w->efds));
+	if (!w->efds)
+		err(EXIT_FAILURE, "calloc");
+
+	for (i = 0; i < nfds; i++) {
+		struct efd *efd = &w->efds[i];
+
+		efd->fd = eventfd(0, EFD_NONBLOCK);
+		if (efd->fd < 0)
+			err(EXIT_FAILURE, "eventfd");
+		efd->epollfd = w->epollfd;
+
+		ev.events = EPOLLIN | epoll_flags;
+		ev.data.ptr = efd;
+		if (epoll_ctl(w->epollfd, EPOLL_CTL_ADD, efd->fd, &ev))
+			err(EXIT_FAILURE, "epoll_ctl");
+	}
+}
+
+static void toggle_done(int sig __maybe_unused,
+			siginfo_t *info __maybe_unused,
+			void *uc __maybe_unused)
+{
+	/* inform all threads that we're done for the day */
+	done = true;
+	gettimeofday(&end, NULL);
+	timersub(&end, &start, &runtime);
+}
+
+static void print_summary(void)
+{
+	unsigned long avg = avg_stats(&throughput_stats);
+	double stddev = stddev_stats(&throughput_stats);
+
+	printf("%sAveraged %ld operations/sec (+- %.2f%%), total secs = %d\n",
+	       !silent ? "\n" : "", avg, rel_stddev_stats(stddev, avg),
+	       (int) runtime.tv_sec);
+	printf("Averaged wakeup latency: %.3f usecs (+- %.2f%%)\n",
+	       avg_stats(&latency_stats) / 1000.0,
+	       rel_stddev_stats(stddev_stats(&latency_stats),
+				avg_stats(&latency_stats)));
+}
+
+int bench_epoll_wait(int argc, const char **argv,
+		     const char *prefix __maybe_unused)
+{
+	int ret = 0;
+	cpu_set_t cpu;
+	struct sigaction act;
+	unsigned int i, ncpus;
+	pthread_attr_t thread_attr;
+	pthread_t writer;
+	struct worker *worker = NULL;
+
+	argc = parse_options(argc, argv, options, bench_epoll_wait_usage, 0);
+	if (argc || !nfds) {
+		usage_with_options(bench_epoll_wait_usage, options);
+		exit(EXIT_FAILURE);
+	}
+
+	ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+	sigfillset(&act.sa_mask);
+	act.sa_sigaction = toggle_done;
+	sigaction(SIGINT, &act, NULL);
+
+	if (!nthreads) /* default to the number of CPUs, minus the writer */
+		nthreads = ncpus > 1 ? ncpus - 1 : 1;
+
+	if (et)
+		epoll_flags |= EPOLLET;
+	if (oneshot)
+		epoll_flags |= EPOLLONESHOT;
+
+	worker = calloc(nthreads, sizeof(*worker));
+	if (!worker)
+		err(EXIT_FAILURE, "calloc");
+
+	if (!multiq) {
+		epollfd = epoll_create1(0);
+		if (epollfd < 0)
+			err(EXIT_FAILURE, "epoll_create1");
+	}
+
+	printf("Run summary [PID %d]: %d threads, each monitoring %d fds%s%s on %s for %d secs.\n\n",
+	       getpid(), nthreads, nfds, et ? " [EPOLLET]" : "",
+	       oneshot ? " [EPOLLONESHOT]" : "",
+	       multiq ? "one epoll instance each" : "a single epoll instance",
+	       nsecs);
+
+	init_stats(&throughput_stats);
+	init_stats(&latency_stats);
+	pthread_mutex_init(&thread_lock, NULL);
+	pthread_cond_init(&thread_parent, NULL);
+	pthread_cond_init(&thread_worker, NULL);
+
+	threads_starting = nthreads;
+	pthread_attr_init(&thread_attr);
+	for (i = 0; i < nthreads; i++) {
+		worker[i].tid = i;
+		init_stats(&worker[i].latency);
+		setup_worker_fds(&worker[i]);
+
+		if (!noaffinity) {
+			CPU_ZERO(&cpu);
+			CPU_SET(i % ncpus, &cpu);
+
+			ret = pthread_attr_setaffinity_np(&thread_attr, sizeof(cpu_set_t), &cpu);
+			if (ret)
+				err(EXIT_FAILURE, "pthread_attr_setaffinity_np");
+		}
+
+		ret = pthread_create(&worker[i].thread, &thread_attr, workerfn,
+				     (void *)(struct worker *) &worker[i]);
+		if (ret)
+			err(EXIT_FAILURE, "pthread_create");
+	}
+	pthread_attr_destroy(&thread_attr);
+
+	pthread_mutex_lock(&thread_lock);
+	while (threads_starting)
+		pthread_cond_wait(&thread_parent, &thread_lock);
+	pthread_cond_broadcast(&thread_worker);
+	pthread_mutex_unlock(&thread_lock);
+
+	gettimeofday(&start, NULL);
+	ret = pthread_create(&writer, NULL, writerfn, worker);
+	if (ret)
+		err(EXIT_FAILURE, "pthread_create");
+
+	sleep(nsecs);
+	toggle_done(0, NULL, NULL);
+
+	for (i = 0; i < nthreads; i++) {
+		ret = pthread_join(worker[i].thread, NULL);
+		if (ret)
+			err(EXIT_FAILURE, "pthread_join");
+	}
+
+	/* the workers are gone, stop feeding them */
+	wdone = true;
+	ret = pthread_join(writer, NULL);
+	if (ret)
+		err(EXIT_FAILURE, "pthread_join");
+
+	/* cleanup & report results */
+	pthread_cond_destroy(&thread_parent);
+	pthread_cond_destroy(&thread_worker);
+	pthread_mutex_destroy(&thread_lock);
+
+	for (i = 0; i < nthreads; i++) {
+		unsigned long t = worker[i].ops / (runtime.tv_sec ?: 1);
+		unsigned int j;
+
+		update_stats(&throughput_stats, t);
+		if (worker[i].ops)
+			update_stats(&latency_stats,
+				     avg_stats(&worker[i].latency));
+		if (!silent)
+			printf("[thread %2d] fds: %d ... %d [ %ld ops/sec, %.3f usecs latency ]\n",
+			       worker[i].tid, worker[i].efds[0].fd,
+			       worker[i].efds[nfds - 1].fd, t,
+			       avg_stats(&worker[i].latency) / 1000.0);
+
+		for (j = 0; j < nfds; j++)
+			close(worker[i].efds[j].fd);
+		free(worker[i].efds);
+		if (multiq)
+			close(worker[i].epollfd);
+	}
+	if (!multiq)
+		close(epollfd);
+
+	print_summary();
+
+	free(worker);
+	return ret;
+}
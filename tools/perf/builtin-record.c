@@ -35,8 +35,30 @@
 
 #include <unistd.h>
 #include <sched.h>
+#include <pthread.h>
+#include <signal.h>
+#include <aio.h>
 #include <sys/mman.h>
 
+#define RECORD_AIO_MAX	4
+
+/* In flight writes of one mmap, see --aio */
+struct record_aio {
+	struct aiocb		cblocks[RECORD_AIO_MAX];
+	void			*data[RECORD_AIO_MAX];
+};
+
+/* A thread draining a subset of the mmaps, see --threads */
+struct record_thread {
+	struct record		*rec;
+	pthread_t		tid;
+	int			*mmaps;
+	int			nr_mmaps;
+	bool			pinned;
+	cpu_set_t		cpus;
+	unsigned long long	samples;
+	int			err;
+};
 
 struct record {
 	struct perf_tool	tool;
@@ -51,10 +73,70 @@ struct record {
 	bool			no_buildid;
 	bool			no_buildid_cache;
 	unsigned long long	samples;
+	const char		*threads_spec;
+	int			nr_threads;
+	struct record_thread	*threads;
+	int			nr_cblocks;
+	struct record_aio	*aio;
+	/*
+	 * With --threads or --aio the data is written with positioned
+	 * writes. The lock hands out the output space and runs the rounds.
+	 */
+	pthread_mutex_t		lock;
+	pthread_cond_t		round_start;
+	pthread_cond_t		round_done;
+	unsigned int		round;
+	int			round_pending;
+	bool			threads_stop;
+	off_t			write_off;
 };
 
+static bool record__async(struct record *rec)
+{
+	return rec->threads_spec || rec->nr_cblocks;
+}
+
+/* Claim @size bytes at the end of the output */
+static off_t record__reserve(struct record *rec, size_t size)
+{
+	off_t off;
+
+	pthread_mutex_lock(&rec->lock);
+	off = rec->write_off;
+	rec->write_off += size;
+	rec->bytes_written += size;
+	pthread_mutex_unlock(&rec->lock);
+
+	return off;
+}
+
+static int record__pwrite(struct record *rec, void *bf, size_t size, off_t off)
+{
+	int fd = perf_data_file__fd(rec->session->file);
+
+	while (size) {
+		ssize_t ret = pwrite(fd, bf, size, off);
+
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			pr_err("failed to write perf data, error: %m\n");
+			return -1;
+		}
+
+		bf += ret;
+		size -= ret;
+		off += ret;
+	}
+
+	return 0;
+}
+
 static int record__write(struct record *rec, void *bf, size_t size)
 {
+	if (record__async(rec))
+		return record__pwrite(rec, bf, size, record__reserve(rec, size));
+
 	if (perf_data_file__write(rec->session->file, bf, size) < 0) {
 		pr_err("failed to write perf data, error: %m\n");
 		return -1;
@@ -64,6 +146,191 @@ static int record__write(struct record *rec, void *bf, size_t size)
 	return 0;
 }
 
+/* Write a piece of an mmap, at *@off when the space was claimed up front */
+static int record__write_chunk(struct record *rec, void *bf, size_t size,
+			       off_t *off)
+{
+	if (!record__async(rec))
+		return record__write(rec, bf, size);
+
+	if (record__pwrite(rec, bf, size, *off) < 0)
+		return -1;
+
+	*off += size;
+	return 0;
+}
+
+static int record__aio_write(struct aiocb *cblock, int fd, void *buf,
+			     size_t size, off_t off)
+{
+	memset(cblock, 0, sizeof(*cblock));
+	cblock->aio_fildes = fd;
+	cblock->aio_buf = buf;
+	cblock->aio_nbytes = size;
+	cblock->aio_offset = off;
+	cblock->aio_sigevent.sigev_notify = SIGEV_NONE;
+
+	while (aio_write(cblock) < 0) {
+		if (errno != EAGAIN && errno != EINTR) {
+			cblock->aio_fildes = -1;
+			pr_err("failed to queue perf data write, error: %m\n");
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * Returns 1 if @cblock is free for another write, 0 if it is still busy
+ * and -1 if its write failed. Short writes are queued again.
+ */
+static int record__aio_complete(struct aiocb *cblock)
+{
+	ssize_t written;
+	int err;
+
+	if (cblock->aio_fildes == -1)
+		return 1;
+
+	err = aio_error(cblock);
+	if (err == EINPROGRESS)
+		return 0;
+
+	written = aio_return(cblock);
+	if (err || written < 0) {
+		cblock->aio_fildes = -1;
+		pr_err("failed to write perf data, error: %s\n",
+		       strerror(err ?: errno));
+		return -1;
+	}
+
+	if ((size_t)written < cblock->aio_nbytes) {
+		if (record__aio_write(cblock, cblock->aio_fildes,
+				      (void *)cblock->aio_buf + written,
+				      cblock->aio_nbytes - written,
+				      cblock->aio_offset + written) < 0)
+			return -1;
+		return 0;
+	}
+
+	cblock->aio_fildes = -1;
+	return 1;
+}
+
+/*
+ * Wait for a free buffer of @aio, or for all of them with @all. Returns
+ * the index of a free buffer, or -1 on error.
+ */
+static int record__aio_sync(struct record_aio *aio, int nr_cblocks, bool all)
+{
+	const struct aiocb *busy[RECORD_AIO_MAX];
+	int i, nr_busy, free;
+
+	for (;;) {
+		nr_busy = 0;
+		free = -1;
+
+		for (i = 0; i < nr_cblocks; i++) {
+			int ret = record__aio_complete(&aio->cblocks[i]);
+
+			if (ret < 0)
+				return -1;
+
+			if (ret) {
+				busy[i] = NULL;
+				if (free < 0)
+					free = i;
+			} else {
+				busy[i] = &aio->cblocks[i];
+				nr_busy++;
+			}
+		}
+
+		if (all ? !nr_busy : free >= 0)
+			return all ? 0 : free;
+
+		if (aio_suspend(busy, nr_cblocks, NULL) < 0 && errno != EINTR &&
+		    errno != EAGAIN) {
+			pr_err("failed to wait for perf data writes, error: %m\n");
+			return -1;
+		}
+	}
+}
+
+/*
+ * Copy the new data of an mmap to a free AIO buffer, so that the ring
+ * buffer space can be handed back right away, and queue its write.
+ */
+static int record__aio_push(struct record *rec, int idx, u64 old, u64 head)
+{
+	struct perf_mmap *md = &rec->evlist->mmap[idx];
+	struct record_aio *aio = &rec->aio[idx];
+	unsigned char *data = md->base + page_size;
+	size_t size = head - old;
+	size_t n;
+	void *buf;
+	int i;
+
+	i = record__aio_sync(aio, rec->nr_cblocks, false);
+	if (i < 0)
+		return -1;
+
+	buf = aio->data[i];
+	n = min(size, (size_t)(md->mask + 1 - (old & md->mask)));
+	memcpy(buf, &data[old & md->mask], n);
+	memcpy(buf + n, data, size - n);
+
+	return record__aio_write(&aio->cblocks[i],
+				 perf_data_file__fd(rec->session->file),
+				 buf, size, record__reserve(rec, size));
+}
+
+static int record__aio_init(struct record *rec)
+{
+	struct perf_evlist *evlist = rec->evlist;
+	size_t size = evlist->mmap_len - page_size;
+	int i, j;
+
+	if (!rec->nr_cblocks)
+		return 0;
+
+	rec->aio = calloc(evlist->nr_mmaps, sizeof(*rec->aio));
+	if (!rec->aio)
+		return -ENOMEM;
+
+	for (i = 0; i < evlist->nr_mmaps; i++) {
+		for (j = 0; j < rec->nr_cblocks; j++) {
+			rec->aio[i].cblocks[j].aio_fildes = -1;
+			rec->aio[i].data[j] = malloc(size);
+			if (!rec->aio[i].data[j])
+				return -ENOMEM;
+		}
+	}
+
+	return 0;
+}
+
+/* Wait for all the writes in flight, then free the buffers */
+static int record__aio_exit(struct record *rec)
+{
+	int i, j, err = 0;
+
+	if (!rec->aio)
+		return 0;
+
+	for (i = 0; i < rec->evlist->nr_mmaps; i++) {
+		if (record__aio_sync(&rec->aio[i], rec->nr_cblocks, true) < 0)
+			err = -1;
+
+		for (j = 0; j < rec->nr_cblocks; j++)
+			free(rec->aio[i].data[j]);
+	}
+
+	zfree(&rec->aio);
+	return err;
+}
+
 static int process_synthesized_event(struct perf_tool *tool,
 				     union perf_event *event,
 				     struct perf_sample *sample __maybe_unused,
@@ -73,29 +340,44 @@ static int process_synthesized_event(struct perf_tool *tool,
 	return record__write(rec, event, event->header.size);
 }
 
-static int record__mmap_read(struct record *rec, int idx)
+static int record__mmap_read(struct record *rec, int idx,
+			     unsigned long long *samples)
 {
 	struct perf_mmap *md = &rec->evlist->mmap[idx];
 	u64 head = perf_mmap__read_head(md);
 	u64 old = md->prev;
 	unsigned char *data = md->base + page_size;
 	unsigned long size;
+	off_t off = 0;
 	void *buf;
 	int rc = 0;
 
 	if (old == head)
 		return 0;
 
-	rec->samples++;
+	(*samples)++;
 
 	size = head - old;
 
+	if (rec->nr_cblocks) {
+		if (record__aio_push(rec, idx, old, head) < 0) {
+			rc = -1;
+			goto out;
+		}
+		old = head;
+		goto consume;
+	}
+
+	/* Keep the whole range in one piece next to the other writers */
+	if (record__async(rec))
+		off = record__reserve(rec, size);
+
 	if ((old & md->mask) + size != (head & md->mask)) {
 		buf = &data[old & md->mask];
 		size = md->mask + 1 - (old & md->mask);
 		old += size;
 
-		if (record__write(rec, buf, size) < 0) {
+		if (record__write_chunk(rec, buf, size, &off) < 0) {
 			rc = -1;
 			goto out;
 		}
@@ -105,11 +387,12 @@ static int record__mmap_read(struct record *rec, int idx)
 	size = head - old;
 	old += size;
 
-	if (record__write(rec, buf, size) < 0) {
+	if (record__write_chunk(rec, buf, size, &off) < 0) {
 		rc = -1;
 		goto out;
 	}
 
+consume:
 	md->prev = old;
 	perf_evlist__mmap_consume(rec->evlist, idx);
 out:
@@ -399,28 +682,246 @@ static struct perf_event_header finished_round_event = {
 	.type = PERF_RECORD_FINISHED_ROUND,
 };
 
-static int record__mmap_read_all(struct record *rec)
+static int record__mmap_read_idx(struct record *rec, int idx,
+				 unsigned long long *samples)
 {
-	u64 bytes_written = rec->bytes_written;
+	struct auxtrace_mmap *mm = &rec->evlist->mmap[idx].auxtrace_mmap;
+
+	if (rec->evlist->mmap[idx].base &&
+	    record__mmap_read(rec, idx, samples) != 0)
+		return -1;
+
+	if (mm->base && !rec->opts.auxtrace_snapshot_mode &&
+	    record__auxtrace_mmap_read(rec, mm) != 0)
+		return -1;
+
+	return 0;
+}
+
+/*
+ * Writer threads drain their mmaps once per round. The main thread waits
+ * for all of them before it closes the round, so that a
+ * PERF_RECORD_FINISHED_ROUND still follows everything read before it.
+ */
+static void *record__thread(void *arg)
+{
+	struct record_thread *thread = arg;
+	struct record *rec = thread->rec;
+	unsigned int round = 0;
+	sigset_t mask;
 	int i;
-	int rc = 0;
 
-	for (i = 0; i < rec->evlist->nr_mmaps; i++) {
-		struct auxtrace_mmap *mm = &rec->evlist->mmap[i].auxtrace_mmap;
+	/* Signals are for the main thread */
+	sigfillset(&mask);
+	pthread_sigmask(SIG_BLOCK, &mask, NULL);
 
-		if (rec->evlist->mmap[i].base) {
-			if (record__mmap_read(rec, i) != 0) {
-				rc = -1;
-				goto out;
-			}
+	if (thread->pinned &&
+	    pthread_setaffinity_np(pthread_self(), sizeof(thread->cpus),
+				   &thread->cpus))
+		pr_debug("failed to set writer thread affinity\n");
+
+	pthread_mutex_lock(&rec->lock);
+	for (;;) {
+		while (rec->round == round && !rec->threads_stop)
+			pthread_cond_wait(&rec->round_start, &rec->lock);
+		if (rec->threads_stop)
+			break;
+		round = rec->round;
+		pthread_mutex_unlock(&rec->lock);
+
+		for (i = 0; i < thread->nr_mmaps && !thread->err; i++) {
+			if (record__mmap_read_idx(rec, thread->mmaps[i],
+						  &thread->samples) < 0)
+				thread->err = -1;
 		}
 
-		if (mm->base && !rec->opts.auxtrace_snapshot_mode &&
-		    record__auxtrace_mmap_read(rec, mm) != 0) {
+		pthread_mutex_lock(&rec->lock);
+		if (!--rec->round_pending)
+			pthread_cond_signal(&rec->round_done);
+	}
+	pthread_mutex_unlock(&rec->lock);
+
+	return NULL;
+}
+
+static int record__threads_round(struct record *rec)
+{
+	int i, rc = 0;
+
+	pthread_mutex_lock(&rec->lock);
+	rec->round++;
+	rec->round_pending = rec->nr_threads;
+	pthread_cond_broadcast(&rec->round_start);
+	while (rec->round_pending)
+		pthread_cond_wait(&rec->round_done, &rec->lock);
+	pthread_mutex_unlock(&rec->lock);
+
+	for (i = 0; i < rec->nr_threads; i++) {
+		rec->samples += rec->threads[i].samples;
+		rec->threads[i].samples = 0;
+		if (rec->threads[i].err)
 			rc = -1;
-			goto out;
+	}
+
+	return rc;
+}
+
+/*
+ * Spread the mmaps over the writer threads: one thread per CPU or per
+ * NUMA node, pinned to the CPUs of its mmaps, or the given number of
+ * threads sharing the mmaps round robin.
+ */
+static int record__threads_setup(struct record *rec, int *slot)
+{
+	struct perf_evlist *evlist = rec->evlist;
+	struct cpu_map *cpus = evlist->cpus;
+	bool per_cpu = !cpu_map__empty(cpus);
+	const char *spec = rec->threads_spec;
+	bool pin = per_cpu;
+	int *node_thread;
+	int nr = 0, i;
+	char *end;
+
+	if (!strcmp(spec, "cpu") || (!per_cpu && !strcmp(spec, "numa"))) {
+		for (i = 0; i < evlist->nr_mmaps; i++)
+			slot[i] = nr++;
+	} else if (!strcmp(spec, "numa")) {
+		if (cpu__setup_cpunode_map())
+			return -1;
+
+		node_thread = malloc(cpu__max_node() * sizeof(*node_thread));
+		if (!node_thread)
+			return -ENOMEM;
+		memset(node_thread, -1, cpu__max_node() * sizeof(*node_thread));
+
+		for (i = 0; i < evlist->nr_mmaps; i++) {
+			int node = cpu__get_node(cpus->map[i]);
+
+			if (node < 0)
+				node = 0;
+			if (node_thread[node] < 0)
+				node_thread[node] = nr++;
+			slot[i] = node_thread[node];
+		}
+		free(node_thread);
+	} else {
+		nr = strtol(spec, &end, 0);
+		if (*end || nr <= 0) {
+			pr_err("Invalid --threads '%s', expected cpu, numa or a number\n",
+			       spec);
+			return -EINVAL;
+		}
+		if (nr > evlist->nr_mmaps)
+			nr = evlist->nr_mmaps;
+		for (i = 0; i < evlist->nr_mmaps; i++)
+			slot[i] = i % nr;
+		pin = false;
+	}
+
+	rec->threads = calloc(nr, sizeof(*rec->threads));
+	if (!rec->threads)
+		return -ENOMEM;
+	rec->nr_threads = nr;
+
+	for (i = 0; i < nr; i++) {
+		rec->threads[i].rec = rec;
+		CPU_ZERO(&rec->threads[i].cpus);
+		rec->threads[i].mmaps = calloc(evlist->nr_mmaps, sizeof(int));
+		if (!rec->threads[i].mmaps)
+			return -ENOMEM;
+	}
+
+	for (i = 0; i < evlist->nr_mmaps; i++) {
+		struct record_thread *thread = &rec->threads[slot[i]];
+
+		thread->mmaps[thread->nr_mmaps++] = i;
+		if (pin && cpus->map[i] < CPU_SETSIZE) {
+			CPU_SET(cpus->map[i], &thread->cpus);
+			thread->pinned = true;
+		}
+	}
+
+	return 0;
+}
+
+static void __record__threads_stop(struct record *rec, int nr_started)
+{
+	int i;
+
+	pthread_mutex_lock(&rec->lock);
+	rec->threads_stop = true;
+	pthread_cond_broadcast(&rec->round_start);
+	pthread_mutex_unlock(&rec->lock);
+
+	for (i = 0; i < nr_started; i++)
+		pthread_join(rec->threads[i].tid, NULL);
+
+	for (i = 0; i < rec->nr_threads; i++)
+		free(rec->threads[i].mmaps);
+	zfree(&rec->threads);
+	rec->nr_threads = 0;
+}
+
+static void record__threads_stop(struct record *rec)
+{
+	if (rec->threads)
+		__record__threads_stop(rec, rec->nr_threads);
+}
+
+static int record__threads_start(struct record *rec)
+{
+	int *slot;
+	int i, err;
+
+	if (!rec->threads_spec)
+		return 0;
+
+	slot = calloc(rec->evlist->nr_mmaps, sizeof(*slot));
+	if (!slot)
+		return -ENOMEM;
+
+	err = record__threads_setup(rec, slot);
+	free(slot);
+	if (err)
+		goto out_free;
+
+	for (i = 0; i < rec->nr_threads; i++) {
+		err = pthread_create(&rec->threads[i].tid, NULL,
+				     record__thread, &rec->threads[i]);
+		if (err) {
+			pr_err("failed to start writer thread: %s\n",
+			       strerror(err));
+			__record__threads_stop(rec, i);
+			return -err;
+		}
+	}
+
+	pr_debug("perf record: %d writer threads\n", rec->nr_threads);
+	return 0;
+
+out_free:
+	if (rec->threads)
+		__record__threads_stop(rec, 0);
+	return err;
+}
+
+static int record__mmap_read_all(struct record *rec)
+{
+	u64 bytes_written = rec->bytes_written;
+	int i;
+	int rc = 0;
+
+	if (rec->nr_threads) {
+		rc = record__threads_round(rec);
+	} else {
+		for (i = 0; i < rec->evlist->nr_mmaps; i++) {
+			rc = record__mmap_read_idx(rec, i, &rec->samples);
+			if (rc)
+				break;
 		}
 	}
+	if (rc)
+		goto out;
 
 	/*
 	 * Mark the round finished in case we wrote
@@ -546,6 +1047,24 @@ static int __cmd_record(struct record *rec, int argc, const char **argv)
 			goto out_child;
 	}
 
+	if (record__async(rec)) {
+		if (file->is_pipe) {
+			pr_err("--threads and --aio need a seekable output file\n");
+			err = -EINVAL;
+			goto out_child;
+		}
+
+		rec->write_off = lseek(fd, 0, SEEK_CUR);
+
+		err = record__aio_init(rec);
+		if (!err)
+			err = record__threads_start(rec);
+		if (err) {
+			pr_err("Couldn't set up the perf data writers\n");
+			goto out_child;
+		}
+	}
+
 	if (!rec->no_buildid
 	    && !perf_header__has_feat(&session->header, HEADER_BUILD_ID)) {
 		pr_err("Couldn't generate buildids. "
@@ -728,6 +1247,10 @@ static int __cmd_record(struct record *rec, int argc, const char **argv)
 		fprintf(stderr, "[ perf record: Woken up %ld times to write data ]\n", waking);
 
 out_child:
+	record__threads_stop(rec);
+	if (record__aio_exit(rec) < 0 && !err)
+		err = -1;
+
 	if (forks) {
 		int exit_status;
 
@@ -750,6 +1273,8 @@ out_child:
 
 	if (!err && !file->is_pipe) {
 		rec->session->header.data_size += rec->bytes_written;
+		if (record__async(rec))
+			lseek(fd, rec->write_off, SEEK_SET);
 		file->size = lseek(perf_data_file__fd(file), 0, SEEK_CUR);
 
 		if (!rec->no_buildid) {
@@ -970,6 +1495,31 @@ out_free:
 	return ret;
 }
 
+static int record__parse_aio(const struct option *opt, const char *str,
+			     int unset)
+{
+	int *nr_cblocks = opt->value;
+	char *end;
+
+	if (unset) {
+		*nr_cblocks = 0;
+		return 0;
+	}
+
+	if (!str) {
+		*nr_cblocks = 1;
+		return 0;
+	}
+
+	*nr_cblocks = strtol(str, &end, 0);
+	if (*end || *nr_cblocks < 1 || *nr_cblocks > RECORD_AIO_MAX) {
+		pr_err("--aio takes 1 to %d buffers per mmap\n", RECORD_AIO_MAX);
+		return -1;
+	}
+
+	return 0;
+}
+
 static const char * const __record_usage[] = {
 	"perf record [<options>] [<command>]",
 	"perf record [<options>] -- <command> [<options>]",
@@ -1009,6 +1559,9 @@ static struct record record = {
 		.mmap2		= perf_event__process_mmap2,
 		.ordered_events	= true,
 	},
+	.lock		= PTHREAD_MUTEX_INITIALIZER,
+	.round_start	= PTHREAD_COND_INITIALIZER,
+	.round_done	= PTHREAD_COND_INITIALIZER,
 };
 
 const char record_callchain_help[] = CALLCHAIN_RECORD_HELP
@@ -1114,6 +1667,12 @@ struct option __record_options[] = {
 	OPT_BOOLEAN(0, "switch-events", &record.opts.record_switch_events,
 		    "Record context switch events"),
 #ifdef HAVE_LIBBPF_SUPPORT
+	OPT_STRING_OPTARG(0, "threads", &record.threads_spec, "spec",
+			  "drain mmaps from threads: per cpu (default), per numa node, or <n>",
+			  "cpu"),
+	OPT_CALLBACK_OPTARG(0, "aio", &record.nr_cblocks, NULL, "n",
+			    "write with POSIX AIO, using n buffers per mmap (default 1, max 4)",
+			    record__parse_aio),
 	OPT_STRING(0, "clang-path", &llvm_param.clang_path, "clang path",
 		   "clang binary to use for compiling BPF scriptlets"),
 	OPT_STRING(0, "clang-opt", &llvm_param.clang_opt, "clang options",
@@ -1215,6 +1774,12 @@ int cmd_record(int argc, const char **argv, const char *prefix __maybe_unused)
 	if (err)
 		goto out_symbol_exit;
 
+	if (record__async(rec) && rec->opts.full_auxtrace) {
+		pr_err("--threads and --aio can't be used with AUX area tracing\n");
+		err = -EINVAL;
+		goto out_symbol_exit;
+	}
+
 	if (record_opts__config(&rec->opts)) {
 		err = -EINVAL;
 		goto out_symbol_exit;
@@ -16,6 +16,8 @@
 #include "util/trace-event.h"
 
 #include "util/debug.h"
+#include "util/stat.h"
+#include "util/callchain.h"
 
 #include <sys/prctl.h>
 #include <sys/resource.h>
@@ -100,6 +102,28 @@ struct work_atoms {
 
 typedef int (*sort_fn_t)(struct work_atoms *, struct work_atoms *);
 
+/* Scheduling delay buckets of the timehist summary, in decades of usecs */
+#define TIMEHIST_NR_BUCKETS	7
+
+/* Per task state of timehist, hung off thread->priv */
+struct thread_runtime {
+	u64			last_time;	/* time of the last sched out */
+	u64			ready_to_run;	/* time it became runnable */
+	u64			dt_run;
+	u64			dt_wait;
+	u64			dt_delay;
+	u64			total_run_time;
+	u64			max_delay;
+	u64			nr_migrations;
+	struct stats		run_stats;
+	u64			delay_hist[TIMEHIST_NR_BUCKETS];
+};
+
+struct timehist_cpu {
+	struct thread_runtime	idle;
+	u64			delay_hist[TIMEHIST_NR_BUCKETS];
+};
+
 struct perf_sched;
 
 struct trace_sched_handler {
@@ -173,6 +197,16 @@ struct perf_sched {
 	struct list_head sort_list, cmp_pid;
 	bool force;
 	bool skip_merge;
+	/* options and state of timehist */
+	bool		 summary;
+	bool		 summary_only;
+	bool		 show_callchain;
+	bool		 show_wakeups;
+	unsigned int	 max_stack;
+	struct timehist_cpu *hist_cpus;
+	u64		 hist_time_start;
+	u64		 hist_time_end;
+	u64		 hist_nr_switches;
 };
 
 static u64 get_nsecs(void)
@@ -1721,6 +1755,491 @@ static int perf_sched__replay(struct perf_sched *sched)
 	return 0;
 }
 
+/*
+ * timehist: one pass over the switch and wakeup events, printing for each
+ * sched out of a task how long it waited off the CPU, how much of that it
+ * spent runnable (the scheduling delay) and how long it then ran.
+ */
+static const char * const timehist_bucket_names[TIMEHIST_NR_BUCKETS] = {
+	"<1us", "<10us", "<100us", "<1ms", "<10ms", "<100ms", ">=100ms",
+};
+
+static int timehist_bucket(u64 delay)
+{
+	u64 limit = NSEC_PER_USEC;
+	int i;
+
+	for (i = 0; i < TIMEHIST_NR_BUCKETS - 1; i++, limit *= 10) {
+		if (delay < limit)
+			break;
+	}
+	return i;
+}
+
+static struct thread_runtime *timehist_get_runtime(struct perf_sched *sched,
+						   struct thread *thread,
+						   int cpu)
+{
+	struct thread_runtime *r;
+
+	/* Every CPU has its own idle task, all of them with pid 0 */
+	if (!thread->tid)
+		return &sched->hist_cpus[cpu].idle;
+
+	r = thread__priv(thread);
+	if (r)
+		return r;
+
+	r = zalloc(sizeof(*r));
+	if (!r)
+		return NULL;
+
+	init_stats(&r->run_stats);
+	thread__set_priv(thread, r);
+	return r;
+}
+
+static const char *timehist_comm(struct thread *thread, char *buf, size_t size)
+{
+	if (!thread->tid)
+		return "<idle>";
+
+	snprintf(buf, size, "%s[%d]", thread__comm_str(thread), thread->tid);
+	return buf;
+}
+
+static void timehist_header(struct perf_sched *sched)
+{
+	printf("%15s %6s  %-30s  %9s  %9s  %9s",
+	       "time", "cpu", "task name", "wait time", "sch delay", "run time");
+	if (sched->show_callchain)
+		printf("  %s", "blocked at");
+	printf("\n");
+
+	printf("%15s %6s  %-30s  %9s  %9s  %9s\n",
+	       "", "", "[tid]", "(msec)", "(msec)", "(msec)");
+
+	printf("%.15s %.6s  %.30s  %.9s  %.9s  %.9s\n",
+	       graph_dotted_line, graph_dotted_line, graph_dotted_line,
+	       graph_dotted_line, graph_dotted_line, graph_dotted_line);
+}
+
+static bool timehist_skip_sym(struct symbol *sym)
+{
+	static const char * const sched_funcs[] = {
+		"schedule", "__schedule", "preempt_schedule",
+		"preempt_schedule_common", "preempt_schedule_irq",
+		"preempt_schedule_notrace", "schedule_preempt_disabled",
+		"schedule_timeout", "io_schedule", "io_schedule_timeout",
+		"_cond_resched", "__cond_resched_lock",
+		"schedule_hrtimeout_range_clock", "schedule_hrtimeout_range",
+	};
+	unsigned int i;
+
+	if (!sym)
+		return false;
+
+	for (i = 0; i < ARRAY_SIZE(sched_funcs); i++) {
+		if (!strcmp(sym->name, sched_funcs[i]))
+			return true;
+	}
+	return false;
+}
+
+/* Where the task blocked: its stack at sched out, scheduler left out */
+static void timehist_print_callchain(struct perf_sched *sched,
+				     struct perf_evsel *evsel,
+				     struct perf_sample *sample,
+				     struct thread *thread)
+{
+	struct callchain_cursor_node *node;
+	unsigned int printed = 0;
+
+	if (!sample->callchain ||
+	    thread__resolve_callchain(thread, evsel, sample, NULL, NULL,
+				      PERF_MAX_STACK_DEPTH) != 0)
+		return;
+
+	callchain_cursor_commit(&callchain_cursor);
+
+	printf(" ");
+	while (printed < sched->max_stack) {
+		node = callchain_cursor_current(&callchain_cursor);
+		if (!node)
+			break;
+
+		if (!timehist_skip_sym(node->sym)) {
+			printf("%s", printed ? " <- " : " ");
+			if (node->sym)
+				printf("%s", node->sym->name);
+			else
+				printf("%#" PRIx64, node->ip);
+			printed++;
+		}
+
+		callchain_cursor_advance(&callchain_cursor);
+	}
+}
+
+static void timehist_update_runtime_stats(struct thread_runtime *r,
+					  u64 t, u64 tprev)
+{
+	r->dt_run = t - tprev;
+	r->dt_wait = 0;
+	r->dt_delay = 0;
+
+	if (r->last_time && r->last_time <= tprev)
+		r->dt_wait = tprev - r->last_time;
+
+	if (r->ready_to_run && r->ready_to_run <= tprev) {
+		r->dt_delay = tprev - r->ready_to_run;
+		if (r->dt_delay > r->max_delay)
+			r->max_delay = r->dt_delay;
+	}
+
+	update_stats(&r->run_stats, r->dt_run);
+	r->total_run_time += r->dt_run;
+}
+
+static int timehist_switch_event(struct perf_sched *sched,
+				 struct perf_evsel *evsel,
+				 struct perf_sample *sample,
+				 struct machine *machine)
+{
+	const u32 prev_pid = perf_evsel__intval(evsel, sample, "prev_pid");
+	const u64 prev_state = perf_evsel__intval(evsel, sample, "prev_state");
+	struct thread_runtime *tr;
+	struct thread *thread;
+	int cpu = sample->cpu;
+	u64 t = sample->time;
+	u64 tprev;
+	char comm[64];
+	int err = 0;
+
+	if (cpu >= MAX_CPUS || cpu < 0) {
+		pr_err("Invalid cpu %d\n", cpu);
+		return -1;
+	}
+
+	if (!sched->hist_time_start)
+		sched->hist_time_start = t;
+	sched->hist_time_end = t;
+
+	/* The previous task has been on this CPU since its last switch */
+	tprev = sched->cpu_last_switched[cpu];
+	sched->cpu_last_switched[cpu] = t;
+
+	thread = machine__findnew_thread(machine, -1, prev_pid);
+	if (thread == NULL)
+		return -1;
+
+	tr = timehist_get_runtime(sched, thread, cpu);
+	if (tr == NULL) {
+		err = -1;
+		goto out_put;
+	}
+
+	/* Nothing to measure against on a CPU's first switch */
+	if (tprev && tprev <= t) {
+		timehist_update_runtime_stats(tr, t, tprev);
+		sched->hist_nr_switches++;
+
+		if (tr->ready_to_run && tr->ready_to_run <= tprev) {
+			int bucket = timehist_bucket(tr->dt_delay);
+
+			tr->delay_hist[bucket]++;
+			sched->hist_cpus[cpu].delay_hist[bucket]++;
+		}
+
+		if (!sched->summary_only) {
+			printf("%15.6f [%04d]  %-30s  %9.3f  %9.3f  %9.3f",
+			       (double)t / NSEC_PER_SEC, cpu,
+			       timehist_comm(thread, comm, sizeof(comm)),
+			       (double)tr->dt_wait / NSEC_PER_MSEC,
+			       (double)tr->dt_delay / NSEC_PER_MSEC,
+			       (double)tr->dt_run / NSEC_PER_MSEC);
+			if (sched->show_callchain && thread->tid)
+				timehist_print_callchain(sched, evsel, sample,
+							 thread);
+			printf("\n");
+		}
+	}
+
+	/* A preempted task is still runnable, it waits for the CPU from now */
+	tr->last_time = t;
+	tr->ready_to_run = prev_state ? 0 : t;
+
+out_put:
+	thread__put(thread);
+	return err;
+}
+
+static int timehist_wakeup_event(struct perf_sched *sched,
+				 struct perf_evsel *evsel,
+				 struct perf_sample *sample,
+				 struct machine *machine)
+{
+	const u32 pid = perf_evsel__intval(evsel, sample, "pid");
+	struct thread_runtime *tr;
+	struct thread *thread;
+	char comm[64];
+
+	thread = machine__findnew_thread(machine, -1, pid);
+	if (thread == NULL)
+		return -1;
+
+	tr = timehist_get_runtime(sched, thread, sample->cpu);
+	if (tr == NULL) {
+		thread__put(thread);
+		return -1;
+	}
+
+	if (!tr->ready_to_run)
+		tr->ready_to_run = sample->time;
+
+	if (sched->show_wakeups && !sched->summary_only) {
+		struct thread *waker;
+		char waker_comm[64];
+
+		waker = machine__findnew_thread(machine, sample->pid,
+						sample->tid);
+		printf("%15.6f [%04d]  %-30s  awakened: %s\n",
+		       (double)sample->time / NSEC_PER_SEC, sample->cpu,
+		       waker ? timehist_comm(waker, waker_comm,
+					     sizeof(waker_comm)) : "?",
+		       timehist_comm(thread, comm, sizeof(comm)));
+		thread__put(waker);
+	}
+
+	thread__put(thread);
+	return 0;
+}
+
+static int timehist_migrate_task_event(struct perf_sched *sched,
+				       struct perf_evsel *evsel,
+				       struct perf_sample *sample,
+				       struct machine *machine)
+{
+	const u32 pid = perf_evsel__intval(evsel, sample, "pid");
+	struct thread_runtime *tr;
+	struct thread *thread;
+
+	thread = machine__findnew_thread(machine, -1, pid);
+	if (thread == NULL)
+		return -1;
+
+	tr = timehist_get_runtime(sched, thread, sample->cpu);
+	if (tr)
+		tr->nr_migrations++;
+
+	thread__put(thread);
+	return tr ? 0 : -1;
+}
+
+static void timehist_print_hist(const char *name, u64 *hist)
+{
+	int i;
+
+	printf("  %-30s", name);
+	for (i = 0; i < TIMEHIST_NR_BUCKETS; i++)
+		printf(" %8" PRIu64, hist[i]);
+	printf("\n");
+}
+
+static void timehist_print_hist_header(const char *what)
+{
+	int i;
+
+	printf("\n  %-30s", what);
+	for (i = 0; i < TIMEHIST_NR_BUCKETS; i++)
+		printf(" %8s", timehist_bucket_names[i]);
+	printf("\n");
+}
+
+struct timehist_totals {
+	u64	nr_tasks;
+	u64	run_time;
+	bool	hist;
+};
+
+static int timehist_print_task(struct thread *thread, void *priv)
+{
+	struct timehist_totals *totals = priv;
+	struct thread_runtime *r = thread__priv(thread);
+	char comm[64];
+	double avg;
+
+	if (!r || !r->run_stats.n)
+		return 0;
+
+	timehist_comm(thread, comm, sizeof(comm));
+
+	if (totals->hist) {
+		timehist_print_hist(comm, r->delay_hist);
+		return 0;
+	}
+
+	totals->nr_tasks++;
+	totals->run_time += r->total_run_time;
+
+	avg = avg_stats(&r->run_stats);
+	printf("  %-30s %8" PRIu64 " %11.3f %10.3f %10.3f %10.3f %6.2f%% %10" PRIu64 " %10.3f\n",
+	       comm, (u64)r->run_stats.n,
+	       (double)r->total_run_time / NSEC_PER_MSEC,
+	       (double)r->run_stats.min / NSEC_PER_MSEC,
+	       avg / NSEC_PER_MSEC,
+	       (double)r->run_stats.max / NSEC_PER_MSEC,
+	       rel_stddev_stats(stddev_stats(&r->run_stats), avg),
+	       r->nr_migrations,
+	       (double)r->max_delay / NSEC_PER_MSEC);
+	return 0;
+}
+
+static void timehist_print_summary(struct perf_sched *sched,
+				   struct perf_session *session)
+{
+	struct machine *machine = &session->machines.host;
+	struct timehist_totals totals = { .hist = false, };
+	u64 span = sched->hist_time_end - sched->hist_time_start;
+	u64 idle_time = 0;
+	char name[32];
+	int cpu;
+
+	printf("\nRuntime summary\n");
+	printf("  %-30s %8s %11s %10s %10s %10s %7s %10s %10s\n",
+	       "comm[tid]", "sched-in", "run-time", "min-run", "avg-run",
+	       "max-run", "stddev", "migrations", "max-delay");
+	printf("  %-30s %8s %11s %10s %10s %10s %7s %10s %10s\n",
+	       "", "(count)", "(msec)", "(msec)", "(msec)", "(msec)", "",
+	       "", "(msec)");
+	printf("  %.30s %.8s %.11s %.10s %.10s %.10s %.7s %.10s %.10s\n",
+	       graph_dotted_line, graph_dotted_line, graph_dotted_line,
+	       graph_dotted_line, graph_dotted_line, graph_dotted_line,
+	       graph_dotted_line, graph_dotted_line, graph_dotted_line);
+
+	machine__for_each_thread(machine, timehist_print_task, &totals);
+
+	timehist_print_hist_header("Scheduling delay per task");
+	totals.hist = true;
+	machine__for_each_thread(machine, timehist_print_task, &totals);
+
+	printf("\nIdle stats:\n");
+	for (cpu = 0; cpu <= sched->max_cpu; cpu++) {
+		struct thread_runtime *r = &sched->hist_cpus[cpu].idle;
+
+		if (!r->run_stats.n)
+			continue;
+
+		idle_time += r->total_run_time;
+		printf("    CPU %4d idle for %12.3f msec", cpu,
+		       (double)r->total_run_time / NSEC_PER_MSEC);
+		if (span)
+			printf("  (%6.2f%%)",
+			       100.0 * r->total_run_time / span);
+		printf("\n");
+	}
+
+	timehist_print_hist_header("Scheduling delay per CPU");
+	for (cpu = 0; cpu <= sched->max_cpu; cpu++) {
+		scnprintf(name, sizeof(name), "CPU %d", cpu);
+		timehist_print_hist(name, sched->hist_cpus[cpu].delay_hist);
+	}
+
+	printf("\n    Total number of unique tasks: %" PRIu64 "\n",
+	       totals.nr_tasks);
+	printf("Total number of context switches: %" PRIu64 "\n",
+	       sched->hist_nr_switches);
+	printf("           Total run time (msec): %.3f\n",
+	       (double)totals.run_time / NSEC_PER_MSEC);
+	printf("          Total idle time (msec): %.3f\n",
+	       (double)idle_time / NSEC_PER_MSEC);
+
+	print_bad_events(sched);
+}
+
+static int perf_sched__timehist(struct perf_sched *sched)
+{
+	const struct perf_evsel_str_handler handlers[] = {
+		{ "sched:sched_switch",	      process_sched_switch_event, },
+		{ "sched:sched_wakeup",	      process_sched_wakeup_event, },
+		{ "sched:sched_wakeup_new",   process_sched_wakeup_event, },
+		{ "sched:sched_migrate_task", process_sched_migrate_task_event, },
+	};
+	struct perf_data_file file = {
+		.path = input_name,
+		.mode = PERF_DATA_MODE_READ,
+		.force = sched->force,
+	};
+	struct perf_session *session;
+	int err = -1;
+
+	sched->tool.mmap  = perf_event__process_mmap;
+	sched->tool.mmap2 = perf_event__process_mmap2;
+	sched->tool.exit  = perf_event__process_exit;
+
+	if (sched->summary_only)
+		sched->summary = true;
+
+	sched->hist_cpus = calloc(MAX_CPUS, sizeof(*sched->hist_cpus));
+	if (sched->hist_cpus == NULL)
+		return -ENOMEM;
+
+	session = perf_session__new(&file, false, &sched->tool);
+	if (session == NULL) {
+		err = -ENOMEM;
+		goto out_free;
+	}
+
+	symbol_conf.use_callchain = sched->show_callchain;
+	symbol__init(&session->header.env);
+
+	if (perf_session__set_tracepoints_handlers(session, handlers))
+		goto out_delete;
+
+	if (!perf_session__has_traces(session, "record -R"))
+		goto out_delete;
+
+	if (!perf_evlist__find_tracepoint_by_name(session->evlist,
+						  "sched:sched_switch")) {
+		pr_err("No sched_switch events found. Have you run 'perf sched record'?\n");
+		goto out_delete;
+	}
+
+	if (sched->show_callchain &&
+	    !(perf_evlist__first(session->evlist)->attr.sample_type &
+	      PERF_SAMPLE_CALLCHAIN))
+		sched->show_callchain = false;
+
+	sched->max_cpu = session->header.env.nr_cpus_online;
+	if (sched->max_cpu == 0 || sched->max_cpu > MAX_CPUS)
+		sched->max_cpu = MAX_CPUS;
+	sched->max_cpu--;
+
+	setup_pager();
+
+	if (!sched->summary_only)
+		timehist_header(sched);
+
+	err = perf_session__process_events(session);
+	if (err) {
+		pr_err("Failed to process events, error %d", err);
+		goto out_delete;
+	}
+
+	sched->nr_events      = session->evlist->stats.nr_events[0];
+	sched->nr_lost_events = session->evlist->stats.total_lost;
+	sched->nr_lost_chunks = session->evlist->stats.nr_events[PERF_RECORD_LOST];
+
+	if (sched->summary)
+		timehist_print_summary(sched, session);
+
+out_delete:
+	perf_session__delete(session);
+out_free:
+	zfree(&sched->hist_cpus);
+	return err;
+}
+
 static void setup_sorting(struct perf_sched *sched, const struct option *options,
 			  const char * const usage_msg[])
 {
@@ -1798,6 +2317,8 @@ int cmd_sched(int argc, const char **argv, const char *prefix __maybe_unused)
 		.next_shortname1      = 'A',
 		.next_shortname2      = '0',
 		.skip_merge           = 0,
+		.show_callchain	      = true,
+		.max_stack	      = 5,
 	};
 	const struct option latency_options[] = {
 	OPT_STRING('s', "sort", &sched.sort_order, "key[,key2...]",
@@ -1822,6 +2343,27 @@ int cmd_sched(int argc, const char **argv, const char *prefix __maybe_unused)
 	OPT_BOOLEAN('f', "force", &sched.force, "don't complain, do it"),
 	OPT_END()
 	};
+	const struct option timehist_options[] = {
+	OPT_STRING('k', "vmlinux", &symbol_conf.vmlinux_name,
+		   "file", "vmlinux pathname"),
+	OPT_STRING(0, "kallsyms", &symbol_conf.kallsyms_name,
+		   "file", "kallsyms pathname"),
+	OPT_BOOLEAN('g', "call-graph", &sched.show_callchain,
+		    "Display call chains if present (default on)"),
+	OPT_UINTEGER(0, "max-stack", &sched.max_stack,
+		     "Maximum number of functions to display backtrace."),
+	OPT_BOOLEAN('s', "summary", &sched.summary_only,
+		    "Show only the per-task and per-CPU summary"),
+	OPT_BOOLEAN('S', "with-summary", &sched.summary,
+		    "Show all events and the summary"),
+	OPT_BOOLEAN('w', "wakeups", &sched.show_wakeups, "Show wakeup events"),
+	OPT_INCR('v', "verbose", &verbose,
+		    "be more verbose (show symbol address, etc)"),
+	OPT_BOOLEAN('D', "dump-raw-trace", &dump_trace,
+		    "dump raw trace in ASCII"),
+	OPT_BOOLEAN('f', "force", &sched.force, "don't complain, do it"),
+	OPT_END()
+	};
 	const struct option sched_options[] = {
 	OPT_STRING('i', "input", &input_name, "file",
 		    "input file name"),
@@ -1839,8 +2381,13 @@ int cmd_sched(int argc, const char **argv, const char *prefix __maybe_unused)
 		"perf sched replay [<options>]",
 		NULL
 	};
+	const char * const timehist_usage[] = {
+		"perf sched timehist [<options>]",
+		NULL
+	};
 	const char *const sched_subcommands[] = { "record", "latency", "map",
-						  "replay", "script", NULL };
+						  "replay", "script",
+						  "timehist", NULL };
 	const char *sched_usage[] = {
 		NULL,
 		NULL
@@ -1859,6 +2406,11 @@ int cmd_sched(int argc, const char **argv, const char *prefix __maybe_unused)
 		.switch_event	    = replay_switch_event,
 		.fork_event	    = replay_fork_event,
 	};
+	struct trace_sched_handler timehist_ops  = {
+		.wakeup_event	    = timehist_wakeup_event,
+		.switch_event	    = timehist_switch_event,
+		.migrate_task_event = timehist_migrate_task_event,
+	};
 	unsigned int i;
 
 	for (i = 0; i < ARRAY_SIZE(sched.curr_pid); i++)
@@ -1898,6 +2450,15 @@ int cmd_sched(int argc, const char **argv, const char *prefix __maybe_unused)
 				usage_with_options(replay_usage, replay_options);
 		}
 		return perf_sched__replay(&sched);
+	} else if (!strcmp(argv[0], "timehist")) {
+		sched.tp_handler = &timehist_ops;
+		if (argc) {
+			argc = parse_options(argc, argv, timehist_options,
+					     timehist_usage, 0);
+			if (argc)
+				usage_with_options(timehist_usage, timehist_options);
+		}
+		return perf_sched__timehist(&sched);
 	} else {
 		usage_with_options(sched_usage, sched_options);
 	}
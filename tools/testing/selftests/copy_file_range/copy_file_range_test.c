@@ -0,0 +1,152 @@
+/*
+ * Smoke test for copy_file_range(): copy with explicit offsets and with
+ * the file positions, stop at the end of the source, and reject flags
+ * and destinations that cannot be written.
+ */
+#define _GNU_SOURCE
+#include <sys/syscall.h>
+#include <sys/types.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../kselftest.h"
+
+#define SRC_SIZE	65536
+
+static char src_buf[SRC_SIZE], dst_buf[SRC_SIZE];
+
+static ssize_t sys_copy_file_range(int fd_in, loff_t *off_in, int fd_out,
+				   loff_t *off_out, size_t len,
+				   unsigned int flags)
+{
+#ifdef __NR_copy_file_range
+	return syscall(__NR_copy_file_range, fd_in, off_in, fd_out, off_out,
+		       len, flags);
+#else
+	errno = ENOSYS;
+	return -1;
+#endif
+}
+
+static int tmpfile_open(void)
+{
+	char template[] = "./copy_file_range_test.XXXXXX";
+	int fd;
+
+	fd = mkstemp(template);
+	if (fd < 0) {
+		perror("copy_file_range: mkstemp");
+		exit(ksft_exit_fail());
+	}
+	unlink(template);
+	return fd;
+}
+
+static int check_dst(int fd, loff_t off, loff_t src_off, size_t len)
+{
+	if (pread(fd, dst_buf, len, off) != len ||
+	    memcmp(dst_buf, src_buf + src_off, len)) {
+		printf("copy_file_range: wrong data at offset %lld\n",
+		       (long long) off);
+		return 1;
+	}
+	return 0;
+}
+
+static int expect_error(const char *what, int fd_in, int fd_out,
+			unsigned int flags, int err)
+{
+	loff_t off_in = 0, off_out = 0;
+
+	if (sys_copy_file_range(fd_in, &off_in, fd_out, &off_out, 1,
+				flags) != -1 || errno != err) {
+		printf("copy_file_range: %s did not fail with %s\n", what,
+		       strerror(err));
+		return 1;
+	}
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	loff_t off_in, off_out;
+	char path[64];
+	int src, dst, fd, i, ret = 0;
+	ssize_t res;
+
+	for (i = 0; i < SRC_SIZE; i++)
+		src_buf[i] = i * 7;
+	src = tmpfile_open();
+	dst = tmpfile_open();
+	if (write(src, src_buf, SRC_SIZE) != SRC_SIZE) {
+		perror("copy_file_range: write");
+		return ksft_exit_fail();
+	}
+
+	/* explicit offsets are advanced, the file positions are not */
+	off_in = 4096;
+	off_out = 0;
+	res = sys_copy_file_range(src, &off_in, dst, &off_out, 8192, 0);
+	if (res < 0 && errno == ENOSYS) {
+		printf("copy_file_range: not supported, skipping\n");
+		return ksft_exit_skip();
+	}
+	if (res != 8192 || off_in != 4096 + 8192 || off_out != 8192 ||
+	    lseek(src, 0, SEEK_CUR) != SRC_SIZE ||
+	    lseek(dst, 0, SEEK_CUR) != 0) {
+		printf("copy_file_range: offset copy returned %zd\n", res);
+		ret = 1;
+	}
+	ret |= check_dst(dst, 0, 4096, 8192);
+
+	/* without offsets, the file positions are used and advanced */
+	lseek(src, 100, SEEK_SET);
+	lseek(dst, 8192, SEEK_SET);
+	res = sys_copy_file_range(src, NULL, dst, NULL, 1000, 0);
+	if (res != 1000 || lseek(src, 0, SEEK_CUR) != 1100 ||
+	    lseek(dst, 0, SEEK_CUR) != 8192 + 1000) {
+		printf("copy_file_range: position copy returned %zd\n", res);
+		ret = 1;
+	}
+	ret |= check_dst(dst, 8192, 100, 1000);
+
+	/* a copy running past the end of the source is short */
+	off_in = SRC_SIZE - 512;
+	off_out = 0;
+	res = sys_copy_file_range(src, &off_in, dst, &off_out, 4096, 0);
+	if (res != 512) {
+		printf("copy_file_range: copy past EOF returned %zd\n", res);
+		ret = 1;
+	}
+	ret |= check_dst(dst, 0, SRC_SIZE - 512, 512);
+
+	ret |= expect_error("non-zero flags", src, dst, 1, EINVAL);
+
+	fd = tmpfile_open();
+	if (fcntl(fd, F_SETFL, O_APPEND)) {
+		perror("copy_file_range: fcntl");
+		return ksft_exit_fail();
+	}
+	ret |= expect_error("an O_APPEND destination", src, fd, 0, EBADF);
+	close(fd);
+
+	snprintf(path, sizeof(path), "/proc/self/fd/%d", dst);
+	fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		perror("copy_file_range: open");
+		return ksft_exit_fail();
+	}
+	ret |= expect_error("a read-only destination", src, fd, 0, EBADF);
+	close(fd);
+	close(src);
+	close(dst);
+
+	if (ret)
+		return ksft_exit_fail();
+	printf("copy_file_range: tests done!\n");
+	return ksft_exit_pass();
+}
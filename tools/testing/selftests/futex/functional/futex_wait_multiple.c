@@ -0,0 +1,202 @@
+/******************************************************************************
+ *
+ *   This program is free software;  you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ * DESCRIPTION
+ *      Test FUTEX_WAIT_MULTIPLE: a value mismatch on any entry, a wakeup on
+ *      each entry returning its index, the absolute timeout, and the
+ *      rejection of a bad count or bad per-entry flags.
+ *
+ *****************************************************************************/
+
+#include <errno.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "futextest.h"
+#include "logging.h"
+
+#define NR_FUTEXES	4
+#define timeout_ns	100000
+
+static futex_t futexes[NR_FUTEXES];
+static struct futex_wait_block blocks[FUTEX_MULTIPLE_MAX_COUNT + 1];
+
+struct waiter_arg {
+	int res;
+	int err;
+};
+
+void usage(char *prog)
+{
+	printf("Usage: %s\n", prog);
+	printf("  -c	Use color\n");
+	printf("  -h	Display this help message\n");
+	printf("  -v L	Verbosity level: %d=QUIET %d=CRITICAL %d=INFO\n",
+	       VQUIET, VCRITICAL, VINFO);
+}
+
+/* Wait on futexes[0..count-1], all expected to be 0 */
+static void setup_blocks(int count)
+{
+	int i;
+
+	for (i = 0; i < count; i++) {
+		blocks[i].uaddr = (uintptr_t)&futexes[i % NR_FUTEXES];
+		blocks[i].val = 0;
+		blocks[i].flags = FUTEX_PRIVATE_FLAG;
+	}
+}
+
+static void *waiter(void *arg)
+{
+	struct waiter_arg *wa = arg;
+
+	wa->res = futex_wait_multiple(blocks, NR_FUTEXES, NULL,
+				      FUTEX_PRIVATE_FLAG);
+	wa->err = errno;
+	return NULL;
+}
+
+static int test_mismatch(void)
+{
+	int i, res, ret = RET_PASS;
+
+	for (i = 0; i < NR_FUTEXES; i++) {
+		setup_blocks(NR_FUTEXES);
+		futexes[i] = 1;
+		info("Value mismatch on entry %d\n", i);
+		res = futex_wait_multiple(blocks, NR_FUTEXES, NULL,
+					  FUTEX_PRIVATE_FLAG);
+		futexes[i] = 0;
+		if (res != -1 || errno != EWOULDBLOCK) {
+			fail("mismatch on entry %d returned %d (%s)\n", i, res,
+			     res < 0 ? strerror(errno) : "no error");
+			ret = RET_FAIL;
+		}
+	}
+	return ret;
+}
+
+static int test_wake(void)
+{
+	struct waiter_arg wa;
+	pthread_t thr;
+	int i, tries, ret = RET_PASS;
+
+	for (i = 0; i < NR_FUTEXES; i++) {
+		setup_blocks(NR_FUTEXES);
+		info("Wake on entry %d\n", i);
+		if (pthread_create(&thr, NULL, waiter, &wa)) {
+			error("pthread_create failed\n", errno);
+			return RET_ERROR;
+		}
+
+		/*
+		 * Retry until the waiter is queued and gets the wakeup, or
+		 * has given up on its own after a second.
+		 */
+		for (tries = 0; tries < 1000; tries++) {
+			if (futex_wake(&futexes[i], 1, FUTEX_PRIVATE_FLAG) > 0)
+				break;
+			usleep(1000);
+		}
+
+		pthread_join(thr, NULL);
+		if (wa.res != i) {
+			fail("wake on entry %d returned %d (%s)\n", i, wa.res,
+			     wa.res < 0 ? strerror(wa.err) : "no error");
+			ret = RET_FAIL;
+		}
+	}
+	return ret;
+}
+
+static int test_timeout(clockid_t clockid, int opflags)
+{
+	struct timespec to;
+	int res;
+
+	setup_blocks(NR_FUTEXES);
+	clock_gettime(clockid, &to);
+	to.tv_nsec += timeout_ns;
+	if (to.tv_nsec >= 1000000000) {
+		to.tv_sec++;
+		to.tv_nsec -= 1000000000;
+	}
+
+	info("Absolute timeout on clock %d\n", clockid);
+	res = futex_wait_multiple(blocks, NR_FUTEXES, &to,
+				  FUTEX_PRIVATE_FLAG | opflags);
+	if (res != -1 || errno != ETIMEDOUT) {
+		fail("timeout on clock %d returned %d (%s)\n", clockid, res,
+		     res < 0 ? strerror(errno) : "no error");
+		return RET_FAIL;
+	}
+	return RET_PASS;
+}
+
+static int test_einval(const char *what, int count)
+{
+	int res;
+
+	info("Rejecting %s\n", what);
+	res = futex_wait_multiple(blocks, count, NULL, FUTEX_PRIVATE_FLAG);
+	if (res != -1 || errno != EINVAL) {
+		fail("%s returned %d (%s)\n", what, res,
+		     res < 0 ? strerror(errno) : "no error");
+		return RET_FAIL;
+	}
+	return RET_PASS;
+}
+
+int main(int argc, char *argv[])
+{
+	int ret = RET_PASS;
+	int c;
+
+	while ((c = getopt(argc, argv, "cht:v:")) != -1) {
+		switch (c) {
+		case 'c':
+			log_color(1);
+			break;
+		case 'h':
+			usage(basename(argv[0]));
+			exit(0);
+		case 'v':
+			log_verbosity(atoi(optarg));
+			break;
+		default:
+			usage(basename(argv[0]));
+			exit(1);
+		}
+	}
+
+	printf("%s: Test FUTEX_WAIT_MULTIPLE\n", basename(argv[0]));
+
+	ret |= test_mismatch();
+	ret |= test_wake();
+	ret |= test_timeout(CLOCK_MONOTONIC, 0);
+	ret |= test_timeout(CLOCK_REALTIME, FUTEX_CLOCK_REALTIME);
+
+	setup_blocks(FUTEX_MULTIPLE_MAX_COUNT + 1);
+	ret |= test_einval("a count of 0", 0);
+	ret |= test_einval("a count above FUTEX_MULTIPLE_MAX_COUNT",
+			   FUTEX_MULTIPLE_MAX_COUNT + 1);
+
+	setup_blocks(NR_FUTEXES);
+	blocks[NR_FUTEXES - 1].flags |= FUTEX_CLOCK_REALTIME;
+	ret |= test_einval("per-entry flags other than FUTEX_PRIVATE_FLAG",
+			   NR_FUTEXES);
+
+	print_result(ret);
+	return ret;
+}
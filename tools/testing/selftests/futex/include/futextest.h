@@ -50,6 +50,15 @@ typedef volatile u_int32_t futex_t;
 #define FUTEX_CMP_REQUEUE_PI_PRIVATE	(FUTEX_CMP_REQUEUE_PI | \
 					 FUTEX_PRIVATE_FLAG)
 #endif
+#ifndef FUTEX_WAIT_MULTIPLE
+#define FUTEX_WAIT_MULTIPLE		13
+#define FUTEX_MULTIPLE_MAX_COUNT	128
+struct futex_wait_block {
+	__u64	uaddr;
+	__u32	val;
+	__u32	flags;
+};
+#endif
 
 /**
  * futex() - SYS_futex syscall wrapper
@@ -117,6 +126,23 @@ futex_wake_bitset(futex_t *uaddr, int nr_wake, u_int32_t bitset, int opflags)
 		     opflags);
 }
 
+/**
+ * futex_wait_multiple() - block on several futexes at once
+ * @blocks:	one futex_wait_block per futex
+ * @count:	number of entries in @blocks
+ * @timeout:	absolute timeout, CLOCK_MONOTONIC unless opflags has
+ *		FUTEX_CLOCK_REALTIME
+ *
+ * Returns the index of the futex that was woken.
+ */
+static inline int
+futex_wait_multiple(struct futex_wait_block *blocks, int count,
+		    struct timespec *timeout, int opflags)
+{
+	return futex(blocks, FUTEX_WAIT_MULTIPLE, count, timeout, NULL, 0,
+		     opflags);
+}
+
 /**
  * futex_lock_pi() - block on uaddr as a PI mutex
  * @detect:	whether (1) or not (0) to perform deadlock detection
@@ -0,0 +1,175 @@
+/*
+ * Smoke test for io_uring: set up a ring, map it, and run a NOP, a
+ * WRITEV and a READV through it.
+ */
+#define _GNU_SOURCE
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../kselftest.h"
+
+#ifndef __NR_io_uring_setup
+#define __NR_io_uring_setup	425
+#define __NR_io_uring_enter	426
+#endif
+
+#define RING_ENTRIES	4
+
+struct ring {
+	int fd;
+	unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+	unsigned *cq_head, *cq_tail, *cq_mask;
+	struct io_uring_sqe *sqes;
+	struct io_uring_cqe *cqes;
+};
+
+static int sys_io_uring_setup(unsigned int entries, struct io_uring_params *p)
+{
+	return syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int sys_io_uring_enter(int fd, unsigned int to_submit,
+			      unsigned int min_complete, unsigned int flags)
+{
+	return syscall(__NR_io_uring_enter, fd, to_submit, min_complete,
+		       flags, NULL, 0);
+}
+
+static int ring_setup(struct ring *ring)
+{
+	struct io_uring_params p;
+	void *sq, *cq;
+
+	memset(&p, 0, sizeof(p));
+	ring->fd = sys_io_uring_setup(RING_ENTRIES, &p);
+	if (ring->fd < 0)
+		return -1;
+
+	sq = mmap(NULL, p.sq_off.array + p.sq_entries * sizeof(unsigned),
+		  PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd,
+		  IORING_OFF_SQ_RING);
+	cq = mmap(NULL, p.cq_off.cqes +
+		  p.cq_entries * sizeof(struct io_uring_cqe),
+		  PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd,
+		  IORING_OFF_CQ_RING);
+	ring->sqes = mmap(NULL, p.sq_entries * sizeof(struct io_uring_sqe),
+			  PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+			  ring->fd, IORING_OFF_SQES);
+	if (sq == MAP_FAILED || cq == MAP_FAILED || ring->sqes == MAP_FAILED) {
+		perror("io_uring: mmap");
+		return -1;
+	}
+
+	ring->sq_head = sq + p.sq_off.head;
+	ring->sq_tail = sq + p.sq_off.tail;
+	ring->sq_mask = sq + p.sq_off.ring_mask;
+	ring->sq_array = sq + p.sq_off.array;
+	ring->cq_head = cq + p.cq_off.head;
+	ring->cq_tail = cq + p.cq_off.tail;
+	ring->cq_mask = cq + p.cq_off.ring_mask;
+	ring->cqes = cq + p.cq_off.cqes;
+	return 0;
+}
+
+/* Submit one sqe, wait for its completion and return the cqe result. */
+static int ring_submit_wait(struct ring *ring, __u8 opcode, int fd,
+			    struct iovec *iov, __u64 user_data)
+{
+	struct io_uring_sqe *sqe;
+	struct io_uring_cqe *cqe;
+	unsigned tail, head, index;
+	int res;
+
+	tail = *ring->sq_tail;
+	index = tail & *ring->sq_mask;
+	sqe = &ring->sqes[index];
+	memset(sqe, 0, sizeof(*sqe));
+	sqe->opcode = opcode;
+	sqe->fd = fd;
+	sqe->addr = (unsigned long) iov;
+	sqe->len = iov ? 1 : 0;
+	sqe->user_data = user_data;
+	ring->sq_array[index] = index;
+	__atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+
+	if (sys_io_uring_enter(ring->fd, 1, 1, IORING_ENTER_GETEVENTS) != 1) {
+		perror("io_uring: io_uring_enter");
+		return -EIO;
+	}
+
+	head = *ring->cq_head;
+	if (head == __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE)) {
+		printf("io_uring: no completion after io_uring_enter\n");
+		return -EIO;
+	}
+	cqe = &ring->cqes[head & *ring->cq_mask];
+	res = cqe->res;
+	if (cqe->user_data != user_data) {
+		printf("io_uring: user_data %llu, expected %llu\n",
+		       (unsigned long long) cqe->user_data,
+		       (unsigned long long) user_data);
+		res = -EIO;
+	}
+	__atomic_store_n(ring->cq_head, head + 1, __ATOMIC_RELEASE);
+	return res;
+}
+
+int main(int argc, char **argv)
+{
+	char template[] = "./io_uring_test.XXXXXX";
+	char wbuf[] = "io_uring", rbuf[sizeof(wbuf)];
+	struct iovec iov;
+	struct ring ring;
+	int fd, res;
+
+	if (ring_setup(&ring)) {
+		if (errno == ENOSYS) {
+			printf("io_uring: not supported, skipping\n");
+			return ksft_exit_skip();
+		}
+		perror("io_uring: io_uring_setup");
+		return ksft_exit_fail();
+	}
+
+	res = ring_submit_wait(&ring, IORING_OP_NOP, -1, NULL, 1);
+	if (res) {
+		printf("io_uring: NOP returned %d\n", res);
+		return ksft_exit_fail();
+	}
+
+	fd = mkstemp(template);
+	if (fd < 0) {
+		perror("io_uring: mkstemp");
+		return ksft_exit_fail();
+	}
+	unlink(template);
+
+	iov.iov_base = wbuf;
+	iov.iov_len = sizeof(wbuf);
+	res = ring_submit_wait(&ring, IORING_OP_WRITEV, fd, &iov, 2);
+	if (res != sizeof(wbuf)) {
+		printf("io_uring: WRITEV returned %d\n", res);
+		return ksft_exit_fail();
+	}
+
+	memset(rbuf, 0, sizeof(rbuf));
+	iov.iov_base = rbuf;
+	iov.iov_len = sizeof(rbuf);
+	res = ring_submit_wait(&ring, IORING_OP_READV, fd, &iov, 3);
+	if (res != sizeof(rbuf) || memcmp(rbuf, wbuf, sizeof(wbuf))) {
+		printf("io_uring: READV returned %d\n", res);
+		return ksft_exit_fail();
+	}
+
+	close(fd);
+	close(ring.fd);
+	printf("io_uring: tests done!\n");
+	return ksft_exit_pass();
+}
@@ -0,0 +1,129 @@
+/*
+ * Smoke test for rseq(): register a struct rseq, check that the kernel
+ * keeps its cpu_id up to date across migrations, check the errors for
+ * bad or conflicting registrations, and unregister it.
+ */
+#define _GNU_SOURCE
+#include <linux/rseq.h>
+#include <sys/syscall.h>
+#include <errno.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../kselftest.h"
+
+#define RSEQ_SIG	0x53053053
+
+static struct rseq rseq_area, rseq_other;
+
+static int sys_rseq(void *rseq, unsigned int rseq_len, int flags,
+		    unsigned int sig)
+{
+#ifdef __NR_rseq
+	return syscall(__NR_rseq, rseq, rseq_len, flags, sig);
+#else
+	errno = ENOSYS;
+	return -1;
+#endif
+}
+
+static int expect_error(const char *what, void *rseq, unsigned int len,
+			int flags, unsigned int sig, int err)
+{
+	if (sys_rseq(rseq, len, flags, sig) != -1 || errno != err) {
+		printf("rseq: %s did not fail with %s\n", what,
+		       strerror(err));
+		return 1;
+	}
+	return 0;
+}
+
+/* Move to each allowed CPU in turn and check that cpu_id follows. */
+static int test_cpu_id(void)
+{
+	cpu_set_t allowed, set;
+	int cpu, ret = 0;
+
+	if (sched_getaffinity(0, sizeof(allowed), &allowed)) {
+		perror("rseq: sched_getaffinity");
+		return 1;
+	}
+	for (cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+		if (!CPU_ISSET(cpu, &allowed))
+			continue;
+		CPU_ZERO(&set);
+		CPU_SET(cpu, &set);
+		if (sched_setaffinity(0, sizeof(set), &set)) {
+			perror("rseq: sched_setaffinity");
+			ret = 1;
+			break;
+		}
+		if (rseq_area.cpu_id != cpu ||
+		    rseq_area.cpu_id_start != cpu) {
+			printf("rseq: on cpu %d, cpu_id %u cpu_id_start %u\n",
+			       cpu, rseq_area.cpu_id,
+			       rseq_area.cpu_id_start);
+			ret = 1;
+		}
+	}
+	sched_setaffinity(0, sizeof(allowed), &allowed);
+	return ret;
+}
+
+int main(int argc, char **argv)
+{
+	unsigned int len = sizeof(struct rseq);
+	int ret = 0;
+
+	rseq_area.cpu_id = RSEQ_CPU_ID_UNINITIALIZED;
+	if (sys_rseq(&rseq_area, len, 0, RSEQ_SIG)) {
+		if (errno == ENOSYS) {
+			printf("rseq: not supported, skipping\n");
+			return ksft_exit_skip();
+		}
+		perror("rseq: register");
+		return ksft_exit_fail();
+	}
+	if ((int) rseq_area.cpu_id < 0) {
+		printf("rseq: cpu_id %d after registration\n",
+		       (int) rseq_area.cpu_id);
+		ret = 1;
+	}
+	ret |= test_cpu_id();
+
+	ret |= expect_error("a second registration", &rseq_area, len, 0,
+			    RSEQ_SIG, EBUSY);
+	ret |= expect_error("a registration at another address",
+			    &rseq_other, len, 0, RSEQ_SIG, EINVAL);
+	ret |= expect_error("a registration with another signature",
+			    &rseq_area, len, 0, RSEQ_SIG + 1, EPERM);
+	ret |= expect_error("unknown flags", &rseq_area, len, 2, RSEQ_SIG,
+			    EINVAL);
+	ret |= expect_error("unregistering with another signature",
+			    &rseq_area, len, RSEQ_FLAG_UNREGISTER,
+			    RSEQ_SIG + 1, EPERM);
+
+	if (sys_rseq(&rseq_area, len, RSEQ_FLAG_UNREGISTER, RSEQ_SIG)) {
+		perror("rseq: unregister");
+		return ksft_exit_fail();
+	}
+	if (rseq_area.cpu_id != (__u32) RSEQ_CPU_ID_UNINITIALIZED) {
+		printf("rseq: cpu_id %d after unregistration\n",
+		       (int) rseq_area.cpu_id);
+		ret = 1;
+	}
+
+	ret |= expect_error("a misaligned registration",
+			    (char *) &rseq_other + sizeof(__u32), len, 0,
+			    RSEQ_SIG, EINVAL);
+	ret |= expect_error("a registration with a bad length",
+			    &rseq_other, len - 1, 0, RSEQ_SIG, EINVAL);
+
+	if (ret)
+		return ksft_exit_fail();
+	printf("rseq: tests done!\n");
+	return ksft_exit_pass();
+}
@@ -27,6 +27,7 @@
 #include <string.h>
 #include <time.h>
 #include <linux/elf.h>
+#include <linux/audit.h>
 #include <sys/uio.h>
 #include <sys/utsname.h>
 #include <sys/fcntl.h>
@@ -998,6 +999,145 @@ TEST_F(precedence, trace_is_fourth_in_any_order)
 	EXPECT_EQ(-1, syscall(__NR_getpid));
 }
 
+/*
+ * The kernel skips the filters for syscalls that the whole filter chain
+ * allows based on the syscall number and arch alone.  These must still
+ * run the filters.
+ */
+TEST(cache_arg_dependent)
+{
+	struct sock_filter filter[] = {
+		BPF_STMT(BPF_LD|BPF_W|BPF_ABS,
+			offsetof(struct seccomp_data, nr)),
+		BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_K, __NR_read, 1, 0),
+		BPF_STMT(BPF_RET|BPF_K, SECCOMP_RET_ALLOW),
+		BPF_STMT(BPF_LD|BPF_W|BPF_ABS, syscall_arg(0)),
+		BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_K, 0x1234, 0, 1),
+		BPF_STMT(BPF_RET|BPF_K, SECCOMP_RET_ERRNO | E2BIG),
+		BPF_STMT(BPF_RET|BPF_K, SECCOMP_RET_ALLOW),
+	};
+	struct sock_fprog prog = {
+		.len = (unsigned short)ARRAY_SIZE(filter),
+		.filter = filter,
+	};
+	long ret;
+	int i;
+
+	ret = prctl(PR_SET_NO_NEW_PRIVS, 1, 0, 0, 0);
+	ASSERT_EQ(0, ret);
+
+	ret = prctl(PR_SET_SECCOMP, SECCOMP_MODE_FILTER, &prog);
+	ASSERT_EQ(0, ret);
+
+	/* An allowed read() must not make the next one allowed. */
+	for (i = 0; i < 2; i++) {
+		EXPECT_EQ(0, read(0, NULL, 0));
+		EXPECT_EQ(-1, read(0x1234, NULL, 0));
+		EXPECT_EQ(E2BIG, errno);
+	}
+}
+
+TEST(cache_stacked_filters)
+{
+	struct sock_filter deny_getpid[] = {
+		BPF_STMT(BPF_LD|BPF_W|BPF_ABS,
+			offsetof(struct seccomp_data, nr)),
+		BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_K, __NR_getpid, 0, 1),
+		BPF_STMT(BPF_RET|BPF_K, SECCOMP_RET_ERRNO | E2BIG),
+		BPF_STMT(BPF_RET|BPF_K, SECCOMP_RET_ALLOW),
+	};
+	struct sock_filter allow_all[] = {
+		BPF_STMT(BPF_RET|BPF_K, SECCOMP_RET_ALLOW),
+	};
+	struct sock_filter deny_getppid[] = {
+		BPF_STMT(BPF_LD|BPF_W|BPF_ABS,
+			offsetof(struct seccomp_data, nr)),
+		BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_K, __NR_getppid, 0, 1),
+		BPF_STMT(BPF_RET|BPF_K, SECCOMP_RET_ERRNO | ESRCH),
+		BPF_STMT(BPF_RET|BPF_K, SECCOMP_RET_ALLOW),
+	};
+	struct sock_fprog deny_getpid_prog = {
+		.len = (unsigned short)ARRAY_SIZE(deny_getpid),
+		.filter = deny_getpid,
+	};
+	struct sock_fprog allow_all_prog = {
+		.len = (unsigned short)ARRAY_SIZE(allow_all),
+		.filter = allow_all,
+	};
+	struct sock_fprog deny_getppid_prog = {
+		.len = (unsigned short)ARRAY_SIZE(deny_getppid),
+		.filter = deny_getppid,
+	};
+	pid_t parent = getppid();
+	long ret;
+
+	ret = prctl(PR_SET_NO_NEW_PRIVS, 1, 0, 0, 0);
+	ASSERT_EQ(0, ret);
+
+	ret = prctl(PR_SET_SECCOMP, SECCOMP_MODE_FILTER, &deny_getpid_prog);
+	ASSERT_EQ(0, ret);
+	EXPECT_EQ(parent, syscall(__NR_getppid));
+
+	/* A newer filter that allows everything must not hide the older. */
+	ret = prctl(PR_SET_SECCOMP, SECCOMP_MODE_FILTER, &allow_all_prog);
+	ASSERT_EQ(0, ret);
+	EXPECT_EQ(parent, syscall(__NR_getppid));
+	EXPECT_EQ(-1, syscall(__NR_getpid));
+	EXPECT_EQ(E2BIG, errno);
+
+	/* getppid() was allowed so far, but no longer. */
+	ret = prctl(PR_SET_SECCOMP, SECCOMP_MODE_FILTER, &deny_getppid_prog);
+	ASSERT_EQ(0, ret);
+	EXPECT_EQ(-1, syscall(__NR_getppid));
+	EXPECT_EQ(ESRCH, errno);
+	EXPECT_EQ(-1, syscall(__NR_getpid));
+	EXPECT_EQ(E2BIG, errno);
+}
+
+#if defined(__x86_64__)
+# define ARCH_NATIVE	AUDIT_ARCH_X86_64
+#elif defined(__i386__)
+# define ARCH_NATIVE	AUDIT_ARCH_I386
+#endif
+
+#ifdef ARCH_NATIVE
+TEST(cache_per_arch)
+{
+	struct sock_filter filter[] = {
+		BPF_STMT(BPF_LD|BPF_W|BPF_ABS,
+			offsetof(struct seccomp_data, arch)),
+		BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_K, ARCH_NATIVE, 0, 1),
+		BPF_STMT(BPF_RET|BPF_K, SECCOMP_RET_ALLOW),
+		BPF_STMT(BPF_RET|BPF_K, SECCOMP_RET_ERRNO | E2BIG),
+	};
+	struct sock_fprog prog = {
+		.len = (unsigned short)ARRAY_SIZE(filter),
+		.filter = filter,
+	};
+	pid_t parent = getppid();
+	long ret;
+
+	ret = prctl(PR_SET_NO_NEW_PRIVS, 1, 0, 0, 0);
+	ASSERT_EQ(0, ret);
+
+	ret = prctl(PR_SET_SECCOMP, SECCOMP_MODE_FILTER, &prog);
+	ASSERT_EQ(0, ret);
+
+	EXPECT_EQ(parent, syscall(__NR_getppid));
+#ifdef __x86_64__
+	/*
+	 * The same syscall through the 32-bit entry must not use the
+	 * native verdict.  getppid is 64 in the i386 table.
+	 */
+	asm volatile ("int $0x80"
+		      : "=a" (ret)
+		      : "0" (64L)
+		      : "memory", "r8", "r9", "r10", "r11");
+	EXPECT_EQ(-E2BIG, ret);
+#endif
+}
+#endif
+
 #ifndef PTRACE_O_TRACESECCOMP
 #define PTRACE_O_TRACESECCOMP	0x00000080
 #endif
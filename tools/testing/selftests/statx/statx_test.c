@@ -0,0 +1,138 @@
+/*
+ * Smoke test for statx(): the basic stats must match fstat(), by path,
+ * by fd with AT_EMPTY_PATH and on a symlink itself, and reserved mask
+ * bits and conflicting sync flags are rejected.
+ */
+#define _GNU_SOURCE
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
+#include <linux/stat.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../kselftest.h"
+
+#ifndef AT_STATX_SYNC_TYPE
+#define AT_STATX_SYNC_TYPE	0x6000
+#endif
+
+static int sys_statx(int dfd, const char *filename, unsigned int flags,
+		     unsigned int mask, struct statx *buffer)
+{
+#ifdef __NR_statx
+	return syscall(__NR_statx, dfd, filename, flags, mask, buffer);
+#else
+	errno = ENOSYS;
+	return -1;
+#endif
+}
+
+static int check_basic(const char *what, struct statx *stx, struct stat *st)
+{
+	if ((stx->stx_mask & STATX_BASIC_STATS) != STATX_BASIC_STATS) {
+		printf("statx: %s: stx_mask %#x lacks basic stats\n", what,
+		       stx->stx_mask);
+		return 1;
+	}
+	if (stx->stx_ino != st->st_ino || stx->stx_mode != st->st_mode ||
+	    stx->stx_nlink != st->st_nlink || stx->stx_uid != st->st_uid ||
+	    stx->stx_gid != st->st_gid || stx->stx_size != st->st_size ||
+	    stx->stx_blocks != st->st_blocks ||
+	    stx->stx_mtime.tv_sec != st->st_mtim.tv_sec ||
+	    stx->stx_mtime.tv_nsec != st->st_mtim.tv_nsec) {
+		printf("statx: %s: stats differ from fstat()\n", what);
+		return 1;
+	}
+	return 0;
+}
+
+static int expect_einval(const char *what, const char *path,
+			 unsigned int flags, unsigned int mask)
+{
+	struct statx stx;
+
+	if (sys_statx(AT_FDCWD, path, flags, mask, &stx) != -1 ||
+	    errno != EINVAL) {
+		printf("statx: %s did not fail with EINVAL\n", what);
+		return 1;
+	}
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	char path[] = "./statx_test.XXXXXX";
+	char link[sizeof(path) + 5];
+	struct statx stx;
+	struct stat st;
+	int fd, ret = 0;
+
+	fd = mkstemp(path);
+	if (fd < 0) {
+		perror("statx: mkstemp");
+		return ksft_exit_fail();
+	}
+	if (write(fd, path, sizeof(path)) != sizeof(path) || fstat(fd, &st)) {
+		perror("statx: write");
+		unlink(path);
+		return ksft_exit_fail();
+	}
+
+	if (sys_statx(AT_FDCWD, path, 0, STATX_BASIC_STATS, &stx)) {
+		if (errno == ENOSYS) {
+			printf("statx: not supported, skipping\n");
+			unlink(path);
+			return ksft_exit_skip();
+		}
+		perror("statx: statx by path");
+		ret = 1;
+	} else {
+		ret |= check_basic("by path", &stx, &st);
+	}
+
+	if (sys_statx(fd, "", AT_EMPTY_PATH, STATX_BASIC_STATS, &stx)) {
+		perror("statx: statx by fd");
+		ret = 1;
+	} else {
+		ret |= check_basic("by fd", &stx, &st);
+	}
+
+	snprintf(link, sizeof(link), "%s.lnk", path);
+	if (symlink(path, link)) {
+		perror("statx: symlink");
+		ret = 1;
+	} else {
+		if (sys_statx(AT_FDCWD, link, 0, STATX_BASIC_STATS, &stx)) {
+			perror("statx: statx through symlink");
+			ret = 1;
+		} else {
+			ret |= check_basic("through symlink", &stx, &st);
+		}
+		if (sys_statx(AT_FDCWD, link, AT_SYMLINK_NOFOLLOW,
+			      STATX_TYPE, &stx)) {
+			perror("statx: statx of symlink");
+			ret = 1;
+		} else if (!S_ISLNK(stx.stx_mode)) {
+			printf("statx: AT_SYMLINK_NOFOLLOW followed it\n");
+			ret = 1;
+		}
+		unlink(link);
+	}
+
+	ret |= expect_einval("STATX__RESERVED", path, 0, STATX__RESERVED);
+	ret |= expect_einval("both sync flags", path, AT_STATX_SYNC_TYPE,
+			     STATX_BASIC_STATS);
+
+	close(fd);
+	unlink(path);
+
+	if (ret)
+		return ksft_exit_fail();
+	printf("statx: tests done!\n");
+	return ksft_exit_pass();
+}
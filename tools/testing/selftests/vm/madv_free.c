@@ -0,0 +1,139 @@
+/*
+ * Test madvise(MADV_FREE) on anonymous memory.
+ *
+ * Freed pages may be discarded at any time until they are written
+ * again, so each page must read back either intact or all zeroes.  A
+ * write after MADV_FREE cancels the free for that page.  Mappings that
+ * are not private anonymous memory, and locked memory, are rejected.
+ */
+#define _GNU_SOURCE
+#include <sys/mman.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+
+#ifndef MADV_FREE
+#define MADV_FREE	8
+#endif
+
+#define NR_PAGES	64
+
+static unsigned long page_size;
+
+/* 1 if every byte of the page is @c */
+static int page_is(char *page, char c)
+{
+	unsigned long i;
+
+	for (i = 0; i < page_size; i++)
+		if (page[i] != c)
+			return 0;
+	return 1;
+}
+
+static int test_free_private(void)
+{
+	unsigned long nr, discarded = 0;
+	char *map;
+	int ret = 1;
+
+	map = mmap(NULL, NR_PAGES * page_size, PROT_READ | PROT_WRITE,
+		   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (map == MAP_FAILED) {
+		perror("mmap");
+		return 1;
+	}
+	memset(map, 0xa5, NR_PAGES * page_size);
+
+	if (madvise(map, NR_PAGES * page_size, MADV_FREE)) {
+		perror("madvise(MADV_FREE)");
+		goto out;
+	}
+	for (nr = 0; nr < NR_PAGES; nr++) {
+		char *page = map + nr * page_size;
+
+		if (page_is(page, 0)) {
+			discarded++;
+		} else if (!page_is(page, 0xa5)) {
+			printf("page %lu is neither intact nor discarded\n",
+			       nr);
+			goto out;
+		}
+	}
+	printf("%lu of %d freed pages discarded\n", discarded, NR_PAGES);
+
+	/* redirtying the pages cancels the free */
+	if (madvise(map, NR_PAGES * page_size, MADV_FREE)) {
+		perror("madvise(MADV_FREE)");
+		goto out;
+	}
+	memset(map, 0x5a, NR_PAGES * page_size);
+	for (nr = 0; nr < NR_PAGES; nr++) {
+		if (!page_is(map + nr * page_size, 0x5a)) {
+			printf("page %lu lost a write made after MADV_FREE\n",
+			       nr);
+			goto out;
+		}
+	}
+	ret = 0;
+out:
+	munmap(map, NR_PAGES * page_size);
+	return ret;
+}
+
+static int expect_einval(const char *what, char *map)
+{
+	if (!madvise(map, NR_PAGES * page_size, MADV_FREE)) {
+		printf("MADV_FREE accepted %s\n", what);
+		return 1;
+	}
+	if (errno != EINVAL) {
+		printf("MADV_FREE on %s: expected EINVAL, got %s\n", what,
+		       strerror(errno));
+		return 1;
+	}
+	return 0;
+}
+
+static int test_free_einval(void)
+{
+	char *map;
+	int ret = 0;
+
+	map = mmap(NULL, NR_PAGES * page_size, PROT_READ | PROT_WRITE,
+		   MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (map == MAP_FAILED) {
+		perror("mmap");
+		return 1;
+	}
+	ret |= expect_einval("shared anonymous memory", map);
+	munmap(map, NR_PAGES * page_size);
+
+	map = mmap(NULL, NR_PAGES * page_size, PROT_READ | PROT_WRITE,
+		   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (map == MAP_FAILED) {
+		perror("mmap");
+		return 1;
+	}
+	if (mlock(map, NR_PAGES * page_size)) {
+		printf("Cannot mlock, skipping locked memory test\n");
+	} else {
+		ret |= expect_einval("locked memory", map);
+	}
+	munmap(map, NR_PAGES * page_size);
+
+	return ret;
+}
+
+int main(int argc, char **argv)
+{
+	int ret = 0;
+
+	page_size = sysconf(_SC_PAGE_SIZE);
+
+	ret |= test_free_private();
+	ret |= test_free_einval();
+	return ret;
+}
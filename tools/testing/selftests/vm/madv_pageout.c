@@ -0,0 +1,280 @@
+/*
+ * Test madvise(MADV_COLD), madvise(MADV_PAGEOUT) and process_madvise().
+ *
+ * Both hints are non-destructive: the advised memory must read back
+ * unchanged.  MADV_PAGEOUT on a clean file mapping drops the pages from
+ * the page cache, which mincore() can see.  process_madvise() applies
+ * the hints to another process through an open /proc/<pid> directory.
+ */
+#define _GNU_SOURCE
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <sys/vfs.h>
+#include <sys/wait.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+
+#ifndef MADV_COLD
+#define MADV_COLD	20
+#endif
+
+#ifndef MADV_PAGEOUT
+#define MADV_PAGEOUT	21
+#endif
+
+#ifndef __NR_process_madvise
+#define __NR_process_madvise	440
+#endif
+
+#ifndef TMPFS_MAGIC
+#define TMPFS_MAGIC	0x01021994
+#endif
+
+#define NR_PAGES	64
+
+static unsigned long page_size;
+
+static ssize_t process_madvise_(int pidfd, const struct iovec *vec,
+				size_t vlen, int behavior, unsigned int flags)
+{
+	return syscall(__NR_process_madvise, pidfd, vec, vlen, behavior,
+		       flags);
+}
+
+static char *map_anon(void)
+{
+	char *map;
+
+	map = mmap(NULL, NR_PAGES * page_size, PROT_READ | PROT_WRITE,
+		   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (map == MAP_FAILED) {
+		perror("mmap");
+		return NULL;
+	}
+	memset(map, 0xa5, NR_PAGES * page_size);
+	return map;
+}
+
+static int check_anon(char *map, const char *what)
+{
+	unsigned long i;
+
+	for (i = 0; i < NR_PAGES * page_size; i++) {
+		if (map[i] != (char)0xa5) {
+			printf("%s changed the contents at offset %lu\n",
+			       what, i);
+			return 1;
+		}
+	}
+	return 0;
+}
+
+static int test_anon(int behavior, const char *what)
+{
+	char *map;
+	int ret = 1;
+
+	map = map_anon();
+	if (!map)
+		return 1;
+	if (madvise(map, NR_PAGES * page_size, behavior)) {
+		printf("%s: %s\n", what, strerror(errno));
+		goto out;
+	}
+	ret = check_anon(map, what);
+out:
+	munmap(map, NR_PAGES * page_size);
+	return ret;
+}
+
+static int test_pageout_file(void)
+{
+	char template[] = "./madv_pageout.XXXXXX";
+	unsigned char vec[NR_PAGES];
+	unsigned long nr, resident;
+	struct statfs sfs;
+	char *buf, *map;
+	int fd, tries, ret = 1;
+
+	fd = mkstemp(template);
+	if (fd < 0) {
+		perror("mkstemp");
+		return 1;
+	}
+	unlink(template);
+
+	buf = malloc(NR_PAGES * page_size);
+	if (!buf) {
+		perror("malloc");
+		goto out_close;
+	}
+	memset(buf, 0xa5, NR_PAGES * page_size);
+	if (write(fd, buf, NR_PAGES * page_size) != NR_PAGES * page_size ||
+	    fsync(fd)) {
+		perror("write");
+		goto out_free;
+	}
+
+	map = mmap(NULL, NR_PAGES * page_size, PROT_READ, MAP_SHARED, fd, 0);
+	if (map == MAP_FAILED) {
+		perror("mmap");
+		goto out_free;
+	}
+	if (check_anon(map, "writing the file"))
+		goto out_unmap;
+
+	/*
+	 * Pages still sitting in another CPU's LRU add batch cannot be
+	 * isolated yet, so give a fully resident file a few more tries.
+	 */
+	for (tries = 0; tries < 10; tries++) {
+		if (madvise(map, NR_PAGES * page_size, MADV_PAGEOUT)) {
+			printf("MADV_PAGEOUT on a file: %s\n",
+			       strerror(errno));
+			goto out_unmap;
+		}
+		if (mincore(map, NR_PAGES * page_size, vec)) {
+			perror("mincore");
+			goto out_unmap;
+		}
+		for (resident = 0, nr = 0; nr < NR_PAGES; nr++)
+			resident += vec[nr] & 1;
+		if (resident < NR_PAGES)
+			break;
+		usleep(10000);
+	}
+	printf("%lu of %d paged out file pages resident\n", resident,
+	       NR_PAGES);
+
+	/* shmem pages only go out to swap, which may not exist */
+	if (!fstatfs(fd, &sfs) && sfs.f_type != TMPFS_MAGIC &&
+	    resident == NR_PAGES) {
+		printf("MADV_PAGEOUT left the whole file resident\n");
+		goto out_unmap;
+	}
+	ret = check_anon(map, "MADV_PAGEOUT on a file");
+out_unmap:
+	munmap(map, NR_PAGES * page_size);
+out_free:
+	free(buf);
+out_close:
+	close(fd);
+	return ret;
+}
+
+static int test_process_madvise(void)
+{
+	struct iovec vec[2];
+	char path[64];
+	char *map;
+	int pidfd, status, pipefd[2], ret = 1;
+	ssize_t res;
+	pid_t pid;
+	char c;
+
+	map = map_anon();
+	if (!map)
+		return 1;
+	if (pipe(pipefd)) {
+		perror("pipe");
+		goto out_unmap;
+	}
+
+	/* the child shares the layout, so the same ranges are valid */
+	pid = fork();
+	if (pid < 0) {
+		perror("fork");
+		goto out_pipe;
+	}
+	if (!pid) {
+		/* wait for the parent to be done with us */
+		close(pipefd[1]);
+		if (read(pipefd[0], &c, 1) < 0)
+			_exit(1);
+		_exit(check_anon(map, "process_madvise"));
+	}
+	close(pipefd[0]);
+	pipefd[0] = -1;
+
+	snprintf(path, sizeof(path), "/proc/%d", pid);
+	pidfd = open(path, O_RDONLY | O_DIRECTORY);
+	if (pidfd < 0) {
+		perror("open");
+		goto out_wait;
+	}
+
+	vec[0].iov_base = map;
+	vec[0].iov_len = NR_PAGES / 2 * page_size;
+	vec[1].iov_base = map + NR_PAGES / 2 * page_size;
+	vec[1].iov_len = NR_PAGES / 2 * page_size;
+
+	res = process_madvise_(pidfd, vec, 2, MADV_COLD, 0);
+	if (res < 0 && errno == EPERM) {
+		printf("process_madvise needs CAP_SYS_NICE, skipping test\n");
+		ret = 0;
+		goto out_close;
+	}
+	if (res != NR_PAGES * page_size) {
+		printf("process_madvise(MADV_COLD) returned %zd (%s)\n", res,
+		       res < 0 ? strerror(errno) : "short");
+		goto out_close;
+	}
+	res = process_madvise_(pidfd, vec, 2, MADV_PAGEOUT, 0);
+	if (res != NR_PAGES * page_size) {
+		printf("process_madvise(MADV_PAGEOUT) returned %zd (%s)\n",
+		       res, res < 0 ? strerror(errno) : "short");
+		goto out_close;
+	}
+
+	res = process_madvise_(pidfd, vec, 2, MADV_DONTNEED, 0);
+	if (res != -1 || errno != EINVAL) {
+		printf("process_madvise accepted a destructive hint\n");
+		goto out_close;
+	}
+	res = process_madvise_(pidfd, vec, 2, MADV_COLD, 1);
+	if (res != -1 || errno != EINVAL) {
+		printf("process_madvise accepted unknown flags\n");
+		goto out_close;
+	}
+	ret = 0;
+
+out_close:
+	close(pidfd);
+out_wait:
+	/* closing the pipe lets the child check its memory and exit */
+	close(pipefd[1]);
+	pipefd[1] = -1;
+	if (waitpid(pid, &status, 0) != pid) {
+		perror("waitpid");
+		ret = 1;
+	} else if (!WIFEXITED(status) || WEXITSTATUS(status)) {
+		ret = 1;
+	}
+out_pipe:
+	if (pipefd[0] >= 0)
+		close(pipefd[0]);
+	if (pipefd[1] >= 0)
+		close(pipefd[1]);
+out_unmap:
+	munmap(map, NR_PAGES * page_size);
+	return ret;
+}
+
+int main(int argc, char **argv)
+{
+	int ret = 0;
+
+	page_size = sysconf(_SC_PAGE_SIZE);
+
+	ret |= test_anon(MADV_COLD, "MADV_COLD");
+	ret |= test_anon(MADV_PAGEOUT, "MADV_PAGEOUT");
+	ret |= test_pageout_file();
+	ret |= test_process_madvise();
+	return ret;
+}
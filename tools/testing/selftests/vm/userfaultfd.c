@@ -46,6 +46,12 @@
  *
  * # 10MiB-~6GiB 999 bounces, continue forever unless an error triggers
  * while ./userfaultfd $[RANDOM % 6000 + 10] 999; do true; done
+ *
+ * After the bounces a last write protect pass registers area_dst in
+ * UFFDIO_REGISTER_MODE_WP, write protects it with UFFDIO_WRITEPROTECT
+ * and writes every page once: reads must not fault, and each write
+ * must raise exactly one UFFD_PAGEFAULT_FLAG_WP fault, resolved by
+ * removing the protection of that page.
  */
 
 #define _GNU_SOURCE
@@ -343,6 +349,40 @@ static void *background_thread(void *arg)
 	return NULL;
 }
 
+static void *uffd_wp_thread(void *arg)
+{
+	unsigned long *wp_faults = (unsigned long *) arg;
+	struct uffdio_writeprotect uffdio_wp;
+	struct uffd_msg msg;
+	int ret;
+
+	for (;;) {
+		ret = read(uffd, &msg, sizeof(msg));
+		if (ret != sizeof(msg)) {
+			if (ret < 0)
+				perror("blocking read error"), exit(1);
+			else
+				fprintf(stderr, "short read\n"), exit(1);
+		}
+		if (msg.event != UFFD_EVENT_PAGEFAULT)
+			fprintf(stderr, "unexpected msg event %u\n",
+				msg.event), exit(1);
+		if (!(msg.arg.pagefault.flags & UFFD_PAGEFAULT_FLAG_WP) ||
+		    !(msg.arg.pagefault.flags & UFFD_PAGEFAULT_FLAG_WRITE))
+			fprintf(stderr, "unexpected fault flags %Lx\n",
+				msg.arg.pagefault.flags), exit(1);
+		/* count it before the wakeup lets the writer go on */
+		(*wp_faults)++;
+		uffdio_wp.range.start = msg.arg.pagefault.address &
+					~(page_size-1);
+		uffdio_wp.range.len = page_size;
+		uffdio_wp.mode = 0;
+		if (ioctl(uffd, UFFDIO_WRITEPROTECT, &uffdio_wp))
+			perror("UFFDIO_WRITEPROTECT unprotect"), exit(1);
+	}
+	return NULL;
+}
+
 static int stress(unsigned long *userfaults)
 {
 	unsigned long cpu;
@@ -606,6 +646,98 @@ static int userfaultfd_stress(void)
 	return err;
 }
 
+static int userfaultfd_wp_test(void)
+{
+	struct uffdio_register uffdio_register;
+	struct uffdio_writeprotect uffdio_wp;
+	struct uffdio_api uffdio_api;
+	volatile unsigned long wp_faults = 0;
+	unsigned long nr;
+	pthread_t uffd_thread;
+
+	close(uffd);
+	uffd = syscall(__NR_userfaultfd, O_CLOEXEC);
+	if (uffd < 0) {
+		perror("userfaultfd");
+		return 1;
+	}
+	uffdio_api.api = UFFD_API;
+	uffdio_api.features = UFFD_FEATURE_PAGEFAULT_FLAG_WP;
+	if (ioctl(uffd, UFFDIO_API, &uffdio_api)) {
+		fprintf(stderr, "UFFDIO_API\n");
+		return 1;
+	}
+	if (!(uffdio_api.features & UFFD_FEATURE_PAGEFAULT_FLAG_WP)) {
+		printf("skip: write protect not supported on this arch\n");
+		return 0;
+	}
+
+	printf("write protect: ");
+	fflush(stdout);
+
+	/* only present ptes can be write protected */
+	for (nr = 0; nr < nr_pages; nr++)
+		*area_count(area_dst, nr) = count_verify[nr] = 1;
+
+	uffdio_register.range.start = (unsigned long) area_dst;
+	uffdio_register.range.len = nr_pages * page_size;
+	uffdio_register.mode = UFFDIO_REGISTER_MODE_WP;
+	if (ioctl(uffd, UFFDIO_REGISTER, &uffdio_register)) {
+		fprintf(stderr, "register failure\n");
+		return 1;
+	}
+	if (!(uffdio_register.ioctls & (1 << _UFFDIO_WRITEPROTECT))) {
+		fprintf(stderr, "missing UFFDIO_WRITEPROTECT ioctl\n");
+		return 1;
+	}
+
+	uffdio_wp.range = uffdio_register.range;
+	uffdio_wp.mode = UFFDIO_WRITEPROTECT_MODE_WP;
+	if (ioctl(uffd, UFFDIO_WRITEPROTECT, &uffdio_wp)) {
+		perror("UFFDIO_WRITEPROTECT");
+		return 1;
+	}
+
+	if (pthread_create(&uffd_thread, &attr, uffd_wp_thread,
+			   (void *) &wp_faults))
+		return 1;
+
+	for (nr = 0; nr < nr_pages; nr++)
+		if (*area_count(area_dst, nr) != count_verify[nr])
+			fprintf(stderr, "page_nr %lu wrong count %Lu %Lu\n",
+				nr, *area_count(area_dst, nr),
+				count_verify[nr]), exit(1);
+	if (wp_faults) {
+		fprintf(stderr, "read faulted on write protected memory\n");
+		return 1;
+	}
+
+	for (nr = 0; nr < nr_pages; nr++)
+		*area_count(area_dst, nr) = ++count_verify[nr];
+
+	if (pthread_cancel(uffd_thread))
+		return 1;
+	if (pthread_join(uffd_thread, NULL))
+		return 1;
+
+	if (ioctl(uffd, UFFDIO_UNREGISTER, &uffdio_register.range)) {
+		fprintf(stderr, "unregister failure\n");
+		return 1;
+	}
+
+	printf("wp faults: %lu\n", wp_faults);
+	if (wp_faults != nr_pages) {
+		fprintf(stderr, "expected %lu wp faults\n", nr_pages);
+		return 1;
+	}
+	for (nr = 0; nr < nr_pages; nr++)
+		if (*area_count(area_dst, nr) != count_verify[nr])
+			fprintf(stderr, "page_nr %lu wrong count %Lu %Lu\n",
+				nr, *area_count(area_dst, nr),
+				count_verify[nr]), exit(1);
+	return 0;
+}
+
 int main(int argc, char **argv)
 {
 	if (argc < 3)
@@ -629,7 +761,9 @@ int main(int argc, char **argv)
 	nr_pages = nr_pages_per_cpu * nr_cpus;
 	printf("nr_pages: %lu, nr_pages_per_cpu: %lu\n",
 	       nr_pages, nr_pages_per_cpu);
-	return userfaultfd_stress();
+	if (userfaultfd_stress())
+		return 1;
+	return userfaultfd_wp_test();
 }
 
 #else /* __NR_userfaultfd */
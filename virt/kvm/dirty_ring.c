@@ -0,0 +1,180 @@
+/*
+ * KVM dirty ring
+ *
+ * Each vcpu owns a ring of struct kvm_dirty_gfn shared with userspace.
+ * The vcpu is the only producer; userspace collects the entries in order
+ * and KVM_RESET_DIRTY_RINGS, running under slots_lock, reclaims them.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2.  See
+ * the COPYING file in the top-level directory.
+ */
+
+#include <linux/kvm_host.h>
+#include <linux/kvm.h>
+#include <linux/vmalloc.h>
+#include <linux/kvm_dirty_ring.h>
+
+static u32 kvm_dirty_ring_used(struct kvm_dirty_ring *ring)
+{
+	/* Pairs with the release in kvm_dirty_ring_reset() */
+	return ACCESS_ONCE(ring->dirty_index) -
+	       smp_load_acquire(&ring->reset_index);
+}
+
+bool kvm_dirty_ring_soft_full(struct kvm_dirty_ring *ring)
+{
+	return kvm_dirty_ring_used(ring) >= ring->soft_limit;
+}
+
+static bool kvm_dirty_ring_full(struct kvm_dirty_ring *ring)
+{
+	return kvm_dirty_ring_used(ring) >= ring->size;
+}
+
+int kvm_dirty_ring_alloc(struct kvm_dirty_ring *ring, int index, u32 size)
+{
+	ring->dirty_gfns = vzalloc(size);
+	if (!ring->dirty_gfns)
+		return -ENOMEM;
+
+	ring->size = size / sizeof(struct kvm_dirty_gfn);
+	ring->soft_limit = ring->size - KVM_DIRTY_RING_RSVD_ENTRIES;
+	ring->dirty_index = 0;
+	ring->reset_index = 0;
+	ring->index = index;
+
+	return 0;
+}
+
+void kvm_dirty_ring_free(struct kvm_dirty_ring *ring)
+{
+	vfree(ring->dirty_gfns);
+	ring->dirty_gfns = NULL;
+}
+
+struct page *kvm_dirty_ring_get_page(struct kvm_dirty_ring *ring, u32 offset)
+{
+	return vmalloc_to_page((void *)ring->dirty_gfns + offset * PAGE_SIZE);
+}
+
+/*
+ * Must be called by the vcpu owning @ring.  Returns false if the ring is
+ * full, which only happens if the vcpu kept running past the soft limit
+ * for longer than the reserved entries allow.
+ */
+bool kvm_dirty_ring_push(struct kvm_dirty_ring *ring, u32 slot, u64 offset)
+{
+	struct kvm_dirty_gfn *entry;
+
+	if (kvm_dirty_ring_full(ring))
+		return false;
+
+	entry = &ring->dirty_gfns[ring->dirty_index & (ring->size - 1)];
+	entry->slot = slot;
+	entry->offset = offset;
+	/* Publish slot and offset before userspace can see the flag */
+	smp_store_release(&entry->flags, KVM_DIRTY_GFN_F_DIRTY);
+	WRITE_ONCE(ring->dirty_index, ring->dirty_index + 1);
+
+	return true;
+}
+
+/*
+ * Write protect @mask pages starting at @offset in @slot again, so that
+ * the next write to them is logged.  Entries may refer to slots that
+ * have been deleted or resized since they were pushed.
+ */
+static void kvm_reset_dirty_gfn(struct kvm *kvm, u32 slot, u64 offset,
+				unsigned long mask)
+{
+	struct kvm_memory_slot *memslot;
+	int as_id, id;
+
+	as_id = slot >> 16;
+	id = (u16)slot;
+
+	if (!mask || as_id >= KVM_ADDRESS_SPACE_NUM || id >= KVM_USER_MEM_SLOTS)
+		return;
+
+	memslot = id_to_memslot(__kvm_memslots(kvm, as_id), id);
+	if (!memslot->dirty_bitmap ||
+	    offset + __fls(mask) >= memslot->npages)
+		return;
+
+	KVM_MMU_READ_LOCK(kvm);
+	kvm_arch_mmu_enable_log_dirty_pt_masked(kvm, memslot, offset, mask);
+	KVM_MMU_READ_UNLOCK(kvm);
+}
+
+/*
+ * Reclaim the entries userspace has marked with KVM_DIRTY_GFN_F_RESET,
+ * write protecting their pages in batches of up to BITS_PER_LONG pages
+ * of the same slot.  Returns the number of entries reclaimed.
+ */
+int kvm_dirty_ring_reset(struct kvm *kvm, struct kvm_dirty_ring *ring)
+{
+	struct kvm_dirty_gfn *entry;
+	u32 cur_slot = 0, next_slot;
+	u64 cur_offset = 0, next_offset;
+	unsigned long mask = 0;
+	int count = 0;
+
+	for (;;) {
+		entry = &ring->dirty_gfns[ring->reset_index & (ring->size - 1)];
+
+		if (!(smp_load_acquire(&entry->flags) & KVM_DIRTY_GFN_F_RESET))
+			break;
+
+		next_slot = ACCESS_ONCE(entry->slot);
+		next_offset = ACCESS_ONCE(entry->offset);
+
+		/* Clear the entry before handing it back to the producer */
+		entry->flags = 0;
+		smp_store_release(&ring->reset_index, ring->reset_index + 1);
+		count++;
+
+		/* Coalesce runs of nearby pages in the same slot */
+		if (mask && next_slot == cur_slot) {
+			s64 delta = next_offset - cur_offset;
+
+			if (delta >= 0 && delta < BITS_PER_LONG) {
+				mask |= 1ul << delta;
+				continue;
+			}
+
+			/* Walking backwards, as long as no bit falls off */
+			if (delta < 0 && delta > -BITS_PER_LONG &&
+			    (mask << -delta >> -delta) == mask) {
+				cur_offset = next_offset;
+				mask = (mask << -delta) | 1;
+				continue;
+			}
+		}
+
+		kvm_reset_dirty_gfn(kvm, cur_slot, cur_offset, mask);
+		cur_slot = next_slot;
+		cur_offset = next_offset;
+		mask = 1;
+	}
+
+	kvm_reset_dirty_gfn(kvm, cur_slot, cur_offset, mask);
+
+	return count;
+}
+
+/*
+ * Called before entering the guest.  The request is kept pending until
+ * userspace has reset enough entries, so the vcpu exits again right
+ * away if it is re-entered with a ring that is still soft-full.
+ */
+bool kvm_dirty_ring_check_request(struct kvm_vcpu *vcpu)
+{
+	if (kvm_check_request(KVM_REQ_DIRTY_RING_SOFT_FULL, vcpu) &&
+	    kvm_dirty_ring_soft_full(&vcpu->dirty_ring)) {
+		kvm_make_request(KVM_REQ_DIRTY_RING_SOFT_FULL, vcpu);
+		vcpu->run->exit_reason = KVM_EXIT_DIRTY_RING_FULL;
+		return true;
+	}
+
+	return false;
+}